@@ -30,6 +30,7 @@
 
 #define VM_STAT(x) { #x, offsetof(struct kvm, stat.x), KVM_STAT_VM }
 #define VCPU_STAT(x) { #x, offsetof(struct kvm_vcpu, stat.x), KVM_STAT_VCPU }
+#define VCPU_STAT_U64(x) { #x, offsetof(struct kvm_vcpu, stat.x), KVM_STAT_VCPU_U64 }
 
 struct kvm_stats_debugfs_item debugfs_entries[] = {
 	VCPU_STAT(hvc_exit_stat),
@@ -38,6 +39,8 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	VCPU_STAT(mmio_exit_user),
 	VCPU_STAT(mmio_exit_kernel),
 	VCPU_STAT(exits),
+	VCPU_STAT_U64(halt_poll_success_ns),
+	VCPU_STAT_U64(halt_poll_fail_ns),
 	{ NULL }
 };
 
@@ -64,6 +64,7 @@ struct jit_ctx {
 	int epilogue_offset;
 	int *offset;
 	u32 *image;
+	bool *func_start; /* insns called by BPF_PSEUDO_CALL, or NULL */
 };
 
 static inline void emit(const u32 insn, struct jit_ctx *ctx)
@@ -498,6 +499,16 @@ emit_cond_jmp:
 		const u8 r0 = bpf2a64[BPF_REG_0];
 		const u64 func = (u64)__bpf_call_base + imm;
 
+		if (insn->src_reg == BPF_PSEUDO_CALL) {
+			/* to the prologue of the called bpf function,
+			 * R0 is left in place by its epilogue
+			 */
+			jmp_offset = bpf2a64_offset(i + imm, i, ctx);
+			check_imm26(jmp_offset);
+			emit(A64_BL(jmp_offset), ctx);
+			break;
+		}
+
 		emit_a64_mov_i64(tmp, func, ctx);
 		emit(A64_PUSH(A64_FP, A64_LR, A64_SP), ctx);
 		emit(A64_MOV(1, A64_FP, A64_SP), ctx);
@@ -700,6 +711,10 @@ static int build_body(struct jit_ctx *ctx)
 		const struct bpf_insn *insn = &prog->insnsi[i];
 		int ret;
 
+		/* a called bpf function sets up a frame of its own */
+		if (i && ctx->func_start && ctx->func_start[i])
+			build_prologue(ctx);
+
 		ret = build_insn(insn, ctx);
 
 		if (ctx->image == NULL)
@@ -748,6 +763,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 	struct jit_ctx ctx;
 	int image_size;
 	u8 *image_ptr;
+	int i;
 
 	if (!bpf_jit_enable)
 		return orig_prog;
@@ -772,6 +788,22 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 		goto out;
 	}
 
+	for (i = 0; i < prog->len; i++) {
+		const struct bpf_insn *insn = &prog->insnsi[i];
+
+		if (!bpf_pseudo_call(insn))
+			continue;
+		if (ctx.func_start == NULL) {
+			ctx.func_start = kcalloc(prog->len, sizeof(bool),
+						 GFP_KERNEL);
+			if (ctx.func_start == NULL) {
+				prog = orig_prog;
+				goto out_off;
+			}
+		}
+		ctx.func_start[i + insn->imm + 1] = true;
+	}
+
 	/* 1. Initial fake pass to compute ctx->idx. */
 
 	/* Fake pass to fill in ctx->offset. */
@@ -827,6 +859,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 	prog->jited = 1;
 
 out_off:
+	kfree(ctx.func_start);
 	kfree(ctx.offset);
 out:
 	if (tmp_blinded)
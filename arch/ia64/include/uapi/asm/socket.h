@@ -99,4 +99,6 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		54
+
 #endif /* _ASM_IA64_SOCKET_H */
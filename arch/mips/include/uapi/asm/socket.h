@@ -108,4 +108,6 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		54
+
 #endif /* _UAPI_ASM_SOCKET_H */
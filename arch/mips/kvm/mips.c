@@ -57,6 +57,8 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	{ "halt_successful_poll", VCPU_STAT(halt_successful_poll), KVM_STAT_VCPU },
 	{ "halt_attempted_poll", VCPU_STAT(halt_attempted_poll), KVM_STAT_VCPU },
 	{ "halt_poll_invalid", VCPU_STAT(halt_poll_invalid), KVM_STAT_VCPU },
+	{ "halt_poll_success_ns", VCPU_STAT(halt_poll_success_ns), KVM_STAT_VCPU_U64 },
+	{ "halt_poll_fail_ns", VCPU_STAT(halt_poll_fail_ns), KVM_STAT_VCPU_U64 },
 	{ "halt_wakeup",  VCPU_STAT(halt_wakeup),	 KVM_STAT_VCPU },
 	{NULL}
 };
@@ -117,6 +117,8 @@ struct kvm_vcpu_stat {
 	u32 halt_successful_poll;
 	u32 halt_attempted_poll;
 	u32 halt_poll_invalid;
+	u64 halt_poll_success_ns;
+	u64 halt_poll_fail_ns;
 	u32 halt_wakeup;
 	u32 dbell_exits;
 	u32 gdbell_exits;
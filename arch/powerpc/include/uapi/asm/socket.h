@@ -97,4 +97,6 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		54
+
 #endif	/* _ASM_POWERPC_SOCKET_H */
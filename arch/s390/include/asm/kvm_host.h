@@ -248,6 +248,8 @@ struct kvm_vcpu_stat {
 	u32 halt_successful_poll;
 	u32 halt_attempted_poll;
 	u32 halt_poll_invalid;
+	u64 halt_poll_success_ns;
+	u64 halt_poll_fail_ns;
 	u32 halt_wakeup;
 	u32 instruction_lctl;
 	u32 instruction_lctlg;
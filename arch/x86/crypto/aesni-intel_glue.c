@@ -270,6 +270,110 @@ static void aesni_gcm_dec_avx2(void *ctx, u8 *out,
 }
 #endif
 
+#ifdef CONFIG_AS_VAES
+/*
+ * GHASH key powers H^8 ... H^1 and the running hash, both in the byte
+ * reflected form used by aesni-intel_vaes-x86_64.S.
+ */
+struct aes_gcm_vaes_state {
+	u8 key_powers[8 * AES_BLOCK_SIZE];
+	u8 ghash[AES_BLOCK_SIZE];
+};
+
+asmlinkage void aes_gcm_vaes_precompute(struct aes_gcm_vaes_state *state,
+					const u8 *hash_subkey);
+asmlinkage void aes_gcm_vaes_ghash(struct aes_gcm_vaes_state *state,
+				   const u8 *src, unsigned long nblocks);
+asmlinkage void aes_gcm_vaes_enc(struct crypto_aes_ctx *ctx,
+				 struct aes_gcm_vaes_state *state, u8 *ctr,
+				 u8 *dst, const u8 *src, unsigned long nblocks);
+asmlinkage void aes_gcm_vaes_dec(struct crypto_aes_ctx *ctx,
+				 struct aes_gcm_vaes_state *state, u8 *ctr,
+				 u8 *dst, const u8 *src, unsigned long nblocks);
+
+static void aes_gcm_vaes_ghash_pad(struct aes_gcm_vaes_state *state,
+				   const u8 *src, unsigned long len)
+{
+	u8 buf[AES_BLOCK_SIZE] = {};
+
+	aes_gcm_vaes_ghash(state, src, len / AES_BLOCK_SIZE);
+	if (len % AES_BLOCK_SIZE) {
+		memcpy(buf, src + round_down(len, AES_BLOCK_SIZE),
+		       len % AES_BLOCK_SIZE);
+		aes_gcm_vaes_ghash(state, buf, 1);
+	}
+}
+
+/*
+ * The key powers are cheap to compute compared to the data, so unlike the
+ * AVX versions this one is used for all lengths and key sizes.
+ */
+static void aesni_gcm_crypt_vaes(void *ctx, u8 *out,
+			const u8 *in, unsigned long len, u8 *iv,
+			u8 *hash_subkey, const u8 *aad, unsigned long aad_len,
+			u8 *auth_tag, unsigned long auth_tag_len, bool enc)
+{
+	struct aes_gcm_vaes_state state;
+	unsigned long tail = len % AES_BLOCK_SIZE;
+	unsigned long done = len - tail;
+	u8 ctr[AES_BLOCK_SIZE], ks[AES_BLOCK_SIZE], buf[AES_BLOCK_SIZE];
+	__be64 lengths[2];
+	unsigned long i;
+
+	aes_gcm_vaes_precompute(&state, hash_subkey);
+	memset(state.ghash, 0, sizeof(state.ghash));
+	aes_gcm_vaes_ghash_pad(&state, aad, aad_len);
+
+	memcpy(ctr, iv, AES_BLOCK_SIZE);
+	be32_add_cpu((__be32 *)(ctr + 12), 1);
+	if (enc)
+		aes_gcm_vaes_enc(ctx, &state, ctr, out, in,
+				 done / AES_BLOCK_SIZE);
+	else
+		aes_gcm_vaes_dec(ctx, &state, ctr, out, in,
+				 done / AES_BLOCK_SIZE);
+
+	if (tail) {
+		aesni_enc(ctx, ks, ctr);
+		memset(buf, 0, sizeof(buf));
+		for (i = 0; i < tail; i++) {
+			u8 c = in[done + i];
+
+			out[done + i] = c ^ ks[i];
+			buf[i] = enc ? out[done + i] : c;
+		}
+		aes_gcm_vaes_ghash(&state, buf, 1);
+	}
+
+	lengths[0] = cpu_to_be64((u64)aad_len * 8);
+	lengths[1] = cpu_to_be64((u64)len * 8);
+	aes_gcm_vaes_ghash(&state, (u8 *)lengths, 1);
+
+	aesni_enc(ctx, ks, iv);
+	for (i = 0; i < auth_tag_len; i++)
+		auth_tag[i] = state.ghash[AES_BLOCK_SIZE - 1 - i] ^ ks[i];
+	memzero_explicit(&state, sizeof(state));
+}
+
+static void aesni_gcm_enc_vaes(void *ctx, u8 *out,
+			const u8 *in, unsigned long plaintext_len, u8 *iv,
+			u8 *hash_subkey, const u8 *aad, unsigned long aad_len,
+			u8 *auth_tag, unsigned long auth_tag_len)
+{
+	aesni_gcm_crypt_vaes(ctx, out, in, plaintext_len, iv, hash_subkey,
+			     aad, aad_len, auth_tag, auth_tag_len, true);
+}
+
+static void aesni_gcm_dec_vaes(void *ctx, u8 *out,
+			const u8 *in, unsigned long ciphertext_len, u8 *iv,
+			u8 *hash_subkey, const u8 *aad, unsigned long aad_len,
+			u8 *auth_tag, unsigned long auth_tag_len)
+{
+	aesni_gcm_crypt_vaes(ctx, out, in, ciphertext_len, iv, hash_subkey,
+			     aad, aad_len, auth_tag, auth_tag_len, false);
+}
+#endif
+
 static void (*aesni_gcm_enc_tfm)(void *ctx, u8 *out,
 			const u8 *in, unsigned long plaintext_len, u8 *iv,
 			u8 *hash_subkey, const u8 *aad, unsigned long aad_len,
@@ -709,12 +813,66 @@ static const struct common_glue_ctx aesni_dec_xts = {
 	} }
 };
 
+#ifdef CONFIG_AS_VAES
+asmlinkage void aesni_xts_crypt16_vaes(struct crypto_aes_ctx *ctx, u8 *out,
+				       const u8 *in, bool enc, u8 *iv);
+
+static void aesni_xts_enc16_vaes(void *ctx, u128 *dst, const u128 *src,
+				 le128 *iv)
+{
+	aesni_xts_crypt16_vaes(ctx, (u8 *)dst, (const u8 *)src, true,
+			       (u8 *)iv);
+}
+
+static void aesni_xts_dec16_vaes(void *ctx, u128 *dst, const u128 *src,
+				 le128 *iv)
+{
+	aesni_xts_crypt16_vaes(ctx, (u8 *)dst, (const u8 *)src, false,
+			       (u8 *)iv);
+}
+
+static const struct common_glue_ctx aesni_enc_xts_vaes = {
+	.num_funcs = 3,
+	.fpu_blocks_limit = 1,
+
+	.funcs = { {
+		.num_blocks = 16,
+		.fn_u = { .xts = GLUE_XTS_FUNC_CAST(aesni_xts_enc16_vaes) }
+	}, {
+		.num_blocks = 8,
+		.fn_u = { .xts = GLUE_XTS_FUNC_CAST(aesni_xts_enc8) }
+	}, {
+		.num_blocks = 1,
+		.fn_u = { .xts = GLUE_XTS_FUNC_CAST(aesni_xts_enc) }
+	} }
+};
+
+static const struct common_glue_ctx aesni_dec_xts_vaes = {
+	.num_funcs = 3,
+	.fpu_blocks_limit = 1,
+
+	.funcs = { {
+		.num_blocks = 16,
+		.fn_u = { .xts = GLUE_XTS_FUNC_CAST(aesni_xts_dec16_vaes) }
+	}, {
+		.num_blocks = 8,
+		.fn_u = { .xts = GLUE_XTS_FUNC_CAST(aesni_xts_dec8) }
+	}, {
+		.num_blocks = 1,
+		.fn_u = { .xts = GLUE_XTS_FUNC_CAST(aesni_xts_dec) }
+	} }
+};
+#endif
+
+static const struct common_glue_ctx *aesni_enc_xts_tfm = &aesni_enc_xts;
+static const struct common_glue_ctx *aesni_dec_xts_tfm = &aesni_dec_xts;
+
 static int xts_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
 		       struct scatterlist *src, unsigned int nbytes)
 {
 	struct aesni_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
 
-	return glue_xts_crypt_128bit(&aesni_enc_xts, desc, dst, src, nbytes,
+	return glue_xts_crypt_128bit(aesni_enc_xts_tfm, desc, dst, src, nbytes,
 				     XTS_TWEAK_CAST(aesni_xts_tweak),
 				     aes_ctx(ctx->raw_tweak_ctx),
 				     aes_ctx(ctx->raw_crypt_ctx));
@@ -725,7 +883,7 @@ static int xts_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
 {
 	struct aesni_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
 
-	return glue_xts_crypt_128bit(&aesni_dec_xts, desc, dst, src, nbytes,
+	return glue_xts_crypt_128bit(aesni_dec_xts_tfm, desc, dst, src, nbytes,
 				     XTS_TWEAK_CAST(aesni_xts_tweak),
 				     aes_ctx(ctx->raw_tweak_ctx),
 				     aes_ctx(ctx->raw_crypt_ctx));
@@ -1456,6 +1614,17 @@ static int __init aesni_init(void)
 	if (!x86_match_cpu(aesni_cpu_id))
 		return -ENODEV;
 #ifdef CONFIG_X86_64
+#ifdef CONFIG_AS_VAES
+	if (boot_cpu_has(X86_FEATURE_VAES) &&
+	    boot_cpu_has(X86_FEATURE_VPCLMULQDQ) &&
+	    boot_cpu_has(X86_FEATURE_AVX2)) {
+		pr_info("VAES version of gcm_enc/dec and xts engaged.\n");
+		aesni_gcm_enc_tfm = aesni_gcm_enc_vaes;
+		aesni_gcm_dec_tfm = aesni_gcm_dec_vaes;
+		aesni_enc_xts_tfm = &aesni_enc_xts_vaes;
+		aesni_dec_xts_tfm = &aesni_dec_xts_vaes;
+	} else
+#endif
 #ifdef CONFIG_AS_AVX2
 	if (boot_cpu_has(X86_FEATURE_AVX2)) {
 		pr_info("AVX2 version of gcm_enc/dec engaged.\n");
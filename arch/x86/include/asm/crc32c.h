@@ -0,0 +1,78 @@
+#ifndef _ASM_X86_CRC32C_H
+#define _ASM_X86_CRC32C_H
+
+/*
+ * CRC32C using the SSE4.2 crc32 instruction, one word per instruction.
+ * Shared by the crc32c-intel shash driver and the crc32c() library
+ * function, which calls it directly for short buffers.
+ */
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <asm/cpufeature.h>
+
+#define HAVE_ARCH_CRC32C
+
+#define CRC32C_SCALE_F	sizeof(unsigned long)
+
+#ifdef CONFIG_X86_64
+#define CRC32C_REX_PRE "0x48, "
+/*
+ * Longer buffers are left to crc32c-intel, which folds three streams
+ * with PCLMULQDQ once the FPU save/restore is paid for.
+ */
+#define CRC32C_ARCH_MAX_LEN	512
+#else
+#define CRC32C_REX_PRE
+#define CRC32C_ARCH_MAX_LEN	UINT_MAX
+#endif
+
+static inline u32 crc32c_intel_le_hw_byte(u32 crc, unsigned char const *data,
+					  size_t length)
+{
+	while (length--) {
+		__asm__ __volatile__(
+			".byte 0xf2, 0xf, 0x38, 0xf0, 0xf1"
+			:"=S"(crc)
+			:"0"(crc), "c"(*data)
+		);
+		data++;
+	}
+
+	return crc;
+}
+
+static inline u32 __pure crc32c_intel_le_hw(u32 crc, unsigned char const *p,
+					    size_t len)
+{
+	unsigned int iquotient = len / CRC32C_SCALE_F;
+	unsigned int iremainder = len % CRC32C_SCALE_F;
+	unsigned long *ptmp = (unsigned long *)p;
+
+	while (iquotient--) {
+		__asm__ __volatile__(
+			".byte 0xf2, " CRC32C_REX_PRE "0xf, 0x38, 0xf1, 0xf1;"
+			:"=S"(crc)
+			:"0"(crc), "c"(*ptmp)
+		);
+		ptmp++;
+	}
+
+	if (iremainder)
+		crc = crc32c_intel_le_hw_byte(crc, (unsigned char *)ptmp,
+				 iremainder);
+
+	return crc;
+}
+
+static inline bool crc32c_arch_available(void)
+{
+	return boot_cpu_has(X86_FEATURE_XMM4_2);
+}
+
+static inline u32 crc32c_arch(u32 crc, const void *p, unsigned int len)
+{
+	return crc32c_intel_le_hw(crc, p, len);
+}
+
+#endif /* _ASM_X86_CRC32C_H */
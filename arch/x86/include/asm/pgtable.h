@@ -605,7 +605,12 @@ static inline pte_t *pte_offset_kernel(pmd_t *pmd, unsigned long address)
 
 static inline int pmd_bad(pmd_t pmd)
 {
-	return (pmd_flags(pmd) & ~_PAGE_USER) != _KERNPG_TABLE;
+	pmdval_t ignore = _PAGE_USER;
+
+	/* page tables shared by fork are mapped read-only */
+	if (IS_ENABLED(CONFIG_SHARED_PTE_TABLES))
+		ignore |= _PAGE_RW;
+	return (pmd_flags(pmd) & ~ignore) != (_KERNPG_TABLE & ~ignore);
 }
 
 static inline unsigned long pages_to_mb(unsigned long npg)
@@ -15,6 +15,22 @@
 #define __NR_seccomp_sigreturn_32	__NR_ia32_sigreturn
 #endif
 
+/*
+ * Syscall tables the seccomp action cache keeps a bitmap for.  The sizes
+ * come from asm-offsets and are only expanded in kernel/seccomp.c.
+ */
+#ifdef CONFIG_X86_32
+#define SECCOMP_ARCH_NATIVE		AUDIT_ARCH_I386
+#define SECCOMP_ARCH_NATIVE_NR		NR_syscalls
+#else
+#define SECCOMP_ARCH_NATIVE		AUDIT_ARCH_X86_64
+#define SECCOMP_ARCH_NATIVE_NR		NR_syscalls
+#ifdef CONFIG_IA32_EMULATION
+#define SECCOMP_ARCH_COMPAT		AUDIT_ARCH_I386
+#define SECCOMP_ARCH_COMPAT_NR		IA32_NR_syscalls
+#endif
+#endif
+
 #include <asm-generic/seccomp.h>
 
 #endif /* _ASM_X86_SECCOMP_H */
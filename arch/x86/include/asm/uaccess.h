@@ -667,6 +667,17 @@ extern struct movsl_mask {
 
 #define ARCH_HAS_NOCACHE_UACCESS 1
 
+extern unsigned long copy_nocache_threshold;
+
+/*
+ * Whether a user copy of @size bytes in total should bypass the cache,
+ * i.e. is so big that it would mostly evict data others still use.
+ */
+static inline bool copy_nocache_wanted(size_t size)
+{
+	return copy_nocache_threshold && size >= copy_nocache_threshold;
+}
+
 #ifdef CONFIG_X86_32
 # include <asm/uaccess_32.h>
 #else
@@ -154,4 +154,18 @@ __copy_from_user_inatomic_nocache(void *to, const void __user *from,
        return __copy_from_user_ll_nocache_nozero(to, from, n);
 }
 
+/* There are no non-temporal copies to user space, use the cached ones */
+static __always_inline unsigned long
+__copy_to_user_nocache(void __user *to, const void *from, unsigned long n)
+{
+	return __copy_to_user(to, from, n);
+}
+
+static __always_inline unsigned long
+__copy_to_user_inatomic_nocache(void __user *to, const void *from,
+				unsigned long n)
+{
+	return __copy_to_user_inatomic(to, from, n);
+}
+
 #endif /* _ASM_X86_UACCESS_32_H */
@@ -275,6 +275,25 @@ __copy_from_user_inatomic_nocache(void *dst, const void __user *src,
 	return __copy_user_nocache(dst, src, size, 0);
 }
 
+/* __copy_user_nocache() works either way, its fault fixup is generic */
+static inline int
+__copy_to_user_nocache(void __user *dst, const void *src, unsigned size)
+{
+	might_fault();
+	kasan_check_read(src, size);
+	return __copy_user_nocache((__force void *)dst,
+				   (__force const void __user *)src, size, 0);
+}
+
+static inline int
+__copy_to_user_inatomic_nocache(void __user *dst, const void *src,
+				unsigned size)
+{
+	kasan_check_read(src, size);
+	return __copy_user_nocache((__force void *)dst,
+				   (__force const void __user *)src, size, 0);
+}
+
 unsigned long
 copy_user_handle_tail(char *to, char *from, unsigned len);
 
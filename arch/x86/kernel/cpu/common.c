@@ -1142,9 +1142,38 @@ void enable_sep_cpu(void)
 }
 #endif
 
+/*
+ * User copies of at least this many bytes bypass the cache, see
+ * copy_nocache_wanted().  Left at zero, it is set from the size of the last
+ * level cache of the boot cpu; a value larger than any copy turns the
+ * non-temporal copies off.
+ */
+unsigned long copy_nocache_threshold __read_mostly;
+EXPORT_SYMBOL_GPL(copy_nocache_threshold);
+core_param(copy_nocache_threshold, copy_nocache_threshold, ulong, 0644);
+
+static void __init init_copy_nocache_threshold(struct cpuinfo_x86 *c)
+{
+	unsigned long llc = 0;
+
+	if (copy_nocache_threshold)
+		return;
+
+	/* AMD reports the per core L2 in x86_cache_size, not the shared L3 */
+	if (c->x86_vendor == X86_VENDOR_AMD &&
+	    c->extended_cpuid_level >= 0x80000006)
+		llc = (cpuid_edx(0x80000006) >> 18) * 512 * 1024;
+	if (!llc && c->x86_cache_size > 0)
+		llc = c->x86_cache_size * 1024UL;
+
+	/* A copy of half the cache evicts most of what others keep in it */
+	copy_nocache_threshold = llc / 2;
+}
+
 void __init identify_boot_cpu(void)
 {
 	identify_cpu(&boot_cpu_data);
+	init_copy_nocache_threshold(&boot_cpu_data);
 	init_amd_e400_c1e_mask();
 #ifdef CONFIG_X86_32
 	sysenter_setup();
@@ -465,6 +465,14 @@ void fixup_irqs(void)
 		irq_force_complete_move(desc);
 
 		if (cpumask_any_and(affinity, cpu_online_mask) >= nr_cpu_ids) {
+			/*
+			 * Managed interrupts are shut down until a CPU
+			 * of their mask comes back online.
+			 */
+			if (irq_shutdown_managed_offline(desc)) {
+				raw_spin_unlock(&desc->lock);
+				continue;
+			}
 			break_affinity = 1;
 			affinity = cpu_online_mask;
 		}
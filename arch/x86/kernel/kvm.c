@@ -78,6 +78,7 @@ early_param("no-kvmclock-vsyscall", parse_no_kvmclock_vsyscall);
 
 static DEFINE_PER_CPU(struct kvm_vcpu_pv_apf_data, apf_reason) __aligned(64);
 static DEFINE_PER_CPU(struct kvm_steal_time, steal_time) __aligned(64);
+static DEFINE_PER_CPU(cpumask_var_t, __pv_tlb_mask);
 static int has_steal_clock = 0;
 
 /*
@@ -409,6 +410,45 @@ static u64 kvm_steal_clock(int cpu)
 	return steal;
 }
 
+/*
+ * A preempted vCPU can't answer a flush IPI until the host runs it again,
+ * and the sender would spin until then.  Ask the host to flush its TLB on
+ * the next entry instead, and only IPI the vCPUs that are running.
+ */
+static void kvm_flush_tlb_others(const struct cpumask *cpumask,
+				 struct mm_struct *mm, unsigned long start,
+				 unsigned long end)
+{
+	struct cpumask *flushmask = this_cpu_cpumask_var_ptr(__pv_tlb_mask);
+	struct kvm_steal_time *src;
+	u8 state;
+	int cpu;
+
+	/* Before kvm_setup_pv_tlb_flush() with CONFIG_CPUMASK_OFFSTACK */
+	if (unlikely(!flushmask)) {
+		native_flush_tlb_others(cpumask, mm, start, end);
+		return;
+	}
+
+	cpumask_copy(flushmask, cpumask);
+	for_each_cpu(cpu, flushmask) {
+		src = &per_cpu(steal_time, cpu);
+		state = READ_ONCE(src->preempted);
+		if ((state & KVM_VCPU_PREEMPTED) &&
+		    cmpxchg(&src->preempted, state,
+			    state | KVM_VCPU_FLUSH_TLB) == state)
+			__cpumask_clear_cpu(cpu, flushmask);
+	}
+
+	native_flush_tlb_others(flushmask, mm, start, end);
+}
+
+static bool kvm_pv_tlb_flush_supported(void)
+{
+	return kvm_para_has_feature(KVM_FEATURE_PV_TLB_FLUSH) &&
+	       kvm_para_has_feature(KVM_FEATURE_STEAL_TIME);
+}
+
 void kvm_disable_steal_time(void)
 {
 	if (!has_steal_clock)
@@ -488,6 +528,9 @@ void __init kvm_guest_init(void)
 		pv_time_ops.steal_clock = kvm_steal_clock;
 	}
 
+	if (kvm_pv_tlb_flush_supported())
+		pv_mmu_ops.flush_tlb_others = kvm_flush_tlb_others;
+
 	if (kvm_para_has_feature(KVM_FEATURE_PV_EOI))
 		apic_set_eoi_write(kvm_guest_apic_eoi_write);
 
@@ -553,6 +596,20 @@ const struct hypervisor_x86 x86_hyper_kvm __refconst = {
 };
 EXPORT_SYMBOL_GPL(x86_hyper_kvm);
 
+static __init int kvm_setup_pv_tlb_flush(void)
+{
+	int cpu;
+
+	if (!kvm_para_available() || !kvm_pv_tlb_flush_supported())
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		zalloc_cpumask_var_node(per_cpu_ptr(&__pv_tlb_mask, cpu),
+					GFP_KERNEL, cpu_to_node(cpu));
+	return 0;
+}
+early_initcall(kvm_setup_pv_tlb_flush);
+
 static __init int activate_jump_labels(void)
 {
 	if (has_steal_clock) {
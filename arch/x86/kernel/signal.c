@@ -736,6 +736,12 @@ handle_signal(struct ksignal *ksig, struct pt_regs *regs)
 	if (stepping)
 		user_disable_single_step(current);
 
+	/*
+	 * Abort an interrupted restartable sequence before its registers
+	 * end up in the signal frame.
+	 */
+	rseq_signal_deliver(ksig, regs);
+
 	failed = (setup_rt_frame(ksig, regs) < 0);
 	if (!failed) {
 		/*
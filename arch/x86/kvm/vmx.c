@@ -518,6 +518,14 @@ static inline int pi_test_sn(struct pi_desc *pi_desc)
 			(unsigned long *)&pi_desc->control);
 }
 
+/* 'NDST' value that sends notification events to @cpu */
+static inline u32 pi_ndst(int cpu)
+{
+	unsigned int dest = cpu_physical_id(cpu);
+
+	return x2apic_enabled() ? dest : (dest << 8) & 0xFF00;
+}
+
 struct vcpu_vmx {
 	struct kvm_vcpu       vcpu;
 	unsigned long         host_rsp;
@@ -2069,10 +2077,19 @@ static void vmx_vcpu_pi_load(struct kvm_vcpu *vcpu, int cpu)
 {
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 	struct pi_desc old, new;
-	unsigned int dest;
 
-	if (!kvm_arch_has_assigned_device(vcpu->kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+	/*
+	 * 'NDST' is kept up to date even without an assigned device:
+	 * assignment can start while the vCPU stays on one pCPU, and
+	 * the first posted interrupt must not go to a stale destination.
+	 * Likewise 'SN' may still be set from before the last device
+	 * went away.
+	 */
+	if (!irq_remapping_cap(IRQ_POSTING_CAP) ||
+	    !kvm_vcpu_apicv_active(vcpu))
+		return;
+
+	if (vcpu->cpu == cpu && !pi_test_sn(pi_desc))
 		return;
 
 	do {
@@ -2093,14 +2110,8 @@ static void vmx_vcpu_pi_load(struct kvm_vcpu *vcpu, int cpu)
 		 *    I think it is not a big deal.
 		 */
 		if (pi_desc->nv != POSTED_INTR_WAKEUP_VECTOR) {
-			if (vcpu->cpu != cpu) {
-				dest = cpu_physical_id(cpu);
-
-				if (x2apic_enabled())
-					new.ndst = dest;
-				else
-					new.ndst = (dest << 8) & 0xFF00;
-			}
+			if (vcpu->cpu != cpu)
+				new.ndst = pi_ndst(cpu);
 
 			/* set 'NV' to 'notification vector' */
 			new.nv = POSTED_INTR_VECTOR;
@@ -5058,8 +5069,16 @@ static void vmx_vcpu_reset(struct kvm_vcpu *vcpu, bool init_event)
 
 	kvm_make_request(KVM_REQ_APIC_PAGE_RELOAD, vcpu);
 
-	if (kvm_vcpu_apicv_active(vcpu))
+	if (kvm_vcpu_apicv_active(vcpu)) {
 		memset(&vmx->pi_desc, 0, sizeof(struct pi_desc));
+		/*
+		 * vmx_vcpu_pi_load() won't run again until the vCPU is
+		 * rescheduled, so make the descriptor usable for VT-d
+		 * posting right away.
+		 */
+		vmx->pi_desc.nv = POSTED_INTR_VECTOR;
+		vmx->pi_desc.ndst = pi_ndst(vcpu->cpu);
+	}
 
 	if (vmx->vpid != 0)
 		vmcs_write16(VIRTUAL_PROCESSOR_ID, vmx->vpid);
@@ -10709,7 +10728,6 @@ static void vmx_enable_log_dirty_pt_masked(struct kvm *kvm,
 static int vmx_pre_block(struct kvm_vcpu *vcpu)
 {
 	unsigned long flags;
-	unsigned int dest;
 	struct pi_desc old, new;
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 
@@ -10757,12 +10775,7 @@ static int vmx_pre_block(struct kvm_vcpu *vcpu)
 		 * to wakeup in wakeup handler if interrupts happen
 		 * when the vCPU is in blocked state.
 		 */
-		dest = cpu_physical_id(vcpu->pre_pcpu);
-
-		if (x2apic_enabled())
-			new.ndst = dest;
-		else
-			new.ndst = (dest << 8) & 0xFF00;
+		new.ndst = pi_ndst(vcpu->pre_pcpu);
 
 		/* set 'NV' to 'wakeup vector' */
 		new.nv = POSTED_INTR_WAKEUP_VECTOR;
@@ -10776,7 +10789,6 @@ static void vmx_post_block(struct kvm_vcpu *vcpu)
 {
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 	struct pi_desc old, new;
-	unsigned int dest;
 	unsigned long flags;
 
 	if (!kvm_arch_has_assigned_device(vcpu->kvm) ||
@@ -10786,12 +10798,7 @@ static void vmx_post_block(struct kvm_vcpu *vcpu)
 	do {
 		old.control = new.control = pi_desc->control;
 
-		dest = cpu_physical_id(vcpu->cpu);
-
-		if (x2apic_enabled())
-			new.ndst = dest;
-		else
-			new.ndst = (dest << 8) & 0xFF00;
+		new.ndst = pi_ndst(vcpu->cpu);
 
 		/* Allow posting non-urgent interrupts */
 		new.sn = 0;
@@ -10832,13 +10839,19 @@ static int vmx_update_pi_irte(struct kvm *kvm, unsigned int host_irq,
 	struct vcpu_data vcpu_info;
 	int idx, ret = -EINVAL;
 
+	/* Posting needs APICv to pick the interrupt up from the PIR */
 	if (!kvm_arch_has_assigned_device(kvm) ||
-		!irq_remapping_cap(IRQ_POSTING_CAP))
+		!irq_remapping_cap(IRQ_POSTING_CAP) ||
+		!kvm_vcpu_apicv_active(kvm->vcpus[0]))
 		return 0;
 
 	idx = srcu_read_lock(&kvm->irq_srcu);
 	irq_rt = srcu_dereference(kvm->irq_routing, &kvm->irq_srcu);
-	BUG_ON(guest_irq >= irq_rt->nr_rt_entries);
+	if (guest_irq >= irq_rt->nr_rt_entries) {
+		pr_warn_once("kvm: no route for guest_irq %u/%u\n",
+			     guest_irq, irq_rt->nr_rt_entries);
+		goto out;
+	}
 
 	hlist_for_each_entry(e, &irq_rt->map[guest_irq], link) {
 		if (e->type != KVM_IRQ_ROUTING_MSI)
@@ -112,6 +112,9 @@ void switch_mm_irqs_off(struct mm_struct *prev, struct mm_struct *next,
 		 *
 		 */
 		load_cr3(next->pgd);
+#ifdef CONFIG_SMP
+		this_cpu_write(cpu_tlbstate.flush_pending, false);
+#endif
 
 		trace_tlb_flush(TLB_FLUSH_ON_TASK_SWITCH, TLB_FLUSH_ALL);
 
@@ -143,6 +146,12 @@ void switch_mm_irqs_off(struct mm_struct *prev, struct mm_struct *next,
 		this_cpu_write(cpu_tlbstate.state, TLBSTATE_OK);
 		BUG_ON(this_cpu_read(cpu_tlbstate.active_mm) != next);
 
+		/*
+		 * Order the state write against the flush_pending read,
+		 * pairs with the barrier in flush_tlb_skip_lazy().
+		 */
+		smp_mb();
+
 		if (!cpumask_test_cpu(cpu, mm_cpumask(next))) {
 			/*
 			 * On established mms, the mm_cpumask is only changed
@@ -161,9 +170,15 @@ void switch_mm_irqs_off(struct mm_struct *prev, struct mm_struct *next,
 			 * fills with respect to the mm_cpumask write.
 			 */
 			load_cr3(next->pgd);
+			this_cpu_write(cpu_tlbstate.flush_pending, false);
 			trace_tlb_flush(TLB_FLUSH_ON_TASK_SWITCH, TLB_FLUSH_ALL);
 			load_mm_cr4(next);
 			load_mm_ldt(next);
+		} else if (this_cpu_read(cpu_tlbstate.flush_pending)) {
+			/* A flush was skipped while we were lazy */
+			this_cpu_write(cpu_tlbstate.flush_pending, false);
+			local_flush_tlb();
+			trace_tlb_flush(TLB_FLUSH_ON_TASK_SWITCH, TLB_FLUSH_ALL);
 		}
 	}
 #endif
@@ -274,6 +289,60 @@ void native_flush_tlb_others(const struct cpumask *cpumask,
 	smp_call_function_many(cpumask, flush_tlb_func, &info, 1);
 }
 
+/* Scratch masks for flush_tlb_skip_lazy(), used with preemption disabled */
+static DEFINE_PER_CPU(cpumask_var_t, flush_tlb_mask);
+static bool flush_tlb_mask_ready __read_mostly;
+
+static int __init flush_tlb_mask_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (!zalloc_cpumask_var_node(&per_cpu(flush_tlb_mask, cpu),
+					     GFP_KERNEL, cpu_to_node(cpu)))
+			return -ENOMEM;
+	}
+	flush_tlb_mask_ready = true;
+	return 0;
+}
+early_initcall(flush_tlb_mask_init);
+
+/*
+ * A cpu in lazy tlb mode runs a kernel thread on the page tables of the
+ * last user mm, and nothing uses the user mappings until it switches
+ * back. Rather than interrupting it only to leave_mm(), mark it and let
+ * switch_mm_irqs_off() flush when it goes back to TLBSTATE_OK: the mark
+ * is written before the state is read again here, and the state is
+ * written before the mark is read there, so one side always sees the
+ * other.
+ *
+ * Not usable when page tables are being freed, the lazy cpu can still
+ * walk them speculatively.
+ */
+static const struct cpumask *flush_tlb_skip_lazy(const struct cpumask *cpumask)
+{
+	int this_cpu = smp_processor_id();
+	struct cpumask *mask;
+	int cpu;
+
+	if (!flush_tlb_mask_ready)
+		return cpumask;
+
+	mask = this_cpu_cpumask_var_ptr(flush_tlb_mask);
+	cpumask_copy(mask, cpumask);
+	for_each_cpu(cpu, cpumask) {
+		if (cpu == this_cpu ||
+		    READ_ONCE(per_cpu(cpu_tlbstate.state, cpu)) != TLBSTATE_LAZY)
+			continue;
+
+		WRITE_ONCE(per_cpu(cpu_tlbstate.flush_pending, cpu), true);
+		smp_mb();
+		if (READ_ONCE(per_cpu(cpu_tlbstate.state, cpu)) == TLBSTATE_LAZY)
+			__cpumask_clear_cpu(cpu, mask);
+	}
+	return mask;
+}
+
 void flush_tlb_current_task(void)
 {
 	struct mm_struct *mm = current->mm;
@@ -304,8 +373,10 @@ void flush_tlb_current_task(void)
 static unsigned long tlb_single_page_flush_ceiling __read_mostly = 33;
 
 void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
-				unsigned long end, unsigned long vmflag)
+				unsigned long end, unsigned long vmflag,
+				bool freed_tables)
 {
+	const struct cpumask *cpumask = mm_cpumask(mm);
 	unsigned long addr;
 	/* do a global flush by default */
 	unsigned long base_pages_to_flush = TLB_FLUSH_ALL;
@@ -351,11 +422,39 @@ out:
 		start = 0UL;
 		end = TLB_FLUSH_ALL;
 	}
-	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, start, end);
+	if (cpumask_any_but(cpumask, smp_processor_id()) < nr_cpu_ids) {
+		if (!freed_tables)
+			cpumask = flush_tlb_skip_lazy(cpumask);
+		if (cpumask_any_but(cpumask, smp_processor_id()) < nr_cpu_ids)
+			flush_tlb_others(cpumask, mm, start, end);
+	}
 	preempt_enable();
 }
 
+/*
+ * Flush everything on the cpus in @cpumask, this one included. Used for
+ * the batches of unmapped pages that try_to_unmap() collects across any
+ * number of mms: no page tables are freed there, so lazy cpus are left
+ * alone.
+ */
+void flush_tlb_batched(const struct cpumask *cpumask)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, cpumask)) {
+		count_vm_tlb_event(NR_TLB_LOCAL_FLUSH_ALL);
+		local_flush_tlb();
+		trace_tlb_flush(TLB_LOCAL_SHOOTDOWN, TLB_FLUSH_ALL);
+	}
+
+	if (cpumask_any_but(cpumask, cpu) < nr_cpu_ids) {
+		cpumask = flush_tlb_skip_lazy(cpumask);
+		if (cpumask_any_but(cpumask, cpu) < nr_cpu_ids)
+			flush_tlb_others(cpumask, NULL, 0, TLB_FLUSH_ALL);
+	}
+	put_cpu();
+}
+
 void flush_tlb_page(struct vm_area_struct *vma, unsigned long start)
 {
 	struct mm_struct *mm = vma->vm_mm;
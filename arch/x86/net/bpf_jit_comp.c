@@ -190,6 +190,7 @@ struct jit_context {
 	int cleanup_addr; /* epilogue code offset */
 	bool seen_ld_abs;
 	bool seen_ax_reg;
+	bool *func_start; /* insns called by BPF_PSEUDO_CALL, or NULL */
 };
 
 /* maximum number of bytes emitted while JITing one eBPF insn */
@@ -379,6 +380,24 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		if (dst_reg == BPF_REG_AX || src_reg == BPF_REG_AX)
 			ctx->seen_ax_reg = seen_ax_reg = true;
 
+		if (i && ctx->func_start && ctx->func_start[i]) {
+			/* a called bpf function sets up a frame of its own
+			 * and shares the epilogue, addrs[i - 1] is the
+			 * address calls go to
+			 */
+			emit_prologue(&prog);
+			ilen = prog - temp;
+			if (image) {
+				if (unlikely(proglen + ilen > oldproglen)) {
+					pr_err("bpf_jit_compile fatal error\n");
+					return -EFAULT;
+				}
+				memcpy(image + proglen, temp, ilen);
+			}
+			proglen += ilen;
+			prog = temp;
+		}
+
 		switch (insn->code) {
 			/* ALU */
 		case BPF_ALU | BPF_ADD | BPF_X:
@@ -850,6 +869,12 @@ xadd:			if (is_imm8(insn->off))
 
 			/* call */
 		case BPF_JMP | BPF_CALL:
+			if (src_reg == BPF_PSEUDO_CALL) {
+				/* call rel32 */
+				jmp_offset = addrs[i + imm32] - addrs[i];
+				EMIT1_off32(0xE8, jmp_offset);
+				break;
+			}
 			func = (u8 *) __bpf_call_base + imm32;
 			jmp_offset = func - (image + addrs[i]);
 			if (seen_ld_abs) {
@@ -1121,11 +1146,29 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 		goto out;
 	}
 
+	for (i = 0; i < prog->len; i++) {
+		const struct bpf_insn *insn = &prog->insnsi[i];
+
+		if (!bpf_pseudo_call(insn))
+			continue;
+		if (!ctx.func_start) {
+			ctx.func_start = kcalloc(prog->len, sizeof(bool),
+						 GFP_KERNEL);
+			if (!ctx.func_start) {
+				prog = orig_prog;
+				goto out_addrs;
+			}
+		}
+		ctx.func_start[i + insn->imm + 1] = true;
+	}
+
 	/* Before first pass, make a rough estimation of addrs[]
 	 * each bpf instruction is translated to less than 64 bytes
 	 */
 	for (proglen = 0, i = 0; i < prog->len; i++) {
 		proglen += 64;
+		if (ctx.func_start && ctx.func_start[i])
+			proglen += PROLOGUE_SIZE;
 		addrs[i] = proglen;
 	}
 	ctx.cleanup_addr = proglen;
@@ -1175,6 +1218,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 	}
 
 out_addrs:
+	kfree(ctx.func_start);
 	kfree(addrs);
 out:
 	if (tmp_blinded)
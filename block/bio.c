@@ -242,6 +242,46 @@ static void __bio_free(struct bio *bio)
 		bio_integrity_free(bio);
 }
 
+/* bios kept per cpu, beyond that they go back to the mempool */
+#define BIO_CACHE_MAX		128
+
+static struct bio *bio_cache_alloc(struct bio_set *bs)
+{
+	struct bio_alloc_cache *cache;
+	struct bio *bio = NULL;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	if (cache->free_list) {
+		bio = cache->free_list;
+		cache->free_list = bio->bi_next;
+		cache->nr--;
+	}
+	local_irq_restore(flags);
+
+	return bio;
+}
+
+static bool bio_cache_free(struct bio_set *bs, struct bio *bio)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	bool cached = false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	if (cache->nr < BIO_CACHE_MAX) {
+		bio->bi_next = cache->free_list;
+		cache->free_list = bio;
+		cache->nr++;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	return cached;
+}
+
 static void bio_free(struct bio *bio)
 {
 	struct bio_set *bs = bio->bi_pool;
@@ -253,6 +293,9 @@ static void bio_free(struct bio *bio)
 		if (bio_flagged(bio, BIO_OWNS_VEC))
 			bvec_free(bs->bvec_pool, bio->bi_io_vec, BIO_POOL_IDX(bio));
 
+		if (bs->cache && bio_cache_free(bs, bio))
+			return;
+
 		/*
 		 * If we have front padding, adjust the bio pointer before freeing
 		 */
@@ -274,6 +317,20 @@ void bio_init(struct bio *bio)
 }
 EXPORT_SYMBOL(bio_init);
 
+/**
+ * bio_uninit - release the resources of a bio that is not freed
+ * @bio:	bio set up with bio_init()
+ *
+ * Description:
+ *   For bios not allocated by bio_alloc_bioset(), e.g. on the stack, which
+ *   don't go through bio_put() at the end of their life.
+ */
+void bio_uninit(struct bio *bio)
+{
+	__bio_free(bio);
+}
+EXPORT_SYMBOL(bio_uninit);
+
 /**
  * bio_reset - reinitialize a bio
  * @bio:	bio to reset
@@ -462,7 +519,14 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, int nr_iovecs, struct bio_set *bs)
 		if (current->bio_list && !bio_list_empty(current->bio_list))
 			gfp_mask &= ~__GFP_DIRECT_RECLAIM;
 
-		p = mempool_alloc(bs->bio_pool, gfp_mask);
+		p = NULL;
+		if (bs->cache) {
+			bio = bio_cache_alloc(bs);
+			if (bio)
+				p = (void *) bio - bs->front_pad;
+		}
+		if (!p)
+			p = mempool_alloc(bs->bio_pool, gfp_mask);
 		if (!p && gfp_mask != saved_gfp) {
 			punt_bios_to_rescuer(bs);
 			gfp_mask = saved_gfp;
@@ -839,6 +903,68 @@ done:
 }
 EXPORT_SYMBOL(bio_add_page);
 
+static int __bio_iov_iter_get_pages(struct bio *bio, struct iov_iter *iter)
+{
+	unsigned short nr_pages = bio->bi_max_vecs - bio->bi_vcnt;
+	struct bio_vec *bv = bio->bi_io_vec + bio->bi_vcnt;
+	struct page **pages = (struct page **)bv;
+	size_t offset, diff;
+	ssize_t size;
+	int i;
+
+	size = iov_iter_get_pages(iter, pages, LONG_MAX, nr_pages, &offset);
+	if (unlikely(size <= 0))
+		return size ? size : -EFAULT;
+	nr_pages = (size + offset + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	/*
+	 * The page array lives in the space of the bio_vecs, which are larger
+	 * than page pointers. Fill the bio_vecs from the end so that no page
+	 * pointer is overwritten before it has been read.
+	 */
+	for (i = nr_pages - 1; i >= 0; i--) {
+		bv[i].bv_page = pages[i];
+		bv[i].bv_len = PAGE_SIZE;
+		bv[i].bv_offset = 0;
+	}
+
+	bv[0].bv_offset += offset;
+	bv[0].bv_len -= offset;
+	diff = (nr_pages * PAGE_SIZE - offset) - size;
+	if (diff)
+		bv[nr_pages - 1].bv_len -= diff;
+
+	bio->bi_vcnt += nr_pages;
+	bio->bi_iter.bi_size += size;
+
+	iov_iter_advance(iter, size);
+	return 0;
+}
+
+/**
+ * bio_iov_iter_get_pages - pin user or kernel pages and add them to a bio
+ * @bio: bio to add pages to
+ * @iter: iov iterator describing the region to be mapped
+ *
+ * Pins pages from *iter and appends them to @bio's bvec array, until either
+ * the bio is full or the iterator is exhausted. The pages will have to be
+ * released using put_page() when done. The iterator is advanced past the
+ * pages that were added.
+ */
+int bio_iov_iter_get_pages(struct bio *bio, struct iov_iter *iter)
+{
+	unsigned short orig_vcnt = bio->bi_vcnt;
+	int ret;
+
+	do {
+		ret = __bio_iov_iter_get_pages(bio, iter);
+	} while (!ret && iov_iter_count(iter) &&
+		 bio->bi_vcnt < bio->bi_max_vecs);
+
+	return bio->bi_vcnt > orig_vcnt ? 0 : ret;
+}
+EXPORT_SYMBOL_GPL(bio_iov_iter_get_pages);
+
 struct submit_bio_ret {
 	struct completion event;
 	int error;
@@ -1839,8 +1965,33 @@ mempool_t *biovec_create_pool(int pool_entries)
 	return mempool_create_slab_pool(pool_entries, bp->slab);
 }
 
+static void bioset_cache_free(struct bio_set *bs)
+{
+	int cpu;
+
+	if (!bs->cache)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct bio_alloc_cache *cache = per_cpu_ptr(bs->cache, cpu);
+
+		while (cache->free_list) {
+			struct bio *bio = cache->free_list;
+
+			cache->free_list = bio->bi_next;
+			mempool_free((void *) bio - bs->front_pad, bs->bio_pool);
+		}
+		cache->nr = 0;
+	}
+
+	free_percpu(bs->cache);
+	bs->cache = NULL;
+}
+
 void bioset_free(struct bio_set *bs)
 {
+	bioset_cache_free(bs);
+
 	if (bs->rescue_workqueue)
 		destroy_workqueue(bs->rescue_workqueue);
 
@@ -1934,6 +2085,30 @@ struct bio_set *bioset_create_nobvec(unsigned int pool_size, unsigned int front_
 }
 EXPORT_SYMBOL(bioset_create_nobvec);
 
+/**
+ * bioset_cache_create - keep freed bios of a bio_set per cpu
+ * @bs:		the bio_set
+ *
+ * Description:
+ *    Bios freed to @bs are kept on a per cpu list and handed out again by
+ *    bio_alloc_bioset() on that cpu, without going through the mempool and
+ *    slab. Meant for high IOPS users like direct IO, where every bio lives
+ *    only for the duration of one request. Bio vectors too large to be
+ *    inline in the bio are still allocated separately.
+ */
+int bioset_cache_create(struct bio_set *bs)
+{
+	if (bs->cache)
+		return 0;
+
+	bs->cache = alloc_percpu(struct bio_alloc_cache);
+	if (!bs->cache)
+		return -ENOMEM;
+
+	return 0;
+}
+EXPORT_SYMBOL(bioset_cache_create);
+
 #ifdef CONFIG_BLK_CGROUP
 
 /**
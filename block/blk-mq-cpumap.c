@@ -96,7 +96,11 @@ unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 	if (!map)
 		return NULL;
 
-	if (!blk_mq_update_queue_map(map, set->nr_hw_queues, cpu_online_mask))
+	if (set->ops->map_queues) {
+		if (!set->ops->map_queues(set, map))
+			return map;
+	} else if (!blk_mq_update_queue_map(map, set->nr_hw_queues,
+					    cpu_online_mask))
 		return map;
 
 	kfree(map);
@@ -0,0 +1,189 @@
+/*
+ * blk-mq I/O scheduler glue
+ *
+ * Requests of a queue with an I/O scheduler are allocated from per hardware
+ * queue scheduler tags, which are not limited by the depth of the device.
+ * They are merged into and ordered by the scheduler, and only get a driver
+ * tag once the scheduler hands them out for dispatch.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-sched.h"
+#include "blk-mq-tag.h"
+
+bool __blk_mq_sched_bio_merge(struct request_queue *q, struct bio *bio)
+{
+	struct elevator_queue *e = q->elevator;
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	bool ret = false;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	if (hctx->flags & BLK_MQ_F_SHOULD_MERGE)
+		ret = e->type->mq_ops.bio_merge(hctx, bio);
+	blk_mq_put_ctx(ctx);
+
+	return ret;
+}
+
+/**
+ * blk_mq_sched_try_merge - merge a bio into a request owned by a scheduler
+ * @q: the queue
+ * @rq: candidate request, adjacent to @bio
+ * @bio: the bio to merge
+ *
+ * Returns ELEVATOR_BACK_MERGE or ELEVATOR_FRONT_MERGE if @bio was merged,
+ * ELEVATOR_NO_MERGE otherwise. The scheduler has to reposition @rq after a
+ * front merge, its start sector changed.
+ */
+int blk_mq_sched_try_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	if (!blk_rq_merge_ok(rq, bio))
+		return ELEVATOR_NO_MERGE;
+
+	switch (blk_try_merge(rq, bio)) {
+	case ELEVATOR_BACK_MERGE:
+		if (bio_attempt_back_merge(q, rq, bio))
+			return ELEVATOR_BACK_MERGE;
+		break;
+	case ELEVATOR_FRONT_MERGE:
+		if (bio_attempt_front_merge(q, rq, bio))
+			return ELEVATOR_FRONT_MERGE;
+		break;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+EXPORT_SYMBOL_GPL(blk_mq_sched_try_merge);
+
+/*
+ * Pull requests from the scheduler one at a time, for as long as the
+ * driver accepts them. Leaving the rest in the scheduler keeps them
+ * available for merging and lets it pick the next one to dispatch.
+ */
+void blk_mq_sched_dispatch_requests(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e = READ_ONCE(hctx->queue->elevator);
+	LIST_HEAD(rq_list);
+
+	if (!e)
+		return;
+
+	do {
+		struct request *rq;
+
+		rq = e->type->mq_ops.dispatch_request(hctx);
+		if (!rq)
+			break;
+		list_add(&rq->queuelist, &rq_list);
+	} while (blk_mq_dispatch_rq_list(hctx, &rq_list));
+}
+
+static void blk_mq_sched_free_tags(struct blk_mq_tag_set *set,
+				   struct blk_mq_hw_ctx *hctx,
+				   unsigned int hctx_idx)
+{
+	if (hctx->sched_tags) {
+		blk_mq_free_rq_map(set, hctx->sched_tags, hctx_idx);
+		hctx->sched_tags = NULL;
+	}
+}
+
+/*
+ * Driver tags keep pointing at the scheduler request they were last
+ * assigned to. Point them back at their own requests before the scheduler
+ * requests go away, other queues sharing the tags may update them
+ * concurrently.
+ */
+static void blk_mq_sched_reset_driver_rqs(struct request_queue *q,
+					  struct blk_mq_tags *tags)
+{
+	unsigned int i;
+
+	for (i = 0; i < tags->nr_tags; i++) {
+		struct request *rq = READ_ONCE(tags->rqs[i]);
+
+		if (rq && rq != tags->static_rqs[i] && rq->q == q)
+			cmpxchg(&tags->rqs[i], rq, tags->static_rqs[i]);
+	}
+}
+
+/**
+ * blk_mq_sched_init - attach an I/O scheduler to a blk-mq queue
+ * @q: the queue, frozen and without scheduler
+ * @e: the scheduler type, the caller holds a module reference to it
+ *
+ * On success the reference is owned by the new elevator_queue.
+ */
+int blk_mq_sched_init(struct request_queue *q, struct elevator_type *e)
+{
+	struct blk_mq_tag_set *set = q->tag_set;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+	int ret;
+
+	/*
+	 * Give the scheduler more requests to pick from than the device can
+	 * take, sized like the legacy request lists.
+	 */
+	q->nr_requests = 2 * min_t(unsigned int, set->queue_depth,
+				   BLKDEV_MAX_RQ);
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		hctx->sched_tags = blk_mq_alloc_rq_map(set, i, q->nr_requests, 0);
+		if (!hctx->sched_tags) {
+			ret = -ENOMEM;
+			goto err;
+		}
+	}
+
+	ret = e->mq_ops.init_sched(q, e);
+	if (ret)
+		goto err;
+
+	return 0;
+
+err:
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_sched_free_tags(set, hctx, i);
+	q->nr_requests = set->queue_depth;
+	return ret;
+}
+
+/*
+ * Detach the I/O scheduler of a frozen queue, which means it owns no
+ * requests anymore.
+ */
+void blk_mq_sched_teardown(struct request_queue *q)
+{
+	struct blk_mq_tag_set *set = q->tag_set;
+	struct elevator_queue *e = q->elevator;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (!e)
+		return;
+
+	if (e->registered)
+		elv_unregister_queue(q);
+
+	/* Wait for queue runs that may still be looking at the scheduler */
+	WRITE_ONCE(q->elevator, NULL);
+	synchronize_rcu();
+
+	elevator_exit(e);
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (hctx->tags)
+			blk_mq_sched_reset_driver_rqs(q, hctx->tags);
+		blk_mq_sched_free_tags(set, hctx, i);
+	}
+
+	q->nr_requests = set->queue_depth;
+}
@@ -0,0 +1,74 @@
+#ifndef INT_BLK_MQ_SCHED_H
+#define INT_BLK_MQ_SCHED_H
+
+#include <linux/elevator.h>
+
+#include "blk-mq.h"
+
+int blk_mq_sched_init(struct request_queue *q, struct elevator_type *e);
+void blk_mq_sched_teardown(struct request_queue *q);
+
+bool __blk_mq_sched_bio_merge(struct request_queue *q, struct bio *bio);
+int blk_mq_sched_try_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio);
+void blk_mq_sched_dispatch_requests(struct blk_mq_hw_ctx *hctx);
+
+static inline bool blk_mq_sched_bio_merge(struct request_queue *q,
+					  struct bio *bio)
+{
+	struct elevator_queue *e = q->elevator;
+
+	if (!e || !e->type->mq_ops.bio_merge || blk_queue_nomerges(q) ||
+	    !bio_mergeable(bio))
+		return false;
+
+	return __blk_mq_sched_bio_merge(q, bio);
+}
+
+/*
+ * Hand a request to the I/O scheduler. Returns false if the caller has to
+ * queue it itself: there is no scheduler, or the request already owns a
+ * driver tag (flushes, passthrough and requeued requests).
+ */
+static inline bool blk_mq_sched_insert_request(struct blk_mq_hw_ctx *hctx,
+					       struct request *rq,
+					       bool at_head)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+	LIST_HEAD(list);
+
+	if (!e || rq->tag != -1)
+		return false;
+
+	list_add(&rq->queuelist, &list);
+	e->type->mq_ops.insert_requests(hctx, &list, at_head);
+	return true;
+}
+
+static inline bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e;
+	bool ret = false;
+
+	/* pairs with the synchronize_rcu() in blk_mq_sched_teardown() */
+	rcu_read_lock();
+	e = READ_ONCE(hctx->queue->elevator);
+	if (e && e->type->mq_ops.has_work)
+		ret = e->type->mq_ops.has_work(hctx);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * A dispatch ran out of driver tags, rerun the queue now that one of them
+ * has been freed.
+ */
+static inline void blk_mq_sched_restart(struct blk_mq_hw_ctx *hctx)
+{
+	if (test_bit(BLK_MQ_S_SCHED_RESTART, &hctx->state) &&
+	    test_and_clear_bit(BLK_MQ_S_SCHED_RESTART, &hctx->state))
+		blk_mq_run_hw_queue(hctx, true);
+}
+
+#endif
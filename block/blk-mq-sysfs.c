@@ -247,6 +247,68 @@ static ssize_t blk_mq_hw_sysfs_cpus_show(struct blk_mq_hw_ctx *hctx, char *page)
 	return ret;
 }
 
+/*
+ * One line per size class, starting with its lower bound in bytes, and one
+ * column per latency bucket. The header has the lower bound of each bucket
+ * in usecs.
+ */
+static ssize_t blk_mq_hw_sysfs_lat_hist_show(struct blk_mq_hw_ctx *hctx,
+					     int ddir, char *page)
+{
+	unsigned int hist[BLK_MQ_SIZE_BKTS][BLK_MQ_LAT_BKTS] = { { 0, }, };
+	struct blk_mq_ctx *ctx;
+	unsigned int i, j, k;
+	ssize_t ret;
+
+	hctx_for_each_ctx(hctx, ctx, i) {
+		for (j = 0; j < BLK_MQ_SIZE_BKTS; j++)
+			for (k = 0; k < BLK_MQ_LAT_BKTS; k++)
+				hist[j][k] += READ_ONCE(ctx->lat_hist[ddir][j][k]);
+	}
+
+	ret = scnprintf(page, PAGE_SIZE, "%6s", "size");
+	for (k = 0; k < BLK_MQ_LAT_BKTS; k++)
+		ret += scnprintf(page + ret, PAGE_SIZE - ret, " %u",
+				 k ? 1U << (k - 1) : 0);
+	ret += scnprintf(page + ret, PAGE_SIZE - ret, "\n");
+
+	for (j = 0; j < BLK_MQ_SIZE_BKTS; j++) {
+		ret += scnprintf(page + ret, PAGE_SIZE - ret, "%6u",
+				 j ? 512U << j : 0);
+		for (k = 0; k < BLK_MQ_LAT_BKTS; k++)
+			ret += scnprintf(page + ret, PAGE_SIZE - ret, " %u",
+					 hist[j][k]);
+		ret += scnprintf(page + ret, PAGE_SIZE - ret, "\n");
+	}
+
+	return ret;
+}
+
+static ssize_t blk_mq_hw_sysfs_read_lat_show(struct blk_mq_hw_ctx *hctx,
+					     char *page)
+{
+	return blk_mq_hw_sysfs_lat_hist_show(hctx, READ, page);
+}
+
+static ssize_t blk_mq_hw_sysfs_write_lat_show(struct blk_mq_hw_ctx *hctx,
+					      char *page)
+{
+	return blk_mq_hw_sysfs_lat_hist_show(hctx, WRITE, page);
+}
+
+/* Writing anything clears the histograms of both directions */
+static ssize_t blk_mq_hw_sysfs_lat_hist_store(struct blk_mq_hw_ctx *hctx,
+					      const char *page, size_t count)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+
+	hctx_for_each_ctx(hctx, ctx, i)
+		memset(ctx->lat_hist, 0, sizeof(ctx->lat_hist));
+
+	return count;
+}
+
 static struct blk_mq_ctx_sysfs_entry blk_mq_sysfs_dispatched = {
 	.attr = {.name = "dispatched", .mode = S_IRUGO },
 	.show = blk_mq_sysfs_dispatched_show,
@@ -304,6 +366,16 @@ static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll = {
 	.attr = {.name = "io_poll", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_poll_show,
 };
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_read_lat = {
+	.attr = {.name = "read_lat_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_mq_hw_sysfs_read_lat_show,
+	.store = blk_mq_hw_sysfs_lat_hist_store,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_write_lat = {
+	.attr = {.name = "write_lat_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_mq_hw_sysfs_write_lat_show,
+	.store = blk_mq_hw_sysfs_lat_hist_store,
+};
 
 static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_queued.attr,
@@ -314,6 +386,8 @@ static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_cpus.attr,
 	&blk_mq_hw_sysfs_active.attr,
 	&blk_mq_hw_sysfs_poll.attr,
+	&blk_mq_hw_sysfs_read_lat.attr,
+	&blk_mq_hw_sysfs_write_lat.attr,
 	NULL,
 };
 
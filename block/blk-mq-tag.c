@@ -127,6 +127,13 @@ static inline bool hctx_may_queue(struct blk_mq_hw_ctx *hctx,
 	if (!test_bit(BLK_MQ_S_TAG_ACTIVE, &hctx->state))
 		return true;
 
+	/*
+	 * Scheduler tags are private to the queue, only the driver tags
+	 * need to be shared fairly.
+	 */
+	if (bt != &hctx->tags->bitmap_tags)
+		return true;
+
 	/*
 	 * Don't try dividing an ant
 	 */
@@ -303,12 +310,13 @@ static int bt_get(struct blk_mq_alloc_data *data,
 		data->ctx = blk_mq_get_ctx(data->q);
 		data->hctx = data->q->mq_ops->map_queue(data->q,
 				data->ctx->cpu);
+		tags = blk_mq_tags_from_data(data);
 		if (data->flags & BLK_MQ_REQ_RESERVED) {
-			bt = &data->hctx->tags->breserved_tags;
+			bt = &tags->breserved_tags;
 		} else {
-			last_tag = &data->ctx->last_tag;
+			last_tag = blk_mq_last_tag_from_data(data);
 			hctx = data->hctx;
-			bt = &hctx->tags->bitmap_tags;
+			bt = &tags->bitmap_tags;
 		}
 		finish_wait(&bs->wait, &wait);
 		bs = bt_wait_ptr(bt, hctx);
@@ -320,27 +328,28 @@ static int bt_get(struct blk_mq_alloc_data *data,
 
 static unsigned int __blk_mq_get_tag(struct blk_mq_alloc_data *data)
 {
+	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
 	int tag;
 
-	tag = bt_get(data, &data->hctx->tags->bitmap_tags, data->hctx,
-			&data->ctx->last_tag, data->hctx->tags);
+	tag = bt_get(data, &tags->bitmap_tags, data->hctx,
+			blk_mq_last_tag_from_data(data), tags);
 	if (tag >= 0)
-		return tag + data->hctx->tags->nr_reserved_tags;
+		return tag + blk_mq_tags_from_data(data)->nr_reserved_tags;
 
 	return BLK_MQ_TAG_FAIL;
 }
 
 static unsigned int __blk_mq_get_reserved_tag(struct blk_mq_alloc_data *data)
 {
+	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
 	int tag, zero = 0;
 
-	if (unlikely(!data->hctx->tags->nr_reserved_tags)) {
+	if (unlikely(!tags->nr_reserved_tags)) {
 		WARN_ON_ONCE(1);
 		return BLK_MQ_TAG_FAIL;
 	}
 
-	tag = bt_get(data, &data->hctx->tags->breserved_tags, NULL, &zero,
-		data->hctx->tags);
+	tag = bt_get(data, &tags->breserved_tags, NULL, &zero, tags);
 	if (tag < 0)
 		return BLK_MQ_TAG_FAIL;
 
@@ -401,11 +410,9 @@ static void bt_clear_tag(struct blk_mq_bitmap_tags *bt, unsigned int tag)
 	}
 }
 
-void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, unsigned int tag,
-		    unsigned int *last_tag)
+void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, struct blk_mq_tags *tags,
+		    unsigned int tag, unsigned int *last_tag)
 {
-	struct blk_mq_tags *tags = hctx->tags;
-
 	if (tag >= tags->nr_reserved_tags) {
 		const int real_tag = tag - tags->nr_reserved_tags;
 
@@ -29,11 +29,14 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-mq-sched.h"
+#include "blk-wbt.h"
 
 static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
 
 static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx);
+static int blk_mq_hctx_next_cpu(struct blk_mq_hw_ctx *hctx);
 
 /*
  * Check if any of the ctx's have pending work in this hardware queue
@@ -140,9 +143,13 @@ void blk_mq_wake_waiters(struct request_queue *q)
 	struct blk_mq_hw_ctx *hctx;
 	unsigned int i;
 
-	queue_for_each_hw_ctx(q, hctx, i)
-		if (blk_mq_hw_queue_mapped(hctx))
-			blk_mq_tag_wakeup_all(hctx->tags, true);
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hw_queue_mapped(hctx))
+			continue;
+		blk_mq_tag_wakeup_all(hctx->tags, true);
+		if (hctx->sched_tags)
+			blk_mq_tag_wakeup_all(hctx->sched_tags, true);
+	}
 
 	/*
 	 * If we are called because the queue has now been marked as
@@ -202,6 +209,9 @@ static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
 	rq->end_io = NULL;
 	rq->end_io_data = NULL;
 	rq->next_rq = NULL;
+	rq->issue_time_ns = 0;
+
+	wbt_clear_state(rq);
 
 	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
 }
@@ -214,14 +224,24 @@ __blk_mq_alloc_request(struct blk_mq_alloc_data *data, int rw)
 
 	tag = blk_mq_get_tag(data);
 	if (tag != BLK_MQ_TAG_FAIL) {
-		rq = data->hctx->tags->rqs[tag];
-
-		if (blk_mq_tag_busy(data->hctx)) {
-			rq->cmd_flags = REQ_MQ_INFLIGHT;
-			atomic_inc(&data->hctx->nr_active);
+		struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
+
+		rq = tags->static_rqs[tag];
+
+		if (data->flags & BLK_MQ_REQ_INTERNAL) {
+			/* the driver tag is only assigned at dispatch time */
+			rq->tag = -1;
+			rq->internal_tag = tag;
+		} else {
+			if (blk_mq_tag_busy(data->hctx)) {
+				rq->cmd_flags = REQ_MQ_INFLIGHT;
+				atomic_inc(&data->hctx->nr_active);
+			}
+			rq->tag = tag;
+			rq->internal_tag = -1;
+			tags->rqs[tag] = rq;
 		}
 
-		rq->tag = tag;
 		blk_mq_rq_ctx_init(data->q, data->ctx, rq, rw);
 		return rq;
 	}
@@ -266,18 +286,75 @@ struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
 }
 EXPORT_SYMBOL(blk_mq_alloc_request);
 
+/*
+ * Allocate a request that will be dispatched on a specific hardware queue,
+ * e.g. for a fabrics Connect command that has to travel on the queue it
+ * connects.  The software context is picked from the first CPU mapped to
+ * @hctx_idx so that blk_mq_insert_request() runs the same hardware queue.
+ */
+struct request *blk_mq_alloc_request_hctx(struct request_queue *q, int rw,
+		unsigned int flags, unsigned int hctx_idx)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	struct blk_mq_alloc_data alloc_data;
+	int ret;
+
+	/*
+	 * If the tag allocator sleeps we could get an allocation for a
+	 * different hardware context.  No need to complicate the low level
+	 * allocator for this for the rare use case of a command tied to
+	 * a specific queue.
+	 */
+	if (WARN_ON_ONCE(!(flags & BLK_MQ_REQ_NOWAIT)))
+		return ERR_PTR(-EINVAL);
+
+	if (hctx_idx >= q->nr_hw_queues)
+		return ERR_PTR(-EIO);
+
+	ret = blk_queue_enter(q, true);
+	if (ret)
+		return ERR_PTR(ret);
+
+	hctx = q->queue_hw_ctx[hctx_idx];
+	if (!blk_mq_hw_queue_mapped(hctx)) {
+		blk_queue_exit(q);
+		return ERR_PTR(-EXDEV);
+	}
+	ctx = __blk_mq_get_ctx(q, cpumask_first(hctx->cpumask));
+
+	blk_mq_set_alloc_data(&alloc_data, q, flags, ctx, hctx);
+	rq = __blk_mq_alloc_request(&alloc_data, rw);
+	if (!rq) {
+		blk_queue_exit(q);
+		return ERR_PTR(-EWOULDBLOCK);
+	}
+
+	return rq;
+}
+EXPORT_SYMBOL_GPL(blk_mq_alloc_request_hctx);
+
 static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
 				  struct blk_mq_ctx *ctx, struct request *rq)
 {
-	const int tag = rq->tag;
+	const int tag = rq->tag, sched_tag = rq->internal_tag;
 	struct request_queue *q = rq->q;
 
+	wbt_done(q->rq_wb, rq);
+
 	if (rq->cmd_flags & REQ_MQ_INFLIGHT)
 		atomic_dec(&hctx->nr_active);
 	rq->cmd_flags = 0;
 
 	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
-	blk_mq_put_tag(hctx, tag, &ctx->last_tag);
+	if (tag != -1) {
+		blk_mq_put_tag(hctx, hctx->tags, tag, &ctx->last_tag);
+		blk_mq_sched_restart(hctx);
+	}
+	if (sched_tag != -1)
+		blk_mq_put_tag(hctx, hctx->sched_tags, sched_tag,
+			       &ctx->last_sched_tag);
 	blk_queue_exit(q);
 }
 
@@ -356,10 +433,211 @@ static void blk_mq_ipi_complete_request(struct request *rq)
 	put_cpu();
 }
 
+/*
+ * Polling stats window, the sleep of hybrid polling is based on the mean
+ * completion time of the previous one.
+ */
+#define BLK_MQ_POLL_STATS_WINDOW	(HZ / 10)
+
+/*
+ * Size classes of completion stats, from 512 bytes and smaller to 64k and
+ * larger in powers of two. Requests without data have none.
+ */
+static int blk_mq_size_bkt(const struct request *rq)
+{
+	unsigned int bytes = blk_rq_bytes(rq);
+
+	if (!bytes)
+		return -1;
+
+	return clamp_t(int, (int)ilog2(bytes) - 9, 0, BLK_MQ_SIZE_BKTS - 1);
+}
+
+/* Poll stats buckets are split by direction and size class */
+static int blk_mq_poll_stats_bkt(const struct request *rq)
+{
+	int size = blk_mq_size_bkt(rq);
+
+	if (size < 0)
+		return -1;
+
+	return rq_data_dir(rq) + 2 * size;
+}
+
+/*
+ * Latency histogram buckets: less than 1us, then powers of two of usecs up
+ * to 2^18us and more.
+ */
+static inline int blk_mq_lat_bkt(u64 nsecs)
+{
+	u64 usecs = div_u64(nsecs, NSEC_PER_USEC);
+
+	if (!usecs)
+		return 0;
+
+	return min_t(int, ilog2(usecs) + 1, BLK_MQ_LAT_BKTS - 1);
+}
+
+static void blk_mq_poll_stats_add(struct request *rq, u64 nsecs)
+{
+	struct request_queue *q = rq->q;
+	unsigned int window = READ_ONCE(q->poll_stat_window);
+	struct blk_mq_poll_cpu_stat *stat;
+	unsigned long flags;
+	int bucket;
+
+	bucket = blk_mq_poll_stats_bkt(rq);
+	if (bucket < 0)
+		return;
+
+	local_irq_save(flags);
+	stat = &__blk_mq_get_ctx(q, smp_processor_id())->poll_stat[bucket];
+	if (stat->window != window) {
+		stat->window = window;
+		stat->total_nsec = 0;
+		stat->nr_samples = 0;
+	}
+	stat->total_nsec += nsecs;
+	stat->nr_samples++;
+	local_irq_restore(flags);
+}
+
+/*
+ * Account the completion of @rq in the latency histograms of the software
+ * queue it was submitted on, they add up to those of its hardware queue.
+ * Completions on other cpus may race with each other, so the counters are
+ * not exact, but they don't cost an atomic operation per request.
+ */
+static void blk_mq_stat_add(struct request *rq)
+{
+	u64 nsecs = ktime_get_ns() - rq->issue_time_ns;
+	int size = blk_mq_size_bkt(rq);
+
+	rq->issue_time_ns = 0;
+	if (size < 0)
+		return;
+
+	rq->mq_ctx->lat_hist[rq_data_dir(rq)][size][blk_mq_lat_bkt(nsecs)]++;
+
+	if (test_bit(QUEUE_FLAG_POLL, &rq->q->queue_flags))
+		blk_mq_poll_stats_add(rq, nsecs);
+}
+
+/*
+ * Fold the per cpu samples of the current window into q->poll_stat. Other
+ * cpus keep adding samples while we look, the stats are only a hint.
+ */
+static void blk_mq_poll_stats_fold(struct request_queue *q)
+{
+	unsigned int window = READ_ONCE(q->poll_stat_window);
+	u64 total[BLK_MQ_POLL_STATS_BKTS] = { 0, };
+	unsigned int nr[BLK_MQ_POLL_STATS_BKTS] = { 0, };
+	int cpu, bucket;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+
+		for (bucket = 0; bucket < BLK_MQ_POLL_STATS_BKTS; bucket++) {
+			struct blk_mq_poll_cpu_stat *stat = &ctx->poll_stat[bucket];
+
+			if (READ_ONCE(stat->window) != window)
+				continue;
+			total[bucket] += stat->total_nsec;
+			nr[bucket] += stat->nr_samples;
+		}
+	}
+
+	/* buckets without samples keep the mean of an older window */
+	for (bucket = 0; bucket < BLK_MQ_POLL_STATS_BKTS; bucket++) {
+		if (!nr[bucket])
+			continue;
+		q->poll_stat[bucket].mean = div_u64(total[bucket], nr[bucket]);
+		q->poll_stat[bucket].nr_samples = nr[bucket];
+	}
+
+	WRITE_ONCE(q->poll_stat_window, window + 1);
+}
+
+static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
+				       struct request *rq)
+{
+	unsigned long expires = READ_ONCE(q->poll_stat_expires);
+	int bucket;
+
+	/* one poller folds the stats, the others use the previous ones */
+	if (time_after_eq(jiffies, expires) &&
+	    cmpxchg(&q->poll_stat_expires, expires,
+		    jiffies + BLK_MQ_POLL_STATS_WINDOW) == expires)
+		blk_mq_poll_stats_fold(q);
+
+	bucket = blk_mq_poll_stats_bkt(rq);
+	if (bucket < 0 || !q->poll_stat[bucket].nr_samples)
+		return 0;
+
+	/*
+	 * Sleeping for half the mean completion time leaves us some margin
+	 * for completions that come in early.
+	 */
+	return (q->poll_stat[bucket].mean + 1) / 2;
+}
+
+/**
+ * blk_mq_poll_hybrid_sleep - sleep before polling for a request
+ * @q: the queue
+ * @rq: the request polled for
+ *
+ * Sleeps once per request, for q->poll_nsec or half the expected
+ * completion time of @rq. Returns true if it slept, the caller should then
+ * check for completion before polling.
+ */
+bool blk_mq_poll_hybrid_sleep(struct request_queue *q, struct request *rq)
+{
+	struct hrtimer_sleeper hs;
+	enum hrtimer_mode mode;
+	unsigned long nsecs;
+
+	if (q->poll_nsec < 0 || !rq ||
+	    test_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags))
+		return false;
+
+	if (q->poll_nsec > 0)
+		nsecs = q->poll_nsec;
+	else
+		nsecs = blk_mq_poll_nsecs(q, rq);
+
+	if (!nsecs)
+		return false;
+
+	set_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+
+	mode = HRTIMER_MODE_REL;
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, mode);
+	hrtimer_set_expires(&hs.timer, ns_to_ktime(nsecs));
+	hrtimer_init_sleeper(&hs, current);
+
+	do {
+		if (test_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags))
+			break;
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		hrtimer_start_expires(&hs.timer, mode);
+		if (hs.task)
+			io_schedule();
+		hrtimer_cancel(&hs.timer);
+		mode = HRTIMER_MODE_ABS;
+	} while (hs.task && !signal_pending(current));
+
+	__set_current_state(TASK_RUNNING);
+	destroy_hrtimer_on_stack(&hs.timer);
+	return true;
+}
+
 static void __blk_mq_complete_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
 
+	if (rq->issue_time_ns)
+		blk_mq_stat_add(rq);
+
 	if (!q->softirq_done_fn)
 		blk_mq_end_request(rq, rq->errors);
 	else
@@ -404,6 +682,11 @@ void blk_mq_start_request(struct request *rq)
 		rq->next_rq->resid_len = blk_rq_bytes(rq->next_rq);
 
 	blk_add_timer(rq);
+	wbt_issue(q->rq_wb, rq);
+
+	rq->issue_time_ns = ktime_get_ns();
+	if (test_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags))
+		clear_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
 
 	/*
 	 * Ensure that ->deadline is visible before set the started
@@ -722,43 +1005,43 @@ static void flush_busy_ctxs(struct blk_mq_hw_ctx *hctx, struct list_head *list)
 }
 
 /*
- * Run this hardware queue, pulling any software queues mapped to it in.
- * Note that this function currently has various problems around ordering
- * of IO. In particular, we'd like FIFO behaviour on handling existing
- * items on the hctx->dispatch list. Ignore that for now.
+ * Assign a driver tag to a request handed out by the I/O scheduler. Requests
+ * that were allocated straight from the driver tags already own one.
  */
-static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+bool blk_mq_get_driver_tag(struct request *rq, struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_mq_alloc_data data;
+
+	if (rq->tag != -1)
+		return true;
+
+	blk_mq_set_alloc_data(&data, rq->q, BLK_MQ_REQ_NOWAIT, rq->mq_ctx, hctx);
+	rq->tag = blk_mq_get_tag(&data);
+	if (rq->tag < 0)
+		return false;
+
+	if (blk_mq_tag_busy(hctx)) {
+		rq->cmd_flags |= REQ_MQ_INFLIGHT;
+		atomic_inc(&hctx->nr_active);
+	}
+	hctx->tags->rqs[rq->tag] = rq;
+	return true;
+}
+
+/*
+ * Send the requests on @list to the driver. Anything the driver could not
+ * take is moved to hctx->dispatch. Returns true if the whole list was
+ * consumed.
+ */
+bool blk_mq_dispatch_rq_list(struct blk_mq_hw_ctx *hctx, struct list_head *list)
 {
 	struct request_queue *q = hctx->queue;
 	struct request *rq;
-	LIST_HEAD(rq_list);
 	LIST_HEAD(driver_list);
 	struct list_head *dptr;
+	bool no_tag = false;
 	int queued;
 
-	WARN_ON(!cpumask_test_cpu(raw_smp_processor_id(), hctx->cpumask));
-
-	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
-		return;
-
-	hctx->run++;
-
-	/*
-	 * Touch any software queue that has pending entries.
-	 */
-	flush_busy_ctxs(hctx, &rq_list);
-
-	/*
-	 * If we have previous entries on our dispatch list, grab them
-	 * and stuff them at the front for more fair dispatch.
-	 */
-	if (!list_empty_careful(&hctx->dispatch)) {
-		spin_lock(&hctx->lock);
-		if (!list_empty(&hctx->dispatch))
-			list_splice_init(&hctx->dispatch, &rq_list);
-		spin_unlock(&hctx->lock);
-	}
-
 	/*
 	 * Start off with dptr being NULL, so we start the first request
 	 * immediately, even if we have more pending.
@@ -769,16 +1052,29 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	 * Now process all the entries, sending them to the driver.
 	 */
 	queued = 0;
-	while (!list_empty(&rq_list)) {
+	while (!list_empty(list)) {
 		struct blk_mq_queue_data bd;
 		int ret;
 
-		rq = list_first_entry(&rq_list, struct request, queuelist);
+		rq = list_first_entry(list, struct request, queuelist);
+		if (!blk_mq_get_driver_tag(rq, hctx)) {
+			/*
+			 * The completion of one of our requests reruns the
+			 * queue. Set the flag before retrying, so a completion
+			 * racing with us can't be missed.
+			 */
+			set_bit(BLK_MQ_S_SCHED_RESTART, &hctx->state);
+			if (!blk_mq_get_driver_tag(rq, hctx)) {
+				no_tag = true;
+				break;
+			}
+			clear_bit(BLK_MQ_S_SCHED_RESTART, &hctx->state);
+		}
 		list_del_init(&rq->queuelist);
 
 		bd.rq = rq;
 		bd.list = dptr;
-		bd.last = list_empty(&rq_list);
+		bd.last = list_empty(list);
 
 		ret = q->mq_ops->queue_rq(hctx, &bd);
 		switch (ret) {
@@ -786,7 +1082,7 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 			queued++;
 			continue;
 		case BLK_MQ_RQ_QUEUE_BUSY:
-			list_add(&rq->queuelist, &rq_list);
+			list_add(&rq->queuelist, list);
 			__blk_mq_requeue_request(rq);
 			break;
 		default:
@@ -804,7 +1100,7 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 		 * We've done the first request. If we have more than 1
 		 * left in the list, set dptr to defer issue.
 		 */
-		if (!dptr && rq_list.next != rq_list.prev)
+		if (!dptr && list->next != list->prev)
 			dptr = &driver_list;
 	}
 
@@ -813,25 +1109,84 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	else if (queued < (1 << (BLK_MQ_MAX_DISPATCH_ORDER - 1)))
 		hctx->dispatched[ilog2(queued) + 1]++;
 
+	if (list_empty(list))
+		return true;
+
 	/*
 	 * Any items that need requeuing? Stuff them into hctx->dispatch,
 	 * that is where we will continue on next queue run.
 	 */
-	if (!list_empty(&rq_list)) {
+	spin_lock(&hctx->lock);
+	list_splice_init(list, &hctx->dispatch);
+	spin_unlock(&hctx->lock);
+
+	if (no_tag) {
+		/*
+		 * Tags freed by other queues sharing the tag map don't
+		 * restart us, poll for them instead.
+		 */
+		if (hctx->flags & BLK_MQ_F_TAG_SHARED)
+			kblockd_schedule_delayed_work_on(
+					blk_mq_hctx_next_cpu(hctx),
+					&hctx->run_work, 1);
+		return false;
+	}
+
+	/*
+	 * the queue is expected stopped with BLK_MQ_RQ_QUEUE_BUSY, but
+	 * it's possible the queue is stopped and restarted again
+	 * before this. Queue restart will dispatch requests. And since
+	 * requests in rq_list aren't added into hctx->dispatch yet,
+	 * the requests in rq_list might get lost.
+	 *
+	 * blk_mq_run_hw_queue() already checks the STOPPED bit
+	 **/
+	blk_mq_run_hw_queue(hctx, true);
+	return false;
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	LIST_HEAD(rq_list);
+
+	WARN_ON(!cpumask_test_cpu(raw_smp_processor_id(), hctx->cpumask));
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	flush_busy_ctxs(hctx, &rq_list);
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
 		spin_lock(&hctx->lock);
-		list_splice(&rq_list, &hctx->dispatch);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
 		spin_unlock(&hctx->lock);
-		/*
-		 * the queue is expected stopped with BLK_MQ_RQ_QUEUE_BUSY, but
-		 * it's possible the queue is stopped and restarted again
-		 * before this. Queue restart will dispatch requests. And since
-		 * requests in rq_list aren't added into hctx->dispatch yet,
-		 * the requests in rq_list might get lost.
-		 *
-		 * blk_mq_run_hw_queue() already checks the STOPPED bit
-		 **/
-		blk_mq_run_hw_queue(hctx, true);
 	}
+
+	/*
+	 * Requests that bypass the I/O scheduler go first, the scheduler is
+	 * only asked for more while the driver keeps accepting them. The
+	 * RCU read side protects the scheduler against being switched.
+	 */
+	rcu_read_lock();
+	if (blk_mq_dispatch_rq_list(hctx, &rq_list))
+		blk_mq_sched_dispatch_requests(hctx);
+	rcu_read_unlock();
 }
 
 /*
@@ -889,7 +1244,8 @@ void blk_mq_run_hw_queues(struct request_queue *q, bool async)
 
 	queue_for_each_hw_ctx(q, hctx, i) {
 		if ((!blk_mq_hctx_has_pending(hctx) &&
-		    list_empty_careful(&hctx->dispatch)) ||
+		    list_empty_careful(&hctx->dispatch) &&
+		    !blk_mq_sched_has_work(hctx)) ||
 		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
 			continue;
 
@@ -1013,9 +1369,11 @@ void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue,
 
 	hctx = q->mq_ops->map_queue(q, ctx->cpu);
 
-	spin_lock(&ctx->lock);
-	__blk_mq_insert_request(hctx, rq, at_head);
-	spin_unlock(&ctx->lock);
+	if (!blk_mq_sched_insert_request(hctx, rq, at_head)) {
+		spin_lock(&ctx->lock);
+		__blk_mq_insert_request(hctx, rq, at_head);
+		spin_unlock(&ctx->lock);
+	}
 
 	if (run_queue)
 		blk_mq_run_hw_queue(hctx, async);
@@ -1041,6 +1399,19 @@ static void blk_mq_insert_requests(struct request_queue *q,
 		ctx = current_ctx;
 	hctx = q->mq_ops->map_queue(q, ctx->cpu);
 
+	/*
+	 * Plugged requests of a queue with an I/O scheduler were all
+	 * allocated from the scheduler tags, hand them over in one go.
+	 */
+	if (q->elevator) {
+		struct request *rq;
+
+		list_for_each_entry(rq, list, queuelist)
+			rq->mq_ctx = ctx;
+		q->elevator->type->mq_ops.insert_requests(hctx, list, false);
+		goto run_queue;
+	}
+
 	/*
 	 * preemption doesn't flush plug list, so it's possible ctx->cpu is
 	 * offline now
@@ -1057,6 +1428,7 @@ static void blk_mq_insert_requests(struct request_queue *q,
 	blk_mq_hctx_mark_pending(hctx, ctx);
 	spin_unlock(&ctx->lock);
 
+run_queue:
 	blk_mq_run_hw_queue(hctx, from_schedule);
 	blk_mq_put_ctx(current_ctx);
 }
@@ -1171,6 +1543,7 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 	struct request *rq;
 	int rw = bio_data_dir(bio);
 	struct blk_mq_alloc_data alloc_data;
+	unsigned int flags = 0;
 
 	blk_queue_enter_live(q);
 	ctx = blk_mq_get_ctx(q);
@@ -1179,8 +1552,16 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 	if (rw_is_sync(bio->bi_rw))
 		rw |= REQ_SYNC;
 
+	/*
+	 * Flushes are sequenced by the flush machinery, not by the I/O
+	 * scheduler, so they take a driver tag right away.
+	 */
+	if (q->elevator && !(bio->bi_rw & (REQ_FLUSH | REQ_FUA)))
+		flags |= BLK_MQ_REQ_INTERNAL;
+
 	trace_block_getrq(q, bio, rw);
-	blk_mq_set_alloc_data(&alloc_data, q, BLK_MQ_REQ_NOWAIT, ctx, hctx);
+	blk_mq_set_alloc_data(&alloc_data, q, flags | BLK_MQ_REQ_NOWAIT, ctx,
+			      hctx);
 	rq = __blk_mq_alloc_request(&alloc_data, rw);
 	if (unlikely(!rq)) {
 		__blk_mq_run_hw_queue(hctx);
@@ -1189,7 +1570,7 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 
 		ctx = blk_mq_get_ctx(q);
 		hctx = q->mq_ops->map_queue(q, ctx->cpu);
-		blk_mq_set_alloc_data(&alloc_data, q, 0, ctx, hctx);
+		blk_mq_set_alloc_data(&alloc_data, q, flags, ctx, hctx);
 		rq = __blk_mq_alloc_request(&alloc_data, rw);
 		ctx = alloc_data.ctx;
 		hctx = alloc_data.hctx;
@@ -1201,6 +1582,16 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 	return rq;
 }
 
+static inline blk_qc_t request_to_qc_t(struct blk_mq_hw_ctx *hctx,
+				       struct request *rq)
+{
+	/* Requests owned by the I/O scheduler have no driver tag to poll */
+	if (rq->tag == -1)
+		return BLK_QC_T_NONE;
+
+	return blk_tag_to_qc_t(rq->tag, hctx->queue_num);
+}
+
 static int blk_mq_direct_issue_request(struct request *rq, blk_qc_t *cookie)
 {
 	int ret;
@@ -1252,6 +1643,7 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	struct blk_plug *plug;
 	struct request *same_queue_rq = NULL;
 	blk_qc_t cookie;
+	bool wb_acct;
 
 	blk_queue_bounce(q, &bio);
 
@@ -1269,11 +1661,21 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	} else
 		request_count = blk_plug_queued_count(q);
 
+	if (!is_flush_fua && blk_mq_sched_bio_merge(q, bio))
+		return BLK_QC_T_NONE;
+
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return BLK_QC_T_NONE;
+	}
 
-	cookie = blk_tag_to_qc_t(rq->tag, data.hctx->queue_num);
+	wbt_track(rq, wb_acct);
+
+	cookie = request_to_qc_t(data.hctx, rq);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1282,6 +1684,31 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	}
 
 	plug = current->plug;
+	if (q->elevator) {
+		/*
+		 * Leave the ordering to the I/O scheduler. Plugged requests
+		 * are handed to it in a batch when the plug is flushed.
+		 */
+		blk_mq_bio_to_request(rq, bio);
+		if (!plug) {
+			blk_mq_sched_insert_request(data.hctx, rq, false);
+			goto run_queue;
+		}
+
+		if (!request_count)
+			trace_block_plug(q);
+
+		blk_mq_put_ctx(data.ctx);
+
+		if (request_count >= BLK_MAX_REQUEST_COUNT) {
+			blk_flush_plug_list(plug, false);
+			trace_block_plug(q);
+		}
+
+		list_add_tail(&rq->queuelist, &plug->mq_list);
+		goto done;
+	}
+
 	/*
 	 * If the driver supports defer issued based on 'last', then
 	 * queue it up like normal since we can potentially save some
@@ -1348,6 +1775,7 @@ static blk_qc_t blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	struct blk_map_ctx data;
 	struct request *rq;
 	blk_qc_t cookie;
+	bool wb_acct;
 
 	blk_queue_bounce(q, &bio);
 
@@ -1362,11 +1790,21 @@ static blk_qc_t blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	    blk_attempt_plug_merge(q, bio, &request_count, NULL))
 		return BLK_QC_T_NONE;
 
+	if (!is_flush_fua && blk_mq_sched_bio_merge(q, bio))
+		return BLK_QC_T_NONE;
+
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return BLK_QC_T_NONE;
+	}
 
-	cookie = blk_tag_to_qc_t(rq->tag, data.hctx->queue_num);
+	wbt_track(rq, wb_acct);
+
+	cookie = request_to_qc_t(data.hctx, rq);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1396,6 +1834,12 @@ static blk_qc_t blk_sq_make_request(struct request_queue *q, struct bio *bio)
 		return cookie;
 	}
 
+	if (q->elevator) {
+		blk_mq_bio_to_request(rq, bio);
+		blk_mq_sched_insert_request(data.hctx, rq, false);
+		goto run_queue;
+	}
+
 	if (!blk_mq_merge_queue_io(data.hctx, data.ctx, rq, bio)) {
 		/*
 		 * For a SYNC request, send it to the hardware immediately. For
@@ -1420,20 +1864,20 @@ struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
 }
 EXPORT_SYMBOL(blk_mq_map_queue);
 
-static void blk_mq_free_rq_map(struct blk_mq_tag_set *set,
-		struct blk_mq_tags *tags, unsigned int hctx_idx)
+void blk_mq_free_rq_map(struct blk_mq_tag_set *set, struct blk_mq_tags *tags,
+			unsigned int hctx_idx)
 {
 	struct page *page;
 
-	if (tags->rqs && set->ops->exit_request) {
+	if (tags->static_rqs && set->ops->exit_request) {
 		int i;
 
 		for (i = 0; i < tags->nr_tags; i++) {
-			if (!tags->rqs[i])
+			if (!tags->static_rqs[i])
 				continue;
-			set->ops->exit_request(set->driver_data, tags->rqs[i],
-						hctx_idx, i);
-			tags->rqs[i] = NULL;
+			set->ops->exit_request(set->driver_data,
+					       tags->static_rqs[i], hctx_idx, i);
+			tags->static_rqs[i] = NULL;
 		}
 	}
 
@@ -1442,13 +1886,14 @@ static void blk_mq_free_rq_map(struct blk_mq_tag_set *set,
 		list_del_init(&page->lru);
 		/*
 		 * Remove kmemleak object previously allocated in
-		 * blk_mq_init_rq_map().
+		 * blk_mq_alloc_rq_map().
 		 */
 		kmemleak_free(page_address(page));
 		__free_pages(page, page->private);
 	}
 
 	kfree(tags->rqs);
+	kfree(tags->static_rqs);
 
 	blk_mq_free_tags(tags);
 }
@@ -1458,22 +1903,28 @@ static size_t order_to_size(unsigned int order)
 	return (size_t)PAGE_SIZE << order;
 }
 
-static struct blk_mq_tags *blk_mq_init_rq_map(struct blk_mq_tag_set *set,
-		unsigned int hctx_idx)
+/*
+ * Allocate a tag map of @depth tags along with the requests backing it. The
+ * driver tags use the depth of the tag set, the I/O scheduler allocates its
+ * own map per hardware queue.
+ */
+struct blk_mq_tags *blk_mq_alloc_rq_map(struct blk_mq_tag_set *set,
+					unsigned int hctx_idx,
+					unsigned int depth,
+					unsigned int reserved_tags)
 {
 	struct blk_mq_tags *tags;
 	unsigned int i, j, entries_per_page, max_order = 4;
 	size_t rq_size, left;
 
-	tags = blk_mq_init_tags(set->queue_depth, set->reserved_tags,
-				set->numa_node,
+	tags = blk_mq_init_tags(depth, reserved_tags, set->numa_node,
 				BLK_MQ_FLAG_TO_ALLOC_POLICY(set->flags));
 	if (!tags)
 		return NULL;
 
 	INIT_LIST_HEAD(&tags->page_list);
 
-	tags->rqs = kzalloc_node(set->queue_depth * sizeof(struct request *),
+	tags->rqs = kzalloc_node(depth * sizeof(struct request *),
 				 GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY,
 				 set->numa_node);
 	if (!tags->rqs) {
@@ -1481,15 +1932,24 @@ static struct blk_mq_tags *blk_mq_init_rq_map(struct blk_mq_tag_set *set,
 		return NULL;
 	}
 
+	tags->static_rqs = kzalloc_node(depth * sizeof(struct request *),
+					GFP_KERNEL | __GFP_NOWARN |
+					__GFP_NORETRY, set->numa_node);
+	if (!tags->static_rqs) {
+		kfree(tags->rqs);
+		blk_mq_free_tags(tags);
+		return NULL;
+	}
+
 	/*
 	 * rq_size is the size of the request plus driver payload, rounded
 	 * to the cacheline size
 	 */
 	rq_size = round_up(sizeof(struct request) + set->cmd_size,
 				cache_line_size());
-	left = rq_size * set->queue_depth;
+	left = rq_size * depth;
 
-	for (i = 0; i < set->queue_depth; ) {
+	for (i = 0; i < depth; ) {
 		int this_order = max_order;
 		struct page *page;
 		int to_do;
@@ -1523,18 +1983,19 @@ static struct blk_mq_tags *blk_mq_init_rq_map(struct blk_mq_tag_set *set,
 		 */
 		kmemleak_alloc(p, order_to_size(this_order), 1, GFP_KERNEL);
 		entries_per_page = order_to_size(this_order) / rq_size;
-		to_do = min(entries_per_page, set->queue_depth - i);
+		to_do = min(entries_per_page, depth - i);
 		left -= to_do * rq_size;
 		for (j = 0; j < to_do; j++) {
-			tags->rqs[i] = p;
+			tags->static_rqs[i] = p;
 			if (set->ops->init_request) {
 				if (set->ops->init_request(set->driver_data,
-						tags->rqs[i], hctx_idx, i,
+						tags->static_rqs[i], hctx_idx, i,
 						set->numa_node)) {
-					tags->rqs[i] = NULL;
+					tags->static_rqs[i] = NULL;
 					goto fail;
 				}
 			}
+			tags->rqs[i] = tags->static_rqs[i];
 
 			p += rq_size;
 			i++;
@@ -1830,7 +2291,9 @@ static void blk_mq_map_swqueue(struct request_queue *q,
 
 		/* unmapped hw queue can be remapped after CPU topo changed */
 		if (!set->tags[i])
-			set->tags[i] = blk_mq_init_rq_map(set, i);
+			set->tags[i] = blk_mq_alloc_rq_map(set, i,
+							   set->queue_depth,
+							   set->reserved_tags);
 		hctx->tags = set->tags[i];
 		WARN_ON(!hctx->tags);
 
@@ -2100,6 +2563,7 @@ void blk_mq_free_queue(struct request_queue *q)
 
 	blk_mq_del_queue_tag_set(q);
 
+	blk_mq_sched_teardown(q);
 	blk_mq_exit_hw_queues(q, set, set->nr_hw_queues);
 	blk_mq_free_hw_queues(q, set);
 }
@@ -2112,7 +2576,10 @@ static void blk_mq_queue_reinit(struct request_queue *q,
 
 	blk_mq_sysfs_unregister(q);
 
-	blk_mq_update_queue_map(q->mq_map, q->nr_hw_queues, online_mask);
+	/* a driver provided map already covers all possible CPUs */
+	if (!q->tag_set->ops->map_queues)
+		blk_mq_update_queue_map(q->mq_map, q->nr_hw_queues,
+					online_mask);
 
 	/*
 	 * redo blk_mq_init_cpu_queues and blk_mq_init_hw_queues. FIXME: maybe
@@ -2203,7 +2670,8 @@ static int __blk_mq_alloc_rq_maps(struct blk_mq_tag_set *set)
 	int i;
 
 	for (i = 0; i < set->nr_hw_queues; i++) {
-		set->tags[i] = blk_mq_init_rq_map(set, i);
+		set->tags[i] = blk_mq_alloc_rq_map(set, i, set->queue_depth,
+						   set->reserved_tags);
 		if (!set->tags[i])
 			goto out_unwind;
 	}
@@ -2338,14 +2806,24 @@ int blk_mq_update_nr_requests(struct request_queue *q, unsigned int nr)
 	struct blk_mq_hw_ctx *hctx;
 	int i, ret;
 
-	if (!set || nr > set->queue_depth)
+	if (!set)
+		return -EINVAL;
+
+	/*
+	 * With an I/O scheduler attached nr_requests sizes the scheduler
+	 * tags, bounded by the depth they were allocated with.
+	 */
+	if (!q->elevator && nr > set->queue_depth)
 		return -EINVAL;
 
 	ret = 0;
 	queue_for_each_hw_ctx(q, hctx, i) {
 		if (!hctx->tags)
 			continue;
-		ret = blk_mq_tag_update_depth(hctx->tags, nr);
+		if (hctx->sched_tags)
+			ret = blk_mq_tag_update_depth(hctx->sched_tags, nr);
+		else
+			ret = blk_mq_tag_update_depth(hctx->tags, nr);
 		if (ret)
 			break;
 	}
@@ -2370,6 +2848,20 @@ void blk_mq_update_nr_hw_queues(struct blk_mq_tag_set *set, int nr_hw_queues)
 
 	set->nr_hw_queues = nr_hw_queues;
 	list_for_each_entry(q, &set->tag_list, tag_set_list) {
+		struct elevator_type *e = NULL;
+		bool registered = false;
+
+		/*
+		 * The scheduler state is per hardware queue, so detach it
+		 * while they are reallocated and set it up again after.
+		 */
+		if (q->elevator) {
+			e = q->elevator->type;
+			registered = q->elevator->registered;
+			__module_get(e->elevator_owner);
+			blk_mq_sched_teardown(q);
+		}
+
 		blk_mq_realloc_hw_ctxs(set, q);
 
 		if (q->nr_hw_queues > 1)
@@ -2377,7 +2869,20 @@ void blk_mq_update_nr_hw_queues(struct blk_mq_tag_set *set, int nr_hw_queues)
 		else
 			blk_queue_make_request(q, blk_sq_make_request);
 
+		/* the driver map changes with the number of queues */
+		if (set->ops->map_queues) {
+			memset(q->mq_map, 0, sizeof(*q->mq_map) * nr_cpu_ids);
+			set->ops->map_queues(set, q->mq_map);
+		}
 		blk_mq_queue_reinit(q, cpu_online_mask);
+
+		if (e && blk_mq_sched_init(q, e)) {
+			pr_warn("%s: failed to restore I/O scheduler %s\n",
+				__func__, e->elevator_name);
+			module_put(e->elevator_owner);
+		} else if (registered) {
+			elv_register_queue(q);
+		}
 	}
 
 	list_for_each_entry(q, &set->tag_list, tag_set_list)
@@ -3,6 +3,18 @@
 
 struct blk_mq_tag_set;
 
+#define BLK_MQ_SIZE_BKTS	8
+#define BLK_MQ_LAT_BKTS		20
+
+/*
+ * Polled completion times seen by one cpu in the current stats window
+ */
+struct blk_mq_poll_cpu_stat {
+	u64			total_nsec;
+	unsigned int		nr_samples;
+	unsigned int		window;
+};
+
 struct blk_mq_ctx {
 	struct {
 		spinlock_t		lock;
@@ -13,6 +25,7 @@ struct blk_mq_ctx {
 	unsigned int		index_hw;
 
 	unsigned int		last_tag ____cacheline_aligned_in_smp;
+	unsigned int		last_sched_tag;
 
 	/* incremented at dispatch time */
 	unsigned long		rq_dispatched[2];
@@ -20,12 +33,16 @@ struct blk_mq_ctx {
 
 	/* incremented at completion time */
 	unsigned long		____cacheline_aligned_in_smp rq_completed[2];
+	struct blk_mq_poll_cpu_stat poll_stat[BLK_MQ_POLL_STATS_BKTS];
+	/* completion latencies by direction and size class */
+	unsigned int		lat_hist[2][BLK_MQ_SIZE_BKTS][BLK_MQ_LAT_BKTS];
 
 	struct request_queue	*queue;
 	struct kobject		kobj;
 } ____cacheline_aligned_in_smp;
 
 void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async);
+bool blk_mq_poll_hybrid_sleep(struct request_queue *q, struct request *rq);
 void blk_mq_freeze_queue(struct request_queue *q);
 void blk_mq_free_queue(struct request_queue *q);
 int blk_mq_update_nr_requests(struct request_queue *q, unsigned int nr);
@@ -63,6 +80,18 @@ extern void blk_mq_rq_timed_out(struct request *req, bool reserved);
 
 void blk_mq_release(struct request_queue *q);
 
+/*
+ * Request maps and dispatch, shared with the I/O scheduler glue
+ */
+struct blk_mq_tags *blk_mq_alloc_rq_map(struct blk_mq_tag_set *set,
+					unsigned int hctx_idx,
+					unsigned int depth,
+					unsigned int reserved_tags);
+void blk_mq_free_rq_map(struct blk_mq_tag_set *set, struct blk_mq_tags *tags,
+			unsigned int hctx_idx);
+bool blk_mq_get_driver_tag(struct request *rq, struct blk_mq_hw_ctx *hctx);
+bool blk_mq_dispatch_rq_list(struct blk_mq_hw_ctx *hctx, struct list_head *list);
+
 /*
  * Basic implementation of sparser bitmap, allowing the user to spread
  * the bits over more cachelines.
@@ -114,6 +143,24 @@ static inline void blk_mq_set_alloc_data(struct blk_mq_alloc_data *data,
 	data->hctx = hctx;
 }
 
+static inline struct blk_mq_tags *
+blk_mq_tags_from_data(struct blk_mq_alloc_data *data)
+{
+	if (data->flags & BLK_MQ_REQ_INTERNAL)
+		return data->hctx->sched_tags;
+
+	return data->hctx->tags;
+}
+
+static inline unsigned int *
+blk_mq_last_tag_from_data(struct blk_mq_alloc_data *data)
+{
+	if (data->flags & BLK_MQ_REQ_INTERNAL)
+		return &data->ctx->last_sched_tag;
+
+	return &data->ctx->last_tag;
+}
+
 static inline bool blk_mq_hw_queue_mapped(struct blk_mq_hw_ctx *hctx)
 {
 	return hctx->nr_ctx && hctx->tags;
@@ -0,0 +1,357 @@
+/*
+ * Writeback throttling
+ *
+ * Buffered writeback can fill the device queue with async writes, and
+ * reads and sync writes then queue up behind them. Limit the number of
+ * async writes in flight per queue, and scale that limit based on the
+ * completion latency of reads: when even the fastest read of a window
+ * missed the target, halve the depth allowed to async writes, and go back
+ * up one step per window in which reads were fast, or didn't happen.
+ *
+ * The target is set through /sys/block/<dev>/queue/wbt_lat_usec, 0 turns
+ * throttling off.
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/swap.h>
+
+#include "blk.h"
+#include "blk-wbt.h"
+
+/* default read latency targets */
+#define WBT_NONROT_LAT_NSEC	(2ULL * NSEC_PER_MSEC)
+#define WBT_ROT_LAT_NSEC	(75ULL * NSEC_PER_MSEC)
+
+#define WBT_WIN_NSEC		(100ULL * NSEC_PER_MSEC)
+
+/* async writes are held to wb_contended this long after a read issue */
+#define WBT_READ_RECENT		(HZ / 10)
+
+static inline bool wbt_enabled(struct rq_wb *rwb)
+{
+	return rwb && READ_ONCE(rwb->min_lat_nsec);
+}
+
+/*
+ * Sync writes are waited for by someone, and flushes and FUA writes are
+ * sequenced by the flush machinery, only throttle plain async writes.
+ */
+static inline bool wbt_should_throttle(unsigned long rw)
+{
+	return (rw & (REQ_WRITE | REQ_SYNC | REQ_DISCARD | REQ_FLUSH |
+		      REQ_FUA)) == REQ_WRITE;
+}
+
+static void wbt_calc_limits(struct rq_wb *rwb)
+{
+	unsigned int depth = max(1U, rwb->queue_depth >> rwb->scale_step);
+
+	rwb->wb_max = depth;
+	rwb->wb_normal = (depth + 1) / 2;
+	rwb->wb_contended = (depth + 3) / 4;
+}
+
+static void wbt_arm_timer(struct rq_wb *rwb)
+{
+	mod_timer(&rwb->window_timer,
+		  jiffies + nsecs_to_jiffies(rwb->win_nsec));
+}
+
+static unsigned int wbt_get_limit(struct rq_wb *rwb)
+{
+	/* reclaim has to make progress */
+	if (current_is_kswapd())
+		return rwb->wb_max;
+
+	if (time_before(jiffies, READ_ONCE(rwb->last_read) + WBT_READ_RECENT))
+		return rwb->wb_contended;
+
+	return rwb->wb_normal;
+}
+
+static bool atomic_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static bool wbt_may_queue(struct rq_wb *rwb)
+{
+	/* throttling was turned off while we waited */
+	if (!READ_ONCE(rwb->min_lat_nsec)) {
+		atomic_inc(&rwb->inflight);
+		return true;
+	}
+
+	return atomic_inc_below(&rwb->inflight, wbt_get_limit(rwb));
+}
+
+/**
+ * wbt_wait - throttle an async write
+ * @rwb: the queue's throttling state
+ * @bio: the bio about to get a request
+ * @lock: queue lock held by the caller with irqs disabled, or NULL
+ *
+ * Sleeps until @bio is within the async write limit. Returns true if it
+ * was accounted, the caller has to pass that on with wbt_track(), or call
+ * __wbt_done() if it does not get a request after all.
+ */
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (!wbt_enabled(rwb) || !wbt_should_throttle(bio->bi_rw))
+		return false;
+
+	if (wbt_may_queue(rwb))
+		return true;
+
+	do {
+		prepare_to_wait(&rwb->wait, &wait, TASK_UNINTERRUPTIBLE);
+
+		if (wbt_may_queue(rwb))
+			break;
+
+		if (lock) {
+			spin_unlock_irq(lock);
+			io_schedule();
+			spin_lock_irq(lock);
+		} else
+			io_schedule();
+	} while (1);
+
+	finish_wait(&rwb->wait, &wait);
+	return true;
+}
+
+void __wbt_done(struct rq_wb *rwb)
+{
+	unsigned int limit = rwb->wb_normal;
+	int inflight;
+
+	inflight = atomic_dec_return(&rwb->inflight);
+	if (!waitqueue_active(&rwb->wait))
+		return;
+
+	/*
+	 * Wake up in batches, waiters woken for every completion would each
+	 * only get to queue one write.
+	 */
+	if (inflight && (inflight >= limit ||
+			 limit - inflight < max(1U, rwb->wb_contended / 2)))
+		return;
+
+	wake_up_all(&rwb->wait);
+}
+
+static void wbt_add_sample(struct rq_wb *rwb, u64 lat)
+{
+	unsigned int window = READ_ONCE(rwb->window);
+	struct wbt_cpu_stat *stat;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	stat = this_cpu_ptr(rwb->cpu_stat);
+	if (stat->window != window) {
+		stat->window = window;
+		stat->min_nsec = U64_MAX;
+		stat->nr_samples = 0;
+	}
+	if (lat < stat->min_nsec)
+		stat->min_nsec = lat;
+	stat->nr_samples++;
+	local_irq_restore(flags);
+}
+
+/*
+ * Called when @rq is freed: release its async write slot, or record its
+ * latency if it was a read.
+ */
+void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb)
+		return;
+
+	if (rq->wbt_flags & WBT_TRACKED)
+		__wbt_done(rwb);
+	else if (rq->wbt_issue_ns)
+		wbt_add_sample(rwb, ktime_get_ns() - rq->wbt_issue_ns);
+
+	wbt_clear_state(rq);
+}
+
+/*
+ * Called when @rq is handed to the driver
+ */
+void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+	unsigned long now = jiffies;
+
+	if (!wbt_enabled(rwb))
+		return;
+
+	if (rq->wbt_flags & WBT_TRACKED) {
+		if (!timer_pending(&rwb->window_timer))
+			wbt_arm_timer(rwb);
+		return;
+	}
+
+	if (rq->cmd_type != REQ_TYPE_FS || rq_data_dir(rq) != READ)
+		return;
+
+	rq->wbt_issue_ns = ktime_get_ns();
+	if (READ_ONCE(rwb->last_read) != now)
+		WRITE_ONCE(rwb->last_read, now);
+}
+
+static void wbt_scale_down(struct rq_wb *rwb)
+{
+	if ((rwb->queue_depth >> rwb->scale_step) <= 1)
+		return;
+
+	rwb->scale_step++;
+	wbt_calc_limits(rwb);
+}
+
+static void wbt_scale_up(struct rq_wb *rwb)
+{
+	if (!rwb->scale_step)
+		return;
+
+	rwb->scale_step--;
+	wbt_calc_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+/*
+ * Fold the per cpu read stats of the window that just ended. Samples
+ * racing with the window switch may be lost, this is only a heuristic.
+ */
+static unsigned int wbt_window_stat(struct rq_wb *rwb, u64 *min_nsec)
+{
+	unsigned int window = rwb->window, nr_samples = 0;
+	int cpu;
+
+	*min_nsec = U64_MAX;
+	for_each_possible_cpu(cpu) {
+		struct wbt_cpu_stat *stat = per_cpu_ptr(rwb->cpu_stat, cpu);
+
+		if (READ_ONCE(stat->window) != window)
+			continue;
+		nr_samples += stat->nr_samples;
+		if (stat->min_nsec < *min_nsec)
+			*min_nsec = stat->min_nsec;
+	}
+
+	WRITE_ONCE(rwb->window, window + 1);
+	return nr_samples;
+}
+
+static void wbt_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	unsigned int nr_samples;
+	u64 min_nsec;
+
+	nr_samples = wbt_window_stat(rwb, &min_nsec);
+	if (!rwb->min_lat_nsec)
+		return;
+
+	if (nr_samples && min_nsec > rwb->min_lat_nsec)
+		wbt_scale_down(rwb);
+	else
+		wbt_scale_up(rwb);
+
+	/* the next tracked write rearms us once we are idle */
+	if (rwb->scale_step || atomic_read(&rwb->inflight))
+		wbt_arm_timer(rwb);
+}
+
+void wbt_set_queue_depth(struct rq_wb *rwb, unsigned int depth)
+{
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	rwb->queue_depth = depth;
+	wbt_calc_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+void wbt_set_min_lat(struct rq_wb *rwb, u64 nsec)
+{
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	WRITE_ONCE(rwb->min_lat_nsec, nsec);
+	rwb->scale_step = 0;
+	wbt_calc_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+/**
+ * wbt_init - set up writeback throttling for a request based queue
+ * @q: the queue, with its limits and rotational flag set by the driver
+ */
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc(sizeof(*rwb), GFP_KERNEL);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->cpu_stat = alloc_percpu(struct wbt_cpu_stat);
+	if (!rwb->cpu_stat) {
+		kfree(rwb);
+		return -ENOMEM;
+	}
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wbt_timer_fn, (unsigned long) rwb);
+
+	rwb->win_nsec = WBT_WIN_NSEC;
+	if (blk_queue_nonrot(q))
+		rwb->min_lat_nsec = WBT_NONROT_LAT_NSEC;
+	else
+		rwb->min_lat_nsec = WBT_ROT_LAT_NSEC;
+	rwb->last_read = jiffies - WBT_READ_RECENT;
+	rwb->queue_depth = q->nr_requests;
+	wbt_calc_limits(rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	q->rq_wb = NULL;
+	free_percpu(rwb->cpu_stat);
+	kfree(rwb);
+}
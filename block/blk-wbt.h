@@ -0,0 +1,110 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/kernel.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
+
+enum {
+	WBT_TRACKED		= 1,	/* counted in rq_wb->inflight */
+};
+
+/*
+ * Read completion latency seen by one cpu in the current window
+ */
+struct wbt_cpu_stat {
+	u64			min_nsec;
+	unsigned int		nr_samples;
+	unsigned int		window;
+};
+
+struct rq_wb {
+	/*
+	 * Limits on in flight async writes, shrunk by scale_step as long
+	 * as reads miss their latency target. wb_contended applies while
+	 * reads are being issued, wb_max to reclaim.
+	 */
+	unsigned int		wb_contended;
+	unsigned int		wb_normal;
+	unsigned int		wb_max;
+	unsigned int		scale_step;
+	unsigned int		queue_depth;
+
+	u64			min_lat_nsec;	/* read latency target, 0 is off */
+	u64			win_nsec;	/* length of a sampling window */
+	unsigned long		last_read;	/* jiffies of last read issue */
+
+	struct timer_list	window_timer;
+	unsigned int		window;
+	struct wbt_cpu_stat __percpu *cpu_stat;
+
+	atomic_t		inflight;
+	wait_queue_head_t	wait;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+int wbt_init(struct request_queue *q);
+void wbt_exit(struct request_queue *q);
+
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock);
+void __wbt_done(struct rq_wb *rwb);
+void wbt_done(struct rq_wb *rwb, struct request *rq);
+void wbt_issue(struct rq_wb *rwb, struct request *rq);
+
+void wbt_set_queue_depth(struct rq_wb *rwb, unsigned int depth);
+void wbt_set_min_lat(struct rq_wb *rwb, u64 nsec);
+
+static inline void wbt_clear_state(struct request *rq)
+{
+	rq->wbt_flags = 0;
+	rq->wbt_issue_ns = 0;
+}
+
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+	if (tracked)
+		rq->wbt_flags |= WBT_TRACKED;
+}
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline bool wbt_wait(struct rq_wb *rwb, struct bio *bio,
+			    spinlock_t *lock)
+{
+	return false;
+}
+static inline void __wbt_done(struct rq_wb *rwb)
+{
+}
+static inline void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_set_queue_depth(struct rq_wb *rwb, unsigned int depth)
+{
+}
+static inline void wbt_set_min_lat(struct rq_wb *rwb, u64 nsec)
+{
+}
+static inline void wbt_clear_state(struct request *rq)
+{
+}
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
@@ -36,9 +36,16 @@ struct skcipher_tfm {
 	bool has_key;
 };
 
+/*
+ * Number of user page lists the sync path pins and chains together, so
+ * that a single request can cover up to SKCIPHER_RSGL_MAX * ALG_MAX_PAGES
+ * pages of output instead of ALG_MAX_PAGES.
+ */
+#define SKCIPHER_RSGL_MAX	4
+
 struct skcipher_ctx {
 	struct list_head tsgl;
-	struct af_alg_sgl rsgl;
+	struct af_alg_sgl rsgl[SKCIPHER_RSGL_MAX];
 
 	void *iv;
 
@@ -646,11 +653,14 @@ static int skcipher_recvmsg_sync(struct socket *sock, struct msghdr *msg,
 	struct skcipher_sg_list *sgl;
 	struct scatterlist *sg;
 	int err = -EAGAIN;
-	int used;
+	int used, len;
 	long copied = 0;
 
 	lock_sock(sk);
 	while (msg_data_left(msg)) {
+		struct iov_iter iter;
+		int nsgl = 0, i;
+
 		if (!ctx->used) {
 			err = skcipher_wait_for_data(sk, flags);
 			if (err)
@@ -659,10 +669,26 @@ static int skcipher_recvmsg_sync(struct socket *sock, struct msghdr *msg,
 
 		used = min_t(unsigned long, ctx->used, msg_data_left(msg));
 
-		used = af_alg_make_sg(&ctx->rsgl, &msg->msg_iter, used);
-		err = used;
-		if (err < 0)
-			goto unlock;
+		/*
+		 * Pin as much of the destination as the rsgl array holds so
+		 * that it goes to the cipher as one request.  The iterator
+		 * is only advanced by what actually got processed.
+		 */
+		iter = msg->msg_iter;
+		len = 0;
+		do {
+			err = af_alg_make_sg(&ctx->rsgl[nsgl], &iter,
+					     used - len);
+			if (err < 0)
+				goto free;
+			if (nsgl)
+				af_alg_link_sg(&ctx->rsgl[nsgl - 1],
+					       &ctx->rsgl[nsgl]);
+			nsgl++;
+			len += err;
+			iov_iter_advance(&iter, err);
+		} while (len < used && nsgl < SKCIPHER_RSGL_MAX);
+		used = len;
 
 		if (ctx->more || used < ctx->used)
 			used -= used % bs;
@@ -678,8 +704,8 @@ static int skcipher_recvmsg_sync(struct socket *sock, struct msghdr *msg,
 		while (!sg->length)
 			sg++;
 
-		skcipher_request_set_crypt(&ctx->req, sg, ctx->rsgl.sg, used,
-					   ctx->iv);
+		skcipher_request_set_crypt(&ctx->req, sg, ctx->rsgl[0].sg,
+					   used, ctx->iv);
 
 		err = af_alg_wait_for_completion(
 				ctx->enc ?
@@ -688,7 +714,8 @@ static int skcipher_recvmsg_sync(struct socket *sock, struct msghdr *msg,
 				&ctx->completion);
 
 free:
-		af_alg_free_sg(&ctx->rsgl);
+		for (i = 0; i < nsgl; i++)
+			af_alg_free_sg(&ctx->rsgl[i]);
 
 		if (err)
 			goto unlock;
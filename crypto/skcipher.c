@@ -142,8 +142,8 @@ static int skcipher_setkey_ablkcipher(struct crypto_skcipher *tfm,
 	return err;
 }
 
-static int skcipher_crypt_ablkcipher(struct skcipher_request *req,
-				     int (*crypt)(struct ablkcipher_request *))
+static struct ablkcipher_request *skcipher_subreq_ablkcipher(
+	struct skcipher_request *req)
 {
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
 	struct crypto_ablkcipher **ctx = crypto_skcipher_ctx(tfm);
@@ -155,7 +155,27 @@ static int skcipher_crypt_ablkcipher(struct skcipher_request *req,
 	ablkcipher_request_set_crypt(subreq, req->src, req->dst, req->cryptlen,
 				     req->iv);
 
-	return crypt(subreq);
+	return subreq;
+}
+
+static int skcipher_crypt_ablkcipher(struct skcipher_request *req,
+				     int (*crypt)(struct ablkcipher_request *))
+{
+	return crypt(skcipher_subreq_ablkcipher(req));
+}
+
+static int skcipher_crypt_batch_ablkcipher(
+	struct skcipher_request **reqs, int *errs, unsigned int nr,
+	int (*crypt)(struct ablkcipher_request **, int *, unsigned int))
+{
+	struct ablkcipher_request *subreqs[CRYPTO_SKCIPHER_MAX_BATCH];
+	unsigned int i;
+
+	nr = min_t(unsigned int, nr, CRYPTO_SKCIPHER_MAX_BATCH);
+	for (i = 0; i < nr; i++)
+		subreqs[i] = skcipher_subreq_ablkcipher(reqs[i]);
+
+	return crypt(subreqs, errs, nr);
 }
 
 static int skcipher_encrypt_ablkcipher(struct skcipher_request *req)
@@ -176,6 +196,28 @@ static int skcipher_decrypt_ablkcipher(struct skcipher_request *req)
 	return skcipher_crypt_ablkcipher(req, alg->decrypt);
 }
 
+static int skcipher_encrypt_batch_ablkcipher(struct skcipher_request **reqs,
+					     int *errs, unsigned int nr)
+{
+	struct crypto_skcipher *skcipher = crypto_skcipher_reqtfm(reqs[0]);
+	struct crypto_tfm *tfm = crypto_skcipher_tfm(skcipher);
+	struct ablkcipher_alg *alg = &tfm->__crt_alg->cra_ablkcipher;
+
+	return skcipher_crypt_batch_ablkcipher(reqs, errs, nr,
+					       alg->encrypt_batch);
+}
+
+static int skcipher_decrypt_batch_ablkcipher(struct skcipher_request **reqs,
+					     int *errs, unsigned int nr)
+{
+	struct crypto_skcipher *skcipher = crypto_skcipher_reqtfm(reqs[0]);
+	struct crypto_tfm *tfm = crypto_skcipher_tfm(skcipher);
+	struct ablkcipher_alg *alg = &tfm->__crt_alg->cra_ablkcipher;
+
+	return skcipher_crypt_batch_ablkcipher(reqs, errs, nr,
+					       alg->decrypt_batch);
+}
+
 static void crypto_exit_skcipher_ops_ablkcipher(struct crypto_tfm *tfm)
 {
 	struct crypto_ablkcipher **ctx = crypto_tfm_ctx(tfm);
@@ -207,6 +249,11 @@ static int crypto_init_skcipher_ops_ablkcipher(struct crypto_tfm *tfm)
 	skcipher->setkey = skcipher_setkey_ablkcipher;
 	skcipher->encrypt = skcipher_encrypt_ablkcipher;
 	skcipher->decrypt = skcipher_decrypt_ablkcipher;
+	if (calg->cra_ablkcipher.encrypt_batch &&
+	    calg->cra_ablkcipher.decrypt_batch) {
+		skcipher->encrypt_batch = skcipher_encrypt_batch_ablkcipher;
+		skcipher->decrypt_batch = skcipher_decrypt_batch_ablkcipher;
+	}
 
 	skcipher->ivsize = crypto_ablkcipher_ivsize(ablkcipher);
 	skcipher->reqsize = crypto_ablkcipher_reqsize(ablkcipher) +
@@ -216,6 +263,76 @@ static int crypto_init_skcipher_ops_ablkcipher(struct crypto_tfm *tfm)
 	return 0;
 }
 
+static int skcipher_crypt_each(struct skcipher_request **reqs, int *errs,
+			       unsigned int nr,
+			       int (*crypt)(struct skcipher_request *))
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		errs[i] = crypt(reqs[i]);
+		if (errs[i] && errs[i] != -EINPROGRESS)
+			return i + 1;
+	}
+
+	return nr;
+}
+
+/**
+ * crypto_skcipher_encrypt_batch() - encrypt several requests at once
+ * @reqs: requests to encrypt, all for the same cipher handle
+ * @errs: per request return values, as crypto_skcipher_encrypt() would give
+ * @nr: number of requests in @reqs
+ *
+ * Requests are started in order.  Submission stops early after a request
+ * that returns neither 0 nor -EINPROGRESS, e.g. -EBUSY when the driver
+ * backlogged it, so the caller can back off before resubmitting the rest.
+ * An implementation may also take fewer than @nr requests at a time.
+ *
+ * Return: number of requests consumed, at least one if @nr is not zero
+ */
+int crypto_skcipher_encrypt_batch(struct skcipher_request **reqs, int *errs,
+				  unsigned int nr)
+{
+	struct crypto_skcipher *tfm;
+
+	if (!nr)
+		return 0;
+
+	tfm = crypto_skcipher_reqtfm(reqs[0]);
+	if (tfm->encrypt_batch)
+		return tfm->encrypt_batch(reqs, errs, nr);
+
+	return skcipher_crypt_each(reqs, errs, nr, tfm->encrypt);
+}
+EXPORT_SYMBOL_GPL(crypto_skcipher_encrypt_batch);
+
+/**
+ * crypto_skcipher_decrypt_batch() - decrypt several requests at once
+ * @reqs: requests to decrypt, all for the same cipher handle
+ * @errs: per request return values, as crypto_skcipher_decrypt() would give
+ * @nr: number of requests in @reqs
+ *
+ * See crypto_skcipher_encrypt_batch().
+ *
+ * Return: number of requests consumed, at least one if @nr is not zero
+ */
+int crypto_skcipher_decrypt_batch(struct skcipher_request **reqs, int *errs,
+				  unsigned int nr)
+{
+	struct crypto_skcipher *tfm;
+
+	if (!nr)
+		return 0;
+
+	tfm = crypto_skcipher_reqtfm(reqs[0]);
+	if (tfm->decrypt_batch)
+		return tfm->decrypt_batch(reqs, errs, nr);
+
+	return skcipher_crypt_each(reqs, errs, nr, tfm->decrypt);
+}
+EXPORT_SYMBOL_GPL(crypto_skcipher_decrypt_batch);
+
 static int crypto_skcipher_init_tfm(struct crypto_tfm *tfm)
 {
 	if (tfm->__crt_alg->cra_type == &crypto_blkcipher_type)
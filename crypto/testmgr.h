@@ -33507,4 +33507,97 @@ static struct comp_testvec lz4hc_decomp_tv_template[] = {
 	},
 };
 
+#define ZSTD_COMP_TEST_VECTORS 2
+#define ZSTD_DECOMP_TEST_VECTORS 2
+
+static struct comp_testvec zstd_comp_tv_template[] = {
+	{
+		.inlen	= 70,
+		.outlen	= 52,
+		.input	= "Join us now and share the software "
+			  "Join us now and share the software ",
+		.output	= "\x28\xb5\x2f\xfd\x20\x46\x5d\x01"
+			  "\x00\x34\x02\x4a\x6f\x69\x6e\x20"
+			  "\x75\x73\x20\x6e\x6f\x77\x20\x61"
+			  "\x6e\x64\x20\x73\x68\x61\x72\x65"
+			  "\x20\x74\x68\x65\x20\x73\x6f\x66"
+			  "\x74\x77\x61\x72\x65\x20\x01\x00"
+			  "\x63\x48\xf5\x04",
+	}, {
+		.inlen	= 269,
+		.outlen	= 151,
+		.input	= "This document describes a compression "
+			  "method based on the LZ77 algorithm, "
+			  "Huffman coding and finite state entropy. "
+			  "The compression method is described in "
+			  "terms of frames, blocks, literals and "
+			  "sequences. The compression method is "
+			  "described in terms of frames and blocks.",
+		.output	= "\x28\xb5\x2f\xfd\x60\x0d\x00\x6d"
+			  "\x04\x00\xe2\x4a\x1e\x18\xa0\xb5"
+			  "\x09\x80\x48\x26\xb1\x2d\x53\x34"
+			  "\x48\x21\xfb\xbb\x73\xb6\x85\xe8"
+			  "\xe1\xcb\x62\x04\x80\x9d\x00\x3d"
+			  "\x4e\x2e\xa3\x3f\xf8\x84\x70\xd5"
+			  "\x55\xda\xf7\x96\x07\x3d\x4e\x2e"
+			  "\xe3\x41\xcf\x4a\x4b\x4e\x69\x65"
+			  "\xed\x6b\x3c\x23\xbd\xab\xc2\x80"
+			  "\x02\x92\x6d\xf1\xfe\x96\x55\x7f"
+			  "\x0f\x2f\x19\x61\xb1\x81\x87\xf2"
+			  "\x18\x0b\x4b\x29\x09\x78\x60\x6a"
+			  "\xaf\xa5\xb1\x8a\x09\x62\x20\xf0"
+			  "\xd5\x1a\xd3\xe8\x5a\x8c\x51\xaa"
+			  "\x3d\x33\xe6\xa9\xbe\x21\x2c\x8f"
+			  "\x8b\xf5\xe6\xda\xd1\x23\x2f\x9e"
+			  "\x25\x27\x91\xf5\x54\x11\x05\x00"
+			  "\x49\x08\xa0\x5b\x9c\x63\x33\xc4"
+			  "\x13\x58\x81\x36\x48\x87\x33",
+	},
+};
+
+static struct comp_testvec zstd_decomp_tv_template[] = {
+	{
+		.inlen	= 52,
+		.outlen	= 70,
+		.input	= "\x28\xb5\x2f\xfd\x20\x46\x5d\x01"
+			  "\x00\x34\x02\x4a\x6f\x69\x6e\x20"
+			  "\x75\x73\x20\x6e\x6f\x77\x20\x61"
+			  "\x6e\x64\x20\x73\x68\x61\x72\x65"
+			  "\x20\x74\x68\x65\x20\x73\x6f\x66"
+			  "\x74\x77\x61\x72\x65\x20\x01\x00"
+			  "\x63\x48\xf5\x04",
+		.output	= "Join us now and share the software "
+			  "Join us now and share the software ",
+	}, {
+		.inlen	= 151,
+		.outlen	= 269,
+		.input	= "\x28\xb5\x2f\xfd\x60\x0d\x00\x6d"
+			  "\x04\x00\xe2\x4a\x1e\x18\xa0\xb5"
+			  "\x09\x80\x48\x26\xb1\x2d\x53\x34"
+			  "\x48\x21\xfb\xbb\x73\xb6\x85\xe8"
+			  "\xe1\xcb\x62\x04\x80\x9d\x00\x3d"
+			  "\x4e\x2e\xa3\x3f\xf8\x84\x70\xd5"
+			  "\x55\xda\xf7\x96\x07\x3d\x4e\x2e"
+			  "\xe3\x41\xcf\x4a\x4b\x4e\x69\x65"
+			  "\xed\x6b\x3c\x23\xbd\xab\xc2\x80"
+			  "\x02\x92\x6d\xf1\xfe\x96\x55\x7f"
+			  "\x0f\x2f\x19\x61\xb1\x81\x87\xf2"
+			  "\x18\x0b\x4b\x29\x09\x78\x60\x6a"
+			  "\xaf\xa5\xb1\x8a\x09\x62\x20\xf0"
+			  "\xd5\x1a\xd3\xe8\x5a\x8c\x51\xaa"
+			  "\x3d\x33\xe6\xa9\xbe\x21\x2c\x8f"
+			  "\x8b\xf5\xe6\xda\xd1\x23\x2f\x9e"
+			  "\x25\x27\x91\xf5\x54\x11\x05\x00"
+			  "\x49\x08\xa0\x5b\x9c\x63\x33\xc4"
+			  "\x13\x58\x81\x36\x48\x87\x33",
+		.output	= "This document describes a compression "
+			  "method based on the LZ77 algorithm, "
+			  "Huffman coding and finite state entropy. "
+			  "The compression method is described in "
+			  "terms of frames, blocks, literals and "
+			  "sequences. The compression method is "
+			  "described in terms of frames and blocks.",
+	},
+};
+
 #endif	/* _CRYPTO_TESTMGR_H */
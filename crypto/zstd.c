@@ -0,0 +1,118 @@
+/*
+ * Cryptographic API.
+ *
+ * Zstandard, at the default level.  The contexts are sized for inputs of
+ * any length; smaller inputs, such as the pages zram and zswap compress,
+ * only touch as much of the tables as they need.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/crypto.h>
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+
+struct zstd_ctx {
+	struct zstd_cctx *cctx;
+	struct zstd_dctx *dctx;
+	void *cwksp;
+	void *dwksp;
+};
+
+static int zstd_init(struct crypto_tfm *tfm)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	struct zstd_params params = zstd_get_params(ZSTD_DEFAULT_CLEVEL, 0);
+	size_t csize = zstd_cctx_workspace_size(&params);
+	size_t dsize = zstd_dctx_workspace_size();
+
+	ctx->cwksp = vmalloc(csize);
+	ctx->dwksp = vmalloc(dsize);
+	if (!ctx->cwksp || !ctx->dwksp)
+		goto err;
+
+	ctx->cctx = zstd_init_cctx(ctx->cwksp, csize, &params);
+	ctx->dctx = zstd_init_dctx(ctx->dwksp, dsize);
+	if (!ctx->cctx || !ctx->dctx)
+		goto err;
+
+	return 0;
+
+err:
+	vfree(ctx->cwksp);
+	vfree(ctx->dwksp);
+	return -ENOMEM;
+}
+
+static void zstd_exit(struct crypto_tfm *tfm)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	vfree(ctx->cwksp);
+	vfree(ctx->dwksp);
+}
+
+static int zstd_compress_crypto(struct crypto_tfm *tfm, const u8 *src,
+				unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	size_t out_len = *dlen;
+	int err;
+
+	err = zstd_compress_cctx(ctx->cctx, dst, &out_len, src, slen);
+	if (err)
+		return err;
+
+	*dlen = out_len;
+	return 0;
+}
+
+static int zstd_decompress_crypto(struct crypto_tfm *tfm, const u8 *src,
+				  unsigned int slen, u8 *dst,
+				  unsigned int *dlen)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	size_t out_len = *dlen;
+	int err;
+
+	err = zstd_decompress_dctx(ctx->dctx, dst, &out_len, src, slen);
+	if (err)
+		return err;
+
+	*dlen = out_len;
+	return 0;
+}
+
+static struct crypto_alg alg_zstd = {
+	.cra_name		= "zstd",
+	.cra_flags		= CRYPTO_ALG_TYPE_COMPRESS,
+	.cra_ctxsize		= sizeof(struct zstd_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(alg_zstd.cra_list),
+	.cra_init		= zstd_init,
+	.cra_exit		= zstd_exit,
+	.cra_u			= { .compress = {
+	.coa_compress		= zstd_compress_crypto,
+	.coa_decompress		= zstd_decompress_crypto } }
+};
+
+static int __init zstd_mod_init(void)
+{
+	return crypto_register_alg(&alg_zstd);
+}
+
+static void __exit zstd_mod_fini(void)
+{
+	crypto_unregister_alg(&alg_zstd);
+}
+
+module_init(zstd_mod_init);
+module_exit(zstd_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Compression Algorithm");
+MODULE_ALIAS_CRYPTO("zstd");
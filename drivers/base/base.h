@@ -65,6 +65,10 @@ struct driver_private {
  *	probed first.
  * @device - pointer back to the struct device that this structure is
  * associated with.
+ * @async_driver - driver to try in the pending asynchronous probe scheduled
+ *	from driver_attach(), NULL if it was scheduled at device registration.
+ * @async_probe_pending - an asynchronous probe of the device is scheduled
+ *	or running.
  *
  * Nothing outside of the driver core should ever touch these fields.
  */
@@ -75,6 +79,8 @@ struct device_private {
 	struct klist_node knode_bus;
 	struct list_head deferred_probe;
 	struct device *device;
+	struct device_driver *async_driver;
+	bool async_probe_pending;
 };
 #define to_device_private_parent(obj)	\
 	container_of(obj, struct device_private, knode_parent)
@@ -117,6 +123,7 @@ static inline int driver_match_device(struct device_driver *drv,
 	return drv->bus->match ? drv->bus->match(dev, drv) : 1;
 }
 extern bool driver_allows_async_probing(struct device_driver *drv);
+extern struct async_domain driver_probe_domain;
 
 extern int driver_add_groups(struct device_driver *drv,
 			     const struct attribute_group **groups);
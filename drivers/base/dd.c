@@ -465,6 +465,7 @@ void wait_for_device_probe(void)
 
 	/* wait for the known devices to complete their probing */
 	wait_event(probe_waitqueue, atomic_read(&probe_count) == 0);
+	async_synchronize_full_domain(&driver_probe_domain);
 	async_synchronize_full();
 }
 EXPORT_SYMBOL_GPL(wait_for_device_probe);
@@ -505,6 +506,40 @@ int driver_probe_device(struct device_driver *drv, struct device *dev)
 	return ret;
 }
 
+/*
+ * Asynchronous probes run in their own domain, so that loading a module
+ * or finishing the boot does not wait for them.  They are waited for in
+ * wait_for_device_probe(), i.e. before the root filesystem is mounted.
+ */
+ASYNC_DOMAIN_EXCLUSIVE(driver_probe_domain);
+
+static char async_probe_bus[128];
+static bool async_probe_bus_set;
+
+/*
+ * async_probe_bus=<bus>[,<bus>...] lists the buses whose drivers probe
+ * asynchronously unless they ask otherwise, replacing the bus defaults.
+ * "none" makes all of them synchronous again.
+ */
+static int __init async_probe_bus_setup(char *str)
+{
+	strlcpy(async_probe_bus, str, sizeof(async_probe_bus));
+	async_probe_bus_set = true;
+	return 1;
+}
+__setup("async_probe_bus=", async_probe_bus_setup);
+
+static bool bus_prefers_async_probing(struct bus_type *bus)
+{
+	if (!bus)
+		return false;
+
+	if (async_probe_bus_set)
+		return parse_option_str(async_probe_bus, bus->name);
+
+	return bus->probe_type == PROBE_PREFER_ASYNCHRONOUS;
+}
+
 bool driver_allows_async_probing(struct device_driver *drv)
 {
 	switch (drv->probe_type) {
@@ -518,10 +553,60 @@ bool driver_allows_async_probing(struct device_driver *drv)
 		if (module_requested_async_probing(drv->owner))
 			return true;
 
-		return false;
+		return bus_prefers_async_probing(drv->bus);
 	}
 }
 
+static void device_wait_for_probe(struct device *dev)
+{
+	/* scheduled, but maybe not started yet */
+	wait_event(probe_waitqueue, !READ_ONCE(dev->p->async_probe_pending));
+
+	/* synchronous probe in progress */
+	device_lock(dev);
+	device_unlock(dev);
+}
+
+/*
+ * Devices probed asynchronously may depend on others: on their parent,
+ * which is usually still probing when it registers its children, and on
+ * whatever the bus reports through ->probe_after(), e.g. the first
+ * function of a multi-function PCI device.  Let those finish first.
+ */
+static void device_wait_for_suppliers(struct device *dev)
+{
+	struct device *sup;
+
+	if (dev->parent && dev->parent->p)
+		device_wait_for_probe(dev->parent);
+
+	if (dev->bus && dev->bus->probe_after) {
+		sup = dev->bus->probe_after(dev);
+		if (sup) {
+			if (sup->p)
+				device_wait_for_probe(sup);
+			put_device(sup);
+		}
+	}
+}
+
+static void device_async_probe_start(struct device *dev,
+				     struct device_driver *drv,
+				     async_func_t func)
+{
+	get_device(dev);
+	dev->p->async_driver = drv;
+	dev->p->async_probe_pending = true;
+	async_schedule_domain(func, dev, &driver_probe_domain);
+}
+
+static void device_async_probe_done(struct device *dev)
+{
+	WRITE_ONCE(dev->p->async_probe_pending, false);
+	wake_up_all(&probe_waitqueue);
+	put_device(dev);
+}
+
 struct device_attach_data {
 	struct device *dev;
 
@@ -603,6 +688,8 @@ static void __device_attach_async_helper(void *_dev, async_cookie_t cookie)
 		.want_async	= true,
 	};
 
+	device_wait_for_suppliers(dev);
+
 	device_lock(dev);
 
 	if (dev->parent)
@@ -618,7 +705,7 @@ static void __device_attach_async_helper(void *_dev, async_cookie_t cookie)
 
 	device_unlock(dev);
 
-	put_device(dev);
+	device_async_probe_done(dev);
 }
 
 static int __device_attach(struct device *dev, bool allow_async)
@@ -659,8 +746,8 @@ static int __device_attach(struct device *dev, bool allow_async)
 			 * try them.
 			 */
 			dev_dbg(dev, "scheduling asynchronous probe\n");
-			get_device(dev);
-			async_schedule(__device_attach_async_helper, dev);
+			device_async_probe_start(dev, NULL,
+					__device_attach_async_helper);
 		} else {
 			pm_request_idle(dev);
 		}
@@ -698,6 +785,28 @@ void device_initial_probe(struct device *dev)
 	__device_attach(dev, true);
 }
 
+static void __driver_attach_async_helper(void *_dev, async_cookie_t cookie)
+{
+	struct device *dev = _dev;
+	struct device_driver *drv;
+
+	device_wait_for_suppliers(dev);
+
+	if (dev->parent)	/* Needed for USB */
+		device_lock(dev->parent);
+	device_lock(dev);
+	drv = dev->p->async_driver;
+	dev->p->async_driver = NULL;
+	if (drv && !dev->driver)
+		driver_probe_device(drv, dev);
+	device_unlock(dev);
+	if (dev->parent)
+		device_unlock(dev->parent);
+
+	dev_dbg(dev, "async probe completed\n");
+	device_async_probe_done(dev);
+}
+
 static int __driver_attach(struct device *dev, void *data)
 {
 	struct device_driver *drv = data;
@@ -725,6 +834,19 @@ static int __driver_attach(struct device *dev, void *data)
 		return ret;
 	} /* ret > 0 means positive match */
 
+	/*
+	 * Probe each matching device in its own async call, rather than
+	 * all of them one after the other, when the driver allows it.
+	 */
+	if (driver_allows_async_probing(drv)) {
+		device_lock(dev);
+		if (!dev->driver && !dev->p->async_probe_pending)
+			device_async_probe_start(dev, drv,
+					__driver_attach_async_helper);
+		device_unlock(dev);
+		return 0;
+	}
+
 	if (dev->parent)	/* Needed for USB */
 		device_lock(dev->parent);
 	device_lock(dev);
@@ -763,7 +885,7 @@ static void __device_release_driver(struct device *dev)
 	drv = dev->driver;
 	if (drv) {
 		if (driver_allows_async_probing(drv))
-			async_synchronize_full();
+			async_synchronize_full_domain(&driver_probe_domain);
 
 		pm_runtime_get_sync(dev);
 
@@ -30,6 +30,7 @@
 #include <linux/syscore_ops.h>
 #include <linux/reboot.h>
 #include <linux/security.h>
+#include <linux/initrd.h>
 
 #include <generated/utsrelease.h>
 
@@ -309,6 +310,9 @@ static int fw_get_filesystem_firmware(struct device *device,
 	int rc = -ENOENT;
 	char *path;
 
+	/* firmware needed during boot is usually shipped in the initramfs */
+	wait_for_initramfs();
+
 	path = __getname();
 	if (!path)
 		return -ENOMEM;
@@ -50,8 +50,11 @@ extern unsigned int xenblk_max_queues;
 /*
  * This is the maximum number of segments that would be allowed in indirect
  * requests. This value will also be passed to the frontend.
+ *
+ * 512 segments take two indirect frames and allow 2MB requests with 4KB
+ * segments, so a single queue can keep a fast backing device busy.
  */
-#define MAX_INDIRECT_SEGMENTS 256
+#define MAX_INDIRECT_SEGMENTS 512
 
 /*
  * Xen use 4K pages. The guest may use different page size (4K or 64K)
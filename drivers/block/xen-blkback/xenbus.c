@@ -19,6 +19,7 @@
 #include <stdarg.h>
 #include <linux/module.h>
 #include <linux/kthread.h>
+#include <linux/interrupt.h>
 #include <xen/events.h>
 #include <xen/grant_table.h>
 #include "common.h"
@@ -81,6 +82,24 @@ static int blkback_name(struct xen_blkif *blkif, char *buf)
 	return 0;
 }
 
+/*
+ * Spread the rings of a multi-queue device over the CPUs close to the
+ * backing device, and keep the event channel of each ring on the CPU its
+ * thread runs on.  The frontend submits on queue i from its vCPU i, so the
+ * same guest queues of all devices end up on the same backend CPU.
+ */
+static void xen_blkif_ring_set_cpu(struct xen_blkif_ring *ring,
+				   unsigned int i)
+{
+	struct request_queue *q = bdev_get_queue(ring->blkif->vbd.bdev);
+	const struct cpumask *mask;
+
+	mask = cpumask_of(cpumask_local_spread(i, q->node));
+
+	set_cpus_allowed_ptr(ring->xenblkd, mask);
+	irq_set_affinity_hint(ring->irq, mask);
+}
+
 static void xen_update_blkif_status(struct xen_blkif *blkif)
 {
 	int err;
@@ -116,7 +135,8 @@ static void xen_update_blkif_status(struct xen_blkif *blkif)
 
 	for (i = 0; i < blkif->nr_rings; i++) {
 		ring = &blkif->rings[i];
-		ring->xenblkd = kthread_run(xen_blkif_schedule, ring, "%s-%d", name, i);
+		ring->xenblkd = kthread_create(xen_blkif_schedule, ring,
+					       "%s-%d", name, i);
 		if (IS_ERR(ring->xenblkd)) {
 			err = PTR_ERR(ring->xenblkd);
 			ring->xenblkd = NULL;
@@ -124,6 +144,9 @@ static void xen_update_blkif_status(struct xen_blkif *blkif)
 					"start %s-%d xenblkd", name, i);
 			goto out;
 		}
+		if (blkif->nr_rings > 1)
+			xen_blkif_ring_set_cpu(ring, i);
+		wake_up_process(ring->xenblkd);
 	}
 	return;
 
@@ -263,6 +286,7 @@ static int xen_blkif_disconnect(struct xen_blkif *blkif)
 			return -EBUSY;
 
 		if (ring->irq) {
+			irq_set_affinity_hint(ring->irq, NULL);
 			unbind_from_irqhandler(ring->irq, ring);
 			ring->irq = 0;
 		}
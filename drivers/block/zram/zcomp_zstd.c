@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/zstd.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+
+#include "zcomp_zstd.h"
+
+/* Each stream compresses and decompresses one page at a time */
+struct zcomp_zstd {
+	struct zstd_cctx *cctx;
+	struct zstd_dctx *dctx;
+};
+
+static struct zstd_params zcomp_zstd_params(void)
+{
+	return zstd_get_params(ZSTD_DEFAULT_CLEVEL, PAGE_SIZE);
+}
+
+static void *zcomp_zstd_create(gfp_t flags)
+{
+	struct zstd_params params = zcomp_zstd_params();
+	size_t csize = zstd_cctx_workspace_size(&params);
+	size_t dsize = zstd_dctx_workspace_size();
+	size_t size = sizeof(struct zcomp_zstd) + csize + dsize;
+	struct zcomp_zstd *zstd;
+	u8 *wksp;
+
+	zstd = kmalloc(size, flags | __GFP_NOWARN);
+	if (!zstd)
+		zstd = __vmalloc(size, flags | __GFP_HIGHMEM, PAGE_KERNEL);
+	if (!zstd)
+		return NULL;
+
+	wksp = (u8 *)(zstd + 1);
+	zstd->cctx = zstd_init_cctx(wksp, csize, &params);
+	zstd->dctx = zstd_init_dctx(wksp + csize, dsize);
+	if (!zstd->cctx || !zstd->dctx) {
+		kvfree(zstd);
+		return NULL;
+	}
+
+	return zstd;
+}
+
+static void zcomp_zstd_destroy(void *private)
+{
+	kvfree(private);
+}
+
+static int zcomp_zstd_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	struct zcomp_zstd *zstd = private;
+
+	/* zram hands over two pages for the output */
+	*dst_len = 2 * PAGE_SIZE;
+	return zstd_compress_cctx(zstd->cctx, dst, dst_len, src, PAGE_SIZE);
+}
+
+static int zcomp_zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, void *private)
+{
+	struct zcomp_zstd *zstd = private;
+	size_t dst_len = PAGE_SIZE;
+	int ret;
+
+	ret = zstd_decompress_dctx(zstd->dctx, dst, &dst_len, src, src_len);
+	if (!ret && dst_len != PAGE_SIZE)
+		ret = -EINVAL;
+	return ret;
+}
+
+struct zcomp_backend zcomp_zstd = {
+	.compress = zcomp_zstd_compress,
+	.decompress = zcomp_zstd_decompress,
+	.create = zcomp_zstd_create,
+	.destroy = zcomp_zstd_destroy,
+	.name = "zstd",
+};
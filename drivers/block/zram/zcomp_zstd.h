@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2014 Sergey Senozhatsky.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZCOMP_ZSTD_H_
+#define _ZCOMP_ZSTD_H_
+
+#include "zcomp.h"
+
+extern struct zcomp_backend zcomp_zstd;
+
+#endif /* _ZCOMP_ZSTD_H_ */
@@ -261,6 +261,7 @@
 #include <linux/syscalls.h>
 #include <linux/completion.h>
 #include <linux/uuid.h>
+#include <crypto/chacha20.h>
 
 #include <asm/processor.h>
 #include <asm/uaccess.h>
@@ -1244,6 +1245,146 @@ static ssize_t extract_entropy_user(struct entropy_store *r, void __user *buf,
 	return ret;
 }
 
+/*********************************************************************
+ *
+ * Per-CPU ChaCha20 output generator
+ *
+ * Once the nonblocking pool is initialized, get_random_bytes() and
+ * /dev/urandom no longer run SHA over the shared pool for every
+ * request: each CPU keys its own ChaCha20 state from the pool and
+ * produces output from that, with interrupts disabled only around
+ * each batch of blocks.  The state is rekeyed from the pool every
+ * CRNG_RESEED_INTERVAL, and at the end of every batch its key is
+ * overwritten with fresh keystream, so that a later compromise of
+ * the state does not reveal output already handed out.
+ *
+ *********************************************************************/
+
+#define CRNG_RESEED_INTERVAL	(300 * HZ)
+#define CRNG_BATCH_SIZE		(4 * CHACHA20_BLOCK_SIZE)
+
+struct crng_state {
+	__u32		state[16];
+	unsigned long	init_time;
+	bool		seeded;
+};
+
+static DEFINE_PER_CPU(struct crng_state, crng_state);
+
+static bool crng_need_reseed(struct crng_state *crng)
+{
+	return !crng->seeded ||
+	       time_after(jiffies, crng->init_time + CRNG_RESEED_INTERVAL);
+}
+
+/* Mix 48 bytes from the pool into the key and nonce words */
+static void crng_reseed(struct crng_state *crng, const __u32 *seed)
+{
+	int i;
+
+	crng->state[0] = 0x61707865;	/* "expand 32-byte k" */
+	crng->state[1] = 0x3320646e;
+	crng->state[2] = 0x79622d32;
+	crng->state[3] = 0x6b206574;
+	for (i = 0; i < 12; i++)
+		crng->state[i + 4] ^= seed[i];
+	crng->init_time = jiffies;
+	crng->seeded = true;
+}
+
+static void crng_block(struct crng_state *crng, __u8 *out)
+{
+	chacha20_block(crng->state, out);
+	if (unlikely(crng->state[12] == 0))
+		crng->state[13]++;
+}
+
+/*
+ * Fill up to CRNG_BATCH_SIZE bytes from this CPU's state.  The pool is
+ * read with interrupts enabled; if that lets another reseed of the same
+ * state slip in first, the second one simply mixes in more.
+ */
+static void crng_extract(__u8 *out, int nbytes)
+{
+	__u32 tmp[CHACHA20_BLOCK_SIZE / sizeof(__u32)];
+	struct crng_state *crng;
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+	crng = this_cpu_ptr(&crng_state);
+	if (unlikely(crng_need_reseed(crng))) {
+		local_irq_restore(flags);
+		extract_entropy(&nonblocking_pool, tmp, 12 * sizeof(__u32),
+				0, 0);
+		local_irq_save(flags);
+		crng = this_cpu_ptr(&crng_state);
+		crng_reseed(crng, tmp);
+	}
+
+	while (nbytes) {
+		crng_block(crng, (__u8 *)tmp);
+		i = min_t(int, nbytes, CHACHA20_BLOCK_SIZE);
+		memcpy(out, tmp, i);
+		nbytes -= i;
+		out += i;
+	}
+
+	/* Fast key erasure */
+	crng_block(crng, (__u8 *)tmp);
+	for (i = 0; i < 8; i++)
+		crng->state[i + 4] ^= tmp[i];
+	local_irq_restore(flags);
+
+	memzero_explicit(tmp, sizeof(tmp));
+}
+
+static void extract_crng(void *buf, int nbytes)
+{
+	int i;
+
+	while (nbytes) {
+		i = min_t(int, nbytes, CRNG_BATCH_SIZE);
+		crng_extract(buf, i);
+		nbytes -= i;
+		buf += i;
+	}
+}
+
+static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
+{
+	ssize_t ret = 0, i;
+	__u8 tmp[CRNG_BATCH_SIZE];
+	int large_request = (nbytes > 256);
+
+	while (nbytes) {
+		if (large_request && need_resched()) {
+			if (signal_pending(current)) {
+				if (ret == 0)
+					ret = -ERESTARTSYS;
+				break;
+			}
+			schedule();
+		}
+
+		i = min_t(size_t, nbytes, CRNG_BATCH_SIZE);
+		crng_extract(tmp, i);
+		if (copy_to_user(buf, tmp, i)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		nbytes -= i;
+		buf += i;
+		ret += i;
+	}
+
+	/* Wipe data just returned from memory */
+	memzero_explicit(tmp, sizeof(tmp));
+
+	return ret;
+}
+
 /*
  * This function is the exported kernel interface.  It returns some
  * number of good random numbers, suitable for key generation, seeding
@@ -1261,7 +1402,10 @@ void get_random_bytes(void *buf, int nbytes)
 		       nonblocking_pool.entropy_total);
 #endif
 	trace_get_random_bytes(nbytes, _RET_IP_);
-	extract_entropy(&nonblocking_pool, buf, nbytes, 0, 0);
+	if (likely(nonblocking_pool.initialized))
+		extract_crng(buf, nbytes);
+	else
+		extract_entropy(&nonblocking_pool, buf, nbytes, 0, 0);
 }
 EXPORT_SYMBOL(get_random_bytes);
 
@@ -1466,7 +1610,10 @@ urandom_read(struct file *file, char __user *buf, size_t nbytes, loff_t *ppos)
 			    current->comm, nonblocking_pool.entropy_total);
 
 	nbytes = min_t(size_t, nbytes, INT_MAX >> (ENTROPY_SHIFT + 3));
-	ret = extract_entropy_user(&nonblocking_pool, buf, nbytes);
+	if (likely(nonblocking_pool.initialized))
+		ret = extract_crng_user(buf, nbytes);
+	else
+		ret = extract_entropy_user(&nonblocking_pool, buf, nbytes);
 
 	trace_urandom_read(8 * nbytes, ENTROPY_BITS(&nonblocking_pool),
 			   ENTROPY_BITS(&input_pool));
@@ -0,0 +1,376 @@
+/*
+ * teo.c - the timer events oriented idle governor
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/jiffies.h>
+#include <linux/pm_qos.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+
+/*
+ * Concepts and ideas behind the TEO governor
+ *
+ * The menu governor scales the time to the next timer event by a
+ * correction factor averaged over all the recent wakeups. On cpus woken
+ * up mostly by interrupts at a high rate that average is dragged around
+ * by the occasional long sleep, and the governor keeps picking states
+ * that are too deep for the idle periods it actually gets.
+ *
+ * Instead, TEO takes the next timer event as an upper bound of the idle
+ * duration, which it is, and only asks how often the cpu has really been
+ * idle for that long recently:
+ *
+ * For every idle state it keeps three decaying counters, bins of a
+ * histogram of the recent idle durations with the target residencies of
+ * the states as boundaries:
+ *
+ * hits		how often the state matching the time to the next timer was
+ *		also the state matching the observed idle duration,
+ * misses	how often the cpu woke up earlier than that, so a shallower
+ *		state would have been a better fit,
+ * early_hits	how often the state was the one matching the observed idle
+ *		duration in the cases counted as misses for a deeper state.
+ *
+ * The state matching the time to the next timer (the candidate) is used
+ * as long as its hits outweigh its misses. Otherwise the shallower state
+ * with the most early hits is taken, the one most likely to match.
+ *
+ * On top of that, the last INTERVALS idle durations observed for non
+ * timer wakeups are kept; if most of them are shorter than the duration
+ * the selected state is good for, their average is used to go shallower
+ * still, which catches wakeups at a steady rate, as from a network
+ * interface under load.
+ *
+ * The counters are exposed as the hits, misses and early_hits attributes
+ * of the cpuidle state directories in sysfs.
+ */
+
+/*
+ * The counters are scaled up by PULSE and decay by 1/2^DECAY_SHIFT with
+ * every update of the bin, so a counter of matching wakeups settles at
+ * PULSE << DECAY_SHIFT.
+ */
+#define PULSE		1024
+#define DECAY_SHIFT	3
+
+/* number of idle durations saved for the pattern detection */
+#define INTERVALS	8
+
+#define TEO_TICK_USEC	(TICK_NSEC / NSEC_PER_USEC)
+
+/**
+ * struct teo_cpu - cpu data used by the TEO governor
+ * @time_span_ns: time between idle state selection and post-wakeup update
+ * @sleep_length_ns: time till the closest timer event at selection time
+ * @last_state: idle state entered after the last selection, or -1
+ * @interval_idx: index of the most recent saved idle interval
+ * @intervals: saved idle duration values
+ */
+struct teo_cpu {
+	u64 time_span_ns;
+	u64 sleep_length_ns;
+	int last_state;
+	int interval_idx;
+	unsigned int intervals[INTERVALS];
+};
+
+static DEFINE_PER_CPU(struct teo_cpu, teo_cpus);
+
+/**
+ * teo_update - update the cpu data after a wakeup
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void teo_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = per_cpu_ptr(&teo_cpus, dev->cpu);
+	unsigned int sleep_length_us = div_u64(cpu_data->sleep_length_ns,
+					       NSEC_PER_USEC);
+	int i, idx_hit = -1, idx_timer = -1;
+	unsigned int measured_us;
+
+	if (cpu_data->time_span_ns >= cpu_data->sleep_length_ns) {
+		/*
+		 * The wakeup came with, or after, the timer event expected
+		 * at the selection time: it was the timer.
+		 */
+		measured_us = sleep_length_us;
+	} else {
+		unsigned int lat = drv->states[cpu_data->last_state].exit_latency;
+
+		measured_us = div_u64(cpu_data->time_span_ns, NSEC_PER_USEC);
+		/*
+		 * The delay between the wakeup and the first instruction
+		 * executed by the cpu is not likely to be worst-case every
+		 * time, take half the exit latency as a rough average.
+		 */
+		if (measured_us >= lat)
+			measured_us -= lat / 2;
+		else
+			measured_us /= 2;
+	}
+
+	/*
+	 * Decay the early hits of all the states and find the ones matching
+	 * the sleep length and the measured idle duration.
+	 */
+	for (i = 0; i < drv->state_count; i++) {
+		struct cpuidle_state_usage *su = &dev->states_usage[i];
+
+		su->early_hits -= su->early_hits >> DECAY_SHIFT;
+
+		if (drv->states[i].target_residency <= sleep_length_us) {
+			idx_timer = i;
+			if (drv->states[i].target_residency <= measured_us)
+				idx_hit = i;
+		}
+	}
+
+	/*
+	 * A hit for the state matching the sleep length if it also matches
+	 * the measured idle duration; a miss otherwise, and an early hit for
+	 * the state that did match.
+	 */
+	if (idx_timer >= 0) {
+		struct cpuidle_state_usage *su = &dev->states_usage[idx_timer];
+		unsigned int hits = su->hits;
+		unsigned int misses = su->misses;
+
+		hits -= hits >> DECAY_SHIFT;
+		misses -= misses >> DECAY_SHIFT;
+
+		if (idx_timer > idx_hit) {
+			misses += PULSE;
+			if (idx_hit >= 0)
+				dev->states_usage[idx_hit].early_hits += PULSE;
+		} else {
+			hits += PULSE;
+		}
+
+		su->misses = misses;
+		su->hits = hits;
+	}
+
+	/*
+	 * Save the idle duration of non-timer wakeups for the pattern
+	 * detection, timer wakeups are covered by the sleep length already.
+	 */
+	if (cpu_data->time_span_ns >= cpu_data->sleep_length_ns)
+		measured_us = UINT_MAX;
+
+	cpu_data->intervals[cpu_data->interval_idx++] = measured_us;
+	if (cpu_data->interval_idx >= INTERVALS)
+		cpu_data->interval_idx = 0;
+}
+
+/**
+ * teo_find_shallower_state - find shallower idle state matching given duration
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ * @state_idx: index of the idle state to start with
+ * @duration_us: idle duration value to match
+ */
+static int teo_find_shallower_state(struct cpuidle_driver *drv,
+				    struct cpuidle_device *dev, int state_idx,
+				    unsigned int duration_us)
+{
+	int i;
+
+	for (i = state_idx - 1; i >= 0; i--) {
+		if (drv->states[i].disabled || dev->states_usage[i].disable)
+			continue;
+
+		state_idx = i;
+		if (drv->states[i].target_residency <= duration_us)
+			break;
+	}
+	return state_idx;
+}
+
+/**
+ * teo_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int teo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = per_cpu_ptr(&teo_cpus, dev->cpu);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int duration_us, count;
+	int max_early_idx, constraint_idx, idx, i;
+
+	if (cpu_data->last_state >= 0) {
+		teo_update(drv, dev);
+		cpu_data->last_state = -1;
+	}
+
+	cpu_data->time_span_ns = local_clock();
+	cpu_data->sleep_length_ns = ktime_to_ns(tick_nohz_get_sleep_length());
+	duration_us = div_u64(cpu_data->sleep_length_ns, NSEC_PER_USEC);
+
+	count = 0;
+	max_early_idx = -1;
+	constraint_idx = drv->state_count;
+	idx = -1;
+
+	for (i = 0; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct cpuidle_state_usage *su = &dev->states_usage[i];
+
+		if (s->disabled || su->disable) {
+			/*
+			 * The early hits of a disabled state still count
+			 * against the deeper states, it would be a mistake
+			 * to pick one of them just because they have more
+			 * than the shallower enabled states.
+			 */
+			if (max_early_idx >= 0 && count < su->early_hits)
+				count = su->early_hits;
+
+			continue;
+		}
+
+		if (idx < 0)
+			idx = i; /* first enabled state */
+
+		if (s->target_residency > duration_us)
+			break;
+
+		if (s->exit_latency > latency_req && constraint_idx > i)
+			constraint_idx = i;
+
+		idx = i;
+
+		/*
+		 * With the tick stopped a state shallower than the tick
+		 * period may end up being used for a long time.
+		 */
+		if (count < su->early_hits &&
+		    !(tick_nohz_tick_stopped() &&
+		      s->target_residency < TEO_TICK_USEC)) {
+			count = su->early_hits;
+			max_early_idx = i;
+		}
+	}
+
+	/*
+	 * Keep the candidate if it was right more often than not, fall
+	 * back to the state with the most early hits otherwise.
+	 */
+	if (idx >= 0 && max_early_idx >= 0 &&
+	    dev->states_usage[idx].hits <= dev->states_usage[idx].misses) {
+		/*
+		 * Avoid a shallower state with the same target residency
+		 * as the candidate.
+		 */
+		if (drv->states[max_early_idx].target_residency <
+		    drv->states[idx].target_residency)
+			idx = max_early_idx;
+
+		duration_us = drv->states[idx].target_residency;
+	}
+
+	/* the latency constraint may call for a shallower state still */
+	if (constraint_idx < idx)
+		idx = constraint_idx;
+
+	if (idx < 0) {
+		idx = 0; /* No states enabled. Must use 0. */
+	} else if (idx > 0) {
+		unsigned int nr = 0;
+		u64 sum = 0;
+
+		/*
+		 * Count and sum the most recent idle durations shorter than
+		 * the expected one; give up unless they are the majority.
+		 */
+		for (i = 0; i < INTERVALS; i++) {
+			unsigned int val = cpu_data->intervals[i];
+
+			if (val >= duration_us)
+				continue;
+
+			nr++;
+			sum += val;
+		}
+
+		if (nr > INTERVALS / 2) {
+			unsigned int avg_us = div64_u64(sum, nr);
+
+			/*
+			 * Avoid spending too much time in an idle state
+			 * that would be too shallow.
+			 */
+			if (!(tick_nohz_tick_stopped() &&
+			      avg_us < TEO_TICK_USEC) &&
+			    drv->states[idx].target_residency > avg_us)
+				idx = teo_find_shallower_state(drv, dev, idx,
+							       avg_us);
+		}
+	}
+
+	return idx;
+}
+
+/**
+ * teo_reflect - note that governor data for the CPU need to be updated
+ * @dev: the CPU
+ * @state: index of the idle state entered
+ */
+static void teo_reflect(struct cpuidle_device *dev, int state)
+{
+	struct teo_cpu *cpu_data = per_cpu_ptr(&teo_cpus, dev->cpu);
+
+	cpu_data->last_state = state;
+	cpu_data->time_span_ns = local_clock() - cpu_data->time_span_ns;
+}
+
+/**
+ * teo_enable_device - initialize the governor's data for the target CPU
+ * @drv: cpuidle driver (not used)
+ * @dev: the CPU
+ */
+static int teo_enable_device(struct cpuidle_driver *drv,
+			     struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = per_cpu_ptr(&teo_cpus, dev->cpu);
+	int i;
+
+	memset(cpu_data, 0, sizeof(*cpu_data));
+	cpu_data->last_state = -1;
+
+	for (i = 0; i < INTERVALS; i++)
+		cpu_data->intervals[i] = UINT_MAX;
+
+	for (i = 0; i < CPUIDLE_STATE_MAX; i++) {
+		dev->states_usage[i].hits = 0;
+		dev->states_usage[i].misses = 0;
+		dev->states_usage[i].early_hits = 0;
+	}
+
+	return 0;
+}
+
+static struct cpuidle_governor teo_governor = {
+	.name =		"teo",
+	.rating =	19,
+	.enable =	teo_enable_device,
+	.select =	teo_select,
+	.reflect =	teo_reflect,
+	.owner =	THIS_MODULE,
+};
+
+static int __init teo_governor_init(void)
+{
+	return cpuidle_register_governor(&teo_governor);
+}
+
+postcore_initcall(teo_governor_init);
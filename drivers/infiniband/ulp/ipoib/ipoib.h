@@ -78,6 +78,7 @@ enum {
 	IPOIB_CM_MAX_CONN_QP	  = 4096,
 
 	IPOIB_NUM_WC		  = 4,
+	IPOIB_RX_POST_BATCH	  = 16,
 
 	IPOIB_MAX_PATH_REC_QUEUE  = 3,
 	IPOIB_MAX_MCAST_QUEUE	  = 64,
@@ -369,6 +370,10 @@ struct ipoib_dev_priv {
 
 	struct ib_recv_wr    rx_wr;
 	struct ib_sge	     rx_sge[IPOIB_UD_RX_SG];
+	/* reposts collected during a poll, posted as one chain */
+	struct ib_recv_wr    rx_wr_batch[IPOIB_RX_POST_BATCH];
+	struct ib_sge	     rx_sge_batch[IPOIB_RX_POST_BATCH];
+	unsigned	     rx_post_count;
 
 	struct ib_wc ibwc[IPOIB_NUM_WC];
 
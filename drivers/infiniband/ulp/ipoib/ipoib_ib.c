@@ -119,6 +119,51 @@ static int ipoib_ib_post_receive(struct net_device *dev, int id)
 	return ret;
 }
 
+/*
+ * Post all the receives queued by ipoib_ib_queue_receive() with a
+ * single ib_post_recv(), so the HCA doorbell is rung once per batch
+ * rather than once per completion.
+ */
+static void ipoib_ib_post_receive_batch(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ib_recv_wr *wr, *bad_wr;
+	unsigned int id;
+	int ret;
+
+	if (!priv->rx_post_count)
+		return;
+
+	priv->rx_wr_batch[priv->rx_post_count - 1].next = NULL;
+	priv->rx_post_count = 0;
+
+	ret = ib_post_recv(priv->qp, priv->rx_wr_batch, &bad_wr);
+	if (likely(!ret))
+		return;
+
+	/* Nothing from bad_wr on made it to the QP */
+	ipoib_warn(priv, "batched receive post failed (%d)\n", ret);
+	for (wr = bad_wr; wr; wr = wr->next) {
+		id = wr->wr_id & ~IPOIB_OP_RECV;
+		ipoib_ud_dma_unmap_rx(priv, priv->rx_ring[id].mapping);
+		dev_kfree_skb_any(priv->rx_ring[id].skb);
+		priv->rx_ring[id].skb = NULL;
+	}
+}
+
+static void ipoib_ib_queue_receive(struct net_device *dev, int id)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ib_recv_wr *wr = &priv->rx_wr_batch[priv->rx_post_count++];
+
+	wr->wr_id = id | IPOIB_OP_RECV;
+	wr->sg_list[0].addr = priv->rx_ring[id].mapping[0];
+	wr->next = wr + 1;
+
+	if (priv->rx_post_count == IPOIB_RX_POST_BATCH)
+		ipoib_ib_post_receive_batch(dev);
+}
+
 static struct sk_buff *ipoib_alloc_rx_skb(struct net_device *dev, int id)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
@@ -267,9 +312,7 @@ static void ipoib_ib_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 	napi_gro_receive(&priv->napi, skb);
 
 repost:
-	if (unlikely(ipoib_ib_post_receive(dev, wr_id)))
-		ipoib_warn(priv, "ipoib_ib_post_receive failed "
-			   "for buf %d\n", wr_id);
+	ipoib_ib_queue_receive(dev, wr_id);
 }
 
 int ipoib_dma_map_tx(struct ib_device *ca, struct ipoib_tx_buf *tx_req)
@@ -475,6 +518,8 @@ poll_more:
 			break;
 	}
 
+	ipoib_ib_post_receive_batch(dev);
+
 	if (done < budget) {
 		napi_complete(napi);
 		if (unlikely(ib_req_notify_cq(priv->recv_cq,
@@ -839,6 +884,8 @@ void ipoib_drain_cq(struct net_device *dev)
 		}
 	} while (n == IPOIB_NUM_WC);
 
+	ipoib_ib_post_receive_batch(dev);
+
 	while (poll_tx(priv))
 		; /* nothing */
 
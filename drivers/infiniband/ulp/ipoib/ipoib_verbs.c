@@ -234,6 +234,15 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 	priv->rx_wr.next = NULL;
 	priv->rx_wr.sg_list = priv->rx_sge;
 
+	for (i = 0; i < IPOIB_RX_POST_BATCH; ++i) {
+		priv->rx_sge_batch[i].lkey = priv->pd->local_dma_lkey;
+		priv->rx_sge_batch[i].length =
+			IPOIB_UD_BUF_SIZE(priv->max_ib_mtu);
+		priv->rx_wr_batch[i].num_sge = 1;
+		priv->rx_wr_batch[i].sg_list = &priv->rx_sge_batch[i];
+	}
+	priv->rx_post_count = 0;
+
 	priv->max_send_sge = init_attr.cap.max_send_sge;
 
 	return 0;
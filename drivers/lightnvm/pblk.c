@@ -0,0 +1,1705 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Implementation of a physical block-device target for Open-channel SSDs.
+ *
+ * User writes are copied to a host write buffer and completed from there.
+ * A writer thread programs the buffer to the media one full write unit (a
+ * page across all planes) at a time, striping the units over the luns of
+ * the target.  Garbage collection moves valid sectors through the same
+ * buffer, and the buffer is split between user and GC writes depending on
+ * the number of free blocks left, which rate-limits GC against user I/O.
+ */
+
+#include "pblk.h"
+
+static struct kmem_cache *pblk_rq_cache;
+
+#define pblk_for_each_lun(pblk, rlun, i) \
+		for ((i) = 0, rlun = &(pblk)->luns[0]; \
+			(i) < (pblk)->nr_luns; (i)++, rlun = &(pblk)->luns[(i)])
+
+static void pblk_write_kick(struct pblk *pblk)
+{
+	set_bit(PBLK_WRITE_KICK, &pblk->write_flags);
+	wake_up(&pblk->writer_wait);
+}
+
+static void pblk_gc_kick(struct pblk *pblk)
+{
+	if (!test_bit(PBLK_STATE_EXITING, &pblk->state))
+		queue_work(pblk->kgc_wq, &pblk->ws_gc);
+}
+
+static struct nvm_rq *pblk_alloc_rqd(struct pblk *pblk, gfp_t gfp)
+{
+	struct nvm_rq *rqd;
+
+	rqd = mempool_alloc(pblk->rq_pool, gfp);
+	if (!rqd)
+		return NULL;
+
+	memset(rqd, 0, sizeof(struct nvm_rq));
+	rqd->ins = &pblk->instance;
+
+	return rqd;
+}
+
+static void pblk_free_rqd(struct pblk *pblk, struct nvm_rq *rqd)
+{
+	if (rqd->nr_ppas > 1 && rqd->ppa_list)
+		nvm_dev_dma_free(pblk->dev, rqd->ppa_list, rqd->dma_ppa_list);
+
+	mempool_free(rqd, pblk->rq_pool);
+}
+
+/*
+ * Rate limiting
+ */
+static unsigned int pblk_nr_free_blks(struct pblk *pblk)
+{
+	struct pblk_lun *rlun;
+	unsigned int nr_free = 0;
+	int i;
+
+	/* We don't take the lock as we only need an estimate */
+	pblk_for_each_lun(pblk, rlun, i)
+		nr_free += rlun->parent->nr_free_blocks;
+
+	return nr_free;
+}
+
+static int pblk_rl_gc_needed(struct pblk *pblk)
+{
+	return pblk_nr_free_blks(pblk) < pblk->rl.high;
+}
+
+static int pblk_rl_is_emergency(struct pblk *pblk)
+{
+	return pblk_nr_free_blks(pblk) <= pblk->rl.low;
+}
+
+/*
+ * Above the high watermark user writes may use the whole write buffer.
+ * Below it their share shrinks linearly with the free blocks, leaving the
+ * rest to GC, and below the low watermark only GC writes are let through.
+ */
+static void pblk_rl_update(struct pblk *pblk)
+{
+	struct pblk_rl *rl = &pblk->rl;
+	unsigned int nr_entries = pblk->rb.nr_entries;
+	unsigned int nr_free = pblk_nr_free_blks(pblk);
+	unsigned int user_max;
+
+	if (nr_free >= rl->high)
+		user_max = nr_entries;
+	else if (nr_free > rl->low)
+		user_max = max_t(unsigned int, rl->rsv,
+			div_u64((u64)nr_entries * (nr_free - rl->low),
+						rl->high - rl->low));
+	else
+		user_max = 0;
+
+	WRITE_ONCE(rl->user_max, user_max);
+	WRITE_ONCE(rl->gc_max, max(rl->rsv, nr_entries - user_max));
+
+	wake_up(&pblk->rb.wait);
+}
+
+static void pblk_rl_init(struct pblk *pblk)
+{
+	struct pblk_rl *rl = &pblk->rl;
+
+	rl->low = pblk->nr_luns * PBLK_GC_RSV_BLKS;
+	rl->high = pblk->total_blocks / GC_LIMIT_INVERSE;
+	if (rl->high <= rl->low)
+		rl->high = rl->low + pblk->nr_luns;
+
+	/* enough for the largest request plus a unit left behind by others */
+	rl->rsv = pblk->max_req + pblk->unit;
+
+	pblk_rl_update(pblk);
+}
+
+/*
+ * Write buffer
+ */
+static unsigned int pblk_rb_space(struct pblk_rb *rb)
+{
+	return rb->nr_entries - (READ_ONCE(rb->mem) -
+						smp_load_acquire(&rb->sync));
+}
+
+static int pblk_rb_empty(struct pblk_rb *rb)
+{
+	return smp_load_acquire(&rb->sync) == READ_ONCE(rb->mem);
+}
+
+static int pblk_rb_may_write(struct pblk *pblk, unsigned int nr, int is_gc)
+{
+	struct pblk_rb *rb = &pblk->rb;
+
+	if (pblk_rb_space(rb) < nr)
+		return 0;
+
+	if (is_gc)
+		return atomic_read(&rb->gc_cnt) + nr <=
+						READ_ONCE(pblk->rl.gc_max);
+
+	return atomic_read(&rb->user_cnt) + nr <= READ_ONCE(pblk->rl.user_max);
+}
+
+/* returns with the producer lock held and room for nr entries */
+static void pblk_rb_write_lock(struct pblk *pblk, unsigned int nr, int is_gc)
+{
+	struct pblk_rb *rb = &pblk->rb;
+
+	for (;;) {
+		if (!pblk_rb_may_write(pblk, nr, is_gc)) {
+			if (!is_gc)
+				pblk_gc_kick(pblk);
+			wait_event(rb->wait,
+					pblk_rb_may_write(pblk, nr, is_gc));
+		}
+
+		mutex_lock(&rb->w_lock);
+		if (pblk_rb_may_write(pblk, nr, is_gc))
+			return;
+		mutex_unlock(&rb->w_lock);
+	}
+}
+
+/*
+ * Writes complete out of order across luns, but entries are released in
+ * order, completing the flush bios that waited on them on the way.
+ */
+static void pblk_rb_sync(struct pblk *pblk, unsigned long pos,
+							unsigned int nr)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	struct pblk_rb_entry *entry;
+	struct bio_list bios;
+	struct bio *bio;
+	unsigned long sync, flags;
+	unsigned int i;
+
+	bio_list_init(&bios);
+
+	spin_lock_irqsave(&rb->s_lock, flags);
+	for (i = 0; i < nr; i++)
+		pblk_rb_entry(rb, pos + i)->flags |= PBLK_RB_DONE;
+
+	sync = rb->sync;
+	while (sync != READ_ONCE(rb->subm)) {
+		entry = pblk_rb_entry(rb, sync);
+		if (!(entry->flags & PBLK_RB_DONE))
+			break;
+
+		if (entry->flags & PBLK_RB_GC)
+			atomic_dec(&rb->gc_cnt);
+		else if (!(entry->flags & PBLK_RB_PAD))
+			atomic_dec(&rb->user_cnt);
+
+		bio_list_merge(&bios, &entry->bios);
+		bio_list_init(&entry->bios);
+		entry->flags = 0;
+		sync++;
+	}
+	smp_store_release(&rb->sync, sync);
+	spin_unlock_irqrestore(&rb->s_lock, flags);
+
+	while ((bio = bio_list_pop(&bios)))
+		bio_endio(bio);
+
+	wake_up(&rb->wait);
+}
+
+/* fill up a partial write unit so that it can be written out */
+static int pblk_rb_pad(struct pblk *pblk)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	struct pblk_rb_entry *entry;
+	unsigned long mem;
+	unsigned int i, nr;
+	int ret = 0;
+
+	mutex_lock(&rb->w_lock);
+	mem = rb->mem;
+	nr = (mem - rb->subm) % pblk->unit;
+	if (!nr)
+		goto out;
+
+	nr = pblk->unit - nr;
+	if (pblk_rb_space(rb) < nr) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		entry = pblk_rb_entry(rb, mem + i);
+		entry->lba = ADDR_EMPTY;
+		entry->flags = PBLK_RB_PAD;
+	}
+	smp_store_release(&rb->mem, mem + nr);
+out:
+	mutex_unlock(&rb->w_lock);
+	return ret;
+}
+
+static int pblk_rb_init(struct pblk *pblk, unsigned int nr_entries)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	unsigned int i;
+
+	rb->entries = vzalloc(sizeof(struct pblk_rb_entry) * nr_entries);
+	if (!rb->entries)
+		return -ENOMEM;
+
+	rb->nr_entries = nr_entries;
+	for (i = 0; i < nr_entries; i++) {
+		struct pblk_rb_entry *entry = &rb->entries[i];
+
+		entry->page = alloc_page(GFP_KERNEL);
+		if (!entry->page)
+			return -ENOMEM;
+
+		entry->lba = ADDR_EMPTY;
+		bio_list_init(&entry->bios);
+	}
+
+	mutex_init(&rb->w_lock);
+	spin_lock_init(&rb->s_lock);
+	atomic_set(&rb->user_cnt, 0);
+	atomic_set(&rb->gc_cnt, 0);
+	init_waitqueue_head(&rb->wait);
+
+	return 0;
+}
+
+static void pblk_rb_free(struct pblk *pblk)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	unsigned int i;
+
+	if (!rb->entries)
+		return;
+
+	for (i = 0; i < rb->nr_entries; i++)
+		if (rb->entries[i].page)
+			__free_page(rb->entries[i].page);
+
+	vfree(rb->entries);
+}
+
+/*
+ * Mapping
+ */
+
+/* requires trans_lock */
+static void pblk_invalidate_ppa(struct pblk *pblk, struct ppa_addr ppa)
+{
+	struct pblk_block *rblk = pblk_ppa_to_blk(pblk, ppa);
+
+	pblk->rev_map[pblk_ppa_to_rev(pblk, ppa)] = ADDR_EMPTY;
+	rblk->nr_invalid++;
+}
+
+/* requires trans_lock */
+static void pblk_map_set_cache(struct pblk *pblk, u64 lba, unsigned long pos)
+{
+	struct ppa_addr *map = &pblk->trans_map[lba];
+
+	if (pblk_ppa_is_dev(*map))
+		pblk_invalidate_ppa(pblk, *map);
+
+	*map = pblk_cacheline_to_ppa(pos);
+}
+
+/* requires trans_lock */
+static void pblk_map_set_dev(struct pblk *pblk, struct pblk_rb_entry *entry,
+							unsigned long pos)
+{
+	struct ppa_addr *map;
+
+	if (entry->flags & PBLK_RB_PAD)
+		goto invalid;
+
+	/* overwritten or discarded while in the write buffer */
+	map = &pblk->trans_map[entry->lba];
+	if (map->ppa != pblk_cacheline_to_ppa(pos).ppa)
+		goto invalid;
+
+	*map = entry->ppa;
+	pblk->rev_map[pblk_ppa_to_rev(pblk, entry->ppa)] = entry->lba;
+	return;
+invalid:
+	pblk_invalidate_ppa(pblk, entry->ppa);
+}
+
+static void pblk_lookup(struct pblk *pblk, sector_t lba, int nr,
+						struct ppa_addr *ppas)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&pblk->trans_lock, flags);
+	for (i = 0; i < nr; i++)
+		ppas[i] = pblk->trans_map[lba + i];
+	spin_unlock_irqrestore(&pblk->trans_lock, flags);
+}
+
+#define PBLK_DISCARD_BATCH 1024
+
+static void pblk_discard(struct pblk *pblk, struct bio *bio)
+{
+	sector_t lba = pblk_get_laddr(bio);
+	sector_t end = lba + pblk_get_pages(bio);
+	struct ppa_addr *map;
+	unsigned long flags;
+	int i;
+
+	if (end > pblk->capacity) {
+		bio_io_error(bio);
+		return;
+	}
+
+	while (lba < end) {
+		spin_lock_irqsave(&pblk->trans_lock, flags);
+		for (i = 0; i < PBLK_DISCARD_BATCH && lba < end; i++, lba++) {
+			map = &pblk->trans_map[lba];
+			if (pblk_ppa_is_dev(*map))
+				pblk_invalidate_ppa(pblk, *map);
+			ppa_set_empty(map);
+		}
+		spin_unlock_irqrestore(&pblk->trans_lock, flags);
+	}
+
+	bio_endio(bio);
+}
+
+/*
+ * Blocks
+ */
+static struct pblk_block *pblk_get_blk(struct pblk *pblk,
+							struct pblk_lun *rlun)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct pblk_block *rblk;
+	struct nvm_block *blk;
+	unsigned long flags = NVM_IOTYPE_NONE;
+
+	if (pblk_rl_is_emergency(pblk))
+		flags = NVM_IOTYPE_GC;
+
+retry:
+	blk = nvm_get_blk(dev, rlun->parent, flags);
+	if (!blk)
+		return NULL;
+
+	/* blocks are erased when taken, not when given back */
+	if (nvm_erase_blk(dev, blk)) {
+		pr_err("pblk: failed to erase block %lu\n", blk->id);
+		blk->state = NVM_BLK_ST_BAD;
+		nvm_put_blk(dev, blk);
+		goto retry;
+	}
+
+	rblk = &rlun->blocks[blk->id % dev->blks_per_lun];
+	blk->priv = rblk;
+	rblk->next_sec = 0;
+	rblk->nr_invalid = 0;
+	rblk->flags = 0;
+	atomic_set(&rblk->nr_cmnt, 0);
+
+	pblk_rl_update(pblk);
+	if (pblk_rl_gc_needed(pblk))
+		pblk_gc_kick(pblk);
+
+	return rblk;
+}
+
+static void pblk_put_blk(struct pblk *pblk, struct pblk_block *rblk)
+{
+	if (rblk->flags & PBLK_BLK_BAD)
+		rblk->parent->state = NVM_BLK_ST_BAD;
+
+	nvm_put_blk(pblk->dev, rblk->parent);
+
+	pblk_rl_update(pblk);
+	pblk_write_kick(pblk);
+}
+
+static void pblk_put_blks(struct pblk *pblk)
+{
+	struct pblk_lun *rlun;
+	struct pblk_block *rblk, *trblk;
+	int i;
+
+	pblk_for_each_lun(pblk, rlun, i) {
+		if (rlun->cur)
+			pblk_put_blk(pblk, rlun->cur);
+
+		list_for_each_entry_safe(rblk, trblk, &rlun->closed_list,
+									list) {
+			list_del_init(&rblk->list);
+			pblk_put_blk(pblk, rblk);
+		}
+	}
+}
+
+/* account sectors that are done with, the block is closed once all are */
+static void pblk_blk_commit(struct pblk *pblk, struct pblk_block *rblk,
+							unsigned int nr)
+{
+	struct pblk_lun *rlun = rblk->rlun;
+	unsigned long flags;
+
+	if (atomic_add_return(nr, &rblk->nr_cmnt) < pblk->dev->sec_per_blk)
+		return;
+
+	spin_lock_irqsave(&rlun->lock, flags);
+	list_add_tail(&rblk->list, &rlun->closed_list);
+	spin_unlock_irqrestore(&rlun->lock, flags);
+}
+
+static void pblk_lun_reads(struct pblk *pblk, struct nvm_rq *rqd, int nr)
+{
+	int i;
+
+	if (rqd->nr_ppas == 1) {
+		atomic_add(nr, &pblk_ppa_to_lun(pblk,
+					rqd->ppa_addr)->inflight_reads);
+		return;
+	}
+
+	for (i = 0; i < rqd->nr_ppas; i++)
+		atomic_add(nr, &pblk_ppa_to_lun(pblk,
+					rqd->ppa_list[i])->inflight_reads);
+}
+
+/*
+ * Write path
+ */
+static int pblk_bio_is_valid(struct pblk *pblk, struct bio *bio)
+{
+	struct bio_vec bv;
+	struct bvec_iter iter;
+	unsigned int nr = pblk_get_pages(bio);
+
+	if (bio->bi_iter.bi_size % PBLK_EXPOSED_PAGE_SIZE || nr > pblk->max_req)
+		return 0;
+
+	if (pblk_get_laddr(bio) + nr > pblk->capacity)
+		return 0;
+
+	bio_for_each_segment(bv, bio, iter)
+		if ((bv.bv_offset | bv.bv_len) % PBLK_EXPOSED_PAGE_SIZE)
+			return 0;
+
+	return 1;
+}
+
+static int pblk_write_to_cache(struct pblk *pblk, struct bio *bio)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	struct pblk_rb_entry *entry = NULL;
+	struct bio_vec bv;
+	struct bvec_iter iter;
+	sector_t lba = pblk_get_laddr(bio);
+	unsigned int nr = pblk_get_pages(bio);
+	int flush = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	unsigned long pos, flags;
+	unsigned int off, i = 0;
+	void *src;
+
+	pblk_rb_write_lock(pblk, nr, 0);
+	pos = rb->mem;
+
+	bio_for_each_segment(bv, bio, iter) {
+		src = kmap_atomic(bv.bv_page);
+		for (off = 0; off < bv.bv_len; off += PBLK_EXPOSED_PAGE_SIZE) {
+			entry = pblk_rb_entry(rb, pos + i);
+			memcpy(page_address(entry->page),
+					src + bv.bv_offset + off,
+					PBLK_EXPOSED_PAGE_SIZE);
+			entry->lba = lba + i;
+			entry->flags = 0;
+			i++;
+		}
+		kunmap_atomic(src);
+	}
+
+	spin_lock_irqsave(&pblk->trans_lock, flags);
+	for (i = 0; i < nr; i++)
+		pblk_map_set_cache(pblk, lba + i, pos + i);
+	spin_unlock_irqrestore(&pblk->trans_lock, flags);
+
+	/* the entries are not visible to the writer yet */
+	if (flush)
+		bio_list_add(&entry->bios, bio);
+
+	atomic_add(nr, &rb->user_cnt);
+	smp_store_release(&rb->mem, pos + nr);
+	mutex_unlock(&rb->w_lock);
+
+	if (flush)
+		set_bit(PBLK_WRITE_FLUSH, &pblk->write_flags);
+	pblk_write_kick(pblk);
+
+	return flush ? NVM_IO_OK : NVM_IO_DONE;
+}
+
+static int pblk_flush(struct pblk *pblk, struct bio *bio)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	unsigned long flags;
+	int ret = NVM_IO_DONE;
+
+	mutex_lock(&rb->w_lock);
+	spin_lock_irqsave(&rb->s_lock, flags);
+	if (rb->sync != rb->mem) {
+		bio_list_add(&pblk_rb_entry(rb, rb->mem - 1)->bios, bio);
+		ret = NVM_IO_OK;
+	}
+	spin_unlock_irqrestore(&rb->s_lock, flags);
+	mutex_unlock(&rb->w_lock);
+
+	if (ret == NVM_IO_OK) {
+		set_bit(PBLK_WRITE_FLUSH, &pblk->write_flags);
+		pblk_write_kick(pblk);
+	}
+
+	return ret;
+}
+
+static void pblk_write_gc(struct pblk *pblk, u64 *lbas, struct ppa_addr *ppas,
+						struct page **pages, int nr)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	struct pblk_rb_entry *entry;
+	unsigned long pos, flags;
+	int i, valid = 0;
+
+	pblk_rb_write_lock(pblk, nr, 1);
+	pos = rb->mem;
+
+	for (i = 0; i < nr; i++) {
+		entry = pblk_rb_entry(rb, pos + i);
+		memcpy(page_address(entry->page), page_address(pages[i]),
+						PBLK_EXPOSED_PAGE_SIZE);
+		entry->lba = lbas[i];
+		entry->flags = PBLK_RB_GC;
+	}
+
+	spin_lock_irqsave(&pblk->trans_lock, flags);
+	for (i = 0; i < nr; i++) {
+		entry = pblk_rb_entry(rb, pos + i);
+
+		/* updated by a user write or discard since it was read */
+		if (pblk->trans_map[lbas[i]].ppa != ppas[i].ppa) {
+			entry->lba = ADDR_EMPTY;
+			entry->flags = PBLK_RB_PAD;
+			continue;
+		}
+
+		pblk_map_set_cache(pblk, lbas[i], pos + i);
+		valid++;
+	}
+	spin_unlock_irqrestore(&pblk->trans_lock, flags);
+
+	atomic_add(valid, &rb->gc_cnt);
+	smp_store_release(&rb->mem, pos + nr);
+	mutex_unlock(&rb->w_lock);
+
+	pblk_write_kick(pblk);
+}
+
+/*
+ * Take back the sectors of a write that did not make it to the media.  They
+ * are accounted as invalid, and if the block went bad it is not written to
+ * anymore and left to GC to move the data it already holds.
+ */
+static void pblk_write_recover(struct pblk *pblk, struct nvm_rq *rqd, int bad)
+{
+	struct pblk_rq *prq = nvm_rq_to_pdu(rqd);
+	struct pblk_block *rblk = prq->rblk;
+	struct pblk_lun *rlun = rblk->rlun;
+	unsigned int nr = rqd->nr_ppas;
+	unsigned long flags;
+
+	bio_put(rqd->bio);
+	rqd->bio = NULL;
+	if (nr > 1)
+		nvm_dev_dma_free(pblk->dev, rqd->ppa_list, rqd->dma_ppa_list);
+	rqd->ppa_list = NULL;
+	rqd->error = 0;
+	rqd->ppa_status = 0;
+
+	if (bad) {
+		rblk->flags |= PBLK_BLK_BAD;
+		if (rlun->cur == rblk) {
+			nr += pblk->dev->sec_per_blk - rblk->next_sec;
+			rblk->next_sec = pblk->dev->sec_per_blk;
+			rlun->cur = NULL;
+		}
+	}
+
+	spin_lock_irqsave(&pblk->trans_lock, flags);
+	rblk->nr_invalid += nr;
+	spin_unlock_irqrestore(&pblk->trans_lock, flags);
+
+	pblk_blk_commit(pblk, rblk, nr);
+}
+
+/* requires a current block on the lun */
+static int pblk_write_rq(struct pblk *pblk, struct nvm_rq *rqd,
+							struct pblk_lun *rlun)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct pblk_rq *prq = nvm_rq_to_pdu(rqd);
+	struct pblk_block *rblk = rlun->cur;
+	struct pblk_rb_entry *entry;
+	struct bio *bio;
+	int nr = pblk->unit;
+	int i, err;
+
+	bio = bio_alloc(GFP_KERNEL, nr);
+	if (!bio)
+		return -ENOMEM;
+	bio->bi_rw = WRITE;
+
+	for (i = 0; i < nr; i++) {
+		entry = pblk_rb_entry(&pblk->rb, prq->pos + i);
+		if (bio_add_pc_page(dev->q, bio, entry->page,
+				PBLK_EXPOSED_PAGE_SIZE, 0) !=
+				PBLK_EXPOSED_PAGE_SIZE) {
+			bio_put(bio);
+			return -ENOMEM;
+		}
+	}
+
+	if (nr > 1) {
+		rqd->ppa_list = nvm_dev_dma_alloc(dev, GFP_KERNEL,
+							&rqd->dma_ppa_list);
+		if (!rqd->ppa_list) {
+			bio_put(bio);
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i < nr; i++) {
+		entry = pblk_rb_entry(&pblk->rb, prq->pos + i);
+		entry->ppa = pblk_sec_to_ppa(pblk, rblk, rblk->next_sec++);
+
+		if (nr > 1)
+			rqd->ppa_list[i] = entry->ppa;
+		else
+			rqd->ppa_addr = entry->ppa;
+	}
+
+	if (rblk->next_sec == dev->sec_per_blk)
+		rlun->cur = NULL;
+
+	rqd->bio = bio;
+	rqd->nr_ppas = nr;
+	rqd->opcode = NVM_OP_PWRITE;
+	rqd->flags = pblk->wr_flags;
+	prq->type = PBLK_RQ_WRITE;
+	prq->rblk = rblk;
+
+	atomic_inc(&rlun->inflight_writes);
+	err = nvm_submit_io(dev, rqd);
+	if (err) {
+		pr_err("pblk: write submission failed: %d\n", err);
+		atomic_dec(&rlun->inflight_writes);
+		pblk_write_recover(pblk, rqd, 0);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void pblk_end_io_write(struct pblk *pblk, struct nvm_rq *rqd)
+{
+	struct pblk_rq *prq = nvm_rq_to_pdu(rqd);
+	struct pblk_block *rblk = prq->rblk;
+	unsigned long flags;
+	int i;
+
+	atomic_dec(&rblk->rlun->inflight_writes);
+
+	if (rqd->error) {
+		pr_err_ratelimited("pblk: write failed on block %lu (%d)\n",
+						rblk->parent->id, rqd->error);
+
+		spin_lock_irqsave(&pblk->resubmit_lock, flags);
+		list_add_tail(&prq->list, &pblk->resubmit_list);
+		spin_unlock_irqrestore(&pblk->resubmit_lock, flags);
+
+		pblk_write_kick(pblk);
+		return;
+	}
+
+	spin_lock_irqsave(&pblk->trans_lock, flags);
+	for (i = 0; i < rqd->nr_ppas; i++)
+		pblk_map_set_dev(pblk, pblk_rb_entry(&pblk->rb, prq->pos + i),
+								prq->pos + i);
+	spin_unlock_irqrestore(&pblk->trans_lock, flags);
+
+	pblk_blk_commit(pblk, rblk, rqd->nr_ppas);
+	pblk_rb_sync(pblk, prq->pos, rqd->nr_ppas);
+
+	bio_put(rqd->bio);
+	pblk_free_rqd(pblk, rqd);
+
+	pblk_write_kick(pblk);
+}
+
+static int pblk_lun_writable(struct pblk *pblk, struct pblk_lun *rlun)
+{
+	if (atomic_read(&rlun->inflight_writes) >= PBLK_LUN_MAX_WRITES)
+		return 0;
+
+	if (!rlun->cur)
+		rlun->cur = pblk_get_blk(pblk, rlun);
+
+	return rlun->cur != NULL;
+}
+
+/*
+ * Units are striped round-robin across the luns.  A lun with reads in
+ * flight is passed over if another one can take the write, so reads don't
+ * queue up behind a program.
+ */
+static struct pblk_lun *pblk_get_lun(struct pblk *pblk)
+{
+	struct pblk_lun *rlun, *found = NULL;
+	int i;
+
+	for (i = 0; i < pblk->nr_luns; i++) {
+		rlun = &pblk->luns[(pblk->next_lun + i) % pblk->nr_luns];
+
+		if (!pblk_lun_writable(pblk, rlun))
+			continue;
+
+		if (!atomic_read(&rlun->inflight_reads)) {
+			found = rlun;
+			break;
+		}
+
+		if (!found)
+			found = rlun;
+	}
+
+	if (found)
+		pblk->next_lun = (found - pblk->luns + 1) % pblk->nr_luns;
+
+	return found;
+}
+
+/* returns 1 if a write unit was submitted */
+static int pblk_submit_write(struct pblk *pblk)
+{
+	struct pblk_rb *rb = &pblk->rb;
+	struct pblk_lun *rlun;
+	struct pblk_rq *prq, *tprq;
+	struct nvm_rq *rqd;
+	unsigned long pending, flags;
+	LIST_HEAD(failed);
+	int err;
+
+	spin_lock_irqsave(&pblk->resubmit_lock, flags);
+	list_splice_init(&pblk->resubmit_list, &failed);
+	spin_unlock_irqrestore(&pblk->resubmit_lock, flags);
+
+	list_for_each_entry_safe(prq, tprq, &failed, list) {
+		pblk_write_recover(pblk, nvm_rq_from_pdu(prq), 1);
+		list_move_tail(&prq->list, &pblk->retry_list);
+	}
+
+	prq = list_first_entry_or_null(&pblk->retry_list, struct pblk_rq,
+									list);
+	if (prq) {
+		rlun = pblk_get_lun(pblk);
+		if (!rlun)
+			return 0;
+
+		list_del_init(&prq->list);
+		err = pblk_write_rq(pblk, nvm_rq_from_pdu(prq), rlun);
+		if (err) {
+			list_add(&prq->list, &pblk->retry_list);
+			return 0;
+		}
+
+		return 1;
+	}
+
+	pending = smp_load_acquire(&rb->mem) - rb->subm;
+	if (pending < pblk->unit) {
+		if (!test_and_clear_bit(PBLK_WRITE_FLUSH, &pblk->write_flags))
+			return 0;
+		if (!pending)
+			return 0;
+
+		if (pblk_rb_pad(pblk)) {
+			set_bit(PBLK_WRITE_FLUSH, &pblk->write_flags);
+			return 0;
+		}
+	}
+
+	rlun = pblk_get_lun(pblk);
+	if (!rlun) {
+		pblk_gc_kick(pblk);
+		return 0;
+	}
+
+	rqd = pblk_alloc_rqd(pblk, GFP_KERNEL);
+	if (!rqd)
+		return 0;
+
+	prq = nvm_rq_to_pdu(rqd);
+	prq->pos = rb->subm;
+	INIT_LIST_HEAD(&prq->list);
+
+	err = pblk_write_rq(pblk, rqd, rlun);
+	if (err == -ENOMEM) {
+		pblk_free_rqd(pblk, rqd);
+		return 0;
+	}
+
+	smp_store_release(&rb->subm, rb->subm + pblk->unit);
+
+	if (err) {
+		list_add_tail(&prq->list, &pblk->retry_list);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int pblk_write_ts(void *data)
+{
+	struct pblk *pblk = data;
+
+	while (!kthread_should_stop()) {
+		if (!wait_event_interruptible_timeout(pblk->writer_wait,
+				test_and_clear_bit(PBLK_WRITE_KICK,
+						&pblk->write_flags) ||
+				kthread_should_stop(),
+				msecs_to_jiffies(PBLK_FLUSH_MSECS)))
+			/* idle, don't keep a partial unit around forever */
+			set_bit(PBLK_WRITE_FLUSH, &pblk->write_flags);
+
+		while (pblk_submit_write(pblk))
+			;
+	}
+
+	return 0;
+}
+
+/*
+ * Read path
+ */
+
+/*
+ * The write buffer entry can be released and reused as soon as its write
+ * completes, so the copy is only good if the mapping still points to the
+ * entry after it was taken.
+ */
+static int pblk_read_from_cache(struct pblk *pblk, sector_t lba,
+					struct ppa_addr ppa, void *dst)
+{
+	struct pblk_rb_entry *entry = pblk_rb_entry(&pblk->rb, ppa.c.line);
+	unsigned long flags;
+	int ret;
+
+	memcpy(dst, page_address(entry->page), PBLK_EXPOSED_PAGE_SIZE);
+
+	spin_lock_irqsave(&pblk->trans_lock, flags);
+	ret = pblk->trans_map[lba].ppa == ppa.ppa;
+	spin_unlock_irqrestore(&pblk->trans_lock, flags);
+
+	return ret;
+}
+
+static int pblk_read_sync(struct pblk *pblk, struct ppa_addr *ppas, int nr,
+							struct page **pages)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct nvm_rq *rqd;
+	struct pblk_rq *prq;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(wait);
+	int i, ret;
+
+	bio = bio_alloc(GFP_NOIO, nr);
+	if (!bio)
+		return -ENOMEM;
+	bio->bi_rw = READ;
+
+	for (i = 0; i < nr; i++) {
+		if (bio_add_pc_page(dev->q, bio, pages[i],
+				PBLK_EXPOSED_PAGE_SIZE, 0) !=
+				PBLK_EXPOSED_PAGE_SIZE) {
+			ret = -ENOMEM;
+			goto out_bio;
+		}
+	}
+
+	rqd = pblk_alloc_rqd(pblk, GFP_NOIO);
+	if (!rqd) {
+		ret = -ENOMEM;
+		goto out_bio;
+	}
+
+	rqd->nr_ppas = nr;
+	if (nr > 1) {
+		rqd->ppa_list = nvm_dev_dma_alloc(dev, GFP_NOIO,
+							&rqd->dma_ppa_list);
+		if (!rqd->ppa_list) {
+			ret = -ENOMEM;
+			goto out_rqd;
+		}
+		memcpy(rqd->ppa_list, ppas, nr * sizeof(struct ppa_addr));
+	} else {
+		rqd->ppa_addr = ppas[0];
+	}
+
+	rqd->bio = bio;
+	rqd->opcode = NVM_OP_PREAD;
+	rqd->wait = &wait;
+	prq = nvm_rq_to_pdu(rqd);
+	prq->type = PBLK_RQ_READ_SYNC;
+
+	pblk_lun_reads(pblk, rqd, 1);
+	ret = nvm_submit_io(dev, rqd);
+	if (ret) {
+		pr_err("pblk: read submission failed: %d\n", ret);
+		nvm_addr_to_generic_mode(dev, rqd);
+		pblk_lun_reads(pblk, rqd, -1);
+		goto out_rqd;
+	}
+
+	wait_for_completion_io(&wait);
+	ret = rqd->error ? -EIO : 0;
+out_rqd:
+	pblk_free_rqd(pblk, rqd);
+out_bio:
+	bio_put(bio);
+	return ret;
+}
+
+/* read a single page, wherever it is by now */
+static int pblk_read_page(struct pblk *pblk, sector_t lba, void *dst)
+{
+	struct ppa_addr ppa;
+	struct page *page;
+	int ret;
+
+	for (;;) {
+		pblk_lookup(pblk, lba, 1, &ppa);
+
+		if (ppa_empty(ppa)) {
+			memset(dst, 0, PBLK_EXPOSED_PAGE_SIZE);
+			return 0;
+		}
+
+		if (!ppa.c.is_cached)
+			break;
+
+		if (pblk_read_from_cache(pblk, lba, ppa, dst))
+			return 0;
+	}
+
+	page = mempool_alloc(pblk->page_pool, GFP_NOIO);
+	ret = pblk_read_sync(pblk, &ppa, 1, &page);
+	if (!ret)
+		memcpy(dst, page_address(page), PBLK_EXPOSED_PAGE_SIZE);
+	mempool_free(page, pblk->page_pool);
+
+	return ret;
+}
+
+/*
+ * Part of the bio is still in the write buffer or was never written.  Read
+ * the rest from the media into private pages and assemble the bio here.
+ */
+static int pblk_read_mixed(struct pblk *pblk, struct bio *bio,
+				struct ppa_addr *ppas, int nr, int nr_dev)
+{
+	sector_t lba = pblk_get_laddr(bio);
+	struct ppa_addr *dev_ppas;
+	struct page **pages;
+	struct bio_vec bv;
+	struct bvec_iter iter;
+	unsigned int off;
+	int i, j, ret = 0;
+	void *dst;
+
+	pages = kmalloc(nr_dev * (sizeof(struct page *) +
+				sizeof(struct ppa_addr)), GFP_NOIO);
+	if (!pages)
+		return NVM_IO_ERR;
+	dev_ppas = (struct ppa_addr *)(pages + nr_dev);
+
+	for (i = 0, j = 0; i < nr; i++) {
+		if (!pblk_ppa_is_dev(ppas[i]))
+			continue;
+
+		dev_ppas[j] = ppas[i];
+		pages[j++] = mempool_alloc(pblk->page_pool, GFP_NOIO);
+	}
+
+	if (nr_dev) {
+		ret = pblk_read_sync(pblk, dev_ppas, nr_dev, pages);
+		if (ret)
+			goto out;
+	}
+
+	i = j = 0;
+	bio_for_each_segment(bv, bio, iter) {
+		dst = kmap(bv.bv_page) + bv.bv_offset;
+		for (off = 0; off < bv.bv_len; off += PBLK_EXPOSED_PAGE_SIZE,
+									i++) {
+			if (ppa_empty(ppas[i]))
+				memset(dst + off, 0, PBLK_EXPOSED_PAGE_SIZE);
+			else if (!ppas[i].c.is_cached)
+				memcpy(dst + off, page_address(pages[j++]),
+						PBLK_EXPOSED_PAGE_SIZE);
+			else if (!pblk_read_from_cache(pblk, lba + i, ppas[i],
+								dst + off))
+				ret = pblk_read_page(pblk, lba + i, dst + off);
+
+			if (ret)
+				break;
+		}
+		kunmap(bv.bv_page);
+
+		if (ret)
+			break;
+	}
+
+out:
+	for (j = 0; j < nr_dev; j++)
+		mempool_free(pages[j], pblk->page_pool);
+	kfree(pages);
+
+	return ret ? NVM_IO_ERR : NVM_IO_DONE;
+}
+
+static int pblk_read_rq(struct pblk *pblk, struct bio *bio)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct nvm_rq *rqd;
+	struct pblk_rq *prq;
+	struct ppa_addr *ppas;
+	dma_addr_t dma_ppas;
+	int nr = pblk_get_pages(bio);
+	int i, nr_dev = 0;
+	int ret;
+
+	ppas = nvm_dev_dma_alloc(dev, GFP_NOIO, &dma_ppas);
+	if (!ppas)
+		return NVM_IO_ERR;
+
+	pblk_lookup(pblk, pblk_get_laddr(bio), nr, ppas);
+	for (i = 0; i < nr; i++)
+		if (pblk_ppa_is_dev(ppas[i]))
+			nr_dev++;
+
+	if (nr_dev != nr) {
+		ret = pblk_read_mixed(pblk, bio, ppas, nr, nr_dev);
+		nvm_dev_dma_free(dev, ppas, dma_ppas);
+		return ret;
+	}
+
+	rqd = pblk_alloc_rqd(pblk, GFP_NOIO);
+	if (!rqd) {
+		nvm_dev_dma_free(dev, ppas, dma_ppas);
+		return NVM_IO_ERR;
+	}
+
+	rqd->nr_ppas = nr;
+	if (nr > 1) {
+		rqd->ppa_list = ppas;
+		rqd->dma_ppa_list = dma_ppas;
+	} else {
+		rqd->ppa_addr = ppas[0];
+		nvm_dev_dma_free(dev, ppas, dma_ppas);
+	}
+
+	bio_get(bio);
+	rqd->bio = bio;
+	rqd->opcode = NVM_OP_PREAD;
+	prq = nvm_rq_to_pdu(rqd);
+	prq->type = PBLK_RQ_READ;
+
+	pblk_lun_reads(pblk, rqd, 1);
+	ret = nvm_submit_io(dev, rqd);
+	if (ret) {
+		pr_err("pblk: read submission failed: %d\n", ret);
+		nvm_addr_to_generic_mode(dev, rqd);
+		pblk_lun_reads(pblk, rqd, -1);
+		bio_put(bio);
+		pblk_free_rqd(pblk, rqd);
+		return NVM_IO_ERR;
+	}
+
+	return NVM_IO_OK;
+}
+
+static void pblk_end_io_read(struct pblk *pblk, struct nvm_rq *rqd)
+{
+	struct pblk_rq *prq = nvm_rq_to_pdu(rqd);
+
+	nvm_addr_to_generic_mode(pblk->dev, rqd);
+	pblk_lun_reads(pblk, rqd, -1);
+
+	if (prq->type == PBLK_RQ_READ_SYNC) {
+		complete(rqd->wait);
+		return;
+	}
+
+	bio_put(rqd->bio);
+	pblk_free_rqd(pblk, rqd);
+}
+
+static void pblk_end_io(struct nvm_rq *rqd)
+{
+	struct pblk *pblk = container_of(rqd->ins, struct pblk, instance);
+	struct pblk_rq *prq = nvm_rq_to_pdu(rqd);
+
+	if (prq->type == PBLK_RQ_WRITE)
+		pblk_end_io_write(pblk, rqd);
+	else
+		pblk_end_io_read(pblk, rqd);
+}
+
+static blk_qc_t pblk_make_rq(struct request_queue *q, struct bio *bio)
+{
+	struct pblk *pblk = q->queuedata;
+	int err;
+
+	blk_queue_split(q, &bio, q->bio_split);
+
+	if (bio->bi_rw & REQ_DISCARD) {
+		pblk_discard(pblk, bio);
+		return BLK_QC_T_NONE;
+	}
+
+	if (!bio->bi_iter.bi_size)
+		err = pblk_flush(pblk, bio);
+	else if (!pblk_bio_is_valid(pblk, bio))
+		err = NVM_IO_ERR;
+	else if (bio_data_dir(bio) == WRITE)
+		err = pblk_write_to_cache(pblk, bio);
+	else
+		err = pblk_read_rq(pblk, bio);
+
+	switch (err) {
+	case NVM_IO_OK:
+		break;
+	case NVM_IO_DONE:
+		bio_endio(bio);
+		break;
+	case NVM_IO_ERR:
+	default:
+		bio_io_error(bio);
+		break;
+	}
+
+	return BLK_QC_T_NONE;
+}
+
+/*
+ * Garbage collection
+ */
+
+/* the closed block with the most invalid sectors, across all luns */
+static struct pblk_block *pblk_gc_victim(struct pblk *pblk)
+{
+	struct pblk_lun *rlun;
+	struct pblk_block *rblk, *victim = NULL;
+	unsigned long flags;
+	int i;
+
+	pblk_for_each_lun(pblk, rlun, i) {
+		spin_lock_irqsave(&rlun->lock, flags);
+		list_for_each_entry(rblk, &rlun->closed_list, list)
+			if (!victim || READ_ONCE(rblk->nr_invalid) >
+						READ_ONCE(victim->nr_invalid))
+				victim = rblk;
+		spin_unlock_irqrestore(&rlun->lock, flags);
+	}
+
+	if (!victim || !READ_ONCE(victim->nr_invalid))
+		return NULL;
+
+	/* only GC takes blocks off the closed lists */
+	rlun = victim->rlun;
+	spin_lock_irqsave(&rlun->lock, flags);
+	list_del_init(&victim->list);
+	spin_unlock_irqrestore(&rlun->lock, flags);
+
+	return victim;
+}
+
+/*
+ * Move the valid sectors of a block through the write buffer.  The GC share
+ * of the buffer throttles this against user writes.
+ */
+static int pblk_gc_move_valid(struct pblk *pblk, struct pblk_block *rblk,
+			u64 *lbas, struct ppa_addr *ppas, struct page **pages)
+{
+	struct nvm_dev *dev = pblk->dev;
+	u64 base = pblk_blk_to_rev(pblk, rblk);
+	unsigned int sec = 0;
+	unsigned long flags;
+	int i, nr, ret;
+
+	while (sec < dev->sec_per_blk) {
+		nr = 0;
+
+		spin_lock_irqsave(&pblk->trans_lock, flags);
+		for (; sec < dev->sec_per_blk && nr < pblk->max_req; sec++) {
+			u64 lba = pblk->rev_map[base + sec];
+
+			if (lba == ADDR_EMPTY)
+				continue;
+
+			lbas[nr] = lba;
+			ppas[nr] = pblk_sec_to_ppa(pblk, rblk, sec);
+			nr++;
+		}
+		spin_unlock_irqrestore(&pblk->trans_lock, flags);
+
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++)
+			pages[i] = mempool_alloc(pblk->page_pool, GFP_NOIO);
+
+		ret = pblk_read_sync(pblk, ppas, nr, pages);
+		if (!ret)
+			pblk_write_gc(pblk, lbas, ppas, pages, nr);
+
+		for (i = 0; i < nr; i++)
+			mempool_free(pages[i], pblk->page_pool);
+
+		if (ret) {
+			pr_err("pblk: gc read failed on block %lu\n",
+							rblk->parent->id);
+			return ret;
+		}
+	}
+
+	if (READ_ONCE(rblk->nr_invalid) != dev->sec_per_blk) {
+		pr_err("pblk: failed to garbage collect block %lu\n",
+							rblk->parent->id);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void pblk_gc(struct work_struct *work)
+{
+	struct pblk *pblk = container_of(work, struct pblk, ws_gc);
+	struct pblk_block *rblk;
+	struct ppa_addr *ppas;
+	struct page **pages;
+	unsigned long flags;
+	u64 *lbas;
+
+	lbas = kmalloc_array(pblk->max_req, sizeof(u64), GFP_KERNEL);
+	ppas = kmalloc_array(pblk->max_req, sizeof(struct ppa_addr),
+								GFP_KERNEL);
+	pages = kmalloc_array(pblk->max_req, sizeof(struct page *),
+								GFP_KERNEL);
+	if (!lbas || !ppas || !pages)
+		goto out;
+
+	while (!test_bit(PBLK_STATE_EXITING, &pblk->state) &&
+						pblk_rl_gc_needed(pblk)) {
+		rblk = pblk_gc_victim(pblk);
+		if (!rblk)
+			break;
+
+		pr_debug("pblk: block '%lu' being reclaimed\n",
+							rblk->parent->id);
+
+		if (pblk_gc_move_valid(pblk, rblk, lbas, ppas, pages)) {
+			spin_lock_irqsave(&rblk->rlun->lock, flags);
+			list_add_tail(&rblk->list, &rblk->rlun->closed_list);
+			spin_unlock_irqrestore(&rblk->rlun->lock, flags);
+			break;
+		}
+
+		pblk_put_blk(pblk, rblk);
+	}
+
+out:
+	kfree(pages);
+	kfree(ppas);
+	kfree(lbas);
+}
+
+static void pblk_gc_timer(unsigned long data)
+{
+	struct pblk *pblk = (struct pblk *)data;
+
+	if (pblk_rl_gc_needed(pblk))
+		pblk_gc_kick(pblk);
+
+	mod_timer(&pblk->gc_timer, jiffies + msecs_to_jiffies(GC_TIME_MSECS));
+}
+
+static int pblk_gc_init(struct pblk *pblk)
+{
+	pblk->kgc_wq = alloc_workqueue("pblk-gc", WQ_MEM_RECLAIM | WQ_UNBOUND,
+									1);
+	if (!pblk->kgc_wq)
+		return -ENOMEM;
+
+	INIT_WORK(&pblk->ws_gc, pblk_gc);
+	setup_timer(&pblk->gc_timer, pblk_gc_timer, (unsigned long)pblk);
+
+	return 0;
+}
+
+static void pblk_gc_free(struct pblk *pblk)
+{
+	if (pblk->kgc_wq)
+		destroy_workqueue(pblk->kgc_wq);
+}
+
+/*
+ * Initialization and teardown
+ */
+static int pblk_core_init(struct pblk *pblk)
+{
+	pblk->page_pool = mempool_create_page_pool(PAGE_POOL_SIZE, 0);
+	if (!pblk->page_pool)
+		return -ENOMEM;
+
+	pblk->rq_pool = mempool_create_slab_pool(64, pblk_rq_cache);
+	if (!pblk->rq_pool)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void pblk_core_free(struct pblk *pblk)
+{
+	mempool_destroy(pblk->page_pool);
+	mempool_destroy(pblk->rq_pool);
+}
+
+static int pblk_map_init(struct pblk *pblk)
+{
+	sector_t i;
+
+	pblk->trans_map = vmalloc(sizeof(struct ppa_addr) * pblk->capacity);
+	if (!pblk->trans_map)
+		return -ENOMEM;
+
+	for (i = 0; i < pblk->capacity; i++)
+		ppa_set_empty(&pblk->trans_map[i]);
+
+	pblk->rev_map = vmalloc(sizeof(u64) * pblk->nr_secs);
+	if (!pblk->rev_map)
+		return -ENOMEM;
+
+	for (i = 0; i < pblk->nr_secs; i++)
+		pblk->rev_map[i] = ADDR_EMPTY;
+
+	return 0;
+}
+
+static void pblk_map_free(struct pblk *pblk)
+{
+	vfree(pblk->rev_map);
+	vfree(pblk->trans_map);
+}
+
+static void pblk_luns_free(struct pblk *pblk)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct pblk_lun *rlun;
+	int i;
+
+	if (!pblk->luns)
+		return;
+
+	pblk_for_each_lun(pblk, rlun, i) {
+		if (!rlun->parent)
+			break;
+		dev->mt->release_lun(dev, rlun->parent->id);
+		vfree(rlun->blocks);
+	}
+
+	kfree(pblk->luns);
+}
+
+static int pblk_luns_init(struct pblk *pblk, int lun_begin, int lun_end)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct pblk_lun *rlun;
+	int i, j;
+
+	pblk->luns = kcalloc(pblk->nr_luns, sizeof(struct pblk_lun),
+								GFP_KERNEL);
+	if (!pblk->luns)
+		return -ENOMEM;
+
+	/* 1:1 mapping */
+	for (i = 0; i < pblk->nr_luns; i++) {
+		int lunid = lun_begin + i;
+		struct nvm_lun *lun;
+
+		if (dev->mt->reserve_lun(dev, lunid)) {
+			pr_err("pblk: lun %u is already allocated\n", lunid);
+			return -EINVAL;
+		}
+
+		lun = dev->mt->get_lun(dev, lunid);
+		if (!lun) {
+			dev->mt->release_lun(dev, lunid);
+			return -EINVAL;
+		}
+
+		rlun = &pblk->luns[i];
+		rlun->parent = lun;
+		rlun->blocks = vzalloc(sizeof(struct pblk_block) *
+							dev->blks_per_lun);
+		if (!rlun->blocks)
+			return -ENOMEM;
+
+		for (j = 0; j < dev->blks_per_lun; j++) {
+			struct pblk_block *rblk = &rlun->blocks[j];
+
+			rblk->parent = &lun->blocks[j];
+			rblk->rlun = rlun;
+			INIT_LIST_HEAD(&rblk->list);
+		}
+
+		rlun->pblk = pblk;
+		INIT_LIST_HEAD(&rlun->closed_list);
+		atomic_set(&rlun->inflight_reads, 0);
+		atomic_set(&rlun->inflight_writes, 0);
+		spin_lock_init(&rlun->lock);
+	}
+
+	return 0;
+}
+
+static int pblk_writer_init(struct pblk *pblk)
+{
+	pblk->writer = kthread_run(pblk_write_ts, pblk, "pblk-writer");
+	if (IS_ERR(pblk->writer))
+		return PTR_ERR(pblk->writer);
+
+	return 0;
+}
+
+static void pblk_free(struct pblk *pblk)
+{
+	pblk_gc_free(pblk);
+	pblk_rb_free(pblk);
+	pblk_map_free(pblk);
+	pblk_core_free(pblk);
+	pblk_luns_free(pblk);
+
+	kfree(pblk);
+}
+
+static void pblk_exit(void *private)
+{
+	struct pblk *pblk = private;
+
+	set_bit(PBLK_STATE_EXITING, &pblk->state);
+	del_timer_sync(&pblk->gc_timer);
+	flush_workqueue(pblk->kgc_wq);
+
+	/* write out what is left in the buffer */
+	set_bit(PBLK_WRITE_FLUSH, &pblk->write_flags);
+	pblk_write_kick(pblk);
+	wait_event(pblk->rb.wait, pblk_rb_empty(&pblk->rb));
+
+	kthread_stop(pblk->writer);
+	cancel_work_sync(&pblk->ws_gc);
+
+	pblk_put_blks(pblk);
+	pblk_free(pblk);
+}
+
+static sector_t pblk_capacity(void *private)
+{
+	struct pblk *pblk = private;
+
+	return pblk->capacity * NR_PHY_IN_LOG;
+}
+
+static struct nvm_tgt_type tt_pblk;
+
+static void *pblk_init(struct nvm_dev *dev, struct gendisk *tdisk,
+						int lun_begin, int lun_end)
+{
+	struct request_queue *tqueue = tdisk->queue;
+	struct pblk *pblk;
+	unsigned long long reserved, provisioned;
+	unsigned int nr_entries;
+	int ret;
+
+	if (dev->sec_size != PBLK_EXPOSED_PAGE_SIZE) {
+		pr_err("nvm: pblk: sector size %d not supported\n",
+							dev->sec_size);
+		return ERR_PTR(-EINVAL);
+	}
+
+	if (!dev->ops->submit_io ||
+			dev->sec_per_pl > dev->ops->max_phys_sect) {
+		pr_err("nvm: pblk: device can't write a page at once\n");
+		return ERR_PTR(-EINVAL);
+	}
+
+	pblk = kzalloc(sizeof(struct pblk), GFP_KERNEL);
+	if (!pblk)
+		return ERR_PTR(-ENOMEM);
+
+	pblk->instance.tt = &tt_pblk;
+	pblk->dev = dev;
+	pblk->disk = tdisk;
+
+	pblk->lun_offset = lun_begin;
+	pblk->nr_luns = lun_end - lun_begin + 1;
+	pblk->total_blocks = (unsigned long)dev->blks_per_lun * pblk->nr_luns;
+	pblk->nr_secs = (unsigned long long)dev->sec_per_lun * pblk->nr_luns;
+	pblk->unit = dev->sec_per_pl;
+	pblk->max_req = dev->ops->max_phys_sect;
+	pblk->wr_flags = dev->plane_mode >> 1;
+
+	spin_lock_init(&pblk->trans_lock);
+	spin_lock_init(&pblk->resubmit_lock);
+	INIT_LIST_HEAD(&pblk->resubmit_list);
+	INIT_LIST_HEAD(&pblk->retry_list);
+	init_waitqueue_head(&pblk->writer_wait);
+
+	/* current, GC and two emergency blocks for each lun */
+	reserved = (unsigned long long)pblk->nr_luns * dev->sec_per_blk * 4;
+	if (reserved >= pblk->nr_secs) {
+		pr_err("nvm: pblk: not enough space available to expose storage.\n");
+		ret = -EINVAL;
+		goto err;
+	}
+	provisioned = pblk->nr_secs - reserved;
+	sector_div(provisioned, 10);
+	pblk->capacity = provisioned * 9;
+
+	ret = pblk_luns_init(pblk, lun_begin, lun_end);
+	if (ret) {
+		pr_err("nvm: pblk: could not initialize luns\n");
+		goto err;
+	}
+
+	ret = pblk_core_init(pblk);
+	if (ret) {
+		pr_err("nvm: pblk: could not initialize core\n");
+		goto err;
+	}
+
+	ret = pblk_map_init(pblk);
+	if (ret) {
+		pr_err("nvm: pblk: could not initialize maps\n");
+		goto err;
+	}
+
+	nr_entries = max(pblk->unit * pblk->nr_luns * PBLK_RB_UNITS_PER_LUN,
+					4 * (pblk->max_req + pblk->unit));
+	ret = pblk_rb_init(pblk, roundup_pow_of_two(nr_entries));
+	if (ret) {
+		pr_err("nvm: pblk: could not initialize write buffer\n");
+		goto err;
+	}
+
+	pblk_rl_init(pblk);
+
+	ret = pblk_gc_init(pblk);
+	if (ret) {
+		pr_err("nvm: pblk: could not initialize gc\n");
+		goto err;
+	}
+
+	ret = pblk_writer_init(pblk);
+	if (ret) {
+		pr_err("nvm: pblk: could not start writer thread\n");
+		goto err;
+	}
+
+	blk_queue_logical_block_size(tqueue, PBLK_EXPOSED_PAGE_SIZE);
+	blk_queue_write_cache(tqueue, true, true);
+
+	tqueue->limits.discard_granularity = PBLK_EXPOSED_PAGE_SIZE;
+	tqueue->limits.discard_zeroes_data = 0;
+	blk_queue_max_discard_sectors(tqueue, UINT_MAX >> 9);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, tqueue);
+
+	pr_info("nvm: pblk initialized with %d luns, %u buffer entries and %llu pages.\n",
+			pblk->nr_luns, pblk->rb.nr_entries,
+			(unsigned long long)pblk->capacity);
+
+	mod_timer(&pblk->gc_timer, jiffies + msecs_to_jiffies(GC_TIME_MSECS));
+
+	return pblk;
+err:
+	pblk_free(pblk);
+	return ERR_PTR(ret);
+}
+
+/* buffered, striped physical writes and rate-limited greedy GC */
+static struct nvm_tgt_type tt_pblk = {
+	.name		= "pblk",
+	.version	= {1, 0, 0},
+
+	.make_rq	= pblk_make_rq,
+	.capacity	= pblk_capacity,
+	.end_io		= pblk_end_io,
+
+	.init		= pblk_init,
+	.exit		= pblk_exit,
+};
+
+static int __init pblk_module_init(void)
+{
+	int ret;
+
+	pblk_rq_cache = kmem_cache_create("pblk_rq",
+			sizeof(struct nvm_rq) + sizeof(struct pblk_rq),
+			0, 0, NULL);
+	if (!pblk_rq_cache)
+		return -ENOMEM;
+
+	ret = nvm_register_tgt_type(&tt_pblk);
+	if (ret)
+		kmem_cache_destroy(pblk_rq_cache);
+
+	return ret;
+}
+
+static void pblk_module_exit(void)
+{
+	nvm_unregister_tgt_type(&tt_pblk);
+	kmem_cache_destroy(pblk_rq_cache);
+}
+
+module_init(pblk_module_init);
+module_exit(pblk_module_exit);
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("Physical Block-Device Target for Open-Channel SSDs");
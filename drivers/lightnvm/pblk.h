@@ -0,0 +1,293 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * Implementation of a physical block-device target for Open-channel SSDs.
+ */
+
+#ifndef PBLK_H_
+#define PBLK_H_
+
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/highmem.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include <linux/lightnvm.h>
+
+/* Run GC if less than 1/X blocks are free */
+#define GC_LIMIT_INVERSE 10
+#define GC_TIME_MSECS 100
+
+/* Blocks per lun left to GC only, user writes stall below this */
+#define PBLK_GC_RSV_BLKS 2
+
+#define PBLK_SECTOR (512)
+#define PBLK_EXPOSED_PAGE_SIZE (4096)
+
+#define NR_PHY_IN_LOG (PBLK_EXPOSED_PAGE_SIZE / PBLK_SECTOR)
+
+/* Write units kept in the write buffer for each lun */
+#define PBLK_RB_UNITS_PER_LUN 8
+/* Outstanding writes per lun */
+#define PBLK_LUN_MAX_WRITES 2
+/* Idle time after which a partial write unit is padded and written */
+#define PBLK_FLUSH_MSECS 1000
+
+#define PAGE_POOL_SIZE 64
+
+/* for pblk->write_flags */
+enum {
+	PBLK_WRITE_KICK,		/* new work for the writer */
+	PBLK_WRITE_FLUSH,		/* pad and write a partial unit */
+};
+
+/* for pblk->state */
+enum {
+	PBLK_STATE_EXITING,
+};
+
+/* for pblk_rb_entry->flags */
+enum {
+	PBLK_RB_GC	= 1 << 0,	/* data moved by GC */
+	PBLK_RB_PAD	= 1 << 1,	/* padding, not mapped to a lba */
+	PBLK_RB_DONE	= 1 << 2,	/* on the media */
+};
+
+struct pblk_rb_entry {
+	struct page *page;
+	u64 lba;
+	struct ppa_addr ppa;	/* where the entry is written to */
+	unsigned int flags;
+	struct bio_list bios;	/* flush bios completed once on the media */
+};
+
+/*
+ * Write buffer.  Producers add entries at mem, the writer submits them to
+ * the media from subm, and entries are released in order at sync once their
+ * writes completed.  The positions only ever grow and are masked to index
+ * the entries, so a position identifies an entry uniquely in the L2P table.
+ */
+struct pblk_rb {
+	struct pblk_rb_entry *entries;
+	unsigned int nr_entries;	/* power of two */
+
+	unsigned long mem;
+	unsigned long subm;
+	unsigned long sync;
+
+	struct mutex w_lock;		/* serializes producers */
+	spinlock_t s_lock;		/* protects sync and completion state */
+
+	atomic_t user_cnt;		/* user entries not yet released */
+	atomic_t gc_cnt;		/* GC entries not yet released */
+
+	wait_queue_head_t wait;		/* producers waiting for room */
+};
+
+/*
+ * Rate limiter.  The write buffer is shared between user and GC writes, the
+ * user share shrinking as the number of free blocks drops.
+ */
+struct pblk_rl {
+	unsigned int high;		/* free blocks to start GC at */
+	unsigned int low;		/* free blocks to stop user writes at */
+	unsigned int rsv;		/* entries any writer can always get */
+
+	unsigned int user_max;
+	unsigned int gc_max;
+};
+
+enum {
+	PBLK_BLK_BAD	= 1 << 0,
+};
+
+struct pblk_block {
+	struct nvm_block *parent;
+	struct pblk_lun *rlun;
+	struct list_head list;
+
+	unsigned int next_sec;		/* next sector to write, writer only */
+	unsigned int nr_invalid;	/* protected by pblk->trans_lock */
+	atomic_t nr_cmnt;		/* sectors done with */
+	unsigned int flags;
+};
+
+struct pblk_lun {
+	struct pblk *pblk;
+	struct nvm_lun *parent;
+	struct pblk_block *blocks;	/* Reference to block allocation */
+	struct pblk_block *cur;		/* Block being written to */
+
+	struct list_head closed_list;	/* Fully written blocks, these are
+					 * the candidates for GC
+					 */
+
+	atomic_t inflight_reads;
+	atomic_t inflight_writes;
+
+	spinlock_t lock;
+};
+
+enum {
+	PBLK_RQ_READ,
+	PBLK_RQ_READ_SYNC,
+	PBLK_RQ_WRITE,
+};
+
+struct pblk_rq {
+	int type;
+	struct pblk_block *rblk;	/* write: block written to */
+	unsigned long pos;		/* write: first write buffer entry */
+	struct list_head list;		/* write: failed, to be written again */
+};
+
+struct pblk {
+	/* instance must be kept in top to resolve pblk in unprep */
+	struct nvm_tgt_instance instance;
+
+	struct nvm_dev *dev;
+	struct gendisk *disk;
+
+	int lun_offset;
+	int nr_luns;
+	struct pblk_lun *luns;
+
+	/* calculated values */
+	unsigned long long nr_secs;	/* physical sectors */
+	sector_t capacity;		/* exposed pages */
+	unsigned long total_blocks;
+	int unit;			/* sectors programmed at once */
+	int max_req;			/* sectors per request */
+	int wr_flags;
+
+	/* Logical to physical table, entries point either to the media or
+	 * to the write buffer (c.is_cached).  The reverse table holds the
+	 * logical address of each valid physical sector, for GC.
+	 */
+	struct ppa_addr *trans_map;
+	u64 *rev_map;
+	spinlock_t trans_lock;
+
+	struct pblk_rb rb;
+	struct pblk_rl rl;
+
+	struct task_struct *writer;
+	wait_queue_head_t writer_wait;
+	unsigned long write_flags;
+	int next_lun;			/* writer only */
+
+	spinlock_t resubmit_lock;
+	struct list_head resubmit_list;	/* failed writes */
+	struct list_head retry_list;	/* writer only */
+
+	mempool_t *page_pool;
+	mempool_t *rq_pool;
+
+	struct timer_list gc_timer;
+	struct workqueue_struct *kgc_wq;
+	struct work_struct ws_gc;
+
+	unsigned long state;
+};
+
+static inline sector_t pblk_get_laddr(struct bio *bio)
+{
+	return bio->bi_iter.bi_sector / NR_PHY_IN_LOG;
+}
+
+static inline unsigned int pblk_get_pages(struct bio *bio)
+{
+	return  bio->bi_iter.bi_size / PBLK_EXPOSED_PAGE_SIZE;
+}
+
+static inline struct pblk_rb_entry *pblk_rb_entry(struct pblk_rb *rb,
+							unsigned long pos)
+{
+	return &rb->entries[pos & (rb->nr_entries - 1)];
+}
+
+static inline struct ppa_addr pblk_cacheline_to_ppa(unsigned long pos)
+{
+	struct ppa_addr ppa;
+
+	ppa.ppa = 0;
+	ppa.c.line = pos;
+	ppa.c.is_cached = 1;
+
+	return ppa;
+}
+
+static inline int pblk_ppa_is_cached(struct ppa_addr ppa)
+{
+	return !ppa_empty(ppa) && ppa.c.is_cached;
+}
+
+static inline int pblk_ppa_is_dev(struct ppa_addr ppa)
+{
+	return !ppa_empty(ppa) && !ppa.c.is_cached;
+}
+
+/* Sectors are laid out page by page, each page spanning all planes */
+static inline struct ppa_addr pblk_sec_to_ppa(struct pblk *pblk,
+				struct pblk_block *rblk, unsigned int sec)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct ppa_addr ppa = block_to_ppa(dev, rblk->parent);
+
+	ppa.g.pg = sec / dev->sec_per_pl;
+	sec %= dev->sec_per_pl;
+	ppa.g.pl = sec / dev->sec_per_pg;
+	ppa.g.sec = sec % dev->sec_per_pg;
+
+	return ppa;
+}
+
+static inline unsigned int pblk_ppa_to_sec(struct nvm_dev *dev,
+							struct ppa_addr ppa)
+{
+	return ppa.g.pg * dev->sec_per_pl + ppa.g.pl * dev->sec_per_pg +
+								ppa.g.sec;
+}
+
+static inline struct pblk_lun *pblk_ppa_to_lun(struct pblk *pblk,
+							struct ppa_addr ppa)
+{
+	int lunid = ppa.g.ch * pblk->dev->luns_per_chnl + ppa.g.lun;
+
+	return &pblk->luns[lunid - pblk->lun_offset];
+}
+
+static inline struct pblk_block *pblk_ppa_to_blk(struct pblk *pblk,
+							struct ppa_addr ppa)
+{
+	return &pblk_ppa_to_lun(pblk, ppa)->blocks[ppa.g.blk];
+}
+
+/* Index of the first sector of a block in the reverse table */
+static inline u64 pblk_blk_to_rev(struct pblk *pblk, struct pblk_block *rblk)
+{
+	struct nvm_dev *dev = pblk->dev;
+	struct pblk_lun *rlun = rblk->rlun;
+	u64 blk = (u64)(rlun - pblk->luns) * dev->blks_per_lun +
+							(rblk - rlun->blocks);
+
+	return blk * dev->sec_per_blk;
+}
+
+static inline u64 pblk_ppa_to_rev(struct pblk *pblk, struct ppa_addr ppa)
+{
+	return pblk_blk_to_rev(pblk, pblk_ppa_to_blk(pblk, ppa)) +
+					pblk_ppa_to_sec(pblk->dev, ppa);
+}
+
+#endif /* PBLK_H_ */
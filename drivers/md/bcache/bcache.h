@@ -325,10 +325,13 @@ struct cached_dev {
 	struct delayed_work	writeback_rate_update;
 
 	/*
-	 * Internal to the writeback code, so read_dirty() can keep track of
-	 * where it's at.
+	 * Internal to the writeback code: read_dirty() reads a batch of
+	 * contiguous keys in parallel, but the writes to the backing device
+	 * are issued in sequence order so they reach it as one sequential
+	 * stream.
 	 */
-	sector_t		last_read;
+	atomic_t		writeback_sequence_next;
+	struct closure_waitlist	writeback_ordering_wait;
 
 	/* Limit number of writeback bios in flight */
 	struct semaphore	in_flight;
@@ -346,6 +349,11 @@ struct cached_dev {
 
 	struct cache_accounting	accounting;
 
+	/* jiffies of the last foreground io, for idle writeback */
+	unsigned long		last_foreground_io;
+	/* Moving average of writeback write latency to the backing device */
+	unsigned		writeback_latency_us;
+
 	/* The rest of this all shows up in sysfs */
 	unsigned		sequential_cutoff;
 	unsigned		readahead;
@@ -367,6 +375,9 @@ struct cached_dev {
 	unsigned		writeback_rate_update_seconds;
 	unsigned		writeback_rate_d_term;
 	unsigned		writeback_rate_p_term_inverse;
+
+	unsigned		writeback_latency_target_us;
+	unsigned		writeback_idle_seconds;
 };
 
 enum alloc_reserve {
@@ -968,6 +968,8 @@ static blk_qc_t cached_dev_make_request(struct request_queue *q,
 
 	generic_start_io_acct(rw, bio_sectors(bio), &d->disk->part0);
 
+	WRITE_ONCE(dc->last_foreground_io, jiffies);
+
 	bio->bi_bdev = dc->bdev;
 	bio->bi_iter.bi_sector += dc->sb.data_offset;
 
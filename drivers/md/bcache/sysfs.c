@@ -83,6 +83,8 @@ rw_attribute(writeback_rate_update_seconds);
 rw_attribute(writeback_rate_d_term);
 rw_attribute(writeback_rate_p_term_inverse);
 read_attribute(writeback_rate_debug);
+rw_attribute(writeback_latency_target_us);
+rw_attribute(writeback_idle_seconds);
 
 read_attribute(stripe_size);
 read_attribute(partial_stripes_expensive);
@@ -131,6 +133,8 @@ SHOW(__bch_cached_dev)
 	var_print(writeback_rate_update_seconds);
 	var_print(writeback_rate_d_term);
 	var_print(writeback_rate_p_term_inverse);
+	var_print(writeback_latency_target_us);
+	var_print(writeback_idle_seconds);
 
 	if (attr == &sysfs_writeback_rate_debug) {
 		char rate[20];
@@ -158,9 +162,11 @@ SHOW(__bch_cached_dev)
 			       "proportional:\t%s\n"
 			       "derivative:\t%s\n"
 			       "change:\t\t%s/sec\n"
-			       "next io:\t%llims\n",
+			       "next io:\t%llims\n"
+			       "write latency:\t%uus\n",
 			       rate, dirty, target, proportional,
-			       derivative, change, next_io);
+			       derivative, change, next_io,
+			       dc->writeback_latency_us);
 	}
 
 	sysfs_hprint(dirty_data,
@@ -214,6 +220,8 @@ STORE(__cached_dev)
 	d_strtoul_nonzero(writeback_rate_update_seconds);
 	d_strtoul(writeback_rate_d_term);
 	d_strtoul_nonzero(writeback_rate_p_term_inverse);
+	d_strtoul(writeback_latency_target_us);
+	d_strtoul(writeback_idle_seconds);
 
 	d_strtoi_h(sequential_cutoff);
 	d_strtoi_h(readahead);
@@ -321,6 +329,8 @@ static struct attribute *bch_cached_dev_files[] = {
 	&sysfs_writeback_rate_d_term,
 	&sysfs_writeback_rate_p_term_inverse,
 	&sysfs_writeback_rate_debug,
+	&sysfs_writeback_latency_target_us,
+	&sysfs_writeback_idle_seconds,
 	&sysfs_dirty_data,
 	&sysfs_stripe_size,
 	&sysfs_partial_stripes_expensive,
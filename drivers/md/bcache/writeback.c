@@ -58,6 +58,15 @@ static void __update_writeback_rate(struct cached_dev *dc)
 			 dc->writeback_rate.next + NSEC_PER_MSEC))
 		change = 0;
 
+	/*
+	 * Writes to the backing device taking longer than the target means
+	 * it's busy with foreground io; back off rather than add to it.
+	 */
+	if (dc->writeback_latency_target_us &&
+	    dc->writeback_latency_us > dc->writeback_latency_target_us)
+		change = min_t(int64_t, change,
+			       -(int64_t) (dc->writeback_rate.rate >> 2));
+
 	dc->writeback_rate.rate =
 		clamp_t(int64_t, (int64_t) dc->writeback_rate.rate + change,
 			1, NSEC_PER_MSEC);
@@ -86,18 +95,32 @@ static void update_writeback_rate(struct work_struct *work)
 			      dc->writeback_rate_update_seconds * HZ);
 }
 
+static bool backing_dev_idle(struct cached_dev *dc)
+{
+	return dc->writeback_idle_seconds &&
+		time_after(jiffies, READ_ONCE(dc->last_foreground_io) +
+			   dc->writeback_idle_seconds * HZ);
+}
+
 static unsigned writeback_delay(struct cached_dev *dc, unsigned sectors)
 {
+	unsigned delay;
+
 	if (test_bit(BCACHE_DEV_DETACHING, &dc->disk.flags) ||
 	    !dc->writeback_percent)
 		return 0;
 
-	return bch_next_delay(&dc->writeback_rate, sectors);
+	delay = bch_next_delay(&dc->writeback_rate, sectors);
+
+	/* Nobody else wants the backing device, flush as fast as it goes */
+	return backing_dev_idle(dc) ? 0 : delay;
 }
 
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
+	unsigned		sequence;
+	uint64_t		start_time;
 	struct bio		bio;
 };
 
@@ -176,19 +199,49 @@ static void dirty_endio(struct bio *bio)
 	closure_put(&io->cl);
 }
 
+static void write_dirty_endio(struct bio *bio)
+{
+	struct keybuf_key *w = bio->bi_private;
+	struct dirty_io *io = w->private;
+	unsigned us = div_u64(local_clock() - io->start_time, NSEC_PER_USEC);
+
+	ewma_add(io->dc->writeback_latency_us, us, 8, 0);
+
+	dirty_endio(bio);
+}
+
 static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
 	struct keybuf_key *w = io->bio.bi_private;
+	struct cached_dev *dc = io->dc;
+
+	if ((unsigned) atomic_read(&dc->writeback_sequence_next) !=
+	    io->sequence) {
+		/* Not our turn yet: wait for the write before us to go out */
+		closure_wait(&dc->writeback_ordering_wait, cl);
+
+		/* It may have gone out before we got on the waitlist */
+		if ((unsigned) atomic_read(&dc->writeback_sequence_next) ==
+		    io->sequence)
+			closure_wake_up(&dc->writeback_ordering_wait);
+
+		continue_at(cl, write_dirty, system_wq);
+		return;
+	}
 
 	dirty_init(w);
 	io->bio.bi_rw		= WRITE;
 	io->bio.bi_iter.bi_sector = KEY_START(&w->key);
-	io->bio.bi_bdev		= io->dc->bdev;
-	io->bio.bi_end_io	= dirty_endio;
+	io->bio.bi_bdev		= dc->bdev;
+	io->bio.bi_end_io	= write_dirty_endio;
+	io->start_time		= local_clock();
 
 	closure_bio_submit(&io->bio, cl);
 
+	atomic_set(&dc->writeback_sequence_next, io->sequence + 1);
+	closure_wake_up(&dc->writeback_ordering_wait);
+
 	continue_at(cl, write_dirty_finish, system_wq);
 }
 
@@ -214,11 +267,15 @@ static void read_dirty_submit(struct closure *cl)
 
 static void read_dirty(struct cached_dev *dc)
 {
-	unsigned delay = 0;
-	struct keybuf_key *w;
+	unsigned delay;
+	struct keybuf_key *next, *keys[MAX_WRITEBACKS_IN_PASS], *w;
+	size_t size;
+	int nk, i;
 	struct dirty_io *io;
 	struct closure cl;
+	unsigned sequence = 0;
 
+	atomic_set(&dc->writeback_sequence_next, sequence);
 	closure_init_stack(&cl);
 
 	/*
@@ -226,55 +283,87 @@ static void read_dirty(struct cached_dev *dc)
 	 * mempools.
 	 */
 
-	while (!kthread_should_stop()) {
-
-		w = bch_keybuf_next(&dc->writeback_keys);
-		if (!w)
-			break;
-
-		BUG_ON(ptr_stale(dc->disk.c, &w->key, 0));
-
-		if (KEY_START(&w->key) != dc->last_read ||
-		    jiffies_to_msecs(delay) > 50)
-			while (!kthread_should_stop() && delay)
-				delay = schedule_timeout_interruptible(delay);
-
-		dc->last_read	= KEY_OFFSET(&w->key);
-
-		io = kzalloc(sizeof(struct dirty_io) + sizeof(struct bio_vec)
-			     * DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS),
-			     GFP_KERNEL);
-		if (!io)
-			goto err;
-
-		w->private	= io;
-		io->dc		= dc;
-
-		dirty_init(w);
-		io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
-		io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
-						    &w->key, 0)->bdev;
-		io->bio.bi_rw		= READ;
-		io->bio.bi_end_io	= read_dirty_endio;
-
-		if (bio_alloc_pages(&io->bio, GFP_KERNEL))
-			goto err_free;
-
-		trace_bcache_writeback(&w->key);
+	next = bch_keybuf_next(&dc->writeback_keys);
+
+	while (!kthread_should_stop() && next) {
+		size = 0;
+		nk = 0;
+
+		/*
+		 * Gather keys that are contiguous on the backing device, so
+		 * their writes go out as one sequential stream instead of a
+		 * seek per key.
+		 */
+		do {
+			BUG_ON(ptr_stale(dc->disk.c, &next->key, 0));
+
+			if (nk >= MAX_WRITEBACKS_IN_PASS ||
+			    size >= MAX_WRITESIZE_IN_PASS)
+				break;
+
+			if (nk && bkey_cmp(&keys[nk - 1]->key,
+					   &START_KEY(&next->key)))
+				break;
+
+			size += KEY_SIZE(&next->key);
+			keys[nk++] = next;
+		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
+
+		for (i = 0; i < nk; i++) {
+			w = keys[i];
+
+			io = kzalloc(sizeof(struct dirty_io) +
+				     sizeof(struct bio_vec) *
+				     DIV_ROUND_UP(KEY_SIZE(&w->key),
+						  PAGE_SECTORS),
+				     GFP_KERNEL);
+			if (!io)
+				goto err;
+
+			w->private	= io;
+			io->dc		= dc;
+			io->sequence	= sequence++;
+
+			dirty_init(w);
+			io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
+			io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
+							    &w->key, 0)->bdev;
+			io->bio.bi_rw		= READ;
+			io->bio.bi_end_io	= read_dirty_endio;
+
+			if (bio_alloc_pages(&io->bio, GFP_KERNEL))
+				goto err_free;
+
+			trace_bcache_writeback(&w->key);
+
+			down(&dc->in_flight);
+			closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		}
 
-		down(&dc->in_flight);
-		closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		delay = writeback_delay(dc, size);
 
-		delay = writeback_delay(dc, KEY_SIZE(&w->key));
+		while (!kthread_should_stop() && delay) {
+			schedule_timeout_interruptible(delay);
+			delay = writeback_delay(dc, 0);
+		}
 	}
 
 	if (0) {
 err_free:
 		kfree(w->private);
 err:
-		bch_keybuf_del(&dc->writeback_keys, w);
+		/*
+		 * Nothing after the failed key was issued, so the sequence
+		 * has no holes for the writes already in flight.
+		 */
+		while (i < nk)
+			bch_keybuf_del(&dc->writeback_keys, keys[i++]);
 	}
 
+	/* Taken off the keybuf but never issued */
+	if (next)
+		bch_keybuf_del(&dc->writeback_keys, next);
+
 	/*
 	 * Wait for outstanding writeback IOs to finish (and keybuf slots to be
 	 * freed) before refilling again
@@ -514,6 +603,10 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_rate_d_term	= 30;
 	dc->writeback_rate_p_term_inverse = 6000;
 
+	dc->writeback_latency_target_us	= 50000;
+	dc->writeback_idle_seconds	= 10;
+	dc->last_foreground_io		= jiffies;
+
 	INIT_DELAYED_WORK(&dc->writeback_rate_update, update_writeback_rate);
 }
 
@@ -550,6 +550,95 @@ static enum performance stats_assess(struct stats *s)
 
 /*----------------------------------------------------------------*/
 
+/*
+ * Large sequential ios are better served by the origin device, and a
+ * long scan would otherwise flush genuinely hot blocks out of the hotspot
+ * queue.  So we sample the io stream and stop feeding the hotspot queue
+ * while it looks sequential.
+ */
+#define DEFAULT_SEQUENTIAL_THRESHOLD 512u
+#define DEFAULT_RANDOM_THRESHOLD 4u
+
+enum io_pattern {
+	PATTERN_SEQUENTIAL,
+	PATTERN_RANDOM
+};
+
+struct io_tracker {
+	enum io_pattern pattern;
+
+	unsigned nr_seq_samples;
+	unsigned nr_rand_samples;
+	unsigned thresholds[2];
+
+	sector_t last_end_sector;
+};
+
+static void iot_init(struct io_tracker *t,
+		     unsigned sequential_threshold, unsigned random_threshold)
+{
+	t->pattern = PATTERN_RANDOM;
+	t->nr_seq_samples = 0;
+	t->nr_rand_samples = 0;
+	t->last_end_sector = 0;
+	t->thresholds[PATTERN_RANDOM] = random_threshold;
+	t->thresholds[PATTERN_SEQUENTIAL] = sequential_threshold;
+}
+
+static enum io_pattern iot_pattern(struct io_tracker *t)
+{
+	return t->pattern;
+}
+
+static void iot_update_stats(struct io_tracker *t, struct bio *bio)
+{
+	if (bio->bi_iter.bi_sector == t->last_end_sector)
+		t->nr_seq_samples++;
+	else {
+		/*
+		 * Just one non-sequential io is enough to reset the
+		 * counters.
+		 */
+		if (t->nr_seq_samples) {
+			t->nr_seq_samples = 0;
+			t->nr_rand_samples = 0;
+		}
+
+		t->nr_rand_samples++;
+	}
+
+	t->last_end_sector = bio_end_sector(bio);
+}
+
+static void iot_check_for_pattern_switch(struct io_tracker *t)
+{
+	switch (t->pattern) {
+	case PATTERN_SEQUENTIAL:
+		if (t->nr_rand_samples >= t->thresholds[PATTERN_RANDOM]) {
+			t->pattern = PATTERN_RANDOM;
+			t->nr_seq_samples = t->nr_rand_samples = 0;
+		}
+		break;
+
+	case PATTERN_RANDOM:
+		/* A zero sequential threshold disables the detection. */
+		if (t->thresholds[PATTERN_SEQUENTIAL] &&
+		    t->nr_seq_samples >= t->thresholds[PATTERN_SEQUENTIAL]) {
+			t->pattern = PATTERN_SEQUENTIAL;
+			t->nr_seq_samples = t->nr_rand_samples = 0;
+		}
+		break;
+	}
+}
+
+static void iot_examine_bio(struct io_tracker *t, struct bio *bio)
+{
+	iot_update_stats(t, bio);
+	iot_check_for_pattern_switch(t);
+}
+
+/*----------------------------------------------------------------*/
+
 struct hash_table {
 	struct entry_space *es;
 	unsigned long long hash_bits;
@@ -768,6 +857,13 @@ static struct entry *get_entry(struct entry_alloc *ea, unsigned index)
 #define HOTSPOT_UPDATE_PERIOD (HZ)
 #define CACHE_UPDATE_PERIOD (10u * HZ)
 
+/*
+ * Cache hits are accounted against the level of their hotspot block, in
+ * buckets of this many levels.
+ */
+#define HOTSPOT_HIT_BUCKET_LEVELS 8u
+#define NR_HOTSPOT_HIT_BUCKETS (NR_HOTSPOT_LEVELS / HOTSPOT_HIT_BUCKET_LEVELS)
+
 struct smq_policy {
 	struct dm_cache_policy policy;
 
@@ -804,6 +900,9 @@ struct smq_policy {
 	struct stats hotspot_stats;
 	struct stats cache_stats;
 
+	struct io_tracker tracker;
+	unsigned long hotspot_hits[NR_HOTSPOT_HIT_BUCKETS];
+
 	/*
 	 * Keeps track of time, incremented by the core.  We use this to
 	 * avoid attributing multiple hits within the same tick.
@@ -826,6 +925,13 @@ struct smq_policy {
 	unsigned write_promote_level;
 	unsigned read_promote_level;
 
+	/*
+	 * Extra hotspot levels a block must climb, on top of the computed
+	 * promote levels, before it is promoted.  Set by the user.
+	 */
+	unsigned read_promote_adjustment;
+	unsigned write_promote_adjustment;
+
 	unsigned long next_hotspot_period;
 	unsigned long next_cache_period;
 };
@@ -1044,8 +1150,12 @@ static void update_promote_levels(struct smq_policy *mq)
 		break;
 	}
 
-	mq->read_promote_level = NR_HOTSPOT_LEVELS - threshold_level;
-	mq->write_promote_level = (NR_HOTSPOT_LEVELS - threshold_level) + 2u;
+	mq->read_promote_level = min(NR_HOTSPOT_LEVELS,
+				     (NR_HOTSPOT_LEVELS - threshold_level) +
+				     mq->read_promote_adjustment);
+	mq->write_promote_level = min(NR_HOTSPOT_LEVELS,
+				      (NR_HOTSPOT_LEVELS - threshold_level) + 2u +
+				      mq->write_promote_adjustment);
 }
 
 /*
@@ -1140,6 +1250,13 @@ static enum promote_result maybe_promote(bool promote)
 static enum promote_result should_promote(struct smq_policy *mq, struct entry *hs_e, struct bio *bio,
 					  bool fast_promote)
 {
+	/*
+	 * No hotspot entry means the io is part of a sequential stream,
+	 * which we leave on the origin.
+	 */
+	if (!hs_e)
+		return PROMOTE_NOT;
+
 	if (bio_data_dir(bio) == WRITE) {
 		if (!allocator_empty(&mq->cache_alloc) && fast_promote)
 			return PROMOTE_TEMPORARY;
@@ -1236,11 +1353,17 @@ static int map(struct smq_policy *mq, struct bio *bio, dm_oblock_t oblock,
 	struct entry *e, *hs_e;
 	enum promote_result pr;
 
-	hs_e = update_hotspot_queue(mq, oblock, bio);
+	iot_examine_bio(&mq->tracker, bio);
+	if (iot_pattern(&mq->tracker) == PATTERN_SEQUENTIAL)
+		hs_e = NULL;
+	else
+		hs_e = update_hotspot_queue(mq, oblock, bio);
 
 	e = h_lookup(&mq->table, oblock);
 	if (e) {
 		stats_level_accessed(&mq->cache_stats, e->level);
+		if (hs_e)
+			mq->hotspot_hits[hs_e->level / HOTSPOT_HIT_BUCKET_LEVELS]++;
 
 		requeue(mq, e);
 		result->op = POLICY_HIT;
@@ -1567,41 +1690,104 @@ static void smq_tick(struct dm_cache_policy *p, bool can_block)
 	spin_unlock_irqrestore(&mq->lock, flags);
 }
 
+static int smq_set_config_value(struct dm_cache_policy *p,
+				const char *key, const char *value)
+{
+	struct smq_policy *mq = to_smq_policy(p);
+	unsigned long flags;
+	unsigned long tmp;
+	int r = 0;
+
+	if (kstrtoul(value, 10, &tmp) || tmp > UINT_MAX)
+		return -EINVAL;
+
+	spin_lock_irqsave(&mq->lock, flags);
+	if (!strcasecmp(key, "sequential_threshold"))
+		mq->tracker.thresholds[PATTERN_SEQUENTIAL] = tmp;
+
+	else if (!strcasecmp(key, "random_threshold"))
+		mq->tracker.thresholds[PATTERN_RANDOM] = tmp;
+
+	else if (!strcasecmp(key, "read_promote_adjustment"))
+		mq->read_promote_adjustment = min_t(unsigned long, tmp, NR_HOTSPOT_LEVELS);
+
+	else if (!strcasecmp(key, "write_promote_adjustment"))
+		mq->write_promote_adjustment = min_t(unsigned long, tmp, NR_HOTSPOT_LEVELS);
+
+	else
+		r = -EINVAL;
+	spin_unlock_irqrestore(&mq->lock, flags);
+
+	return r;
+}
+
+static int smq_emit_config_values(struct dm_cache_policy *p, char *result,
+				  unsigned maxlen, ssize_t *sz_ptr)
+{
+	struct smq_policy *mq = to_smq_policy(p);
+	ssize_t sz = *sz_ptr;
+	unsigned long flags;
+	unsigned i;
+
+	spin_lock_irqsave(&mq->lock, flags);
+	DMEMIT("10 sequential_threshold %u "
+	       "random_threshold %u "
+	       "read_promote_adjustment %u "
+	       "write_promote_adjustment %u "
+	       "hotspot_hits ",
+	       mq->tracker.thresholds[PATTERN_SEQUENTIAL],
+	       mq->tracker.thresholds[PATTERN_RANDOM],
+	       mq->read_promote_adjustment,
+	       mq->write_promote_adjustment);
+
+	for (i = 0; i < NR_HOTSPOT_HIT_BUCKETS; i++)
+		DMEMIT("%s%lu", i ? "," : "", mq->hotspot_hits[i]);
+	DMEMIT(" ");
+	spin_unlock_irqrestore(&mq->lock, flags);
+
+	*sz_ptr = sz;
+	return 0;
+}
+
 /*
- * smq has no config values, but the old mq policy did.  To avoid breaking
- * software we continue to accept these configurables for the mq policy,
- * but they have no effect.
+ * The old mq policy had a few more configurables.  The io tracker and
+ * promote adjustments are shared with smq; discard_promote_adjustment is
+ * still accepted to avoid breaking software, but has no effect.
  */
 static int mq_set_config_value(struct dm_cache_policy *p,
 			       const char *key, const char *value)
 {
 	unsigned long tmp;
 
-	if (kstrtoul(value, 10, &tmp))
-		return -EINVAL;
+	if (!strcasecmp(key, "discard_promote_adjustment")) {
+		if (kstrtoul(value, 10, &tmp))
+			return -EINVAL;
 
-	if (!strcasecmp(key, "random_threshold") ||
-	    !strcasecmp(key, "sequential_threshold") ||
-	    !strcasecmp(key, "discard_promote_adjustment") ||
-	    !strcasecmp(key, "read_promote_adjustment") ||
-	    !strcasecmp(key, "write_promote_adjustment")) {
 		DMWARN("tunable '%s' no longer has any effect, mq policy is now an alias for smq", key);
 		return 0;
 	}
 
-	return -EINVAL;
+	return smq_set_config_value(p, key, value);
 }
 
 static int mq_emit_config_values(struct dm_cache_policy *p, char *result,
 				 unsigned maxlen, ssize_t *sz_ptr)
 {
+	struct smq_policy *mq = to_smq_policy(p);
 	ssize_t sz = *sz_ptr;
+	unsigned long flags;
 
-	DMEMIT("10 random_threshold 0 "
-	       "sequential_threshold 0 "
+	spin_lock_irqsave(&mq->lock, flags);
+	DMEMIT("10 random_threshold %u "
+	       "sequential_threshold %u "
 	       "discard_promote_adjustment 0 "
-	       "read_promote_adjustment 0 "
-	       "write_promote_adjustment 0 ");
+	       "read_promote_adjustment %u "
+	       "write_promote_adjustment %u ",
+	       mq->tracker.thresholds[PATTERN_RANDOM],
+	       mq->tracker.thresholds[PATTERN_SEQUENTIAL],
+	       mq->read_promote_adjustment,
+	       mq->write_promote_adjustment);
+	spin_unlock_irqrestore(&mq->lock, flags);
 
 	*sz_ptr = sz;
 	return 0;
@@ -1627,6 +1813,9 @@ static void init_policy_functions(struct smq_policy *mq, bool mimic_mq)
 	if (mimic_mq) {
 		mq->policy.set_config_value = mq_set_config_value;
 		mq->policy.emit_config_values = mq_emit_config_values;
+	} else {
+		mq->policy.set_config_value = smq_set_config_value;
+		mq->policy.emit_config_values = smq_emit_config_values;
 	}
 }
 
@@ -1723,6 +1912,7 @@ static struct dm_cache_policy *__smq_create(dm_cblock_t cache_size,
 
 	stats_init(&mq->hotspot_stats, NR_HOTSPOT_LEVELS);
 	stats_init(&mq->cache_stats, NR_CACHE_LEVELS);
+	iot_init(&mq->tracker, DEFAULT_SEQUENTIAL_THRESHOLD, DEFAULT_RANDOM_THRESHOLD);
 
 	if (h_init(&mq->table, &mq->es, from_cblock(cache_size)))
 		goto bad_alloc_table;
@@ -1770,7 +1960,7 @@ static struct dm_cache_policy *mq_create(dm_cblock_t cache_size,
 
 static struct dm_cache_policy_type smq_policy_type = {
 	.name = "smq",
-	.version = {1, 5, 0},
+	.version = {1, 6, 0},
 	.hint_size = 4,
 	.owner = THIS_MODULE,
 	.create = smq_create
@@ -1778,7 +1968,7 @@ static struct dm_cache_policy_type smq_policy_type = {
 
 static struct dm_cache_policy_type mq_policy_type = {
 	.name = "mq",
-	.version = {1, 5, 0},
+	.version = {1, 6, 0},
 	.hint_size = 4,
 	.owner = THIS_MODULE,
 	.create = mq_create,
@@ -1786,7 +1976,7 @@ static struct dm_cache_policy_type mq_policy_type = {
 
 static struct dm_cache_policy_type default_policy_type = {
 	.name = "default",
-	.version = {1, 5, 0},
+	.version = {1, 6, 0},
 	.hint_size = 4,
 	.owner = THIS_MODULE,
 	.create = smq_create,
@@ -114,7 +114,8 @@ struct iv_tcw_private {
  */
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
 	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
-	     DM_CRYPT_EXIT_THREAD};
+	     DM_CRYPT_NO_READ_WORKQUEUE, DM_CRYPT_NO_WRITE_WORKQUEUE,
+	     DM_CRYPT_SYNC_TFM, DM_CRYPT_EXIT_THREAD};
 
 /*
  * The fields in here must be read only after initialization.
@@ -182,6 +183,8 @@ struct crypt_config {
 };
 
 #define MIN_IOS        16
+/* Sectors handed at once to a cipher that supports batches */
+#define DM_CRYPT_BATCH	CRYPTO_SKCIPHER_MAX_BATCH
 
 static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
@@ -195,6 +198,16 @@ static struct crypto_skcipher *any_tfm(struct crypt_config *cc)
 	return cc->tfms[0];
 }
 
+/*
+ * The no_*_workqueue options only take effect with a synchronous cipher,
+ * an asynchronous one may sleep or complete in a context of its own.
+ */
+static bool crypt_no_workqueue(struct crypt_config *cc, int flag)
+{
+	return test_bit(flag, &cc->flags) &&
+	       test_bit(DM_CRYPT_SYNC_TFM, &cc->flags);
+}
+
 /*
  * Different IV generation algorithms:
  *
@@ -837,7 +850,10 @@ static u8 *iv_of_dmreq(struct crypt_config *cc,
 		crypto_skcipher_alignmask(any_tfm(cc)) + 1);
 }
 
-static int crypt_convert_block(struct crypt_config *cc,
+/*
+ * Set up @req for the next sector of @ctx and advance past it.
+ */
+static int crypt_prepare_block(struct crypt_config *cc,
 			       struct convert_context *ctx,
 			       struct skcipher_request *req)
 {
@@ -872,13 +888,27 @@ static int crypt_convert_block(struct crypt_config *cc,
 	skcipher_request_set_crypt(req, &dmreq->sg_in, &dmreq->sg_out,
 				   1 << SECTOR_SHIFT, iv);
 
+	return 0;
+}
+
+static int crypt_convert_block(struct crypt_config *cc,
+			       struct convert_context *ctx,
+			       struct skcipher_request *req)
+{
+	struct dm_crypt_request *dmreq = dmreq_of_req(cc, req);
+	int r;
+
+	r = crypt_prepare_block(cc, ctx, req);
+	if (r)
+		return r;
+
 	if (bio_data_dir(ctx->bio_in) == WRITE)
 		r = crypto_skcipher_encrypt(req);
 	else
 		r = crypto_skcipher_decrypt(req);
 
 	if (!r && cc->iv_gen_ops && cc->iv_gen_ops->post)
-		r = cc->iv_gen_ops->post(cc, iv, dmreq);
+		r = cc->iv_gen_ops->post(cc, iv_of_dmreq(cc, dmreq), dmreq);
 
 	return r;
 }
@@ -886,13 +916,17 @@ static int crypt_convert_block(struct crypt_config *cc,
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+static int crypt_alloc_req(struct crypt_config *cc,
+			   struct convert_context *ctx, bool atomic)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
-	if (!ctx->req)
-		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->req) {
+		ctx->req = mempool_alloc(cc->req_pool,
+					 atomic ? GFP_ATOMIC : GFP_NOIO);
+		if (!ctx->req)
+			return -EAGAIN;
+	}
 
 	skcipher_request_set_tfm(ctx->req, cc->tfms[key_index]);
 
@@ -901,8 +935,10 @@ static void crypt_alloc_req(struct crypt_config *cc,
 	 * requests if driver request queue is full.
 	 */
 	skcipher_request_set_callback(ctx->req,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    CRYPTO_TFM_REQ_MAY_BACKLOG | (atomic ? 0 : CRYPTO_TFM_REQ_MAY_SLEEP),
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
+
+	return 0;
 }
 
 static void crypt_free_req(struct crypt_config *cc,
@@ -914,19 +950,164 @@ static void crypt_free_req(struct crypt_config *cc,
 		mempool_free(req, cc->req_pool);
 }
 
+/*
+ * Keep a request that finished synchronously for the next sector,
+ * or give it back if there already is one.
+ */
+static void crypt_reuse_req(struct crypt_config *cc,
+			    struct convert_context *ctx,
+			    struct skcipher_request *req)
+{
+	struct dm_crypt_io *io = container_of(ctx, struct dm_crypt_io, ctx);
+
+	if (!ctx->req)
+		ctx->req = req;
+	else
+		crypt_free_req(cc, req, io->base_bio);
+}
+
+/*
+ * Batching needs every sector of the bio on the same tfm, and only pays
+ * off if the cipher takes the whole batch in one go.
+ */
+static bool crypt_can_batch(struct crypt_config *cc)
+{
+	return cc->tfms_count == 1 && crypto_skcipher_has_batch(cc->tfms[0]);
+}
+
+/*
+ * Handle the results of @nr submitted requests of a batch, the same way
+ * crypt_convert() does for a single one.  Only the last of them can have
+ * been backlogged or have failed in the cipher.
+ */
+static int crypt_batch_done(struct crypt_config *cc,
+			    struct convert_context *ctx,
+			    struct skcipher_request **reqs, int *errs,
+			    unsigned int nr)
+{
+	struct dm_crypt_request *dmreq;
+	unsigned int i;
+	int r, err = 0;
+
+	for (i = 0; i < nr; i++) {
+		dmreq = dmreq_of_req(cc, reqs[i]);
+		r = errs[i];
+		if (!r && cc->iv_gen_ops && cc->iv_gen_ops->post)
+			r = cc->iv_gen_ops->post(cc, iv_of_dmreq(cc, dmreq),
+						 dmreq);
+
+		switch (r) {
+		case -EBUSY:
+			wait_for_completion(&ctx->restart);
+			reinit_completion(&ctx->restart);
+			/* fall through */
+		case -EINPROGRESS:
+			break;
+		case 0:
+			atomic_dec(&ctx->cc_pending);
+			crypt_reuse_req(cc, ctx, reqs[i]);
+			break;
+		default:
+			atomic_dec(&ctx->cc_pending);
+			crypt_reuse_req(cc, ctx, reqs[i]);
+			if (!err)
+				err = r;
+		}
+	}
+
+	return err;
+}
+
+/*
+ * crypt_convert() for ciphers with native batch support: set up to
+ * DM_CRYPT_BATCH sectors and hand them to the cipher in one call.  Only
+ * the first request of a batch may wait for the mempool, the others are
+ * taken only if free, so a partly built batch never holds back requests
+ * that other I/O needs in order to complete.
+ */
+static int crypt_convert_batch(struct crypt_config *cc,
+			       struct convert_context *ctx, bool atomic)
+{
+	struct dm_crypt_io *io = container_of(ctx, struct dm_crypt_io, ctx);
+	struct skcipher_request *reqs[DM_CRYPT_BATCH];
+	int errs[DM_CRYPT_BATCH];
+	unsigned int nr, done, i;
+	int r = 0, err;
+
+	while (!r && ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
+		for (nr = 0; nr < DM_CRYPT_BATCH && ctx->iter_in.bi_size &&
+		     ctx->iter_out.bi_size; nr++) {
+			if (nr && !ctx->req) {
+				ctx->req = mempool_alloc(cc->req_pool,
+							 GFP_NOWAIT);
+				if (!ctx->req)
+					break;
+			}
+			r = crypt_alloc_req(cc, ctx, atomic);
+			if (r)
+				break;
+
+			/* The sectors set up so far are still submitted */
+			r = crypt_prepare_block(cc, ctx, ctx->req);
+			if (r)
+				break;
+
+			reqs[nr] = ctx->req;
+			ctx->req = NULL;
+			ctx->cc_sector++;
+		}
+
+		for (i = 0; i < nr; i += done) {
+			atomic_add(nr - i, &ctx->cc_pending);
+
+			if (bio_data_dir(ctx->bio_in) == WRITE)
+				done = crypto_skcipher_encrypt_batch(reqs + i,
+							errs + i, nr - i);
+			else
+				done = crypto_skcipher_decrypt_batch(reqs + i,
+							errs + i, nr - i);
+
+			atomic_sub(nr - i - done, &ctx->cc_pending);
+
+			err = crypt_batch_done(cc, ctx, reqs + i, errs + i,
+					       done);
+			if (err) {
+				for (i += done; i < nr; i++)
+					crypt_free_req(cc, reqs[i],
+						       io->base_bio);
+				return err;
+			}
+		}
+
+		if (!atomic)
+			cond_resched();
+	}
+
+	return r;
+}
+
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * With @atomic set this runs in I/O completion context: nothing may sleep,
+ * and -EAGAIN means no request could be allocated, the caller has to call
+ * again from process context to convert the rest.
  */
 static int crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+			 struct convert_context *ctx, bool atomic)
 {
 	int r;
 
 	atomic_set(&ctx->cc_pending, 1);
 
+	if (crypt_can_batch(cc))
+		return crypt_convert_batch(cc, ctx, atomic);
+
 	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
 
-		crypt_alloc_req(cc, ctx);
+		r = crypt_alloc_req(cc, ctx, atomic);
+		if (r)
+			return r;
 
 		atomic_inc(&ctx->cc_pending);
 
@@ -955,7 +1136,8 @@ static int crypt_convert(struct crypt_config *cc,
 		case 0:
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector++;
-			cond_resched();
+			if (!atomic)
+				cond_resched();
 			continue;
 
 		/* There was an error while processing the request. */
@@ -1265,7 +1447,9 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_iter.bi_sector = cc->start + io->sector;
 
-	if (likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+	if (likely(!async) &&
+	    (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags) ||
+	     crypt_no_workqueue(cc, DM_CRYPT_NO_WRITE_WORKQUEUE))) {
 		generic_make_request(clone);
 		return;
 	}
@@ -1314,7 +1498,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	sector += bio_sectors(clone);
 
 	crypt_inc_pending(io);
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, false);
 	if (r)
 		io->error = -EIO;
 	crypt_finished = atomic_dec_and_test(&io->ctx.cc_pending);
@@ -1334,17 +1518,20 @@ static void kcryptd_crypt_read_done(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
-static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
+static void kcryptd_crypt_read_continue(struct work_struct *work);
+
+static void kcryptd_crypt_read_run(struct dm_crypt_io *io, bool atomic)
 {
 	struct crypt_config *cc = io->cc;
-	int r = 0;
-
-	crypt_inc_pending(io);
-
-	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
-			   io->sector);
+	int r;
 
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, atomic);
+	if (atomic && r == -EAGAIN) {
+		/* Let kcryptd convert what is left */
+		INIT_WORK(&io->work, kcryptd_crypt_read_continue);
+		queue_work(cc->crypt_queue, &io->work);
+		return;
+	}
 	if (r < 0)
 		io->error = -EIO;
 
@@ -1354,6 +1541,25 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
+static void kcryptd_crypt_read_continue(struct work_struct *work)
+{
+	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+
+	kcryptd_crypt_read_run(io, false);
+}
+
+static void kcryptd_crypt_read_convert(struct dm_crypt_io *io, bool atomic)
+{
+	struct crypt_config *cc = io->cc;
+
+	crypt_inc_pending(io);
+
+	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
+			   io->sector);
+
+	kcryptd_crypt_read_run(io, atomic);
+}
+
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error)
 {
@@ -1394,15 +1600,30 @@ static void kcryptd_crypt(struct work_struct *work)
 	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
 
 	if (bio_data_dir(io->base_bio) == READ)
-		kcryptd_crypt_read_convert(io);
+		kcryptd_crypt_read_convert(io, false);
 	else
 		kcryptd_crypt_write_convert(io);
 }
 
+/*
+ * Reads are queued from bio completion context, writes from crypt_map()
+ * in the submitter's context.  With a synchronous cipher either can skip
+ * kcryptd and do the work right there if the table asked for it.
+ */
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
 
+	if (bio_data_dir(io->base_bio) == READ) {
+		if (crypt_no_workqueue(cc, DM_CRYPT_NO_READ_WORKQUEUE)) {
+			kcryptd_crypt_read_convert(io, true);
+			return;
+		}
+	} else if (crypt_no_workqueue(cc, DM_CRYPT_NO_WRITE_WORKQUEUE)) {
+		kcryptd_crypt_write_convert(io);
+		return;
+	}
+
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
 }
@@ -1467,6 +1688,10 @@ static int crypt_alloc_tfms(struct crypt_config *cc, char *ciphermode)
 		}
 	}
 
+	if (!(crypto_skcipher_tfm(any_tfm(cc))->__crt_alg->cra_flags &
+	      CRYPTO_ALG_ASYNC))
+		set_bit(DM_CRYPT_SYNC_TFM, &cc->flags);
+
 	return 0;
 }
 
@@ -1744,7 +1969,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	char dummy;
 
 	static struct dm_arg _args[] = {
-		{0, 3, "Invalid number of feature args"},
+		{0, 5, "Invalid number of feature args"},
 	};
 
 	if (argc < 5) {
@@ -1859,6 +2084,12 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 			else if (!strcasecmp(opt_string, "submit_from_crypt_cpus"))
 				set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
 
+			else if (!strcasecmp(opt_string, "no_read_workqueue"))
+				set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+
+			else if (!strcasecmp(opt_string, "no_write_workqueue"))
+				set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+
 			else {
 				ti->error = "Invalid feature arguments";
 				goto bad;
@@ -1963,6 +2194,10 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE,
+					     &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE,
+					     &cc->flags);
 		if (num_feature_args) {
 			DMEMIT(" %d", num_feature_args);
 			if (ti->num_discard_bios)
@@ -1971,6 +2206,10 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" same_cpu_crypt");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
 				DMEMIT(" submit_from_crypt_cpus");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
 		}
 
 		break;
@@ -2064,7 +2303,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 14, 1},
+	.version = {1, 15, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -1435,7 +1435,15 @@ int dm_thin_find_block(struct dm_thin_device *td, dm_block_t block,
 	int r;
 	struct dm_pool_metadata *pmd = td->pmd;
 
-	down_read(&pmd->root_lock);
+	/*
+	 * Callers that may not block, i.e. the map path, get deferred
+	 * rather than sleep behind an insert or a commit.
+	 */
+	if (can_issue_io)
+		down_read(&pmd->root_lock);
+	else if (!down_read_trylock(&pmd->root_lock))
+		return -EWOULDBLOCK;
+
 	if (pmd->fail_io) {
 		up_read(&pmd->root_lock);
 		return -EINVAL;
@@ -1563,6 +1571,22 @@ int dm_thin_insert_block(struct dm_thin_device *td, dm_block_t block,
 	return r;
 }
 
+void dm_thin_insert_blocks(struct dm_pool_metadata *pmd,
+			   struct dm_thin_block_insert *ins, unsigned count)
+{
+	unsigned i;
+
+	down_write(&pmd->root_lock);
+	for (i = 0; i < count; i++) {
+		if (pmd->fail_io)
+			ins[i].r = -EINVAL;
+		else
+			ins[i].r = __insert(ins[i].td, ins[i].block,
+					    ins[i].data_block);
+	}
+	up_write(&pmd->root_lock);
+}
+
 static int __remove(struct dm_thin_device *td, dm_block_t block)
 {
 	int r;
@@ -139,7 +139,8 @@ struct dm_thin_lookup_result {
 
 /*
  * Returns:
- *   -EWOULDBLOCK iff @can_issue_io is set and would issue IO
+ *   -EWOULDBLOCK iff @can_issue_io is clear and the lookup would issue IO
+ *		  or wait for the metadata lock
  *   -ENODATA iff that mapping is not present.
  *   0 success
  */
@@ -166,6 +167,21 @@ int dm_pool_alloc_data_block(struct dm_pool_metadata *pmd, dm_block_t *result);
 int dm_thin_insert_block(struct dm_thin_device *td, dm_block_t block,
 			 dm_block_t data_block);
 
+/*
+ * Insert a batch of mappings, possibly for different thin devices of the
+ * same pool, taking the metadata lock only once.  The result of each
+ * insertion is returned in its r field.
+ */
+struct dm_thin_block_insert {
+	struct dm_thin_device *td;
+	dm_block_t block;
+	dm_block_t data_block;
+	int r;
+};
+
+void dm_thin_insert_blocks(struct dm_pool_metadata *pmd,
+			   struct dm_thin_block_insert *ins, unsigned count);
+
 int dm_thin_remove_block(struct dm_thin_device *td, dm_block_t block);
 int dm_thin_remove_range(struct dm_thin_device *td,
 			 dm_block_t begin, dm_block_t end);
@@ -915,24 +915,21 @@ static void process_prepared_mapping_fail(struct dm_thin_new_mapping *m)
 	mempool_free(m, m->tc->pool->mapping_pool);
 }
 
-static void process_prepared_mapping(struct dm_thin_new_mapping *m)
+/*
+ * Finish a prepared mapping once its block has been inserted into the
+ * mapping btree, @r being the result of that insertion.
+ */
+static void __process_prepared_mapping(struct dm_thin_new_mapping *m, int r)
 {
 	struct thin_c *tc = m->tc;
 	struct pool *pool = tc->pool;
 	struct bio *bio = m->bio;
-	int r;
 
 	if (m->err) {
 		cell_error(pool, m->cell);
 		goto out;
 	}
 
-	/*
-	 * Commit the prepared block into the mapping btree.
-	 * Any I/O for this block arriving after this point will get
-	 * remapped to it directly.
-	 */
-	r = dm_thin_insert_block(tc->td, m->virt_begin, m->data_block);
 	if (r) {
 		metadata_operation_failed(pool, "dm_thin_insert_block", r);
 		cell_error(pool, m->cell);
@@ -959,6 +956,22 @@ out:
 	mempool_free(m, pool->mapping_pool);
 }
 
+static void process_prepared_mapping(struct dm_thin_new_mapping *m)
+{
+	int r = 0;
+
+	/*
+	 * Commit the prepared block into the mapping btree.
+	 * Any I/O for this block arriving after this point will get
+	 * remapped to it directly.
+	 */
+	if (!m->err)
+		r = dm_thin_insert_block(m->tc->td, m->virt_begin,
+					 m->data_block);
+
+	__process_prepared_mapping(m, r);
+}
+
 /*----------------------------------------------------------------*/
 
 static void free_discard_mapping(struct dm_thin_new_mapping *m)
@@ -1089,6 +1102,65 @@ static void process_prepared(struct pool *pool, struct list_head *head,
 		(*fn)(m);
 }
 
+#define MAPPING_BATCH 16
+
+/*
+ * process_prepared() for new mappings in write mode: insert the blocks of
+ * up to MAPPING_BATCH mappings under one acquisition of the metadata lock
+ * before finishing each of them.  A failed insertion switches the pool
+ * out of write mode, the rest of the mappings then go to the new mode's
+ * handler one by one.
+ */
+static void process_prepared_mappings(struct pool *pool)
+{
+	struct dm_thin_block_insert ins[MAPPING_BATCH];
+	struct dm_thin_new_mapping *batch[MAPPING_BATCH];
+	struct dm_thin_new_mapping *m, *tmp;
+	unsigned long flags;
+	struct list_head maps;
+	unsigned nr, n, i;
+
+	INIT_LIST_HEAD(&maps);
+	spin_lock_irqsave(&pool->lock, flags);
+	list_splice_init(&pool->prepared_mappings, &maps);
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	while (!list_empty(&maps) &&
+	       pool->process_prepared_mapping == process_prepared_mapping) {
+		nr = n = 0;
+		list_for_each_entry(m, &maps, list) {
+			if (nr == MAPPING_BATCH)
+				break;
+			batch[nr++] = m;
+			if (m->err)
+				continue;
+			ins[n].td = m->tc->td;
+			ins[n].block = m->virt_begin;
+			ins[n].data_block = m->data_block;
+			n++;
+		}
+
+		dm_thin_insert_blocks(pool->pmd, ins, n);
+
+		for (i = n = 0; i < nr; i++) {
+			int r = 0;
+
+			m = batch[i];
+			if (!m->err)
+				r = ins[n++].r;
+
+			if (pool->process_prepared_mapping !=
+			    process_prepared_mapping)
+				pool->process_prepared_mapping(m);
+			else
+				__process_prepared_mapping(m, r);
+		}
+	}
+
+	list_for_each_entry_safe(m, tmp, &maps, list)
+		pool->process_prepared_mapping(m);
+}
+
 /*
  * Deferred bio jobs.
  */
@@ -2208,7 +2280,7 @@ static void do_worker(struct work_struct *ws)
 	throttle_work_start(&pool->throttle);
 	dm_pool_issue_prefetches(pool->pmd);
 	throttle_work_update(&pool->throttle);
-	process_prepared(pool, &pool->prepared_mappings, &pool->process_prepared_mapping);
+	process_prepared_mappings(pool);
 	throttle_work_update(&pool->throttle);
 	process_prepared(pool, &pool->prepared_discards, &pool->process_prepared_discard);
 	throttle_work_update(&pool->throttle);
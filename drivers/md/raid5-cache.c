@@ -97,6 +97,9 @@ struct r5l_log {
 
 	bool need_cache_flush;
 	bool in_teardown;
+
+	bool write_back;		/* complete writes once they are in
+					 * the log, see journal_mode */
 };
 
 /*
@@ -169,18 +172,27 @@ static void __r5l_set_io_unit_state(struct r5l_io_unit *io,
 	io->state = state;
 }
 
-static void r5l_io_run_stripes(struct r5l_io_unit *io)
+/*
+ * The io_unit is safe in the log when this runs.  In write-back mode the
+ * bios written by its stripes are collected in @acked to be completed
+ * once io_list_lock is dropped.
+ */
+static void r5l_io_run_stripes(struct r5l_io_unit *io, struct bio_list *acked)
 {
+	struct r5l_log *log = io->log;
 	struct stripe_head *sh, *next;
+	bool ack = log->write_back && !test_bit(Faulty, &log->rdev->flags);
 
 	list_for_each_entry_safe(sh, next, &io->stripe_list, log_list) {
 		list_del_init(&sh->log_list);
+		if (ack)
+			raid5_ack_logged_stripe(sh, acked);
 		set_bit(STRIPE_HANDLE, &sh->state);
 		raid5_release_stripe(sh);
 	}
 }
 
-static void r5l_log_run_stripes(struct r5l_log *log)
+static void r5l_log_run_stripes(struct r5l_log *log, struct bio_list *acked)
 {
 	struct r5l_io_unit *io, *next;
 
@@ -192,10 +204,18 @@ static void r5l_log_run_stripes(struct r5l_log *log)
 			break;
 
 		list_move_tail(&io->log_sibling, &log->finished_ios);
-		r5l_io_run_stripes(io);
+		r5l_io_run_stripes(io, acked);
 	}
 }
 
+static void r5l_return_acked(struct bio_list *acked)
+{
+	struct bio *bi;
+
+	while ((bi = bio_list_pop(acked)))
+		bio_endio(bi);
+}
+
 static void r5l_move_to_end_ios(struct r5l_log *log)
 {
 	struct r5l_io_unit *io, *next;
@@ -214,6 +234,7 @@ static void r5l_log_endio(struct bio *bio)
 {
 	struct r5l_io_unit *io = bio->bi_private;
 	struct r5l_log *log = io->log;
+	struct bio_list acked = BIO_EMPTY_LIST;
 	unsigned long flags;
 
 	if (bio->bi_error)
@@ -227,9 +248,11 @@ static void r5l_log_endio(struct bio *bio)
 	if (log->need_cache_flush)
 		r5l_move_to_end_ios(log);
 	else
-		r5l_log_run_stripes(log);
+		r5l_log_run_stripes(log, &acked);
 	spin_unlock_irqrestore(&log->io_list_lock, flags);
 
+	r5l_return_acked(&acked);
+
 	if (log->need_cache_flush)
 		md_wakeup_thread(log->rdev->mddev->thread);
 }
@@ -637,6 +660,7 @@ static void r5l_log_flush_endio(struct bio *bio)
 {
 	struct r5l_log *log = container_of(bio, struct r5l_log,
 		flush_bio);
+	struct bio_list acked = BIO_EMPTY_LIST;
 	unsigned long flags;
 	struct r5l_io_unit *io;
 
@@ -645,9 +669,11 @@ static void r5l_log_flush_endio(struct bio *bio)
 
 	spin_lock_irqsave(&log->io_list_lock, flags);
 	list_for_each_entry(io, &log->flushing_ios, log_sibling)
-		r5l_io_run_stripes(io);
+		r5l_io_run_stripes(io, &acked);
 	list_splice_tail_init(&log->flushing_ios, &log->finished_ios);
 	spin_unlock_irqrestore(&log->io_list_lock, flags);
+
+	r5l_return_acked(&acked);
 }
 
 /*
@@ -851,6 +877,67 @@ void r5l_quiesce(struct r5l_log *log, int state)
 	}
 }
 
+bool r5c_is_writeback(struct r5l_log *log)
+{
+	return log && log->write_back;
+}
+
+/*
+ * journal_mode: in write-through mode (the default) writes complete once
+ * the stripe reached the raid disks, the log only closes the write hole.
+ * In write-back mode they complete as soon as data and parity are safe in
+ * the log, recovery replays them from there after a crash.
+ */
+static ssize_t r5c_journal_mode_show(struct mddev *mddev, char *page)
+{
+	struct r5conf *conf;
+	int ret = 0;
+
+	spin_lock(&mddev->lock);
+	conf = mddev->private;
+	if (conf && conf->log)
+		ret = sprintf(page, conf->log->write_back ?
+			      "write-through [write-back]\n" :
+			      "[write-through] write-back\n");
+	spin_unlock(&mddev->lock);
+	return ret;
+}
+
+static ssize_t r5c_journal_mode_store(struct mddev *mddev,
+				      const char *page, size_t len)
+{
+	struct r5conf *conf;
+	bool new;
+	int err;
+
+	if (sysfs_streq(page, "write-through"))
+		new = false;
+	else if (sysfs_streq(page, "write-back"))
+		new = true;
+	else
+		return -EINVAL;
+
+	err = mddev_lock(mddev);
+	if (err)
+		return err;
+	conf = mddev->private;
+	if (!conf || !conf->log)
+		err = -ENODEV;
+	else if (new && conf->skip_copy)
+		err = -EINVAL;
+	else if (new != conf->log->write_back) {
+		mddev_suspend(mddev);
+		conf->log->write_back = new;
+		mddev_resume(mddev);
+	}
+	mddev_unlock(mddev);
+	return err ?: len;
+}
+
+struct md_sysfs_entry
+r5c_journal_mode = __ATTR(journal_mode, S_IRUGO | S_IWUSR,
+			  r5c_journal_mode_show, r5c_journal_mode_store);
+
 bool r5l_log_disk_error(struct r5conf *conf)
 {
 	struct r5l_log *log;
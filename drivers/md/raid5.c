@@ -3132,6 +3132,8 @@ handle_failed_stripe(struct r5conf *conf, struct stripe_head *sh,
 		}
 
 		if (bi) bitmap_end = 1;
+		if (test_bit(STRIPE_LOG_ACKED, &sh->state))
+			bi = NULL;
 		while (bi && bi->bi_iter.bi_sector <
 		       sh->dev[i].sector + STRIPE_SECTORS) {
 			struct bio *bi2 = r5_next_bio(bi, sh->dev[i].sector);
@@ -3178,6 +3180,7 @@ handle_failed_stripe(struct r5conf *conf, struct stripe_head *sh,
 		 */
 		clear_bit(R5_LOCKED, &sh->dev[i].flags);
 	}
+	clear_bit(STRIPE_LOG_ACKED, &sh->state);
 	s->to_write = 0;
 	s->written = 0;
 
@@ -3446,6 +3449,43 @@ static void break_stripe_batch_list(struct stripe_head *head_sh,
  * Note that if we 'wrote' to a failed drive, it will be UPTODATE, but
  * never LOCKED, so we don't need to test 'failed' directly.
  */
+/*
+ * Journal write-back mode: the stripe's data and parity are safe in the
+ * log, so complete the written bios now instead of once the stripe has
+ * reached the raid disks.  Stripes in a batch, discards and skip_copy
+ * (where the bio pages still are the stripe pages) wait for the raid
+ * disks as usual.  Called from the log with the stripe trapped there.
+ */
+void raid5_ack_logged_stripe(struct stripe_head *sh,
+			     struct bio_list *return_bi)
+{
+	struct r5conf *conf = sh->raid_conf;
+	struct bio *wbi, *wbi2;
+	struct r5dev *dev;
+	int i;
+
+	if (sh->batch_head || test_bit(STRIPE_DISCARD, &sh->state))
+		return;
+	for (i = sh->disks; i--; )
+		if (test_bit(R5_SkipCopy, &sh->dev[i].flags))
+			return;
+
+	for (i = sh->disks; i--; ) {
+		dev = &sh->dev[i];
+		wbi = dev->written;
+		while (wbi && wbi->bi_iter.bi_sector <
+		       dev->sector + STRIPE_SECTORS) {
+			wbi2 = r5_next_bio(wbi, dev->sector);
+			if (!raid5_dec_bi_active_stripes(wbi)) {
+				md_write_end(conf->mddev);
+				bio_list_add(return_bi, wbi);
+			}
+			wbi = wbi2;
+		}
+	}
+	set_bit(STRIPE_LOG_ACKED, &sh->state);
+}
+
 static void handle_stripe_clean_event(struct r5conf *conf,
 	struct stripe_head *sh, int disks, struct bio_list *return_bi)
 {
@@ -3476,6 +3516,9 @@ returnbi:
 				dev->page = dev->orig_page;
 				wbi = dev->written;
 				dev->written = NULL;
+				/* already completed by the log */
+				if (test_bit(STRIPE_LOG_ACKED, &sh->state))
+					wbi = NULL;
 				while (wbi && wbi->bi_iter.bi_sector <
 					dev->sector + STRIPE_SECTORS) {
 					wbi2 = r5_next_bio(wbi, dev->sector);
@@ -3504,6 +3547,12 @@ returnbi:
 				discard_pending = 1;
 		}
 
+	for (i = disks; i--; )
+		if (sh->dev[i].written)
+			break;
+	if (i < 0)
+		clear_bit(STRIPE_LOG_ACKED, &sh->state);
+
 	r5l_stripe_write_finished(sh);
 
 	if (!discard_pending &&
@@ -5167,9 +5216,11 @@ static void raid5_make_request(struct mddev *mddev, struct bio * bi)
 	/*
 	 * If array is degraded, better not do chunk aligned read because
 	 * later we might have to read it again in order to reconstruct
-	 * data on failed drives.
+	 * data on failed drives.  In journal write-back mode the newest
+	 * data may only be in the stripe cache, so go through it.
 	 */
 	if (rw == READ && mddev->degraded == 0 &&
+	    !r5c_is_writeback(conf->log) &&
 	    mddev->reshape_position == MaxSector) {
 		bi = chunk_aligned_read(mddev, bi);
 		if (!bi)
@@ -6109,6 +6160,8 @@ raid5_store_skip_copy(struct mddev *mddev, const char *page, size_t len)
 	conf = mddev->private;
 	if (!conf)
 		err = -ENODEV;
+	else if (new && r5c_is_writeback(conf->log))
+		err = -EINVAL;
 	else if (new != conf->skip_copy) {
 		mddev_suspend(mddev);
 		conf->skip_copy = new;
@@ -6218,6 +6271,7 @@ static struct attribute *raid5_attrs[] =  {
 	&raid5_preread_bypass_threshold.attr,
 	&raid5_group_thread_cnt.attr,
 	&raid5_skip_copy.attr,
+	&r5c_journal_mode.attr,
 	&raid5_rmw_level.attr,
 	NULL,
 };
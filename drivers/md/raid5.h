@@ -346,6 +346,7 @@ enum {
 				 * to batch yet.
 				 */
 	STRIPE_LOG_TRAPPED, /* trapped into log */
+	STRIPE_LOG_ACKED,   /* written bios completed once in the log */
 };
 
 #define STRIPE_EXPAND_SYNC_FLAGS \
@@ -635,4 +636,8 @@ extern void r5l_stripe_write_finished(struct stripe_head *sh);
 extern int r5l_handle_flush_request(struct r5l_log *log, struct bio *bio);
 extern void r5l_quiesce(struct r5l_log *log, int state);
 extern bool r5l_log_disk_error(struct r5conf *conf);
+extern bool r5c_is_writeback(struct r5l_log *log);
+extern struct md_sysfs_entry r5c_journal_mode;
+extern void raid5_ack_logged_stripe(struct stripe_head *sh,
+				    struct bio_list *return_bi);
 #endif
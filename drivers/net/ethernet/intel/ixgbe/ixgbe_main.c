@@ -49,6 +49,8 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 #include <scsi/fc/fc_fcoe.h>
 #include <net/vxlan.h>
 #include <net/pkt_cls.h>
@@ -716,7 +718,8 @@ static void ixgbe_dump(struct ixgbe_adapter *adapter)
 					pr_cont("\n");
 
 				if (netif_msg_pktdata(adapter) &&
-				    tx_buffer->skb)
+				    tx_buffer->skb &&
+				    !(tx_buffer->tx_flags & IXGBE_TX_FLAGS_XDP))
 					print_hex_dump(KERN_INFO, "",
 						DUMP_PREFIX_ADDRESS, 16, 1,
 						tx_buffer->skb->data,
@@ -944,7 +947,10 @@ void ixgbe_unmap_and_free_tx_resource(struct ixgbe_ring *ring,
 				      struct ixgbe_tx_buffer *tx_buffer)
 {
 	if (tx_buffer->skb) {
-		dev_kfree_skb_any(tx_buffer->skb);
+		if (tx_buffer->tx_flags & IXGBE_TX_FLAGS_XDP)
+			page_pool_unref_page(tx_buffer->page);
+		else
+			dev_kfree_skb_any(tx_buffer->skb);
 		if (dma_unmap_len(tx_buffer, len))
 			dma_unmap_single(ring->dev,
 					 dma_unmap_addr(tx_buffer, dma),
@@ -1183,8 +1189,11 @@ static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
 		total_bytes += tx_buffer->bytecount;
 		total_packets += tx_buffer->gso_segs;
 
-		/* free the skb */
-		napi_consume_skb(tx_buffer->skb, napi_budget);
+		/* free the skb, or release the page of an XDP_TX frame */
+		if (tx_buffer->tx_flags & IXGBE_TX_FLAGS_XDP)
+			page_pool_unref_page(tx_buffer->page);
+		else
+			napi_consume_skb(tx_buffer->skb, napi_budget);
 
 		/* unmap skb header data */
 		dma_unmap_single(tx_ring->dev,
@@ -1552,35 +1561,22 @@ static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 				    struct ixgbe_rx_buffer *bi)
 {
 	struct page *page = bi->page;
-	dma_addr_t dma;
 
 	/* since we are recycling buffers we should seldom need to alloc */
 	if (likely(page))
 		return true;
 
-	/* alloc new page for storage */
-	page = dev_alloc_pages(ixgbe_rx_pg_order(rx_ring));
-	if (unlikely(!page)) {
-		rx_ring->rx_stats.alloc_rx_page_failed++;
-		return false;
-	}
-
-	/* map page for use */
-	dma = dma_map_page(rx_ring->dev, page, 0,
-			   ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
-
 	/*
-	 * if mapping failed free memory back to system since
-	 * there isn't much point in holding memory we can't use
+	 * pages come back from the stack through the page pool with
+	 * their DMA mapping still in place
 	 */
-	if (dma_mapping_error(rx_ring->dev, dma)) {
-		__free_pages(page, ixgbe_rx_pg_order(rx_ring));
-
+	page = page_pool_dev_alloc_pages(rx_ring->page_pool);
+	if (unlikely(!page)) {
 		rx_ring->rx_stats.alloc_rx_page_failed++;
 		return false;
 	}
 
-	bi->dma = dma;
+	bi->dma = page_pool_get_dma_addr(page);
 	bi->page = page;
 	bi->page_offset = 0;
 
@@ -1824,26 +1820,20 @@ static void ixgbe_pull_tail(struct ixgbe_ring *rx_ring,
  *
  * This function provides a basic DMA sync up for the first fragment of an
  * skb.  The reason for doing this is that the first fragment cannot be
- * unmapped until we have reached the end of packet descriptor for a buffer
- * chain.
+ * synced for the CPU until we have reached the end of packet descriptor
+ * for a buffer chain.
  */
 static void ixgbe_dma_sync_frag(struct ixgbe_ring *rx_ring,
 				struct sk_buff *skb)
 {
-	/* if the page was released unmap it, else just sync our portion */
-	if (unlikely(IXGBE_CB(skb)->page_released)) {
-		dma_unmap_page(rx_ring->dev, IXGBE_CB(skb)->dma,
-			       ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
-		IXGBE_CB(skb)->page_released = false;
-	} else {
-		struct skb_frag_struct *frag = &skb_shinfo(skb)->frags[0];
+	struct skb_frag_struct *frag = &skb_shinfo(skb)->frags[0];
 
-		dma_sync_single_range_for_cpu(rx_ring->dev,
-					      IXGBE_CB(skb)->dma,
-					      frag->page_offset,
-					      ixgbe_rx_bufsz(rx_ring),
-					      DMA_FROM_DEVICE);
-	}
+	/* the page pool keeps the mapping, just sync our portion */
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      IXGBE_CB(skb)->dma,
+				      frag->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
 	IXGBE_CB(skb)->dma = 0;
 }
 
@@ -1930,6 +1920,53 @@ static inline bool ixgbe_page_is_reserved(struct page *page)
 	return (page_to_nid(page) != numa_mem_id()) || page_is_pfmemalloc(page);
 }
 
+/**
+ * ixgbe_can_reuse_rx_page - determine if the ring can keep using a page
+ * @rx_ring: rx descriptor ring the page belongs to
+ * @rx_buffer: buffer whose page has just been handed off
+ * @page: page that was handed off
+ * @truesize: amount of the page consumed by the hand off
+ *
+ * Moves the buffer to the unused part of the page and takes a new page
+ * reference for the ring, returning true if the page can be reused.
+ **/
+static bool ixgbe_can_reuse_rx_page(struct ixgbe_ring *rx_ring,
+				    struct ixgbe_rx_buffer *rx_buffer,
+				    struct page *page,
+				    const unsigned int truesize)
+{
+#if (PAGE_SIZE >= 8192)
+	unsigned int last_offset = ixgbe_rx_pg_size(rx_ring) -
+				   ixgbe_rx_bufsz(rx_ring);
+#endif
+
+	/* avoid re-using remote pages */
+	if (unlikely(ixgbe_page_is_reserved(page)))
+		return false;
+
+#if (PAGE_SIZE < 8192)
+	/* if we are only owner of page we can reuse it */
+	if (unlikely(page_count(page) != 1))
+		return false;
+
+	/* flip page offset to other buffer */
+	rx_buffer->page_offset ^= truesize;
+#else
+	/* move offset up to the next cache line */
+	rx_buffer->page_offset += truesize;
+
+	if (rx_buffer->page_offset > last_offset)
+		return false;
+#endif
+
+	/* Even if we own the page, we are not allowed to use atomic_set()
+	 * This would break get_page_unless_zero() users.
+	 */
+	page_ref_inc(page);
+
+	return true;
+}
+
 /**
  * ixgbe_add_rx_frag - Add contents of Rx buffer to sk_buff
  * @rx_ring: rx descriptor ring to transact packets on
@@ -1956,8 +1993,6 @@ static bool ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
 	unsigned int truesize = ixgbe_rx_bufsz(rx_ring);
 #else
 	unsigned int truesize = ALIGN(size, L1_CACHE_BYTES);
-	unsigned int last_offset = ixgbe_rx_pg_size(rx_ring) -
-				   ixgbe_rx_bufsz(rx_ring);
 #endif
 
 	if ((size <= IXGBE_RX_HDR_SIZE) && !skb_is_nonlinear(skb)) {
@@ -1970,38 +2005,14 @@ static bool ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
 			return true;
 
 		/* this page cannot be reused so discard it */
-		__free_pages(page, ixgbe_rx_pg_order(rx_ring));
+		page_pool_recycle_direct(rx_ring->page_pool, page);
 		return false;
 	}
 
 	skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
 			rx_buffer->page_offset, size, truesize);
 
-	/* avoid re-using remote pages */
-	if (unlikely(ixgbe_page_is_reserved(page)))
-		return false;
-
-#if (PAGE_SIZE < 8192)
-	/* if we are only owner of page we can reuse it */
-	if (unlikely(page_count(page) != 1))
-		return false;
-
-	/* flip page offset to other buffer */
-	rx_buffer->page_offset ^= truesize;
-#else
-	/* move offset up to the next cache line */
-	rx_buffer->page_offset += truesize;
-
-	if (rx_buffer->page_offset > last_offset)
-		return false;
-#endif
-
-	/* Even if we own the page, we are not allowed to use atomic_set()
-	 * This would break get_page_unless_zero() users.
-	 */
-	page_ref_inc(page);
-
-	return true;
+	return ixgbe_can_reuse_rx_page(rx_ring, rx_buffer, page, truesize);
 }
 
 static struct sk_buff *ixgbe_fetch_rx_buffer(struct ixgbe_ring *rx_ring,
@@ -2043,9 +2054,9 @@ static struct sk_buff *ixgbe_fetch_rx_buffer(struct ixgbe_ring *rx_ring,
 		prefetchw(skb->data);
 
 		/*
-		 * Delay unmapping of the first packet. It carries the
+		 * Delay the sync of the first packet. It carries the
 		 * header information, HW may still access the header
-		 * after the writeback.  Only unmap it when EOP is
+		 * after the writeback.  Only sync it when EOP is
 		 * reached
 		 */
 		if (likely(ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP)))
@@ -2067,18 +2078,13 @@ dma_sync:
 		rx_buffer->skb = NULL;
 	}
 
-	/* pull page into skb */
+	/*
+	 * pull page into skb, if the ring cannot keep it the page goes
+	 * back to the page pool once the stack is done with it
+	 */
 	if (ixgbe_add_rx_frag(rx_ring, rx_buffer, rx_desc, skb)) {
 		/* hand second half of page back to the ring */
 		ixgbe_reuse_rx_page(rx_ring, rx_buffer);
-	} else if (IXGBE_CB(skb)->dma == rx_buffer->dma) {
-		/* the page has been released from the ring */
-		IXGBE_CB(skb)->page_released = true;
-	} else {
-		/* we are not reusing the buffer so unmap it */
-		dma_unmap_page(rx_ring->dev, rx_buffer->dma,
-			       ixgbe_rx_pg_size(rx_ring),
-			       DMA_FROM_DEVICE);
 	}
 
 	/* clear contents of buffer_info */
@@ -2087,6 +2093,171 @@ dma_sync:
 	return skb;
 }
 
+/**
+ * ixgbe_xmit_xdp_frame - transmit an XDP_TX frame from an Rx buffer
+ * @tx_ring: Tx ring shared with the stack
+ * @rx_buffer: buffer holding the frame
+ * @size: length of the frame
+ *
+ * The page reference held by the Rx ring is handed to the Tx buffer and
+ * released once the frame has been sent.  Returns false if the frame
+ * could not be queued, in which case the caller still owns the buffer.
+ **/
+static bool ixgbe_xmit_xdp_frame(struct ixgbe_ring *tx_ring,
+				 struct ixgbe_rx_buffer *rx_buffer,
+				 unsigned int size)
+{
+	struct netdev_queue *txq = txring_txq(tx_ring);
+	struct page *page = rx_buffer->page;
+	struct ixgbe_tx_buffer *tx_buffer;
+	union ixgbe_adv_tx_desc *tx_desc;
+	dma_addr_t dma;
+	u32 cmd_type;
+	u16 i;
+
+	__netif_tx_lock(txq, smp_processor_id());
+
+	/* leave the stack the room it expects to find in the queue */
+	if (unlikely(netif_xmit_frozen_or_stopped(txq) ||
+		     ixgbe_desc_unused(tx_ring) <= DESC_NEEDED)) {
+		tx_ring->tx_stats.tx_busy++;
+		__netif_tx_unlock(txq);
+		return false;
+	}
+
+	dma = dma_map_single(tx_ring->dev,
+			     page_address(page) + rx_buffer->page_offset,
+			     size, DMA_TO_DEVICE);
+	if (dma_mapping_error(tx_ring->dev, dma)) {
+		__netif_tx_unlock(txq);
+		return false;
+	}
+
+	i = tx_ring->next_to_use;
+	tx_buffer = &tx_ring->tx_buffer_info[i];
+	tx_buffer->page = page;
+	tx_buffer->bytecount = size;
+	tx_buffer->gso_segs = 1;
+	tx_buffer->protocol = 0;
+	tx_buffer->tx_flags = IXGBE_TX_FLAGS_XDP;
+	dma_unmap_len_set(tx_buffer, len, size);
+	dma_unmap_addr_set(tx_buffer, dma, dma);
+
+	cmd_type = IXGBE_ADVTXD_DTYP_DATA |
+		   IXGBE_ADVTXD_DCMD_DEXT |
+		   IXGBE_ADVTXD_DCMD_IFCS |
+		   IXGBE_TXD_CMD_EOP |
+		   IXGBE_TXD_CMD_RS | size;
+
+	tx_desc = IXGBE_TX_DESC(tx_ring, i);
+	tx_desc->read.buffer_addr = cpu_to_le64(dma);
+	tx_desc->read.cmd_type_len = cpu_to_le32(cmd_type);
+	tx_desc->read.olinfo_status =
+		cpu_to_le32(size << IXGBE_ADVTXD_PAYLEN_SHIFT);
+
+	netdev_tx_sent_queue(txq, size);
+
+	tx_buffer->time_stamp = jiffies;
+
+	/* descriptor and buffer must be visible before next_to_watch */
+	wmb();
+
+	tx_buffer->next_to_watch = tx_desc;
+
+	i++;
+	if (i == tx_ring->count)
+		i = 0;
+
+	tx_ring->next_to_use = i;
+
+	writel(i, tx_ring->tail);
+	mmiowb();
+
+	__netif_tx_unlock(txq);
+
+	return true;
+}
+
+/**
+ * ixgbe_run_xdp - run the XDP program on a received frame
+ * @q_vector: structure containing interrupt and ring information
+ * @rx_ring: rx descriptor ring the frame was received on
+ * @rx_desc: descriptor of the frame
+ * @xdp_prog: program to run
+ *
+ * Runs the program against the frame while it is still in the Rx page,
+ * before any sk_buff is allocated.  Returns true if the program consumed
+ * the frame, false if it should be passed up the stack.
+ **/
+static bool ixgbe_run_xdp(struct ixgbe_q_vector *q_vector,
+			  struct ixgbe_ring *rx_ring,
+			  union ixgbe_adv_rx_desc *rx_desc,
+			  struct bpf_prog *xdp_prog)
+{
+	unsigned int size = le16_to_cpu(rx_desc->wb.upper.length);
+	struct ixgbe_ring *tx_ring = q_vector->tx.ring;
+	struct ixgbe_rx_buffer *rx_buffer;
+	struct xdp_buff xdp;
+	u32 ntc, act;
+
+	/* only complete, error free single buffer frames are handled */
+	if (unlikely(!ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP) ||
+		     ixgbe_test_staterr(rx_desc,
+					IXGBE_RXDADV_ERR_FRAME_ERR_MASK)))
+		return false;
+
+	rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+	if (rx_buffer->skb)
+		return false;
+
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      rx_buffer->dma,
+				      rx_buffer->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
+
+	xdp.data = page_address(rx_buffer->page) + rx_buffer->page_offset;
+	xdp.data_end = xdp.data + size;
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		return false;
+	case XDP_TX:
+		if (tx_ring && ixgbe_xmit_xdp_frame(tx_ring, rx_buffer, size)) {
+#if (PAGE_SIZE < 8192)
+			unsigned int truesize = ixgbe_rx_bufsz(rx_ring);
+#else
+			unsigned int truesize = ALIGN(size, L1_CACHE_BYTES);
+#endif
+
+			/* the Tx buffer now owns the ring's page reference */
+			if (ixgbe_can_reuse_rx_page(rx_ring, rx_buffer,
+						    rx_buffer->page, truesize))
+				ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+			break;
+		}
+
+		/* no room on the Tx ring, drop the frame */
+		ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+	case XDP_ABORTED:
+	case XDP_DROP:
+		/* give the buffer straight back to the hardware */
+		ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+		break;
+	}
+
+	rx_buffer->page = NULL;
+
+	ntc = rx_ring->next_to_clean + 1;
+	rx_ring->next_to_clean = (ntc < rx_ring->count) ? ntc : 0;
+
+	return true;
+}
+
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -2111,6 +2282,10 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 	unsigned int mss = 0;
 #endif /* IXGBE_FCOE */
 	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
+	struct bpf_prog *xdp_prog;
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(q_vector->adapter->xdp_prog);
 
 	while (likely(total_rx_packets < budget)) {
 		union ixgbe_adv_rx_desc *rx_desc;
@@ -2133,6 +2308,14 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		 */
 		dma_rmb();
 
+		if (xdp_prog &&
+		    ixgbe_run_xdp(q_vector, rx_ring, rx_desc, xdp_prog)) {
+			total_rx_bytes += le16_to_cpu(rx_desc->wb.upper.length);
+			total_rx_packets++;
+			cleaned_count++;
+			continue;
+		}
+
 		/* retrieve a buffer from the ring */
 		skb = ixgbe_fetch_rx_buffer(rx_ring, rx_desc);
 
@@ -2187,6 +2370,8 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		total_rx_packets++;
 	}
 
+	rcu_read_unlock();
+
 	u64_stats_update_begin(&rx_ring->syncp);
 	rx_ring->stats.packets += total_rx_packets;
 	rx_ring->stats.bytes += total_rx_bytes;
@@ -4876,7 +5061,6 @@ static void ixgbe_fwd_psrtype(struct ixgbe_fwd_adapter *vadapter)
  **/
 static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 {
-	struct device *dev = rx_ring->dev;
 	unsigned long size;
 	u16 i;
 
@@ -4889,22 +5073,14 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 		struct ixgbe_rx_buffer *rx_buffer = &rx_ring->rx_buffer_info[i];
 
 		if (rx_buffer->skb) {
-			struct sk_buff *skb = rx_buffer->skb;
-			if (IXGBE_CB(skb)->page_released)
-				dma_unmap_page(dev,
-					       IXGBE_CB(skb)->dma,
-					       ixgbe_rx_bufsz(rx_ring),
-					       DMA_FROM_DEVICE);
-			dev_kfree_skb(skb);
+			dev_kfree_skb(rx_buffer->skb);
 			rx_buffer->skb = NULL;
 		}
 
 		if (!rx_buffer->page)
 			continue;
 
-		dma_unmap_page(dev, rx_buffer->dma,
-			       ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
-		__free_pages(rx_buffer->page, ixgbe_rx_pg_order(rx_ring));
+		page_pool_put_page(rx_ring->page_pool, rx_buffer->page, false);
 
 		rx_buffer->page = NULL;
 	}
@@ -5897,6 +6073,10 @@ err_setup_tx:
  **/
 int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 {
+	struct page_pool_params pp_params = {
+		.flags		= PP_FLAG_DMA_MAP,
+		.dma_dir	= DMA_FROM_DEVICE,
+	};
 	struct device *dev = rx_ring->dev;
 	int orig_node = dev_to_node(dev);
 	int ring_node = -1;
@@ -5931,10 +6111,23 @@ int ixgbe_setup_rx_resources(struct ixgbe_ring *rx_ring)
 	if (!rx_ring->desc)
 		goto err;
 
+	pp_params.order = ixgbe_rx_pg_order(rx_ring);
+	pp_params.pool_size = rx_ring->count;
+	pp_params.nid = ring_node;
+	pp_params.dev = dev;
+	rx_ring->page_pool = page_pool_create(&pp_params);
+	if (IS_ERR(rx_ring->page_pool)) {
+		rx_ring->page_pool = NULL;
+		goto err_pool;
+	}
+
 	rx_ring->next_to_clean = 0;
 	rx_ring->next_to_use = 0;
 
 	return 0;
+err_pool:
+	dma_free_coherent(dev, rx_ring->size, rx_ring->desc, rx_ring->dma);
+	rx_ring->desc = NULL;
 err:
 	vfree(rx_ring->rx_buffer_info);
 	rx_ring->rx_buffer_info = NULL;
@@ -6025,6 +6218,10 @@ void ixgbe_free_rx_resources(struct ixgbe_ring *rx_ring)
 {
 	ixgbe_clean_rx_ring(rx_ring);
 
+	/* pages still held by the stack keep the pool alive for a while */
+	page_pool_destroy(rx_ring->page_pool);
+	rx_ring->page_pool = NULL;
+
 	vfree(rx_ring->rx_buffer_info);
 	rx_ring->rx_buffer_info = NULL;
 
@@ -6057,6 +6254,12 @@ static void ixgbe_free_all_rx_resources(struct ixgbe_adapter *adapter)
 			ixgbe_free_rx_resources(adapter->rx_ring[i]);
 }
 
+/* XDP frames must fit in a single Rx buffer */
+static bool ixgbe_xdp_frame_fits(int mtu)
+{
+	return mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN <= IXGBE_RXBUFFER_2K;
+}
+
 /**
  * ixgbe_change_mtu - Change the Maximum Transfer Unit
  * @netdev: network interface device structure
@@ -6073,6 +6276,13 @@ static int ixgbe_change_mtu(struct net_device *netdev, int new_mtu)
 	if ((new_mtu < 68) || (max_frame > IXGBE_MAX_JUMBO_FRAME_SIZE))
 		return -EINVAL;
 
+	if (rtnl_dereference(adapter->xdp_prog) &&
+	    !ixgbe_xdp_frame_fits(new_mtu)) {
+		e_err(probe, "MTU %d too large while XDP is attached\n",
+		      new_mtu);
+		return -EINVAL;
+	}
+
 	/*
 	 * For 82599EB we cannot allow legacy VFs to enable their receive
 	 * paths when MTU greater than 1500 is configured.  So display a
@@ -8707,6 +8917,10 @@ static netdev_features_t ixgbe_fix_features(struct net_device *netdev,
 	if (!(adapter->flags2 & IXGBE_FLAG2_RSC_CAPABLE))
 		features &= ~NETIF_F_LRO;
 
+	/* XDP only handles frames received into a single buffer */
+	if (rtnl_dereference(adapter->xdp_prog))
+		features &= ~NETIF_F_LRO;
+
 	return features;
 }
 
@@ -9115,6 +9329,50 @@ ixgbe_features_check(struct sk_buff *skb, struct net_device *dev,
 	return features;
 }
 
+static int ixgbe_xdp_setup(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+
+	if (prog) {
+		if (!ixgbe_xdp_frame_fits(dev->mtu)) {
+			e_dev_err("MTU %d too large for XDP\n", dev->mtu);
+			return -EINVAL;
+		}
+
+		/* coalesced frames span several buffers */
+		if (dev->features & NETIF_F_LRO) {
+			e_dev_err("LRO must be disabled to use XDP\n");
+			return -EINVAL;
+		}
+	}
+
+	/* the Rx buffer layout is the same with and without a program,
+	 * so the rings keep running while it is swapped
+	 */
+	old_prog = rtnl_dereference(adapter->xdp_prog);
+	rcu_assign_pointer(adapter->xdp_prog, prog);
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+static int ixgbe_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return ixgbe_xdp_setup(dev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(adapter->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -9165,6 +9423,7 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_del_vxlan_port	= ixgbe_del_vxlan_port,
 #endif /* CONFIG_IXGBE_VXLAN */
 	.ndo_features_check	= ixgbe_features_check,
+	.ndo_xdp		= ixgbe_xdp,
 };
 
 /**
@@ -9739,6 +9998,7 @@ err_dma:
 static void ixgbe_remove(struct pci_dev *pdev)
 {
 	struct ixgbe_adapter *adapter = pci_get_drvdata(pdev);
+	struct bpf_prog *xdp_prog;
 	struct net_device *netdev;
 	bool disable_dev;
 	int i;
@@ -9800,6 +10060,11 @@ static void ixgbe_remove(struct pci_dev *pdev)
 	}
 
 	kfree(adapter->mac_table);
+
+	xdp_prog = rcu_dereference_protected(adapter->xdp_prog, 1);
+	if (xdp_prog)
+		bpf_prog_put(xdp_prog);
+
 	disable_dev = !test_and_set_bit(__IXGBE_DISABLED, &adapter->state);
 	free_netdev(netdev);
 
@@ -278,6 +278,17 @@ static u32 mlx4_en_free_tx_desc(struct mlx4_en_priv *priv,
 	int nr_maps = tx_info->nr_maps;
 	int i;
 
+	/* XDP_TX frames own a whole rx page, which is still mapped
+	 * with the rx mapping; give it back to the page allocator.
+	 */
+	if (!skb) {
+		dma_unmap_page(priv->ddev, tx_info->map0_dma,
+			       PAGE_SIZE, priv->dma_dir);
+		put_page(tx_info->page);
+		tx_info->page = NULL;
+		return tx_info->nr_txbb;
+	}
+
 	/* We do not touch skb here, so prefetch skb->users location
 	 * to speedup consume_skb()
 	 */
@@ -700,6 +711,23 @@ static void mlx4_bf_copy(void __iomem *dst, const void *src,
 	__iowrite64_copy(dst, src, bytecnt / 8);
 }
 
+void mlx4_en_xmit_doorbell(struct mlx4_en_tx_ring *ring)
+{
+	wmb();
+	/* Since there is no iowrite*_native() that writes the
+	 * value as is, without byteswapping - using the one
+	 * the doesn't do byteswapping in the relevant arch
+	 * endianness.
+	 */
+#if defined(__LITTLE_ENDIAN)
+	iowrite32(
+#else
+	iowrite32be(
+#endif
+		  ring->doorbell_qpn,
+		  ring->bf.uar->map + MLX4_SEND_DOORBELL);
+}
+
 netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct skb_shared_info *shinfo = skb_shinfo(skb);
@@ -983,19 +1011,7 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		dma_wmb();
 		tx_desc->ctrl.owner_opcode = op_own;
 		if (send_doorbell) {
-			wmb();
-			/* Since there is no iowrite*_native() that writes the
-			 * value as is, without byteswapping - using the one
-			 * the doesn't do byteswapping in the relevant arch
-			 * endianness.
-			 */
-#if defined(__LITTLE_ENDIAN)
-			iowrite32(
-#else
-			iowrite32be(
-#endif
-				  ring->doorbell_qpn,
-				  ring->bf.uar->map + MLX4_SEND_DOORBELL);
+			mlx4_en_xmit_doorbell(ring);
 		} else {
 			ring->xmit_more++;
 		}
@@ -1034,3 +1050,94 @@ tx_drop:
 	return NETDEV_TX_OK;
 }
 
+/* Post an rx page that an XDP program bounced back with XDP_TX. The frame
+ * shares the tx ring with the stack, so the netdev queue lock serializes
+ * us against mlx4_en_xmit(). The doorbell is left to the caller, which
+ * rings it once per napi poll through mlx4_en_xmit_doorbell().
+ */
+netdev_tx_t mlx4_en_xmit_frame(struct mlx4_en_rx_alloc *frame,
+			       struct net_device *dev, unsigned int length,
+			       int tx_ind, bool *doorbell_pending)
+{
+	struct mlx4_en_priv *priv = netdev_priv(dev);
+	struct mlx4_en_tx_ring *ring;
+	struct mlx4_en_tx_desc *tx_desc;
+	struct mlx4_wqe_data_seg *data;
+	struct mlx4_en_tx_info *tx_info;
+	int real_size;
+	__be32 op_own;
+	dma_addr_t dma;
+	u32 index;
+
+	ring = priv->tx_ring[tx_ind];
+
+	__netif_tx_lock(ring->tx_queue, smp_processor_id());
+	if (unlikely(!priv->port_up ||
+		     netif_xmit_frozen_or_stopped(ring->tx_queue) ||
+		     mlx4_en_is_tx_ring_full(ring))) {
+		__netif_tx_unlock(ring->tx_queue);
+		return NETDEV_TX_BUSY;
+	}
+
+	/* A single data segment always fits into one TXBB. */
+	real_size = CTRL_SIZE + DS_SIZE;
+	index = ring->prod & ring->size_mask;
+	tx_desc = ring->buf + index * TXBB_SIZE;
+	data = &tx_desc->data;
+
+	dma = frame->dma;
+
+	tx_info = &ring->tx_info[index];
+	tx_info->skb = NULL;
+	tx_info->page = frame->page;
+	frame->page = NULL;
+	tx_info->map0_dma = dma;
+	tx_info->map0_byte_count = PAGE_SIZE;
+	tx_info->nr_txbb = 1;
+	tx_info->nr_bytes = max_t(unsigned int, length, ETH_ZLEN);
+	tx_info->data_offset = (void *)data - (void *)tx_desc;
+	tx_info->ts_requested = 0;
+	tx_info->nr_maps = 1;
+	tx_info->linear = 0;
+	tx_info->inl = 0;
+
+	dma_sync_single_for_device(priv->ddev, dma + frame->page_offset,
+				   length, priv->dma_dir);
+
+	data->addr = cpu_to_be64(dma + frame->page_offset);
+	data->lkey = ring->mr_key;
+	dma_wmb();
+	data->byte_count = cpu_to_be32(length);
+
+	tx_desc->ctrl.srcrb_flags = priv->ctrl_flags;
+	tx_desc->ctrl.vlan_tag = 0;
+	tx_desc->ctrl.ins_vlan = 0;
+	tx_desc->ctrl.fence_size = (real_size / 16) & 0x3f;
+
+	op_own = cpu_to_be32(MLX4_OPCODE_SEND) |
+		 ((ring->prod & ring->size) ?
+		  cpu_to_be32(MLX4_EN_BIT_DESC_OWN) : 0);
+
+	ring->packets++;
+	ring->bytes += tx_info->nr_bytes;
+	netdev_tx_sent_queue(ring->tx_queue, tx_info->nr_bytes);
+	AVG_PERF_COUNTER(priv->pstats.tx_pktsz_avg, length);
+
+	ring->prod += tx_info->nr_txbb;
+
+	/* Ensure new descriptor hits memory
+	 * before setting ownership of this descriptor to HW
+	 */
+	dma_wmb();
+	tx_desc->ctrl.owner_opcode = op_own;
+
+	if (unlikely(mlx4_en_is_tx_ring_full(ring))) {
+		netif_tx_stop_queue(ring->tx_queue);
+		ring->queue_stopped++;
+	}
+	__netif_tx_unlock(ring->tx_queue);
+
+	*doorbell_pending = true;
+
+	return NETDEV_TX_OK;
+}
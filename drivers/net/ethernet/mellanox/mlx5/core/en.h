@@ -269,6 +269,7 @@ struct mlx5e_mpw_info {
 	};
 	u16 consumed_strides;
 	u16 skbs_frags[MLX5_MPWRQ_PAGES_PER_WQE];
+	bool linear_reuse; /* linear buffer kept mapped for the next post */
 
 	void (*dma_pre_sync)(struct device *pdev,
 			     struct mlx5e_mpw_info *wi,
@@ -610,6 +611,7 @@ void mlx5e_free_rx_linear_mpwqe(struct mlx5e_rq *rq,
 				struct mlx5e_mpw_info *wi);
 void mlx5e_free_rx_fragmented_mpwqe(struct mlx5e_rq *rq,
 				    struct mlx5e_mpw_info *wi);
+void mlx5e_release_rx_mpwqe_bufs(struct mlx5e_rq *rq);
 struct mlx5_cqe64 *mlx5e_get_cqe(struct mlx5e_cq *cq);
 
 void mlx5e_update_stats(struct mlx5e_priv *priv);
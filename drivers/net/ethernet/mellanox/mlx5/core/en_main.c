@@ -358,6 +358,7 @@ static void mlx5e_destroy_rq(struct mlx5e_rq *rq)
 {
 	switch (rq->wq_type) {
 	case MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ:
+		mlx5e_release_rx_mpwqe_bufs(rq);
 		kfree(rq->wqe_info);
 		break;
 	default: /* MLX5_WQ_TYPE_LINKED_LIST */
@@ -509,6 +509,14 @@ static int mlx5e_alloc_rx_linear_mpwqe(struct mlx5e_rq *rq,
 	gfp_t gfp_mask;
 	int i;
 
+	if (wi->linear_reuse) {
+		/* same pages, same references, only hand it back to HW */
+		wi->linear_reuse = false;
+		dma_sync_single_for_device(rq->pdev, wi->dma_info.addr,
+					   rq->wqe_sz, DMA_FROM_DEVICE);
+		goto post;
+	}
+
 	gfp_mask = GFP_ATOMIC | __GFP_COLD | __GFP_MEMALLOC;
 	wi->dma_info.page = alloc_pages_node(NUMA_NO_NODE, gfp_mask,
 					     MLX5_MPWRQ_WQE_PAGE_ORDER);
@@ -532,6 +540,7 @@ static int mlx5e_alloc_rx_linear_mpwqe(struct mlx5e_rq *rq,
 		wi->skbs_frags[i] = 0;
 	}
 
+post:
 	wi->consumed_strides = 0;
 	wi->dma_pre_sync = mlx5e_dma_pre_sync_linear_mpwqe;
 	wi->add_skb_frag = mlx5e_add_skb_frag_linear_mpwqe;
@@ -543,8 +552,8 @@ static int mlx5e_alloc_rx_linear_mpwqe(struct mlx5e_rq *rq,
 	return 0;
 }
 
-void mlx5e_free_rx_linear_mpwqe(struct mlx5e_rq *rq,
-				struct mlx5e_mpw_info *wi)
+static void mlx5e_release_rx_linear_mpwqe(struct mlx5e_rq *rq,
+					  struct mlx5e_mpw_info *wi)
 {
 	int i;
 
@@ -557,6 +566,47 @@ void mlx5e_free_rx_linear_mpwqe(struct mlx5e_rq *rq,
 	}
 }
 
+void mlx5e_free_rx_linear_mpwqe(struct mlx5e_rq *rq,
+				struct mlx5e_mpw_info *wi)
+{
+	int i;
+
+	if (unlikely(!test_bit(MLX5E_RQ_STATE_POST_WQES_ENABLE, &rq->state)))
+		goto release;
+
+	/* With small packets every stride is copied out to the skb linear
+	 * part and no page of the WQE is left referenced by the stack; the
+	 * whole buffer can then be posted again without going through the
+	 * page allocator and the DMA mapping.
+	 */
+	for (i = 0; i < MLX5_MPWRQ_PAGES_PER_WQE; i++)
+		if (wi->skbs_frags[i])
+			goto release;
+
+	wi->linear_reuse = true;
+	return;
+
+release:
+	mlx5e_release_rx_linear_mpwqe(rq, wi);
+}
+
+/* Buffers kept for reuse by WQEs that were not posted again */
+void mlx5e_release_rx_mpwqe_bufs(struct mlx5e_rq *rq)
+{
+	int wq_sz = mlx5_wq_ll_get_size(&rq->wq);
+	int i;
+
+	for (i = 0; i < wq_sz; i++) {
+		struct mlx5e_mpw_info *wi = &rq->wqe_info[i];
+
+		if (!wi->linear_reuse)
+			continue;
+
+		wi->linear_reuse = false;
+		mlx5e_release_rx_linear_mpwqe(rq, wi);
+	}
+}
+
 int mlx5e_alloc_rx_mpwqe(struct mlx5e_rq *rq, struct mlx5e_rx_wqe *wqe, u16 ix)
 {
 	int err;
@@ -495,6 +495,9 @@ static int geneve_gro_complete(struct sock *sk, struct sk_buff *skb,
 	gh_len = geneve_hlen(gh);
 	type = gh->proto_type;
 
+	/* Lets the merged packet be segmented again if it is forwarded */
+	skb_set_inner_protocol(skb, type);
+
 	rcu_read_lock();
 	ptype = gro_find_complete_by_type(type);
 	if (ptype)
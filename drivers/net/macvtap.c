@@ -718,7 +718,7 @@ static void macvtap_skb_to_vnet_hdr(struct macvtap_queue *q,
 #define MACVTAP_RESERVE HH_DATA_OFF(ETH_HLEN)
 
 /* Get packet from user space buffer */
-static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
+static ssize_t macvtap_get_user(struct macvtap_queue *q, void *msg_control,
 				struct iov_iter *from, int noblock)
 {
 	int good_linear = SKB_MAX_HEAD(MACVTAP_RESERVE);
@@ -764,7 +764,7 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 	if (unlikely(len < ETH_HLEN))
 		goto err;
 
-	if (m && m->msg_control && sock_flag(&q->sk, SOCK_ZEROCOPY)) {
+	if (msg_control && sock_flag(&q->sk, SOCK_ZEROCOPY)) {
 		struct iov_iter i;
 
 		copylen = vnet_hdr.hdr_len ?
@@ -798,8 +798,8 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 		err = zerocopy_sg_from_iter(skb, from);
 	else {
 		err = skb_copy_datagram_from_iter(skb, 0, from, len);
-		if (!err && m && m->msg_control) {
-			struct ubuf_info *uarg = m->msg_control;
+		if (!err && msg_control) {
+			struct ubuf_info *uarg = msg_control;
 			uarg->callback(uarg, false);
 		}
 	}
@@ -829,7 +829,7 @@ static ssize_t macvtap_get_user(struct macvtap_queue *q, struct msghdr *m,
 	vlan = rcu_dereference(q->vlan);
 	/* copy skb_ubuf_info for callback when skb has no error */
 	if (zerocopy) {
-		skb_shinfo(skb)->destructor_arg = m->msg_control;
+		skb_shinfo(skb)->destructor_arg = msg_control;
 		skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
 		skb_shinfo(skb)->tx_flags |= SKBTX_SHARED_FRAG;
 	}
@@ -1241,7 +1241,29 @@ static int macvtap_sendmsg(struct socket *sock, struct msghdr *m,
 			   size_t total_len)
 {
 	struct macvtap_queue *q = container_of(sock, struct macvtap_queue, sock);
-	return macvtap_get_user(q, m, &m->msg_iter, m->msg_flags & MSG_DONTWAIT);
+	struct tun_msg_ctl *ctl = m->msg_control;
+	int noblock = m->msg_flags & MSG_DONTWAIT;
+	int i, total = 0;
+	ssize_t len;
+
+	if (!ctl)
+		return macvtap_get_user(q, NULL, &m->msg_iter, noblock);
+
+	switch (ctl->type) {
+	case TUN_MSG_UBUF:
+		return macvtap_get_user(q, ctl->ptr, &m->msg_iter, noblock);
+	case TUN_MSG_PTR:
+		for (i = 0; i < ctl->num; i++) {
+			len = macvtap_get_user(q, NULL,
+					       (struct iov_iter *)ctl->ptr + i,
+					       noblock);
+			if (len > 0)
+				total += len;
+		}
+		return total;
+	default:
+		return -EINVAL;
+	}
 }
 
 static int macvtap_recvmsg(struct socket *sock, struct msghdr *m,
@@ -65,6 +65,7 @@
 #include <linux/nsproxy.h>
 #include <linux/virtio_net.h>
 #include <linux/rcupdate.h>
+#include <linux/skb_array.h>
 #include <net/net_namespace.h>
 #include <net/netns/generic.h>
 #include <net/rtnetlink.h>
@@ -167,6 +168,8 @@ struct tun_file {
 	};
 	struct list_head next;
 	struct tun_struct *detached;
+	/* Packets on their way to the reader, sized from tx_queue_len */
+	struct skb_array tx_array;
 };
 
 struct tun_flow_entry {
@@ -515,7 +518,11 @@ static struct tun_struct *tun_enable_queue(struct tun_file *tfile)
 
 static void tun_queue_purge(struct tun_file *tfile)
 {
-	skb_queue_purge(&tfile->sk.sk_receive_queue);
+	struct sk_buff *skb;
+
+	while ((skb = skb_array_consume(&tfile->tx_array)) != NULL)
+		kfree_skb(skb);
+
 	skb_queue_purge(&tfile->sk.sk_error_queue);
 }
 
@@ -560,6 +567,8 @@ static void __tun_detach(struct tun_file *tfile, bool clean)
 			    tun->dev->reg_state == NETREG_REGISTERED)
 				unregister_netdevice(tun->dev);
 		}
+		/* Out of reach of tun_net_xmit(), and the file is closing */
+		skb_array_cleanup(&tfile->tx_array);
 		sock_put(&tfile->sk);
 	}
 }
@@ -610,6 +619,12 @@ static void tun_detach_all(struct net_device *dev)
 		module_put(THIS_MODULE);
 }
 
+/* One ring per queue, each as long as the device's tx_queue_len */
+static int tun_ring_size(struct net_device *dev)
+{
+	return clamp_t(unsigned long, dev->tx_queue_len, 1, INT_MAX / 8);
+}
+
 static int tun_attach(struct tun_struct *tun, struct file *file, bool skip_filter)
 {
 	struct tun_file *tfile = file->private_data;
@@ -632,6 +647,15 @@ static int tun_attach(struct tun_struct *tun, struct file *file, bool skip_filte
 	    tun->numqueues + tun->numdisabled == MAX_TAP_QUEUES)
 		goto out;
 
+	/* Not yet reachable from tun_net_xmit(), but vhost-net may already
+	 * be consuming; skb_array_resize() takes both locks. */
+	if (tfile->tx_array.ring.size != tun_ring_size(tun->dev)) {
+		err = skb_array_resize(&tfile->tx_array,
+				       tun_ring_size(tun->dev), GFP_KERNEL);
+		if (err)
+			goto out;
+	}
+
 	err = 0;
 
 	/* Re-attach the filter to persist device */
@@ -868,14 +892,7 @@ static netdev_tx_t tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 	    sk_filter(tfile->socket.sk, skb))
 		goto drop;
 
-	/* Limit the number of packets queued by dividing txq length with the
-	 * number of queues.
-	 */
-	if (skb_queue_len(&tfile->socket.sk->sk_receive_queue) * numqueues
-			  >= dev->tx_queue_len)
-		goto drop;
-
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		goto drop;
 
 	if (skb->sk && sk_fullsock(skb->sk)) {
@@ -891,8 +908,9 @@ static netdev_tx_t tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	nf_reset(skb);
 
-	/* Enqueue packet */
-	skb_queue_tail(&tfile->socket.sk->sk_receive_queue, skb);
+	/* Enqueue packet, dropping it if the reader is too far behind */
+	if (skb_array_produce(&tfile->tx_array, skb))
+		goto drop;
 
 	/* Notify and wake up reader process */
 	if (tfile->flags & TUN_FASYNC)
@@ -1107,7 +1125,7 @@ static unsigned int tun_chr_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, sk_sleep(sk), wait);
 
-	if (!skb_queue_empty(&sk->sk_receive_queue))
+	if (!skb_array_empty(&tfile->tx_array))
 		mask |= POLLIN | POLLRDNORM;
 
 	if (sock_writeable(sk) ||
@@ -1149,10 +1167,11 @@ static struct sk_buff *tun_alloc_skb(struct tun_file *tfile,
 	return skb;
 }
 
-/* Get packet from user space buffer */
+/* Get packet from user space buffer. If more is set, further packets
+ * follow and the caller kicks the stack once the last one is in. */
 static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			    void *msg_control, struct iov_iter *from,
-			    int noblock)
+			    int noblock, bool more)
 {
 	struct tun_pi pi = { 0, cpu_to_be16(ETH_P_IP) };
 	struct sk_buff *skb;
@@ -1333,7 +1352,10 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 	skb_probe_transport_header(skb, 0);
 
 	rxhash = skb_get_hash(skb);
-	netif_rx_ni(skb);
+	if (more)
+		netif_rx(skb);
+	else
+		netif_rx_ni(skb);
 
 	stats = get_cpu_ptr(tun->pcpu_stats);
 	u64_stats_update_begin(&stats->syncp);
@@ -1356,7 +1378,8 @@ static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (!tun)
 		return -EBADFD;
 
-	result = tun_get_user(tun, tfile, NULL, from, file->f_flags & O_NONBLOCK);
+	result = tun_get_user(tun, tfile, NULL, from,
+			      file->f_flags & O_NONBLOCK, false);
 
 	tun_put(tun);
 	return result;
@@ -1481,24 +1504,70 @@ done:
 	return total;
 }
 
+static struct sk_buff *tun_ring_recv(struct tun_file *tfile, int noblock,
+				     int *err)
+{
+	DECLARE_WAITQUEUE(wait, current);
+	struct sk_buff *skb = NULL;
+	int error = 0;
+
+	skb = skb_array_consume(&tfile->tx_array);
+	if (skb)
+		goto out;
+	if (noblock) {
+		error = -EAGAIN;
+		goto out;
+	}
+
+	add_wait_queue(&tfile->wq.wait, &wait);
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		skb = skb_array_consume(&tfile->tx_array);
+		if (skb)
+			break;
+		if (signal_pending(current)) {
+			error = -ERESTARTSYS;
+			break;
+		}
+		/* Device went away, report end of file */
+		if (tfile->socket.sk->sk_shutdown & RCV_SHUTDOWN)
+			break;
+
+		schedule();
+	}
+
+	__set_current_state(TASK_RUNNING);
+	remove_wait_queue(&tfile->wq.wait, &wait);
+
+out:
+	*err = error;
+	return skb;
+}
+
+/* skb, if given, was already taken off tx_array by the caller and is
+ * consumed here whatever happens. */
 static ssize_t tun_do_read(struct tun_struct *tun, struct tun_file *tfile,
 			   struct iov_iter *to,
-			   int noblock)
+			   int noblock, struct sk_buff *skb)
 {
-	struct sk_buff *skb;
 	ssize_t ret;
-	int peeked, err, off = 0;
+	int err;
 
 	tun_debug(KERN_INFO, tun, "tun_do_read\n");
 
-	if (!iov_iter_count(to))
+	if (!iov_iter_count(to)) {
+		if (skb)
+			kfree_skb(skb);
 		return 0;
+	}
 
-	/* Read frames from queue */
-	skb = __skb_recv_datagram(tfile->socket.sk, noblock ? MSG_DONTWAIT : 0,
-				  &peeked, &off, &err);
-	if (!skb)
-		return err;
+	if (!skb) {
+		/* Read frames from ring */
+		skb = tun_ring_recv(tfile, noblock, &err);
+		if (!skb)
+			return err;
+	}
 
 	ret = tun_put_user(tun, tfile, skb, to);
 	if (unlikely(ret < 0))
@@ -1518,7 +1587,7 @@ static ssize_t tun_chr_read_iter(struct kiocb *iocb, struct iov_iter *to)
 
 	if (!tun)
 		return -EBADFD;
-	ret = tun_do_read(tun, tfile, to, file->f_flags & O_NONBLOCK);
+	ret = tun_do_read(tun, tfile, to, file->f_flags & O_NONBLOCK, NULL);
 	ret = min_t(ssize_t, ret, len);
 	if (ret > 0)
 		iocb->ki_pos = ret;
@@ -1585,17 +1654,51 @@ static void tun_sock_write_space(struct sock *sk)
 	kill_fasync(&tfile->fasync, SIGIO, POLL_OUT);
 }
 
+/* Send a batch of packets under a single device reference, and let the
+ * stack process them in one go after the last. */
+static int tun_sendmsg_batch(struct tun_struct *tun, struct tun_file *tfile,
+			     struct iov_iter *from, int n, int noblock)
+{
+	ssize_t len;
+	int i, total = 0;
+
+	for (i = 0; i < n; i++) {
+		len = tun_get_user(tun, tfile, NULL, &from[i], noblock, true);
+		/* A bad packet is dropped and counted, it does not stop
+		 * the rest of the batch. */
+		if (len > 0)
+			total += len;
+	}
+
+	/* Run the NET_RX softirq raised by netif_rx() */
+	local_bh_disable();
+	local_bh_enable();
+
+	return total;
+}
+
 static int tun_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 {
 	int ret;
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = __tun_get(tfile);
+	struct tun_msg_ctl *ctl = m->msg_control;
+	int noblock = m->msg_flags & MSG_DONTWAIT;
 
 	if (!tun)
 		return -EBADFD;
 
-	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
-			   m->msg_flags & MSG_DONTWAIT);
+	if (ctl && ctl->type == TUN_MSG_PTR)
+		ret = tun_sendmsg_batch(tun, tfile, ctl->ptr, ctl->num,
+					noblock);
+	else if (ctl && ctl->type == TUN_MSG_UBUF)
+		ret = tun_get_user(tun, tfile, ctl->ptr, &m->msg_iter,
+				   noblock, false);
+	else if (ctl)
+		ret = -EINVAL;
+	else
+		ret = tun_get_user(tun, tfile, NULL, &m->msg_iter, noblock,
+				   false);
 	tun_put(tun);
 	return ret;
 }
@@ -1605,27 +1708,39 @@ static int tun_recvmsg(struct socket *sock, struct msghdr *m, size_t total_len,
 {
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = __tun_get(tfile);
+	struct tun_msg_ctl *ctl = m->msg_control;
+	struct sk_buff *skb = NULL;
 	int ret;
 
-	if (!tun)
-		return -EBADFD;
+	if (ctl && ctl->type == TUN_MSG_PTR)
+		skb = ctl->ptr;
 
-	if (flags & ~(MSG_DONTWAIT|MSG_TRUNC|MSG_ERRQUEUE)) {
+	if (!tun) {
+		ret = -EBADFD;
+		goto out_free;
+	}
+
+	if (flags & ~(MSG_DONTWAIT|MSG_TRUNC|MSG_ERRQUEUE) ||
+	    (ctl && ctl->type != TUN_MSG_PTR)) {
 		ret = -EINVAL;
-		goto out;
+		goto out_put;
 	}
 	if (flags & MSG_ERRQUEUE) {
 		ret = sock_recv_errqueue(sock->sk, m, total_len,
 					 SOL_PACKET, TUN_TX_TIMESTAMP);
-		goto out;
+		goto out_put;
 	}
-	ret = tun_do_read(tun, tfile, &m->msg_iter, flags & MSG_DONTWAIT);
+	ret = tun_do_read(tun, tfile, &m->msg_iter, flags & MSG_DONTWAIT, skb);
+	skb = NULL;
 	if (ret > (ssize_t)total_len) {
 		m->msg_flags |= MSG_TRUNC;
 		ret = flags & MSG_TRUNC ? ret : total_len;
 	}
-out:
+out_put:
 	tun_put(tun);
+out_free:
+	if (skb)
+		kfree_skb(skb);
 	return ret;
 }
 
@@ -2313,6 +2428,11 @@ static int tun_chr_open(struct inode *inode, struct file * file)
 					    &tun_proto, 0);
 	if (!tfile)
 		return -ENOMEM;
+	/* Resized to the device's tx_queue_len on attach */
+	if (skb_array_init(&tfile->tx_array, TUN_READQ_SIZE, GFP_KERNEL)) {
+		sk_free(&tfile->sk);
+		return -ENOMEM;
+	}
 	RCU_INIT_POINTER(tfile->tun, NULL);
 	tfile->flags = 0;
 	tfile->ifindex = 0;
@@ -2500,6 +2620,22 @@ struct socket *tun_get_socket(struct file *file)
 }
 EXPORT_SYMBOL_GPL(tun_get_socket);
 
+/* Get the queue a tun file's reader consumes from, so that the caller can
+ * take packets off it in batches and hand them to recvmsg through
+ * TUN_MSG_PTR. The same lifetime rules as for tun_get_socket apply. */
+struct skb_array *tun_get_skb_array(struct file *file)
+{
+	struct tun_file *tfile;
+
+	if (file->f_op != &tun_fops)
+		return ERR_PTR(-EINVAL);
+	tfile = file->private_data;
+	if (!tfile)
+		return ERR_PTR(-EBADFD);
+	return &tfile->tx_array;
+}
+EXPORT_SYMBOL_GPL(tun_get_skb_array);
+
 module_init(tun_init);
 module_exit(tun_cleanup);
 MODULE_DESCRIPTION(DRV_DESCRIPTION);
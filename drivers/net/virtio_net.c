@@ -36,6 +36,10 @@ static bool csum = true, gso = true;
 module_param(csum, bool, 0444);
 module_param(gso, bool, 0444);
 
+/* Refill the RX ring once this many slots are free, 0 for half the ring */
+static unsigned int rx_refill_batch;
+module_param(rx_refill_batch, uint, 0644);
+
 /* FIXME: MTU in config. */
 #define GOOD_PACKET_LEN (ETH_HLEN + VLAN_HLEN + ETH_DATA_LEN)
 #define GOOD_COPY_LEN	128
@@ -50,6 +54,9 @@ DECLARE_EWMA(pkt_len, 1, 64)
 /* Minimum alignment for mergeable packet buffers. */
 #define MERGEABLE_BUFFER_ALIGN max(L1_CACHE_BYTES, 256)
 
+/* Fully carved frag pages each receive queue waits on for reuse */
+#define VIRTNET_RECYCLE_PAGES 16
+
 #define VIRTNET_DRIVER_VERSION "1.0.0"
 
 struct virtnet_stats {
@@ -90,6 +97,12 @@ struct receive_queue {
 	/* Page frag for packet buffer allocation. */
 	struct page_frag alloc_frag;
 
+	/* Carved-up frag pages still referenced by buffers or skbs, oldest
+	 * first.  Reused for refill once the stack has dropped them. */
+	struct page *recycle[VIRTNET_RECYCLE_PAGES];
+	unsigned int recycle_head;
+	unsigned int recycle_count;
+
 	/* RX: fragments + linear part + virtio header */
 	struct scatterlist sg[MAX_SKB_FRAGS + 2];
 
@@ -618,6 +631,72 @@ static unsigned int get_mergeable_buf_len(struct ewma_pkt_len *avg_pkt_len)
 	return ALIGN(len, MERGEABLE_BUFFER_ALIGN);
 }
 
+static void virtnet_recycle_park(struct receive_queue *rq, struct page *page)
+{
+	unsigned int i;
+
+	if (rq->recycle_count == VIRTNET_RECYCLE_PAGES) {
+		/* The oldest page is held for too long, let it go */
+		put_page(rq->recycle[rq->recycle_head]);
+		rq->recycle_head = (rq->recycle_head + 1) %
+				   VIRTNET_RECYCLE_PAGES;
+		rq->recycle_count--;
+	}
+
+	i = (rq->recycle_head + rq->recycle_count) % VIRTNET_RECYCLE_PAGES;
+	rq->recycle[i] = page;
+	rq->recycle_count++;
+}
+
+static struct page *virtnet_recycle_take(struct receive_queue *rq)
+{
+	struct page *page;
+
+	if (!rq->recycle_count)
+		return NULL;
+
+	/* Only ours once every buffer carved from it has been freed */
+	page = rq->recycle[rq->recycle_head];
+	if (page_ref_count(page) != 1)
+		return NULL;
+
+	rq->recycle_head = (rq->recycle_head + 1) % VIRTNET_RECYCLE_PAGES;
+	rq->recycle_count--;
+	return page;
+}
+
+/*
+ * Like skb_page_frag_refill(), but instead of dropping a page whose
+ * buffers are still in flight, park it and reuse it once they are freed.
+ */
+static bool virtnet_frag_refill(struct receive_queue *rq, unsigned int len,
+				gfp_t gfp)
+{
+	struct page_frag *alloc_frag = &rq->alloc_frag;
+	struct page *page;
+
+	if (alloc_frag->page) {
+		if (page_ref_count(alloc_frag->page) == 1) {
+			alloc_frag->offset = 0;
+			return true;
+		}
+		if (alloc_frag->offset + len <= alloc_frag->size)
+			return true;
+		virtnet_recycle_park(rq, alloc_frag->page);
+		alloc_frag->page = NULL;
+	}
+
+	page = virtnet_recycle_take(rq);
+	if (page) {
+		alloc_frag->page = page;
+		alloc_frag->size = PAGE_SIZE << compound_order(page);
+		alloc_frag->offset = 0;
+		return true;
+	}
+
+	return skb_page_frag_refill(len, alloc_frag, gfp);
+}
+
 static int add_recvbuf_mergeable(struct receive_queue *rq, gfp_t gfp)
 {
 	struct page_frag *alloc_frag = &rq->alloc_frag;
@@ -627,7 +706,7 @@ static int add_recvbuf_mergeable(struct receive_queue *rq, gfp_t gfp)
 	unsigned int len, hole;
 
 	len = get_mergeable_buf_len(&rq->mrg_avg_pkt_len);
-	if (unlikely(!skb_page_frag_refill(len, alloc_frag, gfp)))
+	if (unlikely(!virtnet_frag_refill(rq, len, gfp)))
 		return -ENOMEM;
 
 	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
@@ -733,6 +812,16 @@ static void refill_work(struct work_struct *work)
 	}
 }
 
+static unsigned int virtnet_refill_threshold(struct receive_queue *rq)
+{
+	unsigned int size = virtqueue_get_vring_size(rq->vq);
+	unsigned int batch = READ_ONCE(rx_refill_batch);
+
+	if (!batch)
+		return size / 2;
+	return min(batch, size) - 1;
+}
+
 static int virtnet_receive(struct receive_queue *rq, int budget)
 {
 	struct virtnet_info *vi = rq->vq->vdev->priv;
@@ -745,7 +834,7 @@ static int virtnet_receive(struct receive_queue *rq, int budget)
 		received++;
 	}
 
-	if (rq->vq->num_free > virtqueue_get_vring_size(rq->vq) / 2) {
+	if (rq->vq->num_free > virtnet_refill_threshold(rq)) {
 		if (!try_fill_recv(vi, rq, GFP_ATOMIC))
 			schedule_delayed_work(&vi->refill, 0);
 	}
@@ -1540,9 +1629,18 @@ static void free_receive_bufs(struct virtnet_info *vi)
 static void free_receive_page_frags(struct virtnet_info *vi)
 {
 	int i;
-	for (i = 0; i < vi->max_queue_pairs; i++)
-		if (vi->rq[i].alloc_frag.page)
-			put_page(vi->rq[i].alloc_frag.page);
+	for (i = 0; i < vi->max_queue_pairs; i++) {
+		struct receive_queue *rq = &vi->rq[i];
+
+		if (rq->alloc_frag.page)
+			put_page(rq->alloc_frag.page);
+		while (rq->recycle_count) {
+			put_page(rq->recycle[rq->recycle_head]);
+			rq->recycle_head = (rq->recycle_head + 1) %
+					   VIRTNET_RECYCLE_PAGES;
+			rq->recycle_count--;
+		}
+	}
 }
 
 static void free_unused_bufs(struct virtnet_info *vi)
@@ -550,6 +550,21 @@ static struct vxlanhdr *vxlan_gro_remcsum(struct sk_buff *skb,
 	return vh;
 }
 
+/* Inner protocol announced by a VXLAN-GPE header, 0 if not supported */
+static __be16 vxlan_gpe_proto(u8 next_protocol)
+{
+	switch (next_protocol) {
+	case VXLAN_GPE_NP_IPV4:
+		return htons(ETH_P_IP);
+	case VXLAN_GPE_NP_IPV6:
+		return htons(ETH_P_IPV6);
+	case VXLAN_GPE_NP_ETHERNET:
+		return htons(ETH_P_TEB);
+	default:
+		return 0;
+	}
+}
+
 static struct sk_buff **vxlan_gro_receive(struct sock *sk,
 					  struct sk_buff **head,
 					  struct sk_buff *skb)
@@ -559,6 +574,8 @@ static struct sk_buff **vxlan_gro_receive(struct sock *sk,
 	unsigned int hlen, off_vx;
 	int flush = 1;
 	struct vxlan_sock *vs = rcu_dereference_sk_user_data(sk);
+	const struct packet_offload *ptype = NULL;
+	__be16 type = htons(ETH_P_TEB);
 	__be32 flags;
 	struct gro_remcsum grc;
 
@@ -577,6 +594,17 @@ static struct sk_buff **vxlan_gro_receive(struct sock *sk,
 
 	flags = vh->vx_flags;
 
+	if (vs->flags & VXLAN_F_GPE) {
+		const struct vxlanhdr_gpe *gpe = (struct vxlanhdr_gpe *)vh;
+
+		/* Leave what vxlan_parse_gpe_hdr() drops to the slow path */
+		if (!gpe->np_applied || gpe->version != 0 || gpe->oam_flag)
+			goto out;
+		type = vxlan_gpe_proto(gpe->next_protocol);
+		if (!type)
+			goto out;
+	}
+
 	if ((flags & VXLAN_HF_RCO) && (vs->flags & VXLAN_F_REMCSUM_RX)) {
 		vh = vxlan_gro_remcsum(skb, off_vx, vh, sizeof(struct vxlanhdr),
 				       vh->vx_vni, &grc,
@@ -587,6 +615,13 @@ static struct sk_buff **vxlan_gro_receive(struct sock *sk,
 			goto out;
 	}
 
+	rcu_read_lock();
+	if (type != htons(ETH_P_TEB)) {
+		ptype = gro_find_receive_by_type(type);
+		if (!ptype)
+			goto out_unlock;
+	}
+
 	skb_gro_pull(skb, sizeof(struct vxlanhdr)); /* pull vxlan header */
 
 	for (p = *head; p; p = p->next) {
@@ -601,9 +636,14 @@ static struct sk_buff **vxlan_gro_receive(struct sock *sk,
 		}
 	}
 
-	pp = eth_gro_receive(head, skb);
+	if (ptype)
+		pp = ptype->callbacks.gro_receive(head, skb);
+	else
+		pp = eth_gro_receive(head, skb);
 	flush = 0;
 
+out_unlock:
+	rcu_read_unlock();
 out:
 	skb_gro_remcsum_cleanup(skb, &grc);
 	NAPI_GRO_CB(skb)->flush |= flush;
@@ -613,10 +653,37 @@ out:
 
 static int vxlan_gro_complete(struct sock *sk, struct sk_buff *skb, int nhoff)
 {
+	struct vxlan_sock *vs = rcu_dereference_sk_user_data(sk);
+	struct packet_offload *ptype;
+	__be16 type = htons(ETH_P_TEB);
+	int err = -ENOSYS;
+
+	if (vs->flags & VXLAN_F_GPE) {
+		struct vxlanhdr_gpe *gpe;
+
+		gpe = (struct vxlanhdr_gpe *)(skb->data + nhoff);
+		type = vxlan_gpe_proto(gpe->next_protocol);
+	}
+
+	/* Lets the merged packet be segmented again if it is forwarded */
+	skb_set_inner_protocol(skb, type);
+
 	/* Sets 'skb->inner_mac_header' since we are always called with
 	 * 'skb->encapsulation' set.
 	 */
-	return eth_gro_complete(skb, nhoff + sizeof(struct vxlanhdr));
+	if (type == htons(ETH_P_TEB))
+		return eth_gro_complete(skb, nhoff + sizeof(struct vxlanhdr));
+
+	rcu_read_lock();
+	ptype = gro_find_complete_by_type(type);
+	if (ptype)
+		err = ptype->callbacks.gro_complete(skb, nhoff +
+						    sizeof(struct vxlanhdr));
+	rcu_read_unlock();
+
+	skb_set_inner_mac_header(skb, nhoff + sizeof(struct vxlanhdr));
+
+	return err;
 }
 
 /* Notify netdevs that UDP port started listening */
@@ -975,6 +1042,7 @@ static bool vxlan_snoop(struct net_device *dev,
 				    src_mac, &rdst->remote_ip.sa, &src_ip->sa);
 
 		rdst->remote_ip = *src_ip;
+		dst_cache_reset(&rdst->dst_cache);
 		f->updated = jiffies;
 		vxlan_fdb_notify(vxlan, f, rdst, RTM_NEWNEIGH);
 	} else {
@@ -1215,19 +1283,9 @@ static bool vxlan_parse_gpe_hdr(struct vxlanhdr *unparsed,
 	if (gpe->oam_flag)
 		return false;
 
-	switch (gpe->next_protocol) {
-	case VXLAN_GPE_NP_IPV4:
-		*protocol = htons(ETH_P_IP);
-		break;
-	case VXLAN_GPE_NP_IPV6:
-		*protocol = htons(ETH_P_IPV6);
-		break;
-	case VXLAN_GPE_NP_ETHERNET:
-		*protocol = htons(ETH_P_TEB);
-		break;
-	default:
+	*protocol = vxlan_gpe_proto(gpe->next_protocol);
+	if (!*protocol)
 		return false;
-	}
 
 	unparsed->vx_flags &= ~VXLAN_GPE_USED_BITS;
 	return true;
@@ -1847,7 +1905,8 @@ static struct rtable *vxlan_get_route(struct vxlan_dev *vxlan,
 	struct rtable *rt = NULL;
 	struct flowi4 fl4;
 
-	if (tos && !info)
+	/* A TOS inherited from the inner header may differ per packet */
+	if (!info && vxlan->cfg.tos == 1)
 		use_cache = false;
 	if (use_cache) {
 		rt = dst_cache_get_ip4(dst_cache, saddr);
@@ -1886,7 +1945,7 @@ static struct dst_entry *vxlan6_get_route(struct vxlan_dev *vxlan,
 	struct flowi6 fl6;
 	int err;
 
-	if (tos && !info)
+	if (!info && vxlan->cfg.tos == 1)
 		use_cache = false;
 	if (use_cache) {
 		ndst = dst_cache_get_ip6(dst_cache, saddr);
@@ -0,0 +1,114 @@
+/*
+ * NVMe over Fabrics common host code.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#ifndef _NVME_FABRICS_H
+#define _NVME_FABRICS_H 1
+
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/uuid.h>
+
+#define NVMF_MIN_QUEUE_SIZE	16
+#define NVMF_MAX_QUEUE_SIZE	1024
+#define NVMF_DEF_QUEUE_SIZE	128
+#define NVMF_DEF_RECONNECT_DELAY	10
+#define NVMF_DEF_KATO		15
+
+/* admin queue depth, matches what the target allows */
+#define NVMF_AQ_DEPTH		32
+
+/*
+ * A host as seen by the target.  One is generated at boot, others are
+ * created when a controller is added with an explicit hostnqn, so the Host
+ * NQN can persist over reboots.  A Host ID must never be used with two
+ * different Host NQNs, so each one gets its own generated ID.
+ */
+struct nvmf_host {
+	struct kref		ref;
+	struct list_head	list;
+	char			nqn[NVMF_NQN_SIZE];
+	uuid_be			id;
+};
+
+/* Options accepted when creating a controller through /dev/nvme-fabrics */
+enum {
+	NVMF_OPT_ERR		= 0,
+	NVMF_OPT_TRANSPORT	= 1 << 0,
+	NVMF_OPT_NQN		= 1 << 1,
+	NVMF_OPT_TRADDR		= 1 << 2,
+	NVMF_OPT_TRSVCID	= 1 << 3,
+	NVMF_OPT_QUEUE_SIZE	= 1 << 4,
+	NVMF_OPT_NR_IO_QUEUES	= 1 << 5,
+	NVMF_OPT_KATO		= 1 << 6,
+	NVMF_OPT_HOSTNQN	= 1 << 7,
+	NVMF_OPT_RECONNECT_DELAY = 1 << 8,
+};
+
+/**
+ * struct nvmf_ctrl_options - options a fabrics controller was created with
+ * @mask:		NVMF_OPT_* bits of the options that were given
+ * @transport:		name of the transport
+ * @subsysnqn:		NQN of the subsystem to connect to
+ * @traddr:		transport address of the controller
+ * @trsvcid:		transport service id, e.g. the port number
+ * @queue_size:		number of entries of each I/O queue
+ * @nr_io_queues:	number of I/O queues to connect
+ * @reconnect_delay:	seconds between two reconnect attempts
+ * @discovery_nqn:	@subsysnqn is the well-known discovery NQN
+ * @kato:		keep-alive timeout in seconds
+ * @host:		Host NQN and Host ID to connect with
+ */
+struct nvmf_ctrl_options {
+	unsigned		mask;
+	char			*transport;
+	char			*subsysnqn;
+	char			*traddr;
+	char			*trsvcid;
+	size_t			queue_size;
+	unsigned int		nr_io_queues;
+	unsigned int		reconnect_delay;
+	bool			discovery_nqn;
+	unsigned int		kato;
+	struct nvmf_host	*host;
+};
+
+/**
+ * struct nvmf_transport_ops - a fabrics transport driver
+ * @entry:		entry in the list of registered transports
+ * @name:		value of the "transport=" option selecting it
+ * @required_opts:	options that must be given on top of the common
+ *			NVMF_REQUIRED_OPTS
+ * @allowed_opts:	transport specific options that may be given
+ * @create_ctrl:	connect to the controller described by @opts
+ */
+struct nvmf_transport_ops {
+	struct list_head	entry;
+	const char		*name;
+	int			required_opts;
+	int			allowed_opts;
+	struct nvme_ctrl	*(*create_ctrl)(struct device *dev,
+					struct nvmf_ctrl_options *opts);
+};
+
+#define NVMF_REQUIRED_OPTS	(NVMF_OPT_TRANSPORT | NVMF_OPT_NQN)
+
+int nvmf_reg_read32(struct nvme_ctrl *ctrl, u32 off, u32 *val);
+int nvmf_reg_read64(struct nvme_ctrl *ctrl, u32 off, u64 *val);
+int nvmf_reg_write32(struct nvme_ctrl *ctrl, u32 off, u32 val);
+int nvmf_connect_admin_queue(struct nvme_ctrl *ctrl);
+int nvmf_connect_io_queue(struct nvme_ctrl *ctrl, u16 qid);
+void nvmf_register_transport(struct nvmf_transport_ops *ops);
+void nvmf_unregister_transport(struct nvmf_transport_ops *ops);
+void nvmf_free_options(struct nvmf_ctrl_options *opts);
+int nvmf_get_address(struct nvme_ctrl *ctrl, char *buf, int size);
+
+#endif /* _NVME_FABRICS_H */
@@ -0,0 +1,506 @@
+/*
+ * NVM Express native multipath support.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/genhd.h>
+#include <linux/hdreg.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include "nvme.h"
+
+/*
+ * Namespaces with the same ID that are reachable through several controllers
+ * of the same NVM subsystem are grouped under a struct nvme_ns_head, which
+ * owns a bio based request_queue and the "nvme-mpath%d" block device.  Bios
+ * submitted to it are not cloned, but handed as they are to the blk-mq queue
+ * of the path picked by the I/O policy.  When a request fails because of the
+ * path rather than the medium, its bios are taken back from the request and
+ * resubmitted through the head, which picks another path or holds them until
+ * a controller comes back from a reset or reconnect.
+ */
+
+static bool multipath = true;
+module_param(multipath, bool, 0444);
+MODULE_PARM_DESC(multipath,
+	"group paths to shared namespaces into one block device");
+
+static const char * const nvme_iopolicy_names[] = {
+	[NVME_IOPOLICY_RR]	= "round-robin",
+	[NVME_IOPOLICY_QD]	= "queue-depth",
+};
+
+static char *iopolicy = "round-robin";
+module_param(iopolicy, charp, 0644);
+MODULE_PARM_DESC(iopolicy,
+	"default I/O policy for new multipath devices: round-robin or queue-depth");
+
+static LIST_HEAD(nvme_ns_heads);
+static DEFINE_MUTEX(nvme_ns_heads_lock);
+static DEFINE_IDA(nvme_ns_head_ida);
+
+static int nvme_parse_iopolicy(const char *buf)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nvme_iopolicy_names); i++) {
+		if (sysfs_streq(buf, nvme_iopolicy_names[i]))
+			return i;
+	}
+	return -EINVAL;
+}
+
+static bool nvme_path_is_usable(struct nvme_ns *ns)
+{
+	return ns->ctrl->state == NVME_CTRL_LIVE &&
+		!test_bit(NVME_NS_REMOVING, &ns->flags) &&
+		!test_bit(NVME_NS_DEAD, &ns->flags);
+}
+
+static struct nvme_ns *nvme_round_robin_path(struct nvme_ns_head *head)
+{
+	struct nvme_ns *ns;
+	unsigned int nr_paths = 0, pick;
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (nvme_path_is_usable(ns))
+			nr_paths++;
+	}
+	if (!nr_paths)
+		return NULL;
+
+	pick = (unsigned int)atomic_inc_return(&head->rr_next) % nr_paths;
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (nvme_path_is_usable(ns) && pick-- == 0)
+			return ns;
+	}
+	return NULL;
+}
+
+static struct nvme_ns *nvme_queue_depth_path(struct nvme_ns_head *head)
+{
+	struct nvme_ns *ns, *found = NULL;
+	int depth, min_depth = INT_MAX;
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (!nvme_path_is_usable(ns))
+			continue;
+
+		depth = atomic_read(&ns->nr_active);
+		if (depth < min_depth) {
+			min_depth = depth;
+			found = ns;
+		}
+	}
+	return found;
+}
+
+/* Must be called under srcu_read_lock(&head->srcu) */
+static struct nvme_ns *nvme_find_path(struct nvme_ns_head *head)
+{
+	switch (READ_ONCE(head->iopolicy)) {
+	case NVME_IOPOLICY_QD:
+		return nvme_queue_depth_path(head);
+	default:
+		return nvme_round_robin_path(head);
+	}
+}
+
+/*
+ * A path that is resetting or reconnecting may come back, in which case bios
+ * are held rather than failed.
+ */
+static bool nvme_available_path(struct nvme_ns_head *head)
+{
+	struct nvme_ns *ns;
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (test_bit(NVME_NS_REMOVING, &ns->flags))
+			continue;
+
+		switch (ns->ctrl->state) {
+		case NVME_CTRL_LIVE:
+		case NVME_CTRL_RESETTING:
+		case NVME_CTRL_RECONNECTING:
+			return true;
+		default:
+			break;
+		}
+	}
+	return false;
+}
+
+static void nvme_ns_head_requeue(struct nvme_ns_head *head, struct bio *bio)
+{
+	spin_lock_irq(&head->requeue_lock);
+	bio_list_add(&head->requeue_list, bio);
+	spin_unlock_irq(&head->requeue_lock);
+}
+
+static blk_qc_t nvme_ns_head_make_request(struct request_queue *q,
+		struct bio *bio)
+{
+	struct nvme_ns_head *head = q->queuedata;
+	blk_qc_t ret = BLK_QC_T_NONE;
+	struct nvme_ns *ns;
+	int srcu_idx;
+
+	srcu_idx = srcu_read_lock(&head->srcu);
+	ns = nvme_find_path(head);
+	if (likely(ns) && likely(!blk_queue_enter(ns->queue, false))) {
+		/*
+		 * bi_bdev stays pointed at the multipath device, so the
+		 * request is accounted to it and we can tell later that its
+		 * bios may be moved to another path.
+		 */
+		ret = ns->queue->make_request_fn(ns->queue, bio);
+		blk_queue_exit(ns->queue);
+	} else if (nvme_available_path(head)) {
+		nvme_ns_head_requeue(head, bio);
+	} else {
+		bio_io_error(bio);
+	}
+	srcu_read_unlock(&head->srcu, srcu_idx);
+
+	return ret;
+}
+
+static void nvme_ns_head_requeue_work(struct work_struct *work)
+{
+	struct nvme_ns_head *head =
+		container_of(work, struct nvme_ns_head, requeue_work);
+	struct bio *bio, *next;
+
+	spin_lock_irq(&head->requeue_lock);
+	next = bio_list_get(&head->requeue_list);
+	spin_unlock_irq(&head->requeue_lock);
+
+	while ((bio = next) != NULL) {
+		next = bio->bi_next;
+		bio->bi_next = NULL;
+		generic_make_request(bio);
+	}
+}
+
+bool nvme_req_needs_failover(struct request *req)
+{
+	struct nvme_ns *ns = req->q->queuedata;
+
+	if (!ns || !ns->head || req->cmd_type != REQ_TYPE_FS || !req->bio)
+		return false;
+	if (req->rq_disk != ns->head->disk)
+		return false;
+
+	/* cancelled by the driver because the controller went away */
+	if (req->errors == NVME_SC_CANCELLED)
+		return true;
+
+	switch (req->errors & 0x7ff) {
+	case NVME_SC_ABORT_REQ:
+	case NVME_SC_ABORT_QUEUE:
+	case NVME_SC_NS_NOT_READY:
+		return true;
+	default:
+		return false;
+	}
+}
+EXPORT_SYMBOL_GPL(nvme_req_needs_failover);
+
+void nvme_failover_req(struct request *req)
+{
+	struct nvme_ns_head *head = ((struct nvme_ns *)req->q->queuedata)->head;
+	unsigned long flags;
+
+	spin_lock_irqsave(&head->requeue_lock, flags);
+	if (head->requeue_list.tail)
+		head->requeue_list.tail->bi_next = req->bio;
+	else
+		head->requeue_list.head = req->bio;
+	head->requeue_list.tail = req->biotail;
+	spin_unlock_irqrestore(&head->requeue_lock, flags);
+
+	/* the bios belong to the requeue list now, end the empty request */
+	req->bio = req->biotail = NULL;
+	req->__data_len = 0;
+	blk_mq_end_request(req, 0);
+
+	kblockd_schedule_work(&head->requeue_work);
+}
+EXPORT_SYMBOL_GPL(nvme_failover_req);
+
+static void nvme_free_ns_head(struct kref *ref)
+{
+	struct nvme_ns_head *head =
+		container_of(ref, struct nvme_ns_head, ref);
+
+	mutex_lock(&nvme_ns_heads_lock);
+	head->disk->private_data = NULL;
+	mutex_unlock(&nvme_ns_heads_lock);
+
+	put_disk(head->disk);
+	ida_simple_remove(&nvme_ns_head_ida, head->instance);
+	cleanup_srcu_struct(&head->srcu);
+	kfree(head);
+}
+
+static void nvme_put_ns_head(struct nvme_ns_head *head)
+{
+	kref_put(&head->ref, nvme_free_ns_head);
+}
+
+static int nvme_ns_head_open(struct block_device *bdev, fmode_t mode)
+{
+	struct nvme_ns_head *head;
+	int ret = -ENXIO;
+
+	mutex_lock(&nvme_ns_heads_lock);
+	head = bdev->bd_disk->private_data;
+	if (head && kref_get_unless_zero(&head->ref))
+		ret = 0;
+	mutex_unlock(&nvme_ns_heads_lock);
+
+	return ret;
+}
+
+static void nvme_ns_head_release(struct gendisk *disk, fmode_t mode)
+{
+	nvme_put_ns_head(disk->private_data);
+}
+
+static int nvme_ns_head_ioctl(struct block_device *bdev, fmode_t mode,
+		unsigned int cmd, unsigned long arg)
+{
+	struct nvme_ns_head *head = bdev->bd_disk->private_data;
+	struct nvme_ns *ns;
+	int srcu_idx, ret = -EWOULDBLOCK;
+
+	srcu_idx = srcu_read_lock(&head->srcu);
+	ns = nvme_find_path(head);
+	if (ns)
+		ret = nvme_ns_ioctl(ns, cmd, arg);
+	srcu_read_unlock(&head->srcu, srcu_idx);
+
+	return ret;
+}
+
+static const struct block_device_operations nvme_ns_head_ops = {
+	.owner		= THIS_MODULE,
+	.open		= nvme_ns_head_open,
+	.release	= nvme_ns_head_release,
+	.ioctl		= nvme_ns_head_ioctl,
+	.getgeo		= nvme_getgeo,
+};
+
+static ssize_t iopolicy_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_ns_head *head = dev_to_disk(dev)->private_data;
+
+	return sprintf(buf, "%s\n", nvme_iopolicy_names[head->iopolicy]);
+}
+
+static ssize_t iopolicy_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct nvme_ns_head *head = dev_to_disk(dev)->private_data;
+	int policy = nvme_parse_iopolicy(buf);
+
+	if (policy < 0)
+		return policy;
+	WRITE_ONCE(head->iopolicy, policy);
+	return count;
+}
+static DEVICE_ATTR(iopolicy, S_IRUGO | S_IWUSR, iopolicy_show,
+		iopolicy_store);
+
+static struct attribute *nvme_ns_head_attrs[] = {
+	&dev_attr_iopolicy.attr,
+	NULL,
+};
+
+static const struct attribute_group nvme_ns_head_attr_group = {
+	.attrs		= nvme_ns_head_attrs,
+};
+
+static struct nvme_ns_head *nvme_alloc_ns_head(struct nvme_ns *ns)
+{
+	struct nvme_ns_head *head;
+	struct request_queue *q;
+	int policy;
+
+	head = kzalloc(sizeof(*head), GFP_KERNEL);
+	if (!head)
+		return NULL;
+
+	INIT_LIST_HEAD(&head->list);
+	if (init_srcu_struct(&head->srcu))
+		goto out_free_head;
+	kref_init(&head->ref);
+	head->ns_id = ns->ns_id;
+	memcpy(head->subnqn, ns->ctrl->subnqn, sizeof(head->subnqn));
+	bio_list_init(&head->requeue_list);
+	spin_lock_init(&head->requeue_lock);
+	INIT_WORK(&head->requeue_work, nvme_ns_head_requeue_work);
+
+	policy = nvme_parse_iopolicy(iopolicy);
+	head->iopolicy = policy < 0 ? NVME_IOPOLICY_RR : policy;
+
+	head->instance = ida_simple_get(&nvme_ns_head_ida, 0, 0, GFP_KERNEL);
+	if (head->instance < 0)
+		goto out_cleanup_srcu;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, NUMA_NO_NODE);
+	if (!q)
+		goto out_release_instance;
+	q->queuedata = head;
+	blk_queue_make_request(q, nvme_ns_head_make_request);
+	blk_set_stacking_limits(&q->limits);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, q);
+	head->queue = q;
+
+	head->disk = alloc_disk(0);
+	if (!head->disk)
+		goto out_cleanup_queue;
+	head->disk->major = nvme_major;
+	head->disk->fops = &nvme_ns_head_ops;
+	head->disk->private_data = head;
+	head->disk->queue = q;
+	head->disk->flags = GENHD_FL_EXT_DEVT;
+	sprintf(head->disk->disk_name, "nvme-mpath%d", head->instance);
+	return head;
+
+ out_cleanup_queue:
+	blk_cleanup_queue(q);
+ out_release_instance:
+	ida_simple_remove(&nvme_ns_head_ida, head->instance);
+ out_cleanup_srcu:
+	cleanup_srcu_struct(&head->srcu);
+ out_free_head:
+	kfree(head);
+	return NULL;
+}
+
+static struct nvme_ns_head *nvme_find_ns_head(struct nvme_ns *ns)
+{
+	struct nvme_ns_head *head;
+
+	lockdep_assert_held(&nvme_ns_heads_lock);
+
+	list_for_each_entry(head, &nvme_ns_heads, entry) {
+		if (head->ns_id == ns->ns_id &&
+		    !strcmp(head->subnqn, ns->ctrl->subnqn) &&
+		    kref_get_unless_zero(&head->ref))
+			return head;
+	}
+	return NULL;
+}
+
+void nvme_mpath_update_disk(struct nvme_ns *ns)
+{
+	struct nvme_ns_head *head = ns->head;
+
+	if (!head)
+		return;
+
+	blk_stack_limits(&head->queue->limits, &ns->queue->limits, 0);
+	if (blk_queue_discard(ns->queue))
+		queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, head->queue);
+	blk_queue_write_cache(head->queue,
+		test_bit(QUEUE_FLAG_WC, &ns->queue->queue_flags),
+		test_bit(QUEUE_FLAG_FUA, &ns->queue->queue_flags));
+	set_capacity(head->disk, get_capacity(ns->disk));
+}
+
+/*
+ * Called once a namespace is fully set up.  Only plain LBA namespaces of
+ * controllers that report a subsystem NQN are grouped; the NQN is what tells
+ * us that two namespace IDs seen through different controllers are the same
+ * namespace.
+ */
+void nvme_mpath_add_ns(struct nvme_ns *ns)
+{
+	struct nvme_ns_head *head;
+	bool new_head = false;
+
+	if (!multipath || !ns->ctrl->subnqn[0] || ns->ms ||
+	    ns->type != NVME_NS_LBA)
+		return;
+
+	mutex_lock(&nvme_ns_heads_lock);
+	head = nvme_find_ns_head(ns);
+	if (!head) {
+		head = nvme_alloc_ns_head(ns);
+		if (!head) {
+			mutex_unlock(&nvme_ns_heads_lock);
+			dev_warn(ns->ctrl->device,
+				"failed to allocate multipath node for nsid %u\n",
+				ns->ns_id);
+			return;
+		}
+		list_add_tail(&head->entry, &nvme_ns_heads);
+		new_head = true;
+	}
+
+	ns->head = head;
+	list_add_tail_rcu(&ns->siblings, &head->list);
+	nvme_mpath_update_disk(ns);
+	mutex_unlock(&nvme_ns_heads_lock);
+
+	/* adding the disk scans partitions, which opens it */
+	if (new_head) {
+		add_disk(head->disk);
+		if (sysfs_create_group(&disk_to_dev(head->disk)->kobj,
+					&nvme_ns_head_attr_group))
+			pr_warn("%s: failed to create sysfs group\n",
+				head->disk->disk_name);
+	}
+
+	/* bios may be waiting for a path to come (back) */
+	kblockd_schedule_work(&head->requeue_work);
+}
+
+/*
+ * Called after the path's request_queue has been drained, so no request of
+ * it references the head any more.
+ */
+void nvme_mpath_remove_ns(struct nvme_ns *ns)
+{
+	struct nvme_ns_head *head = ns->head;
+	bool last_path;
+
+	if (!head)
+		return;
+
+	mutex_lock(&nvme_ns_heads_lock);
+	list_del_rcu(&ns->siblings);
+	last_path = list_empty(&head->list);
+	if (last_path)
+		list_del_init(&head->entry);
+	mutex_unlock(&nvme_ns_heads_lock);
+
+	synchronize_srcu(&head->srcu);
+	ns->head = NULL;
+
+	if (last_path) {
+		sysfs_remove_group(&disk_to_dev(head->disk)->kobj,
+				&nvme_ns_head_attr_group);
+		del_gendisk(head->disk);
+		blk_cleanup_queue(head->queue);
+	}
+
+	/* move held bios to the remaining paths, or fail them */
+	kblockd_schedule_work(&head->requeue_work);
+	flush_work(&head->requeue_work);
+
+	nvme_put_ns_head(head);
+}
@@ -18,6 +18,8 @@
 #include <linux/pci.h>
 #include <linux/kref.h>
 #include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/srcu.h>
 
 enum {
 	/*
@@ -71,10 +73,13 @@ enum nvme_ctrl_state {
 	NVME_CTRL_NEW,
 	NVME_CTRL_LIVE,
 	NVME_CTRL_RESETTING,
+	NVME_CTRL_RECONNECTING,
 	NVME_CTRL_DELETING,
 	NVME_CTRL_DEAD,
 };
 
+struct nvmf_ctrl_options;
+
 struct nvme_ctrl {
 	enum nvme_ctrl_state state;
 	spinlock_t lock;
@@ -94,6 +99,7 @@ struct nvme_ctrl {
 	char serial[20];
 	char model[40];
 	char firmware_rev[8];
+	char subnqn[NVMF_NQN_FIELD_LEN];
 	u16 cntlid;
 
 	u32 ctrl_config;
@@ -103,6 +109,7 @@ struct nvme_ctrl {
 	u32 stripe_size;
 	u16 oncs;
 	u16 vid;
+	u32 sgls;
 	atomic_t abort_limit;
 	u8 event_limit;
 	u8 vwc;
@@ -111,6 +118,44 @@ struct nvme_ctrl {
 	unsigned long quirks;
 	struct work_struct scan_work;
 	struct work_struct async_event_work;
+	struct delayed_work ka_work;
+
+	/* Fabrics only */
+	struct request_queue *connect_q;
+	u16 sqsize;
+	u32 ioccsz;
+	u32 iorcsz;
+	u16 icdoff;
+	u16 maxcmd;
+	u16 kas;
+	u32 kato;
+	struct nvmf_ctrl_options *opts;
+};
+
+/*
+ * The paths to a namespace shared by several controllers of one NVM
+ * subsystem, exposed as a single block device.
+ */
+struct nvme_ns_head {
+	struct list_head	list;		/* paths, under srcu */
+	struct srcu_struct	srcu;
+	struct list_head	entry;
+	struct kref		ref;
+	unsigned		ns_id;
+	char			subnqn[NVMF_NQN_FIELD_LEN];
+	int			instance;
+	struct request_queue	*queue;
+	struct gendisk		*disk;
+	int			iopolicy;
+	atomic_t		rr_next;
+	struct bio_list		requeue_list;
+	spinlock_t		requeue_lock;
+	struct work_struct	requeue_work;
+};
+
+enum {
+	NVME_IOPOLICY_RR	= 0,	/* round-robin */
+	NVME_IOPOLICY_QD	= 1,	/* fewest outstanding requests */
 };
 
 /*
@@ -136,6 +181,10 @@ struct nvme_ns {
 	int type;
 	unsigned long flags;
 
+	struct nvme_ns_head *head;
+	struct list_head siblings;
+	atomic_t nr_active;
+
 #define NVME_NS_REMOVING 0
 #define NVME_NS_DEAD     1
 
@@ -144,7 +193,10 @@ struct nvme_ns {
 };
 
 struct nvme_ctrl_ops {
+	const char *name;
 	struct module *module;
+	unsigned int flags;
+#define NVME_F_FABRICS			(1 << 0)
 	int (*reg_read32)(struct nvme_ctrl *ctrl, u32 off, u32 *val);
 	int (*reg_write32)(struct nvme_ctrl *ctrl, u32 off, u32 val);
 	int (*reg_read64)(struct nvme_ctrl *ctrl, u32 off, u64 *val);
@@ -152,6 +204,8 @@ struct nvme_ctrl_ops {
 	void (*free_ctrl)(struct nvme_ctrl *ctrl);
 	void (*post_scan)(struct nvme_ctrl *ctrl);
 	void (*submit_async_event)(struct nvme_ctrl *ctrl, int aer_idx);
+	int (*delete_ctrl)(struct nvme_ctrl *ctrl);
+	int (*get_address)(struct nvme_ctrl *ctrl, char *buf, int size);
 };
 
 static inline bool nvme_ctrl_ready(struct nvme_ctrl *ctrl)
@@ -187,6 +241,12 @@ static inline void nvme_cleanup_cmd(struct request *req)
 {
 	if (req->cmd_flags & REQ_DISCARD)
 		kfree(req->completion_data);
+	if (req->cmd_type == REQ_TYPE_FS) {
+		struct nvme_ns *ns = req->q->queuedata;
+
+		if (ns->head)
+			atomic_dec(&ns->nr_active);
+	}
 }
 
 static inline int nvme_error_status(u16 status)
@@ -230,8 +290,9 @@ void nvme_stop_queues(struct nvme_ctrl *ctrl);
 void nvme_start_queues(struct nvme_ctrl *ctrl);
 void nvme_kill_queues(struct nvme_ctrl *ctrl);
 
+#define NVME_QID_ANY -1
 struct request *nvme_alloc_request(struct request_queue *q,
-		struct nvme_command *cmd, unsigned int flags);
+		struct nvme_command *cmd, unsigned int flags, int qid);
 void nvme_requeue_req(struct request *req);
 int nvme_setup_cmd(struct nvme_ns *ns, struct request *req,
 		struct nvme_command *cmd);
@@ -239,7 +300,7 @@ int nvme_submit_sync_cmd(struct request_queue *q, struct nvme_command *cmd,
 		void *buf, unsigned bufflen);
 int __nvme_submit_sync_cmd(struct request_queue *q, struct nvme_command *cmd,
 		struct nvme_completion *cqe, void *buffer, unsigned bufflen,
-		unsigned timeout);
+		unsigned timeout, int qid, int at_head, int flags);
 int nvme_submit_user_cmd(struct request_queue *q, struct nvme_command *cmd,
 		void __user *ubuffer, unsigned bufflen, u32 *result,
 		unsigned timeout);
@@ -257,6 +318,15 @@ int nvme_set_features(struct nvme_ctrl *dev, unsigned fid, unsigned dword11,
 			dma_addr_t dma_addr, u32 *result);
 int nvme_set_queue_count(struct nvme_ctrl *ctrl, int *count);
 
+void nvme_start_keep_alive(struct nvme_ctrl *ctrl);
+void nvme_stop_keep_alive(struct nvme_ctrl *ctrl);
+
+struct hd_geometry;
+
+extern int nvme_major;
+int nvme_ns_ioctl(struct nvme_ns *ns, unsigned int cmd, unsigned long arg);
+int nvme_getgeo(struct block_device *bdev, struct hd_geometry *geo);
+
 struct sg_io_hdr;
 
 int nvme_sg_io(struct nvme_ns *ns, struct sg_io_hdr __user *u_hdr);
@@ -281,6 +351,34 @@ static inline int nvme_nvm_ns_supported(struct nvme_ns *ns, struct nvme_id_ns *i
 }
 #endif /* CONFIG_NVM */
 
+#ifdef CONFIG_NVME_MULTIPATH
+void nvme_mpath_add_ns(struct nvme_ns *ns);
+void nvme_mpath_remove_ns(struct nvme_ns *ns);
+void nvme_mpath_update_disk(struct nvme_ns *ns);
+bool nvme_req_needs_failover(struct request *req);
+void nvme_failover_req(struct request *req);
+
+static inline void nvme_mpath_kick_requeue(struct nvme_ns *ns)
+{
+	if (ns->head)
+		kblockd_schedule_work(&ns->head->requeue_work);
+}
+#else
+static inline void nvme_mpath_add_ns(struct nvme_ns *ns) {}
+static inline void nvme_mpath_remove_ns(struct nvme_ns *ns) {}
+static inline void nvme_mpath_update_disk(struct nvme_ns *ns) {}
+static inline void nvme_mpath_kick_requeue(struct nvme_ns *ns) {}
+
+static inline bool nvme_req_needs_failover(struct request *req)
+{
+	return false;
+}
+
+static inline void nvme_failover_req(struct request *req)
+{
+}
+#endif /* CONFIG_NVME_MULTIPATH */
+
 int __init nvme_core_init(void);
 void nvme_core_exit(void);
 
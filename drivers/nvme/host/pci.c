@@ -16,6 +16,7 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/blk-mq.h>
+#include <linux/blk-mq-pci.h>
 #include <linux/cpu.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
@@ -36,6 +37,7 @@
 #include <linux/poison.h>
 #include <linux/ptrace.h>
 #include <linux/sched.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/t10-pi.h>
 #include <linux/timer.h>
@@ -63,6 +65,11 @@ static bool use_cmb_sqes = true;
 module_param(use_cmb_sqes, bool, 0644);
 MODULE_PARM_DESC(use_cmb_sqes, "use controller's memory buffer for I/O SQes");
 
+static unsigned int sgl_threshold = SZ_32K;
+module_param(sgl_threshold, uint, 0644);
+MODULE_PARM_DESC(sgl_threshold,
+		"use SGLs when the average request segment size is at least this large, 0 disables SGLs");
+
 static struct workqueue_struct *nvme_workq;
 
 struct nvme_dev;
@@ -142,6 +149,7 @@ struct nvme_queue {
 struct nvme_iod {
 	struct nvme_queue *nvmeq;
 	int aborted;
+	bool use_sgl;		/* data described by SGLs, not PRPs */
 	int npages;		/* In the PRP list. 0 means small pool in use */
 	int nents;		/* Used in scatterlist */
 	int length;		/* Of data, in bytes */
@@ -188,11 +196,24 @@ static int nvme_npages(unsigned size, struct nvme_dev *dev)
 	return DIV_ROUND_UP(8 * nprps, PAGE_SIZE - 8);
 }
 
+#define SGES_PER_PAGE	(PAGE_SIZE / sizeof(struct nvme_sgl_desc))
+
+/*
+ * SGL segments take one descriptor per data segment, and one to chain to
+ * the next segment.
+ */
+static int nvme_npages_sgl(unsigned int nseg)
+{
+	return DIV_ROUND_UP(nseg * sizeof(struct nvme_sgl_desc),
+			    PAGE_SIZE - sizeof(struct nvme_sgl_desc));
+}
+
 static unsigned int nvme_iod_alloc_size(struct nvme_dev *dev,
 		unsigned int size, unsigned int nseg)
 {
-	return sizeof(__le64 *) * nvme_npages(size, dev) +
-			sizeof(struct scatterlist) * nseg;
+	int npages = max(nvme_npages(size, dev), nvme_npages_sgl(nseg));
+
+	return sizeof(__le64 *) * npages + sizeof(struct scatterlist) * nseg;
 }
 
 static unsigned int nvme_cmd_size(struct nvme_dev *dev)
@@ -307,6 +328,7 @@ static int nvme_init_iod(struct request *rq, unsigned size,
 	}
 
 	iod->aborted = 0;
+	iod->use_sgl = false;
 	iod->npages = -1;
 	iod->nents = 0;
 	iod->length = size;
@@ -321,15 +343,24 @@ static void nvme_free_iod(struct nvme_dev *dev, struct request *req)
 	__le64 **list = iod_list(req);
 	dma_addr_t prp_dma = iod->first_dma;
 
-	nvme_cleanup_cmd(req);
-
 	if (iod->npages == 0)
 		dma_pool_free(dev->prp_small_pool, list[0], prp_dma);
 	for (i = 0; i < iod->npages; i++) {
-		__le64 *prp_list = list[i];
-		dma_addr_t next_prp_dma = le64_to_cpu(prp_list[last_prp]);
-		dma_pool_free(dev->prp_page_pool, prp_list, prp_dma);
-		prp_dma = next_prp_dma;
+		void *addr = list[i];
+		dma_addr_t next_dma;
+
+		if (iod->use_sgl) {
+			struct nvme_sgl_desc *sg_list = addr;
+
+			next_dma = le64_to_cpu(sg_list[SGES_PER_PAGE - 1].addr);
+		} else {
+			__le64 *prp_list = addr;
+
+			next_dma = le64_to_cpu(prp_list[last_prp]);
+		}
+
+		dma_pool_free(dev->prp_page_pool, addr, prp_dma);
+		prp_dma = next_dma;
 	}
 
 	if (iod->sg != iod->inline_sg)
@@ -483,6 +514,116 @@ static bool nvme_setup_prps(struct nvme_dev *dev, struct request *req,
 	return true;
 }
 
+static void nvme_sgl_set_data(struct nvme_sgl_desc *sge,
+		struct scatterlist *sg)
+{
+	sge->addr = cpu_to_le64(sg_dma_address(sg));
+	sge->length = cpu_to_le32(sg_dma_len(sg));
+	sge->type = NVME_SGL_FMT_DATA_DESC << 4;
+}
+
+/*
+ * Point @sge at a segment holding @entries descriptors, of which only a
+ * page worth fits if there are more.
+ */
+static void nvme_sgl_set_seg(struct nvme_sgl_desc *sge, dma_addr_t dma_addr,
+		int entries)
+{
+	sge->addr = cpu_to_le64(dma_addr);
+	if (entries <= SGES_PER_PAGE) {
+		sge->length = cpu_to_le32(entries * sizeof(*sge));
+		sge->type = NVME_SGL_FMT_LAST_SEG_DESC << 4;
+	} else {
+		sge->length = cpu_to_le32(PAGE_SIZE);
+		sge->type = NVME_SGL_FMT_SEG_DESC << 4;
+	}
+}
+
+/*
+ * Describe the data with one SGL data descriptor per DMA segment. Unlike
+ * PRPs, this doesn't take an entry per controller page, so large
+ * scattered transfers need much smaller lists, or none at all when there
+ * is a single segment.
+ */
+static bool nvme_setup_sgls(struct nvme_dev *dev, struct request *req,
+		struct nvme_command *cmnd)
+{
+	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
+	struct nvme_sgl_desc *sg_list;
+	struct scatterlist *sg = iod->sg;
+	int entries = iod->nents, i = 0;
+	__le64 **list = iod_list(req);
+	struct dma_pool *pool;
+	dma_addr_t sgl_dma;
+
+	cmnd->rw.flags |= NVME_CMD_SGL_METABUF;
+
+	if (entries == 1) {
+		nvme_sgl_set_data(&cmnd->rw.sgl, sg);
+		return true;
+	}
+
+	if (entries <= (256 / sizeof(struct nvme_sgl_desc))) {
+		pool = dev->prp_small_pool;
+		iod->npages = 0;
+	} else {
+		pool = dev->prp_page_pool;
+		iod->npages = 1;
+	}
+
+	sg_list = dma_pool_alloc(pool, GFP_ATOMIC, &sgl_dma);
+	if (!sg_list) {
+		iod->npages = -1;
+		return false;
+	}
+
+	list[0] = (__le64 *)sg_list;
+	iod->first_dma = sgl_dma;
+	nvme_sgl_set_seg(&cmnd->rw.sgl, sgl_dma, entries);
+
+	do {
+		if (i == SGES_PER_PAGE) {
+			struct nvme_sgl_desc *link = &sg_list[i - 1];
+			struct nvme_sgl_desc *old_sg_list = sg_list;
+
+			sg_list = dma_pool_alloc(pool, GFP_ATOMIC, &sgl_dma);
+			if (!sg_list)
+				return false;
+
+			/* the last slot now chains to the next segment */
+			list[iod->npages++] = (__le64 *)sg_list;
+			sg_list[0] = *link;
+			nvme_sgl_set_seg(&old_sg_list[i - 1], sgl_dma,
+					 entries + 1);
+			i = 1;
+		}
+
+		nvme_sgl_set_data(&sg_list[i++], sg);
+		sg = sg_next(sg);
+	} while (--entries > 0);
+
+	return true;
+}
+
+/*
+ * SGLs pay off for large segments, for small ones the PRP list is just as
+ * compact. The admin queue always uses PRPs.
+ */
+static bool nvme_use_sgls(struct nvme_dev *dev, struct request *req)
+{
+	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
+	unsigned int avg_seg_size;
+
+	if (!(dev->ctrl.sgls & ((1 << 0) | (1 << 1))))
+		return false;
+
+	if (!iod->nvmeq->qid || !sgl_threshold)
+		return false;
+
+	avg_seg_size = DIV_ROUND_UP(iod->length, iod->nents);
+	return avg_seg_size >= sgl_threshold;
+}
+
 static int nvme_map_data(struct nvme_dev *dev, struct request *req,
 		unsigned size, struct nvme_command *cmnd)
 {
@@ -501,7 +642,11 @@ static int nvme_map_data(struct nvme_dev *dev, struct request *req,
 	if (!dma_map_sg(dev->dev, iod->sg, iod->nents, dma_dir))
 		goto out;
 
-	if (!nvme_setup_prps(dev, req, size))
+	iod->use_sgl = nvme_use_sgls(dev, req);
+	if (iod->use_sgl) {
+		if (!nvme_setup_sgls(dev, req, cmnd))
+			goto out_unmap;
+	} else if (!nvme_setup_prps(dev, req, size))
 		goto out_unmap;
 
 	ret = BLK_MQ_RQ_QUEUE_ERROR;
@@ -520,8 +665,10 @@ static int nvme_map_data(struct nvme_dev *dev, struct request *req,
 			goto out_unmap;
 	}
 
-	cmnd->rw.prp1 = cpu_to_le64(sg_dma_address(iod->sg));
-	cmnd->rw.prp2 = cpu_to_le64(iod->first_dma);
+	if (!iod->use_sgl) {
+		cmnd->rw.prp1 = cpu_to_le64(sg_dma_address(iod->sg));
+		cmnd->rw.prp2 = cpu_to_le64(iod->first_dma);
+	}
 	if (blk_integrity_rq(req))
 		cmnd->rw.metadata = cpu_to_le64(sg_dma_address(&iod->meta_sg));
 	return BLK_MQ_RQ_QUEUE_OK;
@@ -547,6 +694,7 @@ static void nvme_unmap_data(struct nvme_dev *dev, struct request *req)
 		}
 	}
 
+	nvme_cleanup_cmd(req);
 	nvme_free_iod(dev, req);
 }
 
@@ -584,13 +732,13 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 
 	ret = nvme_setup_cmd(ns, req, &cmnd);
 	if (ret)
-		goto out;
+		goto out_free_iod;
 
 	if (req->nr_phys_segments)
 		ret = nvme_map_data(dev, req, map_len, &cmnd);
 
 	if (ret)
-		goto out;
+		goto out_cleanup_cmd;
 
 	cmnd.common.command_id = req->tag;
 	blk_mq_start_request(req);
@@ -602,13 +750,15 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 		else
 			ret = BLK_MQ_RQ_QUEUE_ERROR;
 		spin_unlock_irq(&nvmeq->q_lock);
-		goto out;
+		goto out_cleanup_cmd;
 	}
 	__nvme_submit_cmd(nvmeq, &cmnd);
 	nvme_process_cq(nvmeq);
 	spin_unlock_irq(&nvmeq->q_lock);
 	return BLK_MQ_RQ_QUEUE_OK;
-out:
+out_cleanup_cmd:
+	nvme_cleanup_cmd(req);
+out_free_iod:
 	nvme_free_iod(dev, req);
 	return ret;
 }
@@ -622,6 +772,11 @@ static void nvme_complete_rq(struct request *req)
 	nvme_unmap_data(dev, req);
 
 	if (unlikely(req->errors)) {
+		if (nvme_req_needs_failover(req)) {
+			nvme_failover_req(req);
+			return;
+		}
+
 		if (nvme_req_needs_retry(req, req->errors)) {
 			nvme_requeue_req(req);
 			return;
@@ -901,7 +1056,7 @@ static enum blk_eh_timer_return nvme_timeout(struct request *req, bool reserved)
 		 req->tag, nvmeq->qid);
 
 	abort_req = nvme_alloc_request(dev->ctrl.admin_q, &cmd,
-			BLK_MQ_REQ_NOWAIT);
+			BLK_MQ_REQ_NOWAIT, NVME_QID_ANY);
 	if (IS_ERR(abort_req)) {
 		atomic_inc(&dev->ctrl.abort_limit);
 		return BLK_EH_RESET_TIMER;
@@ -1138,6 +1293,14 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 	return result;
 }
 
+static int nvme_pci_map_queues(struct blk_mq_tag_set *set,
+			       unsigned int *mq_map)
+{
+	struct nvme_dev *dev = set->driver_data;
+
+	return blk_mq_pci_map_queues(set, to_pci_dev(dev->dev), mq_map);
+}
+
 static struct blk_mq_ops nvme_mq_admin_ops = {
 	.queue_rq	= nvme_queue_rq,
 	.complete	= nvme_complete_rq,
@@ -1156,6 +1319,7 @@ static struct blk_mq_ops nvme_mq_ops = {
 	.init_request	= nvme_init_request,
 	.timeout	= nvme_timeout,
 	.poll		= nvme_poll,
+	.map_queues	= nvme_pci_map_queues,
 };
 
 static void nvme_dev_remove_admin(struct nvme_dev *dev)
@@ -1441,22 +1605,20 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	 * If we enable msix early due to not intx, disable it again before
 	 * setting up the full range we need.
 	 */
-	if (pdev->msi_enabled)
-		pci_disable_msi(pdev);
-	else if (pdev->msix_enabled)
-		pci_disable_msix(pdev);
-
-	for (i = 0; i < nr_io_queues; i++)
-		dev->entry[i].entry = i;
-	vecs = pci_enable_msix_range(pdev, dev->entry, 1, nr_io_queues);
+	pci_free_irq_vectors(pdev);
+
+	/*
+	 * Let the interrupt core spread the vectors over the CPUs, the I/O
+	 * queues are mapped to the CPUs of their vector, see
+	 * nvme_pci_map_queues().
+	 */
+	vecs = pci_alloc_irq_vectors(pdev, 1, nr_io_queues,
+				     PCI_IRQ_ALL_TYPES | PCI_IRQ_AFFINITY);
 	if (vecs < 0) {
-		vecs = pci_enable_msi_range(pdev, 1, min(nr_io_queues, 32));
-		if (vecs < 0) {
-			vecs = 1;
-		} else {
-			for (i = 0; i < vecs; i++)
-				dev->entry[i].vector = i + pdev->irq;
-		}
+		vecs = 1;
+	} else {
+		for (i = 0; i < vecs; i++)
+			dev->entry[i].vector = pci_irq_vector(pdev, i);
 	}
 
 	/*
@@ -1480,23 +1642,6 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	return result;
 }
 
-static void nvme_pci_post_scan(struct nvme_ctrl *ctrl)
-{
-	struct nvme_dev *dev = to_nvme_dev(ctrl);
-	struct nvme_queue *nvmeq;
-	int i;
-
-	for (i = 0; i < dev->online_queues; i++) {
-		nvmeq = dev->queues[i];
-
-		if (!nvmeq->tags || !(*nvmeq->tags))
-			continue;
-
-		irq_set_affinity_hint(dev->entry[nvmeq->cq_vector].vector,
-					blk_mq_tags_cpumask(*nvmeq->tags));
-	}
-}
-
 static void nvme_del_queue_end(struct request *req, int error)
 {
 	struct nvme_queue *nvmeq = req->end_io_data;
@@ -1536,7 +1681,7 @@ static int nvme_delete_queue(struct nvme_queue *nvmeq, u8 opcode)
 	cmd.delete_queue.opcode = opcode;
 	cmd.delete_queue.qid = cpu_to_le16(nvmeq->qid);
 
-	req = nvme_alloc_request(q, &cmd, BLK_MQ_REQ_NOWAIT);
+	req = nvme_alloc_request(q, &cmd, BLK_MQ_REQ_NOWAIT, NVME_QID_ANY);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
 
@@ -1638,15 +1783,11 @@ static int nvme_pci_enable(struct nvme_dev *dev)
 	 * interrupts. Pre-enable a single MSIX or MSI vec for setup. We'll
 	 * adjust this later.
 	 */
-	if (pci_enable_msix(pdev, dev->entry, 1)) {
-		pci_enable_msi(pdev);
-		dev->entry[0].vector = pdev->irq;
-	}
-
-	if (!dev->entry[0].vector) {
+	if (pci_alloc_irq_vectors(pdev, 1, 1, PCI_IRQ_ALL_TYPES) < 0) {
 		result = -ENODEV;
 		goto disable;
 	}
+	dev->entry[0].vector = pci_irq_vector(pdev, 0);
 
 	cap = lo_hi_readq(dev->bar + NVME_REG_CAP);
 
@@ -1688,10 +1829,7 @@ static void nvme_pci_disable(struct nvme_dev *dev)
 {
 	struct pci_dev *pdev = to_pci_dev(dev->dev);
 
-	if (pdev->msi_enabled)
-		pci_disable_msi(pdev);
-	else if (pdev->msix_enabled)
-		pci_disable_msix(pdev);
+	pci_free_irq_vectors(pdev);
 
 	if (pci_is_enabled(pdev)) {
 		pci_disable_pcie_error_reporting(pdev);
@@ -1897,13 +2035,13 @@ static int nvme_pci_reset_ctrl(struct nvme_ctrl *ctrl)
 }
 
 static const struct nvme_ctrl_ops nvme_pci_ctrl_ops = {
+	.name			= "pcie",
 	.module			= THIS_MODULE,
 	.reg_read32		= nvme_pci_reg_read32,
 	.reg_write32		= nvme_pci_reg_write32,
 	.reg_read64		= nvme_pci_reg_read64,
 	.reset_ctrl		= nvme_pci_reset_ctrl,
 	.free_ctrl		= nvme_pci_free_ctrl,
-	.post_scan		= nvme_pci_post_scan,
 	.submit_async_event	= nvme_pci_submit_async_event,
 };
 
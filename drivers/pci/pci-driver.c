@@ -454,6 +454,28 @@ static int pci_device_remove(struct device *dev)
 	return 0;
 }
 
+/*
+ * With asynchronous probing, drivers relying on the functions of a card
+ * being probed in order still get function 0 first.  Virtual functions
+ * come after their physical function.
+ */
+static struct device *pci_device_probe_after(struct device *dev)
+{
+	struct pci_dev *pci_dev = to_pci_dev(dev);
+	struct pci_dev *first;
+
+	if (pci_dev->is_virtfn)
+		return get_device(&pci_physfn(pci_dev)->dev);
+
+	if (PCI_FUNC(pci_dev->devfn) == 0)
+		return NULL;
+
+	first = pci_get_slot(pci_dev->bus,
+			     PCI_DEVFN(PCI_SLOT(pci_dev->devfn), 0));
+
+	return first ? &first->dev : NULL;
+}
+
 static void pci_device_shutdown(struct device *dev)
 {
 	struct pci_dev *pci_dev = to_pci_dev(dev);
@@ -1433,10 +1455,12 @@ struct bus_type pci_bus_type = {
 	.probe		= pci_device_probe,
 	.remove		= pci_device_remove,
 	.shutdown	= pci_device_shutdown,
+	.probe_after	= pci_device_probe_after,
 	.dev_groups	= pci_dev_groups,
 	.bus_groups	= pci_bus_groups,
 	.drv_groups	= pci_drv_groups,
 	.pm		= PCI_PM_OPS_PTR,
+	.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
 };
 EXPORT_SYMBOL(pci_bus_type);
 
@@ -254,13 +254,71 @@ static int vaddr_get_pfn(unsigned long vaddr, int prot, unsigned long *pfn)
 	return ret;
 }
 
+/* Number of struct page pointers that fit in the pinning batch page */
+#define VFIO_PIN_BATCH	(PAGE_SIZE / sizeof(struct page *))
+
+/*
+ * Pin the pages following a first, already pinned, normal page in batches
+ * of up to VFIO_PIN_BATCH.  get_user_pages_fast() walks huge page mappings
+ * a PMD at a time, and the RLIMIT_MEMLOCK check is done once per batch
+ * rather than once per page.  Returns the number of pages pinned in total.
+ */
+static long vfio_pin_pages_batched(unsigned long vaddr, long npage, int prot,
+				   unsigned long pfn_base, struct page **batch,
+				   unsigned long limit, bool lock_cap)
+{
+	long i = 1;
+
+	for (vaddr += PAGE_SIZE; i < npage; ) {
+		long nr = min_t(long, npage - i, VFIO_PIN_BATCH);
+		long got, j, k;
+
+		if (!lock_cap) {
+			long avail = (long)limit -
+				     (long)current->mm->locked_vm - i;
+
+			if (avail <= 0) {
+				pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
+					__func__, limit << PAGE_SHIFT);
+				break;
+			}
+			nr = min(nr, avail);
+		}
+
+		got = get_user_pages_fast(vaddr, nr, !!(prot & IOMMU_WRITE),
+					  batch);
+		if (got <= 0)
+			break;
+
+		for (j = 0; j < got; j++) {
+			unsigned long pfn = page_to_pfn(batch[j]);
+
+			if (pfn != pfn_base + i + j ||
+			    is_invalid_reserved_pfn(pfn))
+				break;
+		}
+
+		/* Drop whatever lies beyond the contiguous run */
+		for (k = j; k < got; k++)
+			put_page(batch[k]);
+
+		i += j;
+		vaddr += j << PAGE_SHIFT;
+		if (j < nr)
+			break;
+	}
+
+	return i;
+}
+
 /*
  * Attempt to pin pages.  We really don't want to track all the pfns and
  * the iommu can only map chunks of consecutive pfns anyway, so get the
  * first page and all consecutive pages with the same locking.
  */
 static long vfio_pin_pages(unsigned long vaddr, long npage,
-			   int prot, unsigned long *pfn_base)
+			   int prot, unsigned long *pfn_base,
+			   struct page **batch)
 {
 	unsigned long limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
 	bool lock_cap = capable(CAP_IPC_LOCK);
@@ -289,7 +347,14 @@ static long vfio_pin_pages(unsigned long vaddr, long npage,
 		return 1;
 	}
 
-	/* Lock all the consecutive pages from pfn_base */
+	if (!rsvd) {
+		i = vfio_pin_pages_batched(vaddr, npage, prot, *pfn_base,
+					   batch, limit, lock_cap);
+		vfio_lock_acct(i);
+		return i;
+	}
+
+	/* Lock all the consecutive reserved pfns from pfn_base */
 	for (i = 1, vaddr += PAGE_SIZE; i < npage; i++, vaddr += PAGE_SIZE) {
 		unsigned long pfn = 0;
 
@@ -297,24 +362,12 @@ static long vfio_pin_pages(unsigned long vaddr, long npage,
 		if (ret)
 			break;
 
-		if (pfn != *pfn_base + i ||
-		    rsvd != is_invalid_reserved_pfn(pfn)) {
-			put_pfn(pfn, prot);
-			break;
-		}
-
-		if (!rsvd && !lock_cap &&
-		    current->mm->locked_vm + i + 1 > limit) {
+		if (pfn != *pfn_base + i || !is_invalid_reserved_pfn(pfn)) {
 			put_pfn(pfn, prot);
-			pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
-				__func__, limit << PAGE_SHIFT);
 			break;
 		}
 	}
 
-	if (!rsvd)
-		vfio_lock_acct(i);
-
 	return i;
 }
 
@@ -569,6 +622,7 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 	uint64_t mask;
 	struct vfio_dma *dma;
 	unsigned long pfn;
+	struct page **batch;
 
 	/* Verify that none of our __u64 fields overflow */
 	if (map->size != size || map->vaddr != vaddr || map->iova != iova)
@@ -598,8 +652,15 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 		return -EEXIST;
 	}
 
+	batch = (struct page **)__get_free_page(GFP_KERNEL);
+	if (!batch) {
+		mutex_unlock(&iommu->lock);
+		return -ENOMEM;
+	}
+
 	dma = kzalloc(sizeof(*dma), GFP_KERNEL);
 	if (!dma) {
+		free_page((unsigned long)batch);
 		mutex_unlock(&iommu->lock);
 		return -ENOMEM;
 	}
@@ -614,7 +675,7 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 	while (size) {
 		/* Pin a contiguous chunk of memory */
 		npage = vfio_pin_pages(vaddr + dma->size,
-				       size >> PAGE_SHIFT, prot, &pfn);
+				       size >> PAGE_SHIFT, prot, &pfn, batch);
 		if (npage <= 0) {
 			WARN_ON(!npage);
 			ret = (int)npage;
@@ -635,6 +696,7 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 	if (ret)
 		vfio_remove_dma(iommu, dma);
 
+	free_page((unsigned long)batch);
 	mutex_unlock(&iommu->lock);
 	return ret;
 }
@@ -25,6 +25,7 @@
 #include <linux/if_tun.h>
 #include <linux/if_macvlan.h>
 #include <linux/if_vlan.h>
+#include <linux/skb_array.h>
 
 #include <net/sock.h>
 
@@ -35,6 +36,11 @@ module_param(experimental_zcopytx, int, 0444);
 MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 		                       " 1 -Enable; 0 - Disable");
 
+static int separate_rx_tx_workers = 1;
+module_param(separate_rx_tx_workers, int, 0444);
+MODULE_PARM_DESC(separate_rx_tx_workers, "Handle RX and TX on separate"
+		 " worker threads; 1 - Enable; 0 - Disable");
+
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
@@ -43,6 +49,9 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
 
+/* Packets moved per call to and from a tap backend */
+#define VHOST_NET_BATCH 64
+
 /*
  * For transmit, used buffer len is unused; we override it to track buffer
  * status internally; used for zerocopy tx only.
@@ -81,10 +90,29 @@ struct vhost_net_ubuf_ref {
 	struct vhost_virtqueue *vq;
 };
 
+/* skbs taken off a tun queue in one go, not yet passed to recvmsg */
+struct vhost_net_buf {
+	struct sk_buff *queue[VHOST_NET_BATCH];
+	int head;
+	int tail;
+};
+
 struct vhost_net_virtqueue {
 	struct vhost_virtqueue vq;
 	size_t vhost_hlen;
 	size_t sock_hlen;
+	/* Backend is tun or macvtap and takes TUN_MSG_PTR batches */
+	bool tap;
+	/* RX only: the tun queue to batch-dequeue from, or NULL */
+	struct skb_array *rx_array;
+	struct vhost_net_buf rxq;
+	/* TX only: copied packets waiting to go out as one batch. Their
+	 * iovecs sit at the start of vq.iov. Protected by vq mutex. */
+	struct iov_iter tx_iter[VHOST_NET_BATCH];
+	struct vring_used_elem tx_heads[VHOST_NET_BATCH];
+	int tx_batched;
+	int tx_batch_iovs;
+	size_t tx_batch_len;
 	/* vhost zerocopy support fields below: */
 	/* last used idx for outstanding DMA zerocopy buffers */
 	int upend_idx;
@@ -197,6 +225,12 @@ static void vhost_net_vq_reset(struct vhost_net *n)
 		n->vqs[i].ubufs = NULL;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
+		n->vqs[i].tap = false;
+		n->vqs[i].rx_array = NULL;
+		n->vqs[i].rxq.head = n->vqs[i].rxq.tail = 0;
+		n->vqs[i].tx_batched = 0;
+		n->vqs[i].tx_batch_iovs = 0;
+		n->vqs[i].tx_batch_len = 0;
 	}
 
 }
@@ -230,6 +264,13 @@ static bool vhost_sock_zcopy(struct socket *sock)
 		sock_flag(sock->sk, SOCK_ZEROCOPY);
 }
 
+/* Only tun and macvtap understand struct tun_msg_ctl */
+static bool vhost_sock_tap(struct socket *sock)
+{
+	return !IS_ERR(tun_get_socket(sock->file)) ||
+	       !IS_ERR(macvtap_get_socket(sock->file));
+}
+
 /* In case of DMA done not in order in lower device driver for some reason.
  * upend_idx is used to track end of used idx, done_idx is used to track head
  * of used idx. Once lower device DMA done contiguously, we will signal KVM
@@ -292,13 +333,14 @@ static inline unsigned long busy_clock(void)
 	return local_clock() >> 10;
 }
 
-static bool vhost_can_busy_poll(struct vhost_dev *dev,
+/* vq is the queue whose worker is doing the polling. */
+static bool vhost_can_busy_poll(struct vhost_virtqueue *vq,
 				unsigned long endtime)
 {
 	return likely(!need_resched()) &&
 	       likely(!time_after(busy_clock(), endtime)) &&
 	       likely(!signal_pending(current)) &&
-	       !vhost_has_work(dev);
+	       !vhost_vq_has_work(vq);
 }
 
 static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
@@ -307,23 +349,56 @@ static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
 				    unsigned int *out_num, unsigned int *in_num)
 {
 	unsigned long uninitialized_var(endtime);
-	int r = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
-				    out_num, in_num, NULL, NULL);
+	int r = vhost_get_vq_desc(vq, iov, iov_size,
+				  out_num, in_num, NULL, NULL);
 
 	if (r == vq->num && vq->busyloop_timeout) {
 		preempt_disable();
 		endtime = busy_clock() + vq->busyloop_timeout;
-		while (vhost_can_busy_poll(vq->dev, endtime) &&
+		while (vhost_can_busy_poll(vq, endtime) &&
 		       vhost_vq_avail_empty(vq->dev, vq))
 			cpu_relax_lowlatency();
 		preempt_enable();
-		r = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
-					out_num, in_num, NULL, NULL);
+		r = vhost_get_vq_desc(vq, iov, iov_size,
+				      out_num, in_num, NULL, NULL);
 	}
 
 	return r;
 }
 
+/* Send the batched packets in one sendmsg call and mark them used. A
+ * packet the backend refuses is dropped, just as it would have been on
+ * its own. */
+static void vhost_net_tx_flush_batch(struct vhost_net *net,
+				     struct socket *sock)
+{
+	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
+	struct vhost_virtqueue *vq = &nvq->vq;
+	struct tun_msg_ctl ctl = {
+		.type = TUN_MSG_PTR,
+		.num = nvq->tx_batched,
+		.ptr = nvq->tx_iter,
+	};
+	struct msghdr msg = {
+		.msg_control = &ctl,
+		.msg_flags = MSG_DONTWAIT,
+	};
+	int err;
+
+	if (!nvq->tx_batched)
+		return;
+
+	err = sock->ops->sendmsg(sock, &msg, nvq->tx_batch_len);
+	if (unlikely(err < 0))
+		pr_debug("Failed to send TX batch of %d: %d\n",
+			 nvq->tx_batched, err);
+	vhost_add_used_and_signal_n(&net->dev, vq, nvq->tx_heads,
+				    nvq->tx_batched);
+	nvq->tx_batched = 0;
+	nvq->tx_batch_iovs = 0;
+	nvq->tx_batch_len = 0;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -339,11 +414,13 @@ static void handle_tx(struct vhost_net *net)
 		.msg_controllen = 0,
 		.msg_flags = MSG_DONTWAIT,
 	};
+	struct tun_msg_ctl ctl;
 	size_t len, total_len = 0;
 	int err;
 	size_t hdr_size;
 	struct socket *sock;
 	struct vhost_net_ubuf_ref *uninitialized_var(ubufs);
+	struct iovec *iov;
 	bool zcopy, zcopy_used;
 
 	mutex_lock(&vq->mutex);
@@ -368,12 +445,24 @@ static void handle_tx(struct vhost_net *net)
 			      % UIO_MAXIOV == nvq->done_idx))
 			break;
 
-		head = vhost_net_tx_get_vq_desc(net, vq, vq->iov,
-						ARRAY_SIZE(vq->iov),
+		/* Leave the next packet plenty of iovecs after the batch */
+		if (nvq->tx_batch_iovs > UIO_MAXIOV / 2)
+			vhost_net_tx_flush_batch(net, sock);
+
+		iov = vq->iov + nvq->tx_batch_iovs;
+		head = vhost_net_tx_get_vq_desc(net, vq, iov,
+						ARRAY_SIZE(vq->iov) -
+						nvq->tx_batch_iovs,
 						&out, &in);
-		/* On error, stop handling until the next kick. */
-		if (unlikely(head < 0))
+		/* On error, stop handling until the next kick. It may just
+		 * have needed the iovecs the batch holds, so retry once. */
+		if (unlikely(head < 0)) {
+			if (nvq->tx_batched) {
+				vhost_net_tx_flush_batch(net, sock);
+				continue;
+			}
 			break;
+		}
 		/* Nothing new?  Wait for eventfd to tell us they refilled. */
 		if (head == vq->num) {
 			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
@@ -388,8 +477,8 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 		/* Skip header. TODO: support TSO. */
-		len = iov_length(vq->iov, out);
-		iov_iter_init(&msg.msg_iter, WRITE, vq->iov, out, len);
+		len = iov_length(iov, out);
+		iov_iter_init(&msg.msg_iter, WRITE, iov, out, len);
 		iov_iter_advance(&msg.msg_iter, hdr_size);
 		/* Sanity check */
 		if (!msg_data_left(&msg)) {
@@ -405,6 +494,29 @@ static void handle_tx(struct vhost_net *net)
 				      nvq->done_idx
 				   && vhost_net_tx_select_zcopy(net);
 
+		if (!zcopy_used && nvq->tap) {
+			nvq->tx_iter[nvq->tx_batched] = msg.msg_iter;
+			nvq->tx_heads[nvq->tx_batched].id =
+				cpu_to_vhost32(vq, head);
+			nvq->tx_heads[nvq->tx_batched].len = 0;
+			nvq->tx_batched++;
+			nvq->tx_batch_iovs += out;
+			nvq->tx_batch_len += len;
+			if (nvq->tx_batched == VHOST_NET_BATCH)
+				vhost_net_tx_flush_batch(net, sock);
+
+			total_len += len;
+			vhost_net_tx_packet(net);
+			if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
+				vhost_poll_queue(&vq->poll);
+				break;
+			}
+			continue;
+		}
+
+		/* Keep the packets in order: the batch goes first */
+		vhost_net_tx_flush_batch(net, sock);
+
 		/* use msg_control to pass vhost zerocopy ubuf info to skb */
 		if (zcopy_used) {
 			struct ubuf_info *ubuf;
@@ -415,8 +527,10 @@ static void handle_tx(struct vhost_net *net)
 			ubuf->callback = vhost_zerocopy_callback;
 			ubuf->ctx = nvq->ubufs;
 			ubuf->desc = nvq->upend_idx;
-			msg.msg_control = ubuf;
-			msg.msg_controllen = sizeof(ubuf);
+			ctl.type = TUN_MSG_UBUF;
+			ctl.ptr = ubuf;
+			msg.msg_control = &ctl;
+			msg.msg_controllen = sizeof(ctl);
 			ubufs = nvq->ubufs;
 			atomic_inc(&ubufs->refcount);
 			nvq->upend_idx = (nvq->upend_idx + 1) % UIO_MAXIOV;
@@ -449,16 +563,60 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 	}
+	vhost_net_tx_flush_batch(net, sock);
 out:
 	mutex_unlock(&vq->mutex);
 }
 
-static int peek_head_len(struct sock *sk)
+static bool vhost_net_buf_is_empty(struct vhost_net_buf *rxq)
+{
+	return rxq->head == rxq->tail;
+}
+
+static struct sk_buff *vhost_net_buf_consume(struct vhost_net_buf *rxq)
+{
+	return rxq->queue[rxq->head++];
+}
+
+/* Refill rxq from the tun queue, taking its consumer lock only once */
+static int vhost_net_buf_produce(struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_net_buf *rxq = &nvq->rxq;
+
+	rxq->head = 0;
+	rxq->tail = skb_array_consume_batched(nvq->rx_array, rxq->queue,
+					      VHOST_NET_BATCH);
+	return rxq->tail;
+}
+
+/* Called when the backend goes away: the skbs can't be put back */
+static void vhost_net_buf_purge(struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_net_buf *rxq = &nvq->rxq;
+
+	while (!vhost_net_buf_is_empty(rxq))
+		kfree_skb(vhost_net_buf_consume(rxq));
+}
+
+static int vhost_net_buf_peek(struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_net_buf *rxq = &nvq->rxq;
+
+	if (vhost_net_buf_is_empty(rxq) && !vhost_net_buf_produce(nvq))
+		return 0;
+
+	return __skb_array_len_with_tag(rxq->queue[rxq->head]);
+}
+
+static int peek_head_len(struct vhost_net_virtqueue *rvq, struct sock *sk)
 {
 	struct sk_buff *head;
 	int len = 0;
 	unsigned long flags;
 
+	if (rvq->rx_array)
+		return vhost_net_buf_peek(rvq);
+
 	spin_lock_irqsave(&sk->sk_receive_queue.lock, flags);
 	head = skb_peek(&sk->sk_receive_queue);
 	if (likely(head)) {
@@ -471,12 +629,21 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+static bool sk_has_rx_data(struct vhost_net_virtqueue *rvq, struct sock *sk)
+{
+	if (rvq->rx_array)
+		return !skb_array_empty(rvq->rx_array);
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
 static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
 {
+	struct vhost_net_virtqueue *rvq = &net->vqs[VHOST_NET_VQ_RX];
 	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
 	struct vhost_virtqueue *vq = &nvq->vq;
 	unsigned long uninitialized_var(endtime);
-	int len = peek_head_len(sk);
+	int len = peek_head_len(rvq, sk);
 
 	if (!len && vq->busyloop_timeout) {
 		/* Both tx vq and rx socket were polled here */
@@ -486,8 +653,8 @@ static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
 		preempt_disable();
 		endtime = busy_clock() + vq->busyloop_timeout;
 
-		while (vhost_can_busy_poll(&net->dev, endtime) &&
-		       skb_queue_empty(&sk->sk_receive_queue) &&
+		while (vhost_can_busy_poll(&rvq->vq, endtime) &&
+		       !sk_has_rx_data(rvq, sk) &&
 		       vhost_vq_avail_empty(&net->dev, vq))
 			cpu_relax_lowlatency();
 
@@ -497,7 +664,7 @@ static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
 			vhost_poll_queue(&vq->poll);
 		mutex_unlock(&vq->mutex);
 
-		len = peek_head_len(sk);
+		len = peek_head_len(rvq, sk);
 	}
 
 	return len;
@@ -599,6 +766,10 @@ static void handle_rx(struct vhost_net *net)
 		.flags = 0,
 		.gso_type = VIRTIO_NET_HDR_GSO_NONE
 	};
+	struct tun_msg_ctl ctl = {
+		.type = TUN_MSG_PTR,
+		.num = 1,
+	};
 	size_t total_len = 0;
 	int err, mergeable;
 	s16 headcount;
@@ -630,14 +801,6 @@ static void handle_rx(struct vhost_net *net)
 		/* On error, stop handling until the next kick. */
 		if (unlikely(headcount < 0))
 			break;
-		/* On overrun, truncate and discard */
-		if (unlikely(headcount > UIO_MAXIOV)) {
-			iov_iter_init(&msg.msg_iter, READ, vq->iov, 1, 1);
-			err = sock->ops->recvmsg(sock, &msg,
-						 1, MSG_DONTWAIT | MSG_TRUNC);
-			pr_debug("Discarded rx packet: len %zd\n", sock_len);
-			continue;
-		}
 		/* OK, now we need to know about added descriptors. */
 		if (!headcount) {
 			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
@@ -650,6 +813,19 @@ static void handle_rx(struct vhost_net *net)
 			 * they refilled. */
 			break;
 		}
+		/* Hand tun the skb we peeked at; recvmsg owns it from here */
+		if (nvq->rx_array) {
+			ctl.ptr = vhost_net_buf_consume(&nvq->rxq);
+			msg.msg_control = &ctl;
+		}
+		/* On overrun, truncate and discard */
+		if (unlikely(headcount > UIO_MAXIOV)) {
+			iov_iter_init(&msg.msg_iter, READ, vq->iov, 1, 1);
+			err = sock->ops->recvmsg(sock, &msg,
+						 1, MSG_DONTWAIT | MSG_TRUNC);
+			pr_debug("Discarded rx packet: len %zd\n", sock_len);
+			continue;
+		}
 		/* We don't need to be notified again. */
 		iov_iter_init(&msg.msg_iter, READ, vq->iov, in, vhost_len);
 		fixup = msg.msg_iter;
@@ -773,9 +949,13 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].sock_hlen = 0;
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX);
+	if (separate_rx_tx_workers)
+		dev->max_workers = VHOST_NET_VQ_MAX;
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 
@@ -811,12 +991,16 @@ static int vhost_net_enable_vq(struct vhost_net *n,
 static struct socket *vhost_net_stop_vq(struct vhost_net *n,
 					struct vhost_virtqueue *vq)
 {
+	struct vhost_net_virtqueue *nvq =
+		container_of(vq, struct vhost_net_virtqueue, vq);
 	struct socket *sock;
 
 	mutex_lock(&vq->mutex);
 	sock = vq->private_data;
 	vhost_net_disable_vq(n, vq);
 	vq->private_data = NULL;
+	vhost_net_buf_purge(nvq);
+	nvq->rx_array = NULL;
 	mutex_unlock(&vq->mutex);
 	return sock;
 }
@@ -992,6 +1176,17 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 		if (r)
 			goto err_used;
 
+		vhost_net_buf_purge(nvq);
+		nvq->tap = sock && vhost_sock_tap(sock);
+		nvq->rx_array = NULL;
+		if (sock && index == VHOST_NET_VQ_RX) {
+			struct skb_array *rx_array;
+
+			rx_array = tun_get_skb_array(sock->file);
+			if (!IS_ERR(rx_array))
+				nvq->rx_array = rx_array;
+		}
+
 		oldubufs = nvq->ubufs;
 		nvq->ubufs = ubufs;
 
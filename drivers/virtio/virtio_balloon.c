@@ -30,6 +30,7 @@
 #include <linux/oom.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/page_reporting.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -47,7 +48,7 @@ MODULE_PARM_DESC(oom_pages, "pages to free on OOM");
 
 struct virtio_balloon {
 	struct virtio_device *vdev;
-	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq;
+	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *reporting_vq;
 
 	/* The balloon servicing is delegated to a freezable workqueue. */
 	struct work_struct update_balloon_stats_work;
@@ -82,6 +83,9 @@ struct virtio_balloon {
 
 	/* To register callback in oom notifier call chain */
 	struct notifier_block nb;
+
+	/* Free page reporting device */
+	struct page_reporting_dev_info pr_dev_info;
 };
 
 static struct virtio_device_id id_table[] = {
@@ -396,22 +400,32 @@ static void update_balloon_size_func(struct work_struct *work)
 
 static int init_vqs(struct virtio_balloon *vb)
 {
-	struct virtqueue *vqs[3];
-	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request };
-	static const char * const names[] = { "inflate", "deflate", "stats" };
+	struct virtqueue *vqs[4];
+	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request,
+				       balloon_ack };
+	const char *names[] = { "inflate", "deflate", "stats", "reporting" };
 	int err, nvqs;
 
 	/*
 	 * We expect two virtqueues: inflate and deflate, and
-	 * optionally stat.
+	 * optionally stat and reporting.  A queue for a feature the host
+	 * lacks keeps its index but is not set up.
 	 */
-	nvqs = virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	nvqs = 2;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ))
+		nvqs = 3;
+	else
+		names[2] = NULL;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
+		nvqs = 4;
 	err = vb->vdev->config->find_vqs(vb->vdev, nvqs, vqs, callbacks, names);
 	if (err)
 		return err;
 
 	vb->inflate_vq = vqs[0];
 	vb->deflate_vq = vqs[1];
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
+		vb->reporting_vq = vqs[3];
 	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
 		struct scatterlist sg;
 		vb->stats_vq = vqs[2];
@@ -429,6 +443,47 @@ static int init_vqs(struct virtio_balloon *vb)
 	return 0;
 }
 
+/*
+ * Tell the host about free pages it may reclaim.  Each page goes out as
+ * one descriptor; the host has dropped its backing by the time it
+ * returns the buffer.
+ */
+static int virtballoon_free_page_report(struct page_reporting_dev_info *prdev,
+					struct scatterlist *sg,
+					unsigned int nents)
+{
+	struct virtio_balloon *vb =
+		container_of(prdev, struct virtio_balloon, pr_dev_info);
+	struct virtqueue *vq = vb->reporting_vq;
+	unsigned int unused;
+	int err;
+
+	/* Only one report is in flight, so the queue is empty here */
+	err = virtqueue_add_inbuf(vq, sg, nents, vb, GFP_NOWAIT | __GFP_NOWARN);
+	if (WARN_ON_ONCE(err))
+		return err;
+
+	virtqueue_kick(vq);
+	wait_event(vb->acked, virtqueue_get_buf(vq, &unused));
+	return 0;
+}
+
+static void virtballoon_register_reporting(struct virtio_balloon *vb)
+{
+	if (!virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
+		return;
+
+	/* Don't fail the device if another one already reports */
+	if (page_reporting_register(&vb->pr_dev_info))
+		dev_info(&vb->vdev->dev, "free page reporting unavailable\n");
+}
+
+static void virtballoon_unregister_reporting(struct virtio_balloon *vb)
+{
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
+		page_reporting_unregister(&vb->pr_dev_info);
+}
+
 #ifdef CONFIG_BALLOON_COMPACTION
 /*
  * virtballoon_migratepage - perform the balloon page migration on behalf of
@@ -517,6 +572,7 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	mutex_init(&vb->balloon_lock);
 	init_waitqueue_head(&vb->acked);
 	vb->vdev = vdev;
+	vb->pr_dev_info.report = virtballoon_free_page_report;
 
 	balloon_devinfo_init(&vb->vb_dev_info);
 #ifdef CONFIG_BALLOON_COMPACTION
@@ -535,6 +591,7 @@ static int virtballoon_probe(struct virtio_device *vdev)
 
 	virtio_device_ready(vdev);
 
+	virtballoon_register_reporting(vb);
 	return 0;
 
 out_oom_notify:
@@ -547,6 +604,9 @@ out:
 
 static void remove_common(struct virtio_balloon *vb)
 {
+	/* A report in flight needs the queues */
+	virtballoon_unregister_reporting(vb);
+
 	/* There might be pages left in the balloon: free them. */
 	while (vb->num_pages)
 		leak_balloon(vb, vb->num_pages);
@@ -597,6 +657,7 @@ static int virtballoon_restore(struct virtio_device *vdev)
 		return ret;
 
 	virtio_device_ready(vdev);
+	virtballoon_register_reporting(vb);
 
 	if (towards_target(vb))
 		virtballoon_changed(vdev);
@@ -609,6 +670,7 @@ static unsigned int features[] = {
 	VIRTIO_BALLOON_F_MUST_TELL_HOST,
 	VIRTIO_BALLOON_F_STATS_VQ,
 	VIRTIO_BALLOON_F_DEFLATE_ON_OOM,
+	VIRTIO_BALLOON_F_REPORTING,
 };
 
 static struct virtio_driver virtio_balloon_driver = {
@@ -40,6 +40,7 @@
 #include <linux/ramfs.h>
 #include <linux/percpu-refcount.h>
 #include <linux/mount.h>
+#include <linux/pagemap.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -186,6 +187,14 @@ struct aio_kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/* buffered read state, see aio_read_nowait() */
+	struct wait_page_async	ki_page_wait;
+	struct work_struct	ki_work;
+	struct mm_struct	*ki_mm;
+	struct iov_iter		ki_iter;
+	struct iovec		ki_iov;
+	ssize_t			ki_nr_read;
 };
 
 /*------ sysctl variables----*/
@@ -1401,6 +1410,123 @@ static int aio_setup_vectored_rw(int rw, char __user *buf, size_t len,
 				len, UIO_FASTIOV, iovec, iter);
 }
 
+/*
+ * Buffered reads through generic_file_read_iter() can be run without
+ * blocking on page cache misses: readahead is started, and the read is
+ * retried from a workqueue, in the submitter's mm, once the page we stopped
+ * at is unlocked. Other filesystems don't know about IOCB_NOWAIT.
+ */
+static bool aio_can_read_nowait(struct kiocb *req)
+{
+	return !(req->ki_flags & IOCB_DIRECT) &&
+	       req->ki_filp->f_op->read_iter == generic_file_read_iter;
+}
+
+static ssize_t aio_read_iter(struct aio_kiocb *req)
+{
+	ssize_t ret;
+
+	do {
+		ret = generic_file_read_iter(&req->common, &req->ki_iter);
+		if (ret <= 0)
+			break;
+		req->ki_nr_read += ret;
+	} while (iov_iter_count(&req->ki_iter));
+
+	return ret;
+}
+
+static long aio_read_finish(struct aio_kiocb *req, ssize_t ret)
+{
+	if (req->ki_iter.iov != &req->ki_iov)
+		kfree(req->ki_iter.iov);
+	mmput(req->ki_mm);
+
+	return req->ki_nr_read ? req->ki_nr_read : ret;
+}
+
+static void aio_read_work(struct work_struct *work)
+{
+	struct aio_kiocb *req = container_of(work, struct aio_kiocb, ki_work);
+	struct mm_struct *mm = req->ki_mm;
+	ssize_t ret;
+
+	if (req->ki_page_wait.page) {
+		put_page(req->ki_page_wait.page);
+		req->ki_page_wait.page = NULL;
+	}
+
+	use_mm(mm);
+	ret = aio_read_iter(req);
+	if (ret == -EAGAIN && (req->common.ki_flags & IOCB_NOWAIT)) {
+		/* nothing to wait for without blocking, do it here */
+		req->common.ki_flags &= ~IOCB_NOWAIT;
+		ret = aio_read_iter(req);
+	}
+	unuse_mm(mm);
+
+	if (ret == -EIOCBQUEUED)
+		return;
+	if (unlikely(ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
+		     ret == -ERESTARTNOHAND || ret == -ERESTART_RESTARTBLOCK))
+		ret = -EINTR;
+	aio_complete(&req->common, aio_read_finish(req, ret), 0);
+}
+
+static void aio_read_wake(struct wait_page_async *wpa)
+{
+	struct aio_kiocb *req = container_of(wpa, struct aio_kiocb,
+					     ki_page_wait);
+
+	schedule_work(&req->ki_work);
+}
+
+/*
+ * The iterator has to outlive the submission, point it at a copy of the
+ * iovecs. A single range, the common case, fits into the aio_kiocb.
+ */
+static int aio_read_save_iter(struct aio_kiocb *req, struct iov_iter *iter)
+{
+	req->ki_iter = *iter;
+	if (iter->nr_segs == 1) {
+		req->ki_iov = *iter->iov;
+		req->ki_iter.iov = &req->ki_iov;
+		return 0;
+	}
+
+	req->ki_iter.iov = kmemdup(iter->iov,
+				   iter->nr_segs * sizeof(struct iovec),
+				   GFP_KERNEL);
+	return req->ki_iter.iov ? 0 : -ENOMEM;
+}
+
+static ssize_t aio_read_nowait(struct aio_kiocb *req, struct iov_iter *iter)
+{
+	struct kiocb *iocb = &req->common;
+	ssize_t ret;
+
+	if (aio_read_save_iter(req, iter))
+		return iocb->ki_filp->f_op->read_iter(iocb, iter);
+
+	req->ki_mm = current->mm;
+	atomic_inc(&req->ki_mm->mm_users);
+	INIT_WORK(&req->ki_work, aio_read_work);
+	req->ki_page_wait.func = aio_read_wake;
+	iocb->ki_waitq = &req->ki_page_wait;
+	iocb->ki_flags |= IOCB_NOWAIT;
+
+	ret = aio_read_iter(req);
+	if (ret == -EIOCBQUEUED)
+		return ret;
+	if (ret == -EAGAIN) {
+		iocb->ki_flags &= ~IOCB_NOWAIT;
+		schedule_work(&req->ki_work);
+		return -EIOCBQUEUED;
+	}
+
+	return aio_read_finish(req, ret);
+}
+
 /*
  * aio_run_iocb:
  *	Performs the initial checks and io submission.
@@ -1452,6 +1578,14 @@ rw_common:
 			return ret;
 		}
 
+		if (rw == READ && aio_can_read_nowait(req)) {
+			ret = aio_read_nowait(container_of(req,
+						struct aio_kiocb, common),
+					      &iter);
+			kfree(iovec);
+			break;
+		}
+
 		if (rw == WRITE)
 			file_start_write(file);
 
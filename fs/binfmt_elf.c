@@ -36,6 +36,7 @@
 #include <linux/coredump.h>
 #include <linux/sched.h>
 #include <linux/dax.h>
+#include <linux/memcontrol.h>
 #include <asm/uaccess.h>
 #include <asm/param.h>
 #include <asm/page.h>
@@ -333,6 +334,30 @@ create_elf_tables(struct linux_binprm *bprm, struct elfhdr *exec,
 
 #ifndef elf_map
 
+/*
+ * Read the text of the program ahead and map what is cached of it right
+ * away, rather than a fault around batch per fault.  Short lived programs
+ * otherwise spend much of their time faulting their text in.
+ */
+static void elf_prefault(struct file *filep, unsigned long addr,
+			 unsigned long size, unsigned long off)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+
+	if (IS_DAX(file_inode(filep)))
+		return;
+
+	force_page_cache_readahead(filep->f_mapping, filep,
+				   off >> PAGE_SHIFT, size >> PAGE_SHIFT);
+
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, addr);
+	if (vma && vma->vm_start <= addr && vma->vm_file == filep)
+		map_cached_pages(vma, addr, addr + size);
+	up_read(&mm->mmap_sem);
+}
+
 static unsigned long elf_map(struct file *filep, unsigned long addr,
 		struct elf_phdr *eppnt, int prot, int type,
 		unsigned long total_size)
@@ -364,6 +389,10 @@ static unsigned long elf_map(struct file *filep, unsigned long addr,
 	} else
 		map_addr = vm_mmap(filep, addr, size, prot, type, off);
 
+	if (!BAD_ADDR(map_addr) && (prot & PROT_EXEC) &&
+	    mem_cgroup_exec_prefault(current->mm))
+		elf_prefault(filep, map_addr, size, off);
+
 	return(map_addr);
 }
 
@@ -183,9 +183,10 @@ struct btrfs_inode {
 	unsigned reserved_extents;
 
 	/*
-	 * always compress this one file
+	 * always compress this one file, and the level to use for it
 	 */
 	unsigned force_compress;
+	unsigned force_compress_level;
 
 	struct btrfs_delayed_node *delayed_node;
 
@@ -754,6 +754,7 @@ static struct {
 static const struct btrfs_compress_op * const btrfs_compress_op[] = {
 	&btrfs_zlib_compress,
 	&btrfs_lzo_compress,
+	&btrfs_zstd_compress,
 };
 
 void __init btrfs_init_compress(void)
@@ -924,7 +925,8 @@ static void free_workspaces(void)
  * max_out tells us the max number of bytes that we're allowed to
  * stuff into pages
  */
-int btrfs_compress_pages(int type, struct address_space *mapping,
+int btrfs_compress_pages(int type, unsigned int level,
+			 struct address_space *mapping,
 			 u64 start, unsigned long len,
 			 struct page **pages,
 			 unsigned long nr_dest_pages,
@@ -938,8 +940,8 @@ int btrfs_compress_pages(int type, struct address_space *mapping,
 
 	workspace = find_workspace(type);
 
-	ret = btrfs_compress_op[type-1]->compress_pages(workspace, mapping,
-						      start, len, pages,
+	ret = btrfs_compress_op[type-1]->compress_pages(workspace, level,
+						      mapping, start, len, pages,
 						      nr_dest_pages, out_pages,
 						      total_in, total_out,
 						      max_out);
@@ -1005,6 +1007,33 @@ void btrfs_exit_compress(void)
 	free_workspaces();
 }
 
+/*
+ * Parse what follows the type name in a compression mount option or
+ * property value: nothing for the default level, or ":level".
+ */
+int btrfs_compress_parse_level(int type, const char *str, unsigned int *level)
+{
+	unsigned int max_level;
+
+	*level = 0;
+	if (!*str)
+		return 0;
+
+	if (type == BTRFS_COMPRESS_ZLIB)
+		max_level = BTRFS_ZLIB_MAX_LEVEL;
+	else if (type == BTRFS_COMPRESS_ZSTD)
+		max_level = BTRFS_ZSTD_MAX_LEVEL;
+	else
+		max_level = 0;
+
+	if (*str != ':' || kstrtouint(str + 1, 10, level) ||
+	    *level < 1 || *level > max_level) {
+		*level = 0;
+		return -EINVAL;
+	}
+	return 0;
+}
+
 /*
  * Copy uncompressed data from working buffer to pages.
  *
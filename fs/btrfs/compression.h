@@ -22,7 +22,8 @@
 void btrfs_init_compress(void);
 void btrfs_exit_compress(void);
 
-int btrfs_compress_pages(int type, struct address_space *mapping,
+int btrfs_compress_pages(int type, unsigned int level,
+			 struct address_space *mapping,
 			 u64 start, unsigned long len,
 			 struct page **pages,
 			 unsigned long nr_dest_pages,
@@ -37,6 +38,7 @@ int btrfs_decompress_buf2page(char *buf, unsigned long buf_start,
 			      struct bio_vec *bvec, int vcnt,
 			      unsigned long *pg_index,
 			      unsigned long *pg_offset);
+int btrfs_compress_parse_level(int type, const char *str, unsigned int *level);
 
 int btrfs_submit_compressed_write(struct inode *inode, u64 start,
 				  unsigned long len, u64 disk_start,
@@ -53,16 +55,27 @@ enum btrfs_compression_type {
 	BTRFS_COMPRESS_NONE  = 0,
 	BTRFS_COMPRESS_ZLIB  = 1,
 	BTRFS_COMPRESS_LZO   = 2,
-	BTRFS_COMPRESS_TYPES = 2,
-	BTRFS_COMPRESS_LAST  = 3,
+	BTRFS_COMPRESS_ZSTD  = 3,
+	BTRFS_COMPRESS_TYPES = 3,
+	BTRFS_COMPRESS_LAST  = 4,
 };
 
+/*
+ * Compression levels, 0 means the default of the type.  zlib and zstd have
+ * them, lzo ignores the level.
+ */
+#define BTRFS_ZLIB_DEFAULT_LEVEL	3
+#define BTRFS_ZLIB_MAX_LEVEL		9
+#define BTRFS_ZSTD_DEFAULT_LEVEL	3
+#define BTRFS_ZSTD_MAX_LEVEL		9	/* ZSTD_MAX_CLEVEL */
+
 struct btrfs_compress_op {
 	struct list_head *(*alloc_workspace)(void);
 
 	void (*free_workspace)(struct list_head *workspace);
 
 	int (*compress_pages)(struct list_head *workspace,
+			      unsigned int level,
 			      struct address_space *mapping,
 			      u64 start, unsigned long len,
 			      struct page **pages,
@@ -88,5 +101,6 @@ struct btrfs_compress_op {
 
 extern const struct btrfs_compress_op btrfs_zlib_compress;
 extern const struct btrfs_compress_op btrfs_lzo_compress;
+extern const struct btrfs_compress_op btrfs_zstd_compress;
 
 #endif
@@ -276,6 +276,7 @@ struct btrfs_super_block {
 	 BTRFS_FEATURE_INCOMPAT_MIXED_GROUPS |		\
 	 BTRFS_FEATURE_INCOMPAT_BIG_METADATA |		\
 	 BTRFS_FEATURE_INCOMPAT_COMPRESS_LZO |		\
+	 BTRFS_FEATURE_INCOMPAT_COMPRESS_ZSTD |		\
 	 BTRFS_FEATURE_INCOMPAT_RAID56 |		\
 	 BTRFS_FEATURE_INCOMPAT_EXTENDED_IREF |		\
 	 BTRFS_FEATURE_INCOMPAT_SKINNY_METADATA |	\
@@ -681,6 +682,32 @@ struct btrfs_stripe_hash_table {
 
 void btrfs_init_async_reclaim_work(struct work_struct *work);
 
+/*
+ * Delayed refs are run in the background in shards of the bytenr space:
+ * shard n owns the 1GiB slices with (bytenr >> 30) % BTRFS_DELAYED_REF_SHARDS
+ * == n.  Each shard has a single work item, requests coming in while it is
+ * queued just add to the number of refs it runs, and the workers of different
+ * shards don't fight over the same heads and extent tree leaves.
+ */
+#define BTRFS_DELAYED_REF_SHARDS	4
+#define BTRFS_DELAYED_REF_SHARD_SHIFT	30
+
+struct btrfs_delayed_ref_shard {
+	struct btrfs_fs_info *fs_info;
+	int index;
+
+	spinlock_t lock;
+	/* refs to run on the next pass, and the newest transaction they are for */
+	unsigned long count;
+	u64 transid;
+	bool queued;
+	/* passes started and finished, throttled producers wait on these */
+	unsigned long started;
+	unsigned long done;
+
+	struct btrfs_work work;
+};
+
 /* fs_info */
 struct reloc_control;
 struct btrfs_device;
@@ -753,6 +780,7 @@ struct btrfs_fs_info {
 	 */
 	unsigned long pending_changes;
 	unsigned long compress_type:4;
+	unsigned int compress_level;
 	int commit_interval;
 	/*
 	 * It is a suggestive number, the read side is safe even it gets a
@@ -913,6 +941,8 @@ struct btrfs_fs_info {
 
 	/* the extent workers do delayed refs on the extent allocation tree */
 	struct btrfs_workqueue *extent_workers;
+	struct btrfs_delayed_ref_shard delayed_ref_shards[BTRFS_DELAYED_REF_SHARDS];
+	wait_queue_head_t delayed_ref_wait;
 	struct task_struct *transaction_kthread;
 	struct task_struct *cleaner_kthread;
 	int thread_pool_size;
@@ -2518,7 +2548,8 @@ void btrfs_put_block_group(struct btrfs_block_group_cache *cache);
 int btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 			   struct btrfs_root *root, unsigned long count);
 int btrfs_async_run_delayed_refs(struct btrfs_root *root,
-				 unsigned long count, int wait);
+				 unsigned long count, u64 transid, int wait);
+void btrfs_init_delayed_ref_shards(struct btrfs_fs_info *fs_info);
 int btrfs_lookup_data_extent(struct btrfs_root *root, u64 start, u64 len);
 int btrfs_lookup_extent_info(struct btrfs_trans_handle *trans,
 			     struct btrfs_root *root, u64 bytenr,
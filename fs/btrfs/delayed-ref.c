@@ -382,6 +382,72 @@ again:
 	return head;
 }
 
+/*
+ * Find the first head at or after start in the slices of a shard, skipping
+ * the slices of the other shards in one lookup each.  Returns NULL at the
+ * end of the tree.
+ */
+static struct btrfs_delayed_ref_head *
+find_shard_ref_head(struct rb_root *root, u64 start, int shard)
+{
+	struct btrfs_delayed_ref_head *head;
+	u64 slice, next;
+
+	while (1) {
+		head = find_ref_head(root, start, 1);
+		/* find_ref_head() wraps around to the first head */
+		if (!head || head->node.bytenr < start)
+			return NULL;
+
+		slice = head->node.bytenr >> BTRFS_DELAYED_REF_SHARD_SHIFT;
+		if ((slice & (BTRFS_DELAYED_REF_SHARDS - 1)) == shard)
+			return head;
+
+		next = (slice & ~(u64)(BTRFS_DELAYED_REF_SHARDS - 1)) | shard;
+		if (next < slice)
+			next += BTRFS_DELAYED_REF_SHARDS;
+		start = next << BTRFS_DELAYED_REF_SHARD_SHIFT;
+	}
+}
+
+/*
+ * Like btrfs_select_ref_head(), but only picks heads of the given shard, used
+ * by the background workers.
+ */
+struct btrfs_delayed_ref_head *
+btrfs_select_shard_ref_head(struct btrfs_trans_handle *trans, int shard)
+{
+	struct btrfs_delayed_ref_root *delayed_refs;
+	struct btrfs_delayed_ref_head *head;
+	u64 start;
+	bool loop = false;
+
+	delayed_refs = &trans->transaction->delayed_refs;
+	start = delayed_refs->shard_start[shard];
+
+	while (1) {
+		head = find_shard_ref_head(&delayed_refs->href_root, start,
+					   shard);
+		if (!head) {
+			if (loop || !start)
+				return NULL;
+			loop = true;
+			start = 0;
+			continue;
+		}
+		if (!head->processing)
+			break;
+		start = head->node.bytenr + head->node.num_bytes;
+	}
+
+	head->processing = 1;
+	WARN_ON(delayed_refs->num_heads_ready == 0);
+	delayed_refs->num_heads_ready--;
+	delayed_refs->shard_start[shard] = head->node.bytenr +
+		head->node.num_bytes;
+	return head;
+}
+
 /*
  * Helper to insert the ref_node to the tail or merge with tail.
  *
@@ -186,6 +186,9 @@ struct btrfs_delayed_ref_root {
 
 	u64 run_delayed_start;
 
+	/* where the background workers of each shard go on from */
+	u64 shard_start[BTRFS_DELAYED_REF_SHARDS];
+
 	/*
 	 * To make qgroup to skip given root.
 	 * This is for snapshot, as btrfs_qgroup_inherit() will manually
@@ -274,6 +277,8 @@ static inline void btrfs_delayed_ref_unlock(struct btrfs_delayed_ref_head *head)
 
 struct btrfs_delayed_ref_head *
 btrfs_select_ref_head(struct btrfs_trans_handle *trans);
+struct btrfs_delayed_ref_head *
+btrfs_select_shard_ref_head(struct btrfs_trans_handle *trans, int shard);
 
 int btrfs_check_delayed_seq(struct btrfs_fs_info *fs_info,
 			    struct btrfs_delayed_ref_root *delayed_refs,
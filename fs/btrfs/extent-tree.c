@@ -2469,12 +2469,14 @@ select_delayed_ref(struct btrfs_delayed_ref_head *head)
 }
 
 /*
+ * Runs nr delayed refs, of the given shard only unless shard is -1.
+ *
  * Returns 0 on success or if called with an already aborted transaction.
  * Returns -ENOMEM or -EIO on failure and will abort the transaction.
  */
 static noinline int __btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 					     struct btrfs_root *root,
-					     unsigned long nr)
+					     unsigned long nr, int shard)
 {
 	struct btrfs_delayed_ref_root *delayed_refs;
 	struct btrfs_delayed_ref_node *ref;
@@ -2494,7 +2496,11 @@ static noinline int __btrfs_run_delayed_refs(struct btrfs_trans_handle *trans,
 				break;
 
 			spin_lock(&delayed_refs->lock);
-			locked_ref = btrfs_select_ref_head(trans);
+			if (shard < 0)
+				locked_ref = btrfs_select_ref_head(trans);
+			else
+				locked_ref = btrfs_select_shard_ref_head(trans,
+									 shard);
 			if (!locked_ref) {
 				spin_unlock(&delayed_refs->lock);
 				break;
@@ -2833,81 +2839,126 @@ int btrfs_should_throttle_delayed_refs(struct btrfs_trans_handle *trans,
 	return btrfs_check_space_for_delayed_refs(trans, root);
 }
 
-struct async_delayed_refs {
-	struct btrfs_root *root;
-	int count;
-	int error;
-	int sync;
-	struct completion wait;
-	struct btrfs_work work;
-};
-
 static void delayed_ref_async_start(struct btrfs_work *work)
 {
-	struct async_delayed_refs *async;
+	struct btrfs_delayed_ref_shard *shard;
+	struct btrfs_fs_info *fs_info;
+	struct btrfs_root *root;
 	struct btrfs_trans_handle *trans;
+	unsigned long count;
+	unsigned long seq;
+	u64 transid;
 	int ret;
 
-	async = container_of(work, struct async_delayed_refs, work);
+	shard = container_of(work, struct btrfs_delayed_ref_shard, work);
+	fs_info = shard->fs_info;
+	root = fs_info->tree_root;
 
-	trans = btrfs_join_transaction(async->root);
-	if (IS_ERR(trans)) {
-		async->error = PTR_ERR(trans);
+	/* whatever is added from here on needs another pass */
+	spin_lock(&shard->lock);
+	shard->queued = false;
+	count = shard->count;
+	shard->count = 0;
+	transid = shard->transid;
+	seq = ++shard->started;
+	spin_unlock(&shard->lock);
+
+	trans = btrfs_join_transaction(root);
+	if (IS_ERR(trans))
 		goto done;
-	}
+
+	/* Don't bother flushing if we got into a different transaction */
+	if (trans->transid > transid || trans->aborted ||
+	    fs_info->creating_free_space_tree)
+		goto end;
 
 	/*
 	 * trans->sync means that when we call end_transaction, we won't
 	 * wait on delayed refs
 	 */
 	trans->sync = true;
-	ret = btrfs_run_delayed_refs(trans, async->root, async->count);
-	if (ret)
-		async->error = ret;
-
-	ret = btrfs_end_transaction(trans, async->root);
-	if (ret && !async->error)
-		async->error = ret;
+	trans->can_flush_pending_bgs = false;
+	ret = __btrfs_run_delayed_refs(trans, root, count, shard->index);
+	if (ret < 0)
+		btrfs_abort_transaction(trans, root, ret);
+end:
+	btrfs_end_transaction(trans, root);
 done:
-	if (async->sync)
-		complete(&async->wait);
-	else
-		kfree(async);
+	spin_lock(&shard->lock);
+	shard->done = seq;
+	spin_unlock(&shard->lock);
+	wake_up(&fs_info->delayed_ref_wait);
 }
 
-int btrfs_async_run_delayed_refs(struct btrfs_root *root,
-				 unsigned long count, int wait)
+static bool delayed_ref_shard_done(struct btrfs_delayed_ref_shard *shard,
+				   unsigned long seq)
 {
-	struct async_delayed_refs *async;
-	int ret;
+	return (long)(ACCESS_ONCE(shard->done) - seq) >= 0;
+}
 
-	async = kmalloc(sizeof(*async), GFP_NOFS);
-	if (!async)
-		return -ENOMEM;
+/*
+ * Have the shard workers run count delayed refs of transaction transid
+ * between them.  With wait set, this is the admission throttle for producers
+ * of delayed refs: return only once each shard has done a pass that picked up
+ * the refs asked for here.
+ */
+int btrfs_async_run_delayed_refs(struct btrfs_root *root,
+				 unsigned long count, u64 transid, int wait)
+{
+	struct btrfs_fs_info *fs_info = root->fs_info;
+	unsigned long seq[BTRFS_DELAYED_REF_SHARDS];
+	unsigned long per_shard;
+	int i;
 
-	async->root = root->fs_info->tree_root;
-	async->count = count;
-	async->error = 0;
-	if (wait)
-		async->sync = 1;
-	else
-		async->sync = 0;
-	init_completion(&async->wait);
+	per_shard = DIV_ROUND_UP(max_t(unsigned long, count, 1),
+				 BTRFS_DELAYED_REF_SHARDS);
 
-	btrfs_init_work(&async->work, btrfs_extent_refs_helper,
-			delayed_ref_async_start, NULL, NULL);
+	for (i = 0; i < BTRFS_DELAYED_REF_SHARDS; i++) {
+		struct btrfs_delayed_ref_shard *shard;
+		bool queue = false;
 
-	btrfs_queue_work(root->fs_info->extent_workers, &async->work);
+		shard = &fs_info->delayed_ref_shards[i];
+		spin_lock(&shard->lock);
+		shard->count += per_shard;
+		if (transid > shard->transid)
+			shard->transid = transid;
+		if (!shard->queued)
+			shard->queued = queue = true;
+		seq[i] = shard->started + 1;
+		spin_unlock(&shard->lock);
 
-	if (wait) {
-		wait_for_completion(&async->wait);
-		ret = async->error;
-		kfree(async);
-		return ret;
+		if (queue)
+			btrfs_queue_work(fs_info->extent_workers, &shard->work);
 	}
+
+	if (!wait)
+		return 0;
+
+	for (i = 0; i < BTRFS_DELAYED_REF_SHARDS; i++)
+		wait_event(fs_info->delayed_ref_wait,
+			   delayed_ref_shard_done(&fs_info->delayed_ref_shards[i],
+						  seq[i]));
 	return 0;
 }
 
+void btrfs_init_delayed_ref_shards(struct btrfs_fs_info *fs_info)
+{
+	int i;
+
+	init_waitqueue_head(&fs_info->delayed_ref_wait);
+	for (i = 0; i < BTRFS_DELAYED_REF_SHARDS; i++) {
+		struct btrfs_delayed_ref_shard *shard;
+
+		shard = &fs_info->delayed_ref_shards[i];
+		memset(shard, 0, sizeof(*shard));
+		shard->fs_info = fs_info;
+		shard->index = i;
+		spin_lock_init(&shard->lock);
+		btrfs_init_work(&shard->work, btrfs_extent_refs_helper,
+				delayed_ref_async_start, NULL, NULL);
+	}
+}
+
 /*
  * this starts processing the delayed reference count updates and
  * extent insertions we have queued up so far.  count can be
@@ -2947,7 +2998,7 @@ again:
 	delayed_refs->run_delayed_start = find_middle(&delayed_refs->root);
 #endif
 	trans->can_flush_pending_bgs = false;
-	ret = __btrfs_run_delayed_refs(trans, root, count);
+	ret = __btrfs_run_delayed_refs(trans, root, count, -1);
 	if (ret < 0) {
 		btrfs_abort_transaction(trans, root, ret);
 		return ret;
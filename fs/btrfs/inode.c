@@ -425,6 +425,7 @@ static noinline void compress_file_range(struct inode *inode,
 	int i;
 	int will_compress;
 	int compress_type = root->fs_info->compress_type;
+	unsigned int compress_level = root->fs_info->compress_level;
 	int redirty = 0;
 
 	/* if this is a small write inside eof, kick off a defrag */
@@ -490,8 +491,10 @@ again:
 			goto cont;
 		}
 
-		if (BTRFS_I(inode)->force_compress)
+		if (BTRFS_I(inode)->force_compress) {
 			compress_type = BTRFS_I(inode)->force_compress;
+			compress_level = BTRFS_I(inode)->force_compress_level;
+		}
 
 		/*
 		 * we need to call clear_page_dirty_for_io on each
@@ -504,7 +507,7 @@ again:
 		 */
 		extent_range_clear_dirty_for_io(inode, start, end);
 		redirty = 1;
-		ret = btrfs_compress_pages(compress_type,
+		ret = btrfs_compress_pages(compress_type, compress_level,
 					   inode->i_mapping, start,
 					   total_compressed, pages,
 					   nr_pages, &nr_pages_ret,
@@ -4549,7 +4552,8 @@ delete:
 			BUG_ON(ret);
 			if (btrfs_should_throttle_delayed_refs(trans, root))
 				btrfs_async_run_delayed_refs(root,
-					trans->delayed_ref_updates * 2, 0);
+					trans->delayed_ref_updates * 2,
+					trans->transid, 0);
 			if (be_nice) {
 				if (truncate_space_check(trans, root,
 							 extent_num_bytes)) {
@@ -9243,6 +9247,7 @@ struct inode *btrfs_alloc_inode(struct super_block *sb)
 
 	ei->runtime_flags = 0;
 	ei->force_compress = BTRFS_COMPRESS_NONE;
+	ei->force_compress_level = 0;
 
 	ei->delayed_node = NULL;
 
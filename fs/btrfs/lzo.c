@@ -85,6 +85,7 @@ static inline size_t read_compress_length(char *buf)
 }
 
 static int lzo_compress_pages(struct list_head *ws,
+			      unsigned int level,
 			      struct address_space *mapping,
 			      u64 start, unsigned long len,
 			      struct page **pages,
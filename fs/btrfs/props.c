@@ -376,12 +376,42 @@ int btrfs_subvol_inherit_props(struct btrfs_trans_handle *trans,
 	return ret;
 }
 
+/* "zlib:N" or "zstd:N" picks a compression level, returns the type */
+static int prop_compression_level(const char *value, size_t len,
+				  unsigned int *level)
+{
+	char buf[sizeof("zlib:") + 2];
+	int type;
+
+	if (len < 4 || len >= sizeof(buf))
+		return -EINVAL;
+
+	if (!strncmp("zlib", value, 4))
+		type = BTRFS_COMPRESS_ZLIB;
+	else if (!strncmp("zstd", value, 4))
+		type = BTRFS_COMPRESS_ZSTD;
+	else
+		return -EINVAL;
+
+	memcpy(buf, value, len);
+	buf[len] = '\0';
+	if (btrfs_compress_parse_level(type, buf + 4, level))
+		return -EINVAL;
+	return type;
+}
+
 static int prop_compression_validate(const char *value, size_t len)
 {
+	unsigned int level;
+
 	if (!strncmp("lzo", value, len))
 		return 0;
 	else if (!strncmp("zlib", value, len))
 		return 0;
+	else if (!strncmp("zstd", value, len))
+		return 0;
+	else if (prop_compression_level(value, len, &level) > 0)
+		return 0;
 
 	return -EINVAL;
 }
@@ -390,12 +420,14 @@ static int prop_compression_apply(struct inode *inode,
 				  const char *value,
 				  size_t len)
 {
+	unsigned int level = 0;
 	int type;
 
 	if (len == 0) {
 		BTRFS_I(inode)->flags |= BTRFS_INODE_NOCOMPRESS;
 		BTRFS_I(inode)->flags &= ~BTRFS_INODE_COMPRESS;
 		BTRFS_I(inode)->force_compress = BTRFS_COMPRESS_NONE;
+		BTRFS_I(inode)->force_compress_level = 0;
 
 		return 0;
 	}
@@ -404,23 +436,41 @@ static int prop_compression_apply(struct inode *inode,
 		type = BTRFS_COMPRESS_LZO;
 	else if (!strncmp("zlib", value, len))
 		type = BTRFS_COMPRESS_ZLIB;
+	else if (!strncmp("zstd", value, len))
+		type = BTRFS_COMPRESS_ZSTD;
 	else
-		return -EINVAL;
+		type = prop_compression_level(value, len, &level);
+
+	if (type < 0)
+		return type;
 
 	BTRFS_I(inode)->flags &= ~BTRFS_INODE_NOCOMPRESS;
 	BTRFS_I(inode)->flags |= BTRFS_INODE_COMPRESS;
 	BTRFS_I(inode)->force_compress = type;
+	BTRFS_I(inode)->force_compress_level = level;
 
 	return 0;
 }
 
+static const char * const prop_zlib_levels[] = {
+	"zlib", "zlib:1", "zlib:2", "zlib:3", "zlib:4",
+	"zlib:5", "zlib:6", "zlib:7", "zlib:8", "zlib:9",
+};
+
+static const char * const prop_zstd_levels[] = {
+	"zstd", "zstd:1", "zstd:2", "zstd:3", "zstd:4",
+	"zstd:5", "zstd:6", "zstd:7", "zstd:8", "zstd:9",
+};
+
 static const char *prop_compression_extract(struct inode *inode)
 {
 	switch (BTRFS_I(inode)->force_compress) {
 	case BTRFS_COMPRESS_ZLIB:
-		return "zlib";
+		return prop_zlib_levels[BTRFS_I(inode)->force_compress_level];
 	case BTRFS_COMPRESS_LZO:
 		return "lzo";
+	case BTRFS_COMPRESS_ZSTD:
+		return prop_zstd_levels[BTRFS_I(inode)->force_compress_level];
 	}
 
 	return NULL;
@@ -385,6 +385,7 @@ int btrfs_parse_options(struct btrfs_root *root, char *options,
 	char *compress_type;
 	bool compress_force = false;
 	enum btrfs_compression_type saved_compress_type;
+	unsigned int saved_compress_level;
 	bool saved_compress_force;
 	int no_compress = 0;
 
@@ -474,11 +475,23 @@ int btrfs_parse_options(struct btrfs_root *root, char *options,
 				info->compress_type : BTRFS_COMPRESS_NONE;
 			saved_compress_force =
 				btrfs_test_opt(root, FORCE_COMPRESS);
+			saved_compress_level = info->compress_level;
 			if (token == Opt_compress ||
 			    token == Opt_compress_force ||
-			    strcmp(args[0].from, "zlib") == 0) {
+			    strncmp(args[0].from, "zlib", 4) == 0) {
 				compress_type = "zlib";
 				info->compress_type = BTRFS_COMPRESS_ZLIB;
+				info->compress_level = 0;
+				if (token != Opt_compress &&
+				    token != Opt_compress_force) {
+					ret = btrfs_compress_parse_level(
+						BTRFS_COMPRESS_ZLIB,
+						args[0].from + 4,
+						&info->compress_level);
+					if (ret)
+						goto out;
+					compress_type = args[0].from;
+				}
 				btrfs_set_opt(info->mount_opt, COMPRESS);
 				btrfs_clear_opt(info->mount_opt, NODATACOW);
 				btrfs_clear_opt(info->mount_opt, NODATASUM);
@@ -486,11 +499,26 @@ int btrfs_parse_options(struct btrfs_root *root, char *options,
 			} else if (strcmp(args[0].from, "lzo") == 0) {
 				compress_type = "lzo";
 				info->compress_type = BTRFS_COMPRESS_LZO;
+				info->compress_level = 0;
 				btrfs_set_opt(info->mount_opt, COMPRESS);
 				btrfs_clear_opt(info->mount_opt, NODATACOW);
 				btrfs_clear_opt(info->mount_opt, NODATASUM);
 				btrfs_set_fs_incompat(info, COMPRESS_LZO);
 				no_compress = 0;
+			} else if (strncmp(args[0].from, "zstd", 4) == 0) {
+				compress_type = args[0].from;
+				info->compress_type = BTRFS_COMPRESS_ZSTD;
+				ret = btrfs_compress_parse_level(
+					BTRFS_COMPRESS_ZSTD,
+					args[0].from + 4,
+					&info->compress_level);
+				if (ret)
+					goto out;
+				btrfs_set_opt(info->mount_opt, COMPRESS);
+				btrfs_clear_opt(info->mount_opt, NODATACOW);
+				btrfs_clear_opt(info->mount_opt, NODATASUM);
+				btrfs_set_fs_incompat(info, COMPRESS_ZSTD);
+				no_compress = 0;
 			} else if (strncmp(args[0].from, "no", 2) == 0) {
 				compress_type = "no";
 				btrfs_clear_opt(info->mount_opt, COMPRESS);
@@ -515,6 +543,7 @@ int btrfs_parse_options(struct btrfs_root *root, char *options,
 			}
 			if ((btrfs_test_opt(root, COMPRESS) &&
 			     (info->compress_type != saved_compress_type ||
+			      info->compress_level != saved_compress_level ||
 			      compress_force != saved_compress_force)) ||
 			    (!btrfs_test_opt(root, COMPRESS) &&
 			     no_compress == 1)) {
@@ -1210,12 +1239,16 @@ static int btrfs_show_options(struct seq_file *seq, struct dentry *dentry)
 	if (btrfs_test_opt(root, COMPRESS)) {
 		if (info->compress_type == BTRFS_COMPRESS_ZLIB)
 			compress_type = "zlib";
+		else if (info->compress_type == BTRFS_COMPRESS_ZSTD)
+			compress_type = "zstd";
 		else
 			compress_type = "lzo";
 		if (btrfs_test_opt(root, FORCE_COMPRESS))
 			seq_printf(seq, ",compress-force=%s", compress_type);
 		else
 			seq_printf(seq, ",compress=%s", compress_type);
+		if (info->compress_level)
+			seq_printf(seq, ":%u", info->compress_level);
 	}
 	if (btrfs_test_opt(root, NOSSD))
 		seq_puts(seq, ",nossd");
@@ -1684,6 +1717,7 @@ static int btrfs_remount(struct super_block *sb, int *flags, char *data)
 	unsigned old_flags = sb->s_flags;
 	unsigned long old_opts = fs_info->mount_opt;
 	unsigned long old_compress_type = fs_info->compress_type;
+	unsigned int old_compress_level = fs_info->compress_level;
 	u64 old_max_inline = fs_info->max_inline;
 	u64 old_alloc_start = fs_info->alloc_start;
 	int old_thread_pool_size = fs_info->thread_pool_size;
@@ -1820,6 +1854,7 @@ restore:
 	sb->s_flags = old_flags;
 	fs_info->mount_opt = old_opts;
 	fs_info->compress_type = old_compress_type;
+	fs_info->compress_level = old_compress_level;
 	fs_info->max_inline = old_max_inline;
 	mutex_lock(&fs_info->chunk_mutex);
 	fs_info->alloc_start = old_alloc_start;
@@ -200,6 +200,7 @@ BTRFS_FEAT_ATTR_INCOMPAT(mixed_backref, MIXED_BACKREF);
 BTRFS_FEAT_ATTR_INCOMPAT(default_subvol, DEFAULT_SUBVOL);
 BTRFS_FEAT_ATTR_INCOMPAT(mixed_groups, MIXED_GROUPS);
 BTRFS_FEAT_ATTR_INCOMPAT(compress_lzo, COMPRESS_LZO);
+BTRFS_FEAT_ATTR_INCOMPAT(compress_zstd, COMPRESS_ZSTD);
 BTRFS_FEAT_ATTR_INCOMPAT(big_metadata, BIG_METADATA);
 BTRFS_FEAT_ATTR_INCOMPAT(extended_iref, EXTENDED_IREF);
 BTRFS_FEAT_ATTR_INCOMPAT(raid56, RAID56);
@@ -212,6 +213,7 @@ static struct attribute *btrfs_supported_feature_attrs[] = {
 	BTRFS_FEAT_ATTR_PTR(default_subvol),
 	BTRFS_FEAT_ATTR_PTR(mixed_groups),
 	BTRFS_FEAT_ATTR_PTR(compress_lzo),
+	BTRFS_FEAT_ATTR_PTR(compress_zstd),
 	BTRFS_FEAT_ATTR_PTR(big_metadata),
 	BTRFS_FEAT_ATTR_PTR(extended_iref),
 	BTRFS_FEAT_ATTR_PTR(raid56),
@@ -443,11 +445,49 @@ static ssize_t btrfs_clone_alignment_show(struct kobject *kobj,
 
 BTRFS_ATTR(clone_alignment, btrfs_clone_alignment_show);
 
+/* the delayed ref backlog of the running transaction */
+static ssize_t btrfs_delayed_refs_show(struct kobject *kobj,
+				       struct kobj_attribute *a, char *buf)
+{
+	struct btrfs_fs_info *fs_info = to_fs_info(kobj);
+	struct btrfs_transaction *cur_trans;
+	unsigned long entries = 0, heads = 0, heads_ready = 0;
+	unsigned long queued = 0;
+	int i;
+
+	spin_lock(&fs_info->trans_lock);
+	cur_trans = fs_info->running_transaction;
+	if (cur_trans) {
+		entries = atomic_read(&cur_trans->delayed_refs.num_entries);
+		heads = cur_trans->delayed_refs.num_heads;
+		heads_ready = cur_trans->delayed_refs.num_heads_ready;
+	}
+	spin_unlock(&fs_info->trans_lock);
+
+	for (i = 0; i < BTRFS_DELAYED_REF_SHARDS; i++) {
+		struct btrfs_delayed_ref_shard *shard;
+
+		shard = &fs_info->delayed_ref_shards[i];
+		spin_lock(&shard->lock);
+		queued += shard->count;
+		spin_unlock(&shard->lock);
+	}
+
+	return snprintf(buf, PAGE_SIZE,
+			"entries %lu\nheads %lu\nheads_ready %lu\n"
+			"queued %lu\navg_runtime_ns %llu\n",
+			entries, heads, heads_ready, queued,
+			fs_info->avg_delayed_ref_runtime);
+}
+
+BTRFS_ATTR(delayed_refs, btrfs_delayed_refs_show);
+
 static const struct attribute *btrfs_attrs[] = {
 	BTRFS_ATTR_PTR(label),
 	BTRFS_ATTR_PTR(nodesize),
 	BTRFS_ATTR_PTR(sectorsize),
 	BTRFS_ATTR_PTR(clone_alignment),
+	BTRFS_ATTR_PTR(delayed_refs),
 	NULL,
 };
 
@@ -72,6 +72,7 @@ fail:
 }
 
 static int zlib_compress_pages(struct list_head *ws,
+			       unsigned int level,
 			       struct address_space *mapping,
 			       u64 start, unsigned long len,
 			       struct page **pages,
@@ -94,7 +95,10 @@ static int zlib_compress_pages(struct list_head *ws,
 	*total_out = 0;
 	*total_in = 0;
 
-	if (Z_OK != zlib_deflateInit(&workspace->strm, 3)) {
+	if (!level)
+		level = BTRFS_ZLIB_DEFAULT_LEVEL;
+
+	if (Z_OK != zlib_deflateInit(&workspace->strm, level)) {
 		printk(KERN_WARNING "BTRFS: deflateInit failed\n");
 		ret = -EIO;
 		goto out;
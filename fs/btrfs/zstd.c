@@ -0,0 +1,409 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/pagemap.h>
+#include <linux/bio.h>
+#include <linux/sizes.h>
+#include <linux/zstd.h>
+#include "compression.h"
+
+/*
+ * A compressed extent never holds more than 128k of data, so that is all
+ * the window either side needs.
+ */
+#define ZSTD_BTRFS_MAX_INPUT		SZ_128K
+
+struct workspace {
+	void *mem;
+	size_t size;
+	char *buf;	/* where decompressed data goes */
+	struct list_head list;
+};
+
+static struct zstd_params zstd_btrfs_params(unsigned int level)
+{
+	if (!level)
+		level = BTRFS_ZSTD_DEFAULT_LEVEL;
+	return zstd_get_params(level, ZSTD_BTRFS_MAX_INPUT);
+}
+
+static void zstd_free_workspace(struct list_head *ws)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+
+	vfree(workspace->mem);
+	kfree(workspace->buf);
+	kfree(workspace);
+}
+
+static struct list_head *zstd_alloc_workspace(void)
+{
+	/* The highest level needs the most memory, size for that one */
+	struct zstd_params params = zstd_btrfs_params(BTRFS_ZSTD_MAX_LEVEL);
+	struct workspace *workspace;
+
+	workspace = kzalloc(sizeof(*workspace), GFP_NOFS);
+	if (!workspace)
+		return ERR_PTR(-ENOMEM);
+
+	workspace->size = max(zstd_cstream_workspace_size(&params),
+		zstd_dstream_workspace_size(ZSTD_BTRFS_MAX_INPUT));
+	workspace->mem = vmalloc(workspace->size);
+	workspace->buf = kmalloc(PAGE_SIZE, GFP_NOFS);
+	if (!workspace->mem || !workspace->buf)
+		goto fail;
+
+	INIT_LIST_HEAD(&workspace->list);
+
+	return &workspace->list;
+fail:
+	zstd_free_workspace(&workspace->list);
+	return ERR_PTR(-ENOMEM);
+}
+
+static int zstd_compress_pages(struct list_head *ws,
+			       unsigned int level,
+			       struct address_space *mapping,
+			       u64 start, unsigned long len,
+			       struct page **pages,
+			       unsigned long nr_dest_pages,
+			       unsigned long *out_pages,
+			       unsigned long *total_in,
+			       unsigned long *total_out,
+			       unsigned long max_out)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+	struct zstd_params params = zstd_btrfs_params(level);
+	struct zstd_cstream *stream;
+	struct zstd_in_buffer in;
+	struct zstd_out_buffer out;
+	int ret = 0;
+	int nr_pages = 0;
+	struct page *in_page = NULL;
+	struct page *out_page = NULL;
+	unsigned long tot_in = 0;
+	unsigned long tot_out = 0;
+
+	*out_pages = 0;
+	*total_out = 0;
+	*total_in = 0;
+
+	stream = zstd_init_cstream(&params, len, workspace->mem,
+				   workspace->size);
+	if (!stream) {
+		printk(KERN_WARNING "BTRFS: zstd_init_cstream failed\n");
+		ret = -EIO;
+		goto out;
+	}
+
+	in_page = find_get_page(mapping, start >> PAGE_SHIFT);
+	in.src = kmap(in_page);
+	in.pos = 0;
+	in.size = min_t(size_t, len, PAGE_SIZE);
+
+	out_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+	if (out_page == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	pages[nr_pages++] = out_page;
+	out.dst = kmap(out_page);
+	out.pos = 0;
+	out.size = min_t(size_t, max_out, PAGE_SIZE);
+
+	while (1) {
+		ret = zstd_compress_stream(stream, &out, &in);
+		if (ret < 0) {
+			printk(KERN_DEBUG "BTRFS: zstd compress in loop returned %d\n",
+			       ret);
+			ret = -EIO;
+			goto out;
+		}
+
+		/* we're making it bigger, give up */
+		if (tot_in + in.pos > 8192 &&
+		    tot_in + in.pos < tot_out + out.pos) {
+			ret = -E2BIG;
+			goto out;
+		}
+
+		/* we've reached the end of our output range */
+		if (out.pos >= max_out) {
+			ret = -E2BIG;
+			goto out;
+		}
+
+		/* we need another page for writing out */
+		if (out.pos == out.size) {
+			tot_out += PAGE_SIZE;
+			max_out -= PAGE_SIZE;
+			kunmap(out_page);
+			if (nr_pages == nr_dest_pages) {
+				out_page = NULL;
+				ret = -E2BIG;
+				goto out;
+			}
+			out_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+			if (out_page == NULL) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			pages[nr_pages++] = out_page;
+			out.dst = kmap(out_page);
+			out.pos = 0;
+			out.size = min_t(size_t, max_out, PAGE_SIZE);
+		}
+
+		/* we're all done */
+		if (tot_in + in.pos >= len)
+			break;
+
+		/* we need another page of input */
+		if (in.pos == in.size) {
+			tot_in += PAGE_SIZE;
+			kunmap(in_page);
+			put_page(in_page);
+
+			start += PAGE_SIZE;
+			in_page = find_get_page(mapping, start >> PAGE_SHIFT);
+			in.src = kmap(in_page);
+			in.pos = 0;
+			in.size = min_t(size_t, len - tot_in, PAGE_SIZE);
+		}
+	}
+	tot_in += in.pos;
+
+	while (1) {
+		ret = zstd_end_stream(stream, &out);
+		if (ret < 0) {
+			printk(KERN_DEBUG "BTRFS: zstd end stream returned %d\n",
+			       ret);
+			ret = -EIO;
+			goto out;
+		}
+		if (ret == 0) {
+			tot_out += out.pos;
+			break;
+		}
+		if (out.pos >= max_out) {
+			ret = -E2BIG;
+			goto out;
+		}
+
+		tot_out += PAGE_SIZE;
+		max_out -= PAGE_SIZE;
+		kunmap(out_page);
+		if (nr_pages == nr_dest_pages) {
+			out_page = NULL;
+			ret = -E2BIG;
+			goto out;
+		}
+		out_page = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+		if (out_page == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		pages[nr_pages++] = out_page;
+		out.dst = kmap(out_page);
+		out.pos = 0;
+		out.size = min_t(size_t, max_out, PAGE_SIZE);
+	}
+
+	if (tot_out >= tot_in) {
+		ret = -E2BIG;
+		goto out;
+	}
+
+	ret = 0;
+	*total_out = tot_out;
+	*total_in = tot_in;
+out:
+	*out_pages = nr_pages;
+	if (out_page)
+		kunmap(out_page);
+
+	if (in_page) {
+		kunmap(in_page);
+		put_page(in_page);
+	}
+	return ret;
+}
+
+static int zstd_decompress_biovec(struct list_head *ws,
+				  struct page **pages_in,
+				  u64 disk_start,
+				  struct bio_vec *bvec,
+				  int vcnt,
+				  size_t srclen)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+	struct zstd_dstream *stream;
+	struct zstd_in_buffer in;
+	struct zstd_out_buffer out;
+	int ret = 0, ret2;
+	unsigned long page_in_index = 0;
+	unsigned long total_pages_in = DIV_ROUND_UP(srclen, PAGE_SIZE);
+	unsigned long page_out_index = 0;
+	unsigned long pg_offset = 0;
+	unsigned long buf_start;
+	unsigned long total_out = 0;
+
+	stream = zstd_init_dstream(ZSTD_BTRFS_MAX_INPUT, workspace->mem,
+				   workspace->size);
+	if (!stream) {
+		printk(KERN_WARNING "BTRFS: zstd_init_dstream failed\n");
+		return -EIO;
+	}
+
+	in.src = kmap(pages_in[page_in_index]);
+	in.pos = 0;
+	in.size = min_t(size_t, srclen, PAGE_SIZE);
+
+	out.dst = workspace->buf;
+	out.pos = 0;
+	out.size = PAGE_SIZE;
+
+	while (1) {
+		ret = zstd_decompress_stream(stream, &out, &in);
+		if (ret < 0) {
+			printk(KERN_WARNING "BTRFS: zstd decompress failed\n");
+			ret = -EIO;
+			goto done;
+		}
+		buf_start = total_out;
+		total_out += out.pos;
+		out.pos = 0;
+
+		ret2 = btrfs_decompress_buf2page(out.dst, buf_start, total_out,
+						 disk_start, bvec, vcnt,
+						 &page_out_index, &pg_offset);
+		if (ret2 == 0)
+			break;
+
+		/* the end of the frame */
+		if (ret == 0)
+			break;
+
+		/* only move on once everything decoded so far is out */
+		if (in.pos == in.size && total_out - buf_start < out.size) {
+			kunmap(pages_in[page_in_index++]);
+			if (page_in_index >= total_pages_in) {
+				in.src = NULL;
+				ret = -EIO;
+				goto done;
+			}
+			srclen -= PAGE_SIZE;
+			in.src = kmap(pages_in[page_in_index]);
+			in.pos = 0;
+			in.size = min_t(size_t, srclen, PAGE_SIZE);
+		}
+	}
+	ret = 0;
+	btrfs_clear_biovec_end(bvec, vcnt, page_out_index, pg_offset);
+done:
+	if (in.src)
+		kunmap(pages_in[page_in_index]);
+	return ret;
+}
+
+static int zstd_decompress(struct list_head *ws, unsigned char *data_in,
+			   struct page *dest_page,
+			   unsigned long start_byte,
+			   size_t srclen, size_t destlen)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+	struct zstd_dstream *stream;
+	struct zstd_in_buffer in;
+	struct zstd_out_buffer out;
+	int ret = 0;
+	unsigned long total_out = 0;
+	unsigned long pg_offset = 0;
+	char *kaddr;
+
+	stream = zstd_init_dstream(ZSTD_BTRFS_MAX_INPUT, workspace->mem,
+				   workspace->size);
+	if (!stream) {
+		printk(KERN_WARNING "BTRFS: zstd_init_dstream failed\n");
+		return -EIO;
+	}
+
+	destlen = min_t(size_t, destlen, PAGE_SIZE);
+
+	in.src = data_in;
+	in.pos = 0;
+	in.size = srclen;
+
+	out.dst = workspace->buf;
+	out.pos = 0;
+	out.size = PAGE_SIZE;
+
+	kaddr = kmap(dest_page);
+	while (pg_offset < destlen) {
+		unsigned long buf_start;
+		unsigned long buf_offset;
+		unsigned long bytes;
+
+		ret = zstd_decompress_stream(stream, &out, &in);
+		if (ret < 0) {
+			printk(KERN_WARNING "BTRFS: zstd decompress failed\n");
+			ret = -EIO;
+			goto finish;
+		}
+		buf_start = total_out;
+		total_out += out.pos;
+		out.pos = 0;
+
+		if (total_out > start_byte) {
+			buf_offset = start_byte > buf_start ?
+				     start_byte - buf_start : 0;
+			bytes = min_t(unsigned long, destlen - pg_offset,
+				      total_out - buf_start - buf_offset);
+			memcpy(kaddr + pg_offset, workspace->buf + buf_offset,
+			       bytes);
+			pg_offset += bytes;
+		}
+
+		/* the end of the frame */
+		if (ret == 0)
+			break;
+
+		/* out of input without any progress, the data is cut short */
+		if (in.pos == in.size && total_out == buf_start) {
+			ret = -EIO;
+			goto finish;
+		}
+	}
+	ret = 0;
+finish:
+	/*
+	 * btrfs_getblock is doing a zero on the tail of the page too,
+	 * but this will cover anything missing from the decompressed
+	 * data.
+	 */
+	if (pg_offset < destlen)
+		memset(kaddr + pg_offset, 0, destlen - pg_offset);
+	kunmap(dest_page);
+	return ret;
+}
+
+const struct btrfs_compress_op btrfs_zstd_compress = {
+	.alloc_workspace	= zstd_alloc_workspace,
+	.free_workspace		= zstd_free_workspace,
+	.compress_pages		= zstd_compress_pages,
+	.decompress_biovec	= zstd_decompress_biovec,
+	.decompress		= zstd_decompress,
+};
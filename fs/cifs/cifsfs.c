@@ -511,6 +511,9 @@ cifs_show_options(struct seq_file *s, struct dentry *root)
 	seq_printf(s, ",wsize=%u", cifs_sb->wsize);
 	seq_printf(s, ",echo_interval=%lu",
 			tcon->ses->server->echo_interval / HZ);
+	if (tcon->ses->server->max_credits != SMB2_MAX_CREDITS_DEFAULT)
+		seq_printf(s, ",max_credits=%u",
+			   tcon->ses->server->max_credits);
 	/* convert actimeo and display it in seconds */
 	seq_printf(s, ",actimeo=%lu", cifs_sb->actimeo / HZ);
 
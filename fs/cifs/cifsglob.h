@@ -75,6 +75,11 @@
 #define SMB_ECHO_INTERVAL_MAX 600
 #define SMB_ECHO_INTERVAL_DEFAULT 60
 
+/* SMB2 credits the client lets the server grant it at most */
+#define SMB2_MAX_CREDITS_MIN 20
+#define SMB2_MAX_CREDITS_MAX 60000
+#define SMB2_MAX_CREDITS_DEFAULT 32000
+
 #include "cifspdu.h"
 
 #ifndef XATTR_DOS_ATTRIB
@@ -510,6 +515,7 @@ struct smb_vol {
 	struct sockaddr_storage srcaddr; /* allow binding to a local IP */
 	struct nls_table *local_nls;
 	unsigned int echo_interval; /* echo interval in secs */
+	unsigned int max_credits; /* smb2 credits to ask for at most */
 };
 
 #define CIFS_MOUNT_MASK (CIFS_MOUNT_NO_PERM | CIFS_MOUNT_SET_UID | \
@@ -631,6 +637,7 @@ struct TCP_Server_Info {
 	__u8		preauth_hash[512];
 #endif /* CONFIG_CIFS_SMB2 */
 	unsigned long echo_interval;
+	unsigned int max_credits; /* smb2 credits to ask for at most */
 };
 
 static inline unsigned int
@@ -1978,13 +1978,19 @@ int cifs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 	struct cifs_sb_info *cifs_sb = CIFS_SB(dentry->d_sb);
 	struct cifs_tcon *tcon = cifs_sb_master_tcon(cifs_sb);
 	struct inode *inode = d_inode(dentry);
-	int rc;
+	int rc = 0;
+
+	/* The caller is fine with whatever we have cached */
+	if (stat->query_flags & AT_STATX_DONT_SYNC)
+		goto fill;
 
 	/*
 	 * We need to be sure that all dirty pages are written and the server
 	 * has actual ctime, mtime and file length.
 	 */
-	if (!CIFS_CACHE_READ(CIFS_I(inode)) && inode->i_mapping &&
+	if ((stat->request_mask & (STATX_CTIME | STATX_MTIME | STATX_SIZE |
+				   STATX_BLOCKS)) &&
+	    !CIFS_CACHE_READ(CIFS_I(inode)) && inode->i_mapping &&
 	    inode->i_mapping->nrpages != 0) {
 		rc = filemap_fdatawait(inode->i_mapping);
 		if (rc) {
@@ -1993,10 +1999,14 @@ int cifs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 		}
 	}
 
+	if (stat->query_flags & AT_STATX_FORCE_SYNC)
+		CIFS_I(inode)->time = 0;
+
 	rc = cifs_revalidate_dentry_attr(dentry);
 	if (rc)
 		return rc;
 
+fill:
 	generic_fillattr(inode, stat);
 	stat->blksize = CIFS_MAX_MSGSIZE;
 	stat->ino = CIFS_I(inode)->uniqueid;
@@ -78,6 +78,31 @@ static const int smb2_req_struct_sizes[NUMBER_OF_SMB2_COMMANDS] = {
 };
 
 
+/*
+ * Ask for the credits a request is charged back, plus a few more for as long
+ * as the server has granted us less than max_credits. Asking only for what
+ * is spent keeps the window where it was after session setup, and with large
+ * MTU reads and writes each charged several credits, drains it until they go
+ * out one at a time.
+ */
+#define SMB2_CREDITS_GROW 8
+
+static void
+smb2_set_credit_request(struct smb2_hdr *hdr, struct TCP_Server_Info *server)
+{
+	unsigned int request = max_t(unsigned int,
+				     le16_to_cpu(hdr->CreditCharge), 1);
+
+	spin_lock(&server->req_lock);
+	if (server->credits + server->in_flight < server->max_credits)
+		request += min_t(unsigned int, SMB2_CREDITS_GROW,
+				 server->max_credits - server->credits -
+				 server->in_flight);
+	spin_unlock(&server->req_lock);
+
+	hdr->CreditRequest = cpu_to_le16(min_t(unsigned int, request, U16_MAX));
+}
+
 static void
 smb2_hdr_assemble(struct smb2_hdr *hdr, __le16 smb2_cmd /* command */ ,
 		  const struct cifs_tcon *tcon)
@@ -113,6 +138,9 @@ smb2_hdr_assemble(struct smb2_hdr *hdr, __le16 smb2_cmd /* command */ ,
 		hdr->CreditCharge = cpu_to_le16(1);
 	/* else CreditCharge MBZ */
 
+	if (tcon->ses && tcon->ses->server)
+		smb2_set_credit_request(hdr, tcon->ses->server);
+
 	hdr->TreeId = tcon->tid;
 	/* Uid is not converted */
 	if (tcon->ses)
@@ -2036,6 +2064,7 @@ smb2_async_readv(struct cifs_readdata *rdata)
 	if (rdata->credits) {
 		buf->CreditCharge = cpu_to_le16(DIV_ROUND_UP(rdata->bytes,
 						SMB2_MAX_BUFFER_SIZE));
+		smb2_set_credit_request(buf, server);
 		spin_lock(&server->req_lock);
 		server->credits += rdata->credits -
 						le16_to_cpu(buf->CreditCharge);
@@ -2222,6 +2251,7 @@ smb2_async_writev(struct cifs_writedata *wdata,
 	if (wdata->credits) {
 		req->hdr.CreditCharge = cpu_to_le16(DIV_ROUND_UP(wdata->bytes,
 						    SMB2_MAX_BUFFER_SIZE));
+		smb2_set_credit_request(&req->hdr, server);
 		spin_lock(&server->req_lock);
 		server->credits += wdata->credits -
 					le16_to_cpu(req->hdr.CreditCharge);
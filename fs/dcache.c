@@ -39,6 +39,9 @@
 #include <linux/ratelimit.h>
 #include <linux/list_lru.h>
 #include <linux/kasan.h>
+#include <linux/kmemleak.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "internal.h"
 #include "mount.h"
@@ -99,18 +102,87 @@ static struct kmem_cache *dentry_cache __read_mostly;
  * information, yet avoid using a prime hash-size or similar.
  */
 
-static unsigned int d_hash_mask __read_mostly;
-static unsigned int d_hash_shift __read_mostly;
+/*
+ * The table grows with the number of dentries, rhashtable style: a new
+ * table is hung off ->future of the current one and the chains are moved
+ * over one entry at a time, the last entry of a chain first, under the
+ * bucket locks of both tables. A lookup that misses in a table goes on
+ * to ->future; an entry is always reachable from one of them, because it
+ * is published in the new chain before it is cut off the old one, and a
+ * walker that was on it when it moved just goes on with the new chain.
+ * Buckets below ->rehash have been moved; the bucket lock of a table is
+ * only good for inserting and removing while its bucket hasn't been.
+ */
+struct d_hash_table {
+	unsigned int shift;
+	unsigned int rehash;
+	struct d_hash_table __rcu *future;
+	struct hlist_bl_head *buckets;
+	struct page **pages;		/* unless allocated at boot */
+	unsigned int nr_pages;
+};
 
-static struct hlist_bl_head *dentry_hashtable __read_mostly;
+static struct d_hash_table d_hash_boot_table;
+static struct d_hash_table __rcu *dentry_hashtable __read_mostly =
+	&d_hash_boot_table;
 
-static inline struct hlist_bl_head *d_hash(const struct dentry *parent,
+static inline unsigned int d_hash_index(const struct d_hash_table *tbl,
+					const struct dentry *parent,
 					unsigned int hash)
 {
 	hash += (unsigned long) parent / L1_CACHE_BYTES;
-	return dentry_hashtable + hash_32(hash, d_hash_shift);
+	return hash_32(hash, tbl->shift);
+}
+
+static inline struct hlist_bl_head *d_hash(const struct d_hash_table *tbl,
+					   const struct dentry *parent,
+					   unsigned int hash)
+{
+	return tbl->buckets + d_hash_index(tbl, parent, hash);
+}
+
+/*
+ * The table to try after a miss in @tbl: the order against the chain
+ * walk makes an entry moved off the chain visible in the new table.
+ */
+static inline struct d_hash_table *d_hash_next(const struct d_hash_table *tbl)
+{
+	smp_rmb();
+	return rcu_dereference(tbl->future);
 }
 
+/*
+ * Lock the bucket that takes (or holds) dentries of @parent and @hash,
+ * whichever table it is in right now.
+ */
+static struct hlist_bl_head *d_hash_lock(const struct dentry *parent,
+					 unsigned int hash)
+{
+	struct d_hash_table *tbl;
+	struct hlist_bl_head *b;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(dentry_hashtable);
+	for (;;) {
+		unsigned int idx = d_hash_index(tbl, parent, hash);
+
+		b = tbl->buckets + idx;
+		hlist_bl_lock(b);
+		/* ->rehash only moves past us with our bucket locked */
+		if (likely(idx >= READ_ONCE(tbl->rehash)))
+			break;
+		hlist_bl_unlock(b);
+		tbl = rcu_dereference(tbl->future);
+	}
+	rcu_read_unlock();
+	return b;
+}
+
+/* how many allocations per cpu between looks at the table size */
+#define D_HASH_GROW_CHECK	1024
+
+static void d_hash_maybe_grow(void);
+
 #define IN_LOOKUP_SHIFT 10
 static struct hlist_bl_head in_lookup_hashtable[1 << IN_LOOKUP_SHIFT];
 
@@ -130,8 +202,6 @@ struct dentry_stat_t dentry_stat = {
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 
-#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
-
 /*
  * Here we resort to our own counters instead of using generic per-cpu counters
  * for consistency with what the vfs inode code does. We are expected to harvest
@@ -153,6 +223,8 @@ static long get_nr_dentry(void)
 	return sum < 0 ? 0 : sum;
 }
 
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+
 static long get_nr_dentry_unused(void)
 {
 	int i;
@@ -485,12 +557,13 @@ void __d_drop(struct dentry *dentry)
 		 * with the exception of those newly allocated by
 		 * d_obtain_alias, which are always IS_ROOT:
 		 */
-		if (unlikely(IS_ROOT(dentry)))
+		if (unlikely(IS_ROOT(dentry))) {
 			b = &dentry->d_sb->s_anon;
-		else
-			b = d_hash(dentry->d_parent, dentry->d_name.hash);
+			hlist_bl_lock(b);
+		} else {
+			b = d_hash_lock(dentry->d_parent, dentry->d_name.hash);
+		}
 
-		hlist_bl_lock(b);
 		__hlist_bl_del(&dentry->d_hash);
 		dentry->d_hash.pprev = NULL;
 		hlist_bl_unlock(b);
@@ -1618,6 +1691,8 @@ struct dentry *__d_alloc(struct super_block *sb, const struct qstr *name)
 	d_set_d_op(dentry, dentry->d_sb->s_d_op);
 
 	this_cpu_inc(nr_dentry);
+	if (unlikely(!(this_cpu_read(nr_dentry) & (D_HASH_GROW_CHECK - 1))))
+		d_hash_maybe_grow();
 
 	return dentry;
 }
@@ -2094,7 +2169,8 @@ struct dentry *__d_lookup_rcu(const struct dentry *parent,
 {
 	u64 hashlen = name->hash_len;
 	const unsigned char *str = name->name;
-	struct hlist_bl_head *b = d_hash(parent, hashlen_hash(hashlen));
+	struct d_hash_table *tbl = rcu_dereference(dentry_hashtable);
+	struct hlist_bl_head *b;
 	struct hlist_bl_node *node;
 	struct dentry *dentry;
 
@@ -2118,6 +2194,8 @@ struct dentry *__d_lookup_rcu(const struct dentry *parent,
 	 *
 	 * See Documentation/filesystems/path-lookup.txt for more details.
 	 */
+next_table:
+	b = d_hash(tbl, parent, hashlen_hash(hashlen));
 	hlist_bl_for_each_entry_rcu(dentry, node, b, d_hash) {
 		unsigned seq;
 
@@ -2162,6 +2240,9 @@ seqretry:
 		if (!dentry_cmp(dentry, str, hashlen_len(hashlen)))
 			return dentry;
 	}
+	tbl = d_hash_next(tbl);
+	if (unlikely(tbl))
+		goto next_table;
 	return NULL;
 }
 
@@ -2211,7 +2292,8 @@ struct dentry *__d_lookup(const struct dentry *parent, const struct qstr *name)
 	unsigned int len = name->len;
 	unsigned int hash = name->hash;
 	const unsigned char *str = name->name;
-	struct hlist_bl_head *b = d_hash(parent, hash);
+	struct d_hash_table *tbl;
+	struct hlist_bl_head *b;
 	struct hlist_bl_node *node;
 	struct dentry *found = NULL;
 	struct dentry *dentry;
@@ -2237,7 +2319,9 @@ struct dentry *__d_lookup(const struct dentry *parent, const struct qstr *name)
 	 * See Documentation/filesystems/path-lookup.txt for more details.
 	 */
 	rcu_read_lock();
-	
+	tbl = rcu_dereference(dentry_hashtable);
+next_table:
+	b = d_hash(tbl, parent, hash);
 	hlist_bl_for_each_entry_rcu(dentry, node, b, d_hash) {
 
 		if (dentry->d_name.hash != hash)
@@ -2272,6 +2356,11 @@ struct dentry *__d_lookup(const struct dentry *parent, const struct qstr *name)
 next:
 		spin_unlock(&dentry->d_lock);
  	}
+	if (!found) {
+		tbl = d_hash_next(tbl);
+		if (unlikely(tbl))
+			goto next_table;
+	}
  	rcu_read_unlock();
 
  	return found;
@@ -2354,17 +2443,20 @@ again:
 }
 EXPORT_SYMBOL(d_delete);
 
-static void __d_rehash(struct dentry * entry, struct hlist_bl_head *b)
+static void __d_rehash(struct dentry *entry, const struct dentry *parent,
+		       unsigned int hash)
 {
+	struct hlist_bl_head *b;
+
 	BUG_ON(!d_unhashed(entry));
-	hlist_bl_lock(b);
+	b = d_hash_lock(parent, hash);
 	hlist_bl_add_head_rcu(&entry->d_hash, b);
 	hlist_bl_unlock(b);
 }
 
 static void _d_rehash(struct dentry * entry)
 {
-	__d_rehash(entry, d_hash(entry->d_parent, entry->d_name.hash));
+	__d_rehash(entry, entry->d_parent, entry->d_name.hash);
 }
 
 /**
@@ -2821,7 +2913,7 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 	 * for the same hash queue because of how unlikely it is.
 	 */
 	__d_drop(dentry);
-	__d_rehash(dentry, d_hash(target->d_parent, target->d_name.hash));
+	__d_rehash(dentry, target->d_parent, target->d_name.hash);
 
 	/*
 	 * Unhash the target (d_delete() is not usable here).  If exchanging
@@ -2829,8 +2921,7 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 	 */
 	__d_drop(target);
 	if (exchange) {
-		__d_rehash(target,
-			   d_hash(dentry->d_parent, dentry->d_name.hash));
+		__d_rehash(target, dentry->d_parent, dentry->d_name.hash);
 	}
 
 	/* Switch the names.. */
@@ -3572,6 +3663,184 @@ void d_tmpfile(struct dentry *dentry, struct inode *inode)
 }
 EXPORT_SYMBOL(d_tmpfile);
 
+/*
+ * Growing the hash table: up to one bucket per dentry once there are two
+ * per bucket, and up to 1/256 of the memory, four times the boot default.
+ */
+static unsigned int d_hash_max_shift __read_mostly;
+static DEFINE_MUTEX(d_hash_resize_mutex);
+
+static void d_hash_grow_workfn(struct work_struct *work);
+static DECLARE_WORK(d_hash_grow_work, d_hash_grow_workfn);
+
+static void d_hash_maybe_grow(void)
+{
+	unsigned int shift;
+
+	rcu_read_lock();
+	shift = rcu_dereference(dentry_hashtable)->shift;
+	rcu_read_unlock();
+
+	if (shift < d_hash_max_shift && get_nr_dentry() > (2UL << shift))
+		schedule_work(&d_hash_grow_work);
+}
+
+static void d_hash_free(struct d_hash_table *tbl)
+{
+	unsigned int i;
+
+	if (tbl == &d_hash_boot_table) {
+		void *start = tbl->buckets;
+		void *end = start + (sizeof(struct hlist_bl_head) << tbl->shift);
+
+		/* see alloc_large_system_hash() */
+		if (hashdist) {
+			vfree(start);
+		} else {
+			kmemleak_free(start);
+			free_reserved_area(start, end, -1, "Dentry cache");
+		}
+		return;
+	}
+
+	if (tbl->buckets)
+		vunmap(tbl->buckets);
+	if (tbl->pages) {
+		for (i = 0; i < tbl->nr_pages; i++)
+			if (tbl->pages[i])
+				__free_page(tbl->pages[i]);
+		vfree(tbl->pages);
+	}
+	kfree(tbl);
+}
+
+/*
+ * The table is spread over the online nodes page by page, as hashdist
+ * has the boot table spread, so that no node gets all the remote misses.
+ */
+static struct d_hash_table *d_hash_alloc(unsigned int shift)
+{
+	unsigned long size = sizeof(struct hlist_bl_head) << shift;
+	struct d_hash_table *tbl;
+	int node = first_online_node;
+	unsigned int i;
+
+	tbl = kzalloc(sizeof(*tbl), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	tbl->shift = shift;
+	tbl->nr_pages = DIV_ROUND_UP(size, PAGE_SIZE);
+	tbl->pages = vzalloc(tbl->nr_pages * sizeof(struct page *));
+	if (!tbl->pages)
+		goto fail;
+
+	for (i = 0; i < tbl->nr_pages; i++) {
+		tbl->pages[i] = alloc_pages_node(node, GFP_KERNEL | __GFP_ZERO |
+						 __GFP_NOWARN | __GFP_NORETRY, 0);
+		if (!tbl->pages[i])
+			goto fail;
+		node = next_online_node(node);
+		if (node == MAX_NUMNODES)
+			node = first_online_node;
+	}
+
+	/* zeroed buckets are empty, unlocked hlist_bl heads */
+	tbl->buckets = vmap(tbl->pages, tbl->nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!tbl->buckets)
+		goto fail;
+	return tbl;
+
+fail:
+	d_hash_free(tbl);
+	return NULL;
+}
+
+/*
+ * Move the chain of bucket @idx of @old over to @new, last entry first,
+ * see the comment at struct d_hash_table.
+ */
+static void d_hash_rehash_bucket(struct d_hash_table *old,
+				 struct d_hash_table *new, unsigned int idx)
+{
+	struct hlist_bl_head *b = old->buckets + idx;
+
+again:
+	hlist_bl_lock(b);
+	for (;;) {
+		struct hlist_bl_node *node, *last = NULL, **pprev;
+		struct hlist_bl_head *nb;
+		struct dentry *dentry;
+
+		for (node = hlist_bl_first(b); node; node = node->next)
+			last = node;
+		if (!last)
+			break;
+
+		/*
+		 * __d_move() hashes a dentry under the new name before it
+		 * copies the name over, d_lock keeps us out of that window.
+		 */
+		dentry = hlist_bl_entry(last, struct dentry, d_hash);
+		if (!spin_trylock(&dentry->d_lock)) {
+			hlist_bl_unlock(b);
+			cpu_relax();
+			goto again;
+		}
+
+		pprev = last->pprev;
+		nb = d_hash(new, dentry->d_parent, dentry->d_name.hash);
+		hlist_bl_lock(nb);
+		last->next = hlist_bl_first(nb);
+		if (last->next)
+			last->next->pprev = &last->next;
+		last->pprev = &nb->first;
+		hlist_bl_set_first_rcu(nb, last);
+		hlist_bl_unlock(nb);
+
+		/* published in @new before it goes off the old chain */
+		smp_wmb();
+		if (pprev == &b->first)
+			hlist_bl_set_first_rcu(b, NULL);
+		else
+			WRITE_ONCE(*pprev, NULL);
+		spin_unlock(&dentry->d_lock);
+	}
+	WRITE_ONCE(old->rehash, idx + 1);
+	hlist_bl_unlock(b);
+}
+
+static void d_hash_grow_workfn(struct work_struct *work)
+{
+	struct d_hash_table *old, *new;
+	unsigned long nr = get_nr_dentry();
+	unsigned int shift, i;
+
+	mutex_lock(&d_hash_resize_mutex);
+	old = rcu_dereference_protected(dentry_hashtable,
+				lockdep_is_held(&d_hash_resize_mutex));
+	shift = min_t(unsigned int, nr ? ilog2(nr) + 1 : 0, d_hash_max_shift);
+	if (shift <= old->shift)
+		goto out;
+
+	new = d_hash_alloc(shift);
+	if (!new)
+		goto out;
+
+	rcu_assign_pointer(old->future, new);
+	for (i = 0; i < (1U << old->shift); i++) {
+		d_hash_rehash_bucket(old, new, i);
+		cond_resched();
+	}
+	rcu_assign_pointer(dentry_hashtable, new);
+
+	/* lookups and d_hash_lock() may still be looking at @old */
+	synchronize_rcu();
+	d_hash_free(old);
+out:
+	mutex_unlock(&d_hash_resize_mutex);
+}
+
 static __initdata unsigned long dhash_entries;
 static int __init set_dhash_entries(char *str)
 {
@@ -3582,35 +3851,58 @@ static int __init set_dhash_entries(char *str)
 }
 __setup("dhash_entries=", set_dhash_entries);
 
-static void __init dcache_init_early(void)
+static void __init d_hash_init(int flags)
 {
+	struct d_hash_table *tbl = &d_hash_boot_table;
 	unsigned int loop;
 
-	/* If hashes are distributed across NUMA nodes, defer
-	 * hash allocation until vmalloc space is available.
-	 */
-	if (hashdist)
-		return;
-
-	dentry_hashtable =
+	tbl->buckets =
 		alloc_large_system_hash("Dentry cache",
 					sizeof(struct hlist_bl_head),
 					dhash_entries,
 					13,
-					HASH_EARLY,
-					&d_hash_shift,
-					&d_hash_mask,
+					flags,
+					&tbl->shift,
+					NULL,
 					0,
 					0);
 
-	for (loop = 0; loop < (1U << d_hash_shift); loop++)
-		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
+	for (loop = 0; loop < (1U << tbl->shift); loop++)
+		INIT_HLIST_BL_HEAD(tbl->buckets + loop);
 }
 
-static void __init dcache_init(void)
+/*
+ * Growing needs the workqueues, and a size given on the command line
+ * is kept.
+ */
+static int __init d_hash_grow_init(void)
 {
-	unsigned int loop;
+	unsigned long max_buckets;
+
+	if (dhash_entries)
+		return 0;
+
+	max_buckets = (totalram_pages << PAGE_SHIFT) / 256 /
+		      sizeof(struct hlist_bl_head);
+	if (max_buckets && ilog2(max_buckets) > d_hash_boot_table.shift)
+		d_hash_max_shift = ilog2(max_buckets);
+	return 0;
+}
+core_initcall(d_hash_grow_init);
+
+static void __init dcache_init_early(void)
+{
+	/* If hashes are distributed across NUMA nodes, defer
+	 * hash allocation until vmalloc space is available.
+	 */
+	if (hashdist)
+		return;
 
+	d_hash_init(HASH_EARLY);
+}
+
+static void __init dcache_init(void)
+{
 	/* 
 	 * A constructor could be added for stable state like the lists,
 	 * but it is probably not worth it because of the cache nature
@@ -3623,19 +3915,7 @@ static void __init dcache_init(void)
 	if (!hashdist)
 		return;
 
-	dentry_hashtable =
-		alloc_large_system_hash("Dentry cache",
-					sizeof(struct hlist_bl_head),
-					dhash_entries,
-					13,
-					0,
-					&d_hash_shift,
-					&d_hash_mask,
-					0,
-					0);
-
-	for (loop = 0; loop < (1U << d_hash_shift); loop++)
-		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
+	d_hash_init(0);
 }
 
 /* SLAB cache for __getname() consumers */
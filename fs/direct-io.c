@@ -145,6 +145,9 @@ struct dio {
 
 static struct kmem_cache *dio_cache __read_mostly;
 
+/* bios of direct IO are short lived, keep them cached per cpu */
+static struct bio_set *dio_bio_set __read_mostly;
+
 /*
  * How many pages are in the queue?
  */
@@ -368,10 +371,10 @@ dio_bio_alloc(struct dio *dio, struct dio_submit *sdio,
 	struct bio *bio;
 
 	/*
-	 * bio_alloc() is guaranteed to return a bio when called with
+	 * bio_alloc_bioset() is guaranteed to return a bio when called with
 	 * __GFP_RECLAIM and we request a valid number of vectors.
 	 */
-	bio = bio_alloc(GFP_KERNEL, nr_vecs);
+	bio = bio_alloc_bioset(GFP_KERNEL, nr_vecs, dio_bio_set);
 
 	bio->bi_bdev = bdev;
 	bio->bi_iter.bi_sector = first_sector;
@@ -1355,6 +1358,10 @@ EXPORT_SYMBOL(__blockdev_direct_IO);
 static __init int dio_init(void)
 {
 	dio_cache = KMEM_CACHE(dio, SLAB_PANIC);
+
+	dio_bio_set = bioset_create(BIO_POOL_SIZE, 0);
+	if (!dio_bio_set || bioset_cache_create(dio_bio_set))
+		panic("dio: can't allocate bios\n");
 	return 0;
 }
 module_init(dio_init)
@@ -128,6 +128,7 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 		 */
 		ext4_clear_inode_flag(file_inode(file),
 				      EXT4_INODE_INDEX);
+		ext4_set_inode_flags(file_inode(file));
 	}
 
 	if (ext4_has_inline_data(inode)) {
@@ -442,9 +443,12 @@ int ext4_htree_store_dirent(struct file *dir_file, __u32 hash,
 	info = dir_file->private_data;
 	p = &info->root.rb_node;
 
-	/* Create and allocate the fname structure */
+	/*
+	 * Create and allocate the fname structure, no fs reclaim with
+	 * i_dir_sem held
+	 */
 	len = sizeof(struct fname) + ent_name->len + 1;
-	new_fn = kzalloc(len, GFP_KERNEL);
+	new_fn = kzalloc(len, GFP_NOFS);
 	if (!new_fn)
 		return -ENOMEM;
 	new_fn->hash = hash;
@@ -227,6 +227,11 @@ struct ext4_io_submit {
  */
 #define EXT4_LINK_MAX		65000
 
+/*
+ * Number of leaf block locks of htree directories per filesystem
+ */
+#define EXT4_DIR_LEAF_LOCKS	64
+
 /*
  * Macro-instructions used to manage several block sizes
  */
@@ -1008,6 +1013,13 @@ struct ext4_inode_info {
 	 * to occasionally drop it.
 	 */
 	struct rw_semaphore i_mmap_sem;
+	/*
+	 * i_dir_sem is taken shared by the changes to single leaf blocks of
+	 * an htree directory, which then also hold the leaf lock of their
+	 * block (see ext4_dir_leaf_lock()), and exclusive by everything that
+	 * changes the index or the size of a directory.
+	 */
+	struct rw_semaphore i_dir_sem;
 	struct inode vfs_inode;
 	struct jbd2_inode *jinode;
 
@@ -1135,6 +1147,7 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DIOREAD_NOLOCK	0x400000 /* Enable support for dio read nolocking */
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
+#define EXT4_MOUNT_JOURNAL_FAST_COMMIT	0x2000000 /* Fast commits on fsync */
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
 #define EXT4_MOUNT_BLOCK_VALIDITY	0x20000000 /* Block validity checking */
@@ -1400,6 +1413,8 @@ struct ext4_sb_info {
 	struct journal_s *s_journal;
 	struct list_head s_orphan;
 	struct mutex s_orphan_lock;
+	/* Leaf block locks of htree directories, hashed on inode and block */
+	struct rw_semaphore s_dir_leaf_locks[EXT4_DIR_LEAF_LOCKS];
 	unsigned long s_resize_flags;		/* Flags indicating if there
 						   is a resizer */
 	unsigned long s_commit_interval;
@@ -1430,6 +1445,12 @@ struct ext4_sb_info {
 	unsigned short *s_mb_offsets;
 	unsigned int *s_mb_maxs;
 	unsigned int s_group_info_size;
+	/* groups by the order of their largest and average free extents */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	struct list_head *s_mb_avg_fragment_size;
+	rwlock_t *s_mb_avg_fragment_size_locks;
+	atomic_t s_mb_groups_need_init;	/* groups not on those lists yet */
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -1439,6 +1460,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_optimize_scan;
 	unsigned int s_max_dir_size_kb;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -2952,7 +2974,11 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_size_order;/* order of average frag */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct          list_head bb_largest_free_order_node;
+	struct          list_head bb_avg_fragment_size_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -84,6 +84,36 @@ static int ext4_sync_parent(struct inode *inode)
  * inode to disk.
  */
 
+/*
+ * Write just the raw inode to the fast commit area of the journal if that
+ * is all the running transaction changed, ext4_do_update_inode() leaves
+ * it to us.  Updates are locked while the raw inode is copied, nobody
+ * changes it then.
+ */
+static int ext4_fc_commit(journal_t *journal, struct inode *inode,
+			  tid_t commit_tid)
+{
+	struct ext4_iloc iloc;
+	int err;
+
+	err = jbd2_fc_begin_commit(journal, commit_tid);
+	if (err)
+		return err;
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (!err) {
+		err = jbd2_fc_add(journal, iloc.bh->b_blocknr, iloc.offset,
+				  ext4_raw_inode(&iloc),
+				  EXT4_INODE_SIZE(inode->i_sb));
+		brelse(iloc.bh);
+	}
+	if (err) {
+		jbd2_fc_abort_commit(journal);
+		return err;
+	}
+	return jbd2_fc_end_commit(journal);
+}
+
 int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 {
 	struct inode *inode = file->f_mapping->host;
@@ -135,6 +165,10 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	/* the fast commit block flushes the data written above */
+	if (test_opt(inode->i_sb, JOURNAL_FAST_COMMIT) &&
+	    !ext4_fc_commit(journal, inode, commit_tid))
+		goto out;
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
@@ -4319,8 +4319,13 @@ void ext4_set_inode_flags(struct inode *inode)
 		new_fl |= S_DIRSYNC;
 	if (test_opt(inode->i_sb, DAX) && S_ISREG(inode->i_mode))
 		new_fl |= S_DAX;
+	/* entries of htree directories are added and removed leaf by leaf */
+	if (S_ISDIR(inode->i_mode) && (flags & EXT4_INDEX_FL) &&
+	    ext4_has_feature_dir_index(inode->i_sb))
+		new_fl |= S_PARALLEL_DIROPS;
 	inode_set_flags(inode, new_fl,
-			S_SYNC|S_APPEND|S_IMMUTABLE|S_NOATIME|S_DIRSYNC|S_DAX);
+			S_SYNC|S_APPEND|S_IMMUTABLE|S_NOATIME|S_DIRSYNC|S_DAX|
+			S_PARALLEL_DIROPS);
 }
 
 /* Propagate flags from i_flags to EXT4_I(inode)->i_flags */
@@ -4871,7 +4876,12 @@ static int ext4_do_update_inode(handle_t *handle,
 					      bh->b_data);
 
 	BUFFER_TRACE(bh, "call ext4_handle_dirty_metadata");
+	/* fsync can fast commit a raw inode, see ext4_fc_commit() */
+	if (ext4_handle_valid(handle))
+		handle->h_fc_exempt = 1;
 	rc = ext4_handle_dirty_metadata(handle, NULL, bh);
+	if (ext4_handle_valid(handle))
+		handle->h_fc_exempt = 0;
 	if (!err)
 		err = rc;
 	ext4_clear_inode_state(inode, EXT4_STATE_NEW);
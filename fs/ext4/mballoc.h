@@ -72,6 +72,16 @@ extern ushort ext4_mballoc_debug;
  */
 #define MB_DEFAULT_ORDER2_REQS		2
 
+/*
+ * pick groups from the lists by order for the first two criteria
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/*
+ * number of orders of free extents in a group, the buddy has one less
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 /*
  * default group prealloc size 512 blocks
  */
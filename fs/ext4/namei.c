@@ -33,6 +33,7 @@
 #include <linux/quotaops.h>
 #include <linux/buffer_head.h>
 #include <linux/bio.h>
+#include <linux/hash.h>
 #include "ext4.h"
 #include "ext4_jbd2.h"
 
@@ -47,6 +48,48 @@
 #define NAMEI_RA_BLOCKS  4
 #define NAMEI_RA_SIZE	     (NAMEI_RA_CHUNKS * NAMEI_RA_BLOCKS)
 
+/*
+ * Entries of htree directories are added and removed with i_dir_sem held
+ * shared and the leaf lock of the one block they touch, as long as the
+ * leaf has room.  Everything else, splits, appends, the linear and inline
+ * directories, runs with i_dir_sem held exclusive.  Searches take the leaf
+ * locks shared, with i_dir_sem held shared against changes to the index.
+ *
+ * Returns true if i_dir_sem was taken shared.
+ */
+static bool ext4_dir_lock(struct inode *dir)
+{
+	struct ext4_inode_info *ei = EXT4_I(dir);
+
+	down_read(&ei->i_dir_sem);
+	if (is_dx(dir) && !ext4_has_inline_data(dir))
+		return true;
+	up_read(&ei->i_dir_sem);
+	down_write(&ei->i_dir_sem);
+	return false;
+}
+
+static void ext4_dir_unlock(struct inode *dir, bool shared)
+{
+	if (shared)
+		up_read(&EXT4_I(dir)->i_dir_sem);
+	else
+		up_write(&EXT4_I(dir)->i_dir_sem);
+}
+
+/*
+ * Keyed on the logical block the lock can be taken before the block is
+ * read, so nobody verifies the checksum of a block that is being changed.
+ */
+static struct rw_semaphore *ext4_dir_leaf_lock(struct inode *dir,
+					       ext4_lblk_t block)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(dir->i_sb);
+
+	return &sbi->s_dir_leaf_locks[hash_64(((u64)dir->i_ino << 32) + block,
+					      ilog2(EXT4_DIR_LEAF_LOCKS))];
+}
+
 static struct buffer_head *ext4_append(handle_t *handle,
 					struct inode *inode,
 					ext4_lblk_t *block)
@@ -271,9 +314,10 @@ static int ext4_htree_next_block(struct inode *dir, __u32 hash,
 				 __u32 *start_hash);
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 		struct ext4_filename *fname,
-		struct ext4_dir_entry_2 **res_dir);
+		struct ext4_dir_entry_2 **res_dir, ext4_lblk_t *lblk);
 static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
-			     struct inode *dir, struct inode *inode);
+			     struct inode *dir, struct inode *inode,
+			     bool shared);
 
 /* checksumming functions */
 void initialize_dirent_tail(struct ext4_dir_entry_tail *t,
@@ -951,14 +995,19 @@ static int htree_dirblock_to_tree(struct file *dir_file,
 {
 	struct buffer_head *bh;
 	struct ext4_dir_entry_2 *de, *top;
+	struct rw_semaphore *leaf;
 	int err = 0, count = 0;
 	struct ext4_str fname_crypto_str = {.name = NULL, .len = 0}, tmp_str;
 
 	dxtrace(printk(KERN_INFO "In htree dirblock_to_tree: block %lu\n",
 							(unsigned long)block));
+	leaf = ext4_dir_leaf_lock(dir, block);
+	down_read(leaf);
 	bh = ext4_read_dirblock(dir, block, DIRENT);
-	if (IS_ERR(bh))
+	if (IS_ERR(bh)) {
+		up_read(leaf);
 		return PTR_ERR(bh);
+	}
 
 	de = (struct ext4_dir_entry_2 *) bh->b_data;
 	top = (struct ext4_dir_entry_2 *) ((char *) de +
@@ -970,12 +1019,14 @@ static int htree_dirblock_to_tree(struct file *dir_file,
 		err = ext4_get_encryption_info(dir);
 		if (err < 0) {
 			brelse(bh);
+			up_read(leaf);
 			return err;
 		}
 		err = ext4_fname_crypto_alloc_buffer(dir, EXT4_NAME_LEN,
 						     &fname_crypto_str);
 		if (err < 0) {
 			brelse(bh);
+			up_read(leaf);
 			return err;
 		}
 	}
@@ -1024,6 +1075,7 @@ static int htree_dirblock_to_tree(struct file *dir_file,
 	}
 errout:
 	brelse(bh);
+	up_read(leaf);
 #ifdef CONFIG_EXT4_FS_ENCRYPTION
 	ext4_fname_crypto_free_buffer(&fname_crypto_str);
 #endif
@@ -1079,9 +1131,12 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 	}
 	hinfo.hash = start_hash;
 	hinfo.minor_hash = 0;
+	down_read(&EXT4_I(dir)->i_dir_sem);
 	frame = dx_probe(NULL, dir, &hinfo, frames);
-	if (IS_ERR(frame))
+	if (IS_ERR(frame)) {
+		up_read(&EXT4_I(dir)->i_dir_sem);
 		return PTR_ERR(frame);
+	}
 
 	/* Add '.' and '..' from the htree header */
 	if (!start_hash && !start_minor_hash) {
@@ -1138,11 +1193,13 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 			break;
 	}
 	dx_release(frames);
+	up_read(&EXT4_I(dir)->i_dir_sem);
 	dxtrace(printk(KERN_DEBUG "Fill tree: returned %d entries, "
 		       "next hash: %x\n", count, *next_hash));
 	return count;
 errout:
 	dx_release(frames);
+	up_read(&EXT4_I(dir)->i_dir_sem);
 	return (err);
 }
 
@@ -1336,7 +1393,7 @@ static int is_dx_internal_node(struct inode *dir, ext4_lblk_t block,
 }
 
 /*
- *	ext4_find_entry()
+ *	__ext4_find_entry()
  *
  * finds an entry in the specified directory with the wanted name. It
  * returns the cache buffer in which the entry was found, and the entry
@@ -1344,12 +1401,13 @@ static int is_dx_internal_node(struct inode *dir, ext4_lblk_t block,
  * entry - you'll have to do that yourself if you want to.
  *
  * The returned buffer_head has ->b_count elevated.  The caller is expected
- * to brelse() it when appropriate.
+ * to brelse() it when appropriate.  If lblk is given the logical block of
+ * the buffer is stored there, for the leaf lock of a later change.
  */
-static struct buffer_head * ext4_find_entry (struct inode *dir,
+static struct buffer_head * __ext4_find_entry(struct inode *dir,
 					const struct qstr *d_name,
 					struct ext4_dir_entry_2 **res_dir,
-					int *inlined)
+					int *inlined, ext4_lblk_t *lblk)
 {
 	struct super_block *sb;
 	struct buffer_head *bh_use[NAMEI_RA_SIZE];
@@ -1364,6 +1422,7 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 	ext4_lblk_t  nblocks;
 	int i, namelen, retval;
 	struct ext4_filename fname;
+	struct rw_semaphore *leaf;
 
 	*res_dir = NULL;
 	sb = dir->i_sb;
@@ -1397,7 +1456,7 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 		goto restart;
 	}
 	if (is_dx(dir)) {
-		ret = ext4_dx_find_entry(dir, &fname, res_dir);
+		ret = ext4_dx_find_entry(dir, &fname, res_dir, lblk);
 		/*
 		 * On success, or if the error was file not found,
 		 * return.  Otherwise, fall back to doing a search the
@@ -1457,11 +1516,14 @@ restart:
 			brelse(bh);
 			goto next;
 		}
+		leaf = ext4_dir_leaf_lock(dir, block);
+		down_read(leaf);
 		if (!buffer_verified(bh) &&
 		    !is_dx_internal_node(dir, block,
 					 (struct ext4_dir_entry *)bh->b_data) &&
 		    !ext4_dirent_csum_verify(dir,
 				(struct ext4_dir_entry *)bh->b_data)) {
+			up_read(leaf);
 			EXT4_ERROR_INODE(dir, "checksumming directory "
 					 "block %lu", (unsigned long)block);
 			brelse(bh);
@@ -1470,8 +1532,11 @@ restart:
 		set_buffer_verified(bh);
 		i = search_dirblock(bh, dir, &fname, d_name,
 			    block << EXT4_BLOCK_SIZE_BITS(sb), res_dir);
+		up_read(leaf);
 		if (i == 1) {
 			EXT4_I(dir)->i_dir_start_lookup = block;
+			if (lblk)
+				*lblk = block;
 			ret = bh;
 			goto cleanup_and_exit;
 		} else {
@@ -1503,13 +1568,22 @@ cleanup_and_exit:
 	return ret;
 }
 
+static inline struct buffer_head *ext4_find_entry(struct inode *dir,
+					const struct qstr *d_name,
+					struct ext4_dir_entry_2 **res_dir,
+					int *inlined)
+{
+	return __ext4_find_entry(dir, d_name, res_dir, inlined, NULL);
+}
+
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 			struct ext4_filename *fname,
-			struct ext4_dir_entry_2 **res_dir)
+			struct ext4_dir_entry_2 **res_dir, ext4_lblk_t *lblk)
 {
 	struct super_block * sb = dir->i_sb;
 	struct dx_frame frames[2], *frame;
 	const struct qstr *d_name = fname->usr_fname;
+	struct rw_semaphore *leaf;
 	struct buffer_head *bh;
 	ext4_lblk_t block;
 	int retval;
@@ -1522,15 +1596,23 @@ static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 		return (struct buffer_head *) frame;
 	do {
 		block = dx_get_block(frame->at);
+		leaf = ext4_dir_leaf_lock(dir, block);
+		down_read(leaf);
 		bh = ext4_read_dirblock(dir, block, DIRENT);
-		if (IS_ERR(bh))
+		if (IS_ERR(bh)) {
+			up_read(leaf);
 			goto errout;
+		}
 
 		retval = search_dirblock(bh, dir, fname, d_name,
 					 block << EXT4_BLOCK_SIZE_BITS(sb),
 					 res_dir);
-		if (retval == 1)
+		up_read(leaf);
+		if (retval == 1) {
+			if (lblk)
+				*lblk = block;
 			goto success;
+		}
 		brelse(bh);
 		if (retval == -1) {
 			bh = ERR_PTR(ERR_BAD_DX_DIR);
@@ -1562,6 +1644,7 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
 	struct inode *inode;
 	struct ext4_dir_entry_2 *de;
 	struct buffer_head *bh;
+	__u32 ino = 0;
 
        if (ext4_encrypted_inode(dir)) {
                int res = ext4_get_encryption_info(dir);
@@ -1584,12 +1667,16 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
 	if (dentry->d_name.len > EXT4_NAME_LEN)
 		return ERR_PTR(-ENAMETOOLONG);
 
+	/* creates and unlinks may run alongside, see ext4_dir_lock() */
+	down_read(&EXT4_I(dir)->i_dir_sem);
 	bh = ext4_find_entry(dir, &dentry->d_name, &de, NULL);
+	if (!IS_ERR_OR_NULL(bh))
+		ino = le32_to_cpu(de->inode);
+	up_read(&EXT4_I(dir)->i_dir_sem);
 	if (IS_ERR(bh))
 		return (struct dentry *) bh;
 	inode = NULL;
 	if (bh) {
-		__u32 ino = le32_to_cpu(de->inode);
 		brelse(bh);
 		if (!ext4_valid_inum(dir->i_sb, ino)) {
 			EXT4_ERROR_INODE(dir, "bad inode number: %u", ino);
@@ -1941,7 +2028,7 @@ static int add_dirent_to_buf(handle_t *handle, struct ext4_filename *fname,
 	 */
 	dir->i_mtime = dir->i_ctime = ext4_current_time(dir);
 	ext4_update_dx_flag(dir);
-	dir->i_version++;
+	inode_inc_iversion(dir);
 	ext4_mark_inode_dirty(handle, dir);
 	BUFFER_TRACE(bh, "call ext4_handle_dirty_metadata");
 	err = ext4_handle_dirty_dirent_node(handle, dir, bh);
@@ -2004,6 +2091,7 @@ static int make_indexed_dir(handle_t *handle, struct ext4_filename *fname,
 		return PTR_ERR(bh2);
 	}
 	ext4_set_inode_flag(dir, EXT4_INODE_INDEX);
+	ext4_set_inode_flags(dir);
 	data1 = bh2->b_data;
 
 	memcpy (data1, de, len);
@@ -2098,6 +2186,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	unsigned blocksize;
 	ext4_lblk_t block, blocks;
 	int	csum_size = 0;
+	bool	shared;
 
 	if (ext4_has_metadata_csum(inode->i_sb))
 		csum_size = sizeof(struct ext4_dir_entry_tail);
@@ -2111,6 +2200,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	if (retval)
 		return retval;
 
+	shared = ext4_dir_lock(dir);
 	if (ext4_has_inline_data(dir)) {
 		retval = ext4_try_add_inline_entry(handle, &fname, dir, inode);
 		if (retval < 0)
@@ -2121,11 +2211,20 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 		}
 	}
 
+retry:
 	if (is_dx(dir)) {
-		retval = ext4_dx_add_entry(handle, &fname, dir, inode);
+		retval = ext4_dx_add_entry(handle, &fname, dir, inode, shared);
+		if (shared && (retval == -EAGAIN || retval == ERR_BAD_DX_DIR)) {
+			/* the leaf needs a split or the index is bad */
+			ext4_dir_unlock(dir, shared);
+			down_write(&EXT4_I(dir)->i_dir_sem);
+			shared = false;
+			goto retry;
+		}
 		if (!retval || (retval != ERR_BAD_DX_DIR))
 			goto out;
 		ext4_clear_inode_flag(dir, EXT4_INODE_INDEX);
+		ext4_set_inode_flags(dir);
 		dx_fallback++;
 		ext4_mark_inode_dirty(handle, dir);
 	}
@@ -2168,6 +2267,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 
 	retval = add_dirent_to_buf(handle, &fname, dir, inode, de, bh);
 out:
+	ext4_dir_unlock(dir, shared);
 	ext4_fname_free_filename(&fname);
 	brelse(bh);
 	if (retval == 0)
@@ -2176,13 +2276,17 @@ out:
 }
 
 /*
- * Returns 0 for success, or a negative error value
+ * Returns 0 for success, or a negative error value.  With i_dir_sem only
+ * held shared the entry is added to the leaf if it fits, -EAGAIN is
+ * returned if the leaf would need a split.
  */
 static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
-			     struct inode *dir, struct inode *inode)
+			     struct inode *dir, struct inode *inode,
+			     bool shared)
 {
 	struct dx_frame frames[2], *frame;
 	struct dx_entry *entries, *at;
+	struct rw_semaphore *leaf = NULL;
 	struct buffer_head *bh;
 	struct super_block *sb = dir->i_sb;
 	struct ext4_dir_entry_2 *de;
@@ -2193,6 +2297,10 @@ static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
 		return PTR_ERR(frame);
 	entries = frame->entries;
 	at = frame->at;
+	if (shared) {
+		leaf = ext4_dir_leaf_lock(dir, dx_get_block(frame->at));
+		down_write(leaf);
+	}
 	bh = ext4_read_dirblock(dir, dx_get_block(frame->at), DIRENT);
 	if (IS_ERR(bh)) {
 		err = PTR_ERR(bh);
@@ -2208,6 +2316,10 @@ static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
 	err = add_dirent_to_buf(handle, fname, dir, inode, NULL, bh);
 	if (err != -ENOSPC)
 		goto cleanup;
+	if (shared) {
+		err = -EAGAIN;
+		goto cleanup;
+	}
 
 	/* Block full, should compress but for now just split */
 	dxtrace(printk(KERN_DEBUG "using %u of %u node entries\n",
@@ -2313,6 +2425,8 @@ journal_error:
 	ext4_std_error(dir->i_sb, err);
 cleanup:
 	brelse(bh);
+	if (leaf)
+		up_write(leaf);
 	dx_release(frames);
 	return err;
 }
@@ -2350,7 +2464,7 @@ int ext4_generic_delete_entry(handle_t *handle,
 					blocksize);
 			else
 				de->inode = 0;
-			dir->i_version++;
+			inode_inc_iversion(dir);
 			return 0;
 		}
 		i += ext4_rec_len_from_disk(de->rec_len, blocksize);
@@ -3005,9 +3119,12 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 {
 	int retval;
 	struct inode *inode;
-	struct buffer_head *bh;
+	struct buffer_head *bh = NULL;
 	struct ext4_dir_entry_2 *de;
-	handle_t *handle = NULL;
+	struct rw_semaphore *leaf = NULL;
+	handle_t *handle;
+	ext4_lblk_t lblk;
+	bool shared;
 
 	trace_ext4_unlink_enter(dir, dentry);
 	/* Initialize quotas before so that eventual writes go
@@ -3019,10 +3136,23 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (retval)
 		return retval;
 
+	/* the handle goes before i_dir_sem, see ext4_dir_lock() */
+	handle = ext4_journal_start(dir, EXT4_HT_DIR,
+				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
+	if (IS_ERR(handle)) {
+		retval = PTR_ERR(handle);
+		trace_ext4_unlink_exit(dentry, retval);
+		return retval;
+	}
+
+	shared = ext4_dir_lock(dir);
 	retval = -ENOENT;
-	bh = ext4_find_entry(dir, &dentry->d_name, &de, NULL);
-	if (IS_ERR(bh))
-		return PTR_ERR(bh);
+	bh = __ext4_find_entry(dir, &dentry->d_name, &de, NULL, &lblk);
+	if (IS_ERR(bh)) {
+		retval = PTR_ERR(bh);
+		bh = NULL;
+		goto end_unlink;
+	}
 	if (!bh)
 		goto end_unlink;
 
@@ -3032,14 +3162,6 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (le32_to_cpu(de->inode) != inode->i_ino)
 		goto end_unlink;
 
-	handle = ext4_journal_start(dir, EXT4_HT_DIR,
-				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
-	if (IS_ERR(handle)) {
-		retval = PTR_ERR(handle);
-		handle = NULL;
-		goto end_unlink;
-	}
-
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
@@ -3048,7 +3170,17 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 				   dentry->d_name.len, dentry->d_name.name);
 		set_nlink(inode, 1);
 	}
+	/*
+	 * Entries of the leaf may have come and gone since the search, but
+	 * with i_dir_sem held none of them moved.
+	 */
+	if (shared) {
+		leaf = ext4_dir_leaf_lock(dir, lblk);
+		down_write(leaf);
+	}
 	retval = ext4_delete_entry(handle, dir, de, bh);
+	if (leaf)
+		up_write(leaf);
 	if (retval)
 		goto end_unlink;
 	dir->i_ctime = dir->i_mtime = ext4_current_time(dir);
@@ -3061,9 +3193,9 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	ext4_mark_inode_dirty(handle, inode);
 
 end_unlink:
+	ext4_dir_unlock(dir, shared);
 	brelse(bh);
-	if (handle)
-		ext4_journal_stop(handle);
+	ext4_journal_stop(handle);
 	trace_ext4_unlink_exit(dentry, retval);
 	return retval;
 }
@@ -898,6 +898,10 @@ static inline bool is_idle(struct f2fs_sb_info *sbi)
 	if (rl->count[BLK_RW_SYNC] || rl->count[BLK_RW_ASYNC])
 		return 0;
 
+	/* blk-mq queues have no request list, see what is in flight */
+	if (part_in_flight(bdev->bd_part))
+		return 0;
+
 	return f2fs_time_over(sbi, REQ_TIME);
 }
 
@@ -29,6 +29,7 @@ static int gc_thread_func(void *data)
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
 	long wait_ms;
+	unsigned int i;
 
 	wait_ms = gc_th->min_sleep_time;
 
@@ -69,16 +70,39 @@ static int gc_thread_func(void *data)
 			continue;
 		}
 
-		if (has_enough_invalid_blocks(sbi))
+		gc_th->gc_urgent = need_urgent_gc(sbi);
+		if (gc_th->gc_urgent)
+			wait_ms = gc_th->min_sleep_time;
+		else if (has_enough_invalid_blocks(sbi))
 			decrease_sleep_time(gc_th, &wait_ms);
 		else
 			increase_sleep_time(gc_th, &wait_ms);
 
-		stat_inc_bggc_count(sbi);
-
-		/* if return value is not zero, no victim was selected */
-		if (f2fs_gc(sbi, test_opt(sbi, FORCE_FG_GC)))
-			wait_ms = gc_th->no_gc_sleep_time;
+		/*
+		 * Running short of space, collect up to urgent_batch sections
+		 * greedily for as long as the device stays idle, rather than
+		 * one per wakeup.
+		 */
+		for (i = 0; ; ) {
+			stat_inc_bggc_count(sbi);
+
+			/* if return value is not zero, no victim was selected */
+			if (f2fs_gc(sbi, test_opt(sbi, FORCE_FG_GC))) {
+				if (!i)
+					wait_ms = gc_th->no_gc_sleep_time;
+				break;
+			}
+			if (!gc_th->gc_urgent || ++i >= gc_th->urgent_batch ||
+					!need_urgent_gc(sbi))
+				break;
+			if (!mutex_trylock(&sbi->gc_mutex))
+				break;
+			if (!is_idle(sbi)) {
+				mutex_unlock(&sbi->gc_mutex);
+				break;
+			}
+		}
+		gc_th->gc_urgent = false;
 
 		trace_f2fs_background_gc(sbi->sb, wait_ms,
 				prefree_segments(sbi), free_segments(sbi));
@@ -107,6 +131,8 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->no_gc_sleep_time = DEF_GC_THREAD_NOGC_SLEEP_TIME;
 
 	gc_th->gc_idle = 0;
+	gc_th->urgent_batch = DEF_GC_URGENT_BATCH;
+	gc_th->gc_urgent = false;
 
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
@@ -140,6 +166,9 @@ static int select_gc_type(struct f2fs_gc_kthread *gc_th, int gc_type)
 			gc_mode = GC_CB;
 		else if (gc_th->gc_idle == 2)
 			gc_mode = GC_GREEDY;
+	} else if (gc_th && gc_th->gc_urgent && gc_type == BG_GC) {
+		/* free sections are needed soon, not the best ones */
+		gc_mode = GC_GREEDY;
 	}
 	return gc_mode;
 }
@@ -257,6 +286,45 @@ static unsigned int count_bits(const unsigned long *addr,
 	return sum;
 }
 
+/*
+ * Pick the cheapest of the first max_search sections of the victim index.
+ * Buckets are visited from the fewest valid blocks up, so for greedy
+ * nothing later can beat a candidate found in the current bucket; cost-
+ * benefit keeps looking as an older, fuller section may still win.
+ */
+static void get_victim_from_index(struct f2fs_sb_info *sbi, int gc_type,
+					struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int nsearched = 0;
+	struct list_head *pos;
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++) {
+		list_for_each(pos, &dirty_i->victim_buckets[i]) {
+			unsigned int secno = pos - dirty_i->victim_entries;
+			unsigned int segno = secno * sbi->segs_per_sec;
+			unsigned int cost;
+
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+					test_bit(secno, dirty_i->victim_secmap))
+				continue;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+			}
+			if (++nsearched >= p->max_search)
+				return;
+		}
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO)
+			return;
+	}
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -292,6 +360,11 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS) {
+		get_victim_from_index(sbi, gc_type, &p);
+		goto selected;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -340,6 +413,7 @@ next:
 			break;
 		}
 	}
+selected:
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
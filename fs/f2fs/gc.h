@@ -19,6 +19,9 @@
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
+/* sections collected per background pass when space runs low */
+#define DEF_GC_URGENT_BATCH	8
+
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
@@ -33,6 +36,10 @@ struct f2fs_gc_kthread {
 
 	/* for changing gc mode */
 	unsigned int gc_idle;
+
+	/* for background gc close to foreground gc */
+	unsigned int urgent_batch;
+	bool gc_urgent;
 };
 
 struct gc_inode_list {
@@ -86,6 +93,16 @@ static inline void decrease_sleep_time(struct f2fs_gc_kthread *gc_th,
 		*wait = gc_th->min_sleep_time;
 }
 
+/*
+ * Foreground GC steps in at has_not_enough_free_secs(sbi, 0), and writers
+ * then wait for it. Another reserved_sections() before that, background GC
+ * starts hurrying to keep it from getting there.
+ */
+static inline bool need_urgent_gc(struct f2fs_sb_info *sbi)
+{
+	return has_not_enough_free_secs(sbi, -reserved_sections(sbi));
+}
+
 static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 {
 	block_t invalid_user_blocks = sbi->user_block_count -
@@ -489,6 +489,29 @@ void destroy_flush_cmd_control(struct f2fs_sb_info *sbi)
 	SM_I(sbi)->cmd_control_info = NULL;
 }
 
+/*
+ * Move the section of segno to the bucket for its valid blocks, or out of the
+ * victim index once none of its segments is dirty any more.
+ */
+static void __update_victim_index(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SECNO(sbi, segno);
+	unsigned int start = secno * sbi->segs_per_sec;
+	unsigned int end = start + sbi->segs_per_sec;
+	struct list_head *entry = &dirty_i->victim_entries[secno];
+	unsigned int valid_blocks;
+
+	if (find_next_bit(dirty_i->dirty_segmap[DIRTY], end, start) >= end) {
+		list_del_init(entry);
+		return;
+	}
+
+	valid_blocks = get_valid_blocks(sbi, segno, sbi->segs_per_sec);
+	list_move_tail(entry,
+		&dirty_i->victim_buckets[victim_bucket(sbi, valid_blocks)]);
+}
+
 static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		enum dirty_type dirty_type)
 {
@@ -511,6 +534,8 @@ static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		}
 		if (!test_and_set_bit(segno, dirty_i->dirty_segmap[t]))
 			dirty_i->nr_dirty[t]++;
+
+		__update_victim_index(sbi, segno);
 	}
 }
 
@@ -532,6 +557,8 @@ static void __remove_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		if (get_valid_blocks(sbi, segno, sbi->segs_per_sec) == 0)
 			clear_bit(GET_SECNO(sbi, segno),
 						dirty_i->victim_secmap);
+
+		__update_victim_index(sbi, segno);
 	}
 }
 
@@ -2298,10 +2325,28 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+static int init_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int i;
+
+	dirty_i->victim_entries = f2fs_kvzalloc(MAIN_SECS(sbi) *
+				sizeof(struct list_head), GFP_KERNEL);
+	if (!dirty_i->victim_entries)
+		return -ENOMEM;
+
+	for (i = 0; i < MAIN_SECS(sbi); i++)
+		INIT_LIST_HEAD(&dirty_i->victim_entries[i]);
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++)
+		INIT_LIST_HEAD(&dirty_i->victim_buckets[i]);
+	return 0;
+}
+
 static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = kzalloc(sizeof(struct dirty_seglist_info), GFP_KERNEL);
@@ -2319,6 +2364,10 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 			return -ENOMEM;
 	}
 
+	err = init_victim_index(sbi);
+	if (err)
+		return err;
+
 	init_dirty_segmap(sbi);
 	return init_victim_secmap(sbi);
 }
@@ -2443,6 +2492,7 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	kvfree(dirty_i->victim_entries);
 	SM_I(sbi)->dirty_info = NULL;
 	kfree(dirty_i);
 }
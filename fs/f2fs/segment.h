@@ -241,12 +241,23 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * Dirty sections are kept in NR_VICTIM_BUCKETS lists by how many valid blocks
+ * they have, so victim selection looks at the emptiest sections first instead
+ * of scanning the whole dirty bitmap. Within a list, the section whose valid
+ * blocks changed longest ago comes first.
+ */
+#define NR_VICTIM_BUCKETS	64
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	struct list_head victim_buckets[NR_VICTIM_BUCKETS];
+						/* dirty sections by valid blocks */
+	struct list_head *victim_entries;	/* per section, in victim_buckets */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -296,6 +307,14 @@ static inline struct sec_entry *get_sec_entry(struct f2fs_sb_info *sbi,
 	return &sit_i->sec_entries[GET_SECNO(sbi, segno)];
 }
 
+static inline unsigned int victim_bucket(struct f2fs_sb_info *sbi,
+						unsigned int valid_blocks)
+{
+	unsigned int blocks_per_sec = sbi->blocks_per_seg * sbi->segs_per_sec;
+
+	return valid_blocks * NR_VICTIM_BUCKETS / (blocks_per_sec + 1);
+}
+
 static inline unsigned int get_valid_blocks(struct f2fs_sb_info *sbi,
 				unsigned int segno, int section)
 {
@@ -318,15 +318,68 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
+/*
+ * The ids of the per-CPU queues have the top bit set and the CPU in the
+ * low bits, so that they stay unique over the connection without a shared
+ * counter.
+ */
+#define FUSE_CPU_UNIQUE		(1ULL << 63)
+#define FUSE_CPU_UNIQUE_SHIFT	16
+
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	fiq->reqctr += fiq->reqstep;
+	return fiq->reqctr;
+}
+
+/*
+ * Return the input queue for a request submitted on @cpu, locked: the
+ * queue of that CPU if a device is bound to it, the common one otherwise.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc, int cpu)
+__acquires(fiq->waitq.lock)
+{
+	struct fuse_iqueue **cpu_iq = smp_load_acquire(&fc->cpu_iq);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iq) {
+		fiq = smp_load_acquire(&cpu_iq[cpu]);
+		if (fiq) {
+			spin_lock(&fiq->waitq.lock);
+			if (fiq->bound)
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+
+	fiq = &fc->iq;
+	spin_lock(&fiq->waitq.lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue a pending request is on; it may move from a
+ * per-CPU queue to the common one while we wait for the lock.
+ */
+static struct fuse_iqueue *fuse_lock_req_iqueue(struct fuse_req *req)
+__acquires(fiq->waitq.lock)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		spin_lock(&fiq->waitq.lock);
+		if (req->fiq == fiq)
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
 }
 
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -357,12 +410,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_iqueue(fc, req->cpu);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -457,7 +510,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_req_iqueue(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -478,10 +531,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc, raw_smp_processor_id());
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -589,6 +642,7 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 		atomic_inc(&fc->num_waiting);
 	}
 	__set_bit(FR_ISREPLY, &req->flags);
+	req->cpu = smp_processor_id();
 	fc->num_background++;
 	if (fc->num_background == fc->max_background)
 		fc->blocked = 1;
@@ -1237,7 +1291,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = fud->fiq;
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1318,7 +1372,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 
 	return reqsize;
 
@@ -2059,7 +2113,7 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return POLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = fud->fiq;
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2105,6 +2159,18 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+static void fuse_abort_iqueue(struct fuse_iqueue *fiq, struct list_head *head)
+{
+	spin_lock(&fiq->waitq.lock);
+	fiq->connected = 0;
+	list_splice_init(&fiq->pending, head);
+	while (forget_pending(fiq))
+		kfree(dequeue_forget(fiq, 1, NULL));
+	wake_up_all_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /*
  * Abort all requests.
  *
@@ -2125,8 +2191,6 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
@@ -2158,14 +2222,16 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		fc->max_background = UINT_MAX;
 		flush_bg_queue(fc);
 
-		spin_lock(&fiq->waitq.lock);
-		fiq->connected = 0;
-		list_splice_init(&fiq->pending, &to_end2);
-		while (forget_pending(fiq))
-			kfree(dequeue_forget(fiq, 1, NULL));
-		wake_up_all_locked(&fiq->waitq);
-		spin_unlock(&fiq->waitq.lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		fuse_abort_iqueue(&fc->iq, &to_end2);
+		if (fc->cpu_iq) {
+			int cpu;
+
+			for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+				if (fc->cpu_iq[cpu])
+					fuse_abort_iqueue(fc->cpu_iq[cpu],
+							  &to_end2);
+			}
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2183,6 +2249,36 @@ void fuse_abort_conn(struct fuse_conn *fc)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * Unbind a device from a per-CPU queue.  With the last one gone, the
+ * requests still pending there move over to the common queue.
+ */
+static void fuse_dev_unbind_queue(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = fud->fiq;
+	struct fuse_iqueue *common = &fud->fc->iq;
+	struct fuse_req *req;
+	bool moved = false;
+
+	if (fiq == common)
+		return;
+
+	spin_lock(&fiq->waitq.lock);
+	if (!--fiq->bound && !list_empty(&fiq->pending)) {
+		spin_lock_nested(&common->waitq.lock, SINGLE_DEPTH_NESTING);
+		list_for_each_entry(req, &fiq->pending, list)
+			req->fiq = common;
+		list_splice_tail_init(&fiq->pending, &common->pending);
+		wake_up_all_locked(&common->waitq);
+		spin_unlock(&common->waitq.lock);
+		moved = true;
+	}
+	spin_unlock(&fiq->waitq.lock);
+	if (moved)
+		kill_fasync(&common->fasync, SIGIO, POLL_IN);
+	fud->fiq = common;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2193,6 +2289,7 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		WARN_ON(!list_empty(&fpq->io));
 		end_requests(fc, &fpq->processing);
+		fuse_dev_unbind_queue(fud);
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2212,7 +2309,73 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	return fasync_helper(fd, file, on, &fud->fiq->fasync);
+}
+
+/*
+ * Bind a device to the input queue of a CPU.  The queue is created with
+ * the first device bound to it and stays around until the connection goes
+ * away, only the routing to it stops while no device is bound.
+ */
+static int fuse_dev_bind_queue(struct file *file, struct fuse_dev *fud,
+			       u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue **cpu_iq = NULL;
+	struct fuse_iqueue *fiq, *new;
+	int err;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	/* fasync_helper() could not find the entry again at release */
+	if (fud->fiq != &fc->iq || (file->f_flags & FASYNC))
+		return -EBUSY;
+
+	if (!READ_ONCE(fc->cpu_iq)) {
+		cpu_iq = kcalloc(nr_cpu_ids, sizeof(*cpu_iq), GFP_KERNEL);
+		if (!cpu_iq)
+			return -ENOMEM;
+	}
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new) {
+		kfree(cpu_iq);
+		return -ENOMEM;
+	}
+
+	spin_lock(&fc->lock);
+	err = -ENODEV;
+	if (!fc->connected)
+		goto out_unlock;
+
+	err = -EBUSY;
+	if (fud->fiq != &fc->iq)
+		goto out_unlock;
+
+	if (!fc->cpu_iq) {
+		smp_store_release(&fc->cpu_iq, cpu_iq);
+		cpu_iq = NULL;
+	}
+	fiq = fc->cpu_iq[cpu];
+	if (!fiq) {
+		fuse_iqueue_init(new);
+		new->reqctr = FUSE_CPU_UNIQUE | cpu;
+		new->reqstep = 1ULL << FUSE_CPU_UNIQUE_SHIFT;
+		smp_store_release(&fc->cpu_iq[cpu], new);
+		fiq = new;
+		new = NULL;
+	}
+	spin_lock(&fiq->waitq.lock);
+	fiq->bound++;
+	spin_unlock(&fiq->waitq.lock);
+	fud->fiq = fiq;
+	err = 0;
+
+out_unlock:
+	spin_unlock(&fc->lock);
+	kfree(cpu_iq);
+	kfree(new);
+	return err;
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2264,6 +2427,33 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_BIND_QUEUE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		err = -EPERM;
+		if (!fud)
+			return err;
+
+		err = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *) arg))
+			err = fuse_dev_bind_queue(file, fud, cpu);
+	} else if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN ||
+		   cmd == FUSE_DEV_IOC_PASSTHROUGH_CLOSE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		int val;
+
+		err = -EPERM;
+		if (!fud)
+			return err;
+
+		err = -EFAULT;
+		if (!get_user(val, (__u32 __user *) arg)) {
+			if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN)
+				err = fuse_passthrough_open(fud->fc, val);
+			else
+				err = fuse_passthrough_close(fud->fc, val);
+		}
 	}
 	return err;
 }
@@ -23,6 +23,7 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 #include <linux/kref.h>
+#include <linux/idr.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -158,6 +159,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file reads and writes go to, for FOPEN_PASSTHROUGH */
+	struct file *passthrough;
 };
 
 /** One input argument of a request */
@@ -309,6 +313,12 @@ struct fuse_req {
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
+	/** Input queue the request is pending on, under its waitq.lock */
+	struct fuse_iqueue *fiq;
+
+	/** CPU a background request was submitted on */
+	int cpu;
+
 	/** refcount */
 	atomic_t count;
 
@@ -395,6 +405,12 @@ struct fuse_iqueue {
 	/** The next unique request id */
 	u64 reqctr;
 
+	/** Increment of the unique request ids */
+	u64 reqstep;
+
+	/** Number of devices reading this queue, for per-CPU queues */
+	unsigned bound;
+
 	/** The list of pending requests */
 	struct list_head pending;
 
@@ -436,6 +452,9 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input queue read by this device, fc->iq unless bound to a CPU */
+	struct fuse_iqueue *fiq;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -477,6 +496,13 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/**
+	 * Per-CPU input queues, allocated when devices are bound to them.
+	 * Requests submitted on a CPU with a bound device go there, all
+	 * the others, interrupts and forgets go to iq.
+	 */
+	struct fuse_iqueue **cpu_iq;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -617,6 +643,9 @@ struct fuse_conn {
 	/** Is lseek not implemented by fs? */
 	unsigned no_lseek:1;
 
+	/** Can reads and writes be passed through to a backing file? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -632,6 +661,9 @@ struct fuse_conn {
 	/** Device ID from super block */
 	dev_t dev;
 
+	/** Backing files registered for passthrough opens, by passthrough_fh */
+	struct idr passthrough_files;
+
 	/** Dentries in the control filesystem */
 	struct dentry *ctl_dentry[FUSE_CTL_NUM_DENTRIES];
 
@@ -865,6 +897,11 @@ struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
  */
 void fuse_conn_init(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
 /**
  * Release reference to fuse_conn
  */
@@ -956,4 +993,14 @@ int fuse_do_setattr(struct inode *inode, struct iattr *attr,
 
 void fuse_set_initialized(struct fuse_conn *fc);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_conn *fc, int fd);
+int fuse_passthrough_close(struct fuse_conn *fc, int passthrough_fh);
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_file *ff);
+void fuse_passthrough_free_all(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+
 #endif /* _FS_FUSE_I_H */
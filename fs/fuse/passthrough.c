@@ -0,0 +1,208 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough of reads and writes to a backing file
+ *
+ * The daemon registers an open file with FUSE_DEV_IOC_PASSTHROUGH_OPEN and
+ * hands the returned id back as passthrough_fh with FOPEN_PASSTHROUGH in an
+ * open reply. Reads and writes of that fuse file then go straight to the
+ * backing file, with the credentials it was opened with, and never reach
+ * userspace. The page cache of the fuse inode is only kept coherent with
+ * that, the way direct I/O keeps it: written back before and invalidated
+ * after the range that was passed through.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/cred.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/pagemap.h>
+#include <linux/uio.h>
+
+int fuse_passthrough_open(struct fuse_conn *fc, int fd)
+{
+	struct file *backing;
+	struct inode *inode;
+	int id;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	backing = fget(fd);
+	if (!backing)
+		return -EBADF;
+
+	id = -EINVAL;
+	inode = file_inode(backing);
+	if (!S_ISREG(inode->i_mode) ||
+	    !backing->f_op->read_iter || !backing->f_op->write_iter)
+		goto out_fput;
+
+	/* no passthrough to a passthrough filesystem, that could recurse */
+	if (inode->i_sb->s_stack_depth >= FILESYSTEM_MAX_STACK_DEPTH)
+		goto out_fput;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	id = idr_alloc(&fc->passthrough_files, backing, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (id > 0)
+		return id;
+
+out_fput:
+	fput(backing);
+	return id;
+}
+
+int fuse_passthrough_close(struct fuse_conn *fc, int passthrough_fh)
+{
+	struct file *backing;
+
+	spin_lock(&fc->lock);
+	backing = idr_find(&fc->passthrough_files, passthrough_fh);
+	if (backing)
+		idr_remove(&fc->passthrough_files, passthrough_fh);
+	spin_unlock(&fc->lock);
+	if (!backing)
+		return -ENOENT;
+
+	fput(backing);
+	return 0;
+}
+
+/*
+ * Called with the reply to an open or create: take a reference to the
+ * backing file the daemon asked for. The registration itself stays, the
+ * daemon may hand out the same backing file for several opens.
+ */
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct fuse_open_out *openarg)
+{
+	struct file *backing;
+
+	if (!(openarg->open_flags & FOPEN_PASSTHROUGH))
+		return 0;
+
+	if (!fc->passthrough)
+		return -EIO;
+
+	spin_lock(&fc->lock);
+	backing = idr_find(&fc->passthrough_files, openarg->passthrough_fh);
+	if (backing)
+		get_file(backing);
+	spin_unlock(&fc->lock);
+	if (!backing)
+		return -EIO;
+
+	ff->passthrough = backing;
+	/* the backing file does its own caching, or not */
+	ff->open_flags &= ~FOPEN_DIRECT_IO;
+	return 0;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough) {
+		fput(ff->passthrough);
+		ff->passthrough = NULL;
+	}
+}
+
+static int fuse_passthrough_put(int id, void *p, void *data)
+{
+	fput(p);
+	return 0;
+}
+
+void fuse_passthrough_free_all(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_files, fuse_passthrough_put, NULL);
+	idr_destroy(&fc->passthrough_files);
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	/* dirty pages from mmap writes go first */
+	if (file->f_mapping->nrpages) {
+		ret = filemap_write_and_wait_range(file->f_mapping, iocb->ki_pos,
+				iocb->ki_pos + iov_iter_count(to) - 1);
+		if (ret)
+			return ret;
+	}
+
+	old_cred = override_creds(backing->f_cred);
+	ret = vfs_iter_read(backing, to, &iocb->ki_pos);
+	revert_creds(old_cred);
+
+	if (ret >= 0)
+		file_accessed(file);
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	loff_t pos, start, endbyte;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(inode);
+
+	pos = iocb->ki_pos;
+	if (iocb->ki_flags & IOCB_APPEND)
+		pos = i_size_read(file_inode(backing));
+	start = pos;
+	endbyte = pos + iov_iter_count(from) - 1;
+
+	ret = filemap_write_and_wait_range(mapping, pos, endbyte);
+	if (ret)
+		goto out;
+
+	old_cred = override_creds(backing->f_cred);
+	file_start_write(backing);
+	ret = vfs_iter_write(backing, from, &pos);
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		invalidate_inode_pages2_range(mapping, start >> PAGE_SHIFT,
+					      endbyte >> PAGE_SHIFT);
+		iocb->ki_pos = pos;
+		fuse_write_update_size(inode, pos);
+	}
+	fuse_invalidate_attr(inode);
+out:
+	inode_unlock(inode);
+
+	if (ret > 0 && (iocb->ki_flags & IOCB_DSYNC)) {
+		int err = vfs_fsync_range(backing, start, pos - 1,
+					  !(iocb->ki_flags & IOCB_SYNC));
+		if (err)
+			ret = err;
+	}
+	return ret;
+}
@@ -15,6 +15,8 @@ struct linux_binprm;
 struct path;
 struct mount;
 struct shrink_control;
+struct kstat;
+struct statx;
 
 /*
  * block_dev.c
@@ -152,6 +154,11 @@ extern void mnt_pin_kill(struct mount *m);
  */
 extern struct dentry_operations ns_dentry_operations;
 
+/*
+ * stat.c
+ */
+extern int cp_statx(const struct kstat *stat, struct statx __user *buffer);
+
 /*
  * fs/ioctl.c
  */
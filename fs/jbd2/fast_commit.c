@@ -0,0 +1,247 @@
+/*
+ * linux/fs/jbd2/fast_commit.c
+ *
+ * This file is part of the Linux kernel and is made available under
+ * the terms of the GNU General Public License, version 2, or at your
+ * option, any later version, incorporated herein by reference.
+ *
+ * Fast commits for the generic filesystem journaling code.
+ *
+ * A full commit writes every metadata block of the running transaction,
+ * a descriptor and a commit block.  When the client knows what it changed
+ * in a transaction it can ask for a fast commit instead: the changed byte
+ * ranges of its blocks are written to an area at the end of the journal,
+ * one block with a single flush for the common case.
+ *
+ * Fast commit blocks carry the tid of the running transaction.  Recovery
+ * replays them on top of the last full commit when that tid is the next
+ * one expected, so a later full commit of the transaction, or any later
+ * transaction, supersedes them without the area ever being cleared.
+ *
+ * Only transactions the client dirtied nothing but fast committed metadata
+ * in are eligible, jbd2_journal_dirty_metadata() marks all others.
+ */
+
+#include <linux/time.h>
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/errno.h>
+#include <linux/crc32.h>
+#include <linux/blkdev.h>
+#include <linux/export.h>
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit of a transaction
+ * @journal: journal to commit to
+ * @tid: transaction to commit
+ *
+ * Returns 0 with updates to the journal locked if @tid can be fast
+ * committed, the caller then adds its ranges and calls
+ * jbd2_fc_end_commit() or jbd2_fc_abort_commit().  Returns -EAGAIN if a
+ * full commit is needed after all.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction;
+	tid_t committing;
+	int err = 0;
+
+	if (!journal->j_fc_blocks)
+		return -EOPNOTSUPP;
+again:
+	mutex_lock(&journal->j_fc_mutex);
+	jbd2_journal_lock_updates(journal);
+
+	read_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	if (is_journal_aborted(journal)) {
+		err = -EROFS;
+	} else if (!transaction || transaction->t_tid != tid ||
+		   transaction->t_fc_ineligible ||
+		   (journal->j_flags & JBD2_FLUSHED)) {
+		/*
+		 * Already committing, or not only metadata we fast commit
+		 * changed.  While the superblock on disk is not up to date
+		 * recovery may not even look at the log.
+		 */
+		err = -EAGAIN;
+	} else if (journal->j_committing_transaction) {
+		/*
+		 * Replay is on top of the previous transaction, it has to
+		 * be on disk first.
+		 */
+		committing = journal->j_committing_transaction->t_tid;
+		read_unlock(&journal->j_state_lock);
+		jbd2_journal_unlock_updates(journal);
+		mutex_unlock(&journal->j_fc_mutex);
+		jbd2_log_wait_commit(journal, committing);
+		goto again;
+	}
+	read_unlock(&journal->j_state_lock);
+
+	if (err) {
+		jbd2_journal_unlock_updates(journal);
+		mutex_unlock(&journal->j_fc_mutex);
+		return err;
+	}
+
+	if (journal->j_fc_tid != tid) {
+		journal->j_fc_tid = tid;
+		journal->j_fc_off = 0;
+	}
+	/* every fast commit gets blocks of its own, never rewrite a block */
+	journal->j_fc_off = roundup(journal->j_fc_off, journal->j_blocksize);
+	journal->j_fc_start = journal->j_fc_off;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+static struct buffer_head *jbd2_fc_get_buf(journal_t *journal, int index)
+{
+	struct buffer_head *bh = journal->j_fc_wbuf[index];
+	unsigned long long blocknr;
+
+	if (bh)
+		return bh;
+
+	if (jbd2_journal_bmap(journal, journal->j_fc_first + index, &blocknr))
+		return NULL;
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	journal->j_fc_wbuf[index] = bh;
+	return bh;
+}
+
+/**
+ * int jbd2_fc_add() - add a range of a block to a fast commit
+ * @journal: journal of the fast commit
+ * @blocknr: block of the client filesystem
+ * @offset: offset of the range in that block
+ * @data: new contents of the range
+ * @len: length of the range
+ *
+ * Returns -ENOSPC once the fast commit area is used up, a full commit is
+ * needed then.
+ */
+int jbd2_fc_add(journal_t *journal, unsigned long long blocknr,
+		unsigned int offset, const void *data, unsigned int len)
+{
+	unsigned int bsize = journal->j_blocksize;
+	unsigned int need = ALIGN(sizeof(jbd2_fc_tag_t) + len, 4);
+	unsigned int off = journal->j_fc_off;
+	jbd2_fc_header_t *header;
+	jbd2_fc_tag_t *tag;
+	struct buffer_head *bh;
+
+	if (offset + len > bsize ||
+	    need > bsize - sizeof(jbd2_fc_header_t))
+		return -EINVAL;
+
+	if (off % bsize && off % bsize + need > bsize)
+		off = roundup(off, bsize);
+	if (off / bsize >= journal->j_fc_blocks)
+		return -ENOSPC;
+
+	bh = jbd2_fc_get_buf(journal, off / bsize);
+	if (!bh)
+		return -EIO;
+	header = (jbd2_fc_header_t *)bh->b_data;
+
+	if (!(off % bsize)) {
+		memset(bh->b_data, 0, bsize);
+		header->fc_header.h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+		header->fc_header.h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+		header->fc_header.h_sequence = cpu_to_be32(journal->j_fc_tid);
+		off += sizeof(jbd2_fc_header_t);
+	}
+
+	tag = (jbd2_fc_tag_t *)(bh->b_data + off % bsize);
+	tag->fc_blocknr = cpu_to_be64(blocknr);
+	tag->fc_offset = cpu_to_be16(offset);
+	tag->fc_len = cpu_to_be16(len);
+	memcpy(tag + 1, data, len);
+
+	off += need;
+	header->fc_count = cpu_to_be32((off - 1) % bsize + 1 -
+				       sizeof(jbd2_fc_header_t));
+	journal->j_fc_off = off;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_add);
+
+/**
+ * int jbd2_fc_end_commit() - write out a fast commit
+ * @journal: journal of the fast commit
+ *
+ * Lets updates to the journal go on and writes and waits for the blocks
+ * of the fast commit.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	unsigned int bsize = journal->j_blocksize;
+	int first = journal->j_fc_start / bsize;
+	int last = DIV_ROUND_UP(journal->j_fc_off, bsize);
+	int i, err = 0;
+
+	jbd2_journal_unlock_updates(journal);
+
+	for (i = first; i < last; i++) {
+		struct buffer_head *bh = journal->j_fc_wbuf[i];
+		jbd2_fc_header_t *header = (jbd2_fc_header_t *)bh->b_data;
+
+		header->fc_checksum = 0;
+		header->fc_checksum = cpu_to_be32(crc32_be(~0, bh->b_data,
+							   bsize));
+	}
+
+	/* the data the client wrote has to be there before its metadata */
+	if (journal->j_fs_dev != journal->j_dev &&
+	    (journal->j_flags & JBD2_BARRIER))
+		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+
+	for (i = first; i < last; i++) {
+		struct buffer_head *bh = journal->j_fc_wbuf[i];
+
+		lock_buffer(bh);
+		clear_buffer_dirty(bh);
+		set_buffer_uptodate(bh);
+		get_bh(bh);
+		bh->b_end_io = end_buffer_write_sync;
+		if (journal->j_flags & JBD2_BARRIER)
+			submit_bh(WRITE_SYNC | WRITE_FLUSH_FUA, bh);
+		else
+			submit_bh(WRITE_SYNC, bh);
+	}
+
+	for (i = first; i < last; i++) {
+		struct buffer_head *bh = journal->j_fc_wbuf[i];
+
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+	}
+
+	if (err) {
+		/* the next fast commit must not build on this one */
+		journal->j_fc_tid = 0;
+		journal->j_fc_off = 0;
+		jbd2_journal_abort(journal, err);
+	}
+	mutex_unlock(&journal->j_fc_mutex);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * void jbd2_fc_abort_commit() - give up on a fast commit
+ * @journal: journal of the fast commit
+ *
+ * Drops what was added since jbd2_fc_begin_commit(), the caller does a
+ * full commit instead.
+ */
+void jbd2_fc_abort_commit(journal_t *journal)
+{
+	journal->j_fc_off = journal->j_fc_start;
+	jbd2_journal_unlock_updates(journal);
+	mutex_unlock(&journal->j_fc_mutex);
+}
+EXPORT_SYMBOL(jbd2_fc_abort_commit);
@@ -1105,6 +1105,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_reserved);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	mutex_init(&journal->j_fc_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	rwlock_init(&journal->j_state_lock);
@@ -1295,7 +1296,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - journal->j_fc_blocks;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1600,6 +1601,23 @@ out:
 	return err;
 }
 
+/*
+ * Set the last num_fc blocks of the journal aside for fast commits.
+ */
+static int journal_init_fc(journal_t *journal, unsigned long num_fc)
+{
+	if (!journal->j_fc_wbuf) {
+		journal->j_fc_wbuf = kcalloc(num_fc, sizeof(struct buffer_head *),
+					     GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+	}
+	journal->j_fc_blocks = num_fc;
+	journal->j_fc_first = be32_to_cpu(journal->j_superblock->s_maxlen) -
+			      num_fc;
+	return 0;
+}
+
 /*
  * Load the on-disk journal superblock and read the key fields into the
  * journal_t.
@@ -1622,6 +1640,21 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_has_feature_fast_commit(journal)) {
+		unsigned long num_fc = be32_to_cpu(sb->s_num_fc_blks);
+
+		if (num_fc + JBD2_MIN_JOURNAL_BLOCKS >
+		    journal->j_last - journal->j_first) {
+			printk(KERN_ERR "JBD2: Invalid fast commit area size "
+			       "%lu\n", num_fc);
+			return -EFSCORRUPTED;
+		}
+		err = journal_init_fc(journal, num_fc);
+		if (err)
+			return err;
+		journal->j_last = journal->j_fc_first;
+	}
+
 	return 0;
 }
 
@@ -1761,6 +1794,13 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	if (journal->j_fc_wbuf) {
+		int i;
+
+		for (i = 0; i < journal->j_fc_blocks; i++)
+			brelse(journal->j_fc_wbuf[i]);
+		kfree(journal->j_fc_wbuf);
+	}
 	kfree(journal);
 
 	return err;
@@ -1877,6 +1917,33 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 
 	sb = journal->j_superblock;
 
+	/*
+	 * The fast commit area is taken from the end of the log, which has
+	 * to be empty for that.  The superblock describing it goes out with
+	 * the next commit, no fast commit is done before.
+	 */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		unsigned long num_fc = JBD2_DEFAULT_FC_BLOCKS;
+
+		if (journal_init_fc(journal, num_fc))
+			return 0;
+		write_lock(&journal->j_state_lock);
+		if (journal->j_running_transaction ||
+		    journal->j_committing_transaction ||
+		    journal->j_head != journal->j_first ||
+		    journal->j_free != journal->j_last - journal->j_first ||
+		    journal->j_free < num_fc + JBD2_MIN_JOURNAL_BLOCKS) {
+			journal->j_fc_blocks = 0;
+			write_unlock(&journal->j_state_lock);
+			return 0;
+		}
+		sb->s_num_fc_blks = cpu_to_be32(num_fc);
+		journal->j_last = journal->j_fc_first;
+		journal->j_free -= num_fc;
+		journal->j_flags |= JBD2_FLUSHED;
+		write_unlock(&journal->j_state_lock);
+	}
+
 	/* If enabling v3 checksums, update superblock */
 	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_CSUM_V3)) {
 		sb->s_checksum_type = JBD2_CRC32C_CHKSUM;
@@ -36,6 +36,7 @@ struct recovery_info
 	int		nr_replays;
 	int		nr_revokes;
 	int		nr_revoke_hits;
+	int		nr_fc_replays;
 };
 
 enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
@@ -225,6 +226,96 @@ static int count_tags(journal_t *journal, struct buffer_head *bh)
 }
 
 
+static int jbd2_fc_block_csum_verify(journal_t *j, void *buf)
+{
+	jbd2_fc_header_t *header = buf;
+	__be32 provided;
+	__u32 calculated;
+
+	provided = header->fc_checksum;
+	header->fc_checksum = 0;
+	calculated = crc32_be(~0, buf, j->j_blocksize);
+	header->fc_checksum = provided;
+
+	return provided == cpu_to_be32(calculated);
+}
+
+/*
+ * Replay the fast commits of the first transaction that did not make it
+ * to the log, on top of everything the log had.  The valid blocks of that
+ * transaction are the ones at the start of the fast commit area.
+ */
+static int fc_replay(journal_t *journal, struct recovery_info *info)
+{
+	unsigned int bsize = journal->j_blocksize;
+	struct buffer_head *bh, *nbh;
+	int i, err = 0;
+
+	for (i = 0; i < journal->j_fc_blocks && !err; i++) {
+		jbd2_fc_header_t *header;
+		unsigned int off, end;
+
+		err = jread(&bh, journal, journal->j_fc_first + i);
+		if (err)
+			break;
+
+		header = (jbd2_fc_header_t *)bh->b_data;
+		if (header->fc_header.h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    header->fc_header.h_blocktype != cpu_to_be32(JBD2_FC_BLOCK) ||
+		    be32_to_cpu(header->fc_header.h_sequence) !=
+				info->end_transaction ||
+		    be32_to_cpu(header->fc_count) >
+				bsize - sizeof(jbd2_fc_header_t) ||
+		    !jbd2_fc_block_csum_verify(journal, bh->b_data)) {
+			brelse(bh);
+			break;
+		}
+
+		off = sizeof(jbd2_fc_header_t);
+		end = off + be32_to_cpu(header->fc_count);
+		while (off + sizeof(jbd2_fc_tag_t) <= end) {
+			jbd2_fc_tag_t *tag = (jbd2_fc_tag_t *)(bh->b_data + off);
+			unsigned int offset = be16_to_cpu(tag->fc_offset);
+			unsigned int len = be16_to_cpu(tag->fc_len);
+
+			if (off + sizeof(jbd2_fc_tag_t) + len > end ||
+			    offset + len > bsize) {
+				printk(KERN_ERR "JBD2: corrupted fast commit "
+				       "block %u\n", i);
+				err = -EFSCORRUPTED;
+				break;
+			}
+
+			nbh = __getblk(journal->j_fs_dev,
+				       be64_to_cpu(tag->fc_blocknr), bsize);
+			if (!nbh) {
+				err = -ENOMEM;
+				break;
+			}
+			if (!bh_uptodate_or_lock(nbh) && bh_submit_read(nbh)) {
+				printk(KERN_ERR "JBD2: IO error recovering "
+				       "fast commit of block %llu\n",
+				       (unsigned long long)nbh->b_blocknr);
+				brelse(nbh);
+				err = -EIO;
+				break;
+			}
+
+			lock_buffer(nbh);
+			memcpy(nbh->b_data + offset, tag + 1, len);
+			BUFFER_TRACE(nbh, "marking dirty");
+			mark_buffer_dirty(nbh);
+			unlock_buffer(nbh);
+			brelse(nbh);
+			++info->nr_fc_replays;
+
+			off += ALIGN(sizeof(jbd2_fc_tag_t) + len, 4);
+		}
+		brelse(bh);
+	}
+	return err;
+}
+
 /* Make sure we wrap around the log correctly! */
 #define wrap(journal, var)						\
 do {									\
@@ -272,12 +363,16 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err && jbd2_has_feature_fast_commit(journal))
+		err = fc_replay(journal, &info);
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
 		  err, info.start_transaction, info.end_transaction);
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
+	jbd_debug(1, "JBD2: Replayed %d fast commit ranges\n",
+		  info.nr_fc_replays);
 
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
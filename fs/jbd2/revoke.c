@@ -338,6 +338,8 @@ int jbd2_journal_revoke(handle_t *handle, unsigned long long blocknr,
 		J_ASSERT (!"Cannot set revoke feature!");
 		return -EINVAL;
 	}
+	/* revoke records only go out with a full commit */
+	handle->h_transaction->t_fc_ineligible = 1;
 
 	bdev = journal->j_fs_dev;
 	bh = bh_in;
@@ -1320,6 +1320,8 @@ int jbd2_journal_dirty_metadata(handle_t *handle, struct buffer_head *bh)
 
 	if (is_handle_aborted(handle))
 		return -EROFS;
+	if (!handle->h_fc_exempt)
+		transaction->t_fc_ineligible = 1;
 	if (!buffer_jbd(bh)) {
 		ret = -EUCLEAN;
 		goto out;
@@ -1479,6 +1481,7 @@ int jbd2_journal_forget (handle_t *handle, struct buffer_head *bh)
 	if (is_handle_aborted(handle))
 		return -EROFS;
 	journal = transaction->t_journal;
+	transaction->t_fc_ineligible = 1;
 
 	BUFFER_TRACE(bh, "entry");
 
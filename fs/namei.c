@@ -1606,23 +1606,22 @@ static int lookup_fast(struct nameidata *nd,
 	return err;
 }
 
-/* Fast lookup failed, do it the slow way */
-static struct dentry *lookup_slow(const struct qstr *name,
-				  struct dentry *dir,
-				  unsigned int flags)
+/* Fast lookup failed, do it the slow way, with dir held at least shared */
+static struct dentry *__lookup_slow(const struct qstr *name,
+				    struct dentry *dir,
+				    unsigned int flags)
 {
-	struct dentry *dentry = ERR_PTR(-ENOENT), *old;
+	struct dentry *dentry, *old;
 	struct inode *inode = dir->d_inode;
 	DECLARE_WAIT_QUEUE_HEAD_ONSTACK(wq);
 
-	inode_lock_shared(inode);
 	/* Don't go there if it's already dead */
 	if (unlikely(IS_DEADDIR(inode)))
-		goto out;
+		return ERR_PTR(-ENOENT);
 again:
 	dentry = d_alloc_parallel(dir, name, &wq);
 	if (IS_ERR(dentry))
-		goto out;
+		return dentry;
 	if (unlikely(!d_in_lookup(dentry))) {
 		if ((dentry->d_flags & DCACHE_OP_REVALIDATE) &&
 		    !(flags & LOOKUP_NO_REVAL)) {
@@ -1645,11 +1644,53 @@ again:
 			dentry = old;
 		}
 	}
-out:
+	return dentry;
+}
+
+static struct dentry *lookup_slow(const struct qstr *name,
+				  struct dentry *dir,
+				  unsigned int flags)
+{
+	struct inode *inode = dir->d_inode;
+	struct dentry *dentry;
+
+	inode_lock_shared(inode);
+	dentry = __lookup_slow(name, dir, flags);
 	inode_unlock_shared(inode);
 	return dentry;
 }
 
+/*
+ * Directories with S_PARALLEL_DIROPS set take creates through open() and
+ * unlinks with i_rwsem held shared only, the filesystem serializes what it
+ * has to within the directory.  Two of them on the same name must still
+ * not race, the bit locks hashed on the parent and the name below keep them
+ * apart.  A name lock nests inside i_rwsem and only one is ever held.
+ */
+#define NAME_LOCK_BITS	8
+static unsigned long name_locks[BITS_TO_LONGS(1 << NAME_LOCK_BITS)];
+
+static inline unsigned int name_lock_bit(struct dentry *dir,
+					 const struct qstr *name)
+{
+	return hash_long((unsigned long)dir + name->hash, NAME_LOCK_BITS);
+}
+
+static void lock_name(struct dentry *dir, const struct qstr *name)
+{
+	wait_on_bit_lock(name_locks, name_lock_bit(dir, name),
+			 TASK_UNINTERRUPTIBLE);
+}
+
+static void unlock_name(struct dentry *dir, const struct qstr *name)
+{
+	unsigned int bit = name_lock_bit(dir, name);
+
+	clear_bit_unlock(bit, name_locks);
+	smp_mb__after_atomic();
+	wake_up_bit(name_locks, bit);
+}
+
 static inline int may_lookup(struct nameidata *nd)
 {
 	if (nd->flags & LOOKUP_RCU) {
@@ -3202,6 +3243,7 @@ static int do_last(struct nameidata *nd,
 	int open_flag = op->open_flag;
 	bool will_truncate = (open_flag & O_TRUNC) != 0;
 	bool got_write = false;
+	bool parallel = false;
 	int acc_mode = op->acc_mode;
 	unsigned seq;
 	struct inode *inode;
@@ -3259,11 +3301,17 @@ static int do_last(struct nameidata *nd,
 		 */
 	}
 	if (open_flag & O_CREAT)
+		parallel = IS_PARALLEL_DIROPS(dir->d_inode);
+	if ((open_flag & O_CREAT) && !parallel)
 		inode_lock(dir->d_inode);
 	else
 		inode_lock_shared(dir->d_inode);
+	if (parallel)
+		lock_name(dir, &nd->last);
 	error = lookup_open(nd, &path, file, op, got_write, opened);
-	if (open_flag & O_CREAT)
+	if (parallel)
+		unlock_name(dir, &nd->last);
+	if ((open_flag & O_CREAT) && !parallel)
 		inode_unlock(dir->d_inode);
 	else
 		inode_unlock_shared(dir->d_inode);
@@ -3976,6 +4024,7 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 	struct inode *inode = NULL;
 	struct inode *delegated_inode = NULL;
 	unsigned int lookup_flags = 0;
+	bool parallel;
 retry:
 	name = user_path_parent(dfd, pathname,
 				&path, &last, &type, lookup_flags);
@@ -3990,8 +4039,15 @@ retry:
 	if (error)
 		goto exit1;
 retry_deleg:
-	inode_lock_nested(path.dentry->d_inode, I_MUTEX_PARENT);
-	dentry = __lookup_hash(&last, path.dentry, lookup_flags);
+	parallel = IS_PARALLEL_DIROPS(path.dentry->d_inode);
+	if (parallel) {
+		inode_lock_shared(path.dentry->d_inode);
+		lock_name(path.dentry, &last);
+		dentry = __lookup_slow(&last, path.dentry, lookup_flags);
+	} else {
+		inode_lock_nested(path.dentry->d_inode, I_MUTEX_PARENT);
+		dentry = __lookup_hash(&last, path.dentry, lookup_flags);
+	}
 	error = PTR_ERR(dentry);
 	if (!IS_ERR(dentry)) {
 		/* Why not before? Because we want correct error value */
@@ -4008,7 +4064,12 @@ retry_deleg:
 exit2:
 		dput(dentry);
 	}
-	inode_unlock(path.dentry->d_inode);
+	if (parallel) {
+		unlock_name(path.dentry, &last);
+		inode_unlock_shared(path.dentry->d_inode);
+	} else {
+		inode_unlock(path.dentry->d_inode);
+	}
 	if (inode)
 		iput(inode);	/* truncate the inode here */
 	inode = NULL;
@@ -656,11 +656,18 @@ int nfs_getattr(struct vfsmount *mnt, struct dentry *dentry, struct kstat *stat)
 {
 	struct inode *inode = d_inode(dentry);
 	int need_atime = NFS_I(inode)->cache_validity & NFS_INO_INVALID_ATIME;
+	u32 request_mask = stat->request_mask;
 	int err = 0;
 
 	trace_nfs_getattr_enter(inode);
+
+	/* The caller is fine with whatever we have cached */
+	if (stat->query_flags & AT_STATX_DONT_SYNC)
+		goto out_no_revalidate;
+
 	/* Flush out writes to the server in order to update c/mtime.  */
-	if (S_ISREG(inode->i_mode)) {
+	if ((request_mask & (STATX_CTIME | STATX_MTIME)) &&
+	    S_ISREG(inode->i_mode)) {
 		inode_lock(inode);
 		err = nfs_sync_inode(inode);
 		inode_unlock(inode);
@@ -678,22 +685,37 @@ int nfs_getattr(struct vfsmount *mnt, struct dentry *dentry, struct kstat *stat)
 	 *    no point in checking those.
 	 */
  	if ((mnt->mnt_flags & MNT_NOATIME) ||
- 	    ((mnt->mnt_flags & MNT_NODIRATIME) && S_ISDIR(inode->i_mode)))
+ 	    ((mnt->mnt_flags & MNT_NODIRATIME) && S_ISDIR(inode->i_mode)) ||
+	    !(request_mask & STATX_ATIME))
 		need_atime = 0;
 
-	if (need_atime || nfs_need_revalidate_inode(inode)) {
+	/*
+	 * The file type and inode number never change, nothing else asked
+	 * for means there is nothing to revalidate.
+	 */
+	if (!(request_mask & (STATX_MODE | STATX_NLINK | STATX_UID |
+			      STATX_GID | STATX_ATIME | STATX_MTIME |
+			      STATX_CTIME | STATX_SIZE | STATX_BLOCKS)))
+		goto out_no_revalidate;
+
+	if (need_atime || nfs_need_revalidate_inode(inode) ||
+	    (stat->query_flags & AT_STATX_FORCE_SYNC)) {
 		struct nfs_server *server = NFS_SERVER(inode);
 
 		if (server->caps & NFS_CAP_READDIRPLUS)
 			nfs_request_parent_use_readdirplus(dentry);
 		err = __nfs_revalidate_inode(server, inode);
+		if (err)
+			goto out;
 	}
-	if (!err) {
-		generic_fillattr(inode, stat);
-		stat->ino = nfs_compat_user_ino64(NFS_FILEID(inode));
-		if (S_ISDIR(inode->i_mode))
-			stat->blksize = NFS_SERVER(inode)->dtsize;
-	}
+
+	/* Only report the attributes that were revalidated */
+	stat->result_mask &= request_mask;
+out_no_revalidate:
+	generic_fillattr(inode, stat);
+	stat->ino = nfs_compat_user_ino64(NFS_FILEID(inode));
+	if (S_ISDIR(inode->i_mode))
+		stat->blksize = NFS_SERVER(inode)->dtsize;
 out:
 	trace_nfs_getattr_exit(inode, err);
 	return err;
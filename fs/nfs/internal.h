@@ -53,6 +53,12 @@ struct nfs_clone_mount {
  */
 #define NFS_MAX_SECFLAVORS	(12)
 
+/*
+ * Upper bound on the nconnect mount option, the number of TCP connections
+ * to the server.
+ */
+#define NFS_MAX_CONNECTIONS	(16)
+
 /*
  * Value used if the user did not specify a port value.
  */
@@ -71,6 +77,7 @@ struct nfs_client_initdata {
 	size_t addrlen;
 	struct nfs_subversion *nfs_mod;
 	int proto;
+	unsigned int nconnect;
 	u32 minorversion;
 	struct net *net;
 };
@@ -111,6 +118,7 @@ struct nfs_parsed_mount_data {
 		char			*export_path;
 		int			port;
 		unsigned short		protocol;
+		unsigned short		nconnect;
 	} nfs_server;
 
 	struct security_mnt_opts lsm_opts;
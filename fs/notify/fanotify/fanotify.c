@@ -1,3 +1,4 @@
+#include <linux/exportfs.h>
 #include <linux/fanotify.h>
 #include <linux/fdtable.h>
 #include <linux/fsnotify_backend.h>
@@ -11,6 +12,16 @@
 
 #include "fanotify.h"
 
+static bool fanotify_fid_equal(struct fanotify_fid *fid1,
+			       struct fanotify_fid *fid2)
+{
+	return fid1->fsid.val[0] == fid2->fsid.val[0] &&
+	       fid1->fsid.val[1] == fid2->fsid.val[1] &&
+	       fid1->handle_type == fid2->handle_type &&
+	       fid1->handle_bytes == fid2->handle_bytes &&
+	       !memcmp(fid1->f_handle, fid2->f_handle, fid1->handle_bytes);
+}
+
 static bool should_merge(struct fsnotify_event *old_fsn,
 			 struct fsnotify_event *new_fsn)
 {
@@ -20,18 +31,30 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	old = FANOTIFY_E(old_fsn);
 	new = FANOTIFY_E(new_fsn);
 
-	if (old_fsn->inode == new_fsn->inode && old->tgid == new->tgid &&
-	    old->path.mnt == new->path.mnt &&
-	    old->path.dentry == new->path.dentry)
-		return true;
-	return false;
+	if (old_fsn->inode != new_fsn->inode || old->tgid != new->tgid ||
+	    ((old_fsn->mask ^ new_fsn->mask) & FS_ISDIR))
+		return false;
+
+	if (fanotify_event_has_fid(old_fsn) != fanotify_event_has_fid(new_fsn))
+		return false;
+
+	if (fanotify_event_has_fid(old_fsn))
+		return fanotify_fid_equal(&FANOTIFY_FE(old_fsn)->fid,
+					  &FANOTIFY_FE(new_fsn)->fid);
+
+	return old->path.mnt == new->path.mnt &&
+	       old->path.dentry == new->path.dentry;
 }
 
+/* Only look this far back in the queue for an event to merge with */
+#define FANOTIFY_MAX_MERGE_EVENTS	128
+
 /* and the list better be locked by something too! */
 static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 {
 	struct fsnotify_event *test_event;
 	bool do_merge = false;
+	int i = 0;
 
 	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
 
@@ -46,6 +69,8 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 #endif
 
 	list_for_each_entry_reverse(test_event, list, list) {
+		if (++i > FANOTIFY_MAX_MERGE_EVENTS)
+			break;
 		if (should_merge(test_event, event)) {
 			do_merge = true;
 			break;
@@ -98,49 +123,72 @@ static int fanotify_get_response(struct fsnotify_group *group,
 }
 #endif
 
-static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
+static bool fanotify_should_send_event(struct fsnotify_group *group,
+				       struct fsnotify_mark *inode_mark,
 				       struct fsnotify_mark *vfsmnt_mark,
+				       struct fsnotify_mark *sb_mark,
 				       u32 event_mask,
 				       void *data, int data_type)
 {
-	__u32 marks_mask, marks_ignored_mask;
-	struct path *path = data;
+	__u32 marks_mask = 0, marks_ignored_mask = 0;
+	bool isdir;
 
-	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p mask=%x data=%p"
+	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p sb_mark=%p mask=%x data=%p"
 		 " data_type=%d\n", __func__, inode_mark, vfsmnt_mark,
-		 event_mask, data, data_type);
+		 sb_mark, event_mask, data, data_type);
 
-	/* if we don't have enough info to send an event to userspace say no */
-	if (data_type != FSNOTIFY_EVENT_PATH)
-		return false;
+	if (data_type == FSNOTIFY_EVENT_PATH) {
+		struct path *path = data;
 
-	/* sorry, fanotify only gives a damn about files and dirs */
-	if (!d_is_reg(path->dentry) &&
-	    !d_can_lookup(path->dentry))
-		return false;
+		/* sorry, fanotify only gives a damn about files and dirs */
+		if (!d_is_reg(path->dentry) &&
+		    !d_can_lookup(path->dentry))
+			return false;
+		isdir = d_is_dir(path->dentry);
+	} else if (data_type == FSNOTIFY_EVENT_INODE &&
+		   FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
+		struct inode *inode = data;
 
-	if (inode_mark && vfsmnt_mark) {
-		marks_mask = (vfsmnt_mark->mask | inode_mark->mask);
-		marks_ignored_mask = (vfsmnt_mark->ignored_mask | inode_mark->ignored_mask);
-	} else if (inode_mark) {
 		/*
-		 * if the event is for a child and this inode doesn't care about
-		 * events on the child, don't send it!
+		 * events on names are reported on the directory, whatever
+		 * the name is of
 		 */
-		if ((event_mask & FS_EVENT_ON_CHILD) &&
-		    !(inode_mark->mask & FS_EVENT_ON_CHILD))
+		if (event_mask & FAN_ALL_DIRENT_EVENTS)
+			isdir = event_mask & FS_ISDIR;
+		else if (inode && (S_ISREG(inode->i_mode) ||
+				   S_ISDIR(inode->i_mode)))
+			isdir = S_ISDIR(inode->i_mode);
+		else
 			return false;
-		marks_mask = inode_mark->mask;
-		marks_ignored_mask = inode_mark->ignored_mask;
-	} else if (vfsmnt_mark) {
-		marks_mask = vfsmnt_mark->mask;
-		marks_ignored_mask = vfsmnt_mark->ignored_mask;
 	} else {
-		BUG();
+		/* if we don't have enough info to send an event to userspace say no */
+		return false;
+	}
+
+	if (inode_mark) {
+		/*
+		 * if the event is for a child and this inode doesn't care about
+		 * events on the child, the inode mark has no say in it. Name
+		 * events are about the directory itself.
+		 */
+		if (!(event_mask & FS_EVENT_ON_CHILD) ||
+		    (event_mask & FAN_ALL_DIRENT_EVENTS) ||
+		    (inode_mark->mask & FS_EVENT_ON_CHILD))
+			marks_mask |= inode_mark->mask;
+		marks_ignored_mask |= inode_mark->ignored_mask;
 	}
 
-	if (d_is_dir(path->dentry) &&
-	    !(marks_mask & FS_ISDIR & ~marks_ignored_mask))
+	if (vfsmnt_mark) {
+		marks_mask |= vfsmnt_mark->mask;
+		marks_ignored_mask |= vfsmnt_mark->ignored_mask;
+	}
+
+	if (sb_mark) {
+		marks_mask |= sb_mark->mask;
+		marks_ignored_mask |= sb_mark->ignored_mask;
+	}
+
+	if (isdir && !(marks_mask & FS_ISDIR & ~marks_ignored_mask))
 		return false;
 
 	if (event_mask & FAN_ALL_OUTGOING_EVENTS & marks_mask &
@@ -150,8 +198,48 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 	return false;
 }
 
-struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
-						 struct path *path)
+/*
+ * The object the file handle of an event is for: the directory for the
+ * events on names, the object acted upon otherwise.
+ */
+static struct inode *fanotify_fid_inode(struct inode *to_tell, u32 mask,
+					void *data, int data_type)
+{
+	if (mask & FAN_ALL_DIRENT_EVENTS)
+		return to_tell;
+	if (data_type == FSNOTIFY_EVENT_PATH)
+		return d_inode(((struct path *)data)->dentry);
+	if (data_type == FSNOTIFY_EVENT_INODE)
+		return data;
+	return NULL;
+}
+
+static void fanotify_encode_fid(struct fanotify_fid *fid, struct inode *inode,
+				__kernel_fsid_t *fsid)
+{
+	int dwords = FANOTIFY_FH_LEN >> 2;
+	int type;
+
+	fid->fsid = *fsid;
+	fid->handle_type = FILEID_INVALID;
+	fid->handle_bytes = 0;
+	if (!inode)
+		return;
+
+	type = exportfs_encode_inode_fh(inode, (struct fid *)fid->f_handle,
+					&dwords, NULL);
+	if (type <= 0 || type == FILEID_INVALID || dwords <= 0 ||
+	    dwords > FANOTIFY_FH_LEN >> 2)
+		return;
+
+	fid->handle_type = type;
+	fid->handle_bytes = dwords << 2;
+}
+
+struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
+						 struct inode *inode, u32 mask,
+						 void *data, int data_type,
+						 __kernel_fsid_t *fsid)
 {
 	struct fanotify_event_info *event;
 
@@ -168,14 +256,29 @@ struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
 		goto init;
 	}
 #endif
+	if (fsid && FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
+		struct fanotify_fid_event_info *ffe;
+
+		ffe = kmem_cache_alloc(fanotify_fid_event_cachep, GFP_KERNEL);
+		if (!ffe)
+			return NULL;
+		fanotify_encode_fid(&ffe->fid,
+				    fanotify_fid_inode(inode, mask, data,
+						       data_type),
+				    fsid);
+		event = &ffe->fae;
+		/* no reference to the object, and no path to open later */
+		data = NULL;
+		goto init;
+	}
 	event = kmem_cache_alloc(fanotify_event_cachep, GFP_KERNEL);
 	if (!event)
 		return NULL;
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
 	event->tgid = get_pid(task_tgid(current));
-	if (path) {
-		event->path = *path;
+	if (data && data_type == FSNOTIFY_EVENT_PATH) {
+		event->path = *(struct path *)data;
 		path_get(&event->path);
 	} else {
 		event->path.mnt = NULL;
@@ -188,32 +291,41 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 				 struct inode *inode,
 				 struct fsnotify_mark *inode_mark,
 				 struct fsnotify_mark *fanotify_mark,
+				 struct fsnotify_mark *sb_mark,
 				 u32 mask, void *data, int data_type,
 				 const unsigned char *file_name, u32 cookie)
 {
 	int ret = 0;
 	struct fanotify_event_info *event;
 	struct fsnotify_event *fsn_event;
+	struct fsnotify_mark *fsn_mark;
 
 	BUILD_BUG_ON(FAN_ACCESS != FS_ACCESS);
 	BUILD_BUG_ON(FAN_MODIFY != FS_MODIFY);
 	BUILD_BUG_ON(FAN_CLOSE_NOWRITE != FS_CLOSE_NOWRITE);
 	BUILD_BUG_ON(FAN_CLOSE_WRITE != FS_CLOSE_WRITE);
 	BUILD_BUG_ON(FAN_OPEN != FS_OPEN);
+	BUILD_BUG_ON(FAN_MOVED_FROM != FS_MOVED_FROM);
+	BUILD_BUG_ON(FAN_MOVED_TO != FS_MOVED_TO);
+	BUILD_BUG_ON(FAN_CREATE != FS_CREATE);
+	BUILD_BUG_ON(FAN_DELETE != FS_DELETE);
 	BUILD_BUG_ON(FAN_EVENT_ON_CHILD != FS_EVENT_ON_CHILD);
 	BUILD_BUG_ON(FAN_Q_OVERFLOW != FS_Q_OVERFLOW);
 	BUILD_BUG_ON(FAN_OPEN_PERM != FS_OPEN_PERM);
 	BUILD_BUG_ON(FAN_ACCESS_PERM != FS_ACCESS_PERM);
 	BUILD_BUG_ON(FAN_ONDIR != FS_ISDIR);
 
-	if (!fanotify_should_send_event(inode_mark, fanotify_mark, mask, data,
-					data_type))
+	if (!fanotify_should_send_event(group, inode_mark, fanotify_mark,
+					sb_mark, mask, data, data_type))
 		return 0;
 
 	pr_debug("%s: group=%p inode=%p mask=%x\n", __func__, group, inode,
 		 mask);
 
-	event = fanotify_alloc_event(inode, mask, data);
+	/* all the marks of the event are on the same filesystem */
+	fsn_mark = inode_mark ? : fanotify_mark ? : sb_mark;
+	event = fanotify_alloc_event(group, inode, mask, data, data_type,
+				     &FANOTIFY_MARK(fsn_mark)->fsid);
 	if (unlikely(!event))
 		return -ENOMEM;
 
@@ -253,6 +365,11 @@ static void fanotify_free_event(struct fsnotify_event *fsn_event)
 	event = FANOTIFY_E(fsn_event);
 	path_put(&event->path);
 	put_pid(event->tgid);
+	if (fanotify_event_has_fid(fsn_event)) {
+		kmem_cache_free(fanotify_fid_event_cachep,
+				FANOTIFY_FE(fsn_event));
+		return;
+	}
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	if (fsn_event->mask & FAN_ALL_PERM_EVENTS) {
 		kmem_cache_free(fanotify_perm_event_cachep,
@@ -3,8 +3,25 @@
 #include <linux/slab.h>
 
 extern struct kmem_cache *fanotify_event_cachep;
+extern struct kmem_cache *fanotify_fid_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
 
+#define FAN_GROUP_FLAG(group, flag)	((group)->fanotify_data.flags & (flag))
+
+/*
+ * fanotify marks carry the filesystem id of the object they are on, for the
+ * events of FAN_REPORT_FID groups.
+ */
+struct fanotify_mark {
+	struct fsnotify_mark fsn_mark;
+	__kernel_fsid_t fsid;
+};
+
+static inline struct fanotify_mark *FANOTIFY_MARK(struct fsnotify_mark *fsn_mark)
+{
+	return container_of(fsn_mark, struct fanotify_mark, fsn_mark);
+}
+
 /*
  * Structure for normal fanotify events. It gets allocated in
  * fanotify_handle_event() and freed when the information is retrieved by
@@ -20,6 +37,37 @@ struct fanotify_event_info {
 	struct pid *tgid;
 };
 
+/*
+ * Room for the file handles of the events of FAN_REPORT_FID groups. That
+ * covers the handles of the common filesystems without the parent; an event
+ * on an object with a larger handle is reported without one.
+ */
+#define FANOTIFY_FH_LEN		40
+
+struct fanotify_fid {
+	__kernel_fsid_t fsid;
+	unsigned char f_handle[FANOTIFY_FH_LEN] __aligned(4);
+	u8 handle_type;
+	u8 handle_bytes;
+};
+
+/*
+ * Structure for the events of FAN_REPORT_FID groups. Those hold no
+ * reference to the object, the file handle is built when the event is
+ * generated and compared when merging, and no file gets opened when the
+ * event is read.
+ */
+struct fanotify_fid_event_info {
+	struct fanotify_event_info fae;
+	struct fanotify_fid fid;
+};
+
+static inline struct fanotify_fid_event_info *
+FANOTIFY_FE(struct fsnotify_event *fse)
+{
+	return container_of(fse, struct fanotify_fid_event_info, fae.fse);
+}
+
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 /*
  * Structure for permission fanotify events. It gets allocated and freed in
@@ -46,5 +94,13 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
-struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
-						 struct path *path);
+/* overflow events are the only ones with neither a path nor a file handle */
+static inline bool fanotify_event_has_fid(struct fsnotify_event *fse)
+{
+	return !FANOTIFY_E(fse)->path.dentry && !(fse->mask & FS_Q_OVERFLOW);
+}
+
+struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
+						 struct inode *inode, u32 mask,
+						 void *data, int data_type,
+						 __kernel_fsid_t *fsid);
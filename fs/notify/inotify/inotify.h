@@ -26,6 +26,7 @@ extern int inotify_handle_event(struct fsnotify_group *group,
 				struct inode *inode,
 				struct fsnotify_mark *inode_mark,
 				struct fsnotify_mark *vfsmount_mark,
+				struct fsnotify_mark *sb_mark,
 				u32 mask, void *data, int data_type,
 				const unsigned char *file_name, u32 cookie);
 
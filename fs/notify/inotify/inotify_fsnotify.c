@@ -66,6 +66,7 @@ int inotify_handle_event(struct fsnotify_group *group,
 			 struct inode *inode,
 			 struct fsnotify_mark *inode_mark,
 			 struct fsnotify_mark *vfsmount_mark,
+			 struct fsnotify_mark *sb_mark,
 			 u32 mask, void *data, int data_type,
 			 const unsigned char *file_name, u32 cookie)
 {
@@ -77,6 +78,7 @@ int inotify_handle_event(struct fsnotify_group *group,
 	int alloc_len = sizeof(struct inotify_event_info);
 
 	BUG_ON(vfsmount_mark);
+	BUG_ON(sb_mark);
 
 	if ((inode_mark->mask & FS_EXCL_UNLINK) &&
 	    (data_type == FSNOTIFY_EVENT_PATH)) {
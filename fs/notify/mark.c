@@ -153,6 +153,8 @@ void fsnotify_detach_mark(struct fsnotify_mark *mark)
 		fsnotify_destroy_inode_mark(mark);
 	} else if (mark->flags & FSNOTIFY_MARK_FLAG_VFSMOUNT)
 		fsnotify_destroy_vfsmount_mark(mark);
+	else if (mark->flags & FSNOTIFY_MARK_FLAG_SB)
+		fsnotify_destroy_sb_mark(mark);
 	else
 		BUG();
 	/*
@@ -250,8 +252,8 @@ void fsnotify_destroy_marks(struct hlist_head *head, spinlock_t *lock)
 		}
 		mark = hlist_entry(head->first, struct fsnotify_mark, obj_list);
 		/*
-		 * We don't update i_fsnotify_mask / mnt_fsnotify_mask here
-		 * since inode / mount is going away anyway. So just remove
+		 * We don't update i_fsnotify_mask / mnt_fsnotify_mask /
+		 * s_fsnotify_mask here since the object is going away anyway. So just remove
 		 * mark from the list.
 		 */
 		hlist_del_init_rcu(&mark->obj_list);
@@ -349,18 +351,17 @@ int fsnotify_add_mark_list(struct hlist_head *head, struct fsnotify_mark *mark,
 }
 
 /*
- * Attach an initialized mark to a given group and fs object.
- * These marks may be used for the fsnotify backend to determine which
- * event types should be delivered to which group.
+ * Attach an initialized mark to a given group and fs object, exactly one of
+ * @inode, @mnt and @sb is set.
  */
-int fsnotify_add_mark_locked(struct fsnotify_mark *mark,
-			     struct fsnotify_group *group, struct inode *inode,
-			     struct vfsmount *mnt, int allow_dups)
+static int __fsnotify_add_mark_locked(struct fsnotify_mark *mark,
+				      struct fsnotify_group *group,
+				      struct inode *inode, struct vfsmount *mnt,
+				      struct super_block *sb, int allow_dups)
 {
 	int ret = 0;
 
-	BUG_ON(inode && mnt);
-	BUG_ON(!inode && !mnt);
+	BUG_ON(!!inode + !!mnt + !!sb != 1);
 	BUG_ON(!mutex_is_locked(&group->mark_mutex));
 
 	/*
@@ -386,6 +387,10 @@ int fsnotify_add_mark_locked(struct fsnotify_mark *mark,
 		ret = fsnotify_add_vfsmount_mark(mark, group, mnt, allow_dups);
 		if (ret)
 			goto err;
+	} else if (sb) {
+		ret = fsnotify_add_sb_mark(mark, group, sb, allow_dups);
+		if (ret)
+			goto err;
 	} else {
 		BUG();
 	}
@@ -416,6 +421,31 @@ err:
 	return ret;
 }
 
+/*
+ * Attach an initialized mark to a given group and inode or vfsmount.
+ * These marks may be used for the fsnotify backend to determine which
+ * event types should be delivered to which group.
+ */
+int fsnotify_add_mark_locked(struct fsnotify_mark *mark,
+			     struct fsnotify_group *group, struct inode *inode,
+			     struct vfsmount *mnt, int allow_dups)
+{
+	return __fsnotify_add_mark_locked(mark, group, inode, mnt, NULL,
+					  allow_dups);
+}
+
+/*
+ * Attach an initialized mark to a given group and superblock, the mark then
+ * sees the events on every inode of the filesystem, through any mount.
+ */
+int fsnotify_add_sb_mark_locked(struct fsnotify_mark *mark,
+				struct fsnotify_group *group,
+				struct super_block *sb, int allow_dups)
+{
+	return __fsnotify_add_mark_locked(mark, group, NULL, NULL, sb,
+					  allow_dups);
+}
+
 int fsnotify_add_mark(struct fsnotify_mark *mark, struct fsnotify_group *group,
 		      struct inode *inode, struct vfsmount *mnt, int allow_dups)
 {
@@ -236,9 +236,33 @@ int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 	return err;
 }
 
+/*
+ * Leave the data of a regular file on the lower layer: give the upper file
+ * its size and mark it for ovl_lookup() to stack the lower file below it.
+ */
+static int ovl_set_metacopy(struct dentry *upperdentry, struct kstat *stat)
+{
+	struct iattr attr = {
+		.ia_valid = ATTR_SIZE,
+		.ia_size = stat->size,
+	};
+	int err;
+
+	err = ovl_do_setxattr(upperdentry, OVL_XATTR_METACOPY, "", 0, 0);
+	if (err)
+		return err;
+
+	inode_lock(upperdentry->d_inode);
+	err = notify_change(upperdentry, &attr, NULL);
+	inode_unlock(upperdentry->d_inode);
+
+	return err;
+}
+
 static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 			      struct dentry *dentry, struct path *lowerpath,
-			      struct kstat *stat, const char *link)
+			      struct kstat *stat, const char *link,
+			      bool metacopy)
 {
 	struct inode *wdir = workdir->d_inode;
 	struct inode *udir = upperdir->d_inode;
@@ -265,7 +289,11 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out2;
 
-	if (S_ISREG(stat->mode)) {
+	if (metacopy) {
+		err = ovl_set_metacopy(newdentry, stat);
+		if (err)
+			goto out_cleanup;
+	} else if (S_ISREG(stat->mode)) {
 		struct path upperpath;
 
 		ovl_path_upper(dentry, &upperpath);
@@ -291,6 +319,8 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	/* ordered before the upper dentry by ovl_dentry_update() */
+	ovl_dentry_set_metacopy(dentry, metacopy);
 	ovl_dentry_update(dentry, newdentry);
 	newdentry = NULL;
 
@@ -326,8 +356,9 @@ out_cleanup:
  * d_parent it is possible that the copy up will lock the old parent.  At
  * that point the file will have already been copied up anyway.
  */
-int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
-		    struct path *lowerpath, struct kstat *stat)
+static int __ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
+			     struct path *lowerpath, struct kstat *stat,
+			     bool metacopy)
 {
 	struct dentry *workdir = ovl_workdir(dentry);
 	int err;
@@ -371,7 +402,7 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	}
 
 	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath,
-				 stat, link);
+				 stat, link, metacopy);
 	if (!err) {
 		/* Restore timestamps on parent (best effort) */
 		ovl_set_timestamps(upperdir, &pstat);
@@ -386,7 +417,70 @@ out_unlock:
 	return err;
 }
 
-int ovl_copy_up(struct dentry *dentry)
+int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
+		    struct path *lowerpath, struct kstat *stat)
+{
+	return __ovl_copy_up_one(parent, dentry, lowerpath, stat, false);
+}
+
+/*
+ * Copy the data of a metacopy file up into its upper file, in place, and
+ * drop the metacopy mark.  With @trunc nothing is copied, the caller is
+ * about to truncate the file anyway.
+ */
+static int ovl_copy_up_meta_data(struct dentry *dentry, bool trunc)
+{
+	struct dentry *workdir = ovl_workdir(dentry);
+	struct dentry *parent = dget_parent(dentry);
+	struct dentry *upperdir = ovl_dentry_upper(parent);
+	struct path lowerpath, upperpath;
+	const struct cred *old_cred;
+	struct kstat stat;
+	int err;
+
+	old_cred = ovl_override_creds(dentry->d_sb);
+
+	err = -EIO;
+	if (lock_rename(workdir, upperdir) != NULL) {
+		pr_err("overlayfs: failed to lock workdir+upperdir\n");
+		goto out_unlock;
+	}
+	/* Raced with another copy-up? */
+	err = 0;
+	if (!ovl_dentry_is_metacopy(dentry))
+		goto out_unlock;
+
+	ovl_path_lower(dentry, &lowerpath);
+	ovl_path_upper(dentry, &upperpath);
+	err = vfs_getattr(&upperpath, &stat);
+	if (err)
+		goto out_unlock;
+
+	if (!trunc) {
+		err = ovl_copy_up_data(&lowerpath, &upperpath, stat.size);
+		if (err)
+			goto out_unlock;
+	}
+
+	err = ovl_do_removexattr(upperpath.dentry, OVL_XATTR_METACOPY);
+	if (err)
+		goto out_unlock;
+
+	ovl_dentry_set_metacopy(dentry, false);
+
+	/* The data write moved the times that were copied up (best effort) */
+	inode_lock(upperpath.dentry->d_inode);
+	ovl_set_timestamps(upperpath.dentry, &stat);
+	inode_unlock(upperpath.dentry->d_inode);
+out_unlock:
+	unlock_rename(workdir, upperdir);
+	revert_creds(old_cred);
+	dput(parent);
+
+	return err;
+}
+
+static int ovl_copy_up_common(struct dentry *dentry, bool data)
 {
 	int err;
 
@@ -417,7 +511,9 @@ int ovl_copy_up(struct dentry *dentry)
 		ovl_path_lower(next, &lowerpath);
 		err = vfs_getattr(&lowerpath, &stat);
 		if (!err)
-			err = ovl_copy_up_one(parent, next, &lowerpath, &stat);
+			err = __ovl_copy_up_one(parent, next, &lowerpath, &stat,
+						!data && S_ISREG(stat.mode) &&
+						ovl_metacopy_enabled(next));
 
 		dput(parent);
 		dput(next);
@@ -425,3 +521,26 @@ int ovl_copy_up(struct dentry *dentry)
 
 	return err;
 }
+
+/*
+ * Copy up the metadata of a file, its data may stay on the lower layer
+ * with the metacopy mount option.
+ */
+int ovl_copy_up(struct dentry *dentry)
+{
+	return ovl_copy_up_common(dentry, false);
+}
+
+/*
+ * Copy up a file for an access to its data on the upper layer.
+ */
+int ovl_copy_up_with_data(struct dentry *dentry, bool trunc)
+{
+	int err;
+
+	err = ovl_copy_up_common(dentry, true);
+	if (!err && ovl_dentry_is_metacopy(dentry))
+		err = ovl_copy_up_meta_data(dentry, trunc);
+
+	return err;
+}
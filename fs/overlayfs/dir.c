@@ -473,7 +473,8 @@ static int ovl_link(struct dentry *old, struct inode *newdir,
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(old);
+	/* the lower data is only found at the same path */
+	err = ovl_copy_up_with_data(old, false);
 	if (err)
 		goto out_drop_write;
 
@@ -741,7 +742,8 @@ static int ovl_rename2(struct inode *olddir, struct dentry *old,
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(old);
+	/* the lower data is only found at the same path */
+	err = ovl_copy_up_with_data(old, false);
 	if (err)
 		goto out_drop_write;
 
@@ -749,7 +751,7 @@ static int ovl_rename2(struct inode *olddir, struct dentry *old,
 	if (err)
 		goto out_drop_write;
 	if (!overwrite) {
-		err = ovl_copy_up(new);
+		err = ovl_copy_up_with_data(new, false);
 		if (err)
 			goto out_drop_write;
 	}
@@ -59,7 +59,10 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(dentry);
+	if (attr->ia_valid & ATTR_SIZE)
+		err = ovl_copy_up_with_data(dentry, false);
+	else
+		err = ovl_copy_up(dentry);
 	if (!err) {
 		upperdentry = ovl_dentry_upper(dentry);
 
@@ -78,9 +81,20 @@ static int ovl_getattr(struct vfsmount *mnt, struct dentry *dentry,
 			 struct kstat *stat)
 {
 	struct path realpath;
+	int err;
 
 	ovl_path_real(dentry, &realpath);
-	return vfs_getattr(&realpath, stat);
+	err = vfs_getattr(&realpath, stat);
+	if (!err && ovl_dentry_is_metacopy(dentry)) {
+		struct kstat lowerstat;
+
+		/* the blocks holding the data are still on the lower layer */
+		ovl_path_lower(dentry, &realpath);
+		err = vfs_getattr(&realpath, &lowerstat);
+		if (!err)
+			stat->blocks = lowerstat.blocks;
+	}
+	return err;
 }
 
 int ovl_permission(struct inode *inode, int mask)
@@ -357,12 +371,28 @@ struct inode *ovl_d_select_inode(struct dentry *dentry, unsigned file_flags)
 		if (file_flags & O_TRUNC)
 			err = ovl_copy_up_truncate(dentry);
 		else
-			err = ovl_copy_up(dentry);
+			err = ovl_copy_up_with_data(dentry, false);
 		ovl_drop_write(dentry);
 		if (err)
 			return ERR_PTR(err);
 
 		ovl_path_upper(dentry, &realpath);
+	} else if (OVL_TYPE_UPPER(type) && ovl_dentry_is_metacopy(dentry)) {
+		if ((OPEN_FMODE(file_flags) & FMODE_WRITE) ||
+		    (file_flags & O_TRUNC)) {
+			err = ovl_want_write(dentry);
+			if (err)
+				return ERR_PTR(err);
+
+			err = ovl_copy_up_with_data(dentry,
+						    file_flags & O_TRUNC);
+			ovl_drop_write(dentry);
+			if (err)
+				return ERR_PTR(err);
+		} else {
+			/* read the data from where it still is */
+			ovl_path_lower(dentry, &realpath);
+		}
 	}
 
 	if (realpath.dentry->d_flags & DCACHE_OP_SELECT_INODE)
@@ -131,12 +131,25 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page && !PageCompound(page))
 		pipe->tmp_page = page;
 	else
 		put_page(page);
 }
 
+/*
+ * The compound pages of F_SETPIPE_BUFSZ can't go into a page cache, the
+ * one user of ->steal().
+ */
+static int anon_pipe_buf_steal(struct pipe_inode_info *pipe,
+			       struct pipe_buffer *buf)
+{
+	if (PageCompound(buf->page))
+		return 1;
+
+	return generic_pipe_buf_steal(pipe, buf);
+}
+
 /**
  * generic_pipe_buf_steal - attempt to take ownership of a &pipe_buffer
  * @pipe:	the pipe that the buffer belongs to
@@ -219,7 +232,7 @@ static const struct pipe_buf_operations anon_pipe_buf_ops = {
 	.can_merge = 1,
 	.confirm = generic_pipe_buf_confirm,
 	.release = anon_pipe_buf_release,
-	.steal = generic_pipe_buf_steal,
+	.steal = anon_pipe_buf_steal,
 	.get = generic_pipe_buf_get,
 };
 
@@ -227,7 +240,7 @@ static const struct pipe_buf_operations packet_pipe_buf_ops = {
 	.can_merge = 0,
 	.confirm = generic_pipe_buf_confirm,
 	.release = anon_pipe_buf_release,
-	.steal = generic_pipe_buf_steal,
+	.steal = anon_pipe_buf_steal,
 	.get = generic_pipe_buf_get,
 };
 
@@ -340,6 +353,64 @@ static inline int is_packetized(struct file *file)
 	return (file->f_flags & O_DIRECT) != 0;
 }
 
+/**
+ * pipe_wake_mark_reached - should writers wake up the readers
+ * @pipe:	the pipe, locked
+ *
+ * Description:
+ *	With F_SETPIPE_WAKE writers leave the readers alone until that many
+ *	bytes are queued, or until the pipe is full.
+ */
+bool pipe_wake_mark_reached(struct pipe_inode_info *pipe)
+{
+	unsigned int i, len = 0;
+
+	if (!pipe->wake_mark || pipe->nrbufs == pipe->buffers)
+		return true;
+
+	for (i = 0; i < pipe->nrbufs; i++) {
+		len += pipe->bufs[(pipe->curbuf + i) & (pipe->buffers - 1)].len;
+		if (len >= pipe->wake_mark)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Get a buffer for the next @len bytes of a write: pages of up to
+ * ->buf_order with F_SETPIPE_BUFSZ, falling back to a single page. The
+ * large ones come from lowmem so that the kmap() of the head page covers
+ * all of them.
+ */
+static struct page *pipe_alloc_buf_page(struct pipe_inode_info *pipe,
+					size_t len)
+{
+	struct page *page;
+
+	if (pipe->buf_order && len > PAGE_SIZE) {
+		unsigned int order = min_t(unsigned int, pipe->buf_order,
+					   ilog2(len >> PAGE_SHIFT));
+
+		page = alloc_pages(GFP_USER | __GFP_COMP | __GFP_NOWARN |
+				   __GFP_NORETRY, order);
+		if (page)
+			return page;
+	}
+
+	page = pipe->tmp_page;
+	if (page) {
+		pipe->tmp_page = NULL;
+		return page;
+	}
+
+	return alloc_page(GFP_HIGHUSER);
+}
+
+static inline size_t pipe_buf_size(const struct pipe_buffer *buf)
+{
+	return PAGE_SIZE << compound_order(buf->page);
+}
+
 static ssize_t
 pipe_write(struct kiocb *iocb, struct iov_iter *from)
 {
@@ -371,7 +442,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		const struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
 
-		if (ops->can_merge && offset + chars <= PAGE_SIZE) {
+		if (ops->can_merge && offset + chars <= pipe_buf_size(buf)) {
 			ret = ops->confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -401,27 +472,33 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
+			size_t size;
 			int copied;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			/* packets stay page sized */
+			page = pipe_alloc_buf_page(pipe, is_packetized(filp) ?
+						   PAGE_SIZE : iov_iter_count(from));
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
+			size = PAGE_SIZE << compound_order(page);
 			/* Always wake up, even if the copy fails. Otherwise
 			 * we lock up (O_NONBLOCK-)readers that sleep due to
 			 * syscall merging.
 			 * FIXME! Is this really true?
 			 */
 			do_wakeup = 1;
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			copied = copy_page_from_iter(page, 0, size, from);
+			if (unlikely(copied < size && iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
+				/* keep a single page around, as before */
+				if (!pipe->tmp_page && !PageCompound(page))
+					pipe->tmp_page = page;
+				else
+					put_page(page);
 				break;
 			}
 			ret += copied;
@@ -437,7 +514,6 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
 
 			if (!iov_iter_count(from))
 				break;
@@ -464,6 +540,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		pipe->waiting_writers--;
 	}
 out:
+	if (do_wakeup && !pipe_wake_mark_reached(pipe))
+		do_wakeup = 0;
 	__pipe_unlock(pipe);
 	if (do_wakeup) {
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
@@ -642,7 +720,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 {
 	int i;
 
-	account_pipe_buffers(pipe, pipe->buffers, 0);
+	account_pipe_buffers(pipe, pipe->buffers << pipe->buf_order, 0);
 	free_uid(pipe->user);
 	for (i = 0; i < pipe->buffers; i++) {
 		struct pipe_buffer *buf = pipe->bufs + i;
@@ -1035,7 +1113,8 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 			memcpy(bufs + head, pipe->bufs, tail * sizeof(struct pipe_buffer));
 	}
 
-	account_pipe_buffers(pipe, pipe->buffers, nr_pages);
+	account_pipe_buffers(pipe, pipe->buffers << pipe->buf_order,
+			     nr_pages << pipe->buf_order);
 	pipe->curbuf = 0;
 	kfree(pipe->bufs);
 	pipe->bufs = bufs;
@@ -1104,7 +1183,8 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 		if (!nr_pages)
 			goto out;
 
-		if (!capable(CAP_SYS_RESOURCE) && size > pipe_max_size) {
+		if (!capable(CAP_SYS_RESOURCE) &&
+		    ((unsigned long)size << pipe->buf_order) > pipe_max_size) {
 			ret = -EPERM;
 			goto out;
 		} else if ((too_many_pipe_buffers_hard(pipe->user) ||
@@ -1119,6 +1199,47 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F_GETPIPE_SZ:
 		ret = pipe->buffers * PAGE_SIZE;
 		break;
+	case F_SETPIPE_BUFSZ: {
+		unsigned int order;
+
+		ret = -EINVAL;
+		if (!arg || arg > (PAGE_SIZE << PIPE_MAX_BUF_ORDER))
+			goto out;
+		order = get_order(arg);
+
+		/*
+		 * Every buffer may now hold that many pages, which counts
+		 * against the same limits as growing the pipe.
+		 */
+		if (order > pipe->buf_order && !capable(CAP_SYS_RESOURCE)) {
+			ret = -EPERM;
+			if (((unsigned long)pipe->buffers * PAGE_SIZE << order) >
+			    pipe_max_size)
+				goto out;
+			if ((too_many_pipe_buffers_hard(pipe->user) ||
+			     too_many_pipe_buffers_soft(pipe->user)) &&
+			    !capable(CAP_SYS_ADMIN))
+				goto out;
+		}
+		account_pipe_buffers(pipe, pipe->buffers << pipe->buf_order,
+				     pipe->buffers << order);
+		pipe->buf_order = order;
+		ret = PAGE_SIZE << order;
+		break;
+		}
+	case F_GETPIPE_BUFSZ:
+		ret = PAGE_SIZE << pipe->buf_order;
+		break;
+	case F_SETPIPE_WAKE:
+		ret = -EINVAL;
+		if (arg > INT_MAX)
+			goto out;
+		pipe->wake_mark = arg;
+		ret = 0;
+		break;
+	case F_GETPIPE_WAKE:
+		ret = pipe->wake_mark;
+		break;
 	default:
 		ret = -EINVAL;
 		break;
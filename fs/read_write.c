@@ -1459,6 +1459,11 @@ COMPAT_SYSCALL_DEFINE4(sendfile64, int, out_fd, int, in_fd,
  * copy_file_range() differs from regular file read and write in that it
  * specifically allows return partial success.  When it does so is up to
  * the copy_file_range method.
+ *
+ * Within a filesystem a clone of the range is tried first, it shares the
+ * extents instead of copying them, then the filesystem's own copy offload.
+ * Anything else, including copies between filesystems, is spliced through
+ * the page cache in the kernel, at most MAX_RW_COUNT bytes per call.
  */
 ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 			    struct file *file_out, loff_t pos_out,
@@ -1471,6 +1476,16 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 	if (flags != 0)
 		return -EINVAL;
 
+	if (S_ISDIR(inode_in->i_mode) || S_ISDIR(inode_out->i_mode))
+		return -EISDIR;
+	if (!S_ISREG(inode_in->i_mode) || !S_ISREG(inode_out->i_mode))
+		return -EINVAL;
+
+	/* overlapping ranges of the same file have no defined result */
+	if (inode_in == inode_out &&
+	    pos_in + len > pos_out && pos_out + len > pos_in)
+		return -EINVAL;
+
 	ret = rw_verify_area(READ, file_in, &pos_in, len);
 	if (unlikely(ret))
 		return ret;
@@ -1484,10 +1499,6 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 	    (file_out->f_flags & O_APPEND))
 		return -EBADF;
 
-	/* this could be relaxed once a method supports cross-fs copies */
-	if (inode_in->i_sb != inode_out->i_sb)
-		return -EXDEV;
-
 	if (len == 0)
 		return 0;
 
@@ -1496,13 +1507,35 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 		return ret;
 
 	ret = -EOPNOTSUPP;
-	if (file_out->f_op->copy_file_range)
-		ret = file_out->f_op->copy_file_range(file_in, pos_in, file_out,
-						      pos_out, len, flags);
+	/* the methods only know about copies within their own filesystem */
+	if (inode_in->i_sb == inode_out->i_sb) {
+		if (file_in->f_op->clone_file_range) {
+			loff_t isize = i_size_read(inode_in);
+			u64 clone_len;
+
+			/* a clone can't reach past EOF, a copy just stops */
+			if (pos_in >= isize) {
+				ret = 0;
+				goto done;
+			}
+			clone_len = min_t(u64, len, isize - pos_in);
+			/* short of a clone, the copy below does it */
+			if (!file_in->f_op->clone_file_range(file_in, pos_in,
+					file_out, pos_out, clone_len)) {
+				ret = clone_len;
+				goto done;
+			}
+		}
+
+		if (file_out->f_op->copy_file_range)
+			ret = file_out->f_op->copy_file_range(file_in, pos_in,
+						file_out, pos_out, len, flags);
+	}
 	if (ret == -EOPNOTSUPP)
 		ret = do_splice_direct(file_in, &pos_in, file_out, &pos_out,
 				len > MAX_RW_COUNT ? MAX_RW_COUNT : len, 0);
 
+done:
 	if (ret > 0) {
 		fsnotify_access(file_in);
 		add_rchar(current, ret);
@@ -18,9 +18,13 @@
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
+#include <linux/dcache.h>
+#include <linux/fcntl.h>
 
 #include <asm/uaccess.h>
 
+#include "internal.h"
+
 int iterate_dir(struct file *file, struct dir_context *ctx)
 {
 	struct inode *inode = file_inode(file);
@@ -324,3 +328,149 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	fdput_pos(f);
 	return error;
 }
+
+struct getdents_plus_callback {
+	struct dir_context ctx;
+	struct linux_dirent_plus __user * current_dir;
+	struct linux_dirent_plus __user * previous;
+	struct path *dir;
+	unsigned int query_flags;
+	int count;
+	int error;
+};
+
+/*
+ * Get the attributes of an entry the filesystem did not supply them for.
+ * Only entries already in the dcache are looked at, looking up the others
+ * would need the directory locked exclusively; the caller can still
+ * statx() those. Entries with something mounted on them are left out too,
+ * stat() would report the root of the mount instead.
+ */
+static int dirent_plus_getattr(struct getdents_plus_callback *buf,
+			       const char *name, int namlen,
+			       struct kstat *stat)
+{
+	struct qstr this = QSTR_INIT(name, namlen);
+	struct path path;
+	int error = -ENOENT;
+
+	path.dentry = d_hash_and_lookup(buf->dir->dentry, &this);
+	if (IS_ERR_OR_NULL(path.dentry))
+		return error;
+
+	if (d_really_is_positive(path.dentry) && !d_managed(path.dentry)) {
+		path.mnt = buf->dir->mnt;
+		error = vfs_getattr_mask(&path, stat, buf->ctx.stat_mask,
+					 buf->query_flags);
+	}
+	dput(path.dentry);
+	return error;
+}
+
+static int filldir_plus(struct dir_context *ctx, const char *name, int namlen,
+			loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct linux_dirent_plus __user *dirent;
+	struct getdents_plus_callback *buf =
+		container_of(ctx, struct getdents_plus_callback, ctx);
+	int reclen = ALIGN(offsetof(struct linux_dirent_plus, d_name) +
+			   namlen + 1, sizeof(u64));
+	const struct kstat *stat = ctx->stat;
+	struct kstat kstat;
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+	dirent = buf->previous;
+	if (dirent) {
+		if (signal_pending(current))
+			return -EINTR;
+		if (__put_user(offset, &dirent->d_off))
+			goto efault;
+	}
+	if (!stat && !dirent_plus_getattr(buf, name, namlen, &kstat))
+		stat = &kstat;
+
+	dirent = buf->current_dir;
+	if (__put_user(ino, &dirent->d_ino))
+		goto efault;
+	if (__put_user(0, &dirent->d_off))
+		goto efault;
+	if (__put_user(reclen, &dirent->d_reclen))
+		goto efault;
+	if (__put_user(d_type, &dirent->d_type))
+		goto efault;
+	if (stat) {
+		if (cp_statx(stat, &dirent->d_stat))
+			goto efault;
+	} else if (__clear_user(&dirent->d_stat, sizeof(dirent->d_stat))) {
+		goto efault;
+	}
+	if (copy_to_user(dirent->d_name, name, namlen))
+		goto efault;
+	if (__put_user(0, dirent->d_name + namlen))
+		goto efault;
+	buf->previous = dirent;
+	dirent = (void __user *)dirent + reclen;
+	buf->current_dir = dirent;
+	buf->count -= reclen;
+	return 0;
+efault:
+	buf->error = -EFAULT;
+	return -EFAULT;
+}
+
+/**
+ * sys_getdents_plus - read directory entries along with their attributes
+ * @fd: the directory
+ * @dirent: buffer for struct linux_dirent_plus records
+ * @count: size of the buffer
+ * @flags: AT_STATX_* synchronisation flags for the attributes
+ * @mask: STATX_* attributes wanted, as for statx()
+ *
+ * Saves the path walk and lookup of a statx() call per entry for the
+ * entries the filesystem or the dcache can supply the attributes for.
+ */
+SYSCALL_DEFINE5(getdents_plus, unsigned int, fd,
+		struct linux_dirent_plus __user *, dirent, unsigned int, count,
+		unsigned int, flags, unsigned int, mask)
+{
+	struct fd f;
+	struct linux_dirent_plus __user * lastdirent;
+	struct getdents_plus_callback buf = {
+		.ctx.actor = filldir_plus,
+		.ctx.stat_mask = mask,
+		.query_flags = flags,
+		.count = count,
+		.current_dir = dirent
+	};
+	int error;
+
+	if ((flags & ~AT_STATX_SYNC_TYPE) ||
+	    (flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if (!mask || (mask & STATX__RESERVED))
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		return -EFAULT;
+
+	f = fdget_pos(fd);
+	if (!f.file)
+		return -EBADF;
+
+	buf.dir = &f.file->f_path;
+	error = iterate_dir(f.file, &buf.ctx);
+	if (error >= 0)
+		error = buf.error;
+	lastdirent = buf.previous;
+	if (lastdirent) {
+		typeof(lastdirent->d_off) d_off = buf.ctx.pos;
+		if (__put_user(d_off, &lastdirent->d_off))
+			error = -EFAULT;
+		else
+			error = count - buf.count;
+	}
+	fdput_pos(f);
+	return error;
+}
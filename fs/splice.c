@@ -254,6 +254,9 @@ ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 		pipe->waiting_writers--;
 	}
 
+	if (do_wakeup && !pipe_wake_mark_reached(pipe))
+		do_wakeup = 0;
+
 	pipe_unlock(pipe);
 
 	if (do_wakeup)
@@ -974,7 +977,7 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 	while (sd.total_len) {
 		struct iov_iter from;
 		size_t left;
-		int n, idx;
+		int n, i, idx;
 
 		ret = splice_from_pipe_next(pipe, &sd);
 		if (ret <= 0)
@@ -993,9 +996,11 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 
 		/* build the vector */
 		left = sd.total_len;
-		for (n = 0, idx = pipe->curbuf; left && n < pipe->nrbufs; n++, idx++) {
+		for (n = 0, i = 0, idx = pipe->curbuf;
+		     left && n < nbufs && i < pipe->nrbufs; i++, idx++) {
 			struct pipe_buffer *buf = pipe->bufs + idx;
 			size_t this_len = buf->len;
+			unsigned int offset = buf->offset;
 
 			if (this_len > left)
 				this_len = left;
@@ -1010,10 +1015,22 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 				goto done;
 			}
 
-			array[n].bv_page = buf->page;
-			array[n].bv_len = this_len;
-			array[n].bv_offset = buf->offset;
-			left -= this_len;
+			/*
+			 * Buffers of compound pages (F_SETPIPE_BUFSZ) go in
+			 * page sized pieces, bio_vecs don't cross pages.
+			 */
+			while (this_len && n < nbufs) {
+				size_t chunk = min_t(size_t, this_len,
+						     PAGE_SIZE - (offset & ~PAGE_MASK));
+
+				array[n].bv_page = buf->page + (offset >> PAGE_SHIFT);
+				array[n].bv_len = chunk;
+				array[n].bv_offset = offset & ~PAGE_MASK;
+				offset += chunk;
+				this_len -= chunk;
+				left -= chunk;
+				n++;
+			}
 		}
 
 		iov_iter_bvec(&from, ITER_BVEC | WRITE, array, n,
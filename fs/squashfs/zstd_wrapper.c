@@ -0,0 +1,151 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * zstd_wrapper.c
+ */
+
+#include <linux/mutex.h>
+#include <linux/buffer_head.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/zstd.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs.h"
+#include "decompressor.h"
+#include "page_actor.h"
+
+struct squashfs_zstd {
+	struct zstd_dstream *stream;
+	void *workspace;
+};
+
+/*
+ * Every block is compressed on its own, so no frame needs a window larger
+ * than the block size.
+ */
+static size_t zstd_max_window(struct squashfs_sb_info *msblk)
+{
+	return roundup_pow_of_two(max_t(int, msblk->block_size,
+					SQUASHFS_METADATA_SIZE));
+}
+
+static void *zstd_init(struct squashfs_sb_info *msblk, void *buff)
+{
+	size_t max_window = zstd_max_window(msblk);
+	size_t size = zstd_dstream_workspace_size(max_window);
+	struct squashfs_zstd *zstd;
+
+	zstd = kmalloc(sizeof(*zstd), GFP_KERNEL);
+	if (zstd == NULL)
+		goto failed;
+	zstd->workspace = vmalloc(size);
+	if (zstd->workspace == NULL)
+		goto failed2;
+	zstd->stream = zstd_init_dstream(max_window, zstd->workspace, size);
+	if (zstd->stream == NULL)
+		goto failed3;
+
+	return zstd;
+
+failed3:
+	vfree(zstd->workspace);
+failed2:
+	kfree(zstd);
+failed:
+	ERROR("Failed to initialise zstd decompressor\n");
+	return ERR_PTR(-ENOMEM);
+}
+
+
+static void zstd_free(void *strm)
+{
+	struct squashfs_zstd *zstd = strm;
+
+	if (zstd) {
+		vfree(zstd->workspace);
+		kfree(zstd);
+	}
+}
+
+
+static int zstd_uncompress(struct squashfs_sb_info *msblk, void *strm,
+	struct buffer_head **bh, int b, int offset, int length,
+	struct squashfs_page_actor *output)
+{
+	struct squashfs_zstd *zstd = strm;
+	struct zstd_in_buffer in = { NULL, 0, 0 };
+	struct zstd_out_buffer out = { NULL, PAGE_SIZE, 0 };
+	bool last_page = false;
+	int avail, total = 0, k = 0, ret;
+
+	zstd_reset_dstream(zstd->stream);
+	out.dst = squashfs_first_page(output);
+
+	do {
+		if (in.pos == in.size && k < b) {
+			avail = min(length, msblk->devblksize - offset);
+			length -= avail;
+			in.src = bh[k]->b_data + offset;
+			in.size = avail;
+			in.pos = 0;
+			offset = 0;
+		}
+
+		if (out.pos == out.size && !last_page) {
+			void *next = squashfs_next_page(output);
+
+			if (next != NULL) {
+				out.dst = next;
+				out.pos = 0;
+				total += PAGE_SIZE;
+			} else {
+				last_page = true;
+			}
+		}
+
+		ret = zstd_decompress_stream(zstd->stream, &out, &in);
+
+		if (in.pos == in.size && k < b)
+			put_bh(bh[k++]);
+
+		/* Out of input, or out of room for the output */
+		if (ret > 0 && k == b && in.pos == in.size &&
+		    (out.pos < out.size || last_page))
+			ret = -EIO;
+	} while (ret > 0);
+
+	squashfs_finish_page(output);
+
+	if (ret || k < b)
+		goto out;
+
+	return total + out.pos;
+
+out:
+	for (; k < b; k++)
+		put_bh(bh[k]);
+
+	return -EIO;
+}
+
+const struct squashfs_decompressor squashfs_zstd_comp_ops = {
+	.init = zstd_init,
+	.free = zstd_free,
+	.decompress = zstd_uncompress,
+	.id = ZSTD_COMPRESSION,
+	.name = "zstd",
+	.supported = 1
+};
@@ -240,6 +240,7 @@ xfs_inode_set_reclaim_tag(
 			   XFS_ICI_RECLAIM_TAG);
 	xfs_perag_set_reclaim_tag(pag);
 	__xfs_iflags_set(ip, XFS_IRECLAIMABLE);
+	ip->i_flags &= ~XFS_INACTIVATING;
 
 	spin_unlock(&ip->i_flags_lock);
 	spin_unlock(&pag->pag_ici_lock);
@@ -341,6 +342,17 @@ xfs_iget_cache_hit(
 		goto out_error;
 	}
 
+	/*
+	 * Inodes queued for or under inactivation have lost their VFS inode
+	 * and are unlinked, so they are about to be freed.  Only inode
+	 * allocation can look for them and has to wait until they are.
+	 */
+	if (ip->i_flags & (XFS_NEED_INACTIVE | XFS_INACTIVATING)) {
+		trace_xfs_iget_skip(ip);
+		error = (flags & XFS_IGET_CREATE) ? -EAGAIN : -ENOENT;
+		goto out_error;
+	}
+
 	/*
 	 * If IRECLAIMABLE is set, we've torn down the VFS inode already.
 	 * Need to carefully get it back into useable state.
@@ -842,6 +854,119 @@ xfs_inode_ag_iterator_tag(
 	return last_error;
 }
 
+/*
+ * Unlinked inodes are not freed from xfs_fs_destroy_inode(): truncating the
+ * extents, removing the attribute fork and freeing the inode chunk is a
+ * string of transactions that unlink(2), close(2) or the last iput() of a
+ * deleted file should not be waiting for.  Instead the inode is tagged in the
+ * per-ag inode cache radix tree and an inactivation work item for the ag runs
+ * xfs_inactive() on it, then hands it on to background reclaim like
+ * xfs_fs_destroy_inode() does for all other inodes.
+ *
+ * Until inactivation is done the blocks and the inode are still allocated and
+ * still charged to the dquots.  Whoever reports or depends on free space and
+ * quota usage calls xfs_icache_flush_inactive() first.
+ */
+#define XFS_INACTIVE_MAX_PENDING	1024	/* per ag, then inactivate inline */
+
+/*
+ * Queue an inode for background inactivation.  Returns false if the ag has too
+ * large a backlog already, the caller inactivates the inode itself then, which
+ * throttles it to the rate the workers can free inodes at.
+ */
+bool
+xfs_inode_queue_inactive(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_perag	*pag;
+	bool			queued = false;
+
+	pag = xfs_perag_get(mp, XFS_INO_TO_AGNO(mp, ip->i_ino));
+	spin_lock(&pag->pag_ici_lock);
+	if (pag->pag_ici_inactive < XFS_INACTIVE_MAX_PENDING) {
+		spin_lock(&ip->i_flags_lock);
+		radix_tree_tag_set(&pag->pag_ici_root,
+				   XFS_INO_TO_AGINO(mp, ip->i_ino),
+				   XFS_ICI_INACTIVE_TAG);
+		__xfs_iflags_set(ip, XFS_NEED_INACTIVE);
+		spin_unlock(&ip->i_flags_lock);
+		pag->pag_ici_inactive++;
+		queued = true;
+	}
+	spin_unlock(&pag->pag_ici_lock);
+
+	if (queued) {
+		trace_xfs_inode_set_inactive(ip);
+		queue_work(mp->m_inactive_workqueue, &pag->pag_inactive_work);
+	}
+	xfs_perag_put(pag);
+	return queued;
+}
+
+/*
+ * Inactivate all inodes queued in an ag.  The tag is cleared as the inodes are
+ * picked up, a later xfs_inode_queue_inactive() queues the work again.
+ */
+void
+xfs_inactive_worker(
+	struct work_struct	*work)
+{
+	struct xfs_perag	*pag = container_of(work, struct xfs_perag,
+						    pag_inactive_work);
+	struct xfs_mount	*mp = pag->pag_mount;
+	struct xfs_inode	*batch[XFS_LOOKUP_BATCH];
+	int			nr_found;
+	int			i;
+
+	do {
+		spin_lock(&pag->pag_ici_lock);
+		nr_found = radix_tree_gang_lookup_tag(&pag->pag_ici_root,
+				(void **)batch, 0, XFS_LOOKUP_BATCH,
+				XFS_ICI_INACTIVE_TAG);
+		for (i = 0; i < nr_found; i++) {
+			struct xfs_inode *ip = batch[i];
+
+			spin_lock(&ip->i_flags_lock);
+			ASSERT(ip->i_flags & XFS_NEED_INACTIVE);
+			ip->i_flags &= ~XFS_NEED_INACTIVE;
+			ip->i_flags |= XFS_INACTIVATING;
+			spin_unlock(&ip->i_flags_lock);
+
+			radix_tree_tag_clear(&pag->pag_ici_root,
+					     XFS_INO_TO_AGINO(mp, ip->i_ino),
+					     XFS_ICI_INACTIVE_TAG);
+			pag->pag_ici_inactive--;
+		}
+		spin_unlock(&pag->pag_ici_lock);
+
+		for (i = 0; i < nr_found; i++) {
+			struct xfs_inode *ip = batch[i];
+
+			trace_xfs_inode_inactivate(ip);
+			xfs_inactive(ip);
+			ASSERT(XFS_FORCED_SHUTDOWN(mp) ||
+			       ip->i_delayed_blks == 0);
+			XFS_STATS_INC(mp, vn_reclaim);
+			xfs_inode_set_reclaim_tag(ip);
+		}
+		cond_resched();
+	} while (nr_found);
+}
+
+/*
+ * Wait for the inodes queued for inactivation so far to be freed.  Not while
+ * the filesystem is frozen, the workers cannot start transactions until thaw.
+ */
+void
+xfs_icache_flush_inactive(
+	struct xfs_mount	*mp)
+{
+	if (mp->m_super->s_writers.frozen >= SB_FREEZE_FS)
+		return;
+	flush_workqueue(mp->m_inactive_workqueue);
+}
+
 /*
  * Grab the inode for reclaim exclusively.
  * Return 0 if we grabbed it, non-zero otherwise.
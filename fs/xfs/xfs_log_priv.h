@@ -252,11 +252,33 @@ struct xfs_cil_ctx {
 	xfs_lsn_t		commit_lsn;	/* chkpt commit record lsn */
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
 	int			nvecs;		/* number of regions */
-	int			space_used;	/* aggregate size of regions */
+	atomic_t		space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* commit order of items */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct xfs_log_callback	log_cb;		/* completion callback hook. */
 	struct list_head	committing;	/* ctx committing list */
+	struct work_struct	push_work;	/* push of this ctx */
+};
+
+/*
+ * Per-cpu part of the CIL. Transaction commits only touch the structure of the
+ * cpu they run on, with the context lock held shared. The push folds all of
+ * them into the context it is about to write out while it holds the context
+ * lock exclusive, so nobody is committing then.
+ *
+ * Space used is folded into the context early, every XLOG_CIL_PCP_SPACE bytes,
+ * so that the background push threshold can be checked without looking at all
+ * the cpus.
+ */
+struct xlog_cil_pcp {
+	int			space_used;	/* size of regions committed */
+	int			space_folded;	/* of that, added to the ctx */
+	int			space_reserved;	/* stolen for the ctx ticket */
+	int			hdr_res;	/* of that, for log rec headers */
+	int			nvecs;		/* number of regions */
+	struct list_head	busy_extents;	/* busy extents committed */
+	struct list_head	log_items;	/* items first committed here */
 };
 
 /*
@@ -277,8 +299,8 @@ struct xfs_cil_ctx {
  */
 struct xfs_cil {
 	struct xlog		*xc_log;
-	struct list_head	xc_cil;
-	spinlock_t		xc_cil_lock;
+	unsigned long		xc_flags;
+	struct xlog_cil_pcp __percpu *xc_pcp;
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
 	struct xfs_cil_ctx	*xc_ctx;
@@ -288,9 +310,11 @@ struct xfs_cil {
 	struct list_head	xc_committing;
 	wait_queue_head_t	xc_commit_wait;
 	xfs_lsn_t		xc_current_sequence;
-	struct work_struct	xc_push_work;
 } ____cacheline_aligned_in_smp;
 
+/* xc_flags bit values */
+#define	XLOG_CIL_EMPTY		1	/* nothing committed to the ctx yet */
+
 /*
  * The amount of log space we allow the CIL to aggregate is difficult to size.
  * Whatever we choose, we have to make sure we can get a reservation for the
@@ -339,6 +363,7 @@ struct xfs_cil {
  * threshold, yet give us plenty of space for aggregation on large logs.
  */
 #define XLOG_CIL_SPACE_LIMIT(log)	(log->l_logsize >> 3)
+#define XLOG_CIL_PCP_SPACE(log)	(XLOG_CIL_SPACE_LIMIT(log) / num_online_cpus())
 
 /*
  * ticket grant locks, queues and accounting have their own cachlines
@@ -93,6 +93,9 @@ xfs_qm_scall_quotaoff(
 		return xfs_sync_sb(mp, false);
 	}
 
+	/* inodes waiting to be freed still hold on to their dquots */
+	xfs_icache_flush_inactive(mp);
+
 	dqtype = 0;
 	inactivate_flags = 0;
 	/*
@@ -634,6 +637,9 @@ xfs_qm_scall_getquota(
 	struct xfs_dquot	*dqp;
 	int			error;
 
+	/* deleted files still charged to the dquot are about to be freed */
+	xfs_icache_flush_inactive(mp);
+
 	/*
 	 * Try to get the dquot. We don't want it allocated on disk, so
 	 * we aren't passing the XFS_QMOPT_DOALLOC flag. If it doesn't
@@ -868,8 +868,15 @@ xfs_init_mount_workqueues(
 	if (!mp->m_eofblocks_workqueue)
 		goto out_destroy_log;
 
+	mp->m_inactive_workqueue = alloc_workqueue("xfs-inactive/%s",
+			WQ_MEM_RECLAIM|WQ_FREEZABLE, 0, mp->m_fsname);
+	if (!mp->m_inactive_workqueue)
+		goto out_destroy_eofb;
+
 	return 0;
 
+out_destroy_eofb:
+	destroy_workqueue(mp->m_eofblocks_workqueue);
 out_destroy_log:
 	destroy_workqueue(mp->m_log_workqueue);
 out_destroy_reclaim:
@@ -890,6 +897,7 @@ STATIC void
 xfs_destroy_mount_workqueues(
 	struct xfs_mount	*mp)
 {
+	destroy_workqueue(mp->m_inactive_workqueue);
 	destroy_workqueue(mp->m_eofblocks_workqueue);
 	destroy_workqueue(mp->m_log_workqueue);
 	destroy_workqueue(mp->m_reclaim_workqueue);
@@ -915,6 +923,9 @@ xfs_flush_inodes(
 		sync_inodes_sb(sb);
 		up_read(&sb->s_umount);
 	}
+
+	/* and get the space of deleted files back */
+	xfs_icache_flush_inactive(mp);
 }
 
 /* Catch misguided souls that try to use this interface on XFS */
@@ -935,17 +946,13 @@ xfs_fs_destroy_inode(
 	struct inode		*inode)
 {
 	struct xfs_inode	*ip = XFS_I(inode);
+	struct xfs_mount	*mp = ip->i_mount;
 
 	trace_xfs_destroy_inode(ip);
 
 	ASSERT(!rwsem_is_locked(&ip->i_iolock.mr_lock));
-	XFS_STATS_INC(ip->i_mount, vn_rele);
-	XFS_STATS_INC(ip->i_mount, vn_remove);
-
-	xfs_inactive(ip);
-
-	ASSERT(XFS_FORCED_SHUTDOWN(ip->i_mount) || ip->i_delayed_blks == 0);
-	XFS_STATS_INC(ip->i_mount, vn_reclaim);
+	XFS_STATS_INC(mp, vn_rele);
+	XFS_STATS_INC(mp, vn_remove);
 
 	/*
 	 * We should never get here with one of the reclaim flags already set.
@@ -953,6 +960,23 @@ xfs_fs_destroy_inode(
 	ASSERT_ALWAYS(!xfs_iflags_test(ip, XFS_IRECLAIMABLE));
 	ASSERT_ALWAYS(!xfs_iflags_test(ip, XFS_IRECLAIM));
 
+	/*
+	 * Freeing an unlinked inode is left to the background inactivation
+	 * workers, they tag it for reclaim when done.  Not during mount and
+	 * unmount though, log recovery and quotacheck expect unlinked inodes
+	 * to be gone once they are released.
+	 */
+	if (inode->i_nlink == 0 && inode->i_mode != 0 &&
+	    (inode->i_sb->s_flags & MS_ACTIVE) &&
+	    !(mp->m_flags & XFS_MOUNT_RDONLY) && !XFS_FORCED_SHUTDOWN(mp) &&
+	    xfs_inode_queue_inactive(ip))
+		return;
+
+	xfs_inactive(ip);
+
+	ASSERT(XFS_FORCED_SHUTDOWN(mp) || ip->i_delayed_blks == 0);
+	XFS_STATS_INC(mp, vn_reclaim);
+
 	/*
 	 * We always use background reclaim here because even if the
 	 * inode is clean, it still may be under IO and hence we have
@@ -1030,6 +1054,12 @@ xfs_fs_sync_fs(
 	if (!wait)
 		return 0;
 
+	/*
+	 * Deleted files are freed in the background, make that stable too.
+	 * This also gets it done before a freeze.
+	 */
+	xfs_icache_flush_inactive(mp);
+
 	xfs_log_force(mp, XFS_LOG_SYNC);
 	if (laptop_mode) {
 		/*
@@ -1058,6 +1088,9 @@ xfs_fs_statfs(
 	xfs_extlen_t		lsize;
 	__int64_t		ffree;
 
+	/* count the space and inodes of deleted files as free */
+	xfs_icache_flush_inactive(mp);
+
 	statp->f_type = XFS_SB_MAGIC;
 	statp->f_namelen = MAXNAMELEN - 1;
 
@@ -1305,6 +1338,7 @@ xfs_fs_remount(
 		 * reserve pool size so that if we get remounted rw, we can
 		 * return it to the same size.
 		 */
+		xfs_icache_flush_inactive(mp);
 		xfs_save_resvblks(mp);
 		xfs_quiesce_attr(mp);
 		mp->m_flags |= XFS_MOUNT_RDONLY;
@@ -1617,6 +1651,7 @@ xfs_fs_put_super(
 	struct xfs_mount	*mp = XFS_M(sb);
 
 	xfs_notice(mp, "Unmounting Filesystem");
+	flush_workqueue(mp->m_inactive_workqueue);
 	xfs_filestream_unmount(mp);
 	xfs_unmountfs(mp);
 
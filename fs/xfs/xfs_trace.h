@@ -654,6 +654,8 @@ DEFINE_INODE_EVENT(xfs_iget_reclaim);
 DEFINE_INODE_EVENT(xfs_iget_reclaim_fail);
 DEFINE_INODE_EVENT(xfs_iget_hit);
 DEFINE_INODE_EVENT(xfs_iget_miss);
+DEFINE_INODE_EVENT(xfs_inode_set_inactive);
+DEFINE_INODE_EVENT(xfs_inode_inactivate);
 
 DEFINE_INODE_EVENT(xfs_getattr);
 DEFINE_INODE_EVENT(xfs_setattr);
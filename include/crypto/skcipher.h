@@ -52,11 +52,18 @@ struct skcipher_givcrypt_request {
 	struct ablkcipher_request creq;
 };
 
+/* Maximum number of requests handed to a cipher in one batch */
+#define CRYPTO_SKCIPHER_MAX_BATCH	16
+
 struct crypto_skcipher {
 	int (*setkey)(struct crypto_skcipher *tfm, const u8 *key,
 	              unsigned int keylen);
 	int (*encrypt)(struct skcipher_request *req);
 	int (*decrypt)(struct skcipher_request *req);
+	int (*encrypt_batch)(struct skcipher_request **reqs, int *errs,
+			     unsigned int nr);
+	int (*decrypt_batch)(struct skcipher_request **reqs, int *errs,
+			     unsigned int nr);
 
 	unsigned int ivsize;
 	unsigned int reqsize;
@@ -374,6 +381,26 @@ static inline int crypto_skcipher_decrypt(struct skcipher_request *req)
 	return tfm->decrypt(req);
 }
 
+/**
+ * crypto_skcipher_has_batch() - check for native batch support
+ * @tfm: cipher handle
+ *
+ * Batches can be submitted to any cipher, but only some implementations
+ * process them in one pass. For the others crypto_skcipher_encrypt_batch()
+ * and crypto_skcipher_decrypt_batch() issue the requests one at a time.
+ *
+ * Return: true if the cipher implementation processes batches natively
+ */
+static inline bool crypto_skcipher_has_batch(struct crypto_skcipher *tfm)
+{
+	return tfm->encrypt_batch && tfm->decrypt_batch;
+}
+
+int crypto_skcipher_encrypt_batch(struct skcipher_request **reqs, int *errs,
+				  unsigned int nr);
+int crypto_skcipher_decrypt_batch(struct skcipher_request **reqs, int *errs,
+				  unsigned int nr);
+
 /**
  * DOC: Symmetric Key Cipher Request Handle
  *
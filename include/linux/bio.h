@@ -430,6 +430,7 @@ static inline struct bio *bio_next_split(struct bio *bio, int sectors,
 extern struct bio_set *bioset_create(unsigned int, unsigned int);
 extern struct bio_set *bioset_create_nobvec(unsigned int, unsigned int);
 extern void bioset_free(struct bio_set *);
+extern int bioset_cache_create(struct bio_set *);
 extern mempool_t *biovec_create_pool(int pool_entries);
 
 extern struct bio *bio_alloc_bioset(gfp_t, int, struct bio_set *);
@@ -477,10 +478,12 @@ extern int submit_bio_wait(int rw, struct bio *bio);
 extern void bio_advance(struct bio *, unsigned);
 
 extern void bio_init(struct bio *);
+extern void bio_uninit(struct bio *);
 extern void bio_reset(struct bio *);
 void bio_chain(struct bio *, struct bio *);
 
 extern int bio_add_page(struct bio *, struct page *, unsigned int,unsigned int);
+extern int bio_iov_iter_get_pages(struct bio *bio, struct iov_iter *iter);
 extern int bio_add_pc_page(struct request_queue *, struct bio *, struct page *,
 			   unsigned int, unsigned int);
 struct rq_map_data;
@@ -723,10 +726,20 @@ static inline void bio_inc_remaining(struct bio *bio)
 #define BIOVEC_NR_POOLS 6
 #define BIOVEC_MAX_IDX	(BIOVEC_NR_POOLS - 1)
 
+/*
+ * Freed bios kept for reuse on one cpu, see bioset_cache_create()
+ */
+struct bio_alloc_cache {
+	struct bio		*free_list;
+	unsigned int		nr;
+};
+
 struct bio_set {
 	struct kmem_cache *bio_slab;
 	unsigned int front_pad;
 
+	struct bio_alloc_cache __percpu *cache;
+
 	mempool_t *bio_pool;
 	mempool_t *bvec_pool;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -37,6 +37,7 @@ struct bsg_job;
 struct blkcg_gq;
 struct blk_flush_queue;
 struct pr_ops;
+struct rq_wb;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
@@ -157,6 +158,10 @@ struct request {
 	struct request_list *rl;		/* rl this rq is alloced from */
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+#ifdef CONFIG_BLK_WBT
+	u64 wbt_issue_ns;		/* read issue time, for wbt */
+	unsigned short wbt_flags;
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -170,7 +175,10 @@ struct request {
 
 	void *special;		/* opaque pointer available for LLD use */
 
+	u64 issue_time_ns;	/* blk-mq issue time, for completion stats */
+
 	int tag;
+	int internal_tag;	/* blk-mq scheduler tag, -1 if none */
 	int errors;
 
 	/*
@@ -280,6 +288,16 @@ struct queue_limits {
 	unsigned char		raid_partial_stripes_expensive;
 };
 
+/*
+ * Completion times of polled requests, bucketed by direction and size
+ */
+#define BLK_MQ_POLL_STATS_BKTS	16
+
+struct blk_rq_stat {
+	u64			mean;
+	u64			nr_samples;
+};
+
 struct request_queue {
 	/*
 	 * Together with queue_head for cacheline sharing
@@ -412,6 +430,15 @@ struct request_queue {
 	struct work_struct	timeout_work;
 	struct list_head	timeout_list;
 
+	/*
+	 * Hybrid polling: sleep this long before spinning, -1 disables
+	 * sleeping and 0 derives the time from poll_stat.
+	 */
+	int			poll_nsec;
+	struct blk_rq_stat	poll_stat[BLK_MQ_POLL_STATS_BKTS];
+	unsigned long		poll_stat_expires;
+	unsigned int		poll_stat_window;
+
 	struct list_head	icq_list;
 #ifdef CONFIG_BLK_CGROUP
 	DECLARE_BITMAP		(blkcg_pols, BLKCG_MAX_POLS);
@@ -435,6 +462,9 @@ struct request_queue {
 	 */
 	struct blk_flush_queue	*fq;
 
+	/* writeback throttling, see block/blk-wbt.c */
+	struct rq_wb		*rq_wb;
+
 	struct list_head	requeue_list;
 	spinlock_t		requeue_lock;
 	struct work_struct	requeue_work;
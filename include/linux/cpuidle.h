@@ -33,6 +33,10 @@ struct cpuidle_state_usage {
 	unsigned long long	disable;
 	unsigned long long	usage;
 	unsigned long long	time; /* in US */
+	/* recent wakeup history in the bin of this state, see teo.c */
+	unsigned int		hits;
+	unsigned int		misses;
+	unsigned int		early_hits;
 };
 
 struct cpuidle_state {
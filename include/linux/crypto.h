@@ -227,6 +227,14 @@ struct cipher_desc {
  *	     be called in parallel with the same transformation object.
  * @decrypt: Decrypt a single block. This is a reverse counterpart to @encrypt
  *	     and the conditions are exactly the same.
+ * @encrypt_batch: Encrypt up to CRYPTO_SKCIPHER_MAX_BATCH requests for the
+ *		   same transformation in one call, so an implementation with
+ *		   several lanes or a hardware queue can process them in one
+ *		   pass. The result of each request goes to the matching slot
+ *		   of the error array. Processing must stop after a request
+ *		   whose result is neither 0 nor -EINPROGRESS. Returns the
+ *		   number of requests consumed, which is at least one.
+ * @decrypt_batch: Reverse counterpart to @encrypt_batch .
  * @givencrypt: Update the IV for encryption. With this function, a cipher
  *	        implementation may provide the function on how to update the IV
  *	        for encryption.
@@ -240,14 +248,18 @@ struct cipher_desc {
  * @ivsize: IV size applicable for transformation. The consumer must provide an
  *	    IV of exactly that size to perform the encrypt or decrypt operation.
  *
- * All fields except @givencrypt , @givdecrypt , @geniv and @ivsize are
- * mandatory and must be filled.
+ * All fields except @encrypt_batch , @decrypt_batch , @givencrypt ,
+ * @givdecrypt , @geniv and @ivsize are mandatory and must be filled.
  */
 struct ablkcipher_alg {
 	int (*setkey)(struct crypto_ablkcipher *tfm, const u8 *key,
 	              unsigned int keylen);
 	int (*encrypt)(struct ablkcipher_request *req);
 	int (*decrypt)(struct ablkcipher_request *req);
+	int (*encrypt_batch)(struct ablkcipher_request **reqs, int *errs,
+			     unsigned int nr);
+	int (*decrypt_batch)(struct ablkcipher_request **reqs, int *errs,
+			     unsigned int nr);
 	int (*givencrypt)(struct skcipher_givcrypt_request *req);
 	int (*givdecrypt)(struct skcipher_givcrypt_request *req);
 
@@ -0,0 +1,10 @@
+#ifndef DECOMPRESS_UNZSTD_H
+#define DECOMPRESS_UNZSTD_H
+
+int unzstd(unsigned char *inbuf, long len,
+	   long (*fill)(void *, unsigned long),
+	   long (*flush)(void *, unsigned long),
+	   unsigned char *output,
+	   long *pos,
+	   void (*error)(char *x));
+#endif
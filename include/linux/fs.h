@@ -324,6 +324,9 @@ struct writeback_control;
 #define IOCB_HIPRI		(1 << 3)
 #define IOCB_DSYNC		(1 << 4)
 #define IOCB_SYNC		(1 << 5)
+#define IOCB_NOWAIT		(1 << 6)
+
+struct wait_page_async;
 
 struct kiocb {
 	struct file		*ki_filp;
@@ -331,6 +334,7 @@ struct kiocb {
 	void (*ki_complete)(struct kiocb *iocb, long ret, long ret2);
 	void			*private;
 	int			ki_flags;
+	struct wait_page_async	*ki_waitq;	/* for IOCB_NOWAIT reads */
 };
 
 static inline bool is_sync_kiocb(struct kiocb *kiocb)
@@ -1429,6 +1433,11 @@ struct super_block {
 	struct workqueue_struct *s_dio_done_wq;
 	struct hlist_head s_pins;
 
+#ifdef CONFIG_FSNOTIFY
+	__u32			s_fsnotify_mask;
+	struct hlist_head	s_fsnotify_marks;
+#endif
+
 	/*
 	 * Keep the lru lists last in the structure so they always sit on their
 	 * own individual cachelines.
@@ -1635,6 +1644,13 @@ typedef int (*filldir_t)(struct dir_context *, const char *, int, loff_t, u64,
 struct dir_context {
 	const filldir_t actor;
 	loff_t pos;
+	/*
+	 * STATX_* attributes the reader wants along with the entries
+	 * (getdents_plus()), and the attributes of the entry being emitted
+	 * if the filesystem had them at hand, see dir_emit_stat().
+	 */
+	u32 stat_mask;
+	const struct kstat *stat;
 };
 
 struct block_device_operations;
@@ -1820,6 +1836,7 @@ struct super_operations {
 #else
 #define S_DAX		0	/* Make all the DAX code disappear */
 #endif
+#define S_PARALLEL_DIROPS 16384	/* Creates and unlinks with i_rwsem shared */
 
 /*
  * Note that nosuid etc flags are inode-specific: setting some file-system
@@ -1858,6 +1875,7 @@ struct super_operations {
 #define IS_AUTOMOUNT(inode)	((inode)->i_flags & S_AUTOMOUNT)
 #define IS_NOSEC(inode)		((inode)->i_flags & S_NOSEC)
 #define IS_DAX(inode)		((inode)->i_flags & S_DAX)
+#define IS_PARALLEL_DIROPS(inode) ((inode)->i_flags & S_PARALLEL_DIROPS)
 
 #define IS_WHITEOUT(inode)	(S_ISCHR(inode->i_mode) && \
 				 (inode)->i_rdev == WHITEOUT_DEV)
@@ -2885,6 +2903,8 @@ extern int generic_readlink(struct dentry *, char __user *, int);
 extern void generic_fillattr(struct inode *, struct kstat *);
 int vfs_getattr_nosec(struct path *path, struct kstat *stat);
 extern int vfs_getattr(struct path *, struct kstat *);
+extern int vfs_getattr_mask(struct path *, struct kstat *, u32, unsigned int);
+extern int vfs_statx(int, const char __user *, int, struct kstat *, u32);
 void __inode_add_bytes(struct inode *inode, loff_t bytes);
 void inode_add_bytes(struct inode *inode, loff_t bytes);
 void __inode_sub_bytes(struct inode *inode, loff_t bytes);
@@ -3133,6 +3153,22 @@ static inline bool dir_emit(struct dir_context *ctx,
 {
 	return ctx->actor(ctx, name, namelen, ctx->pos, ino, type) == 0;
 }
+/*
+ * dir_emit() for filesystems that get the attributes of the entries from
+ * the directory itself, worth it only if ctx->stat_mask is set.
+ */
+static inline bool dir_emit_stat(struct dir_context *ctx,
+				 const char *name, int namelen,
+				 u64 ino, unsigned type,
+				 const struct kstat *stat)
+{
+	bool ret;
+
+	ctx->stat = stat;
+	ret = ctx->actor(ctx, name, namelen, ctx->pos, ino, type) == 0;
+	ctx->stat = NULL;
+	return ret;
+}
 static inline bool dir_emit_dot(struct file *file, struct dir_context *ctx)
 {
 	return ctx->actor(ctx, ".", 1, ctx->pos,
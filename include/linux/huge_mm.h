@@ -62,6 +62,8 @@ struct page *follow_devmap_pmd(struct vm_area_struct *vma, unsigned long addr,
 
 extern bool is_vma_temporary_stack(struct vm_area_struct *vma);
 
+extern struct kobj_attribute shmem_enabled_attr;
+
 #define transparent_hugepage_enabled(__vma)				\
 	((transparent_hugepage_flags &					\
 	  (1<<TRANSPARENT_HUGEPAGE_FLAG) ||				\
@@ -136,6 +138,11 @@ static inline int hpage_nr_pages(struct page *page)
 
 extern int do_huge_pmd_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
 				unsigned long addr, pmd_t pmd, pmd_t *pmdp);
+extern int do_set_file_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, struct page *page, bool write);
+extern int do_huge_pmd_file_wp_page(struct vm_area_struct *vma,
+				    unsigned long address, pmd_t *pmd,
+				    pmd_t orig_pmd);
 
 extern struct page *huge_zero_page;
 
@@ -17,8 +17,24 @@
 
 #include <uapi/linux/if_tun.h>
 
+/* msg_control of in-kernel sendmsg/recvmsg on a tun or macvtap socket.
+ * Batches are described by iov_iters rather than xdp_buffs as tun has no
+ * XDP path that could build skbs from them.
+ */
+#define TUN_MSG_UBUF 1	/* sendmsg: ptr is the zerocopy struct ubuf_info */
+#define TUN_MSG_PTR  2	/* sendmsg: ptr is an array of num struct iov_iter,
+			 * one packet each, sent in place of msg_iter.
+			 * recvmsg: ptr is an skb taken off the queue with
+			 * tun_get_skb_array(); it is consumed either way. */
+struct tun_msg_ctl {
+	unsigned short type;
+	unsigned short num;
+	void *ptr;
+};
+
 #if defined(CONFIG_TUN) || defined(CONFIG_TUN_MODULE)
 struct socket *tun_get_socket(struct file *);
+struct skb_array *tun_get_skb_array(struct file *file);
 #else
 #include <linux/err.h>
 #include <linux/errno.h>
@@ -28,5 +44,9 @@ static inline struct socket *tun_get_socket(struct file *f)
 {
 	return ERR_PTR(-EINVAL);
 }
+static inline struct skb_array *tun_get_skb_array(struct file *f)
+{
+	return ERR_PTR(-EINVAL);
+}
 #endif /* CONFIG_TUN */
 #endif /* __IF_TUN_H */
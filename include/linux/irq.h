@@ -197,6 +197,9 @@ struct irq_data {
  * IRQD_IRQ_INPROGRESS		- In progress state of the interrupt
  * IRQD_WAKEUP_ARMED		- Wakeup mode armed
  * IRQD_FORWARDED_TO_VCPU	- The interrupt is forwarded to a VCPU
+ * IRQD_AFFINITY_MANAGED	- Affinity is auto-managed by the kernel
+ * IRQD_MANAGED_SHUTDOWN	- Managed interrupt shut down as none of the
+ *				  CPUs of its affinity mask is online
  */
 enum {
 	IRQD_TRIGGER_MASK		= 0xf,
@@ -212,6 +215,8 @@ enum {
 	IRQD_IRQ_INPROGRESS		= (1 << 18),
 	IRQD_WAKEUP_ARMED		= (1 << 19),
 	IRQD_FORWARDED_TO_VCPU		= (1 << 20),
+	IRQD_AFFINITY_MANAGED		= (1 << 21),
+	IRQD_MANAGED_SHUTDOWN		= (1 << 22),
 };
 
 #define __irqd_to_state(d) ACCESS_PRIVATE((d)->common, state_use_accessors)
@@ -285,6 +290,16 @@ static inline bool irqd_irq_inprogress(struct irq_data *d)
 	return __irqd_to_state(d) & IRQD_IRQ_INPROGRESS;
 }
 
+static inline bool irqd_affinity_is_managed(struct irq_data *d)
+{
+	return __irqd_to_state(d) & IRQD_AFFINITY_MANAGED;
+}
+
+static inline bool irqd_is_managed_and_shutdown(struct irq_data *d)
+{
+	return __irqd_to_state(d) & IRQD_MANAGED_SHUTDOWN;
+}
+
 static inline bool irqd_is_wakeup_armed(struct irq_data *d)
 {
 	return __irqd_to_state(d) & IRQD_WAKEUP_ARMED;
@@ -454,6 +469,17 @@ extern int irq_set_vcpu_affinity(unsigned int irq, void *vcpu_info);
 
 extern void irq_migrate_all_off_this_cpu(void);
 
+#ifdef CONFIG_SMP
+extern bool irq_shutdown_managed_offline(struct irq_desc *desc);
+extern int irq_affinity_online_cpu(unsigned int cpu);
+#else
+static inline bool irq_shutdown_managed_offline(struct irq_desc *desc)
+{
+	return false;
+}
+#define irq_affinity_online_cpu	NULL
+#endif
+
 #if defined(CONFIG_SMP) && defined(CONFIG_GENERIC_PENDING_IRQ)
 void irq_move_irq(struct irq_data *data);
 void irq_move_masked_irq(struct irq_data *data);
@@ -701,11 +727,11 @@ static inline struct cpumask *irq_data_get_affinity_mask(struct irq_data *d)
 unsigned int arch_dynirq_lower_bound(unsigned int from);
 
 int __irq_alloc_descs(int irq, unsigned int from, unsigned int cnt, int node,
-		struct module *owner);
+		      struct module *owner, const struct cpumask *affinity);
 
 /* use macros to avoid needing export.h for THIS_MODULE */
 #define irq_alloc_descs(irq, from, cnt, node)	\
-	__irq_alloc_descs(irq, from, cnt, node, THIS_MODULE)
+	__irq_alloc_descs(irq, from, cnt, node, THIS_MODULE, NULL)
 
 #define irq_alloc_desc(node)			\
 	irq_alloc_descs(-1, 0, 1, node)
@@ -126,6 +126,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -221,6 +222,28 @@ typedef struct jbd2_journal_revoke_header_s
 #define JBD2_FLAG_DELETED	4	/* block deleted by this transaction */
 #define JBD2_FLAG_LAST_TAG	8	/* last tag in this descriptor block */
 
+/*
+ * The fast commit block: a series of byte ranges of client fs blocks written
+ * on behalf of the running transaction, replayed on top of the last full
+ * commit.  Tags are followed by fc_len bytes of data and padded to 4 bytes.
+ */
+typedef struct jbd2_fc_header_s
+{
+	journal_header_t fc_header;	/* h_sequence is the running tid */
+	__be32		 fc_checksum;	/* crc32_be(block), this field zero */
+	__be32		 fc_count;	/* Count of bytes used in the block */
+} jbd2_fc_header_t;
+
+typedef struct jbd2_fc_tag_s
+{
+	__be64		fc_blocknr;	/* client fs block */
+	__be16		fc_offset;	/* offset of the range in that block */
+	__be16		fc_len;		/* length of the range */
+} jbd2_fc_tag_t;
+
+/* Blocks set aside for fast commits at the end of a journal by default */
+#define JBD2_DEFAULT_FC_BLOCKS	256
+
 
 /*
  * The journal superblock.  All fields are in big-endian byte order.
@@ -265,7 +288,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Blocks set aside for fast commits */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +316,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +327,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -453,6 +480,7 @@ struct jbd2_revoke_table_s;
  * @h_sync: flag for sync-on-close
  * @h_jdata: flag to force data journaling
  * @h_aborted: flag indicating fatal error on handle
+ * @h_fc_exempt: metadata dirtied is covered by the client's fast commits
  **/
 
 /* Docbook can't yet cope with the bit fields, but will leave the documentation
@@ -486,6 +514,7 @@ struct jbd2_journal_handle
 	unsigned int	h_jdata:	1;	/* force data journaling */
 	unsigned int	h_reserved:	1;	/* handle with reserved credits */
 	unsigned int	h_aborted:	1;	/* fatal error on handle */
+	unsigned int	h_fc_exempt:	1;	/* left to fast commits */
 	unsigned int	h_type:		8;	/* for handle statistics */
 	unsigned int	h_line_no:	16;	/* for handle statistics */
 
@@ -691,6 +720,12 @@ struct transaction_s
 	/* Disk flush needs to be sent to fs partition [no locking] */
 	int			t_need_data_flush;
 
+	/*
+	 * Metadata other than what the client fast commits was changed, only
+	 * a full commit covers this transaction [no locking]
+	 */
+	int			t_fc_ineligible;
+
 	/*
 	 * For use by the filesystem to store fs-specific data
 	 * structures associated with the transaction
@@ -788,6 +823,13 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbuf: array of buffer_heads for jbd2_journal_commit_transaction
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
+ * @j_fc_first: first block of the fast commit area
+ * @j_fc_blocks: number of blocks in the fast commit area
+ * @j_fc_off: bytes of the fast commit area used by j_fc_tid
+ * @j_fc_start: bytes used when the current fast commit began
+ * @j_fc_tid: transaction the fast commit area belongs to
+ * @j_fc_mutex: serialises fast commits
+ * @j_fc_wbuf: buffer_heads of the fast commit area
  * @j_last_sync_writer: most recent pid which did a synchronous write
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
@@ -990,6 +1032,17 @@ struct journal_s
 	struct buffer_head	**j_wbuf;
 	int			j_wbufsize;
 
+	/*
+	 * The fast commit area, after j_last, and its state [j_fc_mutex]
+	 */
+	unsigned long		j_fc_first;
+	int			j_fc_blocks;
+	unsigned int		j_fc_off;
+	unsigned int		j_fc_start;
+	tid_t			j_fc_tid;
+	struct mutex		j_fc_mutex;
+	struct buffer_head	**j_fc_wbuf;
+
 	/*
 	 * this is the pid of hte last person to run a synchronous operation
 	 * through the journal
@@ -1099,6 +1152,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1354,6 +1408,13 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commits */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_add(journal_t *journal, unsigned long long blocknr,
+		unsigned int offset, const void *data, unsigned int len);
+int jbd2_fc_end_commit(journal_t *journal);
+void jbd2_fc_abort_commit(journal_t *journal);
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
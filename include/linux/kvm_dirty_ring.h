@@ -0,0 +1,93 @@
+#ifndef KVM_DIRTY_RING_H
+#define KVM_DIRTY_RING_H
+
+#include <linux/kvm.h>
+
+/*
+ * struct kvm_dirty_ring - per-vCPU ring of dirtied guest pages
+ *
+ * The ring is shared with userspace through the vcpu mmap, see
+ * KVM_DIRTY_LOG_PAGE_OFFSET. Entries between @reset_index and
+ * @dirty_index are owned by userspace until it flags them harvested and
+ * calls KVM_RESET_DIRTY_RINGS.
+ *
+ * @dirty_index:	free running index of the next entry to be pushed
+ * @reset_index:	free running index of the next entry to be reset
+ * @size:		number of entries, a power of two
+ * @soft_limit:		number of used entries above which the vCPU exits
+ *			with KVM_EXIT_DIRTY_RING_FULL
+ * @dirty_gfns:		the ring itself
+ */
+struct kvm_dirty_ring {
+	u32 dirty_index;
+	u32 reset_index;
+	u32 size;
+	u32 soft_limit;
+	struct kvm_dirty_gfn *dirty_gfns;
+};
+
+/*
+ * Entries kept free for the pages dirtied between the soft full check in
+ * the vcpu run loop and the next guest exit.
+ */
+#define KVM_DIRTY_RING_RSVD_ENTRIES	64
+
+#define KVM_DIRTY_RING_MAX_ENTRIES	65536
+
+struct kvm;
+
+#ifndef CONFIG_HAVE_KVM_DIRTY_RING
+
+static inline int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	return 0;
+}
+
+static inline int kvm_dirty_ring_reset(struct kvm *kvm,
+				       struct kvm_dirty_ring *ring)
+{
+	return 0;
+}
+
+static inline bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring,
+				       u32 slot, u64 offset)
+{
+	return false;
+}
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return false;
+}
+
+static inline struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring,
+						   u32 offset)
+{
+	return NULL;
+}
+
+static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+}
+
+#else /* CONFIG_HAVE_KVM_DIRTY_RING */
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size);
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset);
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
+
+static inline u32 kvm_dirty_ring_used(struct kvm_dirty_ring *ring)
+{
+	return READ_ONCE(ring->dirty_index) - READ_ONCE(ring->reset_index);
+}
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return ring->dirty_gfns && kvm_dirty_ring_used(ring) >= ring->soft_limit;
+}
+
+#endif /* CONFIG_HAVE_KVM_DIRTY_RING */
+
+#endif /* KVM_DIRTY_RING_H */
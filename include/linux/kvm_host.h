@@ -26,6 +26,7 @@
 #include <linux/context_tracking.h>
 #include <linux/irqbypass.h>
 #include <linux/swait.h>
+#include <linux/kvm_dirty_ring.h>
 #include <asm/signal.h>
 
 #include <linux/kvm.h>
@@ -230,6 +231,7 @@ struct kvm_vcpu {
 	struct kvm_vcpu_stat stat;
 	unsigned int halt_poll_ns;
 	bool valid_wakeup;
+	struct kvm_dirty_ring dirty_ring;
 
 #ifdef CONFIG_HAS_IOMEM
 	int mmio_needed;
@@ -414,6 +416,12 @@ struct kvm {
 	struct list_head devices;
 	struct dentry *debugfs_dentry;
 	struct kvm_stat_data **debugfs_stat_data;
+	/* size of the per-vcpu dirty rings in bytes, 0 if not in use */
+	u32 dirty_ring_size;
+	/* KVM_GET_DIRTY_LOG leaves the pages alone, see KVM_CLEAR_DIRTY_LOG */
+	bool manual_dirty_log_protect;
+	/* upper bound for the vCPUs' halt_poll_ns, see KVM_CAP_HALT_POLL */
+	unsigned int max_halt_poll_ns;
 };
 
 #define kvm_err(fmt, ...) \
@@ -683,6 +691,8 @@ int kvm_get_dirty_log(struct kvm *kvm,
 
 int kvm_get_dirty_log_protect(struct kvm *kvm,
 			struct kvm_dirty_log *log, bool *is_dirty);
+int kvm_clear_dirty_log_protect(struct kvm *kvm,
+			struct kvm_clear_dirty_log *log, bool *flush);
 
 void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
 					struct kvm_memory_slot *slot,
@@ -691,6 +701,8 @@ void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
 
 int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm,
 				struct kvm_dirty_log *log);
+int kvm_vm_ioctl_clear_dirty_log(struct kvm *kvm,
+				 struct kvm_clear_dirty_log *log);
 
 int kvm_vm_ioctl_irq_line(struct kvm *kvm, struct kvm_irq_level *irq_level,
 			bool line_status);
@@ -991,6 +1003,7 @@ static inline bool kvm_is_error_gpa(struct kvm *kvm, gpa_t gpa)
 enum kvm_stat_kind {
 	KVM_STAT_VM,
 	KVM_STAT_VCPU,
+	KVM_STAT_VCPU_U64,
 };
 
 struct kvm_stat_data {
@@ -13,6 +13,7 @@
 #include <linux/uprobes.h>
 #include <linux/page-flags-layout.h>
 #include <linux/workqueue.h>
+#include <linux/seqlock.h>
 #include <asm/page.h>
 #include <asm/mmu.h>
 
@@ -64,6 +65,8 @@ struct page {
 		union {
 			pgoff_t index;		/* Our offset within mapping. */
 			void *freelist;		/* sl[aou]b first free object */
+			/* shared page table: mm accounting its rss */
+			struct mm_struct *pt_rss_mm;
 			/* page_deferred_list().prev	-- second tail page */
 		};
 
@@ -117,7 +120,7 @@ struct page {
 	 */
 	union {
 		struct list_head lru;	/* Pageout list, eg. active_list
-					 * protected by zone->lru_lock !
+					 * protected by pgdat->lru_lock !
 					 * Can be used as a generic list
 					 * by the page owner.
 					 */
@@ -357,6 +360,10 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t vm_sequence;		/* Bumped around changes to the vma */
+	struct rcu_head vm_rcu;		/* Freed after speculative faults */
+#endif
 };
 
 struct core_thread {
@@ -392,6 +399,7 @@ struct mm_rss_stat {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct vm_area_struct *mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
@@ -421,7 +429,11 @@ struct mm_struct {
 						 * together off init_mm.mmlist, and are protected
 						 * by mmlist_lock
 						 */
-
+#ifdef CONFIG_LRU_GEN
+	struct list_head lru_gen_list;		/* On the list of mm's whose page
+						 * tables lru_gen aging walks
+						 */
+#endif
 
 	unsigned long hiwater_rss;	/* High-watermark of RSS usage */
 	unsigned long hiwater_vm;	/* High-water virtual memory usage */
@@ -517,6 +529,12 @@ struct mm_struct {
 #ifdef CONFIG_MMU
 	struct work_struct async_put_work;
 #endif
+#ifdef CONFIG_MEMBARRIER
+	atomic_t membarrier_state;	/* MEMBARRIER_STATE_* */
+#endif
+#ifdef CONFIG_FUTEX
+	struct futex_private_hash *futex_hash;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -360,6 +360,9 @@ struct module {
 	const unsigned long *crcs;
 	unsigned int num_syms;
 
+	/* Entries of all exported symbols in the symbol hash. */
+	struct ksym_entry *ksym_index;
+
 	/* Kernel parameters. */
 #ifdef CONFIG_SYSFS
 	struct mutex param_lock;
@@ -127,6 +127,9 @@ enum pageflags {
 	/* SLOB */
 	PG_slob_free = PG_private,
 
+	/* Buddy pages: already reported free to the host */
+	PG_reported = PG_uptodate,
+
 	/* Compound pages. Stored in first tail page's flags */
 	PG_double_map = PG_private_2,
 };
@@ -335,6 +338,14 @@ PAGEFLAG(Uncached, uncached, PF_NO_COMPOUND)
 PAGEFLAG_FALSE(Uncached)
 #endif
 
+#ifdef CONFIG_PAGE_REPORTING
+__PAGEFLAG(Reported, reported, PF_NO_COMPOUND)
+#else
+TESTPAGEFLAG_FALSE(Reported)
+static inline void __SetPageReported(struct page *page) {  }
+__CLEARPAGEFLAG_NOOP(Reported)
+#endif
+
 #ifdef CONFIG_MEMORY_FAILURE
 PAGEFLAG(HWPoison, hwpoison, PF_ANY)
 TESTSCFLAG(HWPoison, hwpoison, PF_ANY)
@@ -695,7 +706,7 @@ static inline void ClearPageSlabPfmemalloc(struct page *page)
  * alloc-free cycle to prevent from reusing the page.
  */
 #define PAGE_FLAGS_CHECK_AT_PREP	\
-	(((1UL << NR_PAGEFLAGS) - 1) & ~__PG_HWPOISON)
+	((((1UL << NR_PAGEFLAGS) - 1) & ~__PG_HWPOISON) | LRU_GEN_MASK)
 
 #define PAGE_FLAGS_PRIVATE				\
 	(1UL << PG_private | 1UL << PG_private_2)
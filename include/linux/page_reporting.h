@@ -0,0 +1,33 @@
+#ifndef _LINUX_PAGE_REPORTING_H
+#define _LINUX_PAGE_REPORTING_H
+
+#include <linux/mmzone.h>
+#include <linux/scatterlist.h>
+#include <linux/workqueue.h>
+
+/* Most pages handed to the report callback in one call */
+#define PAGE_REPORTING_CAPACITY		32
+
+/*
+ * A device that can be told about large free pages, so that the memory
+ * behind them can be reclaimed elsewhere (typically by a hypervisor).
+ *
+ * @report is called from process context with up to
+ * PAGE_REPORTING_CAPACITY free pages of at least pageblock_order.  The
+ * pages are off the free lists for the duration of the call and go back
+ * afterwards; if @report returned 0 they are flagged as reported and
+ * are not offered again until they have been allocated and freed.
+ */
+struct page_reporting_dev_info {
+	int (*report)(struct page_reporting_dev_info *prdev,
+		      struct scatterlist *sg, unsigned int nents);
+
+	/* private to mm/page_reporting.c */
+	struct delayed_work work;
+	atomic_t state;
+};
+
+int page_reporting_register(struct page_reporting_dev_info *prdev);
+void page_reporting_unregister(struct page_reporting_dev_info *prdev);
+
+#endif /* _LINUX_PAGE_REPORTING_H */
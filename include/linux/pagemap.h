@@ -472,6 +472,18 @@ extern int wait_on_page_bit_killable(struct page *page, int bit_nr);
 extern int wait_on_page_bit_killable_timeout(struct page *page,
 					     int bit_nr, unsigned long timeout);
 
+/*
+ * Callback for the unlock of a page, for readers that can't sleep on it
+ */
+struct wait_page_async {
+	wait_queue_t		wait;
+	struct page		*page;
+	void			(*func)(struct wait_page_async *wpa);
+};
+
+extern bool wait_on_page_locked_async(struct page *page,
+				      struct wait_page_async *wpa);
+
 static inline int wait_on_page_locked_killable(struct page *page)
 {
 	if (!PageLocked(page))
@@ -16,17 +16,43 @@
 
 #ifdef CONFIG_SMP
 
+/*
+ * On NUMA machines the per-cpu deltas are folded into a counter of their
+ * node: an update only takes a node local lock and a precise sum visits
+ * node local cachelines the same way.
+ */
+struct percpu_counter_node {
+	raw_spinlock_t lock;
+	s64 count;
+};
+
 struct percpu_counter {
 	raw_spinlock_t lock;
 	s64 count;
 #ifdef CONFIG_HOTPLUG_CPU
 	struct list_head list;	/* All percpu_counters are on a list */
 #endif
+	s32 batch;		/* 0: follow percpu_counter_batch */
+	struct percpu_counter_node **nodes;	/* NULL on one node */
 	s32 __percpu *counters;
 };
 
 extern int percpu_counter_batch;
 
+static inline s32 percpu_counter_cur_batch(struct percpu_counter *fbc)
+{
+	return fbc->batch ? : READ_ONCE(percpu_counter_batch);
+}
+
+/*
+ * The per-cpu deltas are each below the batch, so this is the maximum
+ * error of percpu_counter_read().
+ */
+static inline s64 percpu_counter_max_error(struct percpu_counter *fbc)
+{
+	return (s64)percpu_counter_cur_batch(fbc) * num_online_cpus();
+}
+
 int __percpu_counter_init(struct percpu_counter *fbc, s64 amount, gfp_t gfp,
 			  struct lock_class_key *key);
 
@@ -39,18 +65,20 @@ int __percpu_counter_init(struct percpu_counter *fbc, s64 amount, gfp_t gfp,
 
 void percpu_counter_destroy(struct percpu_counter *fbc);
 void percpu_counter_set(struct percpu_counter *fbc, s64 amount);
+void percpu_counter_set_batch(struct percpu_counter *fbc, s32 batch);
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch);
 s64 __percpu_counter_sum(struct percpu_counter *fbc);
+s64 __percpu_counter_read_nodes(struct percpu_counter *fbc);
 int __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch);
 
 static inline int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 {
-	return __percpu_counter_compare(fbc, rhs, percpu_counter_batch);
+	return __percpu_counter_compare(fbc, rhs, percpu_counter_cur_batch(fbc));
 }
 
 static inline void percpu_counter_add(struct percpu_counter *fbc, s64 amount)
 {
-	__percpu_counter_add(fbc, amount, percpu_counter_batch);
+	__percpu_counter_add(fbc, amount, percpu_counter_cur_batch(fbc));
 }
 
 static inline s64 percpu_counter_sum_positive(struct percpu_counter *fbc)
@@ -66,6 +94,8 @@ static inline s64 percpu_counter_sum(struct percpu_counter *fbc)
 
 static inline s64 percpu_counter_read(struct percpu_counter *fbc)
 {
+	if (fbc->nodes)
+		return __percpu_counter_read_nodes(fbc);
 	return fbc->count;
 }
 
@@ -76,7 +106,12 @@ static inline s64 percpu_counter_read(struct percpu_counter *fbc)
  */
 static inline s64 percpu_counter_read_positive(struct percpu_counter *fbc)
 {
-	s64 ret = fbc->count;
+	s64 ret;
+
+	if (fbc->nodes)
+		ret = __percpu_counter_read_nodes(fbc);
+	else
+		ret = fbc->count;
 
 	barrier();		/* Prevent reloads of fbc->count */
 	if (ret >= 0)
@@ -84,6 +119,18 @@ static inline s64 percpu_counter_read_positive(struct percpu_counter *fbc)
 	return 0;
 }
 
+/*
+ * Read the counter with an error of at most @max_error: the cheap
+ * approximate value when it is good enough, the precise sum otherwise.
+ */
+static inline s64 percpu_counter_read_bounded(struct percpu_counter *fbc,
+					      s64 max_error)
+{
+	if (percpu_counter_max_error(fbc) <= max_error)
+		return percpu_counter_read(fbc);
+	return __percpu_counter_sum(fbc);
+}
+
 static inline int percpu_counter_initialized(struct percpu_counter *fbc)
 {
 	return (fbc->counters != NULL);
@@ -111,6 +158,16 @@ static inline void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
 	fbc->count = amount;
 }
 
+static inline void percpu_counter_set_batch(struct percpu_counter *fbc,
+					    s32 batch)
+{
+}
+
+static inline s64 percpu_counter_max_error(struct percpu_counter *fbc)
+{
+	return 0;
+}
+
 static inline int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 {
 	if (fbc->count > rhs)
@@ -165,6 +222,12 @@ static inline s64 percpu_counter_sum(struct percpu_counter *fbc)
 	return percpu_counter_read(fbc);
 }
 
+static inline s64 percpu_counter_read_bounded(struct percpu_counter *fbc,
+					      s64 max_error)
+{
+	return percpu_counter_read(fbc);
+}
+
 static inline int percpu_counter_initialized(struct percpu_counter *fbc)
 {
 	return 1;
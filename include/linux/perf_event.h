@@ -515,6 +515,7 @@ struct swevent_hlist {
 #define PERF_ATTACH_TASK_DATA	0x08
 
 struct perf_cgroup;
+struct perf_cgroup_node;
 struct ring_buffer;
 
 /**
@@ -673,6 +674,14 @@ struct perf_event {
 #ifdef CONFIG_CGROUP_PERF
 	struct perf_cgroup		*cgrp; /* cgroup event is attach to */
 	int				cgrp_defer_enabled;
+
+	/* per-cgroup counting, see PERF_EVENT_IOC_ATTACH_CGROUP */
+	struct list_head		cgrp_node_entry;
+	struct perf_cgroup_node		*cgrp_nodes;	/* sorted by id */
+	int				nr_cgrp_nodes;
+	u64				cgrp_node_count;
+	u64				cgrp_node_enabled;
+	u64				cgrp_node_running;
 #endif
 
 #endif /* CONFIG_PERF_EVENTS */
@@ -751,6 +760,7 @@ struct perf_cpu_context {
 
 	struct pmu			*unique_pmu;
 	struct perf_cgroup		*cgrp;
+	struct list_head		cgrp_node_list;
 };
 
 struct perf_output_handle {
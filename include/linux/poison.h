@@ -40,6 +40,13 @@
 
 #define TAIL_MAPPING	((void *) 0x400 + POISON_POINTER_DELTA)
 
+/********** net/core/page_pool.c **********/
+/*
+ * Kept in page->lru.next of pages owned by a page pool.  Bit zero must
+ * stay clear so the page is never taken for a compound tail page.
+ */
+#define PP_SIGNATURE	((void *) 0x40 + POISON_POINTER_DELTA)
+
 /********** mm/slab.c **********/
 /*
  * Magic nums for obj red zoning.
@@ -25,6 +25,7 @@
 #include <linux/list_nulls.h>
 #include <linux/workqueue.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/rcupdate.h>
 
 /*
@@ -95,6 +96,19 @@ typedef int (*rht_obj_cmpfn_t)(struct rhashtable_compare_arg *arg,
 			       const void *obj);
 
 struct rhashtable;
+struct dentry;
+
+/**
+ * struct rhashtable_stats - Per cpu lookup statistics
+ * @lookups: Number of lookups
+ * @misses: Lookups that found nothing
+ * @compares: Objects compared against the key, i.e. chain entries visited
+ */
+struct rhashtable_stats {
+	unsigned long		lookups;
+	unsigned long		misses;
+	unsigned long		compares;
+};
 
 /**
  * struct rhashtable_params - Hash table construction parameters
@@ -140,6 +154,10 @@ struct rhashtable_params {
  * @run_work: Deferred worker to expand/shrink asynchronously
  * @mutex: Mutex to protect current/future table swapping
  * @lock: Spin lock to protect walker list
+ * @stats: Per cpu lookup statistics
+ * @nr_expands: Number of times the table was grown
+ * @nr_shrinks: Number of times the table was shrunk
+ * @nr_rehashed: Number of objects moved to a new table
  */
 struct rhashtable {
 	struct bucket_table __rcu	*tbl;
@@ -150,8 +168,20 @@ struct rhashtable {
 	struct work_struct		run_work;
 	struct mutex                    mutex;
 	spinlock_t			lock;
+#ifdef CONFIG_RHASHTABLE_STATS
+	struct rhashtable_stats __percpu *stats;
+	unsigned int			nr_expands;
+	unsigned int			nr_shrinks;
+	unsigned long			nr_rehashed;
+#endif
 };
 
+#ifdef CONFIG_RHASHTABLE_STATS
+#define rht_stat_inc(ht, field)		this_cpu_inc((ht)->stats->field)
+#else
+#define rht_stat_inc(ht, field)		do { } while (0)
+#endif
+
 /**
  * struct rhashtable_walker - Hash table walker
  * @list: List entry on list of walkers
@@ -345,6 +375,8 @@ struct bucket_table *rhashtable_insert_slow(struct rhashtable *ht,
 					    struct rhash_head *obj,
 					    struct bucket_table *old_tbl);
 int rhashtable_insert_rehash(struct rhashtable *ht, struct bucket_table *tbl);
+int rhashtable_insert_bulk(struct rhashtable *ht, struct rhash_head **objs,
+			   unsigned int nr, bool unique);
 
 int rhashtable_walk_init(struct rhashtable *ht, struct rhashtable_iter *iter,
 			 gfp_t gfp);
@@ -358,6 +390,19 @@ void rhashtable_free_and_destroy(struct rhashtable *ht,
 				 void *arg);
 void rhashtable_destroy(struct rhashtable *ht);
 
+#ifdef CONFIG_RHASHTABLE_STATS
+struct dentry *rhashtable_debugfs_create(struct rhashtable *ht,
+					 const char *name,
+					 struct dentry *parent);
+#else
+static inline struct dentry *rhashtable_debugfs_create(struct rhashtable *ht,
+						       const char *name,
+						       struct dentry *parent)
+{
+	return NULL;
+}
+#endif
+
 #define rht_dereference(p, ht) \
 	rcu_dereference_protected(p, lockdep_rht_mutex_is_held(ht))
 
@@ -540,10 +585,12 @@ static inline void *rhashtable_lookup_fast(
 
 	rcu_read_lock();
 
+	rht_stat_inc(ht, lookups);
 	tbl = rht_dereference_rcu(ht->tbl, ht);
 restart:
 	hash = rht_key_hashfn(ht, tbl, key, params);
 	rht_for_each_rcu(he, tbl, hash) {
+		rht_stat_inc(ht, compares);
 		if (params.obj_cmpfn ?
 		    params.obj_cmpfn(&arg, rht_obj(ht, he)) :
 		    rhashtable_compare(&arg, rht_obj(ht, he)))
@@ -558,6 +605,7 @@ restart:
 	tbl = rht_dereference_rcu(tbl->future_tbl, ht);
 	if (unlikely(tbl))
 		goto restart;
+	rht_stat_inc(ht, misses);
 	rcu_read_unlock();
 
 	return NULL;
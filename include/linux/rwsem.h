@@ -37,11 +37,23 @@ struct rw_semaphore {
 	 */
 	struct task_struct *owner;
 #endif
+#ifdef CONFIG_RWSEM_READER_BIAS
+	/*
+	 * Reader bias, see kernel/locking/rwsem-rbias.c. While it is on,
+	 * readers don't touch @count.
+	 */
+	int rbias;
+	u64 rbias_inhibit;	/* local_clock() until which it stays off */
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
 };
 
+#define RWSEM_RBIAS_NONE	0	/* not opted in */
+#define RWSEM_RBIAS_OFF		1	/* revoked by a writer */
+#define RWSEM_RBIAS_ON		2
+
 extern struct rw_semaphore *rwsem_down_read_failed(struct rw_semaphore *sem);
 extern struct rw_semaphore *rwsem_down_write_failed(struct rw_semaphore *sem);
 extern struct rw_semaphore *rwsem_down_write_failed_killable(struct rw_semaphore *sem);
@@ -51,14 +63,42 @@ extern struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem);
 /* Include the arch specific part */
 #include <asm/rwsem.h>
 
+#ifdef CONFIG_RWSEM_READER_BIAS
+extern int rwsem_rbias_is_locked(struct rw_semaphore *sem);
+
+/*
+ * rwsem_enable_reader_bias - let readers of @sem bypass the shared count
+ *
+ * For read-mostly semaphores taken by many CPUs at once; readers no longer
+ * bounce the @count cacheline, writers pay for it by scanning the table of
+ * visible readers. Call it before @sem is used.
+ */
+static inline void rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+	sem->rbias = RWSEM_RBIAS_OFF;
+	sem->rbias_inhibit = 0;
+}
+#endif
+
 /* In all implementations count != 0 means locked */
 static inline int rwsem_is_locked(struct rw_semaphore *sem)
 {
+#ifdef CONFIG_RWSEM_READER_BIAS
+	/* biased readers aren't accounted in count */
+	if (!sem->count && READ_ONCE(sem->rbias) == RWSEM_RBIAS_ON)
+		return rwsem_rbias_is_locked(sem);
+#endif
 	return sem->count != 0;
 }
 
 #endif
 
+#ifndef CONFIG_RWSEM_READER_BIAS
+static inline void rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+}
+#endif
+
 /* Common initializer macros and functions */
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
@@ -164,20 +204,25 @@ do {								\
 	typecheck(struct lockdep_map *, &(nest_lock)->dep_map);	\
 	_down_write_nest_lock(sem, &(nest_lock)->dep_map);	\
 } while (0);
+#else
+# define down_read_nested(sem, subclass)		down_read(sem)
+# define down_write_nest_lock(sem, nest_lock)	down_write(sem)
+# define down_write_nested(sem, subclass)	down_write(sem)
+# define down_write_killable_nested(sem, subclass)	down_write_killable(sem)
+#endif
 
+#if defined(CONFIG_DEBUG_LOCK_ALLOC) || defined(CONFIG_RWSEM_READER_BIAS)
 /*
  * Take/release a lock when not the owner will release it.
  *
  * [ This API should be avoided as much as possible - the
  *   proper abstraction for this case is completions. ]
+ *
+ * Biased readers are tracked per task, these never use the bias.
  */
 extern void down_read_non_owner(struct rw_semaphore *sem);
 extern void up_read_non_owner(struct rw_semaphore *sem);
 #else
-# define down_read_nested(sem, subclass)		down_read(sem)
-# define down_write_nest_lock(sem, nest_lock)	down_write(sem)
-# define down_write_nested(sem, subclass)	down_write(sem)
-# define down_write_killable_nested(sem, subclass)	down_write_killable(sem)
 # define down_read_non_owner(sem)		down_read(sem)
 # define up_read_non_owner(sem)			up_read(sem)
 #endif
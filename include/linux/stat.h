@@ -18,7 +18,16 @@
 #include <linux/time.h>
 #include <linux/uidgid.h>
 
+/*
+ * @request_mask and @query_flags are filled in before ->getattr() is called
+ * and tell it which of the STATX_* fields the caller is interested in and
+ * how hard to try to get them up to date (AT_STATX_*); ->getattr() may
+ * clear bits of @result_mask for fields it could not fill in.
+ */
 struct kstat {
+	u32		request_mask;	/* what the caller asked for */
+	unsigned int	query_flags;	/* AT_STATX_* sync flags */
+	u32		result_mask;	/* what fields the caller got */
 	u64		ino;
 	dev_t		dev;
 	umode_t		mode;
@@ -30,6 +39,7 @@ struct kstat {
 	struct timespec  atime;
 	struct timespec	mtime;
 	struct timespec	ctime;
+	struct timespec	btime;		/* file creation time */
 	unsigned long	blksize;
 	unsigned long long	blocks;
 };
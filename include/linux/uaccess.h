@@ -73,6 +73,23 @@ static inline unsigned long __copy_from_user_nocache(void *to,
 	return __copy_from_user(to, from, n);
 }
 
+static inline unsigned long __copy_to_user_inatomic_nocache(void __user *to,
+				const void *from, unsigned long n)
+{
+	return __copy_to_user_inatomic(to, from, n);
+}
+
+static inline unsigned long __copy_to_user_nocache(void __user *to,
+				const void *from, unsigned long n)
+{
+	return __copy_to_user(to, from, n);
+}
+
+static inline bool copy_nocache_wanted(size_t size)
+{
+	return false;
+}
+
 #endif		/* ARCH_HAS_NOCACHE_UACCESS */
 
 /*
@@ -119,18 +119,44 @@ struct delayed_work {
 	int cpu;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  The CPUs are grouped into pods
+ * according to the scope and work items issued on a CPU are executed by a
+ * pool serving the pod of that CPU.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT core */
+	WQ_AFFN_CACHE,			/* one pod per LLC */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /*
  * A struct for workqueue attributes.  This can be used to change
  * attributes of an unbound workqueue.
  *
- * Unlike other fields, ->no_numa isn't a property of a worker_pool.  It
- * only modifies how apply_workqueue_attrs() select pools and thus doesn't
- * participate in pool hash calculations or equality comparisons.
+ * Unlike other fields, ->affn_scope and ->affn_strict aren't properties of
+ * a worker_pool.  They only modify how apply_workqueue_attrs() select
+ * pools and thus don't participate in pool hash calculations or equality
+ * comparisons.  Conversely, ->__pod_cpumask is only meaningful for pools.
  */
 struct workqueue_attrs {
 	int			nice;		/* nice level */
 	cpumask_var_t		cpumask;	/* allowed CPUs */
-	bool			no_numa;	/* disable NUMA affinity */
+
+	/*
+	 * CPUs of the pod a pool serves.  Workers are allowed to run on all
+	 * of ->cpumask but are woken up inside the pod when possible, for
+	 * strict affinity both masks are the same.
+	 */
+	cpumask_var_t		__pod_cpumask;
+
+	enum wq_affn_scope	affn_scope;	/* affinity scope */
+	bool			affn_strict;	/* never leave the pod */
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
@@ -0,0 +1,187 @@
+#ifndef __ZSTD_H__
+#define __ZSTD_H__
+/*
+ * Zstandard Kernel Interface
+ *
+ * Zstandard is an LZ77 compressor with Huffman coded literals and FSE
+ * (tANS) coded match sequences.  It compresses about as well as zlib at
+ * its default level while decompressing several times faster.  The
+ * format is described at <https://github.com/facebook/zstd>.
+ *
+ * Nothing here allocates memory.  Every context lives in a workspace the
+ * caller provides; the *_workspace_size() helpers say how large it has to
+ * be.  All functions returning int return 0 on success and a negative
+ * errno on failure: -EINVAL for corrupt input or bad parameters, -ENOSPC
+ * when the output buffer is too small and -ENOMEM when the workspace is.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+
+#define ZSTD_MAGIC		0xFD2FB528
+#define ZSTD_DICT_MAGIC		0xEC30A437
+
+#define ZSTD_BLOCKSIZE_MAX	(1 << 17)
+#define ZSTD_WINDOWLOG_MIN	10
+#define ZSTD_WINDOWLOG_MAX	27
+
+#define ZSTD_MIN_CLEVEL		1
+#define ZSTD_DEFAULT_CLEVEL	3
+#define ZSTD_MAX_CLEVEL		9
+
+#define ZSTD_CONTENTSIZE_UNKNOWN	(~0ULL)
+#define ZSTD_CONTENTSIZE_ERROR		(~0ULL - 1)
+
+/*
+ * Compression parameters.  zstd_get_params() picks them for a level; they
+ * can be tuned further before the context is initialised.
+ */
+struct zstd_params {
+	unsigned int window_log;	/* largest match distance, log2 */
+	unsigned int chain_log;		/* match chain table entries, log2 */
+	unsigned int hash_log;		/* hash head table entries, log2 */
+	unsigned int search_log;	/* chain entries searched, log2 */
+	unsigned int min_match;		/* shortest match considered, >= 4 */
+	unsigned int lazy_depth;	/* positions tried past a match, 0-2 */
+	bool checksum;			/* append a content checksum */
+};
+
+/* Buffers for the streaming interfaces, pos is advanced by the call */
+struct zstd_in_buffer {
+	const void *src;
+	size_t size;
+	size_t pos;
+};
+
+struct zstd_out_buffer {
+	void *dst;
+	size_t size;
+	size_t pos;
+};
+
+/*
+ * zstd_compress_bound()
+ * Provides the maximum size a single frame compressing src_len bytes may
+ * take, i.e. the destination size that can never fail with -ENOSPC.
+ */
+static inline size_t zstd_compress_bound(size_t src_len)
+{
+	return src_len + (src_len >> 8) + 64;
+}
+
+/*
+ * zstd_get_params()
+ *	level    : ZSTD_MIN_CLEVEL to ZSTD_MAX_CLEVEL
+ *	src_size : size of the data if known up front, 0 otherwise.  Small
+ *		   inputs get smaller tables and so a smaller workspace.
+ */
+struct zstd_params zstd_get_params(int level, size_t src_size);
+
+/* Single shot compression */
+struct zstd_cctx;
+
+size_t zstd_cctx_workspace_size(const struct zstd_params *params);
+struct zstd_cctx *zstd_init_cctx(void *workspace, size_t workspace_size,
+				 const struct zstd_params *params);
+
+/*
+ * zstd_compress_cctx()
+ *	dst_len : capacity of dst on entry, size of the frame on return
+ */
+int zstd_compress_cctx(struct zstd_cctx *cctx, void *dst, size_t *dst_len,
+		       const void *src, size_t src_len);
+
+/*
+ * Precomputed dictionaries.  A dictionary is either raw content or the
+ * format produced by "zstd --train".  Digesting it once up front saves
+ * re-hashing (compression) or re-parsing the entropy tables
+ * (decompression) for every frame.  The dictionary buffer is referenced,
+ * not copied, and has to outlive the digested dictionary.
+ */
+struct zstd_cdict;
+
+size_t zstd_cdict_workspace_size(const struct zstd_params *params);
+struct zstd_cdict *zstd_init_cdict(const void *dict, size_t dict_size,
+				   const struct zstd_params *params,
+				   void *workspace, size_t workspace_size);
+
+/* cctx has to be initialised with the same parameters as cdict */
+int zstd_compress_using_cdict(struct zstd_cctx *cctx, void *dst,
+			      size_t *dst_len, const void *src,
+			      size_t src_len, const struct zstd_cdict *cdict);
+
+/*
+ * Streaming compression.  zstd_compress_stream() consumes as much input as
+ * it can; zstd_flush_stream() and zstd_end_stream() return the number of
+ * bytes still waiting to be written out, so call them until they return 0.
+ * After zstd_end_stream() the context is ready for zstd_reset_cstream().
+ */
+struct zstd_cstream;
+
+size_t zstd_cstream_workspace_size(const struct zstd_params *params);
+struct zstd_cstream *zstd_init_cstream(const struct zstd_params *params,
+				       u64 pledged_src_size,
+				       void *workspace, size_t workspace_size);
+struct zstd_cstream *zstd_init_cstream_using_cdict(
+				const struct zstd_cdict *cdict,
+				u64 pledged_src_size,
+				void *workspace, size_t workspace_size);
+int zstd_reset_cstream(struct zstd_cstream *zcs, u64 pledged_src_size);
+int zstd_compress_stream(struct zstd_cstream *zcs,
+			 struct zstd_out_buffer *out,
+			 struct zstd_in_buffer *in);
+int zstd_flush_stream(struct zstd_cstream *zcs, struct zstd_out_buffer *out);
+int zstd_end_stream(struct zstd_cstream *zcs, struct zstd_out_buffer *out);
+
+/* Single shot decompression, of one or more concatenated frames */
+struct zstd_dctx;
+
+size_t zstd_dctx_workspace_size(void);
+struct zstd_dctx *zstd_init_dctx(void *workspace, size_t workspace_size);
+
+/*
+ * zstd_decompress_dctx()
+ *	dst_len : capacity of dst on entry, decompressed size on return
+ */
+int zstd_decompress_dctx(struct zstd_dctx *dctx, void *dst, size_t *dst_len,
+			 const void *src, size_t src_len);
+
+struct zstd_ddict;
+
+size_t zstd_ddict_workspace_size(void);
+struct zstd_ddict *zstd_init_ddict(const void *dict, size_t dict_size,
+				   void *workspace, size_t workspace_size);
+int zstd_decompress_using_ddict(struct zstd_dctx *dctx, void *dst,
+				size_t *dst_len, const void *src,
+				size_t src_len, const struct zstd_ddict *ddict);
+
+/*
+ * zstd_get_frame_content_size()
+ * Returns the decompressed size recorded in the frame header,
+ * ZSTD_CONTENTSIZE_UNKNOWN if the frame doesn't record it, or
+ * ZSTD_CONTENTSIZE_ERROR if src doesn't start with a valid header.
+ */
+u64 zstd_get_frame_content_size(const void *src, size_t src_len);
+
+/*
+ * Streaming decompression.  Frames needing a window larger than
+ * max_window_size are refused.  zstd_decompress_stream() returns 0 once a
+ * frame has been fully decoded and flushed, 1 while it wants more input
+ * or output space.  A following frame is decoded by calling it again.
+ */
+struct zstd_dstream;
+
+size_t zstd_dstream_workspace_size(size_t max_window_size);
+struct zstd_dstream *zstd_init_dstream(size_t max_window_size,
+				       void *workspace, size_t workspace_size);
+struct zstd_dstream *zstd_init_dstream_using_ddict(size_t max_window_size,
+				const struct zstd_ddict *ddict,
+				void *workspace, size_t workspace_size);
+void zstd_reset_dstream(struct zstd_dstream *zds);
+int zstd_decompress_stream(struct zstd_dstream *zds,
+			   struct zstd_out_buffer *out,
+			   struct zstd_in_buffer *in);
+
+#endif /* __ZSTD_H__ */
@@ -39,6 +39,7 @@ struct fib_lookup_arg {
 	int			flags;
 #define FIB_LOOKUP_NOREF		1
 #define FIB_LOOKUP_IGNORE_LINKSTATE	2
+	int			lookup_flags;	/* passed on to ->action() */
 };
 
 struct fib_rules_ops {
@@ -31,6 +31,7 @@ struct route_info {
 #define RT6_LOOKUP_F_SRCPREF_TMP	0x00000008
 #define RT6_LOOKUP_F_SRCPREF_PUBLIC	0x00000010
 #define RT6_LOOKUP_F_SRCPREF_COA	0x00000020
+#define RT6_LOOKUP_F_DST_NOREF		0x00000040
 
 /* We do not (yet ?) support IPv6 jumbograms (RFC 2675)
  * Unlike IPv4, hdr->seg_len doesn't include the IPv6 header
@@ -62,6 +63,16 @@ static inline bool rt6_need_strict(const struct in6_addr *daddr)
 		(IPV6_ADDR_MULTICAST | IPV6_ADDR_LINKLOCAL | IPV6_ADDR_LOOPBACK);
 }
 
+/* Drop a route returned by a lookup done with @flags.  With
+ * RT6_LOOKUP_F_DST_NOREF only uncached clones carry a reference.
+ */
+static inline void ip6_rt_put_flags(struct rt6_info *rt, int flags)
+{
+	if (!(flags & RT6_LOOKUP_F_DST_NOREF) ||
+	    (rt->dst.flags & DST_NOCACHE))
+		ip6_rt_put(rt);
+}
+
 void ip6_route_input(struct sk_buff *skb);
 
 struct dst_entry *ip6_route_output_flags(struct net *net, const struct sock *sk,
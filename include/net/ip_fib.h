@@ -316,6 +316,14 @@ static inline int fib_num_tclassid_users(struct net *net)
 int fib_unmerge(struct net *net);
 void fib_flush_external(struct net *net);
 
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+void fib_lookup_cache_flush(void);
+#else
+static inline void fib_lookup_cache_flush(void)
+{
+}
+#endif
+
 /* Exported by fib_semantics.c */
 int ip_fib_check_default(__be32 gw, struct net_device *dev);
 int fib_sync_down_dev(struct net_device *dev, unsigned long event, bool force);
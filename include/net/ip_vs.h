@@ -15,6 +15,7 @@
 #include <linux/compiler.h>
 #include <linux/timer.h>
 #include <linux/bug.h>
+#include <linux/rhashtable.h>
 
 #include <net/checksum.h>
 #include <linux/netfilter.h>		/* for union nf_inet_addr */
@@ -510,7 +511,7 @@ struct ip_vs_conn_param {
 
 /* IP_VS structure allocated for each dynamically scheduled connection */
 struct ip_vs_conn {
-	struct hlist_node	c_list;         /* hashed list heads */
+	struct rhash_head	c_node;		/* node in the conn table */
 	/* Protocol, addresses and port numbers */
 	__be16                  cport;
 	__be16                  dport;
@@ -727,7 +728,7 @@ struct ip_vs_pe {
 	/* get the connection template, if any */
 	int (*fill_param)(struct ip_vs_conn_param *p, struct sk_buff *skb);
 	bool (*ct_match)(const struct ip_vs_conn_param *p,
-			 struct ip_vs_conn *ct);
+			 const struct ip_vs_conn *ct);
 	u32 (*hashkey_raw)(const struct ip_vs_conn_param *p, u32 initval,
 			   bool inverse);
 	int (*show_pe_data)(const struct ip_vs_conn *cp, char *buf);
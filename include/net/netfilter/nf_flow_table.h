@@ -0,0 +1,75 @@
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+#include <linux/in.h>
+#include <linux/netdevice.h>
+#include <linux/rhashtable.h>
+#include <linux/rcupdate.h>
+#include <net/dst.h>
+
+struct nf_conn;
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX,
+};
+
+/*
+ * Everything up to @dir is the lookup key, the rest is what the fast path
+ * needs to send the packet on.
+ */
+struct flow_offload_tuple {
+	__be32				src_v4;
+	__be32				dst_v4;
+	__be16				src_port;
+	__be16				dst_port;
+	int				iifidx;
+	u8				l4proto;
+	u8				dir;
+
+	u16				mtu;
+	int				oifidx;
+	struct dst_entry		*dst_cache;
+};
+
+struct flow_offload_tuple_rhash {
+	struct rhash_head		node;
+	struct flow_offload_tuple	tuple;
+};
+
+enum flow_offload_flags {
+	FLOW_OFFLOAD_NAT_BIT,		/* addresses or ports mangled */
+	FLOW_OFFLOAD_TEARDOWN_BIT,	/* back to the slow path */
+	FLOW_OFFLOAD_DYING_BIT,		/* leaving the table */
+};
+
+struct flow_offload {
+	struct flow_offload_tuple_rhash	tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn			*ct;
+	unsigned long			flags;
+	u32				timeout;
+	struct rcu_head			rcu_head;
+};
+
+/* Flows idle for this long are handed back to conntrack */
+#define NF_FLOW_TIMEOUT		(30 * HZ)
+
+struct nf_flow_route {
+	struct {
+		struct dst_entry	*dst;
+		int			ifindex;
+	} tuple[FLOW_OFFLOAD_DIR_MAX];
+};
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route);
+void flow_offload_free(struct flow_offload *flow);
+
+int flow_offload_add(struct net *net, struct flow_offload *flow);
+void flow_offload_teardown(struct flow_offload *flow);
+
+int nf_flow_table_dev_hook(struct net *net, const char *name);
+void nf_flow_table_dev_unhook(struct net *net, const char *name);
+
+#endif /* _NF_FLOW_TABLE_H */
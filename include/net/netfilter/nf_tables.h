@@ -192,11 +192,13 @@ struct nft_set_desc {
 /**
  *	enum nft_set_class - performance class
  *
- *	@NFT_LOOKUP_O_1: constant, O(1)
- *	@NFT_LOOKUP_O_LOG_N: logarithmic, O(log N)
- *	@NFT_LOOKUP_O_N: linear, O(N)
+ *	@NFT_SET_CLASS_O_1_DIRECT: constant, indexed by the key itself
+ *	@NFT_SET_CLASS_O_1: constant, O(1)
+ *	@NFT_SET_CLASS_O_LOG_N: logarithmic, O(log N)
+ *	@NFT_SET_CLASS_O_N: linear, O(N)
  */
 enum nft_set_class {
+	NFT_SET_CLASS_O_1_DIRECT,
 	NFT_SET_CLASS_O_1,
 	NFT_SET_CLASS_O_LOG_N,
 	NFT_SET_CLASS_O_N,
@@ -0,0 +1,102 @@
+/*
+ * include/net/page_pool.h	Recycling pool of pages for driver RX rings
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A page pool hands out pages to a single RX ring and takes them back
+ * when the ring, or the stack, is done with them.  With PP_FLAG_DMA_MAP
+ * the pool maps each page once when it is allocated and keeps the
+ * mapping for as long as the page keeps cycling through the pool, so
+ * a refill does not need to go through the IOMMU.
+ *
+ * Pages owned by a pool are tagged with PP_SIGNATURE in page->lru.next
+ * and point back to their pool through page->lru.prev; the DMA address
+ * lives in page->private.  Dropping a fragment reference from an skb
+ * (__skb_frag_unref) notices the tag, and whoever drops the last
+ * reference puts the page back into its pool instead of freeing it.
+ *
+ * Allocation and the alloc cache belong to the NAPI context of the
+ * ring; pages may be returned from any context through the ptr_ring.
+ */
+#ifndef _NET_PAGE_POOL_H
+#define _NET_PAGE_POOL_H
+
+#include <linux/mm.h>
+#include <linux/poison.h>
+#include <linux/ptr_ring.h>
+#include <linux/dma-mapping.h>
+#include <linux/workqueue.h>
+#include <linux/skbuff.h>
+
+#define PP_FLAG_DMA_MAP		BIT(0)	/* pool maps and unmaps the pages */
+#define PP_FLAG_ALL		PP_FLAG_DMA_MAP
+
+/* Lockless cache used from the NAPI context owning the pool */
+#define PP_ALLOC_CACHE_SIZE	128
+#define PP_ALLOC_CACHE_REFILL	64
+
+struct pp_alloc_cache {
+	u32		count;
+	struct page	*cache[PP_ALLOC_CACHE_SIZE];
+};
+
+struct page_pool_params {
+	unsigned int	flags;
+	unsigned int	order;
+	unsigned int	pool_size;	/* size of the recycle ring */
+	int		nid;		/* NUMA node to allocate from */
+	struct device	*dev;		/* device used for DMA mapping */
+	enum dma_data_direction dma_dir;
+};
+
+struct page_pool {
+	struct page_pool_params	p;
+
+	/* Pages handed out minus pages that left the pool for good;
+	 * the pool is only freed once the two meet.
+	 */
+	u32			pages_state_hold_cnt;
+
+	struct pp_alloc_cache	alloc ____cacheline_aligned_in_smp;
+
+	/* Pages returned from outside the owning NAPI context */
+	struct ptr_ring		ring;
+
+	atomic_t		pages_state_release_cnt;
+
+	struct delayed_work	release_dw;
+};
+
+struct page_pool *page_pool_create(const struct page_pool_params *params);
+void page_pool_destroy(struct page_pool *pool);
+
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp);
+
+static inline struct page *page_pool_dev_alloc_pages(struct page_pool *pool)
+{
+	gfp_t gfp = GFP_ATOMIC | __GFP_NOWARN | __GFP_COLD;
+
+	return page_pool_alloc_pages(pool, gfp);
+}
+
+void page_pool_put_page(struct page_pool *pool, struct page *page,
+			bool allow_direct);
+
+/* Only from the NAPI context owning the pool, for a page the CPU has
+ * not written to, e.g. a frame dropped before it reached the stack.
+ */
+static inline void page_pool_recycle_direct(struct page_pool *pool,
+					    struct page *page)
+{
+	page_pool_put_page(pool, page, true);
+}
+
+static inline dma_addr_t page_pool_get_dma_addr(const struct page *page)
+{
+	return (dma_addr_t)page_private(page);
+}
+
+#endif /* _NET_PAGE_POOL_H */
@@ -15,6 +15,16 @@ struct sock_reuseport {
 	struct sock		*socks[0];	/* array of sock pointers */
 };
 
+/* Selection state of the reuseport BPF program running on this cpu,
+ * filled in by bpf_sk_select_reuseport().
+ */
+struct sk_reuseport_select {
+	struct sock_reuseport	*reuse;		/* group selected from */
+	struct sock		*selected;	/* socket picked by the program */
+};
+
+DECLARE_PER_CPU(struct sk_reuseport_select, sk_reuseport_select);
+
 extern int reuseport_alloc(struct sock *sk);
 extern int reuseport_add_sock(struct sock *sk, struct sock *sk2);
 extern void reuseport_detach_sock(struct sock *sk);
@@ -7,6 +7,74 @@
 #include <linux/lockdep.h>
 #include <linux/tracepoint.h>
 
+/* flags for contention_begin */
+#define LCB_F_SPIN	(1U << 0)
+#define LCB_F_READ	(1U << 1)
+#define LCB_F_WRITE	(1U << 2)
+#define LCB_F_PERCPU	(1U << 3)
+#define LCB_F_MUTEX	(1U << 4)
+
+#define show_lcb_flags(flags)					\
+	__print_flags(flags, "|",				\
+		{ LCB_F_SPIN,		"SPIN" },		\
+		{ LCB_F_READ,		"READ" },		\
+		{ LCB_F_WRITE,		"WRITE" },		\
+		{ LCB_F_PERCPU,		"PERCPU" },		\
+		{ LCB_F_MUTEX,		"MUTEX" })
+
+/*
+ * The contention events don't need lockdep: they fire from the slow paths
+ * of the locks, so they cost nothing while disabled and, unlike lock_stat,
+ * are usable on production kernels. @ip is the caller of the slow path,
+ * use a stacktrace for the full call chain.
+ */
+TRACE_EVENT(contention_begin,
+
+	TP_PROTO(void *lock, unsigned int flags, unsigned long ip),
+
+	TP_ARGS(lock, flags, ip),
+
+	TP_STRUCT__entry(
+		__field(void *, lock_addr)
+		__field(unsigned int, flags)
+		__field(unsigned long, ip)
+	),
+
+	TP_fast_assign(
+		__entry->lock_addr = lock;
+		__entry->flags = flags;
+		__entry->ip = ip;
+	),
+
+	TP_printk("%p (flags=%s) caller=%pS", __entry->lock_addr,
+		  show_lcb_flags(__entry->flags), (void *)__entry->ip)
+);
+
+TRACE_EVENT(contention_end,
+
+	TP_PROTO(void *lock, int ret, unsigned long ip, u64 wait_ns),
+
+	TP_ARGS(lock, ret, ip, wait_ns),
+
+	TP_STRUCT__entry(
+		__field(void *, lock_addr)
+		__field(int, ret)
+		__field(unsigned long, ip)
+		__field(u64, wait_ns)
+	),
+
+	TP_fast_assign(
+		__entry->lock_addr = lock;
+		__entry->ret = ret;
+		__entry->ip = ip;
+		__entry->wait_ns = wait_ns;
+	),
+
+	TP_printk("%p (ret=%d) caller=%pS wait_ns=%llu", __entry->lock_addr,
+		  __entry->ret, (void *)__entry->ip,
+		  (unsigned long long)__entry->wait_ns)
+);
+
 #ifdef CONFIG_LOCKDEP
 
 TRACE_EVENT(lock_acquire,
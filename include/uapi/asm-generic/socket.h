@@ -92,4 +92,6 @@
 
 #define SO_CNX_ADVICE		53
 
+#define SO_ZEROCOPY		54
+
 #endif /* __ASM_GENERIC_SOCKET_H */
@@ -724,9 +724,21 @@ __SYSCALL(__NR_copy_file_range, sys_copy_file_range)
 __SC_COMP(__NR_preadv2, sys_preadv2, compat_sys_preadv2)
 #define __NR_pwritev2 287
 __SC_COMP(__NR_pwritev2, sys_pwritev2, compat_sys_pwritev2)
+#define __NR_io_uring_setup 288
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 289
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register 290
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
+#define __NR_rseq 291
+__SYSCALL(__NR_rseq, sys_rseq)
+#define __NR_statx 292
+__SYSCALL(__NR_statx, sys_statx)
+#define __NR_getdents_plus 293
+__SYSCALL(__NR_getdents_plus, sys_getdents_plus)
 
 #undef __NR_syscalls
-#define __NR_syscalls 288
+#define __NR_syscalls 294
 
 /*
  * All syscalls below here should go away really,
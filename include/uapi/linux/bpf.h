@@ -73,6 +73,12 @@ enum bpf_cmd {
 	BPF_PROG_LOAD,
 	BPF_OBJ_PIN,
 	BPF_OBJ_GET,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
+	BPF_PROG_ATTACH,
+	BPF_PROG_DETACH,
 };
 
 enum bpf_map_type {
@@ -84,6 +90,11 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_PERCPU_HASH,
 	BPF_MAP_TYPE_PERCPU_ARRAY,
 	BPF_MAP_TYPE_STACK_TRACE,
+	BPF_MAP_TYPE_REUSEPORT_SOCKARRAY,
+	BPF_MAP_TYPE_LRU_HASH,
+	BPF_MAP_TYPE_LRU_PERCPU_HASH,
+	BPF_MAP_TYPE_RINGBUF,
+	BPF_MAP_TYPE_SOCKMAP,
 };
 
 enum bpf_prog_type {
@@ -93,16 +104,49 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_SCHED_CLS,
 	BPF_PROG_TYPE_SCHED_ACT,
 	BPF_PROG_TYPE_TRACEPOINT,
+	BPF_PROG_TYPE_XDP,
+	BPF_PROG_TYPE_CGROUP_SKB,
+	BPF_PROG_TYPE_SK_SKB,
 };
 
+enum bpf_attach_type {
+	BPF_CGROUP_INET_INGRESS,
+	BPF_CGROUP_INET_EGRESS,
+	BPF_SK_SKB_STREAM_VERDICT,
+	__MAX_BPF_ATTACH_TYPE
+};
+
+#define MAX_BPF_ATTACH_TYPE __MAX_BPF_ATTACH_TYPE
+
 #define BPF_PSEUDO_MAP_FD	1
 
+/* when bpf_call->src_reg == BPF_PSEUDO_CALL, bpf_call->imm == pc-relative
+ * offset to another bpf function
+ */
+#define BPF_PSEUDO_CALL		1
+
 /* flags for BPF_MAP_UPDATE_ELEM command */
 #define BPF_ANY		0 /* create new element or update existing */
 #define BPF_NOEXIST	1 /* create new element if it didn't exist */
 #define BPF_EXIST	2 /* update existing element */
 
 #define BPF_F_NO_PREALLOC	(1U << 0)
+/* Instead of having one common LRU list in the
+ * BPF_MAP_TYPE_LRU_[PERCPU_]HASH map, use a percpu LRU list
+ * which can scale and perform better.
+ * Note, the LRU nodes (including free nodes) cannot be moved
+ * across different LRU lists.
+ */
+#define BPF_F_NO_COMMON_LRU	(1U << 1)
+/* Each value of the BPF_MAP_TYPE_[LRU_]HASH or BPF_MAP_TYPE_ARRAY map
+ * starts with a struct bpf_spin_lock, which programs take with
+ * bpf_spin_lock() and cannot access otherwise.
+ */
+#define BPF_F_SPIN_LOCK		(1U << 2)
+/* Values of the BPF_MAP_TYPE_STACK_TRACE map are arrays of
+ * struct bpf_stack_build_id instead of instruction pointers.
+ */
+#define BPF_F_STACK_BUILD_ID	(1U << 3)
 
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
@@ -123,6 +167,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -138,6 +199,12 @@ union bpf_attr {
 		__aligned_u64	pathname;
 		__u32		bpf_fd;
 	};
+
+	struct { /* anonymous struct used by BPF_PROG_ATTACH/DETACH commands */
+		__u32		target_fd;	/* container object to attach to */
+		__u32		attach_bpf_fd;	/* eBPF program to attach */
+		__u32		attach_type;
+	};
 } __attribute__((aligned(8)));
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -313,6 +380,59 @@ enum bpf_func_id {
 	 */
 	BPF_FUNC_skb_get_tunnel_opt,
 	BPF_FUNC_skb_set_tunnel_opt,
+
+	/**
+	 * bpf_sk_select_reuseport(skb, map, key, flags)
+	 * select the socket in a BPF_MAP_TYPE_REUSEPORT_SOCKARRAY as the
+	 * receiver of a packet from a SO_ATTACH_REUSEPORT_EBPF program;
+	 * the selection overrides the program's return value
+	 * @skb: pointer to skb
+	 * @map: pointer to reuseport sockarray
+	 * @key: pointer to index of the socket in @map
+	 * @flags: BPF_F_REUSEPORT_NOT_FULL fails if the socket's accept
+	 *         or receive queue is full
+	 * Return: 0 on success, -ENOENT if there is no (live) socket at
+	 *         @key, -EXDEV if it belongs to another reuseport group,
+	 *         -EBUSY if it is full
+	 */
+	BPF_FUNC_sk_select_reuseport,
+
+	/**
+	 * bpf_ringbuf_output(map, data, size, flags) - copy data into a
+	 * record of a BPF_MAP_TYPE_RINGBUF
+	 * @map: pointer to ringbuf map
+	 * @data: data on stack to be output
+	 * @size: size of data
+	 * @flags: BPF_RB_NO_WAKEUP doesn't wake up the consumer,
+	 *         BPF_RB_FORCE_WAKEUP always does
+	 * Return: 0 on success, -EAGAIN if the ring buffer is full
+	 */
+	BPF_FUNC_ringbuf_output,
+
+	/**
+	 * bpf_spin_lock(lock) - take the bpf_spin_lock of a map value
+	 * @lock: pointer to a value of a map created with BPF_F_SPIN_LOCK
+	 * Only bpf_spin_unlock() of the same value may be called while the
+	 * lock is held, and the program must not exit before it.
+	 * Return: 0
+	 */
+	BPF_FUNC_spin_lock,
+
+	/**
+	 * bpf_spin_unlock(lock) - release the lock taken by bpf_spin_lock()
+	 * @lock: pointer to the same map value
+	 * Return: 0
+	 */
+	BPF_FUNC_spin_unlock,
+
+	/**
+	 * bpf_sk_redirect_map(map, key, flags) - redirect skb to a socket
+	 * @map: pointer to sockmap
+	 * @key: index of the socket to send the data on
+	 * @flags: reserved, must be zero
+	 * Return: SK_REDIRECT on success or SK_DROP on error
+	 */
+	BPF_FUNC_sk_redirect_map,
 	__BPF_FUNC_MAX_ID,
 };
 
@@ -351,6 +471,46 @@ enum bpf_func_id {
 #define BPF_F_INDEX_MASK		0xffffffffULL
 #define BPF_F_CURRENT_CPU		BPF_F_INDEX_MASK
 
+/* BPF_FUNC_sk_select_reuseport flags. */
+#define BPF_F_REUSEPORT_NOT_FULL	(1ULL << 0)
+
+/* BPF_FUNC_ringbuf_output flags. */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_MAP_TYPE_RINGBUF records: a __u32 length with
+ * BPF_RINGBUF_BUSY_BIT set while the record is being written, 4 reserved
+ * bytes and the data, padded to 8 bytes.  mmap() of the map's fd at
+ * offset 0 gives the consumer position (writable), at page 1 the producer
+ * position followed by the data area, mapped twice in a row.
+ */
+#define BPF_RINGBUF_BUSY_BIT		(1U << 31)
+#define BPF_RINGBUF_HDR_SZ		8
+
+struct bpf_spin_lock {
+	__u32	val;
+};
+
+#define BPF_BUILD_ID_SIZE 20
+enum bpf_stack_build_id_status {
+	/* the end of a trace shorter than the value */
+	BPF_STACK_BUILD_ID_EMPTY = 0,
+	/* build_id and offset into the file are valid */
+	BPF_STACK_BUILD_ID_VALID = 1,
+	/* no build id could be found, ip is the instruction pointer */
+	BPF_STACK_BUILD_ID_IP = 2,
+};
+
+/* Entry of a BPF_F_STACK_BUILD_ID stack trace map value */
+struct bpf_stack_build_id {
+	__s32		status;
+	unsigned char	build_id[BPF_BUILD_ID_SIZE];
+	union {
+		__u64	offset;
+		__u64	ip;
+	};
+};
+
 /* user accessible mirror of in-kernel sk_buff.
  * new fields can only be added to the end of this structure
  */
@@ -372,6 +532,7 @@ struct __sk_buff {
 	__u32 tc_classid;
 	__u32 data;
 	__u32 data_end;
+	__u32 napi_id;
 };
 
 struct bpf_tunnel_key {
@@ -386,4 +547,34 @@ struct bpf_tunnel_key {
 	__u32 tunnel_label;
 };
 
+/* User return codes for XDP prog type.
+ * A valid XDP program must return one of these defined values. All other
+ * return codes are reserved for future use. Unknown return codes will result
+ * in packet drop.
+ */
+enum xdp_action {
+	XDP_ABORTED = 0,
+	XDP_DROP,
+	XDP_PASS,
+	XDP_TX,
+};
+
+/* Verdicts of BPF_PROG_TYPE_SK_SKB programs.  SK_REDIRECT sends the skb
+ * on the socket chosen with bpf_sk_redirect_map(), unknown return codes
+ * drop it.
+ */
+enum sk_action {
+	SK_ABORTED = 0,
+	SK_DROP,
+	SK_REDIRECT,
+};
+
+/* user accessible metadata for XDP packet hook
+ * new fields must be added to the end of this structure
+ */
+struct xdp_md {
+	__u32 data;
+	__u32 data_end;
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
@@ -105,6 +105,12 @@
  *
  *  7.24
  *  - add FUSE_LSEEK for SEEK_HOLE and SEEK_DATA support
+ *
+ *  7.25
+ *  - add FUSE_PASSTHROUGH and FOPEN_PASSTHROUGH
+ *  - add passthrough_fh to fuse_open_out
+ *  - add FUSE_DEV_IOC_PASSTHROUGH_OPEN and FUSE_DEV_IOC_PASSTHROUGH_CLOSE
+ *  - add FUSE_DEV_IOC_BIND_QUEUE
  */
 
 #ifndef _LINUX_FUSE_H
@@ -140,7 +146,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 24
+#define FUSE_KERNEL_MINOR_VERSION 25
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -208,10 +214,12 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: read and write the backing file of passthrough_fh
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 3)
 
 /**
  * INIT request/reply flags
@@ -234,6 +242,8 @@ struct fuse_file_lock {
  * FUSE_ASYNC_DIO: asynchronous direct I/O submission
  * FUSE_WRITEBACK_CACHE: use writeback cache for buffered writes
  * FUSE_NO_OPEN_SUPPORT: kernel supports zero-message opens
+ * FUSE_PASSTHROUGH: kernel supports passthrough of read and write to a
+ *		     backing file
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -253,6 +263,7 @@ struct fuse_file_lock {
 #define FUSE_ASYNC_DIO		(1 << 15)
 #define FUSE_WRITEBACK_CACHE	(1 << 16)
 #define FUSE_NO_OPEN_SUPPORT	(1 << 17)
+#define FUSE_PASSTHROUGH	(1 << 18)
 
 /**
  * CUSE INIT request/reply flags
@@ -484,7 +495,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	uint32_t	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -761,6 +772,18 @@ struct fuse_notify_retrieve_in {
 
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+/*
+ * Register the file of an fd as the backing file of passthrough opens,
+ * returns the passthrough_fh to use in the open replies
+ */
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(229, 1, uint32_t)
+/* Drop the registration of a passthrough_fh, opens using it are unaffected */
+#define FUSE_DEV_IOC_PASSTHROUGH_CLOSE	_IOW(229, 2, uint32_t)
+/*
+ * Read only the requests submitted on the given CPU from a cloned device.
+ * Interrupts and forgets are still read from the unbound devices.
+ */
+#define FUSE_DEV_IOC_BIND_QUEUE		_IOW(229, 3, uint32_t)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -1013,6 +1013,30 @@ enum nft_fwd_attributes {
 };
 #define NFTA_FWD_MAX	(__NFTA_FWD_MAX - 1)
 
+/**
+ * enum nft_flow_offload_attributes - nf_tables flow offload expression netlink attributes
+ *
+ * @NFTA_FLOW_DEVICES: devices the fast path is attached to (NLA_NESTED: nft_devices_attributes)
+ */
+enum nft_flow_offload_attributes {
+	NFTA_FLOW_UNSPEC,
+	NFTA_FLOW_DEVICES,
+	__NFTA_FLOW_MAX
+};
+#define NFTA_FLOW_MAX	(__NFTA_FLOW_MAX - 1)
+
+/**
+ * enum nft_devices_attributes - nf_tables device list netlink attributes
+ *
+ * @NFTA_DEVICE_NAME: name of this device (NLA_STRING)
+ */
+enum nft_devices_attributes {
+	NFTA_DEVICE_UNSPEC,
+	NFTA_DEVICE_NAME,
+	__NFTA_DEVICE_MAX
+};
+#define NFTA_DEVICE_MAX	(__NFTA_DEVICE_MAX - 1)
+
 /**
  * enum nft_gen_attributes - nf_tables ruleset generation attributes
  *
@@ -403,6 +403,20 @@ struct perf_event_attr {
 #define PERF_EVENT_IOC_ID		_IOR('$', 7, __u64 *)
 #define PERF_EVENT_IOC_SET_BPF		_IOW('$', 8, __u32)
 #define PERF_EVENT_IOC_PAUSE_OUTPUT	_IOW('$', 9, __u32)
+#define PERF_EVENT_IOC_ATTACH_CGROUP	_IOW('$', 10, __u64 *)
+#define PERF_EVENT_IOC_READ_CGROUP	_IOWR('$', 11, __u64 *)
+
+/*
+ * PERF_EVENT_IOC_ATTACH_CGROUP takes an array of { nr, id[nr] } where
+ * each id is the inode number of a perf_event cgroup directory. The
+ * event must be a per-cpu counting event; from then on its count is
+ * split between the listed cgroups (and attributed hierarchically, like
+ * a cgroup event) every time the cgroup switches on that CPU.
+ *
+ * PERF_EVENT_IOC_READ_CGROUP takes an array of 4 __u64: the caller sets
+ * the cgroup id in the first one and the kernel fills in the value,
+ * time_enabled and time_running accumulated for that cgroup.
+ */
 
 enum perf_event_ioc_flags {
 	PERF_IOC_FLAG_GROUP		= 1U << 0,
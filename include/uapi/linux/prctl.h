@@ -197,4 +197,13 @@ struct prctl_mm_map {
 # define PR_CAP_AMBIENT_LOWER		3
 # define PR_CAP_AMBIENT_CLEAR_ALL	4
 
+/* Give the process its own futex hash table, before it has other threads */
+#define PR_FUTEX_HASH			48
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+
+/* Let fork share page tables copy-on-write instead of copying them */
+#define PR_SET_FORK_SHARE_PTES		49
+#define PR_GET_FORK_SHARE_PTES		50
+
 #endif /* _LINUX_PRCTL_H */
@@ -18,6 +18,7 @@
 #include <linux/dirent.h>
 #include <linux/syscalls.h>
 #include <linux/utime.h>
+#include <linux/async.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
 {
@@ -605,7 +606,15 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+static bool __initdata initramfs_async = true;
+
+static int __init initramfs_async_setup(char *str)
+{
+	return kstrtobool(str, &initramfs_async) == 0;
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
 {
 	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
 	if (err)
@@ -653,6 +662,42 @@ static int __init populate_rootfs(void)
 		 */
 		load_default_modules();
 	}
+}
+
+/*
+ * Unpacking runs in its own async domain, so that async_synchronize_full()
+ * callers such as module loading don't end up waiting for it.
+ */
+static ASYNC_DOMAIN_EXCLUSIVE(initramfs_domain);
+static async_cookie_t initramfs_cookie;
+
+/*
+ * Wait for the initramfs to be unpacked, for anything that looks for files
+ * in rootfs: the usermode helper, the firmware loader and the start of
+ * init itself.
+ */
+void wait_for_initramfs(void)
+{
+	if (!initramfs_cookie) {
+		/* nothing has been scheduled yet, rootfs is empty anyway */
+		pr_warn_once("wait_for_initramfs() called before rootfs_initcalls\n");
+		return;
+	}
+	async_synchronize_cookie_domain(initramfs_cookie + 1,
+					&initramfs_domain);
+}
+EXPORT_SYMBOL_GPL(wait_for_initramfs);
+
+/*
+ * Decompressing a large initramfs takes a while, so do it in parallel with
+ * the device initcalls.  "initramfs_async=0" restores the old behaviour.
+ */
+static int __init populate_rootfs(void)
+{
+	initramfs_cookie = async_schedule_domain(do_populate_rootfs, NULL,
+						 &initramfs_domain);
+	if (!initramfs_async)
+		wait_for_initramfs();
 	return 0;
 }
 rootfs_initcall(populate_rootfs);
@@ -69,8 +69,44 @@ static struct list_head audit_rules_list[AUDIT_NR_FILTERS] = {
 	LIST_HEAD_INIT(audit_rules_list[5]),
 };
 
+/*
+ * Union of the syscall masks of the rules on each filter list.  A syscall
+ * whose bit is clear cannot match any rule on that list, so the syscall
+ * filters skip the walk entirely.  Written under audit_filter_mutex.
+ */
+u32 audit_filter_syscalls[AUDIT_NR_FILTERS][AUDIT_BITMASK_SIZE];
+
 DEFINE_MUTEX(audit_filter_mutex);
 
+/* Recompute the syscall union of a filter list after removing a rule. */
+static void audit_update_filter_syscalls(int listnr)
+{
+	u32 mask[AUDIT_BITMASK_SIZE] = { 0 };
+	struct audit_entry *e;
+	int i;
+
+	list_for_each_entry(e, &audit_filter_list[listnr], list)
+		for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+			mask[i] |= e->rule.mask[i];
+
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		WRITE_ONCE(audit_filter_syscalls[listnr][i], mask[i]);
+}
+
+/*
+ * Widen the syscall union before a rule goes on its filter list, so that
+ * a concurrent syscall never sees the rule without its bits.
+ */
+static void audit_add_filter_syscalls(struct audit_krule *rule)
+{
+	int i;
+
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		WRITE_ONCE(audit_filter_syscalls[rule->listnr][i],
+			   audit_filter_syscalls[rule->listnr][i] |
+			   rule->mask[i]);
+}
+
 static void audit_free_lsm_field(struct audit_field *f)
 {
 	switch (f->type) {
@@ -955,6 +991,10 @@ static inline int audit_add_rule(struct audit_entry *entry)
 			entry->rule.prio = --prio_low;
 	}
 
+	/* Watch rules hang off the inode hash, not the filter list */
+	if (list == &audit_filter_list[entry->rule.listnr])
+		audit_add_filter_syscalls(&entry->rule);
+
 	if (entry->rule.flags & AUDIT_FILTER_PREPEND) {
 		list_add(&entry->rule.list,
 			 &audit_rules_list[entry->rule.listnr]);
@@ -1019,6 +1059,8 @@ int audit_del_rule(struct audit_entry *entry)
 
 	list_del_rcu(&e->list);
 	list_del(&e->rule.list);
+	if (list == &audit_filter_list[e->rule.listnr])
+		audit_update_filter_syscalls(e->rule.listnr);
 	call_rcu(&e->rcu, audit_free_rule_rcu);
 
 out:
@@ -740,6 +740,21 @@ static int audit_in_mask(const struct audit_krule *rule, unsigned long val)
 	return rule->mask[word] & bit;
 }
 
+/* Can any rule on filter list @listnr match syscall @val? */
+static bool audit_filter_has_syscall(int listnr, unsigned long val)
+{
+	int word;
+
+	if (val > 0xffffffff)
+		return false;
+
+	word = AUDIT_WORD(val);
+	if (word >= AUDIT_BITMASK_SIZE)
+		return false;
+
+	return READ_ONCE(audit_filter_syscalls[listnr][word]) & AUDIT_BIT(val);
+}
+
 /* At syscall entry and exit time, this filter is called if the
  * audit_state is not low enough that auditing cannot take place, but is
  * also not high enough that we already know we have to write an audit
@@ -747,14 +762,18 @@ static int audit_in_mask(const struct audit_krule *rule, unsigned long val)
  */
 static enum audit_state audit_filter_syscall(struct task_struct *tsk,
 					     struct audit_context *ctx,
-					     struct list_head *list)
+					     int listnr)
 {
+	struct list_head *list = &audit_filter_list[listnr];
 	struct audit_entry *e;
 	enum audit_state state;
 
 	if (audit_pid && tsk->tgid == audit_pid)
 		return AUDIT_DISABLED;
 
+	if (!audit_filter_has_syscall(listnr, ctx->major))
+		return AUDIT_BUILD_CONTEXT;
+
 	rcu_read_lock();
 	if (!list_empty(list)) {
 		list_for_each_entry_rcu(e, list, list) {
@@ -848,7 +867,7 @@ static inline struct audit_context *audit_take_context(struct task_struct *tsk,
 		context->return_code  = return_code;
 
 	if (context->in_syscall && !context->dummy) {
-		audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_EXIT]);
+		audit_filter_syscall(tsk, context, AUDIT_FILTER_EXIT);
 		audit_filter_inodes(tsk, context);
 	}
 
@@ -1517,7 +1536,7 @@ void __audit_syscall_entry(int major, unsigned long a1, unsigned long a2,
 	context->dummy = !audit_n_rules;
 	if (!context->dummy && state == AUDIT_BUILD_CONTEXT) {
 		context->prio = 0;
-		state = audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_ENTRY]);
+		state = audit_filter_syscall(tsk, context, AUDIT_FILTER_ENTRY);
 	}
 	if (state == AUDIT_DISABLED)
 		return;
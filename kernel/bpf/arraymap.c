@@ -16,6 +16,9 @@
 #include <linux/mm.h>
 #include <linux/filter.h>
 #include <linux/perf_event.h>
+#include <linux/net.h>
+#include <linux/log2.h>
+#include <net/sock.h>
 
 static void bpf_array_free_percpu(struct bpf_array *array)
 {
@@ -53,7 +56,12 @@ static struct bpf_map *array_map_alloc(union bpf_attr *attr)
 
 	/* check sanity of attributes */
 	if (attr->max_entries == 0 || attr->key_size != 4 ||
-	    attr->value_size == 0 || attr->map_flags)
+	    attr->value_size == 0 || attr->map_flags & ~BPF_F_SPIN_LOCK)
+		return ERR_PTR(-EINVAL);
+
+	if ((attr->map_flags & BPF_F_SPIN_LOCK) &&
+	    (attr->map_type != BPF_MAP_TYPE_ARRAY ||
+	     attr->value_size < sizeof(struct bpf_spin_lock)))
 		return ERR_PTR(-EINVAL);
 
 	if (attr->value_size >= 1 << (KMALLOC_SHIFT_MAX - 1))
@@ -88,6 +96,7 @@ static struct bpf_map *array_map_alloc(union bpf_attr *attr)
 	array->map.key_size = attr->key_size;
 	array->map.value_size = attr->value_size;
 	array->map.max_entries = attr->max_entries;
+	array->map.map_flags = attr->map_flags;
 	array->elem_size = elem_size;
 
 	if (!percpu)
@@ -118,6 +127,30 @@ static void *array_map_lookup_elem(struct bpf_map *map, void *key)
 	return array->value + array->elem_size * index;
 }
 
+/* array_map_lookup_elem() inlined into the program */
+static u32 array_map_gen_lookup(struct bpf_map *map, struct bpf_insn *insn_buf)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+	struct bpf_insn *insn = insn_buf;
+	u32 elem_size = array->elem_size;
+	const int ret = BPF_REG_0;
+	const int map_ptr = BPF_REG_1;
+	const int index = BPF_REG_2;
+
+	*insn++ = BPF_ALU64_IMM(BPF_ADD, map_ptr,
+				offsetof(struct bpf_array, value));
+	*insn++ = BPF_LDX_MEM(BPF_W, ret, index, 0);
+	*insn++ = BPF_JMP_IMM(BPF_JGE, ret, map->max_entries, 3);
+	if (is_power_of_2(elem_size))
+		*insn++ = BPF_ALU64_IMM(BPF_LSH, ret, ilog2(elem_size));
+	else
+		*insn++ = BPF_ALU64_IMM(BPF_MUL, ret, elem_size);
+	*insn++ = BPF_ALU64_REG(BPF_ADD, ret, map_ptr);
+	*insn++ = BPF_JMP_IMM(BPF_JA, 0, 0, 1);
+	*insn++ = BPF_MOV32_IMM(ret, 0);
+	return insn - insn_buf;
+}
+
 /* Called from eBPF program */
 static void *percpu_array_map_lookup_elem(struct bpf_map *map, void *key)
 {
@@ -160,7 +193,7 @@ int bpf_percpu_array_copy(struct bpf_map *map, void *key, void *value)
 static int array_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
 	struct bpf_array *array = container_of(map, struct bpf_array, map);
-	u32 index = *(u32 *)key;
+	u32 index = key ? *(u32 *)key : U32_MAX;
 	u32 *next = (u32 *)next_key;
 
 	if (index >= array->map.max_entries) {
@@ -198,8 +231,8 @@ static int array_map_update_elem(struct bpf_map *map, void *key, void *value,
 		memcpy(this_cpu_ptr(array->pptrs[index]),
 		       value, map->value_size);
 	else
-		memcpy(array->value + array->elem_size * index,
-		       value, map->value_size);
+		copy_map_value(map, array->value + array->elem_size * index,
+			       value);
 	return 0;
 }
 
@@ -272,6 +305,9 @@ static const struct bpf_map_ops array_ops = {
 	.map_lookup_elem = array_map_lookup_elem,
 	.map_update_elem = array_map_update_elem,
 	.map_delete_elem = array_map_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_gen_lookup = array_map_gen_lookup,
 };
 
 static struct bpf_map_type_list array_type __read_mostly = {
@@ -286,6 +322,8 @@ static const struct bpf_map_ops percpu_array_ops = {
 	.map_lookup_elem = percpu_array_map_lookup_elem,
 	.map_update_elem = array_map_update_elem,
 	.map_delete_elem = array_map_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
 };
 
 static struct bpf_map_type_list percpu_array_type __read_mostly = {
@@ -389,7 +427,7 @@ static void prog_fd_array_put_ptr(void *ptr)
 {
 	struct bpf_prog *prog = ptr;
 
-	bpf_prog_put_rcu(prog);
+	bpf_prog_put(prog);
 }
 
 /* decrement refcnt of all bpf_progs that are stored in this map */
@@ -491,3 +529,72 @@ static int __init register_perf_event_array_map(void)
 	return 0;
 }
 late_initcall(register_perf_event_array_map);
+
+#ifdef CONFIG_INET
+static void reuseport_array_map_free(struct bpf_map *map)
+{
+	bpf_fd_array_map_clear(map);
+	fd_array_map_free(map);
+}
+
+static void *reuseport_fd_array_get_ptr(struct bpf_map *map, int fd)
+{
+	struct socket *sock;
+	struct sock *sk;
+	int err;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return ERR_PTR(err);
+
+	sk = sock->sk;
+	err = -EINVAL;
+	if ((sk->sk_family != AF_INET && sk->sk_family != AF_INET6) ||
+	    (sk->sk_protocol != IPPROTO_TCP && sk->sk_protocol != IPPROTO_UDP))
+		goto err;
+
+	/* Only sockets already in a reuseport group (listening TCP or
+	 * bound UDP) make sense here. Those are hashed and have
+	 * SOCK_RCU_FREE set, so bpf_sk_select_reuseport() can look at them
+	 * under RCU even while we drop the last reference.
+	 */
+	if (!rcu_access_pointer(sk->sk_reuseport_cb) ||
+	    !sock_flag(sk, SOCK_RCU_FREE))
+		goto err;
+
+	sock_hold(sk);
+	sockfd_put(sock);
+	return sk;
+err:
+	sockfd_put(sock);
+	return ERR_PTR(err);
+}
+
+static void reuseport_fd_array_put_ptr(void *ptr)
+{
+	sock_put((struct sock *)ptr);
+}
+
+static const struct bpf_map_ops reuseport_array_ops = {
+	.map_alloc = fd_array_map_alloc,
+	.map_free = reuseport_array_map_free,
+	.map_get_next_key = array_map_get_next_key,
+	.map_lookup_elem = fd_array_map_lookup_elem,
+	.map_update_elem = fd_array_map_update_elem,
+	.map_delete_elem = fd_array_map_delete_elem,
+	.map_fd_get_ptr = reuseport_fd_array_get_ptr,
+	.map_fd_put_ptr = reuseport_fd_array_put_ptr,
+};
+
+static struct bpf_map_type_list reuseport_array_type __read_mostly = {
+	.ops = &reuseport_array_ops,
+	.type = BPF_MAP_TYPE_REUSEPORT_SOCKARRAY,
+};
+
+static int __init register_reuseport_array_map(void)
+{
+	bpf_register_map_type(&reuseport_array_type);
+	return 0;
+}
+late_initcall(register_reuseport_array_map);
+#endif /* CONFIG_INET */
@@ -161,6 +161,18 @@ static void bpf_adj_branches(struct bpf_prog *prog, u32 pos, u32 delta)
 		else if (i > pos + delta && i + insn->off + 1 <= pos + delta)
 			insn->off -= delta;
 	}
+
+	/* Calls of bpf functions carry their target in imm. */
+	insn = prog->insnsi;
+	for (i = 0; i < insn_cnt; i++, insn++) {
+		if (!bpf_pseudo_call(insn))
+			continue;
+
+		if (i < pos && i + insn->imm + 1 > pos)
+			insn->imm += delta;
+		else if (i > pos + delta && i + insn->imm + 1 <= pos + delta)
+			insn->imm -= delta;
+	}
 }
 
 struct bpf_prog *bpf_patch_insn_single(struct bpf_prog *prog, u32 off,
@@ -458,17 +470,28 @@ noinline u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
 }
 EXPORT_SYMBOL_GPL(__bpf_call_base);
 
-/**
- *	__bpf_prog_run - run eBPF program on a given context
- *	@ctx: is the data we are operating on
- *	@insn: is the array of eBPF instructions
- *
- * Decode and execute eBPF instructions.
+static u64 ___bpf_prog_run(u64 *regs, const struct bpf_insn *insn);
+
+/* A bpf function runs on the stack below the insn->off bytes the verifier
+ * found its caller to use, R1-R5 are its arguments.
  */
-static unsigned int __bpf_prog_run(void *ctx, const struct bpf_insn *insn)
+static noinline u64 bpf_call_subprog(const u64 *regs,
+				     const struct bpf_insn *insn)
 {
-	u64 stack[MAX_BPF_STACK / sizeof(u64)];
-	u64 regs[MAX_BPF_REG], tmp;
+	u64 callee[MAX_BPF_REG];
+	int i;
+
+	for (i = BPF_REG_1; i <= BPF_REG_5; i++)
+		callee[i] = regs[i];
+	callee[BPF_REG_FP] = regs[BPF_REG_FP] - insn->off;
+
+	return ___bpf_prog_run(callee, insn + insn->imm + 1);
+}
+
+/* Decode and execute eBPF instructions of one function. */
+static u64 ___bpf_prog_run(u64 *regs, const struct bpf_insn *insn)
+{
+	u64 tmp;
 	static const void *jumptable[256] = {
 		[0 ... 255] = &&default_label,
 		/* Now overwrite non-defaults ... */
@@ -576,9 +599,6 @@ static unsigned int __bpf_prog_run(void *ctx, const struct bpf_insn *insn)
 #define CONT	 ({ insn++; goto select_insn; })
 #define CONT_JMP ({ insn++; goto select_insn; })
 
-	FP = (u64) (unsigned long) &stack[ARRAY_SIZE(stack)];
-	ARG1 = (u64) (unsigned long) ctx;
-
 select_insn:
 	goto *jumptable[insn->code];
 
@@ -707,6 +727,10 @@ select_insn:
 		 * preserves BPF_R6-BPF_R9, and stores return value
 		 * into BPF_R0.
 		 */
+		if (unlikely(insn->src_reg == BPF_PSEUDO_CALL)) {
+			BPF_R0 = bpf_call_subprog(regs, insn);
+			CONT;
+		}
 		BPF_R0 = (__bpf_call_base + insn->imm)(BPF_R1, BPF_R2, BPF_R3,
 						       BPF_R4, BPF_R5);
 		CONT;
@@ -922,7 +946,25 @@ load_byte:
 		WARN_RATELIMIT(1, "unknown opcode %02x\n", insn->code);
 		return 0;
 }
-STACK_FRAME_NON_STANDARD(__bpf_prog_run); /* jump table */
+STACK_FRAME_NON_STANDARD(___bpf_prog_run); /* jump table */
+
+/**
+ *	__bpf_prog_run - run eBPF program on a given context
+ *	@ctx: is the data we are operating on
+ *	@insn: is the array of eBPF instructions
+ *
+ * Decode and execute eBPF instructions.
+ */
+static unsigned int __bpf_prog_run(void *ctx, const struct bpf_insn *insn)
+{
+	u64 stack[MAX_BPF_STACK / sizeof(u64)];
+	u64 regs[MAX_BPF_REG];
+
+	FP = (u64) (unsigned long) &stack[ARRAY_SIZE(stack)];
+	ARG1 = (u64) (unsigned long) ctx;
+
+	return ___bpf_prog_run(regs, insn);
+}
 
 bool bpf_prog_array_compatible(struct bpf_array *array,
 			       const struct bpf_prog *fp)
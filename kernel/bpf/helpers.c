@@ -16,6 +16,8 @@
 #include <linux/ktime.h>
 #include <linux/sched.h>
 #include <linux/uidgid.h>
+#include <linux/spinlock.h>
+#include <linux/irqflags.h>
 
 /* If kernel subsystem is allowing eBPF programs to call this function,
  * inside its own verifier_ops->get_func_proto() callback it should return
@@ -186,3 +188,86 @@ const struct bpf_func_proto bpf_get_current_comm_proto = {
 	.arg1_type	= ARG_PTR_TO_RAW_STACK,
 	.arg2_type	= ARG_CONST_STACK_SIZE,
 };
+
+#ifdef CONFIG_QUEUED_SPINLOCKS
+
+/* an unlocked qspinlock is all zeroes and fits the four bytes user space
+ * sees as struct bpf_spin_lock
+ */
+static inline void __bpf_spin_lock(struct bpf_spin_lock *lock)
+{
+	arch_spinlock_t *l = (void *)lock;
+
+	BUILD_BUG_ON(sizeof(*l) != sizeof(*lock));
+	arch_spin_lock(l);
+}
+
+static inline void __bpf_spin_unlock(struct bpf_spin_lock *lock)
+{
+	arch_spinlock_t *l = (void *)lock;
+
+	arch_spin_unlock(l);
+}
+
+#else
+
+static inline void __bpf_spin_lock(struct bpf_spin_lock *lock)
+{
+	atomic_t *l = (void *)lock;
+
+	BUILD_BUG_ON(sizeof(*l) != sizeof(*lock));
+	do {
+		while (atomic_read(l))
+			cpu_relax();
+	} while (atomic_xchg(l, 1));
+}
+
+static inline void __bpf_spin_unlock(struct bpf_spin_lock *lock)
+{
+	atomic_t *l = (void *)lock;
+
+	atomic_set_release(l, 0);
+}
+
+#endif
+
+/* the verifier allows no other helper and no exit while the lock is held,
+ * so there is one lock per cpu at most and its irq flags can live here
+ */
+static DEFINE_PER_CPU(unsigned long, bpf_spin_irqsave_flags);
+
+static u64 bpf_spin_lock(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_spin_lock *lock = (struct bpf_spin_lock *) (long) r1;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__bpf_spin_lock(lock);
+	__this_cpu_write(bpf_spin_irqsave_flags, flags);
+	return 0;
+}
+
+const struct bpf_func_proto bpf_spin_lock_proto = {
+	.func		= bpf_spin_lock,
+	.gpl_only	= false,
+	.ret_type	= RET_VOID,
+	.arg1_type	= ARG_PTR_TO_SPIN_LOCK,
+};
+
+static u64 bpf_spin_unlock(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_spin_lock *lock = (struct bpf_spin_lock *) (long) r1;
+	unsigned long flags;
+
+	flags = __this_cpu_read(bpf_spin_irqsave_flags);
+	__bpf_spin_unlock(lock);
+	local_irq_restore(flags);
+	return 0;
+}
+
+const struct bpf_func_proto bpf_spin_unlock_proto = {
+	.func		= bpf_spin_unlock,
+	.gpl_only	= false,
+	.ret_type	= RET_VOID,
+	.arg1_type	= ARG_PTR_TO_SPIN_LOCK,
+};
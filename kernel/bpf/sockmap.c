@@ -0,0 +1,645 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * BPF_MAP_TYPE_SOCKMAP: an array of TCP sockets.  While a
+ * BPF_SK_SKB_STREAM_VERDICT program is attached to the map, the data
+ * received on its sockets is handed to the program skb by skb instead of
+ * being queued for the socket's owner.  The program either drops it or
+ * redirects it with bpf_sk_redirect_map() to another socket of the map,
+ * whose send path it is then queued on.  A proxy forwarding between two
+ * sockets never has to copy the data to user space.
+ *
+ * Like KCM, the map claims sk_user_data and the data_ready and
+ * write_space callbacks of a socket and holds a reference on its file
+ * until the socket is deleted from the map or the map is freed.
+ */
+#include <linux/bpf.h>
+#include <linux/err.h>
+#include <linux/file.h>
+#include <linux/filter.h>
+#include <linux/net.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+struct bpf_stab;
+
+struct smap_psock {
+	struct rcu_head rcu;
+	struct bpf_stab *stab;
+	struct socket *sock;
+	struct sock *sk;
+	bool detached;
+
+	/* data redirected to this socket, sent by tx_work */
+	struct sk_buff_head tx_queue;
+	struct sk_buff *tx_skb;		/* partly sent */
+	int tx_off;
+	struct work_struct tx_work;
+
+	/* reads what was received before the socket was added */
+	struct work_struct rx_work;
+	struct work_struct gc_work;
+
+	void (*save_data_ready)(struct sock *sk);
+	void (*save_write_space)(struct sock *sk);
+};
+
+struct bpf_stab {
+	struct bpf_map map;
+	spinlock_t lock;		/* serializes updates of psocks[] */
+	struct bpf_prog __rcu *bpf_verdict;
+	struct smap_psock __rcu *psocks[];
+};
+
+/* set by bpf_sk_redirect_map(), consumed once the verdict program ran */
+struct sk_redirect_info {
+	struct bpf_map *map;
+	u32 key;
+};
+
+static DEFINE_PER_CPU(struct sk_redirect_info, sk_redirect_info);
+
+static inline struct smap_psock *smap_psock_sk(const struct sock *sk)
+{
+	return (struct smap_psock *)sk->sk_user_data;
+}
+
+static void smap_report_sk_error(struct smap_psock *psock, int err)
+{
+	struct sock *sk = psock->sk;
+
+	sk->sk_err = err;
+	sk->sk_error_report(sk);
+}
+
+static struct smap_psock *smap_redirect_psock(void)
+{
+	struct sk_redirect_info *ri = this_cpu_ptr(&sk_redirect_info);
+	struct smap_psock *peer = NULL;
+	struct bpf_stab *stab;
+
+	if (ri->map) {
+		stab = container_of(ri->map, struct bpf_stab, map);
+		if (ri->key < stab->map.max_entries)
+			peer = rcu_dereference(stab->psocks[ri->key]);
+		ri->map = NULL;
+	}
+	return peer;
+}
+
+/* Lower socket lock and rcu read lock held */
+static void smap_do_verdict(struct smap_psock *psock, struct bpf_prog *prog,
+			    struct sk_buff *skb)
+{
+	struct smap_psock *peer;
+	int rc;
+
+	rc = bpf_prog_run_save_cb(prog, skb);
+	peer = smap_redirect_psock();
+
+	if (rc == SK_REDIRECT && likely(peer && !READ_ONCE(peer->detached))) {
+		/* holds the peer's sk until the data is sent */
+		skb_set_owner_w(skb, peer->sk);
+		skb_queue_tail(&peer->tx_queue, skb);
+		schedule_work(&peer->tx_work);
+		return;
+	}
+
+	kfree_skb(skb);
+}
+
+/* Lower socket lock held */
+static int smap_tcp_recv(read_descriptor_t *desc, struct sk_buff *orig_skb,
+			 unsigned int orig_offset, size_t orig_len)
+{
+	struct smap_psock *psock = (struct smap_psock *)desc->arg.data;
+	struct bpf_prog *prog;
+	struct sk_buff *skb;
+
+	prog = rcu_dereference(psock->stab->bpf_verdict);
+	if (unlikely(!prog)) {
+		/* detached meanwhile, leave the rest to the owner */
+		desc->count = 0;
+		return 0;
+	}
+
+	skb = skb_clone(orig_skb, GFP_ATOMIC);
+	if (!skb) {
+		desc->error = -ENOMEM;
+		return 0;
+	}
+
+	if (!pskb_pull(skb, orig_offset) || pskb_trim(skb, orig_len)) {
+		kfree_skb(skb);
+		desc->error = -ENOMEM;
+		return 0;
+	}
+
+	smap_do_verdict(psock, prog, skb);
+	return orig_len;
+}
+
+/* Called with lock held on lower socket */
+static int smap_read_sock(struct smap_psock *psock)
+{
+	read_descriptor_t desc;
+
+	desc.arg.data = psock;
+	desc.error = 0;
+	desc.count = 1; /* give more than one skb per call */
+
+	rcu_read_lock();
+	tcp_read_sock(psock->sk, &desc, smap_tcp_recv);
+	rcu_read_unlock();
+
+	return desc.error;
+}
+
+/* Lower sock lock held */
+static void smap_data_ready(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock))
+		goto out;
+
+	if (!rcu_access_pointer(psock->stab->bpf_verdict)) {
+		/* no program, the data is for the socket's owner */
+		psock->save_data_ready(sk);
+		goto out;
+	}
+
+	if (smap_read_sock(psock) == -ENOMEM)
+		schedule_work(&psock->rx_work);
+out:
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void smap_rx_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock,
+						rx_work);
+	struct sock *sk = psock->sk;
+
+	/* We need the read lock to synchronize with smap_data_ready. We
+	 * need the socket lock for calling tcp_read_sock.
+	 */
+	lock_sock(sk);
+	read_lock_bh(&sk->sk_callback_lock);
+
+	if (unlikely(smap_psock_sk(sk) != psock))
+		goto out;
+
+	if (!rcu_access_pointer(psock->stab->bpf_verdict))
+		goto out;
+
+	if (smap_read_sock(psock) == -ENOMEM)
+		schedule_work(&psock->rx_work);
+out:
+	read_unlock_bh(&sk->sk_callback_lock);
+	release_sock(sk);
+}
+
+static void smap_write_space(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		if (psock->tx_skb || !skb_queue_empty(&psock->tx_queue))
+			schedule_work(&psock->tx_work);
+		psock->save_write_space(sk);
+	}
+
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+/* Send what follows @off in @skb without blocking.  Returns the number of
+ * bytes sent, short when the socket is full, or an error if nothing was.
+ * The paged data goes out by sendpage without being copied.
+ */
+static int smap_send_skb(struct socket *sock, struct sk_buff *skb, int off)
+{
+	int start = 0, end, pos = off, ret, i;
+	struct sk_buff *frag_iter;
+
+	end = skb_headlen(skb);
+	if (pos < end) {
+		struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+		struct kvec kv = {
+			.iov_base = skb->data + pos,
+			.iov_len = end - pos,
+		};
+
+		ret = kernel_sendmsg(sock, &msg, &kv, 1, kv.iov_len);
+		if (ret <= 0)
+			goto out;
+		pos += ret;
+		if (pos < end)
+			goto out;
+	}
+	start = end;
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		end = start + skb_frag_size(frag);
+		if (pos < end) {
+			ret = kernel_sendpage(sock, skb_frag_page(frag),
+					      frag->page_offset + pos - start,
+					      end - pos, MSG_DONTWAIT);
+			if (ret <= 0)
+				goto out;
+			pos += ret;
+			if (pos < end)
+				goto out;
+		}
+		start = end;
+	}
+
+	skb_walk_frags(skb, frag_iter) {
+		end = start + frag_iter->len;
+		if (pos < end) {
+			ret = smap_send_skb(sock, frag_iter, pos - start);
+			if (ret <= 0)
+				goto out;
+			pos += ret;
+			if (pos < end)
+				goto out;
+		}
+		start = end;
+	}
+	ret = 0;
+out:
+	return pos > off ? pos - off : ret;
+}
+
+static void smap_tx_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock,
+						tx_work);
+	struct sk_buff *skb;
+	int n;
+
+	while (!READ_ONCE(psock->detached)) {
+		skb = psock->tx_skb;
+		if (!skb) {
+			skb = skb_dequeue(&psock->tx_queue);
+			if (!skb)
+				break;
+			psock->tx_skb = skb;
+			psock->tx_off = 0;
+		}
+
+		n = smap_send_skb(psock->sock, skb, psock->tx_off);
+		if (n == -EAGAIN)
+			/* write_space reschedules us */
+			break;
+		if (n > 0) {
+			psock->tx_off += n;
+			if (psock->tx_off < skb->len)
+				break;
+		} else {
+			/* the stream lost data, let the owner know */
+			smap_report_sk_error(psock, n ? -n : EPIPE);
+		}
+
+		psock->tx_skb = NULL;
+		kfree_skb(skb);
+	}
+}
+
+static void smap_gc_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock,
+						gc_work);
+
+	cancel_work_sync(&psock->rx_work);
+	cancel_work_sync(&psock->tx_work);
+
+	kfree_skb(psock->tx_skb);
+	skb_queue_purge(&psock->tx_queue);
+
+	fput(psock->sock->file);
+	kfree(psock);
+}
+
+static void smap_free_psock_rcu(struct rcu_head *rcu)
+{
+	struct smap_psock *psock = container_of(rcu, struct smap_psock, rcu);
+
+	/* cancel_work_sync() may sleep */
+	schedule_work(&psock->gc_work);
+}
+
+/* give the socket back to its owner */
+static void smap_release_sock(struct smap_psock *psock)
+{
+	struct sock *sk = psock->sk;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	sk->sk_user_data = NULL;
+	sk->sk_data_ready = psock->save_data_ready;
+	sk->sk_write_space = psock->save_write_space;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	WRITE_ONCE(psock->detached, true);
+	call_rcu(&psock->rcu, smap_free_psock_rcu);
+}
+
+static struct smap_psock *smap_init_psock(struct bpf_stab *stab,
+					  struct socket *sock)
+{
+	struct sock *sk = sock->sk;
+	struct smap_psock *psock;
+
+	psock = kzalloc(sizeof(*psock), GFP_ATOMIC | __GFP_NOWARN);
+	if (!psock)
+		return ERR_PTR(-ENOMEM);
+
+	psock->stab = stab;
+	psock->sock = sock;
+	psock->sk = sk;
+	skb_queue_head_init(&psock->tx_queue);
+	INIT_WORK(&psock->tx_work, smap_tx_work);
+	INIT_WORK(&psock->rx_work, smap_rx_work);
+	INIT_WORK(&psock->gc_work, smap_gc_work);
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (sk->sk_user_data) {
+		/* KCM or another map has the socket */
+		write_unlock_bh(&sk->sk_callback_lock);
+		kfree(psock);
+		return ERR_PTR(-EBUSY);
+	}
+	psock->save_data_ready = sk->sk_data_ready;
+	psock->save_write_space = sk->sk_write_space;
+	sk->sk_user_data = psock;
+	sk->sk_data_ready = smap_data_ready;
+	sk->sk_write_space = smap_write_space;
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	return psock;
+}
+
+/* Called from syscall */
+static struct bpf_map *sock_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_stab *stab;
+	u64 cost;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	cost = sizeof(*stab) +
+	       (u64) attr->max_entries * sizeof(struct smap_psock *);
+	if (cost >= U32_MAX - PAGE_SIZE)
+		return ERR_PTR(-ENOMEM);
+
+	stab = kzalloc(cost, GFP_USER | __GFP_NOWARN);
+	if (!stab) {
+		stab = vzalloc(cost);
+		if (!stab)
+			return ERR_PTR(-ENOMEM);
+	}
+
+	stab->map.map_type = attr->map_type;
+	stab->map.key_size = attr->key_size;
+	stab->map.value_size = attr->value_size;
+	stab->map.max_entries = attr->max_entries;
+	stab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+	spin_lock_init(&stab->lock);
+
+	return &stab->map;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void sock_map_free(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct smap_psock *psock;
+	struct bpf_prog *prog;
+	int i;
+
+	/* no more programs use the map, but data_ready may still be in
+	 * the verdict program
+	 */
+	for (i = 0; i < map->max_entries; i++) {
+		psock = rcu_dereference_protected(stab->psocks[i], 1);
+		if (psock)
+			smap_release_sock(psock);
+	}
+
+	synchronize_rcu();
+
+	prog = rcu_dereference_protected(stab->bpf_verdict, 1);
+	if (prog)
+		bpf_prog_put(prog);
+
+	kvfree(stab);
+}
+
+static int sock_map_get_next_key(struct bpf_map *map, void *key,
+				 void *next_key)
+{
+	u32 index = *(u32 *)key;
+	u32 *next = (u32 *)next_key;
+
+	if (index >= map->max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == map->max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+/* the sockets are not handed out, neither to programs nor user space */
+static void *sock_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+/* Called from syscall, with the fd of a TCP socket as value */
+static int sock_map_update_elem(struct bpf_map *map, void *key, void *value,
+				u64 map_flags)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct smap_psock *psock, *old;
+	u32 index = *(u32 *)key;
+	struct socket *sock;
+	struct sock *sk;
+	int err;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(index >= map->max_entries))
+		return -E2BIG;
+
+	sock = sockfd_lookup(*(u32 *)value, &err);
+	if (!sock)
+		return err;
+
+	sk = sock->sk;
+	if (!sk || sk->sk_type != SOCK_STREAM ||
+	    sk->sk_protocol != IPPROTO_TCP ||
+	    (sk->sk_family != AF_INET && sk->sk_family != AF_INET6)) {
+		err = -EOPNOTSUPP;
+		goto out_put;
+	}
+
+	psock = smap_init_psock(stab, sock);
+	if (IS_ERR(psock)) {
+		err = PTR_ERR(psock);
+		goto out_put;
+	}
+
+	spin_lock_bh(&stab->lock);
+	old = rcu_dereference_protected(stab->psocks[index],
+					lockdep_is_held(&stab->lock));
+	if ((old && map_flags == BPF_NOEXIST) ||
+	    (!old && map_flags == BPF_EXIST)) {
+		spin_unlock_bh(&stab->lock);
+		smap_release_sock(psock);
+		return old ? -EEXIST : -ENOENT;
+	}
+	rcu_assign_pointer(stab->psocks[index], psock);
+	spin_unlock_bh(&stab->lock);
+
+	if (old)
+		smap_release_sock(old);
+
+	/* data may have been queued before data_ready was ours */
+	schedule_work(&psock->rx_work);
+	return 0;
+
+out_put:
+	fput(sock->file);
+	return err;
+}
+
+static int sock_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct smap_psock *psock;
+	u32 index = *(u32 *)key;
+
+	if (index >= map->max_entries)
+		return -EINVAL;
+
+	spin_lock_bh(&stab->lock);
+	psock = rcu_dereference_protected(stab->psocks[index],
+					  lockdep_is_held(&stab->lock));
+	RCU_INIT_POINTER(stab->psocks[index], NULL);
+	spin_unlock_bh(&stab->lock);
+
+	if (!psock)
+		return -ENOENT;
+
+	smap_release_sock(psock);
+	return 0;
+}
+
+/**
+ * sock_map_prog() - attach or detach the verdict program of a sockmap
+ * @map: the BPF_MAP_TYPE_SOCKMAP
+ * @prog: program to attach, NULL to detach
+ * @type: BPF_SK_SKB_STREAM_VERDICT
+ *
+ * Data received on the sockets of @map goes to @prog from now on, or
+ * back to their owners when it is detached.
+ */
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *old;
+	int i;
+
+	if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
+		return -EINVAL;
+
+	if (type != BPF_SK_SKB_STREAM_VERDICT)
+		return -EOPNOTSUPP;
+
+	old = xchg((__force struct bpf_prog **)&stab->bpf_verdict, prog);
+	if (old)
+		bpf_prog_put(old);
+
+	if (!prog)
+		return 0;
+
+	/* take over what the owners have not read yet */
+	rcu_read_lock();
+	for (i = 0; i < map->max_entries; i++) {
+		struct smap_psock *psock = rcu_dereference(stab->psocks[i]);
+
+		if (psock)
+			schedule_work(&psock->rx_work);
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static const struct bpf_map_ops sock_map_ops = {
+	.map_alloc = sock_map_alloc,
+	.map_free = sock_map_free,
+	.map_get_next_key = sock_map_get_next_key,
+	.map_lookup_elem = sock_map_lookup_elem,
+	.map_update_elem = sock_map_update_elem,
+	.map_delete_elem = sock_map_delete_elem,
+};
+
+static struct bpf_map_type_list sock_map_type __read_mostly = {
+	.ops = &sock_map_ops,
+	.type = BPF_MAP_TYPE_SOCKMAP,
+};
+
+static u64 bpf_sk_redirect_map(u64 r1, u64 key, u64 flags, u64 r4, u64 r5)
+{
+	struct sk_redirect_info *ri = this_cpu_ptr(&sk_redirect_info);
+
+	if (unlikely(flags))
+		return SK_DROP;
+
+	ri->map = (struct bpf_map *) (long) r1;
+	ri->key = key;
+	return SK_REDIRECT;
+}
+
+const struct bpf_func_proto bpf_sk_redirect_map_proto = {
+	.func		= bpf_sk_redirect_map,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_ANYTHING,
+};
+
+static int __init register_sock_map(void)
+{
+	bpf_register_map_type(&sock_map_type);
+	return 0;
+}
+late_initcall(register_sock_map);
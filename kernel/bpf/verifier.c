@@ -18,6 +18,8 @@
 #include <net/netlink.h>
 #include <linux/file.h>
 #include <linux/vmalloc.h>
+#include <linux/sort.h>
+#include <linux/bsearch.h>
 
 /* bpf_check() is a static code analyzer that walks eBPF program
  * instruction by instruction and updates register/stack state.
@@ -127,30 +129,6 @@
  */
 
 /* types of values stored in eBPF registers */
-enum bpf_reg_type {
-	NOT_INIT = 0,		 /* nothing was written into register */
-	UNKNOWN_VALUE,		 /* reg doesn't contain a valid pointer */
-	PTR_TO_CTX,		 /* reg points to bpf_context */
-	CONST_PTR_TO_MAP,	 /* reg points to struct bpf_map */
-	PTR_TO_MAP_VALUE,	 /* reg points to map element value */
-	PTR_TO_MAP_VALUE_OR_NULL,/* points to map elem value or NULL */
-	FRAME_PTR,		 /* reg == frame_pointer */
-	PTR_TO_STACK,		 /* reg == frame_pointer + imm */
-	CONST_IMM,		 /* constant integer value */
-
-	/* PTR_TO_PACKET represents:
-	 * skb->data
-	 * skb->data + imm
-	 * skb->data + (u16) var
-	 * skb->data + (u16) var + imm
-	 * if (range > 0) then [ptr, ptr + range - off) is safe to access
-	 * if (id > 0) means that some 'var' was added
-	 * if (off > 0) menas that 'imm' was added
-	 */
-	PTR_TO_PACKET,
-	PTR_TO_PACKET_END,	 /* skb->data + headlen */
-};
-
 struct reg_state {
 	enum bpf_reg_type type;
 	union {
@@ -167,8 +145,30 @@ struct reg_state {
 		/* valid when type == CONST_PTR_TO_MAP | PTR_TO_MAP_VALUE |
 		 *   PTR_TO_MAP_VALUE_OR_NULL
 		 */
-		struct bpf_map *map_ptr;
+		struct {
+			struct bpf_map *map_ptr;
+			/* tells the values of a map with BPF_F_SPIN_LOCK
+			 * apart, 0 for all other maps
+			 */
+			u32 map_uid;
+		};
 	};
+	/* liveness, not part of the state compared by states_equal() */
+	u8 live;
+};
+
+/* Liveness of a register or spilled register.  A state kept in
+ * explored_states is the parent of everything explored from it until the
+ * next pruning point.  A register that is read there before being written
+ * gets REG_LIVE_READ in the parent (and further up until a state that
+ * wrote it), REG_LIVE_WRITTEN marks the registers a state wrote itself.
+ * Registers without REG_LIVE_READ in an explored state do not matter for
+ * what follows, so states_equal() ignores them.
+ */
+enum {
+	REG_LIVE_NONE = 0,
+	REG_LIVE_READ = 1,
+	REG_LIVE_WRITTEN = 2,
 };
 
 enum bpf_stack_slot_type {
@@ -179,6 +179,11 @@ enum bpf_stack_slot_type {
 
 #define BPF_REG_SIZE 8	/* size of eBPF register in bytes */
 
+#define MAX_CALL_FRAMES 8	/* max depth of calls of bpf functions */
+#define BPF_MAX_SUBPROGS 256	/* max number of bpf functions in a program */
+
+struct verifier_frame;
+
 /* state of the program:
  * type of all registers and stack info
  */
@@ -186,6 +191,21 @@ struct verifier_state {
 	struct reg_state regs[MAX_BPF_REG];
 	u8 stack_slot_type[MAX_BPF_STACK];
 	struct reg_state spilled_regs[MAX_BPF_STACK / BPF_REG_SIZE];
+	struct verifier_state *parent;	/* explored state this came from */
+	struct verifier_frame *caller;	/* state of the calling function */
+	u32 curframe;			/* 0 in the main function */
+	u32 subprog;			/* function being verified */
+	u32 active_spin_lock;		/* map_uid of the value locked */
+};
+
+/* state of a calling function while the function it called is verified.
+ * It is never changed once saved, so all states explored in the callee
+ * share it.
+ */
+struct verifier_frame {
+	struct verifier_state state;
+	int callsite;			/* insn_idx of the call */
+	struct verifier_frame *next;	/* list of all frames, for freeing */
 };
 
 /* linked list of verifier states used to prune search */
@@ -220,13 +240,27 @@ struct verifier_env {
 	struct bpf_map *used_maps[MAX_USED_MAPS]; /* array of map's used by eBPF program */
 	u32 used_map_cnt;		/* number of used maps */
 	bool allow_ptr_leaks;
+	struct verifier_frame *frames;	/* saved states of calling functions */
+	u32 subprog_starts[BPF_MAX_SUBPROGS]; /* first insn of each function */
+	u32 subprog_cnt;		/* number of functions, 1 without calls */
+	u16 subprog_stack_depth[BPF_MAX_SUBPROGS]; /* stack used by each */
+	u32 id_gen;			/* last map_uid handed out */
+	struct bpf_insn_aux_data *insn_aux_data; /* per insn state */
+};
+
+/* what the verifier learned about an insn on all paths through it */
+struct bpf_insn_aux_data {
+	struct bpf_map *map_ptr;	/* map a helper call is done on */
 };
 
+#define BPF_MAP_PTR_POISON ((void *)0xeB9F + POISON_POINTER_DELTA)
+
 #define BPF_COMPLEXITY_LIMIT_INSNS	65536
 #define BPF_COMPLEXITY_LIMIT_STACK	1024
 
 struct bpf_call_arg_meta {
 	struct bpf_map *map_ptr;
+	u32 lock_uid;
 	bool raw_mode;
 	int regno;
 	int access_size;
@@ -426,7 +460,9 @@ static void print_bpf_insn(struct bpf_insn *insn)
 	} else if (class == BPF_JMP) {
 		u8 opcode = BPF_OP(insn->code);
 
-		if (opcode == BPF_CALL) {
+		if (opcode == BPF_CALL && insn->src_reg == BPF_PSEUDO_CALL) {
+			verbose("(%02x) call pc%+d\n", insn->code, insn->imm);
+		} else if (opcode == BPF_CALL) {
 			verbose("(%02x) call %d\n", insn->code, insn->imm);
 		} else if (insn->code == (BPF_JMP | BPF_JA)) {
 			verbose("(%02x) goto pc%+d\n",
@@ -494,6 +530,31 @@ err:
 	return NULL;
 }
 
+static int cmp_subprogs(const void *a, const void *b)
+{
+	return *(u32 *)a - *(u32 *)b;
+}
+
+/* index of the function starting at insn off, -ENOENT if none does */
+static int find_subprog(struct verifier_env *env, u32 off)
+{
+	u32 *p;
+
+	p = bsearch(&off, env->subprog_starts, env->subprog_cnt,
+		    sizeof(env->subprog_starts[0]), cmp_subprogs);
+	if (!p)
+		return -ENOENT;
+	return p - env->subprog_starts;
+}
+
+/* first insn after the function */
+static int subprog_end(struct verifier_env *env, int subprog)
+{
+	if (subprog + 1 < env->subprog_cnt)
+		return env->subprog_starts[subprog + 1];
+	return env->prog->len;
+}
+
 #define CALLER_SAVED_REGS 6
 static const int caller_saved[CALLER_SAVED_REGS] = {
 	BPF_REG_0, BPF_REG_1, BPF_REG_2, BPF_REG_3, BPF_REG_4, BPF_REG_5
@@ -522,15 +583,51 @@ static void mark_reg_unknown_value(struct reg_state *regs, u32 regno)
 	regs[regno].imm = 0;
 }
 
+/* mark regno as read by the parents of state, up to the first one that
+ * wrote it
+ */
+static void mark_reg_read(struct verifier_state *state, u32 regno)
+{
+	struct verifier_state *parent = state->parent;
+
+	while (parent) {
+		if (state->regs[regno].live & REG_LIVE_WRITTEN)
+			break;
+		/* the ones further up got marked when this one did */
+		if (parent->regs[regno].live & REG_LIVE_READ)
+			break;
+		parent->regs[regno].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+static void mark_stack_slot_read(struct verifier_state *state, int slot)
+{
+	struct verifier_state *parent = state->parent;
+
+	while (parent) {
+		if (state->spilled_regs[slot].live & REG_LIVE_WRITTEN)
+			break;
+		if (parent->spilled_regs[slot].live & REG_LIVE_READ)
+			break;
+		parent->spilled_regs[slot].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
 enum reg_arg_type {
 	SRC_OP,		/* register is used as source operand */
 	DST_OP,		/* register is used as destination operand */
 	DST_OP_NO_MARK	/* same as above, check only, don't mark */
 };
 
-static int check_reg_arg(struct reg_state *regs, u32 regno,
+static int check_reg_arg(struct verifier_env *env, u32 regno,
 			 enum reg_arg_type t)
 {
+	struct reg_state *regs = env->cur_state.regs;
+
 	if (regno >= MAX_BPF_REG) {
 		verbose("R%d is invalid\n", regno);
 		return -EINVAL;
@@ -542,12 +639,14 @@ static int check_reg_arg(struct reg_state *regs, u32 regno,
 			verbose("R%d !read_ok\n", regno);
 			return -EACCES;
 		}
+		mark_reg_read(&env->cur_state, regno);
 	} else {
 		/* check whether register used as dest operand can be written to */
 		if (regno == BPF_REG_FP) {
 			verbose("frame pointer is read only\n");
 			return -EACCES;
 		}
+		regs[regno].live |= REG_LIVE_WRITTEN;
 		if (t == DST_OP)
 			mark_reg_unknown_value(regs, regno);
 	}
@@ -591,7 +690,7 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 static int check_stack_write(struct verifier_state *state, int off, int size,
 			     int value_regno)
 {
-	int i;
+	int i, slot = (MAX_BPF_STACK + off) / BPF_REG_SIZE;
 	/* caller checked that off % size == 0 and -MAX_BPF_STACK <= off < 0,
 	 * so it's aligned access and [off, off + size) are within stack limits
 	 */
@@ -606,15 +705,14 @@ static int check_stack_write(struct verifier_state *state, int off, int size,
 		}
 
 		/* save register state */
-		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
-			state->regs[value_regno];
+		state->spilled_regs[slot] = state->regs[value_regno];
+		state->spilled_regs[slot].live |= REG_LIVE_WRITTEN;
 
 		for (i = 0; i < BPF_REG_SIZE; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_SPILL;
 	} else {
 		/* regular write of data into stack */
-		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
-			(struct reg_state) {};
+		state->spilled_regs[slot] = (struct reg_state) {};
 
 		for (i = 0; i < size; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_MISC;
@@ -625,8 +723,8 @@ static int check_stack_write(struct verifier_state *state, int off, int size,
 static int check_stack_read(struct verifier_state *state, int off, int size,
 			    int value_regno)
 {
+	int i, slot = (MAX_BPF_STACK + off) / BPF_REG_SIZE;
 	u8 *slot_type;
-	int i;
 
 	slot_type = &state->stack_slot_type[MAX_BPF_STACK + off];
 
@@ -642,10 +740,12 @@ static int check_stack_read(struct verifier_state *state, int off, int size,
 			}
 		}
 
-		if (value_regno >= 0)
+		mark_stack_slot_read(state, slot);
+		if (value_regno >= 0) {
 			/* restore register state from stack */
-			state->regs[value_regno] =
-				state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE];
+			state->regs[value_regno] = state->spilled_regs[slot];
+			state->regs[value_regno].live |= REG_LIVE_WRITTEN;
+		}
 		return 0;
 	} else {
 		for (i = 0; i < size; i++) {
@@ -673,6 +773,11 @@ static int check_map_access(struct verifier_env *env, u32 regno, int off,
 			map->value_size, off, size);
 		return -EACCES;
 	}
+	if (map_value_has_spin_lock(map) &&
+	    off < (int) sizeof(struct bpf_spin_lock)) {
+		verbose("bpf_spin_lock cannot be accessed directly by load/store\n");
+		return -EACCES;
+	}
 	return 0;
 }
 
@@ -695,10 +800,10 @@ static int check_packet_access(struct verifier_env *env, u32 regno, int off,
 
 /* check access to 'struct bpf_context' fields */
 static int check_ctx_access(struct verifier_env *env, int off, int size,
-			    enum bpf_access_type t)
+			    enum bpf_access_type t, enum bpf_reg_type *reg_type)
 {
 	if (env->prog->aux->ops->is_valid_access &&
-	    env->prog->aux->ops->is_valid_access(off, size, t)) {
+	    env->prog->aux->ops->is_valid_access(off, size, t, reg_type)) {
 		/* remember the offset of last byte accessed in ctx */
 		if (env->prog->aux->max_ctx_offset < off + size)
 			env->prog->aux->max_ctx_offset = off + size;
@@ -709,6 +814,19 @@ static int check_ctx_access(struct verifier_env *env, int off, int size,
 	return -EACCES;
 }
 
+/* XDP programs own the packet buffer outright, so they may rewrite it in
+ * place. Programs that see an skb must not, since the data may be shared.
+ */
+static bool may_write_pkt_data(enum bpf_prog_type type)
+{
+	switch (type) {
+	case BPF_PROG_TYPE_XDP:
+		return true;
+	default:
+		return false;
+	}
+}
+
 static bool is_pointer_value(struct verifier_env *env, int regno)
 {
 	if (env->allow_ptr_leaks)
@@ -738,6 +856,7 @@ static int check_ptr_alignment(struct verifier_env *env, struct reg_state *reg,
 	switch (env->prog->type) {
 	case BPF_PROG_TYPE_SCHED_CLS:
 	case BPF_PROG_TYPE_SCHED_ACT:
+	case BPF_PROG_TYPE_XDP:
 		break;
 	default:
 		verbose("verifier is misconfigured\n");
@@ -768,6 +887,17 @@ static int check_ptr_alignment(struct verifier_env *env, struct reg_state *reg,
  * if t==write && value_regno==-1, some unknown value is stored into memory
  * if t==read && value_regno==-1, don't care what we read from memory
  */
+/* remember how much stack the function being verified uses, the stack of
+ * the functions it calls starts below that
+ */
+static void update_stack_depth(struct verifier_env *env, int off)
+{
+	u16 *depth = &env->subprog_stack_depth[env->cur_state.subprog];
+
+	if (-off > *depth)
+		*depth = -off;
+}
+
 static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 			    int bpf_size, enum bpf_access_type t,
 			    int value_regno)
@@ -798,21 +928,19 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 			mark_reg_unknown_value(state->regs, value_regno);
 
 	} else if (reg->type == PTR_TO_CTX) {
+		enum bpf_reg_type reg_type = UNKNOWN_VALUE;
+
 		if (t == BPF_WRITE && value_regno >= 0 &&
 		    is_pointer_value(env, value_regno)) {
 			verbose("R%d leaks addr into ctx\n", value_regno);
 			return -EACCES;
 		}
-		err = check_ctx_access(env, off, size, t);
+		err = check_ctx_access(env, off, size, t, &reg_type);
 		if (!err && t == BPF_READ && value_regno >= 0) {
 			mark_reg_unknown_value(state->regs, value_regno);
-			if (off == offsetof(struct __sk_buff, data) &&
-			    env->allow_ptr_leaks)
-				/* note that reg.[id|off|range] == 0 */
-				state->regs[value_regno].type = PTR_TO_PACKET;
-			else if (off == offsetof(struct __sk_buff, data_end) &&
-				 env->allow_ptr_leaks)
-				state->regs[value_regno].type = PTR_TO_PACKET_END;
+			/* note that reg.[id|off|range] == 0 */
+			if (env->allow_ptr_leaks)
+				state->regs[value_regno].type = reg_type;
 		}
 
 	} else if (reg->type == FRAME_PTR || reg->type == PTR_TO_STACK) {
@@ -820,6 +948,7 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 			verbose("invalid stack off=%d size=%d\n", off, size);
 			return -EACCES;
 		}
+		update_stack_depth(env, off);
 		if (t == BPF_WRITE) {
 			if (!env->allow_ptr_leaks &&
 			    state->stack_slot_type[MAX_BPF_STACK + off] == STACK_SPILL &&
@@ -832,10 +961,15 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 			err = check_stack_read(state, off, size, value_regno);
 		}
 	} else if (state->regs[regno].type == PTR_TO_PACKET) {
-		if (t == BPF_WRITE) {
+		if (t == BPF_WRITE && !may_write_pkt_data(env->prog->type)) {
 			verbose("cannot write into packet\n");
 			return -EACCES;
 		}
+		if (t == BPF_WRITE && value_regno >= 0 &&
+		    is_pointer_value(env, value_regno)) {
+			verbose("R%d leaks addr into packet\n", value_regno);
+			return -EACCES;
+		}
 		err = check_packet_access(env, regno, off, size);
 		if (!err && t == BPF_READ && value_regno >= 0)
 			mark_reg_unknown_value(state->regs, value_regno);
@@ -858,7 +992,6 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 
 static int check_xadd(struct verifier_env *env, struct bpf_insn *insn)
 {
-	struct reg_state *regs = env->cur_state.regs;
 	int err;
 
 	if ((BPF_SIZE(insn->code) != BPF_W && BPF_SIZE(insn->code) != BPF_DW) ||
@@ -868,12 +1001,12 @@ static int check_xadd(struct verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check src1 operand */
-	err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+	err = check_reg_arg(env, insn->src_reg, SRC_OP);
 	if (err)
 		return err;
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -919,6 +1052,7 @@ static int check_stack_boundary(struct verifier_env *env, int regno,
 			regno, off, access_size);
 		return -EACCES;
 	}
+	update_stack_depth(env, off);
 
 	if (meta && meta->raw_mode) {
 		meta->access_size = access_size;
@@ -951,6 +1085,7 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 		verbose("R%d !read_ok\n", regno);
 		return -EACCES;
 	}
+	mark_reg_read(&env->cur_state, regno);
 
 	if (arg_type == ARG_ANYTHING) {
 		if (is_pointer_value(env, regno)) {
@@ -963,6 +1098,8 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 	if (arg_type == ARG_PTR_TO_MAP_KEY ||
 	    arg_type == ARG_PTR_TO_MAP_VALUE) {
 		expected_type = PTR_TO_STACK;
+	} else if (arg_type == ARG_PTR_TO_SPIN_LOCK) {
+		expected_type = PTR_TO_MAP_VALUE;
 	} else if (arg_type == ARG_CONST_STACK_SIZE ||
 		   arg_type == ARG_CONST_STACK_SIZE_OR_ZERO) {
 		expected_type = CONST_IMM;
@@ -1022,6 +1159,13 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 		err = check_stack_boundary(env, regno,
 					   meta->map_ptr->value_size,
 					   false, NULL);
+	} else if (arg_type == ARG_PTR_TO_SPIN_LOCK) {
+		/* map value pointers can't be moved, so this is the lock */
+		if (!map_value_has_spin_lock(reg->map_ptr)) {
+			verbose("map has no bpf_spin_lock, create it with BPF_F_SPIN_LOCK\n");
+			return -EINVAL;
+		}
+		meta->lock_uid = reg->map_uid;
 	} else if (arg_type == ARG_CONST_STACK_SIZE ||
 		   arg_type == ARG_CONST_STACK_SIZE_OR_ZERO) {
 		bool zero_size_allowed = (arg_type == ARG_CONST_STACK_SIZE_OR_ZERO);
@@ -1062,6 +1206,18 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (func_id != BPF_FUNC_get_stackid)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_REUSEPORT_SOCKARRAY:
+		if (func_id != BPF_FUNC_sk_select_reuseport)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_RINGBUF:
+		if (func_id != BPF_FUNC_ringbuf_output)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_SOCKMAP:
+		if (func_id != BPF_FUNC_sk_redirect_map)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1081,6 +1237,18 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (map->map_type != BPF_MAP_TYPE_STACK_TRACE)
 			goto error;
 		break;
+	case BPF_FUNC_sk_select_reuseport:
+		if (map->map_type != BPF_MAP_TYPE_REUSEPORT_SOCKARRAY)
+			goto error;
+		break;
+	case BPF_FUNC_ringbuf_output:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
+	case BPF_FUNC_sk_redirect_map:
+		if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1110,9 +1278,8 @@ static int check_raw_mode(const struct bpf_func_proto *fn)
 	return count > 1 ? -EINVAL : 0;
 }
 
-static void clear_all_pkt_pointers(struct verifier_env *env)
+static void clear_pkt_pointers(struct verifier_state *state)
 {
-	struct verifier_state *state = &env->cur_state;
 	struct reg_state *regs = state->regs, *reg;
 	int i;
 
@@ -1133,7 +1300,30 @@ static void clear_all_pkt_pointers(struct verifier_env *env)
 	}
 }
 
-static int check_call(struct verifier_env *env, int func_id)
+static int clear_all_pkt_pointers(struct verifier_env *env)
+{
+	struct verifier_frame **pframe, *frame;
+
+	clear_pkt_pointers(&env->cur_state);
+
+	/* the calling functions may hold packet pointers as well, their
+	 * saved states are shared, so clear them in copies
+	 */
+	for (pframe = &env->cur_state.caller; *pframe;
+	     pframe = &frame->state.caller) {
+		frame = kmalloc(sizeof(*frame), GFP_KERNEL);
+		if (!frame)
+			return -ENOMEM;
+		memcpy(frame, *pframe, sizeof(*frame));
+		frame->next = env->frames;
+		env->frames = frame;
+		clear_pkt_pointers(&frame->state);
+		*pframe = frame;
+	}
+	return 0;
+}
+
+static int check_call(struct verifier_env *env, int func_id, int insn_idx)
 {
 	struct verifier_state *state = &env->cur_state;
 	const struct bpf_func_proto *fn = NULL;
@@ -1163,6 +1353,11 @@ static int check_call(struct verifier_env *env, int func_id)
 		return -EINVAL;
 	}
 
+	if (state->active_spin_lock && func_id != BPF_FUNC_spin_unlock) {
+		verbose("function calls are not allowed while holding a lock\n");
+		return -EINVAL;
+	}
+
 	changes_data = bpf_helper_changes_skb_data(fn->func);
 
 	memset(&meta, 0, sizeof(meta));
@@ -1193,6 +1388,30 @@ static int check_call(struct verifier_env *env, int func_id)
 	if (err)
 		return err;
 
+	if (func_id == BPF_FUNC_spin_lock) {
+		state->active_spin_lock = meta.lock_uid;
+	} else if (func_id == BPF_FUNC_spin_unlock) {
+		if (!state->active_spin_lock) {
+			verbose("bpf_spin_unlock without taking a lock\n");
+			return -EINVAL;
+		}
+		if (state->active_spin_lock != meta.lock_uid) {
+			verbose("bpf_spin_unlock of different lock\n");
+			return -EINVAL;
+		}
+		state->active_spin_lock = 0;
+	} else if (func_id == BPF_FUNC_map_lookup_elem) {
+		struct bpf_insn_aux_data *aux = &env->insn_aux_data[insn_idx];
+
+		/* the lookup can only be inlined if it is always done on
+		 * the same map
+		 */
+		if (!aux->map_ptr)
+			aux->map_ptr = meta.map_ptr;
+		else if (aux->map_ptr != meta.map_ptr)
+			aux->map_ptr = BPF_MAP_PTR_POISON;
+	}
+
 	/* Mark slots with STACK_MISC in case of raw mode, stack offset
 	 * is inferred from register state.
 	 */
@@ -1207,6 +1426,7 @@ static int check_call(struct verifier_env *env, int func_id)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* update return register */
@@ -1225,6 +1445,8 @@ static int check_call(struct verifier_env *env, int func_id)
 			return -EINVAL;
 		}
 		regs[BPF_REG_0].map_ptr = meta.map_ptr;
+		regs[BPF_REG_0].map_uid = map_value_has_spin_lock(meta.map_ptr) ?
+					  ++env->id_gen : 0;
 	} else {
 		verbose("unknown return type %d of func %d\n",
 			fn->ret_type, func_id);
@@ -1236,7 +1458,101 @@ static int check_call(struct verifier_env *env, int func_id)
 		return err;
 
 	if (changes_data)
-		clear_all_pkt_pointers(env);
+		return clear_all_pkt_pointers(env);
+	return 0;
+}
+
+static int check_func_call(struct verifier_env *env, struct bpf_insn *insn,
+			   int *insn_idx)
+{
+	struct verifier_state *state = &env->cur_state;
+	int i, subprog, target = *insn_idx + insn->imm + 1;
+	struct verifier_frame *frame;
+
+	if (state->active_spin_lock) {
+		verbose("function calls are not allowed while holding a lock\n");
+		return -EINVAL;
+	}
+
+	subprog = find_subprog(env, target);
+	if (subprog < 0) {
+		verbose("verifier bug. No program starts at insn %d\n",
+			target);
+		return -EFAULT;
+	}
+
+	if (state->curframe + 1 >= MAX_CALL_FRAMES) {
+		verbose("the call stack of %d frames is too deep\n",
+			state->curframe + 2);
+		return -E2BIG;
+	}
+
+	/* the called function gets a stack of its own, it can't be handed
+	 * pointers into ours
+	 */
+	for (i = BPF_REG_1; i <= BPF_REG_5; i++) {
+		if (state->regs[i].type == NOT_INIT)
+			continue;
+		mark_reg_read(state, i);
+		if (state->regs[i].type == FRAME_PTR ||
+		    state->regs[i].type == PTR_TO_STACK) {
+			verbose("R%d pointer to stack passed to bpf function\n",
+				i);
+			return -EACCES;
+		}
+	}
+
+	frame = kmalloc(sizeof(*frame), GFP_KERNEL);
+	if (!frame)
+		return -ENOMEM;
+	memcpy(&frame->state, state, sizeof(*state));
+	frame->callsite = *insn_idx;
+	frame->next = env->frames;
+	env->frames = frame;
+
+	/* R1-R5 are the arguments, nothing else is readable in the callee */
+	for (i = 0; i < MAX_BPF_REG; i++) {
+		if (i >= BPF_REG_1 && i <= BPF_REG_5)
+			continue;
+		state->regs[i].type = NOT_INIT;
+		state->regs[i].imm = 0;
+		state->regs[i].live |= REG_LIVE_WRITTEN;
+	}
+	state->regs[BPF_REG_FP].type = FRAME_PTR;
+	memset(state->stack_slot_type, STACK_INVALID,
+	       sizeof(state->stack_slot_type));
+	memset(state->spilled_regs, 0, sizeof(state->spilled_regs));
+	state->caller = frame;
+	state->curframe++;
+	state->subprog = subprog;
+
+	*insn_idx = target;
+	return 0;
+}
+
+static int prepare_func_exit(struct verifier_env *env, int *insn_idx)
+{
+	struct verifier_state *state = &env->cur_state;
+	struct verifier_frame *frame = state->caller;
+	struct reg_state r0 = state->regs[BPF_REG_0];
+	int i;
+
+	if (r0.type == FRAME_PTR || r0.type == PTR_TO_STACK) {
+		verbose("R0 returns pointer to stack of bpf function\n");
+		return -EACCES;
+	}
+
+	/* back to the caller, with its R0 set and R1-R5 clobbered */
+	memcpy(state, &frame->state, sizeof(*state));
+	state->regs[BPF_REG_0] = r0;
+	state->regs[BPF_REG_0].live |= REG_LIVE_WRITTEN;
+	for (i = BPF_REG_1; i <= BPF_REG_5; i++) {
+		state->regs[i].type = NOT_INIT;
+		state->regs[i].imm = 0;
+		state->regs[i].live |= REG_LIVE_WRITTEN;
+	}
+
+	*insn_idx = frame->callsite + 1;
 	return 0;
 }
 
@@ -1272,6 +1588,7 @@ add_imm:
 			/* R6=pkt(id=0,off=0,r=62) R7=imm22; r7 += r6 */
 			tmp_reg = *dst_reg;  /* save r7 state */
 			*dst_reg = *src_reg; /* copy pkt_ptr state r6 into r7 */
+			dst_reg->live = tmp_reg.live;
 			src_reg = &tmp_reg;  /* pretend it's src_reg state */
 			/* if the checks below reject it, the copy won't matter,
 			 * since we're rejecting the whole program. If all ok,
@@ -1459,7 +1776,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1470,7 +1787,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1483,7 +1800,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 			}
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1494,7 +1811,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -1504,6 +1821,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 				 * copy register state to dest reg
 				 */
 				regs[insn->dst_reg] = regs[insn->src_reg];
+				regs[insn->dst_reg].live |= REG_LIVE_WRITTEN;
 			} else {
 				if (is_pointer_value(env, insn->src_reg)) {
 					verbose("R%d partial copy of pointer\n",
@@ -1533,7 +1851,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 				return -EINVAL;
 			}
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -1544,7 +1862,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src2 operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1565,7 +1883,7 @@ static int check_alu_op(struct verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 		if (err)
 			return err;
 
@@ -1660,7 +1978,7 @@ static int check_cond_jmp_op(struct verifier_env *env,
 		}
 
 		/* check src1 operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -1677,7 +1995,7 @@ static int check_cond_jmp_op(struct verifier_env *env,
 	}
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -1758,7 +2076,7 @@ static int check_ld_imm(struct verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
-	err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+	err = check_reg_arg(env, insn->dst_reg, DST_OP);
 	if (err)
 		return err;
 
@@ -1780,6 +2098,7 @@ static bool may_access_skb(enum bpf_prog_type type)
 	case BPF_PROG_TYPE_SOCKET_FILTER:
 	case BPF_PROG_TYPE_SCHED_CLS:
 	case BPF_PROG_TYPE_SCHED_ACT:
+	case BPF_PROG_TYPE_CGROUP_SKB:
 		return true;
 	default:
 		return false;
@@ -1813,6 +2132,12 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
+	if (env->cur_state.active_spin_lock) {
+		/* they may exit the program */
+		verbose("BPF_LD_[ABS|IND] cannot be used while holding a lock\n");
+		return -EINVAL;
+	}
+
 	if (insn->dst_reg != BPF_REG_0 || insn->off != 0 ||
 	    BPF_SIZE(insn->code) == BPF_DW ||
 	    (mode == BPF_ABS && insn->src_reg != BPF_REG_0)) {
@@ -1821,7 +2146,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check whether implicit source operand (register R6) is readable */
-	err = check_reg_arg(regs, BPF_REG_6, SRC_OP);
+	err = check_reg_arg(env, BPF_REG_6, SRC_OP);
 	if (err)
 		return err;
 
@@ -1832,7 +2157,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 
 	if (mode == BPF_IND) {
 		/* check explicit source operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 	}
@@ -1842,6 +2167,7 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 		reg = regs + caller_saved[i];
 		reg->type = NOT_INIT;
 		reg->imm = 0;
+		reg->live |= REG_LIVE_WRITTEN;
 	}
 
 	/* mark destination R0 register as readable, since it contains
@@ -1851,6 +2177,98 @@ static int check_ld_abs(struct verifier_env *env, struct bpf_insn *insn)
 	return 0;
 }
 
+static int add_subprog(struct verifier_env *env, int off)
+{
+	if (off < 0 || off >= env->prog->len) {
+		verbose("call to invalid destination %d\n", off);
+		return -EINVAL;
+	}
+	if (find_subprog(env, off) >= 0)
+		return 0;
+	if (env->subprog_cnt >= BPF_MAX_SUBPROGS) {
+		verbose("too many bpf functions\n");
+		return -E2BIG;
+	}
+	env->subprog_starts[env->subprog_cnt++] = off;
+	sort(env->subprog_starts, env->subprog_cnt,
+	     sizeof(env->subprog_starts[0]), cmp_subprogs, NULL);
+	return 0;
+}
+
+/* Split the program into its functions: the main one starts at insn 0,
+ * the others at the targets of calls with src_reg == BPF_PSEUDO_CALL.
+ * A function has to end in an exit or a jump and none of its jumps may
+ * leave it, so that each one can be verified as a frame of its own.
+ */
+static int check_subprogs(struct verifier_env *env)
+{
+	struct bpf_insn *insn = env->prog->insnsi;
+	int insn_cnt = env->prog->len;
+	int i, ret, subprog = 0, start = 0, end;
+
+	env->subprog_starts[0] = 0;
+	env->subprog_cnt = 1;
+
+	for (i = 0; i < insn_cnt; i++) {
+		if (!bpf_pseudo_call(insn + i))
+			continue;
+		if (!env->allow_ptr_leaks) {
+			verbose("function calls to other bpf functions are allowed for root only\n");
+			return -EPERM;
+		}
+		if (insn[i].off != 0 || insn[i].dst_reg != BPF_REG_0) {
+			verbose("BPF_CALL uses reserved fields\n");
+			return -EINVAL;
+		}
+		ret = add_subprog(env, i + insn[i].imm + 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (env->subprog_cnt == 1)
+		return 0;
+
+	end = subprog_end(env, 0);
+	for (i = 0; i < insn_cnt; i++) {
+		u8 code = insn[i].code;
+
+		if (BPF_CLASS(code) == BPF_LD &&
+		    (BPF_MODE(code) == BPF_ABS || BPF_MODE(code) == BPF_IND)) {
+			/* they return 0 from the whole program on failure */
+			verbose("LD_ABS and LD_IND can't be mixed with bpf function calls\n");
+			return -EINVAL;
+		}
+		if (code == (BPF_JMP | BPF_CALL) &&
+		    insn[i].src_reg == BPF_REG_0 &&
+		    insn[i].imm == BPF_FUNC_tail_call) {
+			verbose("tail calls can't be mixed with bpf function calls\n");
+			return -EINVAL;
+		}
+		if (BPF_CLASS(code) == BPF_JMP && BPF_OP(code) != BPF_CALL &&
+		    BPF_OP(code) != BPF_EXIT) {
+			int off = i + insn[i].off + 1;
+
+			if (off < start || off >= end) {
+				verbose("jump out of range from insn %d to %d\n",
+					i, off);
+				return -EINVAL;
+			}
+		}
+		if (i == end - 1) {
+			if (code != (BPF_JMP | BPF_EXIT) &&
+			    code != (BPF_JMP | BPF_JA)) {
+				verbose("last insn of function %d is not exit or jmp\n",
+					subprog);
+				return -EINVAL;
+			}
+			subprog++;
+			start = end;
+			end = subprog_end(env, subprog);
+		}
+	}
+	return 0;
+}
+
 /* non-recursive DFS pseudo code
  * 1  procedure DFS-iterative(G,v):
  * 2      label v as discovered
@@ -1982,6 +2400,17 @@ peek_stack:
 				goto err_free;
 			if (t + 1 < insn_cnt)
 				env->explored_states[t + 1] = STATE_LIST_MARK;
+			if (insns[t].src_reg == BPF_PSEUDO_CALL) {
+				/* the called function is explored like the
+				 * target of a jump, so recursion is a loop
+				 */
+				ret = push_insn(t, t + insns[t].imm + 1,
+						BRANCH, env);
+				if (ret == 1)
+					goto peek_stack;
+				else if (ret < 0)
+					goto err_free;
+			}
 		} else if (opcode == BPF_JA) {
 			if (BPF_SRC(insns[t].code) != BPF_K) {
 				ret = -EINVAL;
@@ -2127,7 +2556,8 @@ static bool compare_ptrs_to_packet(struct reg_state *old, struct reg_state *cur)
  * whereas register type in current state is meaningful, it means that
  * the current state will reach 'bpf_exit' instruction safely
  */
-static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
+static bool frame_states_equal(struct verifier_state *old,
+			       struct verifier_state *cur, bool in_caller)
 {
 	struct reg_state *rold, *rcur;
 	int i;
@@ -2136,7 +2566,14 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 		rold = &old->regs[i];
 		rcur = &cur->regs[i];
 
-		if (memcmp(rold, rcur, sizeof(*rold)) == 0)
+		/* nothing explored from old looked at it.  The liveness of
+		 * a calling function isn't known yet, but R0-R5 come back
+		 * clobbered to it.
+		 */
+		if (in_caller ? i <= BPF_REG_5 : !(rold->live & REG_LIVE_READ))
+			continue;
+
+		if (memcmp(rold, rcur, offsetof(struct reg_state, live)) == 0)
 			continue;
 
 		if (rold->type == NOT_INIT ||
@@ -2162,9 +2599,13 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 			return false;
 		if (i % BPF_REG_SIZE)
 			continue;
+		if (!in_caller &&
+		    !(old->spilled_regs[i / BPF_REG_SIZE].live & REG_LIVE_READ))
+			/* spilled register never filled again */
+			continue;
 		if (memcmp(&old->spilled_regs[i / BPF_REG_SIZE],
 			   &cur->spilled_regs[i / BPF_REG_SIZE],
-			   sizeof(old->spilled_regs[0])))
+			   offsetof(struct reg_state, live)))
 			/* when explored and current stack slot types are
 			 * the same, check that stored pointers types
 			 * are the same as well.
@@ -2182,10 +2623,61 @@ static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
 	return true;
 }
 
+static bool states_equal(struct verifier_state *old, struct verifier_state *cur)
+{
+	struct verifier_frame *fold, *fcur;
+
+	if (old->curframe != cur->curframe ||
+	    old->active_spin_lock != cur->active_spin_lock ||
+	    !frame_states_equal(old, cur, false))
+		return false;
+
+	/* the calling functions are compared in full */
+	for (fold = old->caller, fcur = cur->caller; fold;
+	     fold = fold->state.caller, fcur = fcur->state.caller) {
+		if (fold == fcur)
+			/* saved frames never change */
+			return true;
+		if (fold->callsite != fcur->callsite ||
+		    !frame_states_equal(&fold->state, &fcur->state, true))
+			return false;
+	}
+	return true;
+}
+
+/* cur was pruned because old is equivalent, so whatever is read after old
+ * is read after cur as well
+ */
+static void propagate_liveness(struct verifier_state *old,
+			       struct verifier_state *cur)
+{
+	struct verifier_frame *frame;
+	int i;
+
+	for (i = 0; i < MAX_BPF_REG; i++)
+		if (old->regs[i].live & REG_LIVE_READ)
+			mark_reg_read(cur, i);
+
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		if (old->spilled_regs[i].live & REG_LIVE_READ)
+			mark_stack_slot_read(cur, i);
+
+	/* what the calling functions read after the return is not tracked,
+	 * assume they read everything they kept
+	 */
+	for (frame = cur->caller; frame; frame = frame->state.caller) {
+		for (i = BPF_REG_6; i < BPF_REG_FP; i++)
+			mark_reg_read(&frame->state, i);
+		for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+			mark_stack_slot_read(&frame->state, i);
+	}
+}
+
 static int is_state_visited(struct verifier_env *env, int insn_idx)
 {
 	struct verifier_state_list *new_sl;
 	struct verifier_state_list *sl;
+	int i;
 
 	sl = env->explored_states[insn_idx];
 	if (!sl)
@@ -2195,11 +2687,13 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 		return 0;
 
 	while (sl != STATE_LIST_MARK) {
-		if (states_equal(&sl->state, &env->cur_state))
+		if (states_equal(&sl->state, &env->cur_state)) {
 			/* reached equivalent register/stack state,
 			 * prune the search
 			 */
+			propagate_liveness(&sl->state, &env->cur_state);
 			return 1;
+		}
 		sl = sl->next;
 	}
 
@@ -2217,6 +2711,13 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 	memcpy(&new_sl->state, &env->cur_state, sizeof(env->cur_state));
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
+
+	/* what is explored from here on records its reads in new_sl */
+	env->cur_state.parent = &new_sl->state;
+	for (i = 0; i < MAX_BPF_REG; i++)
+		env->cur_state.regs[i].live = REG_LIVE_NONE;
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		env->cur_state.spilled_regs[i].live = REG_LIVE_NONE;
 	return 0;
 }
 
@@ -2289,11 +2790,11 @@ static int do_check(struct verifier_env *env)
 			/* check for reserved fields is already done */
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 
-			err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+			err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 			if (err)
 				return err;
 
@@ -2346,11 +2847,11 @@ static int do_check(struct verifier_env *env)
 			}
 
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 			/* check src2 operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -2379,7 +2880,7 @@ static int do_check(struct verifier_env *env)
 				return -EINVAL;
 			}
 			/* check src operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -2396,13 +2897,24 @@ static int do_check(struct verifier_env *env)
 			if (opcode == BPF_CALL) {
 				if (BPF_SRC(insn->code) != BPF_K ||
 				    insn->off != 0 ||
-				    insn->src_reg != BPF_REG_0 ||
+				    (insn->src_reg != BPF_REG_0 &&
+				     insn->src_reg != BPF_PSEUDO_CALL) ||
 				    insn->dst_reg != BPF_REG_0) {
 					verbose("BPF_CALL uses reserved fields\n");
 					return -EINVAL;
 				}
 
-				err = check_call(env, insn->imm);
+				if (insn->src_reg == BPF_PSEUDO_CALL) {
+					prev_insn_idx = insn_idx;
+					err = check_func_call(env, insn,
+							      &insn_idx);
+					if (err)
+						return err;
+					do_print_state = true;
+					continue;
+				}
+
+				err = check_call(env, insn->imm, insn_idx);
 				if (err)
 					return err;
 
@@ -2427,13 +2939,18 @@ static int do_check(struct verifier_env *env)
 					return -EINVAL;
 				}
 
+				if (state->active_spin_lock) {
+					verbose("bpf_spin_unlock is missing\n");
+					return -EINVAL;
+				}
+
 				/* eBPF calling convetion is such that R0 is used
 				 * to return the value from eBPF program.
 				 * Make sure that it's readable at this time
 				 * of bpf_exit, which means that program wrote
 				 * something into it earlier
 				 */
-				err = check_reg_arg(regs, BPF_REG_0, SRC_OP);
+				err = check_reg_arg(env, BPF_REG_0, SRC_OP);
 				if (err)
 					return err;
 
@@ -2442,6 +2959,16 @@ static int do_check(struct verifier_env *env)
 					return -EACCES;
 				}
 
+				if (state->curframe) {
+					/* return to the calling function */
+					prev_insn_idx = insn_idx;
+					err = prepare_func_exit(env, &insn_idx);
+					if (err)
+						return err;
+					do_print_state = true;
+					continue;
+				}
+
 process_bpf_exit:
 				insn_idx = pop_stack(env, &prev_insn_idx);
 				if (insn_idx < 0) {
@@ -2655,11 +3182,141 @@ static int convert_ctx_accesses(struct verifier_env *env)
 	return 0;
 }
 
+/* replace bpf_map_lookup_elem() calls on maps that can do the lookup in
+ * a few instructions with those instructions
+ */
+static int inline_map_lookups(struct verifier_env *env)
+{
+	struct bpf_insn *insn = env->prog->insnsi;
+	int insn_cnt = env->prog->len;
+	struct bpf_insn insn_buf[16];
+	struct bpf_prog *new_prog;
+	struct bpf_map *map;
+	int i, delta = 0;
+	u32 cnt;
+
+	for (i = 0; i < insn_cnt; i++, insn++) {
+		if (insn->code != (BPF_JMP | BPF_CALL) ||
+		    bpf_pseudo_call(insn) ||
+		    insn->imm != BPF_FUNC_map_lookup_elem)
+			continue;
+
+		/* insn_aux_data is indexed by the insns as verified */
+		map = env->insn_aux_data[i].map_ptr;
+		if (!map || map == BPF_MAP_PTR_POISON ||
+		    !map->ops->map_gen_lookup)
+			continue;
+
+		cnt = map->ops->map_gen_lookup(map, insn_buf);
+		if (cnt == 0 || cnt >= ARRAY_SIZE(insn_buf)) {
+			verbose("bpf verifier is misconfigured\n");
+			return -EINVAL;
+		}
+
+		new_prog = bpf_patch_insn_single(env->prog, i + delta,
+						 insn_buf, cnt);
+		if (!new_prog)
+			return -ENOMEM;
+
+		delta += cnt - 1;
+
+		/* keep walking new program and skip insns we just inserted */
+		env->prog = new_prog;
+		insn      = new_prog->insnsi + i + delta;
+	}
+
+	return 0;
+}
+
+struct call_chain {
+	int depth;	/* stack of a function and the functions it calls */
+	int frames;	/* longest chain of calls starting in the function */
+};
+
+static int check_call_chain(struct verifier_env *env, int subprog, int level,
+			    struct call_chain *chains)
+{
+	struct call_chain *chain = &chains[subprog];
+	struct bpf_insn *insn = env->prog->insnsi;
+	int end = subprog_end(env, subprog);
+	int i, err, callee, depth = 0, frames = 0;
+
+	/* also bounds the recursion here */
+	if (level + (chain->frames ?: 1) > MAX_CALL_FRAMES) {
+		verbose("the call stack of %d frames is too deep\n",
+			level + (chain->frames ?: 1));
+		return -E2BIG;
+	}
+	if (chain->frames)
+		return 0;
+
+	for (i = env->subprog_starts[subprog]; i < end; i++) {
+		if (!bpf_pseudo_call(insn + i))
+			continue;
+		callee = find_subprog(env, i + insn[i].imm + 1);
+		err = check_call_chain(env, callee, level + 1, chains);
+		if (err)
+			return err;
+		depth = max(depth, chains[callee].depth);
+		frames = max(frames, chains[callee].frames);
+	}
+
+	chain->depth = round_up(env->subprog_stack_depth[subprog],
+				BPF_REG_SIZE) + depth;
+	chain->frames = frames + 1;
+	if (chain->depth > MAX_BPF_STACK) {
+		verbose("combined stack size %d of function %d and its calls is too large\n",
+			chain->depth, subprog);
+		return -EACCES;
+	}
+	return 0;
+}
+
+/* All functions on a chain of calls share the MAX_BPF_STACK bytes of stack:
+ * tell every call in insn->off where the stack of the called function
+ * starts, below what the calling one uses.
+ */
+static int fixup_call_frames(struct verifier_env *env)
+{
+	struct bpf_insn *insn = env->prog->insnsi;
+	struct call_chain *chains;
+	int i, ret, subprog = 0;
+
+	if (env->subprog_cnt == 1)
+		return 0;
+
+	chains = kcalloc(env->subprog_cnt, sizeof(*chains), GFP_KERNEL);
+	if (!chains)
+		return -ENOMEM;
+
+	ret = check_call_chain(env, 0, 0, chains);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < env->prog->len; i++) {
+		if (i == subprog_end(env, subprog))
+			subprog++;
+		if (bpf_pseudo_call(insn + i))
+			insn[i].off = round_up(env->subprog_stack_depth[subprog],
+					       BPF_REG_SIZE);
+	}
+out:
+	kfree(chains);
+	return ret;
+}
+
 static void free_states(struct verifier_env *env)
 {
 	struct verifier_state_list *sl, *sln;
+	struct verifier_frame *frame;
 	int i;
 
+	while (env->frames) {
+		frame = env->frames->next;
+		kfree(env->frames);
+		env->frames = frame;
+	}
+
 	if (!env->explored_states)
 		return;
 
@@ -2695,6 +3352,14 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 
 	env->prog = *prog;
 
+	env->insn_aux_data = kcalloc((*prog)->len,
+				     sizeof(struct bpf_insn_aux_data),
+				     GFP_USER);
+	if (!env->insn_aux_data) {
+		kfree(env);
+		return -ENOMEM;
+	}
+
 	/* grab the mutex to protect few globals used by verifier */
 	mutex_lock(&bpf_verifier_lock);
 
@@ -2732,18 +3397,27 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	if (!env->explored_states)
 		goto skip_full_check;
 
-	ret = check_cfg(env);
+	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+
+	ret = check_subprogs(env);
 	if (ret < 0)
 		goto skip_full_check;
 
-	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+	ret = check_cfg(env);
+	if (ret < 0)
+		goto skip_full_check;
 
 	ret = do_check(env);
+	if (ret == 0)
+		ret = fixup_call_frames(env);
 
 skip_full_check:
 	while (pop_stack(env, NULL) >= 0);
 	free_states(env);
 
+	if (ret == 0)
+		ret = inline_map_lookups(env);
+
 	if (ret == 0)
 		/* program is valid, convert *(u32*)(ctx + off) accesses */
 		ret = convert_ctx_accesses(env);
@@ -2792,6 +3466,7 @@ free_env:
 		 */
 		release_maps(env);
 	*prog = env->prog;
+	kfree(env->insn_aux_data);
 	kfree(env);
 	mutex_unlock(&bpf_verifier_lock);
 	return ret;
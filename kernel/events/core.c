@@ -46,6 +46,8 @@
 #include <linux/filter.h>
 #include <linux/namei.h>
 #include <linux/parser.h>
+#include <linux/sort.h>
+#include <linux/bsearch.h>
 
 #include "internal.h"
 
@@ -511,6 +513,7 @@ static void cpu_ctx_sched_in(struct perf_cpu_context *cpuctx,
 			     struct task_struct *task);
 
 static void update_context_time(struct perf_event_context *ctx);
+static void update_event_times(struct perf_event *event);
 static u64 perf_event_time(struct perf_event *event);
 
 void __weak perf_event_print_debug(void)	{ }
@@ -634,6 +637,250 @@ perf_cgroup_set_timestamp(struct task_struct *task,
 	info->timestamp = ctx->timestamp;
 }
 
+/*
+ * Per-cgroup counting: instead of opening a cgroup event for every
+ * cgroup on every CPU, userspace can attach a table of cgroup ids to a
+ * single per-cpu counting event. Every time the perf cgroup changes on
+ * that CPU the event is read and what it counted since the last switch
+ * is added to the outgoing cgroup and its ancestors in the table. The
+ * table is sorted by id so it can be searched on every switch.
+ */
+struct perf_cgroup_node {
+	u64				id;
+	u64				count;
+	u64				time_enabled;
+	u64				time_running;
+};
+
+#define PERF_CGROUP_NODES_MAX		(1U << 16)
+
+static int perf_cgroup_node_cmp(const void *a, const void *b)
+{
+	const struct perf_cgroup_node *na = a, *nb = b;
+
+	if (na->id < nb->id)
+		return -1;
+	return na->id > nb->id;
+}
+
+static struct perf_cgroup_node *
+perf_cgroup_node_find(struct perf_event *event, u64 id)
+{
+	struct perf_cgroup_node key = { .id = id };
+
+	return bsearch(&key, event->cgrp_nodes, event->nr_cgrp_nodes,
+		       sizeof(key), perf_cgroup_node_cmp);
+}
+
+/*
+ * Charge what @event counted since the last call to @cgrp and all of
+ * its ancestors that are in the table. A NULL @cgrp only moves the
+ * baseline forward.
+ *
+ * Must be called on event->cpu with the cpuctx lock held.
+ */
+static void perf_cgroup_node_account(struct perf_event *event,
+				     struct cgroup *cgrp)
+{
+	struct perf_event_context *ctx = event->ctx;
+	struct perf_cgroup_node *node;
+	u64 count, enabled, running;
+
+	if (event->state == PERF_EVENT_STATE_ACTIVE)
+		event->pmu->read(event);
+	if (ctx->is_active)
+		update_context_time(ctx);
+	update_event_times(event);
+
+	count = local64_read(&event->count);
+	enabled = event->total_time_enabled;
+	running = event->total_time_running;
+
+	/* PERF_EVENT_IOC_RESET zeroed the count since the last switch */
+	if (count < event->cgrp_node_count)
+		event->cgrp_node_count = 0;
+
+	for (; cgrp; cgrp = cgroup_parent(cgrp)) {
+		node = perf_cgroup_node_find(event, cgroup_ino(cgrp));
+		if (!node)
+			continue;
+
+		node->count += count - event->cgrp_node_count;
+		node->time_enabled += enabled - event->cgrp_node_enabled;
+		node->time_running += running - event->cgrp_node_running;
+	}
+
+	event->cgrp_node_count = count;
+	event->cgrp_node_enabled = enabled;
+	event->cgrp_node_running = running;
+}
+
+/*
+ * @task is leaving the CPU (or its cgroup), charge the per-cgroup
+ * counting events of @cpuctx to its cgroup.
+ */
+static void perf_cgroup_node_switch(struct perf_cpu_context *cpuctx,
+				    struct task_struct *task)
+{
+	struct perf_cgroup *cgrp;
+	struct perf_event *event;
+
+	raw_spin_lock(&cpuctx->ctx.lock);
+	cgrp = perf_cgroup_from_task(task, &cpuctx->ctx);
+	list_for_each_entry(event, &cpuctx->cgrp_node_list, cgrp_node_entry)
+		perf_cgroup_node_account(event, cgrp->css.cgroup);
+	raw_spin_unlock(&cpuctx->ctx.lock);
+}
+
+struct perf_cgroup_node_attach {
+	struct perf_cgroup_node		*nodes;
+	int				nr;
+};
+
+static void __perf_event_attach_cgroup_node(struct perf_event *event,
+					    struct perf_cpu_context *cpuctx,
+					    struct perf_event_context *ctx,
+					    void *info)
+{
+	struct perf_cgroup_node_attach *attach = info;
+
+	if (!(event->attach_state & PERF_ATTACH_CONTEXT))
+		return;
+
+	perf_cgroup_node_account(event, NULL);
+
+	event->cgrp_nodes = attach->nodes;
+	event->nr_cgrp_nodes = attach->nr;
+	list_add(&event->cgrp_node_entry, &cpuctx->cgrp_node_list);
+	atomic_inc(&per_cpu(perf_cgroup_events, event->cpu));
+
+	attach->nodes = NULL;
+}
+
+static int perf_event_attach_cgroup_node(struct perf_event *event,
+					 u64 __user *arg)
+{
+	struct perf_cgroup_node_attach attach;
+	int ret = -EFAULT;
+	u64 nr, i;
+
+	/* counting is split at cgroup switch, which only cpu events see */
+	if (event->cpu < 0 || event->ctx->task || is_cgroup_event(event) ||
+	    is_sampling_event(event))
+		return -EINVAL;
+
+	if (event->nr_cgrp_nodes)
+		return -EBUSY;
+
+	if (copy_from_user(&nr, arg, sizeof(nr)))
+		return -EFAULT;
+
+	if (!nr || nr > PERF_CGROUP_NODES_MAX)
+		return -EINVAL;
+
+	attach.nr = nr;
+	attach.nodes = vzalloc(nr * sizeof(*attach.nodes));
+	if (!attach.nodes)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		if (copy_from_user(&attach.nodes[i].id, arg + 1 + i,
+				   sizeof(attach.nodes[i].id)))
+			goto out_free;
+	}
+
+	sort(attach.nodes, nr, sizeof(*attach.nodes),
+	     perf_cgroup_node_cmp, NULL);
+
+	ret = -EINVAL;
+	for (i = 1; i < nr; i++) {
+		if (attach.nodes[i].id == attach.nodes[i - 1].id)
+			goto out_free;
+	}
+
+	event_function_call(event, __perf_event_attach_cgroup_node, &attach);
+
+	/* the event went away with its CPU */
+	ret = attach.nodes ? -ENODEV : 0;
+out_free:
+	vfree(attach.nodes);
+	return ret;
+}
+
+struct perf_cgroup_node_read {
+	struct perf_cgroup_node		node;
+	int				ret;
+};
+
+static void __perf_event_read_cgroup_node(struct perf_event *event,
+					  struct perf_cpu_context *cpuctx,
+					  struct perf_event_context *ctx,
+					  void *info)
+{
+	struct perf_cgroup_node_read *read = info;
+	struct perf_cgroup_node *node;
+	struct perf_cgroup *cgrp;
+
+	/* flush what the current cgroup counted so far */
+	cgrp = perf_cgroup_from_task(current, ctx);
+	perf_cgroup_node_account(event, cgrp->css.cgroup);
+
+	node = perf_cgroup_node_find(event, read->node.id);
+	if (!node) {
+		read->ret = -ENOENT;
+		return;
+	}
+
+	read->node = *node;
+	read->ret = 0;
+}
+
+static int perf_event_read_cgroup_node(struct perf_event *event,
+				       u64 __user *arg)
+{
+	struct perf_cgroup_node_read read;
+	u64 values[3];
+
+	if (!event->nr_cgrp_nodes)
+		return -EINVAL;
+
+	if (copy_from_user(&read.node.id, arg, sizeof(read.node.id)))
+		return -EFAULT;
+
+	read.ret = -ENODEV;
+	event_function_call(event, __perf_event_read_cgroup_node, &read);
+	if (read.ret)
+		return read.ret;
+
+	values[0] = read.node.count;
+	values[1] = read.node.time_enabled;
+	values[2] = read.node.time_running;
+
+	if (copy_to_user(arg + 1, values, sizeof(values)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+ * Called on event->cpu when @event is taken off its context.
+ */
+static void perf_cgroup_node_detach(struct perf_event *event)
+{
+	if (list_empty(&event->cgrp_node_entry))
+		return;
+
+	list_del_init(&event->cgrp_node_entry);
+	atomic_dec(&per_cpu(perf_cgroup_events, event->cpu));
+}
+
+static inline void perf_cgroup_node_free(struct perf_event *event)
+{
+	vfree(event->cgrp_nodes);
+	event->cgrp_nodes = NULL;
+	event->nr_cgrp_nodes = 0;
+}
+
 #define PERF_CGROUP_SWOUT	0x1 /* cgroup switch out every event */
 #define PERF_CGROUP_SWIN	0x2 /* cgroup switch in events based on task */
 
@@ -666,6 +913,10 @@ static void perf_cgroup_switch(struct task_struct *task, int mode)
 		if (cpuctx->unique_pmu != pmu)
 			continue; /* ensure we process each cpuctx once */
 
+		if ((mode & PERF_CGROUP_SWOUT) &&
+		    !list_empty(&cpuctx->cgrp_node_list))
+			perf_cgroup_node_switch(cpuctx, task);
+
 		/*
 		 * perf_cgroup_events says at least one
 		 * context on this CPU has cgroup events.
@@ -912,6 +1163,26 @@ perf_cgroup_mark_enabled(struct perf_event *event,
 			 struct perf_event_context *ctx)
 {
 }
+
+static inline int perf_event_attach_cgroup_node(struct perf_event *event,
+						u64 __user *arg)
+{
+	return -EINVAL;
+}
+
+static inline int perf_event_read_cgroup_node(struct perf_event *event,
+					      u64 __user *arg)
+{
+	return -EINVAL;
+}
+
+static inline void perf_cgroup_node_detach(struct perf_event *event)
+{
+}
+
+static inline void perf_cgroup_node_free(struct perf_event *event)
+{
+}
 #endif
 
 /*
@@ -1780,6 +2051,7 @@ __perf_remove_from_context(struct perf_event *event,
 	event_sched_out(event, cpuctx, ctx);
 	if (flags & DETACH_GROUP)
 		perf_group_detach(event);
+	perf_cgroup_node_detach(event);
 	list_del_event(event, ctx);
 
 	if (!ctx->nr_events && ctx->is_active) {
@@ -3846,6 +4118,7 @@ static void _free_event(struct perf_event *event)
 
 	if (is_cgroup_event(event))
 		perf_detach_cgroup(event);
+	perf_cgroup_node_free(event);
 
 	if (!event->parent) {
 		if (event->attr.sample_type & PERF_SAMPLE_CALLCHAIN)
@@ -4464,6 +4737,13 @@ static long _perf_ioctl(struct perf_event *event, unsigned int cmd, unsigned lon
 		rcu_read_unlock();
 		return 0;
 	}
+
+	case PERF_EVENT_IOC_ATTACH_CGROUP:
+		return perf_event_attach_cgroup_node(event, (u64 __user *)arg);
+
+	case PERF_EVENT_IOC_READ_CGROUP:
+		return perf_event_read_cgroup_node(event, (u64 __user *)arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -4496,6 +4776,8 @@ static long perf_compat_ioctl(struct file *file, unsigned int cmd,
 	switch (_IOC_NR(cmd)) {
 	case _IOC_NR(PERF_EVENT_IOC_SET_FILTER):
 	case _IOC_NR(PERF_EVENT_IOC_ID):
+	case _IOC_NR(PERF_EVENT_IOC_ATTACH_CGROUP):
+	case _IOC_NR(PERF_EVENT_IOC_READ_CGROUP):
 		/* Fix up pointer size (usually 4 -> 8 in 32-on-64-bit case */
 		if (_IOC_SIZE(cmd) == sizeof(compat_uptr_t)) {
 			cmd &= ~IOCSIZE_MASK;
@@ -8509,6 +8791,7 @@ skip_type:
 		__perf_mux_hrtimer_init(cpuctx, cpu);
 
 		cpuctx->unique_pmu = pmu;
+		INIT_LIST_HEAD(&cpuctx->cgrp_node_list);
 	}
 
 got_cpu_context:
@@ -8772,6 +9055,9 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 	INIT_LIST_HEAD(&event->active_entry);
 	INIT_LIST_HEAD(&event->addr_filters.list);
 	INIT_HLIST_NODE(&event->hlist_entry);
+#ifdef CONFIG_CGROUP_PERF
+	INIT_LIST_HEAD(&event->cgrp_node_entry);
+#endif
 
 
 	init_waitqueue_head(&event->waitq);
@@ -65,6 +65,8 @@
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
 #include <linux/fault-inject.h>
+#include <linux/vmalloc.h>
+#include <linux/prctl.h>
 
 #include <asm/futex.h>
 
@@ -267,6 +269,23 @@ static struct {
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
+/*
+ * A process can have its own table for the futexes keyed on its mm, i.e.
+ * the private ones and the shared ones in private anonymous memory, so that
+ * its contention doesn't collide with unrelated processes in the global
+ * table. It is allocated on the local node before the process has a second
+ * thread and never resized afterwards: waiters already queued in another
+ * table would be invisible to the wakers.
+ */
+struct futex_private_hash {
+	unsigned long			hashsize;
+	struct futex_hash_bucket	queues[];
+};
+
+#define FUTEX_PRIVATE_HASH_MIN	16
+
+int sysctl_futex_private_hash __read_mostly;
+
 
 /*
  * Fault injections for futexes.
@@ -376,11 +395,27 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 /*
  * We hash on the keys returned from get_futex_key (see below).
  */
+static inline struct futex_private_hash *
+futex_private_hash(union futex_key *key)
+{
+	struct mm_struct *mm;
+
+	if (key->both.offset & FUT_OFF_INODE)
+		return NULL;
+
+	mm = key->private.mm;
+	return mm ? READ_ONCE(mm->futex_hash) : NULL;
+}
+
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_private_hash *fph = futex_private_hash(key);
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	if (fph)
+		return &fph->queues[hash & (fph->hashsize - 1)];
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
@@ -2173,6 +2208,7 @@ handle_fault:
 }
 
 static long futex_wait_restart(struct restart_block *restart);
+static long futex_wait_multiple_restart(struct restart_block *restart);
 
 /**
  * fixup_owner() - Post lock pi_state and corner case management
@@ -2451,6 +2487,227 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/**
+ * unqueue_multiple() - Remove several futex_q's from their hash buckets
+ * @qs:		the futex_q's, all previously queued with queue_me()
+ * @count:	the number of futex_q's
+ *
+ * Drops the q.key reference of all of them, like unqueue_me().
+ *
+ * Return: the index of one of the futex_q's that had already been removed
+ * by a waking thread, or -1 if none had.
+ */
+static int unqueue_multiple(struct futex_q *qs, int count)
+{
+	int ret = -1;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&qs[i]) && ret < 0)
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on several futexes
+ * @wb:		the futexes and their expected values
+ * @qs:		the associated futex_q's
+ * @count:	the number of futexes
+ * @flags:	futex flags (FLAGS_SHARED, etc.)
+ * @woken:	index of the futex that woke us, if any
+ *
+ * Like futex_wait_setup(), for each futex: lock its hash bucket, get the
+ * value and compare it with the expected one, and queue the futex_q. The
+ * task state is set before the first futex is queued, a wakeup on one of
+ * them while the others are being queued isn't lost: it is reported
+ * through @woken instead.
+ *
+ * Return:
+ *  0 - all the futexes matched and are queued, with the task state set;
+ *  1 - one futex was woken meanwhile, nothing is queued and @woken is set;
+ * <0 - -EFAULT or -EWOULDBLOCK, nothing is queued.
+ */
+static int futex_wait_multiple_setup(struct futex_wait_block *wb,
+				     struct futex_q *qs, int count,
+				     unsigned int flags, int *woken)
+{
+	struct futex_hash_bucket *hb;
+	u32 __user *uaddr;
+	u32 uval;
+	int ret, i, j;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(u64_to_user_ptr(wb[i].uaddr),
+				    flags & FLAGS_SHARED, &qs[i].key,
+				    VERIFY_READ);
+		if (unlikely(ret != 0)) {
+			while (--i >= 0)
+				put_futex_key(&qs[i].key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		uaddr = u64_to_user_ptr(wb[i].uaddr);
+
+		hb = queue_lock(&qs[i]);
+		ret = get_futex_value_locked(&uval, uaddr);
+		if (!ret && uval == wb[i].val) {
+			queue_me(&qs[i], hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		for (j = i; j < count; j++)
+			put_futex_key(&qs[j].key);
+
+		*woken = unqueue_multiple(qs, i);
+		if (*woken >= 0)
+			return 1;
+
+		if (!ret)
+			return -EWOULDBLOCK;
+
+		ret = get_user(uval, uaddr);
+		if (ret)
+			return ret;
+
+		goto retry;
+	}
+
+	return 0;
+}
+
+static int futex_wait_multiple(u32 __user *uaddr, unsigned int flags,
+			       u32 count, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct restart_block *restart;
+	struct futex_wait_block *wb;
+	struct futex_q *qs;
+	int ret, woken, i;
+
+	if (!count || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	wb = kcalloc(count, sizeof(*wb), GFP_KERNEL);
+	qs = kcalloc(count, sizeof(*qs), GFP_KERNEL);
+	if (!wb || !qs) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	if (copy_from_user(wb, uaddr, count * sizeof(*wb))) {
+		ret = -EFAULT;
+		goto out_free;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!wb[i].bitset) {
+			ret = -EINVAL;
+			goto out_free;
+		}
+		qs[i] = futex_q_init;
+		qs[i].bitset = wb[i].bitset;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, (flags & FLAGS_CLOCKRT) ?
+				      CLOCK_REALTIME : CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+retry:
+	/* On success, all the futexes are queued and hold q.key refs. */
+	ret = futex_wait_multiple_setup(wb, qs, count, flags, &woken);
+	if (ret) {
+		if (ret > 0)
+			ret = woken;
+		goto out;
+	}
+
+	/* Arm the timer */
+	if (to)
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+
+	/*
+	 * If any of the futexes has been removed from its hash list, another
+	 * task has tried to wake us, and we can skip the call to schedule().
+	 */
+	for (i = 0; i < count; i++) {
+		if (plist_node_empty(&qs[i].list))
+			break;
+	}
+	if (i == count && (!to || to->task))
+		freezable_schedule();
+	__set_current_state(TASK_RUNNING);
+
+	/* If we were woken through one of the futexes, return which. */
+	ret = unqueue_multiple(qs, count);
+	if (ret >= 0)
+		goto out;
+
+	ret = -ETIMEDOUT;
+	if (to && !to->task)
+		goto out;
+
+	/*
+	 * We expect signal_pending(current), but we might be the
+	 * victim of a spurious wakeup as well.
+	 */
+	if (!signal_pending(current))
+		goto retry;
+
+	ret = -ERESTARTSYS;
+	if (!abs_time)
+		goto out;
+
+	restart = &current->restart_block;
+	restart->fn = futex_wait_multiple_restart;
+	restart->futex.uaddr = uaddr;
+	restart->futex.val = count;
+	restart->futex.time = abs_time->tv64;
+	restart->futex.flags = flags | FLAGS_HAS_TIMEOUT;
+
+	ret = -ERESTART_RESTARTBLOCK;
+
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(qs);
+	kfree(wb);
+	return ret;
+}
+
+static long futex_wait_multiple_restart(struct restart_block *restart)
+{
+	u32 __user *uaddr = restart->futex.uaddr;
+	ktime_t t, *tp = NULL;
+
+	if (restart->futex.flags & FLAGS_HAS_TIMEOUT) {
+		t.tv64 = restart->futex.time;
+		tp = &t;
+	}
+	restart->fn = do_no_restart_syscall;
+
+	return (long)futex_wait_multiple(uaddr, restart->futex.flags,
+					 restart->futex.val, tp);
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -3197,6 +3454,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAIT_MULTIPLE:
+		return futex_wait_multiple(uaddr, flags, val, timeout);
 	}
 	return -ENOSYS;
 }
@@ -3213,7 +3472,8 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (unlikely(should_fail_futex(!(op & FUTEX_PRIVATE_FLAG))))
 			return -EFAULT;
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
@@ -3222,7 +3482,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
@@ -3257,6 +3517,84 @@ static void __init futex_detect_cmpxchg(void)
 #endif
 }
 
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
+
+/* Only while @mm has no other user, no futex can be queued for it then */
+static bool futex_private_hash_allowed(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 1 && !mm->futex_hash;
+}
+
+static int futex_private_hash_alloc(struct mm_struct *mm, unsigned long slots)
+{
+	struct futex_private_hash *fph;
+	int node = numa_node_id();
+	unsigned long i;
+	size_t size;
+
+	slots = roundup_pow_of_two(clamp_t(unsigned long, slots,
+					   FUTEX_PRIVATE_HASH_MIN,
+					   futex_hashsize));
+	size = sizeof(*fph) + slots * sizeof(fph->queues[0]);
+
+	fph = kzalloc_node(size, GFP_KERNEL | __GFP_NOWARN, node);
+	if (!fph)
+		fph = vzalloc_node(size, node);
+	if (!fph)
+		return -ENOMEM;
+
+	fph->hashsize = slots;
+	for (i = 0; i < slots; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+
+	WRITE_ONCE(mm->futex_hash, fph);
+	return 0;
+}
+
+/*
+ * Called when @mm is about to get a second thread. With the automatic
+ * private hashing size the table for the threads that can run at once,
+ * if the allocation fails the process just keeps using the global table.
+ */
+void futex_private_hash_fork(struct mm_struct *mm)
+{
+	if (!sysctl_futex_private_hash || !futex_private_hash_allowed(mm))
+		return;
+
+	futex_private_hash_alloc(mm, 4 * cpumask_weight(tsk_cpus_allowed(current)));
+}
+
+void futex_private_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	struct mm_struct *mm = current->mm;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (!arg3)
+			return -EINVAL;
+		if (!futex_private_hash_allowed(mm))
+			return -EBUSY;
+		return futex_private_hash_alloc(mm, arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		return mm->futex_hash ? mm->futex_hash->hashsize : 0;
+	}
+
+	return -EINVAL;
+}
+
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
@@ -3277,11 +3615,8 @@ static int __init futex_init(void)
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i]);
 
 	return 0;
 }
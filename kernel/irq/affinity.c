@@ -0,0 +1,216 @@
+/*
+ * Spread the vectors of multiqueue devices over the CPUs and NUMA nodes
+ *
+ * The resulting masks are handed to the interrupt core through the MSI
+ * descriptors. Such interrupts are marked IRQD_AFFINITY_MANAGED: user space
+ * can't change their affinity and they are shut down, rather than broken
+ * onto other CPUs, when the last CPU of their mask goes offline.
+ */
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+
+static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
+				int cpus_per_vec)
+{
+	const struct cpumask *siblmsk;
+	int cpu, sibl;
+
+	for ( ; cpus_per_vec > 0; ) {
+		cpu = cpumask_first(nmsk);
+
+		/* Should not happen, the caller hands out the CPUs it counted */
+		if (cpu >= nr_cpu_ids)
+			return;
+
+		cpumask_clear_cpu(cpu, nmsk);
+		cpumask_set_cpu(cpu, irqmsk);
+		cpus_per_vec--;
+
+		/* If the cpu has siblings, use them first */
+		siblmsk = topology_sibling_cpumask(cpu);
+		for (sibl = -1; cpus_per_vec > 0; ) {
+			sibl = cpumask_next(sibl, siblmsk);
+			if (sibl >= nr_cpu_ids)
+				break;
+			if (!cpumask_test_and_clear_cpu(sibl, nmsk))
+				continue;
+			cpumask_set_cpu(sibl, irqmsk);
+			cpus_per_vec--;
+		}
+	}
+}
+
+/*
+ * cpumask_of_node() only covers the CPUs which have been brought up on some
+ * architectures, build the node masks of the possible CPUs instead so that
+ * CPUs plugged in later already have a vector.
+ */
+static cpumask_var_t *alloc_node_to_possible_cpumask(void)
+{
+	cpumask_var_t *masks;
+	int node, cpu;
+
+	masks = kcalloc(nr_node_ids, sizeof(cpumask_var_t), GFP_KERNEL);
+	if (!masks)
+		return NULL;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		if (!zalloc_cpumask_var(&masks[node], GFP_KERNEL))
+			goto out_unwind;
+	}
+
+	for_each_possible_cpu(cpu)
+		cpumask_set_cpu(cpu, masks[cpu_to_node(cpu)]);
+
+	return masks;
+
+out_unwind:
+	while (--node >= 0)
+		free_cpumask_var(masks[node]);
+	kfree(masks);
+	return NULL;
+}
+
+static void free_node_to_possible_cpumask(cpumask_var_t *masks)
+{
+	int node;
+
+	for (node = 0; node < nr_node_ids; node++)
+		free_cpumask_var(masks[node]);
+	kfree(masks);
+}
+
+static int get_nodes_in_cpumask(cpumask_var_t *node_to_cpumask,
+				nodemask_t *nodemsk)
+{
+	int n, nodes = 0;
+
+	for (n = 0; n < nr_node_ids; n++) {
+		if (!cpumask_empty(node_to_cpumask[n])) {
+			node_set(n, *nodemsk);
+			nodes++;
+		}
+	}
+	return nodes;
+}
+
+/**
+ * irq_create_affinity_masks - Create affinity masks for multiqueue spreading
+ * @nvecs:	The total number of vectors
+ * @affd:	Description of the affinity requirements
+ *
+ * Spreads the possible CPUs over the vectors, node by node so that no vector
+ * spans two nodes unless there are fewer vectors than nodes, and keeping SMT
+ * siblings on the same vector. The pre and post vectors get the default
+ * affinity.
+ *
+ * Returns the masks pointer or NULL if allocation failed.
+ */
+struct cpumask *
+irq_create_affinity_masks(int nvecs, const struct irq_affinity *affd)
+{
+	int affvecs = nvecs - affd->pre_vectors - affd->post_vectors;
+	int last_affv = affvecs + affd->pre_vectors;
+	int curvec, done = 0, nodes, n;
+	nodemask_t nodemsk = NODE_MASK_NONE;
+	cpumask_var_t *node_to_cpumask;
+	struct cpumask *masks = NULL;
+	cpumask_var_t nmsk;
+
+	if (affvecs <= 0)
+		return NULL;
+
+	if (!zalloc_cpumask_var(&nmsk, GFP_KERNEL))
+		return NULL;
+
+	node_to_cpumask = alloc_node_to_possible_cpumask();
+	if (!node_to_cpumask)
+		goto out;
+
+	masks = kcalloc(nvecs, sizeof(*masks), GFP_KERNEL);
+	if (!masks)
+		goto out_free;
+
+	/* Fill out vectors at the beginning that don't need affinity */
+	for (curvec = 0; curvec < affd->pre_vectors; curvec++)
+		cpumask_copy(masks + curvec, irq_default_affinity);
+
+	nodes = get_nodes_in_cpumask(node_to_cpumask, &nodemsk);
+
+	/*
+	 * If the number of nodes is greater than or equal the number of
+	 * vectors, spread the nodes over the vectors.
+	 */
+	if (affvecs <= nodes) {
+		for_each_node_mask(n, nodemsk) {
+			cpumask_or(masks + curvec, masks + curvec,
+				   node_to_cpumask[n]);
+			if (++curvec == last_affv)
+				curvec = affd->pre_vectors;
+		}
+		goto done;
+	}
+
+	for_each_node_mask(n, nodemsk) {
+		int ncpus, v, vecs_to_assign, vecs_per_node, extra_vecs;
+
+		/* Spread the remaining vectors over the remaining nodes */
+		vecs_per_node = (affvecs - done) / nodes;
+
+		cpumask_copy(nmsk, node_to_cpumask[n]);
+		ncpus = cpumask_weight(nmsk);
+		vecs_to_assign = min(vecs_per_node, ncpus);
+
+		/* Account for rounding errors */
+		extra_vecs = ncpus - vecs_to_assign * (ncpus / vecs_to_assign);
+
+		for (v = 0; curvec < last_affv && v < vecs_to_assign;
+		     curvec++, v++) {
+			int cpus_per_vec = ncpus / vecs_to_assign;
+
+			if (extra_vecs) {
+				cpus_per_vec++;
+				--extra_vecs;
+			}
+			irq_spread_init_one(masks + curvec, nmsk, cpus_per_vec);
+		}
+
+		done += v;
+		if (done >= affvecs)
+			break;
+		--nodes;
+	}
+
+done:
+	/* Vectors left over by small nodes must not end up without a CPU */
+	for (curvec = affd->pre_vectors; curvec < last_affv; curvec++) {
+		if (cpumask_empty(masks + curvec))
+			cpumask_copy(masks + curvec, irq_default_affinity);
+	}
+
+	/* Fill out vectors at the end that don't need affinity */
+	for (; curvec < nvecs; curvec++)
+		cpumask_copy(masks + curvec, irq_default_affinity);
+out_free:
+	free_node_to_possible_cpumask(node_to_cpumask);
+out:
+	free_cpumask_var(nmsk);
+	return masks;
+}
+
+/**
+ * irq_calc_affinity_vectors - Calculate the optimal number of vectors
+ * @maxvec:	The maximum number of vectors available
+ * @affd:	Description of the affinity requirements
+ */
+int irq_calc_affinity_vectors(int maxvec, const struct irq_affinity *affd)
+{
+	int resv = affd->pre_vectors + affd->post_vectors;
+	int vecs = maxvec - resv;
+
+	return min_t(int, cpumask_weight(cpu_possible_mask), vecs) + resv;
+}
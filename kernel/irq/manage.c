@@ -133,6 +133,21 @@ int irq_can_set_affinity(unsigned int irq)
 	return __irq_can_set_affinity(irq_to_desc(irq));
 }
 
+/**
+ * irq_can_set_affinity_usr - Check if affinity of a irq can be set from user space
+ * @irq:	Interrupt to check
+ *
+ * Like irq_can_set_affinity() above, but additionally checks for the
+ * AFFINITY_MANAGED flag.
+ */
+bool irq_can_set_affinity_usr(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	return __irq_can_set_affinity(desc) &&
+		!irqd_affinity_is_managed(&desc->irq_data);
+}
+
 /**
  *	irq_set_thread_affinity - Notify irq threads to adjust affinity
  *	@desc:		irq descriptor which has affitnity changed
@@ -338,10 +353,11 @@ static int setup_affinity(struct irq_desc *desc, struct cpumask *mask)
 		return 0;
 
 	/*
-	 * Preserve an userspace affinity setup, but make sure that
-	 * one of the targets is online.
+	 * Preserve the managed affinity setting and an userspace affinity
+	 * setup, but make sure that one of the targets is online.
 	 */
-	if (irqd_has_set(&desc->irq_data, IRQD_AFFINITY_SET)) {
+	if (irqd_affinity_is_managed(&desc->irq_data) ||
+	    irqd_has_set(&desc->irq_data, IRQD_AFFINITY_SET)) {
 		if (cpumask_intersects(desc->irq_common_data.affinity,
 				       cpu_online_mask))
 			set = desc->irq_common_data.affinity;
@@ -383,6 +399,79 @@ int irq_select_affinity_usr(unsigned int irq, struct cpumask *mask)
 	return ret;
 }
 
+/**
+ * irq_shutdown_managed_offline - Shut down a managed irq without online target
+ * @desc:	The interrupt descriptor, desc->lock must be held
+ *
+ * The affinity of a managed interrupt is never broken onto other CPUs: once
+ * the last CPU of its mask is gone the interrupt is shut down instead, and
+ * restarted by irq_affinity_online_cpu() when one of them comes back.
+ *
+ * Returns true if the interrupt is shut down.
+ */
+bool irq_shutdown_managed_offline(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+
+	if (!irqd_affinity_is_managed(d))
+		return false;
+
+	if (irqd_is_managed_and_shutdown(d))
+		return true;
+
+	if (cpumask_any_and(irq_data_get_affinity_mask(d),
+			    cpu_online_mask) < nr_cpu_ids)
+		return false;
+
+	irqd_set(d, IRQD_MANAGED_SHUTDOWN);
+	if (desc->action)
+		irq_shutdown(desc);
+	return true;
+}
+
+/*
+ * @cpu is online: restart the managed interrupts which are shut down for
+ * the lack of an online target and include @cpu in the effective affinity
+ * of the others.
+ */
+int irq_affinity_online_cpu(unsigned int cpu)
+{
+	struct irq_desc *desc;
+	unsigned int irq;
+
+	irq_lock_sparse();
+	for_each_active_irq(irq) {
+		const struct cpumask *affinity;
+		struct irq_data *d;
+
+		desc = irq_to_desc(irq);
+		if (!desc)
+			continue;
+
+		raw_spin_lock_irq(&desc->lock);
+		d = irq_desc_get_irq_data(desc);
+		affinity = irq_data_get_affinity_mask(d);
+
+		if (!irqd_affinity_is_managed(d) || !desc->action ||
+		    !cpumask_test_cpu(cpu, affinity)) {
+			raw_spin_unlock_irq(&desc->lock);
+			continue;
+		}
+
+		if (irqd_is_managed_and_shutdown(d)) {
+			irqd_clear(d, IRQD_MANAGED_SHUTDOWN);
+			irq_do_set_affinity(d, affinity, false);
+			irq_startup(desc, true);
+		} else {
+			irq_set_affinity_locked(d, affinity, false);
+		}
+		raw_spin_unlock_irq(&desc->lock);
+	}
+	irq_unlock_sparse();
+
+	return 0;
+}
+
 #else
 static inline int
 setup_affinity(struct irq_desc *desc, struct cpumask *mask)
@@ -1301,9 +1390,16 @@ __setup_irq(unsigned int irq, struct irq_desc *desc, struct irqaction *new)
 		if (new->flags & IRQF_ONESHOT)
 			desc->istate |= IRQS_ONESHOT;
 
-		if (irq_settings_can_autoenable(desc))
-			irq_startup(desc, true);
-		else
+		irqd_clear(&desc->irq_data, IRQD_MANAGED_SHUTDOWN);
+		if (irq_settings_can_autoenable(desc)) {
+			/*
+			 * A managed interrupt without an online target
+			 * stays shut down until a CPU of its mask comes
+			 * up, see irq_affinity_online_cpu().
+			 */
+			if (!irq_shutdown_managed_offline(desc))
+				irq_startup(desc, true);
+		} else
 			/* Undo nested disables: */
 			desc->depth = 1;
 
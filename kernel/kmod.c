@@ -39,6 +39,7 @@
 #include <linux/rwsem.h>
 #include <linux/ptrace.h>
 #include <linux/async.h>
+#include <linux/initrd.h>
 #include <asm/uaccess.h>
 
 #include <trace/events/module.h>
@@ -228,6 +229,9 @@ static int call_usermodehelper_exec_async(void *data)
 	 */
 	set_user_nice(current, 0);
 
+	/* the helper may live in the initramfs */
+	wait_for_initramfs();
+
 	retval = -ENOMEM;
 	new = prepare_kernel_cred(current);
 	if (!new)
@@ -0,0 +1,38 @@
+/*
+ * Contention tracing for the lock slow paths
+ *
+ * A slow path brackets its wait with lock_contention_begin() and
+ * lock_contention_end(). The wait is only timed while one of the contention
+ * tracepoints is enabled, otherwise both are a static branch.
+ *
+ * The events can be aggregated in the kernel with a hist trigger, e.g.
+ *
+ *   echo 'hist:keys=ip.sym:vals=wait_ns:sort=wait_ns.descending' > \
+ *	/sys/kernel/debug/tracing/events/lock/contention_end/trigger
+ */
+#ifndef __LOCKING_LOCK_CONTENTION_H
+#define __LOCKING_LOCK_CONTENTION_H
+
+#include <linux/sched.h>
+#include <trace/events/lock.h>
+
+static __always_inline u64
+lock_contention_begin(void *lock, unsigned int flags, unsigned long ip)
+{
+	if (!trace_contention_begin_enabled() &&
+	    !trace_contention_end_enabled())
+		return 0;
+
+	trace_contention_begin(lock, flags, ip);
+	return local_clock() ? : 1;
+}
+
+/* @start is the return value of lock_contention_begin() */
+static __always_inline void
+lock_contention_end(void *lock, int ret, unsigned long ip, u64 start)
+{
+	if (start)
+		trace_contention_end(lock, ret, ip, local_clock() - start);
+}
+
+#endif /* __LOCKING_LOCK_CONTENTION_H */
@@ -27,6 +27,12 @@
 #include <linux/debug_locks.h>
 #include <linux/osq_lock.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/lock.h>
+#undef CREATE_TRACE_POINTS
+
+#include "lock_contention.h"
+
 /*
  * In the DEBUG case we are using the "NULL fastpath" for mutexes,
  * which forces all calls into the slowpath:
@@ -512,13 +518,16 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	struct task_struct *task = current;
 	struct mutex_waiter waiter;
 	unsigned long flags;
+	u64 wait_start;
 	int ret;
 
 	preempt_disable();
 	mutex_acquire_nest(&lock->dep_map, subclass, 0, nest_lock, ip);
 
+	wait_start = lock_contention_begin(lock, LCB_F_MUTEX | LCB_F_SPIN, ip);
 	if (mutex_optimistic_spin(lock, ww_ctx, use_ww_ctx)) {
 		/* got the lock, yay! */
+		lock_contention_end(lock, 0, ip, wait_start);
 		preempt_enable();
 		return 0;
 	}
@@ -598,6 +607,7 @@ skip_wait:
 	}
 
 	spin_unlock_mutex(&lock->wait_lock, flags);
+	lock_contention_end(lock, 0, ip, wait_start);
 	preempt_enable();
 	return 0;
 
@@ -606,6 +616,7 @@ err:
 	spin_unlock_mutex(&lock->wait_lock, flags);
 	debug_mutex_free_waiter(&waiter);
 	mutex_release(&lock->dep_map, 1, ip);
+	lock_contention_end(lock, ret, ip, wait_start);
 	preempt_enable();
 	return ret;
 }
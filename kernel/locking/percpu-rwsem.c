@@ -8,6 +8,8 @@
 #include <linux/sched.h>
 #include <linux/errno.h>
 
+#include "lock_contention.h"
+
 int __percpu_init_rwsem(struct percpu_rw_semaphore *brw,
 			const char *name, struct lock_class_key *rwsem_key)
 {
@@ -70,16 +72,21 @@ static bool update_fast_ctr(struct percpu_rw_semaphore *brw, unsigned int val)
  */
 void percpu_down_read(struct percpu_rw_semaphore *brw)
 {
+	u64 wait_start;
+
 	might_sleep();
 	rwsem_acquire_read(&brw->rw_sem.dep_map, 0, 0, _RET_IP_);
 
 	if (likely(update_fast_ctr(brw, +1)))
 		return;
 
+	wait_start = lock_contention_begin(brw, LCB_F_PERCPU | LCB_F_READ,
+					   _RET_IP_);
 	/* Avoid rwsem_acquire_read() and rwsem_release() */
 	__down_read(&brw->rw_sem);
 	atomic_inc(&brw->slow_read_ctr);
 	__up_read(&brw->rw_sem);
+	lock_contention_end(brw, 0, _RET_IP_, wait_start);
 }
 EXPORT_SYMBOL_GPL(percpu_down_read);
 
@@ -141,7 +148,14 @@ void percpu_down_write(struct percpu_rw_semaphore *brw)
 	atomic_add(clear_fast_ctr(brw), &brw->slow_read_ctr);
 
 	/* wait for all readers to complete their percpu_up_read() */
-	wait_event(brw->write_waitq, !atomic_read(&brw->slow_read_ctr));
+	if (atomic_read(&brw->slow_read_ctr)) {
+		u64 wait_start;
+
+		wait_start = lock_contention_begin(brw,
+				LCB_F_PERCPU | LCB_F_WRITE, _RET_IP_);
+		wait_event(brw->write_waitq, !atomic_read(&brw->slow_read_ctr));
+		lock_contention_end(brw, 0, _RET_IP_, wait_start);
+	}
 }
 EXPORT_SYMBOL_GPL(percpu_down_write);
 
@@ -0,0 +1,319 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+#include <linux/moduleparam.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes. Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Primary queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded pointer to the tail of the secondary queue, which is organized as a
+ * circular list.
+ *
+ * While the queue head waits for the owner to release the lock, it moves
+ * waiters running on other nodes from the primary queue into the secondary
+ * one, one at a time and never the primary tail, so that the next lock
+ * holder runs on the same node. The secondary queue is spliced back in front
+ * of the primary queue when no local waiter is found, when the primary queue
+ * becomes empty, or after numa_spinlock_threshold consecutive intra-node
+ * hand-offs, which bounds the time a remote waiter can be starved.
+ *
+ * For more details, see "Compact NUMA-aware Locks" by Dice and Kogan,
+ * https://arxiv.org/abs/1810.05600.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	struct mcs_spinlock	__res[3];
+
+	u16			numa_node;
+	u16			partial_order;
+	u32			encoded_tail;	/* self */
+	u32			intra_count;
+};
+
+enum {
+	LOCAL_WAITER_NOT_FOUND,
+	LOCAL_WAITER_FOUND,
+	FLUSH_SECONDARY_QUEUE,
+};
+
+/*
+ * Number of consecutive lock hand-offs within a NUMA node after which the
+ * secondary queue is flushed; the larger it is the better the throughput
+ * and the longer a remote waiter may wait.
+ */
+static unsigned int numa_spinlock_threshold __read_mostly = 1 << 16;
+module_param(numa_spinlock_threshold, uint, 0644);
+
+/*
+ * numa_spinlock=on|off|auto, auto only enables CNA on multi-node systems.
+ */
+static int numa_spinlock_flag;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto")) {
+		numa_spinlock_flag = 0;
+		return 1;
+	} else if (!strcmp(str, "on")) {
+		numa_spinlock_flag = 1;
+		return 1;
+	} else if (!strcmp(str, "off")) {
+		numa_spinlock_flag = -1;
+		return 1;
+	}
+
+	return 0;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+static void __init cna_init_nodes_per_cpu(unsigned int cpu)
+{
+	struct mcs_spinlock *base = per_cpu_ptr(&mcs_nodes[0], cpu);
+	int numa_node = cpu_to_node(cpu);
+	int i;
+
+	for (i = 0; i < MAX_NODES / 2; i++) {
+		struct cna_node *cn = (struct cna_node *)(base + i);
+
+		cn->numa_node = numa_node;
+		cn->encoded_tail = encode_tail(cpu, i);
+		/*
+		 * make sure @encoded_tail is not confused with other valid
+		 * values for @locked (0 or 1)
+		 */
+		WARN_ON(cn->encoded_tail <= 1);
+	}
+}
+
+static void __init cna_init_nodes(void)
+{
+	unsigned int cpu;
+
+	/*
+	 * The CNA state lives in the second cacheline of mcs_nodes[], just
+	 * like the PV state does.
+	 */
+	BUILD_BUG_ON(sizeof(struct cna_node) > 5 * sizeof(struct mcs_spinlock));
+
+	for_each_possible_cpu(cpu)
+		cna_init_nodes_per_cpu(cpu);
+}
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+
+	cn->partial_order = LOCAL_WAITER_FOUND;
+	cn->intra_count = 0;
+}
+
+/*
+ * cna_splice_next -- splice the next node from the primary queue onto
+ * the secondary queue.
+ */
+static void cna_splice_next(struct mcs_spinlock *node,
+			    struct mcs_spinlock *next,
+			    struct mcs_spinlock *nnext)
+{
+	/* remove 'next' from the main queue */
+	node->next = nnext;
+
+	/* stick `next` on the secondary queue tail */
+	if (node->locked <= 1) { /* if secondary queue is empty */
+		/* create secondary queue */
+		next->next = next;
+	} else {
+		/* add to the tail of the secondary queue */
+		struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+		struct mcs_spinlock *head_2nd = tail_2nd->next;
+
+		tail_2nd->next = next;
+		next->next = head_2nd;
+	}
+
+	node->locked = ((struct cna_node *)next)->encoded_tail;
+}
+
+/*
+ * cna_order_queue - check whether the next waiter in the main queue is on
+ * the same NUMA node as the lock holder; if not, and it has a successor,
+ * move it into the secondary queue.
+ * Returns 1 if the next waiter is local, 0 otherwise.
+ */
+static u32 cna_order_queue(struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next = READ_ONCE(node->next);
+	struct cna_node *cn = (struct cna_node *)node;
+	int numa_node, next_numa_node;
+
+	if (!next)
+		return 0;
+
+	numa_node = cn->numa_node;
+	next_numa_node = ((struct cna_node *)next)->numa_node;
+
+	if (next_numa_node != numa_node) {
+		struct mcs_spinlock *nnext = READ_ONCE(next->next);
+
+		if (nnext) {
+			cna_splice_next(node, next, nnext);
+			next_numa_node = ((struct cna_node *)nnext)->numa_node;
+		}
+	}
+
+	cn->partial_order = next_numa_node == numa_node ?
+				LOCAL_WAITER_FOUND : LOCAL_WAITER_NOT_FOUND;
+
+	return cn->partial_order == LOCAL_WAITER_FOUND;
+}
+
+/* Abuse the pv_wait_head_or_lock() hook to get some work done */
+static __always_inline u32 cna_wait_head_or_lock(struct qspinlock *lock,
+						 struct mcs_spinlock *node)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+
+	if (cn->intra_count < numa_spinlock_threshold) {
+		/*
+		 * Try and put the time otherwise spent spin waiting on
+		 * _Q_LOCKED_PENDING_MASK to use by sorting our lists.
+		 */
+		while ((atomic_read(&lock->val) & _Q_LOCKED_PENDING_MASK) &&
+		       !cna_order_queue(node))
+			cpu_relax();
+	} else {
+		cn->partial_order = FLUSH_SECONDARY_QUEUE;
+	}
+
+	return 0; /* we lied; we didn't wait, go do so now */
+}
+
+static inline bool cna_try_clear_tail(struct qspinlock *lock, u32 *val,
+				      struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *head_2nd, *tail_2nd;
+	u32 new, old;
+
+	/* If the secondary queue is empty, do what MCS does. */
+	if (node->locked <= 1)
+		return __try_clear_tail(lock, val, node);
+
+	/*
+	 * Try to update the tail value to the last node in the secondary queue.
+	 * If successful, pass the lock to the first thread in the secondary
+	 * queue. Doing those two actions effectively moves all nodes from the
+	 * secondary queue into the main one.
+	 */
+	tail_2nd = decode_tail(node->locked);
+	head_2nd = tail_2nd->next;
+	new = ((struct cna_node *)tail_2nd)->encoded_tail + _Q_LOCKED_VAL;
+
+	old = atomic_cmpxchg_relaxed(&lock->val, *val, new);
+	if (old != *val) {
+		*val = old;
+		return false;
+	}
+
+	/*
+	 * Try to reset @next in tail_2nd to NULL, but no need to check the
+	 * result - if failed, a new successor has updated it.
+	 */
+	cmpxchg_relaxed(&tail_2nd->next, head_2nd, NULL);
+	smp_store_release(&head_2nd->locked, 1);
+
+	return true;
+}
+
+static inline void cna_pass_lock(struct mcs_spinlock *node,
+				 struct mcs_spinlock *next)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	u32 val = 1;
+
+	/*
+	 * cna_order_queue() may have moved the successor the caller loaded
+	 * before waiting for the owner; the current one is never NULL.
+	 */
+	next = READ_ONCE(node->next);
+
+	if (cn->partial_order == LOCAL_WAITER_FOUND) {
+		/*
+		 * We found a local waiter; hand it the secondary queue, if
+		 * any, along with the number of intra-node hand-offs so far.
+		 */
+		if (node->locked > 1) {
+			val = node->locked;
+			((struct cna_node *)next)->intra_count = cn->intra_count + 1;
+		}
+	} else if (node->locked > 1) {
+		/*
+		 * No local waiter or the threshold was reached; splice the
+		 * secondary queue in front of the main one and pass the lock
+		 * to its head.
+		 */
+		struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+		struct mcs_spinlock *head_2nd = tail_2nd->next;
+
+		tail_2nd->next = next;
+		next = head_2nd;
+	}
+
+	/* CNA is x86-only, see NUMA_AWARE_SPINLOCKS, no arch hook needed */
+	smp_store_release(&next->locked, val);
+}
+
+/*
+ * Switch to the NUMA-friendly slow path for spinlocks when we have
+ * multiple NUMA nodes in native environment, unless the user has
+ * overridden this default behavior by setting the numa_spinlock flag.
+ */
+void __init cna_configure_spin_lock_slowpath(void)
+{
+	if (numa_spinlock_flag < 0 ||
+	    (numa_spinlock_flag == 0 && nr_node_ids < 2))
+		return;
+
+	/* a paravirt slow path (e.g. KVM or Xen) always wins */
+	if (pv_lock_ops.queued_spin_lock_slowpath !=
+	    native_queued_spin_lock_slowpath)
+		return;
+
+	cna_init_nodes();
+
+	pv_lock_ops.queued_spin_lock_slowpath = __cna_queued_spin_lock_slowpath;
+
+	pr_info("Enabling CNA spinlock\n");
+}
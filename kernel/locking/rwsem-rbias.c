@@ -0,0 +1,187 @@
+/*
+ * Reader bias for rw_semaphores
+ *
+ * Every down_read()/up_read() of an xadd rwsem is an atomic operation on
+ * sem->count, for read-mostly semaphores taken by many CPUs at once (mmap_sem
+ * of a big threaded process faulting in parallel) that cacheline bouncing
+ * dominates even when no writer ever shows up.
+ *
+ * With reader bias on, a reader instead publishes itself in a global table of
+ * visible readers, hashed on the (semaphore, task) pair, and then re-checks
+ * the bias; no shared cacheline is written as long as readers hash apart.
+ * A writer first takes the semaphore the usual way, which holds off new
+ * unbiased readers, then revokes the bias and waits until no slot of the
+ * table refers to the semaphore anymore.
+ *
+ * Revocation costs a scan of the table, so after a revocation the bias
+ * stays off for RWSEM_RBIAS_MULTIPLIER times as long as the scan took; the
+ * first reader to take the semaphore after that turns it on again. This
+ * bounds the slowdown of write-heavy users to a small fraction.
+ *
+ * Based on "BRAVO -- Biased Locking for Reader-Writer Locks", Dice and Kogan,
+ * USENIX ATC 2019.
+ */
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/cache.h>
+#include <linux/export.h>
+
+#include "rwsem.h"
+
+#define RWSEM_RBIAS_BITS	12
+#define RWSEM_RBIAS_SLOTS	(1 << RWSEM_RBIAS_BITS)
+#define RWSEM_RBIAS_MULTIPLIER	9
+
+/* spin that many times on a busy slot before sleeping */
+#define RWSEM_RBIAS_SPINS	1024
+
+struct rwsem_rbias_slot {
+	struct rw_semaphore	*sem;
+	struct task_struct	*task;
+};
+
+static struct rwsem_rbias_slot rwsem_rbias_table[RWSEM_RBIAS_SLOTS]
+	____cacheline_aligned_in_smp;
+
+static inline struct rwsem_rbias_slot *rwsem_rbias_slot(struct rw_semaphore *sem)
+{
+	unsigned long key = (unsigned long)sem ^ (unsigned long)current;
+
+	return &rwsem_rbias_table[hash_long(key, RWSEM_RBIAS_BITS)];
+}
+
+/*
+ * Try to take @sem for reading without touching sem->count; fails if the
+ * slot is taken, e.g. by another semaphore or a nested read of this one, or
+ * if a writer revoked the bias meanwhile.
+ */
+bool __rwsem_rbias_read_trylock(struct rw_semaphore *sem)
+{
+	struct rwsem_rbias_slot *slot = rwsem_rbias_slot(sem);
+
+	if (READ_ONCE(slot->sem))
+		return false;
+
+	/*
+	 * The full barrier of the cmpxchg orders publishing the slot before
+	 * the bias re-check, pairs with the smp_mb() in rwsem_rbias_revoke().
+	 */
+	if (cmpxchg(&slot->sem, NULL, sem) != NULL)
+		return false;
+
+	if (likely(READ_ONCE(sem->rbias) == RWSEM_RBIAS_ON)) {
+		WRITE_ONCE(slot->task, current);
+		return true;
+	}
+
+	/* raced with a writer */
+	smp_store_release(&slot->sem, NULL);
+	return false;
+}
+
+/*
+ * Release @sem if it was read-locked through the table by current; the
+ * task is checked since another task might own the same slot.
+ */
+bool __rwsem_rbias_read_unlock(struct rw_semaphore *sem)
+{
+	struct rwsem_rbias_slot *slot = rwsem_rbias_slot(sem);
+
+	if (READ_ONCE(slot->sem) != sem || READ_ONCE(slot->task) != current)
+		return false;
+
+	WRITE_ONCE(slot->task, NULL);
+	/* the critical section must be complete before the writer sees it */
+	smp_store_release(&slot->sem, NULL);
+	return true;
+}
+
+/*
+ * Called with @sem read-locked the usual way: turn the bias back on once
+ * the inhibit period of the last revocation is over.
+ */
+void __rwsem_rbias_reenable(struct rw_semaphore *sem)
+{
+	if (local_clock() >= READ_ONCE(sem->rbias_inhibit))
+		WRITE_ONCE(sem->rbias, RWSEM_RBIAS_ON);
+}
+
+static bool rwsem_rbias_wait_slot(struct rwsem_rbias_slot *slot,
+				  struct rw_semaphore *sem, bool wait)
+{
+	int spins = RWSEM_RBIAS_SPINS;
+
+	while (READ_ONCE(slot->sem) == sem) {
+		if (!wait)
+			return false;
+		/* biased readers may sleep, don't burn the cpu for them */
+		if (--spins > 0) {
+			cpu_relax();
+			continue;
+		}
+		schedule_timeout_uninterruptible(1);
+		spins = RWSEM_RBIAS_SPINS;
+	}
+
+	return true;
+}
+
+/*
+ * Called with @sem write-locked: revoke the bias and wait for the biased
+ * readers to go away. Without @wait, give up and restore the bias if any
+ * is still around, as down_write_trylock() must not sleep.
+ */
+static bool rwsem_rbias_revoke(struct rw_semaphore *sem, bool wait)
+{
+	u64 start, now;
+	int i;
+
+	start = local_clock();
+
+	WRITE_ONCE(sem->rbias, RWSEM_RBIAS_OFF);
+	smp_mb();
+
+	for (i = 0; i < RWSEM_RBIAS_SLOTS; i++) {
+		if (!rwsem_rbias_wait_slot(&rwsem_rbias_table[i], sem, wait)) {
+			WRITE_ONCE(sem->rbias, RWSEM_RBIAS_ON);
+			return false;
+		}
+	}
+
+	/*
+	 * Order the slot loads before the critical section, pairs with the
+	 * release in __rwsem_rbias_read_unlock().
+	 */
+	smp_mb();
+
+	now = local_clock();
+	WRITE_ONCE(sem->rbias_inhibit,
+		   now + (now - start) * RWSEM_RBIAS_MULTIPLIER);
+
+	return true;
+}
+
+void __rwsem_rbias_write_locked(struct rw_semaphore *sem)
+{
+	might_sleep();
+	rwsem_rbias_revoke(sem, true);
+}
+
+bool __rwsem_rbias_write_trylocked(struct rw_semaphore *sem)
+{
+	return rwsem_rbias_revoke(sem, false);
+}
+
+int rwsem_rbias_is_locked(struct rw_semaphore *sem)
+{
+	int i;
+
+	for (i = 0; i < RWSEM_RBIAS_SLOTS; i++) {
+		if (READ_ONCE(rwsem_rbias_table[i].sem) == sem)
+			return 1;
+	}
+
+	return READ_ONCE(sem->count) != 0;
+}
+EXPORT_SYMBOL(rwsem_rbias_is_locked);
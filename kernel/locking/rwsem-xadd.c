@@ -17,6 +17,7 @@
 #include <linux/osq_lock.h>
 
 #include "rwsem.h"
+#include "lock_contention.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -87,6 +88,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->owner = NULL;
 	osq_lock_init(&sem->osq);
 #endif
+#ifdef CONFIG_RWSEM_READER_BIAS
+	sem->rbias = RWSEM_RBIAS_NONE;
+	sem->rbias_inhibit = 0;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -216,6 +221,10 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
+	void *lock = sem;
+	u64 wait_start;
+
+	wait_start = lock_contention_begin(lock, LCB_F_READ, _RET_IP_);
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
@@ -251,6 +260,7 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	}
 
 	__set_task_state(tsk, TASK_RUNNING);
+	lock_contention_end(lock, 0, _RET_IP_, wait_start);
 	return sem;
 }
 EXPORT_SYMBOL(rwsem_down_read_failed);
@@ -433,20 +443,26 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 /*
  * Wait until we successfully acquire the write lock
  */
-static inline struct rw_semaphore *
-__rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
+static __always_inline struct rw_semaphore *
+__rwsem_down_write_failed_common(struct rw_semaphore *sem, int state,
+				 unsigned long ip)
 {
 	long count;
 	bool waiting = true; /* any queued threads before us */
 	struct rwsem_waiter waiter;
 	struct rw_semaphore *ret = sem;
+	u64 wait_start;
+
+	wait_start = lock_contention_begin(ret, LCB_F_WRITE | LCB_F_SPIN, ip);
 
 	/* undo write bias from down_write operation, stop active locking */
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem)) {
+		lock_contention_end(ret, 0, ip, wait_start);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -499,6 +515,7 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	lock_contention_end(ret, 0, ip, wait_start);
 
 	return ret;
 
@@ -511,6 +528,7 @@ out_nolock:
 	else
 		__rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	lock_contention_end(ret, -EINTR, ip, wait_start);
 
 	return ERR_PTR(-EINTR);
 }
@@ -518,14 +536,15 @@ out_nolock:
 __visible struct rw_semaphore * __sched
 rwsem_down_write_failed(struct rw_semaphore *sem)
 {
-	return __rwsem_down_write_failed_common(sem, TASK_UNINTERRUPTIBLE);
+	return __rwsem_down_write_failed_common(sem, TASK_UNINTERRUPTIBLE,
+						_RET_IP_);
 }
 EXPORT_SYMBOL(rwsem_down_write_failed);
 
 __visible struct rw_semaphore * __sched
 rwsem_down_write_failed_killable(struct rw_semaphore *sem)
 {
-	return __rwsem_down_write_failed_common(sem, TASK_KILLABLE);
+	return __rwsem_down_write_failed_common(sem, TASK_KILLABLE, _RET_IP_);
 }
 EXPORT_SYMBOL(rwsem_down_write_failed_killable);
 
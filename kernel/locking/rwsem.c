@@ -21,7 +21,11 @@ void __sched down_read(struct rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, 0, 0, _RET_IP_);
 
+	if (rwsem_rbias_read_trylock(sem))
+		return;
+
 	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	rwsem_rbias_read_locked(sem);
 }
 
 EXPORT_SYMBOL(down_read);
@@ -31,7 +35,13 @@ EXPORT_SYMBOL(down_read);
  */
 int down_read_trylock(struct rw_semaphore *sem)
 {
-	int ret = __down_read_trylock(sem);
+	int ret = 1;
+
+	if (!rwsem_rbias_read_trylock(sem)) {
+		ret = __down_read_trylock(sem);
+		if (ret == 1)
+			rwsem_rbias_read_locked(sem);
+	}
 
 	if (ret == 1)
 		rwsem_acquire_read(&sem->dep_map, 0, 1, _RET_IP_);
@@ -49,6 +59,7 @@ void __sched down_write(struct rw_semaphore *sem)
 	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
 
 	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
+	rwsem_rbias_write_locked(sem);
 	rwsem_set_owner(sem);
 }
 
@@ -67,6 +78,7 @@ int __sched down_write_killable(struct rw_semaphore *sem)
 		return -EINTR;
 	}
 
+	rwsem_rbias_write_locked(sem);
 	rwsem_set_owner(sem);
 	return 0;
 }
@@ -80,6 +92,12 @@ int down_write_trylock(struct rw_semaphore *sem)
 {
 	int ret = __down_write_trylock(sem);
 
+	/* can't wait for biased readers here */
+	if (ret == 1 && !rwsem_rbias_write_trylocked(sem)) {
+		__up_write(sem);
+		ret = 0;
+	}
+
 	if (ret == 1) {
 		rwsem_acquire(&sem->dep_map, 0, 1, _RET_IP_);
 		rwsem_set_owner(sem);
@@ -97,7 +115,8 @@ void up_read(struct rw_semaphore *sem)
 {
 	rwsem_release(&sem->dep_map, 1, _RET_IP_);
 
-	__up_read(sem);
+	if (!rwsem_rbias_read_unlock(sem))
+		__up_read(sem);
 }
 
 EXPORT_SYMBOL(up_read);
@@ -137,7 +156,11 @@ void down_read_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, subclass, 0, _RET_IP_);
 
+	if (rwsem_rbias_read_trylock(sem))
+		return;
+
 	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	rwsem_rbias_read_locked(sem);
 }
 
 EXPORT_SYMBOL(down_read_nested);
@@ -148,26 +171,19 @@ void _down_write_nest_lock(struct rw_semaphore *sem, struct lockdep_map *nest)
 	rwsem_acquire_nest(&sem->dep_map, 0, 0, nest, _RET_IP_);
 
 	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
+	rwsem_rbias_write_locked(sem);
 	rwsem_set_owner(sem);
 }
 
 EXPORT_SYMBOL(_down_write_nest_lock);
 
-void down_read_non_owner(struct rw_semaphore *sem)
-{
-	might_sleep();
-
-	__down_read(sem);
-}
-
-EXPORT_SYMBOL(down_read_non_owner);
-
 void down_write_nested(struct rw_semaphore *sem, int subclass)
 {
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, subclass, 0, _RET_IP_);
 
 	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
+	rwsem_rbias_write_locked(sem);
 	rwsem_set_owner(sem);
 }
 
@@ -183,12 +199,26 @@ int __sched down_write_killable_nested(struct rw_semaphore *sem, int subclass)
 		return -EINTR;
 	}
 
+	rwsem_rbias_write_locked(sem);
 	rwsem_set_owner(sem);
 	return 0;
 }
 
 EXPORT_SYMBOL(down_write_killable_nested);
 
+#endif
+
+#if defined(CONFIG_DEBUG_LOCK_ALLOC) || defined(CONFIG_RWSEM_READER_BIAS)
+
+void down_read_non_owner(struct rw_semaphore *sem)
+{
+	might_sleep();
+
+	__down_read(sem);
+}
+
+EXPORT_SYMBOL(down_read_non_owner);
+
 void up_read_non_owner(struct rw_semaphore *sem)
 {
 	__up_read(sem);
@@ -18,3 +18,68 @@ static inline void rwsem_clear_owner(struct rw_semaphore *sem)
 {
 }
 #endif
+
+#ifdef CONFIG_RWSEM_READER_BIAS
+extern bool __rwsem_rbias_read_trylock(struct rw_semaphore *sem);
+extern bool __rwsem_rbias_read_unlock(struct rw_semaphore *sem);
+extern void __rwsem_rbias_reenable(struct rw_semaphore *sem);
+extern void __rwsem_rbias_write_locked(struct rw_semaphore *sem);
+extern bool __rwsem_rbias_write_trylocked(struct rw_semaphore *sem);
+
+static inline bool rwsem_rbias_read_trylock(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->rbias) == RWSEM_RBIAS_ON &&
+	       __rwsem_rbias_read_trylock(sem);
+}
+
+/* the bias may have been revoked while we held it, only check opt-in */
+static inline bool rwsem_rbias_read_unlock(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->rbias) != RWSEM_RBIAS_NONE &&
+	       __rwsem_rbias_read_unlock(sem);
+}
+
+/* called with the read lock held through sem->count */
+static inline void rwsem_rbias_read_locked(struct rw_semaphore *sem)
+{
+	if (READ_ONCE(sem->rbias) == RWSEM_RBIAS_OFF)
+		__rwsem_rbias_reenable(sem);
+}
+
+static inline void rwsem_rbias_write_locked(struct rw_semaphore *sem)
+{
+	if (READ_ONCE(sem->rbias) == RWSEM_RBIAS_ON)
+		__rwsem_rbias_write_locked(sem);
+}
+
+static inline bool rwsem_rbias_write_trylocked(struct rw_semaphore *sem)
+{
+	if (READ_ONCE(sem->rbias) == RWSEM_RBIAS_ON)
+		return __rwsem_rbias_write_trylocked(sem);
+	return true;
+}
+
+#else
+static inline bool rwsem_rbias_read_trylock(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline bool rwsem_rbias_read_unlock(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline void rwsem_rbias_read_locked(struct rw_semaphore *sem)
+{
+}
+
+static inline void rwsem_rbias_write_locked(struct rw_semaphore *sem)
+{
+}
+
+static inline bool rwsem_rbias_write_trylocked(struct rw_semaphore *sem)
+{
+	return true;
+}
+#endif
@@ -60,6 +60,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
 #include <uapi/linux/module.h>
 #include "module-internal.h"
 
@@ -421,64 +423,82 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
-/* Returns true as soon as fn returns true, otherwise false. */
-bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
-				    struct module *owner,
-				    void *data),
-			 void *data)
+static const struct symsearch kernel_symsearch[] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
+#define MODULE_SYMSEARCH_MAX	ARRAY_SIZE(kernel_symsearch)
+
+/* Fill @arr with the symbol tables of @mod, returns their number. */
+static unsigned int module_symsearch(struct module *mod,
+				     struct symsearch *arr)
 {
-	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	struct symsearch mod_arr[] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
 		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
 		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
+		{ mod->gpl_future_syms,
+		  mod->gpl_future_syms + mod->num_gpl_future_syms,
+		  mod->gpl_future_crcs,
 		  WILL_BE_GPL_ONLY, false },
 #ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
+		{ mod->unused_syms,
+		  mod->unused_syms + mod->num_unused_syms,
+		  mod->unused_crcs,
 		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
+		{ mod->unused_gpl_syms,
+		  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
+		  mod->unused_gpl_crcs,
 		  GPL_ONLY, true },
 #endif
 	};
 
+	BUILD_BUG_ON(ARRAY_SIZE(mod_arr) != MODULE_SYMSEARCH_MAX);
+	memcpy(arr, mod_arr, sizeof(mod_arr));
+	return ARRAY_SIZE(mod_arr);
+}
+
+/* Returns true as soon as fn returns true, otherwise false. */
+bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
+				    struct module *owner,
+				    void *data),
+			 void *data)
+{
+	struct module *mod;
+
 	module_assert_mutex_or_preempt();
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(kernel_symsearch,
+				   ARRAY_SIZE(kernel_symsearch), NULL, fn,
+				   data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY, false },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY, false },
-			{ mod->gpl_future_syms,
-			  mod->gpl_future_syms + mod->num_gpl_future_syms,
-			  mod->gpl_future_crcs,
-			  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-			{ mod->unused_syms,
-			  mod->unused_syms + mod->num_unused_syms,
-			  mod->unused_crcs,
-			  NOT_GPL_ONLY, true },
-			{ mod->unused_gpl_syms,
-			  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
-			  mod->unused_gpl_crcs,
-			  GPL_ONLY, true },
-#endif
-		};
+		struct symsearch arr[MODULE_SYMSEARCH_MAX];
+		unsigned int n;
 
 		if (mod->state == MODULE_STATE_UNFORMED)
 			continue;
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
+		n = module_symsearch(mod, arr);
+		if (each_symbol_in_section(arr, n, mod, fn, data))
 			return true;
 	}
 	return false;
@@ -555,6 +575,161 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * Index of the symbols exported by the kernel and by the live modules,
+ * hashed by name, so that resolving the undefined symbols of a module
+ * doesn't search the symbol tables of every loaded module in turn.
+ * Entries are added and removed under module_mutex, and looked up like
+ * the module list: with module_mutex held or preemption disabled.
+ */
+struct ksym_entry {
+	struct hlist_node node;
+	const struct kernel_symbol *sym;
+	const unsigned long *crc;
+	struct module *owner;
+	unsigned char licence;
+	bool unused;
+};
+
+#define KSYM_HASH_BITS	14
+static DEFINE_HASHTABLE(ksym_hash, KSYM_HASH_BITS);
+static bool ksym_index_ready;
+
+static unsigned int ksym_hash_name(const char *name)
+{
+	return full_name_hash(name, strlen(name));
+}
+
+static unsigned long ksym_count(const struct symsearch *arr,
+				unsigned int arrsize)
+{
+	unsigned long count = 0;
+	unsigned int j;
+
+	for (j = 0; j < arrsize; j++)
+		count += arr[j].stop - arr[j].start;
+
+	return count;
+}
+
+static void ksym_index_fill(struct ksym_entry *e,
+			    const struct symsearch *arr,
+			    unsigned int arrsize, struct module *owner)
+{
+	unsigned int i, j;
+
+	lockdep_assert_held(&module_mutex);
+
+	for (j = 0; j < arrsize; j++) {
+		for (i = 0; i < arr[j].stop - arr[j].start; i++, e++) {
+			e->sym = &arr[j].start[i];
+			e->crc = symversion(arr[j].crcs, i);
+			e->owner = owner;
+			e->licence = arr[j].licence;
+			e->unused = arr[j].unused;
+			hash_add_rcu(ksym_hash, &e->node,
+				     ksym_hash_name(e->sym->name));
+		}
+	}
+}
+
+/* Called under module_mutex, once the exports were checked for clashes */
+static int ksym_index_add(struct module *mod)
+{
+	struct symsearch arr[MODULE_SYMSEARCH_MAX];
+	unsigned int n = module_symsearch(mod, arr);
+	unsigned long count = ksym_count(arr, n);
+
+	if (!count)
+		return 0;
+
+	mod->ksym_index = kcalloc(count, sizeof(struct ksym_entry),
+				  GFP_KERNEL);
+	if (!mod->ksym_index)
+		return -ENOMEM;
+
+	ksym_index_fill(mod->ksym_index, arr, n, mod);
+	return 0;
+}
+
+/* The entries may only be freed after synchronize_sched() */
+static void ksym_index_remove(struct module *mod)
+{
+	struct symsearch arr[MODULE_SYMSEARCH_MAX];
+	unsigned long i, count;
+
+	if (!mod->ksym_index)
+		return;
+
+	count = ksym_count(arr, module_symsearch(mod, arr));
+	for (i = 0; i < count; i++)
+		hash_del_rcu(&mod->ksym_index[i].node);
+}
+
+static void ksym_index_free(struct module *mod)
+{
+	kfree(mod->ksym_index);
+	mod->ksym_index = NULL;
+}
+
+static bool ksym_index_lookup(struct find_symbol_arg *fsa)
+{
+	struct ksym_entry *e;
+
+	hash_for_each_possible_rcu(ksym_hash, e, node,
+				   ksym_hash_name(fsa->name)) {
+		struct symsearch syms;
+
+		if (strcmp(e->sym->name, fsa->name))
+			continue;
+		if (e->owner && e->owner->state == MODULE_STATE_UNFORMED)
+			continue;
+
+		/* names are unique, see verify_export_symbols() */
+		syms.start = e->sym;
+		syms.stop = e->sym + 1;
+		syms.crcs = e->crc;
+		syms.licence = e->licence;
+		syms.unused = e->unused;
+		return check_symbol(&syms, e->owner, 0, fsa);
+	}
+
+	return false;
+}
+
+static int __init ksym_index_init(void)
+{
+	struct ksym_entry *entries;
+	struct module *mod;
+	unsigned long count;
+	int err = 0;
+
+	count = ksym_count(kernel_symsearch, ARRAY_SIZE(kernel_symsearch));
+	entries = vmalloc(count * sizeof(struct ksym_entry));
+	if (!entries)
+		return -ENOMEM;
+
+	mutex_lock(&module_mutex);
+	ksym_index_fill(entries, kernel_symsearch,
+			ARRAY_SIZE(kernel_symsearch), NULL);
+
+	list_for_each_entry(mod, &modules, list) {
+		if (mod->state == MODULE_STATE_UNFORMED || mod->ksym_index)
+			continue;
+		err = ksym_index_add(mod);
+		if (err)
+			break;
+	}
+
+	/* otherwise keep searching the symbol tables */
+	if (!err)
+		smp_store_release(&ksym_index_ready, true);
+	mutex_unlock(&module_mutex);
+
+	return 0;
+}
+core_initcall(ksym_index_init);
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -564,12 +739,18 @@ const struct kernel_symbol *find_symbol(const char *name,
 					bool warn)
 {
 	struct find_symbol_arg fsa;
+	bool found;
 
 	fsa.name = name;
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	if (smp_load_acquire(&ksym_index_ready))
+		found = ksym_index_lookup(&fsa);
+	else
+		found = each_symbol_section(find_symbol_in_section, &fsa);
+
+	if (found) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -2096,10 +2277,12 @@ static void free_module(struct module *mod)
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	ksym_index_remove(mod);
 	/* Remove this module from bug list, this uses list_del_rcu */
 	module_bug_cleanup(mod);
 	/* Wait for RCU-sched synchronizing before releasing mod->list and buglist. */
 	synchronize_sched();
+	ksym_index_free(mod);
 	mutex_unlock(&module_mutex);
 
 	/* This may be empty, but that's OK */
@@ -3438,6 +3621,10 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err < 0)
 		goto out;
 
+	err = ksym_index_add(mod);
+	if (err < 0)
+		goto out;
+
 	/* This relies on module_mutex for list integrity. */
 	module_bug_finalize(info->hdr, info->sechdrs, mod);
 
@@ -3651,9 +3838,11 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	ksym_index_remove(mod);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_sched();
+	ksym_index_free(mod);
 	mutex_unlock(&module_mutex);
  free_module:
 	/*
@@ -31,6 +31,7 @@
 #include <linux/slab.h>
 #include <linux/init.h>
 #include <linux/rculist.h>
+#include <linux/rculist_bl.h>
 #include <linux/bootmem.h>
 #include <linux/hash.h>
 #include <linux/pid_namespace.h>
@@ -41,7 +42,7 @@
 
 #define pid_hashfn(nr, ns)	\
 	hash_long((unsigned long)nr + (unsigned long)ns, pidhash_shift)
-static struct hlist_head *pid_hash;
+static struct hlist_bl_head *pid_hash;
 static unsigned int pidhash_shift = 4;
 struct pid init_struct_pid = INIT_STRUCT_PID;
 
@@ -75,7 +76,7 @@ struct pid_namespace init_pid_ns = {
 		[ 0 ... PIDMAP_ENTRIES-1] = { ATOMIC_INIT(BITS_PER_PAGE), NULL }
 	},
 	.last_pid = 0,
-	.nr_hashed = PIDNS_HASH_ADDING,
+	.nr_hashed = ATOMIC_INIT(PIDNS_HASH_ADDING),
 	.level = 0,
 	.child_reaper = &init_task,
 	.user_ns = &init_user_ns,
@@ -98,10 +99,58 @@ EXPORT_SYMBOL_GPL(init_pid_ns);
  * After we clean up the tasklist_lock and know there are no
  * irq handlers that take it we can leave the interrupts enabled.
  * For now it is easier to be safe than to prove it can't happen.
+ * The same holds for the pid hash bucket locks below.
+ *
+ * pidmap_lock only serializes installing new pidmap pages.  The pid
+ * hash is protected by a bit lock in each bucket and ->nr_hashed is
+ * an atomic counter, so that forks and exits on different CPUs do
+ * not all queue up on one lock.
  */
 
 static  __cacheline_aligned_in_smp DEFINE_SPINLOCK(pidmap_lock);
 
+static void pid_hash_add(struct upid *upid)
+{
+	struct hlist_bl_head *b = &pid_hash[pid_hashfn(upid->nr, upid->ns)];
+	unsigned long flags;
+
+	local_irq_save(flags);
+	hlist_bl_lock(b);
+	hlist_bl_add_head_rcu(&upid->pid_chain, b);
+	hlist_bl_unlock(b);
+	local_irq_restore(flags);
+}
+
+static void pid_hash_del(struct upid *upid)
+{
+	struct hlist_bl_head *b = &pid_hash[pid_hashfn(upid->nr, upid->ns)];
+	unsigned long flags;
+
+	local_irq_save(flags);
+	hlist_bl_lock(b);
+	hlist_bl_del_rcu(&upid->pid_chain);
+	hlist_bl_unlock(b);
+	local_irq_restore(flags);
+}
+
+/*
+ * Account a new pid in @ns, unless disable_pid_allocation() has already
+ * been called on it.
+ */
+static bool pid_ns_hash_get(struct pid_namespace *ns)
+{
+	unsigned int old, cur = atomic_read(&ns->nr_hashed);
+
+	do {
+		old = cur;
+		if (!(old & PIDNS_HASH_ADDING))
+			return false;
+		cur = atomic_cmpxchg(&ns->nr_hashed, old, old + 1);
+	} while (cur != old);
+
+	return true;
+}
+
 static void free_pidmap(struct upid *upid)
 {
 	int nr = upid->nr;
@@ -260,14 +309,12 @@ void free_pid(struct pid *pid)
 {
 	/* We can be called with write_lock_irq(&tasklist_lock) held */
 	int i;
-	unsigned long flags;
 
-	spin_lock_irqsave(&pidmap_lock, flags);
 	for (i = 0; i <= pid->level; i++) {
 		struct upid *upid = pid->numbers + i;
 		struct pid_namespace *ns = upid->ns;
-		hlist_del_rcu(&upid->pid_chain);
-		switch(--ns->nr_hashed) {
+		pid_hash_del(upid);
+		switch ((unsigned int)atomic_dec_return(&ns->nr_hashed)) {
 		case 2:
 		case 1:
 			/* When all that is left in the pid namespace
@@ -279,14 +326,15 @@ void free_pid(struct pid *pid)
 		case PIDNS_HASH_ADDING:
 			/* Handle a fork failure of the first process */
 			WARN_ON(ns->child_reaper);
-			ns->nr_hashed = 0;
+			if (atomic_cmpxchg(&ns->nr_hashed, PIDNS_HASH_ADDING,
+					   0) != PIDNS_HASH_ADDING)
+				break;
 			/* fall through */
 		case 0:
 			schedule_work(&ns->proc_work);
 			break;
 		}
 	}
-	spin_unlock_irqrestore(&pidmap_lock, flags);
 
 	for (i = 0; i <= pid->level; i++)
 		free_pidmap(pid->numbers + i);
@@ -332,20 +380,17 @@ struct pid *alloc_pid(struct pid_namespace *ns)
 		INIT_HLIST_HEAD(&pid->tasks[type]);
 
 	upid = pid->numbers + ns->level;
-	spin_lock_irq(&pidmap_lock);
-	if (!(ns->nr_hashed & PIDNS_HASH_ADDING))
-		goto out_unlock;
-	for ( ; upid >= pid->numbers; --upid) {
-		hlist_add_head_rcu(&upid->pid_chain,
-				&pid_hash[pid_hashfn(upid->nr, upid->ns)]);
-		upid->ns->nr_hashed++;
+	if (!pid_ns_hash_get(ns))
+		goto out_put;
+	pid_hash_add(upid);
+	while (--upid >= pid->numbers) {
+		atomic_inc(&upid->ns->nr_hashed);
+		pid_hash_add(upid);
 	}
-	spin_unlock_irq(&pidmap_lock);
 
 	return pid;
 
-out_unlock:
-	spin_unlock_irq(&pidmap_lock);
+out_put:
 	put_pid_ns(ns);
 
 out_free:
@@ -358,16 +403,15 @@ out_free:
 
 void disable_pid_allocation(struct pid_namespace *ns)
 {
-	spin_lock_irq(&pidmap_lock);
-	ns->nr_hashed &= ~PIDNS_HASH_ADDING;
-	spin_unlock_irq(&pidmap_lock);
+	atomic_andnot(PIDNS_HASH_ADDING, &ns->nr_hashed);
 }
 
 struct pid *find_pid_ns(int nr, struct pid_namespace *ns)
 {
+	struct hlist_bl_node *node;
 	struct upid *pnr;
 
-	hlist_for_each_entry_rcu(pnr,
+	hlist_bl_for_each_entry_rcu(pnr, node,
 			&pid_hash[pid_hashfn(nr, ns)], pid_chain)
 		if (pnr->nr == nr && pnr->ns == ns)
 			return container_of(pnr, struct pid,
@@ -583,7 +627,7 @@ void __init pidhash_init(void)
 	pidhash_size = 1U << pidhash_shift;
 
 	for (i = 0; i < pidhash_size; i++)
-		INIT_HLIST_HEAD(&pid_hash[i]);
+		INIT_HLIST_BL_HEAD(&pid_hash[i]);
 }
 
 void __init pidmap_init(void)
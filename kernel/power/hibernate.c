@@ -35,6 +35,8 @@
 
 
 static int nocompress;
+static int compress_lz4;
+static int compress_zstd;
 static int noresume;
 static int nohibernate;
 static int resume_wait;
@@ -693,6 +695,10 @@ int hibernate(void)
 			flags |= SF_NOCOMPRESS_MODE;
 		else
 		        flags |= SF_CRC32_MODE;
+		if (compress_zstd && !nocompress)
+			flags |= SF_ZSTD_MODE;
+		else if (compress_lz4 && !nocompress)
+			flags |= SF_LZ4_MODE;
 
 		pr_debug("PM: writing image.\n");
 		error = swsusp_write(flags);
@@ -1119,6 +1125,10 @@ static int __init hibernate_setup(char *str)
 		noresume = 1;
 	else if (!strncmp(str, "nocompress", 10))
 		nocompress = 1;
+	else if (!strncmp(str, "lz4", 3))
+		compress_lz4 = 1;
+	else if (!strncmp(str, "zstd", 4))
+		compress_zstd = 1;
 	else if (!strncmp(str, "no", 2)) {
 		noresume = 1;
 		nohibernate = 1;
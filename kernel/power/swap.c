@@ -25,6 +25,8 @@
 #include <linux/pm.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
+#include <linux/zstd.h>
 #include <linux/vmalloc.h>
 #include <linux/cpumask.h>
 #include <linux/atomic.h>
@@ -504,18 +506,82 @@ static int swap_writer_finish(struct swap_map_handle *handle,
 #define LZO_UNC_PAGES	32
 #define LZO_UNC_SIZE	(LZO_UNC_PAGES * PAGE_SIZE)
 
-/* Number of pages/bytes we need for compressed data (worst case). */
+/*
+ * Number of pages/bytes we need for compressed data (worst case).  LZ4 and
+ * zstd never expand data more than LZO does, so this covers all three.
+ */
 #define LZO_CMP_PAGES	DIV_ROUND_UP(lzo1x_worst_compress(LZO_UNC_SIZE) + \
 			             LZO_HEADER, PAGE_SIZE)
 #define LZO_CMP_SIZE	(LZO_CMP_PAGES * PAGE_SIZE)
 
+/* Compression workspace, large enough for LZO or LZ4. */
+#define LZO_WRK_SIZE	(LZO1X_1_MEM_COMPRESS > LZ4_MEM_COMPRESS ? \
+			 LZO1X_1_MEM_COMPRESS : LZ4_MEM_COMPRESS)
+
 /* Maximum number of threads for compression/decompression. */
-#define LZO_THREADS	3
+#define LZO_THREADS	64
 
 /* Minimum/maximum number of pages for read buffering. */
 #define LZO_MIN_RD_PAGES	1024
 #define LZO_MAX_RD_PAGES	8192
 
+/*
+ * Use one compression/decompression thread for every CPU but the one doing
+ * the I/O, as long as their buffers (@size bytes each) take no more than a
+ * sixteenth of the free low memory.
+ */
+static unsigned hib_nr_threads(size_t size)
+{
+	unsigned long limit = low_free_pages() / 16 /
+			    DIV_ROUND_UP(size, PAGE_SIZE);
+	unsigned long nr_threads = num_online_cpus() - 1;
+
+	nr_threads = min(nr_threads, limit);
+	return clamp_val(nr_threads, 1, LZO_THREADS);
+}
+
+/* Compressors the image can be saved with. */
+enum hib_comp {
+	HIB_COMP_LZO,
+	HIB_COMP_LZ4,
+	HIB_COMP_ZSTD,
+};
+
+static const char * const hib_comp_names[] = {
+	[HIB_COMP_LZO]	= "LZO",
+	[HIB_COMP_LZ4]	= "LZ4",
+	[HIB_COMP_ZSTD]	= "zstd",
+};
+
+static enum hib_comp hib_comp_from_flags(unsigned int flags)
+{
+	if (flags & SF_ZSTD_MODE)
+		return HIB_COMP_ZSTD;
+	if (flags & SF_LZ4_MODE)
+		return HIB_COMP_LZ4;
+	return HIB_COMP_LZO;
+}
+
+static size_t hib_worst_compress(enum hib_comp comp, size_t len)
+{
+	switch (comp) {
+	case HIB_COMP_LZ4:
+		return lz4_compressbound(len);
+	case HIB_COMP_ZSTD:
+		return zstd_compress_bound(len);
+	default:
+		return lzo1x_worst_compress(len);
+	}
+}
+
+/*
+ * zstd keeps its contexts in a separate per-thread workspace, sized for
+ * compressing LZO_UNC_SIZE bytes at a time.
+ */
+static struct zstd_params hib_zstd_params(void)
+{
+	return zstd_get_params(ZSTD_DEFAULT_CLEVEL, LZO_UNC_SIZE);
+}
 
 /**
  *	save_image - save the suspend image data
@@ -565,68 +631,32 @@ static int save_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for CRC32.
- */
-struct crc_data {
-	struct task_struct *thr;                  /* thread */
-	atomic_t ready;                           /* ready to start flag */
-	atomic_t stop;                            /* ready to stop flag */
-	unsigned run_threads;                     /* nr current threads */
-	wait_queue_head_t go;                     /* start crc update */
-	wait_queue_head_t done;                   /* crc update done */
-	u32 *crc32;                               /* points to handle's crc32 */
-	size_t *unc_len[LZO_THREADS];             /* uncompressed lengths */
-	unsigned char *unc[LZO_THREADS];          /* uncompressed data */
-};
-
-/**
- * CRC32 update function that runs in its own thread.
- */
-static int crc32_threadfn(void *data)
-{
-	struct crc_data *d = data;
-	unsigned i;
-
-	while (1) {
-		wait_event(d->go, atomic_read(&d->ready) ||
-		                  kthread_should_stop());
-		if (kthread_should_stop()) {
-			d->thr = NULL;
-			atomic_set(&d->stop, 1);
-			wake_up(&d->done);
-			break;
-		}
-		atomic_set(&d->ready, 0);
-
-		for (i = 0; i < d->run_threads; i++)
-			*d->crc32 = crc32_le(*d->crc32,
-			                     d->unc[i], *d->unc_len[i]);
-		atomic_set(&d->stop, 1);
-		wake_up(&d->done);
-	}
-	return 0;
-}
-/**
- * Structure used for LZO data compression.
+ * Structure used for LZO/LZ4/zstd data compression.
  */
 struct cmp_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	enum hib_comp comp;                       /* compressor */
+	void *zstd_wrk;                           /* zstd workspace */
+	struct zstd_cctx *cctx;                   /* zstd context */
 	wait_queue_head_t go;                     /* start compression */
 	wait_queue_head_t done;                   /* compression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
+	u32 crc32;                                /* CRC32 of unc, seed 0 */
 	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
 	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
-	unsigned char wrk[LZO1X_1_MEM_COMPRESS];  /* compression workspace */
+	unsigned char wrk[LZO_WRK_SIZE];          /* compression workspace */
 };
 
 /**
- * Compression function that runs in its own thread.
+ * Compression function that runs in its own thread.  The CRC32 of each
+ * chunk is computed here too, and folded into the image CRC32 in order by
+ * the thread doing the I/O, so that it does not become the bottleneck.
  */
-static int lzo_compress_threadfn(void *data)
+static int compress_threadfn(void *data)
 {
 	struct cmp_data *d = data;
 
@@ -642,9 +672,25 @@ static int lzo_compress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->ret = lzo1x_1_compress(d->unc, d->unc_len,
-		                          d->cmp + LZO_HEADER, &d->cmp_len,
-		                          d->wrk);
+		switch (d->comp) {
+		case HIB_COMP_LZ4:
+			d->ret = lz4_compress(d->unc, d->unc_len,
+			                      d->cmp + LZO_HEADER, &d->cmp_len,
+			                      d->wrk);
+			break;
+		case HIB_COMP_ZSTD:
+			d->cmp_len = LZO_CMP_SIZE - LZO_HEADER;
+			d->ret = zstd_compress_cctx(d->cctx,
+			                            d->cmp + LZO_HEADER,
+			                            &d->cmp_len,
+			                            d->unc, d->unc_len);
+			break;
+		default:
+			d->ret = lzo1x_1_compress(d->unc, d->unc_len,
+			                          d->cmp + LZO_HEADER,
+			                          &d->cmp_len, d->wrk);
+		}
+		d->crc32 = crc32_le(0, d->unc, d->unc_len);
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -652,36 +698,37 @@ static int lzo_compress_threadfn(void *data)
 }
 
 /**
- * save_image_lzo - Save the suspend image data compressed with LZO.
+ * save_image_lzo - Save the suspend image data compressed with LZO, LZ4 or
+ * zstd.
  * @handle: Swap map handle to use for saving the image.
  * @snapshot: Image to read data from.
  * @nr_to_write: Number of pages to save.
+ * @comp: Compressor to use.
  */
 static int save_image_lzo(struct swap_map_handle *handle,
                           struct snapshot_handle *snapshot,
-                          unsigned int nr_to_write)
+                          unsigned int nr_to_write, enum hib_comp comp)
 {
 	unsigned int m;
 	int ret = 0;
 	int nr_pages;
 	int err2;
 	struct hib_bio_batch hb;
+	struct blk_plug plug;
 	ktime_t start;
 	ktime_t stop;
 	size_t off;
 	unsigned thr, run_threads, nr_threads;
 	unsigned char *page = NULL;
 	struct cmp_data *data = NULL;
-	struct crc_data *crc = NULL;
+	struct zstd_params params = hib_zstd_params();
+	size_t zstd_size = 0;
 
 	hib_init_batch(&hb);
 
-	/*
-	 * We'll limit the number of threads for compression to limit memory
-	 * footprint.
-	 */
-	nr_threads = num_online_cpus() - 1;
-	nr_threads = clamp_val(nr_threads, 1, LZO_THREADS);
+	if (comp == HIB_COMP_ZSTD)
+		zstd_size = zstd_cctx_workspace_size(&params);
+	nr_threads = hib_nr_threads(sizeof(*data) + zstd_size);
 
 	page = (void *)__get_free_page(__GFP_RECLAIM | __GFP_HIGH);
 	if (!page) {
@@ -696,16 +743,22 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct cmp_data, go));
+		data[thr].comp = comp;
+	}
 
-	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
-	if (!crc) {
-		printk(KERN_ERR "PM: Failed to allocate crc\n");
-		ret = -ENOMEM;
-		goto out_clean;
+	for (thr = 0; zstd_size && thr < nr_threads; thr++) {
+		data[thr].zstd_wrk = vmalloc(zstd_size);
+		if (data[thr].zstd_wrk)
+			data[thr].cctx = zstd_init_cctx(data[thr].zstd_wrk,
+			                                zstd_size, &params);
+		if (!data[thr].cctx) {
+			printk(KERN_ERR "PM: Failed to allocate zstd data\n");
+			ret = -ENOMEM;
+			goto out_clean;
+		}
 	}
-	memset(crc, 0, offsetof(struct crc_data, go));
 
 	/*
 	 * Start the compression threads.
@@ -714,7 +767,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_compress_threadfn,
+		data[thr].thr = kthread_run(compress_threadfn,
 		                            &data[thr],
 		                            "image_compress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -726,26 +779,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		}
 	}
 
-	/*
-	 * Start the CRC32 thread.
-	 */
-	init_waitqueue_head(&crc->go);
-	init_waitqueue_head(&crc->done);
-
 	handle->crc32 = 0;
-	crc->crc32 = &handle->crc32;
-	for (thr = 0; thr < nr_threads; thr++) {
-		crc->unc[thr] = data[thr].unc;
-		crc->unc_len[thr] = &data[thr].unc_len;
-	}
-
-	crc->thr = kthread_run(crc32_threadfn, crc, "image_crc32");
-	if (IS_ERR(crc->thr)) {
-		crc->thr = NULL;
-		printk(KERN_ERR "PM: Cannot start CRC32 thread\n");
-		ret = -ENOMEM;
-		goto out_clean;
-	}
 
 	/*
 	 * Adjust the number of required free pages after all allocations have
@@ -754,14 +788,20 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	handle->reqd_free_pages = reqd_free_pages();
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for compression.\n"
+		"PM: Using %u thread(s) for %s compression.\n"
 		"PM: Compressing and saving image data (%u pages)...\n",
-		nr_threads, nr_to_write);
+		nr_threads, hib_comp_names[comp], nr_to_write);
 	m = nr_to_write / 10;
 	if (!m)
 		m = 1;
 	nr_pages = 0;
 	start = ktime_get();
+	/*
+	 * Plug while queueing the compressed pages of a round, so that the
+	 * block layer gets them as large requests.  The plug is flushed
+	 * whenever we sleep waiting for the compression threads or the I/O.
+	 */
+	blk_start_plug(&plug);
 	for (;;) {
 		for (thr = 0; thr < nr_threads; thr++) {
 			for (off = 0; off < LZO_UNC_SIZE; off += PAGE_SIZE) {
@@ -794,10 +834,6 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		if (!thr)
 			break;
 
-		crc->run_threads = thr;
-		atomic_set(&crc->ready, 1);
-		wake_up(&crc->go);
-
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
@@ -806,19 +842,25 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				printk(KERN_ERR "PM: LZO compression failed\n");
+				printk(KERN_ERR
+				       "PM: Image compression failed\n");
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(data[thr].unc_len))) {
+			             hib_worst_compress(comp,
+			                                data[thr].unc_len))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid compressed length\n");
 				ret = -1;
 				goto out_finish;
 			}
 
+			handle->crc32 = crc32_le_combine(handle->crc32,
+			                                 data[thr].crc32,
+			                                 data[thr].unc_len);
+
 			*(size_t *)data[thr].cmp = data[thr].cmp_len;
 
 			/*
@@ -839,12 +881,10 @@ static int save_image_lzo(struct swap_map_handle *handle,
 					goto out_finish;
 			}
 		}
-
-		wait_event(crc->done, atomic_read(&crc->stop));
-		atomic_set(&crc->stop, 0);
 	}
 
 out_finish:
+	blk_finish_plug(&plug);
 	err2 = hib_wait_io(&hb);
 	stop = ktime_get();
 	if (!ret)
@@ -853,15 +893,12 @@ out_finish:
 		printk(KERN_INFO "PM: Image saving done.\n");
 	swsusp_show_speed(start, stop, nr_to_write, "Wrote");
 out_clean:
-	if (crc) {
-		if (crc->thr)
-			kthread_stop(crc->thr);
-		kfree(crc);
-	}
 	if (data) {
-		for (thr = 0; thr < nr_threads; thr++)
+		for (thr = 0; thr < nr_threads; thr++) {
 			if (data[thr].thr)
 				kthread_stop(data[thr].thr);
+			vfree(data[thr].zstd_wrk);
+		}
 		vfree(data);
 	}
 	if (page) free_page((unsigned long)page);
@@ -931,7 +968,8 @@ int swsusp_write(unsigned int flags)
 	if (!error) {
 		error = (flags & SF_NOCOMPRESS_MODE) ?
 			save_image(&handle, &snapshot, pages - 1) :
-			save_image_lzo(&handle, &snapshot, pages - 1);
+			save_image_lzo(&handle, &snapshot, pages - 1,
+				       hib_comp_from_flags(flags));
 	}
 out_finish:
 	error = swap_writer_finish(&handle, flags, error);
@@ -1099,17 +1137,21 @@ static int load_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for LZO data decompression.
+ * Structure used for LZO/LZ4/zstd data decompression.
  */
 struct dec_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	enum hib_comp comp;                       /* compressor */
+	void *zstd_wrk;                           /* zstd workspace */
+	struct zstd_dctx *dctx;                   /* zstd context */
 	wait_queue_head_t go;                     /* start decompression */
 	wait_queue_head_t done;                   /* decompression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
+	u32 crc32;                                /* CRC32 of unc, seed 0 */
 	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
 	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
 };
@@ -1117,7 +1159,7 @@ struct dec_data {
 /**
  * Deompression function that runs in its own thread.
  */
-static int lzo_decompress_threadfn(void *data)
+static int decompress_threadfn(void *data)
 {
 	struct dec_data *d = data;
 
@@ -1134,8 +1176,25 @@ static int lzo_decompress_threadfn(void *data)
 		atomic_set(&d->ready, 0);
 
 		d->unc_len = LZO_UNC_SIZE;
-		d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER, d->cmp_len,
-		                               d->unc, &d->unc_len);
+		switch (d->comp) {
+		case HIB_COMP_LZ4:
+			d->ret = lz4_decompress_unknownoutputsize(
+					d->cmp + LZO_HEADER, d->cmp_len,
+					d->unc, &d->unc_len);
+			break;
+		case HIB_COMP_ZSTD:
+			d->ret = zstd_decompress_dctx(d->dctx, d->unc,
+			                              &d->unc_len,
+			                              d->cmp + LZO_HEADER,
+			                              d->cmp_len);
+			break;
+		default:
+			d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER,
+			                               d->cmp_len,
+			                               d->unc, &d->unc_len);
+		}
+		if (!d->ret && d->unc_len <= LZO_UNC_SIZE)
+			d->crc32 = crc32_le(0, d->unc, d->unc_len);
 		if (clean_pages_on_decompress)
 			flush_icache_range((unsigned long)d->unc,
 					   (unsigned long)d->unc + d->unc_len);
@@ -1147,7 +1206,8 @@ static int lzo_decompress_threadfn(void *data)
 }
 
 /**
- * load_image_lzo - Load compressed image data and decompress them with LZO.
+ * load_image_lzo - Load compressed image data and decompress them with LZO,
+ * LZ4 or zstd, as recorded in the image header.
  * @handle: Swap map handle to use for loading data.
  * @snapshot: Image to copy uncompressed data into.
  * @nr_to_read: Number of pages to load.
@@ -1160,6 +1220,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	int ret = 0;
 	int eof = 0;
 	struct hib_bio_batch hb;
+	struct blk_plug plug;
 	ktime_t start;
 	ktime_t stop;
 	unsigned nr_pages;
@@ -1170,16 +1231,14 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	unsigned long read_pages = 0;
 	unsigned char **page = NULL;
 	struct dec_data *data = NULL;
-	struct crc_data *crc = NULL;
+	enum hib_comp comp = hib_comp_from_flags(swsusp_header->flags);
+	size_t zstd_size = 0;
 
 	hib_init_batch(&hb);
 
-	/*
-	 * We'll limit the number of threads for decompression to limit memory
-	 * footprint.
-	 */
-	nr_threads = num_online_cpus() - 1;
-	nr_threads = clamp_val(nr_threads, 1, LZO_THREADS);
+	if (comp == HIB_COMP_ZSTD)
+		zstd_size = zstd_dctx_workspace_size();
+	nr_threads = hib_nr_threads(sizeof(*data) + zstd_size);
 
 	page = vmalloc(sizeof(*page) * LZO_MAX_RD_PAGES);
 	if (!page) {
@@ -1194,16 +1253,22 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct dec_data, go));
+		data[thr].comp = comp;
+	}
 
-	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
-	if (!crc) {
-		printk(KERN_ERR "PM: Failed to allocate crc\n");
-		ret = -ENOMEM;
-		goto out_clean;
+	for (thr = 0; zstd_size && thr < nr_threads; thr++) {
+		data[thr].zstd_wrk = vmalloc(zstd_size);
+		if (data[thr].zstd_wrk)
+			data[thr].dctx = zstd_init_dctx(data[thr].zstd_wrk,
+			                                zstd_size);
+		if (!data[thr].dctx) {
+			printk(KERN_ERR "PM: Failed to allocate zstd data\n");
+			ret = -ENOMEM;
+			goto out_clean;
+		}
 	}
-	memset(crc, 0, offsetof(struct crc_data, go));
 
 	clean_pages_on_decompress = true;
 
@@ -1214,7 +1279,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_decompress_threadfn,
+		data[thr].thr = kthread_run(decompress_threadfn,
 		                            &data[thr],
 		                            "image_decompress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -1226,26 +1291,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 	}
 
-	/*
-	 * Start the CRC32 thread.
-	 */
-	init_waitqueue_head(&crc->go);
-	init_waitqueue_head(&crc->done);
-
 	handle->crc32 = 0;
-	crc->crc32 = &handle->crc32;
-	for (thr = 0; thr < nr_threads; thr++) {
-		crc->unc[thr] = data[thr].unc;
-		crc->unc_len[thr] = &data[thr].unc_len;
-	}
-
-	crc->thr = kthread_run(crc32_threadfn, crc, "image_crc32");
-	if (IS_ERR(crc->thr)) {
-		crc->thr = NULL;
-		printk(KERN_ERR "PM: Cannot start CRC32 thread\n");
-		ret = -ENOMEM;
-		goto out_clean;
-	}
 
 	/*
 	 * Set the number of pages for read buffering.
@@ -1279,15 +1325,20 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	want = ring_size = i;
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for decompression.\n"
+		"PM: Using %u thread(s) for %s decompression.\n"
 		"PM: Loading and decompressing image data (%u pages)...\n",
-		nr_threads, nr_to_read);
+		nr_threads, hib_comp_names[comp], nr_to_read);
 	m = nr_to_read / 10;
 	if (!m)
 		m = 1;
 	nr_pages = 0;
 	start = ktime_get();
 
+	/*
+	 * Plug while queueing reads, the plug is flushed whenever we sleep
+	 * waiting for the I/O or the decompression threads.
+	 */
+	blk_start_plug(&plug);
 	ret = snapshot_write_next(snapshot);
 	if (ret <= 0)
 		goto out_finish;
@@ -1330,19 +1381,13 @@ static int load_image_lzo(struct swap_map_handle *handle,
 				eof = 2;
 		}
 
-		if (crc->run_threads) {
-			wait_event(crc->done, atomic_read(&crc->stop));
-			atomic_set(&crc->stop, 0);
-			crc->run_threads = 0;
-		}
-
 		for (thr = 0; have && thr < nr_threads; thr++) {
 			data[thr].cmp_len = *(size_t *)page[pg];
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(LZO_UNC_SIZE))) {
+			             hib_worst_compress(comp, LZO_UNC_SIZE))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid compressed length\n");
 				ret = -1;
 				goto out_finish;
 			}
@@ -1394,7 +1439,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 
 			if (ret < 0) {
 				printk(KERN_ERR
-				       "PM: LZO decompression failed\n");
+				       "PM: Image decompression failed\n");
 				goto out_finish;
 			}
 
@@ -1402,11 +1447,15 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			             data[thr].unc_len > LZO_UNC_SIZE ||
 			             data[thr].unc_len & (PAGE_SIZE - 1))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO uncompressed length\n");
+				       "PM: Invalid uncompressed length\n");
 				ret = -1;
 				goto out_finish;
 			}
 
+			handle->crc32 = crc32_le_combine(handle->crc32,
+			                                 data[thr].crc32,
+			                                 data[thr].unc_len);
+
 			for (off = 0;
 			     off < data[thr].unc_len; off += PAGE_SIZE) {
 				memcpy(data_of(*snapshot),
@@ -1420,25 +1469,14 @@ static int load_image_lzo(struct swap_map_handle *handle,
 				nr_pages++;
 
 				ret = snapshot_write_next(snapshot);
-				if (ret <= 0) {
-					crc->run_threads = thr + 1;
-					atomic_set(&crc->ready, 1);
-					wake_up(&crc->go);
+				if (ret <= 0)
 					goto out_finish;
-				}
 			}
 		}
-
-		crc->run_threads = thr;
-		atomic_set(&crc->ready, 1);
-		wake_up(&crc->go);
 	}
 
 out_finish:
-	if (crc->run_threads) {
-		wait_event(crc->done, atomic_read(&crc->stop));
-		atomic_set(&crc->stop, 0);
-	}
+	blk_finish_plug(&plug);
 	stop = ktime_get();
 	if (!ret) {
 		printk(KERN_INFO "PM: Image loading done.\n");
@@ -1459,15 +1497,12 @@ out_finish:
 out_clean:
 	for (i = 0; i < ring_size; i++)
 		free_page((unsigned long)page[i]);
-	if (crc) {
-		if (crc->thr)
-			kthread_stop(crc->thr);
-		kfree(crc);
-	}
 	if (data) {
-		for (thr = 0; thr < nr_threads; thr++)
+		for (thr = 0; thr < nr_threads; thr++) {
 			if (data[thr].thr)
 				kthread_stop(data[thr].thr);
+			vfree(data[thr].zstd_wrk);
+		}
 		vfree(data);
 	}
 	vfree(page);
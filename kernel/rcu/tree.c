@@ -400,6 +400,18 @@ module_param(blimit, long, 0444);
 module_param(qhimark, long, 0444);
 module_param(qlowmark, long, 0444);
 
+/*
+ * Under a callback flood invoke at least 1/2^rcu_divisor of the pending
+ * callbacks per rcu_do_batch(), so the batch limit grows with the rate
+ * callbacks are queued at, but for no longer than rcu_resched_ns once it
+ * is above the default.
+ */
+static int rcu_divisor = 7;
+module_param(rcu_divisor, int, 0644);
+
+static long rcu_resched_ns = 3 * NSEC_PER_MSEC;
+module_param(rcu_resched_ns, long, 0644);
+
 static ulong jiffies_till_first_fqs = ULONG_MAX;
 static ulong jiffies_till_next_fqs = ULONG_MAX;
 static bool rcu_kick_kthreads;
@@ -2728,6 +2740,8 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 	unsigned long flags;
 	struct rcu_head *next, *list, **tail;
 	long bl, count, count_lazy;
+	u64 tlimit = 0;
+	int div;
 	int i;
 
 	/* If no callbacks are ready, just return. */
@@ -2745,7 +2759,10 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 	 */
 	local_irq_save(flags);
 	WARN_ON_ONCE(cpu_is_offline(smp_processor_id()));
-	bl = rdp->blimit;
+	div = clamp(READ_ONCE(rcu_divisor), 0, (int)sizeof(long) * 8 - 2);
+	bl = max(rdp->blimit, rdp->qlen >> div);
+	if (unlikely(bl > blimit))
+		tlimit = local_clock() + READ_ONCE(rcu_resched_ns);
 	trace_rcu_batch_start(rsp->name, rdp->qlen_lazy, rdp->qlen, bl);
 	list = rdp->nxtlist;
 	rdp->nxtlist = *rdp->nxttail[RCU_DONE_TAIL];
@@ -2770,6 +2787,10 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 		    (need_resched() ||
 		     (!is_idle_task(current) && !rcu_is_callbacks_kthread())))
 			break;
+		/* Invoking a flood of callbacks, but not for too long. */
+		if (unlikely(tlimit) && !(count & 31) &&
+		    bl != LONG_MAX && local_clock() >= tlimit)
+			break;
 	}
 
 	local_irq_save(flags);
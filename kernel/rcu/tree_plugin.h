@@ -2295,27 +2295,16 @@ static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
 void __init rcu_init_nohz(void)
 {
 	int cpu;
-	bool need_rcu_nocb_mask = true;
 	struct rcu_state *rsp;
 
-#ifdef CONFIG_RCU_NOCB_CPU_NONE
-	need_rcu_nocb_mask = false;
-#endif /* #ifndef CONFIG_RCU_NOCB_CPU_NONE */
-
-#if defined(CONFIG_NO_HZ_FULL)
-	if (tick_nohz_full_running && cpumask_weight(tick_nohz_full_mask))
-		need_rcu_nocb_mask = true;
-#endif /* #if defined(CONFIG_NO_HZ_FULL) */
-
-	if (!have_rcu_nocb_mask && need_rcu_nocb_mask) {
+	/* Always allocate the mask, CPUs may be offloaded at runtime. */
+	if (!have_rcu_nocb_mask) {
 		if (!zalloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL)) {
 			pr_info("rcu_nocb_mask allocation failed, callback offloading disabled.\n");
 			return;
 		}
 		have_rcu_nocb_mask = true;
 	}
-	if (!have_rcu_nocb_mask)
-		return;
 
 #ifdef CONFIG_RCU_NOCB_CPU_ZERO
 	pr_info("\tOffload RCU callbacks from CPU 0\n");
@@ -2335,6 +2324,8 @@ void __init rcu_init_nohz(void)
 		cpumask_and(rcu_nocb_mask, cpu_possible_mask,
 			    rcu_nocb_mask);
 	}
+	if (cpumask_empty(rcu_nocb_mask))
+		return;
 	pr_info("\tOffload RCU callbacks from CPUs: %*pbl.\n",
 		cpumask_pr_args(rcu_nocb_mask));
 	if (rcu_nocb_poll)
@@ -2434,13 +2425,22 @@ static void __init rcu_spawn_nocb_kthreads(void)
 static int rcu_nocb_leader_stride = -1;
 module_param(rcu_nocb_leader_stride, int, 0444);
 
+static int rcu_nocb_get_leader_stride(void)
+{
+	if (rcu_nocb_leader_stride == -1)
+		rcu_nocb_leader_stride = int_sqrt(nr_cpu_ids);
+	return rcu_nocb_leader_stride;
+}
+
 /*
- * Initialize leader-follower relationships for all no-CBs CPU.
+ * Initialize leader-follower relationships for all no-CBs CPU.  A group
+ * never spans NUMA nodes, so that the leader and its followers share
+ * the callbacks' cache lines.
  */
 static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 {
 	int cpu;
-	int ls = rcu_nocb_leader_stride;
+	int ls;
 	int nl = 0;  /* Next leader. */
 	struct rcu_data *rdp;
 	struct rcu_data *rdp_leader = NULL;  /* Suppress misguided gcc warn. */
@@ -2448,10 +2448,7 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 
 	if (!have_rcu_nocb_mask)
 		return;
-	if (ls == -1) {
-		ls = int_sqrt(nr_cpu_ids);
-		rcu_nocb_leader_stride = ls;
-	}
+	ls = rcu_nocb_get_leader_stride();
 
 	/*
 	 * Each pass through this loop sets up one rcu_data structure and
@@ -2459,7 +2456,8 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 	 */
 	for_each_cpu(cpu, rcu_nocb_mask) {
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (rdp->cpu >= nl) {
+		if (rdp->cpu >= nl ||
+		    cpu_to_node(cpu) != cpu_to_node(rdp_leader->cpu)) {
 			/* New leader, set up for followers & next leader. */
 			nl = DIV_ROUND_UP(rdp->cpu + 1, ls) * ls;
 			rdp->nocb_leader = rdp;
@@ -2473,6 +2471,126 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 	}
 }
 
+/*
+ * Link a CPU offloaded at runtime into a no-CBs group with room left on
+ * its NUMA node, or make it the leader of a new one.  A CPU that was
+ * offloaded before stays linked, and its rcuo kthread stays around.
+ */
+static void rcu_nocb_link_leader(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	int cpu, nr;
+	int ls = rcu_nocb_get_leader_stride();
+	int node = cpu_to_node(rdp->cpu);
+	struct rcu_data *rdp_leader;
+	struct rcu_data *rdp_last;
+
+	if (rdp->nocb_leader)
+		return;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp_leader = per_cpu_ptr(rsp->rda, cpu);
+		if (rdp_leader->nocb_leader != rdp_leader ||
+		    cpu_to_node(cpu) != node)
+			continue;
+		nr = 1;
+		for (rdp_last = rdp_leader; rdp_last->nocb_next_follower;
+		     rdp_last = rdp_last->nocb_next_follower)
+			nr++;
+		if (nr >= ls)
+			continue;
+		rdp->nocb_leader = rdp_leader;
+		/* The leader kthread may be scanning its followers. */
+		smp_store_release(&rdp_last->nocb_next_follower, rdp);
+		return;
+	}
+	rdp->nocb_leader = rdp;
+}
+
+/*
+ * Runtime update of rcu_nocb_mask through rcutree.rcu_nocb_cpus.  Only
+ * offline CPUs may change state, the callback lists are switched and the
+ * rcuo kthreads spawned when they come back online, so offloading a CPU
+ * is: offline it, write the new CPU list, online it.  A CPU is only
+ * de-offloaded once its rcuo kthread has invoked all of its callbacks;
+ * nohz_full CPUs always stay offloaded.
+ */
+static int rcu_nocb_cpus_set(const char *val, const struct kernel_param *kp)
+{
+	cpumask_var_t new, changed;
+	struct rcu_state *rsp;
+	int cpu;
+	int ret;
+
+	if (IS_ENABLED(CONFIG_RCU_NOCB_CPU_ALL) || !have_rcu_nocb_mask ||
+	    !rcu_scheduler_fully_active)
+		return -EPERM;	/* Use rcu_nocbs= at boot. */
+
+	if (!alloc_cpumask_var(&new, GFP_KERNEL))
+		return -ENOMEM;
+	if (!alloc_cpumask_var(&changed, GFP_KERNEL)) {
+		free_cpumask_var(new);
+		return -ENOMEM;
+	}
+
+	ret = cpulist_parse(val, new);
+	if (ret)
+		goto out;
+	ret = -EINVAL;
+	if (!cpumask_subset(new, cpu_possible_mask))
+		goto out;
+#if defined(CONFIG_NO_HZ_FULL)
+	if (tick_nohz_full_running &&
+	    !cpumask_subset(tick_nohz_full_mask, new))
+		goto out;
+#endif /* #if defined(CONFIG_NO_HZ_FULL) */
+
+	get_online_cpus();
+	cpumask_xor(changed, new, rcu_nocb_mask);
+	ret = -EBUSY;
+	if (cpumask_intersects(changed, cpu_online_mask))
+		goto out_unlock;
+	for_each_cpu(cpu, changed) {
+		if (cpumask_test_cpu(cpu, new))
+			continue;
+		for_each_rcu_flavor(rsp)
+			if (atomic_long_read(&per_cpu_ptr(rsp->rda, cpu)->nocb_q_count))
+				goto out_unlock;
+	}
+
+	for_each_cpu(cpu, changed) {
+		if (!cpumask_test_cpu(cpu, new)) {
+			cpumask_clear_cpu(cpu, rcu_nocb_mask);
+			continue;
+		}
+		for_each_rcu_flavor(rsp)
+			rcu_nocb_link_leader(rsp, per_cpu_ptr(rsp->rda, cpu));
+		cpumask_set_cpu(cpu, rcu_nocb_mask);
+	}
+	if (!cpumask_empty(changed))
+		pr_info("Offload RCU callbacks from CPUs: %*pbl.\n",
+			cpumask_pr_args(rcu_nocb_mask));
+	ret = 0;
+out_unlock:
+	put_online_cpus();
+out:
+	free_cpumask_var(changed);
+	free_cpumask_var(new);
+	return ret;
+}
+
+static int rcu_nocb_cpus_get(char *buffer, const struct kernel_param *kp)
+{
+	if (!have_rcu_nocb_mask)
+		return sprintf(buffer, "\n");
+	return sprintf(buffer, "%*pbl\n", cpumask_pr_args(rcu_nocb_mask));
+}
+
+static const struct kernel_param_ops rcu_nocb_cpus_ops = {
+	.set = rcu_nocb_cpus_set,
+	.get = rcu_nocb_cpus_get,
+};
+module_param_cb(rcu_nocb_cpus, &rcu_nocb_cpus_ops, NULL, 0644);
+
 /* Prevent __call_rcu() from enqueuing callbacks on no-CBs CPUs */
 static bool init_nocb_callback_list(struct rcu_data *rdp)
 {
@@ -570,6 +570,9 @@ void print_dl_rq(struct seq_file *m, int cpu, struct dl_rq *dl_rq)
 
 	SEQ_printf(m, "\ndl_rq[%d]:\n", cpu);
 	SEQ_printf(m, "  .%-30s: %ld\n", "dl_nr_running", dl_rq->dl_nr_running);
+	SEQ_printf(m, "  .%-30s: %llu\n", "running_bw", dl_rq->running_bw);
+	SEQ_printf(m, "  .%-30s: %llu\n", "this_bw", dl_rq->this_bw);
+	SEQ_printf(m, "  .%-30s: %lld\n", "extra_bw", dl_rq->extra_bw);
 #ifdef CONFIG_SMP
 	dl_bw = &cpu_rq(cpu)->rd->dl_bw;
 #else
@@ -834,6 +837,14 @@ void print_numa_stats(struct seq_file *m, int node, unsigned long tsf,
 	SEQ_printf(m, "task_private=%lu task_shared=%lu ", tsf, tpf);
 	SEQ_printf(m, "group_private=%lu group_shared=%lu\n", gsf, gpf);
 }
+
+void print_numa_group_stats(struct seq_file *m, int nr_tasks,
+		int active_nodes, int preferred_nid)
+{
+	SEQ_printf(m, "numa_group nr_tasks=%d active_nodes=%d ", nr_tasks,
+			active_nodes);
+	SEQ_printf(m, "preferred_nid=%d\n", preferred_nid);
+}
 #endif
 
 
@@ -855,6 +866,9 @@ static void sched_show_numa(struct task_struct *p, struct seq_file *m)
 	P(numa_pages_migrated);
 	P(numa_preferred_nid);
 	P(total_numa_faults);
+	P(numa_scan_period);
+	P(numa_scan_period_max);
+	P(numa_local_ratio);
 	SEQ_printf(m, "current_node=%d, numa_group_id=%d\n",
 			task_node(p), task_numa_group_id(p));
 	show_numa_stats(p, m);
@@ -687,6 +687,9 @@ void init_entity_runnable_average(struct sched_entity *se)
 	 */
 	sa->util_avg = 0;
 	sa->util_sum = 0;
+	/* don't inherit the parent's estimate through dup_task_struct() */
+	sa->util_est.enqueued = 0;
+	sa->util_est.ewma = 0;
 	/* when this task enqueue'ed, it will contribute to its cfs_rq's load_avg */
 }
 
@@ -955,16 +958,6 @@ static unsigned int task_scan_min(struct task_struct *p)
 	return max_t(unsigned int, floor, scan);
 }
 
-static unsigned int task_scan_max(struct task_struct *p)
-{
-	unsigned int smin = task_scan_min(p);
-	unsigned int smax;
-
-	/* Watch for min being lower than max due to floor calculations */
-	smax = sysctl_numa_balancing_scan_period_max / task_nr_scan_windows(p);
-	return max(smin, smax);
-}
-
 static void account_numa_enqueue(struct rq *rq, struct task_struct *p)
 {
 	rq->nr_numa_running += (p->numa_preferred_nid != -1);
@@ -984,6 +977,7 @@ struct numa_group {
 	int nr_tasks;
 	pid_t gid;
 	int active_nodes;
+	int preferred_nid;	/* placement target of the group's memory */
 
 	struct rcu_head rcu;
 	unsigned long total_faults;
@@ -1046,6 +1040,60 @@ static inline unsigned long group_faults_cpu(struct numa_group *group, int nid)
 		group->faults_cpu[task_faults_idx(NUMA_MEM, nid, 1)];
 }
 
+static unsigned long group_faults_priv(struct numa_group *ng)
+{
+	unsigned long faults = 0;
+	int node;
+
+	for_each_online_node(node)
+		faults += ng->faults[task_faults_idx(NUMA_MEM, node, 1)];
+
+	return faults;
+}
+
+static unsigned long group_faults_shared(struct numa_group *ng)
+{
+	unsigned long faults = 0;
+	int node;
+
+	for_each_online_node(node)
+		faults += ng->faults[task_faults_idx(NUMA_MEM, node, 0)];
+
+	return faults;
+}
+
+static unsigned int task_scan_max(struct task_struct *p)
+{
+	unsigned int smin = task_scan_min(p);
+	unsigned long smax;
+	struct numa_group *ng;
+
+	/* Watch for min being lower than max due to floor calculations */
+	smax = sysctl_numa_balancing_scan_period_max / task_nr_scan_windows(p);
+
+	/*
+	 * Every thread of a group scans the same address space: scale the
+	 * maximum period with the number of tasks sharing the memory, so a
+	 * big process doesn't take a hinting fault per thread for each of
+	 * its shared pages on every pass.
+	 */
+	ng = p->numa_group;
+	if (ng) {
+		unsigned long shared = group_faults_shared(ng);
+		unsigned long private = group_faults_priv(ng);
+		unsigned long period = smax;
+
+		period *= atomic_read(&ng->refcount);
+		period *= shared + 1;
+		period /= private + shared + 1;
+
+		smax = max(smax, period);
+	}
+
+	return max_t(unsigned long, smin,
+		     min_t(unsigned long, smax, UINT_MAX));
+}
+
 /*
  * A node triggering more than 1/3 as many NUMA faults as the maximum is
  * considered part of a numa group's pseudo-interleaving set. Migrations
@@ -1206,6 +1254,20 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 	if (!ng)
 		return true;
 
+	/*
+	 * A group running on a single node has a placement target for its
+	 * memory: pull shared pages there, and don't let them drift away
+	 * from it on faults from the odd task running elsewhere.
+	 */
+	if (ng->active_nodes == 1 && READ_ONCE(ng->preferred_nid) != -1) {
+		int target = READ_ONCE(ng->preferred_nid);
+
+		if (dst_nid == target)
+			return true;
+		if (src_nid == target)
+			return false;
+	}
+
 	/*
 	 * Destination node is much more heavily used than the source
 	 * node? Allow migration.
@@ -1765,6 +1827,10 @@ static void update_task_scan_period(struct task_struct *p,
 	unsigned long remote = p->numa_faults_locality[0];
 	unsigned long local = p->numa_faults_locality[1];
 
+	/* how close we are to convergence, see /proc/<pid>/sched */
+	if (local + remote)
+		p->numa_local_ratio = local * 100 / (local + remote);
+
 	/*
 	 * If there were no record hinting faults then either the task is
 	 * completely idle or all activity is areas that are not of interest
@@ -2030,6 +2096,8 @@ static void task_numa_placement(struct task_struct *p)
 		numa_group_count_active_nodes(p->numa_group);
 		spin_unlock_irq(group_lock);
 		max_nid = preferred_group_nid(p, max_group_nid);
+		if (max_group_faults)
+			WRITE_ONCE(p->numa_group->preferred_nid, max_nid);
 	}
 
 	if (max_faults) {
@@ -2072,6 +2140,7 @@ static void task_numa_group(struct task_struct *p, int cpupid, int flags,
 
 		atomic_set(&grp->refcount, 1);
 		grp->active_nodes = 1;
+		grp->preferred_nid = -1;
 		grp->max_faults_cpu = 0;
 		spin_lock_init(&grp->lock);
 		grp->gid = p->pid;
@@ -2899,8 +2968,14 @@ static inline void cfs_rq_util_change(struct cfs_rq *cfs_rq)
 		 *
 		 * See cpu_util().
 		 */
+		unsigned long util = cfs_rq->avg.util_avg;
+
+		if (sched_feat(UTIL_EST))
+			util = max_t(unsigned long, util,
+				     READ_ONCE(cfs_rq->avg.util_est.enqueued));
+
 		cpufreq_update_util(rq_clock(rq),
-				    min(cfs_rq->avg.util_avg, max), max);
+				    min(uclamp_util(rq, util), max), max);
 	}
 }
 
@@ -3097,6 +3172,81 @@ static inline unsigned long cfs_rq_load_avg(struct cfs_rq *cfs_rq)
 
 static int idle_balance(struct rq *this_rq);
 
+/*
+ * A task's util_avg decays while it sleeps, so a periodic task wakes up
+ * looking much smaller than it is and schedutil only ramps the frequency
+ * back up over the following tens of milliseconds. Snapshot util_avg when
+ * the task goes to sleep and keep an EWMA of those samples:
+ *
+ *   ewma(t) = w * task_util(p) + (1 - w) * ewma(t-1),   w = 1/4
+ *
+ * The root cfs_rq sums the estimates of its runnable tasks, which is then
+ * used as a floor for its util_avg. The snapshot follows a bursty task
+ * up immediately, the EWMA keeps one short activation from pulling the
+ * estimate down.
+ */
+static inline unsigned long task_util(struct task_struct *p)
+{
+	return READ_ONCE(p->se.avg.util_avg);
+}
+
+static inline unsigned long _task_util_est(struct task_struct *p)
+{
+	struct util_est ue = READ_ONCE(p->se.avg.util_est);
+
+	return max(ue.ewma, ue.enqueued);
+}
+
+static inline unsigned long task_util_est(struct task_struct *p)
+{
+	return max(task_util(p), _task_util_est(p));
+}
+
+static inline void util_est_enqueue(struct cfs_rq *cfs_rq,
+				    struct task_struct *p)
+{
+	unsigned int enqueued;
+
+	if (!sched_feat(UTIL_EST))
+		return;
+
+	enqueued = cfs_rq->avg.util_est.enqueued;
+	enqueued += _task_util_est(p);
+	WRITE_ONCE(cfs_rq->avg.util_est.enqueued, enqueued);
+}
+
+static void
+util_est_dequeue(struct cfs_rq *cfs_rq, struct task_struct *p, bool task_sleep)
+{
+	long last_ewma_diff;
+	struct util_est ue;
+
+	if (!sched_feat(UTIL_EST))
+		return;
+
+	/* the feature may have been switched on while p was queued */
+	ue.enqueued = cfs_rq->avg.util_est.enqueued;
+	ue.enqueued -= min_t(unsigned int, ue.enqueued, _task_util_est(p));
+	WRITE_ONCE(cfs_rq->avg.util_est.enqueued, ue.enqueued);
+
+	/* only the end of an activation gives a new sample */
+	if (!task_sleep)
+		return;
+
+	ue = p->se.avg.util_est;
+	ue.enqueued = task_util(p);
+
+	/* not worth touching the EWMA for changes within 1% */
+	last_ewma_diff = ue.enqueued - ue.ewma;
+	if (abs(last_ewma_diff) < SCHED_CAPACITY_SCALE / 100)
+		return;
+
+	ue.ewma <<= UTIL_EST_WEIGHT_SHIFT;
+	ue.ewma  += last_ewma_diff;
+	ue.ewma >>= UTIL_EST_WEIGHT_SHIFT;
+	WRITE_ONCE(p->se.avg.util_est, ue);
+}
+
 #else /* CONFIG_SMP */
 
 static inline void update_load_avg(struct sched_entity *se, int not_used)
@@ -3113,6 +3263,12 @@ static inline void
 dequeue_entity_load_avg(struct cfs_rq *cfs_rq, struct sched_entity *se) {}
 static inline void remove_entity_load_avg(struct sched_entity *se) {}
 
+static inline void
+util_est_enqueue(struct cfs_rq *cfs_rq, struct task_struct *p) {}
+static inline void
+util_est_dequeue(struct cfs_rq *cfs_rq, struct task_struct *p,
+		 bool task_sleep) {}
+
 static inline void
 attach_entity_load_avg(struct cfs_rq *cfs_rq, struct sched_entity *se) {}
 static inline void
@@ -4435,6 +4591,12 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	/*
+	 * Account the estimate before update_load_avg() below kicks
+	 * schedutil, so a waking task gets its frequency right away.
+	 */
+	util_est_enqueue(&rq->cfs, p);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -4528,6 +4690,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se)
 		sub_nr_running(rq, 1);
 
+	util_est_dequeue(&rq->cfs, p, task_sleep);
 	hrtick_update(rq);
 }
 
@@ -5079,16 +5242,25 @@ static int wake_affine(struct sched_domain *sd, struct task_struct *p, int sync)
 	return 1;
 }
 
+static int cpu_util(int cpu);
+
 /*
  * find_idlest_group finds and returns the least busy CPU group within the
  * domain.
+ *
+ * When the estimated utilization of @p fits in the spare capacity of a
+ * group, prefer the group with the most spare capacity: load does not
+ * tell a CPU running a sleepy task apart from an idle one.
  */
 static struct sched_group *
 find_idlest_group(struct sched_domain *sd, struct task_struct *p,
 		  int this_cpu, int sd_flag)
 {
 	struct sched_group *idlest = NULL, *group = sd->groups;
+	struct sched_group *most_spare_sg = NULL;
 	unsigned long min_load = ULONG_MAX, this_load = 0;
+	unsigned long most_spare = 0, this_spare = 0;
+	unsigned long p_util;
 	int load_idx = sd->forkexec_idx;
 	int imbalance = 100 + (sd->imbalance_pct-100)/2;
 
@@ -5096,7 +5268,7 @@ find_idlest_group(struct sched_domain *sd, struct task_struct *p,
 		load_idx = sd->wake_idx;
 
 	do {
-		unsigned long load, avg_load;
+		unsigned long load, avg_load, spare_cap, max_spare_cap;
 		int local_group;
 		int i;
 
@@ -5110,6 +5282,7 @@ find_idlest_group(struct sched_domain *sd, struct task_struct *p,
 
 		/* Tally up the load of all CPUs in the group */
 		avg_load = 0;
+		max_spare_cap = 0;
 
 		for_each_cpu(i, sched_group_cpus(group)) {
 			/* Bias balancing toward cpus of our domain */
@@ -5119,6 +5292,11 @@ find_idlest_group(struct sched_domain *sd, struct task_struct *p,
 				load = target_load(i, load_idx);
 
 			avg_load += load;
+
+			spare_cap = capacity_of(i);
+			spare_cap -= min_t(unsigned long, spare_cap, cpu_util(i));
+			if (spare_cap > max_spare_cap)
+				max_spare_cap = spare_cap;
 		}
 
 		/* Adjust by relative CPU capacity of the group */
@@ -5126,12 +5304,38 @@ find_idlest_group(struct sched_domain *sd, struct task_struct *p,
 
 		if (local_group) {
 			this_load = avg_load;
-		} else if (avg_load < min_load) {
-			min_load = avg_load;
-			idlest = group;
+			this_spare = max_spare_cap;
+		} else {
+			if (avg_load < min_load) {
+				min_load = avg_load;
+				idlest = group;
+			}
+
+			if (most_spare < max_spare_cap) {
+				most_spare = max_spare_cap;
+				most_spare_sg = group;
+			}
 		}
 	} while (group = group->next, group != sd->groups);
 
+	/*
+	 * A new task has no history, its utilization is only the share it
+	 * inherited from its cfs_rq: balance forks on load alone.
+	 */
+	if (sd_flag & SD_BALANCE_FORK || !sched_feat(UTIL_EST))
+		goto skip_spare;
+
+	p_util = uclamp_task_util(p, task_util_est(p));
+
+	/* stay local unless another group has clearly more room */
+	if (this_spare > p_util / 2 &&
+	    imbalance*this_spare > 100*most_spare)
+		return NULL;
+
+	if (most_spare > p_util / 2)
+		return most_spare_sg;
+
+skip_spare:
 	if (!idlest || 100*this_load < imbalance*min_load)
 		return NULL;
 	return idlest;
@@ -5186,13 +5390,199 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return shallowest_idle_cpu != -1 ? shallowest_idle_cpu : least_loaded_cpu;
 }
 
+#ifdef CONFIG_SCHED_SMT
+
+/* Borrowed from load_balance(), the wakeup path runs with irqs disabled */
+DECLARE_PER_CPU(cpumask_var_t, load_balance_mask);
+
+static inline void set_idle_cores(int cpu, int val)
+{
+	struct sched_domain_shared *sds;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds)
+		WRITE_ONCE(sds->has_idle_cores, val);
+}
+
+static inline bool test_idle_cores(int cpu, bool def)
+{
+	struct sched_domain_shared *sds;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds)
+		return READ_ONCE(sds->has_idle_cores);
+
+	return def;
+}
+
 /*
- * Try and locate an idle CPU in the sched_domain.
+ * Called when a cpu goes idle: if all its SMT siblings are idle too, tell
+ * the wakeups of the LLC that there is an idle core to be found.
+ *
+ * The siblings share all cache levels, so looking at them is cheap.
+ */
+void __update_idle_core(struct rq *rq)
+{
+	int core = cpu_of(rq);
+	int cpu;
+
+	rcu_read_lock();
+	if (test_idle_cores(core, true))
+		goto unlock;
+
+	for_each_cpu(cpu, cpu_smt_mask(core)) {
+		if (cpu == core)
+			continue;
+
+		if (!idle_cpu(cpu))
+			goto unlock;
+	}
+
+	set_idle_cores(core, 1);
+unlock:
+	rcu_read_unlock();
+}
+
+/*
+ * Scan the LLC for a core whose siblings are all idle. Only done while
+ * the LLC is known to have one, a scan that finds none clears the hint
+ * until the next core goes idle.
+ */
+static int select_idle_core(struct task_struct *p, struct sched_domain *sd,
+			    int target)
+{
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(load_balance_mask);
+	int core, cpu;
+
+	if (!static_branch_likely(&sched_smt_present))
+		return -1;
+
+	if (!test_idle_cores(target, false))
+		return -1;
+
+	cpumask_and(cpus, sched_domain_span(sd), tsk_cpus_allowed(p));
+
+	for_each_cpu_wrap(core, cpus, target) {
+		bool idle = true;
+
+		for_each_cpu(cpu, cpu_smt_mask(core)) {
+			cpumask_clear_cpu(cpu, cpus);
+			if (!idle_cpu(cpu))
+				idle = false;
+		}
+
+		if (idle)
+			return core;
+	}
+
+	set_idle_cores(target, 0);
+
+	return -1;
+}
+
+/*
+ * There is no idle core, settle for an idle sibling of the target.
+ */
+static int select_idle_smt(struct task_struct *p, struct sched_domain *sd,
+			   int target)
+{
+	int cpu;
+
+	if (!static_branch_likely(&sched_smt_present))
+		return -1;
+
+	for_each_cpu(cpu, cpu_smt_mask(target)) {
+		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
+			continue;
+		if (idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
+#else /* CONFIG_SCHED_SMT */
+
+static inline int select_idle_core(struct task_struct *p,
+				   struct sched_domain *sd, int target)
+{
+	return -1;
+}
+
+static inline int select_idle_smt(struct task_struct *p,
+				  struct sched_domain *sd, int target)
+{
+	return -1;
+}
+
+#endif /* CONFIG_SCHED_SMT */
+
+/*
+ * Scan the LLC for any idle cpu. The number of cpus looked at is limited
+ * by how long this cpu is expected to stay idle (rq->avg_idle) against
+ * what a scan step cost so far (sd_llc->avg_scan_cost), so wakeups on
+ * busy machines don't spend more time looking for a cpu than the cpu they
+ * find would have stayed idle anyway, however large the LLC is.
+ */
+static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd,
+			   int target)
+{
+	struct sched_domain *this_sd;
+	u64 avg_cost, avg_idle, span_avg;
+	u64 time, cost;
+	s64 delta;
+	int cpu, nr;
+
+	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
+	if (!this_sd)
+		return -1;
+
+	/*
+	 * Due to large variance we need a large fuzz factor, hackbench in
+	 * particular is sensitive here.
+	 */
+	avg_idle = this_rq()->avg_idle / 512;
+	avg_cost = this_sd->avg_scan_cost + 1;
+
+	if (avg_idle < avg_cost)
+		return -1;
+
+	span_avg = sd->span_weight * avg_idle;
+	if (span_avg > 4 * avg_cost)
+		nr = div_u64(span_avg, avg_cost);
+	else
+		nr = 4;
+
+	time = local_clock();
+
+	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
+		if (!--nr) {
+			cpu = -1;
+			break;
+		}
+		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
+			continue;
+		if (idle_cpu(cpu))
+			break;
+	}
+
+	time = local_clock() - time;
+	cost = this_sd->avg_scan_cost;
+	delta = (s64)(time - cost) / 8;
+	this_sd->avg_scan_cost += delta;
+
+	if (cpu >= nr_cpu_ids)
+		return -1;
+
+	return cpu;
+}
+
+/*
+ * Try and locate an idle core/thread in the LLC cache domain.
  */
 static int select_idle_sibling(struct task_struct *p, int target)
 {
 	struct sched_domain *sd;
-	struct sched_group *sg;
 	int i = task_cpu(p);
 
 	if (idle_cpu(target))
@@ -5204,47 +5594,27 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	if (i != target && cpus_share_cache(i, target) && idle_cpu(i))
 		return i;
 
+	sd = rcu_dereference(per_cpu(sd_llc, target));
+	if (!sd)
+		return target;
+
 	/*
-	 * Otherwise, iterate the domains and find an eligible idle cpu.
-	 *
-	 * A completely idle sched group at higher domains is more
-	 * desirable than an idle group at a lower level, because lower
-	 * domains have smaller groups and usually share hardware
-	 * resources which causes tasks to contend on them, e.g. x86
-	 * hyperthread siblings in the lowest domain (SMT) can contend
-	 * on the shared cpu pipeline.
-	 *
-	 * However, while we prefer idle groups at higher domains
-	 * finding an idle cpu at the lowest domain is still better than
-	 * returning 'target', which we've already established, isn't
-	 * idle.
+	 * A fully idle core is the best pick, its siblings don't contend
+	 * for the cpu pipeline. Then any idle cpu of the LLC within the
+	 * scan budget, and at last an idle sibling of the target.
 	 */
-	sd = rcu_dereference(per_cpu(sd_llc, target));
-	for_each_lower_domain(sd) {
-		sg = sd->groups;
-		do {
-			if (!cpumask_intersects(sched_group_cpus(sg),
-						tsk_cpus_allowed(p)))
-				goto next;
-
-			/* Ensure the entire group is idle */
-			for_each_cpu(i, sched_group_cpus(sg)) {
-				if (i == target || !idle_cpu(i))
-					goto next;
-			}
+	i = select_idle_core(p, sd, target);
+	if ((unsigned)i < nr_cpumask_bits)
+		return i;
+
+	i = select_idle_cpu(p, sd, target);
+	if ((unsigned)i < nr_cpumask_bits)
+		return i;
+
+	i = select_idle_smt(p, sd, target);
+	if ((unsigned)i < nr_cpumask_bits)
+		return i;
 
-			/*
-			 * It doesn't matter which cpu we pick, the
-			 * whole group is idle.
-			 */
-			target = cpumask_first_and(sched_group_cpus(sg),
-					tsk_cpus_allowed(p));
-			goto done;
-next:
-			sg = sg->next;
-		} while (sg != sd->groups);
-	}
-done:
 	return target;
 }
 
@@ -5276,9 +5646,15 @@ done:
  */
 static int cpu_util(int cpu)
 {
-	unsigned long util = cpu_rq(cpu)->cfs.avg.util_avg;
+	struct cfs_rq *cfs_rq = &cpu_rq(cpu)->cfs;
+	unsigned long util = READ_ONCE(cfs_rq->avg.util_avg);
 	unsigned long capacity = capacity_orig_of(cpu);
 
+	/* don't let a CPU look idle while its tasks merely sleep between runs */
+	if (sched_feat(UTIL_EST))
+		util = max_t(unsigned long, util,
+			     READ_ONCE(cfs_rq->avg.util_est.enqueued));
+
 	return (util >= capacity) ? capacity : util;
 }
 
@@ -5911,6 +6287,9 @@ static bool yield_to_task_fair(struct rq *rq, struct task_struct *p, bool preemp
 
 static unsigned long __read_mostly max_load_balance_interval = HZ/10;
 
+/* a busy cpu spends at most 1/LB_COST_SHARE of its time balancing a domain */
+#define LB_COST_SHARE		32
+
 enum fbq_type { regular, remote, all };
 
 #define LBF_ALL_PINNED	0x01
@@ -6109,6 +6488,7 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 		return 1;
 	}
 
+	schedstat_inc(env->sd, lb_hot_rejected[env->idle]);
 	schedstat_inc(p, se.statistics.nr_failed_migrations_hot);
 	return 0;
 }
@@ -7276,7 +7656,7 @@ static struct rq *find_busiest_queue(struct lb_env *env,
  */
 #define MAX_PINNED_INTERVAL	512
 
-/* Working cpumask for load_balance and load_balance_newidle. */
+/* Working cpumask for load_balance, load_balance_newidle and select_idle_core. */
 DEFINE_PER_CPU(cpumask_var_t, load_balance_mask);
 
 static int need_active_balance(struct lb_env *env)
@@ -7620,6 +8000,16 @@ get_sd_balance_interval(struct sched_domain *sd, int cpu_busy)
 
 	/* scale ms to jiffies */
 	interval = msecs_to_jiffies(interval);
+
+	/*
+	 * A pass over a wide domain can take a good part of a millisecond,
+	 * which a busy cpu pays for out of the time of its tasks. Don't let
+	 * it spend more than 1/LB_COST_SHARE of its time balancing this
+	 * level; max_newidle_lb_cost follows what recent passes cost.
+	 */
+	if (cpu_busy)
+		interval = max(interval, nsecs_to_jiffies(sd->max_newidle_lb_cost *
+							  LB_COST_SHARE));
 	interval = clamp(interval, 1UL, max_load_balance_interval);
 
 	return interval;
@@ -7692,6 +8082,7 @@ static int idle_balance(struct rq *this_rq)
 			domain_cost = sched_clock_cpu(this_cpu) - t0;
 			if (domain_cost > sd->max_newidle_lb_cost)
 				sd->max_newidle_lb_cost = domain_cost;
+			schedstat_add(sd, lb_time[CPU_NEWLY_IDLE], domain_cost);
 
 			curr_cost += domain_cost;
 		}
@@ -8009,6 +8400,9 @@ static void rebalance_domains(struct rq *rq, enum cpu_idle_type idle)
 		}
 
 		if (time_after_eq(jiffies, sd->last_balance + interval)) {
+			u64 t0 = sched_clock_cpu(cpu), domain_cost;
+			enum cpu_idle_type lb_idle = idle;
+
 			if (load_balance(cpu, rq, sd, idle, &continue_balancing)) {
 				/*
 				 * The LBF_DST_PINNED logic could have changed
@@ -8017,6 +8411,16 @@ static void rebalance_domains(struct rq *rq, enum cpu_idle_type idle)
 				 */
 				idle = idle_cpu(cpu) ? CPU_IDLE : CPU_NOT_IDLE;
 			}
+
+			/*
+			 * Periodic passes cost the same as newidle ones,
+			 * let them bound the balance interval too.
+			 */
+			domain_cost = sched_clock_cpu(cpu) - t0;
+			if (domain_cost > sd->max_newidle_lb_cost)
+				sd->max_newidle_lb_cost = domain_cost;
+			schedstat_add(sd, lb_time[lb_idle], domain_cost);
+
 			sd->last_balance = jiffies;
 			interval = get_sd_balance_interval(sd, idle != CPU_IDLE);
 		}
@@ -8719,6 +9123,14 @@ void show_numa_stats(struct task_struct *p, struct seq_file *m)
 {
 	int node;
 	unsigned long tsf = 0, tpf = 0, gsf = 0, gpf = 0;
+	struct numa_group *ng;
+
+	rcu_read_lock();
+	ng = rcu_dereference(p->numa_group);
+	if (ng)
+		print_numa_group_stats(m, ng->nr_tasks, ng->active_nodes,
+				       READ_ONCE(ng->preferred_nid));
+	rcu_read_unlock();
 
 	for_each_online_node(node) {
 		if (p->numa_faults) {
@@ -69,3 +69,10 @@ SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
 SCHED_FEAT(ATTACH_AGE_LOAD, true)
 
+/*
+ * Use the estimated utilization of tasks, which does not decay while
+ * they sleep, as a floor for the CPU utilization seen by schedutil and
+ * by the wakeup path.
+ */
+SCHED_FEAT(UTIL_EST, true)
+
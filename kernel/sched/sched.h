@@ -10,6 +10,7 @@
 #include <linux/irq_work.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 #include "cpudeadline.h"
@@ -29,6 +30,8 @@ extern atomic_long_t calc_load_tasks;
 
 extern void calc_global_load_tick(struct rq *this_rq);
 extern long calc_load_fold_active(struct rq *this_rq);
+extern unsigned long calc_load_n(unsigned long load, unsigned long exp,
+				 unsigned long active, unsigned int n);
 
 #ifdef CONFIG_SMP
 extern void cpu_load_update_active(struct rq *this_rq);
@@ -190,22 +193,35 @@ static inline int dl_bandwidth_enabled(void)
 }
 
 extern struct dl_bw *dl_bw_of(int i);
+extern int dl_bw_cpus(int i);
+
+/* bandwidths are fixed point, see to_ratio() */
+#define BW_SHIFT		20
+#define BW_UNIT			(1 << BW_SHIFT)
+#define RATIO_SHIFT		8
 
 struct dl_bw {
 	raw_spinlock_t lock;
 	u64 bw, total_bw;
 };
 
+/* spread a change of allocated bandwidth on the reclaimable bw of the cpus */
+extern void __dl_update(struct dl_bw *dl_b, s64 bw);
+
 static inline
-void __dl_clear(struct dl_bw *dl_b, u64 tsk_bw)
+void __dl_clear(struct dl_bw *dl_b, u64 tsk_bw, int cpus)
 {
 	dl_b->total_bw -= tsk_bw;
+	if (cpus)
+		__dl_update(dl_b, (s64)tsk_bw / cpus);
 }
 
 static inline
-void __dl_add(struct dl_bw *dl_b, u64 tsk_bw)
+void __dl_add(struct dl_bw *dl_b, u64 tsk_bw, int cpus)
 {
 	dl_b->total_bw += tsk_bw;
+	if (cpus)
+		__dl_update(dl_b, -((s64)tsk_bw / cpus));
 }
 
 static inline
@@ -284,6 +300,13 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	/* clamp values requested through cpu.util.{min,max} */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* and restricted by the parent's effective values */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -527,6 +550,24 @@ struct dl_rq {
 #else
 	struct dl_bw dl_bw;
 #endif
+
+	/*
+	 * GRUB bandwidth reclaiming. running_bw is the active utilization:
+	 * the bandwidth of the tasks that are runnable, or blocked but not
+	 * past their 0-lag time yet. this_bw is the bandwidth of all the
+	 * -deadline tasks assigned to this rq, runnable or not.
+	 */
+	u64 running_bw;
+	u64 this_bw;
+
+	/*
+	 * Allocatable bandwidth of this cpu no task reserved, which
+	 * reclaiming tasks may use as well, and the inverse of the maximum
+	 * bandwidth that can be used by -deadline tasks, 1 / Umax, with
+	 * RATIO_SHIFT bits of fraction.
+	 */
+	s64 extra_bw;
+	u64 bw_ratio;
 };
 
 #ifdef CONFIG_SMP
@@ -570,6 +611,28 @@ extern struct root_domain def_root_domain;
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Runnable tasks of a bucket, and the highest clamp value among them. The
+ * value is only reset once the bucket empties, so it can overestimate by
+ * up to a bucket's width.
+ */
+struct uclamp_bucket {
+	unsigned long value : SCHED_CAPACITY_SHIFT + 1;
+	unsigned long tasks : BITS_PER_LONG - SCHED_CAPACITY_SHIFT - 1;
+};
+
+/*
+ * Per rq aggregation of a clamp: the max value among the runnable tasks,
+ * so that no task is served below its minimum, nor throttled below the
+ * highest maximum asked for.
+ */
+struct uclamp_rq {
+	unsigned int value;
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -611,6 +674,11 @@ struct rq {
 	struct rt_rq rt;
 	struct dl_rq dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* utilization clamp values of the runnable tasks */
+	struct uclamp_rq uclamp[UCLAMP_CNT] ____cacheline_aligned;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -627,6 +695,13 @@ struct rq {
 	struct task_struct *curr, *idle, *stop;
 	unsigned long next_balance;
 	struct mm_struct *prev_mm;
+#ifdef CONFIG_MEMBARRIER
+	/*
+	 * mm of curr, for membarrier to compare against without having to
+	 * dereference a task that may be exiting
+	 */
+	struct mm_struct *membarrier_mm;
+#endif
 
 	unsigned int clock_skip_update;
 	u64 clock;
@@ -856,6 +931,7 @@ static inline struct sched_domain *lowest_flag_domain(int cpu, int flag)
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_busy);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
@@ -1046,6 +1122,20 @@ extern struct static_key sched_feat_keys[__SCHED_FEAT_NR];
 extern struct static_key_false sched_numa_balancing;
 extern struct static_key_false sched_schedstats;
 
+#ifdef CONFIG_SCHED_SMT
+extern struct static_key_false sched_smt_present;
+
+extern void __update_idle_core(struct rq *rq);
+
+static inline void update_idle_core(struct rq *rq)
+{
+	if (static_branch_unlikely(&sched_smt_present))
+		__update_idle_core(rq);
+}
+#else
+static inline void update_idle_core(struct rq *rq) { }
+#endif
+
 static inline u64 global_rt_period(void)
 {
 	return (u64)sysctl_sched_rt_period * NSEC_PER_USEC;
@@ -1318,6 +1408,9 @@ extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime
 extern struct dl_bandwidth def_dl_bandwidth;
 extern void init_dl_bandwidth(struct dl_bandwidth *dl_b, u64 period, u64 runtime);
 extern void init_dl_task_timer(struct sched_dl_entity *dl_se);
+extern void init_dl_inactive_task_timer(struct sched_dl_entity *dl_se);
+extern void init_dl_rq_bw_ratio(struct dl_rq *dl_rq);
+extern void dl_change_utilization(struct task_struct *p, u64 new_bw);
 
 unsigned long to_ratio(u64 period, u64 runtime);
 
@@ -1682,6 +1775,9 @@ show_numa_stats(struct task_struct *p, struct seq_file *m);
 extern void
 print_numa_stats(struct seq_file *m, int node, unsigned long tsf,
 	unsigned long tpf, unsigned long gsf, unsigned long gpf);
+extern void
+print_numa_group_stats(struct seq_file *m, int nr_tasks, int active_nodes,
+	int preferred_nid);
 #endif /* CONFIG_NUMA_BALANCING */
 #endif /* CONFIG_SCHED_DEBUG */
 
@@ -1802,6 +1898,44 @@ static inline void cpufreq_update_util(u64 time, unsigned long util, unsigned lo
 static inline void cpufreq_trigger_update(u64 time) {}
 #endif /* CONFIG_CPU_FREQ */
 
+#ifdef CONFIG_UCLAMP_TASK
+unsigned int uclamp_eff_value(struct task_struct *p, unsigned int clamp_id);
+
+/*
+ * Clamp @util to the clamps of the runnable tasks of @rq. A max below the
+ * min happens when a boosted task shares the rq with a capped one, the
+ * boost wins then.
+ */
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	unsigned int min_util = READ_ONCE(rq->uclamp[UCLAMP_MIN].value);
+	unsigned int max_util = READ_ONCE(rq->uclamp[UCLAMP_MAX].value);
+
+	if (unlikely(min_util >= max_util))
+		return min_util;
+
+	return clamp_t(unsigned long, util, min_util, max_util);
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	return clamp_t(unsigned long, util, uclamp_eff_value(p, UCLAMP_MIN),
+		       uclamp_eff_value(p, UCLAMP_MAX));
+}
+#else
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	return util;
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	return util;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
 #ifdef arch_scale_freq_capacity
 #ifndef arch_scale_freq_invariant
 #define arch_scale_freq_invariant()	(true)
@@ -1822,3 +1956,37 @@ static inline void account_reset_rq(struct rq *rq)
 	rq->prev_steal_time_rq = 0;
 #endif
 }
+
+#ifdef CONFIG_MEMBARRIER
+enum {
+	/* context switches to the mm are fully ordered */
+	MEMBARRIER_STATE_PRIVATE_EXPEDITED		= (1U << 0),
+	/* ... and every cpu has seen it, the command may be used */
+	MEMBARRIER_STATE_PRIVATE_EXPEDITED_READY	= (1U << 1),
+};
+
+static inline void membarrier_set_curr(struct rq *rq, struct mm_struct *mm)
+{
+	WRITE_ONCE(rq->membarrier_mm, mm);
+}
+
+/*
+ * membarrier_private_expedited() only sends IPIs to the cpus running the
+ * mm when it looks; a cpu switching to it at the same time must provide
+ * the full barrier between storing rq->membarrier_mm and going back to
+ * user-space itself, the rq->lock release is not enough on its own.
+ */
+static inline void membarrier_finish_switch(struct mm_struct *mm)
+{
+	if (mm && unlikely(atomic_read(&mm->membarrier_state) &
+			   MEMBARRIER_STATE_PRIVATE_EXPEDITED))
+		smp_mb();
+}
+#else
+static inline void membarrier_set_curr(struct rq *rq, struct mm_struct *mm)
+{
+}
+static inline void membarrier_finish_switch(struct mm_struct *mm)
+{
+}
+#endif
@@ -41,8 +41,9 @@
  *         outside of a lifetime-guarded section.  In general, this
  *         is only needed for handling filters shared across tasks.
  * @prev: points to a previously installed, or inherited, filter
- * @len: the number of instructions in the program
- * @insnsi: the BPF program instructions to evaluate
+ * @prog: the BPF program to evaluate
+ * @cache: syscalls this filter and all of its @prev filters allow
+ *         without looking at the arguments
  *
  * seccomp_filter objects are organized in a tree linked via the @prev
  * pointer.  For any task, it appears to be a singly-linked list starting
@@ -54,10 +55,29 @@
  * seccomp_filter objects should never be modified after being attached
  * to a task_struct (other than @usage).
  */
+#ifdef SECCOMP_ARCH_NATIVE
+/**
+ * struct seccomp_action_cache - per-filter cache of constant allows
+ *
+ * @allow_native: bit N is set if syscall N of the native architecture is
+ *                always allowed by the whole filter chain
+ * @allow_compat: the same for the compat architecture, if there is one
+ */
+struct seccomp_action_cache {
+	DECLARE_BITMAP(allow_native, SECCOMP_ARCH_NATIVE_NR);
+#ifdef SECCOMP_ARCH_COMPAT
+	DECLARE_BITMAP(allow_compat, SECCOMP_ARCH_COMPAT_NR);
+#endif
+};
+#else
+struct seccomp_action_cache { };
+#endif
+
 struct seccomp_filter {
 	atomic_t usage;
 	struct seccomp_filter *prev;
 	struct bpf_prog *prog;
+	struct seccomp_action_cache cache;
 };
 
 /* Limit any path through the tree to 256KB worth of instructions. */
@@ -167,6 +187,45 @@ static int seccomp_check_filter(struct sock_filter *filter, unsigned int flen)
 	return 0;
 }
 
+#ifdef SECCOMP_ARCH_NATIVE
+static inline bool seccomp_cache_test(const unsigned long *bitmap,
+				      unsigned int bitmap_size, int nr)
+{
+	if (unlikely(nr < 0 || nr >= bitmap_size))
+		return false;
+
+	return test_bit(nr, bitmap);
+}
+
+/**
+ * seccomp_cache_check_allow - look up a syscall in the action cache
+ * @f: the most recently attached filter of current
+ * @sd: the seccomp data of the syscall
+ *
+ * Returns true if every filter in the chain is known to return
+ * SECCOMP_RET_ALLOW for this syscall, so none of them needs to run.
+ */
+static inline bool seccomp_cache_check_allow(const struct seccomp_filter *f,
+					     const struct seccomp_data *sd)
+{
+	if (likely(sd->arch == SECCOMP_ARCH_NATIVE))
+		return seccomp_cache_test(f->cache.allow_native,
+					  SECCOMP_ARCH_NATIVE_NR, sd->nr);
+#ifdef SECCOMP_ARCH_COMPAT
+	if (likely(sd->arch == SECCOMP_ARCH_COMPAT))
+		return seccomp_cache_test(f->cache.allow_compat,
+					  SECCOMP_ARCH_COMPAT_NR, sd->nr);
+#endif
+	return false;
+}
+#else
+static inline bool seccomp_cache_check_allow(const struct seccomp_filter *f,
+					     const struct seccomp_data *sd)
+{
+	return false;
+}
+#endif /* SECCOMP_ARCH_NATIVE */
+
 /**
  * seccomp_run_filters - evaluates all seccomp filters against @syscall
  * @syscall: number of the current system call
@@ -190,6 +249,9 @@ static u32 seccomp_run_filters(struct seccomp_data *sd)
 		sd = &sd_local;
 	}
 
+	if (seccomp_cache_check_allow(f, sd))
+		return SECCOMP_RET_ALLOW;
+
 	/*
 	 * All filters in the list are evaluated and the lowest BPF return
 	 * value always takes priority (ignoring the DATA).
@@ -337,6 +399,145 @@ static inline void seccomp_sync_threads(void)
 	}
 }
 
+#ifdef SECCOMP_ARCH_NATIVE
+/**
+ * seccomp_is_const_allow - check if a filter always allows a syscall
+ * @fprog: the original, unchecked classic BPF program
+ * @sd: seccomp data with only @nr and @arch filled in
+ *
+ * Emulates the program for one syscall number and architecture.  Any load
+ * of the arguments or the instruction pointer, or an instruction the
+ * emulator does not model, makes the result depend on more than @nr and
+ * @arch, so the syscall is not cacheable.
+ *
+ * Returns true if the program returns SECCOMP_RET_ALLOW on every path
+ * taken for @sd.
+ */
+static bool seccomp_is_const_allow(struct sock_fprog_kern *fprog,
+				   struct seccomp_data *sd)
+{
+	unsigned int reg_value = 0;
+	unsigned int pc;
+	bool op_res;
+
+	if (WARN_ON_ONCE(!fprog))
+		return false;
+
+	for (pc = 0; pc < fprog->len; pc++) {
+		struct sock_filter *insn = &fprog->filter[pc];
+		u16 code = insn->code;
+		u32 k = insn->k;
+
+		switch (code) {
+		case BPF_LD | BPF_W | BPF_ABS:
+			switch (k) {
+			case offsetof(struct seccomp_data, nr):
+				reg_value = sd->nr;
+				break;
+			case offsetof(struct seccomp_data, arch):
+				reg_value = sd->arch;
+				break;
+			default:
+				/* Depends on the arguments or the IP */
+				return false;
+			}
+			break;
+		case BPF_RET | BPF_K:
+			return k == SECCOMP_RET_ALLOW;
+		case BPF_JMP | BPF_JA:
+			pc += k;
+			break;
+		case BPF_JMP | BPF_JEQ | BPF_K:
+		case BPF_JMP | BPF_JGE | BPF_K:
+		case BPF_JMP | BPF_JGT | BPF_K:
+		case BPF_JMP | BPF_JSET | BPF_K:
+			switch (BPF_OP(code)) {
+			case BPF_JEQ:
+				op_res = reg_value == k;
+				break;
+			case BPF_JGE:
+				op_res = reg_value >= k;
+				break;
+			case BPF_JGT:
+				op_res = reg_value > k;
+				break;
+			default:
+				op_res = !!(reg_value & k);
+				break;
+			}
+			pc += op_res ? insn->jt : insn->jf;
+			break;
+		case BPF_ALU | BPF_AND | BPF_K:
+			reg_value &= k;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	/* bpf_check_classic() guarantees the program ends in a return */
+	WARN_ON_ONCE(1);
+	return false;
+}
+
+static void seccomp_cache_prepare_bitmap(struct seccomp_filter *sfilter,
+					 unsigned long *bitmap,
+					 unsigned int bitmap_size, u32 arch)
+{
+	struct sock_fprog_kern *fprog = sfilter->prog->orig_prog;
+	struct seccomp_data sd = { .arch = arch };
+	unsigned int nr;
+
+	for (nr = 0; nr < bitmap_size; nr++) {
+		sd.nr = nr;
+		if (seccomp_is_const_allow(fprog, &sd))
+			__set_bit(nr, bitmap);
+	}
+}
+
+/**
+ * seccomp_cache_prepare - find the syscalls a new filter always allows
+ * @sfilter: the filter, not yet attached
+ *
+ * This only looks at @sfilter itself, seccomp_cache_inherit() narrows the
+ * result down to what the filters below it allow once it is attached.
+ */
+static void seccomp_cache_prepare(struct seccomp_filter *sfilter)
+{
+	seccomp_cache_prepare_bitmap(sfilter, sfilter->cache.allow_native,
+				     SECCOMP_ARCH_NATIVE_NR,
+				     SECCOMP_ARCH_NATIVE);
+#ifdef SECCOMP_ARCH_COMPAT
+	seccomp_cache_prepare_bitmap(sfilter, sfilter->cache.allow_compat,
+				     SECCOMP_ARCH_COMPAT_NR,
+				     SECCOMP_ARCH_COMPAT);
+#endif
+}
+
+static void seccomp_cache_inherit(struct seccomp_filter *sfilter)
+{
+	const struct seccomp_filter *prev = sfilter->prev;
+
+	if (!prev)
+		return;
+
+	bitmap_and(sfilter->cache.allow_native, sfilter->cache.allow_native,
+		   prev->cache.allow_native, SECCOMP_ARCH_NATIVE_NR);
+#ifdef SECCOMP_ARCH_COMPAT
+	bitmap_and(sfilter->cache.allow_compat, sfilter->cache.allow_compat,
+		   prev->cache.allow_compat, SECCOMP_ARCH_COMPAT_NR);
+#endif
+}
+#else
+static inline void seccomp_cache_prepare(struct seccomp_filter *sfilter)
+{
+}
+
+static inline void seccomp_cache_inherit(struct seccomp_filter *sfilter)
+{
+}
+#endif /* SECCOMP_ARCH_NATIVE */
+
 /**
  * seccomp_prepare_filter: Prepares a seccomp filter for use.
  * @fprog: BPF program to install
@@ -347,7 +548,12 @@ static struct seccomp_filter *seccomp_prepare_filter(struct sock_fprog *fprog)
 {
 	struct seccomp_filter *sfilter;
 	int ret;
+#ifdef SECCOMP_ARCH_NATIVE
+	/* The action cache is built from the original program */
+	const bool save_orig = true;
+#else
 	const bool save_orig = config_enabled(CONFIG_CHECKPOINT_RESTORE);
+#endif
 
 	if (fprog->len == 0 || fprog->len > BPF_MAXINSNS)
 		return ERR_PTR(-EINVAL);
@@ -378,6 +584,7 @@ static struct seccomp_filter *seccomp_prepare_filter(struct sock_fprog *fprog)
 	}
 
 	atomic_set(&sfilter->usage, 1);
+	seccomp_cache_prepare(sfilter);
 
 	return sfilter;
 }
@@ -448,6 +655,7 @@ static long seccomp_attach_filter(unsigned int flags,
 	 * task reference.
 	 */
 	filter->prev = current->seccomp.filter;
+	seccomp_cache_inherit(filter);
 	current->seccomp.filter = filter;
 
 	/* Now that the new filter is in place, synchronize to all threads. */
@@ -10,6 +10,7 @@
 #include <linux/mman.h>
 #include <linux/reboot.h>
 #include <linux/prctl.h>
+#include <linux/futex.h>
 #include <linux/highuid.h>
 #include <linux/fs.h>
 #include <linux/kmod.h>
@@ -2270,6 +2271,26 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 	case PR_GET_FP_MODE:
 		error = GET_FP_MODE(me);
 		break;
+	case PR_FUTEX_HASH:
+		if (arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_prctl(arg2, arg3);
+		break;
+	case PR_SET_FORK_SHARE_PTES:
+		if (!IS_ENABLED(CONFIG_SHARED_PTE_TABLES))
+			return -EINVAL;
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (arg2)
+			set_bit(MMF_SHARE_PTE_TABLES, &me->mm->flags);
+		else
+			clear_bit(MMF_SHARE_PTE_TABLES, &me->mm->flags);
+		break;
+	case PR_GET_FORK_SHARE_PTES:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = test_bit(MMF_SHARE_PTE_TABLES, &me->mm->flags);
+		break;
 	default:
 		error = -EINVAL;
 		break;
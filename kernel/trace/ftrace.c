@@ -469,6 +469,15 @@ static void ftrace_update_pid_func(void)
 }
 
 #ifdef CONFIG_FUNCTION_PROFILER
+#ifdef CONFIG_FUNCTION_GRAPH_TRACER
+/*
+ * log2 histogram of the call durations in usecs: hist[0] counts the calls
+ * shorter than 1 usec, hist[n] the ones in [2^(n-1), 2^n) usecs and the
+ * last slot everything slower.
+ */
+#define FTRACE_PROFILE_HIST	16
+#endif
+
 struct ftrace_profile {
 	struct hlist_node		node;
 	unsigned long			ip;
@@ -476,6 +485,7 @@ struct ftrace_profile {
 #ifdef CONFIG_FUNCTION_GRAPH_TRACER
 	unsigned long long		time;
 	unsigned long long		time_squared;
+	unsigned int			hist[FTRACE_PROFILE_HIST];
 #endif
 };
 
@@ -491,6 +501,9 @@ struct ftrace_profile_stat {
 	struct ftrace_profile_page	*pages;
 	struct ftrace_profile_page	*start;
 	struct tracer_stat		stat;
+#ifdef CONFIG_FUNCTION_GRAPH_TRACER
+	struct tracer_stat		hist_stat;
+#endif
 };
 
 #define PROFILE_RECORDS_SIZE						\
@@ -545,6 +558,17 @@ static void *function_stat_start(struct tracer_stat *trace)
 }
 
 #ifdef CONFIG_FUNCTION_GRAPH_TRACER
+static void *function_hist_start(struct tracer_stat *trace)
+{
+	struct ftrace_profile_stat *stat =
+		container_of(trace, struct ftrace_profile_stat, hist_stat);
+
+	if (!stat || !stat->start)
+		return NULL;
+
+	return function_stat_next(&stat->start->records[0], 0);
+}
+
 /* function graph compares on total time */
 static int function_stat_cmp(void *p1, void *p2)
 {
@@ -652,6 +676,58 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_FUNCTION_GRAPH_TRACER
+static int function_hist_headers(struct seq_file *m)
+{
+	char label[16];
+	int i;
+
+	seq_puts(m, "  Function                               Hit  usecs:");
+	for (i = 0; i < FTRACE_PROFILE_HIST; i++) {
+		if (!i)
+			snprintf(label, sizeof(label), "<1");
+		else
+			snprintf(label, sizeof(label), "%lu%s", 1UL << (i - 1),
+				 i == FTRACE_PROFILE_HIST - 1 ? "+" : "");
+		seq_printf(m, " %6s", label);
+	}
+	seq_puts(m, "\n  --------                               ---\n");
+	return 0;
+}
+
+static int function_hist_show(struct seq_file *m, void *v)
+{
+	struct ftrace_profile *rec = v;
+	char str[KSYM_SYMBOL_LEN];
+	unsigned long long avg;
+	int ret = 0;
+	int i;
+
+	mutex_lock(&ftrace_profile_lock);
+
+	/* we raced with function_profile_reset() */
+	if (unlikely(rec->counter == 0)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	avg = rec->time;
+	do_div(avg, rec->counter);
+	if (tracing_thresh && (avg < tracing_thresh))
+		goto out;
+
+	kallsyms_lookup(rec->ip, NULL, NULL, NULL, str);
+	seq_printf(m, "  %-30.30s  %10lu      ", str, rec->counter);
+	for (i = 0; i < FTRACE_PROFILE_HIST; i++)
+		seq_printf(m, " %6u", rec->hist[i]);
+	seq_putc(m, '\n');
+out:
+	mutex_unlock(&ftrace_profile_lock);
+
+	return ret;
+}
+#endif
+
 static void ftrace_profile_reset(struct ftrace_profile_stat *stat)
 {
 	struct ftrace_profile_page *pg;
@@ -910,8 +986,12 @@ static void profile_graph_return(struct ftrace_graph_ret *trace)
 
 	rec = ftrace_find_profiled_func(stat, trace->func);
 	if (rec) {
+		unsigned long long usecs = div_u64(calltime, NSEC_PER_USEC);
+		int slot = usecs ? min(fls64(usecs), FTRACE_PROFILE_HIST - 1) : 0;
+
 		rec->time += calltime;
 		rec->time_squared += calltime * calltime;
+		rec->hist[slot]++;
 	}
 
  out:
@@ -1019,6 +1099,42 @@ static struct tracer_stat function_stats __initdata = {
 	.stat_show	= function_stat_show
 };
 
+#ifdef CONFIG_FUNCTION_GRAPH_TRACER
+static struct tracer_stat function_hists __initdata = {
+	.name		= "function_hists",
+	.stat_start	= function_hist_start,
+	.stat_next	= function_stat_next,
+	.stat_cmp	= function_stat_cmp,
+	.stat_headers	= function_hist_headers,
+	.stat_show	= function_hist_show
+};
+
+static __init int ftrace_profile_hist_tracefs(struct ftrace_profile_stat *stat,
+					      int cpu)
+{
+	char *name;
+	int ret;
+
+	name = kasprintf(GFP_KERNEL, "function_hist%d", cpu);
+	if (!name)
+		return -ENOMEM;
+
+	stat->hist_stat = function_hists;
+	stat->hist_stat.name = name;
+	ret = register_stat_tracer(&stat->hist_stat);
+	if (ret)
+		kfree(name);
+
+	return ret;
+}
+#else
+static __init int ftrace_profile_hist_tracefs(struct ftrace_profile_stat *stat,
+					      int cpu)
+{
+	return 0;
+}
+#endif
+
 static __init void ftrace_profile_tracefs(struct dentry *d_tracer)
 {
 	struct ftrace_profile_stat *stat;
@@ -1051,6 +1167,13 @@ static __init void ftrace_profile_tracefs(struct dentry *d_tracer)
 			kfree(name);
 			return;
 		}
+
+		if (ftrace_profile_hist_tracefs(stat, cpu)) {
+			WARN(1,
+			     "Could not register function histogram for cpu %d\n",
+			     cpu);
+			return;
+		}
 	}
 
 	entry = tracefs_create_file("function_profile_enabled", 0644,
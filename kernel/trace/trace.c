@@ -3940,6 +3940,8 @@ static const char readme_msg[] =
 	"\t            [:size=#entries]\n"
 	"\t            [:pause][:continue][:clear]\n"
 	"\t            [:name=histname1]\n"
+	"\t            [:<var>=<expr>]\n"
+	"\t            [:onmatch(<system>.<event>).<synthetic_event>(param[,param...])]\n"
 	"\t            [if <filter>]\n\n"
 	"\t    When a matching event is hit, an entry is added to a hash\n"
 	"\t    table using the key(s) and value(s) named, and the value of a\n"
@@ -3980,7 +3982,18 @@ static const char readme_msg[] =
 	"\t    The enable_hist and disable_hist triggers can be used to\n"
 	"\t    have one event conditionally start and stop another event's\n"
 	"\t    already-attached hist trigger.  The syntax is analagous to\n"
-	"\t    the enable_event and disable_event triggers.\n"
+	"\t    the enable_event and disable_event triggers.\n\n"
+	"\t    '<var>=<expr>' saves the value of expr, a field, the special\n"
+	"\t    'common_timestamp' (.usecs for microseconds), a '$var'\n"
+	"\t    reference or the sum or difference of two of them, for the\n"
+	"\t    key of the event.  A '$var' used in another trigger is looked\n"
+	"\t    up with that trigger's key and is consumed when read.  Values\n"
+	"\t    can be expressions as well.  'onmatch()' generates the named\n"
+	"\t    synthetic event whenever the variables saved by the given\n"
+	"\t    event are found for the key.  Synthetic events are defined\n"
+	"\t    in synthetic_events:\n"
+	"\t      echo '<name> <type> <field>[; <type> <field>...]' >> synthetic_events\n"
+	"\t    and removed with '!<name>'.\n"
 #endif
 ;
 
@@ -19,13 +19,38 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/stacktrace.h>
+#include <linux/tracefs.h>
 
 #include "tracing_map.h"
 #include "trace.h"
 
+#define SYNTH_SYSTEM		"synthetic"
+#define SYNTH_FIELDS_MAX	16
+
 struct hist_field;
+struct hist_trigger_data;
+
+typedef u64 (*hist_field_fn_t) (struct hist_field *field, void *event,
+				 u64 *var_ref_vals);
+
+#define HIST_FIELD_OPERANDS_MAX	2
+
+enum field_op_id {
+	FIELD_OP_NONE,
+	FIELD_OP_PLUS,
+	FIELD_OP_MINUS,
+};
 
-typedef u64 (*hist_field_fn_t) (struct hist_field *field, void *event);
+/*
+ * A variable saved by one hist trigger, or a reference to one:
+ * hist_data is the trigger whose tracing_map holds the value and idx
+ * is the value's var index in that map.
+ */
+struct hist_var {
+	char				*name;
+	struct hist_trigger_data	*hist_data;
+	unsigned int			idx;
+};
 
 struct hist_field {
 	struct ftrace_event_field	*field;
@@ -33,26 +58,36 @@ struct hist_field {
 	hist_field_fn_t			fn;
 	unsigned int			size;
 	unsigned int			offset;
+	struct hist_trigger_data	*hist_data;
+	struct hist_field		*operands[HIST_FIELD_OPERANDS_MAX];
+	enum field_op_id		operator;
+	struct hist_var			var;
+	unsigned int			var_ref_idx;
+	char				*name;
 };
 
-static u64 hist_field_none(struct hist_field *field, void *event)
+static u64 hist_field_none(struct hist_field *field, void *event,
+			   u64 *var_ref_vals)
 {
 	return 0;
 }
 
-static u64 hist_field_counter(struct hist_field *field, void *event)
+static u64 hist_field_counter(struct hist_field *field, void *event,
+			      u64 *var_ref_vals)
 {
 	return 1;
 }
 
-static u64 hist_field_string(struct hist_field *hist_field, void *event)
+static u64 hist_field_string(struct hist_field *hist_field, void *event,
+			     u64 *var_ref_vals)
 {
 	char *addr = (char *)(event + hist_field->field->offset);
 
 	return (u64)(unsigned long)addr;
 }
 
-static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
+static u64 hist_field_dynstring(struct hist_field *hist_field, void *event,
+				u64 *var_ref_vals)
 {
 	u32 str_item = *(u32 *)(event + hist_field->field->offset);
 	int str_loc = str_item & 0xffff;
@@ -61,22 +96,51 @@ static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
 	return (u64)(unsigned long)addr;
 }
 
-static u64 hist_field_pstring(struct hist_field *hist_field, void *event)
+static u64 hist_field_pstring(struct hist_field *hist_field, void *event,
+			      u64 *var_ref_vals)
 {
 	char **addr = (char **)(event + hist_field->field->offset);
 
 	return (u64)(unsigned long)*addr;
 }
 
-static u64 hist_field_log2(struct hist_field *hist_field, void *event)
+static u64 hist_field_log2(struct hist_field *hist_field, void *event,
+			   u64 *var_ref_vals)
 {
 	u64 val = *(u64 *)(event + hist_field->field->offset);
 
 	return (u64) ilog2(roundup_pow_of_two(val));
 }
 
+static u64 hist_field_plus(struct hist_field *hist_field, void *event,
+			   u64 *var_ref_vals)
+{
+	struct hist_field *operand1 = hist_field->operands[0];
+	struct hist_field *operand2 = hist_field->operands[1];
+
+	return operand1->fn(operand1, event, var_ref_vals) +
+		operand2->fn(operand2, event, var_ref_vals);
+}
+
+static u64 hist_field_minus(struct hist_field *hist_field, void *event,
+			    u64 *var_ref_vals)
+{
+	struct hist_field *operand1 = hist_field->operands[0];
+	struct hist_field *operand2 = hist_field->operands[1];
+
+	return operand1->fn(operand1, event, var_ref_vals) -
+		operand2->fn(operand2, event, var_ref_vals);
+}
+
+static u64 hist_field_var_ref(struct hist_field *hist_field, void *event,
+			      u64 *var_ref_vals)
+{
+	return var_ref_vals[hist_field->var_ref_idx];
+}
+
 #define DEFINE_HIST_FIELD_FN(type)					\
-static u64 hist_field_##type(struct hist_field *hist_field, void *event)\
+static u64 hist_field_##type(struct hist_field *hist_field, void *event,\
+			     u64 *var_ref_vals)				\
 {									\
 	type *addr = (type *)(event + hist_field->field->offset);	\
 									\
@@ -119,8 +183,15 @@ enum hist_field_flags {
 	HIST_FIELD_FL_SYSCALL		= 128,
 	HIST_FIELD_FL_STACKTRACE	= 256,
 	HIST_FIELD_FL_LOG2		= 512,
+	HIST_FIELD_FL_TIMESTAMP		= 1024,
+	HIST_FIELD_FL_TIMESTAMP_USECS	= 2048,
+	HIST_FIELD_FL_VAR		= 4096,
+	HIST_FIELD_FL_VAR_REF		= 8192,
+	HIST_FIELD_FL_EXPR		= 16384,
 };
 
+#define HIST_ACTIONS_MAX	8
+
 struct hist_trigger_attrs {
 	char		*keys_str;
 	char		*vals_str;
@@ -130,6 +201,42 @@ struct hist_trigger_attrs {
 	bool		cont;
 	bool		clear;
 	unsigned int	map_bits;
+
+	char		*assignment_str[TRACING_MAP_VARS_MAX];
+	unsigned int	n_assignments;
+
+	char		*action_str[HIST_ACTIONS_MAX];
+	unsigned int	n_actions;
+};
+
+struct synth_field {
+	char *type;
+	char *name;
+	bool is_signed;
+};
+
+struct synth_event {
+	struct list_head			list;
+	int					ref;
+	char					*name;
+	struct synth_field			**fields;
+	unsigned int				n_fields;
+	struct trace_event_class		class;
+	struct trace_event_call			call;
+	struct tracepoint			*tp;
+};
+
+/*
+ * onmatch(system.event).synth_event(param, ...): generate synth_event
+ * with the params whenever this trigger's event matches a key for
+ * which the variables saved by system.event could be resolved.
+ */
+struct action_data {
+	char			*match_event_system;
+	char			*match_event;
+	struct synth_event	*synth_event;
+	struct hist_field	*params[SYNTH_FIELDS_MAX];
+	unsigned int		n_params;
 };
 
 struct hist_trigger_data {
@@ -143,6 +250,18 @@ struct hist_trigger_data {
 	struct trace_event_file		*event_file;
 	struct hist_trigger_attrs	*attrs;
 	struct tracing_map		*map;
+
+	struct hist_field		*var_fields[TRACING_MAP_VARS_MAX];
+	unsigned int			n_vars;
+	struct hist_field		*var_refs[TRACING_MAP_VARS_MAX];
+	unsigned int			n_var_refs;
+	/* number of var refs from other triggers to our variables */
+	unsigned int			n_var_users;
+	/* where the variables we reference are looked up, if set */
+	struct trace_event_file		*match_file;
+
+	struct action_data		*actions[HIST_ACTIONS_MAX];
+	unsigned int			n_actions;
 };
 
 static hist_field_fn_t select_value_fn(int field_size, int field_is_signed)
@@ -179,109 +298,762 @@ static hist_field_fn_t select_value_fn(int field_size, int field_is_signed)
 	return fn;
 }
 
-static int parse_map_size(char *str)
+static u64 hist_field_timestamp(struct hist_field *hist_field, void *event,
+				u64 *var_ref_vals)
 {
-	unsigned long size, map_bits;
-	int ret;
+	struct trace_array *tr = hist_field->hist_data->event_file->tr;
+	u64 ts;
 
-	strsep(&str, "=");
-	if (!str) {
-		ret = -EINVAL;
-		goto out;
+	/* the same clock the buffer timestamps its events with */
+	ts = ring_buffer_time_stamp(tr->trace_buffer.buffer,
+				    raw_smp_processor_id());
+	if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
+		ts = ns2usecs(ts);
+
+	return ts;
+}
+
+/*
+ * Synthetic events are defined by writing to the synthetic_events
+ * file and are generated only by hist trigger actions.  All fields
+ * are numeric and stored as u64s.
+ */
+struct synth_trace_event {
+	struct trace_entry	ent;
+	u64			fields[];
+};
+
+static LIST_HEAD(synth_event_list);
+static DEFINE_MUTEX(synth_event_mutex);
+
+static const char * const synth_field_types[] = {
+	"s64", "u64", "s32", "u32", "s16", "u16", "s8", "u8",
+	"char", "unsigned char", "short", "unsigned short",
+	"int", "unsigned int", "long", "unsigned long",
+	"pid_t", "gfp_t", "bool",
+};
+
+static bool synth_field_signed(const char *type)
+{
+	if (strncmp(type, "u", 1) == 0 || strcmp(type, "gfp_t") == 0 ||
+	    strcmp(type, "bool") == 0)
+		return false;
+
+	return true;
+}
+
+static bool synth_field_type_valid(const char *type)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(synth_field_types); i++) {
+		if (strcmp(type, synth_field_types[i]) == 0)
+			return true;
 	}
 
-	ret = kstrtoul(str, 0, &size);
-	if (ret)
-		goto out;
+	return false;
+}
+
+static int synth_event_define_fields(struct trace_event_call *call)
+{
+	struct synth_event *event = call->data;
+	unsigned int i, offset;
+	int ret = 0;
+
+	offset = offsetof(struct synth_trace_event, fields);
+
+	for (i = 0; i < event->n_fields; i++) {
+		ret = trace_define_field(call, event->fields[i]->type,
+					 event->fields[i]->name, offset,
+					 sizeof(u64), event->fields[i]->is_signed,
+					 FILTER_OTHER);
+		if (ret)
+			break;
+		offset += sizeof(u64);
+	}
 
-	map_bits = ilog2(roundup_pow_of_two(size));
-	if (map_bits < TRACING_MAP_BITS_MIN ||
-	    map_bits > TRACING_MAP_BITS_MAX)
-		ret = -EINVAL;
-	else
-		ret = map_bits;
- out:
 	return ret;
 }
 
-static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
+static enum print_line_t print_synth_event(struct trace_iterator *iter,
+					   int flags,
+					   struct trace_event *event)
 {
-	if (!attrs)
+	struct trace_seq *s = &iter->seq;
+	struct synth_trace_event *entry;
+	struct synth_event *se;
+	unsigned int i;
+
+	entry = (struct synth_trace_event *)iter->ent;
+	se = container_of(event, struct synth_event, call.event);
+
+	trace_seq_printf(s, "%s: ", se->name);
+
+	for (i = 0; i < se->n_fields; i++) {
+		if (trace_seq_has_overflowed(s))
+			goto end;
+
+		trace_seq_printf(s, se->fields[i]->is_signed ?
+				 "%s=%lld%s" : "%s=%llu%s",
+				 se->fields[i]->name, entry->fields[i],
+				 i == se->n_fields - 1 ? "" : " ");
+	}
+end:
+	trace_seq_putc(s, '\n');
+
+	return trace_handle_return(s);
+}
+
+static struct trace_event_functions synth_event_funcs = {
+	.trace		= print_synth_event
+};
+
+static notrace void trace_event_raw_event_synth(void *__data, u64 *vals)
+{
+	struct trace_event_file *trace_file = __data;
+	struct synth_trace_event *entry;
+	struct trace_event_buffer fbuffer;
+	struct synth_event *event;
+	unsigned int i;
+
+	event = trace_file->event_call->data;
+
+	if (trace_trigger_soft_disabled(trace_file))
 		return;
 
-	kfree(attrs->name);
-	kfree(attrs->sort_key_str);
-	kfree(attrs->keys_str);
-	kfree(attrs->vals_str);
-	kfree(attrs);
+	entry = trace_event_buffer_reserve(&fbuffer, trace_file,
+					   sizeof(*entry) +
+					   event->n_fields * sizeof(u64));
+	if (!entry)
+		return;
+
+	for (i = 0; i < event->n_fields; i++)
+		entry->fields[i] = vals[i];
+
+	trace_event_buffer_commit(&fbuffer);
 }
 
-static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
+typedef void (*synth_probe_func_t) (void *__data, u64 *vals);
+
+static notrace void trace_synth(struct synth_event *event, u64 *vals)
 {
-	struct hist_trigger_attrs *attrs;
-	int ret = 0;
+	struct tracepoint *tp = event->tp;
 
-	attrs = kzalloc(sizeof(*attrs), GFP_KERNEL);
-	if (!attrs)
+	if (unlikely(static_key_enabled(&tp->key))) {
+		struct tracepoint_func *probe_func_ptr;
+		synth_probe_func_t probe_func;
+		void *__data;
+
+		if (!(cpu_online(raw_smp_processor_id())))
+			return;
+
+		probe_func_ptr = rcu_dereference_sched((tp)->funcs);
+		if (probe_func_ptr) {
+			do {
+				probe_func = probe_func_ptr->func;
+				__data = probe_func_ptr->data;
+				probe_func(__data, vals);
+			} while ((++probe_func_ptr)->func);
+		}
+	}
+}
+
+static int synth_event_reg(struct trace_event_call *call,
+			   enum trace_reg type, void *data)
+{
+	switch (type) {
+	case TRACE_REG_REGISTER:
+	case TRACE_REG_UNREGISTER:
+		return trace_event_reg(call, type, data);
+#ifdef CONFIG_PERF_EVENTS
+	case TRACE_REG_PERF_REGISTER:
+		/* no perf probe, synthetic events only go to the buffer */
+		return -ENODEV;
+#endif
+	default:
+		return 0;
+	}
+}
+
+static int __set_synth_event_print_fmt(struct synth_event *event,
+				       char *buf, int len)
+{
+	int pos = 0;
+	unsigned int i;
+
+	/* When len=0, we just calculate the needed length */
+#define LEN_OR_ZERO (len ? len - pos : 0)
+
+	pos += snprintf(buf + pos, LEN_OR_ZERO, "\"");
+	for (i = 0; i < event->n_fields; i++) {
+		pos += snprintf(buf + pos, LEN_OR_ZERO, "%s=%s%s",
+				event->fields[i]->name,
+				event->fields[i]->is_signed ? "%lld" : "%llu",
+				i == event->n_fields - 1 ? "" : " ");
+	}
+	pos += snprintf(buf + pos, LEN_OR_ZERO, "\"");
+
+	for (i = 0; i < event->n_fields; i++) {
+		pos += snprintf(buf + pos, LEN_OR_ZERO,
+				", REC->%s", event->fields[i]->name);
+	}
+
+#undef LEN_OR_ZERO
+
+	/* return the length of print_fmt */
+	return pos;
+}
+
+static int set_synth_event_print_fmt(struct trace_event_call *call)
+{
+	struct synth_event *event = call->data;
+	char *print_fmt;
+	int len;
+
+	/* First: called with 0 length to calculate the needed length */
+	len = __set_synth_event_print_fmt(event, NULL, 0);
+
+	print_fmt = kmalloc(len + 1, GFP_KERNEL);
+	if (!print_fmt)
+		return -ENOMEM;
+
+	/* Second: actually write the @print_fmt */
+	__set_synth_event_print_fmt(event, print_fmt, len + 1);
+	call->print_fmt = print_fmt;
+
+	return 0;
+}
+
+static void free_synth_field(struct synth_field *field)
+{
+	kfree(field->type);
+	kfree(field->name);
+	kfree(field);
+}
+
+static void free_synth_event(struct synth_event *event)
+{
+	unsigned int i;
+
+	if (!event)
+		return;
+
+	for (i = 0; i < event->n_fields; i++)
+		free_synth_field(event->fields[i]);
+
+	kfree(event->fields);
+	if (event->tp)
+		kfree(event->tp->name);
+	kfree(event->tp);
+	kfree(event->call.print_fmt);
+	kfree(event->name);
+	kfree(event);
+}
+
+static int register_synth_event(struct synth_event *event)
+{
+	struct trace_event_call *call = &event->call;
+	int ret;
+
+	event->tp = kzalloc(sizeof(*event->tp), GFP_KERNEL);
+	if (!event->tp)
+		return -ENOMEM;
+
+	event->tp->name = kstrdup(event->name, GFP_KERNEL);
+	if (!event->tp->name)
+		return -ENOMEM;
+
+	event->class.system = SYNTH_SYSTEM;
+	event->class.reg = synth_event_reg;
+	event->class.probe = trace_event_raw_event_synth;
+	event->class.define_fields = synth_event_define_fields;
+	INIT_LIST_HEAD(&event->class.fields);
+
+	call->class = &event->class;
+	call->event.funcs = &synth_event_funcs;
+	call->flags = TRACE_EVENT_FL_TRACEPOINT;
+	call->tp = event->tp;
+	call->data = event;
+
+	ret = set_synth_event_print_fmt(call);
+	if (ret)
+		return ret;
+
+	ret = register_trace_event(&call->event);
+	if (!ret)
+		return -ENODEV;
+
+	ret = trace_add_event_call(call);
+	if (ret) {
+		pr_warn("Failed to register synthetic event: %s\n",
+			event->name);
+		unregister_trace_event(&call->event);
+	}
+
+	return ret;
+}
+
+/* called with event_mutex or synth_event_mutex held */
+static struct synth_event *find_synth_event(const char *name)
+{
+	struct synth_event *event;
+
+	list_for_each_entry(event, &synth_event_list, list) {
+		if (strcmp(event->name, name) == 0)
+			return event;
+	}
+
+	return NULL;
+}
+
+static struct synth_field *parse_synth_field(char **argv, int argc)
+{
+	struct synth_field *field;
+	char *name, *type;
+	int i, len = 0;
+
+	/* the last word is the field name, the ones before it the type */
+	name = argv[argc - 1];
+
+	for (i = 0; i < argc - 1; i++)
+		len += strlen(argv[i]) + 1;
+
+	field = kzalloc(sizeof(*field), GFP_KERNEL);
+	if (!field)
 		return ERR_PTR(-ENOMEM);
 
-	while (trigger_str) {
-		char *str = strsep(&trigger_str, ":");
+	type = kzalloc(len, GFP_KERNEL);
+	field->name = kstrdup(name, GFP_KERNEL);
+	if (!type || !field->name) {
+		kfree(type);
+		free_synth_field(field);
+		return ERR_PTR(-ENOMEM);
+	}
 
-		if ((strncmp(str, "key=", strlen("key=")) == 0) ||
-		    (strncmp(str, "keys=", strlen("keys=")) == 0))
-			attrs->keys_str = kstrdup(str, GFP_KERNEL);
-		else if ((strncmp(str, "val=", strlen("val=")) == 0) ||
-			 (strncmp(str, "vals=", strlen("vals=")) == 0) ||
-			 (strncmp(str, "values=", strlen("values=")) == 0))
-			attrs->vals_str = kstrdup(str, GFP_KERNEL);
-		else if (strncmp(str, "sort=", strlen("sort=")) == 0)
-			attrs->sort_key_str = kstrdup(str, GFP_KERNEL);
-		else if (strncmp(str, "name=", strlen("name=")) == 0)
-			attrs->name = kstrdup(str, GFP_KERNEL);
-		else if (strcmp(str, "pause") == 0)
-			attrs->pause = true;
-		else if ((strcmp(str, "cont") == 0) ||
-			 (strcmp(str, "continue") == 0))
-			attrs->cont = true;
-		else if (strcmp(str, "clear") == 0)
-			attrs->clear = true;
-		else if (strncmp(str, "size=", strlen("size=")) == 0) {
-			int map_bits = parse_map_size(str);
+	for (i = 0; i < argc - 1; i++) {
+		if (i)
+			strcat(type, " ");
+		strcat(type, argv[i]);
+	}
+	field->type = type;
 
-			if (map_bits < 0) {
-				ret = map_bits;
-				goto free;
-			}
-			attrs->map_bits = map_bits;
+	if (!synth_field_type_valid(type) || !strlen(name)) {
+		free_synth_field(field);
+		return ERR_PTR(-EINVAL);
+	}
+	field->is_signed = synth_field_signed(type);
+
+	return field;
+}
+
+static struct synth_event *alloc_synth_event(char *name, int argc, char **argv)
+{
+	struct synth_event *event;
+	struct synth_field *field;
+	int i, n, first, start = 0, ret = -EINVAL;
+
+	event = kzalloc(sizeof(*event), GFP_KERNEL);
+	if (!event)
+		return ERR_PTR(-ENOMEM);
+
+	event->name = kstrdup(name, GFP_KERNEL);
+	event->fields = kcalloc(SYNTH_FIELDS_MAX, sizeof(*event->fields),
+				GFP_KERNEL);
+	if (!event->name || !event->fields) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	/* "type name" pairs separated by ';', alone or ending a word */
+	for (i = 0; i < argc; i++) {
+		int len = strlen(argv[i]);
+
+		if (strcmp(argv[i], ";") == 0) {
+			n = i - start;
+		} else if (argv[i][len - 1] == ';') {
+			argv[i][len - 1] = '\0';
+			n = i - start + 1;
+		} else if (i == argc - 1) {
+			n = i - start + 1;
 		} else {
-			ret = -EINVAL;
+			continue;
+		}
+
+		first = start;
+		start = i + 1;
+		if (!n)
+			continue;
+
+		if (n < 2 || event->n_fields == SYNTH_FIELDS_MAX)
+			goto free;
+
+		field = parse_synth_field(&argv[first], n);
+		if (IS_ERR(field)) {
+			ret = PTR_ERR(field);
 			goto free;
 		}
+		event->fields[event->n_fields++] = field;
 	}
 
-	if (!attrs->keys_str) {
-		ret = -EINVAL;
+	if (!event->n_fields)
 		goto free;
-	}
 
-	return attrs;
+	return event;
  free:
-	destroy_hist_trigger_attrs(attrs);
+	free_synth_event(event);
 
 	return ERR_PTR(ret);
 }
 
-static inline void save_comm(char *comm, struct task_struct *task)
+static int create_synth_event(int argc, char **argv)
 {
-	if (!task->pid) {
-		strcpy(comm, "<idle>");
-		return;
+	struct synth_event *event;
+	char *name = argv[0];
+	int ret = 0;
+
+	mutex_lock(&synth_event_mutex);
+
+	if (name[0] == '!') {
+		name++;
+
+		mutex_lock(&event_mutex);
+		event = find_synth_event(name);
+		if (!event)
+			ret = -ENOENT;
+		else if (event->ref)
+			ret = -EBUSY;
+		else
+			list_del(&event->list);
+		mutex_unlock(&event_mutex);
+		if (ret)
+			goto out;
+
+		ret = trace_remove_event_call(&event->call);
+		if (ret) {
+			mutex_lock(&event_mutex);
+			list_add(&event->list, &synth_event_list);
+			mutex_unlock(&event_mutex);
+			goto out;
+		}
+		free_synth_event(event);
+		goto out;
 	}
 
-	if (WARN_ON_ONCE(task->pid < 0)) {
-		strcpy(comm, "<XXX>");
-		return;
+	if (argc < 3 || find_synth_event(name)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	event = alloc_synth_event(name, argc - 1, argv + 1);
+	if (IS_ERR(event)) {
+		ret = PTR_ERR(event);
+		goto out;
+	}
+
+	ret = register_synth_event(event);
+	if (ret) {
+		free_synth_event(event);
+		goto out;
+	}
+
+	/* readers in the hist trigger code only hold event_mutex */
+	mutex_lock(&event_mutex);
+	list_add(&event->list, &synth_event_list);
+	mutex_unlock(&event_mutex);
+ out:
+	mutex_unlock(&synth_event_mutex);
+
+	return ret;
+}
+
+static int release_all_synth_events(void)
+{
+	struct synth_event *event, *e;
+	int ret = 0;
+
+	mutex_lock(&synth_event_mutex);
+
+	mutex_lock(&event_mutex);
+	list_for_each_entry(event, &synth_event_list, list) {
+		if (event->ref) {
+			ret = -EBUSY;
+			break;
+		}
+	}
+	mutex_unlock(&event_mutex);
+	if (ret)
+		goto out;
+
+	list_for_each_entry_safe(event, e, &synth_event_list, list) {
+		ret = trace_remove_event_call(&event->call);
+		if (ret)
+			break;
+
+		mutex_lock(&event_mutex);
+		list_del(&event->list);
+		mutex_unlock(&event_mutex);
+
+		free_synth_event(event);
+	}
+ out:
+	mutex_unlock(&synth_event_mutex);
+
+	return ret;
+}
+
+static void *synth_events_seq_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&synth_event_mutex);
+
+	return seq_list_start(&synth_event_list, *pos);
+}
+
+static void *synth_events_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	return seq_list_next(v, &synth_event_list, pos);
+}
+
+static void synth_events_seq_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&synth_event_mutex);
+}
+
+static int synth_events_seq_show(struct seq_file *m, void *v)
+{
+	struct synth_event *event = v;
+	unsigned int i;
+
+	seq_printf(m, "%s\t", event->name);
+
+	for (i = 0; i < event->n_fields; i++) {
+		seq_printf(m, "%s %s%s", event->fields[i]->type,
+			   event->fields[i]->name,
+			   i == event->n_fields - 1 ? "" : "; ");
+	}
+
+	seq_putc(m, '\n');
+
+	return 0;
+}
+
+static const struct seq_operations synth_events_seq_op = {
+	.start  = synth_events_seq_start,
+	.next   = synth_events_seq_next,
+	.stop   = synth_events_seq_stop,
+	.show   = synth_events_seq_show
+};
+
+static int synth_events_open(struct inode *inode, struct file *file)
+{
+	int ret;
+
+	if ((file->f_mode & FMODE_WRITE) && (file->f_flags & O_TRUNC)) {
+		ret = release_all_synth_events();
+		if (ret < 0)
+			return ret;
+	}
+
+	return seq_open(file, &synth_events_seq_op);
+}
+
+#define SYNTH_WRITE_BUFSIZE	4096
+
+static ssize_t synth_events_write(struct file *file,
+				  const char __user *buffer,
+				  size_t count, loff_t *ppos)
+{
+	size_t done = 0, size;
+	char *kbuf, *tmp;
+	char **argv;
+	int argc, ret = 0;
+
+	kbuf = kmalloc(SYNTH_WRITE_BUFSIZE, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	while (done < count) {
+		size = count - done;
+
+		if (size >= SYNTH_WRITE_BUFSIZE)
+			size = SYNTH_WRITE_BUFSIZE - 1;
+
+		if (copy_from_user(kbuf, buffer + done, size)) {
+			ret = -EFAULT;
+			goto out;
+		}
+		kbuf[size] = '\0';
+		tmp = strchr(kbuf, '\n');
+
+		if (tmp) {
+			*tmp = '\0';
+			size = tmp - kbuf + 1;
+		} else if (done + size < count) {
+			pr_warn("Line length is too long: Should be less than %d\n",
+				SYNTH_WRITE_BUFSIZE);
+			ret = -EINVAL;
+			goto out;
+		}
+		done += size;
+
+		/* Remove comments */
+		tmp = strchr(kbuf, '#');
+		if (tmp)
+			*tmp = '\0';
+
+		argv = argv_split(GFP_KERNEL, kbuf, &argc);
+		if (!argv) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		if (argc)
+			ret = create_synth_event(argc, argv);
+
+		argv_free(argv);
+		if (ret)
+			goto out;
+	}
+	ret = done;
+ out:
+	kfree(kbuf);
+
+	return ret;
+}
+
+static const struct file_operations synth_events_fops = {
+	.open           = synth_events_open,
+	.write		= synth_events_write,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = seq_release,
+};
+
+static int parse_map_size(char *str)
+{
+	unsigned long size, map_bits;
+	int ret;
+
+	strsep(&str, "=");
+	if (!str) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = kstrtoul(str, 0, &size);
+	if (ret)
+		goto out;
+
+	map_bits = ilog2(roundup_pow_of_two(size));
+	if (map_bits < TRACING_MAP_BITS_MIN ||
+	    map_bits > TRACING_MAP_BITS_MAX)
+		ret = -EINVAL;
+	else
+		ret = map_bits;
+ out:
+	return ret;
+}
+
+static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
+{
+	unsigned int i;
+
+	if (!attrs)
+		return;
+
+	for (i = 0; i < attrs->n_assignments; i++)
+		kfree(attrs->assignment_str[i]);
+
+	for (i = 0; i < attrs->n_actions; i++)
+		kfree(attrs->action_str[i]);
+
+	kfree(attrs->name);
+	kfree(attrs->sort_key_str);
+	kfree(attrs->keys_str);
+	kfree(attrs->vals_str);
+	kfree(attrs);
+}
+
+static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
+{
+	struct hist_trigger_attrs *attrs;
+	int ret = 0;
+
+	attrs = kzalloc(sizeof(*attrs), GFP_KERNEL);
+	if (!attrs)
+		return ERR_PTR(-ENOMEM);
+
+	while (trigger_str) {
+		char *str = strsep(&trigger_str, ":");
+
+		if ((strncmp(str, "key=", strlen("key=")) == 0) ||
+		    (strncmp(str, "keys=", strlen("keys=")) == 0))
+			attrs->keys_str = kstrdup(str, GFP_KERNEL);
+		else if ((strncmp(str, "val=", strlen("val=")) == 0) ||
+			 (strncmp(str, "vals=", strlen("vals=")) == 0) ||
+			 (strncmp(str, "values=", strlen("values=")) == 0))
+			attrs->vals_str = kstrdup(str, GFP_KERNEL);
+		else if (strncmp(str, "sort=", strlen("sort=")) == 0)
+			attrs->sort_key_str = kstrdup(str, GFP_KERNEL);
+		else if (strncmp(str, "name=", strlen("name=")) == 0)
+			attrs->name = kstrdup(str, GFP_KERNEL);
+		else if (strcmp(str, "pause") == 0)
+			attrs->pause = true;
+		else if ((strcmp(str, "cont") == 0) ||
+			 (strcmp(str, "continue") == 0))
+			attrs->cont = true;
+		else if (strcmp(str, "clear") == 0)
+			attrs->clear = true;
+		else if (strncmp(str, "size=", strlen("size=")) == 0) {
+			int map_bits = parse_map_size(str);
+
+			if (map_bits < 0) {
+				ret = map_bits;
+				goto free;
+			}
+			attrs->map_bits = map_bits;
+		} else if (strncmp(str, "onmatch(", strlen("onmatch(")) == 0) {
+			if (attrs->n_actions >= HIST_ACTIONS_MAX) {
+				ret = -EINVAL;
+				goto free;
+			}
+			attrs->action_str[attrs->n_actions++] =
+				kstrdup(str, GFP_KERNEL);
+		} else if (strchr(str, '=')) {
+			/* var=expr: save the value of expr in var */
+			if (attrs->n_assignments >= TRACING_MAP_VARS_MAX) {
+				ret = -EINVAL;
+				goto free;
+			}
+			attrs->assignment_str[attrs->n_assignments++] =
+				kstrdup(str, GFP_KERNEL);
+		} else {
+			ret = -EINVAL;
+			goto free;
+		}
+	}
+
+	if (!attrs->keys_str) {
+		ret = -EINVAL;
+		goto free;
+	}
+
+	return attrs;
+ free:
+	destroy_hist_trigger_attrs(attrs);
+
+	return ERR_PTR(ret);
+}
+
+static inline void save_comm(char *comm, struct task_struct *task)
+{
+	if (!task->pid) {
+		strcpy(comm, "<idle>");
+		return;
+	}
+
+	if (WARN_ON_ONCE(task->pid < 0)) {
+		strcpy(comm, "<XXX>");
+		return;
 	}
 
 	memcpy(comm, task->comm, TASK_COMM_LEN);
@@ -292,128 +1064,644 @@ static void hist_trigger_elt_comm_free(struct tracing_map_elt *elt)
 	kfree((char *)elt->private_data);
 }
 
-static int hist_trigger_elt_comm_alloc(struct tracing_map_elt *elt)
+static int hist_trigger_elt_comm_alloc(struct tracing_map_elt *elt)
+{
+	struct hist_trigger_data *hist_data = elt->map->private_data;
+	struct hist_field *key_field;
+	unsigned int i;
+
+	for_each_hist_key_field(i, hist_data) {
+		key_field = hist_data->fields[i];
+
+		if (key_field->flags & HIST_FIELD_FL_EXECNAME) {
+			unsigned int size = TASK_COMM_LEN + 1;
+
+			elt->private_data = kzalloc(size, GFP_KERNEL);
+			if (!elt->private_data)
+				return -ENOMEM;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void hist_trigger_elt_comm_copy(struct tracing_map_elt *to,
+				       struct tracing_map_elt *from)
+{
+	char *comm_from = from->private_data;
+	char *comm_to = to->private_data;
+
+	if (comm_from)
+		memcpy(comm_to, comm_from, TASK_COMM_LEN + 1);
+}
+
+static void hist_trigger_elt_comm_init(struct tracing_map_elt *elt)
+{
+	char *comm = elt->private_data;
+
+	if (comm)
+		save_comm(comm, current);
+}
+
+static const struct tracing_map_ops hist_trigger_elt_comm_ops = {
+	.elt_alloc	= hist_trigger_elt_comm_alloc,
+	.elt_copy	= hist_trigger_elt_comm_copy,
+	.elt_free	= hist_trigger_elt_comm_free,
+	.elt_init	= hist_trigger_elt_comm_init,
+};
+
+static void destroy_hist_field(struct hist_field *hist_field)
+{
+	unsigned int i;
+
+	if (!hist_field)
+		return;
+
+	for (i = 0; i < HIST_FIELD_OPERANDS_MAX; i++)
+		destroy_hist_field(hist_field->operands[i]);
+
+	/* a reference to our own variables doesn't pin us */
+	if ((hist_field->flags & HIST_FIELD_FL_VAR_REF) &&
+	    hist_field->var.hist_data &&
+	    hist_field->var.hist_data != hist_field->hist_data)
+		hist_field->var.hist_data->n_var_users--;
+
+	kfree(hist_field->var.name);
+	kfree(hist_field->name);
+	kfree(hist_field);
+}
+
+static struct hist_field *create_hist_field(struct hist_trigger_data *hist_data,
+					    struct ftrace_event_field *field,
+					    unsigned long flags)
+{
+	struct hist_field *hist_field;
+
+	if (field && is_function_field(field))
+		return NULL;
+
+	hist_field = kzalloc(sizeof(struct hist_field), GFP_KERNEL);
+	if (!hist_field)
+		return NULL;
+
+	hist_field->hist_data = hist_data;
+
+	if (flags & (HIST_FIELD_FL_EXPR | HIST_FIELD_FL_VAR_REF))
+		goto out; /* the caller sets fn */
+
+	if (flags & HIST_FIELD_FL_TIMESTAMP) {
+		hist_field->fn = hist_field_timestamp;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_HITCOUNT) {
+		hist_field->fn = hist_field_counter;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_STACKTRACE) {
+		hist_field->fn = hist_field_none;
+		goto out;
+	}
+
+	if (flags & HIST_FIELD_FL_LOG2) {
+		hist_field->fn = hist_field_log2;
+		goto out;
+	}
+
+	if (WARN_ON_ONCE(!field))
+		goto out;
+
+	if (is_string_field(field)) {
+		flags |= HIST_FIELD_FL_STRING;
+
+		if (field->filter_type == FILTER_STATIC_STRING)
+			hist_field->fn = hist_field_string;
+		else if (field->filter_type == FILTER_DYN_STRING)
+			hist_field->fn = hist_field_dynstring;
+		else
+			hist_field->fn = hist_field_pstring;
+	} else {
+		hist_field->fn = select_value_fn(field->size,
+						 field->is_signed);
+		if (!hist_field->fn) {
+			destroy_hist_field(hist_field);
+			return NULL;
+		}
+	}
+ out:
+	hist_field->field = field;
+	hist_field->flags = flags;
+
+	return hist_field;
+}
+
+static void destroy_hist_fields(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < TRACING_MAP_FIELDS_MAX; i++) {
+		if (hist_data->fields[i]) {
+			destroy_hist_field(hist_data->fields[i]);
+			hist_data->fields[i] = NULL;
+		}
+	}
+}
+
+static const char *hist_field_name(struct hist_field *hist_field)
+{
+	if (hist_field->field)
+		return hist_field->field->name;
+
+	if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP)
+		return "common_timestamp";
+
+	if (hist_field->flags & HIST_FIELD_FL_VAR_REF)
+		return hist_field->var.name;
+
+	if (hist_field->name)
+		return hist_field->name;
+
+	return "";
+}
+
+static struct hist_field *find_var_field(struct hist_trigger_data *hist_data,
+					 const char *var_name)
+{
+	struct hist_field *var_field;
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		var_field = hist_data->var_fields[i];
+
+		if (strcmp(var_field->var.name, var_name) == 0)
+			return var_field;
+	}
+
+	return NULL;
+}
+
+static struct hist_field *find_file_var(struct trace_event_file *file,
+					const char *var_name)
+{
+	struct event_trigger_data *test;
+	struct hist_field *var_field;
+
+	list_for_each_entry_rcu(test, &file->triggers, list) {
+		if (test->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			var_field = find_var_field(test->private_data, var_name);
+			if (var_field)
+				return var_field;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Look a variable up in this trigger, then in the triggers of the
+ * onmatch() event if there is one, else in the triggers of every event
+ * in the trace array, which must define it only once.  Called with
+ * event_mutex held.
+ */
+static struct hist_field *find_var(struct hist_trigger_data *hist_data,
+				   const char *var_name)
+{
+	struct trace_array *tr = hist_data->event_file->tr;
+	struct hist_field *var_field, *found = NULL;
+	struct trace_event_file *file;
+
+	var_field = find_var_field(hist_data, var_name);
+	if (var_field)
+		return var_field;
+
+	if (hist_data->match_file)
+		return find_file_var(hist_data->match_file, var_name);
+
+	list_for_each_entry(file, &tr->events, list) {
+		var_field = find_file_var(file, var_name);
+		if (!var_field)
+			continue;
+		if (found)
+			return NULL;
+		found = var_field;
+	}
+
+	return found;
+}
+
+static struct hist_field *create_var_ref(struct hist_trigger_data *hist_data,
+					 struct hist_field *var_field)
+{
+	struct hist_field *ref_field;
+
+	if (hist_data->n_var_refs >= TRACING_MAP_VARS_MAX)
+		return NULL;
+
+	ref_field = create_hist_field(hist_data, NULL, HIST_FIELD_FL_VAR_REF);
+	if (!ref_field)
+		return NULL;
+
+	ref_field->var.name = kstrdup(var_field->var.name, GFP_KERNEL);
+	if (!ref_field->var.name) {
+		destroy_hist_field(ref_field);
+		return NULL;
+	}
+
+	ref_field->fn = hist_field_var_ref;
+	ref_field->var.hist_data = var_field->var.hist_data;
+	ref_field->var.idx = var_field->var.idx;
+	if (ref_field->var.hist_data != hist_data)
+		ref_field->var.hist_data->n_var_users++;
+
+	ref_field->var_ref_idx = hist_data->n_var_refs;
+	hist_data->var_refs[hist_data->n_var_refs++] = ref_field;
+
+	return ref_field;
+}
+
+/* a field of the event, common_timestamp or a $variable reference */
+static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
+				     struct trace_event_file *file, char *str)
+{
+	struct ftrace_event_field *field = NULL;
+	struct hist_field *hist_field;
+	unsigned long flags = 0;
+	char *field_name;
+
+	if (str[0] == '$') {
+		struct hist_field *var_field = find_var(hist_data, str + 1);
+
+		if (!var_field)
+			return ERR_PTR(-EINVAL);
+
+		hist_field = create_var_ref(hist_data, var_field);
+		return hist_field ? hist_field : ERR_PTR(-ENOMEM);
+	}
+
+	field_name = strsep(&str, ".");
+	if (str) {
+		if (strcmp(str, "hex") == 0)
+			flags |= HIST_FIELD_FL_HEX;
+		else if (strcmp(str, "usecs") == 0)
+			flags |= HIST_FIELD_FL_TIMESTAMP_USECS;
+		else
+			return ERR_PTR(-EINVAL);
+	}
+
+	if (strcmp(field_name, "common_timestamp") == 0) {
+		flags |= HIST_FIELD_FL_TIMESTAMP;
+	} else {
+		if (flags & HIST_FIELD_FL_TIMESTAMP_USECS)
+			return ERR_PTR(-EINVAL);
+
+		field = trace_find_event_field(file->event_call, field_name);
+		if (!field)
+			return ERR_PTR(-EINVAL);
+	}
+
+	hist_field = create_hist_field(hist_data, field, flags);
+
+	return hist_field ? hist_field : ERR_PTR(-ENOMEM);
+}
+
+/* an atom, or the sum or difference of two atoms */
+static struct hist_field *parse_expr(struct hist_trigger_data *hist_data,
+				     struct trace_event_file *file, char *str)
+{
+	struct hist_field *expr, *operand1, *operand2;
+	enum field_op_id op = FIELD_OP_NONE;
+	char *op_str, *expr_str;
+
+	op_str = strpbrk(str, "+-");
+	if (!op_str)
+		return parse_atom(hist_data, file, str);
+
+	if (*op_str == '+')
+		op = FIELD_OP_PLUS;
+	else
+		op = FIELD_OP_MINUS;
+
+	expr_str = kstrdup(str, GFP_KERNEL);
+	if (!expr_str)
+		return ERR_PTR(-ENOMEM);
+
+	*op_str++ = '\0';
+	if (strpbrk(op_str, "+-")) {
+		kfree(expr_str);
+		return ERR_PTR(-EINVAL);
+	}
+
+	expr = create_hist_field(hist_data, NULL, HIST_FIELD_FL_EXPR);
+	if (!expr) {
+		kfree(expr_str);
+		return ERR_PTR(-ENOMEM);
+	}
+	expr->name = expr_str;
+	expr->operator = op;
+	expr->fn = op == FIELD_OP_PLUS ? hist_field_plus : hist_field_minus;
+
+	operand1 = parse_atom(hist_data, file, str);
+	if (IS_ERR(operand1))
+		goto free;
+	expr->operands[0] = operand1;
+
+	operand2 = parse_atom(hist_data, file, op_str);
+	if (IS_ERR(operand2)) {
+		operand1 = operand2;
+		goto free;
+	}
+	expr->operands[1] = operand2;
+
+	/* string addresses don't add up to anything */
+	if ((operand1->flags | operand2->flags) & HIST_FIELD_FL_STRING) {
+		operand1 = ERR_PTR(-EINVAL);
+		goto free;
+	}
+
+	return expr;
+ free:
+	destroy_hist_field(expr);
+
+	return operand1;
+}
+
+static int create_var_field(struct hist_trigger_data *hist_data,
+			    struct trace_event_file *file,
+			    char *var_name, char *expr_str)
+{
+	struct hist_field *var_field;
+	unsigned int i, n_var_refs;
+
+	if (!var_name || !expr_str || !strlen(var_name))
+		return -EINVAL;
+
+	if (find_var_field(hist_data, var_name))
+		return -EINVAL;
+
+	if (WARN_ON(hist_data->n_vars >= TRACING_MAP_VARS_MAX))
+		return -EINVAL;
+
+	n_var_refs = hist_data->n_var_refs;
+
+	var_field = parse_expr(hist_data, file, expr_str);
+	if (IS_ERR(var_field))
+		return PTR_ERR(var_field);
+
+	/* vars are all set together, they can't be computed from each other */
+	for (i = n_var_refs; i < hist_data->n_var_refs; i++) {
+		if (hist_data->var_refs[i]->var.hist_data == hist_data) {
+			destroy_hist_field(var_field);
+			return -EINVAL;
+		}
+	}
+
+	var_field->flags |= HIST_FIELD_FL_VAR;
+	var_field->var.hist_data = hist_data;
+	var_field->var.idx = hist_data->n_vars;
+	var_field->var.name = kstrdup(var_name, GFP_KERNEL);
+	if (!var_field->var.name) {
+		destroy_hist_field(var_field);
+		return -ENOMEM;
+	}
+
+	hist_data->var_fields[hist_data->n_vars++] = var_field;
+
+	return 0;
+}
+
+static int create_var_fields(struct hist_trigger_data *hist_data,
+			     struct trace_event_file *file)
+{
+	struct hist_trigger_attrs *attrs = hist_data->attrs;
+	char *str, *expr;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < attrs->n_assignments; i++) {
+		if (!attrs->assignment_str[i])
+			return -ENOMEM;
+
+		str = kstrdup(attrs->assignment_str[i], GFP_KERNEL);
+		if (!str)
+			return -ENOMEM;
+
+		expr = str;
+		strsep(&expr, "=");
+		ret = create_var_field(hist_data, file, str, expr);
+		kfree(str);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void destroy_var_fields(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_vars; i++)
+		destroy_hist_field(hist_data->var_fields[i]);
+}
+
+/* onmatch(system.event) -> system, event; str is modified */
+static int parse_match_event(char *str, char **system, char **event,
+			     char **rest)
+{
+	char *match_event;
+
+	str += strlen("onmatch(");
+	match_event = strsep(&str, ")");
+	if (!str)
+		return -EINVAL;
+
+	*system = strsep(&match_event, ".");
+	if (!match_event || !strlen(*system) || !strlen(match_event))
+		return -EINVAL;
+
+	*event = match_event;
+	*rest = str;
+
+	return 0;
+}
+
+static int create_match_file(struct hist_trigger_data *hist_data)
 {
-	struct hist_trigger_data *hist_data = elt->map->private_data;
-	struct hist_field *key_field;
+	struct hist_trigger_attrs *attrs = hist_data->attrs;
+	struct trace_array *tr = hist_data->event_file->tr;
+	char *str, *system, *event, *rest;
+	struct trace_event_file *file;
 	unsigned int i;
+	int ret = 0;
 
-	for_each_hist_key_field(i, hist_data) {
-		key_field = hist_data->fields[i];
+	for (i = 0; i < attrs->n_actions; i++) {
+		if (!attrs->action_str[i])
+			return -ENOMEM;
 
-		if (key_field->flags & HIST_FIELD_FL_EXECNAME) {
-			unsigned int size = TASK_COMM_LEN + 1;
+		str = kstrdup(attrs->action_str[i], GFP_KERNEL);
+		if (!str)
+			return -ENOMEM;
 
-			elt->private_data = kzalloc(size, GFP_KERNEL);
-			if (!elt->private_data)
-				return -ENOMEM;
-			break;
+		ret = parse_match_event(str, &system, &event, &rest);
+		if (!ret) {
+			file = find_event_file(tr, system, event);
+			/* all the variables must come from the same event */
+			if (!file || (hist_data->match_file &&
+				      hist_data->match_file != file))
+				ret = -EINVAL;
+			else
+				hist_data->match_file = file;
 		}
+		kfree(str);
+		if (ret)
+			break;
 	}
 
-	return 0;
+	return ret;
 }
 
-static void hist_trigger_elt_comm_copy(struct tracing_map_elt *to,
-				       struct tracing_map_elt *from)
+static void destroy_action(struct action_data *data)
 {
-	char *comm_from = from->private_data;
-	char *comm_to = to->private_data;
+	unsigned int i;
 
-	if (comm_from)
-		memcpy(comm_to, comm_from, TASK_COMM_LEN + 1);
-}
+	for (i = 0; i < data->n_params; i++)
+		destroy_hist_field(data->params[i]);
 
-static void hist_trigger_elt_comm_init(struct tracing_map_elt *elt)
-{
-	char *comm = elt->private_data;
+	if (data->synth_event)
+		data->synth_event->ref--;
 
-	if (comm)
-		save_comm(comm, current);
+	kfree(data->match_event_system);
+	kfree(data->match_event);
+	kfree(data);
 }
 
-static const struct tracing_map_ops hist_trigger_elt_comm_ops = {
-	.elt_alloc	= hist_trigger_elt_comm_alloc,
-	.elt_copy	= hist_trigger_elt_comm_copy,
-	.elt_free	= hist_trigger_elt_comm_free,
-	.elt_init	= hist_trigger_elt_comm_init,
-};
-
-static void destroy_hist_field(struct hist_field *hist_field)
+static void destroy_actions(struct hist_trigger_data *hist_data)
 {
-	kfree(hist_field);
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_actions; i++)
+		destroy_action(hist_data->actions[i]);
 }
 
-static struct hist_field *create_hist_field(struct ftrace_event_field *field,
-					    unsigned long flags)
+/* onmatch(system.event).synth_event(param, ...) */
+static struct action_data *create_action(struct hist_trigger_data *hist_data,
+					 struct trace_event_file *file,
+					 char *str)
 {
+	char *system, *event, *synth_name, *params, *param;
 	struct hist_field *hist_field;
+	struct action_data *data;
+	struct synth_event *se;
+	int ret;
 
-	if (field && is_function_field(field))
-		return NULL;
+	ret = parse_match_event(str, &system, &event, &str);
+	if (ret)
+		return ERR_PTR(ret);
 
-	hist_field = kzalloc(sizeof(struct hist_field), GFP_KERNEL);
-	if (!hist_field)
-		return NULL;
+	if (*str++ != '.')
+		return ERR_PTR(-EINVAL);
 
-	if (flags & HIST_FIELD_FL_HITCOUNT) {
-		hist_field->fn = hist_field_counter;
-		goto out;
+	synth_name = strsep(&str, "(");
+	if (!str || !strlen(str) || str[strlen(str) - 1] != ')')
+		return ERR_PTR(-EINVAL);
+	str[strlen(str) - 1] = '\0';
+	params = str;
+
+	se = find_synth_event(synth_name);
+	if (!se)
+		return ERR_PTR(-EINVAL);
+
+	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return ERR_PTR(-ENOMEM);
+
+	data->match_event_system = kstrdup(system, GFP_KERNEL);
+	data->match_event = kstrdup(event, GFP_KERNEL);
+	if (!data->match_event_system || !data->match_event) {
+		ret = -ENOMEM;
+		goto free;
 	}
 
-	if (flags & HIST_FIELD_FL_STACKTRACE) {
-		hist_field->fn = hist_field_none;
-		goto out;
+	while ((param = strsep(&params, ",")) != NULL) {
+		if (data->n_params >= se->n_fields) {
+			ret = -EINVAL;
+			goto free;
+		}
+
+		hist_field = parse_atom(hist_data, file, param);
+		if (IS_ERR(hist_field)) {
+			ret = PTR_ERR(hist_field);
+			goto free;
+		}
+		data->params[data->n_params++] = hist_field;
+
+		if (hist_field->flags & HIST_FIELD_FL_STRING) {
+			ret = -EINVAL;
+			goto free;
+		}
 	}
 
-	if (flags & HIST_FIELD_FL_LOG2) {
-		hist_field->fn = hist_field_log2;
-		goto out;
+	if (data->n_params != se->n_fields) {
+		ret = -EINVAL;
+		goto free;
 	}
 
-	if (WARN_ON_ONCE(!field))
-		goto out;
+	data->synth_event = se;
+	se->ref++;
 
-	if (is_string_field(field)) {
-		flags |= HIST_FIELD_FL_STRING;
+	return data;
+ free:
+	destroy_action(data);
 
-		if (field->filter_type == FILTER_STATIC_STRING)
-			hist_field->fn = hist_field_string;
-		else if (field->filter_type == FILTER_DYN_STRING)
-			hist_field->fn = hist_field_dynstring;
-		else
-			hist_field->fn = hist_field_pstring;
-	} else {
-		hist_field->fn = select_value_fn(field->size,
-						 field->is_signed);
-		if (!hist_field->fn) {
-			destroy_hist_field(hist_field);
-			return NULL;
-		}
+	return ERR_PTR(ret);
+}
+
+static int create_actions(struct hist_trigger_data *hist_data,
+			  struct trace_event_file *file)
+{
+	struct hist_trigger_attrs *attrs = hist_data->attrs;
+	struct action_data *data;
+	unsigned int i;
+	char *str;
+
+	for (i = 0; i < attrs->n_actions; i++) {
+		str = kstrdup(attrs->action_str[i], GFP_KERNEL);
+		if (!str)
+			return -ENOMEM;
+
+		data = create_action(hist_data, file, str);
+		kfree(str);
+		if (IS_ERR(data))
+			return PTR_ERR(data);
+
+		hist_data->actions[hist_data->n_actions++] = data;
 	}
- out:
-	hist_field->field = field;
-	hist_field->flags = flags;
 
-	return hist_field;
+	return 0;
 }
 
-static void destroy_hist_fields(struct hist_trigger_data *hist_data)
+/* a variable is looked up with our key, so the keys have to match up */
+static int check_var_refs(struct hist_trigger_data *hist_data)
 {
+	struct hist_field *ref_field;
 	unsigned int i;
 
-	for (i = 0; i < TRACING_MAP_FIELDS_MAX; i++) {
-		if (hist_data->fields[i]) {
-			destroy_hist_field(hist_data->fields[i]);
-			hist_data->fields[i] = NULL;
-		}
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		ref_field = hist_data->var_refs[i];
+
+		if (ref_field->var.hist_data->key_size != hist_data->key_size)
+			return -EINVAL;
 	}
+
+	return 0;
 }
 
 static int create_hitcount_val(struct hist_trigger_data *hist_data)
 {
 	hist_data->fields[HITCOUNT_IDX] =
-		create_hist_field(NULL, HIST_FIELD_FL_HITCOUNT);
+		create_hist_field(hist_data, NULL, HIST_FIELD_FL_HITCOUNT);
 	if (!hist_data->fields[HITCOUNT_IDX])
 		return -ENOMEM;
 
@@ -430,35 +1718,19 @@ static int create_val_field(struct hist_trigger_data *hist_data,
 			    struct trace_event_file *file,
 			    char *field_str)
 {
-	struct ftrace_event_field *field = NULL;
-	unsigned long flags = 0;
-	char *field_name;
+	struct hist_field *hist_field;
 	int ret = 0;
 
 	if (WARN_ON(val_idx >= TRACING_MAP_VALS_MAX))
 		return -EINVAL;
 
-	field_name = strsep(&field_str, ".");
-	if (field_str) {
-		if (strcmp(field_str, "hex") == 0)
-			flags |= HIST_FIELD_FL_HEX;
-		else {
-			ret = -EINVAL;
-			goto out;
-		}
-	}
-
-	field = trace_find_event_field(file->event_call, field_name);
-	if (!field) {
-		ret = -EINVAL;
+	hist_field = parse_expr(hist_data, file, field_str);
+	if (IS_ERR(hist_field)) {
+		ret = PTR_ERR(hist_field);
 		goto out;
 	}
 
-	hist_data->fields[val_idx] = create_hist_field(field, flags);
-	if (!hist_data->fields[val_idx]) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	hist_data->fields[val_idx] = hist_field;
 
 	++hist_data->n_vals;
 
@@ -558,7 +1830,7 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 			key_size = field->size;
 	}
 
-	hist_data->fields[key_idx] = create_hist_field(field, flags);
+	hist_data->fields[key_idx] = create_hist_field(hist_data, field, flags);
 	if (!hist_data->fields[key_idx]) {
 		ret = -ENOMEM;
 		goto out;
@@ -652,7 +1924,6 @@ static int is_descending(const char *str)
 static int create_sort_keys(struct hist_trigger_data *hist_data)
 {
 	char *fields_str = hist_data->attrs->sort_key_str;
-	struct ftrace_event_field *field = NULL;
 	struct tracing_map_sort_key *sort_key;
 	int descending, ret = 0;
 	unsigned int i, j;
@@ -702,8 +1973,9 @@ static int create_sort_keys(struct hist_trigger_data *hist_data)
 		}
 
 		for (j = 1; j < hist_data->n_fields; j++) {
-			field = hist_data->fields[j]->field;
-			if (field && (strcmp(field_name, field->name) == 0)) {
+			const char *name = hist_field_name(hist_data->fields[j]);
+
+			if (strlen(name) && (strcmp(field_name, name) == 0)) {
 				sort_key->field_idx = j;
 				descending = is_descending(field_str);
 				if (descending < 0) {
@@ -727,6 +1999,8 @@ static int create_sort_keys(struct hist_trigger_data *hist_data)
 static void destroy_hist_data(struct hist_trigger_data *hist_data)
 {
 	destroy_hist_trigger_attrs(hist_data->attrs);
+	destroy_actions(hist_data);
+	destroy_var_fields(hist_data);
 	destroy_hist_fields(hist_data);
 	tracing_map_destroy(hist_data->map);
 	kfree(hist_data);
@@ -764,6 +2038,14 @@ static int create_tracing_map_fields(struct hist_trigger_data *hist_data)
 			return idx;
 	}
 
+	for (i = 0; i < hist_data->n_vars; i++) {
+		idx = tracing_map_add_var(map);
+		if (idx < 0)
+			return idx;
+		if (WARN_ON(idx != hist_data->var_fields[i]->var.idx))
+			return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -796,11 +2078,28 @@ create_hist_data(unsigned int map_bits,
 		return ERR_PTR(-ENOMEM);
 
 	hist_data->attrs = attrs;
+	hist_data->event_file = file;
+
+	ret = create_match_file(hist_data);
+	if (ret)
+		goto free;
+
+	ret = create_var_fields(hist_data, file);
+	if (ret)
+		goto free;
 
 	ret = create_hist_fields(hist_data, file);
 	if (ret)
 		goto free;
 
+	ret = create_actions(hist_data, file);
+	if (ret)
+		goto free;
+
+	ret = check_var_refs(hist_data);
+	if (ret)
+		goto free;
+
 	ret = create_sort_keys(hist_data);
 	if (ret)
 		goto free;
@@ -823,8 +2122,6 @@ create_hist_data(unsigned int map_bits,
 	ret = tracing_map_init(hist_data->map);
 	if (ret)
 		goto free;
-
-	hist_data->event_file = file;
  out:
 	return hist_data;
  free:
@@ -837,9 +2134,70 @@ create_hist_data(unsigned int map_bits,
 	goto out;
 }
 
+/*
+ * Fill in var_ref_vals for the references to variables of other
+ * triggers (self false), which are consumed, or to our own variables
+ * (self true), which have just been set by this event.  Return false
+ * if any of them isn't set for this key.
+ */
+static bool resolve_var_refs(struct hist_trigger_data *hist_data, void *key,
+			     struct tracing_map_elt *elt, u64 *var_ref_vals,
+			     bool self)
+{
+	struct tracing_map_elt *var_elts[TRACING_MAP_VARS_MAX];
+	struct hist_trigger_data *var_data;
+	struct hist_field *ref_field;
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		ref_field = hist_data->var_refs[i];
+		var_data = ref_field->var.hist_data;
+
+		if ((var_data == hist_data) != self)
+			continue;
+
+		var_elts[i] = self ? elt : tracing_map_lookup(var_data->map, key);
+		if (!var_elts[i] ||
+		    !tracing_map_var_set(var_elts[i], ref_field->var.idx))
+			return false;
+	}
+
+	for (i = 0; i < hist_data->n_var_refs; i++) {
+		ref_field = hist_data->var_refs[i];
+		var_data = ref_field->var.hist_data;
+
+		if ((var_data == hist_data) != self)
+			continue;
+
+		if (self)
+			var_ref_vals[i] = tracing_map_read_var(var_elts[i],
+							       ref_field->var.idx);
+		else
+			var_ref_vals[i] = tracing_map_read_var_once(var_elts[i],
+								    ref_field->var.idx);
+	}
+
+	return true;
+}
+
+static void hist_trigger_update_vars(struct hist_trigger_data *hist_data,
+				     struct tracing_map_elt *elt, void *rec,
+				     u64 *var_ref_vals)
+{
+	struct hist_field *var_field;
+	unsigned int i;
+	u64 var_val;
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		var_field = hist_data->var_fields[i];
+		var_val = var_field->fn(var_field, rec, var_ref_vals);
+		tracing_map_set_var(elt, var_field->var.idx, var_val);
+	}
+}
+
 static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 				    struct tracing_map_elt *elt,
-				    void *rec)
+				    void *rec, u64 *var_ref_vals)
 {
 	struct hist_field *hist_field;
 	unsigned int i;
@@ -847,11 +2205,31 @@ static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 
 	for_each_hist_val_field(i, hist_data) {
 		hist_field = hist_data->fields[i];
-		hist_val = hist_field->fn(hist_field, rec);
+		hist_val = hist_field->fn(hist_field, rec, var_ref_vals);
 		tracing_map_update_sum(elt, i, hist_val);
 	}
 }
 
+static void hist_trigger_actions(struct hist_trigger_data *hist_data,
+				 void *rec, u64 *var_ref_vals)
+{
+	u64 synth_vals[SYNTH_FIELDS_MAX];
+	struct hist_field *param;
+	struct action_data *data;
+	unsigned int i, j;
+
+	for (i = 0; i < hist_data->n_actions; i++) {
+		data = hist_data->actions[i];
+
+		for (j = 0; j < data->n_params; j++) {
+			param = data->params[j];
+			synth_vals[j] = param->fn(param, rec, var_ref_vals);
+		}
+
+		trace_synth(data->synth_event, synth_vals);
+	}
+}
+
 static inline void add_to_key(char *compound_key, void *key,
 			      struct hist_field *key_field, void *rec)
 {
@@ -882,6 +2260,7 @@ static void event_hist_trigger(struct event_trigger_data *data, void *rec)
 	bool use_compound_key = (hist_data->n_keys > 1);
 	unsigned long entries[HIST_STACKTRACE_DEPTH];
 	char compound_key[HIST_KEY_SIZE_MAX];
+	u64 var_ref_vals[TRACING_MAP_VARS_MAX];
 	struct stack_trace stacktrace;
 	struct hist_field *key_field;
 	struct tracing_map_elt *elt;
@@ -905,7 +2284,7 @@ static void event_hist_trigger(struct event_trigger_data *data, void *rec)
 
 			key = entries;
 		} else {
-			field_contents = key_field->fn(key_field, rec);
+			field_contents = key_field->fn(key_field, rec, NULL);
 			if (key_field->flags & HIST_FIELD_FL_STRING) {
 				key = (void *)(unsigned long)field_contents;
 				use_compound_key = true;
@@ -920,9 +2299,24 @@ static void event_hist_trigger(struct event_trigger_data *data, void *rec)
 	if (use_compound_key)
 		key = compound_key;
 
+	/* nothing is recorded for a key whose variables aren't all set */
+	if (hist_data->n_var_refs &&
+	    !resolve_var_refs(hist_data, key, NULL, var_ref_vals, false))
+		return;
+
 	elt = tracing_map_insert(hist_data->map, key);
-	if (elt)
-		hist_trigger_elt_update(hist_data, elt, rec);
+	if (!elt)
+		return;
+
+	hist_trigger_update_vars(hist_data, elt, rec, var_ref_vals);
+
+	if (hist_data->n_var_refs &&
+	    !resolve_var_refs(hist_data, key, elt, var_ref_vals, true))
+		return;
+
+	hist_trigger_elt_update(hist_data, elt, rec, var_ref_vals);
+
+	hist_trigger_actions(hist_data, rec, var_ref_vals);
 }
 
 static void hist_trigger_stacktrace_print(struct seq_file *m,
@@ -1022,11 +2416,11 @@ hist_trigger_entry_print(struct seq_file *m,
 	for (i = 1; i < hist_data->n_vals; i++) {
 		if (hist_data->fields[i]->flags & HIST_FIELD_FL_HEX) {
 			seq_printf(m, "  %s: %10llx",
-				   hist_data->fields[i]->field->name,
+				   hist_field_name(hist_data->fields[i]),
 				   tracing_map_read_sum(elt, i));
 		} else {
 			seq_printf(m, "  %s: %10llu",
-				   hist_data->fields[i]->field->name,
+				   hist_field_name(hist_data->fields[i]),
 				   tracing_map_read_sum(elt, i));
 		}
 	}
@@ -1135,13 +2529,26 @@ static const char *get_hist_field_flags(struct hist_field *hist_field)
 		flags_str = "syscall";
 	else if (hist_field->flags & HIST_FIELD_FL_LOG2)
 		flags_str = "log2";
+	else if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
+		flags_str = "usecs";
 
 	return flags_str;
 }
 
 static void hist_field_print(struct seq_file *m, struct hist_field *hist_field)
 {
-	seq_printf(m, "%s", hist_field->field->name);
+	if (hist_field->flags & HIST_FIELD_FL_VAR_REF) {
+		seq_printf(m, "$%s", hist_field->var.name);
+		return;
+	}
+
+	/* the expression as it was written */
+	if (hist_field->flags & HIST_FIELD_FL_EXPR) {
+		seq_printf(m, "%s", hist_field->name);
+		return;
+	}
+
+	seq_printf(m, "%s", hist_field_name(hist_field));
 	if (hist_field->flags) {
 		const char *flags_str = get_hist_field_flags(hist_field);
 
@@ -1215,6 +2622,25 @@ static int event_hist_trigger_print(struct seq_file *m,
 
 	seq_printf(m, ":size=%u", (1 << hist_data->map->map_bits));
 
+	for (i = 0; i < hist_data->n_vars; i++) {
+		seq_printf(m, ":%s=", hist_data->var_fields[i]->var.name);
+		hist_field_print(m, hist_data->var_fields[i]);
+	}
+
+	for (i = 0; i < hist_data->n_actions; i++) {
+		struct action_data *action = hist_data->actions[i];
+		unsigned int j;
+
+		seq_printf(m, ":onmatch(%s.%s).%s(", action->match_event_system,
+			   action->match_event, action->synth_event->name);
+		for (j = 0; j < action->n_params; j++) {
+			if (j)
+				seq_puts(m, ",");
+			hist_field_print(m, action->params[j]);
+		}
+		seq_puts(m, ")");
+	}
+
 	if (data->filter_str)
 		seq_printf(m, " if %s", data->filter_str);
 
@@ -1380,6 +2806,30 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 			return false;
 		if (key_field->offset != key_field_test->offset)
 			return false;
+		if (strcmp(hist_field_name(key_field),
+			   hist_field_name(key_field_test)) != 0)
+			return false;
+	}
+
+	if (hist_data->n_vars != hist_data_test->n_vars ||
+	    hist_data->n_actions != hist_data_test->n_actions)
+		return false;
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		key_field = hist_data->var_fields[i];
+		key_field_test = hist_data_test->var_fields[i];
+
+		if (strcmp(key_field->var.name, key_field_test->var.name) != 0)
+			return false;
+		if (strcmp(hist_field_name(key_field),
+			   hist_field_name(key_field_test)) != 0)
+			return false;
+	}
+
+	for (i = 0; i < hist_data->n_actions; i++) {
+		if (hist_data->actions[i]->synth_event !=
+		    hist_data_test->actions[i]->synth_event)
+			return false;
 	}
 
 	for (i = 0; i < hist_data->n_sort_keys; i++) {
@@ -1498,12 +2948,40 @@ static void hist_unregister_trigger(char *glob, struct event_trigger_ops *ops,
 		test->ops->free(test->ops, test);
 }
 
-static void hist_unreg_all(struct trace_event_file *file)
+/* whether the trigger data matches has variables other triggers use */
+static bool hist_trigger_referenced(struct event_trigger_data *data,
+				    struct trace_event_file *file)
 {
-	struct event_trigger_data *test;
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct event_trigger_data *test, *named_data = NULL;
+
+	if (hist_data->attrs->name)
+		named_data = find_named_trigger(hist_data->attrs->name);
 
 	list_for_each_entry_rcu(test, &file->triggers, list) {
 		if (test->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			if (!hist_trigger_match(data, test, named_data, false))
+				continue;
+			hist_data = test->private_data;
+			return hist_data->n_var_users > 0;
+		}
+	}
+
+	return false;
+}
+
+static void hist_unreg_all(struct trace_event_file *file)
+{
+	struct event_trigger_data *test, *n;
+	struct hist_trigger_data *hist_data;
+
+	list_for_each_entry_safe(test, n, &file->triggers, list) {
+		if (test->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			/* variables still in use keep their trigger around */
+			hist_data = test->private_data;
+			if (hist_data->n_var_users)
+				continue;
+
 			list_del_rcu(&test->list);
 			trace_event_trigger_enable_disable(file, 0);
 			update_cond_flag(file);
@@ -1570,6 +3048,10 @@ static int event_hist_trigger_func(struct event_command *cmd_ops,
 	}
 
 	if (glob[0] == '!') {
+		if (hist_trigger_referenced(trigger_data, file)) {
+			ret = -EBUSY;
+			goto out_free;
+		}
 		cmd_ops->unreg(glob+1, trigger_ops, trigger_data, file);
 		ret = 0;
 		goto out_free;
@@ -1753,3 +3235,31 @@ __init int register_trigger_hist_enable_disable_cmds(void)
 
 	return ret;
 }
+
+static __init int trace_events_hist_init(void)
+{
+	struct dentry *entry = NULL;
+	struct dentry *d_tracer;
+	int err = 0;
+
+	d_tracer = tracing_init_dentry();
+	if (IS_ERR(d_tracer)) {
+		err = PTR_ERR(d_tracer);
+		goto err;
+	}
+
+	entry = tracefs_create_file("synthetic_events", 0644, d_tracer,
+				    NULL, &synth_events_fops);
+	if (!entry) {
+		err = -ENODEV;
+		goto err;
+	}
+
+	return err;
+ err:
+	pr_warn("Could not create tracefs 'synthetic_events' entry\n");
+
+	return err;
+}
+
+fs_initcall(trace_events_hist_init);
@@ -309,6 +309,14 @@ static inline int ftrace_graph_ignore_irqs(void)
 	return in_irq();
 }
 
+/* trace it when it is-nested-in or is a function enabled. */
+static inline int ftrace_graph_ignore_func(struct ftrace_graph_ent *trace)
+{
+	return (!(trace->depth || ftrace_graph_addr(trace->func)) ||
+		ftrace_graph_ignore_irqs()) || (trace->depth < 0) ||
+		(max_depth && trace->depth >= max_depth);
+}
+
 int trace_graph_entry(struct ftrace_graph_ent *trace)
 {
 	struct trace_array *tr = graph_array;
@@ -322,10 +330,7 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	if (!ftrace_trace_task(current))
 		return 0;
 
-	/* trace it when it is-nested-in or is a function enabled. */
-	if ((!(trace->depth || ftrace_graph_addr(trace->func)) ||
-	     ftrace_graph_ignore_irqs()) || (trace->depth < 0) ||
-	    (max_depth && trace->depth >= max_depth))
+	if (ftrace_graph_ignore_func(trace))
 		return 0;
 
 	/*
@@ -355,12 +360,20 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	return ret;
 }
 
+/*
+ * Nothing is recorded on entry with a threshold, but only hook the return
+ * of the functions trace_graph_entry() would have traced: the others are
+ * never reported, and hijacking their return address is most of the cost.
+ */
 static int trace_graph_thresh_entry(struct ftrace_graph_ent *trace)
 {
-	if (tracing_thresh)
-		return 1;
-	else
+	if (!tracing_thresh)
 		return trace_graph_entry(trace);
+
+	if (!ftrace_trace_task(current) || ftrace_graph_ignore_func(trace))
+		return 0;
+
+	return 1;
 }
 
 static void
@@ -0,0 +1,132 @@
+/*
+ * Wrapper for decompressing zstd-compressed initramfs and initrd
+ *
+ * Only the first frame is decoded; *posp tells the caller where it ended,
+ * as for the other formats.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/decompress/unzstd.h>
+#include <linux/decompress/mm.h>
+#include <linux/types.h>
+#include <linux/zstd.h>
+
+/* "zstd -19" uses an 8MB window, larger ones are refused */
+#define UNZSTD_MAX_WINDOW	(1 << 23)
+
+#define UNZSTD_IN_SIZE		(1 << 16)
+#define UNZSTD_OUT_SIZE		ZSTD_BLOCKSIZE_MAX
+
+STATIC int INIT unzstd(unsigned char *input, long in_len,
+		       long (*fill)(void *, unsigned long),
+		       long (*flush)(void *, unsigned long),
+		       unsigned char *output, long *posp,
+		       void (*error)(char *x))
+{
+	size_t ws_size = zstd_dstream_workspace_size(UNZSTD_MAX_WINDOW);
+	struct zstd_in_buffer in;
+	struct zstd_out_buffer out;
+	struct zstd_dstream *zds;
+	unsigned char *inp = input, *outp = output;
+	bool eof = !fill;
+	void *ws;
+	size_t start;
+	int ret = -1, r;
+
+	if (posp)
+		*posp = 0;
+
+	if (!input && !fill) {
+		error("NULL input pointer and missing fill function");
+		return -1;
+	}
+	if (!output && !flush) {
+		error("NULL output pointer and no flush function provided");
+		return -1;
+	}
+
+	ws = large_malloc(ws_size);
+	if (!ws) {
+		error("Could not allocate zstd workspace");
+		return -1;
+	}
+	if (!input) {
+		inp = large_malloc(UNZSTD_IN_SIZE);
+		if (!inp) {
+			error("Could not allocate input buffer");
+			goto exit_0;
+		}
+	}
+	if (!output) {
+		outp = large_malloc(UNZSTD_OUT_SIZE);
+		if (!outp) {
+			error("Could not allocate output buffer");
+			goto exit_1;
+		}
+	}
+
+	zds = zstd_init_dstream(UNZSTD_MAX_WINDOW, ws, ws_size);
+	if (!zds) {
+		error("Could not initialise zstd");
+		goto exit_2;
+	}
+
+	in.src = inp;
+	in.size = input ? in_len : 0;
+	in.pos = 0;
+	out.dst = outp;
+	out.size = UNZSTD_OUT_SIZE;
+	out.pos = 0;
+
+	for (;;) {
+		if (in.pos == in.size && fill) {
+			long n = fill(inp, UNZSTD_IN_SIZE);
+
+			if (n < 0) {
+				error("read error");
+				goto exit_2;
+			}
+			eof = !n;
+			in.size = n;
+			in.pos = 0;
+		}
+
+		start = in.pos;
+		r = zstd_decompress_stream(zds, &out, &in);
+		if (r < 0) {
+			error("zstd data is corrupt");
+			goto exit_2;
+		}
+		if (posp)
+			*posp += in.pos - start;
+
+		if (flush && out.pos && flush(out.dst, out.pos) != out.pos) {
+			error("write error");
+			goto exit_2;
+		}
+		if (output)
+			out.dst = (u8 *)out.dst + out.pos;
+
+		if (!r)
+			break;
+		if (eof && in.pos == in.size && out.pos < out.size) {
+			error("unexpected end of input");
+			goto exit_2;
+		}
+		out.pos = 0;
+	}
+
+	ret = 0;
+exit_2:
+	if (!output)
+		large_free(outp);
+exit_1:
+	if (!input)
+		large_free(inp);
+exit_0:
+	large_free(ws);
+	return ret;
+}
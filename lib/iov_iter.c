@@ -139,9 +139,48 @@
 	}							\
 }
 
+/*
+ * Copies that are large in total, judged by what is left of the iterator,
+ * bypass the cache so that streaming through them does not evict what
+ * everybody else keeps in the last level cache.  The tail of such a copy,
+ * below the threshold, goes through the cache again.
+ */
+static inline size_t copyout(void __user *to, const void *from, size_t n,
+			     bool nocache)
+{
+	if (nocache)
+		return __copy_to_user_nocache(to, from, n);
+	return __copy_to_user(to, from, n);
+}
+
+static inline size_t copyout_inatomic(void __user *to, const void *from,
+				      size_t n, bool nocache)
+{
+	if (nocache)
+		return __copy_to_user_inatomic_nocache(to, from, n);
+	return __copy_to_user_inatomic(to, from, n);
+}
+
+static inline size_t copyin(void *to, const void __user *from, size_t n,
+			    bool nocache)
+{
+	if (nocache)
+		return __copy_from_user_nocache(to, from, n);
+	return __copy_from_user(to, from, n);
+}
+
+static inline size_t copyin_inatomic(void *to, const void __user *from,
+				     size_t n, bool nocache)
+{
+	if (nocache)
+		return __copy_from_user_inatomic_nocache(to, from, n);
+	return __copy_from_user_inatomic(to, from, n);
+}
+
 static size_t copy_page_to_iter_iovec(struct page *page, size_t offset, size_t bytes,
 			 struct iov_iter *i)
 {
+	bool nocache = copy_nocache_wanted(i->count);
 	size_t skip, copy, left, wanted;
 	const struct iovec *iov;
 	char __user *buf;
@@ -164,7 +203,7 @@ static size_t copy_page_to_iter_iovec(struct page *page, size_t offset, size_t b
 		from = kaddr + offset;
 
 		/* first chunk, usually the only one */
-		left = __copy_to_user_inatomic(buf, from, copy);
+		left = copyout_inatomic(buf, from, copy, nocache);
 		copy -= left;
 		skip += copy;
 		from += copy;
@@ -174,7 +213,7 @@ static size_t copy_page_to_iter_iovec(struct page *page, size_t offset, size_t b
 			iov++;
 			buf = iov->iov_base;
 			copy = min(bytes, iov->iov_len);
-			left = __copy_to_user_inatomic(buf, from, copy);
+			left = copyout_inatomic(buf, from, copy, nocache);
 			copy -= left;
 			skip = copy;
 			from += copy;
@@ -192,7 +231,7 @@ static size_t copy_page_to_iter_iovec(struct page *page, size_t offset, size_t b
 	/* Too bad - revert to non-atomic kmap */
 	kaddr = kmap(page);
 	from = kaddr + offset;
-	left = __copy_to_user(buf, from, copy);
+	left = copyout(buf, from, copy, nocache);
 	copy -= left;
 	skip += copy;
 	from += copy;
@@ -201,7 +240,7 @@ static size_t copy_page_to_iter_iovec(struct page *page, size_t offset, size_t b
 		iov++;
 		buf = iov->iov_base;
 		copy = min(bytes, iov->iov_len);
-		left = __copy_to_user(buf, from, copy);
+		left = copyout(buf, from, copy, nocache);
 		copy -= left;
 		skip = copy;
 		from += copy;
@@ -223,6 +262,7 @@ done:
 static size_t copy_page_from_iter_iovec(struct page *page, size_t offset, size_t bytes,
 			 struct iov_iter *i)
 {
+	bool nocache = copy_nocache_wanted(i->count);
 	size_t skip, copy, left, wanted;
 	const struct iovec *iov;
 	char __user *buf;
@@ -245,7 +285,7 @@ static size_t copy_page_from_iter_iovec(struct page *page, size_t offset, size_t
 		to = kaddr + offset;
 
 		/* first chunk, usually the only one */
-		left = __copy_from_user_inatomic(to, buf, copy);
+		left = copyin_inatomic(to, buf, copy, nocache);
 		copy -= left;
 		skip += copy;
 		to += copy;
@@ -255,7 +295,7 @@ static size_t copy_page_from_iter_iovec(struct page *page, size_t offset, size_t
 			iov++;
 			buf = iov->iov_base;
 			copy = min(bytes, iov->iov_len);
-			left = __copy_from_user_inatomic(to, buf, copy);
+			left = copyin_inatomic(to, buf, copy, nocache);
 			copy -= left;
 			skip = copy;
 			to += copy;
@@ -273,7 +313,7 @@ static size_t copy_page_from_iter_iovec(struct page *page, size_t offset, size_t
 	/* Too bad - revert to non-atomic kmap */
 	kaddr = kmap(page);
 	to = kaddr + offset;
-	left = __copy_from_user(to, buf, copy);
+	left = copyin(to, buf, copy, nocache);
 	copy -= left;
 	skip += copy;
 	to += copy;
@@ -282,7 +322,7 @@ static size_t copy_page_from_iter_iovec(struct page *page, size_t offset, size_t
 		iov++;
 		buf = iov->iov_base;
 		copy = min(bytes, iov->iov_len);
-		left = __copy_from_user(to, buf, copy);
+		left = copyin(to, buf, copy, nocache);
 		copy -= left;
 		skip = copy;
 		to += copy;
@@ -390,9 +430,10 @@ static void memzero_page(struct page *page, size_t offset, size_t len)
 size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
 {
 	const char *from = addr;
+	bool nocache = copy_nocache_wanted(i->count);
 	iterate_and_advance(i, bytes, v,
-		__copy_to_user(v.iov_base, (from += v.iov_len) - v.iov_len,
-			       v.iov_len),
+		copyout(v.iov_base, (from += v.iov_len) - v.iov_len,
+			v.iov_len, nocache),
 		memcpy_to_page(v.bv_page, v.bv_offset,
 			       (from += v.bv_len) - v.bv_len, v.bv_len),
 		memcpy(v.iov_base, (from += v.iov_len) - v.iov_len, v.iov_len)
@@ -405,9 +446,10 @@ EXPORT_SYMBOL(copy_to_iter);
 size_t copy_from_iter(void *addr, size_t bytes, struct iov_iter *i)
 {
 	char *to = addr;
+	bool nocache = copy_nocache_wanted(i->count);
 	iterate_and_advance(i, bytes, v,
-		__copy_from_user((to += v.iov_len) - v.iov_len, v.iov_base,
-				 v.iov_len),
+		copyin((to += v.iov_len) - v.iov_len, v.iov_base,
+		       v.iov_len, nocache),
 		memcpy_from_page((to += v.bv_len) - v.bv_len, v.bv_page,
 				 v.bv_offset, v.bv_len),
 		memcpy((to += v.iov_len) - v.iov_len, v.iov_base, v.iov_len)
@@ -37,15 +37,45 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/crc32c.h>
+#include <linux/jump_label.h>
+
+#ifdef CONFIG_X86
+#include <asm/crc32c.h>
+#endif
+
+#ifndef HAVE_ARCH_CRC32C
+#define CRC32C_ARCH_MAX_LEN	0
+
+static inline bool crc32c_arch_available(void)
+{
+	return false;
+}
+
+static inline u32 crc32c_arch(u32 crc, const void *p, unsigned int len)
+{
+	return crc;
+}
+#endif
 
 static struct crypto_shash *tfm;
 
+/*
+ * Metadata checksums are mostly a few dozen bytes, where going through the
+ * shash API costs as much as the checksum.  Call the arch code directly
+ * for those and leave long buffers to the best registered crc32c driver.
+ */
+static DEFINE_STATIC_KEY_FALSE(crc32c_direct);
+
 u32 crc32c(u32 crc, const void *address, unsigned int length)
 {
 	SHASH_DESC_ON_STACK(shash, tfm);
 	u32 *ctx = (u32 *)shash_desc_ctx(shash);
 	int err;
 
+	if (static_branch_likely(&crc32c_direct) &&
+	    length < CRC32C_ARCH_MAX_LEN)
+		return crc32c_arch(crc, address, length);
+
 	shash->tfm = tfm;
 	shash->flags = 0;
 	*ctx = crc;
@@ -61,7 +91,13 @@ EXPORT_SYMBOL(crc32c);
 static int __init libcrc32c_mod_init(void)
 {
 	tfm = crypto_alloc_shash("crc32c", 0, 0);
-	return PTR_ERR_OR_ZERO(tfm);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+
+	if (crc32c_arch_available())
+		static_branch_enable(&crc32c_direct);
+
+	return 0;
 }
 
 static void __exit libcrc32c_mod_fini(void)
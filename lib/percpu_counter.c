@@ -8,6 +8,8 @@
 #include <linux/init.h>
 #include <linux/cpu.h>
 #include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
 #include <linux/debugobjects.h>
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -57,21 +59,70 @@ static inline void debug_percpu_counter_deactivate(struct percpu_counter *fbc)
 { }
 #endif	/* CONFIG_DEBUG_OBJECTS_PERCPU_COUNTER */
 
+/*
+ * With per-node counters, the delta of a cpu moves into the counter of its
+ * node under the node lock, so that is the lock which keeps the pair
+ * consistent for the precise sum; fbc->lock nests outside of it.
+ */
+static inline raw_spinlock_t *
+percpu_counter_fold_lock(struct percpu_counter *fbc, int cpu, s64 **count)
+{
+	struct percpu_counter_node *pcn;
+
+	if (!fbc->nodes) {
+		*count = &fbc->count;
+		return &fbc->lock;
+	}
+
+	pcn = fbc->nodes[cpu_to_node(cpu)];
+	*count = &pcn->count;
+	return &pcn->lock;
+}
+
 void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
 {
-	int cpu;
+	int cpu, node;
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&fbc->lock, flags);
-	for_each_possible_cpu(cpu) {
-		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
-		*pcount = 0;
+	if (fbc->nodes) {
+		for (node = 0; node < nr_node_ids; node++) {
+			struct percpu_counter_node *pcn = fbc->nodes[node];
+
+			raw_spin_lock(&pcn->lock);
+			pcn->count = 0;
+			for_each_possible_cpu(cpu) {
+				if (cpu_to_node(cpu) == node)
+					*per_cpu_ptr(fbc->counters, cpu) = 0;
+			}
+			raw_spin_unlock(&pcn->lock);
+		}
+	} else {
+		for_each_possible_cpu(cpu) {
+			s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
+			*pcount = 0;
+		}
 	}
 	fbc->count = amount;
 	raw_spin_unlock_irqrestore(&fbc->lock, flags);
 }
 EXPORT_SYMBOL(percpu_counter_set);
 
+/**
+ * percpu_counter_set_batch - set the batch of a counter
+ * @fbc:	counter to set the batch for
+ * @batch:	the new batch, 0 to follow percpu_counter_batch again
+ *
+ * A hot counter whose readers can live with a larger error, see
+ * percpu_counter_max_error(), can use a larger batch than the default
+ * to fold less often.
+ */
+void percpu_counter_set_batch(struct percpu_counter *fbc, s32 batch)
+{
+	WRITE_ONCE(fbc->batch, max(batch, 0));
+}
+EXPORT_SYMBOL(percpu_counter_set_batch);
+
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch)
 {
 	s64 count;
@@ -79,11 +130,15 @@ void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch)
 	preempt_disable();
 	count = __this_cpu_read(*fbc->counters) + amount;
 	if (count >= batch || count <= -batch) {
+		raw_spinlock_t *lock;
 		unsigned long flags;
-		raw_spin_lock_irqsave(&fbc->lock, flags);
-		fbc->count += count;
+		s64 *target;
+
+		lock = percpu_counter_fold_lock(fbc, smp_processor_id(), &target);
+		raw_spin_lock_irqsave(lock, flags);
+		*target += count;
 		__this_cpu_sub(*fbc->counters, count - amount);
-		raw_spin_unlock_irqrestore(&fbc->lock, flags);
+		raw_spin_unlock_irqrestore(lock, flags);
 	} else {
 		this_cpu_add(*fbc->counters, amount);
 	}
@@ -91,6 +146,21 @@ void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch)
 }
 EXPORT_SYMBOL(__percpu_counter_add);
 
+/*
+ * Approximate value of a counter with per-node counters, what
+ * percpu_counter_read() returns.
+ */
+s64 __percpu_counter_read_nodes(struct percpu_counter *fbc)
+{
+	s64 ret = READ_ONCE(fbc->count);
+	int node;
+
+	for (node = 0; node < nr_node_ids; node++)
+		ret += READ_ONCE(fbc->nodes[node]->count);
+	return ret;
+}
+EXPORT_SYMBOL(__percpu_counter_read_nodes);
+
 /*
  * Add up all the per-cpu counts, return the result.  This is a more accurate
  * but much slower version of percpu_counter_read_positive()
@@ -98,20 +168,74 @@ EXPORT_SYMBOL(__percpu_counter_add);
 s64 __percpu_counter_sum(struct percpu_counter *fbc)
 {
 	s64 ret;
-	int cpu;
+	int cpu, node;
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&fbc->lock, flags);
 	ret = fbc->count;
-	for_each_online_cpu(cpu) {
-		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
-		ret += *pcount;
+	if (!fbc->nodes) {
+		for_each_online_cpu(cpu) {
+			s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
+			ret += *pcount;
+		}
+		goto out;
 	}
+
+	/* one node at a time, the others can keep folding meanwhile */
+	for (node = 0; node < nr_node_ids; node++) {
+		struct percpu_counter_node *pcn = fbc->nodes[node];
+
+		raw_spin_lock(&pcn->lock);
+		ret += pcn->count;
+		for_each_cpu_and(cpu, cpumask_of_node(node), cpu_online_mask)
+			ret += *per_cpu_ptr(fbc->counters, cpu);
+		raw_spin_unlock(&pcn->lock);
+	}
+out:
 	raw_spin_unlock_irqrestore(&fbc->lock, flags);
 	return ret;
 }
 EXPORT_SYMBOL(__percpu_counter_sum);
 
+static void percpu_counter_free_nodes(struct percpu_counter *fbc)
+{
+	int node;
+
+	if (!fbc->nodes)
+		return;
+
+	for (node = 0; node < nr_node_ids; node++)
+		kfree(fbc->nodes[node]);
+	kfree(fbc->nodes);
+	fbc->nodes = NULL;
+}
+
+static int percpu_counter_alloc_nodes(struct percpu_counter *fbc, gfp_t gfp)
+{
+	int node;
+
+	fbc->nodes = NULL;
+	if (nr_node_ids < 2)
+		return 0;
+
+	fbc->nodes = kcalloc(nr_node_ids, sizeof(*fbc->nodes), gfp);
+	if (!fbc->nodes)
+		return -ENOMEM;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		struct percpu_counter_node *pcn;
+
+		pcn = kzalloc_node(sizeof(*pcn), gfp, node);
+		if (!pcn) {
+			percpu_counter_free_nodes(fbc);
+			return -ENOMEM;
+		}
+		raw_spin_lock_init(&pcn->lock);
+		fbc->nodes[node] = pcn;
+	}
+	return 0;
+}
+
 int __percpu_counter_init(struct percpu_counter *fbc, s64 amount, gfp_t gfp,
 			  struct lock_class_key *key)
 {
@@ -120,9 +244,14 @@ int __percpu_counter_init(struct percpu_counter *fbc, s64 amount, gfp_t gfp,
 	raw_spin_lock_init(&fbc->lock);
 	lockdep_set_class(&fbc->lock, key);
 	fbc->count = amount;
+	fbc->batch = 0;
+	if (percpu_counter_alloc_nodes(fbc, gfp))
+		return -ENOMEM;
 	fbc->counters = alloc_percpu_gfp(s32, gfp);
-	if (!fbc->counters)
+	if (!fbc->counters) {
+		percpu_counter_free_nodes(fbc);
 		return -ENOMEM;
+	}
 
 	debug_percpu_counter_activate(fbc);
 
@@ -152,6 +281,7 @@ void percpu_counter_destroy(struct percpu_counter *fbc)
 #endif
 	free_percpu(fbc->counters);
 	fbc->counters = NULL;
+	percpu_counter_free_nodes(fbc);
 }
 EXPORT_SYMBOL(percpu_counter_destroy);
 
@@ -179,14 +309,17 @@ static int percpu_counter_hotcpu_callback(struct notifier_block *nb,
 	cpu = (unsigned long)hcpu;
 	spin_lock_irq(&percpu_counters_lock);
 	list_for_each_entry(fbc, &percpu_counters, list) {
+		raw_spinlock_t *lock;
 		s32 *pcount;
+		s64 *target;
 		unsigned long flags;
 
-		raw_spin_lock_irqsave(&fbc->lock, flags);
+		lock = percpu_counter_fold_lock(fbc, cpu, &target);
+		raw_spin_lock_irqsave(lock, flags);
 		pcount = per_cpu_ptr(fbc->counters, cpu);
-		fbc->count += *pcount;
+		*target += *pcount;
 		*pcount = 0;
-		raw_spin_unlock_irqrestore(&fbc->lock, flags);
+		raw_spin_unlock_irqrestore(lock, flags);
 	}
 	spin_unlock_irq(&percpu_counters_lock);
 #endif
@@ -203,7 +336,7 @@ int __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch)
 
 	count = percpu_counter_read(fbc);
 	/* Check to see if rough count will be sufficient for comparison */
-	if (abs(count - rhs) > (batch * num_online_cpus())) {
+	if (abs(count - rhs) > ((s64)batch * num_online_cpus())) {
 		if (count > rhs)
 			return 1;
 		else
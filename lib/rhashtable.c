@@ -27,11 +27,19 @@
 #include <linux/rhashtable.h>
 #include <linux/err.h>
 #include <linux/export.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #define HASH_DEFAULT_SIZE	64UL
 #define HASH_MIN_SIZE		4U
 #define BUCKET_LOCKS_PER_CPU   128UL
 
+#ifdef CONFIG_RHASHTABLE_STATS
+#define rht_resize_inc(ht, field)	((ht)->field++)
+#else
+#define rht_resize_inc(ht, field)	do { } while (0)
+#endif
+
 static u32 head_hashfn(struct rhashtable *ht,
 		       const struct bucket_table *tbl,
 		       const struct rhash_head *he)
@@ -120,8 +128,12 @@ static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
 	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER) ||
 	    gfp != GFP_KERNEL)
 		tbl = kzalloc(size, gfp | __GFP_NOWARN | __GFP_NORETRY);
+	/*
+	 * A table too big for the page allocator is hit by every cpu, so
+	 * spread it over all nodes rather than the one the resize ran on.
+	 */
 	if (tbl == NULL && gfp == GFP_KERNEL)
-		tbl = vzalloc(size);
+		tbl = vzalloc_interleave(size);
 	if (tbl == NULL)
 		return NULL;
 
@@ -208,7 +220,7 @@ static void rhashtable_rehash_chain(struct rhashtable *ht,
 
 	spin_lock_bh(old_bucket_lock);
 	while (!rhashtable_rehash_one(ht, old_hash))
-		;
+		rht_resize_inc(ht, nr_rehashed);
 	old_tbl->rehash++;
 	spin_unlock_bh(old_bucket_lock);
 }
@@ -247,8 +259,11 @@ static int rhashtable_rehash_table(struct rhashtable *ht)
 	if (!new_tbl)
 		return 0;
 
-	for (old_hash = 0; old_hash < old_tbl->size; old_hash++)
+	/* Give way between chains, big tables take a while to move. */
+	for (old_hash = 0; old_hash < old_tbl->size; old_hash++) {
 		rhashtable_rehash_chain(ht, old_hash);
+		cond_resched();
+	}
 
 	/* Publish the new table pointer. */
 	rcu_assign_pointer(ht->tbl, new_tbl);
@@ -298,6 +313,8 @@ static int rhashtable_expand(struct rhashtable *ht)
 	err = rhashtable_rehash_attach(ht, old_tbl, new_tbl);
 	if (err)
 		bucket_table_free(new_tbl);
+	else
+		rht_resize_inc(ht, nr_expands);
 
 	return err;
 }
@@ -343,6 +360,8 @@ static int rhashtable_shrink(struct rhashtable *ht)
 	err = rhashtable_rehash_attach(ht, old_tbl, new_tbl);
 	if (err)
 		bucket_table_free(new_tbl);
+	else
+		rht_resize_inc(ht, nr_shrinks);
 
 	return err;
 }
@@ -483,6 +502,99 @@ exit:
 }
 EXPORT_SYMBOL_GPL(rhashtable_insert_slow);
 
+/* Grow the table up front so that @nr more objects fit below 75% load */
+static int rhashtable_reserve(struct rhashtable *ht, unsigned int nr)
+{
+	struct bucket_table *new_tbl, *tbl;
+	size_t size;
+	int err = 0;
+
+	size = roundup_pow_of_two(((size_t)atomic_read(&ht->nelems) + nr) *
+				  4 / 3 + 1);
+	if (ht->p.max_size)
+		size = min_t(size_t, size, ht->p.max_size);
+
+	mutex_lock(&ht->mutex);
+
+	tbl = rhashtable_last_table(ht, rht_dereference(ht->tbl, ht));
+	if (size > tbl->size) {
+		new_tbl = bucket_table_alloc(ht, size, GFP_KERNEL);
+		if (new_tbl == NULL) {
+			err = -ENOMEM;
+			goto out;
+		}
+
+		/* An insertion may have started a rehash in the meantime */
+		if (rhashtable_rehash_attach(ht, tbl, new_tbl))
+			bucket_table_free(new_tbl);
+		else
+			rht_resize_inc(ht, nr_expands);
+	}
+
+	while (rhashtable_rehash_table(ht) == -EAGAIN)
+		;
+
+out:
+	mutex_unlock(&ht->mutex);
+	return err;
+}
+
+/**
+ * rhashtable_insert_bulk - insert a batch of objects into hash table
+ * @ht:		hash table
+ * @objs:	pointers to the hash heads inside the objects
+ * @nr:		number of objects
+ * @unique:	fail with -EEXIST if an object's key is already present;
+ *		only for tables with a fixed key, i.e. no obj_hashfn
+ *
+ * Grows the table once to fit all of @objs and moves the entries across
+ * right away, instead of letting the insertions trigger one deferred
+ * expansion after the other while they land in an overloaded table.
+ *
+ * Either all objects are inserted or, on error, none are.  Concurrent
+ * lookups may see objects of a failed batch until they are removed again.
+ *
+ * This function may sleep.  Returns zero on success.
+ */
+int rhashtable_insert_bulk(struct rhashtable *ht, struct rhash_head **objs,
+			   unsigned int nr, bool unique)
+{
+	unsigned int i;
+	int err;
+
+	BUG_ON(unique && ht->p.obj_hashfn);
+
+	err = rhashtable_reserve(ht, nr);
+	if (err)
+		return err;
+
+	for (i = 0; i < nr; i++) {
+		const char *key = NULL;
+
+		if (unique)
+			key = (char *)rht_obj(ht, objs[i]) + ht->p.key_offset;
+
+		do {
+			err = __rhashtable_insert_fast(ht, key, objs[i],
+						       ht->p);
+			/* a rehash is in progress, it will be done shortly */
+			if (err == -EBUSY)
+				cond_resched();
+		} while (err == -EBUSY);
+
+		if (err)
+			goto unwind;
+	}
+
+	return 0;
+
+unwind:
+	while (i--)
+		rhashtable_remove_fast(ht, objs[i], ht->p);
+	return err;
+}
+EXPORT_SYMBOL_GPL(rhashtable_insert_bulk);
+
 /**
  * rhashtable_walk_init - Initialise an iterator
  * @ht:		Table to walk over
@@ -758,6 +870,12 @@ int rhashtable_init(struct rhashtable *ht,
 	if (params->nelem_hint)
 		size = rounded_hashtable_size(&ht->p);
 
+#ifdef CONFIG_RHASHTABLE_STATS
+	ht->stats = alloc_percpu(struct rhashtable_stats);
+	if (!ht->stats)
+		return -ENOMEM;
+#endif
+
 	/* The maximum (not average) chain length grows with the
 	 * size of the hash table, at a rate of (log N)/(log log N).
 	 * The value of 16 is selected so that even if the hash
@@ -789,8 +907,12 @@ int rhashtable_init(struct rhashtable *ht,
 	}
 
 	tbl = bucket_table_alloc(ht, size, GFP_KERNEL);
-	if (tbl == NULL)
+	if (tbl == NULL) {
+#ifdef CONFIG_RHASHTABLE_STATS
+		free_percpu(ht->stats);
+#endif
 		return -ENOMEM;
+	}
 
 	atomic_set(&ht->nelems, 0);
 
@@ -844,6 +966,9 @@ void rhashtable_free_and_destroy(struct rhashtable *ht,
 	}
 
 	bucket_table_free(tbl);
+#ifdef CONFIG_RHASHTABLE_STATS
+	free_percpu(ht->stats);
+#endif
 	mutex_unlock(&ht->mutex);
 }
 EXPORT_SYMBOL_GPL(rhashtable_free_and_destroy);
@@ -853,3 +978,91 @@ void rhashtable_destroy(struct rhashtable *ht)
 	return rhashtable_free_and_destroy(ht, NULL, NULL);
 }
 EXPORT_SYMBOL_GPL(rhashtable_destroy);
+
+#ifdef CONFIG_RHASHTABLE_STATS
+#define RHT_CHAIN_HIST	8
+
+static int rhashtable_stats_show(struct seq_file *m, void *v)
+{
+	struct rhashtable *ht = m->private;
+	unsigned int hist[RHT_CHAIN_HIST + 1] = { 0 };
+	unsigned long lookups = 0, misses = 0, compares = 0;
+	unsigned int i, len, max_len = 0;
+	const struct bucket_table *tbl;
+	struct rhash_head *he;
+	bool rehashing;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct rhashtable_stats *s = per_cpu_ptr(ht->stats, cpu);
+
+		lookups += s->lookups;
+		misses += s->misses;
+		compares += s->compares;
+	}
+
+	rcu_read_lock();
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	for (i = 0; i < tbl->size; i++) {
+		len = 0;
+		rht_for_each_rcu(he, tbl, i)
+			len++;
+		hist[min_t(unsigned int, len, RHT_CHAIN_HIST)]++;
+		max_len = max(max_len, len);
+	}
+	seq_printf(m, "size: %u\n", tbl->size);
+	rehashing = rcu_access_pointer(tbl->future_tbl) != NULL;
+	rcu_read_unlock();
+
+	seq_printf(m, "nelems: %d\n", atomic_read(&ht->nelems));
+	seq_printf(m, "rehashing: %d\n", rehashing);
+	seq_printf(m, "expands: %u\n", ht->nr_expands);
+	seq_printf(m, "shrinks: %u\n", ht->nr_shrinks);
+	seq_printf(m, "rehashed: %lu\n", ht->nr_rehashed);
+	seq_printf(m, "lookups: %lu\n", lookups);
+	seq_printf(m, "misses: %lu\n", misses);
+	seq_printf(m, "compares: %lu\n", compares);
+	seq_printf(m, "max_chain: %u\n", max_len);
+	seq_puts(m, "chains:");
+	for (i = 0; i < RHT_CHAIN_HIST; i++)
+		seq_printf(m, " %u", hist[i]);
+	seq_printf(m, " %u+:%u\n", RHT_CHAIN_HIST, hist[RHT_CHAIN_HIST]);
+
+	return 0;
+}
+
+static int rhashtable_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rhashtable_stats_show, inode->i_private);
+}
+
+static const struct file_operations rhashtable_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= rhashtable_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/**
+ * rhashtable_debugfs_create - export statistics of a hash table
+ * @ht:		hash table
+ * @name:	name of the debugfs file
+ * @parent:	debugfs directory to create it in, or NULL
+ *
+ * The file reports the table size and load, resize and rehash counts,
+ * the lookup counters summed over all cpus and a histogram of the
+ * chain lengths, computed when it is read.
+ *
+ * The caller removes the file with debugfs_remove() before destroying
+ * the table.
+ */
+struct dentry *rhashtable_debugfs_create(struct rhashtable *ht,
+					 const char *name,
+					 struct dentry *parent)
+{
+	return debugfs_create_file(name, S_IRUSR, parent, ht,
+				   &rhashtable_stats_fops);
+}
+EXPORT_SYMBOL_GPL(rhashtable_debugfs_create);
+#endif /* CONFIG_RHASHTABLE_STATS */
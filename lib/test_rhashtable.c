@@ -236,6 +236,55 @@ static s64 __init test_rhashtable(struct rhashtable *ht)
 
 static struct rhashtable ht;
 
+static int __init test_rhashtable_bulk(struct rhashtable *ht)
+{
+	struct rhash_head **objs;
+	unsigned int i;
+	int err;
+
+	objs = vmalloc(entries * sizeof(*objs));
+	if (!objs)
+		return -ENOMEM;
+
+	pr_info("  Adding %d keys in bulk\n", entries);
+	for (i = 0; i < entries; i++) {
+		array[i].value = i * 2;
+		objs[i] = &array[i].node;
+	}
+
+	err = rhashtable_insert_bulk(ht, objs, entries, true);
+	if (err) {
+		pr_warn("Test failed: bulk insert returned %d\n", err);
+		goto out;
+	}
+
+	rcu_read_lock();
+	err = test_rht_lookup(ht);
+	rcu_read_unlock();
+	if (err)
+		goto out;
+
+	test_bucket_stats(ht);
+
+	/* A batch with a duplicate key must leave the table untouched */
+	err = rhashtable_insert_bulk(ht, objs + entries - 1, 1, true);
+	if (err != -EEXIST || atomic_read(&ht->nelems) != entries) {
+		pr_warn("Test failed: duplicate bulk insert returned %d, nelems=%d\n",
+			err, atomic_read(&ht->nelems));
+		err = -EINVAL;
+		goto out;
+	}
+	err = 0;
+
+	for (i = 0; i < entries; i++) {
+		rhashtable_remove_fast(ht, objs[i], test_rht_params);
+		cond_resched();
+	}
+out:
+	vfree(objs);
+	return err;
+}
+
 static int thread_lookup_test(struct thread_data *tdata)
 {
 	int i, err = 0;
@@ -364,6 +413,19 @@ static int __init test_rht_init(void)
 	do_div(total_time, runs);
 	pr_info("Average test time: %llu\n", total_time);
 
+	pr_info("Testing bulk insertion\n");
+	memset(&array, 0, sizeof(array));
+	err = rhashtable_init(&ht, &test_rht_params);
+	if (err < 0) {
+		pr_warn("Test failed: Unable to initialize hashtable: %d\n",
+			err);
+		return -EINVAL;
+	}
+	err = test_rhashtable_bulk(&ht);
+	rhashtable_destroy(&ht);
+	if (err)
+		return -EINVAL;
+
 	if (!tcount)
 		return 0;
 
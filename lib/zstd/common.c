@@ -0,0 +1,520 @@
+/*
+ * Zstandard helpers shared by the compressor and decompressor: code
+ * tables, entropy table headers, dictionary layout and the content
+ * checksum.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+
+#include "zstd_internal.h"
+
+const u32 zstd_ll_base[ZSTD_LL_MAX_CODE + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 0x80, 0x100, 0x200, 0x400,
+	0x800, 0x1000, 0x2000, 0x4000, 0x8000, 0x10000,
+};
+EXPORT_SYMBOL_GPL(zstd_ll_base);
+
+const u8 zstd_ll_bits[ZSTD_LL_MAX_CODE + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16,
+};
+EXPORT_SYMBOL_GPL(zstd_ll_bits);
+
+const u32 zstd_ml_base[ZSTD_ML_MAX_CODE + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 0x83, 0x103, 0x203,
+	0x403, 0x803, 0x1003, 0x2003, 0x4003, 0x8003, 0x10003,
+};
+EXPORT_SYMBOL_GPL(zstd_ml_base);
+
+const u8 zstd_ml_bits[ZSTD_ML_MAX_CODE + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16,
+};
+EXPORT_SYMBOL_GPL(zstd_ml_bits);
+
+const s16 zstd_ll_default_norm[ZSTD_LL_MAX_CODE + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1,
+};
+EXPORT_SYMBOL_GPL(zstd_ll_default_norm);
+
+const s16 zstd_ml_default_norm[ZSTD_ML_MAX_CODE + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1,
+};
+EXPORT_SYMBOL_GPL(zstd_ml_default_norm);
+
+const s16 zstd_of_default_norm[ZSTD_OF_DEFAULT_MAX + 1] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+};
+EXPORT_SYMBOL_GPL(zstd_of_default_norm);
+
+/* Little endian bit reader for table headers, reads zeroes past the end */
+struct zstd_bitf {
+	const u8 *src;
+	size_t size;
+	size_t pos;
+};
+
+static u32 zstd_bitf_peek(const struct zstd_bitf *bf, unsigned int nb)
+{
+	size_t byte = bf->pos >> 3;
+	u32 v = 0;
+	int i;
+
+	for (i = 0; i < 4 && byte + i < bf->size; i++)
+		v |= (u32)bf->src[byte + i] << (8 * i);
+
+	return (v >> (bf->pos & 7)) & ((1u << nb) - 1);
+}
+
+static u32 zstd_bitf_read(struct zstd_bitf *bf, unsigned int nb)
+{
+	u32 v = zstd_bitf_peek(bf, nb);
+
+	bf->pos += nb;
+	return v;
+}
+
+/*
+ * Read the normalized counts of an FSE table.  On entry *max_symbol is the
+ * largest symbol allowed, on return the largest one described.  Returns
+ * the size of the header.
+ */
+int zstd_read_ncount(s16 *norm, unsigned int *max_symbol,
+		     unsigned int *table_log, const u8 *src, size_t size)
+{
+	struct zstd_bitf bf = { .src = src, .size = size };
+	unsigned int log, nbits, symbol = 0;
+	int remaining, threshold;
+	bool previous0 = false;
+
+	if (!size)
+		return -EINVAL;
+
+	log = zstd_bitf_read(&bf, 4) + ZSTD_FSE_MIN_LOG;
+	if (log > ZSTD_FSE_MAX_LOG)
+		return -EINVAL;
+
+	remaining = (1 << log) + 1;
+	threshold = 1 << log;
+	nbits = log + 1;
+
+	while (remaining > 1 && symbol <= *max_symbol) {
+		int max, count;
+
+		if (previous0) {
+			unsigned int n0 = symbol, repeat;
+
+			do {
+				repeat = zstd_bitf_read(&bf, 2);
+				n0 += repeat;
+				if (bf.pos > size * 8)
+					return -EINVAL;
+			} while (repeat == 3);
+
+			if (n0 > *max_symbol)
+				return -EINVAL;
+			while (symbol < n0)
+				norm[symbol++] = 0;
+		}
+
+		max = (2 * threshold - 1) - remaining;
+		count = zstd_bitf_peek(&bf, nbits);
+		if ((count & (threshold - 1)) < max) {
+			count &= threshold - 1;
+			bf.pos += nbits - 1;
+		} else {
+			count &= 2 * threshold - 1;
+			if (count >= threshold)
+				count -= max;
+			bf.pos += nbits;
+		}
+
+		/* 0 stands for "less than 1", a single low probability slot */
+		count--;
+		remaining -= count < 0 ? -count : count;
+		norm[symbol++] = count;
+		previous0 = !count;
+
+		if (remaining < threshold) {
+			if (remaining <= 1)
+				break;
+			nbits = zstd_highbit(remaining) + 1;
+			threshold = 1 << (nbits - 1);
+		}
+	}
+
+	if (remaining != 1 || bf.pos > size * 8)
+		return -EINVAL;
+
+	*max_symbol = symbol - 1;
+	*table_log = log;
+	return (bf.pos + 7) >> 3;
+}
+EXPORT_SYMBOL_GPL(zstd_read_ncount);
+
+int zstd_fse_build_dtable(struct zstd_fse_dentry *dt, const s16 *norm,
+			  unsigned int max_symbol, unsigned int table_log)
+{
+	u16 next[ZSTD_HUF_MAX_SYMBOLS];
+	unsigned int size = 1 << table_log;
+	unsigned int mask = size - 1;
+	unsigned int step = (size >> 1) + (size >> 3) + 3;
+	unsigned int high = size - 1;
+	unsigned int pos = 0, s, u;
+	int i;
+
+	if (max_symbol >= ZSTD_HUF_MAX_SYMBOLS || table_log > ZSTD_FSE_MAX_LOG)
+		return -EINVAL;
+
+	/* Low probability symbols take the last states, one each */
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			dt[high--].symbol = s;
+			next[s] = 1;
+		} else {
+			next[s] = norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			dt[pos].symbol = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+
+	/* Every state has been visited exactly once iff we're back at 0 */
+	if (pos)
+		return -EINVAL;
+
+	for (u = 0; u < size; u++) {
+		unsigned int n = next[dt[u].symbol]++;
+
+		dt[u].nbits = table_log - zstd_highbit(n);
+		dt[u].base = (n << dt[u].nbits) - size;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zstd_fse_build_dtable);
+
+static int zstd_fse_decode_weights(u8 *weights, const u8 *src, size_t size)
+{
+	struct zstd_fse_dentry dt[ZSTD_FSE_DTABLE_SIZE(ZSTD_HUF_WEIGHTS_LOG)];
+	s16 norm[ZSTD_HUF_MAX_BITS + 2];
+	unsigned int max_symbol = ZSTD_HUF_MAX_BITS + 1, log;
+	unsigned int s1, s2, n = 0;
+	struct zstd_bitd bd;
+	int ret;
+
+	ret = zstd_read_ncount(norm, &max_symbol, &log, src, size);
+	if (ret < 0)
+		return ret;
+	if (log > ZSTD_HUF_WEIGHTS_LOG)
+		return -EINVAL;
+
+	if (zstd_fse_build_dtable(dt, norm, max_symbol, log) ||
+	    zstd_bitd_init(&bd, src + ret, size - ret))
+		return -EINVAL;
+
+	s1 = zstd_bitd_read(&bd, log);
+	zstd_bitd_reload(&bd);
+	s2 = zstd_bitd_read(&bd, log);
+	zstd_bitd_reload(&bd);
+
+	/* The two states alternate until the stream runs dry */
+	for (;;) {
+		if (n >= ZSTD_HUF_MAX_SYMBOLS - 2)
+			return -EINVAL;
+
+		weights[n++] = zstd_fse_decode(dt, &s1, &bd);
+		if (zstd_bitd_reload(&bd) == ZSTD_BITD_OVERFLOW) {
+			weights[n++] = dt[s2].symbol;
+			break;
+		}
+
+		weights[n++] = zstd_fse_decode(dt, &s2, &bd);
+		if (zstd_bitd_reload(&bd) == ZSTD_BITD_OVERFLOW) {
+			weights[n++] = dt[s1].symbol;
+			break;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Read a Huffman tree description.  The weight of the last symbol is
+ * implied, it brings the total up to the next power of two.  Returns the
+ * size of the description.
+ */
+int zstd_huf_read_weights(u8 *weights, unsigned int *nb_symbols,
+			  unsigned int *table_log, const u8 *src, size_t size)
+{
+	u32 rank[ZSTD_HUF_MAX_BITS + 1] = { 0 };
+	unsigned int header, n, i, log, last;
+	u32 total = 0, rest;
+	int ret;
+
+	if (!size)
+		return -EINVAL;
+
+	header = src[0];
+	if (header >= 128) {
+		n = header - 127;
+		header = (n + 1) / 2;
+		if (header + 1 > size)
+			return -EINVAL;
+
+		for (i = 0; i < n; i++)
+			weights[i] = i & 1 ? src[1 + i / 2] & 15 :
+					     src[1 + i / 2] >> 4;
+	} else {
+		if (header + 1 > size)
+			return -EINVAL;
+
+		ret = zstd_fse_decode_weights(weights, src + 1, header);
+		if (ret < 0)
+			return ret;
+		n = ret;
+	}
+
+	if (n >= ZSTD_HUF_MAX_SYMBOLS)
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		if (weights[i] > ZSTD_HUF_MAX_BITS)
+			return -EINVAL;
+		rank[weights[i]]++;
+		total += (1 << weights[i]) >> 1;
+	}
+	if (!total)
+		return -EINVAL;
+
+	log = zstd_highbit(total) + 1;
+	if (log > ZSTD_HUF_MAX_BITS)
+		return -EINVAL;
+
+	rest = (1 << log) - total;
+	if (rest & (rest - 1))
+		return -EINVAL;
+
+	last = zstd_highbit(rest) + 1;
+	weights[n++] = last;
+	rank[last]++;
+
+	/* The tree must be complete, weight 1 leaves come in pairs */
+	if (rank[1] < 2 || (rank[1] & 1))
+		return -EINVAL;
+
+	*nb_symbols = n;
+	*table_log = log;
+	return header + 1;
+}
+EXPORT_SYMBOL_GPL(zstd_huf_read_weights);
+
+/*
+ * Locate the parts of a dictionary.  Anything not starting with the
+ * dictionary magic is raw content, with the default repeat offsets.
+ */
+int zstd_parse_dict(struct zstd_dict_parts *parts, const void *dict,
+		    size_t dict_size)
+{
+	const u8 *p = dict, *end = p + dict_size;
+	u8 weights[ZSTD_HUF_MAX_SYMBOLS];
+	s16 norm[ZSTD_ML_MAX_CODE + 1];
+	unsigned int max, log, n;
+	int ret, i;
+
+	memset(parts, 0, sizeof(*parts));
+	parts->rep[0] = 1;
+	parts->rep[1] = 4;
+	parts->rep[2] = 8;
+
+	if (dict_size < 8 || get_unaligned_le32(p) != ZSTD_DICT_MAGIC) {
+		parts->content = dict;
+		parts->content_size = dict_size;
+		return 0;
+	}
+
+	parts->id = get_unaligned_le32(p + 4);
+	p += 8;
+
+	ret = zstd_huf_read_weights(weights, &n, &log, p, end - p);
+	if (ret < 0)
+		return ret;
+	parts->huf = p;
+	parts->huf_size = ret;
+	p += ret;
+
+	max = ZSTD_OF_MAX_CODE;
+	ret = zstd_read_ncount(norm, &max, &log, p, end - p);
+	if (ret < 0 || log > ZSTD_OF_MAX_LOG)
+		return -EINVAL;
+	parts->of = p;
+	parts->of_size = ret;
+	p += ret;
+
+	max = ZSTD_ML_MAX_CODE;
+	ret = zstd_read_ncount(norm, &max, &log, p, end - p);
+	if (ret < 0 || log > ZSTD_ML_MAX_LOG)
+		return -EINVAL;
+	parts->ml = p;
+	parts->ml_size = ret;
+	p += ret;
+
+	max = ZSTD_LL_MAX_CODE;
+	ret = zstd_read_ncount(norm, &max, &log, p, end - p);
+	if (ret < 0 || log > ZSTD_LL_MAX_LOG)
+		return -EINVAL;
+	parts->ll = p;
+	parts->ll_size = ret;
+	p += ret;
+
+	if (end - p < 4 * ZSTD_REP_NUM)
+		return -EINVAL;
+	for (i = 0; i < ZSTD_REP_NUM; i++, p += 4)
+		parts->rep[i] = get_unaligned_le32(p);
+
+	parts->content = p;
+	parts->content_size = end - p;
+
+	for (i = 0; i < ZSTD_REP_NUM; i++)
+		if (!parts->rep[i] || parts->rep[i] > parts->content_size)
+			return -EINVAL;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zstd_parse_dict);
+
+/* XXH64, see <https://github.com/Cyan4973/xxHash> */
+#define PRIME64_1	11400714785074694791ULL
+#define PRIME64_2	14029467366897019727ULL
+#define PRIME64_3	1609587929392839161ULL
+#define PRIME64_4	9650029242287828579ULL
+#define PRIME64_5	2870177450012600261ULL
+
+static u64 xxh64_round(u64 acc, u64 input)
+{
+	acc += input * PRIME64_2;
+	acc = rol64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static u64 xxh64_merge_round(u64 acc, u64 val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+void zstd_xxh64_reset(struct zstd_xxh64_state *state)
+{
+	memset(state, 0, sizeof(*state));
+	state->v[0] = PRIME64_1 + PRIME64_2;
+	state->v[1] = PRIME64_2;
+	state->v[2] = 0;
+	state->v[3] = -PRIME64_1;
+}
+EXPORT_SYMBOL_GPL(zstd_xxh64_reset);
+
+static void xxh64_stripe(u64 *v, const u8 *p)
+{
+	v[0] = xxh64_round(v[0], get_unaligned_le64(p));
+	v[1] = xxh64_round(v[1], get_unaligned_le64(p + 8));
+	v[2] = xxh64_round(v[2], get_unaligned_le64(p + 16));
+	v[3] = xxh64_round(v[3], get_unaligned_le64(p + 24));
+}
+
+void zstd_xxh64_update(struct zstd_xxh64_state *state, const void *input,
+		       size_t len)
+{
+	const u8 *p = input, *end = p + len;
+
+	state->total_len += len;
+
+	if (state->mem_size + len < 32) {
+		memcpy(state->mem + state->mem_size, p, len);
+		state->mem_size += len;
+		return;
+	}
+
+	if (state->mem_size) {
+		memcpy(state->mem + state->mem_size, p, 32 - state->mem_size);
+		xxh64_stripe(state->v, state->mem);
+		p += 32 - state->mem_size;
+		state->mem_size = 0;
+	}
+
+	for (; p + 32 <= end; p += 32)
+		xxh64_stripe(state->v, p);
+
+	memcpy(state->mem, p, end - p);
+	state->mem_size = end - p;
+}
+EXPORT_SYMBOL_GPL(zstd_xxh64_update);
+
+u64 zstd_xxh64_digest(const struct zstd_xxh64_state *state)
+{
+	const u8 *p = state->mem, *end = p + state->mem_size;
+	const u64 *v = state->v;
+	u64 h;
+
+	if (state->total_len >= 32) {
+		h = rol64(v[0], 1) + rol64(v[1], 7) +
+		    rol64(v[2], 12) + rol64(v[3], 18);
+		h = xxh64_merge_round(h, v[0]);
+		h = xxh64_merge_round(h, v[1]);
+		h = xxh64_merge_round(h, v[2]);
+		h = xxh64_merge_round(h, v[3]);
+	} else {
+		h = PRIME64_5;
+	}
+
+	h += state->total_len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, get_unaligned_le64(p));
+		h = rol64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if (p + 4 <= end) {
+		h ^= (u64)get_unaligned_le32(p) * PRIME64_1;
+		h = rol64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	for (; p < end; p++) {
+		h ^= *p * PRIME64_5;
+		h = rol64(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+EXPORT_SYMBOL_GPL(zstd_xxh64_digest);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard common code");
@@ -0,0 +1,1969 @@
+/*
+ * Zstandard compressor
+ *
+ * Matches are found with hash chains over a window of 1 << window_log
+ * bytes.  Parsing is lazy: once a match is found the next one or two
+ * positions are searched as well and the better match wins.  Every block
+ * gets freshly built Huffman and FSE tables, or the predefined ones when
+ * it has too few sequences to pay for a table; a block that doesn't
+ * shrink is stored raw.
+ *
+ * Positions are u32 indices relative to a base pointer.  Like the decoder
+ * the history is split in two: the prefix, contiguous with the data being
+ * compressed, and one older ext segment.  The ext segment is the
+ * dictionary, or the part of the streaming window buffer that was left
+ * behind when the buffer wrapped.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sort.h>
+
+#include "zstd_internal.h"
+
+/* Indices are rebased once they get this large */
+#define ZSTD_INDEX_MAX		(3U << 29)
+
+/* Literals shorter than this aren't worth a Huffman table */
+#define ZSTD_MIN_LITERALS	64
+
+/* Blocks with fewer sequences than this use the predefined tables */
+#define ZSTD_MIN_SEQ_TABLE	64
+
+/* Window, chain, hash and search logs, minimum match and lazy depth */
+static const struct zstd_params zstd_level_params[ZSTD_MAX_CLEVEL + 1] = {
+	{ 0 },
+	{ 19, 14, 15, 1, 5, 0 },
+	{ 19, 15, 16, 1, 5, 0 },
+	{ 20, 16, 17, 1, 5, 1 },
+	{ 20, 17, 17, 2, 5, 1 },
+	{ 21, 17, 18, 2, 5, 1 },
+	{ 21, 18, 18, 3, 5, 2 },
+	{ 21, 18, 19, 3, 5, 2 },
+	{ 22, 19, 19, 4, 5, 2 },
+	{ 22, 20, 20, 4, 5, 2 },
+};
+
+static const u8 zstd_ll_code_table[64] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 16, 17, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+};
+
+static const u8 zstd_ml_code_table[128] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+	32, 32, 33, 33, 34, 34, 35, 35, 36, 36, 36, 36, 37, 37, 37, 37,
+	38, 38, 38, 38, 38, 38, 38, 38, 39, 39, 39, 39, 39, 39, 39, 39,
+	40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+	41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+};
+
+struct zstd_seq {
+	u32 lit_len;
+	u32 match_len;		/* minus ZSTD_MINMATCH */
+	u32 offset;		/* offset + ZSTD_REP_NUM, or repeat code */
+};
+
+struct zstd_fse_ctable {
+	u16 state[1 << ZSTD_ML_MAX_LOG];
+	struct {
+		s32 delta_find_state;
+		u32 delta_nbits;
+	} tt[ZSTD_ML_MAX_CODE + 1];
+	unsigned int log;
+};
+
+struct zstd_huf_node {
+	u32 count;
+	u16 parent;
+	u8 symbol;
+	u8 nbits;
+};
+
+struct zstd_cctx {
+	struct zstd_params init_params;
+	struct zstd_params params;	/* for the current frame */
+	size_t block_size;
+
+	/* History, see the top of the file */
+	const u8 *base;
+	const u8 *dict_base;
+	u32 dict_limit;
+	u32 low_limit;
+	u32 next_to_update;
+	u32 *hash_table;
+	u32 *chain_table;
+
+	/* Sequences and literals of the current block */
+	struct zstd_seq *seqs;
+	unsigned int nb_seq;
+	u8 *lits;
+	size_t nb_lits;
+	u8 *ll_codes;
+	u8 *ml_codes;
+	u8 *of_codes;
+	u32 rep[ZSTD_REP_NUM];
+
+	u32 dict_id;
+	struct zstd_xxh64_state xxh;
+
+	/* Entropy tables */
+	struct zstd_fse_ctable ll_default, of_default, ml_default;
+	struct zstd_fse_ctable ll_ct, of_ct, ml_ct;
+	u16 huf_code[ZSTD_HUF_MAX_SYMBOLS];
+	u8 huf_nbits[ZSTD_HUF_MAX_SYMBOLS];
+	u32 count[ZSTD_HUF_MAX_SYMBOLS];
+	struct zstd_huf_node nodes[2 * ZSTD_HUF_MAX_SYMBOLS];
+};
+
+struct zstd_cdict {
+	struct zstd_params params;
+	const u8 *content;
+	size_t content_size;
+	u32 id;
+	u32 rep[ZSTD_REP_NUM];
+	u32 *hash_table;
+	u32 *chain_table;
+};
+
+/* No point in a window or tables larger than the input */
+static void zstd_fit_params(struct zstd_params *params, u64 src_size)
+{
+	if (src_size && src_size < (1U << params->window_log)) {
+		unsigned int log = zstd_highbit(src_size - 1) + 1;
+
+		params->window_log = max_t(unsigned int, log,
+					   ZSTD_WINDOWLOG_MIN);
+	}
+	params->hash_log = min(params->hash_log, params->window_log + 1);
+	params->chain_log = min(params->chain_log, params->window_log);
+}
+
+struct zstd_params zstd_get_params(int level, size_t src_size)
+{
+	struct zstd_params params;
+
+	level = clamp(level, ZSTD_MIN_CLEVEL, ZSTD_MAX_CLEVEL);
+	params = zstd_level_params[level];
+	zstd_fit_params(&params, src_size);
+
+	return params;
+}
+EXPORT_SYMBOL(zstd_get_params);
+
+static bool zstd_params_valid(const struct zstd_params *params)
+{
+	return params->window_log >= ZSTD_WINDOWLOG_MIN &&
+	       params->window_log <= ZSTD_WINDOWLOG_MAX &&
+	       params->chain_log >= 6 &&
+	       params->chain_log <= params->window_log &&
+	       params->hash_log >= 6 && params->hash_log <= 26 &&
+	       params->search_log <= params->chain_log &&
+	       params->min_match >= 4 && params->min_match <= 7 &&
+	       params->lazy_depth <= 2;
+}
+
+static size_t zstd_block_size(const struct zstd_params *params)
+{
+	return min_t(size_t, ZSTD_BLOCKSIZE_MAX, 1U << params->window_log);
+}
+
+/* Forward bit stream, least significant bit first */
+
+struct zstd_bitc {
+	u64 container;
+	unsigned int nbits;
+	u8 *start;
+	u8 *ptr;
+	u8 *end;
+	bool overflow;
+};
+
+static void zstd_bitc_init(struct zstd_bitc *bc, u8 *dst, size_t capacity)
+{
+	bc->container = 0;
+	bc->nbits = 0;
+	bc->start = bc->ptr = dst;
+	bc->end = dst + capacity;
+	bc->overflow = false;
+}
+
+/* At most 56 bits may be pending between flushes */
+static inline void zstd_bitc_add(struct zstd_bitc *bc, u64 value,
+				 unsigned int nb)
+{
+	bc->container |= (value & ((1ULL << nb) - 1)) << bc->nbits;
+	bc->nbits += nb;
+}
+
+static inline void zstd_bitc_flush(struct zstd_bitc *bc)
+{
+	size_t bytes = bc->nbits >> 3;
+	size_t i;
+
+	if (bc->end - bc->ptr >= 8) {
+		put_unaligned_le64(bc->container, bc->ptr);
+	} else {
+		if (bytes > (size_t)(bc->end - bc->ptr)) {
+			bc->overflow = true;
+			bytes = bc->end - bc->ptr;
+		}
+		for (i = 0; i < bytes; i++)
+			bc->ptr[i] = bc->container >> (8 * i);
+	}
+
+	bc->ptr += bytes;
+	bc->container >>= bytes * 8;
+	bc->nbits -= bytes * 8;
+	if (bc->overflow)
+		bc->nbits = 0;
+}
+
+/* Pads to a byte, returns the size of the stream */
+static ssize_t zstd_bitc_finish(struct zstd_bitc *bc)
+{
+	zstd_bitc_flush(bc);
+	if (bc->nbits) {
+		if (bc->ptr < bc->end)
+			*bc->ptr++ = bc->container;
+		else
+			bc->overflow = true;
+	}
+
+	return bc->overflow ? -ENOSPC : bc->ptr - bc->start;
+}
+
+/* Streams read backwards end with a 1 bit marking where they start */
+static ssize_t zstd_bitc_close(struct zstd_bitc *bc)
+{
+	zstd_bitc_add(bc, 1, 1);
+	return zstd_bitc_finish(bc);
+}
+
+/* FSE */
+
+static unsigned int zstd_fse_optimal_log(unsigned int max_log, size_t total,
+					 unsigned int max_symbol)
+{
+	unsigned int log = max_log;
+	unsigned int max_bits_src = zstd_highbit(total - 1) - 2;
+	unsigned int min_bits = min(zstd_highbit(total) + 1,
+				    zstd_highbit(max_symbol) + 2);
+
+	if (total > 1 && max_bits_src < log)
+		log = max_bits_src;
+	if (min_bits > log)
+		log = min_bits;
+	return clamp_t(unsigned int, log, ZSTD_FSE_MIN_LOG, max_log);
+}
+
+/*
+ * Scale the symbol counts to add up to 1 << log.  Symbols too rare for a
+ * full state get the "less than 1" probability -1.
+ */
+static void zstd_fse_normalize(s16 *norm, unsigned int log, const u32 *count,
+			       size_t total, unsigned int max_symbol)
+{
+	static const u32 rest_to_beat[8] = {
+		0, 473195, 504333, 520860, 550000, 700000, 750000, 830000,
+	};
+	unsigned int scale = 62 - log;
+	u64 step = div_u64(1ULL << 62, total);
+	u64 vstep = 1ULL << (scale - 20);
+	u32 low_threshold = total >> log;
+	int still = 1 << log;
+	unsigned int s, largest = 0;
+	s16 largest_p = 0;
+
+	for (s = 0; s <= max_symbol; s++) {
+		s16 p;
+
+		if (!count[s]) {
+			norm[s] = 0;
+			continue;
+		}
+		if (count[s] <= low_threshold) {
+			norm[s] = -1;
+			still--;
+			continue;
+		}
+
+		p = (count[s] * step) >> scale;
+		if (p < 8)
+			p += (count[s] * step) - ((u64)p << scale) >
+			     vstep * rest_to_beat[p];
+		if (p > largest_p) {
+			largest_p = p;
+			largest = s;
+		}
+		norm[s] = p;
+		still -= p;
+	}
+
+	if (-still < (norm[largest] >> 1)) {
+		norm[largest] += still;
+		return;
+	}
+
+	/* Too much to take from one symbol, take from the biggest in turn */
+	while (still < 0) {
+		unsigned int big = 0;
+
+		for (s = 0; s <= max_symbol; s++)
+			if (norm[s] > norm[big])
+				big = s;
+		norm[big]--;
+		still++;
+	}
+}
+
+static ssize_t zstd_fse_write_ncount(u8 *dst, size_t capacity,
+				     const s16 *norm, unsigned int max_symbol,
+				     unsigned int log)
+{
+	int remaining = (1 << log) + 1, threshold = 1 << log;
+	unsigned int nbits = log + 1, symbol = 0;
+	bool previous0 = false;
+	struct zstd_bitc bc;
+
+	zstd_bitc_init(&bc, dst, capacity);
+	zstd_bitc_add(&bc, log - ZSTD_FSE_MIN_LOG, 4);
+
+	while (symbol <= max_symbol && remaining > 1) {
+		int count, max;
+
+		if (previous0) {
+			unsigned int start = symbol;
+
+			while (symbol <= max_symbol && !norm[symbol])
+				symbol++;
+			if (symbol > max_symbol)
+				return -EINVAL;
+			while (symbol >= start + 3) {
+				start += 3;
+				zstd_bitc_add(&bc, 3, 2);
+				zstd_bitc_flush(&bc);
+			}
+			zstd_bitc_add(&bc, symbol - start, 2);
+		}
+
+		count = norm[symbol++];
+		max = (2 * threshold - 1) - remaining;
+		remaining -= count < 0 ? -count : count;
+		count++;
+		if (count >= threshold)
+			count += max;
+		zstd_bitc_add(&bc, count, nbits - (count < max));
+		zstd_bitc_flush(&bc);
+		previous0 = count == 1;
+
+		if (remaining < 1)
+			return -EINVAL;
+		while (remaining < threshold) {
+			nbits--;
+			threshold >>= 1;
+		}
+	}
+
+	if (remaining != 1)
+		return -EINVAL;
+	return zstd_bitc_finish(&bc);
+}
+
+/* Mirrors zstd_fse_build_dtable(): same spread, states in the same order */
+static void zstd_fse_build_ctable(struct zstd_fse_ctable *ct, const s16 *norm,
+				  unsigned int max_symbol, unsigned int log)
+{
+	u8 symbols[1 << ZSTD_ML_MAX_LOG];
+	u16 cumul[ZSTD_ML_MAX_CODE + 2];
+	unsigned int size = 1 << log, mask = size - 1;
+	unsigned int step = (size >> 1) + (size >> 3) + 3;
+	unsigned int high = size - 1, pos = 0, s, u;
+	int i, total = 0;
+
+	cumul[0] = 0;
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			cumul[s + 1] = cumul[s] + 1;
+			symbols[high--] = s;
+		} else {
+			cumul[s + 1] = cumul[s] + norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			symbols[pos] = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+
+	for (u = 0; u < size; u++)
+		ct->state[cumul[symbols[u]]++] = size + u;
+
+	for (s = 0; s <= max_symbol; s++) {
+		unsigned int max_bits;
+
+		switch (norm[s]) {
+		case 0:
+			ct->tt[s].delta_nbits = ((log + 1) << 16) - size;
+			ct->tt[s].delta_find_state = 0;
+			break;
+		case -1:
+		case 1:
+			ct->tt[s].delta_nbits = (log << 16) - size;
+			ct->tt[s].delta_find_state = total - 1;
+			total++;
+			break;
+		default:
+			max_bits = log - zstd_highbit(norm[s] - 1);
+			ct->tt[s].delta_nbits = (max_bits << 16) -
+						(norm[s] << max_bits);
+			ct->tt[s].delta_find_state = total - norm[s];
+			total += norm[s];
+			break;
+		}
+	}
+
+	ct->log = log;
+}
+
+/* A table for a single symbol: every state is 0, no bits are spent */
+static void zstd_fse_build_ctable_rle(struct zstd_fse_ctable *ct,
+				      unsigned int symbol)
+{
+	ct->state[0] = 0;
+	ct->tt[symbol].delta_nbits = 0;
+	ct->tt[symbol].delta_find_state = 0;
+	ct->log = 0;
+}
+
+struct zstd_fse_cstate {
+	u32 value;
+	const struct zstd_fse_ctable *ct;
+};
+
+static void zstd_fse_init_state(struct zstd_fse_cstate *st,
+				const struct zstd_fse_ctable *ct,
+				unsigned int symbol)
+{
+	u32 nb = (ct->tt[symbol].delta_nbits + (1 << 15)) >> 16;
+	u32 value = (nb << 16) - ct->tt[symbol].delta_nbits;
+
+	st->ct = ct;
+	st->value = ct->state[(int)(value >> nb) +
+			      ct->tt[symbol].delta_find_state];
+}
+
+static inline void zstd_fse_encode(struct zstd_bitc *bc,
+				   struct zstd_fse_cstate *st,
+				   unsigned int symbol)
+{
+	const struct zstd_fse_ctable *ct = st->ct;
+	u32 nb = (st->value + ct->tt[symbol].delta_nbits) >> 16;
+
+	zstd_bitc_add(bc, st->value, nb);
+	st->value = ct->state[(int)(st->value >> nb) +
+			      ct->tt[symbol].delta_find_state];
+}
+
+static void zstd_fse_flush_state(struct zstd_bitc *bc,
+				 const struct zstd_fse_cstate *st)
+{
+	zstd_bitc_add(bc, st->value, st->ct->log);
+	zstd_bitc_flush(bc);
+}
+
+/* Literals */
+
+static int zstd_huf_node_cmp(const void *a, const void *b)
+{
+	const struct zstd_huf_node *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? -1 : 1;
+	return x->symbol - y->symbol;
+}
+
+/*
+ * Bring the code lengths down to ZSTD_HUF_MAX_BITS, keeping the code
+ * complete: lengthen the rarest codes until the Kraft sum fits, then give
+ * whatever is left over to the most frequent ones.
+ */
+static void zstd_huf_limit(struct zstd_huf_node *leaf, unsigned int n)
+{
+	const u32 full = 1 << ZSTD_HUF_MAX_BITS;
+	u32 kraft = 0;
+	unsigned int i, len;
+
+	for (i = 0; i < n; i++) {
+		if (leaf[i].nbits > ZSTD_HUF_MAX_BITS)
+			leaf[i].nbits = ZSTD_HUF_MAX_BITS;
+		kraft += full >> leaf[i].nbits;
+	}
+
+	while (kraft > full) {
+		struct zstd_huf_node *pick = NULL;
+
+		for (len = ZSTD_HUF_MAX_BITS - 1; len && !pick; len--)
+			for (i = 0; i < n && !pick; i++)
+				if (leaf[i].nbits == len)
+					pick = &leaf[i];
+		pick->nbits++;
+		kraft -= full >> pick->nbits;
+	}
+
+	while (kraft < full) {
+		for (i = n; i--; ) {
+			u32 gain = full >> leaf[i].nbits;
+
+			if (leaf[i].nbits > 1 && kraft + gain <= full) {
+				leaf[i].nbits--;
+				kraft += gain;
+				break;
+			}
+		}
+	}
+}
+
+/* Returns the table log */
+static unsigned int zstd_huf_build(struct zstd_cctx *cctx,
+				   unsigned int max_symbol)
+{
+	struct zstd_huf_node *node = cctx->nodes;
+	u32 start[ZSTD_HUF_MAX_BITS + 2] = { 0 };
+	unsigned int n = 0, i, j, k, s, w, log = 0;
+	u32 next = 0;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (!cctx->count[s])
+			continue;
+		node[n].count = cctx->count[s];
+		node[n].symbol = s;
+		n++;
+	}
+	sort(node, n, sizeof(*node), zstd_huf_node_cmp, NULL);
+
+	/* Two queues: the sorted leaves and the internal nodes as made */
+	i = 0;
+	j = n;
+	for (k = n; k < 2 * n - 1; k++) {
+		unsigned int a, b;
+
+		a = i < n && (j >= k || node[i].count <= node[j].count) ?
+		    i++ : j++;
+		b = i < n && (j >= k || node[i].count <= node[j].count) ?
+		    i++ : j++;
+		node[k].count = node[a].count + node[b].count;
+		node[a].parent = node[b].parent = k;
+	}
+
+	node[2 * n - 2].nbits = 0;
+	for (k = 2 * n - 2; k--; )
+		node[k].nbits = min(node[node[k].parent].nbits + 1, 255);
+
+	zstd_huf_limit(node, n);
+
+	memset(cctx->huf_nbits, 0, sizeof(cctx->huf_nbits));
+	for (i = 0; i < n; i++) {
+		cctx->huf_nbits[node[i].symbol] = node[i].nbits;
+		log = max_t(unsigned int, log, node[i].nbits);
+	}
+
+	/* Canonical codes, laid out the way the decoder builds its table */
+	for (s = 0; s <= max_symbol; s++)
+		if (cctx->huf_nbits[s])
+			start[log + 1 - cctx->huf_nbits[s]]++;
+	for (w = 1; w <= log; w++) {
+		u32 cur = next;
+
+		next += start[w] << (w - 1);
+		start[w] = cur;
+	}
+	for (s = 0; s <= max_symbol; s++) {
+		if (!cctx->huf_nbits[s])
+			continue;
+		w = log + 1 - cctx->huf_nbits[s];
+		cctx->huf_code[s] = start[w] >> (w - 1);
+		start[w] += 1 << (w - 1);
+	}
+
+	return log;
+}
+
+static ssize_t zstd_huf_weights_fse(struct zstd_cctx *cctx, u8 *dst,
+				    size_t capacity, const u8 *weights,
+				    const u32 *count, unsigned int n,
+				    unsigned int max_w)
+{
+	u8 check[ZSTD_HUF_MAX_SYMBOLS];
+	s16 norm[ZSTD_HUF_MAX_BITS + 1];
+	struct zstd_fse_ctable *ct = &cctx->ll_ct;
+	struct zstd_fse_cstate st[2];
+	struct zstd_bitc bc;
+	unsigned int i, flog, nb, tlog;
+	ssize_t hsize, size;
+
+	/* Two interleaved states, and one weight alone has to be RLE */
+	if (n < 2)
+		return -EINVAL;
+	for (i = 0; i <= max_w; i++)
+		if (count[i] == n)
+			return -EINVAL;
+
+	/* The size byte has to stay below 128 */
+	capacity = min_t(size_t, capacity, 128);
+	if (capacity < 2)
+		return -ENOSPC;
+
+	flog = zstd_fse_optimal_log(ZSTD_HUF_WEIGHTS_LOG, n, max_w);
+	zstd_fse_normalize(norm, flog, count, n, max_w);
+	hsize = zstd_fse_write_ncount(dst + 1, capacity - 1, norm, max_w, flog);
+	if (hsize < 0)
+		return hsize;
+	zstd_fse_build_ctable(ct, norm, max_w, flog);
+
+	zstd_bitc_init(&bc, dst + 1 + hsize, capacity - 1 - hsize);
+	zstd_fse_init_state(&st[(n - 1) & 1], ct, weights[n - 1]);
+	zstd_fse_init_state(&st[(n - 2) & 1], ct, weights[n - 2]);
+	for (i = n - 2; i--; ) {
+		zstd_fse_encode(&bc, &st[i & 1], weights[i]);
+		zstd_bitc_flush(&bc);
+	}
+	zstd_fse_flush_state(&bc, &st[1]);
+	zstd_fse_flush_state(&bc, &st[0]);
+	size = zstd_bitc_close(&bc);
+	if (size < 0)
+		return size;
+
+	size += hsize;
+	if (size >= 128)
+		return -EINVAL;
+	dst[0] = size;
+
+	/*
+	 * The decoder finds the end of the weights by running off the end of
+	 * the stream, make sure it lands on the right count.
+	 */
+	if (zstd_huf_read_weights(check, &nb, &tlog, dst, size + 1) < 0 ||
+	    nb != n + 1 || memcmp(check, weights, n))
+		return -EINVAL;
+
+	return size + 1;
+}
+
+/*
+ * Weights of all but the last symbol, which the decoder works out.  Up to
+ * 128 of them can also be stored directly, four bits each.
+ */
+static ssize_t zstd_huf_write_weights(struct zstd_cctx *cctx, u8 *dst,
+				      size_t capacity, unsigned int max_symbol,
+				      unsigned int log)
+{
+	u8 weights[ZSTD_HUF_MAX_SYMBOLS];
+	u32 count[ZSTD_HUF_MAX_BITS + 1] = { 0 };
+	unsigned int n = max_symbol, i, max_w = 0;
+	ssize_t size, direct = 1 + (n + 1) / 2;
+
+	for (i = 0; i < n; i++) {
+		weights[i] = cctx->huf_nbits[i] ?
+			     log + 1 - cctx->huf_nbits[i] : 0;
+		count[weights[i]]++;
+		max_w = max_t(unsigned int, max_w, weights[i]);
+	}
+
+	size = zstd_huf_weights_fse(cctx, dst, capacity, weights, count, n,
+				    max_w);
+	if (n > 128 || (size > 0 && size < direct))
+		return size;
+
+	if (direct > capacity)
+		return -ENOSPC;
+	dst[0] = 127 + n;
+	weights[n] = 0;
+	for (i = 0; i < n; i += 2)
+		dst[1 + i / 2] = (weights[i] << 4) | weights[i + 1];
+	return direct;
+}
+
+static ssize_t zstd_huf_encode_stream(const struct zstd_cctx *cctx, u8 *dst,
+				      size_t capacity, const u8 *src, size_t n)
+{
+	struct zstd_bitc bc;
+
+	zstd_bitc_init(&bc, dst, capacity);
+	while (n) {
+		unsigned int i;
+
+		for (i = 0; i < 4 && n; i++) {
+			n--;
+			zstd_bitc_add(&bc, cctx->huf_code[src[n]],
+				      cctx->huf_nbits[src[n]]);
+		}
+		zstd_bitc_flush(&bc);
+	}
+
+	return zstd_bitc_close(&bc);
+}
+
+static ssize_t zstd_huf_encode(const struct zstd_cctx *cctx, u8 *dst,
+			       size_t capacity, const u8 *src, size_t n,
+			       bool single)
+{
+	size_t segment = (n + 3) / 4, pos = 6;
+	ssize_t size;
+	int i;
+
+	if (single)
+		return zstd_huf_encode_stream(cctx, dst, capacity, src, n);
+
+	if (capacity < 6)
+		return -ENOSPC;
+
+	for (i = 0; i < 4; i++) {
+		size_t len = i < 3 ? segment : n - 3 * segment;
+
+		size = zstd_huf_encode_stream(cctx, dst + pos, capacity - pos,
+					      src + i * segment, len);
+		if (size < 0)
+			return size;
+		if (i < 3) {
+			if (size > 0xffff)
+				return -EINVAL;
+			put_unaligned_le16(size, dst + 2 * i);
+		}
+		pos += size;
+	}
+
+	return pos;
+}
+
+static size_t zstd_write_literals_header(u8 *dst, unsigned int type,
+					 size_t n)
+{
+	if (n < 32) {
+		dst[0] = type | (n << 3);
+		return 1;
+	}
+	if (n < 4096) {
+		put_unaligned_le16(type | (1 << 2) | (n << 4), dst);
+		return 2;
+	}
+	put_unaligned_le32(type | (3 << 2) | (n << 4), dst);
+	return 3;
+}
+
+static ssize_t zstd_encode_literals(struct zstd_cctx *cctx, u8 *dst,
+				    size_t capacity)
+{
+	const u8 *lits = cctx->lits;
+	size_t n = cctx->nb_lits, hsize, i;
+	unsigned int max_symbol = 0, log;
+	bool single = n < 256;
+	ssize_t wsize, csize;
+	u32 most = 0;
+	u64 header;
+
+	memset(cctx->count, 0, sizeof(cctx->count));
+	for (i = 0; i < n; i++)
+		cctx->count[lits[i]]++;
+	for (i = 0; i < ZSTD_HUF_MAX_SYMBOLS; i++) {
+		if (!cctx->count[i])
+			continue;
+		max_symbol = i;
+		most = max(most, cctx->count[i]);
+	}
+
+	if (n > 2 && most == n) {
+		if (capacity < 4)
+			return -ENOSPC;
+		hsize = zstd_write_literals_header(dst, ZSTD_LIT_RLE, n);
+		dst[hsize] = lits[0];
+		return hsize + 1;
+	}
+
+	if (n < ZSTD_MIN_LITERALS || capacity < 5)
+		goto raw;
+
+	log = zstd_huf_build(cctx, max_symbol);
+	hsize = 3 + (n >= 1024) + (n >= 16384);
+
+	wsize = zstd_huf_write_weights(cctx, dst + hsize, capacity - hsize,
+				       max_symbol, log);
+	if (wsize < 0)
+		goto raw;
+
+	csize = zstd_huf_encode(cctx, dst + hsize + wsize,
+				capacity - hsize - wsize, lits, n, single);
+	if (csize < 0)
+		goto raw;
+	csize += wsize;
+
+	if (csize >= n - (n >> 6) - 2)
+		goto raw;
+
+	switch (hsize) {
+	case 3:
+		header = ZSTD_LIT_COMPRESSED | (!single << 2) | (n << 4) |
+			 ((u64)csize << 14);
+		break;
+	case 4:
+		header = ZSTD_LIT_COMPRESSED | (2 << 2) | (n << 4) |
+			 ((u64)csize << 18);
+		break;
+	default:
+		header = ZSTD_LIT_COMPRESSED | (3 << 2) | (n << 4) |
+			 ((u64)csize << 22);
+		break;
+	}
+	for (i = 0; i < hsize; i++)
+		dst[i] = header >> (8 * i);
+
+	return hsize + csize;
+
+raw:
+	if (n + 3 > capacity)
+		return -ENOSPC;
+	hsize = zstd_write_literals_header(dst, ZSTD_LIT_RAW, n);
+	memcpy(dst + hsize, lits, n);
+	return hsize + n;
+}
+
+/* Sequences */
+
+static unsigned int zstd_ll_code(u32 ll)
+{
+	return ll < 64 ? zstd_ll_code_table[ll] : zstd_highbit(ll) + 19;
+}
+
+static unsigned int zstd_ml_code(u32 ml_base)
+{
+	return ml_base < 128 ? zstd_ml_code_table[ml_base] :
+			       zstd_highbit(ml_base) + 36;
+}
+
+/* Pick the mode for one of the three sequence codes, and its table */
+static ssize_t zstd_select_seq_table(struct zstd_cctx *cctx,
+				     const struct zstd_fse_ctable **used,
+				     unsigned int *mode,
+				     struct zstd_fse_ctable *ct,
+				     const struct zstd_fse_ctable *def,
+				     const u8 *codes, unsigned int nb,
+				     unsigned int max_code,
+				     unsigned int max_log,
+				     unsigned int default_max,
+				     unsigned int default_log,
+				     u8 *dst, size_t capacity)
+{
+	s16 norm[ZSTD_ML_MAX_CODE + 1];
+	unsigned int max_symbol = 0, i, log;
+	u32 most = 0;
+	ssize_t size;
+
+	memset(cctx->count, 0, (max_code + 1) * sizeof(u32));
+	for (i = 0; i < nb; i++)
+		cctx->count[codes[i]]++;
+	for (i = 0; i <= max_code; i++) {
+		if (!cctx->count[i])
+			continue;
+		max_symbol = i;
+		most = max(most, cctx->count[i]);
+	}
+
+	if (most == nb && (nb > 2 || max_symbol > default_max)) {
+		if (!capacity)
+			return -ENOSPC;
+		*dst = max_symbol;
+		zstd_fse_build_ctable_rle(ct, max_symbol);
+		*mode = ZSTD_SEQ_RLE;
+		*used = ct;
+		return 1;
+	}
+
+	if (max_symbol <= default_max &&
+	    (nb < ZSTD_MIN_SEQ_TABLE || most < (nb >> (default_log - 1)))) {
+		*mode = ZSTD_SEQ_PREDEFINED;
+		*used = def;
+		return 0;
+	}
+
+	log = zstd_fse_optimal_log(max_log, nb, max_symbol);
+	zstd_fse_normalize(norm, log, cctx->count, nb, max_symbol);
+	size = zstd_fse_write_ncount(dst, capacity, norm, max_symbol, log);
+	if (size < 0)
+		return size;
+	zstd_fse_build_ctable(ct, norm, max_symbol, log);
+	*mode = ZSTD_SEQ_COMPRESSED;
+	*used = ct;
+	return size;
+}
+
+static ssize_t zstd_encode_sequences(struct zstd_cctx *cctx, u8 *dst,
+				     size_t capacity)
+{
+	const struct zstd_fse_ctable *ll_ct, *of_ct, *ml_ct;
+	struct zstd_fse_cstate ll_st, of_st, ml_st;
+	const struct zstd_seq *seq = cctx->seqs;
+	unsigned int nb = cctx->nb_seq, ll_mode, of_mode, ml_mode, i;
+	u8 *p = dst, *end = dst + capacity, *modes;
+	struct zstd_bitc bc;
+	ssize_t size;
+
+	if (capacity < 4)
+		return -ENOSPC;
+
+	if (nb < 128) {
+		*p++ = nb;
+	} else if (nb < 0x7f00) {
+		*p++ = (nb >> 8) + 128;
+		*p++ = nb;
+	} else {
+		*p++ = 255;
+		put_unaligned_le16(nb - 0x7f00, p);
+		p += 2;
+	}
+	if (!nb)
+		return p - dst;
+
+	for (i = 0; i < nb; i++) {
+		cctx->ll_codes[i] = zstd_ll_code(seq[i].lit_len);
+		cctx->of_codes[i] = zstd_highbit(seq[i].offset);
+		cctx->ml_codes[i] = zstd_ml_code(seq[i].match_len);
+	}
+
+	modes = p++;
+	size = zstd_select_seq_table(cctx, &ll_ct, &ll_mode, &cctx->ll_ct,
+				     &cctx->ll_default, cctx->ll_codes, nb,
+				     ZSTD_LL_MAX_CODE, ZSTD_LL_MAX_LOG,
+				     ZSTD_LL_MAX_CODE, ZSTD_LL_DEFAULT_LOG,
+				     p, end - p);
+	if (size < 0)
+		return size;
+	p += size;
+
+	size = zstd_select_seq_table(cctx, &of_ct, &of_mode, &cctx->of_ct,
+				     &cctx->of_default, cctx->of_codes, nb,
+				     ZSTD_OF_MAX_CODE, ZSTD_OF_MAX_LOG,
+				     ZSTD_OF_DEFAULT_MAX, ZSTD_OF_DEFAULT_LOG,
+				     p, end - p);
+	if (size < 0)
+		return size;
+	p += size;
+
+	size = zstd_select_seq_table(cctx, &ml_ct, &ml_mode, &cctx->ml_ct,
+				     &cctx->ml_default, cctx->ml_codes, nb,
+				     ZSTD_ML_MAX_CODE, ZSTD_ML_MAX_LOG,
+				     ZSTD_ML_MAX_CODE, ZSTD_ML_DEFAULT_LOG,
+				     p, end - p);
+	if (size < 0)
+		return size;
+	p += size;
+
+	*modes = (ll_mode << 6) | (of_mode << 4) | (ml_mode << 2);
+
+	/* Backwards, so that the decoder reads the first sequence first */
+	zstd_bitc_init(&bc, p, end - p);
+	i = nb - 1;
+	zstd_fse_init_state(&ml_st, ml_ct, cctx->ml_codes[i]);
+	zstd_fse_init_state(&of_st, of_ct, cctx->of_codes[i]);
+	zstd_fse_init_state(&ll_st, ll_ct, cctx->ll_codes[i]);
+	for (;;) {
+		unsigned int llc = cctx->ll_codes[i];
+		unsigned int mlc = cctx->ml_codes[i];
+
+		zstd_bitc_add(&bc, seq[i].lit_len, zstd_ll_bits[llc]);
+		zstd_bitc_add(&bc, seq[i].match_len, zstd_ml_bits[mlc]);
+		zstd_bitc_flush(&bc);
+		zstd_bitc_add(&bc, seq[i].offset, cctx->of_codes[i]);
+		zstd_bitc_flush(&bc);
+
+		if (!i--)
+			break;
+
+		zstd_fse_encode(&bc, &of_st, cctx->of_codes[i]);
+		zstd_fse_encode(&bc, &ml_st, cctx->ml_codes[i]);
+		zstd_fse_encode(&bc, &ll_st, cctx->ll_codes[i]);
+		zstd_bitc_flush(&bc);
+	}
+	zstd_fse_flush_state(&bc, &ml_st);
+	zstd_fse_flush_state(&bc, &of_st);
+	zstd_fse_flush_state(&bc, &ll_st);
+
+	size = zstd_bitc_close(&bc);
+	if (size < 0)
+		return size;
+	return p + size - dst;
+}
+
+/* Match finding */
+
+/* Hashes the first min_match bytes at p */
+static inline u32 zstd_hash(const u8 *p, const struct zstd_params *params)
+{
+	unsigned int log = params->hash_log;
+
+	if (params->min_match == 4)
+		return (get_unaligned_le32(p) * 2654435761U) >> (32 - log);
+	return ((get_unaligned_le64(p) << (64 - 8 * params->min_match)) *
+		0xCF1BBCDCB7A56463ULL) >> (64 - log);
+}
+
+static void zstd_hash_range(u32 *hash_table, u32 *chain_table,
+			    const struct zstd_params *params, const u8 *base,
+			    u32 from, u32 to)
+{
+	u32 mask = (1U << params->chain_log) - 1;
+	u32 idx;
+
+	for (idx = from; idx < to; idx++) {
+		u32 h = zstd_hash(base + idx, params);
+
+		chain_table[idx & mask] = hash_table[h];
+		hash_table[h] = idx;
+	}
+}
+
+static size_t zstd_count(const u8 *ip, const u8 *match, const u8 *iend)
+{
+	const u8 *start = ip;
+
+	while (iend - ip >= 8) {
+		u64 diff = get_unaligned_le64(ip) ^ get_unaligned_le64(match);
+
+		if (diff)
+			return ip - start + (__ffs64(diff) >> 3);
+		ip += 8;
+		match += 8;
+	}
+	while (ip < iend && *ip == *match) {
+		ip++;
+		match++;
+	}
+
+	return ip - start;
+}
+
+/* A match starting in ext may run on into the prefix */
+static size_t zstd_count_2seg(const u8 *ip, const u8 *match, const u8 *iend,
+			      const u8 *mend, const u8 *prefix_start)
+{
+	const u8 *vend = min(iend, ip + (mend - match));
+	size_t len = zstd_count(ip, match, vend);
+
+	if (match + len != mend)
+		return len;
+	return len + zstd_count(ip + len, prefix_start, iend);
+}
+
+/* Returns the length of the best match at ip, 0 if none is long enough */
+static size_t zstd_hc_find(struct zstd_cctx *cctx, const u8 *ip,
+			   const u8 *iend, u32 *offset)
+{
+	const struct zstd_params *params = &cctx->params;
+	const u8 *base = cctx->base, *dict_base = cctx->dict_base;
+	const u8 *prefix_start = base + cctx->dict_limit;
+	const u8 *dict_end = dict_base + cctx->dict_limit;
+	u32 cur = ip - base;
+	u32 chain_size = 1U << params->chain_log;
+	u32 window = 1U << params->window_log;
+	u32 low = max(cctx->low_limit, cur > window ? cur - window : 0);
+	u32 min_chain = cur > chain_size ? cur - chain_size : 0;
+	unsigned int attempts = 1U << params->search_log;
+	size_t best = 3;
+	u32 idx;
+
+	zstd_hash_range(cctx->hash_table, cctx->chain_table, params, base,
+			cctx->next_to_update, cur);
+	cctx->next_to_update = cur;
+
+	idx = cctx->hash_table[zstd_hash(ip, params)];
+	while (idx >= low && attempts--) {
+		size_t len = 0;
+
+		if (idx >= cctx->dict_limit) {
+			const u8 *match = base + idx;
+
+			if (match[best] == ip[best])
+				len = zstd_count(ip, match, iend);
+		} else {
+			const u8 *match = dict_base + idx;
+
+			if (idx + 4 <= cctx->dict_limit &&
+			    get_unaligned_le32(match) == get_unaligned_le32(ip))
+				len = zstd_count_2seg(ip + 4, match + 4, iend,
+						      dict_end, prefix_start) + 4;
+		}
+
+		if (len > best) {
+			best = len;
+			*offset = cur - idx;
+			if (ip + len == iend)
+				break;
+		}
+
+		if (idx <= min_chain)
+			break;
+		idx = cctx->chain_table[idx & (chain_size - 1)];
+	}
+
+	return best >= params->min_match ? best : 0;
+}
+
+/* Whether a repeat offset is usable at ip, only within the prefix */
+static inline bool zstd_rep_match(const struct zstd_cctx *cctx, const u8 *ip,
+				  u32 offset)
+{
+	const u8 *prefix_start = cctx->base + cctx->dict_limit;
+
+	return offset && offset <= (size_t)(ip - prefix_start) &&
+	       offset <= (1U << cctx->params.window_log) &&
+	       get_unaligned_le32(ip) == get_unaligned_le32(ip - offset);
+}
+
+/*
+ * Append a sequence, turning its offset into a repeat code where one
+ * matches and updating the repeat offsets exactly as the decoder will.
+ */
+static void zstd_store_seq(struct zstd_cctx *cctx, const u8 *lits,
+			   size_t lit_len, u32 offset, size_t match_len)
+{
+	struct zstd_seq *seq = &cctx->seqs[cctx->nb_seq++];
+	u32 *rep = cctx->rep;
+	u32 code;
+
+	memcpy(cctx->lits + cctx->nb_lits, lits, lit_len);
+	cctx->nb_lits += lit_len;
+
+	if (lit_len && offset == rep[0]) {
+		code = 1;
+	} else if (offset == rep[1]) {
+		code = lit_len ? 2 : 1;
+		rep[1] = rep[0];
+		rep[0] = offset;
+	} else if (offset == rep[2]) {
+		code = lit_len ? 3 : 2;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+	} else if (!lit_len && offset == rep[0] - 1) {
+		code = 3;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+	} else {
+		code = offset + ZSTD_REP_NUM;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+	}
+
+	seq->lit_len = lit_len;
+	seq->match_len = match_len - ZSTD_MINMATCH;
+	seq->offset = code;
+}
+
+static inline int zstd_offset_cost(u32 offset, bool rep)
+{
+	return rep ? 0 : zstd_highbit(offset + 1);
+}
+
+static void zstd_find_sequences(struct zstd_cctx *cctx, const u8 *istart,
+				const u8 *iend)
+{
+	const u8 *prefix_start = cctx->base + cctx->dict_limit;
+	const u8 *ip = istart, *anchor = istart;
+	const u8 *ilimit = iend - 8;
+	unsigned int depth = cctx->params.lazy_depth;
+	u32 *rep = cctx->rep;
+
+	cctx->nb_seq = 0;
+	cctx->nb_lits = 0;
+
+	if (iend - istart <= 8)
+		goto last_literals;
+
+	ip += ip == prefix_start;
+	while (ip < ilimit) {
+		const u8 *start = ip + 1;
+		size_t len = 0, len2;
+		u32 offset = 0, offset2;
+		bool is_rep = false;
+
+		if (zstd_rep_match(cctx, ip + 1, rep[0])) {
+			len = zstd_count(ip + 5, ip + 5 - rep[0], iend) + 4;
+			offset = rep[0];
+			is_rep = true;
+			if (!depth)
+				goto store;
+		}
+
+		len2 = zstd_hc_find(cctx, ip, iend, &offset2);
+		if (len2 > len) {
+			len = len2;
+			offset = offset2;
+			is_rep = false;
+			start = ip;
+		}
+
+		if (len < 4) {
+			/* Skip faster the longer nothing has matched */
+			ip += ((ip - anchor) >> 8) + 1;
+			continue;
+		}
+
+		/* See whether waiting a byte or two gives a better match */
+		while (depth && ip < ilimit) {
+			int gain1, gain2;
+
+			ip++;
+			if (!is_rep && zstd_rep_match(cctx, ip, rep[0])) {
+				len2 = zstd_count(ip + 4, ip + 4 - rep[0],
+						  iend) + 4;
+				gain2 = len2 * 3;
+				gain1 = len * 3 -
+					zstd_offset_cost(offset, is_rep) + 1;
+				if (gain2 > gain1) {
+					len = len2;
+					offset = rep[0];
+					is_rep = true;
+					start = ip;
+				}
+			}
+
+			len2 = zstd_hc_find(cctx, ip, iend, &offset2);
+			if (len2) {
+				gain2 = len2 * 4 - zstd_offset_cost(offset2,
+								    false);
+				gain1 = len * 4 -
+					zstd_offset_cost(offset, is_rep) + 4;
+				if (gain2 > gain1) {
+					len = len2;
+					offset = offset2;
+					is_rep = false;
+					start = ip;
+					continue;
+				}
+			}
+
+			if (depth < 2 || ip >= ilimit)
+				break;
+
+			ip++;
+			if (!is_rep && zstd_rep_match(cctx, ip, rep[0])) {
+				len2 = zstd_count(ip + 4, ip + 4 - rep[0],
+						  iend) + 4;
+				gain2 = len2 * 4;
+				gain1 = len * 4 -
+					zstd_offset_cost(offset, is_rep) + 1;
+				if (gain2 > gain1) {
+					len = len2;
+					offset = rep[0];
+					is_rep = true;
+					start = ip;
+				}
+			}
+
+			len2 = zstd_hc_find(cctx, ip, iend, &offset2);
+			if (len2) {
+				gain2 = len2 * 4 - zstd_offset_cost(offset2,
+								    false);
+				gain1 = len * 4 -
+					zstd_offset_cost(offset, is_rep) + 7;
+				if (gain2 > gain1) {
+					len = len2;
+					offset = offset2;
+					is_rep = false;
+					start = ip;
+					continue;
+				}
+			}
+			break;
+		}
+
+		/* Extend the match backwards over the literals */
+		while (start > anchor &&
+		       (u32)(start - cctx->base) > offset &&
+		       (u32)(start - cctx->base) - offset > cctx->dict_limit &&
+		       start[-1] == (start - offset)[-1]) {
+			start--;
+			len++;
+		}
+
+store:
+		zstd_store_seq(cctx, anchor, start - anchor, offset, len);
+		anchor = ip = start + len;
+
+		/* A match right after a match often repeats the one before */
+		while (ip <= ilimit && zstd_rep_match(cctx, ip, rep[1])) {
+			len = zstd_count(ip + 4, ip + 4 - rep[1], iend) + 4;
+			zstd_store_seq(cctx, anchor, 0, rep[1], len);
+			anchor = ip += len;
+		}
+	}
+
+last_literals:
+	memcpy(cctx->lits + cctx->nb_lits, anchor, iend - anchor);
+	cctx->nb_lits += iend - anchor;
+}
+
+/* Blocks and frames */
+
+static void zstd_write_block_header(u8 *dst, unsigned int type, size_t size,
+				    bool last)
+{
+	u32 header = last | (type << 1) | (size << 3);
+
+	dst[0] = header;
+	dst[1] = header >> 8;
+	dst[2] = header >> 16;
+}
+
+static bool zstd_is_rle(const u8 *src, size_t size)
+{
+	size_t i;
+
+	for (i = 1; i < size; i++)
+		if (src[i] != src[0])
+			return false;
+	return true;
+}
+
+/* Rebase the indices before they can overflow, keeping the window */
+static void zstd_correct_overflow(struct zstd_cctx *cctx, const u8 *ip)
+{
+	u32 cur = ip - cctx->base;
+	u32 chain_mask = (1U << cctx->params.chain_log) - 1;
+	u32 correction, i;
+
+	if (cur < ZSTD_INDEX_MAX)
+		return;
+
+	correction = cur - ((cur & chain_mask) +
+			    (1U << cctx->params.window_log));
+
+	for (i = 0; i < 1U << cctx->params.hash_log; i++)
+		cctx->hash_table[i] = cctx->hash_table[i] < correction ? 0 :
+				      cctx->hash_table[i] - correction;
+	for (i = 0; i <= chain_mask; i++)
+		cctx->chain_table[i] = cctx->chain_table[i] < correction ? 0 :
+				       cctx->chain_table[i] - correction;
+
+	cctx->base += correction;
+	cctx->dict_base += correction;
+	cctx->dict_limit = cctx->dict_limit <= correction ? 1 :
+			   cctx->dict_limit - correction;
+	cctx->low_limit = cctx->low_limit <= correction ? 1 :
+			  cctx->low_limit - correction;
+	cctx->low_limit = min(cctx->low_limit, cctx->dict_limit);
+	cctx->next_to_update = max(cctx->next_to_update - correction,
+				   cctx->dict_limit);
+}
+
+/* src has to sit in the window, straight after what came before */
+static ssize_t zstd_compress_block(struct zstd_cctx *cctx, u8 *dst,
+				   size_t capacity, const u8 *src, size_t size,
+				   bool last)
+{
+	u32 rep[ZSTD_REP_NUM];
+	ssize_t lsize, ssize = -ENOSPC;
+	size_t room;
+
+	if (capacity < ZSTD_BLOCK_HEADER_SIZE + 1)
+		return -ENOSPC;
+
+	if (size > 1 && zstd_is_rle(src, size)) {
+		zstd_write_block_header(dst, ZSTD_BLOCK_RLE, size, last);
+		dst[ZSTD_BLOCK_HEADER_SIZE] = src[0];
+		return ZSTD_BLOCK_HEADER_SIZE + 1;
+	}
+
+	zstd_correct_overflow(cctx, src);
+	memcpy(rep, cctx->rep, sizeof(rep));
+
+	if (size) {
+		zstd_find_sequences(cctx, src, src + size);
+
+		/* Anything not smaller than the block is no use */
+		room = min(capacity - ZSTD_BLOCK_HEADER_SIZE, size - 1);
+		lsize = zstd_encode_literals(cctx, dst + ZSTD_BLOCK_HEADER_SIZE,
+					     room);
+		if (lsize >= 0)
+			ssize = zstd_encode_sequences(cctx,
+					dst + ZSTD_BLOCK_HEADER_SIZE + lsize,
+					room - lsize);
+		if (lsize >= 0 && ssize >= 0) {
+			zstd_write_block_header(dst, ZSTD_BLOCK_COMPRESSED,
+						lsize + ssize, last);
+			return ZSTD_BLOCK_HEADER_SIZE + lsize + ssize;
+		}
+	}
+
+	/* Stored raw, the decoder's repeat offsets won't change */
+	memcpy(cctx->rep, rep, sizeof(rep));
+	if (capacity < ZSTD_BLOCK_HEADER_SIZE + size)
+		return -ENOSPC;
+	zstd_write_block_header(dst, ZSTD_BLOCK_RAW, size, last);
+	memcpy(dst + ZSTD_BLOCK_HEADER_SIZE, src, size);
+	return ZSTD_BLOCK_HEADER_SIZE + size;
+}
+
+static size_t zstd_write_frame_header(const struct zstd_cctx *cctx, u8 *dst,
+				      u64 content_size, bool single)
+{
+	u32 dict_id = cctx->dict_id;
+	unsigned int did_code, fcs_code;
+	u8 *p = dst;
+
+	did_code = !dict_id ? 0 : dict_id < 256 ? 1 : dict_id < 65536 ? 2 : 3;
+	if (content_size == ZSTD_CONTENTSIZE_UNKNOWN)
+		fcs_code = 0;
+	else
+		fcs_code = (content_size >= 256) +
+			   (content_size >= 65536 + 256) +
+			   (content_size >= 0xffffffffULL);
+
+	put_unaligned_le32(ZSTD_MAGIC, p);
+	p += 4;
+	*p++ = (fcs_code << 6) | (single << 5) |
+	       (cctx->params.checksum << 2) | did_code;
+	if (!single)
+		*p++ = (cctx->params.window_log - ZSTD_WINDOWLOG_MIN) << 3;
+
+	switch (did_code) {
+	case 1:
+		*p++ = dict_id;
+		break;
+	case 2:
+		put_unaligned_le16(dict_id, p);
+		p += 2;
+		break;
+	case 3:
+		put_unaligned_le32(dict_id, p);
+		p += 4;
+		break;
+	}
+
+	switch (fcs_code) {
+	case 0:
+		if (single)
+			*p++ = content_size;
+		break;
+	case 1:
+		put_unaligned_le16(content_size - 256, p);
+		p += 2;
+		break;
+	case 2:
+		put_unaligned_le32(content_size, p);
+		p += 4;
+		break;
+	case 3:
+		put_unaligned_le64(content_size, p);
+		p += 8;
+		break;
+	}
+
+	return p - dst;
+}
+
+/* Frames without a dictionary that fit the window are a single segment */
+static bool zstd_single_segment(const struct zstd_cctx *cctx,
+				u64 content_size, const struct zstd_cdict *cdict)
+{
+	return !cdict && content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	       content_size <= (1U << cctx->params.window_log);
+}
+
+/*
+ * Start a frame whose data begins at start.  Frames without a dictionary
+ * get tables cut down to src_size, so that small inputs are cheap.
+ */
+static void zstd_begin_frame(struct zstd_cctx *cctx, const u8 *start,
+			     const struct zstd_cdict *cdict, u64 src_size)
+{
+	size_t hsize;
+
+	cctx->params = cctx->init_params;
+	if (!cdict && src_size != ZSTD_CONTENTSIZE_UNKNOWN)
+		zstd_fit_params(&cctx->params, src_size);
+	cctx->block_size = zstd_block_size(&cctx->params);
+	hsize = sizeof(u32) << cctx->params.hash_log;
+
+	if (cdict) {
+		memcpy(cctx->hash_table, cdict->hash_table, hsize);
+		memcpy(cctx->chain_table, cdict->chain_table,
+		       sizeof(u32) << cctx->params.chain_log);
+		memcpy(cctx->rep, cdict->rep, sizeof(cctx->rep));
+		cctx->dict_base = cdict->content - 1;
+		cctx->dict_limit = 1 + cdict->content_size;
+		cctx->dict_id = cdict->id;
+	} else {
+		memset(cctx->hash_table, 0, hsize);
+		cctx->rep[0] = 1;
+		cctx->rep[1] = 4;
+		cctx->rep[2] = 8;
+		cctx->dict_base = start - 1;
+		cctx->dict_limit = 1;
+		cctx->dict_id = 0;
+	}
+
+	cctx->base = start - cctx->dict_limit;
+	cctx->low_limit = 1;
+	cctx->next_to_update = cctx->dict_limit;
+	if (cctx->params.checksum)
+		zstd_xxh64_reset(&cctx->xxh);
+}
+
+static void zstd_build_default_tables(struct zstd_cctx *cctx)
+{
+	zstd_fse_build_ctable(&cctx->ll_default, zstd_ll_default_norm,
+			      ZSTD_LL_MAX_CODE, ZSTD_LL_DEFAULT_LOG);
+	zstd_fse_build_ctable(&cctx->of_default, zstd_of_default_norm,
+			      ZSTD_OF_DEFAULT_MAX, ZSTD_OF_DEFAULT_LOG);
+	zstd_fse_build_ctable(&cctx->ml_default, zstd_ml_default_norm,
+			      ZSTD_ML_MAX_CODE, ZSTD_ML_DEFAULT_LOG);
+}
+
+size_t zstd_cctx_workspace_size(const struct zstd_params *params)
+{
+	size_t block = zstd_block_size(params);
+	size_t max_seq = block / 4;
+
+	return sizeof(struct zstd_cctx) +
+	       (sizeof(u32) << params->hash_log) +
+	       (sizeof(u32) << params->chain_log) +
+	       max_seq * sizeof(struct zstd_seq) + block + 3 * max_seq;
+}
+EXPORT_SYMBOL(zstd_cctx_workspace_size);
+
+struct zstd_cctx *zstd_init_cctx(void *workspace, size_t workspace_size,
+				 const struct zstd_params *params)
+{
+	struct zstd_cctx *cctx = workspace;
+	size_t max_seq;
+	u8 *p;
+
+	if (!workspace || !zstd_params_valid(params) ||
+	    workspace_size < zstd_cctx_workspace_size(params))
+		return NULL;
+
+	cctx->init_params = *params;
+	cctx->params = *params;
+	cctx->block_size = zstd_block_size(params);
+	max_seq = cctx->block_size / 4;
+
+	p = (u8 *)(cctx + 1);
+	cctx->hash_table = (u32 *)p;
+	p += sizeof(u32) << params->hash_log;
+	cctx->chain_table = (u32 *)p;
+	p += sizeof(u32) << params->chain_log;
+	cctx->seqs = (struct zstd_seq *)p;
+	p += max_seq * sizeof(struct zstd_seq);
+	cctx->lits = p;
+	p += cctx->block_size;
+	cctx->ll_codes = p;
+	cctx->ml_codes = p + max_seq;
+	cctx->of_codes = p + 2 * max_seq;
+
+	zstd_build_default_tables(cctx);
+	return cctx;
+}
+EXPORT_SYMBOL(zstd_init_cctx);
+
+static int zstd_compress_frame(struct zstd_cctx *cctx, void *dst,
+			       size_t *dst_len, const void *src,
+			       size_t src_len, const struct zstd_cdict *cdict)
+{
+	const u8 *ip = src, *iend = ip + src_len;
+	u8 *op = dst, *oend = op + *dst_len;
+
+	if (*dst_len < ZSTD_FRAME_HEADER_MAX)
+		return -ENOSPC;
+
+	zstd_begin_frame(cctx, ip, cdict, src_len);
+	op += zstd_write_frame_header(cctx, op, src_len,
+				      zstd_single_segment(cctx, src_len,
+							  cdict));
+
+	do {
+		size_t n = min_t(size_t, cctx->block_size, iend - ip);
+		ssize_t size;
+
+		size = zstd_compress_block(cctx, op, oend - op, ip, n,
+					   ip + n == iend);
+		if (size < 0)
+			return size;
+		if (cctx->params.checksum)
+			zstd_xxh64_update(&cctx->xxh, ip, n);
+		ip += n;
+		op += size;
+	} while (ip < iend);
+
+	if (cctx->params.checksum) {
+		if (oend - op < ZSTD_CHECKSUM_SIZE)
+			return -ENOSPC;
+		put_unaligned_le32(zstd_xxh64_digest(&cctx->xxh), op);
+		op += ZSTD_CHECKSUM_SIZE;
+	}
+
+	*dst_len = op - (u8 *)dst;
+	return 0;
+}
+
+int zstd_compress_cctx(struct zstd_cctx *cctx, void *dst, size_t *dst_len,
+		       const void *src, size_t src_len)
+{
+	return zstd_compress_frame(cctx, dst, dst_len, src, src_len, NULL);
+}
+EXPORT_SYMBOL(zstd_compress_cctx);
+
+/* Dictionaries */
+
+size_t zstd_cdict_workspace_size(const struct zstd_params *params)
+{
+	return sizeof(struct zstd_cdict) +
+	       (sizeof(u32) << params->hash_log) +
+	       (sizeof(u32) << params->chain_log);
+}
+EXPORT_SYMBOL(zstd_cdict_workspace_size);
+
+struct zstd_cdict *zstd_init_cdict(const void *dict, size_t dict_size,
+				   const struct zstd_params *params,
+				   void *workspace, size_t workspace_size)
+{
+	struct zstd_cdict *cdict = workspace;
+	struct zstd_dict_parts parts;
+	int i;
+
+	if (!workspace || !zstd_params_valid(params) ||
+	    workspace_size < zstd_cdict_workspace_size(params))
+		return NULL;
+	if (zstd_parse_dict(&parts, dict, dict_size))
+		return NULL;
+
+	cdict->params = *params;
+	cdict->content = parts.content;
+	cdict->content_size = parts.content_size;
+	cdict->id = parts.id;
+	for (i = 0; i < ZSTD_REP_NUM; i++)
+		cdict->rep[i] = parts.rep[i];
+
+	cdict->hash_table = (u32 *)(cdict + 1);
+	cdict->chain_table = cdict->hash_table + (1U << params->hash_log);
+	memset(cdict->hash_table, 0, sizeof(u32) << params->hash_log);
+
+	/* Index 1 is the first byte, hashing may read 8 bytes */
+	if (cdict->content_size >= 8)
+		zstd_hash_range(cdict->hash_table, cdict->chain_table, params,
+				cdict->content - 1, 1,
+				cdict->content_size - 6);
+
+	return cdict;
+}
+EXPORT_SYMBOL(zstd_init_cdict);
+
+static bool zstd_cdict_matches(const struct zstd_cctx *cctx,
+			       const struct zstd_cdict *cdict)
+{
+	return cdict->params.hash_log == cctx->init_params.hash_log &&
+	       cdict->params.chain_log == cctx->init_params.chain_log;
+}
+
+int zstd_compress_using_cdict(struct zstd_cctx *cctx, void *dst,
+			      size_t *dst_len, const void *src,
+			      size_t src_len, const struct zstd_cdict *cdict)
+{
+	if (!zstd_cdict_matches(cctx, cdict))
+		return -EINVAL;
+	return zstd_compress_frame(cctx, dst, dst_len, src, src_len, cdict);
+}
+EXPORT_SYMBOL(zstd_compress_using_cdict);
+
+/* Streaming */
+
+enum zstd_cstage {
+	ZSTD_CS_INIT,		/* frame header not written yet */
+	ZSTD_CS_ONGOING,
+	ZSTD_CS_ENDED,
+};
+
+struct zstd_cstream {
+	struct zstd_cctx *cctx;
+	const struct zstd_cdict *cdict;
+	enum zstd_cstage stage;
+	u64 pledged;
+	u64 consumed;
+
+	/* Input: window followed by room for a block */
+	u8 *buf;
+	size_t buf_size;
+	size_t block_start;
+	size_t in_end;
+	bool wrapped;
+
+	/* Output of the last block, waiting to be written out */
+	u8 *outbuf;
+	size_t out_pos;
+	size_t out_end;
+};
+
+static size_t zstd_cstream_outbuf_size(const struct zstd_params *params)
+{
+	return ZSTD_FRAME_HEADER_MAX + ZSTD_BLOCK_HEADER_SIZE +
+	       zstd_block_size(params) + ZSTD_CHECKSUM_SIZE;
+}
+
+size_t zstd_cstream_workspace_size(const struct zstd_params *params)
+{
+	return ALIGN(sizeof(struct zstd_cstream), 8) +
+	       ALIGN(zstd_cctx_workspace_size(params), 8) +
+	       (1U << params->window_log) + zstd_block_size(params) +
+	       zstd_cstream_outbuf_size(params);
+}
+EXPORT_SYMBOL(zstd_cstream_workspace_size);
+
+int zstd_reset_cstream(struct zstd_cstream *zcs, u64 pledged_src_size)
+{
+	zcs->stage = ZSTD_CS_INIT;
+	zcs->pledged = pledged_src_size;
+	zcs->consumed = 0;
+	zcs->block_start = zcs->in_end = 0;
+	zcs->wrapped = false;
+	zcs->out_pos = zcs->out_end = 0;
+	zstd_begin_frame(zcs->cctx, zcs->buf, zcs->cdict,
+			 ZSTD_CONTENTSIZE_UNKNOWN);
+	return 0;
+}
+EXPORT_SYMBOL(zstd_reset_cstream);
+
+static struct zstd_cstream *
+__zstd_init_cstream(const struct zstd_params *params,
+		    const struct zstd_cdict *cdict, u64 pledged_src_size,
+		    void *workspace, size_t workspace_size)
+{
+	struct zstd_cstream *zcs = workspace;
+	size_t cctx_size;
+	u8 *p;
+
+	if (!workspace || !zstd_params_valid(params) ||
+	    workspace_size < zstd_cstream_workspace_size(params))
+		return NULL;
+
+	p = (u8 *)zcs + ALIGN(sizeof(*zcs), 8);
+	cctx_size = ALIGN(zstd_cctx_workspace_size(params), 8);
+	zcs->cctx = zstd_init_cctx(p, cctx_size, params);
+	if (!zcs->cctx || (cdict && !zstd_cdict_matches(zcs->cctx, cdict)))
+		return NULL;
+	p += cctx_size;
+
+	zcs->cdict = cdict;
+	zcs->buf = p;
+	zcs->buf_size = (1U << params->window_log) + zstd_block_size(params);
+	zcs->outbuf = p + zcs->buf_size;
+	zstd_reset_cstream(zcs, pledged_src_size);
+
+	return zcs;
+}
+
+struct zstd_cstream *zstd_init_cstream(const struct zstd_params *params,
+				       u64 pledged_src_size,
+				       void *workspace, size_t workspace_size)
+{
+	return __zstd_init_cstream(params, NULL, pledged_src_size, workspace,
+				   workspace_size);
+}
+EXPORT_SYMBOL(zstd_init_cstream);
+
+struct zstd_cstream *zstd_init_cstream_using_cdict(
+				const struct zstd_cdict *cdict,
+				u64 pledged_src_size,
+				void *workspace, size_t workspace_size)
+{
+	return __zstd_init_cstream(&cdict->params, cdict, pledged_src_size,
+				   workspace, workspace_size);
+}
+EXPORT_SYMBOL(zstd_init_cstream_using_cdict);
+
+/* Returns the number of bytes still waiting */
+static size_t zstd_cstream_flush_out(struct zstd_cstream *zcs,
+				     struct zstd_out_buffer *out)
+{
+	size_t n = min(zcs->out_end - zcs->out_pos, out->size - out->pos);
+
+	memcpy((u8 *)out->dst + out->pos, zcs->outbuf + zcs->out_pos, n);
+	out->pos += n;
+	zcs->out_pos += n;
+	if (zcs->out_pos == zcs->out_end)
+		zcs->out_pos = zcs->out_end = 0;
+
+	return zcs->out_end - zcs->out_pos;
+}
+
+static void zstd_cstream_header(struct zstd_cstream *zcs)
+{
+	zcs->out_end = zstd_write_frame_header(zcs->cctx, zcs->outbuf,
+				zcs->pledged,
+				zstd_single_segment(zcs->cctx, zcs->pledged,
+						    zcs->cdict));
+	zcs->stage = ZSTD_CS_ONGOING;
+}
+
+static int zstd_cstream_block(struct zstd_cstream *zcs, bool last)
+{
+	struct zstd_cctx *cctx = zcs->cctx;
+	const u8 *src = zcs->buf + zcs->block_start;
+	size_t size = zcs->in_end - zcs->block_start;
+	ssize_t ret;
+
+	ret = zstd_compress_block(cctx, zcs->outbuf,
+				  zstd_cstream_outbuf_size(&cctx->params),
+				  src, size, last);
+	if (ret < 0)
+		return ret;
+	if (cctx->params.checksum)
+		zstd_xxh64_update(&cctx->xxh, src, size);
+
+	zcs->out_end = ret;
+	zcs->block_start = zcs->in_end;
+	return 0;
+}
+
+/*
+ * Start again at the beginning of the buffer.  What's in it becomes the
+ * ext segment, and gets cut back as new input overwrites it.
+ */
+static void zstd_cstream_wrap(struct zstd_cstream *zcs)
+{
+	struct zstd_cctx *cctx = zcs->cctx;
+	u32 end = zcs->buf + zcs->in_end - cctx->base;
+
+	cctx->dict_base = cctx->base;
+	cctx->low_limit = cctx->dict_limit;
+	cctx->dict_limit = end;
+	cctx->base = zcs->buf - end;
+	cctx->next_to_update = max(cctx->next_to_update, end);
+	zcs->block_start = zcs->in_end = 0;
+	zcs->wrapped = true;
+}
+
+int zstd_compress_stream(struct zstd_cstream *zcs,
+			 struct zstd_out_buffer *out,
+			 struct zstd_in_buffer *in)
+{
+	struct zstd_cctx *cctx = zcs->cctx;
+	size_t n;
+	int ret;
+
+	if (zcs->stage == ZSTD_CS_ENDED)
+		return -EINVAL;
+
+	for (;;) {
+		if (zstd_cstream_flush_out(zcs, out))
+			return 0;
+
+		if (zcs->stage == ZSTD_CS_INIT) {
+			zstd_cstream_header(zcs);
+			continue;
+		}
+
+		if (in->pos == in->size)
+			return 0;
+
+		if (zcs->in_end == zcs->block_start &&
+		    zcs->block_start + cctx->block_size > zcs->buf_size)
+			zstd_cstream_wrap(zcs);
+
+		n = min(in->size - in->pos,
+			zcs->block_start + cctx->block_size - zcs->in_end);
+		memcpy(zcs->buf + zcs->in_end, (const u8 *)in->src + in->pos,
+		       n);
+		zcs->in_end += n;
+		in->pos += n;
+		zcs->consumed += n;
+
+		/* Don't let matches reach into what was just overwritten */
+		if (zcs->wrapped &&
+		    cctx->dict_base + cctx->low_limit < zcs->buf + zcs->in_end)
+			cctx->low_limit = min_t(size_t, cctx->dict_limit,
+					zcs->buf + zcs->in_end - cctx->dict_base);
+
+		if (zcs->in_end - zcs->block_start == cctx->block_size) {
+			ret = zstd_cstream_block(zcs, false);
+			if (ret)
+				return ret;
+		}
+	}
+}
+EXPORT_SYMBOL(zstd_compress_stream);
+
+int zstd_flush_stream(struct zstd_cstream *zcs, struct zstd_out_buffer *out)
+{
+	size_t left;
+	int ret;
+
+	if (zcs->stage == ZSTD_CS_ENDED)
+		return -EINVAL;
+
+	for (;;) {
+		left = zstd_cstream_flush_out(zcs, out);
+		if (left)
+			return left;
+
+		if (zcs->stage == ZSTD_CS_INIT) {
+			zstd_cstream_header(zcs);
+			continue;
+		}
+		if (zcs->in_end == zcs->block_start)
+			return 0;
+
+		ret = zstd_cstream_block(zcs, false);
+		if (ret)
+			return ret;
+	}
+}
+EXPORT_SYMBOL(zstd_flush_stream);
+
+int zstd_end_stream(struct zstd_cstream *zcs, struct zstd_out_buffer *out)
+{
+	struct zstd_cctx *cctx = zcs->cctx;
+	size_t left;
+	int ret;
+
+	for (;;) {
+		left = zstd_cstream_flush_out(zcs, out);
+		if (left || zcs->stage == ZSTD_CS_ENDED)
+			return left;
+
+		if (zcs->stage == ZSTD_CS_INIT) {
+			zstd_cstream_header(zcs);
+			continue;
+		}
+
+		if (zcs->pledged != ZSTD_CONTENTSIZE_UNKNOWN &&
+		    zcs->pledged != zcs->consumed)
+			return -EINVAL;
+
+		ret = zstd_cstream_block(zcs, true);
+		if (ret)
+			return ret;
+		if (cctx->params.checksum) {
+			put_unaligned_le32(zstd_xxh64_digest(&cctx->xxh),
+					   zcs->outbuf + zcs->out_end);
+			zcs->out_end += ZSTD_CHECKSUM_SIZE;
+		}
+		zcs->stage = ZSTD_CS_ENDED;
+	}
+}
+EXPORT_SYMBOL(zstd_end_stream);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard compressor");
@@ -0,0 +1,1193 @@
+/*
+ * Zstandard decompressor
+ *
+ * A frame is a header followed by blocks of at most ZSTD_BLOCKSIZE_MAX
+ * decoded bytes.  A compressed block holds its literals, Huffman coded in
+ * one or four streams, and then the sequences, each a (literal length,
+ * offset, match length) triple coded with three interleaved FSE states.
+ * Offsets 1-3 refer back to recently used offsets.
+ *
+ * Matches may reach back into two pieces of history: the contiguous run
+ * of output leading up to the current position (the prefix), and one
+ * older segment that isn't contiguous with it (ext).  A dictionary is the
+ * ext segment of the first block; the streaming decoder uses it for the
+ * data left behind when its window buffer wraps.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+
+#include "zstd_internal.h"
+
+struct zstd_huf_dentry {
+	u8 symbol;
+	u8 nbits;
+};
+
+/* Entropy tables carried from block to block, or from a dictionary */
+struct zstd_entropy {
+	struct zstd_fse_dentry ll[ZSTD_FSE_DTABLE_SIZE(ZSTD_LL_MAX_LOG)];
+	struct zstd_fse_dentry of[ZSTD_FSE_DTABLE_SIZE(ZSTD_OF_MAX_LOG)];
+	struct zstd_fse_dentry ml[ZSTD_FSE_DTABLE_SIZE(ZSTD_ML_MAX_LOG)];
+	struct zstd_huf_dentry huf[1 << ZSTD_HUF_MAX_BITS];
+	unsigned int ll_log, of_log, ml_log, huf_log;
+	bool ll_valid, of_valid, ml_valid, huf_valid;
+	u32 rep[ZSTD_REP_NUM];
+};
+
+struct zstd_ddict {
+	struct zstd_entropy entropy;
+	const u8 *content;
+	size_t content_size;
+	u32 id;
+};
+
+struct zstd_frame_header {
+	u64 content_size;
+	u64 window_size;
+	u32 dict_id;
+	bool checksum;
+	unsigned int header_size;
+};
+
+struct zstd_dctx {
+	struct zstd_entropy entropy;
+	struct zstd_frame_header fh;
+	struct zstd_xxh64_state xxh;
+
+	/* History matches may refer to, see the top of the file */
+	const u8 *prefix_start;
+	const u8 *ext_start;
+	const u8 *ext_end;
+
+	const u8 *lit_ptr;
+	size_t lit_size;
+	u8 litbuf[ZSTD_BLOCKSIZE_MAX];
+};
+
+/* Frame headers */
+
+static const u8 zstd_did_size[4] = { 0, 1, 2, 4 };
+static const u8 zstd_fcs_size[4] = { 0, 2, 4, 8 };
+
+/* Needs at least 5 bytes: the magic number and the frame descriptor */
+static size_t zstd_frame_header_size(const u8 *src)
+{
+	u8 fhd = src[4];
+	bool single = fhd & 0x20;
+	size_t size = 5 + !single + zstd_did_size[fhd & 3] +
+		      zstd_fcs_size[fhd >> 6];
+
+	if (single && !(fhd >> 6))
+		size++;
+	return size;
+}
+
+/* src has to hold the whole header */
+static int zstd_parse_frame_header(struct zstd_frame_header *fh,
+				   const u8 *src, size_t size)
+{
+	u8 fhd;
+	bool single;
+	const u8 *p;
+
+	if (size < 5 || get_unaligned_le32(src) != ZSTD_MAGIC)
+		return -EINVAL;
+
+	fh->header_size = zstd_frame_header_size(src);
+	if (size < fh->header_size)
+		return -EINVAL;
+
+	fhd = src[4];
+	single = fhd & 0x20;
+	if (fhd & 0x08)
+		return -EINVAL;	/* reserved bit */
+
+	p = src + 5;
+	fh->window_size = 0;
+	if (!single) {
+		unsigned int exponent = *p >> 3, mantissa = *p & 7;
+		u64 base = 1ULL << (ZSTD_WINDOWLOG_MIN + exponent);
+
+		fh->window_size = base + (base >> 3) * mantissa;
+		p++;
+	}
+
+	switch (fhd & 3) {
+	case 0:
+		fh->dict_id = 0;
+		break;
+	case 1:
+		fh->dict_id = *p;
+		break;
+	case 2:
+		fh->dict_id = get_unaligned_le16(p);
+		break;
+	case 3:
+		fh->dict_id = get_unaligned_le32(p);
+		break;
+	}
+	p += zstd_did_size[fhd & 3];
+
+	switch (fhd >> 6) {
+	case 0:
+		fh->content_size = single ? *p : ZSTD_CONTENTSIZE_UNKNOWN;
+		break;
+	case 1:
+		fh->content_size = get_unaligned_le16(p) + 256;
+		break;
+	case 2:
+		fh->content_size = get_unaligned_le32(p);
+		break;
+	case 3:
+		fh->content_size = get_unaligned_le64(p);
+		break;
+	}
+
+	if (single)
+		fh->window_size = fh->content_size;
+	fh->checksum = fhd & 0x04;
+
+	return 0;
+}
+
+u64 zstd_get_frame_content_size(const void *src, size_t src_len)
+{
+	struct zstd_frame_header fh;
+
+	if (zstd_parse_frame_header(&fh, src, src_len))
+		return ZSTD_CONTENTSIZE_ERROR;
+	return fh.content_size;
+}
+EXPORT_SYMBOL(zstd_get_frame_content_size);
+
+/* Literals */
+
+static int zstd_huf_build(struct zstd_entropy *e, const u8 *src, size_t size)
+{
+	u8 weights[ZSTD_HUF_MAX_SYMBOLS];
+	u32 rank[ZSTD_HUF_MAX_BITS + 1] = { 0 };
+	unsigned int n, log, s, w;
+	u32 next = 0;
+	int ret;
+
+	ret = zstd_huf_read_weights(weights, &n, &log, src, size);
+	if (ret < 0)
+		return ret;
+
+	for (s = 0; s < n; s++)
+		rank[weights[s]]++;
+
+	/* Longest codes first: each weight gets 2^(w-1) consecutive slots */
+	for (w = 1; w <= log; w++) {
+		u32 cur = next;
+
+		next += rank[w] << (w - 1);
+		rank[w] = cur;
+	}
+
+	for (s = 0; s < n; s++) {
+		u32 i, len;
+
+		w = weights[s];
+		if (!w)
+			continue;
+
+		len = (1 << w) >> 1;
+		for (i = rank[w]; i < rank[w] + len; i++) {
+			e->huf[i].symbol = s;
+			e->huf[i].nbits = log + 1 - w;
+		}
+		rank[w] += len;
+	}
+
+	e->huf_log = log;
+	e->huf_valid = true;
+	return ret;
+}
+
+static int zstd_huf_decode_stream(const struct zstd_entropy *e, u8 *dst,
+				  size_t n, const u8 *src, size_t size)
+{
+	const struct zstd_huf_dentry *dt = e->huf;
+	unsigned int log = e->huf_log;
+	struct zstd_bitd bd;
+	size_t i = 0;
+
+	if (zstd_bitd_init(&bd, src, size))
+		return -EINVAL;
+
+	/* A reload leaves at least 56 bits, enough for four symbols */
+	while (i + 4 <= n) {
+		if (zstd_bitd_reload(&bd) == ZSTD_BITD_OVERFLOW)
+			return -EINVAL;
+		for (; i + 4 <= n && bd.consumed <= 64 - 4 * ZSTD_HUF_MAX_BITS;
+		     i++) {
+			const struct zstd_huf_dentry *d =
+				&dt[zstd_bitd_look(&bd, log)];
+
+			dst[i] = d->symbol;
+			zstd_bitd_skip(&bd, d->nbits);
+		}
+		if (bd.ptr == bd.start)
+			break;
+	}
+
+	for (; i < n; i++) {
+		const struct zstd_huf_dentry *d;
+
+		if (zstd_bitd_reload(&bd) == ZSTD_BITD_OVERFLOW)
+			return -EINVAL;
+		d = &dt[zstd_bitd_look(&bd, log)];
+		dst[i] = d->symbol;
+		zstd_bitd_skip(&bd, d->nbits);
+	}
+
+	zstd_bitd_reload(&bd);
+	return zstd_bitd_finished(&bd) ? 0 : -EINVAL;
+}
+
+static int zstd_huf_decode(const struct zstd_entropy *e, u8 *dst, size_t n,
+			   const u8 *src, size_t size, bool single)
+{
+	size_t s1, s2, s3, s4, segment;
+	int ret;
+
+	if (single)
+		return zstd_huf_decode_stream(e, dst, n, src, size);
+
+	/* Jump table: the sizes of the first three streams */
+	if (size < 10)
+		return -EINVAL;
+	s1 = get_unaligned_le16(src);
+	s2 = get_unaligned_le16(src + 2);
+	s3 = get_unaligned_le16(src + 4);
+	if (s1 + s2 + s3 + 6 >= size)
+		return -EINVAL;
+	s4 = size - 6 - s1 - s2 - s3;
+	src += 6;
+
+	segment = (n + 3) / 4;
+	if (3 * segment > n)
+		return -EINVAL;
+
+	ret = zstd_huf_decode_stream(e, dst, segment, src, s1);
+	if (!ret)
+		ret = zstd_huf_decode_stream(e, dst + segment, segment,
+					     src + s1, s2);
+	if (!ret)
+		ret = zstd_huf_decode_stream(e, dst + 2 * segment, segment,
+					     src + s1 + s2, s3);
+	if (!ret)
+		ret = zstd_huf_decode_stream(e, dst + 3 * segment,
+					     n - 3 * segment,
+					     src + s1 + s2 + s3, s4);
+	return ret;
+}
+
+/* Returns the size of the literals section */
+static int zstd_decode_literals(struct zstd_dctx *dctx, const u8 *src,
+				size_t size)
+{
+	unsigned int type = src[0] & 3, format = (src[0] >> 2) & 3;
+	size_t hsize, regen, csize;
+	bool single = false;
+	int ret;
+
+	switch (type) {
+	case ZSTD_LIT_RAW:
+	case ZSTD_LIT_RLE:
+		switch (format) {
+		case 1:
+			hsize = 2;
+			if (size < hsize)
+				return -EINVAL;
+			regen = (src[0] >> 4) + (src[1] << 4);
+			break;
+		case 3:
+			hsize = 3;
+			if (size < hsize)
+				return -EINVAL;
+			regen = (src[0] >> 4) + (src[1] << 4) +
+				((size_t)src[2] << 12);
+			break;
+		default:
+			hsize = 1;
+			regen = src[0] >> 3;
+			break;
+		}
+
+		if (regen > ZSTD_BLOCKSIZE_MAX)
+			return -EINVAL;
+
+		dctx->lit_size = regen;
+		if (type == ZSTD_LIT_RAW) {
+			if (hsize + regen > size)
+				return -EINVAL;
+			dctx->lit_ptr = src + hsize;
+			return hsize + regen;
+		}
+
+		if (hsize + 1 > size)
+			return -EINVAL;
+		memset(dctx->litbuf, src[hsize], regen);
+		dctx->lit_ptr = dctx->litbuf;
+		return hsize + 1;
+
+	default:
+		hsize = format < 2 ? 3 : format + 2;
+		if (size < hsize)
+			return -EINVAL;
+
+		switch (format) {
+		case 0:
+			single = true;
+			/* fall through */
+		case 1:
+			regen = (src[0] >> 4) + ((src[1] & 0x3f) << 4);
+			csize = (src[1] >> 6) + (src[2] << 2);
+			break;
+		case 2:
+			regen = (get_unaligned_le32(src) >> 4) & 0x3fff;
+			csize = get_unaligned_le32(src) >> 18;
+			break;
+		default:
+			regen = (get_unaligned_le32(src) >> 4) & 0x3ffff;
+			csize = (get_unaligned_le32(src) >> 22) +
+				((size_t)src[4] << 10);
+			break;
+		}
+
+		if (regen > ZSTD_BLOCKSIZE_MAX || hsize + csize > size)
+			return -EINVAL;
+
+		src += hsize;
+		size = csize;
+		if (type == ZSTD_LIT_COMPRESSED) {
+			ret = zstd_huf_build(&dctx->entropy, src, size);
+			if (ret < 0)
+				return ret;
+			src += ret;
+			size -= ret;
+		} else if (!dctx->entropy.huf_valid) {
+			return -EINVAL;
+		}
+
+		ret = zstd_huf_decode(&dctx->entropy, dctx->litbuf, regen,
+				      src, size, single);
+		if (ret)
+			return ret;
+
+		dctx->lit_ptr = dctx->litbuf;
+		dctx->lit_size = regen;
+		return hsize + csize;
+	}
+}
+
+/* Sequences */
+
+static int zstd_build_seq_table(struct zstd_fse_dentry *dt, unsigned int *log,
+				bool *valid, unsigned int mode,
+				unsigned int max_code, unsigned int max_log,
+				const s16 *default_norm,
+				unsigned int default_max,
+				unsigned int default_log,
+				const u8 *src, size_t size)
+{
+	s16 norm[ZSTD_ML_MAX_CODE + 1];
+	unsigned int max = max_code;
+	int ret;
+
+	switch (mode) {
+	case ZSTD_SEQ_PREDEFINED:
+		*log = default_log;
+		ret = zstd_fse_build_dtable(dt, default_norm, default_max,
+					    default_log);
+		break;
+	case ZSTD_SEQ_RLE:
+		if (!size || src[0] > max_code)
+			return -EINVAL;
+		dt[0].symbol = src[0];
+		dt[0].nbits = 0;
+		dt[0].base = 0;
+		*log = 0;
+		ret = 1;
+		break;
+	case ZSTD_SEQ_COMPRESSED:
+		ret = zstd_read_ncount(norm, &max, log, src, size);
+		if (ret < 0)
+			return ret;
+		if (*log > max_log ||
+		    zstd_fse_build_dtable(dt, norm, max, *log))
+			return -EINVAL;
+		break;
+	default:
+		if (!*valid)
+			return -EINVAL;
+		return 0;
+	}
+
+	if (ret >= 0)
+		*valid = true;
+	return ret;
+}
+
+static void zstd_copy_match(u8 *op, size_t offset, size_t len)
+{
+	const u8 *match = op - offset;
+
+	if (offset >= len) {
+		memcpy(op, match, len);
+		return;
+	}
+
+	while (len--)
+		*op++ = *match++;
+}
+
+/* Returns the number of bytes decoded into dst */
+static ssize_t zstd_decode_sequences(struct zstd_dctx *dctx, u8 *dst,
+				     size_t capacity, const u8 *src,
+				     size_t size)
+{
+	struct zstd_entropy *e = &dctx->entropy;
+	const u8 *p = src, *end = src + size;
+	const u8 *lit = dctx->lit_ptr, *lit_end = lit + dctx->lit_size;
+	u8 *op = dst, *oend = dst + capacity;
+	unsigned int nb_seq, modes, ll_state, of_state, ml_state;
+	struct zstd_bitd bd;
+	int ret;
+
+	if (p >= end)
+		return -EINVAL;
+
+	nb_seq = *p++;
+	if (nb_seq >= 128) {
+		if (nb_seq == 255) {
+			if (end - p < 2)
+				return -EINVAL;
+			nb_seq = get_unaligned_le16(p) + 0x7f00;
+			p += 2;
+		} else {
+			if (p >= end)
+				return -EINVAL;
+			nb_seq = ((nb_seq - 128) << 8) + *p++;
+		}
+	}
+
+	if (!nb_seq) {
+		if (p != end)
+			return -EINVAL;
+		goto last_literals;
+	}
+
+	if (p >= end)
+		return -EINVAL;
+	modes = *p++;
+	if (modes & 3)
+		return -EINVAL;
+
+	ret = zstd_build_seq_table(e->ll, &e->ll_log, &e->ll_valid, modes >> 6,
+				   ZSTD_LL_MAX_CODE, ZSTD_LL_MAX_LOG,
+				   zstd_ll_default_norm, ZSTD_LL_MAX_CODE,
+				   ZSTD_LL_DEFAULT_LOG, p, end - p);
+	if (ret < 0)
+		return ret;
+	p += ret;
+
+	ret = zstd_build_seq_table(e->of, &e->of_log, &e->of_valid,
+				   (modes >> 4) & 3,
+				   ZSTD_OF_MAX_CODE, ZSTD_OF_MAX_LOG,
+				   zstd_of_default_norm, ZSTD_OF_DEFAULT_MAX,
+				   ZSTD_OF_DEFAULT_LOG, p, end - p);
+	if (ret < 0)
+		return ret;
+	p += ret;
+
+	ret = zstd_build_seq_table(e->ml, &e->ml_log, &e->ml_valid,
+				   (modes >> 2) & 3,
+				   ZSTD_ML_MAX_CODE, ZSTD_ML_MAX_LOG,
+				   zstd_ml_default_norm, ZSTD_ML_MAX_CODE,
+				   ZSTD_ML_DEFAULT_LOG, p, end - p);
+	if (ret < 0)
+		return ret;
+	p += ret;
+
+	if (zstd_bitd_init(&bd, p, end - p))
+		return -EINVAL;
+
+	ll_state = zstd_bitd_read(&bd, e->ll_log);
+	zstd_bitd_reload(&bd);
+	of_state = zstd_bitd_read(&bd, e->of_log);
+	zstd_bitd_reload(&bd);
+	ml_state = zstd_bitd_read(&bd, e->ml_log);
+
+	while (nb_seq--) {
+		unsigned int ll_code = e->ll[ll_state].symbol;
+		unsigned int of_code = e->of[of_state].symbol;
+		unsigned int ml_code = e->ml[ml_state].symbol;
+		size_t ll, ml, offset;
+		u32 ofv;
+
+		if (zstd_bitd_reload(&bd) == ZSTD_BITD_OVERFLOW)
+			return -EINVAL;
+
+		ofv = (1u << of_code) + zstd_bitd_read(&bd, of_code);
+		zstd_bitd_reload(&bd);
+		ml = zstd_ml_base[ml_code] +
+		     zstd_bitd_read(&bd, zstd_ml_bits[ml_code]);
+		ll = zstd_ll_base[ll_code] +
+		     zstd_bitd_read(&bd, zstd_ll_bits[ll_code]);
+		zstd_bitd_reload(&bd);
+
+		if (ofv > ZSTD_REP_NUM) {
+			offset = ofv - ZSTD_REP_NUM;
+			e->rep[2] = e->rep[1];
+			e->rep[1] = e->rep[0];
+			e->rep[0] = offset;
+		} else {
+			/* No literals shift the repeat codes by one */
+			unsigned int idx = ofv - 1 + !ll;
+
+			if (!idx) {
+				offset = e->rep[0];
+			} else {
+				offset = idx == ZSTD_REP_NUM ?
+					 e->rep[0] - 1 : e->rep[idx];
+				offset += !offset;
+				if (idx != 1)
+					e->rep[2] = e->rep[1];
+				e->rep[1] = e->rep[0];
+				e->rep[0] = offset;
+			}
+		}
+
+		if (nb_seq) {
+			zstd_fse_decode(e->ll, &ll_state, &bd);
+			zstd_fse_decode(e->ml, &ml_state, &bd);
+			zstd_fse_decode(e->of, &of_state, &bd);
+		}
+
+		if (ll > (size_t)(lit_end - lit))
+			return -EINVAL;
+		if (ll + ml > (size_t)(oend - op))
+			return -ENOSPC;
+
+		memcpy(op, lit, ll);
+		op += ll;
+		lit += ll;
+
+		if (offset > (size_t)(op - dctx->prefix_start)) {
+			/* The match starts in the older segment */
+			size_t back = offset - (op - dctx->prefix_start);
+			size_t n = min(back, ml);
+
+			if (back > (size_t)(dctx->ext_end - dctx->ext_start))
+				return -EINVAL;
+			memcpy(op, dctx->ext_end - back, n);
+			op += n;
+			ml -= n;
+			if (!ml)
+				continue;
+			offset = op - dctx->prefix_start;
+		}
+
+		zstd_copy_match(op, offset, ml);
+		op += ml;
+	}
+
+	if (zstd_bitd_reload(&bd) < ZSTD_BITD_COMPLETED)
+		return -EINVAL;
+
+last_literals:
+	if ((size_t)(lit_end - lit) > (size_t)(oend - op))
+		return -ENOSPC;
+	memcpy(op, lit, lit_end - lit);
+	op += lit_end - lit;
+
+	return op - dst;
+}
+
+static ssize_t zstd_decode_block(struct zstd_dctx *dctx, u8 *dst,
+				 size_t capacity, const u8 *src, size_t size)
+{
+	int ret;
+
+	if (!size || size > ZSTD_BLOCKSIZE_MAX)
+		return -EINVAL;
+
+	ret = zstd_decode_literals(dctx, src, size);
+	if (ret < 0)
+		return ret;
+
+	return zstd_decode_sequences(dctx, dst, capacity, src + ret,
+				     size - ret);
+}
+
+/* Frames */
+
+static void zstd_entropy_init(struct zstd_entropy *e)
+{
+	e->ll_valid = e->of_valid = e->ml_valid = e->huf_valid = false;
+	e->rep[0] = 1;
+	e->rep[1] = 4;
+	e->rep[2] = 8;
+}
+
+static int zstd_begin_frame(struct zstd_dctx *dctx, u8 *dst,
+			    const struct zstd_ddict *ddict)
+{
+	if (dctx->fh.dict_id && (!ddict || ddict->id != dctx->fh.dict_id))
+		return -EINVAL;
+
+	if (ddict) {
+		memcpy(&dctx->entropy, &ddict->entropy,
+		       sizeof(dctx->entropy));
+		dctx->ext_start = ddict->content;
+		dctx->ext_end = ddict->content + ddict->content_size;
+	} else {
+		zstd_entropy_init(&dctx->entropy);
+		dctx->ext_start = dctx->ext_end = NULL;
+	}
+
+	dctx->prefix_start = dst;
+	if (dctx->fh.checksum)
+		zstd_xxh64_reset(&dctx->xxh);
+	return 0;
+}
+
+static int zstd_check_checksum(struct zstd_dctx *dctx, const u8 *src)
+{
+	u32 digest = zstd_xxh64_digest(&dctx->xxh);
+
+	return digest == get_unaligned_le32(src) ? 0 : -EINVAL;
+}
+
+static ssize_t zstd_decompress_frame(struct zstd_dctx *dctx, u8 *dst,
+				     size_t capacity, const u8 **srcp,
+				     size_t *sizep,
+				     const struct zstd_ddict *ddict)
+{
+	const u8 *p = *srcp, *end = p + *sizep;
+	u8 *op = dst, *oend = dst + capacity;
+	bool last;
+	int ret;
+
+	ret = zstd_parse_frame_header(&dctx->fh, p, end - p);
+	if (ret)
+		return ret;
+	p += dctx->fh.header_size;
+
+	ret = zstd_begin_frame(dctx, dst, ddict);
+	if (ret)
+		return ret;
+
+	do {
+		u32 bh;
+		size_t bsize;
+		ssize_t n;
+
+		if (end - p < ZSTD_BLOCK_HEADER_SIZE)
+			return -EINVAL;
+		bh = p[0] | (p[1] << 8) | (p[2] << 16);
+		p += ZSTD_BLOCK_HEADER_SIZE;
+		last = bh & 1;
+		bsize = bh >> 3;
+
+		switch ((bh >> 1) & 3) {
+		case ZSTD_BLOCK_RAW:
+			if (bsize > (size_t)(end - p))
+				return -EINVAL;
+			if (bsize > (size_t)(oend - op))
+				return -ENOSPC;
+			memcpy(op, p, bsize);
+			p += bsize;
+			n = bsize;
+			break;
+		case ZSTD_BLOCK_RLE:
+			if (p >= end || bsize > ZSTD_BLOCKSIZE_MAX)
+				return -EINVAL;
+			if (bsize > (size_t)(oend - op))
+				return -ENOSPC;
+			memset(op, *p++, bsize);
+			n = bsize;
+			break;
+		case ZSTD_BLOCK_COMPRESSED:
+			if (bsize > (size_t)(end - p))
+				return -EINVAL;
+			n = zstd_decode_block(dctx, op, oend - op, p, bsize);
+			if (n < 0)
+				return n;
+			p += bsize;
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		if (dctx->fh.checksum)
+			zstd_xxh64_update(&dctx->xxh, op, n);
+		op += n;
+	} while (!last);
+
+	if (dctx->fh.content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    dctx->fh.content_size != (u64)(op - dst))
+		return -EINVAL;
+
+	if (dctx->fh.checksum) {
+		if (end - p < ZSTD_CHECKSUM_SIZE ||
+		    zstd_check_checksum(dctx, p))
+			return -EINVAL;
+		p += ZSTD_CHECKSUM_SIZE;
+	}
+
+	*sizep -= p - *srcp;
+	*srcp = p;
+	return op - dst;
+}
+
+static int __zstd_decompress(struct zstd_dctx *dctx, void *dst,
+			     size_t *dst_len, const void *src, size_t src_len,
+			     const struct zstd_ddict *ddict)
+{
+	u8 *op = dst;
+	size_t capacity = *dst_len;
+	const u8 *p = src;
+
+	if (src_len < 5)
+		return -EINVAL;
+
+	while (src_len >= 5) {
+		u32 magic = get_unaligned_le32(p);
+		ssize_t n;
+
+		if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+			u32 skip;
+
+			if (src_len < 8)
+				return -EINVAL;
+			skip = get_unaligned_le32(p + 4);
+			if (skip > src_len - 8)
+				return -EINVAL;
+			p += 8 + skip;
+			src_len -= 8 + skip;
+			continue;
+		}
+
+		n = zstd_decompress_frame(dctx, op, capacity, &p, &src_len,
+					  ddict);
+		if (n < 0)
+			return n;
+		op += n;
+		capacity -= n;
+	}
+
+	if (src_len)
+		return -EINVAL;
+
+	*dst_len = op - (u8 *)dst;
+	return 0;
+}
+
+size_t zstd_dctx_workspace_size(void)
+{
+	return sizeof(struct zstd_dctx);
+}
+EXPORT_SYMBOL(zstd_dctx_workspace_size);
+
+struct zstd_dctx *zstd_init_dctx(void *workspace, size_t workspace_size)
+{
+	if (!workspace || workspace_size < sizeof(struct zstd_dctx))
+		return NULL;
+	return workspace;
+}
+EXPORT_SYMBOL(zstd_init_dctx);
+
+int zstd_decompress_dctx(struct zstd_dctx *dctx, void *dst, size_t *dst_len,
+			 const void *src, size_t src_len)
+{
+	return __zstd_decompress(dctx, dst, dst_len, src, src_len, NULL);
+}
+EXPORT_SYMBOL(zstd_decompress_dctx);
+
+/* Dictionaries */
+
+size_t zstd_ddict_workspace_size(void)
+{
+	return sizeof(struct zstd_ddict);
+}
+EXPORT_SYMBOL(zstd_ddict_workspace_size);
+
+static int zstd_load_seq_table(struct zstd_fse_dentry *dt, unsigned int *log,
+			       bool *valid, unsigned int max_code,
+			       const u8 *src, size_t size)
+{
+	s16 norm[ZSTD_ML_MAX_CODE + 1];
+	unsigned int max = max_code;
+	int ret;
+
+	ret = zstd_read_ncount(norm, &max, log, src, size);
+	if (ret < 0)
+		return ret;
+	ret = zstd_fse_build_dtable(dt, norm, max, *log);
+	if (ret)
+		return ret;
+	*valid = true;
+	return 0;
+}
+
+struct zstd_ddict *zstd_init_ddict(const void *dict, size_t dict_size,
+				   void *workspace, size_t workspace_size)
+{
+	struct zstd_ddict *ddict = workspace;
+	struct zstd_entropy *e;
+	struct zstd_dict_parts parts;
+	int i;
+
+	if (!workspace || workspace_size < sizeof(*ddict))
+		return NULL;
+	if (zstd_parse_dict(&parts, dict, dict_size))
+		return NULL;
+
+	e = &ddict->entropy;
+	zstd_entropy_init(e);
+	if (parts.id) {
+		if (zstd_huf_build(e, parts.huf, parts.huf_size) < 0 ||
+		    zstd_load_seq_table(e->of, &e->of_log, &e->of_valid,
+					ZSTD_OF_MAX_CODE, parts.of,
+					parts.of_size) ||
+		    zstd_load_seq_table(e->ml, &e->ml_log, &e->ml_valid,
+					ZSTD_ML_MAX_CODE, parts.ml,
+					parts.ml_size) ||
+		    zstd_load_seq_table(e->ll, &e->ll_log, &e->ll_valid,
+					ZSTD_LL_MAX_CODE, parts.ll,
+					parts.ll_size))
+			return NULL;
+	}
+
+	for (i = 0; i < ZSTD_REP_NUM; i++)
+		e->rep[i] = parts.rep[i];
+	ddict->content = parts.content;
+	ddict->content_size = parts.content_size;
+	ddict->id = parts.id;
+
+	return ddict;
+}
+EXPORT_SYMBOL(zstd_init_ddict);
+
+int zstd_decompress_using_ddict(struct zstd_dctx *dctx, void *dst,
+				size_t *dst_len, const void *src,
+				size_t src_len, const struct zstd_ddict *ddict)
+{
+	return __zstd_decompress(dctx, dst, dst_len, src, src_len, ddict);
+}
+EXPORT_SYMBOL(zstd_decompress_using_ddict);
+
+/* Streaming */
+
+enum zstd_dstage {
+	ZSTD_DS_HEADER,		/* gathering the frame header */
+	ZSTD_DS_SKIP,		/* inside a skippable frame */
+	ZSTD_DS_BLOCK_HEADER,
+	ZSTD_DS_BLOCK,		/* gathering a block */
+	ZSTD_DS_FLUSH,		/* writing out a decoded block */
+	ZSTD_DS_CHECKSUM,
+	ZSTD_DS_DONE,
+	ZSTD_DS_ERROR,
+};
+
+struct zstd_dstream {
+	struct zstd_dctx dctx;
+	const struct zstd_ddict *ddict;
+	enum zstd_dstage stage;
+
+	/* Input gathered until a header or whole block is available */
+	u8 hbuf[ZSTD_FRAME_HEADER_MAX];
+	u8 *inbuf;
+	size_t in_needed;
+	size_t in_size;
+
+	u32 block_type;
+	u32 block_size;
+	bool last_block;
+	u32 skip;
+	u64 produced;
+
+	/* Decoded data: window followed by room for a block */
+	u8 *window;
+	size_t window_buf_size;
+	size_t max_window;
+	size_t out_end;
+	size_t flushed;
+};
+
+size_t zstd_dstream_workspace_size(size_t max_window_size)
+{
+	return sizeof(struct zstd_dstream) + ZSTD_BLOCKSIZE_MAX +
+	       max_window_size + ZSTD_BLOCKSIZE_MAX;
+}
+EXPORT_SYMBOL(zstd_dstream_workspace_size);
+
+static void zstd_expect(struct zstd_dstream *zds, enum zstd_dstage stage,
+			size_t size)
+{
+	zds->stage = stage;
+	zds->in_needed = size;
+	zds->in_size = 0;
+}
+
+void zstd_reset_dstream(struct zstd_dstream *zds)
+{
+	zstd_expect(zds, ZSTD_DS_HEADER, 5);
+}
+EXPORT_SYMBOL(zstd_reset_dstream);
+
+struct zstd_dstream *zstd_init_dstream_using_ddict(size_t max_window_size,
+				const struct zstd_ddict *ddict,
+				void *workspace, size_t workspace_size)
+{
+	struct zstd_dstream *zds = workspace;
+
+	if (!workspace ||
+	    workspace_size < zstd_dstream_workspace_size(max_window_size))
+		return NULL;
+
+	zds->ddict = ddict;
+	zds->inbuf = (u8 *)(zds + 1);
+	zds->window = zds->inbuf + ZSTD_BLOCKSIZE_MAX;
+	zds->window_buf_size = max_window_size + ZSTD_BLOCKSIZE_MAX;
+	zds->max_window = max_window_size;
+	zstd_reset_dstream(zds);
+
+	return zds;
+}
+EXPORT_SYMBOL(zstd_init_dstream_using_ddict);
+
+struct zstd_dstream *zstd_init_dstream(size_t max_window_size,
+				       void *workspace, size_t workspace_size)
+{
+	return zstd_init_dstream_using_ddict(max_window_size, NULL, workspace,
+					     workspace_size);
+}
+EXPORT_SYMBOL(zstd_init_dstream);
+
+/*
+ * Gather zds->in_needed bytes into buf and return it, or NULL if the input
+ * ran out first.  Blocks are decoded straight from the input when they
+ * are there in one piece.
+ */
+static const u8 *zstd_gather(struct zstd_dstream *zds, u8 *buf,
+			     struct zstd_in_buffer *in)
+{
+	const u8 *src = (const u8 *)in->src + in->pos;
+	size_t avail = in->size - in->pos, n;
+
+	if (buf == zds->inbuf && !zds->in_size && avail >= zds->in_needed) {
+		in->pos += zds->in_needed;
+		return src;
+	}
+
+	n = min(avail, zds->in_needed - zds->in_size);
+	memcpy(buf + zds->in_size, src, n);
+	zds->in_size += n;
+	in->pos += n;
+
+	return zds->in_size == zds->in_needed ? buf : NULL;
+}
+
+static int zstd_stream_header(struct zstd_dstream *zds, const u8 *src)
+{
+	struct zstd_dctx *dctx = &zds->dctx;
+	u32 magic = get_unaligned_le32(src);
+	size_t needed;
+	int ret;
+
+	if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+		if (zds->in_needed < 8) {
+			zds->in_needed = 8;
+			return 0;
+		}
+		zds->skip = get_unaligned_le32(src + 4);
+		zds->stage = ZSTD_DS_SKIP;
+		return 0;
+	}
+
+	if (magic != ZSTD_MAGIC)
+		return -EINVAL;
+
+	needed = zstd_frame_header_size(src);
+	if (zds->in_needed < needed) {
+		zds->in_needed = needed;
+		return 0;
+	}
+
+	ret = zstd_parse_frame_header(&dctx->fh, src, needed);
+	if (ret)
+		return ret;
+	if (dctx->fh.window_size > zds->max_window)
+		return -EINVAL;
+
+	ret = zstd_begin_frame(dctx, zds->window, zds->ddict);
+	if (ret)
+		return ret;
+
+	zds->out_end = zds->flushed = 0;
+	zds->produced = 0;
+	zstd_expect(zds, ZSTD_DS_BLOCK_HEADER, ZSTD_BLOCK_HEADER_SIZE);
+	return 0;
+}
+
+static int zstd_stream_block(struct zstd_dstream *zds, const u8 *src)
+{
+	struct zstd_dctx *dctx = &zds->dctx;
+	u8 *op;
+	ssize_t n;
+
+	/* No room for another block: the window moves to the ext segment */
+	if (zds->out_end + ZSTD_BLOCKSIZE_MAX > zds->window_buf_size) {
+		dctx->ext_start = dctx->prefix_start;
+		dctx->ext_end = zds->window + zds->out_end;
+		dctx->prefix_start = zds->window;
+		zds->out_end = zds->flushed = 0;
+	}
+
+	op = zds->window + zds->out_end;
+	switch (zds->block_type) {
+	case ZSTD_BLOCK_RAW:
+		memcpy(op, src, zds->block_size);
+		n = zds->block_size;
+		break;
+	case ZSTD_BLOCK_RLE:
+		memset(op, src[0], zds->block_size);
+		n = zds->block_size;
+		break;
+	default:
+		n = zstd_decode_block(dctx, op, ZSTD_BLOCKSIZE_MAX, src,
+				      zds->block_size);
+		if (n < 0)
+			return n;
+		break;
+	}
+
+	if (dctx->fh.checksum)
+		zstd_xxh64_update(&dctx->xxh, op, n);
+	zds->out_end += n;
+	zds->produced += n;
+	zds->stage = ZSTD_DS_FLUSH;
+	return 0;
+}
+
+int zstd_decompress_stream(struct zstd_dstream *zds,
+			   struct zstd_out_buffer *out,
+			   struct zstd_in_buffer *in)
+{
+	struct zstd_dctx *dctx = &zds->dctx;
+	const u8 *src;
+	size_t n;
+	u32 bh;
+	int ret = 0;
+
+	for (;;) {
+		switch (zds->stage) {
+		case ZSTD_DS_DONE:
+			zstd_reset_dstream(zds);
+			/* fall through */
+		case ZSTD_DS_HEADER:
+			src = zstd_gather(zds, zds->hbuf, in);
+			if (!src)
+				return 1;
+			ret = zstd_stream_header(zds, src);
+			break;
+
+		case ZSTD_DS_SKIP:
+			n = min_t(size_t, zds->skip, in->size - in->pos);
+			in->pos += n;
+			zds->skip -= n;
+			if (zds->skip)
+				return 1;
+			zstd_reset_dstream(zds);
+			continue;
+
+		case ZSTD_DS_BLOCK_HEADER:
+			src = zstd_gather(zds, zds->hbuf, in);
+			if (!src)
+				return 1;
+			bh = src[0] | (src[1] << 8) | (src[2] << 16);
+			zds->last_block = bh & 1;
+			zds->block_type = (bh >> 1) & 3;
+			zds->block_size = bh >> 3;
+			if (zds->block_type == ZSTD_BLOCK_RESERVED ||
+			    zds->block_size > ZSTD_BLOCKSIZE_MAX) {
+				ret = -EINVAL;
+				break;
+			}
+			n = zds->block_type == ZSTD_BLOCK_RLE ? 1 :
+			    zds->block_size;
+			zstd_expect(zds, ZSTD_DS_BLOCK, n);
+			if (!n)
+				zds->stage = ZSTD_DS_FLUSH;
+			break;
+
+		case ZSTD_DS_BLOCK:
+			src = zstd_gather(zds, zds->inbuf, in);
+			if (!src)
+				return 1;
+			ret = zstd_stream_block(zds, src);
+			break;
+
+		case ZSTD_DS_FLUSH:
+			n = min(zds->out_end - zds->flushed,
+				out->size - out->pos);
+			memcpy((u8 *)out->dst + out->pos,
+			       zds->window + zds->flushed, n);
+			out->pos += n;
+			zds->flushed += n;
+			if (zds->flushed < zds->out_end)
+				return 1;
+
+			if (!zds->last_block) {
+				zstd_expect(zds, ZSTD_DS_BLOCK_HEADER,
+					    ZSTD_BLOCK_HEADER_SIZE);
+				break;
+			}
+
+			if (dctx->fh.content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+			    dctx->fh.content_size != zds->produced) {
+				ret = -EINVAL;
+				break;
+			}
+
+			if (!dctx->fh.checksum) {
+				zds->stage = ZSTD_DS_DONE;
+				return 0;
+			}
+			zstd_expect(zds, ZSTD_DS_CHECKSUM, ZSTD_CHECKSUM_SIZE);
+			break;
+
+		case ZSTD_DS_CHECKSUM:
+			src = zstd_gather(zds, zds->hbuf, in);
+			if (!src)
+				return 1;
+			ret = zstd_check_checksum(dctx, src);
+			if (!ret) {
+				zds->stage = ZSTD_DS_DONE;
+				return 0;
+			}
+			break;
+
+		case ZSTD_DS_ERROR:
+			return -EINVAL;
+		}
+
+		if (ret < 0) {
+			zds->stage = ZSTD_DS_ERROR;
+			return ret;
+		}
+	}
+}
+EXPORT_SYMBOL(zstd_decompress_stream);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard decompressor");
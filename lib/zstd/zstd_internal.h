@@ -0,0 +1,241 @@
+/*
+ * Definitions shared by the Zstandard compressor and decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ZSTD_INTERNAL_H__
+#define __ZSTD_INTERNAL_H__
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+
+#define ZSTD_SKIPPABLE_MAGIC	0x184D2A50
+#define ZSTD_SKIPPABLE_MASK	0xFFFFFFF0
+
+#define ZSTD_FRAME_HEADER_MAX	18
+#define ZSTD_BLOCK_HEADER_SIZE	3
+#define ZSTD_CHECKSUM_SIZE	4
+
+enum zstd_block_type {
+	ZSTD_BLOCK_RAW,
+	ZSTD_BLOCK_RLE,
+	ZSTD_BLOCK_COMPRESSED,
+	ZSTD_BLOCK_RESERVED,
+};
+
+enum zstd_literals_type {
+	ZSTD_LIT_RAW,
+	ZSTD_LIT_RLE,
+	ZSTD_LIT_COMPRESSED,
+	ZSTD_LIT_TREELESS,
+};
+
+enum zstd_seq_mode {
+	ZSTD_SEQ_PREDEFINED,
+	ZSTD_SEQ_RLE,
+	ZSTD_SEQ_COMPRESSED,
+	ZSTD_SEQ_REPEAT,
+};
+
+#define ZSTD_MINMATCH		3
+#define ZSTD_REP_NUM		3
+#define ZSTD_REP_MOVE		(ZSTD_REP_NUM - 1)
+
+#define ZSTD_LL_MAX_CODE	35
+#define ZSTD_ML_MAX_CODE	52
+#define ZSTD_OF_MAX_CODE	31
+#define ZSTD_OF_DEFAULT_MAX	28
+
+#define ZSTD_LL_MAX_LOG		9
+#define ZSTD_ML_MAX_LOG		9
+#define ZSTD_OF_MAX_LOG		8
+#define ZSTD_LL_DEFAULT_LOG	6
+#define ZSTD_ML_DEFAULT_LOG	6
+#define ZSTD_OF_DEFAULT_LOG	5
+
+#define ZSTD_FSE_MIN_LOG	5
+#define ZSTD_FSE_MAX_LOG	12
+
+#define ZSTD_HUF_MAX_BITS	11
+#define ZSTD_HUF_MAX_SYMBOLS	256
+#define ZSTD_HUF_WEIGHTS_LOG	6
+
+#define ZSTD_MAX_SEQUENCES	(ZSTD_BLOCKSIZE_MAX / 4)
+
+/* Baselines and extra bits of the literal and match length codes */
+extern const u32 zstd_ll_base[ZSTD_LL_MAX_CODE + 1];
+extern const u8 zstd_ll_bits[ZSTD_LL_MAX_CODE + 1];
+extern const u32 zstd_ml_base[ZSTD_ML_MAX_CODE + 1];
+extern const u8 zstd_ml_bits[ZSTD_ML_MAX_CODE + 1];
+
+/* Distributions of the predefined sequence modes */
+extern const s16 zstd_ll_default_norm[ZSTD_LL_MAX_CODE + 1];
+extern const s16 zstd_ml_default_norm[ZSTD_ML_MAX_CODE + 1];
+extern const s16 zstd_of_default_norm[ZSTD_OF_DEFAULT_MAX + 1];
+
+static inline unsigned int zstd_highbit(u32 v)
+{
+	return fls(v) - 1;
+}
+
+/*
+ * Backward bit stream.  Streams are written forwards, least significant
+ * bit first, and closed by a 1 bit; they are read back from the end.
+ */
+enum zstd_bitd_status {
+	ZSTD_BITD_UNFINISHED,
+	ZSTD_BITD_END,		/* no more bytes to load */
+	ZSTD_BITD_COMPLETED,	/* ... and every bit has been read */
+	ZSTD_BITD_OVERFLOW,	/* more bits were read than there are */
+};
+
+struct zstd_bitd {
+	u64 container;
+	unsigned int consumed;
+	const u8 *ptr;
+	const u8 *start;
+};
+
+static inline int zstd_bitd_init(struct zstd_bitd *bd, const u8 *src,
+				 size_t size)
+{
+	u8 last;
+	size_t i;
+
+	if (!size)
+		return -EINVAL;
+
+	last = src[size - 1];
+	if (!last)
+		return -EINVAL;
+
+	bd->start = src;
+	if (size >= sizeof(bd->container)) {
+		bd->ptr = src + size - sizeof(bd->container);
+		bd->container = get_unaligned_le64(bd->ptr);
+		bd->consumed = 8 - zstd_highbit(last);
+	} else {
+		bd->ptr = src;
+		bd->container = 0;
+		for (i = 0; i < size; i++)
+			bd->container |= (u64)src[i] << (8 * i);
+		bd->consumed = 8 - zstd_highbit(last) +
+			       (sizeof(bd->container) - size) * 8;
+	}
+
+	return 0;
+}
+
+static inline u64 zstd_bitd_look(const struct zstd_bitd *bd, unsigned int nb)
+{
+	return ((bd->container << (bd->consumed & 63)) >> 1) >> (63 - nb);
+}
+
+static inline void zstd_bitd_skip(struct zstd_bitd *bd, unsigned int nb)
+{
+	bd->consumed += nb;
+}
+
+static inline u64 zstd_bitd_read(struct zstd_bitd *bd, unsigned int nb)
+{
+	u64 v = zstd_bitd_look(bd, nb);
+
+	zstd_bitd_skip(bd, nb);
+	return v;
+}
+
+static inline enum zstd_bitd_status zstd_bitd_reload(struct zstd_bitd *bd)
+{
+	unsigned int nb;
+	enum zstd_bitd_status status = ZSTD_BITD_UNFINISHED;
+
+	if (bd->consumed > 64)
+		return ZSTD_BITD_OVERFLOW;
+
+	if (bd->ptr >= bd->start + sizeof(bd->container)) {
+		bd->ptr -= bd->consumed >> 3;
+		bd->consumed &= 7;
+		bd->container = get_unaligned_le64(bd->ptr);
+		return ZSTD_BITD_UNFINISHED;
+	}
+
+	if (bd->ptr == bd->start)
+		return bd->consumed < 64 ? ZSTD_BITD_END : ZSTD_BITD_COMPLETED;
+
+	nb = bd->consumed >> 3;
+	if (bd->ptr - nb < bd->start) {
+		nb = bd->ptr - bd->start;
+		status = ZSTD_BITD_END;
+	}
+	bd->ptr -= nb;
+	bd->consumed -= nb * 8;
+	bd->container = get_unaligned_le64(bd->ptr);
+	return status;
+}
+
+static inline bool zstd_bitd_finished(const struct zstd_bitd *bd)
+{
+	return bd->ptr == bd->start && bd->consumed == 64;
+}
+
+/* FSE decoding table, one entry per state */
+struct zstd_fse_dentry {
+	u16 base;
+	u8 symbol;
+	u8 nbits;
+};
+
+#define ZSTD_FSE_DTABLE_SIZE(log)	(1 << (log))
+
+static inline unsigned int zstd_fse_decode(const struct zstd_fse_dentry *dt,
+					   unsigned int *state,
+					   struct zstd_bitd *bd)
+{
+	const struct zstd_fse_dentry *e = &dt[*state];
+
+	*state = e->base + zstd_bitd_read(bd, e->nbits);
+	return e->symbol;
+}
+
+/* Where the pieces of a dictionary are */
+struct zstd_dict_parts {
+	u32 id;
+	const u8 *huf;
+	size_t huf_size;
+	const u8 *of, *ml, *ll;
+	size_t of_size, ml_size, ll_size;
+	u32 rep[ZSTD_REP_NUM];
+	const u8 *content;
+	size_t content_size;
+};
+
+/* Content checksum, the low 32 bits of XXH64 with seed 0 */
+struct zstd_xxh64_state {
+	u64 total_len;
+	u64 v[4];
+	u8 mem[32];
+	unsigned int mem_size;
+};
+
+int zstd_read_ncount(s16 *norm, unsigned int *max_symbol,
+		     unsigned int *table_log, const u8 *src, size_t size);
+int zstd_fse_build_dtable(struct zstd_fse_dentry *dt, const s16 *norm,
+			  unsigned int max_symbol, unsigned int table_log);
+int zstd_huf_read_weights(u8 *weights, unsigned int *nb_symbols,
+			  unsigned int *table_log, const u8 *src, size_t size);
+int zstd_parse_dict(struct zstd_dict_parts *parts, const void *dict,
+		    size_t dict_size);
+
+void zstd_xxh64_reset(struct zstd_xxh64_state *state);
+void zstd_xxh64_update(struct zstd_xxh64_state *state, const void *input,
+		       size_t len);
+u64 zstd_xxh64_digest(const struct zstd_xxh64_state *state);
+
+#endif /* __ZSTD_INTERNAL_H__ */
@@ -72,6 +72,9 @@ static struct page *follow_page_pte(struct vm_area_struct *vma,
 retry:
 	if (unlikely(pmd_bad(*pmd)))
 		return no_page_table(vma, flags);
+	/* Fault to unshare a page table before writing through it */
+	if ((flags & FOLL_WRITE) && pmd_table_shared(*pmd))
+		return no_page_table(vma, flags);
 
 	ptep = pte_offset_map_lock(mm, pmd, address, &ptl);
 	pte = *ptep;
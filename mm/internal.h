@@ -82,6 +82,15 @@ extern bool zone_reclaimable(struct zone *zone);
  */
 extern pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * in mm/mmap.c:
+ */
+extern struct srcu_struct vma_srcu;
+extern struct vm_area_struct *find_vma_srcu(struct mm_struct *mm,
+					    unsigned long addr);
+#endif
+
 /*
  * in mm/page_alloc.c
  */
@@ -175,6 +184,7 @@ struct compact_control {
 	bool ignore_skip_hint;		/* Scan blocks even if marked skip */
 	bool direct_compaction;		/* False from kcompactd or /proc/... */
 	bool whole_zone;		/* Whole zone has been scanned */
+	bool proactive_compaction;	/* kcompactd proactive compaction */
 	int order;			/* order a direct compactor needs */
 	const gfp_t gfp_mask;		/* gfp mask of a direct compactor */
 	const unsigned int alloc_flags;	/* alloc flags of a direct compactor */
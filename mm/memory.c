@@ -64,6 +64,7 @@
 #include <linux/debugfs.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/dax.h>
+#include <linux/srcu.h>
 
 #include <asm/io.h>
 #include <asm/mmu_context.h>
@@ -975,6 +976,309 @@ again:
 	return 0;
 }
 
+#ifdef CONFIG_SHARED_PTE_TABLES
+/*
+ * Lazy page table copying at fork.
+ *
+ * For an mm with MMF_SHARE_PTE_TABLES set, fork hands the child the last
+ * level page tables of private anonymous memory instead of copying them,
+ * when the vma covers the whole table.  The pmds of both mms are made
+ * read-only, so that any write through the shared table faults, and the
+ * table is refcounted in its struct page.  Before anything modifies the
+ * ptes, the mm gets its own copy of the table with unshare_pte_table(),
+ * and the last mm using the table just makes its pmd writable again.
+ *
+ * Shared tables are only ever write protected further while shared, so
+ * they need no locking against the mms walking them.  Their refcount
+ * is changed under their page table lock, which all the mms share as
+ * the lock lives in the table's struct page, and the pmd of an mm only
+ * stops pointing to a shared table under the pmd lock of that mm, which
+ * keeps the table alive for whoever looks it up under that lock.  The
+ * rss of the pages mapped by a shared table is accounted to one mm only,
+ * page->pt_rss_mm, which is NULL once that mm stopped using the table.
+ *
+ * The vmas of all the mms sharing a table are private anonymous ones,
+ * so any one of them will do for vm_normal_page() and copy_one_pte().
+ */
+static void pte_table_rss(struct vm_area_struct *vma, pmd_t *pmd,
+			  unsigned long addr, int *rss, int delta)
+{
+	unsigned long end = addr + PMD_SIZE;
+	pte_t *start_pte, *pte;
+
+	start_pte = pte = pte_offset_map(pmd, addr);
+	do {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (pte_none(ptent))
+			continue;
+		if (!pte_present(ptent)) {
+			swp_entry_t entry = pte_to_swp_entry(ptent);
+
+			if (!non_swap_entry(entry))
+				rss[MM_SWAPENTS] += delta;
+			else if (is_migration_entry(entry)) {
+				page = migration_entry_to_page(entry);
+				rss[mm_counter(page)] += delta;
+			}
+			continue;
+		}
+		page = vm_normal_page(vma, addr, ptent);
+		if (page)
+			rss[mm_counter(page)] += delta;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	pte_unmap(start_pte);
+}
+
+static bool share_pte_table(struct mm_struct *dst_mm,
+			    struct mm_struct *src_mm, pmd_t *dst_pmd,
+			    pmd_t *src_pmd, struct vm_area_struct *vma,
+			    unsigned long addr, unsigned long end)
+{
+	struct page *table;
+	spinlock_t *ptl;
+	pmd_t entry;
+
+	if (!USE_SPLIT_PTE_PTLOCKS ||
+	    !test_bit(MMF_SHARE_PTE_TABLES, &src_mm->flags))
+		return false;
+	if (vma->vm_file || !is_cow_mapping(vma->vm_flags) ||
+	    (vma->vm_flags & (VM_LOCKED | VM_UFFD_MISSING | VM_UFFD_WP)))
+		return false;
+	if ((addr & ~PMD_MASK) || end - addr != PMD_SIZE)
+		return false;
+
+	ptl = pte_lockptr(src_mm, src_pmd);
+	spin_lock(ptl);
+	table = pmd_page(*src_pmd);
+	/* a table not shared yet is accounted to its mm */
+	if (pmd_write(*src_pmd))
+		table->pt_rss_mm = src_mm;
+	page_ref_inc(table);
+	entry = pmd_wrprotect(*src_pmd);
+	set_pmd(src_pmd, entry);
+	spin_unlock(ptl);
+
+	/* dup_mmap() flushes the parent's TLB */
+	set_pmd(dst_pmd, entry);
+	atomic_long_inc(&dst_mm->nr_ptes);
+	return true;
+}
+
+/* Undo copy_one_pte() for the ptes of a copy we failed to install */
+static void release_pte_table_copy(struct vm_area_struct *vma,
+				   pgtable_t new, unsigned long addr,
+				   unsigned long end)
+{
+	pte_t *start_pte, *pte;
+
+	if (addr == end)
+		return;
+
+	start_pte = pte = (pte_t *)kmap_atomic(new) + pte_index(addr);
+	do {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (pte_none(ptent))
+			continue;
+		if (!pte_present(ptent)) {
+			swp_entry_t entry = pte_to_swp_entry(ptent);
+
+			if (!non_swap_entry(entry))
+				swap_free(entry);
+			continue;
+		}
+		page = vm_normal_page(vma, addr, ptent);
+		if (page) {
+			page_remove_rmap(page, false);
+			put_page(page);
+		}
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	kunmap_atomic(start_pte);
+}
+
+/**
+ * unshare_pte_table - give an mm its own copy of a page table shared by fork
+ * @vma: vma mapping @address
+ * @pmd: pmd mapping @address
+ * @address: address in the page table
+ *
+ * Must be called with mmap_sem held and pmd_table_shared(*@pmd) before
+ * the ptes of the table get modified.  Returns 0 or -ENOMEM.
+ */
+int unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+		      unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = address & PMD_MASK;
+	unsigned long end = start + PMD_SIZE;
+	unsigned long addr = start;
+	int rss[NR_MM_COUNTERS];
+	spinlock_t *pml, *ptl;
+	pte_t *src_pte, *dst_pte;
+	struct page *table;
+	swp_entry_t entry;
+	pmd_t orig_pmd;
+	pgtable_t new;
+	int ret = 0;
+
+	new = pte_alloc_one(mm, start);
+	if (!new)
+		return -ENOMEM;
+
+	init_rss_vec(rss);
+	pml = pmd_lock(mm, pmd);
+	orig_pmd = *pmd;
+	if (!pmd_table_shared(orig_pmd))
+		goto out_unlock_pmd;
+	table = pmd_page(orig_pmd);
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	if (page_ref_count(table) == 1) {
+		/* The other mms are gone, the table is ours alone */
+		if (table->pt_rss_mm != mm)
+			pte_table_rss(vma, pmd, start, rss, 1);
+		set_pmd(pmd, pmd_mkwrite(orig_pmd));
+		goto out_unlock;
+	}
+
+	src_pte = pte_offset_map(pmd, start);
+	dst_pte = (pte_t *)kmap_atomic(new);
+	do {
+		unsigned int i = pte_index(addr);
+
+		if (pte_none(src_pte[i]))
+			continue;
+		entry.val = copy_one_pte(mm, mm, &dst_pte[i], &src_pte[i],
+					 vma, addr, rss);
+		if (unlikely(entry.val)) {
+			/* unlike copy_pte_range(), we cannot sleep here */
+			ret = add_swap_count_continuation(entry, GFP_ATOMIC);
+			if (ret)
+				break;
+			addr -= PAGE_SIZE;
+		}
+	} while (addr += PAGE_SIZE, addr != end);
+	kunmap_atomic(dst_pte);
+	pte_unmap(src_pte);
+
+	if (ret) {
+		release_pte_table_copy(vma, new, start, addr);
+		init_rss_vec(rss);
+		goto out_unlock;
+	}
+
+	/* The pages are accounted to us already, through the shared table */
+	if (table->pt_rss_mm == mm) {
+		table->pt_rss_mm = NULL;
+		init_rss_vec(rss);
+	}
+	pmd_populate(mm, pmd, new);
+	/* Our walks must not see the table once the others may change it */
+	flush_tlb_range(vma, start, end);
+	page_ref_dec(table);
+	new = NULL;
+out_unlock:
+	spin_unlock(ptl);
+out_unlock_pmd:
+	spin_unlock(pml);
+	if (new)
+		pte_free(mm, new);
+	add_mm_rss_vec(mm, rss);
+	return ret;
+}
+
+/*
+ * Drop the reference of the mm to the shared table mapped by @pmd rather
+ * than zapping its ptes.  Returns false if the mm turned out to be the
+ * last user of the table, which is then zapped like any other.
+ */
+static bool drop_shared_pte_table(struct mmu_gather *tlb,
+				  struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	unsigned long start = addr & PMD_MASK;
+	int rss[NR_MM_COUNTERS];
+	spinlock_t *pml, *ptl;
+	struct page *table;
+	pmd_t orig_pmd;
+	bool dropped = false;
+
+	init_rss_vec(rss);
+	pml = pmd_lock(mm, pmd);
+	orig_pmd = *pmd;
+	if (!pmd_table_shared(orig_pmd))
+		goto out_unlock_pmd;
+	table = pmd_page(orig_pmd);
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	if (page_ref_count(table) == 1) {
+		if (table->pt_rss_mm != mm)
+			pte_table_rss(vma, pmd, start, rss, 1);
+		set_pmd(pmd, pmd_mkwrite(orig_pmd));
+		goto out_unlock;
+	}
+
+	if (table->pt_rss_mm == mm) {
+		pte_table_rss(vma, pmd, start, rss, -1);
+		table->pt_rss_mm = NULL;
+	}
+	pmd_clear(pmd);
+	flush_tlb_range(vma, start, start + PMD_SIZE);
+	page_ref_dec(table);
+	atomic_long_dec(&mm->nr_ptes);
+	dropped = true;
+out_unlock:
+	spin_unlock(ptl);
+out_unlock_pmd:
+	spin_unlock(pml);
+	add_mm_rss_vec(mm, rss);
+	return dropped;
+}
+
+/*
+ * Returns true if the shared table mapped by @pmd was dropped, otherwise
+ * the range is to be zapped from the table as usual.
+ */
+static bool zap_shared_pte_table(struct mmu_gather *tlb,
+				 struct vm_area_struct *vma, pmd_t *pmd,
+				 unsigned long addr, unsigned long end,
+				 struct zap_details *details)
+{
+	/*
+	 * Partially zapping the table needs a copy of it, except when the
+	 * whole mm goes away: exit, or the oom reaper which must not
+	 * allocate.  The copy can only fail for an oom victim, which is
+	 * better off losing the rest of the table than not zapping.
+	 */
+	if (end - addr != PMD_SIZE && !tlb->fullmm &&
+	    !(details && details->ignore_dirty) &&
+	    !unshare_pte_table(vma, pmd, addr))
+		return false;
+
+	return drop_shared_pte_table(tlb, vma, pmd, addr);
+}
+#else
+static inline bool share_pte_table(struct mm_struct *dst_mm,
+				   struct mm_struct *src_mm, pmd_t *dst_pmd,
+				   pmd_t *src_pmd, struct vm_area_struct *vma,
+				   unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline bool zap_shared_pte_table(struct mmu_gather *tlb,
+					struct vm_area_struct *vma, pmd_t *pmd,
+					unsigned long addr, unsigned long end,
+					struct zap_details *details)
+{
+	return false;
+}
+#endif /* CONFIG_SHARED_PTE_TABLES */
+
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -1001,6 +1305,9 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (share_pte_table(dst_mm, src_mm, dst_pmd, src_pmd,
+						vma, addr, next))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1239,6 +1546,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 */
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
+		if (pmd_table_shared(*pmd) &&
+		    zap_shared_pte_table(tlb, vma, pmd, addr, next, details))
+			goto next;
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
 next:
 		cond_resched();
@@ -1479,7 +1789,7 @@ static int insert_page(struct vm_area_struct *vma, unsigned long addr,
 	/* Ok, finally just insert the thing.. */
 	get_page(page);
 	inc_mm_counter_fast(mm, mm_counter_file(page));
-	page_add_file_rmap(page);
+	page_add_file_rmap(page, false);
 	set_pte_at(mm, addr, pte, mk_pte(page, prot));
 
 	retval = 0;
@@ -2892,7 +3202,7 @@ void do_set_pte(struct vm_area_struct *vma, unsigned long address,
 		page_add_new_anon_rmap(page, vma, address, false);
 	} else {
 		inc_mm_counter_fast(vma->vm_mm, mm_counter_file(page));
-		page_add_file_rmap(page);
+		page_add_file_rmap(page, false);
 	}
 	set_pte_at(vma->vm_mm, address, pte, entry);
 
@@ -3016,6 +3326,60 @@ static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
 	vma->vm_ops->map_pages(vma, &vmf);
 }
 
+/**
+ * map_cached_pages - map the cached pages of a file range in bulk
+ * @vma: file backed vma
+ * @start: start of the range
+ * @end: end of the range
+ *
+ * Maps the pages of the range that are up to date in the page cache with
+ * ->map_pages(), a page table at a time, like do_fault_around() does for
+ * a few pages around a fault.  Pages not cached yet are left to be
+ * faulted in.  Must be called with mmap_sem held.
+ */
+void map_cached_pages(struct vm_area_struct *vma, unsigned long start,
+		      unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr, next;
+
+	if (!vma->vm_ops || !vma->vm_ops->map_pages)
+		return;
+
+	start = max(start, vma->vm_start);
+	end = min(end, vma->vm_end);
+	for (addr = start; addr < end; addr = next) {
+		struct vm_fault vmf;
+		spinlock_t *ptl;
+		pgd_t *pgd;
+		pud_t *pud;
+		pmd_t *pmd;
+		pte_t *pte;
+
+		next = pmd_addr_end(addr, end);
+		pgd = pgd_offset(mm, addr);
+		pud = pud_alloc(mm, pgd, addr);
+		if (!pud)
+			break;
+		pmd = pmd_alloc(mm, pud, addr);
+		if (!pmd || pte_alloc(mm, pmd, addr))
+			break;
+		if (pmd_trans_unstable(pmd) || pmd_table_shared(*pmd))
+			continue;
+
+		pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+		vmf.virtual_address = (void __user *)addr;
+		vmf.pte = pte;
+		vmf.pgoff = linear_page_index(vma, addr);
+		vmf.max_pgoff = vmf.pgoff + ((next - addr) >> PAGE_SHIFT) - 1;
+		vmf.flags = 0;
+		vmf.gfp_mask = __get_fault_gfp_mask(vma);
+		vma->vm_ops->map_pages(vma, &vmf);
+		pte_unmap_unlock(pte, ptl);
+		cond_resched();
+	}
+}
+
 static int do_read_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pmd_t *pmd,
 		pgoff_t pgoff, unsigned int flags, pte_t orig_pte)
@@ -3450,7 +3814,8 @@ static int __handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+	if (pmd_none(*pmd) &&
+	    (transparent_hugepage_enabled(vma) || vma_is_shmem(vma))) {
 		int ret = create_huge_pmd(mm, vma, address, pmd, flags);
 		if (!(ret & VM_FAULT_FALLBACK))
 			return ret;
@@ -3499,6 +3864,9 @@ static int __handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	if (unlikely(pmd_trans_unstable(pmd) || pmd_devmap(*pmd)))
 		return 0;
+	if (unlikely(pmd_table_shared(*pmd)) &&
+	    unshare_pte_table(vma, pmd, address))
+		return VM_FAULT_OOM;
 	/*
 	 * A regular pmd is established and it can't morph into a huge pmd
 	 * from under us anymore at this point because we hold the mmap_sem
@@ -3554,6 +3922,221 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * Most faults of a large multithreaded process fill in anonymous pages,
+ * which needs nothing from the mmap_sem but a stable vma.
+ * handle_speculative_fault() looks the vma up under vma_srcu, which keeps
+ * unlinked vmas around, works on a copy of it, and checks vm_sequence,
+ * bumped around vma changes, before it installs the pte. Anything less
+ * common, or a vma that changed, is left to a regular fault.
+ *
+ * Nothing pins the page tables but the vma: they are walked with irqs
+ * off, as page table pages are only freed after a TLB flush IPI that
+ * this cpu has to answer, and once the pte lock is taken the zapping or
+ * collapsing of the range waits for us.
+ */
+static bool vma_has_changed(struct vm_area_struct *vma, unsigned int seq)
+{
+	/* vma_rb_erase() clears vm_rb */
+	return RB_EMPTY_NODE(&vma->vm_rb) ||
+	       read_seqcount_retry(&vma->vm_sequence, seq);
+}
+
+static pte_t *spf_pte_map_lock(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long address,
+		pmd_t *pmd, pmd_t orig_pmd, unsigned int seq,
+		spinlock_t **ptlp)
+{
+	pte_t *pte = NULL;
+	spinlock_t *ptl;
+
+	local_irq_disable();
+	if (vma_has_changed(vma, seq) || !pmd_same(READ_ONCE(*pmd), orig_pmd))
+		goto out;
+	ptl = pte_lockptr(mm, pmd);
+	/* The holder may be flushing TLBs, waiting for us to take the IPI */
+	if (!spin_trylock(ptl))
+		goto out;
+	/*
+	 * Or it may have zapped the range and dropped it already, or fork
+	 * may have shared the table, which it does under this lock
+	 */
+	if (vma_has_changed(vma, seq) || !pmd_same(*pmd, orig_pmd) ||
+	    pmd_table_shared(*pmd)) {
+		spin_unlock(ptl);
+		goto out;
+	}
+	pte = pte_offset_map(pmd, address);
+	*ptlp = ptl;
+out:
+	local_irq_enable();
+	return pte;
+}
+
+/*
+ * do_anonymous_page() on a copy of the vma, @pvma, checked against @vma
+ * under the pte lock.
+ */
+static int spf_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		struct vm_area_struct *pvma, unsigned long address,
+		pmd_t *pmd, pmd_t orig_pmd, unsigned int seq,
+		unsigned int flags)
+{
+	struct mem_cgroup *memcg;
+	struct page *page = NULL;
+	spinlock_t *ptl;
+	pte_t *page_table;
+	pte_t entry;
+
+	if (!(flags & FAULT_FLAG_WRITE) && !mm_forbids_zeropage(mm)) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						pvma->vm_page_prot));
+	} else {
+		/* Leave the memcg OOM handling to the regular fault */
+		page = alloc_zeroed_user_highpage_movable(pvma, address);
+		if (!page)
+			return VM_FAULT_RETRY;
+		if (mem_cgroup_try_charge(page, mm, GFP_KERNEL, &memcg, false)) {
+			put_page(page);
+			return VM_FAULT_RETRY;
+		}
+		__SetPageUptodate(page);
+
+		entry = mk_pte(page, pvma->vm_page_prot);
+		if (pvma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	}
+
+	page_table = spf_pte_map_lock(mm, vma, address, pmd, orig_pmd, seq,
+				      &ptl);
+	if (!page_table) {
+		if (page) {
+			mem_cgroup_cancel_charge(page, memcg, false);
+			put_page(page);
+		}
+		return VM_FAULT_RETRY;
+	}
+	if (!pte_none(*page_table))
+		goto release;
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, pvma, address, false);
+		mem_cgroup_commit_charge(page, memcg, false, false);
+		lru_cache_add_active_or_unevictable(page, pvma);
+	}
+	set_pte_at(mm, address, page_table, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(pvma, address, page_table);
+	pte_unmap_unlock(page_table, ptl);
+	return 0;
+release:
+	pte_unmap_unlock(page_table, ptl);
+	if (page) {
+		mem_cgroup_cancel_charge(page, memcg, false);
+		put_page(page);
+	}
+	return 0;
+}
+
+/**
+ * handle_speculative_fault - handle a fault without the mmap_sem
+ * @mm: the faulting mm, current's
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx
+ *
+ * Handles not present faults on anonymous memory. Returns VM_FAULT_RETRY
+ * when the caller has to take the mmap_sem and go through
+ * handle_mm_fault(), including for errors, 0 when the fault was handled.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma, pvma;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, orig_pmd;
+	pte_t *pte, entry;
+	unsigned int seq;
+	int idx, ret = VM_FAULT_RETRY;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	idx = srcu_read_lock(&vma_srcu);
+	vma = find_vma_srcu(mm, address);
+	if (!vma)
+		goto out;
+	seq = raw_read_seqcount(&vma->vm_sequence);
+	if (seq & 1)
+		goto out;
+	pvma = *vma;
+	if (vma_has_changed(vma, seq))
+		goto out;
+
+	if (address < pvma.vm_start || address >= pvma.vm_end)
+		goto out;
+	if (!vma_is_anonymous(&pvma) || !pvma.anon_vma || vma_policy(&pvma))
+		goto out;
+	if (pvma.vm_flags & (VM_SHARED | VM_GROWSDOWN | VM_GROWSUP |
+			     VM_PFNMAP | VM_MIXEDMAP | VM_UFFD_MISSING))
+		goto out;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(pvma.vm_flags & VM_WRITE))
+			goto out;
+	} else if (!(pvma.vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out;
+	if (!arch_vma_access_permitted(&pvma, flags & FAULT_FLAG_WRITE,
+				       flags & FAULT_FLAG_INSTRUCTION,
+				       flags & FAULT_FLAG_REMOTE))
+		goto out;
+
+	/* Page table and huge page allocations are left to the locked path */
+	local_irq_disable();
+	if (vma_has_changed(vma, seq))
+		goto out_walk;
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+	pmd = pmd_offset(pud, address);
+	orig_pmd = READ_ONCE(*pmd);
+	if (pmd_none(orig_pmd) || pmd_trans_huge(orig_pmd) ||
+	    pmd_devmap(orig_pmd) || unlikely(pmd_bad(orig_pmd)))
+		goto out_walk;
+	/* Tables shared by fork are unshared by the regular fault */
+	if (pmd_table_shared(orig_pmd))
+		goto out_walk;
+	pte = pte_offset_map(&orig_pmd, address);
+	entry = READ_ONCE(*pte);
+	pte_unmap(pte);
+	local_irq_enable();
+
+	if (!pte_none(entry))
+		goto out;
+
+	ret = spf_anonymous_page(mm, vma, &pvma, address, pmd, orig_pmd,
+				 seq, flags);
+	if (ret != VM_FAULT_RETRY) {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPECULATIVE_PGFAULT);
+		mem_cgroup_count_vm_event(mm, PGFAULT);
+	}
+out:
+	srcu_read_unlock(&vma_srcu, idx);
+	return ret;
+out_walk:
+	local_irq_enable();
+	goto out;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -367,6 +367,12 @@ void *vzalloc_node(unsigned long size, int node)
 }
 EXPORT_SYMBOL(vzalloc_node);
 
+void *vzalloc_interleave(unsigned long size)
+{
+	return vzalloc(size);
+}
+EXPORT_SYMBOL(vzalloc_interleave);
+
 #ifndef PAGE_KERNEL_EXEC
 # define PAGE_KERNEL_EXEC PAGE_KERNEL
 #endif
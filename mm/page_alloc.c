@@ -68,6 +68,7 @@
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
 #include "internal.h"
+#include "page_reporting.h"
 
 /* prevent >1 _updater_ of zone percpu pageset ->high and ->batch fields */
 static DEFINE_MUTEX(pcp_batch_high_lock);
@@ -179,6 +180,9 @@ unsigned int pageblock_order __read_mostly;
 #endif
 
 static void __free_pages_ok(struct page *page, unsigned int order);
+static void __free_hot_cold_page(struct page *page, unsigned int order,
+				 bool cold);
+static inline bool pcp_allowed_order(unsigned int order);
 
 /*
  * results with 256, 32 in the lowmem_reserve sysctl:
@@ -576,7 +580,12 @@ out:
 
 void free_compound_page(struct page *page)
 {
-	__free_pages_ok(page, compound_order(page));
+	unsigned int order = compound_order(page);
+
+	if (pcp_allowed_order(order))
+		__free_hot_cold_page(page, order, false);
+	else
+		__free_pages_ok(page, order);
 }
 
 void prep_compound_page(struct page *page, unsigned int order)
@@ -702,6 +711,7 @@ static inline void set_page_order(struct page *page, unsigned int order)
 static inline void rmv_page_order(struct page *page)
 {
 	__ClearPageBuddy(page);
+	__ClearPageReported(page);
 	set_page_private(page, 0);
 }
 
@@ -779,7 +789,7 @@ static inline int page_is_buddy(struct page *page, struct page *buddy,
 static inline void __free_one_page(struct page *page,
 		unsigned long pfn,
 		struct zone *zone, unsigned int order,
-		int migratetype)
+		int migratetype, bool report)
 {
 	unsigned long page_idx;
 	unsigned long combined_idx;
@@ -875,8 +885,37 @@ done_merging:
 	list_add(&page->lru, &zone->free_area[order].free_list[migratetype]);
 out:
 	zone->free_area[order].nr_free++;
+	if (report)
+		page_reporting_notify_free(order);
 }
 
+#ifdef CONFIG_PAGE_REPORTING
+/*
+ * Take a free page off its free list while it is being reported.  Unlike
+ * __isolate_free_page() this leaves page owner and the pageblock's
+ * migratetype alone, as the page goes straight back afterwards.  Called
+ * with zone->lock held.
+ */
+void __page_reporting_isolate(struct page *page, unsigned int order, int mt)
+{
+	struct zone *zone = page_zone(page);
+
+	list_del(&page->lru);
+	zone->free_area[order].nr_free--;
+	rmv_page_order(page);
+	__mod_zone_freepage_state(zone, -(1 << order), mt);
+}
+
+/* Undo __page_reporting_isolate(), zone->lock held */
+void __page_reporting_putback(struct page *page, unsigned int order)
+{
+	unsigned long pfn = page_to_pfn(page);
+
+	__free_one_page(page, pfn, page_zone(page), order,
+			get_pfnblock_migratetype(page, pfn), false);
+}
+#endif
+
 /*
  * A bad page could be due to a number of fields. Instead of multiple branches,
  * try and check multiple fields with one check. The caller must do a detailed
@@ -1040,9 +1079,9 @@ static __always_inline bool free_pages_prepare(struct page *page,
 }
 
 #ifdef CONFIG_DEBUG_VM
-static inline bool free_pcp_prepare(struct page *page)
+static inline bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, true);
+	return free_pages_prepare(page, order, true);
 }
 
 static inline bool bulkfree_pcp_prepare(struct page *page)
@@ -1050,9 +1089,9 @@ static inline bool bulkfree_pcp_prepare(struct page *page)
 	return false;
 }
 #else
-static bool free_pcp_prepare(struct page *page)
+static bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, false);
+	return free_pages_prepare(page, order, false);
 }
 
 static bool bulkfree_pcp_prepare(struct page *page)
@@ -1061,10 +1100,25 @@ static bool bulkfree_pcp_prepare(struct page *page)
 }
 #endif /* CONFIG_DEBUG_VM */
 
+static inline unsigned int order_to_pindex(int migratetype, unsigned int order)
+{
+	return MIGRATE_PCPTYPES * order + migratetype;
+}
+
+static inline unsigned int pindex_to_order(unsigned int pindex)
+{
+	return pindex / MIGRATE_PCPTYPES;
+}
+
+static inline bool pcp_allowed_order(unsigned int order)
+{
+	return order <= PAGE_ALLOC_COSTLY_ORDER;
+}
+
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * Assumes all pages on list are in same zone, and of the order of the list.
+ * count is the number of base pages to free, pcp->count is updated here.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -1075,20 +1129,27 @@ static bool bulkfree_pcp_prepare(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	int pindex = 0;
 	int batch_free = 0;
 	unsigned long nr_scanned;
 	bool isolated_pageblocks;
 
+	/* callers may ask for more than is left on the lists */
+	count = min(pcp->count, count);
+	if (count <= 0)
+		return;
+	pcp->drains++;
+
 	spin_lock(&zone->lock);
 	isolated_pageblocks = has_isolate_pageblock(zone);
 	nr_scanned = zone_page_state(zone, NR_PAGES_SCANNED);
 	if (nr_scanned)
 		__mod_zone_page_state(zone, NR_PAGES_SCANNED, -nr_scanned);
 
-	while (count) {
+	while (count > 0) {
 		struct page *page;
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -1099,21 +1160,25 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = count;
 
+		order = pindex_to_order(pindex);
 		do {
 			int mt;	/* migratetype of the to-be-freed page */
 
 			page = list_last_entry(list, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
+			pcp->count -= 1 << order;
+			count -= 1 << order;
+			batch_free--;
 
 			mt = get_pcppage_migratetype(page);
 			/* MIGRATE_ISOLATE page should not go to pcplists */
@@ -1125,9 +1190,10 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			if (bulkfree_pcp_prepare(page))
 				continue;
 
-			__free_one_page(page, page_to_pfn(page), zone, 0, mt);
-			trace_mm_page_pcpu_drain(page, 0, mt);
-		} while (--count && --batch_free && !list_empty(list));
+			__free_one_page(page, page_to_pfn(page), zone, order, mt,
+					true);
+			trace_mm_page_pcpu_drain(page, order, mt);
+		} while (count > 0 && batch_free > 0 && !list_empty(list));
 	}
 	spin_unlock(&zone->lock);
 }
@@ -1147,7 +1213,7 @@ static void free_one_page(struct zone *zone,
 		is_migrate_isolate(migratetype))) {
 		migratetype = get_pfnblock_migratetype(page, pfn);
 	}
-	__free_one_page(page, pfn, zone, order, migratetype);
+	__free_one_page(page, pfn, zone, order, migratetype, true);
 	spin_unlock(&zone->lock);
 }
 
@@ -1390,8 +1456,77 @@ void clear_zone_contiguous(struct zone *zone)
 }
 
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
-static void __init deferred_free_range(struct page *page,
-					unsigned long pfn, int nr_pages)
+/*
+ * Pages freed by a deferred init thread are handed to the buddy allocator
+ * in batches, so that the zone lock is taken once per batch rather than
+ * once per block when all CPUs of a node are freeing into the same zone.
+ */
+#define DEFERRED_FREE_BATCH	32
+
+struct deferred_free_batch {
+	struct zone *zone;
+	unsigned long nr_managed;
+	int nr;
+	struct page *pages[DEFERRED_FREE_BATCH];
+	unsigned int orders[DEFERRED_FREE_BATCH];
+};
+
+static void __init deferred_free_flush(struct deferred_free_batch *batch)
+{
+	struct zone *zone = batch->zone;
+	unsigned long nr_freed = 0;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (i = 0; i < batch->nr; i++) {
+		struct page *page = batch->pages[i];
+		unsigned long pfn = page_to_pfn(page);
+
+		__free_one_page(page, pfn, zone, batch->orders[i],
+				get_pfnblock_migratetype(page, pfn), true);
+		nr_freed += 1UL << batch->orders[i];
+	}
+	__count_vm_events(PGFREE, nr_freed);
+	spin_unlock_irqrestore(&zone->lock, flags);
+	batch->nr = 0;
+
+	/* Other threads of the node are freeing into the same zone */
+	spin_lock(&managed_page_count_lock);
+	zone->managed_pages += batch->nr_managed;
+	spin_unlock(&managed_page_count_lock);
+	batch->nr_managed = 0;
+}
+
+static void __init deferred_free_page(struct deferred_free_batch *batch,
+				      struct page *page, unsigned int order)
+{
+	unsigned int nr_pages = 1 << order;
+	struct page *p = page;
+	unsigned int loop;
+
+	prefetchw(p);
+	for (loop = 0; loop < (nr_pages - 1); loop++, p++) {
+		prefetchw(p + 1);
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	}
+	__ClearPageReserved(p);
+	set_page_count(p, 0);
+
+	batch->nr_managed += nr_pages;
+	if (!free_pages_prepare(page, order, true))
+		return;
+
+	batch->pages[batch->nr] = page;
+	batch->orders[batch->nr] = order;
+	if (++batch->nr == DEFERRED_FREE_BATCH)
+		deferred_free_flush(batch);
+}
+
+static void __init deferred_free_range(struct deferred_free_batch *batch,
+				       struct page *page, unsigned long pfn,
+				       int nr_pages)
 {
 	int i;
 
@@ -1402,12 +1537,12 @@ static void __init deferred_free_range(struct page *page,
 	if (nr_pages == MAX_ORDER_NR_PAGES &&
 	    (pfn & (MAX_ORDER_NR_PAGES-1)) == 0) {
 		set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-		__free_pages_boot_core(page, MAX_ORDER-1);
+		deferred_free_page(batch, page, MAX_ORDER-1);
 		return;
 	}
 
 	for (i = 0; i < nr_pages; i++, page++)
-		__free_pages_boot_core(page, 0);
+		deferred_free_page(batch, page, 0);
 }
 
 /* Completion tracking for deferred_init_memmap() threads */
@@ -1420,56 +1555,47 @@ static inline void __init pgdat_init_report_one_done(void)
 		complete(&pgdat_init_all_done_comp);
 }
 
-/* Initialise remaining memory on a node */
-static int __init deferred_init_memmap(void *data)
-{
-	pg_data_t *pgdat = data;
-	int nid = pgdat->node_id;
-	struct mminit_pfnnid_cache nid_init_state = { };
-	unsigned long start = jiffies;
-	unsigned long nr_pages = 0;
-	unsigned long walk_start, walk_end;
-	int i, zid;
+/*
+ * The deferred range of a node is split into chunks aligned to MAX_ORDER
+ * blocks, which the threads of the node take in turn.  Chunks never share
+ * a block, so a thread only merges buddies it initialised itself.
+ */
+struct deferred_init_job {
 	struct zone *zone;
-	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
-	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-
-	if (first_init_pfn == ULONG_MAX) {
-		pgdat_init_report_one_done();
-		return 0;
-	}
-
-	/* Bind memory initialisation thread to a local node if possible */
-	if (!cpumask_empty(cpumask))
-		set_cpus_allowed_ptr(current, cpumask);
-
-	/* Sanity check boundaries */
-	BUG_ON(pgdat->first_deferred_pfn < pgdat->node_start_pfn);
-	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
-	pgdat->first_deferred_pfn = ULONG_MAX;
+	int zid;
+	int nid;
+	unsigned long start_pfn;
+	unsigned long end_pfn;
+	unsigned long chunk;
+	atomic_long_t next_pfn;
+	atomic_long_t nr_pages;
+	atomic_t nr_running;
+	struct completion done;
+};
 
-	/* Only the highest zone is deferred so find it */
-	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
-		zone = pgdat->node_zones + zid;
-		if (first_init_pfn < zone_end_pfn(zone))
-			break;
-	}
+/* Initialise and free the pages of [start_pfn, end_pfn) on the node */
+static unsigned long __init
+deferred_init_range(struct deferred_init_job *job, unsigned long start_pfn,
+		    unsigned long end_pfn, struct mminit_pfnnid_cache *state,
+		    struct deferred_free_batch *batch)
+{
+	struct zone *zone = job->zone;
+	int nid = job->nid, zid = job->zid;
+	unsigned long walk_start, walk_end;
+	unsigned long nr_pages = 0;
+	int i;
 
 	for_each_mem_pfn_range(i, nid, &walk_start, &walk_end, NULL) {
-		unsigned long pfn, end_pfn;
+		unsigned long pfn, end;
 		struct page *page = NULL;
 		struct page *free_base_page = NULL;
 		unsigned long free_base_pfn = 0;
 		int nr_to_free = 0;
 
-		end_pfn = min(walk_end, zone_end_pfn(zone));
-		pfn = first_init_pfn;
-		if (pfn < walk_start)
-			pfn = walk_start;
-		if (pfn < zone->zone_start_pfn)
-			pfn = zone->zone_start_pfn;
+		pfn = max(start_pfn, walk_start);
+		end = min(end_pfn, walk_end);
 
-		for (; pfn < end_pfn; pfn++) {
+		for (; pfn < end; pfn++) {
 			if (!pfn_valid_within(pfn))
 				goto free_range;
 
@@ -1484,7 +1610,7 @@ static int __init deferred_init_memmap(void *data)
 				}
 			}
 
-			if (!meminit_pfn_in_nid(pfn, nid, &nid_init_state)) {
+			if (!meminit_pfn_in_nid(pfn, nid, state)) {
 				page = NULL;
 				goto free_range;
 			}
@@ -1494,7 +1620,7 @@ static int __init deferred_init_memmap(void *data)
 				page++;
 			} else {
 				nr_pages += nr_to_free;
-				deferred_free_range(free_base_page,
+				deferred_free_range(batch, free_base_page,
 						free_base_pfn, nr_to_free);
 				free_base_page = NULL;
 				free_base_pfn = nr_to_free = 0;
@@ -1521,20 +1647,145 @@ static int __init deferred_init_memmap(void *data)
 free_range:
 			/* Free the current block of pages to allocator */
 			nr_pages += nr_to_free;
-			deferred_free_range(free_base_page, free_base_pfn,
-								nr_to_free);
+			deferred_free_range(batch, free_base_page,
+					    free_base_pfn, nr_to_free);
 			free_base_page = NULL;
 			free_base_pfn = nr_to_free = 0;
 		}
 
-		first_init_pfn = max(end_pfn, first_init_pfn);
+		nr_pages += nr_to_free;
+		deferred_free_range(batch, free_base_page, free_base_pfn,
+				    nr_to_free);
+	}
+
+	return nr_pages;
+}
+
+static void __init deferred_init_chunks(struct deferred_init_job *job)
+{
+	struct mminit_pfnnid_cache nid_init_state = { };
+	struct deferred_free_batch batch = { .zone = job->zone };
+	unsigned long start, nr_pages = 0;
+
+	for (;;) {
+		start = atomic_long_add_return(job->chunk, &job->next_pfn) -
+								job->chunk;
+		if (start >= job->end_pfn)
+			break;
+
+		nr_pages += deferred_init_range(job,
+				max(start, job->start_pfn),
+				min(start + job->chunk, job->end_pfn),
+				&nid_init_state, &batch);
+	}
+	deferred_free_flush(&batch);
+
+	atomic_long_add(nr_pages, &job->nr_pages);
+}
+
+static void __init deferred_init_job_done(struct deferred_init_job *job)
+{
+	if (atomic_dec_and_test(&job->nr_running))
+		complete(&job->done);
+}
+
+static int __init deferred_init_helper(void *data)
+{
+	struct deferred_init_job *job = data;
+
+	deferred_init_chunks(job);
+	deferred_init_job_done(job);
+	return 0;
+}
+
+/* Start a helper on every CPU of the node but one, which the caller uses */
+static void __init deferred_init_start_helpers(struct deferred_init_job *job,
+					       const struct cpumask *cpumask)
+{
+	struct task_struct *tsk;
+	bool first = true;
+	int cpu;
+
+	for_each_cpu_and(cpu, cpumask, cpu_online_mask) {
+		if (first) {
+			first = false;
+			continue;
+		}
+
+		tsk = kthread_create_on_node(deferred_init_helper, job,
+					     job->nid, "pgdatinit%d/%d",
+					     job->nid, cpu);
+		if (IS_ERR(tsk))
+			break;
+
+		kthread_bind(tsk, cpu);
+		atomic_inc(&job->nr_running);
+		wake_up_process(tsk);
 	}
+}
+
+/* Initialise remaining memory on a node */
+static int __init deferred_init_memmap(void *data)
+{
+	pg_data_t *pgdat = data;
+	int nid = pgdat->node_id;
+	struct deferred_init_job job;
+	unsigned long start = jiffies;
+	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
+	unsigned long nr_threads;
+	int zid;
+	struct zone *zone;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (first_init_pfn == ULONG_MAX) {
+		pgdat_init_report_one_done();
+		return 0;
+	}
+
+	/* Bind memory initialisation thread to a local node if possible */
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	/* Sanity check boundaries */
+	BUG_ON(pgdat->first_deferred_pfn < pgdat->node_start_pfn);
+	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
+	pgdat->first_deferred_pfn = ULONG_MAX;
+
+	/* Only the highest zone is deferred so find it */
+	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+		zone = pgdat->node_zones + zid;
+		if (first_init_pfn < zone_end_pfn(zone))
+			break;
+	}
+
+	job.zone = zone;
+	job.zid = zid;
+	job.nid = nid;
+	job.start_pfn = max(first_init_pfn, zone->zone_start_pfn);
+	job.end_pfn = zone_end_pfn(zone);
+	atomic_long_set(&job.next_pfn,
+			round_down(job.start_pfn, MAX_ORDER_NR_PAGES));
+	atomic_long_set(&job.nr_pages, 0);
+	atomic_set(&job.nr_running, 1);
+	init_completion(&job.done);
+
+	/* A few chunks per thread to even out holes and slower CPUs */
+	nr_threads = max(cpumask_weight(cpumask), 1U);
+	job.chunk = DIV_ROUND_UP(job.end_pfn - job.start_pfn, nr_threads * 4);
+	job.chunk = max_t(unsigned long, ALIGN(job.chunk, MAX_ORDER_NR_PAGES),
+			  MAX_ORDER_NR_PAGES);
+
+	deferred_init_start_helpers(&job, cpumask);
+	deferred_init_chunks(&job);
+	deferred_init_job_done(&job);
+	wait_for_completion(&job.done);
 
 	/* Sanity check that the next zone really is unpopulated */
 	WARN_ON(++zid < MAX_NR_ZONES && populated_zone(++zone));
 
-	pr_info("node %d initialised, %lu pages in %ums\n", nid, nr_pages,
-					jiffies_to_msecs(jiffies - start));
+	pr_info("node %d initialised, %lu pages in %ums\n", nid,
+		atomic_long_read(&job.nr_pages),
+		jiffies_to_msecs(jiffies - start));
 
 	pgdat_init_report_one_done();
 	return 0;
@@ -1688,22 +1939,24 @@ static inline bool free_pages_prezeroed(bool poisoned)
 		page_poisoning_enabled() && poisoned;
 }
 
+static bool check_new_pages(struct page *page, unsigned int order);
+
 #ifdef CONFIG_DEBUG_VM
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
 	return false;
 }
 
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
 #else
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
 	return false;
 }
@@ -2182,7 +2435,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 		if (unlikely(page == NULL))
 			break;
 
-		if (unlikely(check_pcp_refill(page)))
+		if (unlikely(check_pcp_refill(page, order)))
 			continue;
 
 		/*
@@ -2225,14 +2478,35 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	local_irq_save(flags);
 	batch = READ_ONCE(pcp->batch);
 	to_drain = min(pcp->count, batch);
-	if (to_drain > 0) {
+	if (to_drain > 0)
 		free_pcppages_bulk(zone, to_drain, pcp);
-		pcp->count -= to_drain;
-	}
 	local_irq_restore(flags);
 }
 #endif
 
+/*
+ * Called from the vmstat counter updater: let pcp->high, raised by
+ * free_hot_cold_page() while this cpu was cycling pages through its
+ * lists, decay back towards pcp->high_min and give back what no longer
+ * fits.
+ */
+void decay_pcp_high(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	unsigned long flags;
+	int high, high_min;
+
+	local_irq_save(flags);
+	high = pcp->high;
+	high_min = READ_ONCE(pcp->high_min);
+	if (high > high_min) {
+		high = max(high - max(high >> 3, 1), high_min);
+		pcp->high = high;
+	}
+	if (pcp->count > high)
+		free_pcppages_bulk(zone, pcp->count - high, pcp);
+	local_irq_restore(flags);
+}
+
 /*
  * Drain pcplists of the indicated processor and zone.
  *
@@ -2250,10 +2524,8 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 	pset = per_cpu_ptr(zone->pageset, cpu);
 
 	pcp = &pset->pcp;
-	if (pcp->count) {
+	if (pcp->count)
 		free_pcppages_bulk(zone, pcp->count, pcp);
-		pcp->count = 0;
-	}
 	local_irq_restore(flags);
 }
 
@@ -2385,24 +2657,50 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Number of pages to give back to the buddy lists once pcp->high is hit.
+ * Every drain that is not followed by an allocation doubles it, as the
+ * cpu is obviously freeing more than it allocates, but at least batch
+ * pages are kept around for the next allocations.
+ */
+static int nr_pcp_free(struct per_cpu_pages *pcp, int high, int batch)
+{
+	int min_nr_free, max_nr_free;
+
+	/* boot pageset or pcp lists disabled */
+	if (unlikely(high < batch))
+		return 1;
+
+	min_nr_free = batch;
+	max_nr_free = max(high - batch, min_nr_free);
+
+	batch <<= pcp->free_factor;
+	if (batch < max_nr_free)
+		pcp->free_factor++;
+
+	return clamp(batch, min_nr_free, max_nr_free);
+}
+
+/*
+ * Free a page of up to PAGE_ALLOC_COSTLY_ORDER to the pcp lists
  * cold == true ? free a cold page : free a hot page
  */
-void free_hot_cold_page(struct page *page, bool cold)
+static void __free_hot_cold_page(struct page *page, unsigned int order,
+				 bool cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
+	struct list_head *list;
 	unsigned long flags;
 	unsigned long pfn = page_to_pfn(page);
 	int migratetype;
 
-	if (!free_pcp_prepare(page))
+	if (!free_pcp_prepare(page, order))
 		return;
 
 	migratetype = get_pfnblock_migratetype(page, pfn);
 	set_pcppage_migratetype(page, migratetype);
 	local_irq_save(flags);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -2413,28 +2711,52 @@ void free_hot_cold_page(struct page *page, bool cold)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(is_migrate_isolate(migratetype))) {
-			free_one_page(zone, page, pfn, 0, migratetype);
+			free_one_page(zone, page, pfn, order, migratetype);
 			goto out;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
 
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[order_to_pindex(migratetype, order)];
 	if (!cold)
-		list_add(&page->lru, &pcp->lists[migratetype]);
+		list_add(&page->lru, list);
 	else
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
+		list_add_tail(&page->lru, list);
+	pcp->count += 1 << order;
 	if (pcp->count >= pcp->high) {
-		unsigned long batch = READ_ONCE(pcp->batch);
-		free_pcppages_bulk(zone, batch, pcp);
-		pcp->count -= batch;
+		int batch = READ_ONCE(pcp->batch);
+
+		/*
+		 * The lists had to be refilled since they were last drained:
+		 * this cpu keeps cycling pages through them, let it cache
+		 * more before going back to zone->lock, up to high_max.
+		 * decay_pcp_high() takes it back once the cpu calms down.
+		 */
+		if (pcp->flags & PCPF_REFILLED) {
+			pcp->flags &= ~PCPF_REFILLED;
+			pcp->high = min(pcp->high + batch,
+					READ_ONCE(pcp->high_max));
+		}
+		if (pcp->count >= pcp->high)
+			free_pcppages_bulk(zone,
+					   nr_pcp_free(pcp, pcp->high, batch),
+					   pcp);
 	}
 
 out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == true ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, bool cold)
+{
+	__free_hot_cold_page(page, 0, cold);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -2583,7 +2905,9 @@ static inline void zone_statistics(struct zone *preferred_zone, struct zone *z,
 }
 
 /*
- * Allocate a page from the given zone. Use pcplists for order-0 allocations.
+ * Allocate a page from the given zone. Use pcplists for allocations up to
+ * PAGE_ALLOC_COSTLY_ORDER, except high-order atomic ones that may have to
+ * dip into the highatomic reserve.
  */
 static inline
 struct page *buffered_rmqueue(struct zone *preferred_zone,
@@ -2595,20 +2919,37 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	bool cold = ((gfp_flags & __GFP_COLD) != 0);
 
-	if (likely(order == 0)) {
+	/*
+	 * We most definitely don't want callers attempting to
+	 * allocate greater than order-1 page units with __GFP_NOFAIL.
+	 */
+	WARN_ON_ONCE((gfp_flags & __GFP_NOFAIL) && (order > 1));
+
+	if (likely(pcp_allowed_order(order)) &&
+	    (!order || !(alloc_flags & ALLOC_HARDER))) {
 		struct per_cpu_pages *pcp;
 		struct list_head *list;
 
 		local_irq_save(flags);
 		do {
 			pcp = &this_cpu_ptr(zone->pageset)->pcp;
-			list = &pcp->lists[migratetype];
+			list = &pcp->lists[order_to_pindex(migratetype, order)];
 			if (list_empty(list)) {
-				pcp->count += rmqueue_bulk(zone, 0,
-						pcp->batch, list,
-						migratetype, cold);
+				int batch = READ_ONCE(pcp->batch);
+
+				/*
+				 * Scale the batch down for high orders so a
+				 * refill moves about as many pages, but take
+				 * at least two to amortise zone->lock.
+				 */
+				if (order)
+					batch = max(batch >> order, 2);
+				pcp->count += rmqueue_bulk(zone, order, batch,
+						list, migratetype, cold) << order;
 				if (unlikely(list_empty(list)))
 					goto failed;
+				pcp->flags |= PCPF_REFILLED;
+				pcp->refills++;
 			}
 
 			if (cold)
@@ -2616,17 +2957,15 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 			else
 				page = list_first_entry(list, struct page, lru);
 
-			__dec_zone_state(zone, NR_ALLOC_BATCH);
+			__mod_zone_page_state(zone, NR_ALLOC_BATCH,
+					      -(1 << order));
 			list_del(&page->lru);
-			pcp->count--;
+			pcp->count -= 1 << order;
 
-		} while (check_new_pcp(page));
+		} while (check_new_pcp(page, order));
+		/* the cpu allocates again, stop growing the drains */
+		pcp->free_factor >>= 1;
 	} else {
-		/*
-		 * We most definitely don't want callers attempting to
-		 * allocate greater than order-1 page units with __GFP_NOFAIL.
-		 */
-		WARN_ON_ONCE((gfp_flags & __GFP_NOFAIL) && (order > 1));
 		spin_lock_irqsave(&zone->lock, flags);
 
 		do {
@@ -3904,8 +4243,8 @@ EXPORT_SYMBOL(get_zeroed_page);
 void __free_pages(struct page *page, unsigned int order)
 {
 	if (put_page_testzero(page)) {
-		if (order == 0)
-			free_hot_cold_page(page, false);
+		if (pcp_allowed_order(order))
+			__free_hot_cold_page(page, order, false);
 		else
 			__free_pages_ok(page, order);
 	}
@@ -5312,6 +5651,8 @@ static void pageset_update(struct per_cpu_pages *pcp, unsigned long high,
 
        /* Update high, then batch, in order */
 	pcp->high = high;
+	pcp->high_min = high;
+	pcp->high_max = high;
 	smp_wmb();
 
 	pcp->batch = batch;
@@ -5326,14 +5667,14 @@ static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
@@ -5356,15 +5697,62 @@ static void pageset_set_high(struct per_cpu_pageset *p,
 	pageset_update(&p->pcp, high, batch);
 }
 
+/*
+ * How far pcp->high may grow for a cpu that keeps cycling pages through
+ * its lists: its share of the zone's low watermark among the cpus of the
+ * node, so the pcp lists of the node cannot hold the zone below it all
+ * by themselves.
+ */
+static int zone_pcp_high_max(struct zone *zone, int high)
+{
+	unsigned long share;
+	int nr_cpus;
+
+	nr_cpus = cpumask_weight(cpumask_of_node(zone_to_nid(zone)));
+	if (!nr_cpus)
+		nr_cpus = num_online_cpus();
+	share = low_wmark_pages(zone) / nr_cpus;
+
+	return max_t(unsigned long, high, min_t(unsigned long, share, INT_MAX));
+}
+
 static void pageset_set_high_and_batch(struct zone *zone,
 				       struct per_cpu_pageset *pcp)
 {
+	/* an explicit percpu_pagelist_fraction is not scaled */
 	if (percpu_pagelist_fraction)
 		pageset_set_high(pcp,
 			(zone->managed_pages /
 				percpu_pagelist_fraction));
-	else
+	else {
 		pageset_set_batch(pcp, zone_batchsize(zone));
+		pcp->pcp.high_max = zone_pcp_high_max(zone, pcp->pcp.high_min);
+	}
+}
+
+/*
+ * The watermarks changed: recompute how far the pcp lists may grow.
+ */
+static void setup_per_zone_pcp_high_max(void)
+{
+	struct zone *zone;
+	int cpu;
+
+	mutex_lock(&pcp_batch_high_lock);
+	if (percpu_pagelist_fraction)
+		goto out;
+
+	for_each_populated_zone(zone) {
+		for_each_possible_cpu(cpu) {
+			struct per_cpu_pages *pcp;
+
+			pcp = &per_cpu_ptr(zone->pageset, cpu)->pcp;
+			WRITE_ONCE(pcp->high_max,
+				   zone_pcp_high_max(zone, pcp->high_min));
+		}
+	}
+out:
+	mutex_unlock(&pcp_batch_high_lock);
 }
 
 static void __meminit zone_pageset_init(struct zone *zone, int cpu)
@@ -5950,6 +6338,8 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat)
 	init_waitqueue_head(&pgdat->kcompactd_wait);
 #endif
 	pgdat_page_ext_init(pgdat);
+	spin_lock_init(&pgdat->lru_lock);
+	lruvec_init(&pgdat->lruvec);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
 		struct zone *zone = pgdat->node_zones + j;
@@ -6005,7 +6395,6 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat)
 #endif
 		zone->name = zone_names[j];
 		spin_lock_init(&zone->lock);
-		spin_lock_init(&zone->lru_lock);
 		zone_seqlock_init(zone);
 		zone->zone_pgdat = pgdat;
 		zone_pcp_init(zone);
@@ -6013,7 +6402,6 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat)
 		/* For bootup, initialized properly in watermark setup */
 		mod_zone_page_state(zone, NR_ALLOC_BATCH, zone->managed_pages);
 
-		lruvec_init(&zone->lruvec);
 		if (!size)
 			continue;
 
@@ -6877,6 +7265,8 @@ void setup_per_zone_wmarks(void)
 	mutex_lock(&zonelists_mutex);
 	__setup_per_zone_wmarks();
 	mutex_unlock(&zonelists_mutex);
+
+	setup_per_zone_pcp_high_max();
 }
 
 /*
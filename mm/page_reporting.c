@@ -0,0 +1,241 @@
+/*
+ * mm/page_reporting.c
+ *
+ * Report large free pages to a device, typically a hypervisor that can
+ * then reclaim the memory behind them, without waiting for a balloon.
+ *
+ * Freeing a page of at least PAGE_REPORTING_MIN_ORDER into the buddy
+ * allocator schedules a delayed worker.  The worker walks the free lists
+ * of every zone, takes up to PAGE_REPORTING_CAPACITY pages not yet
+ * reported off them, hands them to the device and puts them back flagged
+ * with PageReported.  The flag lives only as long as the page stays
+ * free and unmerged: allocation or merging with a buddy clears it, so
+ * the larger merged page gets reported again in its own right.
+ */
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/page_reporting.h>
+#include <linux/rcupdate.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/export.h>
+
+#include "internal.h"
+#include "page_reporting.h"
+
+/* Let frees accumulate before walking the free lists */
+#define PAGE_REPORTING_DELAY	(2 * HZ)
+
+enum {
+	PAGE_REPORTING_IDLE = 0,
+	PAGE_REPORTING_REQUESTED,
+	PAGE_REPORTING_ACTIVE,
+};
+
+static struct page_reporting_dev_info __rcu *pr_dev_info __read_mostly;
+static DEFINE_MUTEX(page_reporting_mutex);
+
+DEFINE_STATIC_KEY_FALSE(page_reporting_enabled);
+
+static void __page_reporting_request(struct page_reporting_dev_info *prdev)
+{
+	/* Cheap check first, this is called under the zone lock */
+	if (atomic_read(&prdev->state) == PAGE_REPORTING_REQUESTED)
+		return;
+
+	/* An active worker will see the request and run once more */
+	if (atomic_xchg(&prdev->state, PAGE_REPORTING_REQUESTED) !=
+	    PAGE_REPORTING_IDLE)
+		return;
+
+	schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+}
+
+void __page_reporting_notify(void)
+{
+	struct page_reporting_dev_info *prdev;
+
+	rcu_read_lock();
+	prdev = rcu_dereference(pr_dev_info);
+	if (likely(prdev))
+		__page_reporting_request(prdev);
+	rcu_read_unlock();
+}
+
+/*
+ * Put the pages back on the free lists.  Only a page that came back at
+ * the order it was reported at, i.e. did not merge with a buddy freed
+ * in the meantime, still describes exactly what the device was told.
+ * Those go to the tail, so the allocator prefers memory that is still
+ * backed and the next pass finds unreported pages first.
+ */
+static void page_reporting_drain(struct zone *zone, struct scatterlist *sgl,
+				 unsigned int nents, unsigned int order,
+				 bool reported)
+{
+	struct scatterlist *sg;
+	unsigned int i;
+
+	for_each_sg(sgl, sg, nents, i) {
+		struct page *page = sg_page(sg);
+
+		__page_reporting_putback(page, order);
+
+		if (!reported || !PageBuddy(page) || page_order(page) != order)
+			continue;
+
+		__SetPageReported(page);
+		list_move_tail(&page->lru, &zone->free_area[order].free_list[
+				get_pageblock_migratetype(page)]);
+	}
+}
+
+/* Report the unreported pages on one free list */
+static int page_reporting_cycle(struct page_reporting_dev_info *prdev,
+				struct zone *zone, unsigned int order,
+				int mt, struct scatterlist *sgl)
+{
+	struct list_head *list = &zone->free_area[order].free_list[mt];
+	unsigned long watermark;
+	struct page *page, *next;
+	unsigned int nents;
+	int err;
+
+	/* Leave the zone enough to keep allocating while pages are out */
+	watermark = low_wmark_pages(zone) +
+		    (PAGE_REPORTING_CAPACITY << PAGE_REPORTING_MIN_ORDER);
+
+	for (;;) {
+		if (list_empty(list))
+			return 0;
+
+		nents = 0;
+		sg_init_table(sgl, PAGE_REPORTING_CAPACITY);
+
+		spin_lock_irq(&zone->lock);
+		if (!zone_watermark_ok(zone, 0, watermark, 0, 0)) {
+			spin_unlock_irq(&zone->lock);
+			return 0;
+		}
+		list_for_each_entry_safe(page, next, list, lru) {
+			if (PageReported(page))
+				continue;
+
+			__page_reporting_isolate(page, order, mt);
+			sg_set_page(&sgl[nents++], page, PAGE_SIZE << order,
+				    0);
+			if (nents == PAGE_REPORTING_CAPACITY)
+				break;
+		}
+		spin_unlock_irq(&zone->lock);
+
+		if (!nents)
+			return 0;
+
+		sg_mark_end(&sgl[nents - 1]);
+		err = prdev->report(prdev, sgl, nents);
+
+		spin_lock_irq(&zone->lock);
+		page_reporting_drain(zone, sgl, nents, order, !err);
+		spin_unlock_irq(&zone->lock);
+
+		if (err)
+			return err;
+
+		cond_resched();
+	}
+}
+
+static int page_reporting_process_zone(struct page_reporting_dev_info *prdev,
+				       struct zone *zone,
+				       struct scatterlist *sgl)
+{
+	int order, mt, err;
+
+	/* Largest pages first: they are worth the most to the host */
+	for (order = MAX_ORDER - 1; order >= PAGE_REPORTING_MIN_ORDER;
+	     order--) {
+		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+			if (is_migrate_isolate(mt))
+				continue;
+
+			err = page_reporting_cycle(prdev, zone, order, mt,
+						   sgl);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+static void page_reporting_process(struct work_struct *work)
+{
+	struct delayed_work *d_work = to_delayed_work(work);
+	struct page_reporting_dev_info *prdev =
+		container_of(d_work, struct page_reporting_dev_info, work);
+	struct scatterlist *sgl;
+	struct zone *zone;
+
+	/* Frees from here on need another pass */
+	atomic_set(&prdev->state, PAGE_REPORTING_ACTIVE);
+
+	sgl = kmalloc_array(PAGE_REPORTING_CAPACITY, sizeof(*sgl), GFP_KERNEL);
+	if (!sgl)
+		goto out;
+
+	for_each_populated_zone(zone) {
+		if (page_reporting_process_zone(prdev, zone, sgl))
+			break;
+	}
+
+	kfree(sgl);
+out:
+	if (atomic_cmpxchg(&prdev->state, PAGE_REPORTING_ACTIVE,
+			   PAGE_REPORTING_IDLE) != PAGE_REPORTING_ACTIVE)
+		schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+}
+
+int page_reporting_register(struct page_reporting_dev_info *prdev)
+{
+	int err = 0;
+
+	mutex_lock(&page_reporting_mutex);
+
+	/* Only one device can report at a time */
+	if (rcu_access_pointer(pr_dev_info)) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	atomic_set(&prdev->state, PAGE_REPORTING_IDLE);
+	INIT_DELAYED_WORK(&prdev->work, page_reporting_process);
+
+	/* Start with a pass over whatever is free already */
+	__page_reporting_request(prdev);
+
+	rcu_assign_pointer(pr_dev_info, prdev);
+
+	/* Left enabled once set, the notifier checks pr_dev_info anyway */
+	static_branch_enable(&page_reporting_enabled);
+out:
+	mutex_unlock(&page_reporting_mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(page_reporting_register);
+
+void page_reporting_unregister(struct page_reporting_dev_info *prdev)
+{
+	mutex_lock(&page_reporting_mutex);
+
+	if (rcu_access_pointer(pr_dev_info) == prdev) {
+		RCU_INIT_POINTER(pr_dev_info, NULL);
+		synchronize_rcu();
+
+		/* Nothing can queue the work now, wait out a running pass */
+		cancel_delayed_work_sync(&prdev->work);
+	}
+
+	mutex_unlock(&page_reporting_mutex);
+}
+EXPORT_SYMBOL_GPL(page_reporting_unregister);
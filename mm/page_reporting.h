@@ -0,0 +1,36 @@
+#ifndef _MM_PAGE_REPORTING_H
+#define _MM_PAGE_REPORTING_H
+
+#include <linux/jump_label.h>
+#include <linux/pageblock-flags.h>
+
+#define PAGE_REPORTING_MIN_ORDER	pageblock_order
+
+#ifdef CONFIG_PAGE_REPORTING
+DECLARE_STATIC_KEY_FALSE(page_reporting_enabled);
+void __page_reporting_notify(void);
+
+/*
+ * Called by the buddy allocator, with the zone lock held, after it
+ * placed a free page of @order on a free list.
+ */
+static inline void page_reporting_notify_free(unsigned int order)
+{
+	if (!static_branch_unlikely(&page_reporting_enabled))
+		return;
+
+	if (order < PAGE_REPORTING_MIN_ORDER)
+		return;
+
+	__page_reporting_notify();
+}
+
+void __page_reporting_isolate(struct page *page, unsigned int order, int mt);
+void __page_reporting_putback(struct page *page, unsigned int order);
+#else
+static inline void page_reporting_notify_free(unsigned int order)
+{
+}
+#endif
+
+#endif /* _MM_PAGE_REPORTING_H */
@@ -1231,6 +1231,11 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 		next = pmd_addr_end(addr, end);
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
+		if (pmd_table_shared(*pmd)) {
+			ret = unshare_pte_table(vma, pmd, addr);
+			if (ret)
+				return ret;
+		}
 		ret = unuse_pte_range(vma, pmd, addr, next, entry, page);
 		if (ret)
 			return ret;
@@ -22,7 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/notifier.h>
-#include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -283,14 +283,45 @@ LIST_HEAD(vmap_area_list);
 static LLIST_HEAD(vmap_purge_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
+/* End of the area before @va, the hole before @va starts there */
+static inline unsigned long vmap_area_prev_end(struct vmap_area *va)
+{
+	if (va->list.prev == &vmap_area_list)
+		return 0;
+	return list_prev_entry(va, list)->va_end;
+}
+
+static unsigned long compute_subtree_max_gap(struct vmap_area *va)
+{
+	unsigned long max, subtree_gap;
+
+	max = va->va_start - vmap_area_prev_end(va);
+	if (va->rb_node.rb_left) {
+		subtree_gap = rb_entry(va->rb_node.rb_left,
+				struct vmap_area, rb_node)->subtree_max_gap;
+		if (subtree_gap > max)
+			max = subtree_gap;
+	}
+	if (va->rb_node.rb_right) {
+		subtree_gap = rb_entry(va->rb_node.rb_right,
+				struct vmap_area, rb_node)->subtree_max_gap;
+		if (subtree_gap > max)
+			max = subtree_gap;
+	}
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, vmap_gap_callbacks, struct vmap_area, rb_node,
+		     unsigned long, subtree_max_gap, compute_subtree_max_gap)
+
+/* The hole before @va changed, update subtree_max_gap up the tree */
+static void vmap_gap_update(struct vmap_area *va)
+{
+	vmap_gap_callbacks_propagate(&va->rb_node, NULL);
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -314,7 +345,7 @@ static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
 	struct rb_node *parent = NULL;
-	struct rb_node *tmp;
+	struct vmap_area *prev = NULL;
 
 	while (*p) {
 		struct vmap_area *tmp_va;
@@ -323,23 +354,131 @@ static void __insert_vmap_area(struct vmap_area *va)
 		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
 		if (va->va_start < tmp_va->va_end)
 			p = &(*p)->rb_left;
-		else if (va->va_end > tmp_va->va_start)
+		else if (va->va_end > tmp_va->va_start) {
+			prev = tmp_va;
 			p = &(*p)->rb_right;
-		else
+		} else
 			BUG();
 	}
 
-	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
-
 	/* address-sort this list */
-	tmp = rb_prev(&va->rb_node);
-	if (tmp) {
-		struct vmap_area *prev;
-		prev = rb_entry(tmp, struct vmap_area, rb_node);
+	if (prev)
 		list_add_rcu(&va->list, &prev->list);
-	} else
+	else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	/* The hole before the next area shrank */
+	if (!list_is_last(&va->list, &vmap_area_list))
+		vmap_gap_update(list_next_entry(va, list));
+
+	/*
+	 * As in __vma_link_rb(), link the area with a zero gap, consistent
+	 * with the descent above, then fix the gaps and rebalance.
+	 */
+	rb_link_node(&va->rb_node, parent, p);
+	va->subtree_max_gap = 0;
+	vmap_gap_update(va);
+	rb_insert_augmented(&va->rb_node, &vmap_area_root, &vmap_gap_callbacks);
+}
+
+/*
+ * Find the lowest hole for @size bytes at @align in [@vstart, @vend), in
+ * the same way unmapped_area() searches the vmas of an mm. That is, look
+ * for an area that immediately follows a suitable hole:
+ * - gap_start = prev->va_end  <= vend   - length;
+ * - gap_end   = va->va_start  >= vstart + length;
+ * - gap_end - gap_start >= length
+ * subtree_max_gap tells which subtrees can have one.
+ *
+ * Called with vmap_area_lock held, returns 0 if there is no such hole.
+ */
+static unsigned long find_vmap_lowest_gap(unsigned long size,
+		unsigned long align, unsigned long vstart, unsigned long vend)
+{
+	struct vmap_area *va;
+	unsigned long length, low_limit, high_limit, gap_start, gap_end;
+
+	/* Adjust search length to account for worst case alignment overhead */
+	length = size + align - 1;
+	if (length < size)
+		return 0;
+
+	/* Adjust search limits by the desired length */
+	if (vend < length)
+		return 0;
+	high_limit = vend - length;
+
+	if (vstart > high_limit)
+		return 0;
+	low_limit = vstart + length;
+
+	/* Check if rbtree root looks promising */
+	if (RB_EMPTY_ROOT(&vmap_area_root))
+		goto check_highest;
+	va = rb_entry(vmap_area_root.rb_node, struct vmap_area, rb_node);
+	if (va->subtree_max_gap < length)
+		goto check_highest;
+
+	while (true) {
+		/* Visit left subtree if it looks promising */
+		gap_end = va->va_start;
+		if (gap_end >= low_limit && va->rb_node.rb_left) {
+			struct vmap_area *left = rb_entry(va->rb_node.rb_left,
+						struct vmap_area, rb_node);
+			if (left->subtree_max_gap >= length) {
+				va = left;
+				continue;
+			}
+		}
+
+		gap_start = vmap_area_prev_end(va);
+check_current:
+		/* Check if current node has a suitable gap */
+		if (gap_start > high_limit)
+			return 0;
+		if (gap_end >= low_limit && gap_end - gap_start >= length)
+			goto found;
+
+		/* Visit right subtree if it looks promising */
+		if (va->rb_node.rb_right) {
+			struct vmap_area *right = rb_entry(va->rb_node.rb_right,
+						struct vmap_area, rb_node);
+			if (right->subtree_max_gap >= length) {
+				va = right;
+				continue;
+			}
+		}
+
+		/* Go back up the rbtree to find next candidate node */
+		while (true) {
+			struct rb_node *prev = &va->rb_node;
+
+			if (!rb_parent(prev))
+				goto check_highest;
+			va = rb_entry(rb_parent(prev), struct vmap_area, rb_node);
+			if (prev == va->rb_node.rb_left) {
+				gap_start = vmap_area_prev_end(va);
+				gap_end = va->va_start;
+				goto check_current;
+			}
+		}
+	}
+
+check_highest:
+	/* Check highest gap, which does not precede any rbtree node */
+	gap_start = 0;
+	if (!list_empty(&vmap_area_list))
+		gap_start = list_last_entry(&vmap_area_list,
+					    struct vmap_area, list)->va_end;
+	if (gap_start > high_limit)
+		return 0;
+
+found:
+	/* We found a suitable gap. Clip it with the original vstart. */
+	if (gap_start < vstart)
+		gap_start = vstart;
+
+	return ALIGN(gap_start, align);
 }
 
 static void purge_vmap_area_lazy(void);
@@ -356,10 +495,8 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
@@ -380,83 +517,14 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_next_entry(first, list);
-	}
-
-found:
-	if (addr + size > vend)
+	addr = find_vmap_lowest_gap(size, align, vstart, vend);
+	if (!addr)
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
@@ -503,27 +571,21 @@ EXPORT_SYMBOL_GPL(unregister_vmap_purge_notifier);
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_area *next = NULL;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
+	if (!list_is_last(&va->list, &vmap_area_list))
+		next = list_next_entry(va, list);
+
+	rb_erase_augmented(&va->rb_node, &vmap_area_root, &vmap_gap_callbacks);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
 
+	/* The hole before the next area grew */
+	if (next)
+		vmap_gap_update(next);
+
 	/*
 	 * Track the highest possible candidate for pcpu area
 	 * allocation.  Areas outside of vmalloc area can be returned
@@ -601,6 +663,9 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/* Areas a purge frees per vmap_area_lock hold */
+#define VMAP_PURGE_BATCH	32
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -662,9 +727,22 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 		flush_tlb_kernel_range(*start, *end);
 
 	if (nr) {
+		int batch = 0;
+
+		/*
+		 * A purge can free thousands of areas, give the allocators
+		 * waiting for vmap_area_lock a turn between batches.
+		 */
 		spin_lock(&vmap_area_lock);
-		llist_for_each_entry_safe(va, n_va, valist, purge_list)
+		llist_for_each_entry_safe(va, n_va, valist, purge_list) {
 			__free_vmap_area(va);
+			if (++batch == VMAP_PURGE_BATCH) {
+				batch = 0;
+				spin_unlock(&vmap_area_lock);
+				cpu_relax();
+				spin_lock(&vmap_area_lock);
+			}
+		}
 		spin_unlock(&vmap_area_lock);
 	}
 	spin_unlock(&purge_lock);
@@ -1606,6 +1684,7 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	unsigned int nr_pages, array_size, i;
 	const gfp_t nested_gfp = (gfp_mask & GFP_RECLAIM_MASK) | __GFP_ZERO;
 	const gfp_t alloc_mask = gfp_mask | __GFP_NOWARN;
+	int nid = first_online_node;
 
 	nr_pages = get_vm_area_size(area) >> PAGE_SHIFT;
 	array_size = (nr_pages * sizeof(struct page *));
@@ -1628,7 +1707,12 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	for (i = 0; i < area->nr_pages; i++) {
 		struct page *page;
 
-		if (node == NUMA_NO_NODE)
+		if (area->flags & VM_INTERLEAVE) {
+			page = alloc_kmem_pages_node(nid, alloc_mask, order);
+			nid = next_online_node(nid);
+			if (nid == MAX_NUMNODES)
+				nid = first_online_node;
+		} else if (node == NUMA_NO_NODE)
 			page = alloc_kmem_pages(alloc_mask, order);
 		else
 			page = alloc_kmem_pages_node(node, alloc_mask, order);
@@ -1845,6 +1929,24 @@ void *vzalloc_node(unsigned long size, int node)
 }
 EXPORT_SYMBOL(vzalloc_node);
 
+/**
+ * vzalloc_interleave - allocate zeroed memory spread over all nodes
+ * @size:	allocation size
+ *
+ * Like vzalloc(), but the pages are taken round-robin from the online
+ * nodes instead of the local one.  Meant for large tables that every cpu
+ * in the system hits, e.g. hash tables resized from a worker that happens
+ * to run on one node.
+ */
+void *vzalloc_interleave(unsigned long size)
+{
+	return __vmalloc_node_range(size, 1, VMALLOC_START, VMALLOC_END,
+				    GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO,
+				    PAGE_KERNEL, VM_INTERLEAVE, NUMA_NO_NODE,
+				    __builtin_return_address(0));
+}
+EXPORT_SYMBOL(vzalloc_interleave);
+
 #ifndef PAGE_KERNEL_EXEC
 # define PAGE_KERNEL_EXEC PAGE_KERNEL
 #endif
@@ -2672,6 +2774,9 @@ static int s_show(struct seq_file *m, void *p)
 	if (v->flags & VM_USERMAP)
 		seq_puts(m, " user");
 
+	if (v->flags & VM_INTERLEAVE)
+		seq_puts(m, " interleave");
+
 	if (is_vmalloc_addr(v->pages))
 		seq_puts(m, " vpages");
 
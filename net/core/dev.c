@@ -139,6 +139,8 @@
 #include <linux/hrtimer.h>
 #include <linux/netfilter_ingress.h>
 #include <linux/sctp.h>
+#include <linux/bpf.h>
+#include <linux/kthread.h>
 
 #include "net-sysfs.h"
 
@@ -1764,7 +1766,7 @@ EXPORT_SYMBOL_GPL(is_skb_forwardable);
 
 int __dev_forward_skb(struct net_device *dev, struct sk_buff *skb)
 {
-	if (skb_orphan_frags(skb, GFP_ATOMIC) ||
+	if (skb_orphan_frags_rx(skb, GFP_ATOMIC) ||
 	    unlikely(!is_skb_forwardable(dev, skb))) {
 		atomic_long_inc(&dev->rx_dropped);
 		kfree_skb(skb);
@@ -1808,7 +1810,7 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -3072,6 +3074,18 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 	int rc;
 
 	qdisc_calculate_pkt_len(skb, q);
+
+	if (q->flags & TCQ_F_NOLOCK) {
+		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+			kfree_skb(skb);
+			rc = NET_XMIT_DROP;
+		} else {
+			rc = q->enqueue(skb, q) & NET_XMIT_MASK;
+			qdisc_run(q);
+		}
+		return rc;
+	}
+
 	/*
 	 * Heuristic to force contended enqueues to serialize on a
 	 * separate lock before trying to get qdisc main lock.
@@ -3457,6 +3471,21 @@ int weight_p __read_mostly = 64;            /* old backlog weight */
 static inline void ____napi_schedule(struct softnet_data *sd,
 				     struct napi_struct *napi)
 {
+	struct task_struct *thread;
+
+	if (test_bit(NAPI_STATE_THREADED, &napi->state)) {
+		/* Paired with smp_mb__before_atomic() in
+		 * dev_set_threaded(): the thread is valid once the
+		 * THREADED bit is seen.
+		 */
+		thread = READ_ONCE(napi->thread);
+		if (thread) {
+			set_bit(NAPI_STATE_SCHED_THREADED, &napi->state);
+			wake_up_process(thread);
+			return;
+		}
+	}
+
 	list_add_tail(&napi->poll_list, &sd->poll_list);
 	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
 }
@@ -3528,6 +3557,7 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	const struct rps_sock_flow_table *sock_flow_table;
 	struct netdev_rx_queue *rxqueue = dev->_rx;
 	struct rps_dev_flow_table *flow_table;
+	struct rps_flow_table *exact_table;
 	struct rps_map *map;
 	int cpu = -1;
 	u32 tcpu;
@@ -3558,18 +3588,27 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	if (!hash)
 		goto done;
 
+	exact_table = rcu_dereference(rps_flow_table);
 	sock_flow_table = rcu_dereference(rps_sock_flow_table);
-	if (flow_table && sock_flow_table) {
+	if (flow_table && (exact_table || sock_flow_table)) {
 		struct rps_dev_flow *rflow;
 		u32 next_cpu;
 		u32 ident;
 
 		/* First check into global flow table if there is a match */
-		ident = sock_flow_table->ents[hash & sock_flow_table->mask];
-		if ((ident ^ hash) & ~rps_cpu_mask)
-			goto try_rps;
+		if (exact_table) {
+			next_cpu = rps_flow_table_lookup(exact_table, hash);
+			if (next_cpu == RPS_NO_CPU)
+				goto miss;
+		} else {
+			ident = sock_flow_table->ents[hash &
+						      sock_flow_table->mask];
+			if ((ident ^ hash) & ~rps_cpu_mask)
+				goto miss;
 
-		next_cpu = ident & rps_cpu_mask;
+			next_cpu = ident & rps_cpu_mask;
+		}
+		__this_cpu_inc(softnet_data.rps_flow_hit);
 
 		/* OK, now we know there is a match,
 		 * we can look at the local (per receive queue) flow table
@@ -3601,6 +3640,9 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 			cpu = tcpu;
 			goto done;
 		}
+		goto try_rps;
+miss:
+		__this_cpu_inc(softnet_data.rps_flow_miss);
 	}
 
 try_rps:
@@ -3733,42 +3775,52 @@ static bool skb_flow_limit(struct sk_buff *skb, unsigned int qlen)
  * enqueue_to_backlog is called to queue an skb to a per CPU backlog
  * queue (may be a remote CPU queue).
  */
+/*
+ * Queue skb to the backlog of sd, returns false if it must be dropped.
+ * Called with rps_lock(sd) held and irqs disabled.
+ */
+static bool __enqueue_to_backlog(struct softnet_data *sd, struct sk_buff *skb,
+				 unsigned int *qtail)
+{
+	unsigned int qlen;
+
+	if (!netif_running(skb->dev))
+		return false;
+	qlen = skb_queue_len(&sd->input_pkt_queue);
+	if (qlen > netdev_max_backlog || skb_flow_limit(skb, qlen))
+		return false;
+
+	/* Schedule NAPI for backlog device
+	 * We can use non atomic operation since we own the queue lock
+	 */
+	if (!qlen && !__test_and_set_bit(NAPI_STATE_SCHED,
+					 &sd->backlog.state)) {
+		if (!rps_ipi_queued(sd))
+			____napi_schedule(sd, &sd->backlog);
+	}
+
+	__skb_queue_tail(&sd->input_pkt_queue, skb);
+	input_queue_tail_incr_save(sd, qtail);
+	return true;
+}
+
 static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
 			      unsigned int *qtail)
 {
 	struct softnet_data *sd;
 	unsigned long flags;
-	unsigned int qlen;
 
 	sd = &per_cpu(softnet_data, cpu);
 
 	local_irq_save(flags);
 
 	rps_lock(sd);
-	if (!netif_running(skb->dev))
-		goto drop;
-	qlen = skb_queue_len(&sd->input_pkt_queue);
-	if (qlen <= netdev_max_backlog && !skb_flow_limit(skb, qlen)) {
-		if (qlen) {
-enqueue:
-			__skb_queue_tail(&sd->input_pkt_queue, skb);
-			input_queue_tail_incr_save(sd, qtail);
-			rps_unlock(sd);
-			local_irq_restore(flags);
-			return NET_RX_SUCCESS;
-		}
-
-		/* Schedule NAPI for backlog device
-		 * We can use non atomic operation since we own the queue lock
-		 */
-		if (!__test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state)) {
-			if (!rps_ipi_queued(sd))
-				____napi_schedule(sd, &sd->backlog);
-		}
-		goto enqueue;
+	if (__enqueue_to_backlog(sd, skb, qtail)) {
+		rps_unlock(sd);
+		local_irq_restore(flags);
+		return NET_RX_SUCCESS;
 	}
 
-drop:
 	sd->dropped++;
 	rps_unlock(sd);
 
@@ -3779,6 +3831,79 @@ drop:
 	return NET_RX_DROP;
 }
 
+#ifdef CONFIG_RPS
+/* Maximum number of skbs moved to a remote backlog under one lock */
+#define RPS_BACKLOG_BATCH	16
+
+/*
+ * A run of consecutive skbs of a list steered to the same cpu, queued
+ * with a single backlog lock round trip. The remote cpu is kicked at
+ * most once per run, and rps_ipi_queued() already defers the IPI to
+ * the end of our NET_RX softirq.
+ */
+struct rps_backlog_batch {
+	struct sk_buff_head	skbs;
+	unsigned int		*qtails[RPS_BACKLOG_BATCH];
+	int			cpu;
+};
+
+static void enqueue_batch_to_backlog(struct rps_backlog_batch *batch)
+{
+	struct sk_buff_head drop;
+	struct softnet_data *sd;
+	struct sk_buff *skb;
+	unsigned long flags;
+	unsigned int i = 0;
+
+	if (skb_queue_empty(&batch->skbs))
+		return;
+
+	__skb_queue_head_init(&drop);
+	sd = &per_cpu(softnet_data, batch->cpu);
+
+	local_irq_save(flags);
+	rps_lock(sd);
+	while ((skb = __skb_dequeue(&batch->skbs)) != NULL) {
+		unsigned int *qtail = batch->qtails[i++];
+
+		if (!__enqueue_to_backlog(sd, skb, qtail)) {
+			/* unpark the qtail set by rps_backlog_batch_add() */
+			*qtail = sd->input_queue_tail;
+			sd->dropped++;
+			__skb_queue_tail(&drop, skb);
+		}
+	}
+	rps_unlock(sd);
+	local_irq_restore(flags);
+
+	while ((skb = __skb_dequeue(&drop)) != NULL) {
+		atomic_long_inc(&skb->dev->rx_dropped);
+		kfree_skb(skb);
+	}
+}
+
+static void rps_backlog_batch_add(struct rps_backlog_batch *batch,
+				  struct sk_buff *skb, int cpu,
+				  unsigned int *qtail)
+{
+	if (cpu != batch->cpu ||
+	    skb_queue_len(&batch->skbs) == RPS_BACKLOG_BATCH) {
+		enqueue_batch_to_backlog(batch);
+		batch->cpu = cpu;
+	}
+
+	/* Until the batch is flushed the flow has packets nobody can see
+	 * in sd->input_pkt_queue yet. Park its qtail far ahead of the
+	 * queue head so get_rps_cpu() does not move the flow to another
+	 * cpu meanwhile; the real tail is stored on enqueue.
+	 */
+	*qtail = per_cpu(softnet_data, cpu).input_queue_head + (1U << 30);
+
+	batch->qtails[skb_queue_len(&batch->skbs)] = qtail;
+	__skb_queue_tail(&batch->skbs, skb);
+}
+#endif /* CONFIG_RPS */
+
 static int netif_rx_internal(struct sk_buff *skb)
 {
 	int ret;
@@ -3897,6 +4022,13 @@ static void net_tx_action(struct softirq_action *h)
 
 			head = head->next_sched;
 
+			if (q->flags & TCQ_F_NOLOCK) {
+				smp_mb__before_atomic();
+				clear_bit(__QDISC_STATE_SCHED, &q->state);
+				qdisc_run(q);
+				continue;
+			}
+
 			root_lock = qdisc_lock(q);
 			if (spin_trylock(root_lock)) {
 				smp_mb__before_atomic();
@@ -4065,10 +4197,18 @@ static inline int nf_ingress(struct sk_buff *skb, struct packet_type **pt_prev,
 	return 0;
 }
 
-static int __netif_receive_skb_core(struct sk_buff *skb, bool pfmemalloc)
+/* Runs the taps, ingress hooks and rx handlers on @*pskb and looks up the
+ * packet_type that should get it.  The final delivery is left to the
+ * caller through @ppt_prev, so that a batch of skbs going to the same
+ * handler can be passed on in one call.  @*pskb is updated as the rx
+ * handlers may replace the skb.
+ */
+static int __netif_receive_skb_core(struct sk_buff **pskb, bool pfmemalloc,
+				    struct packet_type **ppt_prev)
 {
 	struct packet_type *ptype, *pt_prev;
 	rx_handler_func_t *rx_handler;
+	struct sk_buff *skb = *pskb;
 	struct net_device *orig_dev;
 	bool deliver_exact = false;
 	int ret = NET_RX_DROP;
@@ -4199,10 +4339,9 @@ ncls:
 	}
 
 	if (pt_prev) {
-		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 			goto drop;
-		else
-			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+		*ppt_prev = pt_prev;
 	} else {
 drop:
 		if (!deliver_exact)
@@ -4217,6 +4356,19 @@ drop:
 	}
 
 out:
+	*pskb = skb;
+	return ret;
+}
+
+static int __netif_receive_skb_one_core(struct sk_buff *skb, bool pfmemalloc)
+{
+	struct net_device *orig_dev = skb->dev;
+	struct packet_type *pt_prev = NULL;
+	int ret;
+
+	ret = __netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+	if (pt_prev)
+		ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 	return ret;
 }
 
@@ -4237,14 +4389,109 @@ static int __netif_receive_skb(struct sk_buff *skb)
 		 * context down to all allocation sites.
 		 */
 		current->flags |= PF_MEMALLOC;
-		ret = __netif_receive_skb_core(skb, true);
+		ret = __netif_receive_skb_one_core(skb, true);
 		tsk_restore_flags(current, pflags, PF_MEMALLOC);
 	} else
-		ret = __netif_receive_skb_core(skb, false);
+		ret = __netif_receive_skb_one_core(skb, false);
 
 	return ret;
 }
 
+static inline void __netif_receive_skb_list_ptype(struct list_head *head,
+						  struct packet_type *pt_prev,
+						  struct net_device *orig_dev)
+{
+	struct sk_buff *skb, *next;
+
+	if (!pt_prev)
+		return;
+	if (list_empty(head))
+		return;
+	if (pt_prev->list_func)
+		pt_prev->list_func(head, pt_prev, orig_dev);
+	else
+		list_for_each_entry_safe(skb, next, head, list) {
+			skb_list_del_init(skb);
+			pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+		}
+}
+
+static void __netif_receive_skb_list_core(struct list_head *head,
+					  bool pfmemalloc)
+{
+	/* Fast-path assumptions:
+	 * - There is no rx handler.
+	 * - Only one packet_type matches.
+	 * If either of these fails, we end up doing some per-packet
+	 * processing in-line, then handling the 'last ptype' for the whole
+	 * sublist.  This can't cause out-of-order delivery to any single
+	 * ptype, because the 'last ptype' must be constant across the
+	 * sublist, and all other ptypes are handled per-packet.
+	 */
+	/* Current (common) ptype of sublist */
+	struct packet_type *pt_curr = NULL;
+	/* Current (common) orig_dev of sublist */
+	struct net_device *od_curr = NULL;
+	struct list_head sublist;
+	struct sk_buff *skb, *next;
+
+	INIT_LIST_HEAD(&sublist);
+	list_for_each_entry_safe(skb, next, head, list) {
+		struct net_device *orig_dev = skb->dev;
+		struct packet_type *pt_prev = NULL;
+
+		skb_list_del_init(skb);
+		__netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+		if (!pt_prev)
+			continue;
+		if (pt_curr != pt_prev || od_curr != orig_dev) {
+			/* dispatch old sublist */
+			__netif_receive_skb_list_ptype(&sublist, pt_curr,
+						       od_curr);
+			/* start new sublist */
+			INIT_LIST_HEAD(&sublist);
+			pt_curr = pt_prev;
+			od_curr = orig_dev;
+		}
+		list_add_tail(&skb->list, &sublist);
+	}
+
+	/* dispatch final sublist */
+	__netif_receive_skb_list_ptype(&sublist, pt_curr, od_curr);
+}
+
+static void __netif_receive_skb_list(struct list_head *head)
+{
+	unsigned long pflags = current->flags;
+	bool pfmemalloc = false; /* Is current sublist PF_MEMALLOC? */
+	struct sk_buff *skb, *next;
+
+	list_for_each_entry_safe(skb, next, head, list) {
+		if ((sk_memalloc_socks() && skb_pfmemalloc(skb)) != pfmemalloc) {
+			struct list_head sublist;
+
+			/* Handle the previous sublist */
+			list_cut_position(&sublist, head, skb->list.prev);
+			if (!list_empty(&sublist))
+				__netif_receive_skb_list_core(&sublist,
+							      pfmemalloc);
+			pfmemalloc = !pfmemalloc;
+			/* See comments in __netif_receive_skb */
+			if (pfmemalloc)
+				current->flags |= PF_MEMALLOC;
+			else
+				tsk_restore_flags(current, pflags,
+						  PF_MEMALLOC);
+		}
+	}
+	/* Handle the remaining sublist */
+	if (!list_empty(head))
+		__netif_receive_skb_list_core(head, pfmemalloc);
+	/* Restore pflags */
+	if (pfmemalloc)
+		tsk_restore_flags(current, pflags, PF_MEMALLOC);
+}
+
 static int netif_receive_skb_internal(struct sk_buff *skb)
 {
 	int ret;
@@ -4273,6 +4520,48 @@ static int netif_receive_skb_internal(struct sk_buff *skb)
 	return ret;
 }
 
+static void netif_receive_skb_list_internal(struct list_head *head)
+{
+	struct sk_buff *skb, *next;
+	struct list_head sublist;
+
+	INIT_LIST_HEAD(&sublist);
+	list_for_each_entry_safe(skb, next, head, list) {
+		net_timestamp_check(netdev_tstamp_prequeue, skb);
+		skb_list_del_init(skb);
+		if (!skb_defer_rx_timestamp(skb))
+			list_add_tail(&skb->list, &sublist);
+	}
+	list_splice_init(&sublist, head);
+
+	rcu_read_lock();
+#ifdef CONFIG_RPS
+	if (static_key_false(&rps_needed)) {
+		/* voidflow must outlive the batch holding its qtail */
+		struct rps_dev_flow voidflow;
+		struct rps_backlog_batch batch;
+
+		__skb_queue_head_init(&batch.skbs);
+		batch.cpu = -1;
+
+		list_for_each_entry_safe(skb, next, head, list) {
+			struct rps_dev_flow *rflow = &voidflow;
+			int cpu = get_rps_cpu(skb->dev, skb, &rflow);
+
+			if (cpu >= 0) {
+				/* Will be handled, remove from list */
+				skb_list_del_init(skb);
+				rps_backlog_batch_add(&batch, skb, cpu,
+						      &rflow->last_qtail);
+			}
+		}
+		enqueue_batch_to_backlog(&batch);
+	}
+#endif
+	__netif_receive_skb_list(head);
+	rcu_read_unlock();
+}
+
 /**
  *	netif_receive_skb - process receive buffer from network
  *	@skb: buffer to process
@@ -4296,6 +4585,31 @@ int netif_receive_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(netif_receive_skb);
 
+/**
+ *	netif_receive_skb_list - process many receive buffers from network
+ *	@head: list of skbs to process, linked through &sk_buff.list
+ *
+ *	Since return value of netif_receive_skb() is normally ignored, and
+ *	wouldn't be meaningful for a list, this function returns void.
+ *	The skbs are handed to the protocol handlers in batches, so that
+ *	each stage of the receive path runs over the whole list before the
+ *	next one starts.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled.
+ */
+void netif_receive_skb_list(struct list_head *head)
+{
+	struct sk_buff *skb;
+
+	if (list_empty(head))
+		return;
+	list_for_each_entry(skb, head, list)
+		trace_netif_receive_skb_list_entry(skb);
+	netif_receive_skb_list_internal(head);
+}
+EXPORT_SYMBOL(netif_receive_skb_list);
+
 /* Network device is going away, flush any packets still pending
  * Called with irqs disabled.
  */
@@ -4898,6 +5212,7 @@ void __napi_complete(struct napi_struct *n)
 
 	list_del_init(&n->poll_list);
 	smp_mb__before_atomic();
+	clear_bit(NAPI_STATE_SCHED_THREADED, &n->state);
 	clear_bit(NAPI_STATE_SCHED, &n->state);
 }
 EXPORT_SYMBOL(__napi_complete);
@@ -4926,6 +5241,7 @@ void napi_complete_done(struct napi_struct *n, int work_done)
 			napi_gro_flush(n, false);
 	}
 	if (likely(list_empty(&n->poll_list))) {
+		clear_bit(NAPI_STATE_SCHED_THREADED, &n->state);
 		WARN_ON_ONCE(!test_and_clear_bit(NAPI_STATE_SCHED, &n->state));
 	} else {
 		/* If n->poll_list is not empty, we need to mask irqs */
@@ -4951,16 +5267,34 @@ static struct napi_struct *napi_by_id(unsigned int napi_id)
 
 #if defined(CONFIG_NET_RX_BUSY_POLL)
 #define BUSY_POLL_BUDGET 8
-bool sk_busy_loop(struct sock *sk, int nonblock)
-{
-	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+
+/**
+ * napi_busy_loop - poll one NAPI context from process context
+ * @napi_id: id of the NAPI context to poll
+ * @loop_end: returns true once the caller's condition is met, may be NULL
+ * @loop_end_arg: opaque argument passed to @loop_end
+ * @budget: per iteration budget handed to ->poll(), 0 means default
+ *
+ * Polls @napi_id until @loop_end returns true or the task needs to
+ * reschedule. With a NULL @loop_end a single iteration is performed,
+ * which lets callers round robin over several NAPI contexts.
+ * @loop_end is given the busy loop clock at the start of the loop.
+ */
+void napi_busy_loop(unsigned int napi_id,
+		    bool (*loop_end)(void *, unsigned long),
+		    void *loop_end_arg, unsigned int budget)
+{
+	unsigned long start_time = loop_end ? busy_loop_us_clock() : 0;
 	int (*busy_poll)(struct napi_struct *dev);
 	struct napi_struct *napi;
-	int rc = false;
+	int rc;
+
+	if (!budget)
+		budget = BUSY_POLL_BUDGET;
 
 	rcu_read_lock();
 
-	napi = napi_by_id(sk->sk_napi_id);
+	napi = napi_by_id(napi_id);
 	if (!napi)
 		goto out;
 
@@ -4976,9 +5310,9 @@ bool sk_busy_loop(struct sock *sk, int nonblock)
 			void *have = netpoll_poll_lock(napi);
 
 			if (test_bit(NAPI_STATE_SCHED, &napi->state)) {
-				rc = napi->poll(napi, BUSY_POLL_BUDGET);
+				rc = napi->poll(napi, budget);
 				trace_napi_poll(napi);
-				if (rc == BUSY_POLL_BUDGET) {
+				if (rc == budget) {
 					napi_complete_done(napi, rc);
 					napi_schedule(napi);
 				}
@@ -4986,7 +5320,7 @@ bool sk_busy_loop(struct sock *sk, int nonblock)
 			netpoll_poll_unlock(have);
 		}
 		if (rc > 0)
-			__NET_ADD_STATS(sock_net(sk),
+			__NET_ADD_STATS(dev_net(napi->dev),
 					LINUX_MIB_BUSYPOLLRXPACKETS, rc);
 		local_bh_enable();
 
@@ -4994,13 +5328,30 @@ bool sk_busy_loop(struct sock *sk, int nonblock)
 			break; /* permanent failure */
 
 		cpu_relax();
-	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
-		 !need_resched() && !busy_loop_timeout(end_time));
-
-	rc = !skb_queue_empty(&sk->sk_receive_queue);
+	} while (loop_end && !loop_end(loop_end_arg, start_time) &&
+		 !need_resched());
 out:
 	rcu_read_unlock();
-	return rc;
+}
+EXPORT_SYMBOL(napi_busy_loop);
+
+static bool sk_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct sock *sk = p;
+
+	return !skb_queue_empty(&sk->sk_receive_queue) ||
+	       busy_loop_timeout(start_time + ACCESS_ONCE(sk->sk_ll_usec));
+}
+
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned int napi_id = ACCESS_ONCE(sk->sk_napi_id);
+
+	if (napi_id >= MIN_NAPI_ID)
+		napi_busy_loop(napi_id, nonblock ? NULL : sk_busy_loop_end,
+			       sk, BUSY_POLL_BUDGET);
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
 }
 EXPORT_SYMBOL(sk_busy_loop);
 
@@ -5014,10 +5365,10 @@ void napi_hash_add(struct napi_struct *napi)
 
 	spin_lock(&napi_hash_lock);
 
-	/* 0..NR_CPUS+1 range is reserved for sender_cpu use */
+	/* 0..NR_CPUS range is reserved for sender_cpu use */
 	do {
-		if (unlikely(++napi_gen_id < NR_CPUS + 1))
-			napi_gen_id = NR_CPUS + 1;
+		if (unlikely(++napi_gen_id < MIN_NAPI_ID))
+			napi_gen_id = MIN_NAPI_ID;
 	} while (napi_by_id(napi_gen_id));
 	napi->napi_id = napi_gen_id;
 
@@ -5046,6 +5397,79 @@ bool napi_hash_del(struct napi_struct *napi)
 }
 EXPORT_SYMBOL_GPL(napi_hash_del);
 
+static int napi_threaded_poll(void *data);
+
+static int napi_kthread_create(struct napi_struct *n)
+{
+	int err = 0;
+
+	/* Create and wake up the kthread once to put it in
+	 * TASK_INTERRUPTIBLE mode to avoid the blocked task
+	 * warning and work with loadavg.
+	 */
+	n->thread = kthread_run(napi_threaded_poll, n, "napi/%s-%d",
+				n->dev->name, n->napi_id);
+	if (IS_ERR(n->thread)) {
+		err = PTR_ERR(n->thread);
+		pr_err("kthread_run failed with err %d\n", err);
+		n->thread = NULL;
+	}
+
+	return err;
+}
+
+/**
+ *	dev_set_threaded - run the NAPI polls of a device in kthreads
+ *	@dev: device
+ *	@threaded: whether to use one kthread per NAPI instead of softirqs
+ *
+ *	Each NAPI instance of @dev gets a "napi/<dev>-<id>" kthread that
+ *	runs its poll, which can then be prioritized, bound or isolated
+ *	like any other task.  Caller must hold the rtnl lock.
+ */
+int dev_set_threaded(struct net_device *dev, bool threaded)
+{
+	struct napi_struct *napi;
+	int err = 0;
+
+	if (dev->threaded == threaded)
+		return 0;
+
+	if (threaded) {
+		list_for_each_entry(napi, &dev->napi_list, dev_list) {
+			if (!napi->thread) {
+				err = napi_kthread_create(napi);
+				if (err) {
+					threaded = false;
+					break;
+				}
+			}
+		}
+	}
+
+	dev->threaded = threaded;
+
+	/* Make sure kthread is created before THREADED bit
+	 * is set.
+	 */
+	smp_mb__before_atomic();
+
+	/* Setting/unsetting threaded mode on a napi might not immediately
+	 * take effect, if the current napi instance is actively being
+	 * polled. In this case, the switch between threaded mode and
+	 * softirq mode will happen in the next round of napi_schedule().
+	 */
+	list_for_each_entry(napi, &dev->napi_list, dev_list) {
+		if (threaded)
+			set_bit(NAPI_STATE_THREADED, &napi->state);
+		else
+			clear_bit(NAPI_STATE_THREADED, &napi->state);
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(dev_set_threaded);
+
 static enum hrtimer_restart napi_watchdog(struct hrtimer *timer)
 {
 	struct napi_struct *napi;
@@ -5079,6 +5503,14 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 #endif
 	set_bit(NAPI_STATE_SCHED, &napi->state);
 	napi_hash_add(napi);
+	/* Create kthread for this napi if dev->threaded is set.
+	 * Clear dev->threaded if kthread creation failed so that
+	 * threaded mode will not be enabled in napi_enable().
+	 */
+	if (dev->threaded && napi_kthread_create(napi))
+		dev->threaded = false;
+	else if (dev->threaded)
+		set_bit(NAPI_STATE_THREADED, &napi->state);
 }
 EXPORT_SYMBOL(netif_napi_add);
 
@@ -5110,18 +5542,21 @@ void netif_napi_del(struct napi_struct *napi)
 	kfree_skb_list(napi->gro_list);
 	napi->gro_list = NULL;
 	napi->gro_count = 0;
+
+	if (napi->thread) {
+		kthread_stop(napi->thread);
+		napi->thread = NULL;
+	}
 }
 EXPORT_SYMBOL(netif_napi_del);
 
-static int napi_poll(struct napi_struct *n, struct list_head *repoll)
+/* Poll @n once; returns the work done and sets *@repoll if @n has to be
+ * polled again, in which case the caller still owns it.
+ */
+static int __napi_poll(struct napi_struct *n, bool *do_repoll)
 {
-	void *have;
 	int work, weight;
 
-	list_del_init(&n->poll_list);
-
-	have = netpoll_poll_lock(n);
-
 	weight = n->weight;
 
 	/* This NAPI_STATE_SCHED test is for avoiding a race
@@ -5139,7 +5574,7 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	WARN_ON_ONCE(work > weight);
 
 	if (likely(work < weight))
-		goto out_unlock;
+		return work;
 
 	/* Drivers must not modify the NAPI state if they
 	 * consume the entire weight.  In such cases this code
@@ -5148,7 +5583,7 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	 */
 	if (unlikely(napi_disable_pending(n))) {
 		napi_complete(n);
-		goto out_unlock;
+		return work;
 	}
 
 	if (n->gro_list) {
@@ -5164,17 +5599,83 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	if (unlikely(!list_empty(&n->poll_list))) {
 		pr_warn_once("%s: Budget exhausted after napi rescheduled\n",
 			     n->dev ? n->dev->name : "backlog");
-		goto out_unlock;
+		return work;
 	}
 
-	list_add_tail(&n->poll_list, repoll);
+	*do_repoll = true;
+
+	return work;
+}
+
+static int napi_poll(struct napi_struct *n, struct list_head *repoll)
+{
+	bool do_repoll = false;
+	void *have;
+	int work;
+
+	list_del_init(&n->poll_list);
+
+	have = netpoll_poll_lock(n);
+
+	work = __napi_poll(n, &do_repoll);
+
+	if (do_repoll)
+		list_add_tail(&n->poll_list, repoll);
 
-out_unlock:
 	netpoll_poll_unlock(have);
 
 	return work;
 }
 
+static int napi_thread_wait(struct napi_struct *napi)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	while (!kthread_should_stop()) {
+		/* Testing SCHED_THREADED bit here to make sure the current
+		 * kthread owns this napi and could poll on this napi.
+		 */
+		if (test_bit(NAPI_STATE_SCHED_THREADED, &napi->state)) {
+			WARN_ON(!list_empty(&napi->poll_list));
+			__set_current_state(TASK_RUNNING);
+			return 0;
+		}
+
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return -1;
+}
+
+static int napi_threaded_poll(void *data)
+{
+	struct napi_struct *napi = data;
+	void *have;
+
+	while (!napi_thread_wait(napi)) {
+		for (;;) {
+			bool repoll = false;
+
+			local_bh_disable();
+
+			have = netpoll_poll_lock(napi);
+			__napi_poll(napi, &repoll);
+			netpoll_poll_unlock(have);
+
+			__kfree_skb_flush();
+			local_bh_enable();
+
+			if (!repoll)
+				break;
+
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
 static void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = this_cpu_ptr(&softnet_data);
@@ -6529,6 +7030,38 @@ int dev_change_proto_down(struct net_device *dev, bool proto_down)
 }
 EXPORT_SYMBOL(dev_change_proto_down);
 
+/**
+ *	dev_change_xdp_fd - set or clear a bpf program for a device rx path
+ *	@dev: device
+ *	@fd: new program fd or negative value to clear
+ *
+ *	Set or clear a bpf program for a device
+ */
+int dev_change_xdp_fd(struct net_device *dev, int fd)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct bpf_prog *prog = NULL;
+	struct netdev_xdp xdp = {};
+	int err;
+
+	if (!ops->ndo_xdp)
+		return -EOPNOTSUPP;
+	if (fd >= 0) {
+		prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_XDP);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	xdp.command = XDP_SETUP_PROG;
+	xdp.prog = prog;
+	err = ops->ndo_xdp(dev, &xdp);
+	if (err < 0 && prog)
+		bpf_prog_put(prog);
+
+	return err;
+}
+EXPORT_SYMBOL(dev_change_xdp_fd);
+
 /**
  *	dev_new_index	-	allocate an ifindex
  *	@net: the applicable net namespace
@@ -0,0 +1,364 @@
+/*
+ * net/core/page_pool.c	Recycling pool of pages for driver RX rings
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/slab.h>
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/mm.h>
+#include <linux/poison.h>
+#include <linux/workqueue.h>
+#include <net/page_pool.h>
+
+/* Upper bound on the recycle ring, the pages in it are pinned */
+#define PP_RING_MAX		32768
+#define PP_RING_DEFAULT		1024
+
+#define PP_RELEASE_RETRY	HZ
+
+static void page_pool_set_owner(struct page_pool *pool, struct page *page)
+{
+	page->lru.prev = (struct list_head *)pool;
+	WRITE_ONCE(page->lru.next, PP_SIGNATURE);
+}
+
+static struct page_pool *page_pool_owner(struct page *page)
+{
+	return (struct page_pool *)page->lru.prev;
+}
+
+static int page_pool_init(struct page_pool *pool,
+			  const struct page_pool_params *params)
+{
+	unsigned int ring_qsize = PP_RING_DEFAULT;
+
+	pool->p = *params;
+
+	if (pool->p.flags & ~PP_FLAG_ALL)
+		return -EINVAL;
+
+	if (pool->p.pool_size)
+		ring_qsize = pool->p.pool_size;
+	if (ring_qsize > PP_RING_MAX)
+		return -E2BIG;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		/* The address is kept in page->private */
+		if (sizeof(dma_addr_t) > sizeof(unsigned long))
+			return -EOPNOTSUPP;
+		if (!pool->p.dev)
+			return -EINVAL;
+		if (pool->p.dma_dir != DMA_FROM_DEVICE &&
+		    pool->p.dma_dir != DMA_BIDIRECTIONAL)
+			return -EINVAL;
+	}
+
+	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0)
+		return -ENOMEM;
+
+	atomic_set(&pool->pages_state_release_cnt, 0);
+
+	/* Pages may outlive the driver, keep the device for the unmap */
+	if (pool->p.flags & PP_FLAG_DMA_MAP)
+		get_device(pool->p.dev);
+
+	return 0;
+}
+
+/**
+ * page_pool_create - create a page pool for an RX ring
+ * @params: pool parameters, copied into the pool
+ *
+ * Returns the new pool or an ERR_PTR() on failure.
+ */
+struct page_pool *page_pool_create(const struct page_pool_params *params)
+{
+	struct page_pool *pool;
+	int err;
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, params->nid);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	err = page_pool_init(pool, params);
+	if (err < 0) {
+		kfree(pool);
+		return ERR_PTR(err);
+	}
+
+	return pool;
+}
+EXPORT_SYMBOL(page_pool_create);
+
+/* Pages from the emergency reserves or a foreign node are let go */
+static bool page_pool_page_reusable(struct page_pool *pool, struct page *page)
+{
+	int nid = pool->p.nid;
+
+	if (nid == NUMA_NO_NODE)
+		nid = numa_mem_id();
+
+	return !page_is_pfmemalloc(page) && page_to_nid(page) == nid;
+}
+
+static void page_pool_dma_sync_for_device(struct page_pool *pool,
+					  struct page *page)
+{
+	if (!(pool->p.flags & PP_FLAG_DMA_MAP))
+		return;
+
+	dma_sync_single_range_for_device(pool->p.dev,
+					 page_pool_get_dma_addr(page), 0,
+					 PAGE_SIZE << pool->p.order,
+					 pool->p.dma_dir);
+}
+
+/* The page leaves the pool for good: drop the mapping and the tag, the
+ * caller still holds a page reference it has to put.
+ */
+static void page_pool_release_page(struct page_pool *pool, struct page *page)
+{
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma_unmap_page(pool->p.dev, page_pool_get_dma_addr(page),
+			       PAGE_SIZE << pool->p.order, pool->p.dma_dir);
+		set_page_private(page, 0);
+	}
+
+	/* Anyone dropping a later reference must see a plain page */
+	WRITE_ONCE(page->lru.next, NULL);
+
+	/* Done with the pool, it may be freed once this is seen */
+	smp_mb__before_atomic();
+	atomic_inc(&pool->pages_state_release_cnt);
+}
+
+static void page_pool_return_page(struct page_pool *pool, struct page *page)
+{
+	page_pool_release_page(pool, page);
+	put_page(page);
+}
+
+/* Pages returned from other contexts are pulled into the alloc cache in
+ * batches, so the consumer lock is taken once per PP_ALLOC_CACHE_REFILL
+ * pages.  The node is checked again, NAPI may have moved to another one.
+ */
+static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
+{
+	struct ptr_ring *r = &pool->ring;
+	struct page *page;
+
+	if (__ptr_ring_empty(r))
+		return NULL;
+
+	spin_lock(&r->consumer_lock);
+	while (pool->alloc.count < PP_ALLOC_CACHE_REFILL) {
+		page = __ptr_ring_consume(r);
+		if (!page)
+			break;
+
+		if (unlikely(!page_pool_page_reusable(pool, page))) {
+			page_pool_return_page(pool, page);
+			continue;
+		}
+
+		/* The stack may have written to it since the last sync */
+		page_pool_dma_sync_for_device(pool, page);
+		pool->alloc.cache[pool->alloc.count++] = page;
+	}
+	spin_unlock(&r->consumer_lock);
+
+	if (!pool->alloc.count)
+		return NULL;
+
+	return pool->alloc.cache[--pool->alloc.count];
+}
+
+static struct page *page_pool_alloc_pages_slow(struct page_pool *pool,
+					       gfp_t gfp)
+{
+	struct page *page;
+	dma_addr_t dma;
+
+	if (pool->p.order)
+		gfp |= __GFP_COMP;
+
+	page = alloc_pages_node(pool->p.nid, gfp, pool->p.order);
+	if (unlikely(!page))
+		return NULL;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma = dma_map_page(pool->p.dev, page, 0,
+				   PAGE_SIZE << pool->p.order,
+				   pool->p.dma_dir);
+		if (dma_mapping_error(pool->p.dev, dma)) {
+			put_page(page);
+			return NULL;
+		}
+		set_page_private(page, (unsigned long)dma);
+	}
+
+	page_pool_set_owner(pool, page);
+	pool->pages_state_hold_cnt++;
+
+	return page;
+}
+
+/**
+ * page_pool_alloc_pages - get a page from the pool
+ * @pool: pool owned by the calling NAPI context
+ * @gfp: allocation flags used when the pool has to allocate a new page
+ *
+ * Recycled pages come first, with their DMA mapping in place and
+ * synced for the device.  The caller gets one page reference.
+ */
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp)
+{
+	struct page *page;
+
+	if (likely(pool->alloc.count))
+		return pool->alloc.cache[--pool->alloc.count];
+
+	page = page_pool_refill_alloc_cache(pool);
+	if (page)
+		return page;
+
+	return page_pool_alloc_pages_slow(pool, gfp);
+}
+EXPORT_SYMBOL(page_pool_alloc_pages);
+
+/**
+ * page_pool_put_page - give a page back to its pool
+ * @pool: pool the page was allocated from
+ * @page: the page, the caller's reference is consumed
+ * @allow_direct: the caller runs in the NAPI context owning the pool
+ *
+ * A page still referenced elsewhere, or one that should not be reused,
+ * is unmapped and released instead of recycled.
+ */
+void page_pool_put_page(struct page_pool *pool, struct page *page,
+			bool allow_direct)
+{
+	if (likely(page_ref_count(page) == 1 &&
+		   page_pool_page_reusable(pool, page))) {
+		if (allow_direct && pool->alloc.count < PP_ALLOC_CACHE_SIZE) {
+			pool->alloc.cache[pool->alloc.count++] = page;
+			return;
+		}
+
+		if (!ptr_ring_produce_any(&pool->ring, page))
+			return;
+	}
+
+	page_pool_return_page(pool, page);
+}
+EXPORT_SYMBOL(page_pool_put_page);
+
+/**
+ * page_pool_unref_page - drop a reference on a page owned by a pool
+ * @page: the page, or any page of it if it is compound
+ *
+ * Called instead of put_page() wherever a page pool page may be found,
+ * in particular for skb fragments.  The last reference sends the page
+ * back to its pool, with the mapping intact.
+ */
+void page_pool_unref_page(struct page *page)
+{
+	page = compound_head(page);
+
+	if (!page_ref_dec_and_test(page))
+		return;
+
+	/* Ours alone now; the owner may have let it go meanwhile */
+	init_page_count(page);
+	if (unlikely(READ_ONCE(page->lru.next) != PP_SIGNATURE)) {
+		put_page(page);
+		return;
+	}
+
+	page_pool_put_page(page_pool_owner(page), page, false);
+}
+EXPORT_SYMBOL(page_pool_unref_page);
+
+static u32 page_pool_inflight(struct page_pool *pool)
+{
+	u32 release_cnt = atomic_read(&pool->pages_state_release_cnt);
+
+	return pool->pages_state_hold_cnt - release_cnt;
+}
+
+static void page_pool_empty(struct page_pool *pool)
+{
+	struct page *page;
+
+	while (pool->alloc.count) {
+		page = pool->alloc.cache[--pool->alloc.count];
+		page_pool_return_page(pool, page);
+	}
+
+	while ((page = ptr_ring_consume_bh(&pool->ring)))
+		page_pool_return_page(pool, page);
+}
+
+static void page_pool_free(struct page_pool *pool)
+{
+	/* The producer of the last page may still be leaving the ring */
+	spin_lock_irq(&pool->ring.producer_lock);
+	spin_unlock_irq(&pool->ring.producer_lock);
+
+	ptr_ring_cleanup(&pool->ring, NULL);
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP)
+		put_device(pool->p.dev);
+
+	kfree(pool);
+}
+
+/* Pages still out in skbs come back to the ring as they are freed */
+static void page_pool_release_retry(struct work_struct *work)
+{
+	struct delayed_work *dwork = to_delayed_work(work);
+	struct page_pool *pool = container_of(dwork, struct page_pool,
+					      release_dw);
+
+	page_pool_empty(pool);
+
+	if (page_pool_inflight(pool)) {
+		schedule_delayed_work(&pool->release_dw, PP_RELEASE_RETRY);
+		return;
+	}
+
+	page_pool_free(pool);
+}
+
+/**
+ * page_pool_destroy - tear down a pool
+ * @pool: the pool, its NAPI context must no longer be running
+ *
+ * Pages in the pool are released right away.  If some are still held
+ * by the stack, freeing the pool itself is deferred until they are all
+ * back.
+ */
+void page_pool_destroy(struct page_pool *pool)
+{
+	if (!pool)
+		return;
+
+	page_pool_empty(pool);
+
+	if (!page_pool_inflight(pool)) {
+		page_pool_free(pool);
+		return;
+	}
+
+	INIT_DELAYED_WORK(&pool->release_dw, page_pool_release_retry);
+	schedule_delayed_work(&pool->release_dw, PP_RELEASE_RETRY);
+}
+EXPORT_SYMBOL(page_pool_destroy);
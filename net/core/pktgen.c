@@ -213,6 +213,8 @@
 /* Xmit modes */
 #define M_START_XMIT		0	/* Default normal TX */
 #define M_NETIF_RECEIVE 	1	/* Inject packets into stack */
+#define M_QUEUE_XMIT		2	/* Inject packets into qdisc */
+#define M_GRO_RECEIVE		3	/* Inject packets into GRO */
 
 /* If lock -- protects updating of if_list */
 #define   if_lock(t)           spin_lock(&(t->if_lock));
@@ -393,6 +395,8 @@ struct pktgen_dev {
 	__u32 skb_priority;	/* skb priority field */
 	unsigned int burst;	/* number of duplicated packets to burst */
 	int node;               /* Memory node */
+	struct napi_struct napi;	/* GRO context for M_GRO_RECEIVE */
+	struct net_device napi_dev;	/* private owner of napi */
 
 #ifdef CONFIG_XFRM
 	__u8	ipsmode;		/* IPSEC mode (config) */
@@ -626,6 +630,10 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 
 	if (pkt_dev->xmit_mode == M_NETIF_RECEIVE)
 		seq_puts(seq, "     xmit_mode: netif_receive\n");
+	else if (pkt_dev->xmit_mode == M_QUEUE_XMIT)
+		seq_puts(seq, "     xmit_mode: queue_xmit\n");
+	else if (pkt_dev->xmit_mode == M_GRO_RECEIVE)
+		seq_puts(seq, "     xmit_mode: gro_receive\n");
 
 	seq_puts(seq, "     Flags: ");
 
@@ -856,6 +864,12 @@ static ssize_t get_labels(const char __user *buffer, struct pktgen_dev *pkt_dev)
 	return i;
 }
 
+/* Never scheduled, the NAPI context only carries the GRO state */
+static int pktgen_napi_poll(struct napi_struct *napi, int budget)
+{
+	return 0;
+}
+
 static ssize_t pktgen_if_write(struct file *file,
 			       const char __user * user_buffer, size_t count,
 			       loff_t * offset)
@@ -1088,7 +1102,7 @@ static ssize_t pktgen_if_write(struct file *file,
 		if (len < 0)
 			return len;
 		if ((value > 0) &&
-		    ((pkt_dev->xmit_mode == M_NETIF_RECEIVE) ||
+		    ((pkt_dev->xmit_mode != M_START_XMIT) ||
 		     !(pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)))
 			return -ENOTSUPP;
 		i += len;
@@ -1145,6 +1159,9 @@ static ssize_t pktgen_if_write(struct file *file,
 		if ((value > 1) && (pkt_dev->xmit_mode == M_START_XMIT) &&
 		    (!(pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)))
 			return -ENOTSUPP;
+		if ((value > 1) && (pkt_dev->xmit_mode == M_QUEUE_XMIT ||
+				    pkt_dev->xmit_mode == M_GRO_RECEIVE))
+			return -ENOTSUPP;
 		pkt_dev->burst = value < 1 ? 1 : value;
 		sprintf(pg_result, "OK: burst=%d", pkt_dev->burst);
 		return count;
@@ -1198,10 +1215,25 @@ static ssize_t pktgen_if_write(struct file *file,
 			 * at module loading time
 			 */
 			pkt_dev->clone_skb = 0;
+		} else if (strcmp(f, "queue_xmit") == 0 ||
+			   strcmp(f, "gro_receive") == 0) {
+			/* clone_skb and burst are not supported, the qdisc
+			 * or GRO may hold on to the packet
+			 */
+			if (pkt_dev->clone_skb > 0 || pkt_dev->burst > 1)
+				return -ENOTSUPP;
+
+			if (f[0] == 'q')
+				pkt_dev->xmit_mode = M_QUEUE_XMIT;
+			else
+				pkt_dev->xmit_mode = M_GRO_RECEIVE;
+			pkt_dev->last_ok = 1;
+			pkt_dev->clone_skb = 0;
 		} else {
 			sprintf(pg_result,
 				"xmit_mode -:%s:- unknown\nAvailable modes: %s",
-				f, "start_xmit, netif_receive\n");
+				f, "start_xmit, netif_receive, queue_xmit, "
+				"gro_receive\n");
 			return count;
 		}
 		sprintf(pg_result, "OK: xmit_mode=%s", f);
@@ -2090,7 +2122,7 @@ static int pktgen_setup_dev(const struct pktgen_net *pn,
 		return -ENODEV;
 	}
 
-	if (odev->type != ARPHRD_ETHER) {
+	if (odev->type != ARPHRD_ETHER && odev->type != ARPHRD_LOOPBACK) {
 		pr_err("not an ethernet device: \"%s\"\n", ifname);
 		err = -EINVAL;
 	} else if (!netif_running(odev)) {
@@ -3351,6 +3383,10 @@ static void pktgen_wait_for_skb(struct pktgen_dev *pkt_dev)
 {
 	ktime_t idle_start = ktime_get();
 
+	/* Handed over to GRO, nothing to wait for */
+	if (!pkt_dev->skb)
+		return;
+
 	while (atomic_read(&(pkt_dev->skb->users)) != 1) {
 		if (signal_pending(current))
 			break;
@@ -3434,6 +3470,42 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 #endif
 		} while (--burst > 0);
 		goto out; /* Skips xmit_mode M_START_XMIT */
+	} else if (pkt_dev->xmit_mode == M_QUEUE_XMIT) {
+		local_bh_disable();
+		atomic_inc(&pkt_dev->skb->users);
+
+		ret = dev_queue_xmit(pkt_dev->skb);
+		switch (ret) {
+		case NET_XMIT_SUCCESS:
+			pkt_dev->sofar++;
+			pkt_dev->seq_num++;
+			pkt_dev->tx_bytes += pkt_dev->last_pkt_size;
+			break;
+		default:
+			/* Dropped by the qdisc, or returned as is by a
+			 * queueless device
+			 */
+			net_info_ratelimited("%s xmit error: %d\n",
+					     pkt_dev->odevname, ret);
+			pkt_dev->errors++;
+			break;
+		}
+		goto out;
+	} else if (pkt_dev->xmit_mode == M_GRO_RECEIVE) {
+		/* GRO may merge or hold the skb and free it regardless of
+		 * its users count, so it is handed over for good and a new
+		 * one is built next time.
+		 */
+		skb = pkt_dev->skb;
+		pkt_dev->skb = NULL;
+		skb->protocol = eth_type_trans(skb, skb->dev);
+		local_bh_disable();
+		if (napi_gro_receive(&pkt_dev->napi, skb) == GRO_DROP)
+			pkt_dev->errors++;
+		napi_gro_flush(&pkt_dev->napi, false);
+		pkt_dev->sofar++;
+		pkt_dev->seq_num++;
+		goto out;
 	}
 
 	txq = skb_get_tx_queue(odev, pkt_dev->skb);
@@ -3677,6 +3749,13 @@ static int pktgen_add_device(struct pktgen_thread *t, const char *ifname)
 	if (pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)
 		pkt_dev->clone_skb = pg_clone_skb_d;
 
+	/* Keep the GRO context off odev's NAPI list, which belongs to the
+	 * driver and is only changed under its control.
+	 */
+	init_dummy_netdev(&pkt_dev->napi_dev);
+	netif_napi_add(&pkt_dev->napi_dev, &pkt_dev->napi, pktgen_napi_poll,
+		       NAPI_POLL_WEIGHT);
+
 	pkt_dev->entry = proc_create_data(ifname, 0600, t->net->proc_dir,
 					  &pktgen_if_fops, pkt_dev);
 	if (!pkt_dev->entry) {
@@ -3703,6 +3782,7 @@ static int pktgen_add_device(struct pktgen_thread *t, const char *ifname)
 
 	return add_dev_to_thread(t, pkt_dev);
 out2:
+	netif_napi_del(&pkt_dev->napi);
 	dev_put(pkt_dev->odev);
 out1:
 #ifdef CONFIG_XFRM
@@ -3796,6 +3876,8 @@ static int pktgen_remove_device(struct pktgen_thread *t,
 
 	/* Dis-associate from the interface */
 
+	netif_napi_del(&pkt_dev->napi);
+
 	if (pkt_dev->odev) {
 		dev_put(pkt_dev->odev);
 		pkt_dev->odev = NULL;
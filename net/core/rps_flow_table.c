@@ -0,0 +1,259 @@
+/*
+ * net/core/rps_flow_table.c - exact match RFS flow table
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The rps_sock_flow_table is a fixed size array indexed by the low bits
+ * of the flow hash. With many more active flows than entries, flows
+ * keep evicting each other and RFS falls back to RPS for most packets.
+ *
+ * This table is an alternative keyed by the full flow hash. It is an
+ * rhashtable, so it grows with the number of active flows, bounded by
+ * net.core.rps_flow_table_entries, and flows that neither received nor
+ * were read from for net.core.rps_flow_table_timeout are aged out by a
+ * periodic garbage collector.
+ */
+
+#include <linux/kernel.h>
+#include <linux/netdevice.h>
+#include <linux/rhashtable.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+struct rps_flow_entry {
+	struct rhash_head	node;
+	u32			hash;
+	u16			cpu;
+	unsigned long		last_used;	/* jiffies */
+	struct rcu_head		rcu;
+};
+
+struct rps_flow_table {
+	struct rhashtable	ht;
+	unsigned int		max_entries;
+	struct delayed_work	gc_work;
+};
+
+static const struct rhashtable_params rps_flow_params = {
+	.head_offset		= offsetof(struct rps_flow_entry, node),
+	.key_offset		= offsetof(struct rps_flow_entry, hash),
+	.key_len		= sizeof(u32),
+	.automatic_shrinking	= true,
+};
+
+struct rps_flow_table __rcu *rps_flow_table __read_mostly;
+EXPORT_SYMBOL(rps_flow_table);
+
+int rps_flow_table_timeout __read_mostly = 10 * HZ;
+
+/* Entries are shared by the cpu reading from the flow and the cpu
+ * receiving it: only dirty the cache line once per jiffy.
+ */
+static inline void rps_flow_entry_touch(struct rps_flow_entry *e)
+{
+	unsigned long now = jiffies;
+
+	if (READ_ONCE(e->last_used) != now)
+		WRITE_ONCE(e->last_used, now);
+}
+
+/* Called under rcu_read_lock() */
+void rps_flow_table_record(struct rps_flow_table *table, u32 hash)
+{
+	struct rps_flow_entry *e;
+	u16 cpu;
+
+	if (!hash)
+		return;
+
+	/* We only give a hint, preemption can change CPU under us */
+	cpu = raw_smp_processor_id();
+
+	e = rhashtable_lookup_fast(&table->ht, &hash, rps_flow_params);
+	if (likely(e)) {
+		if (READ_ONCE(e->cpu) != cpu)
+			WRITE_ONCE(e->cpu, cpu);
+		rps_flow_entry_touch(e);
+		return;
+	}
+
+	e = kmalloc(sizeof(*e), GFP_ATOMIC | __GFP_NOWARN);
+	if (!e)
+		return;
+
+	e->hash = hash;
+	e->cpu = cpu;
+	e->last_used = jiffies;
+
+	/* Lost a race with another recorder, or the table is full */
+	if (rhashtable_lookup_insert_fast(&table->ht, &e->node,
+					  rps_flow_params))
+		kfree(e);
+}
+EXPORT_SYMBOL(rps_flow_table_record);
+
+/* Called under rcu_read_lock(), returns RPS_NO_CPU for unknown flows */
+u16 rps_flow_table_lookup(struct rps_flow_table *table, u32 hash)
+{
+	struct rps_flow_entry *e;
+
+	e = rhashtable_lookup_fast(&table->ht, &hash, rps_flow_params);
+	if (!e)
+		return RPS_NO_CPU;
+
+	rps_flow_entry_touch(e);
+	return READ_ONCE(e->cpu);
+}
+
+static unsigned long rps_flow_gc_interval(void)
+{
+	return max_t(unsigned long, READ_ONCE(rps_flow_table_timeout) / 2,
+		     HZ);
+}
+
+/* Number of entries visited before giving the cpu and RCU a chance */
+#define RPS_FLOW_GC_BATCH	1024
+
+static void rps_flow_table_gc(struct work_struct *work)
+{
+	struct rps_flow_table *table = container_of(to_delayed_work(work),
+						    struct rps_flow_table,
+						    gc_work);
+	unsigned long timeout = READ_ONCE(rps_flow_table_timeout);
+	struct rhashtable_iter iter;
+	struct rps_flow_entry *e;
+	unsigned int n = 0;
+
+	if (rhashtable_walk_init(&table->ht, &iter, GFP_KERNEL))
+		goto out;
+
+	/* -EAGAIN only means a resize happened, keep walking */
+	rhashtable_walk_start(&iter);
+
+	while ((e = rhashtable_walk_next(&iter)) != NULL) {
+		if (IS_ERR(e)) {
+			if (PTR_ERR(e) == -EAGAIN)
+				continue;
+			break;
+		}
+
+		if (time_after(jiffies, READ_ONCE(e->last_used) + timeout) &&
+		    !rhashtable_remove_fast(&table->ht, &e->node,
+					    rps_flow_params))
+			kfree_rcu(e, rcu);
+
+		if (++n % RPS_FLOW_GC_BATCH == 0) {
+			rhashtable_walk_stop(&iter);
+			cond_resched();
+			rhashtable_walk_start(&iter);
+		}
+	}
+
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
+out:
+	schedule_delayed_work(&table->gc_work, rps_flow_gc_interval());
+}
+
+static struct rps_flow_table *rps_flow_table_alloc(unsigned int size)
+{
+	struct rhashtable_params params = rps_flow_params;
+	struct rps_flow_table *table;
+
+	table = kzalloc(sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	params.max_size = size;
+	if (rhashtable_init(&table->ht, &params)) {
+		kfree(table);
+		return NULL;
+	}
+
+	table->max_entries = size;
+	INIT_DELAYED_WORK(&table->gc_work, rps_flow_table_gc);
+	schedule_delayed_work(&table->gc_work, rps_flow_gc_interval());
+
+	return table;
+}
+
+static void rps_flow_entry_free(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+/* Caller made sure no reader can see @table anymore */
+static void rps_flow_table_free(struct rps_flow_table *table)
+{
+	cancel_delayed_work_sync(&table->gc_work);
+	rhashtable_free_and_destroy(&table->ht, rps_flow_entry_free, NULL);
+	kfree(table);
+}
+
+static DEFINE_MUTEX(rps_flow_table_mutex);
+
+unsigned int rps_flow_table_size(void)
+{
+	struct rps_flow_table *table;
+	unsigned int size;
+
+	mutex_lock(&rps_flow_table_mutex);
+	table = rcu_dereference_protected(rps_flow_table,
+				lockdep_is_held(&rps_flow_table_mutex));
+	size = table ? table->max_entries : 0;
+	mutex_unlock(&rps_flow_table_mutex);
+
+	return size;
+}
+
+/**
+ * rps_flow_table_resize - replace the exact match RFS flow table
+ * @size: maximum number of flows, 0 disables the table
+ *
+ * Recorded flows are not carried over, they are relearnt on the next
+ * recvmsg(). While the table exists it is used instead of the
+ * rps_sock_flow_table.
+ */
+int rps_flow_table_resize(unsigned int size)
+{
+	struct rps_flow_table *orig_table, *table = NULL;
+
+	if (size) {
+		/* Enforce limit to prevent overflow */
+		if (size > 1 << 29)
+			return -EINVAL;
+		size = roundup_pow_of_two(size);
+	}
+
+	mutex_lock(&rps_flow_table_mutex);
+
+	orig_table = rcu_dereference_protected(rps_flow_table,
+				lockdep_is_held(&rps_flow_table_mutex));
+	if ((orig_table ? orig_table->max_entries : 0) == size) {
+		mutex_unlock(&rps_flow_table_mutex);
+		return 0;
+	}
+
+	if (size) {
+		table = rps_flow_table_alloc(size);
+		if (!table) {
+			mutex_unlock(&rps_flow_table_mutex);
+			return -ENOMEM;
+		}
+	}
+
+	rcu_assign_pointer(rps_flow_table, table);
+	if (table)
+		static_key_slow_inc(&rps_needed);
+	if (orig_table) {
+		static_key_slow_dec(&rps_needed);
+		synchronize_rcu();
+		rps_flow_table_free(orig_table);
+	}
+
+	mutex_unlock(&rps_flow_table_mutex);
+	return 0;
+}
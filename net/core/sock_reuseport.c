@@ -13,6 +13,8 @@
 
 static DEFINE_SPINLOCK(reuseport_lock);
 
+DEFINE_PER_CPU(struct sk_reuseport_select, sk_reuseport_select);
+
 static struct sock_reuseport *__reuseport_alloc(u16 max_socks)
 {
 	size_t size = sizeof(struct sock_reuseport) +
@@ -168,7 +170,9 @@ static struct sock *run_bpf(struct sock_reuseport *reuse, u16 socks,
 			    struct bpf_prog *prog, struct sk_buff *skb,
 			    int hdr_len)
 {
+	struct sk_reuseport_select *sel;
 	struct sk_buff *nskb = NULL;
+	struct sock *sk2;
 	u32 index;
 
 	if (skb_shared(skb)) {
@@ -183,11 +187,21 @@ static struct sock *run_bpf(struct sock_reuseport *reuse, u16 socks,
 		kfree_skb(nskb);
 		return NULL;
 	}
+
+	sel = this_cpu_ptr(&sk_reuseport_select);
+	sel->reuse = reuse;
+	sel->selected = NULL;
 	index = bpf_prog_run_save_cb(prog, skb);
+	sk2 = sel->selected;
+	sel->reuse = NULL;
 	__skb_push(skb, hdr_len);
 
 	consume_skb(nskb);
 
+	/* a socket picked with bpf_sk_select_reuseport() wins */
+	if (sk2)
+		return sk2;
+
 	if (index >= socks)
 		return NULL;
 
@@ -72,6 +72,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/export.h>
+#include <linux/hash.h>
 #include <linux/vmalloc.h>
 #include <net/net_namespace.h>
 #include <net/ip.h>
@@ -141,11 +142,49 @@ struct trie_stat {
 	unsigned int nodesizes[MAX_STAT_DEPTH];
 };
 
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+/* Per-CPU cache of recent lookup results in front of the trie walk.
+ * An entry is valid only as long as its gen matches fib_cache_gen, which
+ * is bumped on every change to a trie and on every rt_cache_flush(), so
+ * a hit never returns an alias or fib_info that has been unlinked.
+ */
+#define FIB_CACHE_SHIFT	8
+#define FIB_CACHE_SIZE	(1 << FIB_CACHE_SHIFT)
+
+struct fib_cache_entry {
+	unsigned int		seq;	/* odd while being rewritten */
+	unsigned int		gen;
+
+	/* key */
+	__be32			daddr;
+	int			oif;
+	u8			tos;
+	u8			scope;
+	u8			flags;
+
+	/* result */
+	u8			prefixlen;
+	u8			nh_sel;
+	u8			type;
+	u8			res_scope;
+	int			err;
+	struct fib_info		*fi;
+	struct hlist_head	*fa_head;
+};
+
+struct fib_cache {
+	struct fib_cache_entry	entries[FIB_CACHE_SIZE];
+};
+#endif
+
 struct trie {
 	struct key_vector kv[1];
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	struct trie_use_stats __percpu *stats;
 #endif
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+	struct fib_cache __percpu *cache;
+#endif
 };
 
 static struct key_vector *resize(struct trie *t, struct key_vector *tn);
@@ -1184,6 +1223,7 @@ int fib_table_insert(struct fib_table *tb, struct fib_config *cfg)
 			}
 
 			hlist_replace_rcu(&fa->fa_list, &new_fa->fa_list);
+			fib_lookup_cache_flush();
 
 			alias_free_mem_rcu(fa);
 
@@ -1263,6 +1303,131 @@ static inline t_key prefix_mismatch(t_key key, struct key_vector *n)
 	return (key ^ prefix) & (prefix | -prefix);
 }
 
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+static atomic_t fib_cache_gen;
+
+/* Called after an alias has been unlinked, or a next hop changed state */
+void fib_lookup_cache_flush(void)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&fib_cache_gen);
+}
+
+static inline int fib_cache_oif(const struct flowi4 *flp)
+{
+	return flp->flowi4_flags & FLOWI_FLAG_SKIP_NH_OIF ?
+	       0 : flp->flowi4_oif;
+}
+
+static inline unsigned int fib_cache_hash(const struct flowi4 *flp)
+{
+	return hash_32((__force u32)flp->daddr ^ flp->flowi4_oif ^
+		       flp->flowi4_tos, FIB_CACHE_SHIFT);
+}
+
+static bool fib_cache_lookup(struct trie *t, struct fib_table *tb,
+			     const struct flowi4 *flp,
+			     struct fib_result *res, int fib_flags,
+			     unsigned int *gen, int *err)
+{
+	struct fib_cache_entry *e, c;
+	unsigned int seq;
+
+	if (!t->cache)
+		return false;
+
+	/* sample the generation before looking at the trie, so a result
+	 * computed from a trie that changed underneath us is never valid
+	 */
+	*gen = atomic_read(&fib_cache_gen);
+	smp_rmb();
+
+	e = &get_cpu_ptr(t->cache)->entries[fib_cache_hash(flp)];
+	seq = READ_ONCE(e->seq);
+	barrier();
+	c = *e;
+	barrier();
+	if (READ_ONCE(e->seq) != seq)
+		seq = 1;
+	put_cpu_ptr(t->cache);
+
+	if ((seq & 1) || c.gen != *gen || (!c.fi && !c.err) ||
+	    c.daddr != flp->daddr || c.oif != fib_cache_oif(flp) ||
+	    c.tos != flp->flowi4_tos || c.scope != flp->flowi4_scope ||
+	    c.flags != (fib_flags & FIB_LOOKUP_IGNORE_LINKSTATE))
+		return false;
+
+	*err = c.err;
+	if (c.err < 0)
+		return true;
+
+	if (!(fib_flags & FIB_LOOKUP_NOREF))
+		atomic_inc(&c.fi->fib_clntref);
+
+	res->prefixlen = c.prefixlen;
+	res->nh_sel = c.nh_sel;
+	res->type = c.type;
+	res->scope = c.res_scope;
+	res->fi = c.fi;
+	res->table = tb;
+	res->fa_head = c.fa_head;
+	return true;
+}
+
+static void fib_cache_store(struct trie *t, const struct flowi4 *flp,
+			    int fib_flags, unsigned int gen, int err,
+			    const struct fib_result *res)
+{
+	struct fib_cache_entry *e;
+
+	if (!t->cache)
+		return;
+
+	/* softirq lookups on this cpu may rewrite the same entry */
+	local_bh_disable();
+	e = &this_cpu_ptr(t->cache)->entries[fib_cache_hash(flp)];
+	WRITE_ONCE(e->seq, e->seq + 1);
+	barrier();
+
+	e->gen = gen;
+	e->daddr = flp->daddr;
+	e->oif = fib_cache_oif(flp);
+	e->tos = flp->flowi4_tos;
+	e->scope = flp->flowi4_scope;
+	e->flags = fib_flags & FIB_LOOKUP_IGNORE_LINKSTATE;
+	e->err = err;
+	if (err < 0) {
+		e->fi = NULL;
+		e->fa_head = NULL;
+	} else {
+		e->prefixlen = res->prefixlen;
+		e->nh_sel = res->nh_sel;
+		e->type = res->type;
+		e->res_scope = res->scope;
+		e->fi = res->fi;
+		e->fa_head = res->fa_head;
+	}
+
+	barrier();
+	WRITE_ONCE(e->seq, e->seq + 1);
+	local_bh_enable();
+}
+#else
+static inline bool fib_cache_lookup(struct trie *t, struct fib_table *tb,
+				    const struct flowi4 *flp,
+				    struct fib_result *res, int fib_flags,
+				    unsigned int *gen, int *err)
+{
+	return false;
+}
+
+static inline void fib_cache_store(struct trie *t, const struct flowi4 *flp,
+				   int fib_flags, unsigned int gen, int err,
+				   const struct fib_result *res)
+{
+}
+#endif /* CONFIG_IP_FIB_TRIE_CACHE */
+
 /* should be called with rcu_read_lock */
 int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 		     struct fib_result *res, int fib_flags)
@@ -1275,10 +1440,15 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 	struct key_vector *n, *pn;
 	struct fib_alias *fa;
 	unsigned long index;
+	unsigned int gen = 0;
 	t_key cindex;
+	int cerr;
 
 	trace_fib_table_lookup(tb->tb_id, flp);
 
+	if (fib_cache_lookup(t, tb, flp, res, fib_flags, &gen, &cerr))
+		return cerr;
+
 	pn = t->kv;
 	cindex = 0;
 
@@ -1410,6 +1580,7 @@ found:
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 			this_cpu_inc(stats->semantic_match_passed);
 #endif
+			fib_cache_store(t, flp, fib_flags, gen, err, NULL);
 			return err;
 		}
 		if (fi->fib_flags & RTNH_F_DEAD)
@@ -1446,6 +1617,7 @@ found:
 #endif
 			trace_fib_table_lookup_nh(nh);
 
+			fib_cache_store(t, flp, fib_flags, gen, err, res);
 			return err;
 		}
 	}
@@ -1465,6 +1637,7 @@ static void fib_remove_alias(struct trie *t, struct key_vector *tp,
 
 	/* remove the fib_alias from the list */
 	hlist_del_rcu(&old->fa_list);
+	fib_lookup_cache_flush();
 
 	/* if we emptied the list this leaf will be freed and we can sort
 	 * out parent suffix lengths as a part of trie_rebalance
@@ -1670,6 +1843,9 @@ static void fib_trie_free(struct fib_table *tb)
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	free_percpu(t->stats);
+#endif
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+	free_percpu(t->cache);
 #endif
 	kfree(tb);
 }
@@ -1779,6 +1955,7 @@ void fib_table_flush_external(struct fib_table *tb)
 			 */
 			if (tb->tb_id != fa->tb_id) {
 				hlist_del_rcu(&fa->fa_list);
+				fib_lookup_cache_flush();
 				alias_free_mem_rcu(fa);
 				continue;
 			}
@@ -1858,6 +2035,7 @@ int fib_table_flush(struct fib_table *tb)
 					       fi, fa->fa_tos, fa->fa_type,
 					       tb->tb_id);
 			hlist_del_rcu(&fa->fa_list);
+			fib_lookup_cache_flush();
 			fib_release_info(fa->fa_info);
 			alias_free_mem_rcu(fa);
 			found++;
@@ -1879,12 +2057,16 @@ int fib_table_flush(struct fib_table *tb)
 static void __trie_free_rcu(struct rcu_head *head)
 {
 	struct fib_table *tb = container_of(head, struct fib_table, rcu);
-#ifdef CONFIG_IP_FIB_TRIE_STATS
 	struct trie *t = (struct trie *)tb->tb_data;
 
-	if (tb->tb_data == tb->__data)
+	if (tb->tb_data == tb->__data) {
+#ifdef CONFIG_IP_FIB_TRIE_STATS
 		free_percpu(t->stats);
-#endif /* CONFIG_IP_FIB_TRIE_STATS */
+#endif
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+		free_percpu(t->cache);
+#endif
+	}
 	kfree(tb);
 }
 
@@ -2008,9 +2190,14 @@ struct fib_table *fib_trie_table(u32 id, struct fib_table *alias)
 	t->stats = alloc_percpu(struct trie_use_stats);
 	if (!t->stats) {
 		kfree(tb);
-		tb = NULL;
+		return NULL;
 	}
 #endif
+#ifdef CONFIG_IP_FIB_TRIE_CACHE
+	/* The cache is only an accelerator, do without it if need be */
+	if (id == RT_TABLE_MAIN)
+		t->cache = alloc_percpu(struct fib_cache);
+#endif
 
 	return tb;
 }
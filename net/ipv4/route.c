@@ -438,6 +438,7 @@ static inline bool rt_is_expired(const struct rtable *rth)
 void rt_cache_flush(struct net *net)
 {
 	rt_genid_bump_ipv4(net);
+	fib_lookup_cache_flush();
 }
 
 static struct neighbour *ipv4_neigh_lookup(const struct dst_entry *dst,
@@ -184,6 +184,58 @@ out_unlock:
 }
 EXPORT_SYMBOL(skb_udp_tunnel_segment);
 
+/* Set the length and checksum of a segment cut from a UDP_SEGMENT skb. */
+static void __udp_gso_fixup(struct sk_buff *seg, __be16 newlen)
+{
+	struct udphdr *uh = udp_hdr(seg);
+	__sum16 check;
+
+	/* uh->check holds the pseudo header sum, adjust it to the new length */
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+	uh->len = newlen;
+	uh->check = check;
+
+	if (seg->ip_summed == CHECKSUM_PARTIAL)
+		gso_reset_checksum(seg, ~check);
+	else
+		uh->check = gso_make_checksum(seg, ~check) ? : CSUM_MANGLED_0;
+}
+
+/* Split a UDP_SEGMENT skb into datagrams of gso_size payload each, the last
+ * one possibly shorter.  Unlike UFO, every segment is a complete datagram.
+ */
+static struct sk_buff *__udp4_gso_segment(struct sk_buff *gso_skb,
+					  netdev_features_t features)
+{
+	struct sk_buff *segs, *seg;
+	unsigned int mss;
+	__be16 newlen;
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (gso_skb->len <= sizeof(struct udphdr) + mss)
+		return ERR_PTR(-EINVAL);
+
+	skb_pull(gso_skb, sizeof(struct udphdr));
+
+	segs = skb_segment(gso_skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		return segs;
+
+	/* GSO partial leaves segments of several mss each for the device */
+	if (skb_is_gso(segs))
+		mss *= skb_shinfo(segs)->gso_segs;
+
+	newlen = htons(sizeof(struct udphdr) + mss);
+	for (seg = segs; seg->next; seg = seg->next)
+		__udp_gso_fixup(seg, newlen);
+
+	newlen = htons(skb_tail_pointer(seg) - skb_transport_header(seg) +
+		       seg->data_len);
+	__udp_gso_fixup(seg, newlen);
+
+	return segs;
+}
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -203,6 +255,9 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto out;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return __udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -997,10 +997,8 @@ static struct rt6_info *rt6_get_pcpu_route(struct rt6_info *rt)
 	p = this_cpu_ptr(rt->rt6i_pcpu);
 	pcpu_rt = *p;
 
-	if (pcpu_rt) {
-		dst_hold(&pcpu_rt->dst);
+	if (pcpu_rt)
 		rt6_dst_from_metrics_check(pcpu_rt);
-	}
 	return pcpu_rt;
 }
 
@@ -1078,8 +1076,16 @@ redo_rt6_select:
 	}
 
 
+	/* Routes owned by the tree, including the percpu copies, are
+	 * only freed after an RCU grace period, so a caller that stays
+	 * within rcu_read_lock() can use them without a reference.
+	 * Uncached clones always come back referenced (DST_NOCACHE).
+	 */
 	if (rt == net->ipv6.ip6_null_entry || (rt->rt6i_flags & RTF_CACHE)) {
-		dst_use(&rt->dst, jiffies);
+		if (flags & RT6_LOOKUP_F_DST_NOREF)
+			dst_use_noref(&rt->dst, jiffies);
+		else
+			dst_use(&rt->dst, jiffies);
 		read_unlock_bh(&table->tb6_lock);
 
 		rt6_dst_from_metrics_check(rt);
@@ -1102,12 +1108,14 @@ redo_rt6_select:
 		uncached_rt = ip6_rt_cache_alloc(rt, &fl6->daddr, NULL);
 		dst_release(&rt->dst);
 
-		if (uncached_rt)
+		if (uncached_rt) {
 			rt6_uncached_list_add(uncached_rt);
-		else
+			dst_hold(&uncached_rt->dst);
+		} else {
 			uncached_rt = net->ipv6.ip6_null_entry;
-
-		dst_hold(&uncached_rt->dst);
+			if (!(flags & RT6_LOOKUP_F_DST_NOREF))
+				dst_hold(&uncached_rt->dst);
+		}
 
 		trace_fib6_table_lookup(net, uncached_rt, table->tb6_id, fl6);
 		return uncached_rt;
@@ -1122,6 +1130,8 @@ redo_rt6_select:
 		pcpu_rt = rt6_get_pcpu_route(rt);
 
 		if (pcpu_rt) {
+			if (!(flags & RT6_LOOKUP_F_DST_NOREF))
+				dst_hold(&pcpu_rt->dst);
 			read_unlock_bh(&table->tb6_lock);
 		} else {
 			/* We have to do the read_unlock first
@@ -1132,6 +1142,8 @@ redo_rt6_select:
 			read_unlock_bh(&table->tb6_lock);
 			pcpu_rt = rt6_make_pcpu_route(rt);
 			dst_release(&rt->dst);
+			if (flags & RT6_LOOKUP_F_DST_NOREF)
+				dst_release(&pcpu_rt->dst);
 		}
 
 		trace_fib6_table_lookup(net, pcpu_rt, table->tb6_id, fl6);
@@ -1160,8 +1172,9 @@ void ip6_route_input(struct sk_buff *skb)
 {
 	const struct ipv6hdr *iph = ipv6_hdr(skb);
 	struct net *net = dev_net(skb->dev);
-	int flags = RT6_LOOKUP_F_HAS_SADDR;
+	int flags = RT6_LOOKUP_F_HAS_SADDR | RT6_LOOKUP_F_DST_NOREF;
 	struct ip_tunnel_info *tun_info;
+	struct dst_entry *dst;
 	struct flowi6 fl6 = {
 		.flowi6_iif = l3mdev_fib_oif(skb->dev),
 		.daddr = iph->daddr,
@@ -1175,7 +1188,11 @@ void ip6_route_input(struct sk_buff *skb)
 	if (tun_info && !(tun_info->mode & IP_TUNNEL_INFO_TX))
 		fl6.flowi6_tun_key.tun_id = tun_info->key.tun_id;
 	skb_dst_drop(skb);
-	skb_dst_set(skb, ip6_route_input_lookup(net, skb->dev, &fl6, flags));
+	dst = ip6_route_input_lookup(net, skb->dev, &fl6, flags);
+	if (dst->flags & DST_NOCACHE)
+		skb_dst_set(skb, dst);
+	else
+		skb_dst_set_noref(skb, dst);
 }
 
 static struct rt6_info *ip6_pol_route_output(struct net *net, struct fib6_table *table,
@@ -31,7 +31,6 @@
 #include <linux/net.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
-#include <linux/vmalloc.h>
 #include <linux/proc_fs.h>		/* for proc_net_* */
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -48,19 +47,19 @@
 
 /*
  * Connection hash size. Default is what was selected at compile time.
+ * The table grows with the number of connections, this is its minimum.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
-MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' minimum hash size");
 
-/* size and mask values */
+/* minimum size of the table */
 int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
 
 /*
  *  Connection hash table: for input and output packets lookups of IPVS
  */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+static struct rhashtable ip_vs_conn_tab;
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -68,16 +67,6 @@ static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
 /*  counter for no client port connections */
 static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 
-/* random value for IPVS connection hash */
-static unsigned int ip_vs_conn_rnd __read_mostly;
-
-/*
- *  Fine locking granularity for big connection hash table
- */
-#define CT_LOCKARRAY_BITS  5
-#define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
-#define CT_LOCKARRAY_MASK  (CT_LOCKARRAY_SIZE-1)
-
 /* We need an addrstrlen that works with or without v6 */
 #ifdef CONFIG_IP_VS_IPV6
 #define IP_VS_ADDRSTRLEN INET6_ADDRSTRLEN
@@ -85,54 +74,35 @@ static unsigned int ip_vs_conn_rnd __read_mostly;
 #define IP_VS_ADDRSTRLEN (8+1)
 #endif
 
-struct ip_vs_aligned_lock
-{
-	spinlock_t	l;
-} __attribute__((__aligned__(SMP_CACHE_BYTES)));
-
-/* lock array for conn table */
-static struct ip_vs_aligned_lock
-__ip_vs_conntbl_lock_array[CT_LOCKARRAY_SIZE] __cacheline_aligned;
-
-static inline void ct_write_lock_bh(unsigned int key)
-{
-	spin_lock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
-}
-
-static inline void ct_write_unlock_bh(unsigned int key)
-{
-	spin_unlock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
-}
-
 static void ip_vs_conn_expire(unsigned long data);
 
 /*
  *	Returns hash value for IPVS connection entry
  */
-static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned int proto,
-				       const union nf_inet_addr *addr,
-				       __be16 port)
+static u32 ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af,
+			      unsigned int proto,
+			      const union nf_inet_addr *addr,
+			      __be16 port, u32 seed)
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
-				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+		return jhash_3words(jhash(addr, 16, seed),
+				    (__force u32)port, proto, seed) ^
+			((size_t)ipvs>>8);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
-			    ip_vs_conn_rnd) ^
-		((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+			    seed) ^
+		((size_t)ipvs>>8);
 }
 
-static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
-					     bool inverse)
+static u32 ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
+				    bool inverse, u32 seed)
 {
 	const union nf_inet_addr *addr;
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, seed, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -142,10 +112,11 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 		port = p->vport;
 	}
 
-	return ip_vs_conn_hashkey(p->ipvs, p->af, p->protocol, addr, port);
+	return ip_vs_conn_hashkey(p->ipvs, p->af, p->protocol, addr, port,
+				  seed);
 }
 
-static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
+static u32 ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp, u32 seed)
 {
 	struct ip_vs_conn_param p;
 
@@ -158,40 +129,92 @@ static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
 		p.pe_data_len = cp->pe_data_len;
 	}
 
-	return ip_vs_conn_hashkey_param(&p, false);
+	return ip_vs_conn_hashkey_param(&p, false, seed);
+}
+
+/* Lookup key: packets from the real servers hash by their destination */
+struct ip_vs_conn_key {
+	const struct ip_vs_conn_param	*p;
+	bool				inverse;
+};
+
+static u32 ip_vs_conn_key_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct ip_vs_conn_key *key = data;
+
+	return ip_vs_conn_hashkey_param(key->p, key->inverse, seed);
+}
+
+static u32 ip_vs_conn_obj_hashfn(const void *data, u32 len, u32 seed)
+{
+	return ip_vs_conn_hashkey_conn(data, seed);
+}
+
+static inline bool ip_vs_conn_in_match(const struct ip_vs_conn *cp,
+				       const struct ip_vs_conn_param *p)
+{
+	return p->cport == cp->cport && p->vport == cp->vport &&
+	       cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	       ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
+	       ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
+	       p->protocol == cp->protocol &&
+	       cp->ipvs == p->ipvs;
+}
+
+static int ip_vs_conn_obj_cmpfn(struct rhashtable_compare_arg *arg,
+				const void *obj)
+{
+	const struct ip_vs_conn_key *key = arg->key;
+
+	return !ip_vs_conn_in_match(obj, key->p);
 }
 
+/* The table is walked by the lookups below, entries are never found by
+ * rhashtable_lookup_fast(), several connections may share a hash.
+ */
+static const struct rhashtable_params ip_vs_conn_rht_params = {
+	.head_offset		= offsetof(struct ip_vs_conn, c_node),
+	.hashfn			= ip_vs_conn_key_hashfn,
+	.obj_hashfn		= ip_vs_conn_obj_hashfn,
+	.obj_cmpfn		= ip_vs_conn_obj_cmpfn,
+	.insecure_elasticity	= true,
+	.automatic_shrinking	= true,
+};
+
 /*
  *	Hashes ip_vs_conn in ip_vs_conn_tab by netns,proto,addr,port.
  *	returns bool success.
  */
 static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	int ret;
 
 	if (cp->flags & IP_VS_CONN_F_ONE_PACKET)
 		return 0;
 
-	/* Hash by protocol, client address and port */
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
-		cp->flags |= IP_VS_CONN_F_HASHED;
-		atomic_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
-		ret = 1;
+		/* Hash by protocol, client address and port */
+		ret = rhashtable_insert_fast(&ip_vs_conn_tab, &cp->c_node,
+					     ip_vs_conn_rht_params);
+		if (!ret) {
+			cp->flags |= IP_VS_CONN_F_HASHED;
+			atomic_inc(&cp->refcnt);
+			ret = 1;
+		} else {
+			IP_VS_ERR_RL("%s(): cannot hash connection: %d\n",
+				     __func__, ret);
+			ret = 0;
+		}
 	} else {
 		pr_err("%s(): request for already hashed, called from %pF\n",
 		       __func__, __builtin_return_address(0));
 		ret = 0;
 	}
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
@@ -203,25 +226,21 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
  */
 static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	int ret;
 
 	/* unhash it and decrease its reference counter */
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		hlist_del_rcu(&cp->c_list);
+		rhashtable_remove_fast(&ip_vs_conn_tab, &cp->c_node,
+				       ip_vs_conn_rht_params);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		atomic_dec(&cp->refcnt);
 		ret = 1;
 	} else
 		ret = 0;
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
@@ -231,69 +250,82 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
  */
 static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	bool ret;
 
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
 		ret = false;
 		/* Decrease refcnt and unlink conn only if we are last user */
 		if (atomic_cmpxchg(&cp->refcnt, 1, 0) == 1) {
-			hlist_del_rcu(&cp->c_list);
+			rhashtable_remove_fast(&ip_vs_conn_tab, &cp->c_node,
+					       ip_vs_conn_rht_params);
 			cp->flags &= ~IP_VS_CONN_F_HASHED;
 			ret = true;
 		}
 	} else
 		ret = atomic_read(&cp->refcnt) ? false : true;
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
-
 /*
- *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
- *  Called for pkts coming from OUTside-to-INside.
- *	p->caddr, p->cport: pkt source address (foreign host)
- *	p->vaddr, p->vport: pkt dest address (load balancer)
+ *  Walk the chain for the key and return the first connection accepted
+ *  by match() that we could get a reference to.  Like rhashtable lookups,
+ *  continue in the new table when a resize is in progress.
  */
-static inline struct ip_vs_conn *
-__ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
+static __always_inline struct ip_vs_conn *
+ip_vs_conn_tab_find(const struct ip_vs_conn_param *p, bool inverse,
+		    bool (*match)(const struct ip_vs_conn *cp,
+				  const struct ip_vs_conn_param *p))
 {
-	unsigned int hash;
+	struct ip_vs_conn_key key = { .p = p, .inverse = inverse };
+	struct bucket_table *tbl;
+	struct rhash_head *he;
 	struct ip_vs_conn *cp;
-
-	hash = ip_vs_conn_hashkey_param(p, false);
+	unsigned int hash;
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->cport == cp->cport && p->vport == cp->vport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
-		    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
+	tbl = rht_dereference_rcu(ip_vs_conn_tab.tbl, &ip_vs_conn_tab);
+restart:
+	hash = rht_key_hashfn(&ip_vs_conn_tab, tbl, &key,
+			      ip_vs_conn_rht_params);
+	rht_for_each_entry_rcu(cp, he, tbl, hash, c_node) {
+		if (match(cp, p) && __ip_vs_conn_get(cp)) {
 			/* HIT */
 			rcu_read_unlock();
 			return cp;
 		}
 	}
 
+	/* Ensure we see any new tables. */
+	smp_rmb();
+
+	tbl = rht_dereference_rcu(tbl->future_tbl, &ip_vs_conn_tab);
+	if (unlikely(tbl))
+		goto restart;
+
 	rcu_read_unlock();
 
 	return NULL;
 }
 
+
+/*
+ *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
+ *  Called for pkts coming from OUTside-to-INside.
+ *	p->caddr, p->cport: pkt source address (foreign host)
+ *	p->vaddr, p->vport: pkt dest address (load balancer)
+ */
+static inline struct ip_vs_conn *
+__ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
+{
+	return ip_vs_conn_tab_find(p, false, ip_vs_conn_in_match);
+}
+
 struct ip_vs_conn *ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 {
 	struct ip_vs_conn *cp;
@@ -349,45 +381,33 @@ ip_vs_conn_in_get_proto(struct netns_ipvs *ipvs, int af,
 }
 EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 
+static inline bool ip_vs_ct_in_match(const struct ip_vs_conn *cp,
+				     const struct ip_vs_conn_param *p)
+{
+	if (unlikely(p->pe_data && p->pe->ct_match)) {
+		if (cp->ipvs != p->ipvs)
+			return false;
+		return p->pe == cp->pe && p->pe->ct_match(p, cp);
+	}
+
+	return cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	       /* protocol should only be IPPROTO_IP if
+		* p->vaddr is a fwmark */
+	       ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
+				p->af, p->vaddr, &cp->vaddr) &&
+	       p->vport == cp->vport && p->cport == cp->cport &&
+	       cp->flags & IP_VS_CONN_F_TEMPLATE &&
+	       p->protocol == cp->protocol &&
+	       cp->ipvs == p->ipvs;
+}
+
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
 	struct ip_vs_conn *cp;
 
-	hash = ip_vs_conn_hashkey_param(p, false);
-
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (unlikely(p->pe_data && p->pe->ct_match)) {
-			if (cp->ipvs != p->ipvs)
-				continue;
-			if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
-				if (__ip_vs_conn_get(cp))
-					goto out;
-			}
-			continue;
-		}
-
-		if (cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    /* protocol should only be IPPROTO_IP if
-		     * p->vaddr is a fwmark */
-		    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
-				     p->af, p->vaddr, &cp->vaddr) &&
-		    p->vport == cp->vport && p->cport == cp->cport &&
-		    cp->flags & IP_VS_CONN_F_TEMPLATE &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (__ip_vs_conn_get(cp))
-				goto out;
-		}
-	}
-	cp = NULL;
-
-  out:
-	rcu_read_unlock();
+	cp = ip_vs_conn_tab_find(p, false, ip_vs_ct_in_match);
 
 	IP_VS_DBG_BUF(9, "template lookup/in %s %s:%d->%s:%d %s\n",
 		      ip_vs_proto_name(p->protocol),
@@ -398,38 +418,29 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 	return cp;
 }
 
+static inline bool ip_vs_conn_out_match(const struct ip_vs_conn *cp,
+					const struct ip_vs_conn_param *p)
+{
+	return p->vport == cp->cport && p->cport == cp->dport &&
+	       cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
+	       p->protocol == cp->protocol &&
+	       cp->ipvs == p->ipvs;
+}
+
 /* Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
  * Called for pkts coming from inside-to-OUTside.
  *	p->caddr, p->cport: pkt source address (inside host)
  *	p->vaddr, p->vport: pkt dest address (foreign host) */
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
-	struct ip_vs_conn *cp, *ret=NULL;
+	struct ip_vs_conn *ret;
 
 	/*
 	 *	Check for "full" addressed entries
 	 */
-	hash = ip_vs_conn_hashkey_param(p, true);
-
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->vport == cp->cport && p->cport == cp->dport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			ret = cp;
-			break;
-		}
-	}
-
-	rcu_read_unlock();
+	ret = ip_vs_conn_tab_find(p, true, ip_vs_conn_out_match);
 
 	IP_VS_DBG_BUF(9, "lookup/out %s %s:%d->%s:%d %s\n",
 		      ip_vs_proto_name(p->protocol),
@@ -465,9 +476,15 @@ static void __ip_vs_conn_put_notimer(struct ip_vs_conn *cp)
  */
 static void __ip_vs_conn_put_timer(struct ip_vs_conn *cp)
 {
-	unsigned long t = (cp->flags & IP_VS_CONN_F_ONE_PACKET) ?
-		0 : cp->timeout;
-	mod_timer(&cp->timer, jiffies+t);
+	unsigned long expires = jiffies;
+
+	/* Round up to whole seconds: refreshes within the same second
+	 * leave the timer alone and connections idle for about the same
+	 * time are expired together, in one timer run.
+	 */
+	if (!(cp->flags & IP_VS_CONN_F_ONE_PACKET))
+		expires = round_jiffies_up(expires + cp->timeout);
+	mod_timer(&cp->timer, expires);
 
 	__ip_vs_conn_put(cp);
 }
@@ -907,7 +924,6 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 		return NULL;
 	}
 
-	INIT_HLIST_NODE(&cp->c_list);
 	setup_timer(&cp->timer, ip_vs_conn_expire, (unsigned long)cp);
 	cp->ipvs	   = ipvs;
 	cp->af		   = p->af;
@@ -1000,26 +1016,38 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 #ifdef CONFIG_PROC_FS
 struct ip_vs_iter_state {
 	struct seq_net_private	p;
-	struct hlist_head	*l;
+	struct bucket_table	*tbl;
+	unsigned int		bucket;
 };
 
+static inline struct bucket_table *ip_vs_conn_tab_rcu(void)
+{
+	return rht_dereference_rcu(ip_vs_conn_tab.tbl, &ip_vs_conn_tab);
+}
+
+/* The walk restarts from the current table after rescheduling, entries
+ * moved by a concurrent resize may be missed or shown twice.
+ */
 static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 {
-	int idx;
+	unsigned int idx;
 	struct ip_vs_conn *cp;
+	struct rhash_head *he;
 	struct ip_vs_iter_state *iter = seq->private;
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+	iter->tbl = ip_vs_conn_tab_rcu();
+	for (idx = 0; idx < iter->tbl->size; idx++) {
+		rht_for_each_entry_rcu(cp, he, iter->tbl, idx, c_node) {
 			/* __ip_vs_conn_get() is not needed by
 			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
 			 */
 			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
+				iter->bucket = idx;
 				return cp;
 			}
 		}
 		cond_resched_rcu();
+		iter->tbl = ip_vs_conn_tab_rcu();
 	}
 
 	return NULL;
@@ -1030,7 +1058,7 @@ static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 {
 	struct ip_vs_iter_state *iter = seq->private;
 
-	iter->l = NULL;
+	iter->tbl = NULL;
 	rcu_read_lock();
 	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
 }
@@ -1039,28 +1067,27 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
 	struct ip_vs_conn *cp = v;
 	struct ip_vs_iter_state *iter = seq->private;
-	struct hlist_node *e;
-	struct hlist_head *l = iter->l;
-	int idx;
+	struct rhash_head *he;
+	unsigned int idx;
 
 	++*pos;
 	if (v == SEQ_START_TOKEN)
 		return ip_vs_conn_array(seq, 0);
 
 	/* more on same hash chain? */
-	e = rcu_dereference(hlist_next_rcu(&cp->c_list));
-	if (e)
-		return hlist_entry(e, struct ip_vs_conn, c_list);
-
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
+	he = rcu_dereference(cp->c_node.next);
+	if (!rht_is_a_nulls(he))
+		return container_of(he, struct ip_vs_conn, c_node);
+
+	idx = iter->bucket;
+	while (++idx < iter->tbl->size) {
+		rht_for_each_entry_rcu(cp, he, iter->tbl, idx, c_node) {
+			iter->bucket = idx;
 			return cp;
 		}
 		cond_resched_rcu();
+		iter->tbl = ip_vs_conn_tab_rcu();
 	}
-	iter->l = NULL;
 	return NULL;
 }
 
@@ -1274,17 +1301,22 @@ static inline bool ip_vs_conn_ops_mode(struct ip_vs_conn *cp)
 /* Called from keventd and must protect itself from softirqs */
 void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx, size;
+	struct bucket_table *tbl;
 	struct ip_vs_conn *cp, *cp_c;
+	struct rhash_head *he;
 
 	rcu_read_lock();
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	size = ip_vs_conn_tab_rcu()->size;
+	for (idx = 0; idx < (size>>5); idx++) {
+		unsigned int hash;
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+		tbl = ip_vs_conn_tab_rcu();
+		hash = prandom_u32() & (tbl->size - 1);
+		rht_for_each_entry_rcu(cp, he, tbl, hash, c_node) {
 			if (cp->ipvs != ipvs)
 				continue;
 			if (cp->flags & IP_VS_CONN_F_TEMPLATE) {
@@ -1348,14 +1380,18 @@ try_drop:
  */
 static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 {
-	int idx;
+	unsigned int idx;
+	struct bucket_table *tbl;
 	struct ip_vs_conn *cp, *cp_c;
+	struct rhash_head *he;
 
 flush_again:
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	/* Entries missed during a resize are caught by the next pass */
+	tbl = ip_vs_conn_tab_rcu();
+	for (idx = 0; idx < tbl->size; idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+		rht_for_each_entry_rcu(cp, he, tbl, idx, c_node) {
 			if (cp->ipvs != ipvs)
 				continue;
 			IP_VS_DBG(4, "del connection\n");
@@ -1369,6 +1405,7 @@ flush_again:
 			}
 		}
 		cond_resched_rcu();
+		tbl = ip_vs_conn_tab_rcu();
 	}
 	rcu_read_unlock();
 
@@ -1402,45 +1439,37 @@ void __net_exit ip_vs_conn_net_cleanup(struct netns_ipvs *ipvs)
 
 int __init ip_vs_conn_init(void)
 {
-	int idx;
+	struct rhashtable_params params = ip_vs_conn_rht_params;
+	int ret;
 
-	/* Compute size and mask */
+	/* Compute the minimum size */
 	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
+	params.min_size = ip_vs_conn_tab_size;
+	/* start at the minimum size */
+	params.nelem_hint = ip_vs_conn_tab_size * 3 / 4;
 
 	/*
-	 * Allocate the connection hash table and initialize its list heads
+	 * Allocate the connection hash table, it grows and shrinks
+	 * with the number of connections
 	 */
-	ip_vs_conn_tab = vmalloc(ip_vs_conn_tab_size * sizeof(*ip_vs_conn_tab));
-	if (!ip_vs_conn_tab)
-		return -ENOMEM;
+	ret = rhashtable_init(&ip_vs_conn_tab, &params);
+	if (ret)
+		return ret;
 
 	/* Allocate ip_vs_conn slab cache */
 	ip_vs_conn_cachep = kmem_cache_create("ip_vs_conn",
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
 	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+		rhashtable_destroy(&ip_vs_conn_tab);
 		return -ENOMEM;
 	}
 
-	pr_info("Connection hash table configured "
-		"(size=%d, memory=%ldKbytes)\n",
-		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
+	pr_info("Connection hash table configured (minimum size=%d)\n",
+		ip_vs_conn_tab_size);
 	IP_VS_DBG(0, "Each connection entry needs %Zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
-
-	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
-		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
-	}
-
-	/* calculate the random value for connection hash */
-	get_random_bytes(&ip_vs_conn_rnd, sizeof(ip_vs_conn_rnd));
-
 	return 0;
 }
 
@@ -1450,5 +1479,5 @@ void ip_vs_conn_cleanup(void)
 	rcu_barrier();
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
+	rhashtable_destroy(&ip_vs_conn_tab);
 }
@@ -104,7 +104,7 @@ ip_vs_sip_fill_param(struct ip_vs_conn_param *p, struct sk_buff *skb)
 }
 
 static bool ip_vs_sip_ct_match(const struct ip_vs_conn_param *p,
-				  struct ip_vs_conn *ct)
+				  const struct ip_vs_conn *ct)
 
 {
 	bool ret = false;
@@ -24,29 +24,90 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
 
 #include <net/ip_vs.h>
 
 
+/*
+ * Every CPU goes round its own cursor, so scheduling does not bounce a
+ * shared lock and position between CPUs.  Each CPU still visits the
+ * destinations in turn, which keeps the overall distribution even.
+ */
+struct ip_vs_rr_cpu {
+	spinlock_t		lock;
+	struct list_head	*last;		/* last scheduled dest */
+} ____cacheline_aligned_in_smp;
+
+struct ip_vs_rr_state {
+	struct ip_vs_rr_cpu __percpu	*cpu;
+	struct rcu_head			rcu_head;
+};
+
+
 static int ip_vs_rr_init_svc(struct ip_vs_service *svc)
 {
-	svc->sched_data = &svc->destinations;
+	struct ip_vs_rr_state *s;
+	int cpu;
+
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+	s->cpu = alloc_percpu(struct ip_vs_rr_cpu);
+	if (!s->cpu) {
+		kfree(s);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct ip_vs_rr_cpu *c = per_cpu_ptr(s->cpu, cpu);
+
+		spin_lock_init(&c->lock);
+		c->last = &svc->destinations;
+	}
+
+	svc->sched_data = s;
 	return 0;
 }
 
 
+static void ip_vs_rr_state_free(struct rcu_head *head)
+{
+	struct ip_vs_rr_state *s = container_of(head, struct ip_vs_rr_state,
+						rcu_head);
+
+	free_percpu(s->cpu);
+	kfree(s);
+}
+
+static void ip_vs_rr_done_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_rr_state *s = svc->sched_data;
+
+	call_rcu(&s->rcu_head, ip_vs_rr_state_free);
+}
+
+
 static int ip_vs_rr_del_dest(struct ip_vs_service *svc, struct ip_vs_dest *dest)
 {
+	struct ip_vs_rr_state *s = svc->sched_data;
 	struct list_head *p;
+	int cpu;
 
-	spin_lock_bh(&svc->sched_lock);
-	p = (struct list_head *) svc->sched_data;
-	/* dest is already unlinked, so p->prev is not valid but
-	 * p->next is valid, use it to reach previous entry.
-	 */
-	if (p == &dest->n_list)
-		svc->sched_data = p->next->prev;
-	spin_unlock_bh(&svc->sched_lock);
+	for_each_possible_cpu(cpu) {
+		struct ip_vs_rr_cpu *c = per_cpu_ptr(s->cpu, cpu);
+
+		spin_lock_bh(&c->lock);
+		p = c->last;
+		/* dest is already unlinked, so p->prev is not valid but
+		 * p->next is valid, use it to reach previous entry.
+		 */
+		if (p == &dest->n_list)
+			c->last = p->next->prev;
+		spin_unlock_bh(&c->lock);
+	}
 	return 0;
 }
 
@@ -58,14 +119,18 @@ static struct ip_vs_dest *
 ip_vs_rr_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
 		  struct ip_vs_iphdr *iph)
 {
+	struct ip_vs_rr_state *s = svc->sched_data;
+	struct ip_vs_rr_cpu *c;
 	struct list_head *p;
 	struct ip_vs_dest *dest, *last;
 	int pass = 0;
 
 	IP_VS_DBG(6, "%s(): Scheduling...\n", __func__);
 
-	spin_lock_bh(&svc->sched_lock);
-	p = (struct list_head *) svc->sched_data;
+	local_bh_disable();
+	c = this_cpu_ptr(s->cpu);
+	spin_lock(&c->lock);
+	p = c->last;
 	last = dest = list_entry(p, struct ip_vs_dest, n_list);
 
 	do {
@@ -86,13 +151,15 @@ ip_vs_rr_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
 	} while (pass < 2 && p != &svc->destinations);
 
 stop:
-	spin_unlock_bh(&svc->sched_lock);
+	spin_unlock(&c->lock);
+	local_bh_enable();
 	ip_vs_scheduler_err(svc, "no destination available");
 	return NULL;
 
   out:
-	svc->sched_data = &dest->n_list;
-	spin_unlock_bh(&svc->sched_lock);
+	c->last = &dest->n_list;
+	spin_unlock(&c->lock);
+	local_bh_enable();
 	IP_VS_DBG_BUF(6, "RR: server %s:%u "
 		      "activeconns %d refcnt %d weight %d\n",
 		      IP_VS_DBG_ADDR(dest->af, &dest->addr), ntohs(dest->port),
@@ -109,6 +176,7 @@ static struct ip_vs_scheduler ip_vs_rr_scheduler = {
 	.module =		THIS_MODULE,
 	.n_list =		LIST_HEAD_INIT(ip_vs_rr_scheduler.n_list),
 	.init_service =		ip_vs_rr_init_svc,
+	.done_service =		ip_vs_rr_done_svc,
 	.add_dest =		NULL,
 	.del_dest =		ip_vs_rr_del_dest,
 	.schedule =		ip_vs_rr_schedule,
@@ -123,6 +191,8 @@ static void __exit ip_vs_rr_cleanup(void)
 {
 	unregister_ip_vs_scheduler(&ip_vs_rr_scheduler);
 	synchronize_rcu();
+	/* Wait for ip_vs_rr_state_free() callbacks to complete */
+	rcu_barrier();
 }
 
 module_init(ip_vs_rr_init);
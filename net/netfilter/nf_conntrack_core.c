@@ -35,6 +35,7 @@
 #include <linux/mm.h>
 #include <linux/nsproxy.h>
 #include <linux/rculist_nulls.h>
+#include <linux/workqueue.h>
 
 #include <net/netfilter/nf_conntrack.h>
 #include <net/netfilter/nf_conntrack_l3proto.h>
@@ -886,6 +887,106 @@ restart:
 	return ret;
 }
 
+/*
+ * Early drop only ever looks at a handful of chains, and only once the
+ * table is already full.  Under a SYN flood that means every new
+ * connection pays for a failed search.  Instead, once a namespace gets
+ * close to nf_conntrack_max, a worker walks the table a slice at a time
+ * and evicts entries that have never seen a reply, until the pressure
+ * is gone.
+ */
+#define GC_MAX_BUCKETS_DIV	64u
+#define GC_MAX_BUCKETS		8192u
+#define GC_INTERVAL		(HZ / 10)
+
+static struct delayed_work conntrack_gc_work;
+static unsigned int conntrack_gc_next_bucket;
+
+static bool nf_ct_under_pressure(const struct net *net)
+{
+	unsigned int max = nf_conntrack_max;
+
+	return max && atomic_read(&net->ct.count) > max - max / 8;
+}
+
+static bool gc_evict(struct nf_conn *ct)
+{
+	bool ret = false;
+
+	if (!atomic_inc_not_zero(&ct->ct_general.use))
+		return false;
+
+	/* recheck, the entry may have been reused under us */
+	if (nf_ct_is_confirmed(ct) && !nf_ct_is_dying(ct) &&
+	    !test_bit(IPS_SEEN_REPLY_BIT, &ct->status) &&
+	    del_timer(&ct->timeout)) {
+		if (nf_ct_delete(ct, 0, 0)) {
+			NF_CT_STAT_INC_ATOMIC(nf_ct_net(ct), early_drop);
+			ret = true;
+		}
+	}
+
+	nf_ct_put(ct);
+	return ret;
+}
+
+static void gc_worker(struct work_struct *work)
+{
+	unsigned int i, goal, buckets = 0;
+	bool pressure = false;
+
+	goal = clamp(nf_conntrack_htable_size / GC_MAX_BUCKETS_DIV, 1u,
+		     GC_MAX_BUCKETS);
+	i = conntrack_gc_next_bucket;
+
+	do {
+		struct nf_conntrack_tuple_hash *h;
+		struct hlist_nulls_head *ct_hash;
+		struct hlist_nulls_node *n;
+		unsigned int hashsz, seq;
+		struct nf_conn *tmp;
+
+		rcu_read_lock();
+		do {
+			seq = read_seqcount_begin(&nf_conntrack_generation);
+			hashsz = nf_conntrack_htable_size;
+			ct_hash = nf_conntrack_hash;
+		} while (read_seqcount_retry(&nf_conntrack_generation, seq));
+
+		if (i >= hashsz)
+			i = 0;
+
+		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
+			tmp = nf_ct_tuplehash_to_ctrack(h);
+
+			if (NF_CT_DIRECTION(h) != IP_CT_DIR_ORIGINAL ||
+			    test_bit(IPS_SEEN_REPLY_BIT, &tmp->status) ||
+			    nf_ct_is_dying(tmp) ||
+			    !nf_ct_under_pressure(nf_ct_net(tmp)))
+				continue;
+
+			pressure = true;
+			gc_evict(tmp);
+		}
+		rcu_read_unlock();
+
+		cond_resched();
+		i++;
+	} while (++buckets < goal);
+
+	conntrack_gc_next_bucket = i;
+
+	if (pressure)
+		queue_delayed_work(system_long_wq, &conntrack_gc_work,
+				   GC_INTERVAL);
+}
+
+static void nf_conntrack_gc_kick(void)
+{
+	if (!delayed_work_pending(&conntrack_gc_work))
+		queue_delayed_work(system_long_wq, &conntrack_gc_work, 0);
+}
+
 static struct nf_conn *
 __nf_conntrack_alloc(struct net *net,
 		     const struct nf_conntrack_zone *zone,
@@ -898,6 +999,9 @@ __nf_conntrack_alloc(struct net *net,
 	/* We don't want any race condition at early drop stage */
 	atomic_inc(&net->ct.count);
 
+	if (unlikely(nf_ct_under_pressure(net)))
+		nf_conntrack_gc_kick();
+
 	if (nf_conntrack_max &&
 	    unlikely(atomic_read(&net->ct.count) > nf_conntrack_max)) {
 		if (!early_drop(net, hash)) {
@@ -1530,6 +1634,8 @@ void nf_conntrack_cleanup_end(void)
 	while (untrack_refs() > 0)
 		schedule();
 
+	cancel_delayed_work_sync(&conntrack_gc_work);
+
 	nf_ct_free_hashtable(nf_conntrack_hash, nf_conntrack_htable_size);
 
 #ifdef CONFIG_NF_CONNTRACK_ZONES
@@ -1696,6 +1802,7 @@ int nf_conntrack_init_start(void)
 	int i, cpu;
 
 	seqcount_init(&nf_conntrack_generation);
+	INIT_DELAYED_WORK(&conntrack_gc_work, gc_worker);
 
 	for (i = 0; i < CONNTRACK_LOCKS; i++)
 		spin_lock_init(&nf_conntrack_locks[i]);
@@ -0,0 +1,779 @@
+/*
+ * Flow table: forward established connections from the ingress hook
+ *
+ * Once a forward chain has decided to offload a conntrack entry, both of
+ * its directions are placed in a per-netns hash table keyed on the
+ * packet tuple and the input device.  An ingress hook on the configured
+ * devices looks every IPv4 packet up in it and, on a hit, applies the NAT
+ * mangling, decrements the TTL and hands the packet to the neighbour
+ * layer, skipping the prerouting, forward and postrouting hooks, the
+ * conntrack lookup and the route lookup.
+ *
+ * Anything the fast path does not handle (options, fragments, expiring
+ * TTLs, packets above the path MTU, TCP FIN and RST) goes through the
+ * normal path.  Flows that see no traffic for NF_FLOW_TIMEOUT, whose
+ * route has become stale, or whose conntrack entry is going away are
+ * removed by a periodic garbage collector.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/netfilter.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/rhashtable.h>
+#include <linux/workqueue.h>
+#include <net/ip.h>
+#include <net/neighbour.h>
+#include <net/netns/generic.h>
+#include <net/route.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+#include <net/netfilter/nf_flow_table.h>
+
+/* How far ahead the conntrack timer is pushed while a flow is offloaded */
+#define NF_FLOW_CT_TIMEOUT	(2 * NF_FLOW_TIMEOUT)
+#define NF_FLOW_GC_INTERVAL	HZ
+
+struct nf_flow_dev {
+	struct list_head	list;
+	struct nf_hook_ops	ops;
+	char			name[IFNAMSIZ];
+	int			ifindex;	/* 0 while not hooked */
+	unsigned int		users;
+	struct rcu_head		rcu_head;
+};
+
+struct nf_flowtable {
+	struct rhashtable	rhashtable;
+	struct delayed_work	gc_work;
+	struct mutex		lock;		/* devices and gc */
+	struct list_head	devices;
+	struct net		*net;
+};
+
+static int nf_flow_table_net_id __read_mostly;
+
+static inline struct nf_flowtable *nf_flow_table_pernet(struct net *net)
+{
+	return net_generic(net, nf_flow_table_net_id);
+}
+
+static const struct rhashtable_params nf_flow_offload_rhash_params = {
+	.head_offset	= offsetof(struct flow_offload_tuple_rhash, node),
+	.key_offset	= offsetof(struct flow_offload_tuple_rhash, tuple),
+	.key_len	= offsetof(struct flow_offload_tuple, dir),
+	.automatic_shrinking = true,
+};
+
+static inline u32 nf_flow_timestamp(void)
+{
+	return (u32)jiffies;
+}
+
+static bool nf_flow_has_expired(const struct flow_offload *flow)
+{
+	return (__s32)(flow->timeout - nf_flow_timestamp()) <= 0;
+}
+
+static void flow_offload_fill_dir(struct flow_offload *flow,
+				  struct nf_conn *ct,
+				  struct nf_flow_route *route,
+				  enum flow_offload_tuple_dir dir)
+{
+	struct flow_offload_tuple *ft = &flow->tuplehash[dir].tuple;
+	struct nf_conntrack_tuple *ctt = &ct->tuplehash[dir].tuple;
+	struct dst_entry *dst = route->tuple[dir].dst;
+
+	ft->src_v4 = ctt->src.u3.ip;
+	ft->dst_v4 = ctt->dst.u3.ip;
+	ft->src_port = ctt->src.u.tcp.port;
+	ft->dst_port = ctt->dst.u.tcp.port;
+	ft->iifidx = route->tuple[dir].ifindex;
+	ft->l4proto = ctt->dst.protonum;
+	ft->dir = dir;
+
+	ft->mtu = ip_dst_mtu_maybe_forward(dst, true);
+	ft->oifidx = dst->dev->ifindex;
+	ft->dst_cache = dst;
+}
+
+/**
+ * flow_offload_alloc - build a flow for an established conntrack entry
+ * @ct: the conntrack entry
+ * @route: output route and input device for each direction
+ *
+ * Takes its own references on @ct and on both routes.  Returns NULL if
+ * the conntrack entry is going away or on allocation failure.
+ */
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route)
+{
+	struct flow_offload *flow;
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow)
+		return NULL;
+
+	if (!atomic_inc_not_zero(&ct->ct_general.use))
+		goto err_ct;
+
+	dst_hold(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst);
+	dst_hold(route->tuple[FLOW_OFFLOAD_DIR_REPLY].dst);
+
+	flow->ct = ct;
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_ORIGINAL);
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_REPLY);
+
+	if (ct->status & IPS_NAT_MASK)
+		__set_bit(FLOW_OFFLOAD_NAT_BIT, &flow->flags);
+
+	return flow;
+
+err_ct:
+	kfree(flow);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(flow_offload_alloc);
+
+void flow_offload_free(struct flow_offload *flow)
+{
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_cache);
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_cache);
+	nf_ct_put(flow->ct);
+	kfree_rcu(flow, rcu_head);
+}
+EXPORT_SYMBOL_GPL(flow_offload_free);
+
+static bool nf_flow_dev_hooked(struct nf_flowtable *ft, int ifindex)
+{
+	struct nf_flow_dev *fd;
+
+	list_for_each_entry_rcu(fd, &ft->devices, list) {
+		if (READ_ONCE(fd->ifindex) == ifindex)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * flow_offload_add - insert a flow into the table of its namespace
+ * @net: network namespace
+ * @flow: flow built by flow_offload_alloc()
+ *
+ * Fails with -EOPNOTSUPP unless the input device of each direction has
+ * the fast path attached.  On failure the caller still owns @flow.
+ */
+int flow_offload_add(struct net *net, struct flow_offload *flow)
+{
+	struct nf_flowtable *ft = nf_flow_table_pernet(net);
+	int err;
+
+	rcu_read_lock();
+	if (!nf_flow_dev_hooked(ft,
+		flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.iifidx) ||
+	    !nf_flow_dev_hooked(ft,
+		flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.iifidx)) {
+		rcu_read_unlock();
+		return -EOPNOTSUPP;
+	}
+	rcu_read_unlock();
+
+	flow->timeout = nf_flow_timestamp() + NF_FLOW_TIMEOUT;
+
+	err = rhashtable_insert_fast(&ft->rhashtable,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node,
+			nf_flow_offload_rhash_params);
+	if (err < 0)
+		return err;
+
+	err = rhashtable_insert_fast(&ft->rhashtable,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
+			nf_flow_offload_rhash_params);
+	if (err < 0) {
+		rhashtable_remove_fast(&ft->rhashtable,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node,
+			nf_flow_offload_rhash_params);
+		return err;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(flow_offload_add);
+
+/**
+ * flow_offload_teardown - hand a flow back to the slow path
+ * @flow: the flow
+ *
+ * The fast path stops using @flow right away, the garbage collector
+ * frees it on its next run.
+ */
+void flow_offload_teardown(struct flow_offload *flow)
+{
+	set_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags);
+}
+EXPORT_SYMBOL_GPL(flow_offload_teardown);
+
+static void flow_offload_del(struct nf_flowtable *ft, struct flow_offload *flow)
+{
+	if (test_and_set_bit(FLOW_OFFLOAD_DYING_BIT, &flow->flags))
+		return;
+
+	rhashtable_remove_fast(&ft->rhashtable,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node,
+			nf_flow_offload_rhash_params);
+	rhashtable_remove_fast(&ft->rhashtable,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
+			nf_flow_offload_rhash_params);
+
+	clear_bit(IPS_OFFLOAD_BIT, &flow->ct->status);
+	flow_offload_free(flow);
+}
+
+/* Keep conntrack from timing out a connection it no longer sees */
+static void flow_offload_refresh_ct(struct nf_conn *ct)
+{
+	unsigned long newtime = jiffies + NF_FLOW_CT_TIMEOUT;
+
+	if (test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
+		return;
+
+	if (time_after(newtime, ct->timeout.expires + HZ))
+		mod_timer_pending(&ct->timeout, newtime);
+}
+
+static bool flow_offload_stale(const struct flow_offload *flow)
+{
+	return test_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags) ||
+	       nf_flow_has_expired(flow) ||
+	       nf_ct_is_dying(flow->ct);
+}
+
+/*
+ * Walk the table and remove every flow for which @remove returns true.
+ * Flows that stay get their conntrack entry refreshed.
+ */
+static void nf_flow_table_iterate(struct nf_flowtable *ft,
+				  bool (*remove)(const struct flow_offload *,
+						 void *),
+				  void *data)
+{
+	struct flow_offload_tuple_rhash *tuplehash;
+	struct rhashtable_iter hti;
+	struct flow_offload *flow;
+	int err;
+
+	err = rhashtable_walk_init(&ft->rhashtable, &hti, GFP_KERNEL);
+	if (err)
+		return;
+
+	err = rhashtable_walk_start(&hti);
+	if (err && err != -EAGAIN)
+		goto out;
+
+	while ((tuplehash = rhashtable_walk_next(&hti))) {
+		if (IS_ERR(tuplehash)) {
+			if (PTR_ERR(tuplehash) == -EAGAIN)
+				continue;
+			break;
+		}
+		if (tuplehash->tuple.dir)
+			continue;
+
+		flow = container_of(tuplehash, struct flow_offload,
+				    tuplehash[0]);
+		if (remove(flow, data))
+			flow_offload_del(ft, flow);
+		else
+			flow_offload_refresh_ct(flow->ct);
+	}
+out:
+	rhashtable_walk_stop(&hti);
+	rhashtable_walk_exit(&hti);
+}
+
+static bool nf_flow_gc_remove(const struct flow_offload *flow, void *data)
+{
+	return flow_offload_stale(flow);
+}
+
+static void nf_flow_offload_work_gc(struct work_struct *work)
+{
+	struct nf_flowtable *ft;
+
+	ft = container_of(work, struct nf_flowtable, gc_work.work);
+
+	mutex_lock(&ft->lock);
+	nf_flow_table_iterate(ft, nf_flow_gc_remove, NULL);
+	mutex_unlock(&ft->lock);
+
+	queue_delayed_work(system_power_efficient_wq, &ft->gc_work,
+			   NF_FLOW_GC_INTERVAL);
+}
+
+/*
+ * IPv4 fast path
+ */
+
+struct flow_ports {
+	__be16 source, dest;
+};
+
+static int nf_flow_tuple_ip(struct sk_buff *skb, const struct net_device *dev,
+			    struct flow_offload_tuple *tuple)
+{
+	struct flow_ports *ports;
+	unsigned int thoff;
+	struct iphdr *iph;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	thoff = iph->ihl * 4;
+
+	if (ip_is_fragment(iph) ||
+	    unlikely(thoff != sizeof(struct iphdr)))
+		return -1;
+
+	if (iph->protocol != IPPROTO_TCP &&
+	    iph->protocol != IPPROTO_UDP)
+		return -1;
+
+	if (iph->ttl <= 1)
+		return -1;
+
+	if (!pskb_may_pull(skb, thoff + sizeof(*ports)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	ports = (struct flow_ports *)(skb_network_header(skb) + thoff);
+
+	tuple->src_v4 = iph->saddr;
+	tuple->dst_v4 = iph->daddr;
+	tuple->src_port = ports->source;
+	tuple->dst_port = ports->dest;
+	tuple->iifidx = dev->ifindex;
+	tuple->l4proto = iph->protocol;
+
+	return 0;
+}
+
+static unsigned int nf_flow_l4_hdrsize(u8 l4proto)
+{
+	return l4proto == IPPROTO_TCP ? sizeof(struct tcphdr) :
+					sizeof(struct udphdr);
+}
+
+/* FIN and RST go through conntrack so that it sees the connection end */
+static bool nf_flow_tcp_state_check(struct flow_offload *flow,
+				    struct sk_buff *skb, unsigned int thoff)
+{
+	struct tcphdr *tcph;
+
+	if (!pskb_may_pull(skb, thoff + sizeof(*tcph)))
+		return true;
+
+	tcph = (struct tcphdr *)(skb_network_header(skb) + thoff);
+	if (unlikely(tcph->fin || tcph->rst)) {
+		flow_offload_teardown(flow);
+		return true;
+	}
+
+	return false;
+}
+
+static void nf_flow_nat_l4_addr(struct sk_buff *skb, struct iphdr *iph,
+				unsigned int thoff, __be32 addr, __be32 new_addr)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		tcph = (void *)iph + thoff;
+		inet_proto_csum_replace4(&tcph->check, skb, addr, new_addr,
+					 true);
+		break;
+	case IPPROTO_UDP:
+		udph = (void *)iph + thoff;
+		if (udph->check || skb->ip_summed == CHECKSUM_PARTIAL) {
+			inet_proto_csum_replace4(&udph->check, skb, addr,
+						 new_addr, true);
+			if (!udph->check)
+				udph->check = CSUM_MANGLED_0;
+		}
+		break;
+	}
+}
+
+static void nf_flow_nat_l4_port(struct sk_buff *skb, struct iphdr *iph,
+				unsigned int thoff, __be16 port, __be16 new_port)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		tcph = (void *)iph + thoff;
+		inet_proto_csum_replace2(&tcph->check, skb, port, new_port,
+					 false);
+		break;
+	case IPPROTO_UDP:
+		udph = (void *)iph + thoff;
+		if (udph->check || skb->ip_summed == CHECKSUM_PARTIAL) {
+			inet_proto_csum_replace2(&udph->check, skb, port,
+						 new_port, false);
+			if (!udph->check)
+				udph->check = CSUM_MANGLED_0;
+		}
+		break;
+	}
+}
+
+/*
+ * A packet travelling in direction @dir leaves with the addresses and
+ * ports the other direction's tuple expects to come back.
+ */
+static void nf_flow_nat_ip(const struct flow_offload *flow,
+			   struct sk_buff *skb, unsigned int thoff,
+			   enum flow_offload_tuple_dir dir)
+{
+	const struct flow_offload_tuple *other = &flow->tuplehash[!dir].tuple;
+	struct iphdr *iph = ip_hdr(skb);
+	struct flow_ports *ports = (void *)iph + thoff;
+
+	if (iph->saddr != other->dst_v4) {
+		nf_flow_nat_l4_addr(skb, iph, thoff, iph->saddr,
+				    other->dst_v4);
+		csum_replace4(&iph->check, iph->saddr, other->dst_v4);
+		iph->saddr = other->dst_v4;
+	}
+	if (iph->daddr != other->src_v4) {
+		nf_flow_nat_l4_addr(skb, iph, thoff, iph->daddr,
+				    other->src_v4);
+		csum_replace4(&iph->check, iph->daddr, other->src_v4);
+		iph->daddr = other->src_v4;
+	}
+	if (ports->source != other->dst_port) {
+		nf_flow_nat_l4_port(skb, iph, thoff, ports->source,
+				    other->dst_port);
+		ports->source = other->dst_port;
+	}
+	if (ports->dest != other->src_port) {
+		nf_flow_nat_l4_port(skb, iph, thoff, ports->dest,
+				    other->src_port);
+		ports->dest = other->src_port;
+	}
+}
+
+static unsigned int nf_flow_offload_ip_hook(void *priv, struct sk_buff *skb,
+					    const struct nf_hook_state *state)
+{
+	struct nf_flowtable *ft = priv;
+	struct flow_offload_tuple_rhash *tuplehash;
+	struct flow_offload_tuple tuple = {};
+	enum flow_offload_tuple_dir dir;
+	struct flow_offload *flow;
+	struct net_device *outdev;
+	unsigned int thoff;
+	struct rtable *rt;
+	struct iphdr *iph;
+	__be32 nexthop;
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return NF_ACCEPT;
+
+	if (nf_flow_tuple_ip(skb, state->in, &tuple) < 0)
+		return NF_ACCEPT;
+
+	tuplehash = rhashtable_lookup_fast(&ft->rhashtable, &tuple,
+					   nf_flow_offload_rhash_params);
+	if (!tuplehash)
+		return NF_ACCEPT;
+
+	dir = tuplehash->tuple.dir;
+	flow = container_of(tuplehash, struct flow_offload, tuplehash[dir]);
+	if (unlikely(flow->flags & (BIT(FLOW_OFFLOAD_TEARDOWN_BIT) |
+				    BIT(FLOW_OFFLOAD_DYING_BIT))))
+		return NF_ACCEPT;
+
+	rt = (struct rtable *)tuplehash->tuple.dst_cache;
+	if (unlikely(!dst_check(&rt->dst, 0))) {
+		flow_offload_teardown(flow);
+		return NF_ACCEPT;
+	}
+
+	if (unlikely(skb->len > tuplehash->tuple.mtu))
+		return NF_ACCEPT;
+
+	thoff = ip_hdrlen(skb);
+	if (tuple.l4proto == IPPROTO_TCP &&
+	    nf_flow_tcp_state_check(flow, skb, thoff))
+		return NF_ACCEPT;
+
+	if (!skb_make_writable(skb, thoff + nf_flow_l4_hdrsize(tuple.l4proto)))
+		return NF_DROP;
+
+	if (test_bit(FLOW_OFFLOAD_NAT_BIT, &flow->flags))
+		nf_flow_nat_ip(flow, skb, thoff, dir);
+
+	flow->timeout = nf_flow_timestamp() + NF_FLOW_TIMEOUT;
+
+	iph = ip_hdr(skb);
+	ip_decrease_ttl(iph);
+
+	outdev = rt->dst.dev;
+	skb->dev = outdev;
+	nexthop = rt_nexthop(rt, iph->daddr);
+	skb_dst_set_noref(skb, &rt->dst);
+	neigh_xmit(NEIGH_ARP_TABLE, outdev, &nexthop, skb);
+
+	return NF_STOLEN;
+}
+
+/*
+ * Devices
+ *
+ * The fast path is attached by name, so that a device can be listed
+ * before it exists and keeps its hook across unregister/register.
+ */
+
+static int nf_flow_dev_attach(struct nf_flowtable *ft,
+			      struct nf_flow_dev *fd, struct net_device *dev)
+{
+	int err;
+
+	fd->ops.hook = nf_flow_offload_ip_hook;
+	fd->ops.pf = NFPROTO_NETDEV;
+	fd->ops.hooknum = NF_NETDEV_INGRESS;
+	fd->ops.priority = 0;
+	fd->ops.priv = ft;
+	fd->ops.dev = dev;
+
+	err = nf_register_net_hook(ft->net, &fd->ops);
+	if (err < 0) {
+		fd->ops.dev = NULL;
+		return err;
+	}
+
+	WRITE_ONCE(fd->ifindex, dev->ifindex);
+	return 0;
+}
+
+static void nf_flow_dev_detach(struct nf_flowtable *ft,
+			       struct nf_flow_dev *fd)
+{
+	if (!fd->ops.dev)
+		return;
+
+	WRITE_ONCE(fd->ifindex, 0);
+	nf_unregister_net_hook(ft->net, &fd->ops);
+	fd->ops.dev = NULL;
+}
+
+static struct nf_flow_dev *nf_flow_dev_find(struct nf_flowtable *ft,
+					    const char *name)
+{
+	struct nf_flow_dev *fd;
+
+	list_for_each_entry(fd, &ft->devices, list) {
+		if (!strncmp(fd->name, name, IFNAMSIZ))
+			return fd;
+	}
+	return NULL;
+}
+
+/**
+ * nf_flow_table_dev_hook - attach the fast path to a device
+ * @net: network namespace
+ * @name: device name
+ *
+ * Reference counted; the device does not have to exist yet.
+ */
+int nf_flow_table_dev_hook(struct net *net, const char *name)
+{
+	struct nf_flowtable *ft = nf_flow_table_pernet(net);
+	struct net_device *dev;
+	struct nf_flow_dev *fd;
+	int err = 0;
+
+	mutex_lock(&ft->lock);
+	fd = nf_flow_dev_find(ft, name);
+	if (fd) {
+		fd->users++;
+		goto out;
+	}
+
+	fd = kzalloc(sizeof(*fd), GFP_KERNEL);
+	if (!fd) {
+		err = -ENOMEM;
+		goto out;
+	}
+	strlcpy(fd->name, name, IFNAMSIZ);
+	fd->users = 1;
+
+	dev = dev_get_by_name(net, name);
+	if (dev) {
+		if (dev->reg_state == NETREG_REGISTERED)
+			err = nf_flow_dev_attach(ft, fd, dev);
+		dev_put(dev);
+	}
+	if (err < 0) {
+		kfree(fd);
+		goto out;
+	}
+
+	list_add_tail_rcu(&fd->list, &ft->devices);
+out:
+	mutex_unlock(&ft->lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(nf_flow_table_dev_hook);
+
+void nf_flow_table_dev_unhook(struct net *net, const char *name)
+{
+	struct nf_flowtable *ft = nf_flow_table_pernet(net);
+	struct nf_flow_dev *fd;
+
+	mutex_lock(&ft->lock);
+	fd = nf_flow_dev_find(ft, name);
+	if (fd && --fd->users == 0) {
+		nf_flow_dev_detach(ft, fd);
+		list_del_rcu(&fd->list);
+		kfree_rcu(fd, rcu_head);
+	}
+	mutex_unlock(&ft->lock);
+}
+EXPORT_SYMBOL_GPL(nf_flow_table_dev_unhook);
+
+static bool nf_flow_dev_remove(const struct flow_offload *flow, void *data)
+{
+	const struct net_device *dev = data;
+	int i;
+
+	for (i = 0; i < FLOW_OFFLOAD_DIR_MAX; i++) {
+		if (flow->tuplehash[i].tuple.iifidx == dev->ifindex ||
+		    flow->tuplehash[i].tuple.oifidx == dev->ifindex)
+			return true;
+	}
+	return flow_offload_stale(flow);
+}
+
+static int nf_flow_table_netdev_event(struct notifier_block *this,
+				      unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct nf_flowtable *ft = nf_flow_table_pernet(dev_net(dev));
+	struct nf_flow_dev *fd;
+
+	switch (event) {
+	case NETDEV_REGISTER:
+		mutex_lock(&ft->lock);
+		fd = nf_flow_dev_find(ft, dev->name);
+		if (fd && !fd->ops.dev)
+			nf_flow_dev_attach(ft, fd, dev);
+		mutex_unlock(&ft->lock);
+		break;
+	case NETDEV_UNREGISTER:
+		mutex_lock(&ft->lock);
+		list_for_each_entry(fd, &ft->devices, list) {
+			if (fd->ops.dev == dev)
+				nf_flow_dev_detach(ft, fd);
+		}
+		/* The cached routes hold references on the device */
+		nf_flow_table_iterate(ft, nf_flow_dev_remove, dev);
+		mutex_unlock(&ft->lock);
+		break;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block nf_flow_table_netdev_notifier = {
+	.notifier_call	= nf_flow_table_netdev_event,
+};
+
+static int __net_init nf_flow_table_net_init(struct net *net)
+{
+	struct nf_flowtable *ft = nf_flow_table_pernet(net);
+	int err;
+
+	err = rhashtable_init(&ft->rhashtable, &nf_flow_offload_rhash_params);
+	if (err < 0)
+		return err;
+
+	mutex_init(&ft->lock);
+	INIT_LIST_HEAD(&ft->devices);
+	INIT_DEFERRABLE_WORK(&ft->gc_work, nf_flow_offload_work_gc);
+	ft->net = net;
+
+	queue_delayed_work(system_power_efficient_wq, &ft->gc_work,
+			   NF_FLOW_GC_INTERVAL);
+	return 0;
+}
+
+static bool nf_flow_remove_all(const struct flow_offload *flow, void *data)
+{
+	return true;
+}
+
+/*
+ * Devices are unregistered before we get here, which detaches their
+ * hooks.  The device entries themselves belong to the expressions that
+ * listed them and are released when those go away.
+ */
+static void __net_exit nf_flow_table_net_exit(struct net *net)
+{
+	struct nf_flowtable *ft = nf_flow_table_pernet(net);
+
+	cancel_delayed_work_sync(&ft->gc_work);
+
+	mutex_lock(&ft->lock);
+	nf_flow_table_iterate(ft, nf_flow_remove_all, NULL);
+	mutex_unlock(&ft->lock);
+
+	rhashtable_destroy(&ft->rhashtable);
+}
+
+static struct pernet_operations nf_flow_table_net_ops = {
+	.init	= nf_flow_table_net_init,
+	.exit	= nf_flow_table_net_exit,
+	.id	= &nf_flow_table_net_id,
+	.size	= sizeof(struct nf_flowtable),
+};
+
+static int __init nf_flow_table_module_init(void)
+{
+	int err;
+
+	err = register_pernet_subsys(&nf_flow_table_net_ops);
+	if (err < 0)
+		return err;
+
+	err = register_netdevice_notifier(&nf_flow_table_netdev_notifier);
+	if (err < 0)
+		unregister_pernet_subsys(&nf_flow_table_net_ops);
+
+	return err;
+}
+
+static void __exit nf_flow_table_module_exit(void)
+{
+	unregister_netdevice_notifier(&nf_flow_table_netdev_notifier);
+	unregister_pernet_subsys(&nf_flow_table_net_ops);
+}
+
+module_init(nf_flow_table_module_init);
+module_exit(nf_flow_table_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Netfilter flow table fast path");
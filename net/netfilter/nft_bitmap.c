@@ -0,0 +1,221 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+
+/*
+ * Sets with keys of up to two bytes (protocols, ports, marks of small
+ * range) are kept as a bitmap indexed by the key, so a lookup is a
+ * single bit test.  Each key has one bit per generation, telling
+ * whether the key is active in that generation.  Insert, activate,
+ * deactivate and remove only ever change the state of the next
+ * generation, so only its bit is touched and packets keep seeing the
+ * current generation unchanged until the commit flips the cursor.
+ *
+ * The elements themselves sit on a list for dumps and deletion.
+ */
+
+struct nft_bitmap_elem {
+	struct list_head	head;
+	struct nft_set_ext	ext;
+};
+
+struct nft_bitmap {
+	struct list_head	list;
+	unsigned long		bitmap[];
+};
+
+#define NFT_BITMAP_MAX_KLEN	2
+
+static inline u32 nft_bitmap_key(const struct nft_set *set, const u32 *key)
+{
+	return set->klen == 1 ? *(const u8 *)key : *(const u16 *)key;
+}
+
+static inline unsigned int nft_bitmap_bit(const struct nft_set *set,
+					  const u32 *key, u8 genmask)
+{
+	return nft_bitmap_key(set, key) * 2 + (genmask >> 1);
+}
+
+static inline unsigned int nft_bitmap_size(unsigned int klen)
+{
+	return BITS_TO_LONGS(2U << (klen * BITS_PER_BYTE)) *
+	       sizeof(unsigned long);
+}
+
+static bool nft_bitmap_lookup(const struct nft_set *set, const u32 *key,
+			      const struct nft_set_ext **ext)
+{
+	const struct nft_bitmap *priv = nft_set_priv(set);
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+
+	return test_bit(nft_bitmap_bit(set, key, genmask), priv->bitmap);
+}
+
+static int nft_bitmap_insert(const struct nft_set *set,
+			     const struct nft_set_elem *elem)
+{
+	struct nft_bitmap *priv = nft_set_priv(set);
+	struct nft_bitmap_elem *be = elem->priv;
+	u8 genmask = nft_genmask_next(read_pnet(&set->pnet));
+	unsigned int bit;
+
+	bit = nft_bitmap_bit(set, nft_set_ext_key(&be->ext)->data, genmask);
+	if (test_bit(bit, priv->bitmap))
+		return -EEXIST;
+
+	list_add_tail_rcu(&be->head, &priv->list);
+	set_bit(bit, priv->bitmap);
+	return 0;
+}
+
+static void nft_bitmap_remove(const struct nft_set *set,
+			      const struct nft_set_elem *elem)
+{
+	struct nft_bitmap *priv = nft_set_priv(set);
+	struct nft_bitmap_elem *be = elem->priv;
+	u8 genmask = nft_genmask_next(read_pnet(&set->pnet));
+
+	clear_bit(nft_bitmap_bit(set, nft_set_ext_key(&be->ext)->data,
+				 genmask), priv->bitmap);
+	list_del_rcu(&be->head);
+}
+
+static void nft_bitmap_activate(const struct nft_set *set,
+				const struct nft_set_elem *elem)
+{
+	struct nft_bitmap *priv = nft_set_priv(set);
+	struct nft_bitmap_elem *be = elem->priv;
+	u8 genmask = nft_genmask_next(read_pnet(&set->pnet));
+
+	nft_set_elem_change_active(set, &be->ext);
+	set_bit(nft_bitmap_bit(set, nft_set_ext_key(&be->ext)->data,
+			       genmask), priv->bitmap);
+}
+
+static void *nft_bitmap_deactivate(const struct nft_set *set,
+				   const struct nft_set_elem *elem)
+{
+	struct nft_bitmap *priv = nft_set_priv(set);
+	u8 genmask = nft_genmask_next(read_pnet(&set->pnet));
+	struct nft_bitmap_elem *be;
+
+	list_for_each_entry(be, &priv->list, head) {
+		if (memcmp(nft_set_ext_key(&be->ext), &elem->key.val,
+			   set->klen) ||
+		    !nft_set_elem_active(&be->ext, genmask))
+			continue;
+
+		nft_set_elem_change_active(set, &be->ext);
+		clear_bit(nft_bitmap_bit(set, elem->key.val.data, genmask),
+			  priv->bitmap);
+		return be;
+	}
+	return NULL;
+}
+
+static void nft_bitmap_walk(const struct nft_ctx *ctx,
+			    const struct nft_set *set,
+			    struct nft_set_iter *iter)
+{
+	const struct nft_bitmap *priv = nft_set_priv(set);
+	struct nft_bitmap_elem *be;
+	struct nft_set_elem elem;
+	u8 genmask = nft_genmask_cur(read_pnet(&set->pnet));
+
+	list_for_each_entry_rcu(be, &priv->list, head) {
+		if (iter->count < iter->skip)
+			goto cont;
+		if (!nft_set_elem_active(&be->ext, genmask))
+			goto cont;
+
+		elem.priv = be;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0)
+			return;
+cont:
+		iter->count++;
+	}
+}
+
+static unsigned int nft_bitmap_privsize(const struct nlattr * const nla[])
+{
+	u32 klen = ntohl(nla_get_be32(nla[NFTA_SET_KEY_LEN]));
+
+	return sizeof(struct nft_bitmap) + nft_bitmap_size(klen);
+}
+
+static int nft_bitmap_init(const struct nft_set *set,
+			   const struct nft_set_desc *desc,
+			   const struct nlattr * const nla[])
+{
+	struct nft_bitmap *priv = nft_set_priv(set);
+
+	INIT_LIST_HEAD(&priv->list);
+	return 0;
+}
+
+static void nft_bitmap_destroy(const struct nft_set *set)
+{
+	struct nft_bitmap *priv = nft_set_priv(set);
+	struct nft_bitmap_elem *be, *n;
+
+	list_for_each_entry_safe(be, n, &priv->list, head)
+		nft_set_elem_destroy(set, be);
+}
+
+static bool nft_bitmap_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	if (desc->klen > NFT_BITMAP_MAX_KLEN)
+		return false;
+
+	est->size = sizeof(struct nft_bitmap) + nft_bitmap_size(desc->klen) +
+		    desc->size * sizeof(struct nft_bitmap_elem);
+	est->class = NFT_SET_CLASS_O_1_DIRECT;
+
+	return true;
+}
+
+static struct nft_set_ops nft_bitmap_ops __read_mostly = {
+	.privsize	= nft_bitmap_privsize,
+	.elemsize	= offsetof(struct nft_bitmap_elem, ext),
+	.estimate	= nft_bitmap_estimate,
+	.init		= nft_bitmap_init,
+	.destroy	= nft_bitmap_destroy,
+	.insert		= nft_bitmap_insert,
+	.remove		= nft_bitmap_remove,
+	.deactivate	= nft_bitmap_deactivate,
+	.activate	= nft_bitmap_activate,
+	.lookup		= nft_bitmap_lookup,
+	.walk		= nft_bitmap_walk,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_bitmap_module_init(void)
+{
+	return nft_register_set(&nft_bitmap_ops);
+}
+
+static void __exit nft_bitmap_module_exit(void)
+{
+	nft_unregister_set(&nft_bitmap_ops);
+}
+
+module_init(nft_bitmap_module_init);
+module_exit(nft_bitmap_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
@@ -0,0 +1,267 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/ip.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_table.h>
+
+#define NFT_FLOW_OFFLOAD_MAX_DEVS	8
+
+struct nft_flow_offload {
+	unsigned int	num_devs;
+	char		devs[NFT_FLOW_OFFLOAD_MAX_DEVS][IFNAMSIZ];
+};
+
+/*
+ * The route of the packet at hand covers its own direction; look up the
+ * way back to its source for the other one.
+ */
+static int nft_flow_route(const struct nft_pktinfo *pkt,
+			  const struct nf_conn *ct,
+			  struct nf_flow_route *route,
+			  enum ip_conntrack_dir dir)
+{
+	struct dst_entry *this_dst = skb_dst(pkt->skb);
+	struct dst_entry *other_dst = NULL;
+	const struct nf_afinfo *afinfo;
+	struct flowi fl;
+
+	afinfo = nf_get_afinfo(NFPROTO_IPV4);
+	if (!afinfo || !this_dst)
+		return -ENOENT;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.u.ip4.daddr = ct->tuplehash[dir].tuple.src.u3.ip;
+
+	afinfo->route(pkt->net, &other_dst, &fl, false);
+	if (!other_dst)
+		return -ENOENT;
+
+	route->tuple[dir].dst		= this_dst;
+	route->tuple[dir].ifindex	= pkt->in->ifindex;
+	route->tuple[!dir].dst		= other_dst;
+	route->tuple[!dir].ifindex	= this_dst->dev->ifindex;
+
+	return 0;
+}
+
+static bool nft_flow_offload_skip(const struct nf_conn *ct)
+{
+	switch (ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum) {
+	case IPPROTO_TCP:
+		if (ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED)
+			return true;
+		break;
+	case IPPROTO_UDP:
+		break;
+	default:
+		return true;
+	}
+
+	/* Helpers need to see every packet */
+	return test_bit(IPS_HELPER_BIT, &ct->status) || nfct_help(ct);
+}
+
+/* Conntrack misses the window updates of offloaded packets */
+static void nft_flow_offload_tcp_liberal(struct nf_conn *ct)
+{
+	spin_lock_bh(&ct->lock);
+	ct->proto.tcp.seen[0].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+	ct->proto.tcp.seen[1].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+	spin_unlock_bh(&ct->lock);
+}
+
+static void nft_flow_offload_eval(const struct nft_expr *expr,
+				  struct nft_regs *regs,
+				  const struct nft_pktinfo *pkt)
+{
+	enum ip_conntrack_info ctinfo;
+	struct nf_flow_route route;
+	struct flow_offload *flow;
+	enum ip_conntrack_dir dir;
+	struct nf_conn *ct;
+
+	if (pkt->pf != NFPROTO_IPV4)
+		goto out;
+
+	ct = nf_ct_get(pkt->skb, &ctinfo);
+	if (!ct || nf_ct_is_untracked(ct))
+		goto out;
+
+	if (ctinfo != IP_CT_ESTABLISHED && ctinfo != IP_CT_ESTABLISHED_REPLY)
+		goto out;
+
+	if (nft_flow_offload_skip(ct))
+		goto out;
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status))
+		goto out;
+
+	dir = CTINFO2DIR(ctinfo);
+	if (nft_flow_route(pkt, ct, &route, dir) < 0)
+		goto err_route;
+
+	flow = flow_offload_alloc(ct, &route);
+	if (!flow)
+		goto err_alloc;
+
+	if (flow_offload_add(pkt->net, flow) < 0)
+		goto err_add;
+
+	if (ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum == IPPROTO_TCP)
+		nft_flow_offload_tcp_liberal(ct);
+
+	dst_release(route.tuple[!dir].dst);
+	return;
+
+err_add:
+	flow_offload_free(flow);
+err_alloc:
+	dst_release(route.tuple[!dir].dst);
+err_route:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+out:
+	regs->verdict.code = NFT_BREAK;
+}
+
+static int nft_flow_offload_validate(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr,
+				     const struct nft_data **data)
+{
+	return nft_chain_validate_hooks(ctx->chain, 1 << NF_INET_FORWARD);
+}
+
+static const struct nla_policy nft_flow_offload_policy[NFTA_FLOW_MAX + 1] = {
+	[NFTA_FLOW_DEVICES]	= { .type = NLA_NESTED },
+};
+
+static void nft_flow_offload_unhook(const struct nft_ctx *ctx,
+				    struct nft_flow_offload *priv,
+				    unsigned int n)
+{
+	while (n-- > 0)
+		nf_flow_table_dev_unhook(ctx->net, priv->devs[n]);
+}
+
+static int nft_flow_offload_init(const struct nft_ctx *ctx,
+				 const struct nft_expr *expr,
+				 const struct nlattr * const tb[])
+{
+	struct nft_flow_offload *priv = nft_expr_priv(expr);
+	const struct nlattr *attr;
+	unsigned int i;
+	int err, rem;
+
+	err = nft_flow_offload_validate(ctx, expr, NULL);
+	if (err < 0)
+		return err;
+
+	if (tb[NFTA_FLOW_DEVICES] == NULL)
+		return -EINVAL;
+
+	nla_for_each_nested(attr, tb[NFTA_FLOW_DEVICES], rem) {
+		if (nla_type(attr) != NFTA_DEVICE_NAME)
+			return -EINVAL;
+		if (priv->num_devs == NFT_FLOW_OFFLOAD_MAX_DEVS)
+			return -E2BIG;
+
+		nla_strlcpy(priv->devs[priv->num_devs++], attr, IFNAMSIZ);
+	}
+	if (priv->num_devs == 0)
+		return -EINVAL;
+
+	err = nf_ct_l3proto_try_module_get(NFPROTO_IPV4);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < priv->num_devs; i++) {
+		err = nf_flow_table_dev_hook(ctx->net, priv->devs[i]);
+		if (err < 0)
+			goto err_hook;
+	}
+
+	return 0;
+
+err_hook:
+	nft_flow_offload_unhook(ctx, priv, i);
+	nf_ct_l3proto_module_put(NFPROTO_IPV4);
+	return err;
+}
+
+static void nft_flow_offload_destroy(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr)
+{
+	struct nft_flow_offload *priv = nft_expr_priv(expr);
+
+	nft_flow_offload_unhook(ctx, priv, priv->num_devs);
+	nf_ct_l3proto_module_put(NFPROTO_IPV4);
+}
+
+static int nft_flow_offload_dump(struct sk_buff *skb,
+				 const struct nft_expr *expr)
+{
+	const struct nft_flow_offload *priv = nft_expr_priv(expr);
+	struct nlattr *nest;
+	unsigned int i;
+
+	nest = nla_nest_start(skb, NFTA_FLOW_DEVICES);
+	if (!nest)
+		goto nla_put_failure;
+
+	for (i = 0; i < priv->num_devs; i++) {
+		if (nla_put_string(skb, NFTA_DEVICE_NAME, priv->devs[i]))
+			goto nla_put_failure;
+	}
+	nla_nest_end(skb, nest);
+
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static struct nft_expr_type nft_flow_offload_type;
+static const struct nft_expr_ops nft_flow_offload_ops = {
+	.type		= &nft_flow_offload_type,
+	.size		= NFT_EXPR_SIZE(sizeof(struct nft_flow_offload)),
+	.eval		= nft_flow_offload_eval,
+	.init		= nft_flow_offload_init,
+	.destroy	= nft_flow_offload_destroy,
+	.validate	= nft_flow_offload_validate,
+	.dump		= nft_flow_offload_dump,
+};
+
+static struct nft_expr_type nft_flow_offload_type __read_mostly = {
+	.name		= "flow_offload",
+	.ops		= &nft_flow_offload_ops,
+	.policy		= nft_flow_offload_policy,
+	.maxattr	= NFTA_FLOW_MAX,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_flow_offload_module_init(void)
+{
+	return nft_register_expr(&nft_flow_offload_type);
+}
+
+static void __exit nft_flow_offload_module_exit(void)
+{
+	nft_unregister_expr(&nft_flow_offload_type);
+}
+
+module_init(nft_flow_offload_module_init);
+module_exit(nft_flow_offload_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_EXPR("flow_offload");
@@ -1648,6 +1648,10 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 	if (!po->running)
 		return -EINVAL;
 
+	/* the group spreads the load, the queue binding would undo it */
+	if (po->rx_queue >= 0)
+		return -EINVAL;
+
 	if (po->fanout)
 		return -EALREADY;
 
@@ -2043,6 +2047,25 @@ static int packet_rcv_vnet(struct msghdr *msg, const struct sk_buff *skb,
  * we will not harm anyone.
  */
 
+/* A socket bound to an RX queue only sees what was received on it;
+ * devices that don't record the queue are taken as single queue.
+ */
+static bool packet_rx_queue_match(const struct packet_sock *po,
+				  const struct sk_buff *skb)
+{
+	int queue = READ_ONCE(po->rx_queue);
+
+	if (queue < 0)
+		return true;
+	if (skb->pkt_type == PACKET_OUTGOING)
+		return false;
+
+	if (!skb_rx_queue_recorded(skb))
+		return queue == 0;
+
+	return skb_get_rx_queue(skb) == queue;
+}
+
 static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 		      struct packet_type *pt, struct net_device *orig_dev)
 {
@@ -2063,6 +2086,9 @@ static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 	if (!net_eq(dev_net(dev), sock_net(sk)))
 		goto drop;
 
+	if (!packet_rx_queue_match(po, skb))
+		goto drop;
+
 	skb->dev = dev;
 
 	if (dev->header_ops) {
@@ -2193,6 +2219,9 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	if (!net_eq(dev_net(dev), sock_net(sk)))
 		goto drop;
 
+	if (!packet_rx_queue_match(po, skb))
+		goto drop;
+
 	if (dev->header_ops) {
 		if (sk->sk_type != SOCK_DGRAM)
 			skb_push(skb, skb->data - skb_mac_header(skb));
@@ -3230,6 +3259,7 @@ static int packet_create(struct net *net, struct socket *sock, int protocol,
 	sk->sk_family = PF_PACKET;
 	po->num = proto;
 	po->xmit = dev_queue_xmit;
+	po->rx_queue = -1;
 
 	err = packet_alloc_pending(po);
 	if (err)
@@ -3821,6 +3851,22 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		po->xmit = val ? packet_direct_xmit : dev_queue_xmit;
 		return 0;
 	}
+	case PACKET_RX_QUEUE:
+	{
+		int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+		if (val < -1 || val >= U16_MAX)
+			return -EINVAL;
+		if (po->fanout)
+			return -EBUSY;
+
+		WRITE_ONCE(po->rx_queue, val);
+		return 0;
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3926,6 +3972,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	case PACKET_QDISC_BYPASS:
 		val = packet_use_direct_xmit(po);
 		break;
+	case PACKET_RX_QUEUE:
+		val = po->rx_queue;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -116,6 +116,7 @@ struct packet_sock {
 				has_vnet_hdr:1;
 	int			pressure;
 	int			ifindex;	/* bound device		*/
+	int			rx_queue;	/* bound RX queue or -1	*/
 	__be16			num;
 	struct packet_rollover	*rollover;
 	struct packet_mclist	*mclist;
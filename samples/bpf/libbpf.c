@@ -76,6 +76,24 @@ int bpf_get_next_key(int fd, void *key, void *next_key)
 	return syscall(__NR_bpf, BPF_MAP_GET_NEXT_KEY, &attr, sizeof(attr));
 }
 
+int bpf_map_batch(int cmd, int fd, void *in_batch, void *out_batch,
+		  void *keys, void *values, unsigned int *count)
+{
+	union bpf_attr attr = {
+		.batch.map_fd = fd,
+		.batch.in_batch = ptr_to_u64(in_batch),
+		.batch.out_batch = ptr_to_u64(out_batch),
+		.batch.keys = ptr_to_u64(keys),
+		.batch.values = ptr_to_u64(values),
+		.batch.count = *count,
+	};
+	int ret;
+
+	ret = syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+	*count = attr.batch.count;
+	return ret;
+}
+
 #define ROUND_UP(x, n) (((x) + (n) - 1u) & ~((n) - 1u))
 
 char bpf_log_buf[LOG_BUF_SIZE];
@@ -123,6 +141,27 @@ int bpf_obj_get(const char *pathname)
 	return syscall(__NR_bpf, BPF_OBJ_GET, &attr, sizeof(attr));
 }
 
+int bpf_prog_attach(int prog_fd, int target_fd, enum bpf_attach_type type)
+{
+	union bpf_attr attr = {
+		.target_fd = target_fd,
+		.attach_bpf_fd = prog_fd,
+		.attach_type = type,
+	};
+
+	return syscall(__NR_bpf, BPF_PROG_ATTACH, &attr, sizeof(attr));
+}
+
+int bpf_prog_detach(int target_fd, enum bpf_attach_type type)
+{
+	union bpf_attr attr = {
+		.target_fd = target_fd,
+		.attach_type = type,
+	};
+
+	return syscall(__NR_bpf, BPF_PROG_DETACH, &attr, sizeof(attr));
+}
+
 int open_raw_sock(const char *name)
 {
 	struct sockaddr_ll sll;
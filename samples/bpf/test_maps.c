@@ -15,6 +15,10 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 #include "libbpf.h"
 
@@ -68,7 +72,15 @@ static void test_hashmap_sanity(int i, void *data)
 	assert(bpf_update_elem(map_fd, &key, &value, BPF_NOEXIST) == -1 &&
 	       errno == E2BIG);
 
+	/* existing elements can still be replaced in a full map */
+	key = 1;
+	value = 4321;
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_EXIST) == 0);
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+	assert(bpf_lookup_elem(map_fd, &key, &value) == 0 && value == 4321);
+
 	/* check that key = 0 doesn't exist */
+	key = 0;
 	assert(bpf_delete_elem(map_fd, &key) == -1 && errno == ENOENT);
 
 	/* iterate over two elements */
@@ -187,6 +199,97 @@ static void test_percpu_hashmap_sanity(int task, void *data)
 	close(map_fd);
 }
 
+/* LRU maps evict instead of failing once they are full */
+static void test_lru_hashmap_sanity(int map_type, int lru_flags)
+{
+	unsigned int nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	unsigned int max_entries = 64 * nr_cpus;
+	long long key, next_key, value[nr_cpus];
+	unsigned int nr_keys = 0;
+	int map_fd;
+
+	/* there is nothing to evict to with lazily allocated elements */
+	assert(bpf_create_map(map_type, sizeof(key), sizeof(value[0]),
+			      max_entries, lru_flags | BPF_F_NO_PREALLOC) == -1);
+
+	map_fd = bpf_create_map(map_type, sizeof(key), sizeof(value[0]),
+				max_entries, lru_flags);
+	if (map_fd < 0) {
+		printf("failed to create lru hashmap '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	memset(value, 0, sizeof(value));
+	for (key = 0; key < 4 * max_entries; key++)
+		assert(bpf_update_elem(map_fd, &key, value, BPF_NOEXIST) == 0);
+
+	/* the key inserted last is still there */
+	key = 4 * max_entries - 1;
+	assert(bpf_lookup_elem(map_fd, &key, value) == 0);
+
+	/* and no more than max_entries of them */
+	key = -1;
+	while (!bpf_get_next_key(map_fd, &key, &next_key)) {
+		nr_keys++;
+		key = next_key;
+	}
+	assert(errno == ENOENT);
+	assert(nr_keys > 0 && nr_keys <= max_entries);
+
+	close(map_fd);
+}
+
+/* batches of elements in and out of a hashmap */
+static void test_hashmap_batch(void)
+{
+	long long keys[64], values[64], seen = 0;
+	unsigned int batch, count, total, n = 64, i;
+	int map_fd, ret;
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(keys[0]),
+				sizeof(values[0]), n, map_flags);
+	if (map_fd < 0) {
+		printf("failed to create hashmap '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++) {
+		keys[i] = i;
+		values[i] = i * 10;
+	}
+	count = n;
+	assert(bpf_map_batch(BPF_MAP_UPDATE_BATCH, map_fd, NULL, NULL,
+			     keys, values, &count) == 0 && count == n);
+
+	/* walk it 16 at a time, a NULL cursor starts at the beginning */
+	total = 0;
+	do {
+		count = 16;
+		ret = bpf_map_batch(BPF_MAP_LOOKUP_BATCH, map_fd,
+				    total ? &batch : NULL, &batch,
+				    keys + total, values + total, &count);
+		assert(!ret || errno == ENOENT);
+		total += count;
+	} while (!ret);
+	assert(total == n);
+	for (i = 0; i < n; i++) {
+		assert(values[i] == keys[i] * 10);
+		seen |= 1ULL << keys[i];
+	}
+	assert(seen == ~0ULL);
+
+	/* take everything out in one go */
+	count = n;
+	assert(bpf_map_batch(BPF_MAP_LOOKUP_AND_DELETE_BATCH, map_fd, NULL,
+			     &batch, keys, values, &count) == -1 &&
+	       errno == ENOENT && count == n);
+	keys[0] = -1;
+	assert(bpf_get_next_key(map_fd, &keys[0], &keys[1]) == -1 &&
+	       errno == ENOENT);
+
+	close(map_fd);
+}
+
 static void test_arraymap_sanity(int i, void *data)
 {
 	int key, next_key, map_fd;
@@ -330,6 +433,152 @@ static void test_percpu_arraymap_sanity(int i, void *data)
 }
 
 #define MAP_SIZE (32 * 1024)
+static void test_ringbuf_sanity(void)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	int key = 0, map_fd, size = 4 * page_size;
+	struct pollfd pfd;
+	unsigned long *pos;
+	long long value;
+
+	/* the size has to be a power of 2 number of pages */
+	assert(bpf_create_map(BPF_MAP_TYPE_RINGBUF, 0, 0, 3 * page_size,
+			      0) == -1 && errno == EINVAL);
+	assert(bpf_create_map(BPF_MAP_TYPE_RINGBUF, sizeof(key), 0, size,
+			      0) == -1 && errno == EINVAL);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_RINGBUF, 0, 0, size, 0);
+	if (map_fd < 0) {
+		printf("failed to create ringbuf '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	/* ringbuf has no elements */
+	assert(bpf_lookup_elem(map_fd, &key, &value) == -1 && errno == ENOENT);
+
+	/* only the consumer position may be mapped writable */
+	pos = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   map_fd, 0);
+	assert(pos != MAP_FAILED && *pos == 0);
+	munmap(pos, page_size);
+	assert(mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    map_fd, page_size) == MAP_FAILED && errno == EPERM);
+
+	/* producer position and the data mapped twice */
+	pos = mmap(NULL, page_size + 2 * size, PROT_READ, MAP_SHARED,
+		   map_fd, page_size);
+	assert(pos != MAP_FAILED && *pos == 0);
+	munmap(pos, page_size + 2 * size);
+	assert(mmap(NULL, page_size + 2 * size + page_size, PROT_READ,
+		    MAP_SHARED, map_fd, page_size) == MAP_FAILED);
+
+	/* nothing to read yet */
+	pfd.fd = map_fd;
+	pfd.events = POLLIN;
+	assert(poll(&pfd, 1, 0) == 0);
+
+	close(map_fd);
+}
+
+/* the bpf_spin_lock of a value is the map's, user space neither sets
+ * nor sees it
+ */
+static void test_spin_lock_map_sanity(int map_type)
+{
+	struct {
+		struct bpf_spin_lock lock;
+		int cnt;
+	} value;
+	int key = 0, map_fd;
+
+	map_fd = bpf_create_map(map_type, sizeof(key), sizeof(value), 2,
+				BPF_F_SPIN_LOCK |
+				(map_type == BPF_MAP_TYPE_HASH ? map_flags : 0));
+	if (map_fd < 0) {
+		printf("failed to create map with bpf_spin_lock '%s'\n",
+		       strerror(errno));
+		exit(1);
+	}
+
+	value.lock.val = -1;
+	value.cnt = 1234;
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_ANY) == 0);
+
+	memset(&value, 0xff, sizeof(value));
+	assert(bpf_lookup_elem(map_fd, &key, &value) == 0 &&
+	       value.lock.val == 0 && value.cnt == 1234);
+
+	close(map_fd);
+
+	/* no room for the lock */
+	assert(bpf_create_map(map_type, sizeof(key), 2, 2,
+			      BPF_F_SPIN_LOCK) == -1 && errno == EINVAL);
+}
+
+static void test_stackmap_build_id_sanity(void)
+{
+	int map_fd;
+
+	/* values hold whole struct bpf_stack_build_id entries */
+	assert(bpf_create_map(BPF_MAP_TYPE_STACK_TRACE, sizeof(__u32),
+			      sizeof(__u64), 2, BPF_F_STACK_BUILD_ID) == -1 &&
+	       errno == EINVAL);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_STACK_TRACE, sizeof(__u32),
+				4 * sizeof(struct bpf_stack_build_id), 2,
+				BPF_F_STACK_BUILD_ID);
+	if (map_fd < 0) {
+		printf("failed to create build id stackmap '%s'\n",
+		       strerror(errno));
+		exit(1);
+	}
+	close(map_fd);
+}
+
+static void test_sockmap_sanity(void)
+{
+	int key = 0, value, map_fd, sk;
+
+	assert(bpf_create_map(BPF_MAP_TYPE_SOCKMAP, sizeof(key),
+			      sizeof(long long), 2, 0) == -1 && errno == EINVAL);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_SOCKMAP, sizeof(key),
+				sizeof(value), 2, 0);
+	if (map_fd < 0) {
+		printf("failed to create sockmap '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	/* values must be sockets, and only TCP ones */
+	value = map_fd;
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == ENOTSOCK);
+	sk = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sk >= 0);
+	value = sk;
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == EOPNOTSUPP);
+	close(sk);
+
+	sk = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	assert(sk >= 0);
+	value = sk;
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_EXIST) == -1 &&
+	       errno == ENOENT);
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_NOEXIST) == 0);
+	assert(bpf_update_elem(map_fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+
+	/* the socket is never handed back out */
+	assert(bpf_lookup_elem(map_fd, &key, &value) == -1 && errno == ENOENT);
+
+	assert(bpf_delete_elem(map_fd, &key) == 0);
+	assert(bpf_delete_elem(map_fd, &key) == -1 && errno == ENOENT);
+
+	close(sk);
+	close(map_fd);
+}
+
 static void test_map_large(void)
 {
 	struct bigkey {
@@ -472,10 +721,31 @@ static void run_all_tests(void)
 {
 	test_hashmap_sanity(0, NULL);
 	test_percpu_hashmap_sanity(0, NULL);
+	test_hashmap_batch();
 	test_arraymap_sanity(0, NULL);
 	test_percpu_arraymap_sanity(0, NULL);
 	test_percpu_arraymap_many_keys();
 
+	/* percpu LRU lists only make sense on LRU maps */
+	assert(bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(long long),
+			      sizeof(long long), 2, BPF_F_NO_COMMON_LRU) == -1 &&
+	       errno == EINVAL);
+	test_lru_hashmap_sanity(BPF_MAP_TYPE_LRU_HASH, 0);
+	test_lru_hashmap_sanity(BPF_MAP_TYPE_LRU_HASH, BPF_F_NO_COMMON_LRU);
+	test_lru_hashmap_sanity(BPF_MAP_TYPE_LRU_PERCPU_HASH, 0);
+	test_lru_hashmap_sanity(BPF_MAP_TYPE_LRU_PERCPU_HASH,
+				BPF_F_NO_COMMON_LRU);
+	test_ringbuf_sanity();
+	test_sockmap_sanity();
+	test_stackmap_build_id_sanity();
+
+	test_spin_lock_map_sanity(BPF_MAP_TYPE_HASH);
+	test_spin_lock_map_sanity(BPF_MAP_TYPE_ARRAY);
+	/* values of percpu maps are never shared */
+	assert(bpf_create_map(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(int),
+			      sizeof(long long), 2, BPF_F_SPIN_LOCK) == -1 &&
+	       errno == EINVAL);
+
 	test_map_large();
 	test_map_parallel();
 	test_map_stress();
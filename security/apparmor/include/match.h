@@ -93,9 +93,19 @@ struct table_header {
 #define ACCEPT_TABLE(DFA) ((u32 *)((DFA)->tables[YYTD_ID_ACCEPT]->td_data))
 #define ACCEPT_TABLE2(DFA) ((u32 *)((DFA)->tables[YYTD_ID_ACCEPT2]->td_data))
 
+/*
+ * The next and check tables are merged into a single transition table at
+ * unpack time, so each step of a match touches one cache line instead of
+ * two far apart arrays.  Check is in the high 16 bits, next in the low.
+ */
+#define TRANS_TABLE(DFA) ((DFA)->trans)
+#define trans_next(X) ((X) & 0xffff)
+#define trans_check(X) ((X) >> 16)
+
 struct aa_dfa {
 	struct kref count;
 	u16 flags;
+	u32 *trans;
 	struct table_header *tables[YYTD_ID_TSIZE];
 };
 
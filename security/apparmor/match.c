@@ -159,6 +159,43 @@ out:
 	return error;
 }
 
+/**
+ * build_trans - merge the next and check tables into the transition table
+ * @dfa: verified dfa to build the table for  (NOT NULL)
+ *
+ * The next and check tables are not needed for matching afterwards and are
+ * freed, so this does not grow the dfa.
+ *
+ * Returns: %0 else -ENOMEM
+ */
+static int build_trans(struct aa_dfa *dfa)
+{
+	size_t i, trans_count = dfa->tables[YYTD_ID_NXT]->td_lolen;
+	u16 *next = NEXT_TABLE(dfa);
+	u16 *check = CHECK_TABLE(dfa);
+
+	if (trans_count > SIZE_MAX / sizeof(u32))
+		return -ENOMEM;
+
+	dfa->trans = kvmalloc(trans_count * sizeof(u32));
+	if (!dfa->trans)
+		return -ENOMEM;
+
+	for (i = 0; i < trans_count; i++)
+		dfa->trans[i] = ((u32) check[i] << 16) | next[i];
+
+	kvfree(dfa->tables[YYTD_ID_NXT]);
+	dfa->tables[YYTD_ID_NXT] = NULL;
+	kvfree(dfa->tables[YYTD_ID_CHK]);
+	dfa->tables[YYTD_ID_CHK] = NULL;
+
+	/* see unpack_table() */
+	if (is_vmalloc_addr(dfa->trans))
+		vm_unmap_aliases();
+
+	return 0;
+}
+
 /**
  * dfa_free - free a dfa allocated by aa_dfa_unpack
  * @dfa: the dfa to free  (MAYBE NULL)
@@ -174,6 +211,7 @@ static void dfa_free(struct aa_dfa *dfa)
 			kvfree(dfa->tables[i]);
 			dfa->tables[i] = NULL;
 		}
+		kvfree(dfa->trans);
 		kfree(dfa);
 	}
 }
@@ -273,6 +311,10 @@ struct aa_dfa *aa_dfa_unpack(void *blob, size_t size, int flags)
 	if (error)
 		goto fail;
 
+	error = build_trans(dfa);
+	if (error)
+		goto fail;
+
 	return dfa;
 
 fail:
@@ -302,8 +344,8 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 {
 	u16 *def = DEFAULT_TABLE(dfa);
 	u32 *base = BASE_TABLE(dfa);
-	u16 *next = NEXT_TABLE(dfa);
-	u16 *check = CHECK_TABLE(dfa);
+	u32 *trans = TRANS_TABLE(dfa);
+	u32 t;
 	unsigned int state = start, pos;
 
 	if (state == 0)
@@ -316,8 +358,9 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 		/* default is direct to next state */
 		for (; len; len--) {
 			pos = base_idx(base[state]) + equiv[(u8) *str++];
-			if (check[pos] == state)
-				state = next[pos];
+			t = trans[pos];
+			if (trans_check(t) == state)
+				state = trans_next(t);
 			else
 				state = def[state];
 		}
@@ -325,8 +368,9 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 		/* default is direct to next state */
 		for (; len; len--) {
 			pos = base_idx(base[state]) + (u8) *str++;
-			if (check[pos] == state)
-				state = next[pos];
+			t = trans[pos];
+			if (trans_check(t) == state)
+				state = trans_next(t);
 			else
 				state = def[state];
 		}
@@ -352,8 +396,8 @@ unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 {
 	u16 *def = DEFAULT_TABLE(dfa);
 	u32 *base = BASE_TABLE(dfa);
-	u16 *next = NEXT_TABLE(dfa);
-	u16 *check = CHECK_TABLE(dfa);
+	u32 *trans = TRANS_TABLE(dfa);
+	u32 t;
 	unsigned int state = start, pos;
 
 	if (state == 0)
@@ -366,8 +410,9 @@ unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 		/* default is direct to next state */
 		while (*str) {
 			pos = base_idx(base[state]) + equiv[(u8) *str++];
-			if (check[pos] == state)
-				state = next[pos];
+			t = trans[pos];
+			if (trans_check(t) == state)
+				state = trans_next(t);
 			else
 				state = def[state];
 		}
@@ -375,8 +420,9 @@ unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 		/* default is direct to next state */
 		while (*str) {
 			pos = base_idx(base[state]) + (u8) *str++;
-			if (check[pos] == state)
-				state = next[pos];
+			t = trans[pos];
+			if (trans_check(t) == state)
+				state = trans_next(t);
 			else
 				state = def[state];
 		}
@@ -400,8 +446,8 @@ unsigned int aa_dfa_next(struct aa_dfa *dfa, unsigned int state,
 {
 	u16 *def = DEFAULT_TABLE(dfa);
 	u32 *base = BASE_TABLE(dfa);
-	u16 *next = NEXT_TABLE(dfa);
-	u16 *check = CHECK_TABLE(dfa);
+	u32 *trans = TRANS_TABLE(dfa);
+	u32 t;
 	unsigned int pos;
 
 	/* current state is <state>, matching character *str */
@@ -411,15 +457,17 @@ unsigned int aa_dfa_next(struct aa_dfa *dfa, unsigned int state,
 		/* default is direct to next state */
 
 		pos = base_idx(base[state]) + equiv[(u8) c];
-		if (check[pos] == state)
-			state = next[pos];
+		t = trans[pos];
+		if (trans_check(t) == state)
+			state = trans_next(t);
 		else
 			state = def[state];
 	} else {
 		/* default is direct to next state */
 		pos = base_idx(base[state]) + (u8) c;
-		if (check[pos] == state)
-			state = next[pos];
+		t = trans[pos];
+		if (trans_check(t) == state)
+			state = trans_next(t);
 		else
 			state = def[state];
 	}
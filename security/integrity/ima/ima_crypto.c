@@ -19,6 +19,7 @@
 #include <linux/moduleparam.h>
 #include <linux/ratelimit.h>
 #include <linux/file.h>
+#include <linux/mm.h>
 #include <linux/crypto.h>
 #include <linux/scatterlist.h>
 #include <linux/err.h>
@@ -62,7 +63,7 @@ static const struct kernel_param_ops param_ops_bufsize = {
 #define param_check_bufsize(name, p) __param_check(name, p, unsigned int)
 
 module_param_named(ahash_bufsize, ima_bufsize, bufsize, 0644);
-MODULE_PARM_DESC(ahash_bufsize, "Maximum ahash buffer size");
+MODULE_PARM_DESC(ahash_bufsize, "Maximum file hashing buffer size");
 
 static struct crypto_shash *ima_shash_tfm;
 static struct crypto_ahash *ima_ahash_tfm;
@@ -168,6 +169,32 @@ static void ima_free_pages(void *ptr, size_t size)
 	free_pages((unsigned long)ptr, get_order(size));
 }
 
+/**
+ * ima_readahead() - Start reading the next chunk of a file.
+ * @file:   File being measured.
+ * @offset: Start of the next chunk.
+ * @i_size: Size of the file.
+ * @len:    Length of the next chunk.
+ *
+ * Issues the reads for the chunk following the one about to be hashed, so
+ * the storage works on it while the current chunk is being hashed.  This is
+ * only a hint: on failure the next read simply waits for the data.
+ */
+static void ima_readahead(struct file *file, loff_t offset, loff_t i_size,
+			  size_t len)
+{
+	pgoff_t start, end;
+
+	if (offset >= i_size || IS_DAX(file_inode(file)))
+		return;
+
+	len = min_t(loff_t, i_size - offset, len);
+	start = offset >> PAGE_SHIFT;
+	end = (offset + len - 1) >> PAGE_SHIFT;
+	force_page_cache_readahead(file->f_mapping, file, start,
+				   end - start + 1);
+}
+
 static struct crypto_ahash *ima_alloc_atfm(enum hash_algo algo)
 {
 	struct crypto_ahash *tfm = ima_ahash_tfm;
@@ -299,6 +326,9 @@ static int ima_calc_file_hash_atfm(struct file *file,
 		if (rc != rbuf_len)
 			goto out3;
 
+		ima_readahead(file, offset + rbuf_len, i_size,
+			      rbuf_size[rbuf[1] ? !active : active]);
+
 		if (rbuf[1] && offset) {
 			/* Using two buffers, and it is not the first
 			 * read/request, wait for the completion of the
@@ -356,6 +386,7 @@ static int ima_calc_file_hash_tfm(struct file *file,
 {
 	loff_t i_size, offset = 0;
 	char *rbuf;
+	size_t rbuf_size;
 	int rc, read = 0;
 	SHASH_DESC_ON_STACK(shash, tfm);
 
@@ -373,7 +404,8 @@ static int ima_calc_file_hash_tfm(struct file *file,
 	if (i_size == 0)
 		goto out;
 
-	rbuf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	/* Read in chunks of up to ima.ahash_bufsize here as well */
+	rbuf = ima_alloc_pages(i_size, &rbuf_size, 1);
 	if (!rbuf)
 		return -ENOMEM;
 
@@ -385,7 +417,7 @@ static int ima_calc_file_hash_tfm(struct file *file,
 	while (offset < i_size) {
 		int rbuf_len;
 
-		rbuf_len = integrity_kernel_read(file, offset, rbuf, PAGE_SIZE);
+		rbuf_len = integrity_kernel_read(file, offset, rbuf, rbuf_size);
 		if (rbuf_len < 0) {
 			rc = rbuf_len;
 			break;
@@ -394,13 +426,15 @@ static int ima_calc_file_hash_tfm(struct file *file,
 			break;
 		offset += rbuf_len;
 
+		ima_readahead(file, offset, i_size, rbuf_size);
+
 		rc = crypto_shash_update(shash, rbuf, rbuf_len);
 		if (rc)
 			break;
 	}
 	if (read)
 		file->f_mode &= ~FMODE_READ;
-	kfree(rbuf);
+	ima_free_pages(rbuf, rbuf_size);
 out:
 	if (!rc)
 		rc = crypto_shash_final(shash, hash->digest);
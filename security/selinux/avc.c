@@ -23,6 +23,8 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/bootmem.h>
+#include <linux/jhash.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,8 +36,8 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
-#define AVC_DEF_CACHE_THRESHOLD		512
+#define AVC_CACHE_MIN_SLOTS		512
+#define AVC_CACHE_MAX_SLOTS		65536
 #define AVC_CACHE_RECLAIM		16
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
@@ -54,7 +56,7 @@ struct avc_entry {
 
 struct avc_node {
 	struct avc_entry	ae;
-	struct hlist_node	list; /* anchored in avc_cache->slots[i] */
+	struct hlist_node	list; /* anchored in avc_cache.slots[i].head */
 	struct rcu_head		rhead;
 };
 
@@ -68,9 +70,14 @@ struct avc_xperms_node {
 	struct list_head xpd_head; /* list head of extended_perms_decision */
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_slot		*slots;
+	unsigned int		slots_mask;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
@@ -82,8 +89,17 @@ struct avc_callback_node {
 	struct avc_callback_node *next;
 };
 
-/* Exported via selinufs */
-unsigned int avc_cache_threshold = AVC_DEF_CACHE_THRESHOLD;
+/* Exported via selinufs, defaults to one entry per slot */
+unsigned int avc_cache_threshold;
+
+/* Number of hash slots, 0 sizes the cache by the amount of memory */
+static unsigned long avc_cache_slots __initdata;
+
+static int __init avc_cache_slots_setup(char *str)
+{
+	return kstrtoul(str, 0, &avc_cache_slots) == 0;
+}
+__setup("selinux_avc_slots=", avc_cache_slots_setup);
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
@@ -98,7 +114,7 @@ static struct kmem_cache *avc_xperms_cachep;
 
 static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return jhash_3words(ssid, tsid, tclass, 0) & avc_cache.slots_mask;
 }
 
 /**
@@ -176,12 +192,26 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	unsigned int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
+	/*
+	 * SIDs are handed out densely, so hosts with many contexts need
+	 * far more than the minimum to keep the chains short.  Scale the
+	 * table with memory like the other large system hashes unless
+	 * the size was given on the command line.
+	 */
+	avc_cache.slots = alloc_large_system_hash("AVC cache",
+						  sizeof(struct avc_slot),
+						  avc_cache_slots, 20, 0,
+						  NULL, &avc_cache.slots_mask,
+						  AVC_CACHE_MIN_SLOTS,
+						  AVC_CACHE_MAX_SLOTS);
+	for (i = 0; i <= avc_cache.slots_mask; i++) {
+		INIT_HLIST_HEAD(&avc_cache.slots[i].head);
+		spin_lock_init(&avc_cache.slots[i].lock);
 	}
+	if (!avc_cache_threshold)
+		avc_cache_threshold = avc_cache.slots_mask + 1;
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
 
@@ -211,8 +241,8 @@ int avc_get_hash_stats(char *page)
 
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i <= avc_cache.slots_mask; i++) {
+		head = &avc_cache.slots[i].head;
 		if (!hlist_empty(head)) {
 			slots_used++;
 			chain_len = 0;
@@ -228,7 +258,7 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, avc_cache.slots_mask + 1, max_chain_len);
 }
 
 /*
@@ -520,10 +550,11 @@ static inline int avc_reclaim_node(void)
 	struct hlist_head *head;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	for (try = 0, ecx = 0; try <= avc_cache.slots_mask; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) &
+			 avc_cache.slots_mask;
+		head = &avc_cache.slots[hvalue].head;
+		lock = &avc_cache.slots[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
@@ -579,7 +610,7 @@ static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 	struct hlist_head *head;
 
 	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	head = &avc_cache.slots[hvalue].head;
 	hlist_for_each_entry_rcu(node, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -682,8 +713,8 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 			kmem_cache_free(avc_node_cachep, node);
 			return NULL;
 		}
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		head = &avc_cache.slots[hvalue].head;
+		lock = &avc_cache.slots[hvalue].lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, head, list) {
@@ -837,8 +868,8 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	/* Lock the target slot */
 	hvalue = avc_hash(ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &avc_cache.slots[hvalue].head;
+	lock = &avc_cache.slots[hvalue].lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -916,9 +947,9 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	for (i = 0; i <= avc_cache.slots_mask; i++) {
+		head = &avc_cache.slots[i].head;
+		lock = &avc_cache.slots[i].lock;
 
 		spin_lock_irqsave(lock, flag);
 		/*
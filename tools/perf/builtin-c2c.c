@@ -0,0 +1,710 @@
+/*
+ * builtin-c2c.c
+ *
+ * Builtin c2c command: Shared data cache line analysis.  Groups load and
+ * store samples of the memory events by the data cache line they hit and
+ * lists the lines that bounce between cpus, the loads that hit modified
+ * data in another core's cache (HITM), with the offsets and code locations
+ * that access them.
+ */
+#include "builtin.h"
+#include "perf.h"
+
+#include <sys/mman.h>
+#include <linux/rbtree.h>
+#include <subcmd/parse-options.h>
+#include "util/tool.h"
+#include "util/session.h"
+#include "util/data.h"
+#include "util/mem-events.h"
+#include "util/debug.h"
+#include "util/symbol.h"
+#include "util/thread.h"
+#include "util/cpumap.h"
+#include "util/sort.h"
+
+struct c2c_stats {
+	u32	nr_entries;
+	u32	loads;
+	u32	stores;
+	u32	lcl_hitm;
+	u32	rmt_hitm;
+	u32	st_l1hit;
+	u32	st_l1miss;
+	u64	ld_weight;
+};
+
+/* one code location accessing an offset of a cache line */
+struct c2c_offset {
+	struct rb_node		rb_node;
+	struct rb_node		sorted_node;
+	u64			offset;
+	u64			iaddr;
+	struct map		*map;
+	struct symbol		*sym;
+	u64			nodes;
+	struct c2c_stats	stats;
+};
+
+struct c2c_cacheline {
+	struct rb_node		rb_node;
+	struct rb_node		sorted_node;
+	u64			addr;
+	struct map		*map;
+	pid_t			pid;
+	u8			cpumode;
+	u64			nodes;
+	struct c2c_stats	stats;
+	struct rb_root		offsets;
+	struct rb_root		sorted_offsets;
+};
+
+struct perf_c2c {
+	struct perf_tool	tool;
+	bool			force;
+	bool			show_all;
+	struct rb_root		cachelines;
+	struct rb_root		sorted_cachelines;
+	struct c2c_stats	stats;
+	u32			nr_cachelines;
+	u32			nr_shared;
+	u32			no_daddr;
+	int			*cpu2node;
+	int			nr_cpus;
+};
+
+static bool c2c_stats__add(struct c2c_stats *stats,
+			   union perf_mem_data_src *dsrc, u64 weight)
+{
+	u64 lvl = dsrc->mem_lvl;
+
+	if (dsrc->mem_op & PERF_MEM_OP_LOAD) {
+		stats->loads++;
+		stats->ld_weight += weight;
+		if (dsrc->mem_snoop & PERF_MEM_SNOOP_HITM) {
+			if (lvl & PERF_MEM_LVL_L3)
+				stats->lcl_hitm++;
+			if (lvl & (PERF_MEM_LVL_REM_CCE1 | PERF_MEM_LVL_REM_CCE2))
+				stats->rmt_hitm++;
+		}
+	} else if (dsrc->mem_op & PERF_MEM_OP_STORE) {
+		stats->stores++;
+		if (lvl & PERF_MEM_LVL_L1) {
+			if (lvl & PERF_MEM_LVL_HIT)
+				stats->st_l1hit++;
+			if (lvl & PERF_MEM_LVL_MISS)
+				stats->st_l1miss++;
+		}
+	} else {
+		return false;
+	}
+
+	stats->nr_entries++;
+	return true;
+}
+
+/*
+ * Same rules as the dcacheline sort key: file backed and kernel lines are
+ * the same line in every process, anonymous private memory is per pid.
+ */
+static pid_t c2c__line_pid(struct map *map, u8 cpumode, struct thread *thread)
+{
+	if (cpumode != PERF_RECORD_MISC_KERNEL && map &&
+	    !(map->flags & MAP_SHARED) && !map->maj && !map->min &&
+	    !map->ino && !map->ino_generation)
+		return thread->pid_;
+	return -1;
+}
+
+static int c2c_cacheline__cmp(struct c2c_cacheline *cl, u8 cpumode,
+			      struct map *map, pid_t pid, u64 addr)
+{
+	struct map *l_map = cl->map;
+
+	if (cl->cpumode != cpumode)
+		return cl->cpumode > cpumode ? -1 : 1;
+
+	if (!l_map || !map) {
+		if (l_map != map)
+			return !l_map ? -1 : 1;
+		goto addr;
+	}
+
+	if (l_map->maj != map->maj)
+		return l_map->maj > map->maj ? -1 : 1;
+	if (l_map->min != map->min)
+		return l_map->min > map->min ? -1 : 1;
+	if (l_map->ino != map->ino)
+		return l_map->ino > map->ino ? -1 : 1;
+	if (l_map->ino_generation != map->ino_generation)
+		return l_map->ino_generation > map->ino_generation ? -1 : 1;
+	if (cl->pid != pid)
+		return cl->pid > pid ? -1 : 1;
+addr:
+	if (cl->addr != addr)
+		return cl->addr > addr ? -1 : 1;
+	return 0;
+}
+
+static struct c2c_cacheline *c2c__findnew_cacheline(struct perf_c2c *c2c,
+						    struct addr_location *al,
+						    struct mem_info *mi)
+{
+	struct rb_node **p = &c2c->cachelines.rb_node, *parent = NULL;
+	struct map *map = mi->daddr.map;
+	u64 addr = cl_address(mi->daddr.al_addr);
+	pid_t pid = c2c__line_pid(map, al->cpumode, al->thread);
+	struct c2c_cacheline *cl;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		cl = rb_entry(parent, struct c2c_cacheline, rb_node);
+
+		cmp = c2c_cacheline__cmp(cl, al->cpumode, map, pid, addr);
+		if (!cmp)
+			return cl;
+		if (cmp < 0)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	cl = zalloc(sizeof(*cl));
+	if (!cl)
+		return NULL;
+
+	cl->addr = addr;
+	cl->map = map__get(map);
+	cl->pid = pid;
+	cl->cpumode = al->cpumode;
+	cl->offsets = RB_ROOT;
+	cl->sorted_offsets = RB_ROOT;
+
+	rb_link_node(&cl->rb_node, parent, p);
+	rb_insert_color(&cl->rb_node, &c2c->cachelines);
+	c2c->nr_cachelines++;
+	return cl;
+}
+
+static struct c2c_offset *c2c_cacheline__findnew_offset(struct c2c_cacheline *cl,
+							 struct mem_info *mi)
+{
+	struct rb_node **p = &cl->offsets.rb_node, *parent = NULL;
+	u64 offset = cl_offset(mi->daddr.al_addr);
+	u64 iaddr = mi->iaddr.addr;
+	struct c2c_offset *off;
+
+	while (*p) {
+		parent = *p;
+		off = rb_entry(parent, struct c2c_offset, rb_node);
+
+		if (off->offset == offset && off->iaddr == iaddr)
+			return off;
+		if (offset < off->offset ||
+		    (offset == off->offset && iaddr < off->iaddr))
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	off = zalloc(sizeof(*off));
+	if (!off)
+		return NULL;
+
+	off->offset = offset;
+	off->iaddr = iaddr;
+	off->map = map__get(mi->iaddr.map);
+	off->sym = mi->iaddr.sym;
+
+	rb_link_node(&off->rb_node, parent, p);
+	rb_insert_color(&off->rb_node, &cl->offsets);
+	return off;
+}
+
+static u64 c2c__node_bit(struct perf_c2c *c2c, struct perf_sample *sample)
+{
+	int node;
+
+	if (!c2c->cpu2node || sample->cpu >= (u32)c2c->nr_cpus)
+		return 0;
+
+	/* only the first 64 nodes are told apart */
+	node = c2c->cpu2node[sample->cpu];
+	return node >= 0 && node < 64 ? 1ULL << node : 0;
+}
+
+static int process_sample_event(struct perf_tool *tool,
+				union perf_event *event,
+				struct perf_sample *sample,
+				struct perf_evsel *evsel __maybe_unused,
+				struct machine *machine)
+{
+	struct perf_c2c *c2c = container_of(tool, struct perf_c2c, tool);
+	struct c2c_cacheline *cl;
+	struct c2c_offset *off;
+	struct addr_location al;
+	struct mem_info *mi;
+	u64 node;
+	int ret = 0;
+
+	if (machine__resolve(machine, &al, sample) < 0) {
+		pr_debug("problem processing %d event, skipping it.\n",
+			 event->header.type);
+		return -1;
+	}
+
+	if (al.filtered)
+		goto out_put;
+
+	if (!sample->addr || !sample->data_src) {
+		c2c->no_daddr++;
+		goto out_put;
+	}
+
+	mi = sample__resolve_mem(sample, &al);
+	if (!mi) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	if (!c2c_stats__add(&c2c->stats, &mi->data_src, sample->weight))
+		goto out_free;
+
+	cl = c2c__findnew_cacheline(c2c, &al, mi);
+	off = cl ? c2c_cacheline__findnew_offset(cl, mi) : NULL;
+	if (!off) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	c2c_stats__add(&cl->stats, &mi->data_src, sample->weight);
+	c2c_stats__add(&off->stats, &mi->data_src, sample->weight);
+
+	node = c2c__node_bit(c2c, sample);
+	cl->nodes |= node;
+	off->nodes |= node;
+
+	if (al.map)
+		al.map->dso->hit = 1;
+out_free:
+	free(mi);
+out_put:
+	addr_location__put(&al);
+	return ret;
+}
+
+/* cpu to node from the header, the recording machine may not be this one */
+static int c2c__setup_nodes(struct perf_c2c *c2c, struct perf_env *env)
+{
+	char *str = env->numa_nodes, *tmp;
+	struct cpu_map *map;
+	int i, j, node;
+
+	if (!str || env->nr_cpus_avail <= 0)
+		return 0;
+
+	c2c->nr_cpus = env->nr_cpus_avail;
+	c2c->cpu2node = malloc(c2c->nr_cpus * sizeof(int));
+	if (!c2c->cpu2node)
+		return -ENOMEM;
+	for (i = 0; i < c2c->nr_cpus; i++)
+		c2c->cpu2node[i] = -1;
+
+	for (i = 0; i < env->nr_numa_nodes; i++) {
+		/* "node:mem_total:mem_free:cpu list" */
+		node = strtoul(str, &tmp, 0);
+		for (j = 0; j < 3 && tmp; j++)
+			tmp = strchr(tmp, ':') ? strchr(tmp, ':') + 1 : NULL;
+		if (!tmp)
+			break;
+
+		map = cpu_map__new(tmp);
+		for (j = 0; map && j < map->nr; j++) {
+			if (map->map[j] >= 0 && map->map[j] < c2c->nr_cpus)
+				c2c->cpu2node[map->map[j]] = node;
+		}
+		cpu_map__put(map);
+		str = tmp + strlen(tmp) + 1;
+	}
+	return 0;
+}
+
+static u32 c2c_stats__hitm(struct c2c_stats *stats)
+{
+	return stats->rmt_hitm + stats->lcl_hitm;
+}
+
+static int c2c_stats__cmp(struct c2c_stats *a, struct c2c_stats *b)
+{
+	if (a->rmt_hitm != b->rmt_hitm)
+		return a->rmt_hitm > b->rmt_hitm ? -1 : 1;
+	if (a->lcl_hitm != b->lcl_hitm)
+		return a->lcl_hitm > b->lcl_hitm ? -1 : 1;
+	if (a->nr_entries != b->nr_entries)
+		return a->nr_entries > b->nr_entries ? -1 : 1;
+	return 0;
+}
+
+static void c2c_cacheline__sort_offsets(struct c2c_cacheline *cl)
+{
+	struct rb_node *nd, **p, *parent;
+	struct c2c_offset *off, *pos;
+
+	for (nd = rb_first(&cl->offsets); nd; nd = rb_next(nd)) {
+		off = rb_entry(nd, struct c2c_offset, rb_node);
+		p = &cl->sorted_offsets.rb_node;
+		parent = NULL;
+
+		/* by offset, then the code doing the most damage first */
+		while (*p) {
+			parent = *p;
+			pos = rb_entry(parent, struct c2c_offset, sorted_node);
+			if (off->offset < pos->offset ||
+			    (off->offset == pos->offset &&
+			     c2c_stats__cmp(&off->stats, &pos->stats) < 0))
+				p = &(*p)->rb_left;
+			else
+				p = &(*p)->rb_right;
+		}
+		rb_link_node(&off->sorted_node, parent, p);
+		rb_insert_color(&off->sorted_node, &cl->sorted_offsets);
+	}
+}
+
+static void c2c__sort_cachelines(struct perf_c2c *c2c)
+{
+	struct rb_node *nd, **p, *parent;
+	struct c2c_cacheline *cl, *pos;
+
+	for (nd = rb_first(&c2c->cachelines); nd; nd = rb_next(nd)) {
+		cl = rb_entry(nd, struct c2c_cacheline, rb_node);
+
+		if (c2c_stats__hitm(&cl->stats))
+			c2c->nr_shared++;
+		else if (!c2c->show_all)
+			continue;
+
+		p = &c2c->sorted_cachelines.rb_node;
+		parent = NULL;
+		while (*p) {
+			parent = *p;
+			pos = rb_entry(parent, struct c2c_cacheline, sorted_node);
+			if (c2c_stats__cmp(&cl->stats, &pos->stats) < 0)
+				p = &(*p)->rb_left;
+			else
+				p = &(*p)->rb_right;
+		}
+		rb_link_node(&cl->sorted_node, parent, p);
+		rb_insert_color(&cl->sorted_node, &c2c->sorted_cachelines);
+
+		c2c_cacheline__sort_offsets(cl);
+	}
+}
+
+static double percent(u32 st, u32 tot)
+{
+	return tot ? 100.0 * st / tot : 0.0;
+}
+
+static void print_header(const char *title)
+{
+	printf("=================================================\n");
+	printf("%*s%s\n", (int)(49 - strlen(title)) / 2, "", title);
+	printf("=================================================\n");
+}
+
+static void print_nodes(u64 nodes)
+{
+	char bf[64 * 4] = "", *p = bf;
+	int node;
+
+	for (node = 0; node < 64; node++) {
+		if (nodes & (1ULL << node))
+			p += scnprintf(p, bf + sizeof(bf) - p, "%s%d",
+				       p == bf ? "" : ",", node);
+	}
+	printf("  %-8s", p == bf ? "-" : bf);
+}
+
+static void print_stats(struct perf_c2c *c2c)
+{
+	struct c2c_stats *stats = &c2c->stats;
+
+	print_header("Trace Event Information");
+	printf("  Total records                     : %10u\n", stats->nr_entries);
+	printf("  Load Operations                   : %10u\n", stats->loads);
+	printf("  Load Local HITM                   : %10u\n", stats->lcl_hitm);
+	printf("  Load Remote HITM                  : %10u\n", stats->rmt_hitm);
+	printf("  Store Operations                  : %10u\n", stats->stores);
+	printf("  Store L1D Hit                     : %10u\n", stats->st_l1hit);
+	printf("  Store L1D Miss                    : %10u\n", stats->st_l1miss);
+	printf("  No data address or source         : %10u\n", c2c->no_daddr);
+	printf("  Cache lines                       : %10u\n", c2c->nr_cachelines);
+	printf("  Shared data cache lines (HITM)    : %10u\n", c2c->nr_shared);
+	printf("\n");
+}
+
+static void print_cacheline_table(struct perf_c2c *c2c)
+{
+	struct c2c_stats *tot = &c2c->stats;
+	struct c2c_cacheline *cl;
+	struct rb_node *nd;
+	int idx = 0;
+
+	print_header("Shared Data Cache Line Table");
+	printf("#  Index         Cacheline  Rmt HITM  Lcl HITM   Records"
+	       "     Loads    Stores  Nodes     Data object\n");
+
+	for (nd = rb_first(&c2c->sorted_cachelines); nd; nd = rb_next(nd)) {
+		cl = rb_entry(nd, struct c2c_cacheline, sorted_node);
+
+		printf("  %5d  %#16" PRIx64 "   %6.2f%%   %6.2f%%  %8u  %8u  %8u",
+		       idx++, cl->addr,
+		       percent(cl->stats.rmt_hitm, tot->rmt_hitm),
+		       percent(cl->stats.lcl_hitm, tot->lcl_hitm),
+		       cl->stats.nr_entries, cl->stats.loads, cl->stats.stores);
+		print_nodes(cl->nodes);
+		printf("  %s\n", cl->map && cl->map->dso ?
+		       cl->map->dso->short_name : "[unknown]");
+	}
+	printf("\n");
+}
+
+static void print_pareto(struct perf_c2c *c2c)
+{
+	struct c2c_cacheline *cl;
+	struct c2c_offset *off;
+	struct rb_node *nd, *ond;
+	int idx = 0;
+
+	print_header("Shared Cache Line Distribution Pareto");
+
+	for (nd = rb_first(&c2c->sorted_cachelines); nd; nd = rb_next(nd)) {
+		cl = rb_entry(nd, struct c2c_cacheline, sorted_node);
+
+		printf("\n  ----- %d: cache line %#" PRIx64 ", %u HITM"
+		       " (%u remote, %u local), pid %d -----\n",
+		       idx++, cl->addr, c2c_stats__hitm(&cl->stats),
+		       cl->stats.rmt_hitm, cl->stats.lcl_hitm, cl->pid);
+		printf("#  Rmt HITM  Lcl HITM   St L1Hit  St L1Miss  Offset"
+		       "        Code address   Ld cycles  Nodes     Symbol\n");
+
+		for (ond = rb_first(&cl->sorted_offsets); ond;
+		     ond = rb_next(ond)) {
+			off = rb_entry(ond, struct c2c_offset, sorted_node);
+
+			printf("   %6.2f%%   %6.2f%%    %6.2f%%    %6.2f%%  %#6" PRIx64
+			       "  %#18" PRIx64 "  %10" PRIu64,
+			       percent(off->stats.rmt_hitm, cl->stats.rmt_hitm),
+			       percent(off->stats.lcl_hitm, cl->stats.lcl_hitm),
+			       percent(off->stats.st_l1hit, cl->stats.st_l1hit),
+			       percent(off->stats.st_l1miss, cl->stats.st_l1miss),
+			       off->offset, off->iaddr,
+			       off->stats.loads ?
+			       off->stats.ld_weight / off->stats.loads : 0);
+			print_nodes(off->nodes);
+			printf("  %s  %s\n", off->sym ? off->sym->name : "[unknown]",
+			       off->map && off->map->dso ?
+			       off->map->dso->short_name : "[unknown]");
+		}
+	}
+}
+
+static void c2c__delete_cachelines(struct perf_c2c *c2c)
+{
+	struct rb_node *nd, *ond;
+	struct c2c_cacheline *cl;
+	struct c2c_offset *off;
+
+	while ((nd = rb_first(&c2c->cachelines))) {
+		cl = rb_entry(nd, struct c2c_cacheline, rb_node);
+		rb_erase(nd, &c2c->cachelines);
+
+		while ((ond = rb_first(&cl->offsets))) {
+			off = rb_entry(ond, struct c2c_offset, rb_node);
+			rb_erase(ond, &cl->offsets);
+			map__put(off->map);
+			free(off);
+		}
+		map__put(cl->map);
+		free(cl);
+	}
+}
+
+static const char * const report_c2c_usage[] = {
+	"perf c2c report [<options>]",
+	NULL
+};
+
+static int perf_c2c__report(int argc, const char **argv, struct perf_c2c *c2c)
+{
+	struct perf_data_file file = {
+		.mode = PERF_DATA_MODE_READ,
+	};
+	struct perf_session *session;
+	const struct option options[] = {
+	OPT_STRING('i', "input", &input_name, "file",
+		   "the input file to process"),
+	OPT_BOOLEAN('f', "force", &c2c->force, "don't complain, do it"),
+	OPT_BOOLEAN('a', "all", &c2c->show_all,
+		    "list cache lines without HITM as well"),
+	OPT_INCR('v', "verbose", &verbose,
+		 "be more verbose (show counter open errors, etc)"),
+	OPT_END()
+	};
+	int err;
+
+	argc = parse_options(argc, argv, options, report_c2c_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	if (argc)
+		usage_with_options(report_c2c_usage, options);
+
+	file.path = input_name;
+	file.force = c2c->force;
+
+	session = perf_session__new(&file, 0, &c2c->tool);
+	if (session == NULL) {
+		pr_debug("No memory for session\n");
+		return -1;
+	}
+
+	err = symbol__init(&session->header.env);
+	if (err < 0)
+		goto out_delete;
+
+	err = c2c__setup_nodes(c2c, &session->header.env);
+	if (err < 0)
+		goto out_delete;
+
+	err = perf_session__process_events(session);
+	if (err) {
+		pr_err("failed to process sample\n");
+		goto out_delete;
+	}
+
+	c2c__sort_cachelines(c2c);
+
+	setup_pager();
+	print_stats(c2c);
+	print_cacheline_table(c2c);
+	print_pareto(c2c);
+
+out_delete:
+	c2c__delete_cachelines(c2c);
+	zfree(&c2c->cpu2node);
+	perf_session__delete(session);
+	return err;
+}
+
+static const char * const record_c2c_usage[] = {
+	"perf c2c record [<options>] [<command>]",
+	"perf c2c record [<options>] -- <command> [<options>]",
+	NULL
+};
+
+static int perf_c2c__record(int argc, const char **argv)
+{
+	bool all_user = false, all_kernel = false;
+	int rec_argc, i = 0, j, ret;
+	const char **rec_argv;
+	const struct option options[] = {
+	OPT_INCR('v', "verbose", &verbose,
+		 "be more verbose (show counter open errors, etc)"),
+	OPT_BOOLEAN('u', "all-user", &all_user, "collect only user level data"),
+	OPT_BOOLEAN('k', "all-kernel", &all_kernel, "collect only kernel level data"),
+	OPT_END()
+	};
+
+	argc = parse_options(argc, argv, options, record_c2c_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+
+	rec_argc = argc + 10; /* max number of arguments */
+	rec_argv = calloc(rec_argc + 1, sizeof(char *));
+	if (!rec_argv)
+		return -1;
+
+	rec_argv[i++] = "record";
+	rec_argv[i++] = "-W";
+	rec_argv[i++] = "-d";
+	rec_argv[i++] = "--sample-cpu";
+
+	for (j = 0; j < PERF_MEM_EVENTS__MAX; j++) {
+		if (!perf_mem_events[j].supported) {
+			pr_err("failed: event '%s' not supported\n",
+			       perf_mem_events__name(j));
+			free(rec_argv);
+			return -1;
+		}
+
+		rec_argv[i++] = "-e";
+		rec_argv[i++] = perf_mem_events__name(j);
+	}
+
+	if (all_user)
+		rec_argv[i++] = "--all-user";
+
+	if (all_kernel)
+		rec_argv[i++] = "--all-kernel";
+
+	for (j = 0; j < argc; j++, i++)
+		rec_argv[i] = argv[j];
+
+	if (verbose > 0) {
+		pr_debug("calling: ");
+
+		for (j = 0; j < i; j++)
+			pr_debug("%s ", rec_argv[j]);
+		pr_debug("\n");
+	}
+
+	ret = cmd_record(i, rec_argv, NULL);
+	free(rec_argv);
+	return ret;
+}
+
+int cmd_c2c(int argc, const char **argv, const char *prefix __maybe_unused)
+{
+	struct perf_c2c c2c = {
+		.tool = {
+			.sample		= process_sample_event,
+			.mmap		= perf_event__process_mmap,
+			.mmap2		= perf_event__process_mmap2,
+			.comm		= perf_event__process_comm,
+			.exit		= perf_event__process_exit,
+			.fork		= perf_event__process_fork,
+			.lost		= perf_event__process_lost,
+			.build_id	= perf_event__process_build_id,
+			.ordered_events	= true,
+		},
+		.cachelines		= RB_ROOT,
+		.sorted_cachelines	= RB_ROOT,
+	};
+	const struct option c2c_options[] = {
+	OPT_INCR('v', "verbose", &verbose, "be more verbose"),
+	OPT_END()
+	};
+	const char *const c2c_subcommands[] = { "record", "report", NULL };
+	const char *c2c_usage[] = {
+		NULL,
+		NULL
+	};
+
+	argc = parse_options_subcommand(argc, argv, c2c_options, c2c_subcommands,
+					c2c_usage, PARSE_OPT_STOP_AT_NON_OPTION);
+	if (!argc)
+		usage_with_options(c2c_usage, c2c_options);
+
+	if (!strncmp(argv[0], "rec", 3)) {
+		if (perf_mem_events__init()) {
+			pr_err("failed: memory events not supported\n");
+			return -1;
+		}
+		return perf_c2c__record(argc, argv);
+	} else if (!strncmp(argv[0], "rep", 3)) {
+		return perf_c2c__report(argc, argv, &c2c);
+	}
+
+	usage_with_options(c2c_usage, c2c_options);
+	return 0;
+}
@@ -34,14 +34,26 @@
 #include "util/parse-regs-options.h"
 #include "util/llvm-utils.h"
 #include "util/bpf-loader.h"
+#include "util/bpf-off-cpu.h"
 #include "util/trigger.h"
 #include "asm/bug.h"
 
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <asm/bug.h>
 
+struct record;
+
+struct record_thread {
+	pthread_t		tid;
+	struct record		*rec;
+	int			mmap_start;
+	int			mmap_end;
+	unsigned long long	samples;
+	int			err;
+};
 
 struct record {
 	struct perf_tool	tool;
@@ -61,10 +73,53 @@ struct record {
 	bool			timestamp_filename;
 	bool			switch_output;
 	unsigned long long	samples;
+	int			nr_threads;
+	struct record_thread	*threads;
+	pthread_mutex_t		threads_lock;
+	pthread_cond_t		round_cond;
+	pthread_cond_t		round_done_cond;
+	unsigned int		round;
+	int			threads_busy;
+	bool			threads_exit;
+	off_t			threads_fileoff;
+	bool			off_cpu;
+	struct off_cpu		off_cpu_maps;
+	struct perf_evsel	*off_cpu_evsel;
+	struct perf_evsel	*off_cpu_switch;
 };
 
+/*
+ * While reader threads run they write concurrently: every write reserves
+ * its own range of the file, the file offset is only moved once they're
+ * stopped.
+ */
+static int record__pwrite(struct record *rec, void *bf, size_t size)
+{
+	int fd = perf_data_file__fd(rec->session->file);
+	off_t off = rec->threads_fileoff +
+		    __sync_fetch_and_add(&rec->bytes_written, size);
+
+	while (size) {
+		ssize_t ret = pwrite(fd, bf, size, off);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			pr_err("failed to write perf data, error: %m\n");
+			return -1;
+		}
+		bf += ret;
+		off += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
 static int record__write(struct record *rec, void *bf, size_t size)
 {
+	if (rec->threads)
+		return record__pwrite(rec, bf, size);
+
 	if (perf_data_file__write(rec->session->file, bf, size) < 0) {
 		pr_err("failed to write perf data, error: %m\n");
 		return -1;
@@ -149,15 +204,13 @@ static int record__mmap_read(struct record *rec, int idx)
 	if (start == end)
 		return 0;
 
-	rec->samples++;
-
 	size = end - start;
 	if (size > (unsigned long)(md->mask) + 1) {
 		WARN_ONCE(1, "failed to keep up with mmap data. (warn only once)\n");
 
 		md->prev = head;
 		perf_evlist__mmap_consume(rec->evlist, idx);
-		return 0;
+		return 1;
 	}
 
 	if ((start & md->mask) + size != (end & md->mask)) {
@@ -182,6 +235,7 @@ static int record__mmap_read(struct record *rec, int idx)
 
 	md->prev = head;
 	perf_evlist__mmap_consume(rec->evlist, idx);
+	rc = 1;
 out:
 	return rc;
 }
@@ -341,6 +395,210 @@ int auxtrace_record__snapshot_start(struct auxtrace_record *itr __maybe_unused)
 
 #endif
 
+/*
+ * The off-cpu samples are synthesized at the end from what the BPF program
+ * aggregated, on a dummy event that gives them an id and a sample_type.
+ * Leave alone the bits that locate the sample id, they have to match the
+ * other events.
+ */
+#define OFF_CPU_SAMPLE_KEEP	(PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP |	\
+				 PERF_SAMPLE_TID | PERF_SAMPLE_TIME |		\
+				 PERF_SAMPLE_ADDR | PERF_SAMPLE_ID |		\
+				 PERF_SAMPLE_STREAM_ID | PERF_SAMPLE_CPU)
+
+static int record__add_off_cpu_evsel(struct record *rec)
+{
+	struct perf_event_attr attr = {
+		.type	= PERF_TYPE_SOFTWARE,
+		.config = PERF_COUNT_SW_DUMMY,
+		.size	= sizeof(attr), /* to capture ABI version */
+	};
+	struct perf_evsel *evsel = perf_evsel__new(&attr);
+
+	if (evsel == NULL)
+		return -ENOMEM;
+
+	evsel->name = strdup(OFF_CPU_EVENT_NAME);
+	if (evsel->name == NULL) {
+		perf_evsel__delete(evsel);
+		return -ENOMEM;
+	}
+
+	perf_evlist__add(rec->evlist, evsel);
+	rec->off_cpu_evsel = evsel;
+	return 0;
+}
+
+static void record__config_off_cpu_evsel(struct perf_evsel *evsel)
+{
+	evsel->attr.sample_type &= OFF_CPU_SAMPLE_KEEP;
+	evsel->attr.sample_type |= PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_PERIOD;
+	evsel->attr.sample_period = 1;
+	evsel->attr.freq = 0;
+	perf_evsel__calc_id_pos(evsel);
+}
+
+static int record__setup_off_cpu(struct record *rec)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	struct off_cpu_filter filter = { .nr_pids = 0, };
+	struct format_field *prev_state, *next_pid;
+	struct perf_evsel *evsel;
+	pid_t self = getpid(), *pids = NULL;
+	int i, err;
+
+	evsel = perf_evsel__newtp("sched", "sched_switch");
+	if (IS_ERR(evsel)) {
+		pr_err("Can't open the sched:sched_switch tracepoint\n");
+		return PTR_ERR(evsel);
+	}
+
+	prev_state = perf_evsel__field(evsel, "prev_state");
+	next_pid   = perf_evsel__field(evsel, "next_pid");
+	if (prev_state == NULL || next_pid == NULL) {
+		pr_err("Can't find the sched:sched_switch fields\n");
+		err = -EINVAL;
+		goto out_delete;
+	}
+
+	filter.prev_state_offset = prev_state->offset;
+	filter.prev_state_size	 = prev_state->size;
+	filter.next_pid_offset	 = next_pid->offset;
+
+	/*
+	 * The BPF program sees every context switch in the system, do the
+	 * target filtering there.
+	 */
+	if (thread_map__pid(evlist->threads, 0) == -1) {
+		filter.exclude	  = &self;
+		filter.nr_exclude = 1;
+	} else {
+		filter.nr_pids = thread_map__nr(evlist->threads);
+		pids = calloc(filter.nr_pids, sizeof(pid_t));
+		if (pids == NULL) {
+			err = -ENOMEM;
+			goto out_delete;
+		}
+
+		for (i = 0; i < filter.nr_pids; i++)
+			pids[i] = thread_map__pid(evlist->threads, i);
+		filter.pids = pids;
+	}
+
+	err = off_cpu__load(&rec->off_cpu_maps, &filter);
+	free(pids);
+	if (err)
+		goto out_delete;
+
+	evsel->cpus    = cpu_map__new(NULL);
+	evsel->threads = thread_map__new_dummy();
+	if (evsel->cpus == NULL || evsel->threads == NULL) {
+		err = -ENOMEM;
+		goto out_close;
+	}
+
+	evsel->bpf_fd = rec->off_cpu_maps.prog_fd;
+	if (perf_evsel__open(evsel, evsel->cpus, evsel->threads) < 0) {
+		err = -errno;
+		pr_err("Failed to attach the off-cpu BPF program: %s\n",
+		       strerror(errno));
+		goto out_close;
+	}
+
+	rec->off_cpu_switch = evsel;
+	return 0;
+
+out_close:
+	off_cpu__close(&rec->off_cpu_maps);
+out_delete:
+	perf_evsel__delete(evsel);
+	return err;
+}
+
+static int record__off_cpu_sample(struct off_cpu_key *key,
+				  struct off_cpu_val *val,
+				  u64 *kstack, int nr_kstack,
+				  u64 *ustack, int nr_ustack, void *arg)
+{
+	struct record *rec = arg;
+	struct perf_evsel *evsel = rec->off_cpu_evsel;
+	u64 type = evsel->attr.sample_type;
+	u64 chain[1 + 2 * (1 + OFF_CPU_MAX_STACK)];
+	struct perf_sample sample = {
+		.pid	= key->tgid,
+		.tid	= key->tid,
+		.time	= val->last,
+		.period	= val->total,
+		.callchain = (struct ip_callchain *)chain,
+	};
+	union perf_event *event;
+	size_t size;
+	u64 nr = 0;
+	int err;
+
+	if (evsel->ids)
+		sample.id = sample.stream_id = evsel->id[0];
+
+	if (nr_kstack) {
+		chain[1 + nr++] = PERF_CONTEXT_KERNEL;
+		memcpy(&chain[1 + nr], kstack, nr_kstack * sizeof(u64));
+		nr += nr_kstack;
+		sample.ip = kstack[0];
+	}
+	if (nr_ustack) {
+		chain[1 + nr++] = PERF_CONTEXT_USER;
+		memcpy(&chain[1 + nr], ustack, nr_ustack * sizeof(u64));
+		nr += nr_ustack;
+		if (!nr_kstack)
+			sample.ip = ustack[0];
+	}
+	chain[0] = nr;
+
+	size = perf_event__sample_event_size(&sample, type, evsel->attr.read_format);
+	event = zalloc(size);
+	if (event == NULL)
+		return -ENOMEM;
+
+	event->header.type = PERF_RECORD_SAMPLE;
+	event->header.misc = nr_kstack ? PERF_RECORD_MISC_KERNEL :
+					 PERF_RECORD_MISC_USER;
+	event->header.size = size;
+
+	err = perf_event__synthesize_sample(event, type, evsel->attr.read_format,
+					    &sample, false);
+	if (!err)
+		err = record__write(rec, event, size);
+
+	free(event);
+	return err;
+}
+
+/*
+ * Detach the program and turn what it accumulated into one sample per
+ * thread and stack pair, weighted by the time spent blocked there.
+ */
+static int record__finish_off_cpu(struct record *rec, bool write)
+{
+	int err = 0;
+
+	if (rec->off_cpu_switch == NULL)
+		return 0;
+
+	perf_evsel__close(rec->off_cpu_switch, cpu_map__nr(rec->off_cpu_switch->cpus),
+			  thread_map__nr(rec->off_cpu_switch->threads));
+	perf_evsel__delete(rec->off_cpu_switch);
+	rec->off_cpu_switch = NULL;
+
+	if (write) {
+		err = off_cpu__for_each(&rec->off_cpu_maps, record__off_cpu_sample, rec);
+		if (err)
+			pr_err("Failed to write the off-cpu samples\n");
+	}
+
+	off_cpu__close(&rec->off_cpu_maps);
+	return err;
+}
+
 static int record__open(struct record *rec)
 {
 	char msg[512];
@@ -352,6 +610,9 @@ static int record__open(struct record *rec)
 
 	perf_evlist__config(evlist, opts, &callchain_param);
 
+	if (rec->off_cpu_evsel)
+		record__config_off_cpu_evsel(rec->off_cpu_evsel);
+
 	evlist__for_each(evlist, pos) {
 try_again:
 		if (perf_evsel__open(pos, pos->cpus, pos->threads) < 0) {
@@ -481,20 +742,187 @@ static struct perf_event_header finished_round_event = {
 	.type = PERF_RECORD_FINISHED_ROUND,
 };
 
+static void record__thread_read(struct record_thread *thread)
+{
+	struct perf_evlist *evlist = thread->rec->evlist;
+	int i, rc;
+
+	for (i = thread->mmap_start; i < thread->mmap_end; i++) {
+		if (!evlist->mmap[i].base)
+			continue;
+
+		rc = record__mmap_read(thread->rec, i);
+		if (rc < 0) {
+			thread->err = rc;
+			return;
+		}
+		thread->samples += rc;
+	}
+}
+
+/* Keep the reader thread close to the buffers it drains. */
+static void record__thread_affinity(struct record_thread *thread)
+{
+	struct cpu_map *cpus = thread->rec->evlist->cpus;
+	cpu_set_t mask;
+	int i;
+
+	/* per-thread buffers aren't tied to any cpu */
+	if (cpu_map__empty(cpus))
+		return;
+
+	CPU_ZERO(&mask);
+	for (i = thread->mmap_start; i < thread->mmap_end; i++) {
+		if (cpus->map[i] >= 0 && cpus->map[i] < CPU_SETSIZE)
+			CPU_SET(cpus->map[i], &mask);
+	}
+
+	if (CPU_COUNT(&mask) && sched_setaffinity(0, sizeof(mask), &mask))
+		pr_debug("failed to set reader thread affinity: %m\n");
+}
+
+static void *record__thread(void *arg)
+{
+	struct record_thread *thread = arg;
+	struct record *rec = thread->rec;
+	unsigned int round = 0;
+
+	record__thread_affinity(thread);
+
+	pthread_mutex_lock(&rec->threads_lock);
+	for (;;) {
+		while (rec->round == round && !rec->threads_exit)
+			pthread_cond_wait(&rec->round_cond, &rec->threads_lock);
+		if (rec->threads_exit)
+			break;
+		round = rec->round;
+		pthread_mutex_unlock(&rec->threads_lock);
+
+		record__thread_read(thread);
+
+		pthread_mutex_lock(&rec->threads_lock);
+		if (--rec->threads_busy == 0)
+			pthread_cond_signal(&rec->round_done_cond);
+	}
+	pthread_mutex_unlock(&rec->threads_lock);
+	return NULL;
+}
+
+/*
+ * Each reader thread drains a contiguous range of the mmaps.  The main
+ * thread still does the polling and starts a round when woken, a round
+ * is finished once every thread went over all its buffers, which is what
+ * PERF_RECORD_FINISHED_ROUND promises to perf report.
+ */
+static int record__threads_start(struct record *rec)
+{
+	int nr_mmaps = rec->evlist->nr_mmaps;
+	int fd = perf_data_file__fd(&rec->file);
+	struct record_thread *thread;
+	int i, per_thread, nr_threads;
+
+	if (rec->nr_threads > nr_mmaps)
+		rec->nr_threads = nr_mmaps;
+	per_thread = DIV_ROUND_UP(nr_mmaps, rec->nr_threads);
+	nr_threads = DIV_ROUND_UP(nr_mmaps, per_thread);
+
+	rec->threads = calloc(nr_threads, sizeof(*rec->threads));
+	if (!rec->threads)
+		return -ENOMEM;
+
+	pthread_mutex_init(&rec->threads_lock, NULL);
+	pthread_cond_init(&rec->round_cond, NULL);
+	pthread_cond_init(&rec->round_done_cond, NULL);
+	rec->threads_fileoff = lseek(fd, 0, SEEK_CUR) - rec->bytes_written;
+
+	for (i = 0, rec->nr_threads = 0; i < nr_threads; i++) {
+		thread = &rec->threads[i];
+		thread->rec = rec;
+		thread->mmap_start = i * per_thread;
+		thread->mmap_end = min(thread->mmap_start + per_thread, nr_mmaps);
+
+		if (pthread_create(&thread->tid, NULL, record__thread, thread)) {
+			pr_err("failed to create reader thread: %m\n");
+			return -1;
+		}
+		rec->nr_threads++;
+	}
+
+	pr_debug("%d threads read %d mmaps\n", rec->nr_threads, nr_mmaps);
+	return 0;
+}
+
+static void record__threads_stop(struct record *rec)
+{
+	int fd = perf_data_file__fd(&rec->file);
+	int i;
+
+	if (!rec->threads)
+		return;
+
+	pthread_mutex_lock(&rec->threads_lock);
+	rec->threads_exit = true;
+	pthread_cond_broadcast(&rec->round_cond);
+	pthread_mutex_unlock(&rec->threads_lock);
+
+	for (i = 0; i < rec->nr_threads; i++)
+		pthread_join(rec->threads[i].tid, NULL);
+
+	pthread_cond_destroy(&rec->round_done_cond);
+	pthread_cond_destroy(&rec->round_cond);
+	pthread_mutex_destroy(&rec->threads_lock);
+
+	/* back to plain writes at the end of what the threads wrote */
+	lseek(fd, rec->threads_fileoff + rec->bytes_written, SEEK_SET);
+	zfree(&rec->threads);
+}
+
+static int record__threads_read_all(struct record *rec)
+{
+	u64 bytes_written = rec->bytes_written;
+	int i, rc = 0;
+
+	pthread_mutex_lock(&rec->threads_lock);
+	rec->threads_busy = rec->nr_threads;
+	rec->round++;
+	pthread_cond_broadcast(&rec->round_cond);
+	while (rec->threads_busy)
+		pthread_cond_wait(&rec->round_done_cond, &rec->threads_lock);
+	pthread_mutex_unlock(&rec->threads_lock);
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->threads[i];
+
+		if (thread->err)
+			rc = -1;
+		rec->samples += thread->samples;
+		thread->samples = 0;
+	}
+
+	if (!rc && bytes_written != rec->bytes_written)
+		rc = record__write(rec, &finished_round_event,
+				   sizeof(finished_round_event));
+	return rc;
+}
+
 static int record__mmap_read_all(struct record *rec)
 {
 	u64 bytes_written = rec->bytes_written;
 	int i;
 	int rc = 0;
 
+	if (rec->threads)
+		return record__threads_read_all(rec);
+
 	for (i = 0; i < rec->evlist->nr_mmaps; i++) {
 		struct auxtrace_mmap *mm = &rec->evlist->mmap[i].auxtrace_mmap;
 
 		if (rec->evlist->mmap[i].base) {
-			if (record__mmap_read(rec, i) != 0) {
-				rc = -1;
+			rc = record__mmap_read(rec, i);
+			if (rc < 0)
 				goto out;
-			}
+			rec->samples += rc;
+			rc = 0;
 		}
 
 		if (mm->base && !rec->opts.auxtrace_snapshot_mode &&
@@ -786,6 +1214,12 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		goto out_child;
 	}
 
+	if (rec->off_cpu) {
+		err = record__setup_off_cpu(rec);
+		if (err)
+			goto out_child;
+	}
+
 	err = bpf__apply_obj_config();
 	if (err) {
 		char errbuf[BUFSIZ];
@@ -832,6 +1266,18 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	if (err < 0)
 		goto out_child;
 
+	if (rec->nr_threads) {
+		if (file->is_pipe || opts->full_auxtrace) {
+			pr_err("--threads can't be used with pipe output or AUX area tracing\n");
+			err = -EINVAL;
+			goto out_child;
+		}
+
+		err = record__threads_start(rec);
+		if (err < 0)
+			goto out_child;
+	}
+
 	if (rec->realtime_prio) {
 		struct sched_param param;
 
@@ -964,6 +1410,8 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		fprintf(stderr, "[ perf record: Woken up %ld times to write data ]\n", waking);
 
 out_child:
+	record__threads_stop(rec);
+
 	if (forks) {
 		int exit_status;
 
@@ -981,6 +1429,9 @@ out_child:
 	} else
 		status = err;
 
+	if (record__finish_off_cpu(rec, !err) < 0)
+		status = err = -1;
+
 	/* this will be recalculated during process_buildids() */
 	rec->samples = 0;
 
@@ -1325,6 +1776,7 @@ struct option __record_options[] = {
 			&record.opts.sample_time_set,
 			"Record the sample timestamps"),
 	OPT_BOOLEAN('P', "period", &record.opts.period, "Record the sample period"),
+	OPT_BOOLEAN(0, "sample-cpu", &record.opts.sample_cpu, "Record the sample cpu"),
 	OPT_BOOLEAN('n', "no-samples", &record.opts.no_samples,
 		    "don't sample"),
 	OPT_BOOLEAN_SET('N', "no-buildid-cache", &record.no_buildid_cache,
@@ -1386,6 +1838,10 @@ struct option __record_options[] = {
 		    "append timestamp to output filename"),
 	OPT_BOOLEAN(0, "switch-output", &record.switch_output,
 		    "Switch output when receive SIGUSR2"),
+	OPT_INTEGER(0, "threads", &record.nr_threads,
+		    "number of threads reading the mmap buffers"),
+	OPT_BOOLEAN(0, "off-cpu", &record.off_cpu,
+		    "Profile the time threads spend blocked, with BPF"),
 	OPT_END()
 };
 
@@ -1401,6 +1857,7 @@ int cmd_record(int argc, const char **argv, const char *prefix __maybe_unused)
 # define set_nobuild(s, l, c) set_option_nobuild(record_options, s, l, "NO_LIBBPF=1", c)
 	set_nobuild('\0', "clang-path", true);
 	set_nobuild('\0', "clang-opt", true);
+	set_nobuild('\0', "off-cpu", true);
 # undef set_nobuild
 #endif
 
@@ -1444,6 +1901,18 @@ int cmd_record(int argc, const char **argv, const char *prefix __maybe_unused)
 	if (rec->switch_output)
 		rec->timestamp_filename = true;
 
+	if (rec->nr_threads < 0) {
+		ui__error("--threads takes a positive number of threads\n");
+		parse_options_usage(record_usage, record_options, "threads", 0);
+		return -EINVAL;
+	}
+
+	if (rec->nr_threads && rec->switch_output) {
+		ui__error("--threads and --switch-output can't be combined\n");
+		parse_options_usage(record_usage, record_options, "threads", 0);
+		return -EINVAL;
+	}
+
 	if (!rec->itr) {
 		rec->itr = auxtrace_record__init(rec->evlist, &err);
 		if (err)
@@ -1514,6 +1983,21 @@ int cmd_record(int argc, const char **argv, const char *prefix __maybe_unused)
 		goto out_symbol_exit;
 	}
 
+	if (rec->off_cpu) {
+		if (record__add_off_cpu_evsel(rec) < 0) {
+			pr_err("Not enough memory for the off-cpu event\n");
+			goto out_symbol_exit;
+		}
+
+		/* the BPF program timestamps with ktime_get_ns() */
+		if (!rec->opts.use_clockid) {
+			rec->opts.use_clockid = true;
+			rec->opts.clockid = CLOCK_MONOTONIC;
+		} else if (rec->opts.clockid != CLOCK_MONOTONIC) {
+			pr_warning("WARNING: off-cpu samples are timestamped with CLOCK_MONOTONIC\n");
+		}
+	}
+
 	if (rec->opts.target.tid && !rec->opts.no_inherit_set)
 		rec->opts.no_inherit = true;
 
@@ -816,6 +816,8 @@ int cmd_report(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "Show raw trace event output (do not use print fmt or plugins)"),
 	OPT_BOOLEAN(0, "hierarchy", &symbol_conf.report_hierarchy,
 		    "Show entries in a hierarchy"),
+	OPT_INTEGER(0, "symbol-threads", &symbol_conf.nr_load_threads,
+		    "number of threads loading symbols while processing events"),
 	OPT_END()
 	};
 	struct perf_data_file file = {
@@ -13,6 +13,9 @@
 #include "util/cloexec.h"
 #include "util/thread_map.h"
 #include "util/color.h"
+#include "util/stat.h"
+#include "util/callchain.h"
+#include "util/intlist.h"
 
 #include <subcmd/parse-options.h>
 #include "util/trace-event.h"
@@ -191,6 +194,33 @@ struct perf_sched {
 	bool force;
 	bool skip_merge;
 	struct perf_sched_map map;
+
+	/* options for timehist command */
+	bool		summary;
+	bool		summary_only;
+	bool		show_callchain;
+	unsigned int	max_stack;
+	bool		show_wakeups;
+	const char	*cpu_list;
+	DECLARE_BITMAP(cpu_bitmap, MAX_CPUS);
+	struct thread	*idle_threads[MAX_CPUS];
+	u64		hist_time_first;
+	u64		hist_time_last;
+};
+
+/* per thread run time data for timehist */
+struct thread_runtime {
+	u64 last_time;      /* time of previous sched out or first seen */
+	u64 ready_to_run;   /* time of wakeup */
+
+	u64 dt_run;         /* run time of the last sched in */
+	u64 dt_wait;        /* time between sched out and wakeup */
+	u64 dt_delay;       /* time between wakeup and sched in */
+
+	u64 total_run_time;
+	u64 total_wait_time;
+	u64 total_delay_time;
+	struct stats run_stats;
 };
 
 static u64 get_nsecs(void)
@@ -1875,6 +1905,496 @@ static int perf_sched__replay(struct perf_sched *sched)
 	return 0;
 }
 
+/*
+ * timehist: one line per context switch with the wait time, scheduling
+ * delay and run time of the task switched out.
+ */
+static struct thread_runtime *thread__get_runtime(struct thread *thread)
+{
+	struct thread_runtime *r = thread__priv(thread);
+
+	if (r == NULL) {
+		r = zalloc(sizeof(*r));
+		if (r == NULL)
+			return NULL;
+
+		init_stats(&r->run_stats);
+		thread__set_priv(thread, r);
+	}
+
+	return r;
+}
+
+static struct thread *timehist__idle_thread(struct perf_sched *sched, int cpu)
+{
+	struct thread *idle;
+
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return NULL;
+
+	idle = sched->idle_threads[cpu];
+	if (idle == NULL) {
+		idle = thread__new(0, 0);
+		if (idle == NULL)
+			return NULL;
+
+		if (thread__set_comm(idle, "<idle>", 0) ||
+		    thread__get_runtime(idle) == NULL) {
+			thread__put(idle);
+			return NULL;
+		}
+		sched->idle_threads[cpu] = idle;
+	}
+
+	return idle;
+}
+
+static void timehist__free_idle_threads(struct perf_sched *sched)
+{
+	int i;
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		struct thread *idle = sched->idle_threads[i];
+
+		if (idle == NULL)
+			continue;
+
+		zfree(&idle->priv);
+		thread__zput(sched->idle_threads[i]);
+	}
+}
+
+static bool timehist__skip_thread(struct thread *thread)
+{
+	if (symbol_conf.pid_list &&
+	    !intlist__has(symbol_conf.pid_list, thread->pid_))
+		return true;
+
+	if (symbol_conf.tid_list &&
+	    !intlist__has(symbol_conf.tid_list, thread->tid))
+		return true;
+
+	return false;
+}
+
+static bool timehist__skip_sample(struct perf_sched *sched,
+				  struct perf_sample *sample,
+				  struct thread *thread)
+{
+	if (sched->cpu_list && !test_bit(sample->cpu, sched->cpu_bitmap))
+		return true;
+
+	/* the idle task is only filtered by cpu */
+	if (thread->tid == 0)
+		return false;
+
+	return timehist__skip_thread(thread);
+}
+
+static void timestamp__print(u64 timestamp)
+{
+	unsigned long secs, usecs;
+	unsigned long long nsecs;
+
+	nsecs = timestamp;
+	secs = nsecs / NSEC_PER_SEC;
+	nsecs -= secs * NSEC_PER_SEC;
+	usecs = nsecs / NSEC_PER_USEC;
+
+	printf("%15lu.%06lu ", secs, usecs);
+}
+
+static void timehist__print_header(struct perf_sched *sched)
+{
+	printf("%15s %6s  %-25s  %9s  %9s  %9s",
+	       "time", "cpu", "task name[tid/pid]", "wait time", "sch delay",
+	       "run time");
+	if (sched->show_callchain)
+		printf("  %s", "sleep callchain");
+	printf("\n");
+
+	printf("%15s %6s  %-25s  %9s  %9s  %9s\n",
+	       "", "", "", "(msec)", "(msec)", "(msec)");
+
+	printf("%.15s %.6s  %.25s  %.9s  %.9s  %.9s\n",
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line,
+	       graph_dotted_line, graph_dotted_line, graph_dotted_line);
+}
+
+static const char *timehist__comm(struct thread *thread, char *buf, size_t len)
+{
+	if (thread->tid == 0)
+		return thread__comm_str(thread);
+
+	if (thread->pid_ == thread->tid || thread->pid_ == -1)
+		scnprintf(buf, len, "%s[%d]", thread__comm_str(thread),
+			  thread->tid);
+	else
+		scnprintf(buf, len, "%s[%d/%d]", thread__comm_str(thread),
+			  thread->tid, thread->pid_);
+	return buf;
+}
+
+/* the scheduler itself is in every sleeping callchain, leave it out */
+static bool is_sched_func(const char *name)
+{
+	const char * const sched_funcs[] = {
+		"schedule",
+		"__schedule",
+		"preempt_schedule",
+		"preempt_schedule_common",
+		"preempt_schedule_irq",
+		"schedule_preempt_disabled",
+		NULL
+	};
+	int i;
+
+	for (i = 0; sched_funcs[i]; i++) {
+		if (!strcmp(name, sched_funcs[i]))
+			return true;
+	}
+	return false;
+}
+
+static void timehist__print_callchain(struct perf_sched *sched,
+				      struct perf_evsel *evsel,
+				      struct perf_sample *sample,
+				      struct thread *thread)
+{
+	struct callchain_cursor *cursor = &callchain_cursor;
+	struct callchain_cursor_node *node;
+	bool first = true;
+
+	if (thread__resolve_callchain(thread, cursor, evsel, sample,
+				      NULL, NULL, sched->max_stack) != 0) {
+		if (verbose)
+			pr_err("Failed to resolve callchain. Skipping\n");
+		return;
+	}
+
+	callchain_cursor_commit(cursor);
+
+	while ((node = callchain_cursor_current(cursor)) != NULL) {
+		callchain_cursor_advance(cursor);
+
+		if (node->sym == NULL) {
+			if (!first)
+				continue;
+		} else if (is_sched_func(node->sym->name)) {
+			continue;
+		}
+
+		if (node->sym)
+			printf("%s%s", first ? "  " : " <- ", node->sym->name);
+		else
+			printf("  %#" PRIx64, node->ip);
+		first = false;
+	}
+}
+
+static void timehist__print_sample(struct perf_sched *sched,
+				   struct perf_evsel *evsel,
+				   struct perf_sample *sample,
+				   struct thread *thread)
+{
+	struct thread_runtime *tr = thread__priv(thread);
+	char comm[64];
+
+	timestamp__print(sample->time);
+	printf("[%04d]  %-25s  %9.3f  %9.3f  %9.3f",
+	       sample->cpu, timehist__comm(thread, comm, sizeof(comm)),
+	       (double)tr->dt_wait / NSEC_PER_MSEC,
+	       (double)tr->dt_delay / NSEC_PER_MSEC,
+	       (double)tr->dt_run / NSEC_PER_MSEC);
+
+	if (sched->show_callchain && thread->tid != 0)
+		timehist__print_callchain(sched, evsel, sample, thread);
+
+	printf("\n");
+}
+
+/*
+ * Explanation of the times, with t being the time of this switch out and
+ * tprev the previous switch on this cpu, which is when the task got it:
+ *
+ *   last_time      ready_to_run    tprev                t
+ *   |--- wait ------|--- delay ----|------ run --------|
+ *   sched out       wakeup         sched in            sched out
+ *
+ * A task that was preempted goes straight back on the run queue, so it
+ * has no wakeup and no wait time: all of its time off cpu is delay.
+ */
+static void timehist__update_runtime_stats(struct thread_runtime *r,
+					   u64 t, u64 tprev)
+{
+	r->dt_run = 0;
+	r->dt_wait = 0;
+	r->dt_delay = 0;
+
+	if (tprev) {
+		r->dt_run = t - tprev;
+
+		if (r->ready_to_run) {
+			if (r->ready_to_run > tprev)
+				pr_debug("time travel: wakeup time for task > previous sched_switch event\n");
+			else
+				r->dt_delay = tprev - r->ready_to_run;
+
+			if (r->last_time && r->last_time <= r->ready_to_run)
+				r->dt_wait = r->ready_to_run - r->last_time;
+		} else if (r->last_time && r->last_time <= tprev) {
+			r->dt_delay = tprev - r->last_time;
+		}
+	}
+
+	update_stats(&r->run_stats, r->dt_run);
+	r->total_run_time += r->dt_run;
+	r->total_wait_time += r->dt_wait;
+	r->total_delay_time += r->dt_delay;
+}
+
+static struct thread *timehist__get_thread(struct perf_sched *sched,
+					   struct machine *machine,
+					   int cpu, u32 pid)
+{
+	struct thread *thread;
+
+	if (pid == 0)
+		return thread__get(timehist__idle_thread(sched, cpu));
+
+	thread = machine__findnew_thread(machine, -1, pid);
+	if (thread && thread__get_runtime(thread) == NULL) {
+		thread__put(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+static int timehist_sched_wakeup_event(struct perf_sched *sched,
+				       struct perf_evsel *evsel,
+				       struct perf_sample *sample,
+				       struct machine *machine)
+{
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct thread_runtime *tr;
+	struct thread *thread;
+	char comm[64];
+
+	thread = timehist__get_thread(sched, machine, sample->cpu, pid);
+	if (thread == NULL)
+		return -1;
+
+	/* a second wakeup of a task on the run queue does not move it */
+	tr = thread__priv(thread);
+	if (tr->ready_to_run == 0)
+		tr->ready_to_run = sample->time;
+
+	if (sched->show_wakeups && !sched->summary_only &&
+	    !timehist__skip_sample(sched, sample, thread)) {
+		timestamp__print(sample->time);
+		printf("[%04d]  %-25s  %9s  %9s  %9s  awakened: %s\n",
+		       sample->cpu, "", "", "", "",
+		       timehist__comm(thread, comm, sizeof(comm)));
+	}
+
+	thread__put(thread);
+	return 0;
+}
+
+static int timehist_sched_switch_event(struct perf_sched *sched,
+				       struct perf_evsel *evsel,
+				       struct perf_sample *sample,
+				       struct machine *machine)
+{
+	const u32 prev_pid = perf_evsel__intval(evsel, sample, "prev_pid");
+	const u64 prev_state = perf_evsel__intval(evsel, sample, "prev_state");
+	int cpu = sample->cpu;
+	struct thread_runtime *tr;
+	struct thread *thread;
+	u64 tprev;
+
+	if (cpu < 0 || cpu >= MAX_CPUS) {
+		pr_debug("Out-of-bound cpu %d in sched_switch event\n", cpu);
+		return -1;
+	}
+
+	thread = timehist__get_thread(sched, machine, cpu, prev_pid);
+	if (thread == NULL)
+		return -1;
+
+	if (sched->hist_time_first == 0)
+		sched->hist_time_first = sample->time;
+	sched->hist_time_last = sample->time;
+
+	tr = thread__priv(thread);
+	tprev = sched->cpu_last_switched[cpu];
+
+	timehist__update_runtime_stats(tr, sample->time, tprev);
+
+	/* the first switch on a cpu has no start of the run to report */
+	if (tprev && !sched->summary_only &&
+	    !timehist__skip_sample(sched, sample, thread))
+		timehist__print_sample(sched, evsel, sample, thread);
+
+	/*
+	 * A task switched out while runnable was preempted and is waiting
+	 * for the cpu from now on, otherwise it waits for a wakeup.
+	 */
+	tr->last_time = sample->time;
+	tr->ready_to_run = prev_state == 0 && prev_pid ? sample->time : 0;
+
+	sched->cpu_last_switched[cpu] = sample->time;
+
+	thread__put(thread);
+	return 0;
+}
+
+static void timehist__print_thread_summary(struct thread *thread)
+{
+	struct thread_runtime *r = thread__priv(thread);
+	double mean, stddev;
+	char comm[64];
+
+	if (r == NULL || r->run_stats.n == 0 || timehist__skip_thread(thread))
+		return;
+
+	mean = avg_stats(&r->run_stats);
+	stddev = rel_stddev_stats(stddev_stats(&r->run_stats), mean);
+
+	printf("%25s  %8" PRIu64 "  %10.3f  %10.3f  %10.3f  %10.3f  %10.3f  %6.2f\n",
+	       timehist__comm(thread, comm, sizeof(comm)),
+	       (u64)r->run_stats.n,
+	       (double)r->total_run_time / NSEC_PER_MSEC,
+	       (double)r->total_wait_time / NSEC_PER_MSEC,
+	       (double)r->total_delay_time / NSEC_PER_MSEC,
+	       (double)r->run_stats.max / NSEC_PER_MSEC,
+	       mean / NSEC_PER_MSEC, stddev);
+}
+
+static void timehist__print_summary(struct perf_sched *sched,
+				    struct machine *machine)
+{
+	u64 span = sched->hist_time_last - sched->hist_time_first;
+	struct rb_node *nd;
+	int i;
+
+	printf("\nRuntime summary\n");
+	printf("%25s  %8s  %10s  %10s  %10s  %10s  %10s  %6s\n",
+	       "comm[tid/pid]", "switches", "run (ms)", "wait (ms)",
+	       "delay (ms)", "max run", "avg run", "stddev");
+	printf("%.102s\n", graph_dotted_line);
+
+	for (nd = rb_first(&machine->threads); nd; nd = rb_next(nd))
+		timehist__print_thread_summary(rb_entry(nd, struct thread, rb_node));
+
+	printf("\nIdle stats:\n");
+	for (i = 0; i < MAX_CPUS; i++) {
+		struct thread *idle = sched->idle_threads[i];
+		struct thread_runtime *r;
+
+		if (idle == NULL)
+			continue;
+		if (sched->cpu_list && !test_bit(i, sched->cpu_bitmap))
+			continue;
+
+		r = thread__priv(idle);
+		printf("    CPU %3d idle for %10.3f msec", i,
+		       (double)r->total_run_time / NSEC_PER_MSEC);
+		if (span)
+			printf("  (%6.2f%%)", 100.0 * r->total_run_time / span);
+		printf("\n");
+	}
+
+	printf("\n    Total trace time %.3f msec\n", (double)span / NSEC_PER_MSEC);
+}
+
+static int timehist__check_attr(struct perf_sched *sched,
+				struct perf_evlist *evlist)
+{
+	struct perf_evsel *evsel;
+
+	evlist__for_each(evlist, evsel) {
+		if (sched->show_callchain &&
+		    !(evsel->attr.sample_type & PERF_SAMPLE_CALLCHAIN)) {
+			pr_info("Samples do not have callchains.\n");
+			sched->show_callchain = false;
+			symbol_conf.use_callchain = false;
+		}
+	}
+
+	return 0;
+}
+
+static int perf_sched__timehist(struct perf_sched *sched)
+{
+	const struct perf_evsel_str_handler handlers[] = {
+		{ "sched:sched_switch",	      process_sched_switch_event, },
+		{ "sched:sched_wakeup",	      process_sched_wakeup_event, },
+		{ "sched:sched_wakeup_new",   process_sched_wakeup_event, },
+	};
+	struct perf_data_file file = {
+		.path = input_name,
+		.mode = PERF_DATA_MODE_READ,
+		.force = sched->force,
+	};
+	struct perf_session *session;
+	int err = -1;
+
+	/* the callchains need the maps to be resolved */
+	sched->tool.mmap	 = perf_event__process_mmap;
+	sched->tool.mmap2	 = perf_event__process_mmap2;
+	sched->tool.exit	 = perf_event__process_exit;
+	sched->tool.ordering_requires_timestamps = true;
+
+	symbol_conf.use_callchain = sched->show_callchain;
+
+	session = perf_session__new(&file, false, &sched->tool);
+	if (session == NULL) {
+		pr_debug("No Memory for session\n");
+		return -ENOMEM;
+	}
+
+	if (symbol__init(&session->header.env) < 0)
+		goto out;
+
+	if (timehist__check_attr(sched, session->evlist))
+		goto out;
+
+	if (sched->cpu_list &&
+	    perf_session__cpu_bitmap(session, sched->cpu_list, sched->cpu_bitmap))
+		goto out;
+
+	if (perf_session__set_tracepoints_handlers(session, handlers))
+		goto out;
+
+	if (!perf_session__has_traces(session, "record -R"))
+		goto out;
+
+	setup_pager();
+
+	if (!sched->summary_only)
+		timehist__print_header(sched);
+
+	err = perf_session__process_events(session);
+	if (err) {
+		pr_err("Failed to process events, error %d", err);
+		goto out;
+	}
+
+	sched->nr_events      = session->evlist->stats.nr_events[0];
+	sched->nr_lost_events = session->evlist->stats.total_lost;
+	sched->nr_lost_chunks = session->evlist->stats.nr_events[PERF_RECORD_LOST];
+
+	if (sched->summary)
+		timehist__print_summary(sched, &session->machines.host);
+
+	print_bad_events(sched);
+out:
+	timehist__free_idle_threads(sched);
+	perf_session__delete(session);
+	return err;
+}
+
 static void setup_sorting(struct perf_sched *sched, const struct option *options,
 			  const char * const usage_msg[])
 {
@@ -1952,6 +2472,8 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.next_shortname1      = 'A',
 		.next_shortname2      = '0',
 		.skip_merge           = 0,
+		.show_callchain	      = 1,
+		.max_stack	      = 5,
 	};
 	const struct option latency_options[] = {
 	OPT_STRING('s', "sort", &sched.sort_order, "key[,key2...]",
@@ -1996,6 +2518,29 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
                     "display given CPUs in map"),
 	OPT_END()
 	};
+	const struct option timehist_options[] = {
+	OPT_STRING('k', "vmlinux", &symbol_conf.vmlinux_name,
+		   "file", "vmlinux pathname"),
+	OPT_STRING(0, "kallsyms", &symbol_conf.kallsyms_name,
+		   "file", "kallsyms pathname"),
+	OPT_BOOLEAN('g', "call-graph", &sched.show_callchain,
+		    "Display call chains if present (default on)"),
+	OPT_UINTEGER(0, "max-stack", &sched.max_stack,
+		   "Maximum number of functions to display backtrace."),
+	OPT_BOOLEAN('s', "summary", &sched.summary_only,
+		    "Show only the per task summary with statistics"),
+	OPT_BOOLEAN('S', "with-summary", &sched.summary,
+		    "Show all events and the summary with statistics"),
+	OPT_BOOLEAN('w', "wakeups", &sched.show_wakeups, "Show wakeup events"),
+	OPT_STRING('C', "cpu", &sched.cpu_list, "cpu",
+		   "list of cpus to show"),
+	OPT_STRING('p', "pid", &symbol_conf.pid_list_str, "pid[,pid...]",
+		   "only show events for given process ids"),
+	OPT_STRING('t', "tid", &symbol_conf.tid_list_str, "tid[,tid...]",
+		   "only show events for given thread ids"),
+	OPT_BOOLEAN('f', "force", &sched.force, "don't complain, do it"),
+	OPT_END()
+	};
 	const char * const latency_usage[] = {
 		"perf sched latency [<options>]",
 		NULL
@@ -2008,8 +2553,13 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		"perf sched map [<options>]",
 		NULL
 	};
+	const char * const timehist_usage[] = {
+		"perf sched timehist [<options>]",
+		NULL
+	};
 	const char *const sched_subcommands[] = { "record", "latency", "map",
-						  "replay", "script", NULL };
+						  "replay", "script",
+						  "timehist", NULL };
 	const char *sched_usage[] = {
 		NULL,
 		NULL
@@ -2028,6 +2578,10 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.switch_event	    = replay_switch_event,
 		.fork_event	    = replay_fork_event,
 	};
+	struct trace_sched_handler timehist_ops  = {
+		.wakeup_event	    = timehist_sched_wakeup_event,
+		.switch_event	    = timehist_sched_switch_event,
+	};
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(sched.curr_pid); i++)
@@ -2072,6 +2626,18 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 				usage_with_options(replay_usage, replay_options);
 		}
 		return perf_sched__replay(&sched);
+	} else if (!strcmp(argv[0], "timehist")) {
+		if (argc) {
+			argc = parse_options(argc, argv, timehist_options,
+					     timehist_usage, 0);
+			if (argc)
+				usage_with_options(timehist_usage, timehist_options);
+		}
+		if (sched.summary_only)
+			sched.summary = sched.summary_only;
+
+		sched.tp_handler = &timehist_ops;
+		return perf_sched__timehist(&sched);
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
@@ -2055,6 +2055,8 @@ int cmd_script(int argc, const char **argv, const char *prefix __maybe_unused)
 			"Enable symbol demangling"),
 	OPT_BOOLEAN(0, "demangle-kernel", &symbol_conf.demangle_kernel,
 			"Enable kernel symbol demangling"),
+	OPT_INTEGER(0, "symbol-threads", &symbol_conf.nr_load_threads,
+		    "number of threads loading symbols while processing events"),
 
 	OPT_END()
 	};
@@ -34,6 +34,7 @@
 #include "trace-event.h"
 #include "util/parse-events.h"
 #include "util/bpf-loader.h"
+#include "util/bpf-syscall-summary.h"
 #include "callchain.h"
 #include "syscalltbl.h"
 #include "rb_resort.h"
@@ -86,6 +87,7 @@ struct trace {
 		u64		vfs_getname,
 				proc_getname;
 	} stats;
+	struct syscall_summary	syscall_summary;
 	unsigned int		max_stack;
 	unsigned int		min_stack;
 	bool			not_ev_qualifier;
@@ -95,6 +97,7 @@ struct trace {
 	bool			multiple_threads;
 	bool			summary;
 	bool			summary_only;
+	bool			bpf_summary;
 	bool			show_comm;
 	bool			show_tool_stats;
 	bool			trace_syscalls;
@@ -856,6 +859,7 @@ struct thread_trace {
 	} paths;
 
 	struct intlist *syscall_stats;
+	struct intlist *syscall_hists;	/* only with --bpf-summary */
 };
 
 static struct thread_trace *thread_trace__new(void)
@@ -2155,6 +2159,140 @@ out_enomem:
 	goto out;
 }
 
+static int trace__setup_bpf_summary(struct trace *trace)
+{
+	struct perf_evlist *evlist = trace->evlist;
+	struct perf_evsel *sys_enter = trace->syscalls.events.sys_enter,
+			  *sys_exit = trace->syscalls.events.sys_exit;
+	struct format_field *field = perf_evsel__field(sys_exit, "id");
+	struct syscall_summary_filter filter = {
+		.ids	 = trace->ev_qualifier_ids.entries,
+		.nr_ids	 = trace->ev_qualifier_ids.nr,
+		.not_ids = trace->not_ev_qualifier,
+	};
+	pid_t self = getpid(), *pids = NULL;
+	int i, err;
+
+	if (field == NULL) {
+		pr_err("Can't find the 'id' field of raw_syscalls:sys_exit\n");
+		return -EINVAL;
+	}
+
+	filter.id_offset = field->offset;
+	filter.id_size	 = field->size;
+
+	/*
+	 * The BPF program runs for every task hitting the tracepoint, the
+	 * per task perf events don't limit it, so filter in the program.
+	 */
+	if (trace->filter_pids.nr > 0) {
+		filter.exclude	  = trace->filter_pids.entries;
+		filter.nr_exclude = trace->filter_pids.nr;
+	} else if (thread_map__pid(evlist->threads, 0) == -1) {
+		filter.exclude	  = &self;
+		filter.nr_exclude = 1;
+	}
+
+	if (thread_map__pid(evlist->threads, 0) != -1) {
+		filter.nr_pids = thread_map__nr(evlist->threads);
+		pids = calloc(filter.nr_pids, sizeof(pid_t));
+		if (pids == NULL)
+			return -ENOMEM;
+
+		for (i = 0; i < filter.nr_pids; i++)
+			pids[i] = thread_map__pid(evlist->threads, i);
+		filter.pids = pids;
+	}
+
+	err = syscall_summary__load(&trace->syscall_summary, &filter);
+	free(pids);
+	if (err)
+		return err;
+
+	sys_enter->bpf_fd = trace->syscall_summary.enter_fd;
+	sys_exit->bpf_fd  = trace->syscall_summary.exit_fd;
+	return 0;
+}
+
+static int trace__import_syscall_summary(struct syscall_summary_key *key,
+					 struct syscall_summary_stats *bstats,
+					 const char *comm, void *arg)
+{
+	struct trace *trace = arg;
+	struct thread_trace *ttrace;
+	struct thread *thread;
+	struct int_node *inode;
+	struct stats *stats;
+	double mean, m2;
+	u64 *hist;
+
+	if (trace__syscall_info(trace, trace->syscalls.events.sys_exit, key->id) == NULL)
+		return 0;
+
+	thread = machine__findnew_thread(trace->host, -1, key->tid);
+	if (thread == NULL)
+		return -ENOMEM;
+
+	if (comm[0])
+		thread__set_comm(thread, comm, 0);
+
+	if (thread__priv(thread) == NULL)
+		thread__set_priv(thread, thread_trace__new());
+
+	ttrace = thread__priv(thread);
+	thread__put(thread);
+	if (ttrace == NULL)
+		return -ENOMEM;
+
+	if (ttrace->syscall_hists == NULL)
+		ttrace->syscall_hists = intlist__new(NULL);
+
+	inode = intlist__findnew(ttrace->syscall_stats, key->id);
+	stats = zalloc(sizeof(*stats));
+	hist = memdup(bstats->hist, sizeof(bstats->hist));
+	if (inode == NULL || stats == NULL || hist == NULL ||
+	    ttrace->syscall_hists == NULL) {
+		free(stats);
+		free(hist);
+		return -ENOMEM;
+	}
+
+	/* The BPF side keeps sums, rebuild what update_stats() would have */
+	mean = (double)bstats->total / bstats->count;
+	m2 = (double)bstats->sumsq_us * NSEC_PER_USEC * NSEC_PER_USEC -
+	     bstats->count * mean * mean;
+
+	stats->n    = bstats->count;
+	stats->mean = mean;
+	stats->M2   = m2 > 0 ? m2 : 0;
+	stats->min  = bstats->min;
+	stats->max  = bstats->max;
+	inode->priv = stats;
+
+	inode = intlist__findnew(ttrace->syscall_hists, key->id);
+	if (inode == NULL) {
+		free(hist);
+		return -ENOMEM;
+	}
+	inode->priv = hist;
+
+	ttrace->nr_events += bstats->count;
+	trace->nr_events  += bstats->count;
+	return 0;
+}
+
+static int trace__import_bpf_summary(struct trace *trace)
+{
+	int err = syscall_summary__for_each(&trace->syscall_summary,
+					    trace__import_syscall_summary,
+					    trace);
+
+	if (err)
+		pr_err("Failed to read the BPF syscall summary: %s\n",
+		       strerror(-err));
+	return err;
+}
+
 static int trace__run(struct trace *trace, int argc, const char **argv)
 {
 	struct perf_evlist *evlist = trace->evlist;
@@ -2255,6 +2393,12 @@ static int trace__run(struct trace *trace, int argc, const char **argv)
 		}
 	}
 
+	if (trace->bpf_summary) {
+		err = trace__setup_bpf_summary(trace);
+		if (err < 0)
+			goto out_delete_evlist;
+	}
+
 	err = perf_evlist__open(evlist);
 	if (err < 0)
 		goto out_error_open;
@@ -2359,6 +2503,9 @@ out_disable:
 	perf_evlist__disable(evlist);
 
 	if (!err) {
+		if (trace->bpf_summary)
+			trace__import_bpf_summary(trace);
+
 		if (trace->summary)
 			trace__fprintf_thread_summary(trace, trace->output);
 
@@ -2372,6 +2519,7 @@ out_disable:
 	}
 
 out_delete_evlist:
+	syscall_summary__close(&trace->syscall_summary);
 	perf_evlist__delete(evlist);
 	trace->evlist = NULL;
 	trace->live = false;
@@ -2533,6 +2681,39 @@ DEFINE_RESORT_RB(syscall_stats, a->msecs > b->msecs,
 	entry->msecs   = stats ? (u64)stats->n * (avg_stats(stats) / NSEC_PER_MSEC) : 0;
 }
 
+static size_t syscall_hist__fprintf(struct thread_trace *ttrace, int id, FILE *fp)
+{
+	struct int_node *inode = intlist__find(ttrace->syscall_hists, id);
+	int i, first = -1, last = -1;
+	size_t printed = 0;
+	u64 *hist;
+
+	if (inode == NULL || inode->priv == NULL)
+		return 0;
+
+	hist = inode->priv;
+	for (i = 0; i < SYSCALL_SUMMARY_HIST; i++) {
+		if (hist[i]) {
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+
+	for (i = first; first >= 0 && i <= last; i++) {
+		u64 lo = i ? 1ULL << (i - 1) : 0;
+
+		printed += fprintf(fp, "     %10" PRIu64 " -> ", lo);
+		if (i == SYSCALL_SUMMARY_HIST - 1)
+			printed += fprintf(fp, "%-10s", "...");
+		else
+			printed += fprintf(fp, "%-10" PRIu64, 1ULL << i);
+		printed += fprintf(fp, " usecs: %8" PRIu64 "\n", hist[i]);
+	}
+
+	return printed;
+}
+
 static size_t thread__dump_stats(struct thread_trace *ttrace,
 				 struct trace *trace, FILE *fp)
 {
@@ -2567,6 +2748,9 @@ static size_t thread__dump_stats(struct thread_trace *ttrace,
 			printed += fprintf(fp, " %8" PRIu64 " %9.3f %9.3f %9.3f",
 					   n, syscall_stats_entry->msecs, min, avg);
 			printed += fprintf(fp, " %9.3f %9.2f%%\n", max, pct);
+
+			if (ttrace->syscall_hists)
+				printed += syscall_hist__fprintf(ttrace, syscall_stats_entry->syscall, fp);
 		}
 	}
 
@@ -2743,6 +2927,13 @@ int cmd_trace(int argc, const char **argv, const char *prefix __maybe_unused)
 			.proc_map_timeout  = 500,
 		},
 		.output = stderr,
+		.syscall_summary = {
+			.start_fd = -1,
+			.stats_fd = -1,
+			.comm_fd  = -1,
+			.enter_fd = -1,
+			.exit_fd  = -1,
+		},
 		.show_comm = true,
 		.trace_syscalls = true,
 		.kernel_syscallchains = false,
@@ -2788,6 +2979,8 @@ int cmd_trace(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "Show only syscall summary with statistics"),
 	OPT_BOOLEAN('S', "with-summary", &trace.summary,
 		    "Show all syscalls and summary with statistics"),
+	OPT_BOOLEAN(0, "bpf-summary", &trace.bpf_summary,
+		    "Like --summary, but aggregate in kernel BPF maps"),
 	OPT_CALLBACK_DEFAULT('F', "pf", &trace.trace_pgfaults, "all|maj|min",
 		     "Trace pagefaults", parse_pagefaults, "maj"),
 	OPT_BOOLEAN(0, "syscalls", &trace.trace_syscalls, "Trace syscalls"),
@@ -2869,6 +3062,14 @@ int cmd_trace(int argc, const char **argv, const char *prefix __maybe_unused)
 	if ((argc >= 1) && (strcmp(argv[0], "record") == 0))
 		return trace__record(&trace, argc-1, &argv[1]);
 
+	if (trace.bpf_summary) {
+		if (input_name || !trace.trace_syscalls) {
+			pr_err("--bpf-summary needs live syscall tracing\n");
+			goto out;
+		}
+		trace.summary_only = true;
+	}
+
 	/* summary_only implies summary option, but don't overwrite summary if set */
 	if (trace.summary_only)
 		trace.summary = trace.summary_only;
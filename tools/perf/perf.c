@@ -69,6 +69,7 @@ static struct cmd_struct commands[] = {
 #endif
 	{ "inject",	cmd_inject,	0 },
 	{ "mem",	cmd_mem,	0 },
+	{ "c2c",	cmd_c2c,	0 },
 	{ "data",	cmd_data,	0 },
 };
 
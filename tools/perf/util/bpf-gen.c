@@ -0,0 +1,126 @@
+/*
+ * bpf-gen.c
+ *
+ * Runtime generation of small BPF programs, for the tools that need an
+ * in-kernel aggregation but shouldn't depend on a compiler to build it.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <bpf/bpf.h>
+#include <linux/filter.h>
+#include "debug.h"
+#include "bpf-gen.h"
+
+int bpf_gen__emit(struct bpf_gen *g, struct bpf_insn insn)
+{
+	if (g->cnt >= BPF_GEN_MAX_INSNS)
+		return -1;
+
+	g->insns[g->cnt] = insn;
+	return g->cnt++;
+}
+
+void bpf_gen__jump(struct bpf_gen *g, struct bpf_gen_jumps *jumps,
+		   struct bpf_insn insn)
+{
+	int pos = bpf_gen__emit(g, insn);
+
+	if (pos >= 0 && jumps->nr < BPF_GEN_MAX_JUMPS)
+		jumps->pos[jumps->nr++] = pos;
+}
+
+/* Point the jump emitted at @from to the next instruction */
+void bpf_gen__set_target(struct bpf_gen *g, int from)
+{
+	if (from >= 0)
+		g->insns[from].off = g->cnt - from - 1;
+}
+
+void bpf_gen__resolve(struct bpf_gen *g, struct bpf_gen_jumps *jumps)
+{
+	int i;
+
+	for (i = 0; i < jumps->nr; i++)
+		bpf_gen__set_target(g, jumps->pos[i]);
+	jumps->nr = 0;
+}
+
+void bpf_gen__ld_map_fd(struct bpf_gen *g, int reg, int fd)
+{
+	struct bpf_insn ld[] = { BPF_LD_MAP_FD(reg, fd) };
+
+	bpf_gen__emit(g, ld[0]);
+	bpf_gen__emit(g, ld[1]);
+}
+
+void bpf_gen__stack_ptr(struct bpf_gen *g, int reg, int off)
+{
+	bpf_gen__emit(g, BPF_MOV64_REG(reg, BPF_REG_10));
+	bpf_gen__emit(g, BPF_ALU64_IMM(BPF_ADD, reg, off));
+}
+
+/*
+ * @reg holds a pid_tgid, jump to @fail if the tgid is in @exclude or
+ * if @pids is set and neither the tgid nor the tid is in it. Clobbers
+ * r2 and r3.
+ */
+void bpf_gen__pid_filter(struct bpf_gen *g, struct bpf_gen_jumps *fail,
+			 int reg, pid_t *pids, int nr_pids,
+			 pid_t *exclude, int nr_exclude)
+{
+	struct bpf_gen_jumps ok = { .nr = 0, };
+	int i;
+
+	bpf_gen__emit(g, BPF_MOV64_REG(BPF_REG_2, reg));
+	bpf_gen__emit(g, BPF_ALU64_IMM(BPF_RSH, BPF_REG_2, 32));
+
+	for (i = 0; i < nr_exclude; i++)
+		bpf_gen__jump(g, fail, BPF_JMP_IMM(BPF_JEQ, BPF_REG_2,
+						   exclude[i], 0));
+
+	if (!pids)
+		return;
+
+	bpf_gen__emit(g, BPF_MOV32_REG(BPF_REG_3, reg));
+	for (i = 0; i < nr_pids; i++) {
+		bpf_gen__jump(g, &ok, BPF_JMP_IMM(BPF_JEQ, BPF_REG_2,
+						  pids[i], 0));
+		bpf_gen__jump(g, &ok, BPF_JMP_IMM(BPF_JEQ, BPF_REG_3,
+						  pids[i], 0));
+	}
+	bpf_gen__jump(g, fail, BPF_JMP_IMM(BPF_JA, 0, 0, 0));
+
+	bpf_gen__resolve(g, &ok);
+}
+
+int bpf_gen__exit(struct bpf_gen *g)
+{
+	bpf_gen__resolve(g, &g->out);
+
+	bpf_gen__emit(g, BPF_MOV64_IMM(BPF_REG_0, 0));
+	if (bpf_gen__emit(g, BPF_EXIT_INSN()) < 0) {
+		pr_err("bpf: generated program too long\n");
+		return -E2BIG;
+	}
+
+	return 0;
+}
+
+int bpf_gen__load(struct bpf_gen *g, enum bpf_prog_type type,
+		  const char *name)
+{
+	static char log_buf[BPF_LOG_BUF_SIZE];
+	int fd;
+
+	fd = bpf_load_program(type, g->insns, g->cnt, (char *)"GPL", 0,
+			      log_buf, sizeof(log_buf));
+	if (fd < 0) {
+		pr_err("bpf: failed to load the %s program: %s\n",
+		       name, strerror(errno));
+		pr_debug("%s\n", log_buf);
+		return -errno;
+	}
+
+	return fd;
+}
@@ -0,0 +1,49 @@
+#ifndef __PERF_BPF_GEN_H
+#define __PERF_BPF_GEN_H
+
+#include <linux/types.h>
+#include <linux/bpf.h>
+#include <sys/types.h>
+
+/*
+ * Helpers to generate small BPF programs at runtime, as a sequence of
+ * instructions with forward jumps that are patched once their target
+ * is known.
+ */
+
+#define BPF_GEN_MAX_INSNS	1024
+#define BPF_GEN_MAX_JUMPS	512
+#define BPF_GEN_MAX_PIDS	64
+
+struct bpf_gen_jumps {
+	int		pos[BPF_GEN_MAX_JUMPS];
+	int		nr;
+};
+
+struct bpf_gen {
+	struct bpf_insn		insns[BPF_GEN_MAX_INSNS];
+	int			cnt;
+	/* jumps to the exit code, resolved by bpf_gen__exit() */
+	struct bpf_gen_jumps	out;
+};
+
+int bpf_gen__emit(struct bpf_gen *g, struct bpf_insn insn);
+void bpf_gen__jump(struct bpf_gen *g, struct bpf_gen_jumps *jumps,
+		   struct bpf_insn insn);
+void bpf_gen__set_target(struct bpf_gen *g, int from);
+void bpf_gen__resolve(struct bpf_gen *g, struct bpf_gen_jumps *jumps);
+void bpf_gen__ld_map_fd(struct bpf_gen *g, int reg, int fd);
+void bpf_gen__stack_ptr(struct bpf_gen *g, int reg, int off);
+void bpf_gen__pid_filter(struct bpf_gen *g, struct bpf_gen_jumps *fail,
+			 int reg, pid_t *pids, int nr_pids,
+			 pid_t *exclude, int nr_exclude);
+int bpf_gen__exit(struct bpf_gen *g);
+int bpf_gen__load(struct bpf_gen *g, enum bpf_prog_type type,
+		  const char *name);
+
+static inline void bpf_gen__out(struct bpf_gen *g, struct bpf_insn insn)
+{
+	bpf_gen__jump(g, &g->out, insn);
+}
+
+#endif /* __PERF_BPF_GEN_H */
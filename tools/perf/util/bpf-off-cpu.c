@@ -0,0 +1,280 @@
+/*
+ * bpf-off-cpu.c
+ *
+ * Off-cpu profiling for 'perf record --off-cpu': a BPF program hooked on
+ * sched:sched_switch takes the kernel and user stacks of the tasks that
+ * block and, when they are switched back in, accumulates the time they
+ * were off cpu per thread and stack pair, so that only the aggregate has
+ * to be read at the end of the session.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <linux/filter.h>
+#include <linux/kernel.h>
+#include "util.h"
+#include "debug.h"
+#include "bpf-gen.h"
+#include "bpf-off-cpu.h"
+
+#define OFF_CPU_MAX_ENTRIES	16384
+#define OFF_CPU_MAX_STACKS	8192
+
+/* include/linux/sched.h */
+#define OFF_CPU_TASK_BLOCKED	(1 /* TASK_INTERRUPTIBLE */ | 2 /* TASK_UNINTERRUPTIBLE */)
+
+/* start[tid], taken when the task is switched out */
+struct off_cpu_start {
+	u64	ts;
+	u32	tgid;
+	s32	kstack;
+	s32	ustack;
+	u32	pad;
+};
+
+/* stack layout, see gen_prog() */
+#define STACK_TID		-8
+#define STACK_START		(STACK_TID - (int)sizeof(struct off_cpu_start))
+#define STACK_KEY		(STACK_START - (int)sizeof(struct off_cpu_key))
+#define STACK_VAL		(STACK_KEY - (int)sizeof(struct off_cpu_val))
+
+/* Give it a shorter name */
+#define emit(g, insn)		bpf_gen__emit((g), (insn))
+
+#define START_OFF(field)	((int)offsetof(struct off_cpu_start, field))
+#define KEY_OFF(field)		((int)offsetof(struct off_cpu_key, field))
+#define VAL_OFF(field)		((int)offsetof(struct off_cpu_val, field))
+
+/*
+ * next task: delta = now - start[next_pid].ts, accounted in offcpu[tgid,
+ * tid, stacks] with the stacks from start[next_pid].
+ */
+static void gen_switch_in(struct bpf_gen *p, struct off_cpu *oc,
+			  struct off_cpu_filter *filter)
+{
+	struct bpf_gen_jumps done = { .nr = 0, };
+	int have, off;
+
+	/* entries are only created for the filtered tasks */
+	emit(p, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6, filter->next_pid_offset));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_TID));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_KEY + KEY_OFF(tid)));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, oc->start_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_TID);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+	bpf_gen__jump(p, &done, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
+
+	emit(p, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_0, START_OFF(tgid)));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_KEY + KEY_OFF(tgid)));
+	emit(p, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_0, START_OFF(kstack)));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_KEY + KEY_OFF(kstack)));
+	emit(p, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_0, START_OFF(ustack)));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_KEY + KEY_OFF(ustack)));
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_8, BPF_REG_0, START_OFF(ts)));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, oc->start_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_TID);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_delete_elem));
+
+	/* r7 = now, r8 = delta */
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+	emit(p, BPF_MOV64_REG(BPF_REG_7, BPF_REG_0));
+	emit(p, BPF_ALU64_REG(BPF_SUB, BPF_REG_0, BPF_REG_8));
+	emit(p, BPF_MOV64_REG(BPF_REG_8, BPF_REG_0));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, oc->offcpu_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+	have = emit(p, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
+
+	for (off = STACK_VAL; off < STACK_KEY; off += 8)
+		emit(p, BPF_ST_MEM(BPF_DW, BPF_REG_10, off, 0));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, oc->offcpu_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	bpf_gen__stack_ptr(p, BPF_REG_3, STACK_VAL);
+	emit(p, BPF_MOV64_IMM(BPF_REG_4, BPF_NOEXIST));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_update_elem));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, oc->offcpu_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+	bpf_gen__jump(p, &done, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
+
+	bpf_gen__set_target(p, have);
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0, VAL_OFF(total)));
+	emit(p, BPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_8));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1, VAL_OFF(total)));
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0, VAL_OFF(count)));
+	emit(p, BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 1));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1, VAL_OFF(count)));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_7, VAL_OFF(last)));
+
+	bpf_gen__resolve(p, &done);
+}
+
+/*
+ * prev task, i.e. current: if it is blocking rather than being preempted,
+ * start[tid] = { now, tgid, kernel stack, user stack }
+ */
+static void gen_switch_out(struct bpf_gen *p, struct off_cpu *oc,
+			   struct off_cpu_filter *filter)
+{
+	int size = filter->prev_state_size == 8 ? BPF_DW : BPF_W;
+
+	emit(p, BPF_LDX_MEM(size, BPF_REG_1, BPF_REG_6, filter->prev_state_offset));
+	emit(p, BPF_ALU64_IMM(BPF_AND, BPF_REG_1, OFF_CPU_TASK_BLOCKED));
+	bpf_gen__out(p, BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_get_current_pid_tgid));
+	emit(p, BPF_MOV64_REG(BPF_REG_7, BPF_REG_0));
+
+	bpf_gen__pid_filter(p, &p->out, BPF_REG_7, filter->pids,
+			    filter->nr_pids, filter->exclude,
+			    filter->nr_exclude);
+
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_7, STACK_TID));
+	emit(p, BPF_MOV64_REG(BPF_REG_1, BPF_REG_7));
+	emit(p, BPF_ALU64_IMM(BPF_RSH, BPF_REG_1, 32));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_START + START_OFF(tgid)));
+	emit(p, BPF_ST_MEM(BPF_W, BPF_REG_10, STACK_START + START_OFF(pad), 0));
+
+	emit(p, BPF_MOV64_REG(BPF_REG_1, BPF_REG_6));
+	bpf_gen__ld_map_fd(p, BPF_REG_2, oc->stacks_fd);
+	emit(p, BPF_MOV64_IMM(BPF_REG_3, 0));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_get_stackid));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, STACK_START + START_OFF(kstack)));
+
+	emit(p, BPF_MOV64_REG(BPF_REG_1, BPF_REG_6));
+	bpf_gen__ld_map_fd(p, BPF_REG_2, oc->stacks_fd);
+	emit(p, BPF_MOV64_IMM(BPF_REG_3, BPF_F_USER_STACK));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_get_stackid));
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, STACK_START + START_OFF(ustack)));
+
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, STACK_START + START_OFF(ts)));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, oc->start_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_TID);
+	bpf_gen__stack_ptr(p, BPF_REG_3, STACK_START);
+	emit(p, BPF_MOV64_IMM(BPF_REG_4, BPF_ANY));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_update_elem));
+}
+
+/* A single program handles both the task going out and the one coming in */
+static int gen_prog(struct bpf_gen *p, struct off_cpu *oc,
+		    struct off_cpu_filter *filter)
+{
+	emit(p, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+
+	gen_switch_in(p, oc, filter);
+	gen_switch_out(p, oc, filter);
+
+	return bpf_gen__exit(p);
+}
+
+int off_cpu__load(struct off_cpu *oc, struct off_cpu_filter *filter)
+{
+	struct bpf_gen *p;
+	int err;
+
+	oc->start_fd = oc->stacks_fd = oc->offcpu_fd = oc->prog_fd = -1;
+
+	if (filter->nr_pids > BPF_GEN_MAX_PIDS ||
+	    filter->nr_exclude > BPF_GEN_MAX_PIDS) {
+		pr_err("bpf off-cpu: at most %d pids can be filtered\n",
+		       BPF_GEN_MAX_PIDS);
+		return -E2BIG;
+	}
+
+	p = zalloc(sizeof(*p));
+	if (p == NULL)
+		return -ENOMEM;
+
+	oc->start_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(u32),
+				      sizeof(struct off_cpu_start),
+				      OFF_CPU_MAX_ENTRIES);
+	oc->stacks_fd = bpf_create_map(BPF_MAP_TYPE_STACK_TRACE, sizeof(u32),
+				       OFF_CPU_MAX_STACK * sizeof(u64),
+				       OFF_CPU_MAX_STACKS);
+	oc->offcpu_fd = bpf_create_map(BPF_MAP_TYPE_HASH,
+				       sizeof(struct off_cpu_key),
+				       sizeof(struct off_cpu_val),
+				       OFF_CPU_MAX_ENTRIES);
+	if (oc->start_fd < 0 || oc->stacks_fd < 0 || oc->offcpu_fd < 0) {
+		err = -errno;
+		pr_err("bpf off-cpu: failed to create maps: %s\n",
+		       strerror(errno));
+		goto out_close;
+	}
+
+	err = gen_prog(p, oc, filter);
+	if (err)
+		goto out_close;
+
+	oc->prog_fd = err = bpf_gen__load(p, BPF_PROG_TYPE_TRACEPOINT, "sched_switch");
+	if (err < 0)
+		goto out_close;
+
+	free(p);
+	return 0;
+
+out_close:
+	free(p);
+	off_cpu__close(oc);
+	return err;
+}
+
+static int off_cpu__read_stack(struct off_cpu *oc, s32 id, u64 *ips)
+{
+	int nr;
+
+	if (id < 0 || bpf_map_lookup_elem(oc->stacks_fd, &id, ips))
+		return 0;
+
+	for (nr = 0; nr < OFF_CPU_MAX_STACK && ips[nr]; nr++)
+		;
+
+	return nr;
+}
+
+int off_cpu__for_each(struct off_cpu *oc, off_cpu__cb_t cb, void *arg)
+{
+	struct off_cpu_key key = { .tid = -1, .kstack = -1, .ustack = -1, }, next;
+	struct off_cpu_val val;
+	u64 kstack[OFF_CPU_MAX_STACK], ustack[OFF_CPU_MAX_STACK];
+	int nr_kstack, nr_ustack, err;
+
+	while (bpf_map_get_next_key(oc->offcpu_fd, &key, &next) == 0) {
+		key = next;
+
+		if (bpf_map_lookup_elem(oc->offcpu_fd, &key, &val))
+			continue;
+
+		nr_kstack = off_cpu__read_stack(oc, key.kstack, kstack);
+		nr_ustack = off_cpu__read_stack(oc, key.ustack, ustack);
+
+		err = cb(&key, &val, kstack, nr_kstack, ustack, nr_ustack, arg);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+void off_cpu__close(struct off_cpu *oc)
+{
+	int *fds[] = { &oc->prog_fd, &oc->start_fd, &oc->stacks_fd,
+		       &oc->offcpu_fd, };
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(fds); i++) {
+		if (*fds[i] >= 0)
+			close(*fds[i]);
+		*fds[i] = -1;
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef __PERF_BPF_OFF_CPU_H
+#define __PERF_BPF_OFF_CPU_H
+
+#include <linux/types.h>
+#include <sys/types.h>
+
+#define OFF_CPU_EVENT_NAME	"offcpu-time"
+#define OFF_CPU_MAX_STACK	127	/* PERF_MAX_STACK_DEPTH */
+
+/*
+ * Blocked time is accumulated per thread and per pair of kernel and user
+ * stacks, the stack ids index the BPF stack map and are negative when the
+ * stack couldn't be collected.
+ */
+struct off_cpu_key {
+	u32	tgid;
+	u32	tid;
+	s32	kstack;
+	s32	ustack;
+};
+
+struct off_cpu_val {
+	u64	total;		/* nsecs off cpu */
+	u64	count;
+	u64	last;		/* ktime of the last switch in */
+};
+
+struct off_cpu_filter {
+	pid_t	*pids;		/* tgids or tids to profile, NULL for all */
+	int	nr_pids;
+	pid_t	*exclude;	/* tgids not to profile, e.g. ourselves */
+	int	nr_exclude;
+	int	prev_state_offset;	/* of the sched_switch fields */
+	int	prev_state_size;
+	int	next_pid_offset;
+};
+
+struct off_cpu {
+	int	start_fd;
+	int	stacks_fd;
+	int	offcpu_fd;
+	int	prog_fd;
+};
+
+typedef int (*off_cpu__cb_t)(struct off_cpu_key *key, struct off_cpu_val *val,
+			     u64 *kstack, int nr_kstack,
+			     u64 *ustack, int nr_ustack, void *arg);
+
+#ifdef HAVE_LIBBPF_SUPPORT
+int off_cpu__load(struct off_cpu *oc, struct off_cpu_filter *filter);
+int off_cpu__for_each(struct off_cpu *oc, off_cpu__cb_t cb, void *arg);
+void off_cpu__close(struct off_cpu *oc);
+#else
+#include <errno.h>
+#include <linux/compiler.h>
+
+static inline int off_cpu__load(struct off_cpu *oc __maybe_unused,
+				struct off_cpu_filter *filter __maybe_unused)
+{
+	return -ENOTSUP;
+}
+
+static inline int off_cpu__for_each(struct off_cpu *oc __maybe_unused,
+				    off_cpu__cb_t cb __maybe_unused,
+				    void *arg __maybe_unused)
+{
+	return -ENOTSUP;
+}
+
+static inline void off_cpu__close(struct off_cpu *oc __maybe_unused)
+{
+}
+#endif
+#endif /* __PERF_BPF_OFF_CPU_H */
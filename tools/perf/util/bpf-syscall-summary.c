@@ -0,0 +1,326 @@
+/*
+ * bpf-syscall-summary.c
+ *
+ * Aggregate raw_syscalls:sys_enter/sys_exit in BPF maps so that
+ * 'perf trace --bpf-summary' only has to read the maps at the end
+ * instead of streaming every syscall through the ring buffer.
+ *
+ * The programs are generated here, like the BPF prologue, so that no
+ * compiler is needed at runtime and the filters (pids, syscall ids)
+ * end up as immediate compares in the program.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <linux/filter.h>
+#include <linux/kernel.h>
+#include "util.h"
+#include "debug.h"
+#include "bpf-gen.h"
+#include "bpf-syscall-summary.h"
+
+#define SUMMARY_MAX_PIDS	BPF_GEN_MAX_PIDS
+#define SUMMARY_MAX_IDS		256
+#define SUMMARY_MAX_ENTRIES	16384
+#define SUMMARY_COMM_LEN	16
+
+/* stack layout, see gen_exit_prog() */
+#define STACK_KEY		-8
+#define STACK_TS		-16
+#define STACK_VAL		(STACK_KEY - (int)sizeof(struct syscall_summary_stats))
+#define STACK_COMM		(STACK_VAL - SUMMARY_COMM_LEN)
+#define STACK_COMM_KEY		(STACK_COMM - 8)
+
+/* Give it a shorter name */
+#define emit(g, insn)		bpf_gen__emit((g), (insn))
+
+#define VAL_OFF(field)		((int)offsetof(struct syscall_summary_stats, field))
+
+static void emit_ld_id(struct bpf_gen *p, int reg,
+		       struct syscall_summary_filter *filter)
+{
+	int size = filter->id_size == 8 ? BPF_DW : BPF_W;
+
+	emit(p, BPF_LDX_MEM(size, reg, BPF_REG_6, filter->id_offset));
+}
+
+/* Increment the u64 at @off in the map value pointed to by r9 */
+static void emit_inc(struct bpf_gen *p, int off)
+{
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9, off));
+	emit(p, BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 1));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1, off));
+}
+
+/*
+ * r8 holds the syscall id, bail out if it is not (or, with not_ids,
+ * if it is) in the list.
+ */
+static void emit_id_filter(struct bpf_gen *p,
+			   struct syscall_summary_filter *filter)
+{
+	struct bpf_gen_jumps match = { .nr = 0, };
+	int i;
+
+	if (!filter->ids)
+		return;
+
+	for (i = 0; i < filter->nr_ids; i++)
+		bpf_gen__jump(p, filter->not_ids ? &p->out : &match,
+			      BPF_JMP_IMM(BPF_JEQ, BPF_REG_8, filter->ids[i], 0));
+
+	if (filter->not_ids)
+		return;
+
+	bpf_gen__out(p, BPF_JMP_IMM(BPF_JA, 0, 0, 0));
+	bpf_gen__resolve(p, &match);
+}
+
+/*
+ * sys_enter: start[pid_tgid] = now
+ */
+static int gen_enter_prog(struct bpf_gen *p, struct syscall_summary *ss,
+			  struct syscall_summary_filter *filter)
+{
+	emit(p, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_get_current_pid_tgid));
+	emit(p, BPF_MOV64_REG(BPF_REG_7, BPF_REG_0));
+
+	bpf_gen__pid_filter(p, &p->out, BPF_REG_7, filter->pids,
+			    filter->nr_pids, filter->exclude,
+			    filter->nr_exclude);
+
+	emit_ld_id(p, BPF_REG_8, filter);
+	emit_id_filter(p, filter);
+
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_7, STACK_KEY));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, STACK_TS));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->start_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	bpf_gen__stack_ptr(p, BPF_REG_3, STACK_TS);
+	emit(p, BPF_MOV64_IMM(BPF_REG_4, BPF_ANY));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_update_elem));
+
+	return bpf_gen__exit(p);
+}
+
+/*
+ * sys_exit: delta = now - start[pid_tgid], then account delta in
+ * stats[tid, id], creating the entry (and remembering the comm of the
+ * thread) the first time.
+ *
+ * The stats of a thread are only ever updated by that thread, so plain
+ * loads and stores are enough.
+ */
+static int gen_exit_prog(struct bpf_gen *p, struct syscall_summary *ss,
+			 struct syscall_summary_filter *filter)
+{
+	struct bpf_gen_jumps done = { .nr = 0, };
+	int have, i, off;
+
+	emit(p, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_get_current_pid_tgid));
+	emit(p, BPF_MOV64_REG(BPF_REG_7, BPF_REG_0));
+
+	/* entries are only created by sys_enter, no need to filter here */
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_7, STACK_KEY));
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->start_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+	bpf_gen__out(p, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_8, BPF_REG_0, 0));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->start_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_delete_elem));
+
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+	emit(p, BPF_ALU64_REG(BPF_SUB, BPF_REG_0, BPF_REG_8));
+	emit(p, BPF_MOV64_REG(BPF_REG_8, BPF_REG_0));
+
+	/* key = { tid, id } */
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_7, STACK_KEY));
+	emit_ld_id(p, BPF_REG_1, filter);
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, STACK_KEY + 4));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->stats_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+	have = emit(p, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
+
+	/* first call of this syscall by this thread */
+	for (off = STACK_VAL; off < STACK_KEY; off += 8)
+		emit(p, BPF_ST_MEM(BPF_DW, BPF_REG_10, off, 0));
+	emit(p, BPF_ST_MEM(BPF_DW, BPF_REG_10, STACK_VAL + VAL_OFF(min), -1));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->stats_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	bpf_gen__stack_ptr(p, BPF_REG_3, STACK_VAL);
+	emit(p, BPF_MOV64_IMM(BPF_REG_4, BPF_NOEXIST));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_update_elem));
+
+	emit(p, BPF_ST_MEM(BPF_DW, BPF_REG_10, STACK_COMM, 0));
+	emit(p, BPF_ST_MEM(BPF_DW, BPF_REG_10, STACK_COMM + 8, 0));
+	bpf_gen__stack_ptr(p, BPF_REG_1, STACK_COMM);
+	emit(p, BPF_MOV64_IMM(BPF_REG_2, SUMMARY_COMM_LEN));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_get_current_comm));
+
+	emit(p, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_7, STACK_COMM_KEY));
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->comm_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_COMM_KEY);
+	bpf_gen__stack_ptr(p, BPF_REG_3, STACK_COMM);
+	emit(p, BPF_MOV64_IMM(BPF_REG_4, BPF_ANY));
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_update_elem));
+
+	bpf_gen__ld_map_fd(p, BPF_REG_1, ss->stats_fd);
+	bpf_gen__stack_ptr(p, BPF_REG_2, STACK_KEY);
+	emit(p, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+	bpf_gen__out(p, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
+
+	bpf_gen__set_target(p, have);
+	emit(p, BPF_MOV64_REG(BPF_REG_9, BPF_REG_0));
+
+	emit_inc(p, VAL_OFF(count));
+
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9, VAL_OFF(total)));
+	emit(p, BPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_8));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1, VAL_OFF(total)));
+
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9, VAL_OFF(min)));
+	emit(p, BPF_JMP_REG(BPF_JGE, BPF_REG_8, BPF_REG_1, 1));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_8, VAL_OFF(min)));
+
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9, VAL_OFF(max)));
+	emit(p, BPF_JMP_REG(BPF_JGE, BPF_REG_1, BPF_REG_8, 1));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_8, VAL_OFF(max)));
+
+	/* r3 = usecs */
+	emit(p, BPF_MOV64_REG(BPF_REG_3, BPF_REG_8));
+	emit(p, BPF_ALU64_IMM(BPF_DIV, BPF_REG_3, 1000));
+
+	emit(p, BPF_MOV64_REG(BPF_REG_1, BPF_REG_3));
+	emit(p, BPF_ALU64_REG(BPF_MUL, BPF_REG_1, BPF_REG_3));
+	emit(p, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_9, VAL_OFF(sumsq_us)));
+	emit(p, BPF_ALU64_REG(BPF_ADD, BPF_REG_2, BPF_REG_1));
+	emit(p, BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_2, VAL_OFF(sumsq_us)));
+
+	/*
+	 * Map values can only be accessed at constant offsets, so find the
+	 * log2 slot with a ladder of compares.
+	 */
+	for (i = 0; i < SYSCALL_SUMMARY_HIST - 1; i++) {
+		emit(p, BPF_JMP_IMM(BPF_JGE, BPF_REG_3, 1 << i, 4));
+		emit_inc(p, VAL_OFF(hist[i]));
+		bpf_gen__jump(p, &done, BPF_JMP_IMM(BPF_JA, 0, 0, 0));
+	}
+	emit_inc(p, VAL_OFF(hist[SYSCALL_SUMMARY_HIST - 1]));
+
+	bpf_gen__resolve(p, &done);
+
+	return bpf_gen__exit(p);
+}
+
+int syscall_summary__load(struct syscall_summary *ss,
+			  struct syscall_summary_filter *filter)
+{
+	struct bpf_gen *p;
+	int err = -ENOMEM;
+
+	ss->start_fd = ss->stats_fd = ss->comm_fd = -1;
+	ss->enter_fd = ss->exit_fd = -1;
+
+	if (filter->nr_pids > SUMMARY_MAX_PIDS ||
+	    filter->nr_exclude > SUMMARY_MAX_PIDS ||
+	    filter->nr_ids > SUMMARY_MAX_IDS) {
+		pr_err("bpf syscall summary: at most %d pids and %d syscalls can be filtered\n",
+		       SUMMARY_MAX_PIDS, SUMMARY_MAX_IDS);
+		return -E2BIG;
+	}
+
+	p = zalloc(sizeof(*p));
+	if (p == NULL)
+		return -ENOMEM;
+
+	ss->start_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(u64),
+				      sizeof(u64), SUMMARY_MAX_ENTRIES);
+	ss->stats_fd = bpf_create_map(BPF_MAP_TYPE_HASH,
+				      sizeof(struct syscall_summary_key),
+				      sizeof(struct syscall_summary_stats),
+				      SUMMARY_MAX_ENTRIES);
+	ss->comm_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(u32),
+				     SUMMARY_COMM_LEN, SUMMARY_MAX_ENTRIES);
+	if (ss->start_fd < 0 || ss->stats_fd < 0 || ss->comm_fd < 0) {
+		err = -errno;
+		pr_err("bpf syscall summary: failed to create maps: %s\n",
+		       strerror(errno));
+		goto out_close;
+	}
+
+	err = gen_enter_prog(p, ss, filter);
+	if (err)
+		goto out_close;
+
+	ss->enter_fd = err = bpf_gen__load(p, BPF_PROG_TYPE_TRACEPOINT, "sys_enter");
+	if (err < 0)
+		goto out_close;
+
+	memset(p, 0, sizeof(*p));
+	err = gen_exit_prog(p, ss, filter);
+	if (err)
+		goto out_close;
+
+	ss->exit_fd = err = bpf_gen__load(p, BPF_PROG_TYPE_TRACEPOINT, "sys_exit");
+	if (err < 0)
+		goto out_close;
+
+	free(p);
+	return 0;
+
+out_close:
+	free(p);
+	syscall_summary__close(ss);
+	return err;
+}
+
+int syscall_summary__for_each(struct syscall_summary *ss,
+			      syscall_summary__cb_t cb, void *arg)
+{
+	struct syscall_summary_key key = { .tid = -1, .id = -1, }, next;
+	struct syscall_summary_stats stats;
+	char comm[SUMMARY_COMM_LEN + 1];
+	int err;
+
+	while (bpf_map_get_next_key(ss->stats_fd, &key, &next) == 0) {
+		key = next;
+
+		if (bpf_map_lookup_elem(ss->stats_fd, &key, &stats))
+			continue;
+
+		memset(comm, 0, sizeof(comm));
+		bpf_map_lookup_elem(ss->comm_fd, &key.tid, comm);
+
+		err = cb(&key, &stats, comm, arg);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+void syscall_summary__close(struct syscall_summary *ss)
+{
+	int *fds[] = { &ss->enter_fd, &ss->exit_fd, &ss->start_fd,
+		       &ss->stats_fd, &ss->comm_fd, };
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(fds); i++) {
+		if (*fds[i] >= 0)
+			close(*fds[i]);
+		*fds[i] = -1;
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef __PERF_BPF_SYSCALL_SUMMARY_H
+#define __PERF_BPF_SYSCALL_SUMMARY_H
+
+#include <linux/types.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define SYSCALL_SUMMARY_HIST	32
+
+struct syscall_summary_key {
+	u32	tid;
+	u32	id;
+};
+
+/*
+ * Per thread/syscall aggregation kept by the BPF program, hist[] is a
+ * log2 histogram of the latency in usecs: hist[0] counts calls that
+ * took less than 1 usec, hist[n] calls in [2^(n-1), 2^n) usecs and the
+ * last slot everything slower.
+ */
+struct syscall_summary_stats {
+	u64	count;
+	u64	total;
+	u64	min;
+	u64	max;
+	u64	sumsq_us;
+	u64	hist[SYSCALL_SUMMARY_HIST];
+};
+
+struct syscall_summary_filter {
+	pid_t	*pids;		/* tgids or tids to trace, NULL for all */
+	int	nr_pids;
+	pid_t	*exclude;	/* tgids not to trace, e.g. ourselves */
+	int	nr_exclude;
+	int	*ids;		/* syscall ids, NULL for all */
+	int	nr_ids;
+	bool	not_ids;
+	int	id_offset;	/* of the raw_syscalls 'id' field */
+	int	id_size;
+};
+
+struct syscall_summary {
+	int	start_fd;
+	int	stats_fd;
+	int	comm_fd;
+	int	enter_fd;
+	int	exit_fd;
+};
+
+typedef int (*syscall_summary__cb_t)(struct syscall_summary_key *key,
+				     struct syscall_summary_stats *stats,
+				     const char *comm, void *arg);
+
+#ifdef HAVE_LIBBPF_SUPPORT
+int syscall_summary__load(struct syscall_summary *ss,
+			  struct syscall_summary_filter *filter);
+int syscall_summary__for_each(struct syscall_summary *ss,
+			      syscall_summary__cb_t cb, void *arg);
+void syscall_summary__close(struct syscall_summary *ss);
+#else
+#include <errno.h>
+#include <linux/compiler.h>
+
+static inline int
+syscall_summary__load(struct syscall_summary *ss __maybe_unused,
+		      struct syscall_summary_filter *filter __maybe_unused)
+{
+	return -ENOTSUP;
+}
+
+static inline int
+syscall_summary__for_each(struct syscall_summary *ss __maybe_unused,
+			  syscall_summary__cb_t cb __maybe_unused,
+			  void *arg __maybe_unused)
+{
+	return -ENOTSUP;
+}
+
+static inline void
+syscall_summary__close(struct syscall_summary *ss __maybe_unused)
+{
+}
+#endif
+#endif /* __PERF_BPF_SYSCALL_SUMMARY_H */
@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include "evlist.h"
 #include "evsel.h"
@@ -17,6 +18,7 @@
 #include "asm/bug.h"
 #include "auxtrace.h"
 #include "thread-stack.h"
+#include "vdso.h"
 #include "stat.h"
 
 static int perf_session__deliver_event(struct perf_session *session,
@@ -1846,19 +1848,139 @@ out_err:
 	return err;
 }
 
+/*
+ * Symbols are loaded when the first sample hits a DSO, in the middle of
+ * processing events.  The build-id table of the header already names the
+ * user space DSOs with hits, so threads can load those while the events
+ * are being processed, map__load() then finds them loaded or waits on the
+ * dso lock for the one being loaded.
+ */
+struct symbol_loader {
+	struct dso	**dsos;
+	int		nr_dsos;
+	int		next;
+	symbol_filter_t	filter;
+	int		nr_threads;
+	pthread_t	threads[];
+};
+
+static void *symbol_loader__thread(void *arg)
+{
+	struct symbol_loader *loader = arg;
+	struct map *map;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&loader->next, 1)) < loader->nr_dsos) {
+		map = map__new2(0, loader->dsos[i], MAP__FUNCTION);
+		if (map) {
+			map__load(map, loader->filter);
+			map__put(map);
+		}
+	}
+	return NULL;
+}
+
+static int symbol_loader__add_dsos(struct symbol_loader *loader,
+				   struct machine *machine)
+{
+	struct dsos *dsos = &machine->dsos;
+	struct dso *dso, **tmp;
+	int err = 0;
+
+	pthread_rwlock_rdlock(&dsos->lock);
+	list_for_each_entry(dso, &dsos->head, node) {
+		if (dso->kernel != DSO_TYPE_USER || !dso->has_build_id ||
+		    is_vdso_map(dso->short_name) ||
+		    dso__loaded(dso, MAP__FUNCTION))
+			continue;
+
+		tmp = realloc(loader->dsos,
+			      (loader->nr_dsos + 1) * sizeof(*loader->dsos));
+		if (!tmp) {
+			err = -ENOMEM;
+			break;
+		}
+		loader->dsos = tmp;
+		loader->dsos[loader->nr_dsos++] = dso__get(dso);
+	}
+	pthread_rwlock_unlock(&dsos->lock);
+	return err;
+}
+
+static void symbol_loader__wait(struct symbol_loader *loader)
+{
+	int i;
+
+	if (!loader)
+		return;
+
+	for (i = 0; i < loader->nr_threads; i++)
+		pthread_join(loader->threads[i], NULL);
+	for (i = 0; i < loader->nr_dsos; i++)
+		dso__put(loader->dsos[i]);
+	free(loader->dsos);
+	free(loader);
+}
+
+static struct symbol_loader *perf_session__load_symbols(struct perf_session *session)
+{
+	int nr_threads = symbol_conf.nr_load_threads;
+	struct symbol_loader *loader;
+	struct rb_node *nd;
+
+	loader = zalloc(sizeof(*loader) + nr_threads * sizeof(pthread_t));
+	if (!loader)
+		return NULL;
+
+	loader->filter = session->machines.symbol_filter;
+	if (symbol_loader__add_dsos(loader, &session->machines.host))
+		goto out_wait;
+
+	for (nd = rb_first(&session->machines.guests); nd; nd = rb_next(nd)) {
+		struct machine *pos = rb_entry(nd, struct machine, rb_node);
+
+		if (symbol_loader__add_dsos(loader, pos))
+			goto out_wait;
+	}
+
+	if (nr_threads > loader->nr_dsos)
+		nr_threads = loader->nr_dsos;
+
+	for (loader->nr_threads = 0; loader->nr_threads < nr_threads;
+	     loader->nr_threads++) {
+		if (pthread_create(&loader->threads[loader->nr_threads], NULL,
+				   symbol_loader__thread, loader))
+			break;
+	}
+
+	pr_debug("loading symbols of %d DSOs with %d threads\n",
+		 loader->nr_dsos, loader->nr_threads);
+	return loader;
+
+out_wait:
+	/* not fatal, symbols are loaded as the samples hit them */
+	symbol_loader__wait(loader);
+	return NULL;
+}
+
 int perf_session__process_events(struct perf_session *session)
 {
 	u64 size = perf_data_file__size(session->file);
+	struct symbol_loader *loader = NULL;
 	int err;
 
 	if (perf_session__register_idle_thread(session) < 0)
 		return -ENOMEM;
 
-	if (!perf_data_file__is_pipe(session->file))
+	if (!perf_data_file__is_pipe(session->file)) {
+		if (symbol_conf.nr_load_threads > 0)
+			loader = perf_session__load_symbols(session);
+
 		err = __perf_session__process_events(session,
 						     session->header.data_offset,
 						     session->header.data_size, size);
-	else
+		symbol_loader__wait(loader);
+	} else
 		err = __perf_session__process_pipe_events(session);
 
 	return err;
@@ -116,6 +116,7 @@ struct symbol_conf {
 			hide_unresolved,
 			raw_trace,
 			report_hierarchy;
+	int		nr_load_threads;
 	const char	*vmlinux_name,
 			*kallsyms_name,
 			*source_prefix,
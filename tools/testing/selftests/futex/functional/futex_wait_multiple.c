@@ -0,0 +1,129 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ * DESCRIPTION
+ *      Test FUTEX_WAIT_MULTIPLE: -EWOULDBLOCK if any of the futex values
+ *      differs from the expected one, -ETIMEDOUT if none is woken, and the
+ *      index of the woken futex otherwise.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define NR_FUTEXES	3
+#define WOKEN		2
+#define timeout_ns	100000
+
+static futex_t futexes[NR_FUTEXES];
+static struct futex_wait_block blocks[NR_FUTEXES];
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *waiterfn(void *arg)
+{
+	long res;
+
+	res = futex_wait_multiple(blocks, NR_FUTEXES, NULL, FUTEX_PRIVATE_FLAG);
+	if (res < 0)
+		res = -errno;
+
+	return (void *)res;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec to = {.tv_sec = 0, .tv_nsec = timeout_ns};
+	int res, ret = RET_PASS;
+	pthread_t waiter;
+	void *woken;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Test FUTEX_WAIT_MULTIPLE\n", basename(argv[0]));
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		blocks[i].uaddr = (unsigned long)&futexes[i];
+		blocks[i].val = futexes[i];
+		blocks[i].bitset = ~0;
+	}
+
+	info("Calling futex_wait_multiple with a mismatched value\n");
+	blocks[1].val = futexes[1] + 1;
+	res = futex_wait_multiple(blocks, NR_FUTEXES, &to, FUTEX_PRIVATE_FLAG);
+	if (!res || errno != EWOULDBLOCK) {
+		fail("futex_wait_multiple returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+	blocks[1].val = futexes[1];
+
+	info("Calling futex_wait_multiple with a %dns timeout\n", timeout_ns);
+	res = futex_wait_multiple(blocks, NR_FUTEXES, &to, FUTEX_PRIVATE_FLAG);
+	if (!res || errno != ETIMEDOUT) {
+		fail("futex_wait_multiple returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	info("Waking futex %d of a waiter blocked on %d\n", WOKEN, NR_FUTEXES);
+	if (pthread_create(&waiter, NULL, waiterfn, NULL)) {
+		error("pthread_create failed\n", errno);
+		ret = RET_ERROR;
+		goto out;
+	}
+
+	/* Wake until the waiter has actually queued itself */
+	while ((res = futex_wake(&futexes[WOKEN], 1, FUTEX_PRIVATE_FLAG)) == 0)
+		usleep(1000);
+	if (res < 0) {
+		error("futex_wake failed\n", errno);
+		ret = RET_ERROR;
+	}
+
+	pthread_join(waiter, &woken);
+	if ((long)woken != WOKEN) {
+		fail("futex_wait_multiple returned %ld instead of %d\n",
+		     (long)woken, WOKEN);
+		ret = RET_FAIL;
+	}
+
+out:
+	print_result(ret);
+	return ret;
+}
@@ -50,6 +50,14 @@ typedef volatile u_int32_t futex_t;
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 #endif
+#ifndef FUTEX_WAIT_MULTIPLE
+#define FUTEX_WAIT_MULTIPLE		13
+struct futex_wait_block {
+	u_int64_t	uaddr;
+	u_int32_t	val;
+	u_int32_t	bitset;
+};
+#endif
 
 /**
  * futex() - SYS_futex syscall wrapper
@@ -117,6 +125,22 @@ futex_wake_bitset(futex_t *uaddr, int nr_wake, u_int32_t bitset, int opflags)
 		     opflags);
 }
 
+/**
+ * futex_wait_multiple() - block on several futexes with optional timeout
+ * @blocks:	the futexes, their expected values and bitsets
+ * @count:	the number of futexes
+ * @timeout:	relative timeout
+ *
+ * Returns the index of the futex that was woken.
+ */
+static inline int
+futex_wait_multiple(struct futex_wait_block *blocks, int count,
+		    struct timespec *timeout, int opflags)
+{
+	return futex(blocks, FUTEX_WAIT_MULTIPLE, count, timeout, NULL, 0,
+		     opflags);
+}
+
 /**
  * futex_lock_pi() - block on uaddr as a PI mutex
  * @detect:	whether (1) or not (0) to perform deadlock detection
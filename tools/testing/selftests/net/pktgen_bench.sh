@@ -0,0 +1,161 @@
+#!/bin/sh
+# Receive and transmit path microbenchmark driven by pktgen.
+#
+# pktgen injects packets at different points of the stack inside a private
+# network namespace and the per packet cost of each run is reported.  The
+# difference between two runs that only differ in one stage is the cost of
+# that stage:
+#
+#   veth:  rx       netif_receive_skb(), dropped as PACKET_OTHERHOST
+#          gro      napi_gro_receive() on top of rx
+#          ip       IP input, routing and UDP lookup miss on top of rx
+#          socket   UDP enqueue on a socket drained by udp_sink
+#          xmit     dev_queue_xmit() over veth, noqueue, into the peer
+#          qdisc    the same with a pfifo qdisc on the veth
+#   lo:    ip       netif_receive_skb() of local traffic, no socket
+#          socket   the same with a bound and drained socket
+#          xmit     dev_queue_xmit() over loopback to that socket
+#
+# Numbers are for a single pktgen thread on one CPU, run it on an idle
+# machine and compare runs of the same kernel configuration only.
+#
+# Usage: pktgen_bench.sh [packet count]
+
+COUNT=${1:-1000000}
+NS=pktgen_bench
+PG=/proc/net/pktgen
+PORT_CLOSED=9
+PORT_SINK=7777
+SINK_PID=
+
+if [ $(id -u) != 0 ]; then
+	echo "pktgen_bench: must be run as root" >&2
+	exit 0
+fi
+
+if ! /sbin/modprobe -q pktgen || ! /sbin/modprobe -q veth; then
+	echo "pktgen_bench: pktgen or veth not available [SKIP]"
+	exit 0
+fi
+
+cleanup()
+{
+	[ -n "$SINK_PID" ] && kill $SINK_PID 2>/dev/null
+	ip netns del $NS 2>/dev/null
+}
+trap cleanup EXIT
+
+run()
+{
+	ip netns exec $NS "$@"
+}
+
+pgset()
+{
+	run sh -c "echo '$2' > $PG/$1"
+	if ! run grep -q "^Result: OK" $PG/$1; then
+		echo "pktgen_bench: '$2' to $1 failed:" >&2
+		run grep "^Result:" $PG/$1 >&2
+		exit 1
+	fi
+}
+
+sink_start()
+{
+	run ./udp_sink $1 $PORT_SINK &
+	SINK_PID=$!
+	sleep 1
+}
+
+sink_stop()
+{
+	kill $SINK_PID
+	wait $SINK_PID 2>/dev/null
+	SINK_PID=
+}
+
+# bench <label> <dev> <xmit_mode> <src> <dst> <dst_mac> <udp port>
+# Prints the label and ns/packet, and leaves ns/packet in $NSPP.
+bench()
+{
+	pgset kpktgend_0 "rem_device_all"
+	pgset kpktgend_0 "add_device $2"
+	pgset $2 "count $COUNT"
+	pgset $2 "pkt_size 64"
+	pgset $2 "delay 0"
+	pgset $2 "flag NO_TIMESTAMP"
+	pgset $2 "src_min $4"
+	pgset $2 "src_max $4"
+	pgset $2 "dst $5"
+	pgset $2 "dst_mac $6"
+	pgset $2 "udp_dst_min $7"
+	pgset $2 "udp_dst_max $7"
+	pgset $2 "xmit_mode $3"
+
+	run sh -c "echo start > $PG/pgctrl"
+
+	pps=$(run sed -n 's/^ *\([0-9]*\)pps.*/\1/p' $PG/$2)
+	if [ -z "$pps" ] || [ "$pps" -eq 0 ]; then
+		echo "pktgen_bench: $1: no result" >&2
+		run cat $PG/$2 >&2
+		exit 1
+	fi
+	NSPP=$((1000000000 / pps))
+	printf "  %-24s %8d pps %6d ns/pkt\n" "$1" $pps $NSPP
+}
+
+delta()
+{
+	printf "  %-24s %6d ns/pkt\n" "$1" $(($2 - $3))
+}
+
+ip netns add $NS || exit 1
+run ip link set lo up
+run ip link add veth0 type veth peer name veth1 || exit 1
+run ip link set veth0 up
+run ip link set veth1 up
+run ip addr add 10.11.0.2/24 dev veth1
+MAC=$(run cat /sys/class/net/veth1/address)
+OTHER=02:00:00:00:00:01
+
+echo "veth, $COUNT packets per run"
+bench "rx" veth1 netif_receive 10.11.0.1 10.11.0.2 $OTHER $PORT_CLOSED
+RX=$NSPP
+bench "rx + gro" veth1 gro_receive 10.11.0.1 10.11.0.2 $OTHER $PORT_CLOSED
+GRO=$NSPP
+bench "rx + ip" veth1 netif_receive 10.11.0.1 10.11.0.2 $MAC $PORT_CLOSED
+IP=$NSPP
+sink_start 10.11.0.2
+bench "rx + ip + socket" veth1 netif_receive 10.11.0.1 10.11.0.2 $MAC $PORT_SINK
+SOCK=$NSPP
+sink_stop
+bench "xmit" veth0 queue_xmit 10.11.0.1 10.11.0.2 $OTHER $PORT_CLOSED
+XMIT=$NSPP
+run tc qdisc add dev veth0 root pfifo limit 1000
+bench "xmit + qdisc" veth0 queue_xmit 10.11.0.1 10.11.0.2 $OTHER $PORT_CLOSED
+QDISC=$NSPP
+run tc qdisc del dev veth0 root
+
+echo "veth, per stage"
+delta "gro" $GRO $RX
+delta "ip" $IP $RX
+delta "socket enqueue" $SOCK $IP
+delta "qdisc" $QDISC $XMIT
+
+echo "loopback, $COUNT packets per run"
+LOMAC=00:00:00:00:00:00
+bench "rx + ip" lo netif_receive 127.0.0.1 127.0.0.1 $LOMAC $PORT_CLOSED
+IP=$NSPP
+sink_start 127.0.0.1
+bench "rx + ip + socket" lo netif_receive 127.0.0.1 127.0.0.1 $LOMAC $PORT_SINK
+SOCK=$NSPP
+bench "xmit + rx + ip + socket" lo queue_xmit 127.0.0.1 127.0.0.1 $LOMAC \
+	$PORT_SINK
+XMIT=$NSPP
+sink_stop
+
+echo "loopback, per stage"
+delta "socket enqueue" $SOCK $IP
+delta "xmit" $XMIT $SOCK
+
+exit 0
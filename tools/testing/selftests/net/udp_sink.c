@@ -0,0 +1,52 @@
+/*
+ * Bind a UDP socket and drain it until killed, so that packets sent to it
+ * are actually enqueued instead of being dropped on a full receive buffer.
+ * Used by pktgen_bench.sh to time socket enqueue.
+ *
+ * Usage: udp_sink <ipv4 address> <port>
+ */
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	char buf[2048];
+	int fd, opt;
+
+	if (argc != 3)
+		error(1, 0, "usage: %s <ipv4 address> <port>", argv[0]);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(argv[2]));
+	if (inet_pton(AF_INET, argv[1], &addr.sin_addr) != 1)
+		error(1, 0, "bad address: %s", argv[1]);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+
+	opt = 1 << 22;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) &&
+	    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)))
+		error(1, errno, "setsockopt SO_RCVBUF");
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+
+	for (;;) {
+		if (recv(fd, buf, sizeof(buf), 0) < 0 && errno != EINTR)
+			error(1, errno, "recv");
+	}
+
+	return 0;
+}
@@ -99,6 +99,7 @@ struct kmem_cache *kvm_vcpu_cache;
 EXPORT_SYMBOL_GPL(kvm_vcpu_cache);
 
 static __read_mostly struct preempt_ops kvm_preempt_ops;
+static DEFINE_PER_CPU(struct kvm_vcpu *, kvm_running_vcpu);
 
 struct dentry *kvm_debugfs_dir;
 EXPORT_SYMBOL_GPL(kvm_debugfs_dir);
@@ -143,6 +144,7 @@ int vcpu_load(struct kvm_vcpu *vcpu)
 	if (mutex_lock_killable(&vcpu->mutex))
 		return -EINTR;
 	cpu = get_cpu();
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	preempt_notifier_register(&vcpu->preempt_notifier);
 	kvm_arch_vcpu_load(vcpu, cpu);
 	put_cpu();
@@ -154,6 +156,7 @@ void vcpu_put(struct kvm_vcpu *vcpu)
 	preempt_disable();
 	kvm_arch_vcpu_put(vcpu);
 	preempt_notifier_unregister(&vcpu->preempt_notifier);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 	preempt_enable();
 	mutex_unlock(&vcpu->mutex);
 }
@@ -253,11 +256,20 @@ int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id)
 	kvm_vcpu_set_dy_eligible(vcpu, false);
 	vcpu->preempted = false;
 
+	if (kvm->dirty_ring_size) {
+		r = kvm_dirty_ring_alloc(&vcpu->dirty_ring,
+					 kvm->dirty_ring_size);
+		if (r)
+			goto fail_free_run;
+	}
+
 	r = kvm_arch_vcpu_init(vcpu);
 	if (r < 0)
-		goto fail_free_run;
+		goto fail_free_ring;
 	return 0;
 
+fail_free_ring:
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 fail_free_run:
 	free_page((unsigned long)vcpu->run);
 fail:
@@ -269,6 +281,7 @@ void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 {
 	put_pid(vcpu->pid);
 	kvm_arch_vcpu_uninit(vcpu);
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 	free_page((unsigned long)vcpu->run);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_uninit);
@@ -617,6 +630,7 @@ static struct kvm *kvm_create_vm(unsigned long type)
 	mutex_init(&kvm->slots_lock);
 	atomic_set(&kvm->users_count, 1);
 	INIT_LIST_HEAD(&kvm->devices);
+	kvm->max_halt_poll_ns = READ_ONCE(halt_poll_ns);
 
 	r = kvm_arch_init_vm(kvm, type);
 	if (r)
@@ -1138,6 +1152,9 @@ EXPORT_SYMBOL_GPL(kvm_get_dirty_log);
  * the snapshot taken before and step 4 ensures that writes done after
  * exiting to userspace will be logged for the next call.
  *
+ * With KVM_CAP_MANUAL_DIRTY_LOG_PROTECT, steps 1 and 2 are left to
+ * kvm_clear_dirty_log_protect() and the bitmap is copied as is; *is_dirty
+ * is left false since there is nothing to flush.
  */
 int kvm_get_dirty_log_protect(struct kvm *kvm,
 			struct kvm_dirty_log *log, bool *is_dirty)
@@ -1164,12 +1181,17 @@ int kvm_get_dirty_log_protect(struct kvm *kvm,
 		goto out;
 
 	n = kvm_dirty_bitmap_bytes(memslot);
+	*is_dirty = false;
+
+	if (kvm->manual_dirty_log_protect) {
+		dirty_bitmap_buffer = dirty_bitmap;
+		goto copy;
+	}
 
 	dirty_bitmap_buffer = dirty_bitmap + n / sizeof(long);
 	memset(dirty_bitmap_buffer, 0, n);
 
 	spin_lock(&kvm->mmu_lock);
-	*is_dirty = false;
 	for (i = 0; i < n / sizeof(long); i++) {
 		unsigned long mask;
 		gfn_t offset;
@@ -1191,6 +1213,7 @@ int kvm_get_dirty_log_protect(struct kvm *kvm,
 
 	spin_unlock(&kvm->mmu_lock);
 
+copy:
 	r = -EFAULT;
 	if (copy_to_user(log->dirty_bitmap, dirty_bitmap_buffer, n))
 		goto out;
@@ -1200,6 +1223,92 @@ out:
 	return r;
 }
 EXPORT_SYMBOL_GPL(kvm_get_dirty_log_protect);
+
+/**
+ * kvm_clear_dirty_log_protect - clear dirty bits in the bitmap and write
+ *	protect the pages again, for a range of a slot
+ * @kvm:	pointer to kvm instance
+ * @log:	slot id, range and userspace bitmap of the pages to clear
+ * @flush:	flag set if any page was write protected
+ *
+ * Only the pages that are set in both the userspace bitmap and the slot
+ * bitmap are cleared and write protected, so that pages dirtied again
+ * since KVM_GET_DIRTY_LOG stay dirty. The mmu_lock is held for the range
+ * only, which lets userspace keep the hold times short by clearing large
+ * slots in chunks. The range must start on a multiple of 64 pages and, but
+ * at the end of the slot, span a multiple of 64 pages. The caller flushes
+ * the TLBs if needed.
+ */
+int kvm_clear_dirty_log_protect(struct kvm *kvm,
+				struct kvm_clear_dirty_log *log, bool *flush)
+{
+	struct kvm_memslots *slots;
+	struct kvm_memory_slot *memslot;
+	int as_id, id;
+	gfn_t offset;
+	unsigned long i, n;
+	unsigned long *dirty_bitmap;
+	unsigned long *dirty_bitmap_buffer;
+
+	as_id = log->slot >> 16;
+	id = (u16)log->slot;
+	if (as_id >= KVM_ADDRESS_SPACE_NUM || id >= KVM_USER_MEM_SLOTS)
+		return -EINVAL;
+
+	if (log->first_page & 63)
+		return -EINVAL;
+
+	slots = __kvm_memslots(kvm, as_id);
+	memslot = id_to_memslot(slots, id);
+
+	dirty_bitmap = memslot->dirty_bitmap;
+	if (!dirty_bitmap)
+		return -ENOENT;
+
+	if (log->first_page > memslot->npages ||
+	    log->num_pages > memslot->npages - log->first_page ||
+	    (log->num_pages < memslot->npages - log->first_page &&
+	     (log->num_pages & 63)))
+		return -EINVAL;
+
+	*flush = false;
+	n = ALIGN(log->num_pages, BITS_PER_LONG) / 8;
+	dirty_bitmap_buffer = dirty_bitmap + kvm_dirty_bitmap_bytes(memslot) /
+					     sizeof(long);
+	if (copy_from_user(dirty_bitmap_buffer, log->dirty_bitmap, n))
+		return -EFAULT;
+
+	spin_lock(&kvm->mmu_lock);
+	offset = log->first_page;
+	for (i = offset / BITS_PER_LONG; n; i++, n -= sizeof(long)) {
+		unsigned long mask = *dirty_bitmap_buffer++;
+		unsigned long old;
+
+		if (mask) {
+			do {
+				old = READ_ONCE(dirty_bitmap[i]);
+			} while (cmpxchg(&dirty_bitmap[i], old,
+					 old & ~mask) != old);
+
+			/*
+			 * Only the bits that were really cleared; this never
+			 * includes the bits past the end of the slot, which
+			 * userspace may have set.
+			 */
+			mask &= old;
+			if (mask) {
+				*flush = true;
+				kvm_arch_mmu_enable_log_dirty_pt_masked(kvm,
+						memslot, offset, mask);
+			}
+		}
+		offset += BITS_PER_LONG;
+	}
+	spin_unlock(&kvm->mmu_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(kvm_clear_dirty_log_protect);
 #endif
 
 bool kvm_largepages_enabled(void)
@@ -1989,12 +2098,64 @@ int kvm_clear_guest(struct kvm *kvm, gpa_t gpa, unsigned long len)
 }
 EXPORT_SYMBOL_GPL(kvm_clear_guest);
 
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+static int kvm_memslot_as_id(struct kvm *kvm, struct kvm_memory_slot *memslot)
+{
+	struct kvm_memslots *slots;
+	int i;
+
+	for (i = 0; i < KVM_ADDRESS_SPACE_NUM; i++) {
+		slots = __kvm_memslots(kvm, i);
+		if (memslot >= slots->memslots &&
+		    memslot < slots->memslots + KVM_MEM_SLOTS_NUM)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Pages dirtied by a vCPU of a VM using dirty rings go to the ring of that
+ * vCPU. The others, e.g. written by device emulation in another thread,
+ * still go to the memslot bitmap.
+ */
+static bool kvm_dirty_ring_mark_page(struct kvm_memory_slot *memslot,
+				     unsigned long rel_gfn)
+{
+	struct kvm_vcpu *vcpu;
+	int as_id;
+
+	/* the ring has a single producer, the task running the vCPU */
+	if (in_interrupt())
+		return false;
+
+	vcpu = this_cpu_read(kvm_running_vcpu);
+	if (!vcpu || !vcpu->dirty_ring.dirty_gfns)
+		return false;
+
+	as_id = kvm_memslot_as_id(vcpu->kvm, memslot);
+	if (as_id < 0)
+		return false;
+
+	return kvm_dirty_ring_push(&vcpu->dirty_ring,
+				   (as_id << 16) | memslot->id, rel_gfn);
+}
+#else
+static inline bool kvm_dirty_ring_mark_page(struct kvm_memory_slot *memslot,
+					    unsigned long rel_gfn)
+{
+	return false;
+}
+#endif
+
 static void mark_page_dirty_in_slot(struct kvm_memory_slot *memslot,
 				    gfn_t gfn)
 {
 	if (memslot && memslot->dirty_bitmap) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
 
+		if (kvm_dirty_ring_mark_page(memslot, rel_gfn))
+			return;
 		set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
 }
@@ -2017,7 +2178,7 @@ void kvm_vcpu_mark_page_dirty(struct kvm_vcpu *vcpu, gfn_t gfn)
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_mark_page_dirty);
 
-static void grow_halt_poll_ns(struct kvm_vcpu *vcpu)
+static void grow_halt_poll_ns(struct kvm_vcpu *vcpu, unsigned int max)
 {
 	unsigned int old, val, grow;
 
@@ -2029,8 +2190,8 @@ static void grow_halt_poll_ns(struct kvm_vcpu *vcpu)
 	else
 		val *= grow;
 
-	if (val > halt_poll_ns)
-		val = halt_poll_ns;
+	if (val > max)
+		val = max;
 
 	vcpu->halt_poll_ns = val;
 	trace_kvm_halt_poll_ns_grow(vcpu->vcpu_id, val, old);
@@ -2065,17 +2226,37 @@ static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
 	return 0;
 }
 
+/*
+ * Polling only pays off while this vCPU has the CPU to itself; give up as
+ * soon as anything else wants to run here.
+ */
+static bool kvm_vcpu_can_poll(ktime_t cur, ktime_t stop)
+{
+	return single_task_running() && !need_resched() &&
+	       ktime_before(cur, stop);
+}
+
+static void update_halt_poll_stats(struct kvm_vcpu *vcpu, u64 poll_ns,
+				   bool waited)
+{
+	if (waited)
+		vcpu->stat.halt_poll_fail_ns += poll_ns;
+	else
+		vcpu->stat.halt_poll_success_ns += poll_ns;
+}
+
 /*
  * The vCPU has executed a HLT instruction with in-kernel mode enabled.
  */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
-	ktime_t start, cur;
+	unsigned int max_halt_poll_ns = READ_ONCE(vcpu->kvm->max_halt_poll_ns);
+	ktime_t start, cur, poll_end;
 	DECLARE_SWAITQUEUE(wait);
 	bool waited = false;
 	u64 block_ns;
 
-	start = cur = ktime_get();
+	start = cur = poll_end = ktime_get();
 	if (vcpu->halt_poll_ns) {
 		ktime_t stop = ktime_add_ns(ktime_get(), vcpu->halt_poll_ns);
 
@@ -2091,8 +2272,8 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 					++vcpu->stat.halt_poll_invalid;
 				goto out;
 			}
-			cur = ktime_get();
-		} while (single_task_running() && ktime_before(cur, stop));
+			poll_end = cur = ktime_get();
+		} while (kvm_vcpu_can_poll(cur, stop));
 	}
 
 	kvm_arch_vcpu_blocking(vcpu);
@@ -2113,19 +2294,24 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 	kvm_arch_vcpu_unblocking(vcpu);
 out:
 	block_ns = ktime_to_ns(cur) - ktime_to_ns(start);
+	/* on a successful poll, cur is where polling stopped */
+	if (!waited)
+		poll_end = cur;
+	update_halt_poll_stats(vcpu, ktime_to_ns(ktime_sub(poll_end, start)),
+			       waited);
 
 	if (!vcpu_valid_wakeup(vcpu))
 		shrink_halt_poll_ns(vcpu);
-	else if (halt_poll_ns) {
+	else if (max_halt_poll_ns) {
 		if (block_ns <= vcpu->halt_poll_ns)
 			;
 		/* we had a long block, shrink polling */
-		else if (vcpu->halt_poll_ns && block_ns > halt_poll_ns)
+		else if (vcpu->halt_poll_ns && block_ns > max_halt_poll_ns)
 			shrink_halt_poll_ns(vcpu);
 		/* we had a short halt and our poll time is too small */
-		else if (vcpu->halt_poll_ns < halt_poll_ns &&
-			block_ns < halt_poll_ns)
-			grow_halt_poll_ns(vcpu);
+		else if (vcpu->halt_poll_ns < max_halt_poll_ns &&
+			block_ns < max_halt_poll_ns)
+			grow_halt_poll_ns(vcpu, max_halt_poll_ns);
 	} else
 		vcpu->halt_poll_ns = 0;
 
@@ -2277,6 +2463,17 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_on_spin);
 
+static bool kvm_page_in_dirty_ring(struct kvm *kvm, unsigned long pgoff)
+{
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	return pgoff >= KVM_DIRTY_LOG_PAGE_OFFSET &&
+	       pgoff < KVM_DIRTY_LOG_PAGE_OFFSET +
+		       kvm->dirty_ring_size / PAGE_SIZE;
+#else
+	return false;
+#endif
+}
+
 static int kvm_vcpu_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct kvm_vcpu *vcpu = vma->vm_file->private_data;
@@ -2292,6 +2489,9 @@ static int kvm_vcpu_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	else if (vmf->pgoff == KVM_COALESCED_MMIO_PAGE_OFFSET)
 		page = virt_to_page(vcpu->kvm->coalesced_mmio_ring);
 #endif
+	else if (kvm_page_in_dirty_ring(vcpu->kvm, vmf->pgoff))
+		page = kvm_dirty_ring_get_page(&vcpu->dirty_ring,
+				vmf->pgoff - KVM_DIRTY_LOG_PAGE_OFFSET);
 	else
 		return kvm_arch_vcpu_fault(vcpu, vmf);
 	get_page(page);
@@ -2305,6 +2505,15 @@ static const struct vm_operations_struct kvm_vcpu_vm_ops = {
 
 static int kvm_vcpu_mmap(struct file *file, struct vm_area_struct *vma)
 {
+	struct kvm_vcpu *vcpu = file->private_data;
+	unsigned long pages = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+
+	/* the ring is only useful if userspace and KVM see the same pages */
+	if ((kvm_page_in_dirty_ring(vcpu->kvm, vma->vm_pgoff) ||
+	     kvm_page_in_dirty_ring(vcpu->kvm, vma->vm_pgoff + pages - 1)) &&
+	    !(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
 	vma->vm_ops = &kvm_vcpu_vm_ops;
 	return 0;
 }
@@ -2369,6 +2578,12 @@ static int kvm_vm_ioctl_create_vcpu(struct kvm *kvm, u32 id)
 		r = -EEXIST;
 		goto unlock_vcpu_destroy;
 	}
+	/* raced with KVM_CAP_DIRTY_LOG_RING being enabled */
+	if (vcpu->dirty_ring.size * sizeof(struct kvm_dirty_gfn) !=
+	    kvm->dirty_ring_size) {
+		r = -EINVAL;
+		goto unlock_vcpu_destroy;
+	}
 
 	BUG_ON(kvm->vcpus[atomic_read(&kvm->online_vcpus)]);
 
@@ -2819,12 +3034,102 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #endif
 	case KVM_CAP_MAX_VCPU_ID:
 		return KVM_MAX_VCPU_ID;
+	case KVM_CAP_HALT_POLL:
+		return 1;
+#ifdef CONFIG_KVM_GENERIC_DIRTYLOG_READ_PROTECT
+	case KVM_CAP_MANUAL_DIRTY_LOG_PROTECT:
+		return 1;
+#endif
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_CAP_DIRTY_LOG_RING:
+		return KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn);
+#endif
 	default:
 		break;
 	}
 	return kvm_vm_ioctl_check_extension(kvm, arg);
 }
 
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+static int kvm_vm_ioctl_enable_dirty_log_ring(struct kvm *kvm, u64 size)
+{
+	int r;
+
+	if (!size || (size & (size - 1)))
+		return -EINVAL;
+
+	/* room for the reserved entries, and a whole number of pages */
+	if (size < KVM_DIRTY_RING_RSVD_ENTRIES * sizeof(struct kvm_dirty_gfn) ||
+	    size < PAGE_SIZE)
+		return -EINVAL;
+
+	if (size > KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn))
+		return -E2BIG;
+
+	mutex_lock(&kvm->lock);
+	/* the rings are allocated along with the vCPUs, and only once */
+	if (kvm->dirty_ring_size || atomic_read(&kvm->online_vcpus))
+		r = -EINVAL;
+	else {
+		kvm->dirty_ring_size = size;
+		r = 0;
+	}
+	mutex_unlock(&kvm->lock);
+
+	return r;
+}
+
+static int kvm_vm_ioctl_reset_dirty_pages(struct kvm *kvm)
+{
+	struct kvm_vcpu *vcpu;
+	int i, cleared = 0;
+
+	if (!kvm->dirty_ring_size)
+		return -EINVAL;
+
+	mutex_lock(&kvm->slots_lock);
+
+	kvm_for_each_vcpu(i, vcpu, kvm)
+		cleared += kvm_dirty_ring_reset(kvm, &vcpu->dirty_ring);
+
+	/* writes to the harvested pages must fault again from now on */
+	if (cleared)
+		kvm_flush_remote_tlbs(kvm);
+
+	mutex_unlock(&kvm->slots_lock);
+
+	return cleared;
+}
+#endif
+
+static int kvm_vm_ioctl_enable_cap_generic(struct kvm *kvm,
+					   struct kvm_enable_cap *cap)
+{
+	if (cap->flags)
+		return -EINVAL;
+
+	switch (cap->cap) {
+	case KVM_CAP_HALT_POLL:
+		if (cap->args[0] != (unsigned int)cap->args[0])
+			return -EINVAL;
+		WRITE_ONCE(kvm->max_halt_poll_ns, cap->args[0]);
+		return 0;
+#ifdef CONFIG_KVM_GENERIC_DIRTYLOG_READ_PROTECT
+	case KVM_CAP_MANUAL_DIRTY_LOG_PROTECT:
+		if (cap->args[0] & ~1ULL)
+			return -EINVAL;
+		kvm->manual_dirty_log_protect = cap->args[0];
+		return 0;
+#endif
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_CAP_DIRTY_LOG_RING:
+		return kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap->args[0]);
+#endif
+	default:
+		return -EINVAL;
+	}
+}
+
 static long kvm_vm_ioctl(struct file *filp,
 			   unsigned int ioctl, unsigned long arg)
 {
@@ -2858,6 +3163,43 @@ static long kvm_vm_ioctl(struct file *filp,
 		r = kvm_vm_ioctl_get_dirty_log(kvm, &log);
 		break;
 	}
+#ifdef CONFIG_KVM_GENERIC_DIRTYLOG_READ_PROTECT
+	case KVM_CLEAR_DIRTY_LOG: {
+		struct kvm_clear_dirty_log log;
+
+		r = -EFAULT;
+		if (copy_from_user(&log, argp, sizeof(log)))
+			goto out;
+		r = kvm_vm_ioctl_clear_dirty_log(kvm, &log);
+		break;
+	}
+#endif
+	case KVM_ENABLE_CAP: {
+		struct kvm_enable_cap cap;
+
+		r = -EFAULT;
+		if (copy_from_user(&cap, argp, sizeof(cap)))
+			goto out;
+		switch (cap.cap) {
+		case KVM_CAP_HALT_POLL:
+#ifdef CONFIG_KVM_GENERIC_DIRTYLOG_READ_PROTECT
+		case KVM_CAP_MANUAL_DIRTY_LOG_PROTECT:
+#endif
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+		case KVM_CAP_DIRTY_LOG_RING:
+#endif
+			r = kvm_vm_ioctl_enable_cap_generic(kvm, &cap);
+			break;
+		default:
+			r = kvm_arch_vm_ioctl(filp, ioctl, arg);
+		}
+		break;
+	}
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_RESET_DIRTY_RINGS:
+		r = kvm_vm_ioctl_reset_dirty_pages(kvm);
+		break;
+#endif
 #ifdef KVM_COALESCED_MMIO_PAGE_OFFSET
 	case KVM_REGISTER_COALESCED_MMIO: {
 		struct kvm_coalesced_mmio_zone zone;
@@ -3566,6 +3908,20 @@ static int vcpu_stat_get_per_vm(void *data, u64 *val)
 	return 0;
 }
 
+static int vcpu_stat_u64_get_per_vm(void *data, u64 *val)
+{
+	int i;
+	struct kvm_stat_data *stat_data = (struct kvm_stat_data *)data;
+	struct kvm_vcpu *vcpu;
+
+	*val = 0;
+
+	kvm_for_each_vcpu(i, vcpu, stat_data->kvm)
+		*val += *(u64 *)((void *)vcpu + stat_data->offset);
+
+	return 0;
+}
+
 static int vcpu_stat_get_per_vm_open(struct inode *inode, struct file *file)
 {
 	__simple_attr_check_format("%llu\n", 0ull);
@@ -3582,8 +3938,26 @@ static const struct file_operations vcpu_stat_get_per_vm_fops = {
 	.llseek  = generic_file_llseek,
 };
 
+static int vcpu_stat_u64_get_per_vm_open(struct inode *inode,
+					 struct file *file)
+{
+	__simple_attr_check_format("%llu\n", 0ull);
+	return kvm_debugfs_open(inode, file, vcpu_stat_u64_get_per_vm,
+				 NULL, "%llu\n");
+}
+
+static const struct file_operations vcpu_stat_u64_get_per_vm_fops = {
+	.owner   = THIS_MODULE,
+	.open    = vcpu_stat_u64_get_per_vm_open,
+	.release = kvm_debugfs_release,
+	.read    = simple_attr_read,
+	.write   = simple_attr_write,
+	.llseek  = generic_file_llseek,
+};
+
 static const struct file_operations *stat_fops_per_vm[] = {
 	[KVM_STAT_VCPU] = &vcpu_stat_get_per_vm_fops,
+	[KVM_STAT_VCPU_U64] = &vcpu_stat_u64_get_per_vm_fops,
 	[KVM_STAT_VM]   = &vm_stat_get_per_vm_fops,
 };
 
@@ -3627,8 +4001,29 @@ static int vcpu_stat_get(void *_offset, u64 *val)
 
 DEFINE_SIMPLE_ATTRIBUTE(vcpu_stat_fops, vcpu_stat_get, NULL, "%llu\n");
 
+static int vcpu_stat_u64_get(void *_offset, u64 *val)
+{
+	unsigned offset = (long)_offset;
+	struct kvm *kvm;
+	struct kvm_stat_data stat_tmp = {.offset = offset};
+	u64 tmp_val;
+
+	*val = 0;
+	spin_lock(&kvm_lock);
+	list_for_each_entry(kvm, &vm_list, vm_list) {
+		stat_tmp.kvm = kvm;
+		vcpu_stat_u64_get_per_vm((void *)&stat_tmp, &tmp_val);
+		*val += tmp_val;
+	}
+	spin_unlock(&kvm_lock);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(vcpu_stat_u64_fops, vcpu_stat_u64_get, NULL, "%llu\n");
+
 static const struct file_operations *stat_fops[] = {
 	[KVM_STAT_VCPU] = &vcpu_stat_fops,
+	[KVM_STAT_VCPU_U64] = &vcpu_stat_u64_fops,
 	[KVM_STAT_VM]   = &vm_stat_fops,
 };
 
@@ -3690,6 +4085,7 @@ static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 	if (vcpu->preempted)
 		vcpu->preempted = false;
 
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	kvm_arch_sched_in(vcpu, cpu);
 
 	kvm_arch_vcpu_load(vcpu, cpu);
@@ -3703,6 +4099,7 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 	if (current->state == TASK_RUNNING)
 		vcpu->preempted = true;
 	kvm_arch_vcpu_put(vcpu);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 }
 
 int kvm_init(void *opaque, unsigned vcpu_size, unsigned vcpu_align,